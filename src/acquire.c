@@ -61,8 +61,22 @@ typedef struct {
   gboolean creating_new_layer;
   VikTrwLayer *vtl;
   DownloadFileOptions *options;
+  GList *parts; // of acquire_part_t, when the datasource splits the work up
+  guint parts_total;
+  guint parts_done;
+  guint parts_ok;
 } w_and_interface_t;
 
+/* one independent piece of a split acquire */
+typedef struct {
+  w_and_interface_t *wi;
+  ProcessOptions *po;
+  VikTrwLayer *vtl; // Temporary layer the part is read into
+} acquire_part_t;
+
+// How many parts of a split acquire are fetched at once
+#define ACQUIRE_PART_THREADS 4
+
 
 /*********************************************************
  * Definitions and routines for acquiring data from Data Sources in general
@@ -114,6 +128,12 @@ static void on_complete_process (w_and_interface_t *wi)
     // Main display update
     if ( wi->vtl ) {
       vik_layer_post_read ( VIK_LAYER(wi->vtl), wi->w->vvp, TRUE );
+      // After the post read, as that may tidy up the new tracks the same as the existing ones were
+      gchar *report = vik_trw_layer_import_end ( wi->vtl );
+      if ( report ) {
+        a_dialog_info_msg_extra ( GTK_WINDOW(wi->w->vw), "%s", report );
+        g_free ( report );
+      }
       // View this data if desired - must be done after post read (so that the bounds are known)
       if ( wi->w->source_interface->autoview ) {
 	vik_trw_layer_auto_set_view ( wi->vtl, vik_layers_panel_get_viewport(wi->w->vlp) );
@@ -140,6 +160,140 @@ static void free_process_options ( ProcessOptions *po )
   }
 }
 
+/**
+ * Each item is identified by its name and where it is,
+ *  so the overlap fetched by neighbouring parts is only kept once
+ */
+static gchar *acquire_waypoint_key ( const gchar *name, VikWaypoint *wp )
+{
+  return g_strdup_printf ( "%s|%.7f|%.7f", name ? name : "", wp->coord.north_south, wp->coord.east_west );
+}
+
+static gchar *acquire_track_key ( const gchar *name, VikTrack *trk )
+{
+  VikTrackpoint *first = vik_track_get_tp_first ( trk );
+  VikTrackpoint *last = vik_track_get_tp_last ( trk );
+  if ( !first || !last )
+    return g_strdup_printf ( "%s|0", name ? name : "" );
+  // NB a missing timestamp is printed as "nan", which is consistent enough here
+  return g_strdup_printf ( "%s|%lu|%.7f|%.7f|%.3f|%.7f|%.7f|%.3f", name ? name : "", vik_track_get_tp_count(trk),
+                           first->coord.north_south, first->coord.east_west, first->timestamp,
+                           last->coord.north_south, last->coord.east_west, last->timestamp );
+}
+
+static void acquire_merge_tracks ( VikTrwLayer *vtl, GHashTable *target, GHashTable *source, gboolean routes )
+{
+  GHashTable *keys = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init ( &iter, target );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    g_hash_table_add ( keys, acquire_track_key ( trk->name, trk ) );
+  }
+
+  g_hash_table_iter_init ( &iter, source );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    gchar *tkey = acquire_track_key ( trk->name, trk );
+    if ( g_hash_table_contains ( keys, tkey ) ) {
+      g_free ( tkey );
+      continue;
+    }
+    g_hash_table_add ( keys, tkey );
+    VikTrack *copy = vik_track_copy ( trk, TRUE );
+    if ( routes )
+      vik_trw_layer_add_route ( vtl, g_strdup(trk->name), copy );
+    else
+      vik_trw_layer_add_track ( vtl, g_strdup(trk->name), copy );
+  }
+  g_hash_table_destroy ( keys );
+}
+
+/**
+ * Copy everything in the part layer that isn't already in the layer
+ */
+static void acquire_merge ( VikTrwLayer *vtl, VikTrwLayer *part )
+{
+  GHashTable *keys = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init ( &iter, vik_trw_layer_get_waypoints(vtl) );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikWaypoint *wp = VIK_WAYPOINT(value);
+    g_hash_table_add ( keys, acquire_waypoint_key ( wp->name, wp ) );
+  }
+
+  g_hash_table_iter_init ( &iter, vik_trw_layer_get_waypoints(part) );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikWaypoint *wp = VIK_WAYPOINT(value);
+    gchar *wkey = acquire_waypoint_key ( wp->name, wp );
+    if ( g_hash_table_contains ( keys, wkey ) ) {
+      g_free ( wkey );
+      continue;
+    }
+    g_hash_table_add ( keys, wkey );
+    vik_trw_layer_add_waypoint ( vtl, g_strdup(wp->name), vik_waypoint_copy(wp) );
+  }
+  g_hash_table_destroy ( keys );
+
+  acquire_merge_tracks ( vtl, vik_trw_layer_get_tracks(vtl), vik_trw_layer_get_tracks(part), FALSE );
+  acquire_merge_tracks ( vtl, vik_trw_layer_get_routes(vtl), vik_trw_layer_get_routes(part), TRUE );
+}
+
+/**
+ * Progress of the individual parts isn't shown - only how many have completed
+ *  (and unlike progress_func() this mustn't end the thread, as that belongs to the pool)
+ */
+static void part_progress_func ( BabelProgressCode c, gpointer data, gpointer user_data )
+{
+}
+
+static void get_part ( acquire_part_t *part, w_and_interface_t *wi )
+{
+  // Parts not yet started when cancelled are skipped
+  gboolean result = FALSE;
+  if ( wi->w->running )
+    result = wi->w->source_interface->process_func ( part->vtl, part->po, part_progress_func, wi->w, wi->options );
+
+  gdk_threads_enter();
+  if ( wi->w->running ) {
+    wi->parts_done++;
+    if ( result ) {
+      wi->parts_ok++;
+      acquire_merge ( wi->vtl, part->vtl );
+    }
+    gchar *msg = g_strdup_printf ( _("Fetched %d of %d parts"), wi->parts_done, wi->parts_total );
+    gtk_label_set_text ( GTK_LABEL(wi->w->status), msg );
+    g_free ( msg );
+  }
+  g_object_unref ( part->vtl );
+  gdk_threads_leave();
+
+  free_process_options ( part->po );
+  g_free ( part );
+}
+
+/**
+ * Fetch all the parts, several at a time
+ *
+ * Returns: Whether any part was acquired
+ */
+static gboolean get_parts ( w_and_interface_t *wi )
+{
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)get_part, wi, ACQUIRE_PART_THREADS, FALSE, NULL );
+  GList *iter;
+  for ( iter = wi->parts; iter; iter = iter->next )
+    g_thread_pool_push ( pool, iter->data, NULL );
+  // Wait for them all to finish
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  g_list_free ( wi->parts );
+  wi->parts = NULL;
+  return wi->parts_ok > 0;
+}
+
 /* this routine is the worker thread.  there is only one simultaneous download allowed */
 static void get_from_anything ( w_and_interface_t *wi )
 {
@@ -147,7 +301,10 @@ static void get_from_anything ( w_and_interface_t *wi )
 
   VikDataSourceInterface *source_interface = wi->w->source_interface;
 
-  if ( source_interface->process_func ) {
+  if ( wi->parts ) {
+    result = get_parts ( wi );
+  }
+  else if ( source_interface->process_func ) {
     result = source_interface->process_func ( wi->vtl, wi->po, (BabelStatusFunc)progress_func, wi->w, wi->options );
   }
   free_process_options ( wi->po );
@@ -305,6 +462,11 @@ static void acquire ( VikWindow *vw,
   } else if ( source_interface->get_process_options_func )
     source_interface->get_process_options_func ( pass_along_data, po, options, NULL, NULL );
 
+  // Only threaded acquires can be split up, as the parts are fetched in the background
+  GList *parts = NULL;
+  if ( source_interface->is_thread && source_interface->split_func && ( po->babelargs || po->url || po->shell_command ) )
+    parts = source_interface->split_func ( pass_along_data, po );
+
   /* Get data for Off command */
   if ( source_interface->off_func ) {
     source_interface->off_func ( pass_along_data, &args_off, &fd_off );
@@ -326,6 +488,10 @@ static void acquire ( VikWindow *vw,
   wi->options = options;
   wi->vtl = vtl;
   wi->creating_new_layer = (!vtl); // Default if Auto Layer Management is passed in
+  wi->parts = NULL;
+  wi->parts_total = g_list_length ( parts );
+  wi->parts_done = 0;
+  wi->parts_ok = 0;
 
   dialog = gtk_dialog_new_with_buttons ( "", GTK_WINDOW(vw), 0, GTK_STOCK_OK, GTK_RESPONSE_ACCEPT, GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT, NULL );
   gtk_dialog_set_response_sensitive ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT, FALSE );
@@ -370,6 +536,22 @@ static void acquire ( VikWindow *vw,
     wi->vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, w->vvp, FALSE ) );
     vik_layer_rename ( VIK_LAYER ( wi->vtl ), _(source_interface->layer_title) );
   }
+  // So tracks already there (or repeated in the data) can be spotted afterwards
+  if ( wi->vtl )
+    vik_trw_layer_import_begin ( wi->vtl );
+
+  if ( parts ) {
+    GList *iter;
+    for ( iter = parts; iter; iter = iter->next ) {
+      acquire_part_t *part = g_malloc ( sizeof(acquire_part_t) );
+      part->wi = wi;
+      part->po = iter->data;
+      part->vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, w->vvp, FALSE ) );
+      wi->parts = g_list_prepend ( wi->parts, part );
+    }
+    wi->parts = g_list_reverse ( wi->parts );
+    g_list_free ( parts );
+  }
 
   if ( source_interface->is_thread ) {
     if ( po->babelargs || po->url || po->shell_command ) {
@@ -136,6 +136,19 @@ typedef void (*VikDataSourceCleanupFunc) ( gpointer user_data );
 
 typedef void (*VikDataSourceOffFunc) ( gpointer user_data, gchar **babelargs, gchar **file_descriptor );
 
+/**
+ * VikDataSourceSplitFunc:
+ * @user_data: provided by #VikDataSourceInterface.init_func or dialog with params
+ * @process_options: the options from #VikDataSourceInterface.get_process_options_func
+ *
+ * Optionally divide one acquire into independent parts, which are then fetched at the same time
+ *  and merged into the layer as each one completes.
+ *
+ * Returns: A list of newly allocated #ProcessOptions, one per part,
+ *  or %NULL to process the original options in one go.
+ */
+typedef GList* (*VikDataSourceSplitFunc) ( gpointer user_data, ProcessOptions *process_options );
+
 /**
  * VikDataSourceInterface:
  *
@@ -173,6 +186,7 @@ struct _VikDataSourceInterface {
   gchar **                          params_groups;
   guint8                            params_groups_count;
 
+  VikDataSourceSplitFunc split_func;
 };
 
 /**********************************/
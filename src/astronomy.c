@@ -22,6 +22,7 @@
 #include "astronomy.h"
 #include <time.h>
 #include "degrees_converters.h"
+#include "trackcache.h"
 
 #ifdef HAVE_LIBNOVA_LIBNOVA_H
 #include <libnova/libnova.h>
@@ -107,6 +108,77 @@ double astro_get_daystart ( double JDin, VikCoord *vc )
 	return JDdaystart;
 }
 
+// Most levels worked out for a track, which is plenty for any graph of it
+#define SUNLIGHT_MAX_LEVELS 4096
+// But no closer together than this (seconds)
+#define SUNLIGHT_MIN_STEP 60.0
+// The Sun's position amongst the stars is taken as fixed for this long (days)
+//  moving less than 0.05 degrees meanwhile
+#define SUNLIGHT_EQU_DAYS (1.0/24.0)
+// Of the levels kept by trackcache.c - change when the results would differ
+#define SUNLIGHT_CACHE_VERSION 1
+
+/**
+ * astro_track_sunlight:
+ *
+ * Work out how light it was at even steps over the time of the track,
+ *  each as seen from where the track was at that time.
+ * Only reads the track, so this can be used on a copy of the track in another thread.
+ *
+ * Returns: NULL if the track has no times
+ */
+VikTrackSunlight *astro_track_sunlight ( const VikTrack *trk )
+{
+	gdouble first, last;
+	if ( !vik_track_get_time_span ( trk, &first, &last ) )
+		return NULL;
+
+	VikTrackSunlight *sun = g_malloc ( sizeof(VikTrackSunlight) );
+	sun->start = first;
+	sun->step = MAX ( SUNLIGHT_MIN_STEP, (last - first) / SUNLIGHT_MAX_LEVELS );
+	sun->len = (guint)ceil ( (last - first) / sun->step ) + 1;
+	sun->levels = g_new ( guint8, sun->len );
+	// The steps only depend on the time span, so these are the levels as worked out before
+	if ( a_trackcache_load ( trk, "sunlight", SUNLIGHT_CACHE_VERSION, sun->levels, sun->len ) )
+		return sun;
+
+	// NB libnova uses the mathematical long,lat ordering
+	struct ln_lnlat_posn observer = { 0.0, 0.0 };
+	struct ln_equ_posn equ;
+	double JD_equ = 0.0;
+	for ( guint ii = 0; ii < sun->len; ii++ ) {
+		gdouble timestamp = MIN ( first + ii * sun->step, last );
+		VikTrackPosition pos;
+		if ( vik_track_get_position_at_time ( trk, timestamp, TRUE, &pos ) ) {
+			struct LatLon ll;
+			vik_coord_to_latlon ( &pos.coord, &ll );
+			observer.lng = ll.lon;
+			observer.lat = ll.lat;
+		}
+		time_t tt = timestamp; // no need to round
+		double JD = ln_get_julian_from_timet ( &tt );
+		if ( ii == 0 || fabs(JD - JD_equ) > SUNLIGHT_EQU_DAYS ) {
+			ln_get_solar_equ_coords ( JD, &equ );
+			JD_equ = JD;
+		}
+		struct ln_hrz_posn hrz;
+		ln_get_hrz_from_equ ( &equ, &observer, JD, &hrz );
+
+		if ( hrz.alt > LN_SOLAR_STANDART_HORIZON )
+			sun->levels[ii] = VIK_SUNLIGHT_DAY;
+		else if ( hrz.alt > LN_SOLAR_CIVIL_HORIZON )
+			sun->levels[ii] = VIK_SUNLIGHT_CIVIL_TWILIGHT;
+		else if ( hrz.alt > LN_SOLAR_NAUTIC_HORIZON )
+			sun->levels[ii] = VIK_SUNLIGHT_NAUTICAL_TWILIGHT;
+		else if ( hrz.alt > LN_SOLAR_ASTRONOMICAL_HORIZON )
+			sun->levels[ii] = VIK_SUNLIGHT_ASTRONOMICAL_TWILIGHT;
+		else
+			sun->levels[ii] = VIK_SUNLIGHT_NIGHT;
+	}
+	a_trackcache_save ( trk, "sunlight", SUNLIGHT_CACHE_VERSION, sun->levels, sun->len );
+	return sun;
+}
+
 // Free string after use
 static gchar *time_string_for_julian ( double JD, const VikCoord* vc, const gchar *tz )
 {
@@ -32,6 +32,8 @@ double astro_get_daystart ( double JDin, VikCoord *vc );
 
 GtkWidget *astro_info ( time_t att, VikCoord* vc, gboolean reset_for_day_beginning );
 
+VikTrackSunlight *astro_track_sunlight ( const VikTrack *trk );
+
 #endif
 
 G_END_DECLS
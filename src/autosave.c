@@ -0,0 +1,313 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Autosave
+ *
+ * Between full saves, the layers that have changed are snapshotted
+ *  via the same marshalling as used for copy and paste.
+ * This is an in memory copy, so is quick enough to do on the main thread whatever the workspace size,
+ *  whereas appending the snapshots to a journal file is done by a background thread.
+ *
+ * The journal starts with JOURNAL_MAGIC, followed by records of:
+ *  gint64 time (microseconds), guint64 layer id, guint32 length, marshalled layer
+ * A later record for the same layer supersedes an earlier one.
+ * A full save of the workspace contains everything, after which the journal is simply removed.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include "autosave.h"
+#include "dir.h"
+#include "fileutils.h"
+
+#define JOURNAL_MAGIC "VIKJOURNAL1\n"
+#define JOURNAL_DIR "autosave"
+#define JOURNAL_EXT ".vikj"
+#define UNTITLED_PREFIX "untitled-"
+
+typedef struct {
+  guint64 id;
+  guint8 *data;
+  guint len;
+} AutosaveRecord;
+
+typedef struct {
+  gchar *journal;
+  gint64 time;
+  GPtrArray *records; // NULL to remove the journal
+} AutosaveJob;
+
+// Just the one thread, so that journal updates happen in order
+static GThreadPool *pool = NULL;
+
+static void autosave_record_free ( AutosaveRecord *rec )
+{
+  g_free ( rec->data );
+  g_free ( rec );
+}
+
+static void autosave_job_run ( AutosaveJob *job, gpointer user_data )
+{
+  if ( !job->records ) {
+    if ( g_remove ( job->journal ) != 0 && errno != ENOENT )
+      g_warning ( "%s: Could not remove %s", __FUNCTION__, job->journal );
+  }
+  else {
+    gboolean is_new = !g_file_test ( job->journal, G_FILE_TEST_EXISTS );
+    if ( is_new ) {
+      gchar *dir = g_path_get_dirname ( job->journal );
+      (void)g_mkdir_with_parents ( dir, 0700 );
+      g_free ( dir );
+    }
+    FILE *f = g_fopen ( job->journal, "ab" );
+    if ( f ) {
+      if ( is_new )
+        fwrite ( JOURNAL_MAGIC, strlen(JOURNAL_MAGIC), 1, f );
+      for ( guint ii = 0; ii < job->records->len; ii++ ) {
+        AutosaveRecord *rec = g_ptr_array_index ( job->records, ii );
+        guint32 len = rec->len;
+        fwrite ( &job->time, sizeof(job->time), 1, f );
+        fwrite ( &rec->id, sizeof(rec->id), 1, f );
+        fwrite ( &len, sizeof(len), 1, f );
+        fwrite ( rec->data, len, 1, f );
+      }
+      // Only worthwhile if it survives a crash
+      fflush ( f );
+      (void)g_fsync ( fileno(f) );
+      fclose ( f );
+    }
+    else
+      g_warning ( "%s: Could not write to %s", __FUNCTION__, job->journal );
+    g_ptr_array_free ( job->records, TRUE );
+  }
+  g_free ( job->journal );
+  g_free ( job );
+}
+
+static void autosave_push ( const gchar *journal, GPtrArray *records )
+{
+  AutosaveJob *job = g_new0 ( AutosaveJob, 1 );
+  job->journal = g_strdup ( journal );
+  job->time = g_get_real_time ();
+  job->records = records;
+  if ( !pool )
+    pool = g_thread_pool_new ( (GFunc)autosave_job_run, NULL, 1, FALSE, NULL );
+  if ( pool )
+    g_thread_pool_push ( pool, job, NULL );
+  else
+    autosave_job_run ( job, NULL );
+}
+
+/**
+ * a_autosave_uninit:
+ *
+ * Wait for any journal updates to finish
+ */
+void a_autosave_uninit ( void )
+{
+  if ( pool ) {
+    g_thread_pool_free ( pool, FALSE, TRUE );
+    pool = NULL;
+  }
+}
+
+/**
+ * a_autosave_journal_name:
+ * @filename: The workspace file, or NULL for an untitled workspace
+ *
+ * Returns: The journal file to use for the workspace. Free after use.
+ */
+gchar *a_autosave_journal_name ( const gchar *filename )
+{
+  static guint untitled = 0;
+  gchar *name;
+  if ( filename ) {
+    // The same file however it was specified
+    gchar *real = file_realpath_dup ( filename );
+    gchar *sum = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, real ? real : filename, -1 );
+    name = g_strconcat ( sum, JOURNAL_EXT, NULL );
+    g_free ( sum );
+    g_free ( real );
+  }
+  else
+    name = g_strdup_printf ( UNTITLED_PREFIX "%" G_GINT64_FORMAT "-%u" JOURNAL_EXT, g_get_real_time(), ++untitled );
+  gchar *journal = g_build_filename ( a_get_viking_dir(), JOURNAL_DIR, name, NULL );
+  g_free ( name );
+  return journal;
+}
+
+static void autosave_collect ( VikAggregateLayer *agg, GPtrArray *records )
+{
+  for ( const GList *iter = vik_aggregate_layer_get_children(agg); iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->type == VIK_LAYER_AGGREGATE ) {
+      autosave_collect ( VIK_AGGREGATE_LAYER(vl), records );
+      continue;
+    }
+    if ( !vl->changed )
+      continue;
+    AutosaveRecord *rec = g_new0 ( AutosaveRecord, 1 );
+    // Only needs to identify the layer within this program run
+    rec->id = GPOINTER_TO_SIZE ( vl );
+    vik_layer_marshall ( vl, &rec->data, &rec->len );
+    if ( rec->data ) {
+      g_ptr_array_add ( records, rec );
+      vl->changed = FALSE;
+    }
+    else
+      g_free ( rec );
+  }
+}
+
+/**
+ * a_autosave_snapshot:
+ *
+ * Add the layers changed since they were last saved to the journal
+ *
+ * Returns: The number of layers saved
+ */
+guint a_autosave_snapshot ( const gchar *journal, VikAggregateLayer *top )
+{
+  GPtrArray *records = g_ptr_array_new_with_free_func ( (GDestroyNotify)autosave_record_free );
+  autosave_collect ( top, records );
+  guint num = records->len;
+  if ( num )
+    autosave_push ( journal, records );
+  else
+    g_ptr_array_free ( records, TRUE );
+  return num;
+}
+
+/**
+ * a_autosave_set_changed:
+ * @changed: FALSE when the layers are all in a file (just saved or loaded),
+ *           TRUE to include every layer in the next snapshot
+ */
+void a_autosave_set_changed ( VikAggregateLayer *top, gboolean changed )
+{
+  for ( const GList *iter = vik_aggregate_layer_get_children(top); iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    vl->changed = changed;
+    if ( vl->type == VIK_LAYER_AGGREGATE )
+      a_autosave_set_changed ( VIK_AGGREGATE_LAYER(vl), changed );
+  }
+}
+
+/**
+ * a_autosave_discard:
+ *
+ * Remove the journal (once any pending updates to it are done)
+ */
+void a_autosave_discard ( const gchar *journal )
+{
+  autosave_push ( journal, NULL );
+}
+
+gboolean a_autosave_journal_exists ( const gchar *journal )
+{
+  // Any updates still in hand are for this program run rather than something to recover
+  return g_file_test ( journal, G_FILE_TEST_IS_REGULAR );
+}
+
+/**
+ * a_autosave_recover:
+ *
+ * Add the latest version of each layer in the journal to @top
+ *
+ * Returns: The number of layers recovered
+ */
+guint a_autosave_recover ( const gchar *journal, VikAggregateLayer *top, VikViewport *vvp )
+{
+  gchar *contents;
+  gsize length;
+  if ( !g_file_get_contents ( journal, &contents, &length, NULL ) )
+    return 0;
+  if ( length < strlen(JOURNAL_MAGIC) || memcmp ( contents, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC) ) != 0 ) {
+    g_warning ( "%s: Not a journal %s", __FUNCTION__, journal );
+    g_free ( contents );
+    return 0;
+  }
+
+  // The latest record for each layer, in the order the layers first appeared
+  GHashTable *latest = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, g_free );
+  GArray *ids = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  gsize pos = strlen ( JOURNAL_MAGIC );
+  const gsize head = sizeof(gint64) + sizeof(guint64) + sizeof(guint32);
+  while ( pos + head <= length ) {
+    AutosaveRecord *rec = g_new0 ( AutosaveRecord, 1 );
+    guint32 len;
+    memcpy ( &rec->id, contents + pos + sizeof(gint64), sizeof(rec->id) );
+    memcpy ( &len, contents + pos + sizeof(gint64) + sizeof(guint64), sizeof(len) );
+    // A record cut short by a crash whilst writing it
+    if ( pos + head + len > length || len < sizeof(VikLayerTypeEnum) ) {
+      g_free ( rec );
+      break;
+    }
+    rec->data = (guint8*)contents + pos + head;
+    rec->len = len;
+    if ( !g_hash_table_contains ( latest, &rec->id ) )
+      g_array_append_val ( ids, rec->id );
+    // NB The key is within the new value
+    g_hash_table_replace ( latest, &rec->id, rec );
+    pos += head + len;
+  }
+
+  guint num = 0;
+  for ( guint ii = 0; ii < ids->len; ii++ ) {
+    AutosaveRecord *rec = g_hash_table_lookup ( latest, &g_array_index(ids, guint64, ii) );
+    VikLayerTypeEnum type;
+    memcpy ( &type, rec->data, sizeof(type) );
+    if ( type >= VIK_LAYER_NUM_TYPES )
+      continue;
+    VikLayer *vl = vik_layer_unmarshall ( rec->data, rec->len, vvp );
+    if ( vl ) {
+      vik_aggregate_layer_add_layer ( top, vl, FALSE );
+      num++;
+    }
+  }
+
+  g_array_free ( ids, TRUE );
+  g_hash_table_destroy ( latest );
+  g_free ( contents );
+  return num;
+}
+
+/**
+ * a_autosave_get_untitled_journals:
+ *
+ * Returns: List of the journals of untitled workspaces. Free the list and contents after use.
+ */
+GList *a_autosave_get_untitled_journals ( void )
+{
+  GList *journals = NULL;
+  gchar *dirname = g_build_filename ( a_get_viking_dir(), JOURNAL_DIR, NULL );
+  GDir *dir = g_dir_open ( dirname, 0, NULL );
+  if ( dir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name(dir)) )
+      if ( g_str_has_prefix(name, UNTITLED_PREFIX) && g_str_has_suffix(name, JOURNAL_EXT) )
+        journals = g_list_prepend ( journals, g_build_filename(dirname, name, NULL) );
+    g_dir_close ( dir );
+  }
+  g_free ( dirname );
+  return journals;
+}
@@ -0,0 +1,44 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_AUTOSAVE_H
+#define _VIKING_AUTOSAVE_H
+
+#include "vikaggregatelayer.h"
+
+G_BEGIN_DECLS
+
+void a_autosave_uninit ( void );
+
+gchar *a_autosave_journal_name ( const gchar *filename );
+
+guint a_autosave_snapshot ( const gchar *journal, VikAggregateLayer *top );
+
+void a_autosave_set_changed ( VikAggregateLayer *top, gboolean changed );
+
+void a_autosave_discard ( const gchar *journal );
+
+gboolean a_autosave_journal_exists ( const gchar *journal );
+
+guint a_autosave_recover ( const gchar *journal, VikAggregateLayer *top, VikViewport *vvp );
+
+GList *a_autosave_get_untitled_journals ( void );
+
+G_END_DECLS
+
+#endif
@@ -34,6 +34,7 @@
 #include "gpx.h"
 #include "kml.h"
 #include "geojson.h"
+#include "compression.h"
 #include "babel.h"
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -62,11 +63,39 @@ static GList *a_babel_file_list = NULL;
  */
 static GList *a_babel_device_list = NULL;
 
+/**
+ * The features are probed in the background, so the lists above
+ *  are not to be used until any probing has finished.
+ */
+static GThread *probe_thread = NULL;
+static gboolean probed = FALSE;
+static GSourceFunc probe_done_func = NULL;
+static gpointer probe_done_data = NULL;
+
+static gboolean load_feature ();
+
+static void probe_features_wait ()
+{
+  if ( probed )
+    return;
+  if ( probe_thread ) {
+    g_thread_join ( probe_thread );
+    probe_thread = NULL;
+  }
+  else if ( gpsbabel_loc ) {
+    // Not started in the background, so just get them now
+    if ( !load_feature() )
+      g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
+  }
+  probed = TRUE;
+}
+
 /**
  * Run a function on all file formats supporting a given mode.
  */
 void a_babel_foreach_file_with_mode (BabelMode mode, GFunc func, gpointer user_data)
 {
+  probe_features_wait ();
   GList *current;
   for ( current = g_list_first (a_babel_file_list) ;
         current != NULL ;
@@ -97,6 +126,7 @@ void a_babel_foreach_file_with_mode (BabelMode mode, GFunc func, gpointer user_d
  */
 void a_babel_foreach_file_read_any (GFunc func, gpointer user_data)
 {
+  probe_features_wait ();
   GList *current;
   for ( current = g_list_first (a_babel_file_list) ;
         current != NULL ;
@@ -396,6 +426,26 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
  *
  */
 gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, const char *input_type, const char *babelfilters, BabelStatusFunc cb, gpointer user_data, DownloadFileOptions *options )
+{
+  return a_babel_convert_from_url_cached ( vt, url, input_type, babelfilters, options, NULL, NULL );
+}
+
+/**
+ * a_babel_convert_from_url_cached:
+ * @vt:           The #VikTrwLayer where to insert the collected data
+ * @url:          The URL to fetch
+ * @input_type:   As per a_babel_convert_from_url_filter()
+ * @babelfilters: The filter arguments to pass to gpsbabel
+ * @options:      Download options. If %NULL then default download options will be used.
+ * @handle:       Optional download handle, so that the connection can be kept open between calls
+ * @data:         Optional store of the response: when it already holds data, this is used instead of fetching the URL.
+ *                Otherwise on success it is set to the downloaded data; free with g_bytes_unref()
+ *
+ * Like a_babel_convert_from_url_filter(), for callers that keep their own cache of responses.
+ *
+ * Returns: %TRUE on successful invocation of GPSBabel or read of the downloaded file
+ */
+gboolean a_babel_convert_from_url_cached ( VikTrwLayer *vt, const char *url, const char *input_type, const char *babelfilters, DownloadFileOptions *options, void *handle, GBytes **data )
 {
   // If no download options specified, use defaults:
   DownloadFileOptions myoptions = { FALSE, FALSE, NULL, 2, NULL, NULL, 0, NULL, NULL, FALSE, FALSE, NULL };
@@ -414,7 +464,20 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
     close(fd_src);
     (void)g_remove(name_src);
 
-    fetch_ret = a_http_download_get_url(url, "", name_src, &myoptions, NULL);
+    if ( data && *data ) {
+      gsize size;
+      gconstpointer contents = g_bytes_get_data ( *data, &size );
+      fetch_ret = g_file_set_contents ( name_src, contents, size, NULL ) ? DOWNLOAD_SUCCESS : DOWNLOAD_FILE_WRITE_ERROR;
+    }
+    else {
+      fetch_ret = a_http_download_get_url(url, "", name_src, &myoptions, handle);
+      if ( data && fetch_ret == DOWNLOAD_SUCCESS ) {
+        gchar *contents = NULL;
+        gsize size;
+        if ( g_file_get_contents ( name_src, &contents, &size, NULL ) )
+          *data = g_bytes_new_take ( contents, size );
+      }
+    }
     if (fetch_ret == DOWNLOAD_SUCCESS) {
       gboolean do_gpx = FALSE;
       gboolean do_kml = FALSE;
@@ -437,24 +500,25 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
       if ( do_gpx || do_kml || do_gjo ) {
         /* Process directly the retrieved file */
         g_debug ( "%s: directly read file %s", __FUNCTION__, name_src );
-        FILE *f = g_fopen(name_src, "r");
-        if (f) {
-          gchar *dirpath = g_path_get_dirname ( name_src );
-          if ( do_kml ) {
-            ret = a_kml_read_file ( vt, f, FALSE );
-            fclose(f);
-          }
-          else if ( do_gjo ) {
-            fclose(f);
-            ret = a_geojson_read_file_OSRM ( vt, name_src );
-          }
-          else {
-            GpxReadStatus_t read_status = a_gpx_read_file ( vt, f, dirpath, FALSE );
-            if ( read_status == GPX_READ_SUCCESS )
-              ret = TRUE;
-            fclose(f);
+        if ( do_gjo ) {
+          ret = a_geojson_read_file_OSRM ( vt, name_src );
+        }
+        else {
+          // Compressed downloads are decompressed as they are parsed
+          VikDecompressStream *ds = a_decompress_stream_open ( name_src );
+          if ( ds ) {
+            if ( do_kml ) {
+              ret = a_kml_read_stream ( vt, (UtilReadFunc)a_decompress_stream_read, ds, FALSE );
+            }
+            else {
+              gchar *dirpath = g_path_get_dirname ( name_src );
+              GpxReadStatus_t read_status = a_gpx_read_stream ( vt, (UtilReadFunc)a_decompress_stream_read, ds, dirpath, FALSE );
+              if ( read_status == GPX_READ_SUCCESS )
+                ret = TRUE;
+              g_free ( dirpath );
+            }
+            a_decompress_stream_close ( ds );
           }
-          g_free ( dirpath );
         }
         // Try to avoid adding the description if URL is OAuth signed
         if ( !g_ascii_strncasecmp(url, "?oauth_consumer_key=", 20) ) {
@@ -733,8 +797,9 @@ void a_babel_init ()
  * a_babel_post_init:
  *
  * Initialises babel module.
- * Mainly check existence of gpsbabel progam
- * and load all features available in that version.
+ * Mainly check existence of gpsbabel progam.
+ * The features available in that version are loaded by a_babel_probe_features(),
+ *  or otherwise when first needed.
  */
 void a_babel_post_init ()
 {
@@ -756,12 +821,51 @@ void a_babel_post_init ()
   if ( !unbuffer_loc )
     g_message ( "unbuffer not found in $PATH. It is recommended to install the relevant package for your system, which for some is in the \"expect\" package." );
 #endif
+}
 
-  if ( gpsbabel_loc ) {
-    if ( !load_feature() ) {
-      g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
-    }
-  }
+static gboolean probe_features_finished ( gpointer data )
+{
+  probe_features_wait ();
+  if ( probe_done_func )
+    probe_done_func ( probe_done_data );
+  return FALSE;
+}
+
+static gpointer probe_features_thread ( gpointer data )
+{
+  if ( !load_feature() )
+    g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
+  g_idle_add ( probe_features_finished, NULL );
+  return NULL;
+}
+
+/**
+ * a_babel_probe_features:
+ * @func:      Called (in the main loop) once the features are known
+ * @user_data: Data passed into the function
+ *
+ * Start loading the features available from gpsbabel in the background,
+ *  as running gpsbabel to find them can take a while.
+ * Anything using the features before then waits for them.
+ */
+void a_babel_probe_features ( GSourceFunc func, gpointer user_data )
+{
+  probe_done_func = func;
+  probe_done_data = user_data;
+  if ( !probed && !probe_thread && gpsbabel_loc )
+    probe_thread = g_thread_try_new ( "babel_probe_features", probe_features_thread, NULL, NULL );
+  if ( !probe_thread )
+    g_idle_add ( probe_features_finished, NULL );
+}
+
+/**
+ * a_babel_features_probed:
+ *
+ * Returns: TRUE if the features are known, without waiting for them
+ */
+gboolean a_babel_features_probed ()
+{
+  return probed;
 }
 
 /**
@@ -771,6 +875,8 @@ void a_babel_post_init ()
  */
 void a_babel_uninit ()
 {
+  if ( probe_thread )
+    probe_features_wait ();
   g_free ( gpsbabel_loc );
   g_free ( unbuffer_loc );
 
@@ -808,6 +914,7 @@ void a_babel_uninit ()
  */
 gboolean a_babel_available ()
 {
+  probe_features_wait ();
   return a_babel_device_list != NULL;
 }
 
@@ -818,6 +925,7 @@ gboolean a_babel_available ()
  */
 GList *a_babel_file_list_get ()
 {
+  probe_features_wait ();
   return a_babel_file_list;
 }
 
@@ -828,5 +936,6 @@ GList *a_babel_file_list_get ()
  */
 GList *a_babel_device_list_get ()
 {
+  probe_features_wait ();
   return a_babel_device_list;
 }
@@ -116,11 +116,14 @@ gboolean a_babel_gpx_export ( const char *babelargs, const char *infile, const c
 
 // NB needs to match typedef VikDataSourceProcessFunc in acquire.h
 gboolean a_babel_convert_from ( VikTrwLayer *vt, ProcessOptions *process_options, BabelStatusFunc cb, gpointer user_data, DownloadFileOptions *download_options );
+gboolean a_babel_convert_from_url_cached ( VikTrwLayer *vt, const char *url, const char *input_type, const char *babelfilters, DownloadFileOptions *options, void *handle, GBytes **data );
 
 gboolean a_babel_convert_to( VikTrwLayer *vt, VikTrack *track, const char *babelargs, const char *file, BabelStatusFunc cb, gpointer user_data );
 
 void a_babel_init ();
 void a_babel_post_init ();
+void a_babel_probe_features ( GSourceFunc func, gpointer user_data );
+gboolean a_babel_features_probed ();
 void a_babel_uninit ();
 
 gboolean a_babel_available ();
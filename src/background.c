@@ -30,13 +30,35 @@
 #include "uibuilder.h"
 #include "globals.h"
 #include "preferences.h"
+#include "perfstats.h"
+#include "tracelog.h"
 
+// Network requests spend most of their time waiting, so have their own (larger) pool
 static GThreadPool *thread_pool_remote = NULL;
-static GThreadPool *thread_pool_local = NULL;
+static gboolean stop_all_threads = FALSE;
+
+// CPU bound work, both local (and Mapnik) jobs and the items of a_background_parallel(),
+//  shares one set of worker threads so the CPUs are used without running more threads than them
+static GMutex cpu_mutex;
+static GCond cpu_cond;   // Work added, or stopping
+static GCond batch_cond; // Items of a batch finished
+static GQueue cpu_jobs = G_QUEUE_INIT;    // Waiting jobs (args), in job_compare() order
+static GQueue cpu_batches = G_QUEUE_INIT; // ParallelBatch with items yet to be started
+static guint cpu_workers = 0;
+static gboolean cpu_stop = FALSE;
 #ifdef HAVE_LIBMAPNIK
-static GThreadPool *thread_pool_local_mapnik = NULL;
+// Limit on Mapnik jobs running at once
+static guint mapnik_running = 0;
+static guint mapnik_max = 1;
 #endif
-static gboolean stop_all_threads = FALSE;
+
+typedef struct {
+  vik_thr_index_func func;
+  gpointer data;
+  guint count;
+  guint next; // Next item to start
+  guint done; // Number of items finished
+} ParallelBatch;
 
 // A single store of background items for all Windows
 // Must always be accessed in the main thread
@@ -48,7 +70,23 @@ static GSList *windows_to_update = NULL;
 
 static gint bgitemcount = 0;
 
-#define VIK_BG_NUM_ARGS 8
+// Keeps jobs of the same priority in the order they were added
+static guint bgsequence = 0;
+
+#define VIK_BG_NUM_ARGS 12
+
+// Progress changes more often than this are not shown, so busy loops don't flood the main loop
+#define BACKGROUND_PROGRESS_INTERVAL 100000 // microseconds
+
+// Details of a job for tracing what the pools are doing and for showing its progress
+typedef struct {
+  gchar *message;
+  gint64 queued;
+  guint id;
+  Background_Pool_Type bp;
+  gint64 last_progress; // When the progress was last shown
+  gint cleaned;         // Set once the cancel cleanup has been called
+} JobInfo;
 
 enum
 {
@@ -88,12 +126,37 @@ static gboolean idle_progress_update ( gpointer user_data )
   return FALSE;
 }
 
+/**
+ * Show the progress, unless it was shown only a moment ago
+ *
+ * Returns: Whether the progress was shown
+ */
+static gboolean show_progress ( gpointer *args, gdouble fraction )
+{
+  gdouble myfraction = fabs(fraction);
+  if ( myfraction > 1.0 )
+    myfraction = 1.0;
+  JobInfo *ji = args[11];
+  gint64 now = g_get_monotonic_time ();
+  if ( myfraction < 1.0 && now - ji->last_progress < BACKGROUND_PROGRESS_INTERVAL )
+    return FALSE;
+  ji->last_progress = now;
+  if ( args[5] != NULL ) {
+    progress_t *progress = g_malloc0 ( sizeof(progress_t) );
+    progress->percent = myfraction * 100;
+    progress->iter = (GtkTreeIter*)args[5];
+    args[7] = GUINT_TO_POINTER(gdk_threads_add_idle ( idle_progress_update, progress ));
+  }
+  return TRUE;
+}
+
 /**
  * a_background_thread_progress:
  * @callbackdata: Thread data
  * @fraction:     The value should be between 0.0 and 1.0 indicating percentage of the task complete
  *
- * Called from other threads
+ * Called from other threads, marking one of the items of the job as done.
+ * The display is only updated every so often, so this can be called for many small items.
  *
  * Returns a non zero number if the thread should be terminated
  */
@@ -101,19 +164,34 @@ int a_background_thread_progress ( gpointer callbackdata, gdouble fraction )
 {
   gpointer *args = (gpointer *) callbackdata;
   int res = a_background_testcancel ( callbackdata );
-  if (args[5] != NULL) {
-    gdouble myfraction = fabs(fraction);
-    if ( myfraction > 1.0 )
-      myfraction = 1.0;
-    progress_t *progress = g_malloc0 ( sizeof(progress_t) );
-    progress->percent = myfraction * 100;
-    progress->iter = (GtkTreeIter*)args[5];
-    args[7] = GUINT_TO_POINTER(gdk_threads_add_idle ( idle_progress_update, progress ));
-  }
+  // Thread functions may also be run directly, without any progress to show
+  if ( !args )
+    return res;
 
   args[6] = GINT_TO_POINTER(GPOINTER_TO_INT(args[6])-1);
   bgitemcount--;
-  background_thread_update();
+  if ( show_progress(args, fraction) )
+    background_thread_update();
+  return res;
+}
+
+/**
+ * a_background_set_progress:
+ * @callbackdata: Thread data
+ * @fraction:     Between 0.0 and 1.0 indicating how much of the task is complete
+ *
+ * Called from other threads, for progress within an item (e.g. part way through a large file),
+ *  so unlike a_background_thread_progress() no item is marked as done.
+ * As the display is only updated every so often, this is cheap enough for inner loops.
+ *
+ * Returns a non zero number if the thread should be terminated
+ */
+int a_background_set_progress ( gpointer callbackdata, gdouble fraction )
+{
+  gpointer *args = (gpointer *) callbackdata;
+  int res = a_background_testcancel ( callbackdata );
+  if ( args )
+    (void)show_progress ( args, fraction );
   return res;
 }
 
@@ -124,15 +202,28 @@ static void thread_die ( gpointer args[VIK_BG_NUM_ARGS] )
   if ( userdata_free_func != NULL )
     userdata_free_func ( args[2] );
 
-  if ( GPOINTER_TO_INT(args[6]) )
-  {
-    bgitemcount -= GPOINTER_TO_INT(args[6]);
-    background_thread_update ();
-  }
+  JobInfo *ji = args[11];
+  g_free ( ji->message );
+  g_free ( ji );
+
+  // Also shows any count not yet shown due to progress changes being limited
+  bgitemcount -= GPOINTER_TO_INT(args[6]);
+  background_thread_update ();
 
   g_free ( args );
 }
 
+/**
+ * Call the cancel cleanup of a job, only the first time
+ */
+static void job_cleanup ( gpointer *args )
+{
+  JobInfo *ji = args[11];
+  vik_thr_free_func cleanup = args[4];
+  if ( g_atomic_int_compare_and_exchange(&ji->cleaned, 0, 1) && cleanup )
+    cleanup ( args[2] );
+}
+
 // Called from other threads
 // Returns a non zero number if the thread should be terminated
 int a_background_testcancel ( gpointer callbackdata )
@@ -140,16 +231,33 @@ int a_background_testcancel ( gpointer callbackdata )
   gpointer *args = (gpointer *) callbackdata;
   if ( stop_all_threads )
     return -1;
-  if ( args && args[0] )
+  if ( args && g_atomic_pointer_get(&args[0]) )
   {
-    vik_thr_free_func cleanup = args[4];
-    if ( cleanup )
-      cleanup ( args[2] );
+    job_cleanup ( args );
     return -1;
   }
   return 0;
 }
 
+/**
+ * a_background_cancelled:
+ * @callbackdata: Thread data (may be NULL when a thread function is run directly)
+ *
+ * A quick check for inner loops of whether the job has been cancelled.
+ * Unlike a_background_testcancel() the cancel cleanup is not called here,
+ *  it gets called once the job stops.
+ * Can be called from any thread, so also from the items of a_background_parallel().
+ *
+ * Returns: TRUE if the job should stop
+ */
+gboolean a_background_cancelled ( gpointer callbackdata )
+{
+  gpointer *args = (gpointer *) callbackdata;
+  if ( stop_all_threads )
+    return TRUE;
+  return args && g_atomic_pointer_get(&args[0]);
+}
+
 // Called from the main thread
 static gboolean idle_remove ( gpointer user_data )
 {
@@ -160,16 +268,61 @@ static gboolean idle_remove ( gpointer user_data )
   return FALSE;
 }
 
+static const gchar *pool_name ( Background_Pool_Type bp )
+{
+  if ( bp == BACKGROUND_POOL_REMOTE )
+    return "remote";
+#ifdef HAVE_LIBMAPNIK
+  if ( bp == BACKGROUND_POOL_LOCAL_MAPNIK )
+    return "mapnik";
+#endif
+  return "local";
+}
+
+/**
+ * Number of jobs waiting to be started
+ */
+static guint queue_length ( Background_Pool_Type bp )
+{
+  if ( bp == BACKGROUND_POOL_REMOTE )
+    return g_thread_pool_unprocessed ( thread_pool_remote );
+  g_mutex_lock ( &cpu_mutex );
+  guint len = g_queue_get_length ( &cpu_jobs );
+  g_mutex_unlock ( &cpu_mutex );
+  return len;
+}
+
 // Called from other threads
 static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
 {
   /* unpack args */
   vik_thr_func func = args[1];
   gpointer userdata = args[2];
+  JobInfo *ji = args[11];
+  Background_Pool_Type pool = ji->bp;
 
   g_debug(__FUNCTION__);
 
-  func ( userdata, args );
+  g_atomic_pointer_set ( &args[10], GINT_TO_POINTER(1) ); // Started
+
+  gint64 start = g_get_monotonic_time ();
+  a_tracelog_thread_name ( pool_name(pool) );
+  a_tracelog_async ( "queue", ji->message, ji->id, ji->queued, start, g_strdup_printf ( "\"pool\": \"%s\"", pool_name(pool) ) );
+  a_tracelog_counter ( pool_name(pool), queue_length(pool) );
+  a_perfstats_time ( "background wait", pool_name(pool), start - ji->queued );
+  gboolean cancelled_waiting = args[0] != NULL;
+
+  // Don't even start if cancelled whilst waiting
+  if ( !args[0] )
+    func ( userdata, args );
+  // Cleanup if cancelled whilst waiting, or if the job noticed via a_background_cancelled()
+  if ( args[0] )
+    job_cleanup ( args );
+
+  a_tracelog_complete ( "job", ji->message, start,
+                       g_strdup_printf ( "\"pool\": \"%s\", \"queue_wait_us\": %" G_GINT64_FORMAT ", \"cancelled\": %s%s",
+                                         pool_name(pool), start - ji->queued, args[0] ? "true" : "false",
+                                         cancelled_waiting ? ", \"started\": false" : "" ) );
 
   if ( ! args[0] ) {
     gdk_threads_add_idle ( idle_remove, args[5] );
@@ -177,6 +330,22 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
   thread_die ( args );
 }
 
+/**
+ * Order waiting jobs by priority and then by when they were added
+ */
+static gint job_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  gpointer *args_a = (gpointer *) a;
+  gpointer *args_b = (gpointer *) b;
+  gint pa = GPOINTER_TO_INT(args_a[8]);
+  gint pb = GPOINTER_TO_INT(args_b[8]);
+  if ( pa != pb )
+    return pa < pb ? -1 : 1;
+  guint sa = GPOINTER_TO_UINT(args_a[9]);
+  guint sb = GPOINTER_TO_UINT(args_b[9]);
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
 /**
  * a_background_thread:
  * @bp:      Which pool this thread should run in
@@ -191,6 +360,17 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
  * Function to enlist new background function.
  */
 void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
+{
+  a_background_thread_with_priority ( bp, BACKGROUND_PRIORITY_NORMAL, parent, message, func, userdata, userdata_free_func, userdata_cancel_cleanup_func, number_items );
+}
+
+/**
+ * a_background_thread_with_priority:
+ * @priority: Jobs with a higher priority are started before those waiting with a lower priority
+ *
+ * As a_background_thread()
+ */
+void a_background_thread_with_priority ( Background_Pool_Type bp, Background_Priority priority, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
 {
   GtkTreeIter *piter = g_malloc ( sizeof ( GtkTreeIter ) );
   gpointer *args = g_malloc ( sizeof(gpointer) * VIK_BG_NUM_ARGS );
@@ -205,6 +385,17 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
   args[5] = piter;
   args[6] = GINT_TO_POINTER(number_items);
   args[7] = GUINT_TO_POINTER(0); // Will be id of progress update func
+  args[8] = GINT_TO_POINTER(priority);
+  args[9] = GUINT_TO_POINTER(bgsequence++);
+  args[10] = GINT_TO_POINTER(0); // Set once started
+  JobInfo *ji = g_malloc ( sizeof(JobInfo) );
+  ji->message = g_strdup ( message );
+  ji->queued = g_get_monotonic_time ();
+  ji->id = GPOINTER_TO_UINT(args[9]);
+  ji->bp = bp;
+  ji->last_progress = 0;
+  ji->cleaned = 0;
+  args[11] = ji;
 
   bgitemcount += number_items;
 
@@ -217,13 +408,127 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
 
   /* run the thread in the background */
   if ( bp == BACKGROUND_POOL_REMOTE )
-    g_thread_pool_push( thread_pool_remote, args, NULL );
+    g_thread_pool_push ( thread_pool_remote, args, NULL );
+  else {
+    g_mutex_lock ( &cpu_mutex );
+    g_queue_insert_sorted ( &cpu_jobs, args, job_compare, NULL );
+    g_cond_signal ( &cpu_cond );
+    g_mutex_unlock ( &cpu_mutex );
+  }
+  a_perfstats_level ( "background queue", pool_name(bp), queue_length(bp) );
+  a_tracelog_counter ( pool_name(bp), queue_length(bp) );
+  a_perfstats_level ( "background queue", "items", bgitemcount );
+}
+
+/**
+ * Must be called with the cpu_mutex held
+ *
+ * Returns the first waiting job that can be started now, or NULL
+ */
+static gpointer *cpu_take_job ()
+{
+  for ( GList *iter = cpu_jobs.head; iter; iter = iter->next ) {
+    gpointer *args = iter->data;
 #ifdef HAVE_LIBMAPNIK
-  else if ( bp == BACKGROUND_POOL_LOCAL_MAPNIK )
-    g_thread_pool_push( thread_pool_local_mapnik, args, NULL );
+    if ( ((JobInfo*)args[11])->bp == BACKGROUND_POOL_LOCAL_MAPNIK ) {
+      if ( mapnik_running >= mapnik_max )
+        continue;
+      mapnik_running++;
+    }
 #endif
-  else
-    g_thread_pool_push( thread_pool_local, args, NULL );
+    g_queue_delete_link ( &cpu_jobs, iter );
+    return args;
+  }
+  return NULL;
+}
+
+/**
+ * Must be called with the cpu_mutex held, which is released whilst the item runs
+ */
+static void batch_run_one ( ParallelBatch *pb )
+{
+  guint index = pb->next++;
+  // Once all are started, others can only wait for the batch to finish
+  if ( pb->next == pb->count )
+    g_queue_remove ( &cpu_batches, pb );
+  g_mutex_unlock ( &cpu_mutex );
+  pb->func ( index, pb->data );
+  g_mutex_lock ( &cpu_mutex );
+  if ( ++pb->done == pb->count )
+    g_cond_broadcast ( &batch_cond );
+}
+
+static gpointer cpu_worker ( gpointer data )
+{
+  a_tracelog_thread_name ( "cpu" );
+  g_mutex_lock ( &cpu_mutex );
+  while ( !cpu_stop ) {
+    // Items of a batch first, as something is waiting for them
+    ParallelBatch *pb = g_queue_peek_head ( &cpu_batches );
+    if ( pb ) {
+      batch_run_one ( pb );
+      continue;
+    }
+    gpointer *args = cpu_take_job ();
+    if ( args ) {
+#ifdef HAVE_LIBMAPNIK
+      gboolean mapnik = ((JobInfo*)args[11])->bp == BACKGROUND_POOL_LOCAL_MAPNIK;
+#endif
+      g_mutex_unlock ( &cpu_mutex );
+      thread_helper ( args, NULL );
+      g_mutex_lock ( &cpu_mutex );
+#ifdef HAVE_LIBMAPNIK
+      if ( mapnik ) {
+        mapnik_running--;
+        // Another Mapnik job may be able to start
+        g_cond_signal ( &cpu_cond );
+      }
+#endif
+      continue;
+    }
+    g_cond_wait ( &cpu_cond, &cpu_mutex );
+  }
+  g_mutex_unlock ( &cpu_mutex );
+  return NULL;
+}
+
+/**
+ * a_background_parallel:
+ * @func:  Called for each index from 0 to @count-1, from any thread
+ * @data:  Passed to the func
+ * @count: Number of items
+ *
+ * Run the items on the shared CPU workers as they become free, returning once all have finished.
+ * The calling thread runs items too, so this can be used from within a background job
+ *  (or from another parallel item) without waiting on itself.
+ */
+void a_background_parallel ( vik_thr_index_func func, gpointer data, guint count )
+{
+  if ( cpu_workers == 0 || count < 2 ) {
+    for ( guint ii = 0; ii < count; ii++ )
+      func ( ii, data );
+    return;
+  }
+
+  ParallelBatch pb = { func, data, count, 0, 0 };
+  g_mutex_lock ( &cpu_mutex );
+  g_queue_push_tail ( &cpu_batches, &pb );
+  g_cond_broadcast ( &cpu_cond );
+  while ( pb.next < pb.count )
+    batch_run_one ( &pb );
+  while ( pb.done < pb.count )
+    g_cond_wait ( &batch_cond, &cpu_mutex );
+  g_mutex_unlock ( &cpu_mutex );
+}
+
+/**
+ * a_background_get_cpu_workers:
+ *
+ * Returns: The number of threads for CPU bound work, so work can be split into about that many parts
+ */
+guint a_background_get_cpu_workers ()
+{
+  return MAX ( 1, cpu_workers );
 }
 
 // In main thread
@@ -238,11 +543,59 @@ static void cancel_job_with_iter ( GtkTreeIter *piter )
     /* we know args still exists because it is free _after_ the list item is destroyed */
     /* need MUTEX ? */
     args[0] = GINT_TO_POINTER(1); /* set killswitch */
-    (void)g_source_remove ( GPOINTER_TO_UINT(args[7]) ); // Stop next idle_progress_update() from running
+    if ( args[7] )
+      (void)g_source_remove ( GPOINTER_TO_UINT(args[7]) ); // Stop next idle_progress_update() from running
     g_free ( args[5] );
     args[5] = NULL;
 }
 
+/**
+ * a_background_reprioritise:
+ * @func:          Only waiting jobs running this function are considered
+ * @priority_func: Called for each of these jobs to return the new priority,
+ *                 or BACKGROUND_PRIORITY_CANCEL to remove the job
+ * @data:          Passed to the priority_func
+ *
+ * Typically used when the display has changed, so previously requested jobs are no longer as relevant.
+ * Must be called from the main thread.
+ */
+void a_background_reprioritise ( vik_thr_func func, vik_thr_priority_func priority_func, gpointer data )
+{
+  gboolean changed = FALSE;
+  gboolean removed = FALSE;
+  GtkTreeIter iter;
+  gboolean valid = gtk_tree_model_get_iter_first ( GTK_TREE_MODEL(bgstore), &iter );
+  while ( valid ) {
+    gpointer *args;
+    gtk_tree_model_get ( GTK_TREE_MODEL(bgstore), &iter, DATA_COLUMN, &args, -1 );
+    if ( args[1] == func && !args[0] && !g_atomic_pointer_get(&args[10]) ) {
+      Background_Priority current = GPOINTER_TO_INT(args[8]);
+      Background_Priority priority = priority_func ( args[2], current, data );
+      if ( priority == BACKGROUND_PRIORITY_CANCEL ) {
+        cancel_job_with_iter ( &iter );
+        valid = gtk_list_store_remove ( bgstore, &iter );
+        removed = TRUE;
+        continue;
+      }
+      if ( priority != current ) {
+        args[8] = GINT_TO_POINTER(priority);
+        changed = TRUE;
+      }
+    }
+    valid = gtk_tree_model_iter_next ( GTK_TREE_MODEL(bgstore), &iter );
+  }
+
+  // Setting the sort function again resorts the waiting jobs
+  if ( changed ) {
+    g_thread_pool_set_sort_function ( thread_pool_remote, job_compare, NULL );
+    g_mutex_lock ( &cpu_mutex );
+    g_queue_sort ( &cpu_jobs, job_compare, NULL );
+    g_mutex_unlock ( &cpu_mutex );
+  }
+  if ( removed )
+    background_thread_update();
+}
+
 static GtkWidget *bgwindow = NULL;
 
 // In main thread
@@ -283,14 +636,18 @@ static void bgwindow_response (GtkDialog *dialog, gint response_id, GtkTreeView
 #define VIK_SETTINGS_BACKGROUND_MAX_THREADS_LOCAL "background_max_threads_local"
 
 #ifdef HAVE_LIBMAPNIK
-// Default to 1 thread due to potential crashing issues
-static VikLayerParamData mpk_thrds_default ( void ) { return VIK_LPD_UINT(1); }
+// Each thread renders with its own copy of the Mapnik map, so as for other local jobs don't use all available CPUs
+static VikLayerParamData mpk_thrds_default ( void )
+{
+  guint cpus = util_get_number_of_cpus ();
+  return VIK_LPD_UINT(cpus > 1 ? cpus-1 : 1);
+}
 
 VikLayerParamScale params_threads[] = { {1, 64, 1, 0} }; // 64 threads should be enough for anyone...
 // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
 static VikLayerParam prefs_mapnik[] = {
   { VIK_LAYER_NUM_TYPES, "mapnik.background_max_threads_local_mapnik", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Threads:"), VIK_LAYER_WIDGET_SPINBUTTON, params_threads, NULL,
-    N_("Number of threads to use for Mapnik tasks. You need to restart Viking for a change to this value to be used"), mpk_thrds_default, NULL, NULL },
+    N_("Maximum number of Mapnik tasks run at once, sharing the threads for other local tasks. You need to restart Viking for a change to this value to be used"), mpk_thrds_default, NULL, NULL },
 };
 #endif
 
@@ -321,6 +678,7 @@ void a_background_post_init()
     max_threads = maxt;
 
   thread_pool_remote = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  g_thread_pool_set_sort_function ( thread_pool_remote, job_compare, NULL );
 
   if ( a_settings_get_integer ( VIK_SETTINGS_BACKGROUND_MAX_THREADS_LOCAL, &maxt ) )
     max_threads = maxt;
@@ -329,12 +687,18 @@ void a_background_post_init()
     max_threads = cpus > 1 ? cpus-1 : 1; // Don't use all available CPUs!
   }
 
-  thread_pool_local = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  for ( cpu_workers = 0; cpu_workers < (guint)max_threads; cpu_workers++ ) {
+    GThread *thread = g_thread_try_new ( "cpu", cpu_worker, NULL, NULL );
+    if ( !thread )
+      break;
+    g_thread_unref ( thread );
+  }
+  if ( !cpu_workers )
+    g_critical ( "%s: no worker threads", __FUNCTION__ );
 
 #ifdef HAVE_LIBMAPNIK
   // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
-  guint mapnik_threads = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u;
-  thread_pool_local_mapnik = g_thread_pool_new ( (GFunc) thread_helper, NULL, mapnik_threads, FALSE, NULL );
+  mapnik_max = MAX ( 1, a_preferences_get("mapnik.background_max_threads_local_mapnik")->u );
 #endif
 
   bgstore = gtk_list_store_new ( N_COLUMNS, G_TYPE_STRING, G_TYPE_DOUBLE, G_TYPE_POINTER );
@@ -397,10 +761,10 @@ void a_background_uninit()
   stop_all_threads = TRUE;
   // Don't wait for these threads to complete - i.e. end now.
   g_thread_pool_free ( thread_pool_remote, TRUE, FALSE );
-  g_thread_pool_free ( thread_pool_local, TRUE, FALSE );
-#ifdef HAVE_LIBMAPNIK
-  g_thread_pool_free ( thread_pool_local_mapnik, TRUE, FALSE );
-#endif
+  g_mutex_lock ( &cpu_mutex );
+  cpu_stop = TRUE;
+  g_cond_broadcast ( &cpu_cond );
+  g_mutex_unlock ( &cpu_mutex );
   gtk_list_store_clear ( bgstore );
   g_object_unref ( bgstore );
   bgstore = NULL;
@@ -32,18 +32,39 @@ G_BEGIN_DECLS
 
 typedef void(*vik_thr_free_func)(gpointer);
 typedef void(*vik_thr_func)(gpointer,gpointer);
+typedef void(*vik_thr_index_func)(guint,gpointer);
 
 typedef enum {
   BACKGROUND_POOL_REMOTE, // i.e. Network requests - can have an arbitary large pool
-  BACKGROUND_POOL_LOCAL,  // i.e. CPU bound tasks - pool should be no larger than available CPUs for best performance
+  BACKGROUND_POOL_LOCAL,  // i.e. CPU bound tasks - run by the shared CPU workers, no more than available CPUs
 #ifdef HAVE_LIBMAPNIK
-  BACKGROUND_POOL_LOCAL_MAPNIK,  // Due to potential issues with multi-threading a separate configurable pool for Mapnik
+  BACKGROUND_POOL_LOCAL_MAPNIK,  // Due to potential issues with multi-threading, local but with a configurable limit on how many run at once
 #endif
 } Background_Pool_Type;
 
+/**
+ * Waiting jobs in a pool are run in this order
+ */
+typedef enum {
+  BACKGROUND_PRIORITY_VISIBLE, // e.g. Tiles for what is currently being displayed
+  BACKGROUND_PRIORITY_NEARBY,  // e.g. Tiles just outside the display, likely to be wanted next
+  BACKGROUND_PRIORITY_NORMAL,
+  BACKGROUND_PRIORITY_BULK,    // e.g. Downloading large areas
+  BACKGROUND_PRIORITY_CANCEL,  // Only for a vik_thr_priority_func() to remove a waiting job
+} Background_Priority;
+
+// Return the new priority for a waiting job
+typedef Background_Priority(*vik_thr_priority_func)(gpointer userdata,Background_Priority current,gpointer data);
+
 void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
+void a_background_thread_with_priority ( Background_Pool_Type bp, Background_Priority priority, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
+void a_background_reprioritise ( vik_thr_func func, vik_thr_priority_func priority_func, gpointer data );
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction );
 int a_background_testcancel ( gpointer callbackdata );
+int a_background_set_progress ( gpointer callbackdata, gdouble fraction );
+gboolean a_background_cancelled ( gpointer callbackdata );
+void a_background_parallel ( vik_thr_index_func func, gpointer data, guint count );
+guint a_background_get_cpu_workers ();
 void a_background_show_window ();
 void a_background_init ();
 void a_background_post_init ();
@@ -0,0 +1,278 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Rendering benchmark: replays a sequence of views of the layers of a window,
+ *  drawn off-screen (as when saving an image), timing the drawing of each layer.
+ *
+ * Script commands, one per line ('#' starts a comment):
+ *  size <width> <height>     Size of the off-screen view (default 1024 768)
+ *  center <lat> <lon>
+ *  zoom <mpp>                Metres per pixel
+ *  zoomin [steps]            A frame is drawn after each step
+ *  zoomout [steps]
+ *  pan <dx> <dy> [steps]     In pixels, split over the steps with a frame drawn after each
+ *  draw [frames]             Draw again without changing the view
+ *  settle <ms>               Let background work (e.g. loading map tiles) run, without timing it
+ *
+ * Results are tab separated: a line per layer, then an overall line for all the frames.
+ * Tiles drawn are counted as the images each layer draws on the viewport.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchrender.h"
+#include "viking.h"
+#include "mapcache.h"
+
+#define BENCH_DEFAULT_WIDTH 1024
+#define BENCH_DEFAULT_HEIGHT 768
+
+static const gchar *default_script =
+  "draw 3\n"
+  "pan 512 0 8\n"
+  "pan 0 384 8\n"
+  "pan -512 0 8\n"
+  "pan 0 -384 8\n"
+  "zoomin 3\n"
+  "zoomout 6\n"
+  "zoomin 3\n"
+  "settle 2000\n"
+  "draw 3\n";
+
+typedef struct {
+  VikLayer *vl;
+  guint draws;
+  gdouble total;  // Seconds
+  gdouble max;
+  guint pixbufs;
+} LayerTiming;
+
+typedef struct {
+  VikViewport *vvp;
+  gint width;
+  gint height;
+  GArray *layers; // Of LayerTiming
+  guint frames;
+  gdouble total;
+  guint hits;
+  guint misses;
+} BenchRender;
+
+static gdouble elapsed ( gint64 start )
+{
+  return (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+}
+
+/**
+ * Processing GUI events could resize the viewport back to its window
+ */
+static void ensure_size ( BenchRender *br )
+{
+  if ( vik_viewport_get_width(br->vvp) != br->width || vik_viewport_get_height(br->vvp) != br->height )
+    vik_viewport_configure_manually ( br->vvp, br->width, br->height );
+}
+
+static void draw_frame ( BenchRender *br )
+{
+  ensure_size ( br );
+
+  guint hits0, misses0;
+  a_mapcache_get_hit_stats ( &hits0, &misses0 );
+  gint64 frame_start = g_get_monotonic_time ();
+
+  vik_viewport_clear ( br->vvp );
+  for ( guint ii = 0; ii < br->layers->len; ii++ ) {
+    LayerTiming *lt = &g_array_index ( br->layers, LayerTiming, ii );
+    guint pixbufs = vik_viewport_get_pixbufs_drawn ( br->vvp );
+    gint64 start = g_get_monotonic_time ();
+    vik_layer_draw ( lt->vl, br->vvp );
+    gdouble secs = elapsed ( start );
+    lt->draws++;
+    lt->total += secs;
+    lt->max = MAX ( lt->max, secs );
+    lt->pixbufs += vik_viewport_get_pixbufs_drawn ( br->vvp ) - pixbufs;
+  }
+
+  br->total += elapsed ( frame_start );
+  br->frames++;
+  guint hits, misses;
+  a_mapcache_get_hit_stats ( &hits, &misses );
+  br->hits += hits - hits0;
+  br->misses += misses - misses0;
+}
+
+static void settle ( guint ms )
+{
+  gint64 end = g_get_monotonic_time () + (gint64)ms * 1000;
+  while ( g_get_monotonic_time () < end ) {
+    while ( gtk_events_pending () )
+      gtk_main_iteration ();
+    g_usleep ( 10000 );
+  }
+}
+
+static guint steps_arg ( gchar **args, guint nn )
+{
+  guint steps = args[nn] ? (guint)atoi ( args[nn] ) : 1;
+  return MAX ( 1, steps );
+}
+
+static void run_command ( BenchRender *br, gchar **args, guint line )
+{
+  const gchar *cmd = args[0];
+  guint nargs = g_strv_length ( args );
+
+  if ( g_strcmp0 ( cmd, "size" ) == 0 && nargs >= 3 ) {
+    br->width = MAX ( 1, atoi(args[1]) );
+    br->height = MAX ( 1, atoi(args[2]) );
+    ensure_size ( br );
+  }
+  else if ( g_strcmp0 ( cmd, "center" ) == 0 && nargs >= 3 ) {
+    struct LatLon ll = { g_ascii_strtod(args[1], NULL), g_ascii_strtod(args[2], NULL) };
+    vik_viewport_set_center_latlon ( br->vvp, &ll, FALSE );
+    draw_frame ( br );
+  }
+  else if ( g_strcmp0 ( cmd, "zoom" ) == 0 && nargs >= 2 ) {
+    vik_viewport_set_zoom ( br->vvp, g_ascii_strtod(args[1], NULL) );
+    draw_frame ( br );
+  }
+  else if ( g_strcmp0 ( cmd, "zoomin" ) == 0 || g_strcmp0 ( cmd, "zoomout" ) == 0 ) {
+    guint steps = steps_arg ( args, 1 );
+    for ( guint ss = 0; ss < steps; ss++ ) {
+      if ( cmd[4] == 'i' )
+        (void)vik_viewport_zoom_in ( br->vvp );
+      else
+        (void)vik_viewport_zoom_out ( br->vvp );
+      draw_frame ( br );
+    }
+  }
+  else if ( g_strcmp0 ( cmd, "pan" ) == 0 && nargs >= 3 ) {
+    gint dx = atoi ( args[1] );
+    gint dy = atoi ( args[2] );
+    guint steps = steps_arg ( args, 3 );
+    for ( guint ss = 0; ss < steps; ss++ ) {
+      // Spread any remainder so the total is exact
+      gint sx = dx * (gint)(ss+1) / (gint)steps - dx * (gint)ss / (gint)steps;
+      gint sy = dy * (gint)(ss+1) / (gint)steps - dy * (gint)ss / (gint)steps;
+      VikCoord coord;
+      vik_viewport_screen_to_coord ( br->vvp, br->width/2 + sx, br->height/2 + sy, &coord );
+      vik_viewport_set_center_coord ( br->vvp, &coord, FALSE );
+      draw_frame ( br );
+    }
+  }
+  else if ( g_strcmp0 ( cmd, "draw" ) == 0 ) {
+    guint frames = steps_arg ( args, 1 );
+    for ( guint ff = 0; ff < frames; ff++ )
+      draw_frame ( br );
+  }
+  else if ( g_strcmp0 ( cmd, "settle" ) == 0 && nargs >= 2 )
+    settle ( (guint)atoi ( args[1] ) );
+  else
+    g_warning ( "%s: Unknown or incomplete command on line %u: %s", __FUNCTION__, line, cmd );
+}
+
+static void report ( BenchRender *br )
+{
+  printf ( "#layer\ttype\tdraws\ttotal_s\tmean_ms\tmax_ms\ttiles\n" );
+  for ( guint ii = 0; ii < br->layers->len; ii++ ) {
+    LayerTiming *lt = &g_array_index ( br->layers, LayerTiming, ii );
+    printf ( "%s\t%s\t%u\t%.6f\t%.3f\t%.3f\t%u\n",
+             lt->vl->name ? lt->vl->name : "",
+             vik_layer_get_interface(lt->vl->type)->fixed_layer_name,
+             lt->draws, lt->total, lt->draws ? 1000.0 * lt->total / lt->draws : 0.0, 1000.0 * lt->max, lt->pixbufs );
+  }
+  printf ( "#frames\ttotal_s\tfps\tcache_hits\tcache_misses\tcache_hit_rate\n" );
+  guint lookups = br->hits + br->misses;
+  printf ( "%u\t%.6f\t%.2f\t%u\t%u\t%.4f\n", br->frames, br->total,
+           br->total > 0.0 ? br->frames / br->total : 0.0,
+           br->hits, br->misses, lookups ? (gdouble)br->hits / lookups : 0.0 );
+  fflush ( stdout );
+}
+
+/**
+ * a_bench_render_run:
+ * @vw:     The window with the layers to draw
+ * @script: File of commands, or NULL or "-" for a default sequence of pans and zooms
+ *
+ * Draw each of the visible top level layers for every frame of the script,
+ *  printing the timings to stdout.
+ *
+ * Returns: FALSE if the script could not be read
+ */
+gboolean a_bench_render_run ( VikWindow *vw, const gchar *script )
+{
+  gchar *contents = NULL;
+  if ( script && g_strcmp0 ( script, "-" ) != 0 ) {
+    GError *error = NULL;
+    if ( !g_file_get_contents ( script, &contents, NULL, &error ) ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+      return FALSE;
+    }
+  }
+  else
+    contents = g_strdup ( default_script );
+
+  BenchRender br = { 0 };
+  br.vvp = vik_window_viewport ( vw );
+  br.width = BENCH_DEFAULT_WIDTH;
+  br.height = BENCH_DEFAULT_HEIGHT;
+  br.layers = g_array_new ( FALSE, TRUE, sizeof(LayerTiming) );
+  VikAggregateLayer *top = vik_layers_panel_get_top_layer ( vik_window_layers_panel ( vw ) );
+  for ( const GList *iter = vik_aggregate_layer_get_children ( top ); iter; iter = iter->next ) {
+    LayerTiming lt = { VIK_LAYER(iter->data), 0, 0.0, 0.0, 0 };
+    if ( lt.vl->visible )
+      g_array_append_val ( br.layers, lt );
+  }
+
+  // Whatever happens in the meantime (e.g. file loading)
+  settle ( 0 );
+
+  gchar **lines = g_strsplit ( contents, "\n", -1 );
+  for ( guint nn = 0; lines[nn]; nn++ ) {
+    gchar *comment = strchr ( lines[nn], '#' );
+    if ( comment )
+      *comment = '\0';
+    gchar **args = g_strsplit_set ( g_strstrip(lines[nn]), " \t", -1 );
+    // Drop empty fields from repeated spaces
+    guint kept = 0;
+    for ( guint aa = 0; args[aa]; aa++ ) {
+      if ( *args[aa] )
+        args[kept++] = args[aa];
+      else
+        g_free ( args[aa] );
+    }
+    args[kept] = NULL;
+    if ( kept )
+      run_command ( &br, args, nn+1 );
+    g_strfreev ( args );
+  }
+  g_strfreev ( lines );
+  g_free ( contents );
+
+  report ( &br );
+  g_array_free ( br.layers, TRUE );
+  return TRUE;
+}
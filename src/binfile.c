@@ -0,0 +1,1326 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * A binary form of the Viking file.
+ *
+ * It holds the same information as the text format (see file.c and gpspoint.c),
+ *  but numbers are kept in their binary form so loading does not have to parse every coordinate.
+ *
+ * All values are little-endian. The file starts with:
+ *   8 byte magic, guint32 version, guint32 reserved
+ * followed by a sequence of chunks, each being:
+ *   4 byte id, guint8 compression, 3 reserved bytes, guint64 stored size, guint64 original size
+ *   then the stored bytes
+ *
+ * Layers nest in the same way as ~Layer / ~EndLayer of the text format.
+ * Chunks with an unknown id are skipped, so later versions may add more.
+ *
+ * A TrackWaypoint layer's data is preceded by a summary of its extent,
+ *  so that reading all the items can be put off until they are actually needed.
+ * The data itself ends with the summary values of each track and route (see VikTrackSummary);
+ *  being last, older versions simply stop reading before them.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+#include <gio/gio.h>
+
+#include "viking.h"
+#include "binfile.h"
+#include "vikgpslayer.h"
+
+#define VIK_BINARY_FILE_VERSION 1
+
+#define VIK_SETTINGS_BINARY_FILE_COMPRESS "binary_file_compress"
+#define VIK_SETTINGS_BINARY_FILE_DEFER "binary_file_defer_load"
+
+#define CHUNK_ID(a,b,c,d) ((guint32)(a) | ((guint32)(b) << 8) | ((guint32)(c) << 16) | ((guint32)(d) << 24))
+#define CHUNK_VIEWPORT    CHUNK_ID('V','I','E','W')
+#define CHUNK_TOPLAYER    CHUNK_ID('T','O','P','L')
+#define CHUNK_ENDTOPLAYER CHUNK_ID('E','N','D','T')
+#define CHUNK_LAYER       CHUNK_ID('L','A','Y','R')
+#define CHUNK_LAYERBOUNDS CHUNK_ID('B','N','D','S')
+#define CHUNK_LAYERDATA   CHUNK_ID('D','A','T','A')
+#define CHUNK_ENDLAYER    CHUNK_ID('E','N','D','L')
+
+#define CHUNK_HEADER_SIZE 24
+
+typedef enum {
+  BIN_COMPRESSION_NONE = 0,
+  BIN_COMPRESSION_ZLIB,      // Raw deflate stream
+} BinCompression;
+
+// Not worth compressing small chunks
+#define BIN_COMPRESS_MIN 4096
+// Nor deferring the reading of small layers
+#define BIN_DEFER_MIN 65536
+
+#define BIN_NULL_STRING G_MAXUINT32
+
+// Trackpoint & waypoint flags
+#define BIN_TP_NEWSEGMENT 1
+#define BIN_WP_VISIBLE    1
+#define BIN_WP_HIDE_NAME  2
+#define BIN_TRK_VISIBLE   1
+#define BIN_TRK_HAS_COLOR 2
+
+/* ---------------------------------------------------- */
+
+static void put_u8 ( GByteArray *ba, guint8 value )
+{
+  g_byte_array_append ( ba, &value, 1 );
+}
+
+static void put_u16 ( GByteArray *ba, guint16 value )
+{
+  value = GUINT16_TO_LE ( value );
+  g_byte_array_append ( ba, (guint8*)&value, sizeof(value) );
+}
+
+static void put_u32 ( GByteArray *ba, guint32 value )
+{
+  value = GUINT32_TO_LE ( value );
+  g_byte_array_append ( ba, (guint8*)&value, sizeof(value) );
+}
+
+static void put_u64 ( GByteArray *ba, guint64 value )
+{
+  value = GUINT64_TO_LE ( value );
+  g_byte_array_append ( ba, (guint8*)&value, sizeof(value) );
+}
+
+static void put_double ( GByteArray *ba, gdouble value )
+{
+  guint64 bits;
+  memcpy ( &bits, &value, sizeof(bits) );
+  put_u64 ( ba, bits );
+}
+
+static void put_string ( GByteArray *ba, const gchar *str )
+{
+  if ( !str ) {
+    put_u32 ( ba, BIN_NULL_STRING );
+    return;
+  }
+  guint32 len = strlen ( str );
+  put_u32 ( ba, len );
+  g_byte_array_append ( ba, (const guint8*)str, len );
+}
+
+typedef struct {
+  const guint8 *ptr;
+  const guint8 *end;
+  gboolean short_read; // Tried to read beyond the end
+} BinReader;
+
+static gboolean have_bytes ( BinReader *br, gsize size )
+{
+  if ( br->short_read || (gsize)(br->end - br->ptr) < size ) {
+    br->short_read = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static guint8 get_u8 ( BinReader *br )
+{
+  if ( !have_bytes ( br, 1 ) )
+    return 0;
+  return *br->ptr++;
+}
+
+static guint16 get_u16 ( BinReader *br )
+{
+  guint16 value = 0;
+  if ( have_bytes ( br, sizeof(value) ) ) {
+    memcpy ( &value, br->ptr, sizeof(value) );
+    br->ptr += sizeof(value);
+  }
+  return GUINT16_FROM_LE ( value );
+}
+
+static guint32 get_u32 ( BinReader *br )
+{
+  guint32 value = 0;
+  if ( have_bytes ( br, sizeof(value) ) ) {
+    memcpy ( &value, br->ptr, sizeof(value) );
+    br->ptr += sizeof(value);
+  }
+  return GUINT32_FROM_LE ( value );
+}
+
+static guint64 get_u64 ( BinReader *br )
+{
+  guint64 value = 0;
+  if ( have_bytes ( br, sizeof(value) ) ) {
+    memcpy ( &value, br->ptr, sizeof(value) );
+    br->ptr += sizeof(value);
+  }
+  return GUINT64_FROM_LE ( value );
+}
+
+static gdouble get_double ( BinReader *br )
+{
+  guint64 bits = get_u64 ( br );
+  gdouble value;
+  memcpy ( &value, &bits, sizeof(value) );
+  return value;
+}
+
+/**
+ * Returns a newly allocated string or NULL
+ */
+static gchar *get_string ( BinReader *br )
+{
+  guint32 len = get_u32 ( br );
+  if ( len == BIN_NULL_STRING || !have_bytes ( br, len ) )
+    return NULL;
+  gchar *str = g_strndup ( (const gchar*)br->ptr, len );
+  br->ptr += len;
+  return str;
+}
+
+/**
+ * Returns the shared copy of the string (see g_intern_string()) or NULL
+ */
+static const gchar *get_interned_string ( BinReader *br )
+{
+  gchar *str = get_string ( br );
+  const gchar *ans = str ? g_intern_string ( str ) : NULL;
+  g_free ( str );
+  return ans;
+}
+
+/* ---------------------------------------------------- */
+
+/**
+ * Run all the input through the converter
+ *
+ * Returns newly allocated output or NULL on failure
+ */
+static guint8 *convert_all ( GConverter *converter, const guint8 *in, gsize in_len, gsize size_hint, gsize *out_len )
+{
+  gsize capacity = MAX ( size_hint, 1024 );
+  guint8 *out = g_malloc ( capacity );
+  gsize total_read = 0;
+  gsize total_written = 0;
+
+  while ( TRUE ) {
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+    GError *error = NULL;
+    GConverterResult result = g_converter_convert ( converter,
+                                                    in + total_read, in_len - total_read,
+                                                    out + total_written, capacity - total_written,
+                                                    G_CONVERTER_INPUT_AT_END,
+                                                    &bytes_read, &bytes_written, &error );
+    total_read += bytes_read;
+    total_written += bytes_written;
+    if ( result == G_CONVERTER_FINISHED )
+      break;
+    if ( result == G_CONVERTER_ERROR ) {
+      if ( !g_error_matches ( error, G_IO_ERROR, G_IO_ERROR_NO_SPACE ) ) {
+        g_warning ( "%s: %s", __FUNCTION__, error->message );
+        g_error_free ( error );
+        g_free ( out );
+        return NULL;
+      }
+      g_error_free ( error );
+    }
+    else if ( bytes_read || bytes_written )
+      // Progress made, try again with what is left
+      continue;
+    capacity *= 2;
+    out = g_realloc ( out, capacity );
+  }
+  *out_len = total_written;
+  return out;
+}
+
+static void write_chunk ( FILE *f, guint32 id, const GByteArray *ba, gboolean compress )
+{
+  const guint8 *data = ba ? ba->data : NULL;
+  gsize len = ba ? ba->len : 0;
+  gsize stored = len;
+  guint8 compression = BIN_COMPRESSION_NONE;
+  guint8 *packed = NULL;
+
+  if ( compress && len > BIN_COMPRESS_MIN ) {
+    // Favour speed, as the main point of this format is fast loading & saving
+    GZlibCompressor *zc = g_zlib_compressor_new ( G_ZLIB_COMPRESSOR_FORMAT_RAW, 1 );
+    gsize packed_len = 0;
+    packed = convert_all ( G_CONVERTER(zc), data, len, len / 2, &packed_len );
+    g_object_unref ( zc );
+    if ( packed && packed_len < len ) {
+      data = packed;
+      stored = packed_len;
+      compression = BIN_COMPRESSION_ZLIB;
+    }
+  }
+
+  GByteArray *header = g_byte_array_sized_new ( CHUNK_HEADER_SIZE );
+  put_u32 ( header, id );
+  put_u8 ( header, compression );
+  put_u8 ( header, 0 );
+  put_u16 ( header, 0 );
+  put_u64 ( header, stored );
+  put_u64 ( header, len );
+  if ( fwrite ( header->data, 1, header->len, f ) != header->len ||
+       ( stored && fwrite ( data, 1, stored, f ) != stored ) )
+    g_warning ( "%s: failed to write chunk", __FUNCTION__ );
+  g_byte_array_free ( header, TRUE );
+  g_free ( packed );
+}
+
+/* ---------------------------------------------------- */
+
+static void write_viewport ( FILE *f, VikViewport *vp )
+{
+  GByteArray *ba = g_byte_array_new ();
+  struct LatLon ll;
+  vik_coord_to_latlon ( vik_viewport_get_center ( vp ), &ll );
+
+  // Same mode names as the text format, rather than relying on enumeration values
+  const gchar *modestring = NULL;
+  switch ( vik_viewport_get_drawmode ( vp ) ) {
+    case VIK_VIEWPORT_DRAWMODE_UTM: modestring = "utm"; break;
+    case VIK_VIEWPORT_DRAWMODE_EXPEDIA: modestring = "expedia"; break;
+    case VIK_VIEWPORT_DRAWMODE_MERCATOR: modestring = "mercator"; break;
+    case VIK_VIEWPORT_DRAWMODE_LATLON: modestring = "latlon"; break;
+    default: break;
+  }
+
+  put_double ( ba, vik_viewport_get_xmpp ( vp ) );
+  put_double ( ba, vik_viewport_get_ympp ( vp ) );
+  put_double ( ba, ll.lat );
+  put_double ( ba, ll.lon );
+  put_string ( ba, modestring );
+  put_string ( ba, vik_viewport_get_background_color ( vp ) );
+  put_string ( ba, vik_viewport_get_highlight_color ( vp ) );
+  put_u8 ( ba, vik_viewport_get_draw_scale ( vp ) );
+  put_u8 ( ba, vik_viewport_get_draw_centermark ( vp ) );
+  put_u8 ( ba, vik_viewport_get_draw_highlight ( vp ) );
+
+  write_chunk ( f, CHUNK_VIEWPORT, ba, FALSE );
+  g_byte_array_free ( ba, TRUE );
+}
+
+static void read_viewport ( BinReader *br, VikViewport *vp, struct LatLon *ll )
+{
+  gdouble xmpp = get_double ( br );
+  gdouble ympp = get_double ( br );
+  ll->lat = get_double ( br );
+  ll->lon = get_double ( br );
+  gchar *mode = get_string ( br );
+  gchar *color = get_string ( br );
+  gchar *highlight_color = get_string ( br );
+  gboolean draw_scale = get_u8 ( br );
+  gboolean draw_centermark = get_u8 ( br );
+  gboolean draw_highlight = get_u8 ( br );
+
+  if ( !br->short_read ) {
+    vik_viewport_set_xmpp ( vp, xmpp );
+    vik_viewport_set_ympp ( vp, ympp );
+    if ( g_strcmp0 ( mode, "utm" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_UTM );
+    else if ( g_strcmp0 ( mode, "expedia" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_EXPEDIA );
+    else if ( g_strcmp0 ( mode, "mercator" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_MERCATOR );
+    else if ( g_strcmp0 ( mode, "latlon" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_LATLON );
+    if ( color )
+      vik_viewport_set_background_color ( vp, color );
+    if ( highlight_color )
+      vik_viewport_set_highlight_color ( vp, highlight_color );
+    vik_viewport_set_draw_scale ( vp, draw_scale );
+    vik_viewport_set_draw_centermark ( vp, draw_centermark );
+    vik_viewport_set_draw_highlight ( vp, draw_highlight );
+  }
+  else {
+    ll->lat = 0.0;
+    ll->lon = 0.0;
+  }
+  g_free ( mode );
+  g_free ( color );
+  g_free ( highlight_color );
+}
+
+/**
+ * Decompress a chunk's stored bytes as necessary
+ *
+ * Returns the bytes to read (pointing into either the original or @unpacked, which must be freed)
+ *  or NULL on failure
+ */
+static const guint8 *unpack_chunk ( const guint8 *payload, gsize stored, guint8 compression, guint64 original, gsize *len, guint8 **unpacked )
+{
+  *unpacked = NULL;
+  *len = stored;
+  if ( compression == BIN_COMPRESSION_NONE )
+    return payload;
+
+  if ( compression == BIN_COMPRESSION_ZLIB ) {
+    GZlibDecompressor *zd = g_zlib_decompressor_new ( G_ZLIB_COMPRESSOR_FORMAT_RAW );
+    *unpacked = convert_all ( G_CONVERTER(zd), payload, stored, original + 1, len );
+    g_object_unref ( zd );
+    if ( *unpacked && *len == original )
+      return *unpacked;
+    g_warning ( "%s: Failed to decompress chunk", __FUNCTION__ );
+    g_free ( *unpacked );
+    *unpacked = NULL;
+  }
+  else
+    g_warning ( "%s: Unknown compression %d", __FUNCTION__, compression );
+  *len = 0;
+  return NULL;
+}
+
+/* ---------------------------------------------------- */
+
+struct _VikBinDeferred {
+  VikBinBounds bounds;
+  guint8 *stored; // Kept as in the file, so compressed data stays small
+  gsize stored_len;
+  guint8 compression;
+  guint64 original;
+  gchar *dirpath;
+};
+
+const VikBinBounds *a_binfile_deferred_get_bounds ( VikBinDeferred *bd )
+{
+  return &bd->bounds;
+}
+
+/**
+ * a_binfile_deferred_load:
+ *
+ * Read the held back data into the layer
+ *
+ * Returns whether the data was read completely
+ */
+gboolean a_binfile_deferred_load ( VikBinDeferred *bd, VikTrwLayer *trw )
+{
+  gsize len;
+  guint8 *unpacked;
+  const guint8 *data = unpack_chunk ( bd->stored, bd->stored_len, bd->compression, bd->original, &len, &unpacked );
+  gboolean ans = data && a_binfile_read_trw ( trw, data, len, bd->dirpath );
+  g_free ( unpacked );
+  return ans;
+}
+
+void a_binfile_deferred_free ( VikBinDeferred *bd )
+{
+  if ( !bd )
+    return;
+  g_free ( bd->stored );
+  g_free ( bd->dirpath );
+  g_free ( bd );
+}
+
+static VikBinDeferred *deferred_new ( const VikBinBounds *bounds, const guint8 *stored, gsize stored_len, guint8 compression, guint64 original, const gchar *dirpath )
+{
+  VikBinDeferred *bd = g_malloc0 ( sizeof(VikBinDeferred) );
+  bd->bounds = *bounds;
+  // Copied as the file itself may be overwritten before it's needed
+  bd->stored = g_malloc ( MAX(stored_len, 1) );
+  memcpy ( bd->stored, stored, stored_len );
+  bd->stored_len = stored_len;
+  bd->compression = compression;
+  bd->original = original;
+  bd->dirpath = g_strdup ( dirpath );
+  return bd;
+}
+
+static void write_bounds ( FILE *f, VikTrwLayer *trw )
+{
+  gdouble first = NAN;
+  gdouble last = NAN;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, vik_trw_layer_get_tracks ( trw ) );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    // Assume trackpoints are in time order
+    VikTrackpoint *tpt = vik_track_get_tp_first ( VIK_TRACK(value) );
+    if ( tpt && !isnan(tpt->timestamp) && ( isnan(first) || tpt->timestamp < first ) )
+      first = tpt->timestamp;
+    tpt = vik_track_get_tp_last ( VIK_TRACK(value) );
+    if ( tpt && !isnan(tpt->timestamp) && ( isnan(last) || tpt->timestamp > last ) )
+      last = tpt->timestamp;
+  }
+
+  LatLonBBox bbox = vik_trw_layer_get_bbox ( trw );
+  GByteArray *ba = g_byte_array_new ();
+  put_double ( ba, bbox.north );
+  put_double ( ba, bbox.south );
+  put_double ( ba, bbox.east );
+  put_double ( ba, bbox.west );
+  put_double ( ba, first );
+  put_double ( ba, last );
+  put_u32 ( ba, g_hash_table_size ( vik_trw_layer_get_waypoints ( trw ) ) );
+  put_u32 ( ba, g_hash_table_size ( vik_trw_layer_get_tracks ( trw ) ) );
+  put_u32 ( ba, g_hash_table_size ( vik_trw_layer_get_routes ( trw ) ) );
+  write_chunk ( f, CHUNK_LAYERBOUNDS, ba, FALSE );
+  g_byte_array_free ( ba, TRUE );
+}
+
+static void read_bounds ( BinReader *br, VikBinBounds *bounds )
+{
+  bounds->bbox.north = get_double ( br );
+  bounds->bbox.south = get_double ( br );
+  bounds->bbox.east = get_double ( br );
+  bounds->bbox.west = get_double ( br );
+  bounds->tracks_first = get_double ( br );
+  bounds->tracks_last = get_double ( br );
+  bounds->waypoints = get_u32 ( br );
+  bounds->tracks = get_u32 ( br );
+  bounds->routes = get_u32 ( br );
+}
+
+/* ---------------------------------------------------- */
+
+static void put_param ( GByteArray *ba, VikLayerParamType type, VikLayerParamData data )
+{
+  switch ( type ) {
+    case VIK_LAYER_PARAM_DOUBLE: put_double ( ba, data.d ); break;
+    case VIK_LAYER_PARAM_UINT: put_u32 ( ba, data.u ); break;
+    case VIK_LAYER_PARAM_INT: put_u32 ( ba, (guint32)data.i ); break;
+    case VIK_LAYER_PARAM_BOOLEAN: put_u8 ( ba, data.b ); break;
+    case VIK_LAYER_PARAM_STRING: put_string ( ba, data.s ? data.s : "" ); break;
+    case VIK_LAYER_PARAM_COLOR:
+      put_u16 ( ba, data.c.red );
+      put_u16 ( ba, data.c.green );
+      put_u16 ( ba, data.c.blue );
+      break;
+    case VIK_LAYER_PARAM_STRING_LIST:
+      put_u32 ( ba, g_list_length ( data.sl ) );
+      for ( GList *iter = data.sl; iter; iter = iter->next )
+        put_string ( ba, (const gchar*)iter->data );
+      break;
+    default: break;
+  }
+}
+
+/**
+ * Read a parameter value of the stored type
+ *
+ * Returns TRUE if the value needs freeing via free_param()
+ */
+static gboolean get_param ( BinReader *br, VikLayerParamType type, VikLayerParamData *data )
+{
+  memset ( data, 0, sizeof(VikLayerParamData) );
+  switch ( type ) {
+    case VIK_LAYER_PARAM_DOUBLE: data->d = get_double ( br ); break;
+    case VIK_LAYER_PARAM_UINT: data->u = get_u32 ( br ); break;
+    case VIK_LAYER_PARAM_INT: data->i = (gint32)get_u32 ( br ); break;
+    case VIK_LAYER_PARAM_BOOLEAN: data->b = get_u8 ( br ); break;
+    case VIK_LAYER_PARAM_STRING:
+      data->s = get_string ( br );
+      return TRUE;
+    case VIK_LAYER_PARAM_COLOR:
+      data->c.red = get_u16 ( br );
+      data->c.green = get_u16 ( br );
+      data->c.blue = get_u16 ( br );
+      break;
+    case VIK_LAYER_PARAM_STRING_LIST: {
+      guint32 count = get_u32 ( br );
+      GList *list = NULL;
+      for ( guint32 ii = 0; ii < count && !br->short_read; ii++ ) {
+        gchar *str = get_string ( br );
+        if ( str )
+          list = g_list_prepend ( list, str );
+      }
+      data->sl = g_list_reverse ( list );
+      return TRUE;
+    }
+    default:
+      // Unable to know how much to skip
+      br->short_read = TRUE;
+      break;
+  }
+  return FALSE;
+}
+
+static void free_param ( VikLayerParamType type, VikLayerParamData *data )
+{
+  if ( type == VIK_LAYER_PARAM_STRING )
+    g_free ( (gchar*)data->s );
+  else if ( type == VIK_LAYER_PARAM_STRING_LIST )
+    g_list_free_full ( data->sl, g_free );
+}
+
+/**
+ * As write_layer_params_and_data() of file.c
+ */
+static void write_layer ( FILE *f, guint32 id, VikLayer *l, const gchar *dirpath, gboolean compress )
+{
+  VikLayerInterface *vli = vik_layer_get_interface ( l->type );
+  GByteArray *ba = g_byte_array_new ();
+
+  put_string ( ba, vli->fixed_layer_name );
+  put_string ( ba, l->name ? l->name : "" );
+  put_u8 ( ba, l->visible );
+
+  guint32 count = 0;
+  guint count_pos = ba->len;
+  put_u32 ( ba, count );
+  if ( vli->params && vli->get_param ) {
+    for ( guint16 ii = 0; ii < vli->params_count; ii++ ) {
+      VikLayerParamType type = vli->params[ii].type;
+      if ( type == VIK_LAYER_PARAM_PTR || type == VIK_LAYER_PARAM_PTR_DEFAULT )
+        continue;
+      VikLayerParamData data = vli->get_param ( l, ii, TRUE );
+      put_string ( ba, vli->params[ii].name );
+      put_u8 ( ba, type );
+      put_param ( ba, type, data );
+      count++;
+    }
+  }
+  count = GUINT32_TO_LE ( count );
+  memcpy ( ba->data + count_pos, &count, sizeof(count) );
+
+  write_chunk ( f, id, ba, FALSE );
+  g_byte_array_free ( ba, TRUE );
+
+  if ( l->type == VIK_LAYER_TRW ) {
+    ba = g_byte_array_new ();
+    vik_trw_layer_write_file_binary ( VIK_TRW_LAYER(l), ba, dirpath );
+    // Only layers with actual contents (i.e. not external ones) are summarized
+    if ( ba->len )
+      write_bounds ( f, VIK_TRW_LAYER(l) );
+    write_chunk ( f, CHUNK_LAYERDATA, ba, compress );
+    g_byte_array_free ( ba, TRUE );
+  }
+}
+
+/**
+ * Apply the stored name, visibility and parameters (the layer type has already been read)
+ */
+static gboolean read_layer ( BinReader *br, VikLayer *l, VikViewport *vp, const gchar *dirpath )
+{
+  VikLayerInterface *vli = vik_layer_get_interface ( l->type );
+  gboolean success = TRUE;
+
+  gchar *name = get_string ( br );
+  if ( name )
+    vik_layer_rename ( l, name );
+  g_free ( name );
+  l->visible = get_u8 ( br );
+
+  guint32 count = get_u32 ( br );
+  for ( guint32 nn = 0; nn < count && !br->short_read; nn++ ) {
+    gchar *pname = get_string ( br );
+    VikLayerParamType type = get_u8 ( br );
+    VikLayerParamData data;
+    gboolean to_free = get_param ( br, type, &data );
+    if ( br->short_read || !pname ) {
+      if ( to_free )
+        free_param ( type, &data );
+      g_free ( pname );
+      break;
+    }
+
+    guint16 ii;
+    for ( ii = 0; ii < vli->params_count; ii++ )
+      if ( g_ascii_strcasecmp ( pname, vli->params[ii].name ) == 0 )
+        break;
+
+    if ( ii < vli->params_count && vli->params[ii].type == type ) {
+      VikLayerSetParam vlsp;
+      vlsp.id                  = ii;
+      vlsp.data                = data;
+      vlsp.vp                  = vp;
+      vlsp.is_file_operation   = TRUE;
+      vlsp.dirpath             = dirpath;
+      (void)vik_layer_set_param ( l, &vlsp );
+      // String lists are then the responsibility of the layer
+      if ( type == VIK_LAYER_PARAM_STRING_LIST )
+        to_free = FALSE;
+    }
+    else
+      // As file_read(), not considered a failure since parameters can change between versions
+      g_warning ( "%s: Unknown parameter %s", __FUNCTION__, pname );
+
+    if ( to_free )
+      free_param ( type, &data );
+    g_free ( pname );
+  }
+
+  if ( br->short_read )
+    success = FALSE;
+  return success;
+}
+
+static void write_layer_tree ( FILE *f, VikLayer *l, const gchar *dirpath, gboolean compress )
+{
+  write_layer ( f, CHUNK_LAYER, l, dirpath, compress );
+
+  const GList *children = NULL;
+  if ( l->type == VIK_LAYER_AGGREGATE && !vik_aggregate_layer_is_empty(VIK_AGGREGATE_LAYER(l)) )
+    children = vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(l) );
+  else if ( l->type == VIK_LAYER_GPS && !vik_gps_layer_is_empty(VIK_GPS_LAYER(l)) )
+    children = vik_gps_layer_get_children ( VIK_GPS_LAYER(l) );
+
+  for ( const GList *child = children; child; child = child->next )
+    write_layer_tree ( f, VIK_LAYER(child->data), dirpath, compress );
+
+  write_chunk ( f, CHUNK_ENDLAYER, NULL, FALSE );
+}
+
+/**
+ * a_binfile_write:
+ *
+ * Write the layers and viewport settings, as file_write() does for the text format
+ */
+void a_binfile_write ( VikAggregateLayer *top, FILE *f, VikViewport *vp, const gchar *dirpath )
+{
+  gboolean compress = TRUE;
+  gboolean tmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_BINARY_FILE_COMPRESS, &tmp ) )
+    compress = tmp;
+
+  GByteArray *header = g_byte_array_new ();
+  g_byte_array_append ( header, (const guint8*)VIK_BINARY_MAGIC, strlen(VIK_BINARY_MAGIC) );
+  put_u32 ( header, VIK_BINARY_FILE_VERSION );
+  put_u32 ( header, 0 );
+  if ( fwrite ( header->data, 1, header->len, f ) != header->len )
+    g_warning ( "%s: failed to write header", __FUNCTION__ );
+  g_byte_array_free ( header, TRUE );
+
+  write_viewport ( f, vp );
+
+  write_layer ( f, CHUNK_TOPLAYER, VIK_LAYER(top), dirpath, compress );
+  for ( const GList *child = vik_aggregate_layer_get_children ( top ); child; child = child->next )
+    write_layer_tree ( f, VIK_LAYER(child->data), dirpath, compress );
+  write_chunk ( f, CHUNK_ENDTOPLAYER, NULL, FALSE );
+}
+
+/**
+ * Finish off a layer read in, as on a ~EndLayer in file_read()
+ */
+static gboolean end_layer ( VikLayer *l, VikLayer *parent, VikViewport *vp )
+{
+  if ( !l || !parent )
+    return TRUE;
+  if ( parent->type == VIK_LAYER_AGGREGATE ) {
+    vik_aggregate_layer_add_layer ( VIK_AGGREGATE_LAYER(parent), l, FALSE );
+    vik_layer_post_read ( l, vp, TRUE );
+  }
+  else if ( parent->type != VIK_LAYER_GPS ) {
+    g_warning ( "%s: Layer inside non-Aggregate Layer (type %d)", __FUNCTION__, parent->type );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+#define STACK_TOP(stack) ( (stack)->len ? (VikLayer*)g_ptr_array_index((stack), (stack)->len-1) : NULL )
+
+static gboolean read_contents ( VikAggregateLayer *top, VikViewport *vp, const guint8 *data, gsize len, const gchar *dirpath )
+{
+  BinReader br = { data, data + len, FALSE };
+  gboolean successful_read = TRUE;
+  struct LatLon ll = { 0.0, 0.0 };
+  VikBinBounds bounds;
+  gboolean have_bounds = FALSE;
+
+  gboolean defer = TRUE;
+  gboolean tmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_BINARY_FILE_DEFER, &tmp ) )
+    defer = tmp;
+
+  if ( !have_bytes ( &br, strlen(VIK_BINARY_MAGIC) ) || memcmp ( br.ptr, VIK_BINARY_MAGIC, strlen(VIK_BINARY_MAGIC) ) != 0 )
+    return FALSE;
+  br.ptr += strlen(VIK_BINARY_MAGIC);
+  guint32 version = get_u32 ( &br );
+  (void)get_u32 ( &br );
+  g_debug ( "%s: reading binary file version %d", __FUNCTION__, version );
+  if ( version > VIK_BINARY_FILE_VERSION )
+    successful_read = FALSE;
+    // However we'll still carry and attempt to read whatever we can
+
+  // Layers currently being read - the bottom entry is the enclosing top layer
+  GPtrArray *stack = g_ptr_array_new ();
+  g_ptr_array_add ( stack, top );
+  gboolean in_toplayer = FALSE;
+
+  while ( !br.short_read && br.ptr < br.end ) {
+    guint32 id = get_u32 ( &br );
+    guint8 compression = get_u8 ( &br );
+    (void)get_u8 ( &br );
+    (void)get_u16 ( &br );
+    guint64 stored = get_u64 ( &br );
+    guint64 original = get_u64 ( &br );
+    if ( br.short_read || stored > (guint64)(br.end - br.ptr) ) {
+      successful_read = FALSE;
+      g_warning ( "%s: Truncated file", __FUNCTION__ );
+      break;
+    }
+    const guint8 *payload = br.ptr;
+    br.ptr += stored;
+    VikLayer *current = STACK_TOP ( stack );
+
+    if ( id == CHUNK_LAYERDATA && have_bounds && defer && original >= BIN_DEFER_MIN &&
+         current && current != VIK_LAYER(top) && current->type == VIK_LAYER_TRW ) {
+      // Just keep hold of the data, it's read in when the layer is first drawn or used
+      VikBinDeferred *bd = deferred_new ( &bounds, payload, stored, compression, original, dirpath );
+      have_bounds = FALSE;
+      if ( vik_trw_layer_set_deferred ( VIK_TRW_LAYER(current), bd ) )
+        continue;
+      a_binfile_deferred_free ( bd );
+    }
+
+    gsize payload_len;
+    guint8 *unpacked;
+    payload = unpack_chunk ( payload, stored, compression, original, &payload_len, &unpacked );
+    if ( !payload )
+      successful_read = FALSE;
+
+    BinReader cr = { payload, payload + payload_len, FALSE };
+
+    switch ( id ) {
+    case CHUNK_VIEWPORT:
+      if ( !in_toplayer && stack->len == 1 )
+        read_viewport ( &cr, vp, &ll );
+      break;
+    case CHUNK_TOPLAYER:
+      in_toplayer = TRUE;
+      g_free ( get_string ( &cr ) );
+      // No need to create the Top Layer, values replace the current
+      g_ptr_array_add ( stack, top );
+      if ( !read_layer ( &cr, VIK_LAYER(top), vp, dirpath ) )
+        successful_read = FALSE;
+      break;
+    case CHUNK_ENDTOPLAYER:
+      while ( stack->len > 1 ) {
+        VikLayer *vl = g_ptr_array_remove_index ( stack, stack->len-1 );
+        if ( vl != VIK_LAYER(top) ) {
+          g_warning ( "%s: Missing end of layer", __FUNCTION__ );
+          successful_read = FALSE;
+          (void)end_layer ( vl, STACK_TOP(stack), vp );
+        }
+        else
+          break;
+      }
+      in_toplayer = FALSE;
+      break;
+    case CHUNK_LAYER: {
+      VikLayer *vl = NULL;
+      gchar *type_name = get_string ( &cr );
+      VikLayerTypeEnum type = type_name ? vik_layer_type_from_string ( type_name ) : VIK_LAYER_NUM_TYPES;
+      if ( !current ) {
+        // Inside an invalid layer
+      }
+      else if ( current->type != VIK_LAYER_AGGREGATE && current->type != VIK_LAYER_GPS ) {
+        successful_read = FALSE;
+        g_warning ( "%s: Layer inside non-Aggregate Layer (type %d)", __FUNCTION__, current->type );
+      }
+      else if ( type == VIK_LAYER_NUM_TYPES ) {
+        successful_read = FALSE;
+        g_warning ( "%s: Unknown type %s", __FUNCTION__, type_name );
+      }
+      else if ( current->type == VIK_LAYER_GPS )
+        vl = VIK_LAYER(vik_gps_layer_get_a_child ( VIK_GPS_LAYER(current) ));
+      else
+        vl = vik_layer_create ( type, vp, FALSE );
+
+      if ( vl && !read_layer ( &cr, vl, vp, dirpath ) )
+        successful_read = FALSE;
+      g_ptr_array_add ( stack, vl );
+      have_bounds = FALSE;
+      g_free ( type_name );
+      break;
+    }
+    case CHUNK_LAYERBOUNDS:
+      read_bounds ( &cr, &bounds );
+      have_bounds = !cr.short_read;
+      break;
+    case CHUNK_LAYERDATA:
+      have_bounds = FALSE;
+      if ( current && current != VIK_LAYER(top) && current->type == VIK_LAYER_TRW )
+        if ( !vik_trw_layer_read_file_binary ( VIK_TRW_LAYER(current), cr.ptr, cr.end - cr.ptr, dirpath ) )
+          successful_read = FALSE;
+      break;
+    case CHUNK_ENDLAYER:
+      if ( stack->len <= 2 || current == VIK_LAYER(top) ) {
+        successful_read = FALSE;
+        g_warning ( "%s: Mismatched end of layer", __FUNCTION__ );
+      }
+      else {
+        g_ptr_array_remove_index ( stack, stack->len-1 );
+        if ( !end_layer ( current, STACK_TOP(stack), vp ) )
+          successful_read = FALSE;
+      }
+      break;
+    default:
+      g_debug ( "%s: skipping unknown chunk %08x", __FUNCTION__, id );
+      break;
+    }
+
+    if ( cr.short_read ) {
+      successful_read = FALSE;
+      g_warning ( "%s: Malformed chunk %08x", __FUNCTION__, id );
+    }
+    g_free ( unpacked );
+  }
+
+  if ( br.short_read )
+    successful_read = FALSE;
+
+  // Add in whatever was read of a truncated file
+  while ( stack->len > 1 ) {
+    VikLayer *vl = g_ptr_array_remove_index ( stack, stack->len-1 );
+    if ( vl != VIK_LAYER(top) ) {
+      successful_read = FALSE;
+      (void)end_layer ( vl, STACK_TOP(stack), vp );
+    }
+  }
+  g_ptr_array_free ( stack, TRUE );
+
+  if ( ll.lat != 0.0 || ll.lon != 0.0 )
+    vik_viewport_set_center_latlon ( vp, &ll, TRUE );
+
+  if ( ( ! VIK_LAYER(top)->visible ) && VIK_LAYER(top)->realized )
+    vik_treeview_item_set_visible ( VIK_LAYER(top)->vt, &(VIK_LAYER(top)->iter), FALSE );
+  if ( VIK_LAYER(top)->realized )
+    vik_treeview_item_set_name ( VIK_LAYER(top)->vt, &(VIK_LAYER(top)->iter), VIK_LAYER(top)->name );
+
+  return successful_read;
+}
+
+/**
+ * a_binfile_read:
+ * @f:        The already opened file (only used if it can't be mapped, e.g. from stdin)
+ * @filename: The file to map into memory
+ *
+ * Returns how successful the parsing was, see file_read()
+ */
+gboolean a_binfile_read ( VikAggregateLayer *top, VikViewport *vp, FILE *f, const gchar *filename, const gchar *dirpath )
+{
+  GMappedFile *mf = NULL;
+  GByteArray *contents = NULL;
+  const guint8 *data;
+  gsize len;
+
+  if ( g_strcmp0 ( filename, "-" ) != 0 ) {
+    GError *error = NULL;
+    mf = g_mapped_file_new ( filename, FALSE, &error );
+    if ( error ) {
+      g_warning ( "%s: Couldn't map %s: %s", __FUNCTION__, filename, error->message );
+      g_error_free ( error );
+    }
+  }
+
+  if ( mf ) {
+    data = (const guint8*)g_mapped_file_get_contents ( mf );
+    len = g_mapped_file_get_length ( mf );
+  }
+  else {
+    contents = g_byte_array_new ();
+    guint8 buffer[65536];
+    size_t nn;
+    while ( (nn = fread ( buffer, 1, sizeof(buffer), f )) > 0 )
+      g_byte_array_append ( contents, buffer, nn );
+    data = contents->data;
+    len = contents->len;
+  }
+
+  gboolean ans = read_contents ( top, vp, data, len, dirpath );
+
+  if ( mf )
+    g_mapped_file_unref ( mf );
+  if ( contents )
+    g_byte_array_free ( contents, TRUE );
+  return ans;
+}
+
+/* ---------------------------------------------------- */
+
+static void put_coord ( GByteArray *ba, const VikCoord *coord )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  put_double ( ba, ll.lat );
+  put_double ( ba, ll.lon );
+}
+
+static void write_waypoint ( GByteArray *ba, const VikWaypoint *wp, const gchar *dirpath )
+{
+  const VikWaypointExtra *extra = vik_waypoint_get_extra ( wp );
+  put_coord ( ba, &wp->coord );
+  put_string ( ba, wp->name );
+  put_u8 ( ba, (wp->visible ? BIN_WP_VISIBLE : 0) | (wp->hide_name ? BIN_WP_HIDE_NAME : 0) );
+  put_double ( ba, wp->altitude );
+  put_double ( ba, wp->timestamp );
+  put_double ( ba, wp->speed );
+  put_double ( ba, wp->course );
+  put_double ( ba, extra->magvar );
+  put_double ( ba, extra->geoidheight );
+  put_string ( ba, wp->comment );
+  put_string ( ba, wp->description );
+  put_string ( ba, wp->source );
+  put_string ( ba, wp->url );
+  put_string ( ba, wp->url_name );
+  put_string ( ba, wp->type );
+  put_u32 ( ba, extra->fix_mode );
+  put_u32 ( ba, extra->nsats );
+  put_double ( ba, extra->hdop );
+  put_double ( ba, extra->vdop );
+  put_double ( ba, extra->pdop );
+  put_double ( ba, extra->ageofdgpsdata );
+  put_u32 ( ba, extra->dgpsid );
+  put_double ( ba, wp->proximity );
+
+  // As a_gpspoint_write_waypoint()
+  gchar *image = NULL;
+  if ( wp->image && a_vik_get_file_ref_format() == VIK_FILE_REF_FORMAT_RELATIVE && dirpath )
+    image = g_strdup ( file_GetRelativeFilename ( (gchar*)dirpath, wp->image ) );
+  put_string ( ba, image ? image : wp->image );
+  g_free ( image );
+  put_double ( ba, wp->image_direction );
+  put_u32 ( ba, wp->image_direction_ref );
+
+  gchar *symbol = wp->symbol ? g_utf8_strdown ( wp->symbol, -1 ) : NULL;
+  put_string ( ba, symbol );
+  g_free ( symbol );
+  put_string ( ba, wp->extensions );
+}
+
+static void write_trackpoint ( GByteArray *ba, const VikTrackpoint *tp )
+{
+  put_coord ( ba, &tp->coord );
+  put_u8 ( ba, tp->newsegment ? BIN_TP_NEWSEGMENT : 0 );
+  put_double ( ba, tp->timestamp );
+  put_double ( ba, tp->altitude );
+  put_double ( ba, tp->speed );
+  put_double ( ba, tp->course );
+  put_u32 ( ba, tp->nsats );
+  put_u32 ( ba, tp->fix_mode );
+  put_double ( ba, tp->hdop );
+  put_double ( ba, tp->vdop );
+  put_double ( ba, tp->pdop );
+  put_u32 ( ba, tp->heart_rate );
+  put_u32 ( ba, (guint32)tp->cadence );
+  put_double ( ba, tp->temp );
+  put_u32 ( ba, (guint32)tp->power );
+  put_string ( ba, tp->name );
+  put_string ( ba, tp->extensions );
+}
+
+static void write_track ( GByteArray *ba, const VikTrack *trk )
+{
+  put_string ( ba, trk->name );
+  put_u8 ( ba, (trk->visible ? BIN_TRK_VISIBLE : 0) | (trk->has_color ? BIN_TRK_HAS_COLOR : 0) );
+  put_string ( ba, trk->comment );
+  put_string ( ba, trk->description );
+  put_string ( ba, trk->source );
+  put_string ( ba, trk->url );
+  put_string ( ba, trk->url_name );
+  put_u32 ( ba, trk->number );
+  put_string ( ba, trk->type );
+  put_u16 ( ba, trk->color.red );
+  put_u16 ( ba, trk->color.green );
+  put_u16 ( ba, trk->color.blue );
+  put_u32 ( ba, trk->draw_name_mode );
+  put_u8 ( ba, trk->max_number_dist_labels );
+  put_string ( ba, trk->extensions );
+
+  put_u32 ( ba, g_list_length ( trk->trackpoints ) );
+  for ( const GList *iter = trk->trackpoints; iter; iter = iter->next )
+    write_trackpoint ( ba, VIK_TRACKPOINT(iter->data) );
+}
+
+static void write_summary ( GByteArray *ba, const VikTrack *trk )
+{
+  VikTrackSummary sum;
+  if ( !vik_track_get_summary ( trk, &sum ) ) {
+    put_u8 ( ba, 0 );
+    return;
+  }
+  put_u8 ( ba, 1 );
+  put_u32 ( ba, sum.tp_count );
+  put_double ( ba, sum.first_timestamp );
+  put_double ( ba, sum.last_timestamp );
+  put_double ( ba, sum.length );
+  put_double ( ba, sum.length_including_gaps );
+  put_double ( ba, sum.timed_length );
+  put_double ( ba, sum.duration );
+  put_double ( ba, sum.max_speed );
+  put_double ( ba, sum.max_speed_by_gps );
+  put_double ( ba, sum.elev_up );
+  put_double ( ba, sum.elev_down );
+  put_double ( ba, sum.min_alt );
+  put_double ( ba, sum.max_alt );
+  put_u32 ( ba, sum.max_heart_rate );
+  put_double ( ba, sum.heart_rate_sum );
+  put_u64 ( ba, sum.heart_rate_count );
+  put_double ( ba, sum.bbox.north );
+  put_double ( ba, sum.bbox.south );
+  put_double ( ba, sum.bbox.east );
+  put_double ( ba, sum.bbox.west );
+}
+
+/**
+ * NB The tracks are appended to @written, in the order they are written out
+ */
+static void write_tracks ( GByteArray *ba, GHashTable *tracks, GPtrArray *written )
+{
+  put_u32 ( ba, g_hash_table_size ( tracks ) );
+  GList *gl = vu_sorted_list_from_hash_table ( tracks, VL_SO_NONE, VIKING_TRACK );
+  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) ) {
+    VikTrack *trk = (VikTrack*)((SortTRWHashT*)it->data)->data;
+    write_track ( ba, trk );
+    g_ptr_array_add ( written, trk );
+  }
+  g_list_free_full ( gl, g_free );
+}
+
+/**
+ * a_binfile_write_trw:
+ *
+ * The binary equivalent of a_gpspoint_write_file(),
+ *  again in the order the items have been read in
+ */
+void a_binfile_write_trw ( VikTrwLayer *trw, GByteArray *ba, const gchar *dirpath )
+{
+  GHashTable *waypoints = vik_trw_layer_get_waypoints ( trw );
+  put_u32 ( ba, g_hash_table_size ( waypoints ) );
+  GList *gl = vu_sorted_list_from_hash_table ( waypoints, VL_SO_NONE, VIKING_WAYPOINT );
+  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
+    write_waypoint ( ba, (VikWaypoint*)((SortTRWHashT*)it->data)->data, dirpath );
+  g_list_free_full ( gl, g_free );
+
+  GPtrArray *written = g_ptr_array_new ();
+  write_tracks ( ba, vik_trw_layer_get_tracks ( trw ), written );
+  write_tracks ( ba, vik_trw_layer_get_routes ( trw ), written );
+
+  put_u32 ( ba, written->len );
+  for ( guint ii = 0; ii < written->len; ii++ )
+    write_summary ( ba, g_ptr_array_index(written, ii) );
+  g_ptr_array_free ( written, TRUE );
+}
+
+static void get_coord ( BinReader *br, VikCoordMode coord_mode, VikCoord *coord )
+{
+  struct LatLon ll;
+  ll.lat = get_double ( br );
+  ll.lon = get_double ( br );
+  vik_coord_load_from_latlon ( coord, coord_mode, &ll );
+}
+
+static VikWaypoint *read_waypoint ( BinReader *br, VikCoordMode coord_mode, const gchar *dirpath, gchar **name )
+{
+  VikWaypoint *wp = vik_waypoint_new ();
+  get_coord ( br, coord_mode, &wp->coord );
+  *name = get_string ( br );
+  guint8 flags = get_u8 ( br );
+  wp->visible = flags & BIN_WP_VISIBLE;
+  wp->hide_name = (flags & BIN_WP_HIDE_NAME) ? TRUE : FALSE;
+  wp->altitude = get_double ( br );
+  wp->timestamp = get_double ( br );
+  wp->speed = get_double ( br );
+  wp->course = get_double ( br );
+  VikWaypointExtra *extra = vik_waypoint_edit_extra ( wp );
+  extra->magvar = get_double ( br );
+  extra->geoidheight = get_double ( br );
+  wp->comment = get_string ( br );
+  wp->description = get_string ( br );
+  wp->source = get_interned_string ( br );
+  wp->url = get_string ( br );
+  wp->url_name = get_string ( br );
+  wp->type = get_interned_string ( br );
+  extra->fix_mode = get_u32 ( br );
+  extra->nsats = get_u32 ( br );
+  extra->hdop = get_double ( br );
+  extra->vdop = get_double ( br );
+  extra->pdop = get_double ( br );
+  extra->ageofdgpsdata = get_double ( br );
+  extra->dgpsid = get_u32 ( br );
+  vik_waypoint_trim_extra ( wp );
+  wp->proximity = get_double ( br );
+
+  gchar *image = get_string ( br );
+  if ( image ) {
+    gchar *fn = util_make_absolute_filename ( image, dirpath );
+    vik_waypoint_set_image ( wp, fn ? fn : image );
+    g_free ( fn );
+    g_free ( image );
+  }
+  wp->image_direction = get_double ( br );
+  wp->image_direction_ref = get_u32 ( br );
+
+  gchar *symbol = get_string ( br );
+  if ( symbol ) {
+    vik_waypoint_set_symbol ( wp, symbol );
+    g_free ( symbol );
+  }
+  wp->extensions = get_string ( br );
+  return wp;
+}
+
+static VikTrackpoint *read_trackpoint ( BinReader *br, VikCoordMode coord_mode )
+{
+  VikTrackpoint *tp = vik_trackpoint_new ();
+  get_coord ( br, coord_mode, &tp->coord );
+  tp->newsegment = (get_u8 ( br ) & BIN_TP_NEWSEGMENT) ? TRUE : FALSE;
+  tp->timestamp = get_double ( br );
+  tp->altitude = get_double ( br );
+  tp->speed = get_double ( br );
+  tp->course = get_double ( br );
+  tp->nsats = get_u32 ( br );
+  tp->fix_mode = get_u32 ( br );
+  tp->hdop = get_double ( br );
+  tp->vdop = get_double ( br );
+  tp->pdop = get_double ( br );
+  tp->heart_rate = get_u32 ( br );
+  tp->cadence = (gint32)get_u32 ( br );
+  tp->temp = get_double ( br );
+  tp->power = (gint32)get_u32 ( br );
+  tp->name = get_string ( br );
+  tp->extensions = get_string ( br );
+  return tp;
+}
+
+static VikTrack *read_track ( BinReader *br, VikCoordMode coord_mode, gboolean is_route, gchar **name )
+{
+  VikTrack *trk = vik_track_new ();
+  trk->is_route = is_route;
+  *name = get_string ( br );
+  guint8 flags = get_u8 ( br );
+  trk->visible = flags & BIN_TRK_VISIBLE;
+  trk->has_color = (flags & BIN_TRK_HAS_COLOR) ? TRUE : FALSE;
+  trk->comment = get_string ( br );
+  trk->description = get_string ( br );
+  trk->source = get_string ( br );
+  trk->url = get_string ( br );
+  trk->url_name = get_string ( br );
+  trk->number = get_u32 ( br );
+  trk->type = get_string ( br );
+  trk->color.red = get_u16 ( br );
+  trk->color.green = get_u16 ( br );
+  trk->color.blue = get_u16 ( br );
+  trk->draw_name_mode = get_u32 ( br );
+  if ( trk->draw_name_mode >= NUM_TRACK_DRAWNAMES )
+    trk->draw_name_mode = TRACK_DRAWNAME_NO;
+  trk->max_number_dist_labels = get_u8 ( br );
+  trk->extensions = get_string ( br );
+
+  guint32 count = get_u32 ( br );
+  // Much faster to prepend and then reverse list once all points read in
+  for ( guint32 ii = 0; ii < count && !br->short_read; ii++ )
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, read_trackpoint ( br, coord_mode ) );
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  return trk;
+}
+
+/**
+ * Returns whether a summary could be read in, even if it was then not used for the track
+ */
+static gboolean read_summary ( BinReader *br, VikTrack *trk )
+{
+  if ( !get_u8 ( br ) )
+    return !br->short_read;
+
+  VikTrackSummary sum;
+  sum.tp_count = get_u32 ( br );
+  sum.first_timestamp = get_double ( br );
+  sum.last_timestamp = get_double ( br );
+  sum.length = get_double ( br );
+  sum.length_including_gaps = get_double ( br );
+  sum.timed_length = get_double ( br );
+  sum.duration = get_double ( br );
+  sum.max_speed = get_double ( br );
+  sum.max_speed_by_gps = get_double ( br );
+  sum.elev_up = get_double ( br );
+  sum.elev_down = get_double ( br );
+  sum.min_alt = get_double ( br );
+  sum.max_alt = get_double ( br );
+  sum.max_heart_rate = get_u32 ( br );
+  sum.heart_rate_sum = get_double ( br );
+  sum.heart_rate_count = get_u64 ( br );
+  sum.bbox.north = get_double ( br );
+  sum.bbox.south = get_double ( br );
+  sum.bbox.east = get_double ( br );
+  sum.bbox.west = get_double ( br );
+  if ( br->short_read )
+    return FALSE;
+
+  if ( !vik_track_set_summary ( trk, &sum ) )
+    g_debug ( "%s: Summary does not match the trackpoints of %s", __FUNCTION__, trk->name );
+  return TRUE;
+}
+
+/**
+ * a_binfile_read_trw:
+ *
+ * The binary equivalent of a_gpspoint_read_file()
+ *
+ * Returns whether the data was read completely
+ */
+gboolean a_binfile_read_trw ( VikTrwLayer *trw, const guint8 *data, gsize len, const gchar *dirpath )
+{
+  VikCoordMode coord_mode = vik_trw_layer_get_coord_mode ( trw );
+  BinReader br = { data, data + len, FALSE };
+  gchar *name;
+
+  guint32 count = get_u32 ( &br );
+  for ( guint32 ii = 0; ii < count && !br.short_read; ii++ ) {
+    VikWaypoint *wp = read_waypoint ( &br, coord_mode, dirpath, &name );
+    if ( br.short_read || !name ) {
+      vik_waypoint_free ( wp );
+      g_free ( name );
+      break;
+    }
+    vik_trw_layer_filein_add_waypoint ( trw, name, wp );
+    g_free ( name );
+  }
+
+  // Tracks may get merged into others when added, so can't rely on them still being around
+  GPtrArray *tracks = g_ptr_array_new_with_free_func ( (GDestroyNotify)vik_track_free );
+  for ( guint route = 0; route < 2; route++ ) {
+    count = get_u32 ( &br );
+    for ( guint32 ii = 0; ii < count && !br.short_read; ii++ ) {
+      VikTrack *trk = read_track ( &br, coord_mode, route, &name );
+      if ( br.short_read || !name ) {
+        vik_track_free ( trk );
+        g_free ( name );
+        break;
+      }
+      vik_track_ref ( trk );
+      g_ptr_array_add ( tracks, trk );
+      vik_trw_layer_filein_add_track ( trw, name, trk );
+      g_free ( name );
+    }
+  }
+
+  gboolean ok = !br.short_read;
+  // Files from older versions end without the summaries
+  if ( ok && br.ptr < br.end ) {
+    count = get_u32 ( &br );
+    if ( count == tracks->len ) {
+      for ( guint32 ii = 0; ii < count; ii++ )
+        if ( !read_summary ( &br, g_ptr_array_index(tracks, ii) ) )
+          break;
+    }
+  }
+  g_ptr_array_free ( tracks, TRUE );
+
+  return ok;
+}
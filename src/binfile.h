@@ -0,0 +1,59 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_BINFILE_H
+#define __VIKING_BINFILE_H
+
+#include <stdio.h>
+#include <glib.h>
+#include "vikaggregatelayer.h"
+#include "viktrwlayer.h"
+#include "vikviewport.h"
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+// Saving to a file with this extension uses the binary format
+#define VIK_BINARY_FILE_EXT ".vikb"
+// 8 bytes, in the style of PNG to detect text mode transfer mangling
+#define VIK_BINARY_MAGIC "\x89VIKB\r\n\x1a"
+
+// Summary of a TrackWaypoint layer's contents, stored ahead of them
+typedef struct {
+  LatLonBBox bbox;
+  gdouble tracks_first; // Earliest and latest track times, NAN if none
+  gdouble tracks_last;
+  guint32 waypoints;
+  guint32 tracks;
+  guint32 routes;
+} VikBinBounds;
+
+void a_binfile_write ( VikAggregateLayer *top, FILE *f, VikViewport *vp, const gchar *dirpath );
+gboolean a_binfile_read ( VikAggregateLayer *top, VikViewport *vp, FILE *f, const gchar *filename, const gchar *dirpath );
+
+void a_binfile_write_trw ( VikTrwLayer *trw, GByteArray *ba, const gchar *dirpath );
+gboolean a_binfile_read_trw ( VikTrwLayer *trw, const guint8 *data, gsize len, const gchar *dirpath );
+
+const VikBinBounds *a_binfile_deferred_get_bounds ( VikBinDeferred *bd );
+gboolean a_binfile_deferred_load ( VikBinDeferred *bd, VikTrwLayer *trw );
+void a_binfile_deferred_free ( VikBinDeferred *bd );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Keep the size of map tile cache directories within a budget.
+ *
+ * The directory is measured in a background job, and if it's over the budget
+ *  the least recently accessed tiles are removed until it is comfortably under it.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#include "cachejanitor.h"
+#include "background.h"
+#include "tileindex.h"
+#include "vik_compat.h"
+
+// Don't rescan a directory more often than this (seconds)
+#define JANITOR_INTERVAL 600
+// Tile layouts are only a few levels deep
+#define JANITOR_MAX_DEPTH 4
+
+typedef struct {
+  guint64 bytes;
+  guint files;
+  gint64 checked;  // Monotonic time of the last scan
+  gboolean known;  // A scan has completed
+  gboolean running;
+} JanitorUsage;
+
+typedef struct {
+  gchar *dir;
+  guint64 budget; // Bytes, 0 for only measuring
+  VikWindow *vw;  // Report results to this window's statusbar (maybe NULL)
+} JanitorJob;
+
+typedef struct {
+  gchar *path;
+  gint64 atime;
+  gint64 size;
+} TileFile;
+
+typedef struct {
+  guint64 bytes;
+  guint files;
+  GArray *tiles; // Only filled in when eviction may be needed
+  gpointer threaddata;
+} JanitorScan;
+
+static GMutex *janitor_mutex = NULL;
+static GHashTable *janitor_usage = NULL; // dir -> JanitorUsage
+
+void a_cachejanitor_init ()
+{
+  janitor_mutex = vik_mutex_new ();
+  janitor_usage = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+}
+
+void a_cachejanitor_uninit ()
+{
+  g_hash_table_destroy ( janitor_usage );
+  janitor_usage = NULL;
+  vik_mutex_free ( janitor_mutex );
+  janitor_mutex = NULL;
+}
+
+/**
+ * Files Viking uses for its own purposes, rather than tiles
+ */
+static gboolean is_ignored ( const gchar *name )
+{
+  return name[0] == '.' || g_str_has_suffix ( name, ".tmp" );
+}
+
+/**
+ * Returns -1 if cancelled
+ */
+static gint scan_dir ( JanitorScan *scan, const gchar *path, gint depth, gdouble fraction, gdouble portion )
+{
+  GDir *dir = g_dir_open ( path, 0, NULL );
+  if ( !dir )
+    return 0;
+
+  GPtrArray *subdirs = g_ptr_array_new_with_free_func ( g_free );
+  const gchar *name;
+  while ( (name = g_dir_read_name(dir)) ) {
+    if ( is_ignored(name) )
+      continue;
+    gchar *fn = g_build_filename ( path, name, NULL );
+    GStatBuf st;
+    if ( g_stat(fn, &st) != 0 ) {
+      g_free ( fn );
+      continue;
+    }
+    if ( S_ISDIR(st.st_mode) ) {
+      if ( depth < JANITOR_MAX_DEPTH )
+        g_ptr_array_add ( subdirs, fn );
+      else
+        g_free ( fn );
+      continue;
+    }
+    scan->bytes += st.st_size;
+    // ETag sidecar files go with their tile
+    if ( g_str_has_suffix ( name, ".etag" ) ) {
+      g_free ( fn );
+      continue;
+    }
+    scan->files++;
+    if ( scan->tiles ) {
+      // Access times may not be updated (e.g. 'noatime' mounts), so also consider when it was written
+      TileFile tf = { fn, MAX(st.st_atime, st.st_mtime), st.st_size };
+      g_array_append_val ( scan->tiles, tf );
+    }
+    else
+      g_free ( fn );
+  }
+  g_dir_close ( dir );
+
+  gint ans = a_background_thread_progress ( scan->threaddata, fraction );
+  for ( guint ii = 0; ans == 0 && ii < subdirs->len; ii++ ) {
+    gdouble part = portion / subdirs->len;
+    ans = scan_dir ( scan, g_ptr_array_index(subdirs, ii), depth+1, fraction + part*ii, part );
+  }
+  g_ptr_array_free ( subdirs, TRUE );
+  return ans;
+}
+
+static gint tile_file_compare ( gconstpointer a, gconstpointer b )
+{
+  const TileFile *ta = a;
+  const TileFile *tb = b;
+  return ta->atime < tb->atime ? -1 : (ta->atime > tb->atime ? 1 : 0);
+}
+
+/**
+ * Remove the oldest tiles until under the budget (with some headroom so this is not needed again soon)
+ *
+ * Returns the number of tiles removed
+ */
+static guint evict ( JanitorScan *scan, guint64 budget )
+{
+  guint64 target = budget - budget / 10;
+  guint removed = 0;
+  g_array_sort ( scan->tiles, tile_file_compare );
+  for ( guint ii = 0; ii < scan->tiles->len && scan->bytes > target; ii++ ) {
+    if ( ii % 256 == 0 && a_background_cancelled ( scan->threaddata ) )
+      break;
+    TileFile *tf = &g_array_index ( scan->tiles, TileFile, ii );
+    if ( g_remove ( tf->path ) != 0 )
+      continue;
+    a_tileindex_remove ( tf->path );
+    scan->bytes -= MIN ( scan->bytes, (guint64)tf->size );
+    scan->files--;
+    removed++;
+
+    gchar *etag = g_strconcat ( tf->path, ".etag", NULL );
+    GStatBuf st;
+    if ( g_stat(etag, &st) == 0 && g_remove(etag) == 0 )
+      scan->bytes -= MIN ( scan->bytes, (guint64)st.st_size );
+    g_free ( etag );
+
+    // Tidy up now empty directories (only succeeds when empty)
+    gchar *parent = g_path_get_dirname ( tf->path );
+    (void)g_rmdir ( parent );
+    g_free ( parent );
+  }
+  return removed;
+}
+
+static void janitor_thread ( JanitorJob *job, gpointer threaddata )
+{
+  JanitorScan scan = { 0, 0, NULL, threaddata };
+  if ( job->budget )
+    scan.tiles = g_array_new ( FALSE, FALSE, sizeof(TileFile) );
+
+  guint removed = 0;
+  gboolean complete = scan_dir ( &scan, job->dir, 0, 0.0, 1.0 ) == 0;
+  if ( complete && job->budget && scan.bytes > job->budget )
+    removed = evict ( &scan, job->budget );
+
+  if ( scan.tiles ) {
+    for ( guint ii = 0; ii < scan.tiles->len; ii++ )
+      g_free ( g_array_index(scan.tiles, TileFile, ii).path );
+    g_array_free ( scan.tiles, TRUE );
+  }
+
+  if ( !complete )
+    return;
+
+  g_mutex_lock ( janitor_mutex );
+  JanitorUsage *usage = g_hash_table_lookup ( janitor_usage, job->dir );
+  if ( usage ) {
+    usage->bytes = scan.bytes;
+    usage->files = scan.files;
+    usage->known = TRUE;
+  }
+  g_mutex_unlock ( janitor_mutex );
+
+  if ( job->vw || removed ) {
+    gchar *size = g_format_size ( scan.bytes );
+    gchar *msg;
+    if ( removed )
+      msg = g_strdup_printf ( _("Map cache %s: %s in %u tiles (removed %u old tiles)"), job->dir, size, scan.files, removed );
+    else
+      msg = g_strdup_printf ( _("Map cache %s: %s in %u tiles"), job->dir, size, scan.files );
+    if ( job->vw )
+      vik_window_statusbar_update ( job->vw, msg, VIK_STATUSBAR_INFO );
+    else
+      g_debug ( "%s", msg );
+    g_free ( msg );
+    g_free ( size );
+  }
+}
+
+static void janitor_job_free ( JanitorJob *job )
+{
+  g_mutex_lock ( janitor_mutex );
+  JanitorUsage *usage = g_hash_table_lookup ( janitor_usage, job->dir );
+  if ( usage ) {
+    usage->running = FALSE;
+    usage->checked = g_get_monotonic_time ();
+  }
+  g_mutex_unlock ( janitor_mutex );
+  g_free ( job->dir );
+  g_free ( job );
+}
+
+/**
+ * a_cachejanitor_check:
+ * @dir:    The tile cache directory
+ * @budget: The maximum size in bytes of the directory, 0 means unlimited (so it's only measured)
+ * @vw:     The window to report the usage to
+ * @report: If TRUE always measure now and report the usage,
+ *          otherwise only check whether the budget is exceeded if not done recently
+ *
+ * Must be called from the main thread
+ */
+void a_cachejanitor_check ( const gchar *dir, guint64 budget, VikWindow *vw, gboolean report )
+{
+  if ( !janitor_mutex || !dir || !dir[0] )
+    return;
+  if ( !report && !budget )
+    return;
+
+  g_mutex_lock ( janitor_mutex );
+  JanitorUsage *usage = g_hash_table_lookup ( janitor_usage, dir );
+  if ( !usage ) {
+    usage = g_malloc0 ( sizeof(JanitorUsage) );
+    g_hash_table_insert ( janitor_usage, g_strdup(dir), usage );
+  }
+  else if ( usage->running ||
+            ( !report && (g_get_monotonic_time() - usage->checked) < (gint64)JANITOR_INTERVAL * G_USEC_PER_SEC ) ) {
+    g_mutex_unlock ( janitor_mutex );
+    return;
+  }
+  usage->running = TRUE;
+  g_mutex_unlock ( janitor_mutex );
+
+  if ( !g_file_test ( dir, G_FILE_TEST_IS_DIR ) ) {
+    // Nothing cached yet
+    g_mutex_lock ( janitor_mutex );
+    usage->running = FALSE;
+    usage->checked = g_get_monotonic_time ();
+    g_mutex_unlock ( janitor_mutex );
+    return;
+  }
+
+  JanitorJob *job = g_malloc0 ( sizeof(JanitorJob) );
+  job->dir = g_strdup ( dir );
+  job->budget = budget;
+  job->vw = report ? vw : NULL;
+
+  gchar *msg = g_strdup_printf ( _("Checking map cache %s"), dir );
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_BULK,
+                                      (GtkWindow*)vw, msg,
+                                      (vik_thr_func) janitor_thread,
+                                      job,
+                                      (vik_thr_free_func) janitor_job_free,
+                                      NULL,
+                                      1 );
+  g_free ( msg );
+}
+
+/**
+ * a_cachejanitor_get_usage:
+ *
+ * Returns TRUE if the directory has been measured, giving its size in bytes and number of tiles
+ */
+gboolean a_cachejanitor_get_usage ( const gchar *dir, guint64 *bytes, guint *files )
+{
+  gboolean known = FALSE;
+  if ( !janitor_mutex )
+    return FALSE;
+  g_mutex_lock ( janitor_mutex );
+  JanitorUsage *usage = g_hash_table_lookup ( janitor_usage, dir );
+  if ( usage && usage->known ) {
+    *bytes = usage->bytes;
+    *files = usage->files;
+    known = TRUE;
+  }
+  g_mutex_unlock ( janitor_mutex );
+  return known;
+}
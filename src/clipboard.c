@@ -430,18 +430,22 @@ void a_clipboard_copy_selected ( VikLayersPanel *vlp )
 
 void a_clipboard_copy( VikClipboardDataType type, guint16 layer_type, gint subtype, guint len, const gchar* text, guint8 * data)
 {
-  vik_clipboard_t * vc = g_malloc(sizeof(*vc) + len);
+  vik_clipboard_t * vc;
   GtkClipboard *c = gtk_clipboard_get ( GDK_SELECTION_CLIPBOARD );
 
+  // Take over the (potentially very large) data buffer, making room for the clipboard header in front of it
+  if ( data ) {
+    vc = g_realloc(data, sizeof(*vc) + len);
+    memmove(vc->data, vc, len);
+  }
+  else
+    vc = g_malloc(sizeof(*vc) + len);
+
   vc->type = type;
   vc->layer_type = layer_type;
   vc->subtype = subtype;
   vc->len = len;
   vc->text = g_strdup (text);
-  if ( data ) {
-    memcpy(vc->data, data, len);
-    g_free(data);
-  }
   vc->pid = getpid();
 
   // Simple clipboard copy when necessary
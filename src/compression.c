@@ -48,6 +48,378 @@
 #include <gio/gio.h>
 #include <glib/gstdio.h>
 
+#ifdef HAVE_ZIP_H
+// Older libzip compatibility:
+#ifndef zip_t
+typedef struct zip zip_t;
+typedef struct zip_file zip_file_t;
+#endif
+#ifndef ZIP_RDONLY
+#define ZIP_RDONLY 0
+#endif
+#endif
+
+// Sufficient to recognise the contents
+#define DECOMPRESS_PEEK_SIZE 4096
+
+typedef enum {
+	DS_PLAIN,
+	DS_GZIP,
+	DS_BZIP2,
+	DS_XZ,
+	DS_ZIP,
+} ds_kind_t;
+
+struct _VikDecompressStream {
+	ds_kind_t kind;
+	FILE *ff;
+	GInputStream *gis;
+#ifdef HAVE_BZLIB_H
+	BZFILE *bf;
+#endif
+#ifdef HAVE_LZMA_H
+	lzma_stream lstrm;
+	guint8 bufi[4096];
+#endif
+#ifdef HAVE_ZIP_H
+	zip_t *archive; // Only when owned by the stream
+	zip_file_t *zf;
+#endif
+	gboolean eof;
+	// Data read in advance by a_decompress_stream_peek()
+	guint8 *peek;
+	gsize peek_len;
+	gsize peek_pos;
+};
+
+static ds_kind_t decompress_kind ( const guint8 *magic, gsize len )
+{
+	if ( len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b )
+		return DS_GZIP;
+	if ( len >= 3 && memcmp(magic, "BZh", 3) == 0 )
+		return DS_BZIP2;
+	if ( len >= 6 && memcmp(magic, "\xfd" "7zXZ\0", 6) == 0 )
+		return DS_XZ;
+	// Legacy .lzma has no real magic, but nearly always starts like this
+	if ( len >= 3 && magic[0] == 0x5d && magic[1] == 0x00 && magic[2] == 0x00 )
+		return DS_XZ;
+	if ( len >= 4 && memcmp(magic, "PK\x03\x04", 4) == 0 )
+		return DS_ZIP;
+	return DS_PLAIN;
+}
+
+/**
+ * a_decompress_stream_open:
+ * @filename: A gzip, bzip2, xz/lzma or zip file - or otherwise taken to be uncompressed
+ *
+ * Open the file to be read decompressing as it goes, so nothing more than a block at a time is held.
+ * For a zip file only the first entry is read.
+ *
+ * Returns: The stream, close with a_decompress_stream_close(); or NULL on failure
+ */
+VikDecompressStream* a_decompress_stream_open ( const gchar *filename )
+{
+	FILE *ff = g_fopen ( filename, "rb" );
+	if ( !ff )
+		return NULL;
+	guint8 magic[6];
+	gsize len = fread ( magic, 1, sizeof(magic), ff );
+	rewind ( ff );
+
+	VikDecompressStream *ds = g_malloc0 ( sizeof(VikDecompressStream) );
+	ds->kind = decompress_kind ( magic, len );
+	ds->ff = ff;
+
+	switch ( ds->kind ) {
+	case DS_GZIP: {
+		(void)fclose ( ds->ff );
+		ds->ff = NULL;
+		GFile *gf = g_file_new_for_path ( filename );
+		GFileInputStream *fis = g_file_read ( gf, NULL, NULL );
+		g_object_unref ( gf );
+		if ( !fis )
+			goto fail;
+		GZlibDecompressor *decompressor = g_zlib_decompressor_new ( G_ZLIB_COMPRESSOR_FORMAT_GZIP );
+		ds->gis = g_converter_input_stream_new ( G_INPUT_STREAM(fis), G_CONVERTER(decompressor) );
+		g_object_unref ( decompressor );
+		g_object_unref ( fis );
+		break;
+	}
+	case DS_BZIP2: {
+#ifdef HAVE_BZLIB_H
+		int bzerror;
+		ds->bf = BZ2_bzReadOpen ( &bzerror, ds->ff, 0, 0, NULL, 0 );
+		if ( bzerror != BZ_OK ) {
+			g_warning ( "%s: BZ ReadOpen error on %s", __FUNCTION__, filename );
+			BZ2_bzReadClose ( &bzerror, ds->bf );
+			ds->bf = NULL;
+			goto fail;
+		}
+		break;
+#else
+		goto fail;
+#endif
+	}
+	case DS_XZ: {
+#ifdef HAVE_LZMA_H
+		lzma_stream init = LZMA_STREAM_INIT;
+		ds->lstrm = init;
+		if ( lzma_auto_decoder ( &ds->lstrm, UINT64_MAX, 0 ) != LZMA_OK )
+			goto fail;
+		break;
+#else
+		goto fail;
+#endif
+	}
+	case DS_ZIP: {
+#ifdef HAVE_ZIP_H
+		(void)fclose ( ds->ff );
+		ds->ff = NULL;
+		int zans = ZIP_ER_OK;
+		ds->archive = zip_open ( filename, ZIP_RDONLY, &zans );
+		if ( !ds->archive ) {
+			g_warning ( "%s: Unable to open archive: '%s' Error code %d", __FUNCTION__, filename, zans );
+			goto fail;
+		}
+		ds->zf = zip_fopen_index ( ds->archive, 0, 0 );
+		if ( !ds->zf )
+			goto fail;
+		break;
+#else
+		goto fail;
+#endif
+	}
+	default:
+		break;
+	}
+	return ds;
+
+ fail:
+	a_decompress_stream_close ( ds );
+	return NULL;
+}
+
+#ifdef HAVE_ZIP_H
+/**
+ * Read an entry of an already opened archive
+ */
+static VikDecompressStream* decompress_stream_open_zip_entry ( zip_t *archive, zip_uint64_t index )
+{
+	zip_file_t *zf = zip_fopen_index ( archive, index, 0 );
+	if ( !zf )
+		return NULL;
+	VikDecompressStream *ds = g_malloc0 ( sizeof(VikDecompressStream) );
+	ds->kind = DS_ZIP;
+	ds->zf = zf;
+	return ds;
+}
+#endif
+
+static gssize decompress_read ( VikDecompressStream *ds, void *buffer, gsize size )
+{
+	if ( ds->eof )
+		return 0;
+
+	switch ( ds->kind ) {
+	case DS_GZIP: {
+		GError *error = NULL;
+		gssize len = g_input_stream_read ( ds->gis, buffer, size, NULL, &error );
+		if ( len < 0 ) {
+			g_warning ( "%s: %s", __FUNCTION__, error->message );
+			g_error_free ( error );
+		}
+		return len;
+	}
+#ifdef HAVE_BZLIB_H
+	case DS_BZIP2: {
+		int bzerror;
+		int len = BZ2_bzRead ( &bzerror, ds->bf, buffer, MIN(size, G_MAXINT) );
+		if ( bzerror == BZ_STREAM_END )
+			ds->eof = TRUE;
+		else if ( bzerror != BZ_OK ) {
+			g_warning ( "%s: BZ error %d", __FUNCTION__, bzerror );
+			return -1;
+		}
+		return len;
+	}
+#endif
+#ifdef HAVE_LZMA_H
+	case DS_XZ: {
+		ds->lstrm.next_out = buffer;
+		ds->lstrm.avail_out = size;
+		// Until something is produced
+		while ( ds->lstrm.avail_out == size ) {
+			lzma_action action = LZMA_RUN;
+			if ( ds->lstrm.avail_in == 0 ) {
+				ds->lstrm.next_in = ds->bufi;
+				ds->lstrm.avail_in = fread ( ds->bufi, 1, sizeof(ds->bufi), ds->ff );
+				if ( ds->lstrm.avail_in == 0 )
+					action = LZMA_FINISH;
+			}
+			lzma_ret rv = lzma_code ( &ds->lstrm, action );
+			if ( rv == LZMA_STREAM_END ) {
+				ds->eof = TRUE;
+				break;
+			}
+			if ( rv != LZMA_OK ) {
+				g_warning ( "%s: %u", __FUNCTION__, rv );
+				return -1;
+			}
+		}
+		return size - ds->lstrm.avail_out;
+	}
+#endif
+#ifdef HAVE_ZIP_H
+	case DS_ZIP:
+		return zip_fread ( ds->zf, buffer, size );
+#endif
+	case DS_PLAIN: {
+		size_t len = fread ( buffer, 1, size, ds->ff );
+		if ( len == 0 && ferror(ds->ff) )
+			return -1;
+		return len;
+	}
+	default:
+		return -1;
+	}
+}
+
+/**
+ * a_decompress_stream_peek:
+ * @len: Returns the amount available, which is less than a block only for small contents
+ *
+ * Look at the start of the decompressed data (e.g. to detect its type), without consuming it.
+ * Must be called before any a_decompress_stream_read().
+ *
+ * Returns: The data, owned by the stream (NULL on failure)
+ */
+const guint8* a_decompress_stream_peek ( VikDecompressStream *ds, gsize *len )
+{
+	if ( !ds->peek ) {
+		ds->peek = g_malloc ( DECOMPRESS_PEEK_SIZE );
+		while ( ds->peek_len < DECOMPRESS_PEEK_SIZE ) {
+			gssize got = decompress_read ( ds, ds->peek + ds->peek_len, DECOMPRESS_PEEK_SIZE - ds->peek_len );
+			if ( got < 0 ) {
+				*len = 0;
+				return NULL;
+			}
+			if ( got == 0 )
+				break;
+			ds->peek_len += got;
+		}
+	}
+	*len = ds->peek_len;
+	return ds->peek;
+}
+
+/**
+ * a_decompress_stream_read:
+ *
+ * Suitable as a #UtilReadFunc
+ */
+gssize a_decompress_stream_read ( VikDecompressStream *ds, void *buffer, gsize size )
+{
+	if ( ds->peek_pos < ds->peek_len ) {
+		gsize len = MIN ( size, ds->peek_len - ds->peek_pos );
+		memcpy ( buffer, ds->peek + ds->peek_pos, len );
+		ds->peek_pos += len;
+		return len;
+	}
+	return decompress_read ( ds, buffer, size );
+}
+
+void a_decompress_stream_close ( VikDecompressStream *ds )
+{
+	if ( !ds )
+		return;
+	if ( ds->gis )
+		g_object_unref ( ds->gis );
+#ifdef HAVE_BZLIB_H
+	if ( ds->bf ) {
+		int bzerror;
+		BZ2_bzReadClose ( &bzerror, ds->bf );
+	}
+#endif
+#ifdef HAVE_LZMA_H
+	if ( ds->kind == DS_XZ )
+		lzma_end ( &ds->lstrm );
+#endif
+#ifdef HAVE_ZIP_H
+	if ( ds->zf )
+		zip_fclose ( ds->zf );
+	if ( ds->archive )
+		zip_discard ( ds->archive );
+#endif
+	if ( ds->ff )
+		(void)fclose ( ds->ff );
+	g_free ( ds->peek );
+	g_free ( ds );
+}
+
+/**
+ * Whether the decompressed contents are to be read as GPX or KML
+ *  (the only kinds a_file_load_xml_stream() handles)
+ */
+static gboolean decompress_stream_is_xml ( VikDecompressStream *ds, const gchar *name )
+{
+	if ( a_file_check_ext ( name, ".gpx" ) || a_file_check_ext ( name, ".kml" ) )
+		return TRUE;
+	gsize len;
+	const guint8 *head = a_decompress_stream_peek ( ds, &len );
+	if ( !head )
+		return FALSE;
+	// Allow for a Byte Order Mark
+	if ( len >= 3 && memcmp(head, "\xef\xbb\xbf", 3) == 0 ) {
+		head += 3;
+		len -= 3;
+	}
+	return len >= strlen(FILE_XML_MAGIC) && memcmp(head, FILE_XML_MAGIC, strlen(FILE_XML_MAGIC)) == 0;
+}
+
+/**
+ * The name of the contents of a compressed file, i.e. without its compression extension
+ */
+static gchar* decompressed_name ( const gchar *filename )
+{
+	const gchar *dot = strrchr ( filename, '.' );
+	if ( dot && dot != filename && !strchr(dot, G_DIR_SEPARATOR) )
+		return g_strndup ( filename, dot - filename );
+	return g_strdup ( filename );
+}
+
+/**
+ * Read GPX or KML contents straight from the decompressing stream
+ *
+ * Returns: FALSE if the file is of some other kind, so nothing was loaded
+ */
+static gboolean uncompress_load_stream ( const gchar *filename,
+                                         VikAggregateLayer *top,
+                                         VikViewport *vp,
+                                         VikTrwLayer *vtl,
+                                         gboolean new_layer,
+                                         gboolean external,
+                                         const gchar *dirpath,
+                                         VikLoadType_t *ans )
+{
+	// External files need to be read from the file itself
+	if ( external )
+		return FALSE;
+	VikDecompressStream *ds = a_decompress_stream_open ( filename );
+	if ( !ds )
+		return FALSE;
+	gboolean handled = FALSE;
+	if ( ds->kind != DS_PLAIN ) {
+		gchar *inner = decompressed_name ( filename );
+		if ( decompress_stream_is_xml ( ds, inner ) ) {
+			*ans = a_file_load_xml_stream ( (UtilReadFunc)a_decompress_stream_read, ds, inner, top, vp, vtl, new_layer, dirpath, filename );
+			handled = TRUE;
+		}
+		g_free ( inner );
+	}
+	a_decompress_stream_close ( ds );
+	return handled;
+}
+
 #ifdef HAVE_ZIP_H
 /**
  * figure_out_answer:
@@ -95,15 +467,6 @@ VikLoadType_t uncompress_load_zip_file ( const gchar *filename,
 {
 	VikLoadType_t ans = LOAD_TYPE_READ_FAILURE;
 #ifdef HAVE_ZIP_H
-// Older libzip compatibility:
-#ifndef zip_t
-typedef struct zip zip_t;
-typedef struct zip_file zip_file_t;
-#endif
-#ifndef ZIP_RDONLY
-#define ZIP_RDONLY 0
-#endif
-
 #ifdef WINDOWS
 	GError *err = NULL;
 	char *zip_filename = g_locale_from_utf8 ( filename, -1, NULL, NULL, &err );
@@ -129,6 +492,18 @@ typedef struct zip_file zip_file_t;
 	struct zip_stat zs;
 	for ( int ii = 0; ii < entries; ii++ ) {
 		if ( zip_stat_index( archive, ii, 0, &zs ) == 0) {
+			// GPX and KML (e.g. the doc.kml of a KMZ) are parsed as the entry is decompressed
+			VikDecompressStream *ds = NULL;
+			if ( !external )
+				ds = decompress_stream_open_zip_entry ( archive, ii );
+			if ( ds && decompress_stream_is_xml ( ds, zs.name ) ) {
+				VikLoadType_t current_ans = a_file_load_xml_stream ( (UtilReadFunc)a_decompress_stream_read, ds, zs.name, top, vp, vtl, new_layer, dirpath, zs.name );
+				a_decompress_stream_close ( ds );
+				ans = figure_out_answer ( current_ans, ans, ii, entries );
+				continue;
+			}
+			a_decompress_stream_close ( ds );
+
 			zip_file_t *zf = zip_fopen_index ( archive, ii, 0 );
 			if ( zf ) {
 				char *buffer = g_malloc(zs.size);
@@ -292,7 +667,7 @@ end:
  *  data should be freed once used
  *
  */
-static void *ungzip_file ( gchar *gzip_file, gsize zipped_size, gulong *unzip_size )
+void *ungzip_file ( gchar *gzip_file, gsize zipped_size, gulong *unzip_size )
 {
 	g_autoptr(GInputStream) inputGz = g_memory_input_stream_new_from_data ( gzip_file, zipped_size, NULL );
 	if ( !inputGz )
@@ -389,10 +764,15 @@ VikLoadType_t uncompress_load_bzip_file ( const gchar *filename,
                                           VikViewport *vp,
                                           VikTrwLayer *vtl,
                                           gboolean new_layer,
-                                          gboolean external )
+                                          gboolean external,
+                                          const gchar *dirpath )
 {
+	VikLoadType_t ans;
+	if ( uncompress_load_stream ( filename, top, vp, vtl, new_layer, external, dirpath, &ans ) )
+		return ans;
+
 	gchar *tmp_name = uncompress_bzip2 ( filename );
-	VikLoadType_t ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
+	ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
 	(void)util_remove ( tmp_name );
 	return ans;
 }
@@ -498,10 +878,15 @@ VikLoadType_t uncompress_load_xz_file ( const gchar *filename,
                                         VikViewport *vp,
                                         VikTrwLayer *vtl,
                                         gboolean new_layer,
-                                        gboolean external )
+                                        gboolean external,
+                                        const gchar *dirpath )
 {
+	VikLoadType_t ans;
+	if ( uncompress_load_stream ( filename, top, vp, vtl, new_layer, external, dirpath, &ans ) )
+		return ans;
+
 	gchar *tmp_name = uncompress_xz ( filename );
-	VikLoadType_t ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
+	ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
 	(void)util_remove ( tmp_name );
 	return ans;
 }
@@ -511,9 +896,13 @@ VikLoadType_t uncompress_load_gz_file ( const gchar *filename,
                                         VikViewport *vp,
                                         VikTrwLayer *vtl,
                                         gboolean new_layer,
-                                        gboolean external )
+                                        gboolean external,
+                                        const gchar *dirpath )
 {
 	VikLoadType_t ans = LOAD_TYPE_READ_FAILURE;
+	if ( uncompress_load_stream ( filename, top, vp, vtl, new_layer, external, dirpath, &ans ) )
+		return ans;
+
 	GMappedFile *mf;
 	GError *error = NULL;
 	if ( (mf = g_mapped_file_new(filename, FALSE, &error)) == NULL ) {
@@ -31,7 +31,15 @@
 
 G_BEGIN_DECLS
 
+typedef struct _VikDecompressStream VikDecompressStream;
+
+VikDecompressStream* a_decompress_stream_open ( const gchar *filename );
+const guint8* a_decompress_stream_peek ( VikDecompressStream *ds, gsize *len );
+gssize a_decompress_stream_read ( VikDecompressStream *ds, void *buffer, gsize size );
+void a_decompress_stream_close ( VikDecompressStream *ds );
+
 void *unzip_file(gchar *zip_file, gulong *unzip_size);
+void *ungzip_file ( gchar *gzip_file, gsize zipped_size, gulong *unzip_size );
 
 gchar* uncompress_bzip2 ( const gchar *name );
 
@@ -48,21 +56,24 @@ VikLoadType_t uncompress_load_bzip_file ( const gchar *filename,
                                           VikViewport *vp,
                                           VikTrwLayer *vtl,
                                           gboolean new_layer,
-                                          gboolean external );
+                                          gboolean external,
+                                          const gchar *dirpath );
 
 VikLoadType_t uncompress_load_xz_file ( const gchar *filename,
                                         VikAggregateLayer *top,
                                         VikViewport *vp,
                                         VikTrwLayer *vtl,
                                         gboolean new_layer,
-                                        gboolean external );
+                                        gboolean external,
+                                        const gchar *dirpath );
 
 VikLoadType_t uncompress_load_gz_file ( const gchar *filename,
                                         VikAggregateLayer *top,
                                         VikViewport *vp,
                                         VikTrwLayer *vtl,
                                         gboolean new_layer,
-                                        gboolean external );
+                                        gboolean external,
+                                        const gchar *dirpath );
 G_END_DECLS
 
 #endif
@@ -101,16 +101,27 @@ int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 {
-  static struct LatLon tmp1, tmp2;
   if ( utm1->zone == utm2->zone ) {
     return sqrt ( pow ( utm1->easting - utm2->easting, 2 ) + pow ( utm1->northing - utm2->northing, 2 ) );
   } else {
+    struct LatLon tmp1, tmp2;
     a_coords_utm_to_latlon ( utm1, &tmp1 );
     a_coords_utm_to_latlon ( utm2, &tmp2 );
     return a_coords_latlon_diff ( &tmp1, &tmp2 );
   }
 }
 
+/**
+ * Distance from the sines & cosines of the two latitudes and the cosine of the longitude difference
+ * The evaluation order is kept the same everywhere so all the diff functions give identical results
+ */
+static inline gdouble latlon_diff_sincos ( gdouble sinlat1, gdouble coslat1, gdouble sinlat2, gdouble coslat2, gdouble cosdlon )
+{
+  gdouble tmp3 = EquatorialRadius * acos(sinlat1*sinlat2+coslat1*coslat2*cosdlon);
+  // For very small differences we can sometimes get NaN returned
+  return isnan(tmp3)?0:tmp3;
+}
+
 /**
  * a_coords_latlon_diff:
  *
@@ -119,24 +130,87 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
  */
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
 {
-  static struct LatLon tmp1, tmp2;
-  gdouble tmp3;
-  tmp1.lat = ll1->lat * PIOVER180;
-  tmp1.lon = ll1->lon * PIOVER180;
-  tmp2.lat = ll2->lat * PIOVER180;
-  tmp2.lon = ll2->lon * PIOVER180;
-  tmp3 = EquatorialRadius * acos(sin(tmp1.lat)*sin(tmp2.lat)+cos(tmp1.lat)*cos(tmp2.lat)*cos(tmp1.lon-tmp2.lon));
-  // For very small differences we can sometimes get NaN returned
-  return isnan(tmp3)?0:tmp3;
+  gdouble lat1 = ll1->lat * PIOVER180;
+  gdouble lat2 = ll2->lat * PIOVER180;
+  return latlon_diff_sincos ( sin(lat1), cos(lat1), sin(lat2), cos(lat2),
+                              cos(ll1->lon * PIOVER180 - ll2->lon * PIOVER180) );
 }
 
-void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+// Points handled at a time by a_coords_latlon_diffs(), so the workspace stays on the stack
+#define LATLON_DIFFS_BLOCK 256
+
+/**
+ * a_coords_latlon_diffs:
+ * @lls:   The points
+ * @n:     Number of points
+ * @diffs: Filled with the n-1 distances between each point and the next one
+ *
+ * Same as calling a_coords_latlon_diff() on each consecutive pair (with identical results),
+ *  but the sine & cosine of each latitude is only worked out once rather than for both of its pairs.
+ * The per pair arithmetic is done in separate simple loops over arrays so the compiler can vectorise them.
+ *
+ * Uses no shared state, so may be called from several threads at once.
+ */
+void a_coords_latlon_diffs ( const struct LatLon *lls, guint n, gdouble *diffs )
+{
+  gdouble sinlat[LATLON_DIFFS_BLOCK];
+  gdouble coslat[LATLON_DIFFS_BLOCK];
+  gdouble cosdlon[LATLON_DIFFS_BLOCK];
+
+  // Consecutive blocks overlap by one point, as the last point of a block starts the next pair
+  for ( guint start = 0; start + 1 < n; start += LATLON_DIFFS_BLOCK - 1 ) {
+    const struct LatLon *ll = lls + start;
+    gdouble *diff = diffs + start;
+    guint m = MIN ( LATLON_DIFFS_BLOCK, n - start );
+
+    for ( guint ii = 0; ii < m; ii++ ) {
+      gdouble lat = ll[ii].lat * PIOVER180;
+      sinlat[ii] = sin ( lat );
+      coslat[ii] = cos ( lat );
+    }
+    for ( guint ii = 0; ii + 1 < m; ii++ )
+      cosdlon[ii] = cos ( ll[ii].lon * PIOVER180 - ll[ii+1].lon * PIOVER180 );
+    for ( guint ii = 0; ii + 1 < m; ii++ )
+      cosdlon[ii] = sinlat[ii]*sinlat[ii+1]+coslat[ii]*coslat[ii+1]*cosdlon[ii];
+    for ( guint ii = 0; ii + 1 < m; ii++ ) {
+      gdouble tmp3 = EquatorialRadius * acos ( cosdlon[ii] );
+      diff[ii] = isnan(tmp3)?0:tmp3;
+    }
+  }
+}
+
+/**
+ * The values that only depend on the UTM zone, kept while converting runs of points
+ *  (which nearly always stay within one zone)
+ */
+typedef struct {
+    int zone;                  /* 0 until first used */
+    double long_origin;
+    double long_origin_rad;
+} CoordsZone;
+
+static inline void coords_zone_set( CoordsZone *cz, int zone )
+    {
+    if ( cz->zone == zone )
+	return;
+    cz->zone = zone;
+    cz->long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
+    cz->long_origin_rad = DEG2RAD(cz->long_origin);
+    }
+
+/* Series coefficients, only depending on the ellipsoid */
+#define ECC_PRIME_SQUARED ( EccentricitySquared / ( 1.0 - EccentricitySquared ) )
+#define M_COEFF0 ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 )
+#define M_COEFF2 ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 )
+#define M_COEFF4 ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 )
+#define M_COEFF6 ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 )
+
+static inline void coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm, CoordsZone *cz )
     {
     double latitude;
     double longitude;
     double lat_rad, long_rad;
-    double long_origin, long_origin_rad;
-    double eccPrimeSquared;
+    double sin_lat, cos_lat, tan_lat;
     double N, T, C, A, M;
     int zone;
     double northing, easting;
@@ -165,18 +239,20 @@ void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
 	else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
 	else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
 	}
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    long_origin_rad = DEG2RAD(long_origin);
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( lat_rad ) * sin( lat_rad ) );
-    T = tan( lat_rad ) * tan( lat_rad );
-    C = eccPrimeSquared * cos( lat_rad ) * cos( lat_rad );
-    A = cos( lat_rad ) * ( long_rad - long_origin_rad );
-    M = EquatorialRadius * ( ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) * lat_rad - ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 2 * lat_rad ) + ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 4 * lat_rad ) - ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 ) * sin( 6 * lat_rad ) );
+    coords_zone_set( cz, zone );
+    /* Each trig function of the latitude is only needed once */
+    sin_lat = sin( lat_rad );
+    cos_lat = cos( lat_rad );
+    tan_lat = tan( lat_rad );
+    N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin_lat * sin_lat );
+    T = tan_lat * tan_lat;
+    C = ECC_PRIME_SQUARED * cos_lat * cos_lat;
+    A = cos_lat * ( long_rad - cz->long_origin_rad );
+    M = EquatorialRadius * ( M_COEFF0 * lat_rad - M_COEFF2 * sin( 2 * lat_rad ) + M_COEFF4 * sin( 4 * lat_rad ) - M_COEFF6 * sin( 6 * lat_rad ) );
     easting =
-	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * eccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
+	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * ECC_PRIME_SQUARED ) * A * A * A * A * A / 120 ) + 500000.0;
     northing =
-	K0 * ( M + N * tan( lat_rad ) * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * eccPrimeSquared ) * A * A * A * A * A * A / 720 ) );
+	K0 * ( M + N * tan_lat * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * ECC_PRIME_SQUARED ) * A * A * A * A * A * A / 720 ) );
     if ( latitude < 0.0 )
 	northing += 10000000.0;  /* 1e7 meter offset for southern hemisphere */
 
@@ -188,6 +264,29 @@ void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
     /* All done. */
     }
 
+void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+    {
+    CoordsZone cz = { 0 };
+    coords_latlon_to_utm( latlon, utm, &cz );
+    }
+
+/**
+ * a_coords_latlons_to_utms:
+ * @n: Number of points in both arrays
+ *
+ * Same results as a_coords_latlon_to_utm() on each point,
+ *  but the zone values are only worked out again when the zone changes.
+ * Reentrant, so separate threads can convert separate arrays.
+ */
+void a_coords_latlons_to_utms( const struct LatLon *latlons, struct UTM *utms, guint n )
+    {
+    CoordsZone cz = { 0 };
+    for ( guint ii = 0; ii < n; ii++ )
+	coords_latlon_to_utm( &latlons[ii], &utms[ii], &cz );
+    }
+
+/* Letter designators for each 8 degree band from 80S up to 72N (the last band to 84N is 12 degrees) */
+static const char coords_utm_letters[] = "CDEFGHJKLMNPQRSTUVWX";
 
 static char coords_utm_letter( double latitude )
     {
@@ -195,72 +294,57 @@ static char coords_utm_letter( double latitude )
     ** given latitude.  It returns 'Z' if the latitude is outside the UTM
     ** limits of 84N to 80S.
     */
-    if ( latitude <= 84.0 && latitude >= 72.0 ) return 'X';
-    else if ( latitude < 72.0 && latitude >= 64.0 ) return 'W';
-    else if ( latitude < 64.0 && latitude >= 56.0 ) return 'V';
-    else if ( latitude < 56.0 && latitude >= 48.0 ) return 'U';
-    else if ( latitude < 48.0 && latitude >= 40.0 ) return 'T';
-    else if ( latitude < 40.0 && latitude >= 32.0 ) return 'S';
-    else if ( latitude < 32.0 && latitude >= 24.0 ) return 'R';
-    else if ( latitude < 24.0 && latitude >= 16.0 ) return 'Q';
-    else if ( latitude < 16.0 && latitude >= 8.0 ) return 'P';
-    else if ( latitude <  8.0 && latitude >= 0.0 ) return 'N';
-    else if ( latitude <  0.0 && latitude >= -8.0 ) return 'M';
-    else if ( latitude < -8.0 && latitude >= -16.0 ) return 'L';
-    else if ( latitude < -16.0 && latitude >= -24.0 ) return 'K';
-    else if ( latitude < -24.0 && latitude >= -32.0 ) return 'J';
-    else if ( latitude < -32.0 && latitude >= -40.0 ) return 'H';
-    else if ( latitude < -40.0 && latitude >= -48.0 ) return 'G';
-    else if ( latitude < -48.0 && latitude >= -56.0 ) return 'F';
-    else if ( latitude < -56.0 && latitude >= -64.0 ) return 'E';
-    else if ( latitude < -64.0 && latitude >= -72.0 ) return 'D';
-    else if ( latitude < -72.0 && latitude >= -80.0 ) return 'C';
-    else return 'Z';
+    if ( !( latitude <= 84.0 && latitude >= -80.0 ) )
+	return 'Z';
+    if ( latitude >= 72.0 )
+	return 'X';
+    /* The band boundaries are exact in doubles, so check against them rather than trusting the division's rounding */
+    int band = (int) ( ( latitude + 80.0 ) / 8.0 );
+    if ( band > 18 )
+	band = 18;
+    if ( latitude < band * 8 - 80 )
+	band--;
+    else if ( band < 18 && latitude >= ( band + 1 ) * 8 - 80 )
+	band++;
+    return coords_utm_letters[band];
     }
 
+/* As for M_COEFF* above */
+#define E1 ( ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) ) )
 
-
-void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+static inline void coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon, CoordsZone *cz, double e1 )
     {
-    double northing, easting;
-    int zone;
-    char letter[100];
     double x, y;
-    double eccPrimeSquared;
-    double e1;
     double N1, T1, C1, R1, D, M;
-    double long_origin;
     double mu, phi1_rad;
+    double sin_phi1, cos_phi1, tan_phi1;
     double latitude, longitude;
 
-    northing = utm->northing;
-    easting = utm->easting;
-    zone = utm->zone;
-    letter[0] = utm->letter;
-
     /* Now convert. */
-    x = easting - 500000.0;	/* remove 500000 meter offset */
-    y = northing;
-    if ( ( *letter - 'N' ) < 0 ) {
+    x = utm->easting - 500000.0;	/* remove 500000 meter offset */
+    y = utm->northing;
+    if ( ( utm->letter - 'N' ) < 0 ) {
       /* southern hemisphere */
       y -= 10000000.0;	/* remove 1e7 meter offset */
     }
 
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
+    coords_zone_set( cz, utm->zone );
     M = y / K0;
-    mu = M / ( EquatorialRadius * ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) );
+    mu = M / ( EquatorialRadius * M_COEFF0 );
     phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 )* sin( 2 * mu ) + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * sin( 4 * mu ) + ( 151 * e1 * e1 * e1 / 96 ) * sin( 6 *mu );
-    N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ) );
-    T1 = tan( phi1_rad ) * tan( phi1_rad );
-    C1 = eccPrimeSquared * cos( phi1_rad ) * cos( phi1_rad );
-    R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ), 1.5 );
+    /* Each trig function of the footprint latitude is only needed once */
+    sin_phi1 = sin( phi1_rad );
+    cos_phi1 = cos( phi1_rad );
+    tan_phi1 = tan( phi1_rad );
+    N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin_phi1 * sin_phi1 );
+    T1 = tan_phi1 * tan_phi1;
+    C1 = ECC_PRIME_SQUARED * cos_phi1 * cos_phi1;
+    R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin_phi1 * sin_phi1, 1.5 );
     D = x / ( N1 * K0 );
-    latitude = phi1_rad - ( N1 * tan( phi1_rad ) / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * eccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * eccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
+    latitude = phi1_rad - ( N1 * tan_phi1 / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * ECC_PRIME_SQUARED ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * ECC_PRIME_SQUARED - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
     latitude = RAD2DEG(latitude);
-    longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * eccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos( phi1_rad );
-    longitude = long_origin + RAD2DEG(longitude);
+    longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * ECC_PRIME_SQUARED + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos_phi1;
+    longitude = cz->long_origin + RAD2DEG(longitude);
 
     /* Show results. */
 
@@ -269,6 +353,28 @@ void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
 
     }
 
+void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+    {
+    CoordsZone cz = { 0 };
+    coords_utm_to_latlon( utm, latlon, &cz, E1 );
+    }
+
+/**
+ * a_coords_utms_to_latlons:
+ * @n: Number of points in both arrays
+ *
+ * Same results as a_coords_utm_to_latlon() on each point,
+ *  but the constants and zone values are only worked out when needed.
+ * Reentrant, so separate threads can convert separate arrays.
+ */
+void a_coords_utms_to_latlons( const struct UTM *utms, struct LatLon *latlons, guint n )
+    {
+    CoordsZone cz = { 0 };
+    double e1 = E1;
+    for ( guint ii = 0; ii < n; ii++ )
+	coords_utm_to_latlon( &utms[ii], &latlons[ii], &cz, e1 );
+    }
+
 void a_coords_latlon_to_string ( const struct LatLon *latlon,
 				 gchar **lat,
 				 gchar **lon )
@@ -0,0 +1,358 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Built-in reader for CSV files with a header line naming the columns,
+ *  much as GPSBabel's unicsv format, so these can be loaded without going through GPSBabel.
+ *
+ * The delimiter may be a comma, semicolon or tab, and fields may be quoted.
+ * Needs latitude and longitude columns in decimal degrees.
+ * When there is a name column each line is a waypoint, otherwise each line is
+ *  a trackpoint of a single track.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include "csv.h"
+#include "globals.h"
+#include "fileutils.h"
+
+typedef enum {
+  CSV_LAT = 0,
+  CSV_LON,
+  CSV_ALT,
+  CSV_TIME,
+  CSV_DATE,
+  CSV_NAME,
+  CSV_DESC,
+  CSV_COMMENT,
+  CSV_SYMBOL,
+  CSV_SPEED,
+  CSV_COURSE,
+  CSV_SATS,
+  CSV_HDOP,
+  CSV_NUM_COLUMNS
+} CsvColumn;
+
+typedef struct {
+  const gchar *name;
+  CsvColumn column;
+} CsvHeader;
+
+// Header names are compared ignoring case
+static const CsvHeader headers[] = {
+  { "lat", CSV_LAT },
+  { "latitude", CSV_LAT },
+  { "lon", CSV_LON },
+  { "long", CSV_LON },
+  { "lng", CSV_LON },
+  { "longitude", CSV_LON },
+  { "alt", CSV_ALT },
+  { "altitude", CSV_ALT },
+  { "ele", CSV_ALT },
+  { "elevation", CSV_ALT },
+  { "time", CSV_TIME },
+  { "utc", CSV_TIME },
+  { "timestamp", CSV_TIME },
+  { "datetime", CSV_TIME },
+  { "date_time", CSV_TIME },
+  { "date", CSV_DATE },
+  { "name", CSV_NAME },
+  { "desc", CSV_DESC },
+  { "description", CSV_DESC },
+  { "cmt", CSV_COMMENT },
+  { "comment", CSV_COMMENT },
+  { "notes", CSV_COMMENT },
+  { "sym", CSV_SYMBOL },
+  { "symbol", CSV_SYMBOL },
+  { "speed", CSV_SPEED },
+  { "course", CSV_COURSE },
+  { "heading", CSV_COURSE },
+  { "sat", CSV_SATS },
+  { "sats", CSV_SATS },
+  { "nsats", CSV_SATS },
+  { "satellites", CSV_SATS },
+  { "hdop", CSV_HDOP },
+};
+
+typedef struct {
+  VikTrwLayer *vtl;
+  gchar delimiter;
+  gint index[CSV_NUM_COLUMNS]; // Field position of each column, -1 if not present
+  GPtrArray *fields;
+  VikTrack *trk;
+  guint waypoints;
+} CsvReader;
+
+/**
+ * Read a whole line of any length, without the line ending
+ */
+static gboolean read_line ( FILE *ff, GString *line )
+{
+  gchar buf[1024];
+  g_string_truncate ( line, 0 );
+  while ( fgets ( buf, sizeof(buf), ff ) ) {
+    g_string_append ( line, buf );
+    if ( line->len && line->str[line->len-1] == '\n' )
+      break;
+  }
+  if ( !line->len )
+    return FALSE;
+  while ( line->len && (line->str[line->len-1] == '\n' || line->str[line->len-1] == '\r') )
+    g_string_truncate ( line, line->len-1 );
+  return TRUE;
+}
+
+/**
+ * Use whichever possible delimiter is most common outside of quotes
+ */
+static gchar guess_delimiter ( const gchar *header )
+{
+  guint commas = 0, semicolons = 0, tabs = 0;
+  gboolean quoted = FALSE;
+  for ( const gchar *ptr = header; *ptr; ptr++ ) {
+    if ( *ptr == '"' )
+      quoted = !quoted;
+    else if ( !quoted ) {
+      if ( *ptr == ',' ) commas++;
+      else if ( *ptr == ';' ) semicolons++;
+      else if ( *ptr == '\t' ) tabs++;
+    }
+  }
+  if ( tabs > commas && tabs >= semicolons )
+    return '\t';
+  if ( semicolons > commas )
+    return ';';
+  return ',';
+}
+
+/**
+ * Split the line in place into the fields, removing any quotes
+ */
+static void split_line ( CsvReader *rd, gchar *line )
+{
+  g_ptr_array_set_size ( rd->fields, 0 );
+  gchar *in = line;
+  gchar *out = line;
+  while ( TRUE ) {
+    gchar *field = out;
+    gboolean quoted = FALSE;
+    while ( g_ascii_isspace(*in) && *in != rd->delimiter )
+      in++;
+    if ( *in == '"' ) {
+      quoted = TRUE;
+      in++;
+    }
+    while ( *in ) {
+      if ( quoted && *in == '"' ) {
+        if ( in[1] == '"' ) {
+          *out++ = '"';
+          in += 2;
+          continue;
+        }
+        quoted = FALSE;
+        in++;
+        continue;
+      }
+      if ( !quoted && *in == rd->delimiter )
+        break;
+      *out++ = *in++;
+    }
+    gboolean more = *in == rd->delimiter;
+    if ( more )
+      in++;
+    *out++ = '\0';
+    g_ptr_array_add ( rd->fields, g_strchomp(field) );
+    if ( !more )
+      break;
+  }
+}
+
+static const gchar *get_field ( CsvReader *rd, CsvColumn column )
+{
+  gint ii = rd->index[column];
+  if ( ii < 0 || ii >= (gint)rd->fields->len )
+    return NULL;
+  const gchar *value = g_ptr_array_index ( rd->fields, ii );
+  return value[0] ? value : NULL;
+}
+
+/**
+ * Returns NAN if the field is missing or not a number
+ */
+static gdouble get_number ( CsvReader *rd, CsvColumn column )
+{
+  const gchar *value = get_field ( rd, column );
+  if ( !value )
+    return NAN;
+  gchar *end = NULL;
+  gdouble number = g_ascii_strtod ( value, &end );
+  // Allow for decimal commas, which is usually why semicolons are used
+  if ( *end == ',' && rd->delimiter != ',' ) {
+    gchar *copy = g_strdup ( value );
+    g_strdelimit ( copy, ",", '.' );
+    number = g_ascii_strtod ( copy, &end );
+    gboolean valid = !*end;
+    g_free ( copy );
+    return valid ? number : NAN;
+  }
+  return *end ? NAN : number;
+}
+
+/**
+ * The time is either seconds since the Unix epoch or ISO8601,
+ *  which may also be split into separate date and time columns
+ */
+static gdouble get_timestamp ( CsvReader *rd )
+{
+  const gchar *time = get_field ( rd, CSV_TIME );
+  const gchar *date = get_field ( rd, CSV_DATE );
+  if ( !time && !date )
+    return NAN;
+
+  gchar *end = NULL;
+  if ( time && !date ) {
+    gdouble seconds = g_ascii_strtod ( time, &end );
+    if ( !*end )
+      return seconds;
+  }
+
+  gchar *iso = date && time ? g_strdup_printf ( "%sT%s", date, time ) : g_strdup ( time ? time : date );
+  g_strdelimit ( iso, "/", '-' );
+  g_strdelimit ( iso, " ", 'T' );
+  gdouble timestamp = NAN;
+  GTimeVal tv;
+  if ( g_time_val_from_iso8601 ( iso, &tv ) )
+    timestamp = tv.tv_sec + tv.tv_usec / 1000000.0;
+  g_free ( iso );
+  return timestamp;
+}
+
+static void read_row ( CsvReader *rd )
+{
+  struct LatLon ll;
+  ll.lat = get_number ( rd, CSV_LAT );
+  ll.lon = get_number ( rd, CSV_LON );
+  if ( isnan(ll.lat) || isnan(ll.lon) || fabs(ll.lat) > 90.0 || fabs(ll.lon) > 180.0 )
+    return;
+
+  if ( rd->index[CSV_NAME] >= 0 ) {
+    VikWaypoint *wp = vik_waypoint_new ();
+    vik_coord_load_from_latlon ( &(wp->coord), vik_trw_layer_get_coord_mode(rd->vtl), &ll );
+    wp->altitude = get_number ( rd, CSV_ALT );
+    wp->timestamp = get_timestamp ( rd );
+    wp->speed = get_number ( rd, CSV_SPEED );
+    wp->course = get_number ( rd, CSV_COURSE );
+    vik_waypoint_set_description ( wp, get_field(rd, CSV_DESC) );
+    vik_waypoint_set_comment ( wp, get_field(rd, CSV_COMMENT) );
+    vik_waypoint_set_symbol ( wp, get_field(rd, CSV_SYMBOL) );
+    const gchar *name = get_field ( rd, CSV_NAME );
+    gchar *wp_name = name ? g_strdup ( name ) : g_strdup_printf ( _("Waypoint%03d"), rd->waypoints+1 );
+    vik_trw_layer_filein_add_waypoint ( rd->vtl, wp_name, wp );
+    g_free ( wp_name );
+    rd->waypoints++;
+  }
+  else {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    vik_coord_load_from_latlon ( &(tp->coord), vik_trw_layer_get_coord_mode(rd->vtl), &ll );
+    tp->altitude = get_number ( rd, CSV_ALT );
+    tp->timestamp = get_timestamp ( rd );
+    tp->speed = get_number ( rd, CSV_SPEED );
+    tp->course = get_number ( rd, CSV_COURSE );
+    tp->hdop = get_number ( rd, CSV_HDOP );
+    gdouble sats = get_number ( rd, CSV_SATS );
+    if ( !isnan(sats) && sats > 0 )
+      tp->nsats = (guint)sats;
+    // Prepended for speed, put in order at the end
+    rd->trk->trackpoints = g_list_prepend ( rd->trk->trackpoints, tp );
+  }
+}
+
+/**
+ * a_csv_read_file_into_layer:
+ * @vtl:      The layer to add the waypoints or track to
+ * @ff:       The CSV file
+ * @filename: Used to name the track
+ *
+ * Returns: %FALSE if the file does not have latitude and longitude columns
+ *  or nothing could be read from it
+ */
+gboolean a_csv_read_file_into_layer ( VikTrwLayer *vtl, FILE *ff, const gchar *filename )
+{
+  GString *line = g_string_new ( NULL );
+  // The header is the first line that is not empty
+  gboolean have_header;
+  while ( (have_header = read_line ( ff, line )) ) {
+    g_strstrip ( line->str );
+    if ( line->str[0] )
+      break;
+  }
+  if ( !have_header ) {
+    g_string_free ( line, TRUE );
+    return FALSE;
+  }
+
+  CsvReader rd;
+  memset ( &rd, 0, sizeof(rd) );
+  rd.vtl = vtl;
+  rd.fields = g_ptr_array_new ();
+  rd.delimiter = guess_delimiter ( line->str );
+  for ( guint cc = 0; cc < CSV_NUM_COLUMNS; cc++ )
+    rd.index[cc] = -1;
+
+  split_line ( &rd, line->str );
+  for ( guint ii = 0; ii < rd.fields->len; ii++ ) {
+    const gchar *field = g_ptr_array_index ( rd.fields, ii );
+    for ( guint hh = 0; hh < G_N_ELEMENTS(headers); hh++ )
+      if ( g_ascii_strcasecmp ( field, headers[hh].name ) == 0 && rd.index[headers[hh].column] < 0 )
+        rd.index[headers[hh].column] = ii;
+  }
+
+  gboolean ans = FALSE;
+  if ( rd.index[CSV_LAT] >= 0 && rd.index[CSV_LON] >= 0 ) {
+    rd.trk = vik_track_new ();
+    while ( read_line ( ff, line ) ) {
+      split_line ( &rd, line->str );
+      read_row ( &rd );
+    }
+    ans = rd.waypoints > 0;
+    if ( rd.trk->trackpoints ) {
+      rd.trk->trackpoints = g_list_reverse ( rd.trk->trackpoints );
+      gchar *name = filename ? g_strdup ( a_file_basename(filename) ) : g_strdup ( _("Track") );
+      gchar *dot = strrchr ( name, '.' );
+      if ( dot && dot != name )
+        *dot = '\0';
+      vik_trw_layer_filein_add_track ( vtl, name, rd.trk );
+      g_free ( name );
+      ans = TRUE;
+    }
+    else
+      vik_track_free ( rd.trk );
+  }
+  else
+    g_debug ( "%s: no latitude and longitude columns in %s", __FUNCTION__, filename );
+
+  g_ptr_array_free ( rd.fields, TRUE );
+  g_string_free ( line, TRUE );
+  return ans;
+}
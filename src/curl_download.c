@@ -63,6 +63,12 @@ static size_t curl_write_func(void *ptr, size_t size, size_t nmemb, FILE *stream
   return fwrite(ptr, size, nmemb, stream);
 }
 
+static size_t curl_write_bytes_func ( void *ptr, size_t size, size_t nmemb, GByteArray *data )
+{
+  g_byte_array_append ( data, ptr, size * nmemb );
+  return size * nmemb;
+}
+
 static size_t curl_get_etag_func(void *ptr, size_t size, size_t nmemb, void *stream)
 {
 #define ETAG_KEYWORD "ETag: "
@@ -101,6 +107,7 @@ static char *get_cookie_file ( gboolean init )
 
 static gint curl_ssl_verifypeer = 1; // https://curl.haxx.se/libcurl/c/CURLOPT_SSL_VERIFYPEER.html
 static gchar* curl_cainfo = NULL;    // https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
+static gint curl_max_host_connections = 2; // https://curl.se/libcurl/c/CURLMOPT_MAX_HOST_CONNECTIONS.html
 
 /* This should to be called from main() to make sure thread safe */
 void curl_download_init()
@@ -127,6 +134,10 @@ void curl_download_init()
     curl_cainfo = g_strdup ( str );
     g_free ( str );
   }
+  gint itmp;
+  if ( a_settings_get_integer ( "curl_max_host_connections", &itmp ) )
+    if ( itmp > 0 )
+      curl_max_host_connections = itmp;
 }
 
 /* This should to be called from main() to make sure thread safe */
@@ -174,21 +185,48 @@ static void common_opts ( CURL *curl, const char *uri, DownloadFileOptions *opti
 }
 
 /**
+ * Reusable handles for a sequence of downloads,
+ *  the multi handle keeps its connections open between batches.
+ */
+typedef struct {
+  CURL *curl;
+  CURLM *multi;
+  GPtrArray *spare; // CURL easy handles available for the multi handle
+} CurlDownloadHandle;
+
+/**
+ * Release the multi part of the handle
+ */
+static void handle_free_multi ( CurlDownloadHandle *cdh )
+{
+  if ( cdh->spare ) {
+    for ( guint ii = 0; ii < cdh->spare->len; ii++ )
+      curl_easy_cleanup ( g_ptr_array_index(cdh->spare, ii) );
+    g_ptr_array_free ( cdh->spare, TRUE );
+    cdh->spare = NULL;
+  }
+  if ( cdh->multi )
+    curl_multi_cleanup ( cdh->multi );
+  cdh->multi = NULL;
+}
+
+/**
+ * Set the per request options
  *
+ * Returns the headers to be freed after the transfer (maybe NULL)
  */
-CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+static struct curl_slist *uri_opts ( CURL *curl, const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo )
 {
-  CURL *curl;
   struct curl_slist *curl_send_headers = NULL;
-  CURLcode res = CURLE_FAILED_INIT;
 
-  curl = handle ? handle : curl_easy_init ();
-  if ( !curl ) {
-    return CURL_DOWNLOAD_ERROR;
-  }
   common_opts ( curl, uri, options );
-  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
-  curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
+  if ( cdo && cdo->data ) {
+    curl_easy_setopt ( curl, CURLOPT_WRITEDATA, cdo->data );
+    curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_bytes_func );
+  } else {
+    curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
+    curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
+  }
   if (options != NULL) {
     if (cdo != NULL) {
       if(options->check_file_server_time && cdo->time_condition != 0) {
@@ -230,13 +268,20 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   if ( curl_send_headers )
     curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , curl_send_headers );
 
-  res = curl_easy_perform ( curl );
+  return curl_send_headers;
+}
 
+/**
+ * Interpret the outcome of a transfer
+ */
+static CURL_download_t uri_result ( CURL *curl, CURLcode res, const char *uri )
+{
+  CURL_download_t ret;
   if (res == CURLE_OK) {
     glong response;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
     if (response == 304) {         // 304 = Not Modified
-      res = CURL_DOWNLOAD_NO_NEWER_FILE;
+      ret = CURL_DOWNLOAD_NO_NEWER_FILE;
     } else if (response == 200 ||  // http: 200 = Ok
                response == 226) {  // ftp:  226 = sucess
       gdouble size;
@@ -244,19 +289,41 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
          when the server has a (incorrect) time earlier than the time on the file we already have */
       curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &size);
       if (size == 0)
-        res = CURL_DOWNLOAD_ERROR;
+        ret = CURL_DOWNLOAD_ERROR;
       else
-        res = CURL_DOWNLOAD_NO_ERROR;
+        ret = CURL_DOWNLOAD_NO_ERROR;
     } else {
       g_warning("%s: http response: %ld for uri %s", __FUNCTION__, response, uri);
-      res = CURL_DOWNLOAD_ERROR;
+      ret = CURL_DOWNLOAD_ERROR;
     }
   } else if (res == CURLE_ABORTED_BY_CALLBACK) {
-    res = CURL_DOWNLOAD_ABORTED;
+    ret = CURL_DOWNLOAD_ABORTED;
   } else {
     g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
-    res = CURL_DOWNLOAD_ERROR;
+    ret = CURL_DOWNLOAD_ERROR;
+  }
+  return ret;
+}
+
+/**
+ *
+ */
+CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+{
+  CURL *curl;
+  struct curl_slist *curl_send_headers = NULL;
+  CURLcode res = CURLE_FAILED_INIT;
+
+  curl = handle ? ((CurlDownloadHandle*)handle)->curl : curl_easy_init ();
+  if ( !curl ) {
+    return CURL_DOWNLOAD_ERROR;
   }
+  curl_send_headers = uri_opts ( curl, uri, f, options, cdo );
+
+  res = curl_easy_perform ( curl );
+
+  CURL_download_t ret = uri_result ( curl, res, uri );
+
   if (curl_send_headers) {
     curl_slist_free_all(curl_send_headers);
     curl_send_headers = NULL;
@@ -264,44 +331,163 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   }
   if (!handle)
      curl_easy_cleanup ( curl );
-  return res;
+  return ret;
 }
 
 /**
- * curl_download_get_url:
+ * curl_download_make_url:
  *  Either hostname and/or uri should be defined
  *
+ * Returns: the full URL, or NULL if it can't be determined.
+ *  Free the returned string after use.
  */
-CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+gchar *curl_download_make_url ( const char *hostname, const char *uri, gboolean ftp )
 {
-  gchar *full = NULL;
-
   if ( hostname && strstr ( hostname, "://" ) != NULL ) {
     if ( uri && strlen ( uri ) > 1 )
       // Simply append them together
-      full = g_strdup_printf ( "%s%s", hostname, uri );
+      return g_strdup_printf ( "%s%s", hostname, uri );
     else
       /* Already full url */
-      full = (gchar *) hostname;
+      return g_strdup ( hostname );
   }
   else if ( uri && strstr ( uri, "://" ) != NULL )
     /* Already full url */
-    full = (gchar *) uri;
+    return g_strdup ( uri );
   else if ( hostname && uri )
     /* Compose the full url */
-    full = g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
-  else {
+    return g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
+  return NULL;
+}
+
+/**
+ * curl_download_get_url:
+ *  Either hostname and/or uri should be defined
+ *
+ */
+CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+{
+  gchar *full = curl_download_make_url ( hostname, uri, ftp );
+  if ( !full )
     return CURL_DOWNLOAD_ERROR;
-  }
 
   CURL_download_t ret = curl_download_uri ( full, f, options, cdo, handle );
-  // Only free newly allocated memory
-  if ( hostname != full && uri != full )
-    g_free ( full );
+  g_free ( full );
 
   return ret;
 }
 
+/**
+ * curl_download_uris:
+ * @items:  The transfers to perform, with the result of each set on return
+ * @count:  The number of items
+ * @handle: Handle from curl_download_handle_init() (may be NULL)
+ *
+ * Run several transfers at once. Transfers to the same server share connections,
+ *  multiplexed over HTTP/2 where the server supports it, otherwise upto
+ *  the 'curl_max_host_connections' setting are used in parallel.
+ * With a handle, connections remain open for the next call.
+ */
+void curl_download_uris ( CurlDownloadItem *items, guint count, void *handle )
+{
+  CurlDownloadHandle *cdh = handle;
+  CurlDownloadHandle tmp = { NULL, NULL, NULL };
+  if ( !cdh )
+    cdh = &tmp;
+
+  if ( !cdh->multi ) {
+    cdh->multi = curl_multi_init ();
+    if ( !cdh->multi ) {
+      for ( guint ii = 0; ii < count; ii++ )
+        items[ii].result = CURL_DOWNLOAD_ERROR;
+      return;
+    }
+    curl_multi_setopt ( cdh->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)curl_max_host_connections );
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_multi_setopt ( cdh->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX );
+#endif
+  }
+  if ( !cdh->spare )
+    cdh->spare = g_ptr_array_new ();
+
+  CURL **curls = g_new0 ( CURL*, count );
+  struct curl_slist **headers = g_new0 ( struct curl_slist*, count );
+  guint running = 0;
+
+  for ( guint ii = 0; ii < count; ii++ ) {
+    CURL *curl = NULL;
+    if ( cdh->spare->len ) {
+      curl = g_ptr_array_index ( cdh->spare, cdh->spare->len-1 );
+      g_ptr_array_set_size ( cdh->spare, cdh->spare->len-1 );
+    }
+    else
+      curl = curl_easy_init ();
+    if ( !curl ) {
+      items[ii].result = CURL_DOWNLOAD_ERROR;
+      continue;
+    }
+    curl_easy_reset ( curl );
+    headers[ii] = uri_opts ( curl, items[ii].uri, items[ii].f, items[ii].options, items[ii].cdo );
+    curl_easy_setopt ( curl, CURLOPT_PRIVATE, GUINT_TO_POINTER(ii) );
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    curl_easy_setopt ( curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    // Prefer waiting to multiplex on an existing connection, rather than opening another one
+    curl_easy_setopt ( curl, CURLOPT_PIPEWAIT, 1L );
+#endif
+    if ( curl_multi_add_handle ( cdh->multi, curl ) != CURLM_OK ) {
+      items[ii].result = CURL_DOWNLOAD_ERROR;
+      g_ptr_array_add ( cdh->spare, curl );
+      continue;
+    }
+    curls[ii] = curl;
+    running++;
+  }
+
+  while ( running ) {
+    int still_running = 0;
+    CURLMcode mc = curl_multi_perform ( cdh->multi, &still_running );
+    if ( mc == CURLM_OK && still_running )
+      mc = curl_multi_wait ( cdh->multi, NULL, 0, 1000, NULL );
+    if ( mc != CURLM_OK ) {
+      g_warning ( "%s: curl multi error: %s", __FUNCTION__, curl_multi_strerror(mc) );
+      break;
+    }
+
+    CURLMsg *msg;
+    int msgs_left;
+    while ( (msg = curl_multi_info_read ( cdh->multi, &msgs_left )) ) {
+      if ( msg->msg != CURLMSG_DONE )
+        continue;
+      gpointer ptr = NULL;
+      curl_easy_getinfo ( msg->easy_handle, CURLINFO_PRIVATE, &ptr );
+      guint ii = GPOINTER_TO_UINT(ptr);
+      items[ii].result = uri_result ( msg->easy_handle, msg->data.result, items[ii].uri );
+      curl_easy_getinfo ( msg->easy_handle, CURLINFO_TOTAL_TIME, &items[ii].seconds );
+      curl_multi_remove_handle ( cdh->multi, msg->easy_handle );
+      g_ptr_array_add ( cdh->spare, msg->easy_handle );
+      curls[ii] = NULL;
+      running--;
+    }
+  }
+
+  // Only on a multi error
+  for ( guint ii = 0; ii < count; ii++ ) {
+    if ( curls[ii] ) {
+      items[ii].result = CURL_DOWNLOAD_ERROR;
+      curl_multi_remove_handle ( cdh->multi, curls[ii] );
+      g_ptr_array_add ( cdh->spare, curls[ii] );
+    }
+    if ( headers[ii] )
+      curl_slist_free_all ( headers[ii] );
+  }
+  g_free ( headers );
+  g_free ( curls );
+
+  if ( cdh == &tmp )
+    handle_free_multi ( &tmp );
+}
 
 struct MemoryStruct {
   char *data;
@@ -362,12 +548,97 @@ char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options )
   return mem.data;
 }
 
+/**
+ * curl_download_get_range:
+ * @uri:     The full URL
+ * @offset:  Position of the first byte wanted
+ * @length:  The number of bytes wanted
+ * @options: Download options (maybe NULL)
+ * @handle:  Handle from curl_download_handle_init() (may be NULL)
+ *
+ * Download part of a file into memory using a HTTP range request.
+ * A server that ignores the range and sends the whole file is also handled.
+ *
+ * Returns: The data, which is shorter than requested at the end of the file,
+ *  or NULL on failure. Unref the returned data after use.
+ */
+GBytes* curl_download_get_range ( const char *uri, guint64 offset, guint64 length, DownloadFileOptions *options, void *handle )
+{
+  if ( length == 0 )
+    return NULL;
+
+  CURL *curl = handle ? ((CurlDownloadHandle*)handle)->curl : curl_easy_init ();
+  if ( !curl )
+    return NULL;
+
+  GByteArray *data = g_byte_array_new ();
+  struct curl_slist *curl_send_headers = NULL;
+  gchar *range = g_strdup_printf ( "%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT, offset, offset + length - 1 );
+
+  common_opts ( curl, uri, options );
+  curl_easy_setopt ( curl, CURLOPT_RANGE, range );
+  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, data );
+  curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_bytes_func );
+  if ( options && options->custom_http_headers ) {
+    gchar **headers = g_strsplit ( options->custom_http_headers, "\n", -1 );
+    for ( guint ii = 0; ii < g_strv_length(headers); ii++ )
+      curl_send_headers = curl_slist_append ( curl_send_headers, headers[ii] );
+    g_strfreev ( headers );
+    curl_easy_setopt ( curl, CURLOPT_HTTPHEADER, curl_send_headers );
+  }
+  curl_easy_setopt ( curl, CURLOPT_SSL_VERIFYPEER, curl_ssl_verifypeer );
+  if ( curl_cainfo )
+    curl_easy_setopt ( curl, CURLOPT_CAINFO, curl_cainfo );
+
+  CURLcode res = curl_easy_perform ( curl );
+  glong response = 0;
+  if ( res == CURLE_OK )
+    curl_easy_getinfo ( curl, CURLINFO_RESPONSE_CODE, &response );
+
+  // Don't leave these for the next use of the handle
+  curl_easy_setopt ( curl, CURLOPT_RANGE, NULL );
+  curl_easy_setopt ( curl, CURLOPT_HTTPHEADER, NULL );
+  if ( curl_send_headers )
+    curl_slist_free_all ( curl_send_headers );
+  if ( !handle )
+    curl_easy_cleanup ( curl );
+  g_free ( range );
+
+  GBytes *whole = g_byte_array_free_to_bytes ( data );
+  GBytes *ans = NULL;
+  if ( res != CURLE_OK ) {
+    if ( res != CURLE_ABORTED_BY_CALLBACK )
+      g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
+  }
+  else if ( response == 206 ) // Partial Content
+    ans = g_bytes_ref ( whole );
+  else if ( response == 200 ) {
+    // The whole file
+    gsize size = g_bytes_get_size ( whole );
+    if ( offset < size )
+      ans = g_bytes_new_from_bytes ( whole, offset, MIN(length, size - offset) );
+  }
+  else
+    g_warning ( "%s: http response: %ld for uri %s", __FUNCTION__, response, uri );
+  g_bytes_unref ( whole );
+
+  return ans;
+}
+
 void * curl_download_handle_init ()
 {
-  return curl_easy_init();
+  CurlDownloadHandle *cdh = g_malloc0 ( sizeof(CurlDownloadHandle) );
+  cdh->curl = curl_easy_init();
+  return cdh;
 }
 
 void curl_download_handle_cleanup ( void *handle )
 {
-  curl_easy_cleanup(handle);
+  CurlDownloadHandle *cdh = handle;
+  if ( !cdh )
+    return;
+  if ( cdh->curl )
+    curl_easy_cleanup ( cdh->curl );
+  handle_free_multi ( cdh );
+  g_free ( cdh );
 }
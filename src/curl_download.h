@@ -49,17 +49,36 @@ typedef struct {
    * Etag sent by server on this download
    */
   char *new_etag;
+  /**
+   * When set, the download goes here instead of the file
+   */
+  GByteArray *data;
 
 } CurlDownloadOptions;
 
+/**
+ * One transfer of a curl_download_uris() batch
+ */
+typedef struct {
+  const char *uri;
+  FILE *f;
+  DownloadFileOptions *options;
+  CurlDownloadOptions *cdo;
+  CURL_download_t result;
+  gdouble seconds; // Time the transfer took
+} CurlDownloadItem;
+
 void curl_download_init ();
 void curl_download_uninit ();
 CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *curl_options, void *handle );
 CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *curl_options, void *handle );
+gchar *curl_download_make_url ( const char *hostname, const char *uri, gboolean ftp );
+void curl_download_uris ( CurlDownloadItem *items, guint count, void *handle );
 void * curl_download_handle_init ();
 void curl_download_handle_cleanup ( void * handle );
 
 char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options );
+GBytes* curl_download_get_range ( const char *uri, guint64 offset, guint64 length, DownloadFileOptions *options, void *handle );
 
 G_END_DECLS
 
@@ -24,6 +24,21 @@
 #include "gpx.h"
 #include "babel_ui.h"
 #include "acquire.h"
+#include "nmea.h"
+#include "csv.h"
+#include "fit.h"
+
+typedef gboolean (*BuiltinReadFunc) ( VikTrwLayer *vtl, FILE *ff, const gchar *filename );
+
+/* Formats read directly, without running gpsbabel */
+static const struct {
+  const gchar *name; /* gpsbabel's identifier of the format */
+  BuiltinReadFunc read_func;
+} builtin_readers[] = {
+  { "nmea", a_nmea_read_file_into_layer },
+  { "unicsv", a_csv_read_file_into_layer },
+  { "garmin_fit", a_fit_read_file_into_layer },
+};
 
 typedef struct {
   GtkWidget *file;
@@ -46,6 +61,7 @@ static gpointer datasource_file_init ( acq_vik_t *avt );
 static void datasource_file_add_setup_widgets ( GtkWidget *dialog, VikViewport *vvp, gpointer user_data );
 static void datasource_file_get_process_options ( datasource_file_widgets_t *widgets, ProcessOptions *po, gpointer not_used, const gchar *not_used2, const gchar *not_used3 );
 static void datasource_file_cleanup ( gpointer data );
+static gboolean datasource_file_process ( VikTrwLayer *vtl, ProcessOptions *po, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options );
 
 VikDataSourceInterface vik_datasource_file_interface = {
   N_("Import file with GPSBabel"),
@@ -59,7 +75,7 @@ VikDataSourceInterface vik_datasource_file_interface = {
   (VikDataSourceCheckExistenceFunc)	NULL,
   (VikDataSourceAddSetupWidgetsFunc)	datasource_file_add_setup_widgets,
   (VikDataSourceGetProcessOptionsFunc)  datasource_file_get_process_options,
-  (VikDataSourceProcessFunc)            a_babel_convert_from,
+  (VikDataSourceProcessFunc)            datasource_file_process,
   (VikDataSourceProgressFunc)		NULL,
   (VikDataSourceAddProgressWidgetsFunc)	NULL,
   (VikDataSourceCleanupFunc)		datasource_file_cleanup,
@@ -172,6 +188,7 @@ static void datasource_file_get_process_options ( datasource_file_widgets_t *wid
   /* Generate the process options */
   po->babelargs = g_strdup_printf( "-i %s", type);
   po->filename = g_strdup(filename);
+  po->input_file_type = g_strdup(type);
 
   /* Free memory */
   g_free (filename);
@@ -179,6 +196,30 @@ static void datasource_file_get_process_options ( datasource_file_widgets_t *wid
   g_debug(_("using babel args '%s' and file '%s'"), po->babelargs, po->filename);
 }
 
+/**
+ * Use the built in reader for the format when there is one,
+ *  falling back to gpsbabel if it can not read the file
+ */
+static gboolean datasource_file_process ( VikTrwLayer *vtl, ProcessOptions *po, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options )
+{
+  if ( po->filename && po->input_file_type && !po->babel_filters ) {
+    for ( guint ii = 0; ii < G_N_ELEMENTS(builtin_readers); ii++ ) {
+      if ( g_strcmp0 ( po->input_file_type, builtin_readers[ii].name ) != 0 )
+        continue;
+      FILE *ff = g_fopen ( po->filename, "rb" );
+      if ( ff ) {
+        gboolean ans = builtin_readers[ii].read_func ( vtl, ff, po->filename );
+        fclose ( ff );
+        if ( ans )
+          return TRUE;
+      }
+      g_debug ( "%s: built in %s reader failed for %s, trying gpsbabel", __FUNCTION__, po->input_file_type, po->filename );
+      break;
+    }
+  }
+  return a_babel_convert_from ( vtl, po, status_cb, adw, options );
+}
+
 /* See VikDataSourceInterface */
 static void datasource_file_cleanup ( gpointer data )
 {
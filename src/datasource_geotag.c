@@ -22,6 +22,7 @@
 #include "viking.h"
 #include "acquire.h"
 #include "geotag_exif.h"
+#include "background.h"
 
 typedef struct {
 	GtkWidget *files;
@@ -133,8 +134,28 @@ static void datasource_geotag_get_process_options ( gpointer user_data, ProcessO
 	po->babelargs = g_strdup ("fake command"); // Not really used, thus no translations
 }
 
+typedef struct {
+	gchar *filename;
+	VikWaypoint *wp;
+	gchar *name;
+} geotag_file_t;
+
+typedef struct {
+	geotag_file_t *files;
+	VikCoordMode mode;
+} geotag_files_t;
+
+static void datasource_geotag_file_item ( guint ii, geotag_files_t *batch )
+{
+	geotag_file_t *gf = &batch->files[ii];
+	gf->wp = a_geotag_create_waypoint_from_file ( gf->filename, batch->mode, &gf->name );
+}
+
 /**
  * Process selected files and try to generate waypoints storing them in the given vtl
+ *
+ * The files are read several at once (or from the EXIF cache if seen before),
+ *  then the waypoints added in the order of the files
  */
 static gboolean datasource_geotag_process ( VikTrwLayer *vtl, ProcessOptions *po, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, gpointer not_used )
 {
@@ -142,11 +163,18 @@ static gboolean datasource_geotag_process ( VikTrwLayer *vtl, ProcessOptions *po
 
 	// Process selected files
 	// In prinicple this loading should be quite fast and so don't need to have any progress monitoring
-	GSList *cur_file = user_data->filelist;
-	while ( cur_file ) {
-		gchar *filename = cur_file->data;
-		gchar *name;
-		VikWaypoint *wp = a_geotag_create_waypoint_from_file ( filename, vik_viewport_get_coord_mode ( adw->vvp ), &name );
+	guint count = g_slist_length ( user_data->filelist );
+	geotag_files_t batch = { g_new0 ( geotag_file_t, count ), vik_viewport_get_coord_mode ( adw->vvp ) };
+	guint ii = 0;
+	for ( GSList *cur_file = user_data->filelist; cur_file; cur_file = g_slist_next(cur_file) )
+		batch.files[ii++].filename = cur_file->data;
+
+	a_background_parallel ( (vik_thr_index_func)datasource_geotag_file_item, &batch, count );
+
+	for ( ii = 0; ii < count; ii++ ) {
+		gchar *filename = batch.files[ii].filename;
+		gchar *name = batch.files[ii].name;
+		VikWaypoint *wp = batch.files[ii].wp;
 		if ( wp ) {
 			// Create name if geotag method didn't return one
 			if ( !name )
@@ -160,8 +188,8 @@ static gboolean datasource_geotag_process ( VikTrwLayer *vtl, ProcessOptions *po
 			g_free (msg);
 		}
 		g_free ( filename );
-		cur_file = g_slist_next ( cur_file );
 	}
+	g_free ( batch.files );
 
 	/* Free memory */
 	g_slist_free ( user_data->filelist );
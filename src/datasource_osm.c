@@ -36,6 +36,11 @@
  * See http://wiki.openstreetmap.org/wiki/API_v0.6#GPS_Traces
  */
 #define DOWNLOAD_URL_FMT "https://api.openstreetmap.org/api/0.6/trackpoints?bbox=%s,%s,%s,%s&page=%d"
+/**
+ * The API refuses areas of more than 0.25 square degrees,
+ *  so a bigger view is fetched as several cells of up to this size
+ */
+#define DOWNLOAD_CELL_DEGREES 0.5
 
 typedef struct {
   GtkWidget *page_number;
@@ -47,6 +52,7 @@ static gdouble last_page_number = 0;
 static gpointer datasource_osm_init ( acq_vik_t *avt );
 static void datasource_osm_add_setup_widgets ( GtkWidget *dialog, VikViewport *vvp, gpointer user_data );
 static void datasource_osm_get_process_options ( datasource_osm_widgets_t *widgets, ProcessOptions *po, DownloadFileOptions *options, const gchar *notused1, const gchar *notused2);
+static GList *datasource_osm_split ( datasource_osm_widgets_t *widgets, ProcessOptions *po );
 static void datasource_osm_cleanup ( gpointer data );
 
 VikDataSourceInterface vik_datasource_osm_interface = {
@@ -71,7 +77,9 @@ VikDataSourceInterface vik_datasource_osm_interface = {
   0,
   NULL,
   NULL,
-  0
+  0,
+
+  (VikDataSourceSplitFunc)              datasource_osm_split,
 };
 
 static gpointer datasource_osm_init ( acq_vik_t *avt )
@@ -124,6 +132,43 @@ static void datasource_osm_get_process_options ( datasource_osm_widgets_t *widge
   options = NULL; // i.e. use the default download settings
 }
 
+/**
+ * Divide the viewport into cells the API will accept, for the same page number
+ */
+static GList *datasource_osm_split ( datasource_osm_widgets_t *widgets, ProcessOptions *po )
+{
+  gdouble min_lat, max_lat, min_lon, max_lon;
+  vik_viewport_get_min_max_lat_lon ( widgets->vvp, &min_lat, &max_lat, &min_lon, &max_lon );
+
+  gint rows = MAX ( 1, (gint)ceil ( (max_lat - min_lat) / DOWNLOAD_CELL_DEGREES ) );
+  gint cols = MAX ( 1, (gint)ceil ( (max_lon - min_lon) / DOWNLOAD_CELL_DEGREES ) );
+  if ( rows == 1 && cols == 1 )
+    return NULL;
+
+  gdouble lat_step = (max_lat - min_lat) / rows;
+  gdouble lon_step = (max_lon - min_lon) / cols;
+  int page = last_page_number;
+  GList *parts = NULL;
+  gint row, col;
+  for ( row = 0; row < rows; row++ ) {
+    for ( col = 0; col < cols; col++ ) {
+      gchar sminlon[COORDS_STR_BUFFER_SIZE];
+      gchar smaxlon[COORDS_STR_BUFFER_SIZE];
+      gchar sminlat[COORDS_STR_BUFFER_SIZE];
+      gchar smaxlat[COORDS_STR_BUFFER_SIZE];
+      a_coords_dtostr_buffer ( min_lon + col * lon_step, sminlon );
+      a_coords_dtostr_buffer ( min_lon + (col+1) * lon_step, smaxlon );
+      a_coords_dtostr_buffer ( min_lat + row * lat_step, sminlat );
+      a_coords_dtostr_buffer ( min_lat + (row+1) * lat_step, smaxlat );
+
+      ProcessOptions *part = g_malloc0 ( sizeof(ProcessOptions) );
+      part->url = g_strdup_printf( DOWNLOAD_URL_FMT, sminlon, sminlat, smaxlon, smaxlat, page );
+      parts = g_list_prepend ( parts, part );
+    }
+  }
+  return g_list_reverse ( parts );
+}
+
 static void datasource_osm_cleanup ( gpointer data )
 {
   g_free ( data );
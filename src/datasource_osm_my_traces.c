@@ -33,6 +33,8 @@
  */
 #define DS_OSM_TRACES_GPX_URL_FMT "https://api.openstreetmap.org/api/0.6/gpx/%d/data"
 #define DS_OSM_TRACES_GPX_FILES "https://api.openstreetmap.org/api/0.6/user/gpx_files"
+// Most traces downloaded at once
+#define DS_OSM_TRACES_DOWNLOAD_THREADS 4
 
 typedef struct {
 	GtkWidget *user_entry;
@@ -498,6 +500,80 @@ static GList *select_from_list (GtkWindow *parent, GList *list, const gchar *tit
 	return NULL;
 }
 
+/**
+ * A trace being fetched by one of the download threads
+ */
+typedef struct {
+	gpx_meta_data_t *gmd;
+	gchar *url;
+	gchar *request_url; // May be signed
+	DownloadFileOptions options;
+	GBytes *data; // The response or NULL on failure
+	GAsyncQueue *done;
+} trace_download_t;
+
+static void trace_download_worker ( trace_download_t *td, gpointer unused )
+{
+	gchar *tmpname = a_download_uri_to_tmp_file ( td->request_url, &td->options );
+	if ( tmpname ) {
+		gchar *contents = NULL;
+		gsize size;
+		if ( g_file_get_contents ( tmpname, &contents, &size, NULL ) )
+			td->data = g_bytes_new_take ( contents, size );
+		(void)util_remove ( tmpname );
+		g_free ( tmpname );
+	}
+	g_async_queue_push ( td->done, td );
+}
+
+static void trace_download_free ( trace_download_t *td )
+{
+	if ( td->request_url != td->url )
+		g_free ( td->request_url );
+	g_free ( td->url );
+	if ( td->data )
+		g_bytes_unref ( td->data );
+	g_free ( td );
+}
+
+/**
+ * Traces acquired during this run of the program,
+ *  so getting them again can be skipped while their layers still exist
+ */
+typedef struct {
+	gchar *timestamp;
+	VikTrwLayer *vtl; // Weak pointer
+} loaded_trace_t;
+
+static GHashTable *loaded_traces = NULL;
+
+static void loaded_trace_free ( loaded_trace_t *lt )
+{
+	if ( lt->vtl )
+		g_object_remove_weak_pointer ( G_OBJECT(lt->vtl), (gpointer*)&lt->vtl );
+	g_free ( lt->timestamp );
+	g_free ( lt );
+}
+
+static gboolean trace_is_loaded ( gpx_meta_data_t *gmd )
+{
+	if ( !loaded_traces )
+		return FALSE;
+	loaded_trace_t *lt = g_hash_table_lookup ( loaded_traces, GUINT_TO_POINTER(gmd->id) );
+	return lt && lt->vtl && g_strcmp0 ( lt->timestamp, gmd->timestamp ) == 0;
+}
+
+static void trace_set_loaded ( gpx_meta_data_t *gmd, VikTrwLayer *vtl )
+{
+	if ( !loaded_traces )
+		loaded_traces = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)loaded_trace_free );
+	loaded_trace_t *lt = g_malloc ( sizeof(loaded_trace_t) );
+	lt->timestamp = g_strdup ( gmd->timestamp );
+	lt->vtl = vtl;
+	g_object_add_weak_pointer ( G_OBJECT(vtl), (gpointer*)&lt->vtl );
+	g_hash_table_replace ( loaded_traces, GUINT_TO_POINTER(gmd->id), lt );
+}
+
 static void none_found ( GtkWindow *gw )
 {
 	GtkWidget *dialog = NULL;
@@ -621,44 +697,66 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 	VikTrwLayer *vtl_last = vtl;
 	gboolean got_something = FALSE;
 
+	// Download the traces a few at once, reading each one as it arrives
+	GAsyncQueue *done = g_async_queue_new ();
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)trace_download_worker, NULL, DS_OSM_TRACES_DOWNLOAD_THREADS, FALSE, NULL );
+	guint pending = 0;
+	guint skipped = 0;
+
 	GList *selected_iterator = selected;
 	while ( selected_iterator ) {
+		gpx_meta_data_t *gmd = (gpx_meta_data_t*)selected_iterator->data;
+		selected_iterator = g_list_next ( selected_iterator );
+		if ( !gmd->id )
+			continue;
+		if ( trace_is_loaded ( gmd ) ) {
+			skipped++;
+			continue;
+		}
+		trace_download_t *td = g_malloc0 ( sizeof(trace_download_t) );
+		td->gmd = gmd;
+		td->url = g_strdup_printf ( DS_OSM_TRACES_GPX_URL_FMT, gmd->id );
+#ifdef HAVE_OAUTH_H
+		td->request_url = osm_oauth_sign_url ( td->url, NULL );
+#else
+		td->request_url = td->url;
+#endif
+		td->options = options;
+		td->done = done;
+		if ( td->request_url )
+			g_thread_pool_push ( pool, td, NULL );
+		else
+			// Failed to sign, so just report it
+			g_async_queue_push ( done, td );
+		pending++;
+	}
+
+	while ( pending-- ) {
+		trace_download_t *td = g_async_queue_pop ( done );
+		gpx_meta_data_t *gmd = td->gmd;
 
 		VikTrwLayer *vtlX = vtl;
 
 		if ( create_new_layer ) {
 			// Have data but no layer - so create one
 			vtlX = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, adw->vvp, FALSE ) );
-			if ( ((gpx_meta_data_t*)selected_iterator->data)->name )
-				vik_layer_rename ( VIK_LAYER ( vtlX ), ((gpx_meta_data_t*)selected_iterator->data)->name );
+			if ( gmd->name )
+				vik_layer_rename ( VIK_LAYER ( vtlX ), gmd->name );
 			else
 				vik_layer_rename ( VIK_LAYER ( vtlX ), _("My OSM Traces") );
 		}
 
+		// NB download type is GPX (or a compressed version)
 		result = FALSE;
-		gint gpx_id = ((gpx_meta_data_t*)selected_iterator->data)->id;
-		if ( gpx_id ) {
-			gchar *url = g_strdup_printf ( DS_OSM_TRACES_GPX_URL_FMT, gpx_id );
-
-			// NB download type is GPX (or a compressed version)
-			ProcessOptions my_po = *process_options;
-#ifdef HAVE_OAUTH_H
-			my_po.url = osm_oauth_sign_url ( url, NULL );
-#else
-			my_po.url = url;
-#endif
-			result = a_babel_convert_from ( vtlX, &my_po, status_cb, adw, &options );
-			// TODO investigate using a progress bar:
-			// http://developer.gnome.org/gtk/2.24/GtkProgressBar.html
-
-			got_something = got_something || result;
-			if ( !result ) {
-				// Report errors to the status bar
-				gchar* msg = g_strdup_printf ( _("Unable to get trace: %s"), url );
-				vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
-				g_free (msg);
-			}
-			g_free ( url );
+		if ( td->data )
+			result = a_babel_convert_from_url_cached ( vtlX, td->request_url, process_options->input_file_type, NULL, &td->options, NULL, &td->data );
+
+		got_something = got_something || result;
+		if ( !result ) {
+			// Report errors to the status bar
+			gchar* msg = g_strdup_printf ( _("Unable to get trace: %s"), td->url );
+			vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
+			g_free (msg);
 		}
 
 		if ( result ) {
@@ -668,13 +766,21 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 			vik_layer_post_read ( VIK_LAYER(vtlX), vik_window_viewport(adw->vw), TRUE );
 			vik_trw_layer_auto_set_view ( vtlX, vik_window_viewport(adw->vw) );
 			vtl_last = vtlX;
+			trace_set_loaded ( gmd, vtlX );
 		}
 		else if ( create_new_layer ) {
 			// Layer not needed as no data has been acquired
 			g_object_unref ( vtlX );
 		}
+		trace_download_free ( td );
+	}
+	g_thread_pool_free ( pool, FALSE, TRUE );
+	g_async_queue_unref ( done );
 
-		selected_iterator = g_list_next ( selected_iterator );
+	if ( skipped ) {
+		gchar *msg = g_strdup_printf ( ngettext("Skipped %d trace already loaded", "Skipped %d traces already loaded", skipped), skipped );
+		vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
+		g_free ( msg );
 	}
 
 	// Free memory
@@ -693,7 +799,8 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 
 	// ATM The user is only informed if all getting *all* of the traces failed
 	if ( selected )
-		result = got_something;
+		// Nothing new when all were already loaded is still as requested
+		result = got_something || skipped;
 	else
 		// Process was cancelled but need to return that it proceeded as expected
 		result = TRUE;
@@ -154,8 +154,12 @@ static void datasource_url_get_process_options ( datasource_url_widgets_t *widge
 
 	po->url = g_strdup ( last_url );
 
-	// Support .zip + bzip2 files directly
-	download_options->convert_file = a_try_decompress_file;
+	// GPX and KML are read straight from any compressed download,
+	//  otherwise support .zip + bzip2 files directly by decompressing them for gpsbabel
+	if ( po->input_file_type &&
+	     g_strcmp0 ( po->input_file_type, "gpx" ) != 0 &&
+	     g_strcmp0 ( po->input_file_type, "kml" ) != 0 )
+		download_options->convert_file = a_try_decompress_file;
 	download_options->follow_location = 5;
 }
 
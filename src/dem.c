@@ -43,6 +43,7 @@
 #include "coords.h"
 #include "fileutils.h"
 #include "file_magic.h"
+#include "background.h"
 
 #define DEM_BLOCK_SIZE 1024
 #define GET_COLUMN(dem,n) ((VikDEMColumn *)g_ptr_array_index( (dem)->columns, (n) ))
@@ -242,65 +243,48 @@ static void dem_parse_block ( gchar *buffer, VikDEM *dem, gint *cur_column, gint
   }
 }
 
+/**
+ * The .hgt samples are used in place from the mapping (or the decompressed memory),
+ *  so loading needs no pass over the data and the OS can share the pages between uses
+ */
 static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basename, gboolean zip)
 {
-  gint i, j;
   VikDEM *dem;
-  off_t file_size;
-  gint16 *dem_mem = NULL;
+  gsize file_size;
   gchar *dem_file = NULL;
-  const gint num_rows_3sec = 1201;
-  const gint num_rows_1sec = 3601;
-  gint num_rows;
+  const guint num_rows_3sec = 1201;
+  const guint num_rows_1sec = 3601;
   GMappedFile *mf;
   gint arcsec;
   GError *error = NULL;
 
-  dem = g_malloc(sizeof(VikDEM));
-
-  dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
-  dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
-
-  /* TODO */
-  dem->min_north = atoi(basename+1) * 3600;
-  dem->min_east = atoi(basename+4) * 3600;
-  if ( basename[0] == 'S' )
-    dem->min_north = - dem->min_north;
-  if ( basename[3] == 'W' )
-    dem->min_east = - dem->min_east;
-
-  dem->max_north = 3600 + dem->min_north;
-  dem->max_east = 3600 + dem->min_east;
-
-  dem->columns = g_ptr_array_new();
-  dem->n_columns = 0;
-
   if ((mf = g_mapped_file_new(file_name, FALSE, &error)) == NULL) {
     g_critical(_("Couldn't map file %s: %s"), file_name, error->message);
     g_error_free(error);
-    g_free(dem);
     return NULL;
   }
   file_size = g_mapped_file_get_length(mf);
   dem_file = g_mapped_file_get_contents(mf);
 
+  dem = g_malloc0(sizeof(VikDEM));
+
   if (zip) {
-    void *unzip_mem = NULL;
     gulong ucsize;
-
-    if ((unzip_mem = unzip_file(dem_file, &ucsize)) == NULL) {
+    if ((dem->grid_mem = unzip_file(dem_file, &ucsize)) == NULL) {
       g_mapped_file_unref(mf);
-      g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
-      g_ptr_array_free(dem->columns, TRUE);
       g_free(dem);
       return NULL;
     }
-
-    dem_mem = unzip_mem;
+    // The compressed file is no longer needed
+    g_mapped_file_unref(mf);
+    mf = NULL;
+    dem->grid = dem->grid_mem;
     file_size = ucsize;
   }
-  else
-    dem_mem = (gint16 *)dem_file;
+  else {
+    dem->mapped = mf;
+    dem->grid = (const gint16 *)dem_file;
+  }
 
   if (file_size == (num_rows_3sec * num_rows_3sec * sizeof(gint16)))
     arcsec = 3;
@@ -308,35 +292,27 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     arcsec = 1;
   else {
     g_warning("%s(): file %s does not have right size", __PRETTY_FUNCTION__, basename);
-    g_mapped_file_unref(mf);
-    g_free(dem);
+    vik_dem_free(dem);
     return NULL;
   }
 
-  num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
-  dem->east_scale = dem->north_scale = arcsec;
+  dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
+  dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
 
-  for ( i = 0; i < num_rows; i++ ) {
-    dem->n_columns++;
-    g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-    GET_COLUMN(dem,i)->east_west = dem->min_east + arcsec*i;
-    GET_COLUMN(dem,i)->south = dem->min_north;
-    GET_COLUMN(dem,i)->n_points = num_rows;
-    GET_COLUMN(dem,i)->points = g_malloc(sizeof(gint16)*num_rows);
-  }
+  /* TODO */
+  dem->min_north = atoi(basename+1) * 3600;
+  dem->min_east = atoi(basename+4) * 3600;
+  if ( basename[0] == 'S' )
+    dem->min_north = - dem->min_north;
+  if ( basename[3] == 'W' )
+    dem->min_east = - dem->min_east;
 
-  int ent = 0;
-  for ( i = (num_rows - 1); i >= 0; i-- ) {
-    for ( j = 0; j < num_rows; j++ ) {
-      GET_COLUMN(dem,j)->points[i] = GINT16_FROM_BE(dem_mem[ent]);
-      ent++;
-    }
+  dem->max_north = 3600 + dem->min_north;
+  dem->max_east = 3600 + dem->min_east;
 
-  }
+  dem->n_columns = dem->n_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
+  dem->east_scale = dem->north_scale = arcsec;
 
-  if (zip)
-    g_free(dem_mem);
-  g_mapped_file_unref(mf);
   return dem;
 }
 
@@ -364,7 +340,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   }
 
       /* Create Structure */
-  rv = g_malloc(sizeof(VikDEM));
+  rv = g_malloc0(sizeof(VikDEM));
 
       /* Header */
   f = g_fopen(file, "r");
@@ -423,21 +399,174 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
 void vik_dem_free ( VikDEM *dem )
 {
   guint i;
-  for ( i = 0; i < dem->n_columns; i++)
-    g_free ( GET_COLUMN(dem, i)->points );
-  g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
-  g_ptr_array_free ( dem->columns, TRUE );
+  if ( dem->columns ) {
+    for ( i = 0; i < dem->n_columns; i++)
+      g_free ( GET_COLUMN(dem, i)->points );
+    g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
+    g_ptr_array_free ( dem->columns, TRUE );
+  }
+  if ( dem->mapped )
+    g_mapped_file_unref ( dem->mapped );
+  g_free ( dem->grid_mem );
+  g_free ( dem->normals );
   g_free ( dem );
 }
 
 gint16 vik_dem_get_xy ( VikDEM *dem, guint col, guint row )
 {
-  if ( col < dem->n_columns )
-    if ( row < GET_COLUMN(dem, col)->n_points )
+  if ( col < dem->n_columns ) {
+    if ( dem->grid ) {
+      if ( row < dem->n_rows )
+        return GINT16_FROM_BE ( dem->grid[(dem->n_rows - 1 - row) * dem->n_columns + col] );
+    }
+    else if ( row < GET_COLUMN(dem, col)->n_points )
       return GET_COLUMN(dem, col)->points[row];
+  }
   return VIK_DEM_INVALID_ELEVATION;
 }
 
+/**
+ * vik_dem_get_size:
+ *
+ * Returns: Approximately how many bytes the samples occupy
+ */
+gsize vik_dem_get_size ( VikDEM *dem )
+{
+  gsize size = sizeof(VikDEM);
+  if ( dem->normals )
+    size += (gsize)dem->n_columns * dem->normals_stride * 2;
+  if ( dem->grid )
+    return size + (gsize)dem->n_rows * dem->n_columns * sizeof(gint16);
+  for ( guint i = 0; i < dem->n_columns; i++ )
+    size += sizeof(VikDEMColumn) + GET_COLUMN(dem, i)->n_points * sizeof(gint16);
+  return size;
+}
+
+/**
+ * vik_dem_get_n_points:
+ *
+ * Returns: The number of samples in the column
+ */
+guint vik_dem_get_n_points ( VikDEM *dem, guint col )
+{
+  if ( col >= dem->n_columns )
+    return 0;
+  if ( dem->grid )
+    return dem->n_rows;
+  return GET_COLUMN(dem, col)->n_points;
+}
+
+// Metres per degree of latitude (approximately, on a spherical Earth)
+#define DEM_METRES_PER_DEGREE 111195.0
+// Columns of the DEM worked on by one thread
+typedef struct {
+  VikDEM *dem;
+  guint8 *normals;
+  guint first;
+  guint last; // Exclusive
+} DEMNormalsBand;
+
+/**
+ * The height change per metre between two samples either side (or of one side, at an edge)
+ */
+static gdouble dem_slope_between ( gint16 elev, gint16 before, gint16 after, gdouble spacing )
+{
+  if ( before != VIK_DEM_INVALID_ELEVATION && after != VIK_DEM_INVALID_ELEVATION )
+    return (after - before) / (2 * spacing);
+  if ( after != VIK_DEM_INVALID_ELEVATION )
+    return (after - elev) / spacing;
+  if ( before != VIK_DEM_INVALID_ELEVATION )
+    return (elev - before) / spacing;
+  return 0.0;
+}
+
+static void dem_normals_band ( DEMNormalsBand *band )
+{
+  VikDEM *dem = band->dem;
+  const gboolean ll = (dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS);
+  const gdouble north_spacing = ll ? dem->north_scale / 3600 * DEM_METRES_PER_DEGREE : dem->north_scale;
+
+  for ( guint x = band->first; x < band->last; x++ ) {
+    guint8 *column = band->normals + (gsize)x * dem->normals_stride * 2;
+    guint n_points = vik_dem_get_n_points ( dem, x );
+    for ( guint y = 0; y < n_points; y++ ) {
+      gint16 elev = vik_dem_get_xy ( dem, x, y );
+      if ( elev == VIK_DEM_INVALID_ELEVATION )
+        continue;
+      gdouble east_spacing = dem->east_scale;
+      if ( ll ) {
+        gdouble lat = (dem->min_north + y * dem->north_scale) / 3600;
+        east_spacing = dem->east_scale / 3600 * DEM_METRES_PER_DEGREE * MAX ( cos(lat * G_PI / 180), 0.01 );
+      }
+      gdouble dzdx = dem_slope_between ( elev,
+                                         x > 0 ? vik_dem_get_xy(dem, x-1, y) : VIK_DEM_INVALID_ELEVATION,
+                                         vik_dem_get_xy(dem, x+1, y), east_spacing );
+      gdouble dzdy = dem_slope_between ( elev,
+                                         y > 0 ? vik_dem_get_xy(dem, x, y-1) : VIK_DEM_INVALID_ELEVATION,
+                                         vik_dem_get_xy(dem, x, y+1), north_spacing );
+      gdouble slope = atan ( sqrt(dzdx*dzdx + dzdy*dzdy) );
+      // Compass direction of the way down
+      gdouble aspect = atan2 ( -dzdx, -dzdy );
+      if ( aspect < 0 )
+        aspect += 2 * G_PI;
+      column[y*2] = (guint8)lround ( slope / (G_PI / 2) * VIK_DEM_SLOPE_MAX );
+      column[y*2+1] = (guint8)((gint)lround ( aspect / (2 * G_PI) * 256 ) & 0xff);
+    }
+  }
+}
+
+static void dem_normals_band_item ( guint index, DEMNormalsBand *bands )
+{
+  dem_normals_band ( &bands[index] );
+}
+
+/**
+ * Calculate the normals of all the samples,
+ *  in parallel across bands of columns
+ */
+static guint8 *dem_calculate_normals ( VikDEM *dem )
+{
+  guint stride = 0;
+  for ( guint x = 0; x < dem->n_columns; x++ )
+    stride = MAX ( stride, vik_dem_get_n_points(dem, x) );
+  dem->normals_stride = stride;
+  // Never NULL, to mark them as done
+  guint8 *normals = g_malloc0 ( MAX((gsize)dem->n_columns * stride * 2, 2) );
+
+  guint n_bands = CLAMP ( a_background_get_cpu_workers()+1, 1, dem->n_columns / 64 + 1 );
+  DEMNormalsBand *bands = g_new0 ( DEMNormalsBand, n_bands );
+  for ( guint ii = 0; ii < n_bands; ii++ ) {
+    bands[ii].dem = dem;
+    bands[ii].normals = normals;
+    bands[ii].first = dem->n_columns * ii / n_bands;
+    bands[ii].last = dem->n_columns * (ii+1) / n_bands;
+  }
+  a_background_parallel ( (vik_thr_index_func)dem_normals_band_item, bands, n_bands );
+  g_free ( bands );
+  return normals;
+}
+
+/**
+ * vik_dem_get_normal_xy:
+ *
+ * The way the surface faces at the sample, see VIK_DEM_NORMAL_SLOPE() and VIK_DEM_NORMAL_ASPECT()
+ * The normals of the whole DEM are calculated on the first call,
+ *  any other thread wanting them meanwhile waits for that to finish.
+ *
+ * Returns: 0 (flat) where there is no sample
+ */
+guint16 vik_dem_get_normal_xy ( VikDEM *dem, guint x, guint y )
+{
+  if ( g_once_init_enter ( &dem->normals ) ) {
+    guint8 *normals = dem_calculate_normals ( dem );
+    g_once_init_leave ( &dem->normals, normals );
+  }
+  if ( x >= dem->n_columns || y >= dem->normals_stride )
+    return 0;
+  const guint8 *normal = dem->normals + ((gsize)x * dem->normals_stride + y) * 2;
+  return (normal[0] << 8) | normal[1];
+}
+
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north )
 {
   gint col, row;
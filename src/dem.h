@@ -37,10 +37,23 @@ G_BEGIN_DECLS
 
 #define VIK_DEM_VERT_METERS 1 /* wrong in 250k?	 */
 
+/* Normals are quantised as a slope from flat (0) to vertical (VIK_DEM_SLOPE_MAX),
+ *  and the aspect (the direction downhill) clockwise from north in 256ths of a turn */
+#define VIK_DEM_SLOPE_MAX 127
+#define VIK_DEM_NORMAL_SLOPE(n) ((n) >> 8)
+#define VIK_DEM_NORMAL_ASPECT(n) ((n) & 0xff)
+
 
 typedef struct {
   guint n_columns;
-  GPtrArray *columns;
+  GPtrArray *columns; /* NULL when the samples are in a grid */
+
+  /* SRTM samples are kept as given in the file rather than copied into columns:
+   * big-endian, in rows of n_columns from the north, decoded on access */
+  GMappedFile *mapped;
+  const gint16 *grid;
+  gint16 *grid_mem; /* When not mapped (i.e. decompressed) */
+  guint n_rows;
 
   guint8 horiz_units;
   guint8 orig_vert_units; /* original, always converted to meters when loading. */
@@ -51,6 +64,11 @@ typedef struct {
 
   guint8 utm_zone;
   gchar utm_letter;
+
+  /* Slope and aspect pairs of each sample, only calculated when first wanted
+   * see vik_dem_get_normal_xy() */
+  guint8 *normals;
+  guint normals_stride; /* Samples per column */
 } VikDEM;
 
 typedef struct {
@@ -69,6 +87,9 @@ typedef struct {
 VikDEM *vik_dem_new_from_file(const gchar *file);
 void vik_dem_free ( VikDEM *dem );
 gint16 vik_dem_get_xy ( VikDEM *dem, guint x, guint y );
+guint vik_dem_get_n_points ( VikDEM *dem, guint x );
+gsize vik_dem_get_size ( VikDEM *dem );
+guint16 vik_dem_get_normal_xy ( VikDEM *dem, guint x, guint y );
 
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_simple_interpol ( VikDEM *dem, gdouble east, gdouble north );
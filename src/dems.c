@@ -19,30 +19,197 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  *
  */
+#include <math.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 
 #include "dems.h"
 #include "background.h"
+#include "settings.h"
+#include "vik_compat.h"
+#include "perfstats.h"
+
+#define VIK_SETTINGS_DEM_CACHE_BUDGET "dem_cache_budget_mb"
+// Megabytes of samples kept loaded (0 for unlimited)
+static gint DEM_CACHE_BUDGET = 1024;
 
 typedef struct {
-  VikDEM *dem;
+  gchar *filename;
+  VikDEM *dem; /* NULL when paged out, reloaded when next needed */
   guint ref_count;
+  gsize bytes; /* Of the loaded dem */
+  GList *lru_link; /* In dems_lru when loaded */
+  /* Remembered so that paged out DEMs need not be loaded to know where they are */
+  LatLonBBox bbox;
+  guint8 horiz_units;
+  guint8 utm_zone;
+  gboolean indexed; /* In dems_cells */
+  guint pinned; /* Being read without the lock, so must not be paged out */
 } LoadedDEM;
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
-static void loaded_dem_free ( LoadedDEM *ldem )
+// Loaded DEMs, most recently used first
+static GQueue dems_lru = G_QUEUE_INIT;
+static guint64 dems_bytes = 0;
+static guint dems_trim_id = 0;
+// DEMs are loaded in background threads whilst being used for drawing in the main one
+static GMutex *dems_mutex = NULL;
+
+// Whole degree cell -> GSList of the LoadedDEMs that overlap it
+//  so finding the DEM for a position need not test all of them
+static GHashTable *dems_cells = NULL;
+// Consecutive lookups (e.g. along a track) are nearly always in the same DEM
+static LoadedDEM *dems_last_hit = NULL;
+// Changed whenever the set of known DEMs changes - see a_dems_get_serial()
+static guint dems_serial = 0;
+
+// UTM based DEM bounds are only approximately a lat/lon box
+#define DEM_UTM_BBOX_MARGIN 0.01
+
+static gpointer dems_cell_key ( gint lat, gint lon )
 {
+  lat = CLAMP ( lat, -90, 89 );
+  lon = CLAMP ( lon, -180, 179 );
+  return GINT_TO_POINTER ( (lat + 90) * 360 + (lon + 180) );
+}
+
+/**
+ * Add the DEM to (or remove it from) the list of each cell that it overlaps
+ */
+static void dems_cells_update ( LoadedDEM *ldem, gboolean add )
+{
+  gdouble margin = ldem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ? DEM_UTM_BBOX_MARGIN : 0.0;
+  gint south = floor ( ldem->bbox.south - margin );
+  gint north = floor ( ldem->bbox.north + margin );
+  gint west = floor ( ldem->bbox.west - margin );
+  gint east = floor ( ldem->bbox.east + margin );
+  for ( gint lat = MAX(south, -90); lat <= MIN(north, 89); lat++ ) {
+    for ( gint lon = MAX(west, -180); lon <= MIN(east, 179); lon++ ) {
+      gpointer key = dems_cell_key ( lat, lon );
+      GSList *list = g_hash_table_lookup ( dems_cells, key );
+      if ( add )
+        list = g_slist_prepend ( list, ldem );
+      else
+        list = g_slist_remove ( list, ldem );
+      if ( list )
+        g_hash_table_insert ( dems_cells, key, list );
+      else
+        g_hash_table_remove ( dems_cells, key );
+    }
+  }
+  ldem->indexed = add;
+  dems_serial++;
+}
+
+static void loaded_dem_page_out ( LoadedDEM *ldem )
+{
+  if ( !ldem->dem )
+    return;
+  g_queue_delete_link ( &dems_lru, ldem->lru_link );
+  ldem->lru_link = NULL;
+  dems_bytes -= ldem->bytes;
   vik_dem_free ( ldem->dem );
+  ldem->dem = NULL;
+}
+
+static void loaded_dem_free ( LoadedDEM *ldem )
+{
+  if ( ldem->indexed )
+    dems_cells_update ( ldem, FALSE );
+  if ( dems_last_hit == ldem )
+    dems_last_hit = NULL;
+  loaded_dem_page_out ( ldem );
+  g_free ( ldem->filename );
   g_free ( ldem );
 }
 
+/**
+ * Page out the least recently used DEMs until within the budget
+ *
+ * Only done from the main loop, so any DEM the main thread has got is not
+ *  freed whilst it is being used
+ */
+static gboolean dems_trim ( gpointer data )
+{
+  g_mutex_lock ( dems_mutex );
+  dems_trim_id = 0;
+  guint64 budget = (guint64)DEM_CACHE_BUDGET * 1024 * 1024;
+  // Always keep the most recently used one
+  GList *link = dems_lru.tail;
+  while ( budget && dems_bytes > budget && link && link != dems_lru.head ) {
+    LoadedDEM *ldem = link->data;
+    link = link->prev;
+    if ( ldem->pinned )
+      continue;
+    g_debug ( "%s: paging out %s", __FUNCTION__, ldem->filename );
+    loaded_dem_page_out ( ldem );
+  }
+  g_mutex_unlock ( dems_mutex );
+  return FALSE;
+}
+
+/**
+ * The DEM itself, loading it again if it has been paged out
+ * Must have the lock
+ */
+static VikDEM *loaded_dem_resident ( LoadedDEM *ldem )
+{
+  if ( ldem->dem ) {
+    if ( ldem->lru_link != dems_lru.head ) {
+      g_queue_unlink ( &dems_lru, ldem->lru_link );
+      g_queue_push_head_link ( &dems_lru, ldem->lru_link );
+    }
+    return ldem->dem;
+  }
+
+  VikDEM *dem = vik_dem_new_from_file ( ldem->filename );
+  if ( !dem )
+    return NULL;
+  ldem->dem = dem;
+  ldem->bytes = vik_dem_get_size ( dem );
+  ldem->bbox = vik_dem_get_bbox ( dem );
+  ldem->horiz_units = dem->horiz_units;
+  ldem->utm_zone = dem->utm_zone;
+  g_queue_push_head ( &dems_lru, ldem );
+  ldem->lru_link = dems_lru.head;
+  dems_bytes += ldem->bytes;
+
+  if ( DEM_CACHE_BUDGET && dems_bytes > (guint64)DEM_CACHE_BUDGET * 1024 * 1024 && !dems_trim_id )
+    dems_trim_id = g_idle_add ( dems_trim, NULL );
+  return dem;
+}
+
+static void dems_init ()
+{
+  if ( loaded_dems )
+    return;
+  loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) loaded_dem_free );
+  dems_cells = g_hash_table_new ( g_direct_hash, g_direct_equal );
+}
+
+void a_dems_init ()
+{
+  dems_mutex = vik_mutex_new ();
+  gint budget = DEM_CACHE_BUDGET;
+  if ( a_settings_get_integer ( VIK_SETTINGS_DEM_CACHE_BUDGET, &budget ) )
+    DEM_CACHE_BUDGET = MAX(0, budget);
+}
+
 void a_dems_uninit ()
 {
+  if ( dems_trim_id )
+    g_source_remove ( dems_trim_id );
+  dems_trim_id = 0;
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  loaded_dems = NULL;
+  if ( dems_cells )
+    g_hash_table_destroy ( dems_cells );
+  dems_cells = NULL;
+  vik_mutex_free ( dems_mutex );
+  dems_mutex = NULL;
 }
 
 /* To load a dem. if it was already loaded, will simply
@@ -51,51 +218,209 @@ void a_dems_uninit ()
 VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
+  VikDEM *dem;
 
+  g_mutex_lock ( dems_mutex );
   /* dems init hash table */
-  if ( ! loaded_dems )
-    loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
+  dems_init ();
 
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
-    return ldem->dem;
+    dem = loaded_dem_resident ( ldem );
   } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
-    ldem = g_malloc ( sizeof(LoadedDEM) );
-    ldem->ref_count = 1;
-    ldem->dem = dem;
-    g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
+    ldem = g_malloc0 ( sizeof(LoadedDEM) );
+    ldem->filename = g_strdup ( filename );
+    dem = loaded_dem_resident ( ldem );
+    if ( dem ) {
+      ldem->ref_count = 1;
+      g_hash_table_insert ( loaded_dems, ldem->filename, ldem );
+      dems_cells_update ( ldem, TRUE );
+    }
+    else
+      loaded_dem_free ( ldem );
   }
+  g_mutex_unlock ( dems_mutex );
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
-  if ( !ldem ) {
-    /* This is fine - probably means the loaded list was aborted / not completed for some reason */
-    return;
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem ) {
+    ldem->ref_count--;
+    if ( ldem->ref_count == 0 )
+      g_hash_table_remove ( loaded_dems, filename );
   }
-  ldem->ref_count--;
-  if ( ldem->ref_count == 0 )
-    g_hash_table_remove ( loaded_dems, filename );
+  /* otherwise this is fine - probably means the loaded list was aborted / not completed for some reason */
+  g_mutex_unlock ( dems_mutex );
 }
 
 /* to get a DEM that was already loaded.
  * assumes that its in there already,
  * although it could not be if earlier load failed.
+ * The DEM may be paged out again once control returns to the main loop,
+ *  so don't keep it beyond that.
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
+  VikDEM *dem = NULL;
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( ldem )
-    return ldem->dem;
-  return NULL;
+    dem = loaded_dem_resident ( ldem );
+  g_mutex_unlock ( dems_mutex );
+  return dem;
+}
+
+/**
+ * a_dems_pin:
+ *
+ * Get a DEM to read from another thread without taking the lock for each sample.
+ * It stays loaded (and referenced) until a_dems_unpin() is called.
+ *
+ * Returns: NULL if the DEM is not known or can't be loaded
+ */
+VikDEM *a_dems_pin ( const gchar *filename )
+{
+  VikDEM *dem = NULL;
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem )
+    dem = loaded_dem_resident ( ldem );
+  if ( dem ) {
+    ldem->ref_count++;
+    ldem->pinned++;
+  }
+  g_mutex_unlock ( dems_mutex );
+  return dem;
+}
+
+/**
+ * Must have the lock
+ */
+static void loaded_dem_unpin ( LoadedDEM *ldem )
+{
+  // Whilst pinned it may have grown (e.g. by calculating normals)
+  if ( ldem->dem ) {
+    gsize bytes = vik_dem_get_size ( ldem->dem );
+    dems_bytes = dems_bytes - ldem->bytes + bytes;
+    ldem->bytes = bytes;
+    if ( DEM_CACHE_BUDGET && dems_bytes > (guint64)DEM_CACHE_BUDGET * 1024 * 1024 && !dems_trim_id )
+      dems_trim_id = g_idle_add ( dems_trim, NULL );
+  }
+  ldem->pinned--;
+  ldem->ref_count--;
+  if ( ldem->ref_count == 0 )
+    g_hash_table_remove ( loaded_dems, ldem->filename );
+}
+
+void a_dems_unpin ( const gchar *filename )
+{
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem && ldem->pinned )
+    loaded_dem_unpin ( ldem );
+  g_mutex_unlock ( dems_mutex );
+}
+
+/**
+ * a_dems_get_bbox:
+ *
+ * Find where a DEM is without needing it to be loaded
+ *
+ * Returns: FALSE if the DEM is not known
+ */
+gboolean a_dems_get_bbox ( const gchar *filename, LatLonBBox *bbox )
+{
+  gboolean ans = FALSE;
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem ) {
+    *bbox = ldem->bbox;
+    ans = TRUE;
+  }
+  g_mutex_unlock ( dems_mutex );
+  return ans;
+}
+
+/**
+ * a_dems_get_usage:
+ * @count:    Returns the number of DEMs referenced
+ * @resident: Returns how many of them are currently loaded
+ * @bytes:    Returns the size of the loaded ones
+ *
+ * For diagnostics
+ */
+void a_dems_get_usage ( guint *count, guint *resident, guint64 *bytes )
+{
+  g_mutex_lock ( dems_mutex );
+  *count = loaded_dems ? g_hash_table_size ( loaded_dems ) : 0;
+  *resident = dems_lru.length;
+  *bytes = dems_bytes;
+  g_mutex_unlock ( dems_mutex );
+}
+
+/**
+ * a_dems_get_file_usage:
+ *
+ * Returns: The size of the DEM if it is currently loaded, otherwise 0
+ */
+guint64 a_dems_get_file_usage ( const gchar *filename )
+{
+  guint64 bytes = 0;
+  g_mutex_lock ( dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem && ldem->dem )
+    bytes = ldem->bytes;
+  g_mutex_unlock ( dems_mutex );
+  return bytes;
 }
 
+/**
+ * a_dems_trim:
+ * @bytes: How much to release
+ *
+ * Page out the least recently used DEMs (other than the most recent one) regardless of the budget,
+ *  e.g. to keep within the overall memory budget.
+ * Must be called from the main loop - see dems_trim().
+ *
+ * Returns: The amount released
+ */
+guint64 a_dems_trim ( guint64 bytes )
+{
+  guint64 freed = 0;
+  g_mutex_lock ( dems_mutex );
+  GList *link = dems_lru.tail;
+  while ( freed < bytes && link && link != dems_lru.head ) {
+    LoadedDEM *ldem = link->data;
+    link = link->prev;
+    if ( ldem->pinned )
+      continue;
+    freed += ldem->bytes;
+    loaded_dem_page_out ( ldem );
+  }
+  g_mutex_unlock ( dems_mutex );
+  return freed;
+}
+
+/**
+ * Whether the coordinate is worth looking up in this DEM
+ *  (so a paged out one is only reloaded when it may be used)
+ */
+static gboolean loaded_dem_may_contain ( LoadedDEM *ldem, const VikCoord *coord, const struct LatLon *ll )
+{
+  if ( ldem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+    return ll->lat >= ldem->bbox.south && ll->lat <= ldem->bbox.north &&
+           ll->lon >= ldem->bbox.west && ll->lon <= ldem->bbox.east;
+  } else if ( ldem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+    struct UTM utm;
+    vik_coord_to_utm ( coord, &utm );
+    return utm.zone == ldem->utm_zone;
+  }
+  return FALSE;
+}
 
 /* Load a string list (GList of strings) of dems. You have to use get to at them later.
  * When updating a list as a parameter, this should be before freeing the list so
@@ -173,10 +498,16 @@ gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
   static struct LatLon ll_tmp;
   GList *iter = dems;
   VikDEM *dem;
-  gint elev;
+  gint elev = VIK_DEM_INVALID_ELEVATION;
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
 
+  g_mutex_lock ( dems_mutex );
   while ( iter ) {
-    dem = a_dems_get ( (gchar *) iter->data );
+    LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, iter->data ) : NULL;
+    dem = NULL;
+    if ( ldem && loaded_dem_may_contain ( ldem, coord, &ll ) )
+      dem = loaded_dem_resident ( ldem );
     if ( dem ) {
       if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
         vik_coord_to_latlon ( coord, &ll_tmp );
@@ -184,40 +515,46 @@ gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
         ll_tmp.lon *= 3600;
         elev = vik_dem_get_east_north(dem, ll_tmp.lon, ll_tmp.lat);
         if ( elev != VIK_DEM_INVALID_ELEVATION )
-          return elev;
+          break;
       } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
         vik_coord_to_utm ( coord, &utm_tmp );
         if ( utm_tmp.zone == dem->utm_zone &&
              (elev = vik_dem_get_east_north(dem, utm_tmp.easting, utm_tmp.northing)) != VIK_DEM_INVALID_ELEVATION )
-            return elev;
+            break;
       }
     }
+    elev = VIK_DEM_INVALID_ELEVATION;
     iter = iter->next;
   }
-  return VIK_DEM_INVALID_ELEVATION;
+  g_mutex_unlock ( dems_mutex );
+  a_perfstats_count ( "dem", "lookups", 1 );
+  if ( elev != VIK_DEM_INVALID_ELEVATION )
+    a_perfstats_count ( "dem", "found", 1 );
+  return elev;
 }
 
 typedef struct {
   const VikCoord *coord;
+  struct LatLon ll; /* Of the coord */
   VikDemInterpol method;
   gint elev;
 } CoordElev;
 
-static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+/**
+ * Only reads the DEM, so need not have the lock when the DEM is pinned
+ */
+static gboolean get_elev_from_dem ( VikDEM *dem, CoordElev *ce )
 {
-  VikDEM *dem = ldem->dem;
   gdouble lat, lon;
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    struct LatLon ll_tmp;
-    vik_coord_to_latlon (ce->coord, &ll_tmp );
-    lat = ll_tmp.lat * 3600;
-    lon = ll_tmp.lon * 3600;
+    lat = ce->ll.lat * 3600;
+    lon = ce->ll.lon * 3600;
   } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
+    struct UTM utm_tmp;
+    vik_coord_to_utm (ce->coord, &utm_tmp);
     if (utm_tmp.zone != dem->utm_zone)
       return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
     lat = utm_tmp.northing;
     lon = utm_tmp.easting;
   } else
@@ -238,21 +575,110 @@ static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
   return (ce->elev != VIK_DEM_INVALID_ELEVATION);
 }
 
-/* TODO: keep a (sorted) linked list of DEMs and select the best resolution one */
-gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
+/**
+ * Must have the lock
+ */
+static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+{
+  if ( !loaded_dem_may_contain ( ldem, ce->coord, &ce->ll ) )
+    return FALSE;
+  VikDEM *dem = loaded_dem_resident ( ldem );
+  if ( !dem )
+    return FALSE;
+  return get_elev_from_dem ( dem, ce );
+}
+
+/**
+ * a_dems_get_elev_batch:
+ * @coords: The positions to look up
+ * @n:      The number of positions
+ * @method: How to interpolate between samples
+ * @out:    Returns the elevation for each position, or VIK_DEM_INVALID_ELEVATION where there is none
+ *
+ * As a_dems_get_elev_by_coord() for many positions at once.
+ * Runs of positions within the same DEM (as is usual along a track) go
+ *  straight to it, with each position converted only once.
+ * The DEM of such a run is read without holding the lock,
+ *  so several threads can look up positions at once.
+ */
+void a_dems_get_elev_batch ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *out )
 {
   CoordElev ce;
+  ce.method = method;
+  guint hits = 0;
+  // The DEM of the previous position, pinned so that it stays loaded
+  LoadedDEM *pinned = NULL;
 
-  if (!loaded_dems)
-    return VIK_DEM_INVALID_ELEVATION;
+  for ( guint ii = 0; ii < n; ii++ ) {
+    out[ii] = VIK_DEM_INVALID_ELEVATION;
+    ce.coord = &coords[ii];
+    vik_coord_to_latlon ( ce.coord, &ce.ll );
+    ce.elev = VIK_DEM_INVALID_ELEVATION;
 
-  ce.coord = coord;
-  ce.method = method;
-  ce.elev = VIK_DEM_INVALID_ELEVATION;
+    gboolean found = FALSE;
+    if ( pinned && loaded_dem_may_contain ( pinned, ce.coord, &ce.ll ) )
+      found = get_elev_from_dem ( pinned->dem, &ce );
+    if ( !found ) {
+      g_mutex_lock ( dems_mutex );
+      if ( pinned )
+        loaded_dem_unpin ( pinned );
+      pinned = NULL;
+      if ( loaded_dems ) {
+        if ( dems_last_hit )
+          found = get_elev_by_coord ( NULL, dems_last_hit, &ce );
+        if ( !found ) {
+          GSList *list = g_hash_table_lookup ( dems_cells, dems_cell_key ( floor(ce.ll.lat), floor(ce.ll.lon) ) );
+          for ( GSList *iter = list; iter; iter = iter->next ) {
+            if ( iter->data == dems_last_hit )
+              continue;
+            if ( (found = get_elev_by_coord ( NULL, iter->data, &ce )) ) {
+              dems_last_hit = iter->data;
+              break;
+            }
+          }
+        }
+        // Going straight to the DEM for the next position
+        if ( found && ii+1 < n ) {
+          pinned = dems_last_hit;
+          pinned->pinned++;
+          pinned->ref_count++;
+        }
+      }
+      g_mutex_unlock ( dems_mutex );
+    }
+    if ( found ) {
+      out[ii] = ce.elev;
+      hits++;
+    }
+  }
+  if ( pinned ) {
+    g_mutex_lock ( dems_mutex );
+    loaded_dem_unpin ( pinned );
+    g_mutex_unlock ( dems_mutex );
+  }
+
+  a_perfstats_count ( "dem", "lookups", n );
+  a_perfstats_count ( "dem", "found", hits );
+}
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
-    return VIK_DEM_INVALID_ELEVATION;
-  return ce.elev;
+/* TODO: keep a (sorted) linked list of DEMs and select the best resolution one */
+gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
+{
+  gint16 elev;
+  a_dems_get_elev_batch ( coord, 1, method, &elev );
+  return elev;
+}
+
+/**
+ * a_dems_get_serial:
+ *
+ * Returns: A number that changes whenever a DEM is loaded or discarded,
+ *          so elevations looked up before can be known to be out of date.
+ *          (Paging a DEM out and back in again does not change it)
+ */
+guint a_dems_get_serial ( void )
+{
+  return dems_serial;
 }
 
 /**
@@ -271,13 +697,15 @@ gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
 
   gpointer key, value;
   GHashTableIter ght_iter;
+  g_mutex_lock ( dems_mutex );
   g_hash_table_iter_init ( &ght_iter, loaded_dems );
   while ( g_hash_table_iter_next (&ght_iter, &key, &value) ) {
-    dem_bbox = vik_dem_get_bbox ( ((LoadedDEM*)value)->dem );
+    dem_bbox = ((LoadedDEM*)value)->bbox;
     if ( BBOX_INTERSECT(dem_bbox, bbox) ) {
       ans = TRUE;
       break;
     }
   }
+  g_mutex_unlock ( dems_mutex );
   return ans;
 }
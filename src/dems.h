@@ -33,15 +33,24 @@ typedef enum {
   VIK_DEM_INTERPOL_BEST,
 } VikDemInterpol;
 
+void a_dems_init ();
 void a_dems_uninit ();
 VikDEM *a_dems_load(const gchar *filename);
 void a_dems_unref(const gchar *filename);
 VikDEM *a_dems_get(const gchar *filename);
+VikDEM *a_dems_pin ( const gchar *filename );
+void a_dems_unpin ( const gchar *filename );
+gboolean a_dems_get_bbox ( const gchar *filename, LatLonBBox *bbox );
+void a_dems_get_usage ( guint *count, guint *resident, guint64 *bytes );
+guint64 a_dems_get_file_usage ( const gchar *filename );
+guint64 a_dems_trim ( guint64 bytes );
 int a_dems_load_list ( GList **dems, gpointer threaddata );
 void a_dems_list_free ( GList *dems );
 GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
+void a_dems_get_elev_batch ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *out );
+guint a_dems_get_serial ( void );
 
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox );
 
@@ -0,0 +1,144 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Syncing from a GPS device presented as USB mass storage (e.g. Garmin units),
+ *  where each activity is a FIT file in a folder on the device.
+ *
+ * The files already imported are remembered by name, size and modification time,
+ *  so each sync only offers the new (or changed) ones.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "devicesync.h"
+#include "dir.h"
+
+#define VIKING_DEVICE_SYNC_INI_FILE "device_sync.ini"
+
+static gchar *device_sync_index_filename ( void )
+{
+  return g_build_filename ( a_get_viking_dir(), VIKING_DEVICE_SYNC_INI_FILE, NULL );
+}
+
+static GKeyFile *device_sync_index_load ( void )
+{
+  GKeyFile *kf = g_key_file_new ();
+  gchar *fn = device_sync_index_filename ();
+  // Not existing until the first sync
+  (void)g_key_file_load_from_file ( kf, fn, G_KEY_FILE_NONE, NULL );
+  g_free ( fn );
+  return kf;
+}
+
+/**
+ * How the file is recognised as being the same one again
+ */
+static gchar *device_sync_file_stamp ( const gchar *filename )
+{
+  GStatBuf st;
+  if ( g_stat ( filename, &st ) != 0 )
+    return NULL;
+  return g_strdup_printf ( "%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, (gint64)st.st_size, (gint64)st.st_mtime );
+}
+
+static gint device_sync_compare ( gconstpointer a, gconstpointer b )
+{
+  return g_strcmp0 ( (const gchar*)a, (const gchar*)b );
+}
+
+/**
+ * a_device_sync_scan:
+ * @folder: The activity folder of the device (e.g. GARMIN/Activity)
+ *
+ * Returns: A list of the full filenames of the FIT files in the folder not imported before,
+ *  in name order (which for devices is normally the order recorded).
+ *  Free the list and its strings after use.
+ */
+GSList *a_device_sync_scan ( const gchar *folder )
+{
+  GError *error = NULL;
+  GDir *dir = g_dir_open ( folder, 0, &error );
+  if ( !dir ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return NULL;
+  }
+
+  GKeyFile *kf = device_sync_index_load ();
+  GSList *files = NULL;
+  const gchar *name;
+  while ( (name = g_dir_read_name(dir)) ) {
+    if ( !g_str_has_suffix(name, ".fit") && !g_str_has_suffix(name, ".FIT") )
+      continue;
+    gchar *fn = g_build_filename ( folder, name, NULL );
+    gchar *stamp = device_sync_file_stamp ( fn );
+    gchar *known = g_key_file_get_string ( kf, folder, name, NULL );
+    if ( stamp && g_strcmp0(stamp, known) != 0 )
+      files = g_slist_prepend ( files, fn );
+    else
+      g_free ( fn );
+    g_free ( known );
+    g_free ( stamp );
+  }
+  g_dir_close ( dir );
+  g_key_file_free ( kf );
+
+  return g_slist_sort ( files, device_sync_compare );
+}
+
+/**
+ * a_device_sync_remember:
+ * @files: Full filenames (as given by a_device_sync_scan()) that have been imported
+ *
+ * So they are not offered again, unless they change
+ */
+void a_device_sync_remember ( GSList *files )
+{
+  if ( !files )
+    return;
+
+  GKeyFile *kf = device_sync_index_load ();
+  for ( GSList *iter = files; iter; iter = iter->next ) {
+    gchar *stamp = device_sync_file_stamp ( iter->data );
+    if ( !stamp )
+      continue;
+    gchar *folder = g_path_get_dirname ( iter->data );
+    gchar *name = g_path_get_basename ( iter->data );
+    g_key_file_set_string ( kf, folder, name, stamp );
+    g_free ( name );
+    g_free ( folder );
+    g_free ( stamp );
+  }
+
+  GError *error = NULL;
+  gsize size;
+  gchar *data = g_key_file_to_data ( kf, &size, NULL );
+  gchar *fn = device_sync_index_filename ();
+  if ( !g_file_set_contents ( fn, data, size, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( fn );
+  g_free ( data );
+  g_key_file_free ( kf );
+}
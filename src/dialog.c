@@ -878,7 +878,11 @@ void a_dialog_about ( GtkWindow *parent )
   g_free(copyright);
 }
 
-gboolean a_dialog_map_n_zoom(GtkWindow *parent, gchar *mapnames[], gint default_map, gchar *zoom_list[], gint default_zoom, gint *selected_map, gint *selected_zoom)
+/**
+ * Choose the map, the range of zoom levels and how far either side (in km) to download along a track
+ */
+gboolean a_dialog_map_corridor ( GtkWindow *parent, gchar *mapnames[], gint default_map, gchar *zoom_list[], gint default_zoom1, gint default_zoom2, gdouble default_distance,
+                                 gint *selected_map, gint *selected_zoom1, gint *selected_zoom2, gdouble *selected_distance )
 {
   gchar **s;
 
@@ -894,17 +898,30 @@ gboolean a_dialog_map_n_zoom(GtkWindow *parent, gchar *mapnames[], gint default_
     vik_combo_box_text_append (GTK_COMBO_BOX(map_combo), *s);
   gtk_combo_box_set_active (GTK_COMBO_BOX(map_combo), default_map);
 
-  GtkWidget *zoom_label = gtk_label_new(_("Zoom level:"));
-  GtkWidget *zoom_combo = vik_combo_box_text_new();
+  GtkWidget *zoom_label1 = gtk_label_new(_("Zoom Start:"));
+  GtkWidget *zoom_combo1 = vik_combo_box_text_new();
   for (s = zoom_list; *s; s++)
-    vik_combo_box_text_append (GTK_COMBO_BOX(zoom_combo), *s);
-  gtk_combo_box_set_active (GTK_COMBO_BOX(zoom_combo), default_zoom);
+    vik_combo_box_text_append (GTK_COMBO_BOX(zoom_combo1), *s);
+  gtk_combo_box_set_active (GTK_COMBO_BOX(zoom_combo1), default_zoom1);
+
+  GtkWidget *zoom_label2 = gtk_label_new(_("Zoom End:"));
+  GtkWidget *zoom_combo2 = vik_combo_box_text_new();
+  for (s = zoom_list; *s; s++)
+    vik_combo_box_text_append (GTK_COMBO_BOX(zoom_combo2), *s);
+  gtk_combo_box_set_active (GTK_COMBO_BOX(zoom_combo2), default_zoom2);
+
+  GtkWidget *distance_label = gtk_label_new(_("Distance either side (km):"));
+  GtkWidget *distance_spin = gtk_spin_button_new ( (GtkAdjustment *) gtk_adjustment_new ( default_distance, 0.0, 50.0, 0.1, 1.0, 0 ), 0.1, 1 );
 
-  GtkTable *box = GTK_TABLE(gtk_table_new(2, 2, FALSE));
+  GtkTable *box = GTK_TABLE(gtk_table_new(4, 2, FALSE));
   gtk_table_attach_defaults(box, map_label, 0, 1, 0, 1);
   gtk_table_attach_defaults(box, map_combo, 1, 2, 0, 1);
-  gtk_table_attach_defaults(box, zoom_label, 0, 1, 1, 2);
-  gtk_table_attach_defaults(box, zoom_combo, 1, 2, 1, 2);
+  gtk_table_attach_defaults(box, zoom_label1, 0, 1, 1, 2);
+  gtk_table_attach_defaults(box, zoom_combo1, 1, 2, 1, 2);
+  gtk_table_attach_defaults(box, zoom_label2, 0, 1, 2, 3);
+  gtk_table_attach_defaults(box, zoom_combo2, 1, 2, 2, 3);
+  gtk_table_attach_defaults(box, distance_label, 0, 1, 3, 4);
+  gtk_table_attach_defaults(box, distance_spin, 1, 2, 3, 4);
 
   gtk_box_pack_start ( GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), GTK_WIDGET(box), FALSE, FALSE, 5 );
 
@@ -918,7 +935,9 @@ gboolean a_dialog_map_n_zoom(GtkWindow *parent, gchar *mapnames[], gint default_
   }
 
   *selected_map = gtk_combo_box_get_active(GTK_COMBO_BOX(map_combo));
-  *selected_zoom = gtk_combo_box_get_active(GTK_COMBO_BOX(zoom_combo));
+  *selected_zoom1 = gtk_combo_box_get_active(GTK_COMBO_BOX(zoom_combo1));
+  *selected_zoom2 = gtk_combo_box_get_active(GTK_COMBO_BOX(zoom_combo2));
+  *selected_distance = gtk_spin_button_get_value(GTK_SPIN_BUTTON(distance_spin));
 
   gtk_widget_destroy(dialog);
   return TRUE;
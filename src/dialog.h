@@ -65,7 +65,8 @@ guint a_dialog_get_positive_number ( GtkWindow *parent, gchar *title_text, gchar
 
 gint a_dialog_get_non_zero_number ( GtkWindow *parent, gchar *title_text, gchar *label_text, gint default_num, gint min, gint max, guint step );
 
-gboolean a_dialog_map_n_zoom(GtkWindow *parent, gchar *mapnames[], gint default_map, gchar *zoom_list[], gint default_zoom, gint *selected_map, gint *selected_zoom);
+gboolean a_dialog_map_corridor ( GtkWindow *parent, gchar *mapnames[], gint default_map, gchar *zoom_list[], gint default_zoom1, gint default_zoom2, gdouble default_distance,
+                                 gint *selected_map, gint *selected_zoom1, gint *selected_zoom2, gdouble *selected_distance );
 
 GList *a_dialog_select_from_list ( GtkWindow *parent, GList *names, gboolean multiple_selection_allowed, const gchar *title, const gchar *msg );
 
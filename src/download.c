@@ -45,9 +45,12 @@
 #include "download.h"
 
 #include "curl_download.h"
+#include "tileindex.h"
+#include "tilebundle.h"
 #include "preferences.h"
 #include "globals.h"
 #include "vik_compat.h"
+#include "perfstats.h"
 
 /**
  * a_download_file_options_free:
@@ -122,8 +125,27 @@ gboolean a_check_kml_file(FILE* f)
   return check_file_first_line(f, kml_str);
 }
 
-static GList *file_list = NULL;
-static GMutex *file_list_mutex = NULL;
+// Set of the (temporary) filenames being downloaded to
+static GHashTable *file_locks = NULL;
+// Filename -> GBytes of files downloaded into memory and not yet written
+static GHashTable *fresh_files = NULL;
+// Protects both of the above
+static GMutex *file_locks_mutex = NULL;
+// Writes the fresh files in the background, one at a time
+static GThreadPool *fresh_writer = NULL;
+
+/**
+ * A file downloaded into memory, to be written
+ */
+typedef struct {
+  gchar *fn;
+  GBytes *bytes;
+  gchar *etag; // New etag to be set on the file (maybe NULL)
+  gboolean use_etag;
+} FreshFile;
+
+// Fwd declaration
+static void fresh_file_write ( FreshFile *ff, gpointer user_data );
 
 /* spin button scales */
 static VikLayerParamScale params_scales[] = {
@@ -151,33 +173,61 @@ static VikLayerParam prefs[] = {
 void a_download_init (void)
 {
 	a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
-	file_list_mutex = vik_mutex_new();
+	file_locks_mutex = vik_mutex_new();
+	// The keys are owned by the lockers
+	file_locks = g_hash_table_new ( g_str_hash, g_str_equal );
+	fresh_files = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_bytes_unref );
+	fresh_writer = g_thread_pool_new ( (GFunc)fresh_file_write, NULL, 1, FALSE, NULL );
 }
 
 void a_download_uninit (void)
 {
-	vik_mutex_free(file_list_mutex);
+	// Finish writing any fresh files
+	g_thread_pool_free ( fresh_writer, FALSE, TRUE );
+	fresh_writer = NULL;
+	g_hash_table_destroy ( fresh_files );
+	g_hash_table_destroy ( file_locks );
+	vik_mutex_free(file_locks_mutex);
 }
 
 static gboolean lock_file(const char *fn)
 {
 	gboolean locked = FALSE;
-	g_mutex_lock(file_list_mutex);
-	if (g_list_find_custom(file_list, fn, (GCompareFunc)g_strcmp0) == NULL)
+	g_mutex_lock(file_locks_mutex);
+	if ( !g_hash_table_contains ( file_locks, fn ) )
 	{
 		// The filename is not yet locked
-		file_list = g_list_append(file_list, (gpointer)fn),
+		g_hash_table_add ( file_locks, (gpointer)fn );
 		locked = TRUE;
 	}
-	g_mutex_unlock(file_list_mutex);
+	g_mutex_unlock(file_locks_mutex);
 	return locked;
 }
 
 static void unlock_file(const char *fn)
 {
-	g_mutex_lock(file_list_mutex);
-	file_list = g_list_remove(file_list, (gconstpointer)fn);
-	g_mutex_unlock(file_list_mutex);
+	g_mutex_lock(file_locks_mutex);
+	(void)g_hash_table_remove ( file_locks, fn );
+	g_mutex_unlock(file_locks_mutex);
+}
+
+/**
+ * a_download_get_fresh:
+ *
+ * Returns: The contents of the file if it has just been downloaded into memory
+ *          and may not yet be written, otherwise NULL.
+ *          Unref the returned data after use.
+ */
+GBytes *a_download_get_fresh ( const gchar *fn )
+{
+	GBytes *bytes = NULL;
+	g_mutex_lock ( file_locks_mutex );
+	if ( fresh_files )
+		bytes = g_hash_table_lookup ( fresh_files, fn );
+	if ( bytes )
+		g_bytes_ref ( bytes );
+	g_mutex_unlock ( file_locks_mutex );
+	return bytes;
 }
 
 /**
@@ -335,74 +385,262 @@ static void set_etag(const char *fn, const char *fntmp, CurlDownloadOptions *cdo
   }
 }
 
-static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
+/**
+ * Write a file downloaded into memory (in the writer thread)
+ *  after which it is read from the file again
+ */
+static void fresh_file_write ( FreshFile *ff, gpointer user_data )
+{
+  gsize len = 0;
+  gconstpointer data = g_bytes_get_data ( ff->bytes, &len );
+  GError *error = NULL;
+  // Written to a temporary file and then moved into place
+  if ( g_file_set_contents ( ff->fn, data, len, &error ) ) {
+    if ( ff->use_etag && ff->etag ) {
+      CurlDownloadOptions cdo = { 0, NULL, ff->etag, NULL };
+      set_etag ( ff->fn, ff->fn, &cdo );
+    }
+    a_tileindex_update ( ff->fn, ff->use_etag ? ff->etag : NULL );
+  }
+  else {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+
+  g_mutex_lock ( file_locks_mutex );
+  // Unless downloaded again meanwhile
+  if ( g_hash_table_lookup(fresh_files, ff->fn) == ff->bytes )
+    (void)g_hash_table_remove ( fresh_files, ff->fn );
+  g_mutex_unlock ( file_locks_mutex );
+
+  g_bytes_unref ( ff->bytes );
+  g_free ( ff->fn );
+  g_free ( ff->etag );
+  g_free ( ff );
+}
+
+/**
+ * As check_file_first_line() for data in memory
+ */
+static gboolean check_data_first_line ( GByteArray *data, gchar *patterns[] )
 {
-  FILE *f;
+  guint pos = 0;
+  while ( pos < data->len && pos < 32 && isspace(data->data[pos]) )
+    pos++;
+  if ( pos >= data->len || pos >= 32 )
+    return FALSE;
+  for ( gchar **s = patterns; *s; s++ ) {
+    gsize len = strlen ( *s );
+    if ( data->len - pos >= len && g_ascii_strncasecmp ( *s, (const gchar*)data->data + pos, len ) == 0 )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * As a_check_map_file() for data in memory
+ */
+static gboolean check_map_data ( GByteArray *data )
+{
+  gchar * html_str[] = {
+    "<html",
+    "<!DOCTYPE html",
+    "<head",
+    "<title",
+    NULL
+  };
+  return !check_data_first_line ( data, html_str );
+}
+
+/**
+ * The state of one download between starting and finishing it
+ */
+typedef struct {
+  const char *fn;
+  DownloadFileOptions *options;
+  gboolean file_exists;
   gchar *tmpfilename;
-  gboolean failure = FALSE;
-  CurlDownloadOptions cdo = {0, NULL, NULL};
+  FILE *f;                  // NULL when downloading into memory
+  CurlDownloadOptions cdo;  // cdo.data set when downloading into memory
+} DownloadState;
 
-  /* Check file */
-  gboolean file_exists = g_file_test ( fn, G_FILE_TEST_EXISTS );
-  if ( file_exists )
+/**
+ * Check whether the download is needed and if so open the temporary file to download into
+ *
+ * Returns DOWNLOAD_SUCCESS when the download should go ahead,
+ *  otherwise the final result for this download
+ */
+static DownloadResult_t download_begin ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, DownloadState *ds )
+{
+  memset ( ds, 0, sizeof(DownloadState) );
+  ds->fn = fn;
+  ds->options = options;
+
+  // Only just downloaded, and so the file is as recent as can be
+  GBytes *fresh = a_download_get_fresh ( fn );
+  if ( fresh ) {
+    g_bytes_unref ( fresh );
+    return DOWNLOAD_NOT_REQUIRED;
+  }
+
+  /* Check file - preferring the tile index, as that also knows the time and etag */
+  TileIndexEntry entry = { 0, 0, NULL };
+  // Tiles in bundles are downloaded to a file next to the bundle and then moved in
+  gboolean bundled = a_tilebundle_is_member ( fn );
+  gboolean indexed = bundled ? a_tilebundle_lookup ( fn, &entry.mtime, NULL ) : a_tileindex_lookup ( fn, &entry );
+  ds->file_exists = indexed || ( !bundled && g_file_test ( fn, G_FILE_TEST_EXISTS ) );
+  if ( ds->file_exists )
   {
     // Options should always be specified when request downloading
     //  a file that already exists (i.e. map tiles)
-    if ( options == NULL )
+    if ( options == NULL ) {
+      g_free ( entry.etag );
       return DOWNLOAD_NOT_REQUIRED;
+    }
 
     time_t file_age = options->expiry_age;
     /* Get the modified time of this file */
-    GStatBuf buf;
-    (void)g_stat ( fn, &buf );
-    time_t file_time = buf.st_mtime;
+    time_t file_time = entry.mtime;
+    if ( !indexed ) {
+      GStatBuf buf;
+      (void)g_stat ( fn, &buf );
+      file_time = buf.st_mtime;
+    }
     if ( (time(NULL) - file_time) < file_age ) {
       /* File cache is too recent, so return */
+      g_free ( entry.etag );
       return DOWNLOAD_NOT_REQUIRED;
     }
 
     if ( options->check_file_server_time ) {
-      cdo.time_condition = file_time;
+      ds->cdo.time_condition = file_time;
     }
 
-    if ( options->use_etag ) {
-      get_etag(fn, &cdo);
+    if ( options->use_etag && !bundled ) {
+      if ( entry.etag && strlen(entry.etag) <= 100 ) {
+        ds->cdo.etag = entry.etag;
+        entry.etag = NULL;
+      }
+      else
+        get_etag(fn, &ds->cdo);
     }
+    g_free ( entry.etag );
 
   } else {
-    gchar *dir = g_path_get_dirname ( fn );
+    gchar *target = bundled ? a_tilebundle_staging_name ( fn ) : g_strdup ( fn );
+    gchar *dir = g_path_get_dirname ( target );
     if ( g_mkdir_with_parents ( dir , 0777 ) != 0)
       g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
     g_free ( dir );
+    g_free ( target );
   }
 
   // Early test for valid hostname & uri to avoid unnecessary tmp file
   if ( !hostname && !uri ) {
     g_warning ( "%s: Parameter error - neither hostname nor uri defined", __FUNCTION__ );
+    g_free ( ds->cdo.etag );
     return DOWNLOAD_PARAMETERS_ERROR;
   }
 
-  tmpfilename = g_strdup_printf("%s.tmp", fn);
-  if (!lock_file ( tmpfilename ) )
+  if ( bundled ) {
+    gchar *staging = a_tilebundle_staging_name ( fn );
+    ds->tmpfilename = g_strdup_printf("%s.tmp", staging);
+    g_free ( staging );
+  }
+  else
+    ds->tmpfilename = g_strdup_printf("%s.tmp", fn);
+  if (!lock_file ( ds->tmpfilename ) )
   {
-    g_debug("%s: Couldn't take lock on temporary file \"%s\"", __FUNCTION__, tmpfilename);
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
+    g_debug("%s: Couldn't take lock on temporary file \"%s\"", __FUNCTION__, ds->tmpfilename);
+    g_free ( ds->tmpfilename );
+    g_free ( ds->cdo.etag );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
-  f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
-  if ( ! f ) {
-    g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
+  // Still taking the lock, so the same file isn't downloaded at the same time
+  if ( options && options->in_memory && !options->convert_file && !bundled &&
+       ( !options->check_file || options->check_file == a_check_map_file ) ) {
+    ds->cdo.data = g_byte_array_new ();
+    return DOWNLOAD_SUCCESS;
+  }
+  ds->f = g_fopen ( ds->tmpfilename, "w+b" );  /* truncate file and open it */
+  if ( ! ds->f ) {
+    g_warning("Couldn't open temporary file \"%s\": %s", ds->tmpfilename, g_strerror(errno));
+    unlock_file ( ds->tmpfilename );
+    g_free ( ds->tmpfilename );
+    g_free ( ds->cdo.etag );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
+  return DOWNLOAD_SUCCESS;
+}
 
-  /* Call the backend function */
-  CURL_download_t ret = curl_download_get_url ( hostname, uri, f, options, ftp, &cdo, handle );
+/**
+ * Check the data downloaded into memory, which then becomes the file's contents
+ *  whilst the file is written in the background
+ *
+ * Returns the final result for this download
+ */
+static DownloadResult_t download_end_in_memory ( DownloadState *ds, CURL_download_t ret )
+{
+  DownloadFileOptions *options = ds->options;
+  const char *fn = ds->fn;
+  GByteArray *data = ds->cdo.data;
+  DownloadResult_t result = DOWNLOAD_SUCCESS;
+  ds->cdo.data = NULL;
+
+  if ( ret == CURL_DOWNLOAD_ABORTED ) {
+    g_debug ( "%s: download aborted: curl_download_get_url=%d", __FUNCTION__, ret );
+    result = DOWNLOAD_USER_ABORTED;
+  } else if ( ret == CURL_DOWNLOAD_ERROR ) {
+    g_debug ( "%s: download failed: curl_download_get_url=%d", __FUNCTION__, ret );
+    result = DOWNLOAD_HTTP_ERROR;
+  } else if ( ret != CURL_DOWNLOAD_NO_NEWER_FILE && options->check_file && !check_map_data(data) ) {
+    g_debug ( "%s: content checking failed", __FUNCTION__ );
+    result = DOWNLOAD_CONTENT_ERROR;
+  }
+
+  if ( result != DOWNLOAD_SUCCESS ) {
+    g_warning ( _("Download error: %s"), fn );
+    g_byte_array_free ( data, TRUE );
+  } else if ( ret == CURL_DOWNLOAD_NO_NEWER_FILE ) {
+    g_byte_array_free ( data, TRUE );
+    // update mtime of local copy
+    if ( g_utime ( fn, NULL ) != 0 )
+      g_warning ( "%s couldn't set time on: %s", __FUNCTION__, fn );
+    a_tileindex_touch ( fn );
+  } else {
+    FreshFile *ff = g_malloc0 ( sizeof(FreshFile) );
+    ff->fn = g_strdup ( fn );
+    ff->bytes = g_byte_array_free_to_bytes ( data );
+    ff->use_etag = options->use_etag;
+    ff->etag = ds->cdo.new_etag;
+    ds->cdo.new_etag = NULL;
+    g_mutex_lock ( file_locks_mutex );
+    g_hash_table_replace ( fresh_files, g_strdup(fn), g_bytes_ref(ff->bytes) );
+    g_mutex_unlock ( file_locks_mutex );
+    g_thread_pool_push ( fresh_writer, ff, NULL );
+  }
+
+  unlock_file ( ds->tmpfilename );
+  g_free ( ds->tmpfilename );
+  g_free ( ds->cdo.etag );
+  g_free ( ds->cdo.new_etag );
+  return result;
+}
 
+/**
+ * Check the downloaded file and move it into place
+ *
+ * Returns the final result for this download
+ */
+static DownloadResult_t download_end ( DownloadState *ds, CURL_download_t ret )
+{
+  if ( ds->cdo.data )
+    return download_end_in_memory ( ds, ret );
+
+  DownloadFileOptions *options = ds->options;
+  const char *fn = ds->fn;
+  gchar *tmpfilename = ds->tmpfilename;
+  gboolean failure = FALSE;
   DownloadResult_t result = DOWNLOAD_SUCCESS;
 
   if (ret == CURL_DOWNLOAD_ABORTED) {
@@ -415,14 +653,14 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     result = DOWNLOAD_HTTP_ERROR;
   }
 
-  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(f)) {
+  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(ds->f)) {
     g_debug("%s: file content checking failed", __FUNCTION__);
     failure = TRUE;
     result = DOWNLOAD_CONTENT_ERROR;
   }
 
-  fclose ( f );
-  f = NULL;
+  fclose ( ds->f );
+  ds->f = NULL;
 
   if (failure)
   {
@@ -431,49 +669,75 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
       g_warning( ("Failed to remove: %s"), tmpfilename);
     unlock_file ( tmpfilename );
     g_free ( tmpfilename );
-    if ( options != NULL && options->use_etag ) {
-      g_free ( cdo.etag );
-      g_free ( cdo.new_etag );
-    }
+    g_free ( ds->cdo.etag );
+    g_free ( ds->cdo.new_etag );
     return result;
   }
 
-  if (ret == CURL_DOWNLOAD_NO_NEWER_FILE)  {
+  if ( a_tilebundle_is_member ( fn ) ) {
+    if ( ret == CURL_DOWNLOAD_NO_NEWER_FILE ) {
+      (void)g_remove ( tmpfilename );
+      a_tilebundle_touch ( fn );
+    }
+    else {
+      if ( options != NULL && options->convert_file )
+        options->convert_file ( tmpfilename );
+      if ( !a_tilebundle_put_file ( fn, tmpfilename ) ) {
+        (void)g_remove ( tmpfilename );
+        result = DOWNLOAD_FILE_WRITE_ERROR;
+      }
+    }
+  } else if (ret == CURL_DOWNLOAD_NO_NEWER_FILE)  {
     (void)g_remove ( tmpfilename );
      // update mtime of local copy
      // Not security critical, thus potential Time of Check Time of Use race condition is not bad
      // coverity[toctou]
      if ( g_utime ( fn, NULL ) != 0 )
        g_warning ( "%s couldn't set time on: %s", __FUNCTION__, fn );
+     a_tileindex_touch ( fn );
   } else {
     if ( options != NULL && options->convert_file )
       options->convert_file ( tmpfilename );
 
     if ( options != NULL && options->use_etag ) {
-      if ( cdo.new_etag ) {
+      if ( ds->cdo.new_etag ) {
         /* server returned an etag value */
-        set_etag(fn, tmpfilename, &cdo);
+        set_etag(fn, tmpfilename, &ds->cdo);
       }
     }
 
     // Remove existing file if it exists and then replace with the newly downloaded file
     // Potential TOCTOU, but we shouldn't be requesting downloads of the same file multiple times anyway.
-    if ( file_exists )
+    if ( ds->file_exists )
       if ( g_remove ( fn ) )
         g_warning ( "%s: failed to remove: %s", __FUNCTION__, fn );
 
      /* move completely-downloaded file to permanent location */
      if ( g_rename ( tmpfilename, fn ) )
         g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, tmpfilename, fn );
+     a_tileindex_update ( fn, ( options != NULL && options->use_etag ) ? ds->cdo.new_etag : NULL );
   }
   unlock_file ( tmpfilename );
   g_free ( tmpfilename );
 
-  if ( options != NULL && options->use_etag ) {
-    g_free ( cdo.etag );
-    g_free ( cdo.new_etag );
-  }
-  return DOWNLOAD_SUCCESS;
+  g_free ( ds->cdo.etag );
+  g_free ( ds->cdo.new_etag );
+  return result;
+}
+
+static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
+{
+  DownloadState ds;
+  DownloadResult_t result = download_begin ( hostname, uri, fn, options, &ds );
+  if ( result != DOWNLOAD_SUCCESS )
+    return result;
+
+  /* Call the backend function */
+  gint64 start = g_get_monotonic_time ();
+  CURL_download_t ret = curl_download_get_url ( hostname, uri, ds.f, options, ftp, &ds.cdo, handle );
+  a_perfstats_time ( "download", hostname, g_get_monotonic_time() - start );
+
+  return download_end ( &ds, ret );
 }
 
 /**
@@ -490,6 +754,55 @@ DownloadResult_t a_ftp_download_get_url ( const char *hostname, const char *uri,
   return download ( hostname, uri, fn, opt, TRUE, handle );
 }
 
+/**
+ * a_http_download_get_urls:
+ * @requests: The downloads to perform, with the result of each filled in on return
+ * @count:    The number of requests
+ * @handle:   Handle from a_download_handle_init() (may be NULL)
+ *
+ * Like a_http_download_get_url() for each request, but the transfers run concurrently
+ *  sharing connections to the same server.
+ */
+void a_http_download_get_urls ( DownloadRequest *requests, guint count, void *handle )
+{
+  DownloadState *states = g_new0 ( DownloadState, count );
+  CurlDownloadItem *items = g_new0 ( CurlDownloadItem, count );
+  guint *index = g_new0 ( guint, count );
+  guint active = 0;
+
+  for ( guint ii = 0; ii < count; ii++ ) {
+    DownloadRequest *dr = &requests[ii];
+    dr->result = download_begin ( dr->hostname, dr->uri, dr->fn, dr->options, &states[ii] );
+    if ( dr->result != DOWNLOAD_SUCCESS )
+      continue;
+    gchar *full = curl_download_make_url ( dr->hostname, dr->uri, FALSE );
+    if ( !full ) {
+      dr->result = download_end ( &states[ii], CURL_DOWNLOAD_ERROR );
+      continue;
+    }
+    items[active].uri = full;
+    items[active].f = states[ii].f;
+    items[active].options = dr->options;
+    items[active].cdo = &states[ii].cdo;
+    index[active] = ii;
+    active++;
+  }
+
+  if ( active )
+    curl_download_uris ( items, active, handle );
+
+  for ( guint jj = 0; jj < active; jj++ ) {
+    guint ii = index[jj];
+    a_perfstats_time ( "download", requests[ii].hostname, (gint64)(items[jj].seconds * G_USEC_PER_SEC) );
+    requests[ii].result = download_end ( &states[ii], items[jj].result );
+    g_free ( (gchar*)items[jj].uri );
+  }
+
+  g_free ( index );
+  g_free ( items );
+  g_free ( states );
+}
+
 void * a_download_handle_init ()
 {
   return curl_download_handle_init ();
@@ -112,6 +112,13 @@ typedef struct {
    */
   VikFileContentConvertFunc convert_file;
 
+  /**
+   * Download into memory, where the content is checked, and then write the file in the background,
+   *  so the file's contents are available straight away - see a_download_get_fresh().
+   * Not used with convert_file or content checkers other than a_check_map_file().
+   */
+  gboolean in_memory;
+
 } DownloadFileOptions;
 
 void a_download_file_options_free ( DownloadFileOptions *dfo );
@@ -132,11 +139,22 @@ typedef enum {
 /* TODO: convert to Glib */
 DownloadResult_t a_http_download_get_url ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *handle );
 DownloadResult_t a_ftp_download_get_url ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *handle );
+typedef struct {
+  const char *hostname;
+  const char *uri;
+  const char *fn;
+  DownloadFileOptions *options;
+  DownloadResult_t result;
+} DownloadRequest;
+
+void a_http_download_get_urls ( DownloadRequest *requests, guint count, void *handle );
 void *a_download_handle_init ();
 void a_download_handle_cleanup ( void *handle );
 
 gchar *a_download_uri_to_tmp_file ( const gchar *uri, DownloadFileOptions *options );
 
+GBytes *a_download_get_fresh ( const gchar *fn );
+
 G_END_DECLS
 
 #endif
@@ -32,6 +32,7 @@
 #include "gpsmapper.h"
 #include "compression.h"
 #include "file_magic.h"
+#include "binfile.h"
 #include "vikgpslayer.h"
 #include "vikgeocluelayer.h"
 
@@ -87,7 +88,10 @@ static gboolean str_starts_with ( const gchar *haystack, const gchar *needle, gu
   return FALSE;
 }
 
-void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type, VikLayerParamData data ) {
+/**
+ * As file_write_layer_param() but adding to a string in memory
+ */
+void file_append_layer_param ( GString *str, const gchar *name, VikLayerParamType type, VikLayerParamData data ) {
       /* string lists are handled differently. We get a GList (that shouldn't
        * be freed) back for get_param and if it is null we shouldn't write
        * anything at all (otherwise we'd read in a list with an empty string,
@@ -97,31 +101,38 @@ void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type
         if ( data.sl ) {
           GList *iter = (GList *)data.sl;
           while ( iter ) {
-            fprintf ( f, "%s=", name );
-            fprintf ( f, "%s\n", (gchar *)(iter->data) );
+            g_string_append_printf ( str, "%s=", name );
+            g_string_append_printf ( str, "%s\n", (gchar *)(iter->data) );
             iter = iter->next;
           }
         }
       } else if ( type != VIK_LAYER_PARAM_PTR && type != VIK_LAYER_PARAM_PTR_DEFAULT ) {
-        fprintf ( f, "%s=", name );
+        g_string_append_printf ( str, "%s=", name );
         switch ( type )
         {
           case VIK_LAYER_PARAM_DOUBLE: {
   //          char buf[15]; /* locale independent */
   //          fprintf ( f, "%s\n", (char *) g_dtostr (data.d, buf, sizeof (buf)) ); break;
-              fprintf ( f, "%f\n", data.d );
+              g_string_append_printf ( str, "%f\n", data.d );
               break;
          }
-          case VIK_LAYER_PARAM_UINT: fprintf ( f, "%d\n", data.u ); break;
-          case VIK_LAYER_PARAM_INT: fprintf ( f, "%d\n", data.i ); break;
-          case VIK_LAYER_PARAM_BOOLEAN: fprintf ( f, "%c\n", data.b ? 't' : 'f' ); break;
-          case VIK_LAYER_PARAM_STRING: fprintf ( f, "%s\n", data.s ? data.s : "" ); break;
-          case VIK_LAYER_PARAM_COLOR: fprintf ( f, "#%.2x%.2x%.2x\n", (int)(data.c.red/256),(int)(data.c.green/256),(int)(data.c.blue/256)); break;
+          case VIK_LAYER_PARAM_UINT: g_string_append_printf ( str, "%d\n", data.u ); break;
+          case VIK_LAYER_PARAM_INT: g_string_append_printf ( str, "%d\n", data.i ); break;
+          case VIK_LAYER_PARAM_BOOLEAN: g_string_append_printf ( str, "%c\n", data.b ? 't' : 'f' ); break;
+          case VIK_LAYER_PARAM_STRING: g_string_append_printf ( str, "%s\n", data.s ? data.s : "" ); break;
+          case VIK_LAYER_PARAM_COLOR: g_string_append_printf ( str, "#%.2x%.2x%.2x\n", (int)(data.c.red/256),(int)(data.c.green/256),(int)(data.c.blue/256)); break;
           default: break;
         }
       }
 }
 
+void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type, VikLayerParamData data ) {
+  GString *str = g_string_new ( NULL );
+  file_append_layer_param ( str, name, type, data );
+  fputs ( str->str, f );
+  g_string_free ( str, TRUE );
+}
+
 static void write_layer_params_and_data ( VikLayer *l, FILE *f, const gchar *dirpath )
 {
   VikLayerParam *params = vik_layer_get_interface(l->type)->params;
@@ -649,7 +660,7 @@ gboolean check_file_magic_vik ( const gchar *filename )
   gboolean result = FALSE;
   FILE *ff = xfopen ( filename );
   if ( ff ) {
-    result = file_check_magic ( ff, VIK_MAGIC );
+    result = file_check_magic ( ff, VIK_MAGIC ) || file_check_magic ( ff, VIK_BINARY_MAGIC );
     xfclose ( ff );
   }
   return result;
@@ -696,6 +707,62 @@ gchar *append_file_ext ( const gchar *filename, VikFileType_t type )
   return new_name;
 }
 
+/**
+ * The TrackWaypoint layer to load a file's tracks, routes and waypoints into:
+ *  either the one given or a new one (indicated by @add_new)
+ */
+static VikTrwLayer* load_target_layer ( VikViewport *vp,
+                                        VikTrwLayer *vtl,
+                                        gboolean new_layer,
+                                        const gchar *filename,
+                                        const gchar *name,
+                                        gboolean *add_new )
+{
+  // Load the file as a new layer as instructed
+  *add_new = new_layer;
+
+  // If a layer is specified, then potentially load into that one
+  if ( a_vik_get_open_files_in_selected_layer() || !*add_new ) {
+    *add_new = TRUE;
+    if ( vtl ) {
+      if ( IS_VIK_TRW_LAYER(vtl) ) {
+        // Provided that the layer will be visible
+        //  (otherwise possibly confusing to load but not display it)
+        if ( vik_treeview_item_get_visible_tree (VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter)) ) {
+          *add_new = FALSE;
+        }
+      }
+    }
+  }
+
+  if ( *add_new ) {
+    vtl = VIK_TRW_LAYER (vik_layer_create ( VIK_LAYER_TRW, vp, FALSE ));
+    vik_layer_rename ( VIK_LAYER(vtl), name ? name : a_file_basename ( filename ) );
+  }
+  return vtl;
+}
+
+static void load_complete ( VikAggregateLayer *top, VikViewport *vp, VikTrwLayer *vtl, gboolean add_new, gboolean success )
+{
+  // Clean up when we can't handle the file
+  if ( ! success ) {
+    // free up layer
+    g_object_unref ( vtl );
+  }
+  else {
+    // Complete the setup from the successful load
+    vik_layer_post_read ( VIK_LAYER(vtl), vp, TRUE );
+    if ( add_new ) {
+      vik_aggregate_layer_add_layer ( top, VIK_LAYER(vtl), FALSE );
+    }
+    else {
+      // Make it more accessible in layers panel
+      vik_layer_expand_tree ( VIK_LAYER(vtl) );
+    }
+    vik_trw_layer_auto_set_view ( vtl, vp );
+  }
+}
+
 /**
  * a_file_load_stream:
  *
@@ -720,21 +787,28 @@ VikLoadType_t a_file_load_stream ( FILE *f,
     else
       load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
   }
+  else if ( file_check_magic ( f, VIK_BINARY_MAGIC ) )
+  {
+    if ( a_binfile_read ( top, vp, f, filename, dirpath ) )
+      load_answer = LOAD_TYPE_VIK_SUCCESS;
+    else
+      load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
+  }
   else if ( file_magic_check ( filename, "application/zip", ".zip" ) ) {
     (void)fclose ( f );
     load_answer = uncompress_load_zip_file ( filename, top, vp, vtl, new_layer, external, dirpath );
   }
   else if ( file_magic_check ( filename, "application/x-bzip2", ".bz2" ) ) {
-    load_answer = uncompress_load_bzip_file ( filename, top, vp, vtl, new_layer, external );
+    load_answer = uncompress_load_bzip_file ( filename, top, vp, vtl, new_layer, external, dirpath );
   }
   else if ( file_magic_check ( filename, "application/x-xz", ".xz" ) ) {
-    load_answer = uncompress_load_xz_file ( filename, top, vp, vtl, new_layer, external );
+    load_answer = uncompress_load_xz_file ( filename, top, vp, vtl, new_layer, external, dirpath );
   }
   else if ( file_magic_check ( filename, "application/x-lzma", ".lzma" ) ) {
-    load_answer = uncompress_load_xz_file ( filename, top, vp, vtl, new_layer, external );
+    load_answer = uncompress_load_xz_file ( filename, top, vp, vtl, new_layer, external, dirpath );
   }
   else if ( file_magic_check ( filename, "application/gzip", ".gz" ) ) {
-    load_answer = uncompress_load_gz_file ( filename, top, vp, vtl, new_layer, external );
+    load_answer = uncompress_load_gz_file ( filename, top, vp, vtl, new_layer, external, dirpath );
   }
   else if ( a_jpg_magic_check ( filename ) ) {
     if ( ! a_jpg_load_file ( top, filename, vp ) )
@@ -757,27 +831,8 @@ VikLoadType_t a_file_load_stream ( FILE *f,
 	//  must be loaded into a new TrackWaypoint layer (hence it be created)
     gboolean success = TRUE; // Detect load failures - mainly to remove the layer created as it's not required
 
-    // Load the file as a new layer as instructed
-    gboolean add_new = new_layer;
-
-    // If a layer is specified, then potentially load into that one
-    if ( a_vik_get_open_files_in_selected_layer() || !add_new ) {
-      add_new = TRUE;
-      if ( vtl ) {
-        if ( IS_VIK_TRW_LAYER(vtl) ) {
-          // Provided that the layer will be visible
-          //  (otherwise possibly confusing to load but not display it)
-          if ( vik_treeview_item_get_visible_tree (VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter)) ) {
-            add_new = FALSE;
-          }
-        }
-      }
-    }
-
-    if (add_new) {
-      vtl = VIK_TRW_LAYER (vik_layer_create ( VIK_LAYER_TRW, vp, FALSE ));
-      vik_layer_rename ( VIK_LAYER(vtl), name ? name : a_file_basename ( filename ) );
-    }
+    gboolean add_new;
+    vtl = load_target_layer ( vp, vtl, new_layer, filename, name, &add_new );
 
     // In fact both kml & gpx files start the same as they are in xml
     if ( a_file_check_ext ( filename, ".kml" ) && file_check_magic ( f, FILE_XML_MAGIC ) && !external ) {
@@ -818,6 +873,10 @@ VikLoadType_t a_file_load_stream ( FILE *f,
       else
         load_answer = LOAD_TYPE_FIT_FAILURE;
     }
+    else if ( a_file_check_ext ( filename, ".geojson" ) && !external ) {
+      if ( ! ( success = a_geojson_read_file ( vtl, filename ) ) )
+        load_answer = LOAD_TYPE_UNSUPPORTED_FAILURE;
+    }
     else {
       // Try final supported file type
       if ( ! ( success = a_gpspoint_read_file ( vtl, f, dirpath ) ) ) {
@@ -825,24 +884,46 @@ VikLoadType_t a_file_load_stream ( FILE *f,
         load_answer = LOAD_TYPE_UNSUPPORTED_FAILURE;
       }
     }
-    // Clean up when we can't handle the file
-    if ( ! success ) {
-      // free up layer
-      g_object_unref ( vtl );
-    }
-    else {
-      // Complete the setup from the successful load
-      vik_layer_post_read ( VIK_LAYER(vtl), vp, TRUE );
-      if (add_new) {
-        vik_aggregate_layer_add_layer ( top, VIK_LAYER(vtl), FALSE );
-      }
-      else {
-	// Make it more accessible in layers panel
-	vik_layer_expand_tree ( VIK_LAYER(vtl) );
-      }
-      vik_trw_layer_auto_set_view ( vtl, vp );
+    load_complete ( top, vp, vtl, add_new, success );
+  }
+  return load_answer;
+}
+
+/**
+ * a_file_load_xml_stream:
+ * @read_func: Where the (already decompressed) contents are read from
+ * @filename:  The name of the contents, only used to tell KML from GPX
+ *
+ * Load GPX or KML contents without needing a file for them,
+ *  otherwise the same as a_file_load_stream() for these types.
+ */
+VikLoadType_t a_file_load_xml_stream ( UtilReadFunc read_func,
+                                       gpointer user_data,
+                                       const gchar *filename,
+                                       VikAggregateLayer *top,
+                                       VikViewport *vp,
+                                       VikTrwLayer *vtl,
+                                       gboolean new_layer,
+                                       const gchar *dirpath,
+                                       const gchar *name )
+{
+  VikLoadType_t load_answer = LOAD_TYPE_OTHER_SUCCESS;
+  gboolean success = TRUE;
+  gboolean add_new;
+  vtl = load_target_layer ( vp, vtl, new_layer, filename, name, &add_new );
+
+  if ( a_file_check_ext ( filename, ".kml" ) ) {
+    if ( ! ( success = a_kml_read_stream ( vtl, read_func, user_data, FALSE ) ) )
+      load_answer = LOAD_TYPE_KML_FAILURE;
+  }
+  else {
+    switch ( a_gpx_read_stream ( vtl, read_func, user_data, dirpath, !add_new ) ) {
+    case GPX_READ_FAILURE: load_answer = LOAD_TYPE_GPX_FAILURE; break;
+    case GPX_READ_WARNING: load_answer = LOAD_TYPE_GPX_WARNING; break;
+    case GPX_READ_SUCCESS: load_answer = LOAD_TYPE_OTHER_SUCCESS; break;
     }
   }
+  load_complete ( top, vp, vtl, add_new, success );
   return load_answer;
 }
 
@@ -887,6 +968,126 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
   return load_answer;
 }
 
+/**
+ * a_file_load_can_read_gpx_only:
+ *
+ * Returns TRUE if the file would be loaded by a_file_load() as a GPX file into a new layer,
+ *  and so may be read by a_file_load_gpx() (e.g. in a background thread)
+ */
+gboolean a_file_load_can_read_gpx_only ( const gchar *filename )
+{
+  if ( !filename || strcmp(filename, "-") == 0 || strncmp(filename, "file://", 7) == 0 )
+    return FALSE;
+  if ( !a_file_check_ext ( filename, ".gpx" ) )
+    return FALSE;
+  // Compressed files and other types may be named .gpx too
+  if ( file_magic_check ( filename, "application/zip", ".zip" ) ||
+       file_magic_check ( filename, "application/x-bzip2", ".bz2" ) ||
+       file_magic_check ( filename, "application/x-xz", ".xz" ) ||
+       file_magic_check ( filename, "application/x-lzma", ".lzma" ) ||
+       file_magic_check ( filename, "application/gzip", ".gz" ) )
+    return FALSE;
+
+  gboolean ans = FALSE;
+  FILE *f = xfopen ( filename );
+  if ( f ) {
+    ans = !file_check_magic ( f, VIK_MAGIC ) && !file_check_magic ( f, VIK_BINARY_MAGIC ) && !a_fit_check_magic ( f );
+    xfclose ( f );
+  }
+  return ans;
+}
+
+/**
+ * a_file_load_gpx:
+ * @vtl: A new layer, not yet attached to the layers panel
+ *
+ * Read a GPX file into the layer, without any of the GUI follow up that a_file_load() does
+ * (the caller is responsible for vik_layer_post_read() and adding the layer)
+ *
+ * Safe to be called from a background thread, provided the layer is not otherwise in use
+ */
+VikLoadType_t a_file_load_gpx ( VikTrwLayer *vtl, const gchar *filename )
+{
+  FILE *f = xfopen ( filename );
+  if ( ! f )
+    return LOAD_TYPE_READ_FAILURE;
+
+  gchar *absolute = file_realpath_dup ( filename );
+  gchar *dirpath = NULL;
+  if ( absolute )
+    dirpath = g_path_get_dirname ( absolute );
+  g_free ( absolute );
+
+  VikLoadType_t load_answer = LOAD_TYPE_OTHER_SUCCESS;
+  switch ( a_gpx_read_file ( vtl, f, dirpath, FALSE ) ) {
+  case GPX_READ_FAILURE: load_answer = LOAD_TYPE_GPX_FAILURE; break;
+  case GPX_READ_WARNING: load_answer = LOAD_TYPE_GPX_WARNING; break;
+  default: break;
+  }
+
+  g_free ( dirpath );
+  xfclose ( f );
+  return load_answer;
+}
+
+/**
+ * a_file_load_can_read_fit_only:
+ *
+ * Returns TRUE if the file would be loaded by a_file_load() as a FIT file into a new layer,
+ *  and so may be read by a_file_load_fit() (e.g. in a background thread)
+ */
+gboolean a_file_load_can_read_fit_only ( const gchar *filename )
+{
+  if ( !filename || strcmp(filename, "-") == 0 || strncmp(filename, "file://", 7) == 0 )
+    return FALSE;
+  // NB Only the file contents determine whether it is a FIT file, not the extension
+  if ( file_magic_check ( filename, "application/zip", ".zip" ) ||
+       file_magic_check ( filename, "application/x-bzip2", ".bz2" ) ||
+       file_magic_check ( filename, "application/x-xz", ".xz" ) ||
+       file_magic_check ( filename, "application/x-lzma", ".lzma" ) ||
+       file_magic_check ( filename, "application/gzip", ".gz" ) ||
+       a_jpg_magic_check ( filename ) )
+    return FALSE;
+
+  gboolean ans = FALSE;
+  FILE *f = xfopen ( filename );
+  if ( f ) {
+    ans = !file_check_magic ( f, VIK_MAGIC ) && !file_check_magic ( f, VIK_BINARY_MAGIC ) && a_fit_check_magic ( f );
+    xfclose ( f );
+  }
+  return ans;
+}
+
+/**
+ * a_file_load_fit:
+ * @vtl: A new layer, not yet attached to the layers panel
+ *
+ * Read a FIT file into the layer, without any of the GUI follow up that a_file_load() does
+ * (the caller is responsible for vik_layer_post_read() and adding the layer)
+ *
+ * Safe to be called from a background thread, provided the layer is not otherwise in use
+ */
+VikLoadType_t a_file_load_fit ( VikTrwLayer *vtl, const gchar *filename )
+{
+  FILE *f = xfopen ( filename );
+  if ( ! f )
+    return LOAD_TYPE_READ_FAILURE;
+
+  // Always force V1.1, since we may read in 'extended' data like cadence, etc...
+  vik_trw_layer_set_gpx_version ( vtl, GPX_V1_1 );
+
+  VikLoadType_t load_answer = LOAD_TYPE_OTHER_SUCCESS;
+  if ( !a_fit_read_file_into_layer ( vtl, f, filename ) )
+    load_answer = LOAD_TYPE_FIT_FAILURE;
+  else if ( vik_trw_layer_is_empty ( vtl ) ) {
+    g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, filename );
+    load_answer = LOAD_TYPE_FIT_FAILURE;
+  }
+
+  xfclose ( f );
+  return load_answer;
+}
+
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
 {
   FILE *f;
@@ -894,7 +1095,8 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
   if (strncmp(filename, "file://", 7) == 0)
     filename = filename + 7;
 
-  f = g_fopen(filename, "w");
+  gboolean binary = a_file_check_ext ( filename, VIK_BINARY_FILE_EXT );
+  f = g_fopen(filename, binary ? "wb" : "w");
 
   if ( ! f )
     return FALSE;
@@ -908,7 +1110,10 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
     }
   }
 
-  file_write ( top, f, vp, dir );
+  if ( binary )
+    a_binfile_write ( top, f, VIK_VIEWPORT(vp), dir );
+  else
+    file_write ( top, f, vp, dir );
   g_free (dir);
 
   // Restore previous working directory
@@ -1020,6 +1225,30 @@ gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t
   return FALSE;
 }
 
+/**
+ * a_file_export_area:
+ * @vtl: The TrackWaypoint to export data from
+ * @filename: The name of the file to be written
+ * @file_type: Choose one of the supported file types for the export
+ * @bbox: Only export the items within this area, or NULL for anywhere
+ * @start: Only export the items within this period (seconds since the epoch), or NAN for any time
+ * @end: The end of the period
+ * @write_hidden: Whether to write invisible items
+ *
+ * As a_file_export() for the whole layer, but with only the waypoints and the
+ *  track segments within the limits - for example to export what is in view
+ */
+gboolean a_file_export_area ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type,
+                              const LatLonBBox *bbox, gdouble start, gdouble end, gboolean write_hidden )
+{
+  g_return_val_if_fail ( vtl != NULL, FALSE );
+
+  VikTrwLayer *area = vik_trw_layer_extract ( vtl, bbox, start, end );
+  gboolean result = a_file_export ( area, filename, file_type, NULL, write_hidden );
+  g_object_unref ( area );
+  return result;
+}
+
 /**
  * a_file_export_babel:
  * @vtl:         If specified, use this layer for the source of the export, otherwise use @gpxfilename for the source.
@@ -29,6 +29,7 @@
 #include "vikaggregatelayer.h"
 #include "viktrwlayer.h"
 #include "vikviewport.h"
+#include "util.h"
 
 G_BEGIN_DECLS
 
@@ -79,6 +80,16 @@ VikLoadType_t a_file_load_stream ( FILE *f,
                                    const gchar *dirpath,
                                    const gchar *name );
 
+VikLoadType_t a_file_load_xml_stream ( UtilReadFunc read_func,
+                                       gpointer user_data,
+                                       const gchar *filename,
+                                       VikAggregateLayer *top,
+                                       VikViewport *vp,
+                                       VikTrwLayer *vtl,
+                                       gboolean new_layer,
+                                       const gchar *dirpath,
+                                       const gchar *name );
+
 VikLoadType_t a_file_load ( VikAggregateLayer *top,
                             VikViewport *vp,
                             VikTrwLayer *vtl,
@@ -87,13 +98,21 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
                             gboolean external,
                             const gchar *name );
 
+gboolean a_file_load_can_read_gpx_only ( const gchar *filename );
+VikLoadType_t a_file_load_gpx ( VikTrwLayer *vtl, const gchar *filename );
+gboolean a_file_load_can_read_fit_only ( const gchar *filename );
+VikLoadType_t a_file_load_fit ( VikTrwLayer *vtl, const gchar *filename );
+
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename );
 /* Only need to define VikTrack if the file type is FILE_TYPE_GPX_TRACK */
 gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type, VikTrack *trk, gboolean write_hidden );
+gboolean a_file_export_area ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type,
+                              const LatLonBBox *bbox, gdouble start, gdouble end, gboolean write_hidden );
 gboolean a_file_export_babel ( VikTrwLayer *vtl, const gchar *gpxfilename, const gchar *filename, const gchar *format,
                                gboolean tracks, gboolean routes, gboolean waypoints, const gchar *suboptions );
 
 void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type, VikLayerParamData data );
+void file_append_layer_param ( GString *str, const gchar *name, VikLayerParamType type, VikLayerParamData data );
 
 G_END_DECLS
 
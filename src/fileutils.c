@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <glib/gstdio.h>
 
 #include "fileutils.h"
 
@@ -190,3 +191,88 @@ const gchar *file_GetRelativeFilename ( gchar *currentDirectory, gchar *absolute
   return relativeFilename;
 }
 /* END http://www.codeguru.com/cpp/misc/misc/fileanddirectorynaming/article.php/c263 */
+
+/**
+ * a_file_set_contents:
+ * @mode: Permissions for the file, or -1 for the default
+ *
+ * Write the whole file in one go, such that any reader sees either
+ *  all the old contents or all the new contents.
+ */
+gboolean a_file_set_contents ( const gchar *fn, const gchar *contents, gsize length, gint mode, GError **error )
+{
+#if GLIB_CHECK_VERSION(2,66,0)
+  if ( mode >= 0 )
+    return g_file_set_contents_full ( fn, contents, length, G_FILE_SET_CONTENTS_CONSISTENT, mode, error );
+#endif
+  if ( !g_file_set_contents ( fn, contents, length, error ) )
+    return FALSE;
+  if ( mode >= 0 && g_chmod ( fn, mode ) != 0 )
+    g_warning ( "%s: Failed to set permissions on %s", __FUNCTION__, fn );
+  return TRUE;
+}
+
+typedef struct {
+  gchar *fn;
+  gchar *contents;
+  gsize length;
+  gint mode;
+} FileSaveJob;
+
+// Just the one thread, so files are written in the order they were asked for
+static GThreadPool *save_pool = NULL;
+static GMutex save_pool_mutex;
+
+static void file_save_job_run ( FileSaveJob *job, gpointer user_data )
+{
+  GError *error = NULL;
+  if ( !a_file_set_contents ( job->fn, job->contents, job->length, job->mode, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( job->fn );
+  g_free ( job->contents );
+  g_free ( job );
+}
+
+/**
+ * a_file_set_contents_async:
+ * @contents: Taken over by this function
+ *
+ * As a_file_set_contents(), but done by another thread
+ *  so a slow disk doesn't hold up the caller.
+ * Use a_file_set_contents_async_wait() to make sure it's happened.
+ */
+void a_file_set_contents_async ( const gchar *fn, gchar *contents, gsize length, gint mode )
+{
+  FileSaveJob *job = g_new0 ( FileSaveJob, 1 );
+  job->fn = g_strdup ( fn );
+  job->contents = contents;
+  job->length = length;
+  job->mode = mode;
+
+  g_mutex_lock ( &save_pool_mutex );
+  if ( !save_pool )
+    save_pool = g_thread_pool_new ( (GFunc)file_save_job_run, NULL, 1, FALSE, NULL );
+  if ( save_pool )
+    g_thread_pool_push ( save_pool, job, NULL );
+  g_mutex_unlock ( &save_pool_mutex );
+
+  if ( !save_pool )
+    file_save_job_run ( job, NULL );
+}
+
+/**
+ * a_file_set_contents_async_wait:
+ *
+ * Wait until every file given to a_file_set_contents_async() has been written
+ */
+void a_file_set_contents_async_wait ( void )
+{
+  g_mutex_lock ( &save_pool_mutex );
+  GThreadPool *pool = save_pool;
+  save_pool = NULL;
+  g_mutex_unlock ( &save_pool_mutex );
+  if ( pool )
+    g_thread_pool_free ( pool, FALSE, TRUE );
+}
@@ -33,6 +33,12 @@ char *file_realpath_dup ( const char *path );
 
 const gchar *file_GetRelativeFilename ( gchar *currentDirectory, gchar *absoluteFilename );
 
+gboolean a_file_set_contents ( const gchar *fn, const gchar *contents, gsize length, gint mode, GError **error );
+
+void a_file_set_contents_async ( const gchar *fn, gchar *contents, gsize length, gint mode );
+
+void a_file_set_contents_async_wait ( void );
+
 G_END_DECLS
 
 #endif
@@ -40,19 +40,6 @@
 // (seconds from device power on)
 #define FIT_DATE_TIME_MIN 0x10000000
 
-static guint32 g_data_size = 0;
-
-// NB Force structure to minimum size in order to match binary representation
-// Although without CRC, packed is the same as normal layout
-// FIT files may omit the upfront CRC
-typedef struct __attribute__((__packed__)) {
-	guint8 header_size;
-	guint8 protocol_version;
-	guint16 profile_version;
-	guint32 data_size;
-	guint32 magic;
-	//guint16 crc;
-} header_t;
 
 // As published on https://developer.garmin.com/fit/protocol/
 //  but changed to use 'g' types
@@ -92,95 +79,92 @@ gboolean a_fit_check_magic ( FILE *ff )
 	return rv;
 }
 
-typedef struct __attribute__((__packed__)) {
+// A field of a local message definition,
+//  precompiled with where its value is within each data message
+typedef struct {
 	guint8 num;
 	guint8 size;
 	guint8 type;
+	guint16 offset;
 } field_t;
 
 typedef struct {
-	guint8 reserved;
+	gboolean defined;
 	guint8 arch;
 	guint16 mesg_id;
+	gboolean wanted; // Whether that message contains anything we use
 	guint8 num_fields;
 	field_t *fields;
+	guint32 size; // Of each data message, including any developer fields
 } mesg_def_t;
 
-static mesg_def_t g_defs[FIT_MAX_LOCAL_MESGS];
-
-static gboolean read_uint8 ( FILE *ff, guint8 *data, gboolean trackSize )
-{
-	if ( fread(data, 1, sizeof(*data), ff) != sizeof(*data))
-		return FALSE;
-	if ( trackSize ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
-	return TRUE;
-}
-
-static gboolean read_uint16 ( FILE *ff, guint16 *data, guint8 endian, gboolean monitor_size )
+// All the state of decoding one file,
+//  so different files can be decoded at the same time
+typedef struct {
+	const guint8 *ptr; // Current position
+	const guint8 *end; // End of the data records
+	gboolean truncated; // Data size says there should be more than the file has
+	mesg_def_t defs[FIT_MAX_LOCAL_MESGS];
+
+	guint32 settings_ts_offset;
+	gboolean newseg;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+
+	// Current objects
+	VikTrwLayer *vtl;
+	VikTrack *tr; // TODO turn into a list to create anew and then load each the end?
+	VikTRWMetadata *md;
+
+	gboolean create_layers;
+	VikViewport *vvp; // Maybe NULL
+} FitDecoder;
+
+// All multi-byte values are in the order given by the definition's architecture
+static guint16 get_uint16 ( const guint8 *data, guint8 endian )
 {
 	guint16 val;
-	if ( fread(&val, 2, 1, ff) != 1)
-		return FALSE;
-	if ( endian == FIT_ARCH_ENDIAN_LITTLE )
-		*data = GUINT16_FROM_LE(val);
-	else
-		*data = GUINT16_FROM_BE(val);
-	if ( monitor_size ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
-	return TRUE;
+	memcpy ( &val, data, sizeof(val) );
+	return endian == FIT_ARCH_ENDIAN_LITTLE ? GUINT16_FROM_LE(val) : GUINT16_FROM_BE(val);
 }
 
-static gboolean read_uint32 ( FILE *ff, guint32 *data, guint8 endian, gboolean monitor_size )
+static guint32 get_uint32 ( const guint8 *data, guint8 endian )
 {
 	guint32 val;
-	if ( fread(&val, 4, 1, ff) != 1)
-		return FALSE;
-	if ( endian == FIT_ARCH_ENDIAN_LITTLE )
-		*data = GINT32_FROM_LE(val);
-	else
-		*data = GINT32_FROM_BE(val);
-	if ( monitor_size ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
-	return TRUE;
+	memcpy ( &val, data, sizeof(val) );
+	return endian == FIT_ARCH_ENDIAN_LITTLE ? GUINT32_FROM_LE(val) : GUINT32_FROM_BE(val);
 }
 
-// As each component is 8bit - no need to cater for endian in this type
-static gboolean read_field_t ( FILE *ff, field_t *data )
+static void decoder_init ( FitDecoder *dec, VikTrwLayer *vtl, gboolean create_layers, VikViewport *vvp )
 {
-	if ( fread(data, 1, sizeof(*data), ff) != sizeof(*data))
-		return FALSE;
-	g_data_size -= sizeof(*data);
-	//g_debug ( "%s: g_data_size=%d", __FUNCTION__, g_data_size );
-	return TRUE;
+	memset ( dec, 0, sizeof(FitDecoder) );
+	dec->unnamed_waypoints = 1;
+	dec->unnamed_tracks = 1;
+	dec->vtl = vtl;
+	dec->create_layers = create_layers;
+	dec->vvp = vvp;
 }
 
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_layers = 0;
-
-// Current ("fit_") objects
-// Easier to have as globals rather than passing around the functions
-static VikTrwLayer *fit_vtl = NULL;
-static VikWaypoint *fit_wp = NULL;
-static VikTrackpoint *fit_tp = NULL;
-static VikTrack *fit_tr = NULL; // TODO turn into a list to create anew and then load each the end?
-static VikTRWMetadata *fit_md = NULL;
-
-static gboolean create_layers = FALSE;
+static void decoder_clear ( FitDecoder *dec )
+{
+	for ( guint8 ii = 0; ii < FIT_MAX_LOCAL_MESGS; ii++ ) {
+		g_free ( dec->defs[ii].fields );
+		dec->defs[ii].fields = NULL;
+	}
+	// Anything not handed over to a layer
+	if ( dec->tr )
+		vik_track_free ( dec->tr );
+	dec->tr = NULL;
+}
 
-static void fit_add_track ( VikTrwLayer *vtl )
+static void fit_add_track ( FitDecoder *dec )
 {
-	if ( fit_tr && fit_tr->trackpoints ) {
-		gchar *tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
-		fit_tr->trackpoints = g_list_reverse ( fit_tr->trackpoints );
-		vik_trw_layer_filein_add_track ( vtl, tr_name, fit_tr );
+	if ( dec->tr && dec->tr->trackpoints ) {
+		gchar *tr_name = g_strdup_printf ( _("Track%03d"), dec->unnamed_tracks++ );
+		dec->tr->trackpoints = g_list_reverse ( dec->tr->trackpoints );
+		vik_trw_layer_filein_add_track ( dec->vtl, tr_name, dec->tr );
+		g_free ( tr_name );
+		dec->tr = NULL;
 	}
 }
 
@@ -235,16 +219,8 @@ gdouble semi2degrees(gint32 value)
 	return ((gdouble)value / (gdouble)(1U<<31)) * 180.0;
 }
 
-static gboolean f_tr_newseg = FALSE;
-
-// vvp can be NULL
-static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset, VikViewport *vvp )
+static gboolean decode_fields ( FitDecoder *dec, const mesg_def_t *def, const guint8 *data )
 {
-	//g_debug ( "%s: fields=%d", __FUNCTION__, num_fields );
-	static guint32 ts = 0;
-	ts = ts + time_offset;
-	static guint32 settings_ts_offset = 0;
-	//static guint32 last_ts = 0;
 	// c.f. 'FIT_RECORD_MESG'
 	gint32 lat = FIT_SINT32_INVALID;
 	gint32 lon = FIT_SINT32_INVALID;
@@ -261,459 +237,459 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 
 	gchar* name = NULL;
 
-	// Read Fields...
-	for ( guint8 ii = 0; ii < num_fields; ii++ ) {
-		field_t field = g_defs[id].fields[ii];
-		//g_debug ( "%s: field=%d size=%d", __FUNCTION__, ii, field.size );
+	for ( guint8 ii = 0; ii < def->num_fields; ii++ ) {
+		const field_t *field = &def->fields[ii];
+		const guint8 *value = data + field->offset;
 
-		guint8 data8;
-		guint16 data16;
-		guint32 data32;
+		guint8 data8 = 0;
+		guint16 data16 = 0;
+		guint32 data32 = 0;
 		gchar* str = NULL;
-		// Read per indicated type
+		// Take per indicated type
 		//  and then depending on the size
 		//   whether a singular or multiple of that type
-		switch ( field.type ) {
-		case FIT_BASE_TYPE_ENUM:
-		case FIT_BASE_TYPE_SINT8:
-		case FIT_BASE_TYPE_UINT8:
-		case FIT_BASE_TYPE_UINT8Z:
-			// ATM means if array of them we only use the final one
-			for (guint8 jj = 0; jj < field.size; jj++)
-				if ( !read_uint8(ff, &data8, TRUE) ) return FALSE;
-			break;
+		// ATM means if array of them we only use the final one
+		switch ( field->type ) {
 		case FIT_BASE_TYPE_SINT16:
 		case FIT_BASE_TYPE_UINT16:
-			// Maybe should check field.size is rem 2
-			for (guint8 jj = 0; jj < field.size/2; jj++)
-				if ( !read_uint16(ff, &data16, g_defs[id].arch, TRUE) ) return FALSE;
+			if ( field->size >= 2 )
+				data16 = get_uint16 ( value + (field->size/2 - 1)*2, def->arch );
 			break;
 		case FIT_BASE_TYPE_STRING:
-			{
-				str = g_malloc0(field.size+1); // Ensure null terminator
-				if ( !str ) {
-					g_warning ( "%s: Unable to allocate memory of size %d ", __FUNCTION__, field.size );
-					return FALSE;
-				}
-				for (guint8 jj = 0; jj < field.size; jj++)
-					if ( !read_uint8(ff, (guint8*)&str[jj], TRUE) ) return FALSE;
-			}
+			// Ensure null terminator
+			str = g_strndup ( (const gchar*)value, field->size );
 			break;
 		case FIT_BASE_TYPE_SINT32:
 		case FIT_BASE_TYPE_UINT32:
 		case FIT_BASE_TYPE_FLOAT32:
 		case FIT_BASE_TYPE_UINT32Z:
-			// Maybe should check field.size is rem 4
-			for (guint8 jj = 0; jj < field.size/4; jj++)
-				if ( !read_uint32(ff, &data32, g_defs[id].arch, TRUE) ) return FALSE;
+			if ( field->size >= 4 )
+				data32 = get_uint32 ( value + (field->size/4 - 1)*4, def->arch );
 			break;
 		default:
-			// So basically ignore them
-			for (guint8 jj = 0; jj < field.size; jj++)
-				if ( !read_uint8(ff, &data8, TRUE) ) return FALSE;
+			// Byte types, otherwise basically ignore them
+			if ( field->size )
+				data8 = value[field->size - 1];
 			break;
 		}
 
 		// PARSE FIELDS
 
 		// Is 'File Id Message'
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_FILE_ID ) {
-			if ( field.num == FIT_FILE_ID_FIELD_NUM_TYPE ) {
+		if ( def->mesg_id == FIT_MESG_NUM_FILE_ID ) {
+			if ( field->num == FIT_FILE_ID_FIELD_NUM_TYPE ) {
 				if ( !(data8 == FIT_FILE_ACTIVITY || data8 == FIT_FILE_COURSE) ) {
 					// Ignore
 					g_warning ( "%s: Fit File Id Type=%d not supported", __FUNCTION__, data8 );
 				} else {
-					if ( create_layers && vvp ) {
+					if ( dec->create_layers && dec->vvp ) {
 						// If existing track, add to layer and then create new track
-						if ( fit_vtl && fit_tr )
-							fit_add_track ( fit_vtl );
-						fit_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+						if ( dec->vtl ) {
+							fit_add_track ( dec );
+							// TODO - support 'chained' fit files; only the last one is kept
+							g_object_unref ( dec->vtl );
+						}
+						if ( dec->md )
+							vik_trw_metadata_free ( dec->md );
+						dec->vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, dec->vvp, FALSE ));
 						// Always force V1.1, since we may read in 'extended' data like cadence, etc...
-						vik_trw_layer_set_gpx_version ( fit_vtl, GPX_V1_1 );
-						fit_md = vik_trw_metadata_new();
+						vik_trw_layer_set_gpx_version ( dec->vtl, GPX_V1_1 );
+						dec->md = vik_trw_metadata_new();
 					}
-					fit_tr = vik_track_new ();
+					if ( dec->tr )
+						vik_track_free ( dec->tr );
+					dec->tr = vik_track_new ();
 					if ( data8 == FIT_FILE_COURSE )
-						fit_tr->is_route = TRUE;
+						dec->tr->is_route = TRUE;
 				}
 			}
 
-			if ( field.num == FIT_FILE_ID_FIELD_NUM_MANUFACTURER )
+			if ( field->num == FIT_FILE_ID_FIELD_NUM_MANUFACTURER )
 				g_debug ( "%s: File Manufacturer=%d", __FUNCTION__, data16 );
 
-			if ( field.num == FIT_FILE_ID_FIELD_NUM_SERIAL_NUMBER )
+			if ( field->num == FIT_FILE_ID_FIELD_NUM_SERIAL_NUMBER )
 				g_debug ( "%s: Serial Number=%u", __FUNCTION__, data32 );
 
-			if ( field.num == FIT_FILE_ID_FIELD_NUM_TIME_CREATED ) {
+			if ( field->num == FIT_FILE_ID_FIELD_NUM_TIME_CREATED ) {
 #if GLIB_CHECK_VERSION(2,62,0)
 				gint64 ts = FIT_EPOCH_OFFSET + data32;
 				GDateTime* gdt = g_date_time_new_from_unix_utc ( ts );
 				gchar* msg = g_date_time_format_iso8601 ( gdt );
-				g_debug ( "%s: [%u] [%ld] create time=%s\n", __FUNCTION__, data32, ts, msg );
+				g_debug ( "%s: [%u] [%" G_GINT64_FORMAT "] create time=%s\n", __FUNCTION__, data32, ts, msg );
 				g_free ( msg );
 				g_date_time_unref ( gdt );
 #endif
-				settings_ts_offset = data32;
+				dec->settings_ts_offset = data32;
 			}
 		}
 
 		// Main track information
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_RECORD ) {
-			if ( field.num == FIT_RECORD_FIELD_NUM_POSITION_LAT && field.size == 4 )
+		if ( def->mesg_id == FIT_MESG_NUM_RECORD ) {
+			if ( field->num == FIT_RECORD_FIELD_NUM_POSITION_LAT && field->size == 4 )
 				lat = (gint32)data32;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_POSITION_LONG && field.size == 4 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_POSITION_LONG && field->size == 4 )
 				lon = (gint32)data32;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_TIMESTAMP && field.size == 4 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_TIMESTAMP && field->size == 4 )
 				timestamp = data32;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_ALTITUDE && field.size == 2 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_ALTITUDE && field->size == 2 )
 				alt = data16;
 
 			// 'enhanced' takes presidence over previous 'standard' value
-			if ( field.num == FIT_RECORD_FIELD_NUM_ENHANCED_ALTITUDE && field.size == 2 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_ENHANCED_ALTITUDE && field->size == 2 )
 				alt = data16;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_SPEED && field.size == 2 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_SPEED && field->size == 2 )
 				speed = data16;
 
 			// 'enhanced' takes presidence over previous 'standard' value
-			if ( field.num == FIT_RECORD_FIELD_NUM_ENHANCED_SPEED && field.size == 2 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_ENHANCED_SPEED && field->size == 2 )
 				speed = data16;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_HEART_RATE && field.size == 1 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_HEART_RATE && field->size == 1 )
 				hr = data8;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_CADENCE && field.size == 1 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_CADENCE && field->size == 1 )
 				cad = data8;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_TEMPERATURE && field.size == 1 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_TEMPERATURE && field->size == 1 )
 				temp = data8;
 
-			if ( field.num == FIT_RECORD_FIELD_NUM_POWER && field.size == 2 )
+			if ( field->num == FIT_RECORD_FIELD_NUM_POWER && field->size == 2 )
 				pow = data16;
 
 		}
 
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_EVENT ) {
+		if ( def->mesg_id == FIT_MESG_NUM_EVENT ) {
 			// ATM I can't work out the event nums in the SDK
-			if ( field.num == 0 && field.size == 1 ) {
+			if ( field->num == 0 && field->size == 1 ) {
 				event = data8;
 			}
-			if ( field.num == 1 && field.size == 1 ) {
+			if ( field->num == 1 && field->size == 1 ) {
 				eventtype = data8;
 			}
 		}
 
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_TIMESTAMP && field.size == 4 ) {
+		if ( def->mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
+			if ( field->num == FIT_COURSE_POINT_FIELD_NUM_TIMESTAMP && field->size == 4 ) {
 				timestamp = data32;
 			}
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_POSITION_LAT && field.size == 4 )
+			if ( field->num == FIT_COURSE_POINT_FIELD_NUM_POSITION_LAT && field->size == 4 )
 				lat = (gint32)data32;
 
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_POSITION_LONG && field.size == 4 )
+			if ( field->num == FIT_COURSE_POINT_FIELD_NUM_POSITION_LONG && field->size == 4 )
 				lon = (gint32)data32;
 
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_NAME )
-				name = g_strdup ( str );
+			if ( field->num == FIT_COURSE_POINT_FIELD_NUM_NAME && str ) {
+				g_free ( name );
+				name = str;
+				str = NULL;
+			}
 
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_TYPE && field.size == 1 )
+			if ( field->num == FIT_COURSE_POINT_FIELD_NUM_TYPE && field->size == 1 )
 				eventtype = data8;
 		}
 
-		//if ( field.type == FIT_BASE_TYPE_STRING )
-		//	g_debug ( "%s: String=%s", __FUNCTION__, str );
-		if ( str ) g_free ( str );
+		g_free ( str );
+	}
+
+	// Nowhere to put anything
+	if ( !dec->vtl ) {
+		g_free ( name );
+		return TRUE;
 	}
 
 	// PARSE DATA from the collected field info
 	// Events before tracks, as we insert this into the trackpoint
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_EVENT ) {
+	if ( def->mesg_id == FIT_MESG_NUM_EVENT ) {
 		if ( event == FIT_EVENT_TIMER && eventtype == FIT_EVENT_TYPE_START ) {
-			f_tr_newseg = TRUE;
+			dec->newseg = TRUE;
 			g_debug ( "%s: NEWSEGMENT EVENT", __FUNCTION__ );
 		}
 	}
 
 	// Main track information
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_RECORD ) {
+	if ( def->mesg_id == FIT_MESG_NUM_RECORD ) {
 		if ( lat != FIT_SINT32_INVALID && lon != FIT_SINT32_INVALID ) {
-			fit_tp = vik_trackpoint_new ();
+			VikTrackpoint *tp = vik_trackpoint_new ();
 			struct LatLon fit_ll;
 			fit_ll.lat = semi2degrees ( lat );
 			fit_ll.lon = semi2degrees ( lon );
-			vik_coord_load_from_latlon ( &(fit_tp->coord), vik_trw_layer_get_coord_mode(fit_vtl), &fit_ll );
-			if ( f_tr_newseg ) {
-				fit_tp->newsegment = f_tr_newseg;
-				f_tr_newseg = FALSE; // Reset
+			vik_coord_load_from_latlon ( &(tp->coord), vik_trw_layer_get_coord_mode(dec->vtl), &fit_ll );
+			if ( dec->newseg ) {
+				tp->newsegment = TRUE;
+				dec->newseg = FALSE; // Reset
 			}
 
 			if ( alt != FIT_UINT16_INVALID )
 				// Encoded as "5 * m + 500" (for both normal and enhanced), thus apply the reverse
-				fit_tp->altitude = (alt / 5.0) - 500;
+				tp->altitude = (alt / 5.0) - 500;
 
 			if ( timestamp != FIT_UINT32_INVALID ) {
 				guint32 ts = timestamp;
 				if ( timestamp < FIT_DATE_TIME_MIN )
-					ts = ts + settings_ts_offset;
-				//last_ts = ts;
+					ts = ts + dec->settings_ts_offset;
 				gint64 ts64 = (gint64)ts + (gint64)FIT_EPOCH_OFFSET;
-#if GLIB_CHECK_VERSION(2,62,0)
-				//GDateTime* gdt = g_date_time_new_from_unix_utc ( ts64 );
-				//gchar* msg = g_date_time_format_iso8601 ( gdt );
-				//g_printf ( "%s: [%d] time=%s\n", __FUNCTION__, timestamp, msg );
-				//g_free ( msg );
-				//g_date_time_unref ( gdt );
-#endif
-				fit_tp->timestamp = (gdouble)ts64;
+				tp->timestamp = (gdouble)ts64;
 			}
 
 			// Both normal and enhanced
 			if ( speed != FIT_UINT16_INVALID )
-				fit_tp->speed = (speed / 1000.0);
+				tp->speed = (speed / 1000.0);
 
 			if ( hr != FIT_UINT8_INVALID )
-				fit_tp->heart_rate = hr;
+				tp->heart_rate = hr;
 
 			if ( cad != FIT_UINT8_INVALID )
-				fit_tp->cadence = cad;
+				tp->cadence = cad;
 
 			if ( temp != FIT_SINT8_INVALID )
-				fit_tp->temp = temp;
+				tp->temp = temp;
 
 			if ( pow != FIT_UINT16_INVALID )
-				fit_tp->power = pow;
+				tp->power = pow;
 
-			if ( fit_tr )
-				fit_tr->trackpoints = g_list_prepend ( fit_tr->trackpoints, fit_tp );
+			if ( dec->tr )
+				dec->tr->trackpoints = g_list_prepend ( dec->tr->trackpoints, tp );
+			else
+				vik_trackpoint_free ( tp );
 		}
 	}
 
 	// Waypoints
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
+	if ( def->mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
 		if ( lat != FIT_SINT32_INVALID && lon != FIT_SINT32_INVALID ) {
-			fit_wp = vik_waypoint_new ();
+			VikWaypoint *wp = vik_waypoint_new ();
 			struct LatLon fit_ll;
 			fit_ll.lat = semi2degrees ( lat );
 			fit_ll.lon = semi2degrees ( lon );
-			vik_coord_load_from_latlon ( &(fit_wp->coord), vik_trw_layer_get_coord_mode(fit_vtl), &fit_ll );
-			gchar* wp_name = name;
-			if ( !wp_name )
-				wp_name = g_strdup_printf ( _("Waypoint%04d"), unnamed_waypoints++ );
+			vik_coord_load_from_latlon ( &(wp->coord), vik_trw_layer_get_coord_mode(dec->vtl), &fit_ll );
+			if ( !name )
+				name = g_strdup_printf ( _("Waypoint%04d"), dec->unnamed_waypoints++ );
 			if ( eventtype != FIT_UINT8_INVALID )
-				fit_waypoint_symbol ( fit_wp, eventtype );
-			vik_trw_layer_filein_add_waypoint ( fit_vtl, wp_name, fit_wp );
+				fit_waypoint_symbol ( wp, eventtype );
+			vik_trw_layer_filein_add_waypoint ( dec->vtl, name, wp );
 		}
 	}
+	g_free ( name );
 
 	return TRUE;
 }
 
-static gboolean read_data ( FILE *ff, int id, int time_offset, VikViewport *vvp )
+static gboolean read_data_msg ( FitDecoder *dec, guint8 local_id )
 {
-	// Read This mesg type...
-	//g_debug ( "%s: id=%d - mesg id=%d", __FUNCTION__, id, g_defs[id].mesg_id );
-	if ( g_defs[id].reserved )
-		return read_fields ( ff, g_defs[id].num_fields, id, time_offset, vvp );
-	else {
-		g_warning ( "%s: Data id %d encountered before definition", __FUNCTION__, id );
+	const mesg_def_t *def = &dec->defs[local_id];
+	if ( !def->defined ) {
+		g_warning ( "%s: Data id %d encountered before definition", __FUNCTION__, local_id );
 		return FALSE;
 	}
-}
-
-static gboolean read_data_msg ( FILE *ff, guint8 header, int time_offset, VikViewport *vvp )
-{
-	int local_id = header & FIT_HDR_TYPE_MASK;
-	//g_debug ( "%s: id=%d ", __FUNCTION__, local_id );
-	if ( local_id > FIT_HDR_TYPE_MASK )
-	{
-		g_warning ( "%s: id=%d is bigger than maximum allowed %d", __FUNCTION__, local_id, FIT_HDR_TYPE_MASK);
+	if ( (gsize)(dec->end - dec->ptr) < def->size ) {
+		g_warning ( "%s: Data id %d truncated", __FUNCTION__, local_id );
 		return FALSE;
 	}
 
-	return read_data ( ff, local_id, time_offset, vvp );
+	gboolean ans = TRUE;
+	// Messages we have no use for can be stepped over in one go
+	if ( def->wanted )
+		ans = decode_fields ( dec, def, dec->ptr );
+	dec->ptr += def->size;
+	return ans;
 }
 
-static gboolean read_msg_type_def ( FILE *ff, guint8 header )
+static gboolean read_msg_type_def ( FitDecoder *dec, guint8 header )
 {
-	int local_id = header & FIT_HDR_TYPE_MASK;
+	guint8 local_id = header & FIT_HDR_TYPE_MASK;
+	mesg_def_t *def = &dec->defs[local_id];
+
+	// Reserved byte, architecture, global message number and number of fields
+	if ( dec->end - dec->ptr < 5 ) return FALSE;
 
-	// Instead of trying to read mesg_def_t;
-	// Do one by one
-	guint8 reserved; // Read byte from file but otherwise basically ignore
-	if ( !read_uint8(ff, &reserved, TRUE) ) return FALSE;
-	// Use internally as whether this message id been 'defined' yet
 	// Messages can be redefined according to FIT protocol
 	// Normally not done, but perhaps if the file needs to store more message types than FIT_MAX_LOCAL_MESGS allows
 	//  then the only way is to override a previous definition
-	if ( g_defs[local_id].reserved )
+	if ( def->defined )
 		g_debug ( "%s: ID [%d] REDEFINED!!", __FUNCTION__, local_id );
-	g_defs[local_id].reserved = TRUE;
-
-	if ( !read_uint8(ff, &g_defs[local_id].arch, TRUE) ) return FALSE;
 
-	if ( !read_uint16(ff, &g_defs[local_id].mesg_id, g_defs[local_id].arch, TRUE) ) return FALSE;
-
-	g_debug ( "%s: Defining id=%u as %u", __FUNCTION__, local_id, g_defs[local_id].mesg_id );
-
-	if ( !read_uint8(ff, &g_defs[local_id].num_fields, TRUE) ) return FALSE;
-
-	field_t *fields = g_malloc0 ( sizeof(field_t) * g_defs[local_id].num_fields );
-	g_defs[local_id].fields = fields;
-
-	for ( guint ii = 0; ii < g_defs[local_id].num_fields; ii++ ) {
-		if ( !read_field_t(ff, &fields[ii]) ) return FALSE;
-		//g_debug ( "%s: Field[%d] num, size, type= %d %d 0x%02x", __FUNCTION__, ii, fields[ii].num, fields[ii].size, fields[ii].type );
+	def->arch = dec->ptr[1];
+	def->mesg_id = get_uint16 ( dec->ptr+2, def->arch );
+	def->num_fields = dec->ptr[4];
+	dec->ptr += 5;
+
+	g_debug ( "%s: Defining id=%u as %u", __FUNCTION__, local_id, def->mesg_id );
+
+	def->wanted = ( def->mesg_id == FIT_MESG_NUM_FILE_ID ||
+	                def->mesg_id == FIT_MESG_NUM_RECORD ||
+	                def->mesg_id == FIT_MESG_NUM_EVENT ||
+	                def->mesg_id == FIT_MESG_NUM_COURSE_POINT );
+
+	// Each field definition is 3 bytes: number, size and base type
+	if ( dec->end - dec->ptr < 3 * def->num_fields ) return FALSE;
+	g_free ( def->fields );
+	def->fields = g_malloc0 ( sizeof(field_t) * MAX(1,def->num_fields) );
+	def->size = 0;
+	for ( guint ii = 0; ii < def->num_fields; ii++ ) {
+		def->fields[ii].num = dec->ptr[0];
+		def->fields[ii].size = dec->ptr[1];
+		def->fields[ii].type = dec->ptr[2];
+		def->fields[ii].offset = def->size;
+		def->size += def->fields[ii].size;
+		dec->ptr += 3;
 	}
 
+	// Developer data follows the normal fields in each data message
+	//  otherwise we ignore them
 	if ( header & FIT_HDR_DEV_DATA_BIT ) {
-		guint8 dev_num_fields;
-		if ( !read_uint8(ff, &dev_num_fields, TRUE) ) return FALSE;
-		//g_debug ( "%s: dev_num_fields=%d", __FUNCTION__, dev_num_fields );
-
-		// Read in one block and otherwise ignore
-		gchar *dev_buffer = g_malloc ( sizeof(field_t)*dev_num_fields );
-		if ( fread(dev_buffer, 1, sizeof(field_t)*dev_num_fields, ff) != sizeof(field_t)*dev_num_fields )
-			return FALSE;
-		g_data_size -= sizeof(field_t)*dev_num_fields;
-		//g_debug ( "%s: g_data_size=%d", __FUNCTION__, g_data_size );
+		if ( dec->end - dec->ptr < 1 ) return FALSE;
+		guint8 dev_num_fields = *dec->ptr++;
+		if ( dec->end - dec->ptr < 3 * dev_num_fields ) return FALSE;
+		for ( guint ii = 0; ii < dev_num_fields; ii++ ) {
+			def->size += dec->ptr[1];
+			dec->ptr += 3;
+		}
 	}
 
+	def->defined = TRUE;
 	return TRUE;
 }
 
-static gboolean read_compressed_time_rec ( FILE *ff, guint8 header, VikViewport *vvp )
-{
-	//g_debug ( "%s: ", __FUNCTION__ );
-	return read_data_msg ( ff, header, header & FIT_HDR_TIME_OFFSET_MASK, vvp );
-}
-
-static gboolean read_record ( FILE *ff, VikViewport *vvp )
+static gboolean read_record ( FitDecoder *dec )
 {
 	// Data/Msg Header is 1 byte
-	guint8 header;
-	if ( !read_uint8(ff, &header, TRUE) ) return FALSE;
+	guint8 header = *dec->ptr++;
 
+	// NB The time offset of compressed timestamp headers is not used
 	if ( header & FIT_HDR_TIME_REC_BIT )
-		return read_compressed_time_rec ( ff, header, vvp );
+		return read_data_msg ( dec, (header & FIT_HDR_TIME_TYPE_MASK) >> FIT_HDR_TIME_TYPE_SHIFT );
 	// Otherwise 'Normal' header kinds:
 	else if ( header & FIT_HDR_TYPE_DEF_BIT )
-		return read_msg_type_def ( ff, header );
+		return read_msg_type_def ( dec, header );
 	else
-		return read_data_msg ( ff, header, 0, vvp );
-}
-
-static header_t read_header ( FILE *ff )
-{
-	header_t header = { 0, 0, 0, 0, 0 };
-	// Very simple if on a Little Endian machine as all multi-byte
-	//  values are by protocol definition in LE order,
-	//  so can just map the entire header structure in one go. e.g.:
-	//fread ( &header, 1, sizeof(header), ff );
-
-	// However to be fully compatible...
-
-	// Annoyingly compiler warns about taking address of packed member of 'struct <anonymous>' may result in an unaligned pointer value
-	// so repeat variables and assign at the end, instead of using struct directly
-	guint8 header_size;
-	guint8 protocol_version;
-	guint16 profile_version;
-	guint32 data_size;
-	guint32 magic;
-	if ( !read_uint8(ff, &header_size, FALSE) ) goto FAIL;
-	if ( !read_uint8(ff, &protocol_version, FALSE) ) goto FAIL;
-	if ( !read_uint16(ff, &profile_version, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	if ( !read_uint32(ff, &data_size, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	if ( !read_uint32(ff, &magic, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	header.header_size = header_size;
-	header.protocol_version = protocol_version;
-	header.profile_version = profile_version;
-	header.data_size = data_size;
-	header.magic = magic;
-	goto FINISH;
-FAIL:
-	g_warning ( "%s: Read Header failed", __FUNCTION__ );
-	header.data_size = 0;
-FINISH:
-	return header;
+		return read_data_msg ( dec, header & FIT_HDR_TYPE_MASK );
 }
 
-header_t get_header ( FILE *ff )
+/**
+ * Check the header and set where the data records are
+ */
+static gboolean read_header ( FitDecoder *dec, const guint8 *data, gsize len )
 {
-	header_t header = { 0, 0, 0, 0, 0 };
-
 	// NB very first byte is the size of the Header
 	// Check header size is as we support
-	guint8 hdr_size;
-	if ( fread(&hdr_size, 1, sizeof(hdr_size), ff) != sizeof(hdr_size) ) {
+	if ( len < FIT_HEADER_SIZE ) {
 		g_warning ( "%s: Header read failure", __FUNCTION__ );
-		return header;
+		return FALSE;
 	}
-
+	guint8 hdr_size = data[0];
 	// Allow for a missing CRC
-	if ( hdr_size == FIT_HEADER_SIZE || (hdr_size == FIT_HEADER_SIZE+2) ) {
-
-		rewind ( ff );
-		// NB Should not fail as already performed a_fit_check_magic()
-		header = read_header ( ff );
-		if ( header.data_size == 0 )
-			return header;
-
-		// Does it have the CRC?
-		if ( hdr_size > FIT_HEADER_SIZE ) {
-
-			guint16 crc;
-			if ( !read_uint16(ff, &crc, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) {
-				g_warning ( "%s: Read CRC failed", __FUNCTION__ );
-				// Fake the data size so caller can detect failure.
-				header.data_size = 0;
-				return header;
-			}
-			g_debug ( "%s: HAS CRC = %d", __FUNCTION__, crc );
-			// Check the CRC if it is not 0 (which is allowed)
-			if ( crc != 0 ) {
-				guint16 hh = 0;
-				rewind ( ff );
-				for ( guint8 ii = 0; ii < FIT_HEADER_SIZE; ii++ ) {
-					guint8 byte;
-					if ( !read_uint8(ff, &byte, FALSE) ) {
-						g_warning ( "%s: CRC check reading failed", __FUNCTION__ );
-						header.data_size = 0;
-						return header;
-					}
-					hh = FitCRC_Get16 ( hh, byte );
-				};
-				// Only warn, carry on to attempt to read the file even if CRC value not as expected
-				if ( hh != crc ) {
-					g_warning ( "%s: Header CRC check failure: expected=%d vs calculated= %d", __FUNCTION__, crc, hh );
-				}
-				// Return to end of header
-				(void)fseek ( ff, hdr_size, SEEK_SET );
+	if ( !(hdr_size == FIT_HEADER_SIZE || hdr_size == FIT_HEADER_SIZE+2) || len < hdr_size ) {
+		g_warning ( "%s: Unexpected header size=%d", __FUNCTION__, hdr_size );
+		return FALSE;
+	}
+
+	// By protocol definition all header values are in LE order
+	guint32 data_size = get_uint32 ( data+4, FIT_ARCH_ENDIAN_LITTLE );
+	g_debug ( "%s: Protocol=%d", __FUNCTION__, data[1] );
+	g_debug ( "%s: Profile=%d", __FUNCTION__, get_uint16(data+2, FIT_ARCH_ENDIAN_LITTLE) );
+	g_debug ( "%s: Data size=%d", __FUNCTION__, data_size );
+
+	// Does it have the CRC?
+	if ( hdr_size > FIT_HEADER_SIZE ) {
+		guint16 crc = get_uint16 ( data+FIT_HEADER_SIZE, FIT_ARCH_ENDIAN_LITTLE );
+		g_debug ( "%s: HAS CRC = %d", __FUNCTION__, crc );
+		// Check the CRC if it is not 0 (which is allowed)
+		if ( crc != 0 ) {
+			guint16 hh = 0;
+			for ( guint8 ii = 0; ii < FIT_HEADER_SIZE; ii++ )
+				hh = FitCRC_Get16 ( hh, data[ii] );
+			// Only warn, carry on to attempt to read the file even if CRC value not as expected
+			if ( hh != crc ) {
+				g_warning ( "%s: Header CRC check failure: expected=%d vs calculated= %d", __FUNCTION__, crc, hh );
 			}
 		}
-	} else
-		g_warning ( "%s: Unexpected header size=%d", __FUNCTION__, hdr_size );
-	return header;
+	}
+
+	dec->ptr = data + hdr_size;
+	if ( data_size > len - hdr_size ) {
+		// Decode what is there, but it will be reported as a failure
+		dec->truncated = TRUE;
+		dec->end = data + len;
+	}
+	else
+		dec->end = dec->ptr + data_size;
+	return TRUE;
+}
+
+/**
+ * Returns TRUE if all the data records were decoded
+ */
+static gboolean decoder_run ( FitDecoder *dec, const guint8 *data, gsize len )
+{
+	if ( !read_header ( dec, data, len ) )
+		return FALSE;
+	// Keep decoding until nothing left
+	while ( dec->ptr < dec->end ) {
+		if ( !read_record(dec) ) {
+			g_warning ( "%s: data size not read =%ld", __FUNCTION__, (glong)(dec->end - dec->ptr) );
+			return FALSE;
+		}
+	}
+	if ( dec->truncated )
+		g_warning ( "%s: data size not read =%ld", __FUNCTION__, (glong)(get_uint32(data+4, FIT_ARCH_ENDIAN_LITTLE) - (len - data[0])) );
+	return !dec->truncated;
 }
 
-static void reset_globals ( VikTrwLayer *vtl, gboolean create_lyrs )
+// The whole file in memory - mapped when possible
+typedef struct {
+	GMappedFile *mf;
+	GByteArray *ba;
+	const guint8 *data;
+	gsize len;
+} fit_buffer_t;
+
+static void buffer_load ( fit_buffer_t *fb, FILE *ff )
 {
-	for ( guint8 ii = 0; ii < FIT_HDR_TYPE_MASK+1; ii++ )
-		g_defs[ii].reserved = FALSE;
-
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-	unnamed_layers = 1;
-	f_tr_newseg = FALSE;
-
-	fit_vtl = vtl;
-	fit_tp = NULL;
-	fit_wp = NULL;
-	fit_tr = NULL;
-	fit_md = NULL;
-	create_layers = create_lyrs;
+	memset ( fb, 0, sizeof(fit_buffer_t) );
+	GError *error = NULL;
+	fb->mf = g_mapped_file_new_from_fd ( fileno(ff), FALSE, &error );
+	if ( fb->mf && g_mapped_file_get_length(fb->mf) ) {
+		fb->data = (const guint8*)g_mapped_file_get_contents ( fb->mf );
+		fb->len = g_mapped_file_get_length ( fb->mf );
+		return;
+	}
+	if ( error ) {
+		g_debug ( "%s: Unable to map: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
+	}
+	if ( fb->mf )
+		g_mapped_file_unref ( fb->mf );
+	fb->mf = NULL;
+
+	// Not something that can be mapped (e.g. a pipe), so read it all in
+	fb->ba = g_byte_array_new ();
+	guint8 block[65536];
+	size_t nn;
+	while ( (nn = fread(block, 1, sizeof(block), ff)) > 0 )
+		g_byte_array_append ( fb->ba, block, nn );
+	fb->data = fb->ba->data;
+	fb->len = fb->ba->len;
+}
+
+static void buffer_free ( fit_buffer_t *fb )
+{
+	if ( fb->mf )
+		g_mapped_file_unref ( fb->mf );
+	if ( fb->ba )
+		g_byte_array_free ( fb->ba, TRUE );
+}
+
+static gboolean decode_file ( FitDecoder *dec, FILE *ff )
+{
+	fit_buffer_t fb;
+	buffer_load ( &fb, ff );
+	gboolean ans = decoder_run ( dec, fb.data, fb.len );
+	buffer_free ( &fb );
+	return ans;
 }
 
 /**
@@ -726,44 +702,37 @@ gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
 {
 	gboolean ans = FALSE;
 
-	reset_globals ( NULL, TRUE );
+	FitDecoder dec;
+	decoder_init ( &dec, NULL, TRUE, vvp );
 
-	header_t header = get_header ( ff );
-	g_debug ( "%s: Protocol=%d", __FUNCTION__, header.protocol_version );
-	g_debug ( "%s: Profile=%d", __FUNCTION__, header.profile_version );
-	g_debug ( "%s: Data size=%d", __FUNCTION__, header.data_size );
-
-	// Keep decoding until nothing left
-	g_data_size = header.data_size;
-	while ( g_data_size ) {
-		if ( !read_record(ff, vvp) ) {
-			g_warning ( "%s: data size not read =%d", __FUNCTION__, g_data_size );
-			return FALSE;
-		}
-	}
-
-	// TODO - support 'chained' fit files.
-	// Not found any examples to test with, so probably would end up with multiple tracks,
-	//  rather than say multiple TRW layers, however that should be good enough.
-	if ( fit_vtl ) {
-		fit_add_track ( fit_vtl );
-		if ( vik_trw_layer_is_empty(fit_vtl) ) {
+	if ( decode_file(&dec, ff) && dec.vtl ) {
+		// TODO - support 'chained' fit files.
+		// Not found any examples to test with, so probably would end up with multiple tracks,
+		//  rather than say multiple TRW layers, however that should be good enough.
+		fit_add_track ( &dec );
+		if ( vik_trw_layer_is_empty(dec.vtl) ) {
 			// free up layer
-			g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(fit_vtl)) );
-			g_object_unref ( fit_vtl );
+			g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(dec.vtl)) );
 		} else {
 			// Add it
 			gchar *name = g_strdup_printf ( "%s", a_file_basename(filename) );
-			vik_layer_rename ( VIK_LAYER(fit_vtl), name );
+			vik_layer_rename ( VIK_LAYER(dec.vtl), name );
 			g_free ( name );
-			vik_layer_post_read ( VIK_LAYER(fit_vtl), vvp, TRUE );
-			vik_aggregate_layer_add_layer ( val, VIK_LAYER(fit_vtl), FALSE );
-			vik_trw_layer_set_metadata ( fit_vtl, fit_md );
-			vik_trw_layer_auto_set_view ( fit_vtl, vvp );
+			vik_layer_post_read ( VIK_LAYER(dec.vtl), vvp, TRUE );
+			vik_aggregate_layer_add_layer ( val, VIK_LAYER(dec.vtl), FALSE );
+			vik_trw_layer_set_metadata ( dec.vtl, dec.md );
+			vik_trw_layer_auto_set_view ( dec.vtl, vvp );
+			dec.vtl = NULL;
+			dec.md = NULL;
 			ans = TRUE;
 		}
 	}
 
+	if ( dec.vtl )
+		g_object_unref ( dec.vtl );
+	if ( dec.md )
+		vik_trw_metadata_free ( dec.md );
+	decoder_clear ( &dec );
 	return ans;
 }
 
@@ -775,27 +744,20 @@ gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
  * This function reads all tracks found in a FIT file into the specified existing TRW Layer;
  *  typically device recorded FIT files will just have one 'layer' with track(s) in it,
  *  so this is particularly useful for reading in files in 'External' mode.
+ * As all the decoding state is local, this may be used on different layers at the same time
+ *  (e.g. from background threads, as long as the layers are not yet in use)
  */
 gboolean a_fit_read_file_into_layer ( VikTrwLayer *vtl, FILE *ff, const gchar* filename )
 {
-	reset_globals ( vtl, FALSE );
+	FitDecoder dec;
+	decoder_init ( &dec, vtl, FALSE, NULL );
 
-	header_t header = get_header ( ff );
-	g_debug ( "%s: Protocol=%d", __FUNCTION__, header.protocol_version );
-	g_debug ( "%s: Profile=%d", __FUNCTION__, header.profile_version );
-	g_debug ( "%s: Data size=%d", __FUNCTION__, header.data_size );
+	gboolean ans = decode_file ( &dec, ff );
+	if ( ans )
+		fit_add_track ( &dec );
 
-	// Keep decoding until nothing left
-	g_data_size = header.data_size;
-	while ( g_data_size ) {
-		if ( !read_record(ff, NULL) ) {
-			g_warning ( "%s: data size not read =%d", __FUNCTION__, g_data_size );
-			return FALSE;
-		}
-	}
-
-	fit_add_track ( vtl );
-	return TRUE;
+	decoder_clear ( &dec );
+	return ans;
 }
 
 gboolean a_fit_check_magic_filename ( const gchar* filename )
@@ -21,6 +21,7 @@
  *
  */
 
+#include <math.h>
 #include "viking.h"
 #include "garminsymbols.h"
 #include "icons/icons.h"
@@ -337,6 +338,12 @@ static struct {
 
 static GHashTable *icons = NULL;
 static GHashTable *old_icons = NULL;
+// Icons come from the icon theme, which is only for the main thread
+static GThread *icons_thread = NULL;
+
+// All the symbols at the current size in one pixbuf,
+//  with each symbol's icon being a sub-pixbuf of it
+static GdkPixbuf *atlas = NULL;
 
 static gboolean str_equal_casefold ( gconstpointer v1, gconstpointer v2 ) {
   gboolean equal;
@@ -385,21 +392,49 @@ static void init_icons() {
   }
 }
 
+/**
+ * Load every symbol at the size given by the preferences into a single grid,
+ *  rather than each in its own pixbuf as it is first wanted.
+ * This is one allocation instead of hundreds, and being made only once per size change
+ *  the waypoints that share a symbol then all draw from the same pixels.
+ */
+static void build_atlas ()
+{
+  guint size = a_vik_get_use_large_waypoint_icons() ? 30 : 18;
+  guint cols = (guint)ceil ( sqrt ( G_N_ELEMENTS(garmin_syms) ) );
+  guint rows = ( G_N_ELEMENTS(garmin_syms) + cols - 1 ) / cols;
+
+  atlas = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, cols*size, rows*size );
+  if ( !atlas ) {
+    g_warning ( "%s: failed to allocate %dx%d", __FUNCTION__, cols*size, rows*size );
+    return;
+  }
+  gdk_pixbuf_fill ( atlas, 0x00000000 );
+
+  gint i;
+  for (i=0; i<G_N_ELEMENTS(garmin_syms); i++) {
+    // Ensure data exists to either directly load icon or scale from the other set
+    if ( !garmin_syms[i].data && !garmin_syms[i].data_large )
+      continue;
+    GdkPixbuf *icon = ui_get_icon ( garmin_syms[i].data ? garmin_syms[i].data : garmin_syms[i].data_large, size );
+    if ( !icon )
+      continue;
+    gint xx = (i % cols) * size;
+    gint yy = (i / cols) * size;
+    gint width = MIN ( gdk_pixbuf_get_width(icon), size );
+    gint height = MIN ( gdk_pixbuf_get_height(icon), size );
+    gdk_pixbuf_copy_area ( icon, 0, 0, width, height, atlas, xx, yy );
+    g_object_unref ( icon );
+    garmin_syms[i].icon = gdk_pixbuf_new_subpixbuf ( atlas, xx, yy, width, height );
+  }
+}
+
 static GdkPixbuf *get_wp_sym_from_index ( gint i ) {
-  // Ensure data exists to either directly load icon or scale from the other set
-  if ( !garmin_syms[i].icon && ( garmin_syms[i].data || garmin_syms[i].data_large) ) {
-    if ( a_vik_get_use_large_waypoint_icons() ) {
-      if ( garmin_syms[i].data )
-        garmin_syms[i].icon = ui_get_icon ( garmin_syms[i].data, 30 );
-      else
-        garmin_syms[i].icon = ui_get_icon ( garmin_syms[i].data_large, 30 );
-    }
-    else {
-      if ( garmin_syms[i].data )
-        garmin_syms[i].icon = ui_get_icon ( garmin_syms[i].data, 18 );
-      else
-        garmin_syms[i].icon = ui_get_icon ( garmin_syms[i].data_large, 18 );
-    }
+  if ( !atlas ) {
+    // Files read in the background get their icons once handed over to the main thread
+    if ( icons_thread && g_thread_self() != icons_thread )
+      return NULL;
+    build_atlas ();
   }
   return garmin_syms[i].icon;
 }
@@ -482,6 +517,10 @@ void clear_garmin_icon_syms () {
       garmin_syms[i].icon = NULL;
     }
   }
+  if ( atlas ) {
+    g_object_unref ( atlas );
+    atlas = NULL;
+  }
   if ( list ) {
     gtk_list_store_clear ( list );
     g_object_unref ( list );
@@ -489,6 +528,17 @@ void clear_garmin_icon_syms () {
   }
 }
 
+/**
+ * Must be called from the main thread,
+ *  then symbol names can be looked up from any thread
+ */
+void a_garmin_icons_init ()
+{
+  icons_thread = g_thread_self ();
+  if ( !icons )
+    init_icons ();
+}
+
 void a_garmin_icons_uninit ()
 {
   clear_garmin_icon_syms ();
@@ -33,6 +33,7 @@ const gchar *a_get_hashed_sym ( const gchar *sym );
 GtkListStore *a_garmin_get_sym_liststore ();
 /* Use when preferences have changed to reload icons*/
 void clear_garmin_icon_syms ();
+void a_garmin_icons_init ();
 void a_garmin_icons_uninit ();
 
 G_END_DECLS
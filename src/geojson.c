@@ -23,169 +23,484 @@
  */
 
 #include "geojson.h"
-#include "gpx.h"
 #include "globals.h"
-#include "vikwindow.h"
+#include "misc/fpconv.h"
 
+#include <math.h>
+#include <string.h>
 #include <glib.h>
-#include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <json-glib/json-glib.h>
 
+// Flush the output in blocks of this size
+#define GEOJSON_WRITE_BUFFER 1048576
+
+/* Writing */
+
+static void append_json_string ( GString *gs, const gchar *str )
+{
+	g_string_append_c ( gs, '"' );
+	for ( const gchar *pp = str; *pp; pp++ ) {
+		switch ( *pp ) {
+		case '"':  g_string_append ( gs, "\\\"" ); break;
+		case '\\': g_string_append ( gs, "\\\\" ); break;
+		case '\n': g_string_append ( gs, "\\n" ); break;
+		case '\r': g_string_append ( gs, "\\r" ); break;
+		case '\t': g_string_append ( gs, "\\t" ); break;
+		default:
+			if ( (guchar)*pp < 0x20 )
+				g_string_append_printf ( gs, "\\u%04x", (guchar)*pp );
+			else
+				g_string_append_c ( gs, *pp );
+			break;
+		}
+	}
+	g_string_append_c ( gs, '"' );
+}
+
+static void append_double ( GString *gs, gdouble value )
+{
+	gchar buf[24];
+	gint len = fpconv_dtoa ( value, buf, 1 );
+	g_string_append_len ( gs, buf, len );
+}
+
+static void append_time ( GString *gs, gdouble timestamp )
+{
+	GTimeVal tv;
+	tv.tv_sec = timestamp;
+	tv.tv_usec = fabs((timestamp-(gint64)timestamp)*G_USEC_PER_SEC);
+	gchar *time_iso8601 = g_time_val_to_iso8601 ( &tv );
+	append_json_string ( gs, time_iso8601 );
+	g_free ( time_iso8601 );
+}
+
+/**
+ * Add a property, if there is a value for it
+ */
+static void append_property ( GString *gs, gboolean *first, const gchar *name, const gchar *value )
+{
+	if ( !value || !value[0] )
+		return;
+	if ( !*first )
+		g_string_append_c ( gs, ',' );
+	*first = FALSE;
+	append_json_string ( gs, name );
+	g_string_append_c ( gs, ':' );
+	append_json_string ( gs, value );
+}
+
+static void append_position ( GString *gs, const VikCoord *coord, gdouble altitude )
+{
+	struct LatLon ll;
+	vik_coord_to_latlon ( coord, &ll );
+	// GeoJSON positions are in 'lon,lat' order
+	g_string_append_c ( gs, '[' );
+	append_double ( gs, ll.lon );
+	g_string_append_c ( gs, ',' );
+	append_double ( gs, ll.lat );
+	if ( !isnan(altitude) ) {
+		g_string_append_c ( gs, ',' );
+		append_double ( gs, altitude );
+	}
+	g_string_append_c ( gs, ']' );
+}
+
+static void write_waypoint ( GString *gs, VikWaypoint *wp )
+{
+	gboolean first = TRUE;
+	g_string_append ( gs, "{\"type\":\"Feature\",\"properties\":{" );
+	append_property ( gs, &first, "name", wp->name );
+	append_property ( gs, &first, "desc", wp->description );
+	append_property ( gs, &first, "cmt", wp->comment );
+	append_property ( gs, &first, "sym", wp->symbol );
+	if ( !isnan(wp->timestamp) ) {
+		if ( !first )
+			g_string_append_c ( gs, ',' );
+		first = FALSE;
+		g_string_append ( gs, "\"time\":" );
+		append_time ( gs, wp->timestamp );
+	}
+	g_string_append ( gs, "},\"geometry\":{\"type\":\"Point\",\"coordinates\":" );
+	append_position ( gs, &wp->coord, wp->altitude );
+	g_string_append ( gs, "}}" );
+}
+
 /**
- * Perform any cleanup actions once program has completed running
+ * Tracks with several segments are written as a MultiLineString,
+ *  with the 'coordTimes' property (as used by togeojson) in the same shape as the coordinates
  */
-static void my_watch ( GPid pid,
-                       gint status,
-                       gpointer user_data )
+static void write_track ( GString *gs, VikTrack *trk )
+{
+	gboolean multi = FALSE;
+	gboolean times = FALSE;
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( iter != trk->trackpoints && tp->newsegment )
+			multi = TRUE;
+		if ( !isnan(tp->timestamp) )
+			times = TRUE;
+	}
+
+	gboolean first = TRUE;
+	g_string_append ( gs, "{\"type\":\"Feature\",\"properties\":{" );
+	append_property ( gs, &first, "name", trk->name );
+	append_property ( gs, &first, "desc", trk->description );
+	append_property ( gs, &first, "cmt", trk->comment );
+	append_property ( gs, &first, "_gpxType", trk->is_route ? "rte" : "trk" );
+	if ( times ) {
+		g_string_append ( gs, ",\"coordTimes\":[" );
+		if ( multi )
+			g_string_append_c ( gs, '[' );
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+			if ( iter != trk->trackpoints )
+				g_string_append ( gs, multi && tp->newsegment ? "],[" : "," );
+			if ( isnan(tp->timestamp) )
+				g_string_append ( gs, "null" );
+			else
+				append_time ( gs, tp->timestamp );
+		}
+		if ( multi )
+			g_string_append_c ( gs, ']' );
+		g_string_append_c ( gs, ']' );
+	}
+	g_string_append ( gs, "},\"geometry\":{\"type\":" );
+	g_string_append ( gs, multi ? "\"MultiLineString\"" : "\"LineString\"" );
+	g_string_append ( gs, ",\"coordinates\":[" );
+	if ( multi )
+		g_string_append_c ( gs, '[' );
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( iter != trk->trackpoints )
+			g_string_append ( gs, multi && tp->newsegment ? "],[" : "," );
+		append_position ( gs, &tp->coord, tp->altitude );
+	}
+	if ( multi )
+		g_string_append_c ( gs, ']' );
+	g_string_append ( gs, "]}}" );
+}
+
+static int waypoint_compare_name ( gconstpointer x, gconstpointer y )
+{
+	return g_strcmp0 ( ((VikWaypoint*)x)->name, ((VikWaypoint*)y)->name );
+}
+
+static int track_compare_name ( gconstpointer x, gconstpointer y )
 {
-	g_spawn_close_pid ( pid );
+	return g_strcmp0 ( ((VikTrack*)x)->name, ((VikTrack*)y)->name );
+}
+
+static void write_items ( GString *gs, FILE *ff, GHashTable *items, GCompareFunc compare, gboolean waypoints, gboolean *first )
+{
+	GList *gl = g_list_sort ( g_hash_table_get_values ( items ), compare );
+	for ( GList *iter = gl; iter; iter = iter->next ) {
+		if ( !waypoints && !VIK_TRACK(iter->data)->trackpoints )
+			continue;
+		g_string_append ( gs, *first ? "\n" : ",\n" );
+		*first = FALSE;
+		if ( waypoints )
+			write_waypoint ( gs, VIK_WAYPOINT(iter->data) );
+		else
+			write_track ( gs, VIK_TRACK(iter->data) );
+		if ( gs->len >= GEOJSON_WRITE_BUFFER ) {
+			fwrite ( gs->str, 1, gs->len, ff );
+			g_string_truncate ( gs, 0 );
+		}
+	}
+	g_list_free ( gl );
 }
 
 /**
  * a_geojson_write_file:
  *
+ * Write the layer as a GeoJSON FeatureCollection:
+ *  waypoints as Points, tracks and routes as LineStrings (or MultiLineStrings when split into segments)
+ *
  * Returns TRUE if successfully written
  */
 gboolean a_geojson_write_file ( VikTrwLayer *vtl, FILE *ff )
 {
-	gboolean result = FALSE;
+	GString *gs = g_string_sized_new ( GEOJSON_WRITE_BUFFER );
+	gboolean first = TRUE;
+
+	g_string_append ( gs, "{\"type\":\"FeatureCollection\",\"features\":[" );
+	if ( vik_trw_layer_get_waypoints_visibility(vtl) )
+		write_items ( gs, ff, vik_trw_layer_get_waypoints(vtl), waypoint_compare_name, TRUE, &first );
+	if ( vik_trw_layer_get_tracks_visibility(vtl) )
+		write_items ( gs, ff, vik_trw_layer_get_tracks(vtl), track_compare_name, FALSE, &first );
+	if ( vik_trw_layer_get_routes_visibility(vtl) )
+		write_items ( gs, ff, vik_trw_layer_get_routes(vtl), track_compare_name, FALSE, &first );
+	g_string_append ( gs, "\n]}\n" );
+
+	gboolean result = fwrite ( gs->str, 1, gs->len, ff ) == gs->len;
+	g_string_free ( gs, TRUE );
+	return result && !ferror ( ff );
+}
 
-	gchar *tmp_filename = a_gpx_write_tmp_file ( vtl, NULL );
-	if ( !tmp_filename )
-		return result;
+/* Reading */
 
-	GPid pid;
-	gint mystdout;
+typedef struct {
+	VikTrwLayer *vtl;
+	VikCoordMode coord_mode;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint added;
+	gboolean routes; // Lines are always routes
+} GeojsonRead;
 
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 5);
-	argv[0] = g_strdup (a_geojson_program_export());
-	argv[1] = g_strdup ("-f");
-	argv[2] = g_strdup ("gpx");
-	argv[3] = g_strdup (tmp_filename);
-	argv[4] = NULL;
+static const gchar* get_string ( JsonObject *obj, const gchar *name )
+{
+	if ( !obj )
+		return NULL;
+	JsonNode *node = json_object_get_member ( obj, name );
+	if ( node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING )
+		return json_node_get_string ( node );
+	return NULL;
+}
 
-	GError *error = NULL;
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
+static JsonArray* get_array ( JsonObject *obj, const gchar *name )
+{
+	if ( !obj )
+		return NULL;
+	JsonNode *node = json_object_get_member ( obj, name );
+	if ( node && JSON_NODE_HOLDS_ARRAY(node) )
+		return json_node_get_array ( node );
+	return NULL;
+}
 
-		if ( IS_VIK_WINDOW ((VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(vtl)) ) {
-			gchar* msg = g_strdup_printf ( _("%s command failed: %s"), argv[0], error->message );
-			vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vtl), msg, VIK_STATUSBAR_INFO );
-			g_free (msg);
-		}
-		else
-			g_warning ("Async command failed: %s", error->message);
+static gboolean get_number ( JsonNode *node, gdouble *value )
+{
+	if ( !node || !JSON_NODE_HOLDS_VALUE(node) )
+		return FALSE;
+	GType type = json_node_get_value_type ( node );
+	if ( type != G_TYPE_DOUBLE && type != G_TYPE_INT64 )
+		return FALSE;
+	*value = json_node_get_double ( node );
+	return TRUE;
+}
 
-		g_error_free(error);
-	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
-
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( ff, "%s", line );
-		}
+/**
+ * A position is an array of lon, lat and optionally the altitude
+ */
+static gboolean get_position ( GeojsonRead *gr, JsonNode *node, VikCoord *coord, gdouble *altitude )
+{
+	if ( !node || !JSON_NODE_HOLDS_ARRAY(node) )
+		return FALSE;
+	JsonArray *pos = json_node_get_array ( node );
+	guint len = json_array_get_length ( pos );
+	struct LatLon ll;
+	if ( len < 2 ||
+	     !get_number ( json_array_get_element(pos, 0), &ll.lon ) ||
+	     !get_number ( json_array_get_element(pos, 1), &ll.lat ) )
+		return FALSE;
+	vik_coord_load_from_latlon ( coord, gr->coord_mode, &ll );
+	if ( len < 3 || !get_number ( json_array_get_element(pos, 2), altitude ) )
+		*altitude = NAN;
+	return TRUE;
+}
 
-		fclose(fout);
+static gdouble get_time ( JsonNode *node )
+{
+	GTimeVal tv;
+	if ( node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING &&
+	     g_time_val_from_iso8601 ( json_node_get_string(node), &tv ) )
+		return (gdouble)tv.tv_sec + (gdouble)tv.tv_usec / G_USEC_PER_SEC;
+	return NAN;
+}
 
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
-		result = TRUE;
+static void add_waypoint ( GeojsonRead *gr, JsonNode *position, JsonObject *props )
+{
+	VikWaypoint *wp = vik_waypoint_new ();
+	if ( !get_position ( gr, position, &wp->coord, &wp->altitude ) ) {
+		vik_waypoint_free ( wp );
+		return;
 	}
+	const gchar *desc = get_string ( props, "desc" );
+	if ( !desc )
+		desc = get_string ( props, "description" );
+	vik_waypoint_set_description ( wp, desc );
+	vik_waypoint_set_comment ( wp, get_string ( props, "cmt" ) );
+	const gchar *sym = get_string ( props, "sym" );
+	if ( sym )
+		vik_waypoint_set_symbol ( wp, sym );
+	if ( props )
+		wp->timestamp = get_time ( json_object_get_member ( props, "time" ) );
+
+	const gchar *name = get_string ( props, "name" );
+	gchar *unnamed = NULL;
+	if ( !name )
+		name = unnamed = g_strdup_printf ( _("Waypoint%04d"), gr->unnamed_waypoints++ );
+	vik_trw_layer_filein_add_waypoint ( gr->vtl, (gchar*)name, wp );
+	g_free ( unnamed );
+	gr->added++;
+}
 
-	g_strfreev (argv);
+/**
+ * Prepends the positions of a line to the track, in the reverse order
+ */
+static void add_line ( GeojsonRead *gr, VikTrack *trk, JsonArray *line, JsonArray *times )
+{
+	gboolean newseg = trk->trackpoints != NULL;
+	guint len = json_array_get_length ( line );
+	guint ntimes = times ? json_array_get_length ( times ) : 0;
+	for ( guint ii = 0; ii < len; ii++ ) {
+		VikTrackpoint *tp = vik_trackpoint_new ();
+		if ( !get_position ( gr, json_array_get_element(line, ii), &tp->coord, &tp->altitude ) ) {
+			vik_trackpoint_free ( tp );
+			continue;
+		}
+		if ( ii < ntimes )
+			tp->timestamp = get_time ( json_array_get_element(times, ii) );
+		tp->newsegment = newseg;
+		newseg = FALSE;
+		trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+	}
+}
 
-	// Delete the temporary file
-	(void)g_remove (tmp_filename);
-	g_free (tmp_filename);
+static void add_track ( GeojsonRead *gr, JsonArray *coords, gboolean multi, JsonObject *props, const gchar *default_name )
+{
+	VikTrack *trk = vik_track_new ();
+	trk->is_route = gr->routes || g_strcmp0 ( get_string ( props, "_gpxType" ), "rte" ) == 0;
+
+	JsonArray *times = get_array ( props, "coordTimes" );
+	if ( multi ) {
+		guint len = json_array_get_length ( coords );
+		guint ntimes = times ? json_array_get_length ( times ) : 0;
+		for ( guint ii = 0; ii < len; ii++ ) {
+			JsonNode *line = json_array_get_element ( coords, ii );
+			if ( !JSON_NODE_HOLDS_ARRAY(line) )
+				continue;
+			JsonArray *line_times = NULL;
+			if ( ii < ntimes && JSON_NODE_HOLDS_ARRAY(json_array_get_element(times, ii)) )
+				line_times = json_array_get_array_element ( times, ii );
+			add_line ( gr, trk, json_node_get_array(line), line_times );
+		}
+	}
+	else
+		add_line ( gr, trk, coords, times );
 
-	return result;
+	if ( !trk->trackpoints ) {
+		vik_track_free ( trk );
+		return;
+	}
+	trk->trackpoints = g_list_reverse ( trk->trackpoints );
+
+	const gchar *desc = get_string ( props, "desc" );
+	if ( !desc )
+		desc = get_string ( props, "description" );
+	vik_track_set_description ( trk, desc );
+	vik_track_set_comment ( trk, get_string ( props, "cmt" ) );
+
+	const gchar *name = get_string ( props, "name" );
+	if ( !name )
+		name = default_name;
+	gchar *unnamed = NULL;
+	if ( !name )
+		name = unnamed = g_strdup_printf ( _("Track%03d"), gr->unnamed_tracks++ );
+	vik_trw_layer_filein_add_track ( gr->vtl, (gchar*)name, trk );
+	g_free ( unnamed );
+	gr->added++;
 }
 
-//
-// https://github.com/mapbox/togeojson
-//
-// https://www.npmjs.org/package/togeojson
-//
-// Tested with version 0.7.0
-const gchar* a_geojson_program_export ( void )
+static void read_geometry ( GeojsonRead *gr, JsonObject *geom, JsonObject *props, const gchar *default_name )
 {
-	return "togeojson";
+	const gchar *type = get_string ( geom, "type" );
+	if ( !type )
+		return;
+
+	if ( g_strcmp0 ( type, "GeometryCollection" ) == 0 ) {
+		JsonArray *geoms = get_array ( geom, "geometries" );
+		for ( guint ii = 0; geoms && ii < json_array_get_length(geoms); ii++ ) {
+			JsonNode *node = json_array_get_element ( geoms, ii );
+			if ( JSON_NODE_HOLDS_OBJECT(node) )
+				read_geometry ( gr, json_node_get_object(node), props, default_name );
+		}
+		return;
+	}
+
+	JsonNode *coords = json_object_get_member ( geom, "coordinates" );
+	if ( !coords )
+		return;
+
+	if ( g_strcmp0 ( type, "Point" ) == 0 )
+		add_waypoint ( gr, coords, props );
+	else if ( !JSON_NODE_HOLDS_ARRAY(coords) )
+		return;
+	else if ( g_strcmp0 ( type, "MultiPoint" ) == 0 ) {
+		JsonArray *points = json_node_get_array ( coords );
+		for ( guint ii = 0; ii < json_array_get_length(points); ii++ )
+			add_waypoint ( gr, json_array_get_element(points, ii), props );
+	}
+	else if ( g_strcmp0 ( type, "LineString" ) == 0 )
+		add_track ( gr, json_node_get_array(coords), FALSE, props, default_name );
+	else if ( g_strcmp0 ( type, "MultiLineString" ) == 0 )
+		add_track ( gr, json_node_get_array(coords), TRUE, props, default_name );
+	else
+		g_debug ( "%s: Ignoring geometry type %s", __FUNCTION__, type );
 }
 
-//
-// https://github.com/tyrasd/togpx
-//
-// https://www.npmjs.org/package/togpx
-//
-// Tested with version 0.3.1
-const gchar* a_geojson_program_import ( void )
+static void read_feature ( GeojsonRead *gr, JsonObject *feature )
 {
-	return "togpx";
+	JsonNode *geom = json_object_get_member ( feature, "geometry" );
+	if ( !geom || !JSON_NODE_HOLDS_OBJECT(geom) )
+		return;
+	JsonNode *props = json_object_get_member ( feature, "properties" );
+	read_geometry ( gr, json_node_get_object(geom), props && JSON_NODE_HOLDS_OBJECT(props) ? json_node_get_object(props) : NULL, NULL );
 }
 
-/**
- * a_geojson_import_to_gpx:
- *
- * @filename: The source GeoJSON file
- *
- * Returns: The name of newly created temporary GPX file
- *          This file should be removed once used and the string freed.
- *          If NULL then the process failed.
- */
-gchar* a_geojson_import_to_gpx ( const gchar *filename )
+static JsonParser* parse_file ( const gchar *filename, const gchar *func )
 {
-	gchar *gpx_filename = NULL;
+	JsonParser *jp = json_parser_new ();
 	GError *error = NULL;
-	// Opening temporary file
-	int fd = g_file_open_tmp("vik_geojson_XXXXXX.gpx", &gpx_filename, &error);
-	if (fd < 0) {
-		g_warning ( _("failed to open temporary file: %s"), error->message );
+	if ( !json_parser_load_from_file ( jp, filename, &error ) ) {
+		g_warning ( "%s: parse load failed: %s", func, error ? error->message : "" );
 		g_clear_error ( &error );
+		g_object_unref ( jp );
 		return NULL;
 	}
-	g_debug ( "%s: temporary file = %s", __FUNCTION__, gpx_filename );
-
-	GPid pid;
-	gint mystdout;
-
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 3);
-	argv[0] = g_strdup (a_geojson_program_import());
-	argv[1] = g_strdup (filename);
-	argv[2] = NULL;
+	JsonNode *root = json_parser_get_root ( jp );
+	if ( !root || !JSON_NODE_HOLDS_OBJECT(root) ) {
+		g_warning ( "%s: %s is not a JSON object", func, filename );
+		g_object_unref ( jp );
+		return NULL;
+	}
+	return jp;
+}
 
-	FILE *gpxfile = fdopen (fd, "w");
+/**
+ * a_geojson_read_file:
+ *
+ * Read Points, MultiPoints, LineStrings and MultiLineStrings
+ *  from a FeatureCollection, a Feature or a bare geometry into the layer.
+ * Properties are as written by a_geojson_write_file() (and togeojson).
+ *
+ * Returns TRUE if anything was read
+ */
+gboolean a_geojson_read_file ( VikTrwLayer *vtl, const gchar *filename )
+{
+	JsonParser *jp = parse_file ( filename, __FUNCTION__ );
+	if ( !jp )
+		return FALSE;
 
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
-		g_warning ("Async command failed: %s", error->message);
-		g_error_free(error);
-	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
-
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( gpxfile, "%s", line );
+	GeojsonRead gr = { vtl, vik_trw_layer_get_coord_mode(vtl), 1, 1, 0, FALSE };
+	JsonObject *root = json_node_get_object ( json_parser_get_root(jp) );
+	const gchar *type = get_string ( root, "type" );
+	if ( g_strcmp0 ( type, "FeatureCollection" ) == 0 ) {
+		JsonArray *features = get_array ( root, "features" );
+		for ( guint ii = 0; features && ii < json_array_get_length(features); ii++ ) {
+			JsonNode *node = json_array_get_element ( features, ii );
+			if ( JSON_NODE_HOLDS_OBJECT(node) )
+				read_feature ( &gr, json_node_get_object(node) );
 		}
-
-		fclose(fout);
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
 	}
+	else if ( g_strcmp0 ( type, "Feature" ) == 0 )
+		read_feature ( &gr, root );
+	else
+		read_geometry ( &gr, root, NULL, NULL );
 
-	fclose (gpxfile);
-
-	g_strfreev (argv);
-
-	return gpx_filename;
+	g_object_unref ( jp );
+	return gr.added > 0;
 }
 
 /**
@@ -196,82 +511,22 @@ gchar* a_geojson_import_to_gpx ( const gchar *filename )
  */
 gboolean a_geojson_read_file_OSRM ( VikTrwLayer *vtl, const gchar *filename )
 {
-	JsonParser *jp = json_parser_new();
-	GError *error = NULL;
-	gboolean ans = json_parser_load_from_file ( jp, filename, &error );
-	if ( error ) {
-		g_warning ( "%s: parse load failed: %s", __FUNCTION__, error->message );
-		g_error_free ( error );
+	JsonParser *jp = parse_file ( filename, __FUNCTION__ );
+	if ( !jp )
 		return FALSE;
-	}
-
-	JsonNode *result;
-	JsonPath *path = json_path_new ();
-	json_path_compile ( path, "$.routes..geometry..coordinates", NULL );
-	result = json_path_match ( path, json_parser_get_root(jp) );
-
-	JsonGenerator *generator = json_generator_new ();
-	json_generator_set_root ( generator, result );
-
-	// Not sure of a good way to use native glib types (or GObjects etc...)
-	//  so simply hack apart this returned string
-	gchar *str = json_generator_to_data ( generator, NULL );
-	//g_debug ( "%s result: %s\n", __FUNCTION__, str );
-
-	if ( strlen(str) > 8 ) {
-		// Not sure how efficient this is; but should suffice for our use cases
-		gchar *ptr = GINT_TO_POINTER(1);
-		while ( ptr ) {
-			// Remove the inbetween brackets
-			ptr = g_strrstr ( str, "],[" );
-			if ( ptr )
-				// NB using memcpy() as compiler moans about not nul-terminated for strncpy(),
-				//  but here we definitely want just a direct substitution
-				//strncpy ( ptr, "   ", 3 );
-				memcpy ( ptr, "   ", 3 );
-		}
 
-		// Tidy up beginning and ending brackets
-		ptr = g_strrstr ( str, "]]]" );
-		if ( ptr )
-			memcpy ( ptr, "   ", 3 ); // as above
-		ptr = g_strrstr ( str, "[[[" );
-		if ( ptr )
-			memcpy ( ptr, "   ", 3 ); // as above
-
-		gchar **coords = g_strsplit ( str, " ", -1 );
-
-		gint gi = 0;
-		gchar *coord = coords[0];
-		if ( coord ) {
-			ans = TRUE;
-			VikCoordMode coord_mode = vik_trw_layer_get_coord_mode ( vtl );
-			VikTrack *trk = vik_track_new ();
-			trk->is_route = TRUE;
-			VikTrackpoint *tp;
-			struct LatLon ll;
-			while ( coord ) {
-				gchar **vals = g_strsplit ( coord, ",", -1 );
-				guint nn = g_strv_length ( vals );
-				if ( nn == 2 ) {
-					tp = vik_trackpoint_new ();
-					// Remember geojson coordinates are in the 'lon,lat' order
-					ll.lat = g_ascii_strtod ( vals[1], NULL );
-					ll.lon = g_ascii_strtod ( vals[0], NULL );
-					vik_coord_load_from_latlon ( &tp->coord, coord_mode, &ll );
-					trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
-				}
-				g_strfreev ( vals );
-				//gi++;
-				coord = coords[gi++];
-			}
-			trk->trackpoints = g_list_reverse ( trk->trackpoints );
-            // Potentially could try to be more clever with the name...
-			vik_trw_layer_filein_add_track ( vtl, N_("OSRM Route"), trk );
-		}
-		g_strfreev ( coords );
+	GeojsonRead gr = { vtl, vik_trw_layer_get_coord_mode(vtl), 1, 1, 0, TRUE };
+	JsonArray *routes = get_array ( json_node_get_object(json_parser_get_root(jp)), "routes" );
+	for ( guint ii = 0; routes && ii < json_array_get_length(routes); ii++ ) {
+		JsonNode *route = json_array_get_element ( routes, ii );
+		if ( !JSON_NODE_HOLDS_OBJECT(route) )
+			continue;
+		JsonNode *geom = json_object_get_member ( json_node_get_object(route), "geometry" );
+		// Potentially could try to be more clever with the name...
+		if ( geom && JSON_NODE_HOLDS_OBJECT(geom) )
+			read_geometry ( &gr, json_node_get_object(geom), NULL, N_("OSRM Route") );
 	}
-	g_object_unref ( jp );
 
-	return ans;
+	g_object_unref ( jp );
+	return gr.added > 0;
 }
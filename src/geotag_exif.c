@@ -28,11 +28,13 @@
  *  The attentative reader will notice the use of gexiv2 is a lot simpler as well.
  * For the time being the libexif code + build is still made available.
  */
+#include <stdio.h>
 #include <string.h>
 #include "geotag_exif.h"
 #include "config.h"
 #include "globals.h"
 #include "file.h"
+#include "dir.h"
 
 #include <sys/stat.h>
 #ifdef HAVE_UTIME_H
@@ -213,16 +215,50 @@ static struct LatLon get_latlon ( ExifData *ed )
 #endif
 
 /**
- * a_geotag_get_position:
- *
- * @filename: The (JPG) file with EXIF information in it
- *
- * Returns: The position in LatLon format.
- *  It will be 0,0 if some kind of failure occurs.
+ * Everything the waypoint creation and geotagging wants from an image's EXIF,
+ *  so a single read of the file serves all of those
  */
-struct LatLon a_geotag_get_position ( const gchar *filename )
+typedef struct {
+	gint64 size;
+	gint64 mtime;
+	gchar *datetime;     // In EXIF_DATE_FORMAT, or NULL
+	gboolean has_gps;    // Existing GPS information, as far as geotagging is concerned
+	gboolean positioned; // Enough to create a waypoint at ll
+	struct LatLon ll;    // 0,0 if none
+	gdouble altitude;
+	gdouble direction;
+	VikWaypointImageDirectionRef direction_ref;
+	gchar *title;
+	gchar *comment;
+	gboolean used;       // Looked up during this run
+} geotag_info_t;
+
+static void geotag_info_free ( geotag_info_t *info )
 {
-	struct LatLon ll = { 0.0, 0.0 };
+	g_free ( info->datetime );
+	g_free ( info->title );
+	g_free ( info->comment );
+	g_free ( info );
+}
+
+static geotag_info_t *geotag_info_copy ( const geotag_info_t *info )
+{
+	geotag_info_t *copy = g_memdup ( info, sizeof(geotag_info_t) );
+	copy->datetime = g_strdup ( info->datetime );
+	copy->title = g_strdup ( info->title );
+	copy->comment = g_strdup ( info->comment );
+	return copy;
+}
+
+/**
+ * Parse the file's EXIF (the slow part)
+ */
+static geotag_info_t *geotag_info_read ( const gchar *filename )
+{
+	geotag_info_t *info = g_new0 ( geotag_info_t, 1 );
+	info->altitude = NAN;
+	info->direction = NAN;
+	info->direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
 
 #ifdef HAVE_LIBGEXIV2
 	GExiv2Metadata *gemd = gexiv2_metadata_new ();
@@ -231,11 +267,39 @@ struct LatLon a_geotag_get_position ( const gchar *filename )
 		gdouble lon;
 		gdouble alt;
 		if ( gexiv2_metadata_get_gps_info ( gemd, &lon, &lat, &alt ) ) {
-			ll.lat = lat;
-			ll.lon = lon;
+			info->ll.lat = lat;
+			info->ll.lon = lon;
+			info->altitude = alt;
+			info->positioned = TRUE;
+		}
+		info->has_gps = ( gexiv2_metadata_get_gps_longitude(gemd,&lon) && gexiv2_metadata_get_gps_latitude(gemd,&lat) );
+
+		// Prefer 'Photo' version over 'Image'
+		if ( gexiv2_metadata_has_tag ( gemd, "Exif.Photo.DateTimeOriginal" ) )
+			info->datetime = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Photo.DateTimeOriginal" ) );
+		else
+			info->datetime = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.DateTimeOriginal" ) );
+
+		if ( gexiv2_metadata_has_tag ( gemd, "Exif.Image.XPTitle" ) )
+			info->title = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.XPTitle" ) );
+		info->comment = geotag_get_exif_comment ( gemd );
+
+		// Direction
+		if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR_REF ) ) {
+			gchar* ref_str = gexiv2_metadata_get_tag_interpreted_string(gemd, EXIF_GPS_IMGDIR_REF);
+			if ( ref_str && g_ascii_strncasecmp ("M", ref_str, 1) == 0 )
+				info->direction_ref = WP_IMAGE_DIRECTION_REF_MAGNETIC;
+			g_free ( ref_str );
+		}
+		if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR ) ) {
+			gint nom;
+			gint den;
+			if ( gexiv2_metadata_get_exif_tag_rational (gemd, EXIF_GPS_IMGDIR, &nom, &den) )
+				if ( den != 0 )
+					info->direction = (gdouble)nom/(gdouble)den;
 		}
 	}
-	metadata_free  ( gemd );
+	metadata_free ( gemd );
 #else
 #ifdef HAVE_LIBEXIF
 	// open image with libexif
@@ -243,162 +307,325 @@ struct LatLon a_geotag_get_position ( const gchar *filename )
 
 	// Detect EXIF load failure
 	if ( !ed )
-		return ll;
+		return info;
 
-	ExifEntry *ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_VERSION_ID);
+	gchar str[128];
+	ExifEntry *ee;
+
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_EXIF], EXIF_TAG_DATE_TIME_ORIGINAL);
+	if ( ee ) {
+		exif_entry_get_value ( ee, str, 128 );
+		info->datetime = g_strdup ( str );
+	}
+
+	// Name
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_0], EXIF_TAG_XP_TITLE);
+	if ( ee ) {
+		exif_entry_get_value ( ee, str, 128 );
+		info->title = g_strdup ( str );
+	}
+	info->comment = geotag_get_exif_comment ( ed );
+
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_VERSION_ID);
 	// Confirm this has a GPS Id - normally "2.0.0.0" or "2.2.0.0"
-	if ( ! ( ee && ee->components == 4 ) )
-		goto MyReturn0;
+	if ( ee && ee->components == 4 ) {
+		info->has_gps = TRUE;
+		// Could test for these versions explicitly but may have byte order issues...
+		info->ll = get_latlon ( ed );
+		// Hopefully won't have valid images at 0,0!
+		info->positioned = !( info->ll.lat == 0.0 && info->ll.lon == 0.0 );
+
+		ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE);
+		if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_RATIONAL ) {
+			info->altitude = Rational2Double ( ee->data,
+											   0,
+											   exif_data_get_byte_order(ed) );
+
+			ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE_REF);
+			if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_BYTE && ee->data[0] == 1 )
+				info->altitude = -info->altitude;
+		}
+	}
 
-	ll = get_latlon ( ed );
+	// Check other basic GPS fields exist too
+	// I have encountered some images which have just the EXIF_TAG_GPS_VERSION_ID but nothing else
+	// So to confirm check more EXIF GPS TAGS:
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LATITUDE);
+	if ( !ee )
+		info->has_gps = FALSE;
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LONGITUDE);
+	if ( !ee )
+		info->has_gps = FALSE;
 
-MyReturn0:
 	// Finished with EXIF
 	exif_data_free ( ed );
 #endif
 #endif
 
-	return ll;
+	return info;
 }
 
-/**
- * a_geotag_create_waypoint_from_file:
- * @filename: The image file to process
- * @vcmode:   The current location mode to use in the positioning of Waypoint
- * @name:     Returns a name for the Waypoint (can be NULL)
- *
- * Returns: An allocated Waypoint or NULL if Waypoint could not be generated (e.g. no EXIF info)
- *
- */
-VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoordMode vcmode, gchar **name )
+//
+// The EXIF of images already seen, keyed by filename
+//  and only used while the file still has the same size and modification time.
+// Kept between runs, so re-processing a large directory of photos only reads the new or changed ones.
+//
+#define VIKING_GEOTAG_CACHE_FILE "geotag_exif.ini"
+
+static GHashTable *geotag_cache = NULL;
+static GMutex geotag_cache_mutex;
+static gboolean geotag_cache_dirty = FALSE;
+
+static gchar *geotag_cache_filename ( void )
 {
-	// Default return values (for failures)
-	*name = NULL;
-	VikWaypoint *wp = NULL;
+	return g_build_filename ( a_get_viking_dir(), VIKING_GEOTAG_CACHE_FILE, NULL );
+}
 
-#ifdef HAVE_LIBGEXIV2
-	GExiv2Metadata *gemd = gexiv2_metadata_new ();
-	if ( gexiv2_metadata_open_path ( gemd, filename, NULL ) ) {
-		gdouble lat;
-		gdouble lon;
-		gdouble alt;
-		if ( gexiv2_metadata_get_gps_info ( gemd, &lon, &lat, &alt ) ) {
-			struct LatLon ll;
-			ll.lat = lat;
-			ll.lon = lon;
-
-			//
-			// Now create Waypoint with acquired information
-			//
-			wp = vik_waypoint_new();
-			// Set info from exif values
-			// Location
-			vik_coord_load_from_latlon ( &(wp->coord), vcmode, &ll );
-			// Altitude
-			wp->altitude = alt;
-
-			if ( gexiv2_metadata_has_tag ( gemd, "Exif.Image.XPTitle" ) )
-				*name = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.XPTitle" ) );
-			wp->comment = geotag_get_exif_comment ( gemd );
-
-			// Direction
-			VikWaypointImageDirectionRef ref = WP_IMAGE_DIRECTION_REF_TRUE;
-			if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR_REF ) ) {
-				gchar* ref_str = gexiv2_metadata_get_tag_interpreted_string(gemd, EXIF_GPS_IMGDIR_REF);
-				if ( ref_str && g_ascii_strncasecmp ("M", ref_str, 1) == 0 )
-					ref = WP_IMAGE_DIRECTION_REF_MAGNETIC;
-				g_free ( ref_str );
-			}
-			if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR ) ) {
-				gint nom;
-				gint den;
-				gdouble direction = NAN;
-				if ( gexiv2_metadata_get_exif_tag_rational (gemd, EXIF_GPS_IMGDIR, &nom, &den) )
-					if ( den != 0 )
-						direction = (gdouble)nom/(gdouble)den;
-
-				if ( !isnan(direction) )
-					vik_waypoint_set_image_direction_info ( wp, direction, ref );
-			}
+static gchar *geotag_cache_get_string ( GKeyFile *kf, const gchar *group, const gchar *key )
+{
+	if ( !g_key_file_has_key ( kf, group, key, NULL ) )
+		return NULL;
+	return g_key_file_get_string ( kf, group, key, NULL );
+}
 
-			vik_waypoint_set_image ( wp, filename );
-		}
+static gdouble geotag_cache_get_double ( GKeyFile *kf, const gchar *group, const gchar *key )
+{
+	GError *error = NULL;
+	gdouble value = g_key_file_get_double ( kf, group, key, &error );
+	if ( error ) {
+		g_error_free ( error );
+		return NAN;
 	}
-	metadata_free ( gemd );
-#else
-#ifdef HAVE_LIBEXIF
-	// TODO use log?
-	//ExifLog *log = NULL;
-
-	// open image with libexif
-	ExifData *ed = exif_data_new_from_file ( filename );
+	return value;
+}
 
-	// Detect EXIF load failure
-	if ( !ed )
-		// return with no Waypoint
-		return wp;
+// Call with the mutex held
+static void geotag_cache_load ( void )
+{
+	geotag_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)geotag_info_free );
+
+	GKeyFile *kf = g_key_file_new ();
+	gchar *fn = geotag_cache_filename ();
+	// Not existing until the first images have been read
+	if ( g_key_file_load_from_file ( kf, fn, G_KEY_FILE_NONE, NULL ) ) {
+		gsize len = 0;
+		gchar **groups = g_key_file_get_groups ( kf, &len );
+		for ( gsize ii = 0; ii < len; ii++ ) {
+			const gchar *group = groups[ii];
+			gchar *stamp = g_key_file_get_string ( kf, group, "stamp", NULL );
+			gint64 size, mtime;
+			if ( stamp && sscanf ( stamp, "%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, &size, &mtime ) == 2 ) {
+				geotag_info_t *info = g_new0 ( geotag_info_t, 1 );
+				info->size = size;
+				info->mtime = mtime;
+				info->datetime = geotag_cache_get_string ( kf, group, "date" );
+				info->has_gps = g_key_file_get_boolean ( kf, group, "gps", NULL );
+				info->positioned = g_key_file_get_boolean ( kf, group, "positioned", NULL );
+				info->ll.lat = g_key_file_get_double ( kf, group, "lat", NULL );
+				info->ll.lon = g_key_file_get_double ( kf, group, "lon", NULL );
+				info->altitude = geotag_cache_get_double ( kf, group, "altitude" );
+				info->direction = geotag_cache_get_double ( kf, group, "direction" );
+				info->direction_ref = g_key_file_get_integer ( kf, group, "direction_ref", NULL );
+				info->title = geotag_cache_get_string ( kf, group, "title" );
+				info->comment = geotag_cache_get_string ( kf, group, "comment" );
+				g_hash_table_replace ( geotag_cache, g_strdup(group), info );
+			}
+			g_free ( stamp );
+		}
+		g_strfreev ( groups );
+	}
+	g_free ( fn );
+	g_key_file_free ( kf );
+}
 
-	struct LatLon ll;
+/**
+ * Whether the values can be stored in the key file
+ */
+static gboolean geotag_cache_storable ( const gchar *filename, const geotag_info_t *info )
+{
+	// Group names can't have these
+	if ( strpbrk ( filename, "[]\r\n" ) || !g_utf8_validate ( filename, -1, NULL ) )
+		return FALSE;
+	if ( info->datetime && !g_utf8_validate ( info->datetime, -1, NULL ) )
+		return FALSE;
+	if ( info->title && !g_utf8_validate ( info->title, -1, NULL ) )
+		return FALSE;
+	if ( info->comment && !g_utf8_validate ( info->comment, -1, NULL ) )
+		return FALSE;
+	return TRUE;
+}
 
-	gchar str[128];
-	ExifEntry *ee;
+/**
+ * Get the EXIF information of the file, from the cache if the file is unchanged
+ *
+ * Can be called from any thread; the files are read outside of the lock
+ *  so several can be read at once.
+ *
+ * Returns: An allocated copy, to be freed by geotag_info_free()
+ */
+static geotag_info_t *geotag_info_get ( const gchar *filename )
+{
+	GStatBuf st;
+	if ( g_stat ( filename, &st ) != 0 )
+		// Let the read fail in the usual way
+		return geotag_info_read ( filename );
+
+	g_mutex_lock ( &geotag_cache_mutex );
+	if ( !geotag_cache )
+		geotag_cache_load ();
+	geotag_info_t *known = g_hash_table_lookup ( geotag_cache, filename );
+	if ( known && known->size == (gint64)st.st_size && known->mtime == (gint64)st.st_mtime ) {
+		known->used = TRUE;
+		geotag_info_t *copy = geotag_info_copy ( known );
+		g_mutex_unlock ( &geotag_cache_mutex );
+		return copy;
+	}
+	g_mutex_unlock ( &geotag_cache_mutex );
 
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_VERSION_ID);
-	// Confirm this has a GPS Id - normally "2.0.0.0" or "2.2.0.0"
-	if ( ! ( ee && ee->components == 4 ) )
-		goto MyReturn;
-	// Could test for these versions explicitly but may have byte order issues...
-	//if ( ! ( ee->data[0] == 2 && ee->data[2] == 0 && ee->data[3] == 0 ) )
-	//	goto MyReturn;
+	geotag_info_t *info = geotag_info_read ( filename );
+	info->size = (gint64)st.st_size;
+	info->mtime = (gint64)st.st_mtime;
+	info->used = TRUE;
 
-	ll = get_latlon ( ed );
+	g_mutex_lock ( &geotag_cache_mutex );
+	g_hash_table_replace ( geotag_cache, g_strdup(filename), geotag_info_copy(info) );
+	geotag_cache_dirty = TRUE;
+	g_mutex_unlock ( &geotag_cache_mutex );
 
-	// Hopefully won't have valid images at 0,0!
-	if ( ll.lat == 0.0 && ll.lon == 0.0 )
-		goto MyReturn;
+	return info;
+}
 
-	//
-	// Not worried if none of the other fields exist, as can default the values to something
-	//
+/**
+ * The file is being rewritten, so forget what was read from it
+ *  (even if the modification time is going to be kept the same)
+ */
+static void geotag_cache_forget ( const gchar *filename )
+{
+	g_mutex_lock ( &geotag_cache_mutex );
+	if ( geotag_cache && g_hash_table_remove ( geotag_cache, filename ) )
+		geotag_cache_dirty = TRUE;
+	g_mutex_unlock ( &geotag_cache_mutex );
+}
 
-	gdouble alt = NAN;
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE);
-	if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_RATIONAL ) {
-		alt = Rational2Double ( ee->data,
-								0,
-								exif_data_get_byte_order(ed) );
+static void geotag_cache_save ( void )
+{
+	GKeyFile *kf = g_key_file_new ();
+
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init ( &iter, geotag_cache );
+	while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+		const gchar *filename = key;
+		geotag_info_t *info = value;
+		// Drop those of files since removed
+		if ( !info->used && !g_file_test ( filename, G_FILE_TEST_EXISTS ) )
+			continue;
+		if ( !geotag_cache_storable ( filename, info ) )
+			continue;
+		gchar *stamp = g_strdup_printf ( "%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, info->size, info->mtime );
+		g_key_file_set_string ( kf, filename, "stamp", stamp );
+		g_free ( stamp );
+		if ( info->datetime )
+			g_key_file_set_string ( kf, filename, "date", info->datetime );
+		g_key_file_set_boolean ( kf, filename, "gps", info->has_gps );
+		g_key_file_set_boolean ( kf, filename, "positioned", info->positioned );
+		g_key_file_set_double ( kf, filename, "lat", info->ll.lat );
+		g_key_file_set_double ( kf, filename, "lon", info->ll.lon );
+		if ( !isnan(info->altitude) )
+			g_key_file_set_double ( kf, filename, "altitude", info->altitude );
+		if ( !isnan(info->direction) )
+			g_key_file_set_double ( kf, filename, "direction", info->direction );
+		g_key_file_set_integer ( kf, filename, "direction_ref", info->direction_ref );
+		if ( info->title )
+			g_key_file_set_string ( kf, filename, "title", info->title );
+		if ( info->comment )
+			g_key_file_set_string ( kf, filename, "comment", info->comment );
+	}
 
-		ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE_REF);
-		if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_BYTE && ee->data[0] == 1 )
-			alt = -alt;
+	GError *error = NULL;
+	gsize size;
+	gchar *data = g_key_file_to_data ( kf, &size, NULL );
+	gchar *fn = geotag_cache_filename ();
+	if ( !g_file_set_contents ( fn, data, size, &error ) ) {
+		g_warning ( "%s: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
 	}
+	g_free ( fn );
+	g_free ( data );
+	g_key_file_free ( kf );
+}
 
-	// Name
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_0], EXIF_TAG_XP_TITLE);
-	if ( ee ) {
-		exif_entry_get_value ( ee, str, 128 );
-		*name = g_strdup ( str );
+/**
+ * a_geotag_uninit:
+ *
+ * Store the EXIF information read during this run, for the next one
+ */
+void a_geotag_uninit ( void )
+{
+	g_mutex_lock ( &geotag_cache_mutex );
+	if ( geotag_cache ) {
+		if ( geotag_cache_dirty )
+			geotag_cache_save ();
+		g_hash_table_destroy ( geotag_cache );
+		geotag_cache = NULL;
 	}
+	geotag_cache_dirty = FALSE;
+	g_mutex_unlock ( &geotag_cache_mutex );
+}
 
-	//
-	// Now create Waypoint with acquired information
-	//
-	wp = vik_waypoint_new();
-	// Set info from exif values
-	// Location
-	vik_coord_load_from_latlon ( &(wp->coord), vcmode, &ll );
-	// Altitude
-	wp->altitude = alt;
+/**
+ * a_geotag_get_position:
+ *
+ * @filename: The (JPG) file with EXIF information in it
+ *
+ * Returns: The position in LatLon format.
+ *  It will be 0,0 if some kind of failure occurs.
+ */
+struct LatLon a_geotag_get_position ( const gchar *filename )
+{
+	geotag_info_t *info = geotag_info_get ( filename );
+	struct LatLon ll = info->ll;
+	geotag_info_free ( info );
+	return ll;
+}
 
-	wp->comment = geotag_get_exif_comment ( ed );
+/**
+ * a_geotag_create_waypoint_from_file:
+ * @filename: The image file to process
+ * @vcmode:   The current location mode to use in the positioning of Waypoint
+ * @name:     Returns a name for the Waypoint (can be NULL)
+ *
+ * Returns: An allocated Waypoint or NULL if Waypoint could not be generated (e.g. no EXIF info)
+ *
+ */
+VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoordMode vcmode, gchar **name )
+{
+	// Default return values (for failures)
+	*name = NULL;
+	VikWaypoint *wp = NULL;
 
-	vik_waypoint_set_image ( wp, filename );
+	geotag_info_t *info = geotag_info_get ( filename );
+	if ( info->positioned ) {
+		//
+		// Now create Waypoint with acquired information
+		//
+		wp = vik_waypoint_new();
+		// Set info from exif values
+		// Location
+		vik_coord_load_from_latlon ( &(wp->coord), vcmode, &info->ll );
+		// Altitude
+		wp->altitude = info->altitude;
 
-MyReturn:
-	// Finished with EXIF
-	exif_data_free ( ed );
-#endif
-#endif
+		*name = g_strdup ( info->title );
+		wp->comment = g_strdup ( info->comment );
+
+		// Direction
+		if ( !isnan(info->direction) )
+			vik_waypoint_set_image_direction_info ( wp, info->direction, info->direction_ref );
+
+		vik_waypoint_set_image ( wp, filename );
+	}
+	geotag_info_free ( info );
 
 	return wp;
 }
@@ -426,36 +653,11 @@ VikWaypoint* a_geotag_waypoint_positioned ( const gchar *filename, VikCoord coor
 	wp->coord = coord;
 	wp->altitude = alt;
 
-#ifdef HAVE_LIBGEXIV2
-	GExiv2Metadata *gemd = gexiv2_metadata_new ();
-	if ( gexiv2_metadata_open_path ( gemd, filename, NULL ) ) {
-			wp->comment = geotag_get_exif_comment ( gemd );
-			if ( gexiv2_metadata_has_tag ( gemd, "Exif.Image.XPTitle" ) )
-				*name = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.XPTitle" ) );
-	}
-	metadata_free ( gemd );
-#else
-#ifdef HAVE_LIBEXIF
-	ExifData *ed = exif_data_new_from_file ( filename );
-
-	// Set info from exif values
-	if ( ed ) {
-		wp->comment = geotag_get_exif_comment ( ed );
-
-		gchar str[128];
-		ExifEntry *ee;
-		// Name
-		ee = exif_content_get_entry (ed->ifd[EXIF_IFD_0], EXIF_TAG_XP_TITLE);
-		if ( ee ) {
-			exif_entry_get_value ( ee, str, 128 );
-			*name = g_strdup ( str );
-		}
-
-		// Finished with EXIF
-		exif_data_free ( ed );
-	}
-#endif
-#endif
+	geotag_info_t *info = geotag_info_get ( filename );
+	if ( info->comment )
+		wp->comment = g_strdup ( info->comment );
+	*name = g_strdup ( info->title );
+	geotag_info_free ( info );
 
 	vik_waypoint_set_image ( wp, filename );
 
@@ -474,59 +676,11 @@ VikWaypoint* a_geotag_waypoint_positioned ( const gchar *filename, VikCoord coor
  */
 gchar* a_geotag_get_exif_date_from_file ( const gchar *filename, gboolean *has_GPS_info )
 {
-	gchar* datetime = NULL;
-	*has_GPS_info = FALSE;
-
-#ifdef HAVE_LIBGEXIV2
-	GExiv2Metadata *gemd = gexiv2_metadata_new ();
-	if ( gexiv2_metadata_open_path ( gemd, filename, NULL ) ) {
-		gdouble lat, lon;
-		*has_GPS_info = ( gexiv2_metadata_get_gps_longitude(gemd,&lon) && gexiv2_metadata_get_gps_latitude(gemd,&lat) );
-
-		// Prefer 'Photo' version over 'Image'
-		if ( gexiv2_metadata_has_tag ( gemd, "Exif.Photo.DateTimeOriginal" ) )
-			datetime = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Photo.DateTimeOriginal" ) );
-		else
-			datetime = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.DateTimeOriginal" ) );
-	}
-	metadata_free ( gemd );
-#else
-#ifdef HAVE_LIBEXIF
-	ExifData *ed = exif_data_new_from_file ( filename );
-
-	// Detect EXIF load failure
-	if ( !ed )
-		return datetime;
-
-	gchar str[128];
-	ExifEntry *ee;
-
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_EXIF], EXIF_TAG_DATE_TIME_ORIGINAL);
-	if ( ee ) {
-		exif_entry_get_value ( ee, str, 128 );
-		datetime = g_strdup ( str );
-	}
-
-	// Check GPS Info
-
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_VERSION_ID);
-	// Confirm this has a GPS Id - normally "2.0.0.0" or "2.2.0.0"
-	if ( ee && ee->components == 4 )
-		*has_GPS_info = TRUE;
-
-	// Check other basic GPS fields exist too
-	// I have encountered some images which have just the EXIF_TAG_GPS_VERSION_ID but nothing else
-	// So to confirm check more EXIF GPS TAGS:
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LATITUDE);
-	if ( !ee )
-		*has_GPS_info = FALSE;
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LONGITUDE);
-	if ( !ee )
-		*has_GPS_info = FALSE;
-
-	exif_data_free ( ed );
-#endif
-#endif
+	geotag_info_t *info = geotag_info_get ( filename );
+	gchar* datetime = info->datetime;
+	*has_GPS_info = info->has_gps;
+	info->datetime = NULL;
+	geotag_info_free ( info );
 	return datetime;
 }
 
@@ -904,5 +1058,7 @@ gint a_geotag_write_exif_gps ( const gchar *filename, VikCoord coord, gdouble al
 			g_warning ( "%s couldn't set time on: %s", __FUNCTION__, filename );
 	}
 
+	geotag_cache_forget ( filename );
+
 	return result;
 }
@@ -46,6 +46,8 @@ gint a_geotag_write_exif_gps ( const gchar *filename, VikCoord coord, gdouble al
                                gdouble direction, VikWaypointImageDirectionRef direction_ref,
                                gboolean no_change_mtime );
 
+void a_geotag_uninit ( void );
+
 G_END_DECLS
 
 #endif // _VIKING_GEOTAG_EXIF_H
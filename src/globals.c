@@ -159,6 +159,8 @@ static VikLayerParamData rlr_lbl_pos_default ( void ) { return VIK_LPD_UINT(VIK_
 
 static VikLayerParamScale params_disp_time[] = { { 0, 5000, 100, 0} };
 static VikLayerParamData disp_time_default ( void ) { return VIK_LPD_INT(1500); }
+static VikLayerParamScale params_redraw_rate[] = { { 0, 120, 5, 0} };
+static VikLayerParamData redraw_rate_default ( void ) { return VIK_LPD_INT(30); }
 
 static VikLayerParam prefs_advanced[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_file_reference_mode", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Save File Reference Mode:"), VIK_LAYER_WIDGET_COMBOBOX, params_vik_fileref, NULL,
@@ -181,8 +183,12 @@ static VikLayerParam prefs_advanced[] = {
     N_("Select trackpoint from mouse over graph on main display"), vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "warn_unsaved_changes_on_exit", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Warn Unsaved Changes on Exit:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "select_newly_created_layer", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Select Newly Created Layer:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Automatically select the newly created layer"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "parallel_layer_drawing", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Draw Layers in Parallel:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Layers that support it are drawn in other threads at the same time as the rest, then all are put together in order"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "viewport_popup_display_time", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Time(in ms) Popup is Shown on Viewport:"), VIK_LAYER_WIDGET_SPINBUTTON, params_disp_time, NULL,
     N_("Use a value of 0 to disable showing a popup"), disp_time_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "max_redraw_rate", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Maximum Map Redraws per Second:"), VIK_LAYER_WIDGET_SPINBUTTON, params_redraw_rate, NULL,
+    N_("Layer updates arriving faster than this are combined into a single redraw. Use a value of 0 for no limit"), redraw_rate_default, NULL, NULL },
 };
 
 static gchar * params_startup_methods[] = {N_("Home Location"), N_("Last Location"), N_("Specified File"), N_("Auto Location"), NULL};
@@ -429,6 +435,11 @@ guint a_vik_get_viewport_popup_time ( )
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "viewport_popup_display_time")->u;
 }
 
+guint a_vik_get_max_redraw_rate ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "max_redraw_rate")->u;
+}
+
 gint a_vik_get_recent_number_files ( )
 {
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "number_recent_files")->i;
@@ -469,6 +480,11 @@ gboolean a_vik_get_auto_trackpoint_select ( )
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "auto_trackpoint_select")->b;
 }
 
+gboolean a_vik_get_parallel_layer_drawing ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "parallel_layer_drawing")->b;
+}
+
 // Startup Options
 gboolean a_vik_get_restore_window_state ( )
 {
@@ -269,6 +269,8 @@ gboolean a_vik_get_select_newly_created_layer ( );
 
 guint a_vik_get_viewport_popup_time ( );
 
+guint a_vik_get_max_redraw_rate ( );
+
 gboolean a_vik_get_open_files_in_selected_layer ( );
 
 gboolean a_vik_get_calendar_show_day_names ( );
@@ -290,6 +292,8 @@ gboolean a_vik_get_select_double_click_to_zoom ( );
 
 gboolean a_vik_get_auto_trackpoint_select ( );
 
+gboolean a_vik_get_parallel_layer_drawing ( );
+
 gboolean a_vik_get_restore_window_state ( );
 
 gboolean a_vik_get_add_default_map_layer ( );
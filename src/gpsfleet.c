@@ -0,0 +1,387 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Follow many GPS position streams at once - e.g. one per vehicle of a fleet.
+ *
+ * A single thread connects to all the sources and waits on them together with poll(),
+ *  decoding the NMEA sentences as they arrive. Only the latest fix of each source is kept,
+ *  for the GUI to take all together at whatever rate it wants to update at.
+ *
+ * Sources are host:port of a gpsd (which is asked to pass on NMEA),
+ *  or nmea://host:port for anything else that sends NMEA sentences over TCP.
+ *
+ * ATM only for Unix-like systems, as on Windows g_poll() can not wait on sockets.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "globals.h"
+#include "gpsfleet.h"
+#include "nmea.h"
+
+#define GPS_FLEET_DEFAULT_PORT 2947
+// Also the longest it takes to stop
+#define GPS_FLEET_POLL_TIMEOUT 500
+// Longer lines are not NMEA sentences, so the remainder is ignored
+#define GPS_FLEET_LINE_MAX 256
+#define GPS_FLEET_GPSD_WATCH "?WATCH={\"enable\":true,\"nmea\":true}\n"
+
+typedef enum {
+  SOURCE_IDLE = 0,
+  SOURCE_CONNECTING,
+  SOURCE_CONNECTED,
+} SourceState;
+
+typedef struct {
+  gchar *name;        // As given
+  gchar *address;
+  gboolean nmea;      // Otherwise gpsd
+  // Only used by the fleet thread
+  SourceState state;
+  GSocket *socket;
+  gint64 retry_time;
+  GString *line;
+  gdouble altitude;   // From the latest GGA sentence
+  guint nsats;
+  gboolean has_3d;
+  // Protected by the fleet mutex
+  VikGpsFleetFix fix;
+  gboolean fresh;
+} Source;
+
+struct _VikGpsFleet {
+  GPtrArray *sources;
+  gint64 retry_interval; // Microseconds
+  GThread *thread;
+  gint stop;
+  GMutex mutex;
+};
+
+static void source_free ( Source *src )
+{
+  if ( src->socket ) {
+    (void)g_socket_close ( src->socket, NULL );
+    g_object_unref ( src->socket );
+  }
+  g_string_free ( src->line, TRUE );
+  g_free ( src->address );
+  g_free ( src->name );
+  g_free ( src );
+}
+
+static void source_close ( VikGpsFleet *fleet, Source *src )
+{
+  if ( src->socket ) {
+    (void)g_socket_close ( src->socket, NULL );
+    g_object_unref ( src->socket );
+    src->socket = NULL;
+  }
+  src->state = SOURCE_IDLE;
+  src->retry_time = g_get_monotonic_time () + fleet->retry_interval;
+  g_string_truncate ( src->line, 0 );
+}
+
+static void source_connected ( VikGpsFleet *fleet, Source *src )
+{
+  src->state = SOURCE_CONNECTED;
+  g_debug ( "%s: %s", __FUNCTION__, src->name );
+  if ( !src->nmea ) {
+    GError *error = NULL;
+    if ( g_socket_send ( src->socket, GPS_FLEET_GPSD_WATCH, strlen(GPS_FLEET_GPSD_WATCH), NULL, &error ) < 0 ) {
+      g_debug ( "%s: %s: %s", __FUNCTION__, src->name, error->message );
+      g_error_free ( error );
+      source_close ( fleet, src );
+    }
+  }
+}
+
+/**
+ * Start connecting without waiting for it to complete
+ *  (although any name lookup does wait)
+ */
+static void source_connect ( VikGpsFleet *fleet, Source *src )
+{
+  GError *error = NULL;
+  GSocketConnectable *connectable = g_network_address_parse ( src->address, GPS_FLEET_DEFAULT_PORT, &error );
+  if ( !connectable ) {
+    g_warning ( "%s: %s: %s", __FUNCTION__, src->name, error->message );
+    g_error_free ( error );
+    source_close ( fleet, src );
+    return;
+  }
+
+  GSocketAddressEnumerator *enumerator = g_socket_connectable_enumerate ( connectable );
+  GSocketAddress *address = g_socket_address_enumerator_next ( enumerator, NULL, &error );
+  if ( address ) {
+    src->socket = g_socket_new ( g_socket_address_get_family(address), G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error );
+    if ( src->socket ) {
+      g_socket_set_blocking ( src->socket, FALSE );
+      if ( g_socket_connect ( src->socket, address, NULL, &error ) )
+        source_connected ( fleet, src );
+      else if ( g_error_matches ( error, G_IO_ERROR, G_IO_ERROR_PENDING ) ) {
+        g_clear_error ( &error );
+        src->state = SOURCE_CONNECTING;
+      }
+    }
+    g_object_unref ( address );
+  }
+  if ( error ) {
+    g_debug ( "%s: %s: %s", __FUNCTION__, src->name, error->message );
+    g_error_free ( error );
+  }
+  if ( src->state == SOURCE_IDLE )
+    source_close ( fleet, src );
+
+  g_object_unref ( enumerator );
+  g_object_unref ( connectable );
+}
+
+static void source_parse ( VikGpsFleet *fleet, Source *src, const gchar *line )
+{
+  // gpsd's own JSON reports are ignored, the NMEA it passes on is enough
+  if ( line[0] != '$' || !a_nmea_checksum_ok(line) )
+    return;
+
+  gchar *sentence = g_strndup ( line, strcspn(line, "*") );
+  gchar **fields = g_strsplit ( sentence, ",", -1 );
+  guint nfields = g_strv_length ( fields );
+  // Skip the '$' and the talker
+  const gchar *type = strlen(fields[0]) == 6 ? fields[0]+3 : "";
+
+  if ( g_strcmp0 ( type, "GGA" ) == 0 && nfields >= 10 ) {
+    // $--GGA,time,lat,N,lon,E,quality,satellites,hdop,altitude,M,...
+    src->nsats = (guint)atoi ( fields[7] );
+    src->has_3d = atoi(fields[6]) > 0 && fields[9][0];
+    src->altitude = src->has_3d ? g_ascii_strtod ( fields[9], NULL ) : NAN;
+  }
+  else if ( g_strcmp0 ( type, "RMC" ) == 0 && nfields >= 10 && fields[2][0] == 'A' ) {
+    // $--RMC,time,status,lat,N,lon,E,knots,course,date,...
+    VikGpsFleetFix fix;
+    fix.ll.lat = a_nmea_degrees ( fields[3], fields[4] );
+    fix.ll.lon = a_nmea_degrees ( fields[5], fields[6] );
+    if ( !isnan(fix.ll.lat) && !isnan(fix.ll.lon) ) {
+      fix.timestamp = a_nmea_timestamp ( fields[1], fields[9] );
+      fix.speed = fields[7][0] ? VIK_KNOTS_TO_MPS(g_ascii_strtod(fields[7], NULL)) : NAN;
+      fix.course = fields[8][0] ? g_ascii_strtod ( fields[8], NULL ) : NAN;
+      fix.altitude = src->altitude;
+      fix.nsats = src->nsats;
+      fix.fix_mode = src->has_3d ? VIK_GPS_MODE_3D : VIK_GPS_MODE_2D;
+      g_mutex_lock ( &fleet->mutex );
+      src->fix = fix;
+      src->fresh = TRUE;
+      g_mutex_unlock ( &fleet->mutex );
+    }
+  }
+
+  g_strfreev ( fields );
+  g_free ( sentence );
+}
+
+static void source_read ( VikGpsFleet *fleet, Source *src )
+{
+  gchar buf[4096];
+  GError *error = NULL;
+  gssize len = g_socket_receive ( src->socket, buf, sizeof(buf), NULL, &error );
+  if ( len <= 0 ) {
+    if ( error ) {
+      gboolean again = g_error_matches ( error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK );
+      if ( !again )
+        g_debug ( "%s: %s: %s", __FUNCTION__, src->name, error->message );
+      g_error_free ( error );
+      if ( again )
+        return;
+    }
+    source_close ( fleet, src );
+    return;
+  }
+
+  for ( gssize ii = 0; ii < len; ii++ ) {
+    if ( buf[ii] == '\n' || buf[ii] == '\r' ) {
+      if ( src->line->len )
+        source_parse ( fleet, src, src->line->str );
+      g_string_truncate ( src->line, 0 );
+    }
+    else if ( src->line->len < GPS_FLEET_LINE_MAX )
+      g_string_append_c ( src->line, buf[ii] );
+  }
+}
+
+static gpointer fleet_thread ( gpointer data )
+{
+  VikGpsFleet *fleet = data;
+  GPollFD *fds = g_new0 ( GPollFD, fleet->sources->len );
+  Source **polled = g_new0 ( Source*, fleet->sources->len );
+
+  while ( !g_atomic_int_get ( &fleet->stop ) ) {
+    gint64 now = g_get_monotonic_time ();
+    guint nfds = 0;
+    for ( guint ii = 0; ii < fleet->sources->len; ii++ ) {
+      Source *src = g_ptr_array_index ( fleet->sources, ii );
+      if ( src->state == SOURCE_IDLE && now >= src->retry_time )
+        source_connect ( fleet, src );
+      if ( src->state == SOURCE_IDLE )
+        continue;
+      fds[nfds].fd = g_socket_get_fd ( src->socket );
+      fds[nfds].events = (src->state == SOURCE_CONNECTING) ? G_IO_OUT : G_IO_IN;
+      fds[nfds].revents = 0;
+      polled[nfds++] = src;
+    }
+
+    if ( nfds == 0 ) {
+      g_usleep ( GPS_FLEET_POLL_TIMEOUT * 1000 );
+      continue;
+    }
+    if ( g_poll ( fds, nfds, GPS_FLEET_POLL_TIMEOUT ) <= 0 )
+      continue;
+
+    for ( guint ii = 0; ii < nfds; ii++ ) {
+      if ( !fds[ii].revents )
+        continue;
+      Source *src = polled[ii];
+      if ( src->state == SOURCE_CONNECTING ) {
+        GError *error = NULL;
+        if ( g_socket_check_connect_result ( src->socket, &error ) )
+          source_connected ( fleet, src );
+        else {
+          g_debug ( "%s: %s: %s", __FUNCTION__, src->name, error->message );
+          g_error_free ( error );
+          source_close ( fleet, src );
+        }
+      }
+      else
+        source_read ( fleet, src );
+    }
+  }
+
+  g_free ( polled );
+  g_free ( fds );
+  return NULL;
+}
+
+/**
+ * vik_gps_fleet_new:
+ * @sources:        Space or comma separated list of sources
+ * @retry_interval: Seconds to wait before reconnecting to a source
+ *
+ * Start following the sources.
+ *
+ * Returns: NULL if there are no sources
+ */
+VikGpsFleet *vik_gps_fleet_new ( const gchar *sources, guint retry_interval )
+{
+  VikGpsFleet *fleet = g_new0 ( VikGpsFleet, 1 );
+  fleet->sources = g_ptr_array_new_with_free_func ( (GDestroyNotify)source_free );
+  fleet->retry_interval = (gint64)MAX(retry_interval, 1) * G_USEC_PER_SEC;
+  g_mutex_init ( &fleet->mutex );
+
+  gchar **names = g_strsplit_set ( sources ? sources : "", " ,;", -1 );
+  for ( guint ii = 0; names[ii]; ii++ ) {
+    if ( !names[ii][0] )
+      continue;
+    Source *src = g_new0 ( Source, 1 );
+    src->name = g_strdup ( names[ii] );
+    if ( g_str_has_prefix ( names[ii], "nmea://" ) ) {
+      src->nmea = TRUE;
+      src->address = g_strdup ( names[ii] + strlen("nmea://") );
+    }
+    else if ( g_str_has_prefix ( names[ii], "gpsd://" ) )
+      src->address = g_strdup ( names[ii] + strlen("gpsd://") );
+    else
+      src->address = g_strdup ( names[ii] );
+    src->line = g_string_new ( NULL );
+    src->altitude = NAN;
+    g_ptr_array_add ( fleet->sources, src );
+  }
+  g_strfreev ( names );
+
+  if ( fleet->sources->len ) {
+    GError *error = NULL;
+    fleet->thread = g_thread_try_new ( "gpsfleet", fleet_thread, fleet, &error );
+    if ( !fleet->thread ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+  }
+  if ( !fleet->thread ) {
+    vik_gps_fleet_free ( fleet );
+    return NULL;
+  }
+  return fleet;
+}
+
+/**
+ * vik_gps_fleet_free:
+ *
+ * Stop following the sources.
+ */
+void vik_gps_fleet_free ( VikGpsFleet *fleet )
+{
+  if ( !fleet )
+    return;
+  if ( fleet->thread ) {
+    g_atomic_int_set ( &fleet->stop, 1 );
+    g_thread_join ( fleet->thread );
+  }
+  g_ptr_array_free ( fleet->sources, TRUE );
+  g_mutex_clear ( &fleet->mutex );
+  g_free ( fleet );
+}
+
+/**
+ * vik_gps_fleet_take_fixes:
+ * @func: Called with each source that has had a fix since the last time
+ *
+ * Returns: The number of fixes
+ */
+guint vik_gps_fleet_take_fixes ( VikGpsFleet *fleet, VikGpsFleetFunc func, gpointer user_data )
+{
+  guint len = fleet->sources->len;
+  VikGpsFleetFix *fixes = g_new ( VikGpsFleetFix, len );
+  gboolean *fresh = g_new ( gboolean, len );
+
+  // Don't hold up the thread whilst the fixes are used
+  g_mutex_lock ( &fleet->mutex );
+  for ( guint ii = 0; ii < len; ii++ ) {
+    Source *src = g_ptr_array_index ( fleet->sources, ii );
+    fresh[ii] = src->fresh;
+    if ( src->fresh )
+      fixes[ii] = src->fix;
+    src->fresh = FALSE;
+  }
+  g_mutex_unlock ( &fleet->mutex );
+
+  guint count = 0;
+  for ( guint ii = 0; ii < len; ii++ ) {
+    if ( fresh[ii] ) {
+      Source *src = g_ptr_array_index ( fleet->sources, ii );
+      func ( src->name, &fixes[ii], user_data );
+      count++;
+    }
+  }
+
+  g_free ( fresh );
+  g_free ( fixes );
+  return count;
+}
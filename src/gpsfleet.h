@@ -0,0 +1,49 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_GPSFLEET_H
+#define __VIKING_GPSFLEET_H
+
+#include <glib.h>
+#include "coords.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VikGpsFleet VikGpsFleet;
+
+typedef struct {
+  gdouble timestamp;  // NAN if unknown
+  struct LatLon ll;
+  gdouble altitude;   // NAN if unknown
+  gdouble speed;      // m/s
+  gdouble course;     // NAN if unknown
+  guint nsats;
+  guint fix_mode;     // VIK_GPS_MODE_2D or VIK_GPS_MODE_3D
+} VikGpsFleetFix;
+
+typedef void (*VikGpsFleetFunc) ( const gchar *source, const VikGpsFleetFix *fix, gpointer user_data );
+
+VikGpsFleet *vik_gps_fleet_new ( const gchar *sources, guint retry_interval );
+void vik_gps_fleet_free ( VikGpsFleet *fleet );
+
+guint vik_gps_fleet_take_fixes ( VikGpsFleet *fleet, VikGpsFleetFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -21,16 +21,11 @@
  */
 
 #include "viking.h"
+#include "background.h"
+#include "misc/fpconv.h"
 #include <ctype.h>
 /* strtod */
 
-typedef struct {
-  FILE *f;
-  gboolean is_route;
-} TP_write_info_type;
-
-static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info );
-
 /* outline for file gpspoint.c
 
 reading file:
@@ -98,35 +93,13 @@ static guint line_hr = 0;
 static gint line_cad = VIK_TRKPT_CADENCE_NONE;
 static gdouble line_temp = NAN;
 static gint line_power = VIK_TRKPT_POWER_NONE;
+static gchar *line_summary;
 /* other possible properties go here */
 
 
 static void gpspoint_process_tag ( const gchar *tag, guint len );
 static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, const gchar *value, guint value_len );
 
-static gchar *slashdup(const gchar *str)
-{
-  size_t len = strlen(str);
-  size_t need_bs_count, i, j;
-  gchar *rv;
-  for ( i = 0, need_bs_count = 0; i < len; i++ )
-    if ( str[i] == '\\' || str[i] == '"' )
-      need_bs_count++;
-  rv = g_malloc ( (len+need_bs_count+1) * sizeof(gchar) );
-  for ( i = 0, j = 0; i < len; i++, j++ )
-  {
-    if ( str[i] == '\\' || str[i] == '"' )
-      rv[j++] = '\\';
-    rv[j] = str[i];
-    // Basic normalization of strings - replace Linefeed and Carriage returns as blanks.
-    //  although allowed in GPX Spec - Viking file format can't handle multi-line strings yet...
-    if ( str[i] == '\n' || str[i] == '\r' )
-      rv[j] = ' ';
-  }
-  rv[j] = '\0';
-  return rv;
-}
-
 static gchar *deslashndup ( const gchar *str, guint16 len )
 {
   guint16 i,j, bs_count, new_len;
@@ -162,11 +135,83 @@ static gchar *deslashndup ( const gchar *str, guint16 len )
 }
 
 
+// The number of values in a track's summary (see VikTrackSummary)
+#define SUMMARY_VALUES 20
+
+static void summary_to_values ( const VikTrackSummary *sum, gdouble *values )
+{
+  values[0] = sum->tp_count;
+  values[1] = sum->first_timestamp;
+  values[2] = sum->last_timestamp;
+  values[3] = sum->length;
+  values[4] = sum->length_including_gaps;
+  values[5] = sum->timed_length;
+  values[6] = sum->duration;
+  values[7] = sum->max_speed;
+  values[8] = sum->max_speed_by_gps;
+  values[9] = sum->elev_up;
+  values[10] = sum->elev_down;
+  values[11] = sum->min_alt;
+  values[12] = sum->max_alt;
+  values[13] = sum->max_heart_rate;
+  values[14] = sum->heart_rate_sum;
+  values[15] = sum->heart_rate_count;
+  values[16] = sum->bbox.north;
+  values[17] = sum->bbox.south;
+  values[18] = sum->bbox.east;
+  values[19] = sum->bbox.west;
+}
+
+static void values_to_summary ( const gdouble *values, VikTrackSummary *sum )
+{
+  sum->tp_count = (guint)values[0];
+  sum->first_timestamp = values[1];
+  sum->last_timestamp = values[2];
+  sum->length = values[3];
+  sum->length_including_gaps = values[4];
+  sum->timed_length = values[5];
+  sum->duration = values[6];
+  sum->max_speed = values[7];
+  sum->max_speed_by_gps = values[8];
+  sum->elev_up = values[9];
+  sum->elev_down = values[10];
+  sum->min_alt = values[11];
+  sum->max_alt = values[12];
+  sum->max_heart_rate = (guint)values[13];
+  sum->heart_rate_sum = values[14];
+  sum->heart_rate_count = (gulong)values[15];
+  sum->bbox.north = values[16];
+  sum->bbox.south = values[17];
+  sum->bbox.east = values[18];
+  sum->bbox.west = values[19];
+}
+
+/**
+ * Use the summary from the end of the track, if it is of the expected form
+ *  (otherwise the values are simply worked out from the trackpoints as usual)
+ */
+static void track_apply_summary ( VikTrack *trk, const gchar *summary )
+{
+  gchar **parts = g_strsplit ( summary, ",", -1 );
+  if ( g_strv_length ( parts ) == SUMMARY_VALUES ) {
+    gdouble values[SUMMARY_VALUES];
+    for ( guint ii = 0; ii < SUMMARY_VALUES; ii++ )
+      values[ii] = g_ascii_strtod ( parts[ii], NULL );
+    VikTrackSummary sum;
+    values_to_summary ( values, &sum );
+    if ( !vik_track_set_summary ( trk, &sum ) )
+      g_debug ( "%s: Summary does not match the trackpoints of %s", __FUNCTION__, trk->name );
+  }
+  g_strfreev ( parts );
+}
+
 static void trackpoints_end ()
 {
   if ( current_track )
     if ( current_track->trackpoints ) {
       current_track->trackpoints = g_list_reverse ( current_track->trackpoints );
+      if ( line_summary )
+        track_apply_summary ( current_track, line_summary );
       current_track = NULL;
     }
 }
@@ -185,6 +230,7 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
   line_newsegment = FALSE;
   line_image = NULL;
   line_symbol = NULL;
+  line_summary = NULL;
   current_track = NULL;
   gboolean have_read_something = FALSE;
 
@@ -252,15 +298,17 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
       wp->timestamp = line_timestamp;
       wp->speed = line_speed;
       wp->course = line_course;
-      wp->magvar = line_magvar;
-      wp->geoidheight = line_geoidheight;
-      wp->nsats = line_sat;
-      wp->fix_mode = line_fix;
-      wp->hdop = line_hdop;
-      wp->vdop = line_vdop;
-      wp->pdop = line_pdop;
-      wp->ageofdgpsdata = line_ageofdgpsdata;
-      wp->dgpsid = line_dgpsid;
+      VikWaypointExtra *extra = vik_waypoint_edit_extra ( wp );
+      extra->magvar = line_magvar;
+      extra->geoidheight = line_geoidheight;
+      extra->nsats = line_sat;
+      extra->fix_mode = line_fix;
+      extra->hdop = line_hdop;
+      extra->vdop = line_vdop;
+      extra->pdop = line_pdop;
+      extra->ageofdgpsdata = line_ageofdgpsdata;
+      extra->dgpsid = line_dgpsid;
+      vik_waypoint_trim_extra ( wp );
       wp->proximity = line_proximity;
 
       vik_coord_load_from_latlon ( &(wp->coord), coord_mode, &line_latlon );
@@ -399,6 +447,8 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
       g_free ( line_url );
     if (line_url_name)
       g_free ( line_url_name );
+    g_free ( line_summary );
+    line_summary = NULL;
     line_comment = NULL;
     line_description = NULL;
     line_source = NULL;
@@ -659,6 +709,11 @@ static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, co
   {
     line_power = (guint)atoi(value);
   }
+  else if (key_len == 7 && strncasecmp( key, "summary", key_len ) == 0 && value != NULL)
+  {
+    if (line_summary == NULL)
+      line_summary = g_strndup ( value, value_len );
+  }
   else if (key_len == 6 && strncasecmp( key, "magvar", key_len ) == 0 && value != NULL)
   {
     line_magvar = g_ascii_strtod(value, NULL);
@@ -693,40 +748,116 @@ static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, co
   }
 }
 
+// Output is gathered up and written to the file in large blocks
+#define GPSPOINT_WRITE_BUFFER (1024*1024)
+// Tracks are formatted in parallel in batches of about this many points
+#define GPSPOINT_WRITE_BATCH_POINTS 100000
+
+#define VIK_SETTINGS_GPSPOINT_WRITE_THREADS "gpspoint_write_threads"
+
 typedef struct {
+  GString *buf;
   FILE *file;
   const gchar *dirpath;
 } WritingContext;
 
-static void write_double ( FILE *ff, const gchar *tag, gdouble value )
+static void flush_buffer ( GString *gs, FILE *f, gboolean force )
+{
+  if ( gs->len && ( force || gs->len >= GPSPOINT_WRITE_BUFFER ) ) {
+    if ( fwrite ( gs->str, 1, gs->len, f ) != gs->len )
+      g_warning ( "%s: failed to write", __FUNCTION__ );
+    g_string_truncate ( gs, 0 );
+  }
+}
+
+/**
+ * As slashdup() but directly into the output
+ */
+static void append_slashed ( GString *gs, const gchar *str )
+{
+  for ( const gchar *ptr = str; *ptr; ptr++ ) {
+    if ( *ptr == '\\' || *ptr == '"' )
+      g_string_append_c ( gs, '\\' );
+    // Basic normalization of strings - replace Linefeed and Carriage returns as blanks.
+    //  although allowed in GPX Spec - Viking file format can't handle multi-line strings yet...
+    if ( *ptr == '\n' || *ptr == '\r' )
+      g_string_append_c ( gs, ' ' );
+    else
+      g_string_append_c ( gs, *ptr );
+  }
+}
+
+/**
+ * Same output as a_coords_dtostr_buffer()
+ */
+static void append_double ( GString *gs, gdouble value )
+{
+  gchar buf[24];
+  gint len = fpconv_dtoa ( value, buf, 1 );
+  g_string_append_len ( gs, buf, MIN(len, COORDS_STR_BUFFER_SIZE-1) );
+}
+
+/**
+ * Same output as "%d"
+ */
+static void append_int ( GString *gs, gint value )
+{
+  gchar buf[12];
+  gint pos = sizeof(buf);
+  guint uvalue = value < 0 ? -(guint)value : (guint)value;
+  do {
+    buf[--pos] = '0' + uvalue % 10;
+    uvalue /= 10;
+  } while ( uvalue );
+  if ( value < 0 )
+    buf[--pos] = '-';
+  g_string_append_len ( gs, buf + pos, sizeof(buf) - pos );
+}
+
+static void append_tag ( GString *gs, const gchar *tag )
+{
+  g_string_append_c ( gs, ' ' );
+  g_string_append ( gs, tag );
+  g_string_append ( gs, "=\"" );
+}
+
+static void write_double ( GString *gs, const gchar *tag, gdouble value )
 {
   if ( !isnan(value) ) {
-    gchar buf[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( value, buf );
-    fprintf ( ff, " %s=\"%s\"", tag, buf );
+    append_tag ( gs, tag );
+    append_double ( gs, value );
+    g_string_append_c ( gs, '"' );
   }
 }
 
-static void write_positive_uint ( FILE *ff, const gchar *tag, guint value )
+static void write_positive_uint ( GString *gs, const gchar *tag, guint value )
 {
-  if ( value )
-    fprintf ( ff, " %s=\"%d\"", tag, value );
+  if ( value ) {
+    append_tag ( gs, tag );
+    append_int ( gs, (gint)value );
+    g_string_append_c ( gs, '"' );
+  }
+}
+
+static void write_int ( GString *gs, const gchar *tag, gint value )
+{
+  append_tag ( gs, tag );
+  append_int ( gs, value );
+  g_string_append_c ( gs, '"' );
 }
 
-static void write_string ( FILE *ff, const gchar *tag, const gchar *value )
+static void write_string ( GString *gs, const gchar *tag, const gchar *value )
 {
   if ( value && strlen(value) ) {
-    gchar *tmp = slashdup(value);
-    fprintf ( ff, " %s=\"%s\"", tag, tmp );
-    g_free ( tmp );
+    append_tag ( gs, tag );
+    append_slashed ( gs, value );
+    g_string_append_c ( gs, '"' );
   }
 }
 
 static void a_gpspoint_write_waypoint ( const VikWaypoint *wp, WritingContext *wc )
 {
   struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
   // Sanity clauses
   if ( !wp )
     return;
@@ -735,37 +866,40 @@ static void a_gpspoint_write_waypoint ( const VikWaypoint *wp, WritingContext *w
   if ( !wc )
     return;
 
-  FILE *f = wc->file;
+  GString *gs = wc->buf;
 
   vik_coord_to_latlon ( &(wp->coord), &ll );
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  gchar *tmp_name = slashdup(wp->name);
-  fprintf ( f, "type=\"waypoint\" latitude=\"%s\" longitude=\"%s\" name=\"%s\"", s_lat, s_lon, tmp_name );
-  g_free ( tmp_name );
-
-  write_double ( f, "altitude", wp->altitude );
-  write_double ( f, "unixtime", wp->timestamp );
-  write_double ( f, "speed", wp->speed );
-  write_double ( f, "course", wp->course );
-  write_double ( f, "magvar", wp->magvar );
-  write_double ( f, "geoidheight", wp->geoidheight );
-  write_string ( f, "comment", wp->comment );
-  write_string ( f, "description", wp->description );
-  write_string ( f, "source", wp->source );
-  write_string ( f, "url", wp->url );
-  write_string ( f, "url_name", wp->url_name );
-  write_string ( f, "xtype", wp->type );
-
-  write_positive_uint ( f, "fix", wp->fix_mode );
-  write_positive_uint ( f, "sat", wp->nsats );
-  write_double ( f, "hdop", wp->hdop );
-  write_double ( f, "vdop", wp->vdop );
-  write_double ( f, "pdop", wp->pdop );
-  write_double ( f, "ageofdgpsdata", wp->ageofdgpsdata );
-  write_positive_uint ( f, "dgpsid", wp->dgpsid );
-
-  write_double ( f, "proximity", wp->proximity );
+  g_string_append ( gs, "type=\"waypoint\" latitude=\"" );
+  append_double ( gs, ll.lat );
+  g_string_append ( gs, "\" longitude=\"" );
+  append_double ( gs, ll.lon );
+  g_string_append ( gs, "\" name=\"" );
+  append_slashed ( gs, wp->name );
+  g_string_append_c ( gs, '"' );
+
+  write_double ( gs, "altitude", wp->altitude );
+  write_double ( gs, "unixtime", wp->timestamp );
+  write_double ( gs, "speed", wp->speed );
+  write_double ( gs, "course", wp->course );
+  const VikWaypointExtra *extra = vik_waypoint_get_extra ( wp );
+  write_double ( gs, "magvar", extra->magvar );
+  write_double ( gs, "geoidheight", extra->geoidheight );
+  write_string ( gs, "comment", wp->comment );
+  write_string ( gs, "description", wp->description );
+  write_string ( gs, "source", wp->source );
+  write_string ( gs, "url", wp->url );
+  write_string ( gs, "url_name", wp->url_name );
+  write_string ( gs, "xtype", wp->type );
+
+  write_positive_uint ( gs, "fix", extra->fix_mode );
+  write_positive_uint ( gs, "sat", extra->nsats );
+  write_double ( gs, "hdop", extra->hdop );
+  write_double ( gs, "vdop", extra->vdop );
+  write_double ( gs, "pdop", extra->pdop );
+  write_double ( gs, "ageofdgpsdata", extra->ageofdgpsdata );
+  write_positive_uint ( gs, "dgpsid", extra->dgpsid );
+
+  write_double ( gs, "proximity", wp->proximity );
 
   if ( wp->image )
   {
@@ -775,22 +909,25 @@ static void a_gpspoint_write_waypoint ( const VikWaypoint *wp, WritingContext *w
         tmp_image = g_strdup ( file_GetRelativeFilename ( (gchar*)wc->dirpath, wp->image ) );
     }
 
-    // if tmp_image not available - use image filename as is
-    // this should be an absolute path as set in thumbnails
-    if ( !tmp_image )
-      tmp_image = slashdup(wp->image);
-
+    append_tag ( gs, "image" );
     if ( tmp_image )
-      fprintf ( f, " image=\"%s\"", tmp_image );
+      g_string_append ( gs, tmp_image );
+    else
+      // if tmp_image not available - use image filename as is
+      // this should be an absolute path as set in thumbnails
+      append_slashed ( gs, wp->image );
+    g_string_append_c ( gs, '"' );
 
     g_free ( tmp_image );
   }
   if ( !isnan(wp->image_direction) )
   {
     gchar *tmp = util_formatd ( "%.2f", wp->image_direction );
-    fprintf ( f, " image_direction=\"%s\"", tmp );
+    append_tag ( gs, "image_direction" );
+    g_string_append ( gs, tmp );
+    g_string_append_c ( gs, '"' );
     g_free ( tmp );
-    fprintf ( f, " image_direction_ref=\"%d\"", wp->image_direction_ref );
+    write_int ( gs, "image_direction_ref", wp->image_direction_ref );
   }
   if ( wp->symbol )
   {
@@ -798,60 +935,85 @@ static void a_gpspoint_write_waypoint ( const VikWaypoint *wp, WritingContext *w
     // However to keep newly generated .vik files better compatible with older Viking versions
     //   The symbol names will always be lowercase
     gchar *tmp_symbol = g_utf8_strdown(wp->symbol, -1);
-    fprintf ( f, " symbol=\"%s\"", tmp_symbol );
+    append_tag ( gs, "symbol" );
+    g_string_append ( gs, tmp_symbol );
+    g_string_append_c ( gs, '"' );
     g_free ( tmp_symbol );
   }
   if ( ! wp->visible )
-    fprintf ( f, " visible=\"n\"" );
+    g_string_append ( gs, " visible=\"n\"" );
   if ( wp->hide_name )
-    fprintf ( f, " hide_name=\"yes\"" );
-  fprintf ( f, "\n" );
+    g_string_append ( gs, " hide_name=\"yes\"" );
+  g_string_append_c ( gs, '\n' );
 }
 
-static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info )
+static void a_gpspoint_write_trackpoint ( const VikTrackpoint *tp, GString *gs, gboolean is_route )
 {
   struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
-  FILE *f = write_info->f;
-
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "type=\"%spoint\" latitude=\"%s\" longitude=\"%s\"", write_info->is_route ? "route" : "track", s_lat, s_lon );
+  g_string_append ( gs, is_route ? "type=\"routepoint\" latitude=\"" : "type=\"trackpoint\" latitude=\"" );
+  append_double ( gs, ll.lat );
+  g_string_append ( gs, "\" longitude=\"" );
+  append_double ( gs, ll.lon );
+  g_string_append_c ( gs, '"' );
 
-  write_string ( f, "name", tp->name );
-  write_double ( f, "altitude", tp->altitude );
-  write_double ( f, "unixtime", tp->timestamp );
+  write_string ( gs, "name", tp->name );
+  write_double ( gs, "altitude", tp->altitude );
+  write_double ( gs, "unixtime", tp->timestamp );
 
   if ( tp->newsegment )
-    fprintf ( f, " newsegment=\"yes\"" );
+    g_string_append ( gs, " newsegment=\"yes\"" );
 
   if ( !isnan(tp->speed) || !isnan(tp->course) || tp->nsats > 0 ||
        !isnan(tp->temp) || tp->heart_rate || tp->cadence != VIK_TRKPT_CADENCE_NONE || tp->cadence != VIK_TRKPT_POWER_NONE ) {
-    fprintf ( f, " extended=\"yes\"" );
-    write_double ( f, "speed", tp->speed );
-    write_double ( f, "course", tp->course );
-    write_positive_uint ( f, "sat", tp->nsats );
-    write_positive_uint ( f, "fix", tp->fix_mode );
-    write_double ( f, "hdop", tp->hdop );
-    write_double ( f, "vdop", tp->vdop );
-    write_double ( f, "pdop", tp->pdop );
+    g_string_append ( gs, " extended=\"yes\"" );
+    write_double ( gs, "speed", tp->speed );
+    write_double ( gs, "course", tp->course );
+    write_positive_uint ( gs, "sat", tp->nsats );
+    write_positive_uint ( gs, "fix", tp->fix_mode );
+    write_double ( gs, "hdop", tp->hdop );
+    write_double ( gs, "vdop", tp->vdop );
+    write_double ( gs, "pdop", tp->pdop );
     // Note that in general these use shortened strings as there may be many thousands of points,
     //  thus helping keep the filesize down.
-    write_positive_uint ( f, "hr", tp->heart_rate );
+    write_positive_uint ( gs, "hr", tp->heart_rate );
     if ( tp->cadence != VIK_TRKPT_CADENCE_NONE )
-      fprintf ( f, " cad=\"%d\"", tp->cadence );
-    write_double ( f, "temp", tp->temp );
+      write_int ( gs, "cad", tp->cadence );
+    write_double ( gs, "temp", tp->temp );
     if ( tp->power != VIK_TRKPT_POWER_NONE )
-      fprintf ( f, " pow=\"%d\"", tp->power );
+      write_int ( gs, "pow", tp->power );
   }
-  fprintf ( f, "\n" );
+  g_string_append_c ( gs, '\n' );
 }
 
+/**
+ * The values worked out from the trackpoints, so they needn't be worked out again when read back in.
+ * Written at the end of the track as (like all tags) it is ignored by older versions.
+ * NB Obtaining the summary may fill in the track's statistics cache, but does not change the track
+ */
+static void write_summary ( GString *gs, const VikTrack *trk )
+{
+  VikTrackSummary sum;
+  if ( !vik_track_get_summary ( trk, &sum ) )
+    return;
+  gdouble values[SUMMARY_VALUES];
+  summary_to_values ( &sum, values );
+  append_tag ( gs, "summary" );
+  for ( guint ii = 0; ii < SUMMARY_VALUES; ii++ ) {
+    if ( ii )
+      g_string_append_c ( gs, ',' );
+    append_double ( gs, values[ii] );
+  }
+  g_string_append_c ( gs, '"' );
+}
 
-static void a_gpspoint_write_track ( const VikTrack *trk, FILE *f )
+/**
+ * @f: When set, the output is written out as it fills up
+ *
+ * NB Must not use anything that isn't thread safe, as this may be run on different tracks concurrently
+ */
+static void a_gpspoint_write_track ( const VikTrack *trk, GString *gs, FILE *f )
 {
   // Sanity clauses
   if ( !trk )
@@ -859,33 +1021,102 @@ static void a_gpspoint_write_track ( const VikTrack *trk, FILE *f )
   if ( !(trk->name) )
     return;
 
-  gchar *tmp_name = slashdup(trk->name);
-  fprintf ( f, "type=\"%s\" name=\"%s\"", trk->is_route ? "route" : "track", tmp_name );
-  g_free ( tmp_name );
+  g_string_append ( gs, trk->is_route ? "type=\"route\" name=\"" : "type=\"track\" name=\"" );
+  append_slashed ( gs, trk->name );
+  g_string_append_c ( gs, '"' );
 
-  write_string ( f, "comment", trk->comment );
-  write_string ( f, "description", trk->description );
-  write_string ( f, "source", trk->source );
-  write_string ( f, "url", trk->url );
-  write_string ( f, "url_name", trk->url_name );
-  write_positive_uint ( f, "number", trk->number );
-  write_string ( f, "xtype", trk->type );
+  write_string ( gs, "comment", trk->comment );
+  write_string ( gs, "description", trk->description );
+  write_string ( gs, "source", trk->source );
+  write_string ( gs, "url", trk->url );
+  write_string ( gs, "url_name", trk->url_name );
+  write_positive_uint ( gs, "number", trk->number );
+  write_string ( gs, "xtype", trk->type );
 
   if ( trk->has_color ) {
-    fprintf ( f, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
+    g_string_append_printf ( gs, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
   }
 
-  write_positive_uint ( f, "draw_name_mode", trk->draw_name_mode );
-  write_positive_uint ( f, "number_dist_labels", trk->max_number_dist_labels );
+  write_positive_uint ( gs, "draw_name_mode", trk->draw_name_mode );
+  write_positive_uint ( gs, "number_dist_labels", trk->max_number_dist_labels );
 
   if ( ! trk->visible ) {
-    fprintf ( f, " visible=\"n\"" );
+    g_string_append ( gs, " visible=\"n\"" );
+  }
+  g_string_append_c ( gs, '\n' );
+
+  for ( const GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    a_gpspoint_write_trackpoint ( VIK_TRACKPOINT(iter->data), gs, trk->is_route );
+    if ( f )
+      flush_buffer ( gs, f, FALSE );
+  }
+  g_string_append ( gs, trk->is_route ? "type=\"routeend\"" : "type=\"trackend\"" );
+  write_summary ( gs, trk );
+  g_string_append_c ( gs, '\n' );
+}
+
+typedef struct {
+  GPtrArray *tracks;
+  GString **out; // Formatted text of each track in the batch
+  guint first;   // Index of the first track in the batch
+} TrackBatch;
+
+static void write_track_item ( guint ii, TrackBatch *batch )
+{
+  GString *gs = g_string_new ( NULL );
+  a_gpspoint_write_track ( g_ptr_array_index(batch->tracks, batch->first + ii), gs, NULL );
+  batch->out[ii] = gs;
+}
+
+/**
+ * Format tracks on the background CPU workers, but still write them out in order
+ */
+static void write_tracks_parallel ( GPtrArray *tracks, WritingContext *wc )
+{
+  TrackBatch batch = { tracks, g_malloc0 ( tracks->len * sizeof(GString*) ), 0 };
+  while ( batch.first < tracks->len ) {
+    // Limit how much formatted text is held at once
+    guint count = 0;
+    gulong points = 0;
+    while ( batch.first + count < tracks->len && points < GPSPOINT_WRITE_BATCH_POINTS ) {
+      points += vik_track_get_tp_count ( g_ptr_array_index(tracks, batch.first + count) );
+      count++;
+    }
+
+    a_background_parallel ( (vik_thr_index_func)write_track_item, &batch, count );
+
+    for ( guint ii = 0; ii < count; ii++ ) {
+      flush_buffer ( wc->buf, wc->file, TRUE );
+      flush_buffer ( batch.out[ii], wc->file, TRUE );
+      g_string_free ( batch.out[ii], TRUE );
+      batch.out[ii] = NULL;
+    }
+    batch.first += count;
   }
-  fprintf ( f, "\n" );
+  g_free ( batch.out );
+}
 
-  TP_write_info_type tp_write_info = { f, trk->is_route };
-  g_list_foreach ( trk->trackpoints, (GFunc) a_gpspoint_write_trackpoint, &tp_write_info );
-  fprintf ( f, "type=\"%send\"\n", trk->is_route ? "route" : "track" );
+static void write_tracks ( GHashTable *tracks, WritingContext *wc )
+{
+  GList *gl = vu_sorted_list_from_hash_table ( tracks, VL_SO_NONE, VIKING_TRACK );
+
+  guint threads = a_background_get_cpu_workers () + 1;
+  gint gitmp = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_GPSPOINT_WRITE_THREADS, &gitmp ) && gitmp > 0 )
+    threads = gitmp;
+
+  if ( threads > 1 && g_hash_table_size ( tracks ) > 1 ) {
+    GPtrArray *array = g_ptr_array_sized_new ( g_hash_table_size ( tracks ) );
+    for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
+      g_ptr_array_add ( array, ((SortTRWHashT*)it->data)->data );
+    write_tracks_parallel ( array, wc );
+    g_ptr_array_free ( array, TRUE );
+  }
+  else {
+    for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
+      a_gpspoint_write_track ( (VikTrack*)((SortTRWHashT*)it->data)->data, wc->buf, wc->file );
+  }
+  g_list_free_full ( gl, g_free );
 }
 
 /**
@@ -900,22 +1131,20 @@ void a_gpspoint_write_file ( VikTrwLayer *trw, FILE *f, const gchar *dirpath )
   GHashTable *routes = vik_trw_layer_get_routes ( trw );
   GHashTable *waypoints = vik_trw_layer_get_waypoints ( trw );
   GList *gl = NULL;
-  WritingContext wc = { f, dirpath };
+  WritingContext wc = { g_string_sized_new ( GPSPOINT_WRITE_BUFFER ), f, dirpath };
 
-  fprintf ( f, "type=\"waypointlist\"\n" );
+  g_string_append ( wc.buf, "type=\"waypointlist\"\n" );
   gl = vu_sorted_list_from_hash_table ( waypoints, VL_SO_NONE, VIKING_WAYPOINT );
-  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
+  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) ) {
     a_gpspoint_write_waypoint ( (VikWaypoint*)((SortTRWHashT*)it->data)->data, &wc );
+    flush_buffer ( wc.buf, f, FALSE );
+  }
   g_list_free_full ( gl, g_free );
-  fprintf ( f, "type=\"waypointlistend\"\n" );
+  g_string_append ( wc.buf, "type=\"waypointlistend\"\n" );
 
-  gl = vu_sorted_list_from_hash_table ( tracks, VL_SO_NONE, VIKING_TRACK );
-  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
-    a_gpspoint_write_track ( (VikTrack*)((SortTRWHashT*)it->data)->data, f );
-  g_list_free_full ( gl, g_free );
+  write_tracks ( tracks, &wc );
+  write_tracks ( routes, &wc );
 
-  gl = vu_sorted_list_from_hash_table ( routes, VL_SO_NONE, VIKING_TRACK );
-  for ( GList *it = g_list_first(gl); it != NULL; it = g_list_next(it) )
-    a_gpspoint_write_track ( (VikTrack*)((SortTRWHashT*)it->data)->data, f );
-  g_list_free_full ( gl, g_free );
+  flush_buffer ( wc.buf, f, TRUE );
+  g_string_free ( wc.buf, TRUE );
 }
@@ -29,8 +29,11 @@
 #include "gpx.h"
 #include "viking.h"
 #include "file_magic.h"
+#include "background.h"
 #include <expat.h>
+#include "xmltagtree.h"
 #include "misc/gtkhtml-private.h"
+#include "misc/strtod.h"
 
 typedef enum {
         tt_unknown = 0,
@@ -120,9 +123,10 @@ typedef struct tag_mapping {
 
 typedef struct {
 	GpxWritingOptions *options;
-	FILE *file;
+	FILE *file; // NULL when only formatting into the buffer
 	const gchar *dirpath;
 	VikTrwLayer *vtl;
+	GString *buf;
 } GpxWritingContext;
 
 /*
@@ -241,25 +245,22 @@ static tag_mapping extension_tag_path_map[] = {
   { 0 }
 };
 
-// Note in this lookup we just compare the first n characters
-//  enabling to match with anything in that xml tree
-//  since the order of the lookup will find the generic match first
-static tag_type get_tag_extension ( const char *tt )
-{
-  tag_mapping *tm;
-  for ( tm = extension_tag_path_map; tm->tag_type != 0; tm++ )
-    if ( 0 == g_ascii_strncasecmp(tm->tag_name, tt, strlen(tm->tag_name)) )
-      return tm->tag_type;
-  return tt_unknown;
-}
-
-static tag_type get_tag(const char *t)
+/**
+ * The tags of both maps in one tree, made on first use
+ */
+static VikXmlTagTree *get_tag_tree ( void )
 {
-        tag_mapping *tm;
-        for (tm = tag_path_map; tm->tag_type != 0; tm++)
-                if (0 == strcmp(tm->tag_name, t))
-                        return tm->tag_type;
-        return tt_unknown;
+  static VikXmlTagTree *tree = NULL;
+  if ( g_once_init_enter ( &tree ) ) {
+    VikXmlTagTree *tt = vik_xml_tag_tree_new ();
+    tag_mapping *tm;
+    for ( tm = tag_path_map; tm->tag_type != 0; tm++ )
+      vik_xml_tag_tree_add ( tt, tm->tag_name, tm->tag_type );
+    for ( tm = extension_tag_path_map; tm->tag_type != 0; tm++ )
+      vik_xml_tag_tree_add ( tt, tm->tag_name, tm->tag_type );
+    g_once_init_leave ( &tree, tt );
+  }
+  return tree;
 }
 
 static const gchar* get_tag_name ( tag_type tt )
@@ -273,40 +274,57 @@ static const gchar* get_tag_name ( tag_type tt )
 
 /******************************************/
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-
-/* current ("c_") objects */
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTRWMetadata *c_md = NULL;
-static GString *c_cdata = NULL;
-static GString *c_ext = NULL;
-static GString *c_trkpt_ext = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-
-// Global colour for all tracks (ATM not for waypoints)
-static GdkColor c_color;
-static gboolean c_have_color = FALSE;
-
-/* temporary things so we don't have to create them lots of times */
-static const gchar *c_slat, *c_slon;
-static struct LatLon c_ll;
-
-/* specialty flags / etc */
-static gboolean f_tr_newseg;
-static const gchar *c_link = NULL;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
+/*
+ * Everything about the file being read,
+ *  kept per thread so that several files can be read at the same time
+ */
+typedef struct {
+  tag_type current_tag;
+  // Where the parse is within the tag tree
+  GArray *tag_stack;
+
+  /* current ("c_") objects */
+  VikTrackpoint *c_tp;
+  VikWaypoint *c_wp;
+  VikTrack *c_tr;
+  VikTRWMetadata *c_md;
+  GString *c_cdata;
+  GString *c_ext;
+  GString *c_trkpt_ext;
+
+  gchar *c_wp_name;
+  gchar *c_tr_name;
+
+  // Global colour for all tracks (ATM not for waypoints)
+  GdkColor c_color;
+  gboolean c_have_color;
+
+  /* temporary things so we don't have to create them lots of times */
+  const gchar *c_slat, *c_slon;
+  struct LatLon c_ll;
+
+  /* specialty flags / etc */
+  gboolean f_tr_newseg;
+  gboolean f_tp_valid;
+  const gchar *c_link;
+  guint unnamed_waypoints;
+  guint unnamed_tracks;
+  guint unnamed_routes;
+
+  // For trackpoint extension fragments
+  GString *gs_ext;
+  GMarkupParseContext *gcontext;
+} GpxReadState;
+
+static GPrivate gpx_read_state;
 
 typedef struct {
 	VikTrwLayer *vtl;
 	const gchar *dirpath;
 	gboolean append;
+	// When streaming, only trackpoints are read and each is handed over once complete
+	GpxTrackpointFunc tp_func;
+	gpointer tp_data;
 } UserDataT;
 
 static const char *get_attr ( const char **attr, const char *key )
@@ -324,6 +342,7 @@ static const char *get_attr ( const char **attr, const char *key )
  */
 static gboolean global_set_color ( gchar *color )
 {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
 	// If "#AARRGGBB" style
 	if ( strlen(color) == 9 && color[0] == '#' ) {
 		// Skip the alpha component
@@ -336,11 +355,11 @@ static gboolean global_set_color ( gchar *color )
 		gcol[5] = color[7];
 		gcol[6] = color[8];
 		gcol[7] = '\0';
-		return gdk_color_parse ( gcol, &c_color );
+		return gdk_color_parse ( gcol, &st->c_color );
 	}
 	// Otherwise try whole string
 	//  hopefully "#RRGGBB" or named colour
-	return gdk_color_parse ( color, &c_color );
+	return gdk_color_parse ( color, &st->c_color );
 }
 
 /**
@@ -377,9 +396,10 @@ static GString *get_header ( const char **attr )
 
 static gboolean set_c_ll ( const char **attr )
 {
-  if ( (c_slat = get_attr ( attr, "lat" )) && (c_slon = get_attr ( attr, "lon" )) ) {
-    c_ll.lat = g_ascii_strtod(c_slat, NULL);
-    c_ll.lon = g_ascii_strtod(c_slon, NULL);
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  if ( (st->c_slat = get_attr ( attr, "lat" )) && (st->c_slon = get_attr ( attr, "lon" )) ) {
+    st->c_ll.lat = strtod_i8n(st->c_slat, NULL);
+    st->c_ll.lon = strtod_i8n(st->c_slon, NULL);
     return TRUE;
   }
   return FALSE;
@@ -471,7 +491,6 @@ static tag_type_ext get_tag_ext_specific (const char *tt)
  return ext_unknown;
 }
 
-static GString *gs_ext;
 
 // Reprocess the extension text to extract tags we handle
 static void ext_start_element ( GMarkupParseContext *context,
@@ -481,7 +500,8 @@ static void ext_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  g_string_erase ( st->gs_ext, 0, -1 ); // Reset the tmp string buffer
 }
 
 // NB Text is not null terminated
@@ -491,8 +511,9 @@ static void ext_text ( GMarkupParseContext *context,
                        gpointer             user_data,
                        GError             **error )
 {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
   // Store tag contents
-  g_string_append_len ( gs_ext, text, text_len );
+  g_string_append_len ( st->gs_ext, text, text_len );
 }
 
 // Main trackpoint extension processing here
@@ -501,41 +522,42 @@ static void ext_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
   // If it is any of the extended tags we are interested in,
   //  then use the text stored in the string buffer to set the appropriate track or trackpoint value
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_tp_heart_rate:
-    if ( c_tp ) c_tp->heart_rate = atoi ( gs_ext->str ); // bpm
+    if ( st->c_tp ) st->c_tp->heart_rate = atoi ( st->gs_ext->str ); // bpm
     break;
   case ext_tp_cadence:
-    if ( c_tp ) c_tp->cadence = atoi ( gs_ext->str ); // RPM
+    if ( st->c_tp ) st->c_tp->cadence = atoi ( st->gs_ext->str ); // RPM
     break;
   case ext_tp_speed:
-    if ( c_tp ) c_tp->speed = g_ascii_strtod ( gs_ext->str, NULL ); // m/s
+    if ( st->c_tp ) st->c_tp->speed = strtod_i8n ( st->gs_ext->str, NULL ); // m/s
     break;
   case ext_tp_course:
-    if ( c_tp ) c_tp->course = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees
+    if ( st->c_tp ) st->c_tp->course = strtod_i8n ( st->gs_ext->str, NULL ); // Degrees
     break;
   case ext_tp_temp:
-    if ( c_tp ) c_tp->temp = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees Celsius
+    if ( st->c_tp ) st->c_tp->temp = strtod_i8n ( st->gs_ext->str, NULL ); // Degrees Celsius
     break;
   case ext_tp_power:
-    if ( c_tp ) c_tp->power = atoi ( gs_ext->str ); // Watts
+    if ( st->c_tp ) st->c_tp->power = atoi ( st->gs_ext->str ); // Watts
     break;
   case ext_trk_color:
-    if ( c_tr ) {
+    if ( st->c_tr ) {
       GdkColor gclr;
-      if ( gdk_color_parse ( gs_ext->str, &gclr ) ) {
-        c_tr->has_color = TRUE;
-        c_tr->color = gclr;
+      if ( gdk_color_parse ( st->gs_ext->str, &gclr ) ) {
+        st->c_tr->has_color = TRUE;
+        st->c_tr->color = gclr;
       }
     }
     break;
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( st->gs_ext, 0, -1 );
 }
 
 // Laps
@@ -546,7 +568,8 @@ static void lap_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  g_string_erase ( st->gs_ext, 0, -1 ); // Reset the tmp string buffer
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_gpx_lap:
@@ -572,13 +595,14 @@ static void lap_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
   // If it is any of the (lap) extended tags we are interested in
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_gpx_lap_index:
     {
       // What if negative?
-      //index = atoi ( gs_ext->str, NULL );
+      //index = atoi ( st->gs_ext->str, NULL );
       // Ignore index from file (have seen files with 0 - which just complicates matters)
       // - So use the structure index instead
     }
@@ -586,7 +610,7 @@ static void lap_end_element ( GMarkupParseContext *context,
   case ext_gpx_lap_length:
     // Add to current list
     if (user_data) {
-      gdouble distance = g_ascii_strtod ( gs_ext->str, NULL ); // metres
+      gdouble distance = g_ascii_strtod ( st->gs_ext->str, NULL ); // metres
       if ( !isnan(distance) ) {
         GQueue* gq = (GQueue*)user_data;
         GList* laps = g_queue_peek_tail_link(gq);
@@ -601,7 +625,7 @@ static void lap_end_element ( GMarkupParseContext *context,
     // Add to current list
     if (user_data) {
       GTimeVal gtv;
-      if ( g_time_val_from_iso8601(gs_ext->str, &gtv) ) {
+      if ( g_time_val_from_iso8601(st->gs_ext->str, &gtv) ) {
         GQueue* gq = (GQueue*)user_data;
         GList* laps = g_queue_peek_tail_link(gq);
         if (laps) {
@@ -617,7 +641,7 @@ static void lap_end_element ( GMarkupParseContext *context,
     // Add to current list
     if (user_data)
     {
-      gdouble duration = g_ascii_strtod ( gs_ext->str, NULL ); // seconds
+      gdouble duration = g_ascii_strtod ( st->gs_ext->str, NULL ); // seconds
       if ( !isnan(duration) ) {
         GQueue* gq = (GQueue*)user_data;
         GList* laps = g_queue_peek_tail_link(gq);
@@ -631,23 +655,22 @@ static void lap_end_element ( GMarkupParseContext *context,
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( st->gs_ext, 0, -1 );
 }
 
-static GMarkupParser gparser;
-static GMarkupParseContext *gcontext;
 
 static void track_or_trackpoint_extension_process ( gchar *str )
 {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
   if ( !str )
     return;
 
   // Parse xml fragment to extract extension tag values
   GError *error = NULL;
-  if ( !g_markup_parse_context_parse ( gcontext, str, strlen(str), &error ) )
+  if ( !g_markup_parse_context_parse ( st->gcontext, str, strlen(str), &error ) )
     g_warning ( "%s: parse error %s on:%s", __FUNCTION__, error ? error->message : "???", str );
 
-  if ( !g_markup_parse_context_end_parse ( gcontext, &error) )
+  if ( !g_markup_parse_context_end_parse ( st->gcontext, &error) )
     g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", str );
 }
 
@@ -668,25 +691,22 @@ static void extension_append_attributions ( GString *gs, const char *el, const c
 
 static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 {
-  static const gchar *tmp;
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  const gchar *tmp;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_append_c ( xpath, '/' );
-  g_string_append ( xpath, el );
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  st->current_tag = vik_xml_tag_tree_push ( get_tag_tree(), st->tag_stack, el );
 
-  switch ( current_tag ) {
+  switch ( st->current_tag ) {
 
      case tt_gpx:
        {
-         c_md = vik_trw_metadata_new();
+         st->c_md = vik_trw_metadata_new();
          // Store creator information if possible
          const gchar *crt = get_attr ( attr, "creator" );
          if ( crt ) {
            // If there is an actual description field it will overwrite this value
-           c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
+           st->c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
          }
 
          const gchar *version = get_attr ( attr, "version" );
@@ -697,6 +717,8 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
          gpx_version_t gvt = GPX_V1_1; // Default
          if ( g_strcmp0(version, "1.0") == 0 )
            gvt = GPX_V1_0;
+         if ( ud->tp_func )
+           break;
          if ( ud->append ) {
            if ( vik_trw_layer_get_gpx_version(vtl) == GPX_V1_0 )
              vik_trw_layer_set_gpx_version ( vtl, gvt );
@@ -711,48 +733,59 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
        break;
      case tt_wpt:
        if ( set_c_ll( attr ) ) {
-         c_wp = vik_waypoint_new ();
+         st->c_wp = vik_waypoint_new ();
          if ( get_attr ( attr, "hidden" ) )
-           c_wp->visible = FALSE;
+           st->c_wp->visible = FALSE;
 
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(st->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &st->c_ll );
        }
        break;
 
      case tt_trk:
      case tt_rte:
-       c_tr = vik_track_new ();
-       c_tr->is_route = (current_tag == tt_rte) ? TRUE : FALSE;
+       st->c_tr = vik_track_new ();
+       st->c_tr->is_route = (st->current_tag == tt_rte) ? TRUE : FALSE;
        if ( get_attr ( attr, "hidden" ) )
-         c_tr->visible = FALSE;
+         st->c_tr->visible = FALSE;
        // Apply default colouring if applicable,
        //  which will then get overridden by any specific colour later
-       if ( c_have_color ) {
-           c_tr->has_color = TRUE;
-           c_tr->color = c_color;
+       if ( st->c_have_color ) {
+           st->c_tr->has_color = TRUE;
+           st->c_tr->color = st->c_color;
        }
        break;
 
      case tt_trk_trkseg:
-       f_tr_newseg = TRUE;
+       st->f_tr_newseg = TRUE;
        break;
 
      case tt_trk_trkseg_trkpt:
-       if ( set_c_ll( attr ) ) {
-         c_tp = vik_trackpoint_new ();
-         vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
-         if ( f_tr_newseg ) {
-           c_tp->newsegment = TRUE;
-           f_tr_newseg = FALSE;
+       if ( ud->tp_func ) {
+         // Always have a trackpoint for the values to go into, even if it can't be used
+         st->c_tp = vik_trackpoint_new ();
+         st->f_tp_valid = set_c_ll ( attr );
+         if ( st->f_tp_valid )
+           vik_coord_load_from_latlon ( &(st->c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &st->c_ll );
+         if ( st->f_tr_newseg ) {
+           st->c_tp->newsegment = TRUE;
+           st->f_tr_newseg = FALSE;
+         }
+       }
+       else if ( set_c_ll( attr ) ) {
+         st->c_tp = vik_trackpoint_new ();
+         vik_coord_load_from_latlon ( &(st->c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &st->c_ll );
+         if ( st->f_tr_newseg ) {
+           st->c_tp->newsegment = TRUE;
+           st->f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+         st->c_tr->trackpoints = g_list_prepend ( st->c_tr->trackpoints, st->c_tp );
        }
        break;
 
      case tt_gpx_url:
      case tt_wpt_link:
      case tt_trk_link:
-       c_link = get_attr ( attr, "href" );
+       st->c_link = get_attr ( attr, "href" );
        break;
      case tt_gpx_url_name:
      case tt_gpx_name:
@@ -792,42 +825,42 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
      case tt_trk_url:
      case tt_trk_url_name:
      case tt_trk_name:
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer */
+       g_string_erase ( st->c_cdata, 0, -1 ); /* clear the cdata buffer */
        break;
 
      case tt_waypoint:
-       c_wp = vik_waypoint_new ();
+       st->c_wp = vik_waypoint_new ();
        break;
 
      case tt_waypoint_coord:
        if ( set_c_ll( attr ) )
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(st->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &st->c_ll );
        break;
 
      case tt_waypoint_name:
        if ( ( tmp = get_attr(attr, "id") ) ) {
-         if ( c_wp_name )
-           g_free ( c_wp_name );
-         c_wp_name = g_strdup ( tmp );
+         if ( st->c_wp_name )
+           g_free ( st->c_wp_name );
+         st->c_wp_name = g_strdup ( tmp );
        }
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer for description */
+       g_string_erase ( st->c_cdata, 0, -1 ); /* clear the cdata buffer for description */
        break;
 
      case tt_gpx_extensions:
      case tt_wpt_extensions:
      case tt_trk_extensions:
-       g_string_erase ( c_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( st->c_ext, 0, -1 ); // clear the buffer
        break;
      case tt_trk_trkseg_trkpt_extensions:
-       g_string_erase ( c_trkpt_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( st->c_trkpt_ext, 0, -1 ); // clear the buffer
        break;
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       extension_append_attributions ( c_ext, el, attr );
+       extension_append_attributions ( st->c_ext, el, attr );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       extension_append_attributions ( c_trkpt_ext, el, attr );
+       extension_append_attributions ( st->c_trkpt_ext, el, attr );
        break;
 
      default: break;
@@ -863,19 +896,110 @@ static void track_tidy_processing ( VikTrwLayer *vtl )
   }
 }
 
+static gint64 days_from_civil ( gint year, guint month, guint day )
+{
+  year -= month <= 2;
+  gint era = year / 400;
+  guint yoe = (guint)(year - era * 400);
+  guint doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  guint doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (gint64)era * 146097 + (gint64)doe - 719468;
+}
+
+/**
+ * Nearly every GPX time is like 2020-01-31T12:34:56Z (perhaps with fractional seconds or a UTC offset),
+ *  so decode these directly as this is done for every trackpoint.
+ *
+ * Returns: FALSE if not in this form (so g_time_val_from_iso8601() should be tried),
+ *  otherwise the same values as g_time_val_from_iso8601() would give
+ */
+static gboolean time_val_from_simple_iso8601 ( const gchar *str, GTimeVal *tv )
+{
+  static const guint digits[6] = { 4, 2, 2, 2, 2, 2 };
+  static const gchar separators[6] = { '-', '-', 'T', ':', ':', '\0' };
+  guint vals[6];
+  const gchar *pp = str;
+  while ( g_ascii_isspace(*pp) )
+    pp++;
+  for ( guint ii = 0; ii < 6; ii++ ) {
+    vals[ii] = 0;
+    for ( guint jj = 0; jj < digits[ii]; jj++, pp++ ) {
+      if ( !g_ascii_isdigit(*pp) )
+        return FALSE;
+      vals[ii] = vals[ii] * 10 + (*pp - '0');
+    }
+    if ( separators[ii] ) {
+      if ( *pp != separators[ii] )
+        return FALSE;
+      pp++;
+    }
+  }
+  if ( vals[0] < 1 || vals[1] < 1 || vals[1] > 12 || vals[2] < 1 ||
+       vals[2] > g_date_get_days_in_month ( vals[1], vals[0] ) ||
+       vals[3] > 23 || vals[4] > 59 || vals[5] > 59 )
+    return FALSE;
+
+  glong usec = 0;
+  if ( *pp == '.' || *pp == ',' ) {
+    // As GLib does, only to microsecond precision
+    glong mul = 100000;
+    pp++;
+    while ( g_ascii_isdigit(*pp) ) {
+      usec += (*pp - '0') * mul;
+      mul /= 10;
+      pp++;
+    }
+  }
+
+  gint offset = 0; // Minutes
+  if ( *pp == 'Z' )
+    pp++;
+  else if ( (*pp == '+' || *pp == '-') &&
+            g_ascii_isdigit(pp[1]) && g_ascii_isdigit(pp[2]) && pp[3] == ':' &&
+            g_ascii_isdigit(pp[4]) && g_ascii_isdigit(pp[5]) ) {
+    offset = ((pp[1]-'0') * 10 + (pp[2]-'0')) * 60 + (pp[4]-'0') * 10 + (pp[5]-'0');
+    if ( *pp == '-' )
+      offset = -offset;
+    pp += 6;
+  }
+  else
+    // Local time
+    return FALSE;
+  while ( g_ascii_isspace(*pp) )
+    pp++;
+  if ( *pp != '\0' )
+    return FALSE;
+
+  tv->tv_sec = days_from_civil ( vals[0], vals[1], vals[2] ) * 86400 +
+               vals[3] * 3600 + vals[4] * 60 + vals[5] - offset * 60;
+  tv->tv_usec = usec;
+  return TRUE;
+}
+
+static gboolean time_val_from_iso8601 ( const gchar *str, GTimeVal *tv )
+{
+  if ( time_val_from_simple_iso8601 ( str, tv ) )
+    return TRUE;
+  return g_time_val_from_iso8601 ( str, tv );
+}
+
 static void gpx_end(UserDataT *ud, const char *el)
 {
-  static GTimeVal tp_time;
-  static GTimeVal wp_time;
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  GTimeVal tp_time;
+  GTimeVal wp_time;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
-
-  switch ( current_tag ) {
+  switch ( st->current_tag ) {
 
      case tt_gpx:
-       vik_trw_layer_set_metadata ( vtl, c_md );
-       c_md = NULL;
+       if ( ud->tp_func ) {
+         vik_trw_metadata_free ( st->c_md );
+         st->c_md = NULL;
+         break;
+       }
+       vik_trw_layer_set_metadata ( vtl, st->c_md );
+       st->c_md = NULL;
 
        // Essentially the end for a TrackWaypoint layer,
        //  so any specific GPX post processing can occur here
@@ -884,386 +1008,407 @@ static void gpx_end(UserDataT *ud, const char *el)
        break;
 
      case tt_gpx_name:
-       vik_layer_rename ( VIK_LAYER(vtl), c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( !ud->tp_func )
+         vik_layer_rename ( VIK_LAYER(vtl), st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_author:
-       if ( c_md->author )
-         g_free ( c_md->author );
-       c_md->author = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->author )
+         g_free ( st->c_md->author );
+       st->c_md->author = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_desc:
-       if ( c_md->description )
-         g_free ( c_md->description );
-       c_md->description = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->description )
+         g_free ( st->c_md->description );
+       st->c_md->description = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_keywords:
-       if ( c_md->keywords )
-         g_free ( c_md->keywords );
-       c_md->keywords = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->keywords )
+         g_free ( st->c_md->keywords );
+       st->c_md->keywords = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_time:
-       if ( c_md->timestamp )
-         g_free ( c_md->timestamp );
-       c_md->timestamp = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->timestamp )
+         g_free ( st->c_md->timestamp );
+       st->c_md->timestamp = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_url:
-       if ( c_md->url )
-         g_free ( c_md->url );
-       if ( c_link ) {
-         c_md->url = g_strdup ( c_link );
-         c_link = NULL;
-       } else if ( c_cdata->len > 0 ) {
-         c_md->url = g_strdup ( c_cdata->str );
-         g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->url )
+         g_free ( st->c_md->url );
+       if ( st->c_link ) {
+         st->c_md->url = g_strdup ( st->c_link );
+         st->c_link = NULL;
+       } else if ( st->c_cdata->len > 0 ) {
+         st->c_md->url = g_strdup ( st->c_cdata->str );
+         g_string_erase ( st->c_cdata, 0, -1 );
        }
        break;
 
      case tt_gpx_url_name:
-       if ( c_md->url_name )
-         g_free ( c_md->url_name );
-       c_md->url_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_md->url_name )
+         g_free ( st->c_md->url_name );
+       st->c_md->url_name = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_color:
-       c_have_color = global_set_color ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_have_color = global_set_color ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint:
      case tt_wpt:
-       if ( ! c_wp_name )
-         c_wp_name = g_strdup_printf("VIKING_WP%04d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
-       g_free ( c_wp_name );
-       c_wp = NULL;
-       c_wp_name = NULL;
+       if ( ud->tp_func ) {
+         if ( st->c_wp )
+           vik_waypoint_free ( st->c_wp );
+       }
+       else {
+         if ( ! st->c_wp_name )
+           st->c_wp_name = g_strdup_printf("VIKING_WP%04d", st->unnamed_waypoints++);
+         vik_trw_layer_filein_add_waypoint ( vtl, st->c_wp_name, st->c_wp );
+       }
+       g_free ( st->c_wp_name );
+       st->c_wp = NULL;
+       st->c_wp_name = NULL;
        break;
 
      case tt_trk:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_TR%03d", unnamed_tracks++);
+       if ( ! st->c_tr_name )
+         st->c_tr_name = g_strdup_printf("VIKING_TR%03d", st->unnamed_tracks++);
        // Delibrate fall through
      case tt_rte:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_RT%03d", unnamed_routes++);
-       c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-       vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
-       g_free ( c_tr_name );
-       c_tr = NULL;
-       c_tr_name = NULL;
+       if ( ! st->c_tr_name )
+         st->c_tr_name = g_strdup_printf("VIKING_RT%03d", st->unnamed_routes++);
+       if ( ud->tp_func )
+         vik_track_free ( st->c_tr );
+       else {
+         st->c_tr->trackpoints = g_list_reverse ( st->c_tr->trackpoints );
+         vik_trw_layer_filein_add_track ( vtl, st->c_tr_name, st->c_tr );
+       }
+       g_free ( st->c_tr_name );
+       st->c_tr = NULL;
+       st->c_tr_name = NULL;
        break;
 
      case tt_wpt_name:
-       if ( c_wp_name )
-         g_free ( c_wp_name );
-       c_wp_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_wp_name )
+         g_free ( st->c_wp_name );
+       st->c_wp_name = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_name:
-       if ( c_tr_name )
-         g_free ( c_tr_name );
-       c_tr_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_tr_name )
+         g_free ( st->c_tr_name );
+       st->c_tr_name = g_strdup ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ele:
-       c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_wp->altitude = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_ele:
-       c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->altitude = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint_name: /* .loc name is really description. */
      case tt_wpt_desc:
-       vik_waypoint_set_description ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_description ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_cmt:
-       vik_waypoint_set_comment ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_comment ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_src:
-       vik_waypoint_set_source ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_source ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_type:
-       vik_waypoint_set_type ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_type ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url:
-       vik_waypoint_set_url ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url_name:
-       vik_waypoint_set_url_name ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url_name ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_link:
-       if ( c_link ) {
+       if ( st->c_link ) {
          // Correct <link href="uri"></link> format
          // NB although Viking itself may write <type> information,
          //  ATM we don't use it and rely on the value of the URI to determine if URL vs Image
-         if ( util_is_url(c_link) ) {
-           vik_waypoint_set_url ( c_wp, c_link );
+         if ( util_is_url(st->c_link) ) {
+           vik_waypoint_set_url ( st->c_wp, st->c_link );
          }
          else {
-           vu_waypoint_set_image_uri ( c_wp, c_link, ud->dirpath );
+           vu_waypoint_set_image_uri ( st->c_wp, st->c_link, ud->dirpath );
          }
        }
        else {
          // Fallback for incorrect GPX <link> format (probably from previous versions of Viking!)
          //  of the form <link>file</link>
-         gchar *fn = util_make_absolute_filename ( c_cdata->str, ud->dirpath );
-         vik_waypoint_set_image ( c_wp, fn ? fn : c_cdata->str );
+         gchar *fn = util_make_absolute_filename ( st->c_cdata->str, ud->dirpath );
+         vik_waypoint_set_image ( st->c_wp, fn ? fn : st->c_cdata->str );
          g_free ( fn );
        }
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_link = NULL;
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sym:
-       vik_waypoint_set_symbol ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_symbol ( st->c_wp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_course:
-       c_wp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_wp->course = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_speed:
-       c_wp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_wp->speed = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_magvar:
-       c_wp->magvar = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->magvar = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_geoidheight:
-       c_wp->geoidheight = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->geoidheight = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", st->c_cdata->str))
+         vik_waypoint_edit_extra(st->c_wp)->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", st->c_cdata->str))
+         vik_waypoint_edit_extra(st->c_wp)->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", st->c_cdata->str))
+         vik_waypoint_edit_extra(st->c_wp)->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", st->c_cdata->str))
+         vik_waypoint_edit_extra(st->c_wp)->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         vik_waypoint_edit_extra(st->c_wp)->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sat:
-       c_wp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->nsats = atoi ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_hdop:
-       c_wp->hdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->hdop = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_vdop:
-       c_wp->vdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->vdop = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_pdop:
-       c_wp->pdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->pdop = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ageofdgpsdata:
-       c_wp->ageofdgpsdata = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->ageofdgpsdata = g_ascii_strtod ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_dgpsid:
-       c_wp->dgpsid = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_edit_extra(st->c_wp)->dgpsid = atoi ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_desc:
-       vik_track_set_description ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_description ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_src:
-       vik_track_set_source ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_source ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_number:
-       c_tr->number = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tr->number = atoi ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_type:
-       vik_track_set_type ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_type ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url:
-       vik_track_set_url ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url_name:
-       vik_track_set_url_name ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url_name ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_link:
-       if ( c_link )
-         if ( util_is_url(c_link) )
-           vik_track_set_url ( c_tr, c_link );
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( st->c_link )
+         if ( util_is_url(st->c_link) )
+           vik_track_set_url ( st->c_tr, st->c_link );
+       st->c_link = NULL;
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_cmt:
-       vik_track_set_comment ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_comment ( st->c_tr, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
+       if ( time_val_from_iso8601(st->c_cdata->str, &wp_time) ) {
 	 gdouble d1 = wp_time.tv_sec;
 	 gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-         c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         st->c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_name:
-       vik_trackpoint_set_name ( c_tp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_trackpoint_set_name ( st->c_tp, st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
+       if ( time_val_from_iso8601(st->c_cdata->str, &tp_time) ) {
 	 gdouble d1 = tp_time.tv_sec;
 	 gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-         c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         st->c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_course:
-       c_tp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->course = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_speed:
-       c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->speed = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", st->c_cdata->str))
+         st->c_tp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", st->c_cdata->str))
+         st->c_tp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", st->c_cdata->str))
+         st->c_tp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", st->c_cdata->str))
+         st->c_tp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         st->c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_sat:
-       c_tp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->nsats = atoi ( st->c_cdata->str );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_hdop:
-       c_tp->hdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->hdop = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_vdop:
-       c_tp->vdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->vdop = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_pdop:
-       c_tp->pdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       st->c_tp->pdop = strtod_i8n ( st->c_cdata->str, NULL );
+       g_string_erase ( st->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       g_string_append_printf ( c_ext, "</%s>", el );
+       g_string_append_printf ( st->c_ext, "</%s>", el );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       g_string_append_printf ( c_trkpt_ext, "</%s>", el );
+       g_string_append_printf ( st->c_trkpt_ext, "</%s>", el );
        break;
 
      case tt_trk_extensions:
-       if ( current_tag == tt_trk_extensions )
-         track_or_trackpoint_extension_process ( c_ext->str );
-       vik_track_set_extensions ( c_tr, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       if ( st->current_tag == tt_trk_extensions )
+         track_or_trackpoint_extension_process ( st->c_ext->str );
+       vik_track_set_extensions ( st->c_tr, st->c_ext->str );
+       g_string_erase ( st->c_ext, 0, -1 );
+       break;
+
+     case tt_trk_trkseg_trkpt:
+       if ( ud->tp_func ) {
+         if ( st->f_tp_valid )
+           ud->tp_func ( st->c_tp, ud->tp_data );
+         else
+           vik_trackpoint_free ( st->c_tp );
+         st->c_tp = NULL;
+       }
        break;
 
      case tt_gpx_extensions:
-       vik_trw_layer_set_gpx_extensions ( vtl, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       if ( !ud->tp_func )
+         vik_trw_layer_set_gpx_extensions ( vtl, st->c_ext->str );
+       g_string_erase ( st->c_ext, 0, -1 );
        break;
 
      case tt_wpt_extensions:
-       vik_waypoint_set_extensions ( c_wp, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_waypoint_set_extensions ( st->c_wp, st->c_ext->str );
+       g_string_erase ( st->c_ext, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_extensions:
-       vik_trackpoint_set_extensions ( c_tp, c_trkpt_ext->str );
-       track_or_trackpoint_extension_process ( c_trkpt_ext->str );
-       g_string_erase ( c_trkpt_ext, 0, -1 );
+       vik_trackpoint_set_extensions ( st->c_tp, st->c_trkpt_ext->str );
+       track_or_trackpoint_extension_process ( st->c_trkpt_ext->str );
+       g_string_erase ( st->c_trkpt_ext, 0, -1 );
        break;
 
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  st->current_tag = vik_xml_tag_tree_pop ( get_tag_tree(), st->tag_stack );
 }
 
 static void gpx_cdata(void *dta, const XML_Char *s, int len)
 {
-  switch ( current_tag ) {
+  GpxReadState *st = g_private_get ( &gpx_read_state );
+  switch ( st->current_tag ) {
     case tt_gpx_name:
     case tt_gpx_author:
     case tt_gpx_desc:
@@ -1314,18 +1459,18 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_trk_trkseg_trkpt_vdop:
     case tt_trk_trkseg_trkpt_pdop:
     case tt_waypoint_name: /* .loc name is really description. */
-      g_string_append_len ( c_cdata, s, len );
+      g_string_append_len ( st->c_cdata, s, len );
       break;
 
     case tt_trk_trkseg_trkpt_an_extension:
     case tt_trk_trkseg_trkpt_extensions:
-      g_string_append_len ( c_trkpt_ext, s, len );
+      g_string_append_len ( st->c_trkpt_ext, s, len );
       break;
     case tt_trk_extensions:
     case tt_gpx_extensions:
     // No longer store the <extensions> tag itself for waypoints
     //case tt_wpt_extensions:
-      g_string_append_len ( c_ext, s, len );
+      g_string_append_len ( st->c_ext, s, len );
       break;
     case tt_trk_an_extension:
     case tt_wpt_an_extension:
@@ -1334,10 +1479,8 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
       //  thus need to restore any XML escape quoting
       gchar *txt = g_memdup ( s, len+1 );
       txt[len] = '\0';
-      gchar *tmp = a_gpx_entitize ( txt );
-      g_string_append ( c_ext, tmp );
+      a_gpx_entitize_append ( st->c_ext, txt );
       g_free ( txt );
-      g_free ( tmp );
     }
       break;
 
@@ -1345,23 +1488,19 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
   }
 }
 
+#define GPX_READ_BUFFER_SIZE 65536
+
 // make like a "stack" of tag names
 // like gpspoint's separated like /gpx/wpt/whatever
+// The data is taken from @read_func a block at a time (e.g. as it is decompressed)
 // @append: Whether the read is to append to the vtl (or otherwise a new layer)
 //  i.e. primarily to decide what to do regarding appending files with different GPX versions
 // Returns:
 //  The #GpxReadStatus_t of how successful the read attempt is
 //
-GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
+static XML_Parser gpx_parser_new ( GpxReadState *st, UserDataT *ud )
+{
   XML_Parser parser = XML_ParserCreate(NULL);
-  int done=0, len;
-  enum XML_Status status = XML_STATUS_ERROR;
-
-  UserDataT *ud = g_malloc (sizeof(UserDataT));
-  ud->vtl     = vtl;
-  ud->dirpath = dirpath;
-  ud->append  = append;
-
   XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
   XML_SetUserData(parser, ud);
   XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_cdata);
@@ -1370,54 +1509,87 @@ GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath
   //  seems to work better on xml fragments compared to expat,
   //  and also we can reuse a single parser,
   //  rather than having to create an expat parser each time on each <extension> tag group
+  GMarkupParser gparser;
   gparser.start_element = &ext_start_element;
   gparser.end_element = &ext_end_element;
   gparser.text = &ext_text;
   gparser.passthrough = NULL;
   gparser.error = NULL;
-  gcontext = g_markup_parse_context_new ( &gparser, 0, NULL, NULL );
+  st->gcontext = g_markup_parse_context_new ( &gparser, 0, NULL, NULL );
+
+  st->tag_stack = vik_xml_tag_tree_stack_new ();
+  st->c_cdata = g_string_new ( "" );
+  st->c_ext = g_string_new ( NULL );
+  st->c_trkpt_ext = g_string_new ( NULL );
+  st->gs_ext = g_string_new ( NULL );
+
+  st->unnamed_waypoints = 1;
+  st->unnamed_tracks = 1;
+  st->unnamed_routes = 1;
+  return parser;
+}
 
-  gchar buf[4096];
+static void gpx_parser_free ( GpxReadState *st, XML_Parser parser )
+{
+  XML_ParserFree (parser);
+  g_array_free ( st->tag_stack, TRUE );
+  g_string_free ( st->c_cdata, TRUE );
+  g_string_free ( st->c_ext, TRUE );
+  g_string_free ( st->c_trkpt_ext, TRUE );
+  g_string_free ( st->gs_ext, TRUE );
+  g_markup_parse_context_free ( st->gcontext );
+}
 
-  g_assert ( f != NULL && vtl != NULL );
+GpxReadStatus_t a_gpx_read_stream ( VikTrwLayer *vtl, UtilReadFunc read_func, gpointer user_data, const gchar* dirpath, gboolean append ) {
+  g_assert ( read_func != NULL && vtl != NULL );
 
-  xpath = g_string_new ( "" );
-  c_cdata = g_string_new ( "" );
-  c_ext = g_string_new ( NULL );
-  c_trkpt_ext = g_string_new ( NULL );
-  gs_ext = g_string_new ( NULL );
+  GpxReadState *st = g_malloc0 ( sizeof(GpxReadState) );
+  g_private_set ( &gpx_read_state, st );
+  int done=0, len;
+  enum XML_Status status = XML_STATUS_ERROR;
 
-  unnamed_waypoints = 1;
-  unnamed_tracks = 1;
-  unnamed_routes = 1;
+  UserDataT *ud = g_malloc0 (sizeof(UserDataT));
+  ud->vtl     = vtl;
+  ud->dirpath = dirpath;
+  ud->append  = append;
+  XML_Parser parser = gpx_parser_new ( st, ud );
 
+  // Read straight into the parser's own buffer, a block at a time
   while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
-    done = feof(f) || !len;
-    status = XML_Parse(parser, buf, len, done);
+    void *buf = XML_GetBuffer(parser, GPX_READ_BUFFER_SIZE);
+    if ( !buf ) {
+      status = XML_STATUS_ERROR;
+      break;
+    }
+    gssize got = read_func ( user_data, buf, GPX_READ_BUFFER_SIZE );
+    len = got > 0 ? got : 0;
+    done = !len;
+    status = XML_ParseBuffer(parser, len, done);
+    if ( status == XML_STATUS_ERROR )
+      break;
   }
 
   GpxReadStatus_t result;
   gboolean ans = (status != XML_STATUS_ERROR);
   if ( !ans ) {
-    g_warning ( "%s: XML error %s at line %ld with tag %s", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser), get_tag_name(current_tag)  );
+    g_warning ( "%s: XML error %s at line %ld with tag %s", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser), get_tag_name(st->current_tag)  );
     gboolean have_closed_tag = FALSE;
     // Possibly should try to close the latest tag - e.g. for various trackpoint elements
     //  but generally missing out only the last partial trackpoint isn't too bad
     //  vs at least having some kind of track at all
-    if ( current_tag >= tt_trk && current_tag <= tt_trk_trkseg_trkpt_an_extension ) {
+    if ( st->current_tag >= tt_trk && st->current_tag <= tt_trk_trkseg_trkpt_an_extension ) {
       g_debug ( "%s: Force closure of track", __FUNCTION__ );
-      current_tag = tt_trk;
+      st->current_tag = tt_trk;
       gpx_end ( ud, "" );
       have_closed_tag = TRUE;
-    } else if ( current_tag >= tt_wpt && current_tag <= tt_wpt_an_extension ) {
+    } else if ( st->current_tag >= tt_wpt && st->current_tag <= tt_wpt_an_extension ) {
       g_debug ( "%s: Force closure of waypoint", __FUNCTION__ );
-      current_tag = tt_wpt;
+      st->current_tag = tt_wpt;
       gpx_end ( ud, "" );
       have_closed_tag = TRUE;
     }
     if ( have_closed_tag ) {
-      current_tag = tt_gpx;
+      st->current_tag = tt_gpx;
       gpx_end ( ud, "" );
       result = GPX_READ_WARNING;
     } else {
@@ -1452,35 +1624,103 @@ GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath
     }
   }
 
-  XML_ParserFree (parser);
+  gpx_parser_free ( st, parser );
   g_free ( ud );
-  g_string_free ( xpath, TRUE );
-  g_string_free ( c_cdata, TRUE );
-  g_string_free ( c_ext, TRUE );
-  g_string_free ( c_trkpt_ext, TRUE );
-  g_string_free ( gs_ext, TRUE );
-  g_markup_parse_context_free ( gcontext );
+  g_private_set ( &gpx_read_state, NULL );
+  g_free ( st );
 
   return result;
 }
 
-/**** entitize from GPSBabel ****/
-typedef struct {
-        const char * text;
-        const char * entity;
-        int  not_html;
-} entity_types;
-
-static
-entity_types stdentities[] =  {
-        { "&",  "&amp;", 0 },
-        { "'",  "&apos;", 1 },
-        { "<",  "&lt;", 0 },
-        { ">",  "&gt;", 0 },
-        { "\"", "&quot;", 0 },
-        { NULL, NULL, 0 }
+struct _GpxStream {
+  GpxReadState *st;
+  UserDataT ud;
+  XML_Parser parser;
+  gboolean failed;
 };
 
+/**
+ * a_gpx_stream_new:
+ * @vtl:       The layer the trackpoints are for (only used for its coordinate mode)
+ * @func:      Called with each trackpoint as its closing tag is parsed, which it then owns
+ * @user_data: Passed to @func
+ *
+ * Parse GPX incrementally as it arrives, e.g. from a live tracking feed.
+ * Only trackpoints are read - the layer itself is not changed.
+ */
+GpxStream *a_gpx_stream_new ( VikTrwLayer *vtl, GpxTrackpointFunc func, gpointer user_data )
+{
+  GpxStream *gs = g_malloc0 ( sizeof(GpxStream) );
+  gs->st = g_malloc0 ( sizeof(GpxReadState) );
+  gs->ud.vtl = vtl;
+  gs->ud.append = TRUE;
+  gs->ud.tp_func = func;
+  gs->ud.tp_data = user_data;
+  gs->parser = gpx_parser_new ( gs->st, &gs->ud );
+  return gs;
+}
+
+/**
+ * a_gpx_stream_feed:
+ * @buf: The next data, which need not end on a tag boundary
+ * @len: The length of @buf
+ *
+ * Returns: %FALSE once the data is not valid GPX, after which nothing more is parsed
+ */
+gboolean a_gpx_stream_feed ( GpxStream *gs, const gchar *buf, gsize len )
+{
+  if ( gs->failed )
+    return FALSE;
+  // The parse state is per thread, so allow for other reads in between feeds
+  gpointer prev = g_private_get ( &gpx_read_state );
+  g_private_set ( &gpx_read_state, gs->st );
+  if ( XML_Parse(gs->parser, buf, len, 0) == XML_STATUS_ERROR ) {
+    g_warning ( "%s: XML error %s at line %ld with tag %s", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(gs->parser)), XML_GetCurrentLineNumber(gs->parser), get_tag_name(gs->st->current_tag) );
+    gs->failed = TRUE;
+  }
+  g_private_set ( &gpx_read_state, prev );
+  return !gs->failed;
+}
+
+void a_gpx_stream_free ( GpxStream *gs )
+{
+  GpxReadState *st = gs->st;
+  // Anything not closed by the end of the stream is simply dropped
+  if ( st->c_tp )
+    vik_trackpoint_free ( st->c_tp );
+  if ( st->c_tr )
+    vik_track_free ( st->c_tr );
+  if ( st->c_wp )
+    vik_waypoint_free ( st->c_wp );
+  if ( st->c_md )
+    vik_trw_metadata_free ( st->c_md );
+  g_free ( st->c_tr_name );
+  g_free ( st->c_wp_name );
+  gpx_parser_free ( st, gs->parser );
+  g_free ( st );
+  g_free ( gs );
+}
+
+static gssize gpx_fread ( FILE *f, void *buffer, gsize size )
+{
+  size_t len = fread ( buffer, 1, size, f );
+  if ( len == 0 && ferror(f) )
+    return -1;
+  return len;
+}
+
+/**
+ * a_gpx_read_file:
+ *
+ * See a_gpx_read_stream()
+ */
+GpxReadStatus_t a_gpx_read_file ( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append )
+{
+  g_assert ( f != NULL );
+  return a_gpx_read_stream ( vtl, (UtilReadFunc)gpx_fread, f, dirpath, append );
+}
+
+/**** entitize from GPSBabel ****/
 void utf8_to_int( const char *cp, int *bytes, int *value )
 {
         if ( (*cp & 0xe0) == 0xc0 ) {
@@ -1540,95 +1780,65 @@ dodefault:
         }
 }
 
+/**** end GPSBabel code ****/
+
+/**
+ * a_gpx_entitize_append:
+ * @gs:  The string to add to
+ * @str: The text to add
+ *
+ * Add the text with the XML special characters and any characters beyond U+007F
+ *  replaced by entities.
+ * Runs of text that don't need replacing (typically all of it) are copied straight in,
+ *  so nothing is allocated beyond growing @gs.
+ */
+void a_gpx_entitize_append ( GString *gs, const gchar *str )
+{
+  const gchar *run = str;
+  const gchar *cp;
+  for ( cp = str; *cp; cp++ ) {
+    const gchar *entity;
+    switch ( *cp ) {
+    case '&':  entity = "&amp;"; break;
+    case '\'': entity = "&apos;"; break;
+    case '<':  entity = "&lt;"; break;
+    case '>':  entity = "&gt;"; break;
+    case '"':  entity = "&quot;"; break;
+    default:
+      if ( !(*cp & 0x80) )
+        continue;
+      entity = NULL;
+      break;
+    }
+    g_string_append_len ( gs, run, cp - run );
+    if ( entity )
+      g_string_append ( gs, entity );
+    else {
+      int bytes = 0;
+      int value = 0;
+      gchar buf[16];
+      utf8_to_int ( cp, &bytes, &value );
+      g_snprintf ( buf, sizeof(buf), "&#x%x;", value );
+      g_string_append ( gs, buf );
+      cp += bytes-1;
+    }
+    run = cp + 1;
+  }
+  g_string_append_len ( gs, run, cp - run );
+}
+
+/**
+ * a_gpx_entitize:
+ *
+ * Returns: A new string of the text as per a_gpx_entitize_append()
+ */
 char *
 a_gpx_entitize(const char * str)
 {
-        int elen, ecount, nsecount;
-        entity_types *ep;
-        const char * cp;
-        char * p, * tmp, * xstr;
-
-        char tmpsub[20];
-        int bytes = 0;
-        int value = 0;
-        ep = stdentities;
-        elen = ecount = nsecount = 0;
-
-        /* figure # of entity replacements and additional size. */
-        while (ep->text) {
-                cp = str;
-                while ((cp = strstr(cp, ep->text)) != NULL) {
-                        elen += strlen(ep->entity) - strlen(ep->text);
-                        ecount++;
-                        cp += strlen(ep->text);
-                }
-                ep++;
-        }
-
-        /* figure the same for other than standard entities (i.e. anything
-         * that isn't in the range U+0000 to U+007F */
-        for ( cp = str; *cp; cp++ ) {
-                if ( *cp & 0x80 ) {
-
-                        utf8_to_int( cp, &bytes, &value );
-                        cp += bytes-1;
-                        elen += sprintf( tmpsub, "&#x%x;", value ) - bytes;
-                        nsecount++;
-                }
-        }
-
-        /* enough space for the whole string plus entity replacements, if any */
-        tmp = g_malloc((strlen(str) + elen + 1));
-        strcpy(tmp, str);
-
-        /* no entity replacements */
-        if (ecount == 0 && nsecount == 0)
-                return (tmp);
-
-        if ( ecount != 0 ) {
-                for (ep = stdentities; ep->text; ep++) {
-                        p = tmp;
-                        while ((p = strstr(p, ep->text)) != NULL) {
-                                elen = strlen(ep->entity);
-
-                                xstr = g_strdup(p + strlen(ep->text));
-
-                                strcpy(p, ep->entity);
-                                strcpy(p + elen, xstr);
-
-                                g_free(xstr);
-
-                                p += elen;
-                        }
-                }
-        }
-
-        if ( nsecount != 0 ) {
-                p = tmp;
-                while (*p) {
-                        if ( *p & 0x80 ) {
-                                utf8_to_int( p, &bytes, &value );
-                                if ( p[bytes] ) {
-                                        xstr = g_strdup( p + bytes );
-                                }
-                                else {
-                                        xstr = NULL;
-                                }
-                                sprintf( p, "&#x%x;", value );
-                                p = p+strlen(p);
-                                if ( xstr ) {
-                                        strcpy( p, xstr );
-                                        g_free(xstr);
-                                }
-                        }
-                        else {
-                                p++;
-                        }
-                }
-        }
-        return (tmp);
+  GString *gs = g_string_sized_new ( strlen(str) );
+  a_gpx_entitize_append ( gs, str );
+  return g_string_free ( gs, FALSE );
 }
-/**** end GPSBabel code ****/
 
 /* export GPX */
 
@@ -1696,52 +1906,80 @@ static const gchar * nearest_colour_string ( GdkColor color )
   return allowed_color_names[answer].color_name;
 }
 
-static void write_double ( FILE *ff, guint spaces, const gchar *tag, gdouble value )
+// Output is gathered up and written to the file in large blocks
+#define GPX_WRITE_BUFFER (1024*1024)
+// Tracks are formatted in parallel in batches of about this many points
+#define GPX_WRITE_BATCH_POINTS 100000
+
+static void gpx_flush ( GpxWritingContext *context, gboolean force )
+{
+  GString *gs = context->buf;
+  if ( context->file && gs->len && ( force || gs->len >= GPX_WRITE_BUFFER ) ) {
+    if ( fwrite ( gs->str, 1, gs->len, context->file ) != gs->len )
+      g_warning ( "%s: failed to write", __FUNCTION__ );
+    g_string_truncate ( gs, 0 );
+  }
+}
+
+static void write_double ( GString *gs, guint spaces, const gchar *tag, gdouble value )
 {
   if ( !isnan(value) ) {
     gchar buf[COORDS_STR_BUFFER_SIZE];
     a_coords_dtostr_buffer ( value, buf );
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, buf, tag );
+    g_string_append_printf ( gs, "%*s<%s>%s</%s>\n", spaces, "", tag, buf, tag );
   }
 }
 
 // Value must positive to be written otherwise it is ignored
-static void write_positive_uint ( FILE *ff, guint spaces, const gchar *tag, guint value )
+static void write_positive_uint ( GString *gs, guint spaces, const gchar *tag, guint value )
 {
   if ( value )
-    fprintf ( ff, "%*s<%s>%d</%s>\n", spaces, "", tag, value, tag );
+    g_string_append_printf ( gs, "%*s<%s>%d</%s>\n", spaces, "", tag, value, tag );
 }
 
-static void write_string ( FILE *ff, guint spaces, const gchar *tag, const gchar *value )
+/**
+ * Write the element with the text escaped as necessary,
+ *  without the allocations of formatting each part
+ */
+static void write_entitized ( GString *gs, guint spaces, const gchar *tag, const gchar *value )
 {
-  if ( value && strlen(value) ) {
-    gchar *tmp = a_gpx_entitize ( value );
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, tmp, tag );
-    g_free ( tmp );
-  }
+  for ( guint ii = 0; ii < spaces; ii++ )
+    g_string_append_c ( gs, ' ' );
+  g_string_append_c ( gs, '<' );
+  g_string_append ( gs, tag );
+  g_string_append_c ( gs, '>' );
+  a_gpx_entitize_append ( gs, value );
+  g_string_append ( gs, "</" );
+  g_string_append ( gs, tag );
+  g_string_append ( gs, ">\n" );
 }
 
-static void write_string_as_is ( FILE *ff, guint spaces, const gchar *tag, const gchar *value )
+static void write_string ( GString *gs, guint spaces, const gchar *tag, const gchar *value )
+{
+  if ( value && value[0] )
+    write_entitized ( gs, spaces, tag, value );
+}
+
+static void write_string_as_is ( GString *gs, guint spaces, const gchar *tag, const gchar *value )
 {
   if ( value && strlen(value) ) {
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, value, tag );
+    g_string_append_printf ( gs, "%*s<%s>%s</%s>\n", spaces, "", tag, value, tag );
   }
 }
 
-static void write_link ( FILE *ff, guint spaces, const gchar *link, const gchar *text, const gchar *type )
+static void write_link ( GString *gs, guint spaces, const gchar *link, const gchar *text, const gchar *type )
 {
-  if ( link && strlen(link) && text && strlen(text) && type && strlen(type) ) {
-    gchar *tmp = a_gpx_entitize ( text );
-    fprintf ( ff, "%*s<link href=\"%s\"><text>%s</text><type>%s</type></link>\n", spaces, "", link, text, type );
-    g_free ( tmp );
-  } else if ( link && strlen(link) && text && strlen(text) ) {
-    gchar *tmp = a_gpx_entitize ( text );
-    fprintf ( ff, "%*s<link href=\"%s\"><text>%s</text></link>\n", spaces, "", link, text );
-    g_free ( tmp );
+  if ( link && strlen(link) && text && strlen(text) ) {
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"><text>", spaces, "", link );
+    a_gpx_entitize_append ( gs, text );
+    if ( type && strlen(type) )
+      g_string_append_printf ( gs, "</text><type>%s</type></link>\n", type );
+    else
+      g_string_append ( gs, "</text></link>\n" );
   } else if ( link && strlen(link) && type && strlen(type) ) {
-    fprintf ( ff, "%*s<link href=\"%s\"><type>%s</type></link>\n", spaces, "", link, type );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"><type>%s</type></link>\n", spaces, "", link, type );
   } else if ( link && strlen(link) ) {
-    fprintf ( ff, "%*s<link href=\"%s\"></link>\n", spaces, "", link );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"></link>\n", spaces, "", link );
   }
 }
 
@@ -1756,20 +1994,20 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !wp->visible)
     return;
 
-  FILE *f = context->file;
+  GString *gs = context->buf;
   struct LatLon ll;
   gchar s_lat[COORDS_STR_BUFFER_SIZE];
   gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar *tmp;
+  const VikWaypointExtra *extra = vik_waypoint_get_extra ( wp );
   vik_coord_to_latlon ( &(wp->coord), &ll );
   a_coords_dtostr_buffer ( ll.lat, s_lat );
   a_coords_dtostr_buffer ( ll.lon, s_lon );
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<wpt lat=\"%s\" lon=\"%s\"%s>\n",
+  g_string_append_printf ( gs, "<wpt lat=\"%s\" lon=\"%s\"%s>\n",
                s_lat, s_lon, wp->visible ? "" : " hidden=\"hidden\"" );
 
-  write_double ( f, WPT_SPACES, "ele", wp->altitude );
+  write_double ( gs, WPT_SPACES, "ele", wp->altitude );
 
   if ( !isnan(wp->timestamp) ) {
     GTimeVal timestamp;
@@ -1778,35 +2016,29 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
 
     gchar *time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
     if ( time_iso8601 != NULL )
-      fprintf ( f, "  <time>%s</time>\n", time_iso8601 );
+      g_string_append_printf ( gs, "  <time>%s</time>\n", time_iso8601 );
     g_free ( time_iso8601 );
   }
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
-    write_double ( f, WPT_SPACES, "course", wp->course );
-    write_double ( f, WPT_SPACES, "speed", wp->speed );
+    write_double ( gs, WPT_SPACES, "course", wp->course );
+    write_double ( gs, WPT_SPACES, "speed", wp->speed );
   }
-  write_double ( f, WPT_SPACES, "magvar", wp->magvar );
-  write_double ( f, WPT_SPACES, "geoidheight", wp->geoidheight );
+  write_double ( gs, WPT_SPACES, "magvar", extra->magvar );
+  write_double ( gs, WPT_SPACES, "geoidheight", extra->geoidheight );
 
   // Sanity clause
-  if ( wp->name )
-    tmp = a_gpx_entitize ( wp->name );
-  else
-    tmp = g_strdup ("waypoint");
-
-  fprintf ( f, "  <name>%s</name>\n", tmp );
-  g_free ( tmp);
+  write_entitized ( gs, WPT_SPACES, "name", wp->name ? wp->name : "waypoint" );
 
-  write_string ( f, WPT_SPACES, "cmt", wp->comment );
-  write_string ( f, WPT_SPACES, "desc", wp->description );
-  write_string ( f, WPT_SPACES, "src", wp->source );
+  write_string ( gs, WPT_SPACES, "cmt", wp->comment );
+  write_string ( gs, WPT_SPACES, "desc", wp->description );
+  write_string ( gs, WPT_SPACES, "src", wp->source );
 
   if ( wp->url && context->options && context->options->version == GPX_V1_1 ) {
-    write_link ( f, WPT_SPACES, wp->url, wp->url_name, NULL );
+    write_link ( gs, WPT_SPACES, wp->url, wp->url_name, NULL );
   } else {
-    write_string ( f, WPT_SPACES, "url", wp->url );
-    write_string ( f, WPT_SPACES, "urlname", wp->url_name );
+    write_string ( gs, WPT_SPACES, "url", wp->url );
+    write_string ( gs, WPT_SPACES, "urlname", wp->url_name );
   }
 
   if ( wp->image )
@@ -1823,53 +2055,52 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
     if ( !tmp )
       tmp = gtk_html_filename_to_uri ( wp->image );
     const gchar *mtype = file_magic_type ( wp->image );
-    write_link ( f, WPT_SPACES, tmp, NULL, mtype );
+    write_link ( gs, WPT_SPACES, tmp, NULL, mtype );
     g_free ( (gchar*)mtype );
     g_free ( tmp );
   }
 
   if ( wp->symbol )
   {
-    tmp = a_gpx_entitize(wp->symbol);
+    g_string_append ( gs, "  <sym>" );
+    gsize start = gs->len;
+    a_gpx_entitize_append ( gs, wp->symbol );
     if ( a_vik_gpx_export_wpt_sym_name ( ) ) {
-       // Lowercase the symbol name
-       gchar *tmp2 = g_utf8_strdown ( tmp, -1 );
-       fprintf ( f, "  <sym>%s</sym>\n",  tmp2 );
-       g_free ( tmp2 );
+       // Lowercase the symbol name (once escaped it is all ASCII)
+       for ( gsize ii = start; ii < gs->len; ii++ )
+         gs->str[ii] = g_ascii_tolower ( gs->str[ii] );
     }
-    else
-      fprintf ( f, "  <sym>%s</sym>\n", tmp);
-    g_free ( tmp );
+    g_string_append ( gs, "</sym>\n" );
   }
-  write_string ( f, WPT_SPACES, "type", wp->type );
-
-  if ( wp->fix_mode == VIK_GPS_MODE_2D )
-    fprintf ( f, "  <fix>2d</fix>\n" );
-  else if ( wp->fix_mode == VIK_GPS_MODE_3D )
-    fprintf ( f, "  <fix>3d</fix>\n" );
-  else if ( wp->fix_mode == VIK_GPS_MODE_DGPS )
-    fprintf ( f, "  <fix>dgps</fix>\n" );
-  else if ( wp->fix_mode == VIK_GPS_MODE_PPS )
-    fprintf ( f, "  <fix>pps</fix>\n" );
-
-  write_positive_uint ( f, WPT_SPACES, "sat", wp->nsats );
-  write_double ( f, WPT_SPACES, "hdop", wp->hdop );
-  write_double ( f, WPT_SPACES, "vdop", wp->vdop );
-  write_double ( f, WPT_SPACES, "pdop", wp->pdop );
-  write_double ( f, WPT_SPACES, "ageofdgpsdata", wp->ageofdgpsdata );
-  write_positive_uint ( f, WPT_SPACES, "dgpsid", wp->dgpsid );
+  write_string ( gs, WPT_SPACES, "type", wp->type );
+
+  if ( extra->fix_mode == VIK_GPS_MODE_2D )
+    g_string_append_printf ( gs, "  <fix>2d</fix>\n" );
+  else if ( extra->fix_mode == VIK_GPS_MODE_3D )
+    g_string_append_printf ( gs, "  <fix>3d</fix>\n" );
+  else if ( extra->fix_mode == VIK_GPS_MODE_DGPS )
+    g_string_append_printf ( gs, "  <fix>dgps</fix>\n" );
+  else if ( extra->fix_mode == VIK_GPS_MODE_PPS )
+    g_string_append_printf ( gs, "  <fix>pps</fix>\n" );
+
+  write_positive_uint ( gs, WPT_SPACES, "sat", extra->nsats );
+  write_double ( gs, WPT_SPACES, "hdop", extra->hdop );
+  write_double ( gs, WPT_SPACES, "vdop", extra->vdop );
+  write_double ( gs, WPT_SPACES, "pdop", extra->pdop );
+  write_double ( gs, WPT_SPACES, "ageofdgpsdata", extra->ageofdgpsdata );
+  write_positive_uint ( gs, WPT_SPACES, "dgpsid", extra->dgpsid );
 
   // NB if 'extensions' have been read in/or set, yet the GPX version is specifically V1.0
   //  then ensure extension fields are not written
   if ( context->options && context->options->version == GPX_V1_1 ) {
     if ( vik_waypoint_have_extensions(wp) ) {
       GString *gs = vik_waypoint_get_extensions ( wp );
-      write_string_as_is ( f, WPT_SPACES, "extensions", gs->str );
+      write_string_as_is ( gs, WPT_SPACES, "extensions", gs->str );
       g_string_free ( gs, TRUE );
     }
   }
 
-  fprintf ( f, "</wpt>\n" );
+  g_string_append_printf ( gs, "</wpt>\n" );
 }
 
 #define TRKPT_SPACES 4
@@ -1877,9 +2108,12 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
 /**
  * Note that elements are written in the schema specification order
  */
-static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context )
+/**
+ * @first: The first point of a track doesn't start a new segment, as one is already open
+ */
+static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context, gboolean first )
 {
-  FILE *f = context->file;
+  GString *gs = context->buf;
   struct LatLon ll;
   gchar s_lat[COORDS_STR_BUFFER_SIZE];
   gchar s_lon[COORDS_STR_BUFFER_SIZE];
@@ -1888,21 +2122,21 @@ static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
   // No such thing as a rteseg! So make sure we don't put them in
-  if ( context->options && !context->options->is_route && tp->newsegment )
-    fprintf ( f, "  </trkseg>\n  <trkseg>\n" );
+  if ( context->options && !context->options->is_route && tp->newsegment && !first )
+    g_string_append_printf ( gs, "  </trkseg>\n  <trkseg>\n" );
 
   a_coords_dtostr_buffer ( ll.lat, s_lat );
   a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
+  g_string_append_printf ( gs, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
 
   if ( !isnan(tp->altitude) )
   {
     a_coords_dtostr_buffer ( tp->altitude, s_alt );
-    fprintf ( f, "    <ele>%s</ele>\n", s_alt );
+    g_string_append_printf ( gs, "    <ele>%s</ele>\n", s_alt );
   }
   else if ( context->options != NULL && context->options->force_ele )
   {
-    fprintf ( f, "    <ele>0</ele>\n" );
+    g_string_append_printf ( gs, "    <ele>0</ele>\n" );
   }
 
   time_iso8601 = NULL;
@@ -1919,98 +2153,93 @@ static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context
     time_iso8601 = g_time_val_to_iso8601 ( &current );
   }
   if ( time_iso8601 != NULL )
-    fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
+    g_string_append_printf ( gs, "    <time>%s</time>\n", time_iso8601 );
   g_free(time_iso8601);
   time_iso8601 = NULL;
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
-    write_double ( f, TRKPT_SPACES, "course", tp->course );
-    write_double ( f, TRKPT_SPACES, "speed", tp->speed );
+    write_double ( gs, TRKPT_SPACES, "course", tp->course );
+    write_double ( gs, TRKPT_SPACES, "speed", tp->speed );
   }
-  write_string ( f, TRKPT_SPACES, "name", tp->name );
+  write_string ( gs, TRKPT_SPACES, "name", tp->name );
 
   if (tp->fix_mode == VIK_GPS_MODE_2D)
-    fprintf ( f, "    <fix>2d</fix>\n");
+    g_string_append_printf ( gs, "    <fix>2d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_3D)
-    fprintf ( f, "    <fix>3d</fix>\n");
+    g_string_append_printf ( gs, "    <fix>3d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_DGPS)
-    fprintf ( f, "    <fix>dgps</fix>\n");
+    g_string_append_printf ( gs, "    <fix>dgps</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_PPS)
-    fprintf ( f, "    <fix>pps</fix>\n");
+    g_string_append_printf ( gs, "    <fix>pps</fix>\n");
 
-  write_positive_uint ( f, TRKPT_SPACES, "sat", tp->nsats );
-  write_double ( f, TRKPT_SPACES, "hdop", tp->hdop );
-  write_double ( f, TRKPT_SPACES, "vdop", tp->vdop );
-  write_double ( f, TRKPT_SPACES, "pdop", tp->pdop );
+  write_positive_uint ( gs, TRKPT_SPACES, "sat", tp->nsats );
+  write_double ( gs, TRKPT_SPACES, "hdop", tp->hdop );
+  write_double ( gs, TRKPT_SPACES, "vdop", tp->vdop );
+  write_double ( gs, TRKPT_SPACES, "pdop", tp->pdop );
 
   // If have the raw extensions - then save that (which should include all of the individual values we use)
   // NB if 'extensions' have been read in yet the GPX version is V1.0
   //  then ensure extension fields are not written
   if ( tp->extensions && context->options && context->options->version == GPX_V1_1 )
-    write_string_as_is ( f, TRKPT_SPACES, "extensions", tp->extensions );
+    write_string_as_is ( gs, TRKPT_SPACES, "extensions", tp->extensions );
   else {
     // Otherwise write the individual values we are supporting (in Garmin TrackPointExtension/v2 format)
     if ( context->options && context->options->version == GPX_V1_1 ) {
       if ( !isnan(tp->speed) || !isnan(tp->course) ||
            !isnan(tp->temp) || tp->heart_rate || tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
-        fprintf ( f, "    <extensions>\n");
-        fprintf ( f, "      <gpxtpx:TrackPointExtension>\n");
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
-        write_positive_uint ( f, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
+        g_string_append_printf ( gs, "    <extensions>\n");
+        g_string_append_printf ( gs, "      <gpxtpx:TrackPointExtension>\n");
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
+        write_positive_uint ( gs, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
         if ( tp->cadence != VIK_TRKPT_CADENCE_NONE )
-          fprintf ( f, "%*s<%s>%d</%s>\n", TRKPT_EXT_SPACES, "", "gpxtpx:cad", tp->cadence, "gpxtpx:cad" );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
-        fprintf ( f, "      </gpxtpx:TrackPointExtension>\n");
-        fprintf ( f, "    </extensions>\n");
+          g_string_append_printf ( gs, "%*s<%s>%d</%s>\n", TRKPT_EXT_SPACES, "", "gpxtpx:cad", tp->cadence, "gpxtpx:cad" );
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
+        g_string_append_printf ( gs, "      </gpxtpx:TrackPointExtension>\n");
+        g_string_append_printf ( gs, "    </extensions>\n");
       }
     }
   }
-  fprintf ( f, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
+  g_string_append_printf ( gs, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
 }
 
 #define TRK_SPACES 2
 
-static void write_track_extension_color_only ( FILE *ff, VikTrack *trk )
+static void write_track_extension_color_only ( GString *gs, VikTrack *trk )
 {
-  fprintf ( ff, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>%s</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n", nearest_colour_string(trk->color) );
+  g_string_append_printf ( gs, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>%s</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n", nearest_colour_string(trk->color) );
 }
 
+/**
+ * NB Must not use anything that isn't thread safe, as this may be run on different tracks concurrently
+ */
 static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
 {
   // Don't write invisible tracks when specified
   if (context->options && !context->options->hidden && !t->visible)
     return;
 
-  FILE *f = context->file;
-  gchar *tmp;
-  gboolean first_tp_is_newsegment = FALSE; /* must temporarily make it not so, but we want to restore state. not that it matters. */
-
-  // Sanity clause
-  if ( t->name )
-    tmp = a_gpx_entitize ( t->name );
-  else
-    tmp = g_strdup ("track");
+  GString *gs = context->buf;
 
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<%s%s>\n  <name>%s</name>\n",
+  g_string_append_printf ( gs, "<%s%s>\n",
 	    t->is_route ? "rte" : "trk",
-	    t->visible ? "" : " hidden=\"hidden\"",
-	    tmp );
-  g_free ( tmp );
-
-  write_string ( f, TRK_SPACES, "cmt", t->comment );
-  write_string ( f, TRK_SPACES, "desc", t->description );
-  write_string ( f, TRK_SPACES, "src", t->source );
-  write_positive_uint ( f, TRK_SPACES, "number", t->number );
+	    t->visible ? "" : " hidden=\"hidden\"" );
+  // Sanity clause
+  write_entitized ( gs, TRK_SPACES, "name", t->name ? t->name : "track" );
+
+  write_string ( gs, TRK_SPACES, "cmt", t->comment );
+  write_string ( gs, TRK_SPACES, "desc", t->description );
+  write_string ( gs, TRK_SPACES, "src", t->source );
+  write_positive_uint ( gs, TRK_SPACES, "number", t->number );
   if ( t->url && context->options && context->options->version == GPX_V1_1 ) {
-    write_link ( f, TRK_SPACES, t->url, t->url_name, NULL );
+    write_link ( gs, TRK_SPACES, t->url, t->url_name, NULL );
   } else {
-    write_string ( f, TRK_SPACES, "url", t->url );
-    write_string ( f, TRK_SPACES, "urlname", t->url_name );
+    write_string ( gs, TRK_SPACES, "url", t->url );
+    write_string ( gs, TRK_SPACES, "urlname", t->url_name );
   }
-  write_string ( f, TRK_SPACES, "type", t->type );
+  write_string ( gs, TRK_SPACES, "type", t->type );
 
   // ATM Track Colour is the only extension Viking supports editing
   //  thus if there is some other track extension Viking will not add in the color,
@@ -2029,7 +2258,7 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_strstrip ( text );
         if ( g_str_has_prefix(text, "<gpxx:TrackExtension><gpxx:DisplayColor>") ) {
           if ( g_str_has_suffix(text, "</gpxx:DisplayColor></gpxx:TrackExtension>") )
-            write_track_extension_color_only ( f, t );
+            write_track_extension_color_only ( gs, t );
           else
             write_as_is = TRUE;
         }
@@ -2038,34 +2267,33 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_free ( text );
       }
       if ( write_as_is )
-        write_string_as_is ( f, TRK_SPACES, "extensions", t->extensions );
+        write_string_as_is ( gs, TRK_SPACES, "extensions", t->extensions );
     }
     else {
       if ( context->options && context->options->version == GPX_V1_1 )
         if ( t->has_color )
-          write_track_extension_color_only ( f, t );
+          write_track_extension_color_only ( gs, t );
     }
   }
 
   /* No such thing as a rteseg! */
   if ( !t->is_route )
-    fprintf ( f, "  <trkseg>\n" );
+    g_string_append_printf ( gs, "  <trkseg>\n" );
 
-  if ( t->trackpoints && t->trackpoints->data ) {
-    first_tp_is_newsegment = VIK_TRACKPOINT(t->trackpoints->data)->newsegment;
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = FALSE; /* so we won't write </trkseg><trkseg> already */
-    g_list_foreach ( t->trackpoints, (GFunc) gpx_write_trackpoint, context );
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = first_tp_is_newsegment; /* restore state */
+  for ( GList *iter = t->trackpoints; iter; iter = iter->next ) {
+    gpx_write_trackpoint ( VIK_TRACKPOINT(iter->data), context, iter == t->trackpoints );
+    gpx_flush ( context, FALSE );
   }
 
   /* NB apparently no such thing as a rteseg! */
   if (!t->is_route)
-    fprintf ( f, "  </trkseg>\n");
-  fprintf ( f, "</%s>\n", t->is_route ? "rte" : "trk" );
+    g_string_append_printf ( gs, "  </trkseg>\n");
+  g_string_append_printf ( gs, "</%s>\n", t->is_route ? "rte" : "trk" );
 }
 
-static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *context )
+static void gpx_write_header( VikTrwLayer *vtl, GpxWritingContext *context )
 {
+  GString *gs = context->buf;
   // Allow overriding the creator value
   // E.g. if something actually cares about it, see for example:
   //   http://strava.github.io/api/v3/uploads/
@@ -2075,7 +2303,7 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
     creator = g_strdup_printf("Viking %s -- %s", PACKAGE_VERSION, PACKAGE_URL);
   }
 
-  fprintf(f, "<?xml version=\"1.0\"?>\n");
+  g_string_append_printf ( gs, "<?xml version=\"1.0\"?>\n");
 
   gpx_version_t version = GPX_V1_0;
   if ( vtl )
@@ -2084,20 +2312,20 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
     version = context->options->version;
 
   if ( version == GPX_V1_1 ) {
-    fprintf(f, "<gpx version=\"1.1\" creator=\"%s\" ", creator);
+    g_string_append_printf ( gs, "<gpx version=\"1.1\" creator=\"%s\" ", creator);
     // If we already have a ready to use header then use that
     gchar *header = NULL;
     if ( vtl )
       header = vik_trw_layer_get_gpx_header ( vtl );
     if ( header )
-      fprintf(f, "%s%s", header, ">\n");
+      g_string_append_printf ( gs, "%s%s", header, ">\n");
     else
       // Otherwise write a load of xmlns stuff, even if we don't actually end up using any extensions
       // This is for writing a single GPX file of multiple layers and thus can contain any kind of extension
       // Write these known** xmlns types in an effort to create a formally valid XML file
       //  (according to all these schema kinds)
       // **as opposed to trying to parse each TRW layer to come up with computated relevant bespoke list
-      fprintf(f, "xmlns=\"http://www.topografix.com/GPX/1/1\" "
+      g_string_append_printf ( gs, "xmlns=\"http://www.topografix.com/GPX/1/1\" "
                  "xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\" "
                  "xmlns:wptx1=\"http://www.garmin.com/xmlschemas/WaypointExtension/v1\" "
                  "xmlns:ns3=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\" "
@@ -2111,16 +2339,87 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
                  "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
                  "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd http://www.garmin.com/xmlschemas/GpxExtensions/v3 http://www8.garmin.com/xmlschemas/GpxExtensionsv3.xsd http://www.garmin.com/xmlschemas/WaypointExtension/v1 http://www8.garmin.com/xmlschemas/WaypointExtensionv1.xsd http://www.garmin.com/xmlschemas/TrackPointExtension/v2 http://www.garmin.com/xmlschemas/TrackPointExtensionv2.xsd http://www.garmin.com/xmlschemas/PowerExtensionv1.xsd\">\n");
   } else {
-    fprintf(f, "<gpx version=\"1.0\" creator=\"%s\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+    g_string_append_printf ( gs, "<gpx version=\"1.0\" creator=\"%s\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
               " xmlns=\"http://www.topografix.com/GPX/1/0\""
               " xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 http://www.topografix.com/GPX/1/0/gpx.xsd\">\n", creator);
   }
   g_free(creator);
 }
 
-static void gpx_write_footer( FILE *f )
+static void gpx_write_footer( GpxWritingContext *context )
 {
-  fprintf(f, "</gpx>\n");
+  g_string_append ( context->buf, "</gpx>\n" );
+  gpx_flush ( context, TRUE );
+}
+
+#define VIK_SETTINGS_GPX_WRITE_THREADS "gpx_write_threads"
+
+typedef struct {
+  GPtrArray *tracks;
+  GString **out;      // Formatted text of each track in the batch
+  guint first;        // Index of the first track in the batch
+  GpxWritingContext *context;
+} GpxTrackBatch;
+
+static void gpx_write_track_item ( guint ii, GpxTrackBatch *batch )
+{
+  // Same settings, but only into its own buffer
+  GpxWritingContext context = *batch->context;
+  context.file = NULL;
+  context.buf = g_string_new ( NULL );
+  gpx_write_track ( g_ptr_array_index(batch->tracks, batch->first + ii), &context );
+  batch->out[ii] = context.buf;
+}
+
+/**
+ * Write the tracks in the order given
+ *
+ * When there are several, they are formatted on the background CPU workers,
+ *  giving the same output as writing each one in turn
+ */
+static void gpx_write_tracks ( GList *tracks, GpxWritingContext *context )
+{
+  guint threads = a_background_get_cpu_workers () + 1;
+  gint gitmp = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_GPX_WRITE_THREADS, &gitmp ) && gitmp > 0 )
+    threads = gitmp;
+
+  if ( threads < 2 || !context->file || !tracks || !tracks->next ) {
+    for ( GList *iter = tracks; iter != NULL; iter = g_list_next(iter) ) {
+      gpx_write_track ( (VikTrack*)iter->data, context );
+      gpx_flush ( context, FALSE );
+    }
+    return;
+  }
+
+  GPtrArray *array = g_ptr_array_new ();
+  for ( GList *iter = tracks; iter != NULL; iter = g_list_next(iter) )
+    g_ptr_array_add ( array, iter->data );
+
+  GpxTrackBatch batch = { array, g_malloc0 ( array->len * sizeof(GString*) ), 0, context };
+  while ( batch.first < array->len ) {
+    // Limit how much formatted text is held at once
+    guint count = 0;
+    gulong points = 0;
+    while ( batch.first + count < array->len && points < GPX_WRITE_BATCH_POINTS ) {
+      points += vik_track_get_tp_count ( g_ptr_array_index(array, batch.first + count) );
+      count++;
+    }
+
+    a_background_parallel ( (vik_thr_index_func)gpx_write_track_item, &batch, count );
+
+    gpx_flush ( context, TRUE );
+    for ( guint ii = 0; ii < count; ii++ ) {
+      GString *gs = batch.out[ii];
+      if ( gs->len && fwrite ( gs->str, 1, gs->len, context->file ) != gs->len )
+        g_warning ( "%s: failed to write", __FUNCTION__ );
+      g_string_free ( gs, TRUE );
+      batch.out[ii] = NULL;
+    }
+    batch.first += count;
+  }
+  g_free ( batch.out );
+  g_ptr_array_free ( array, TRUE );
 }
 
 static int gpx_waypoint_compare(const void *x, const void *y)
@@ -2139,9 +2438,10 @@ static int gpx_track_compare_name(const void *x, const void *y)
 
 void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, const gchar* dirpath )
 {
-  GpxWritingContext context = { options, f, dirpath, vtl };
+  GpxWritingContext context = { options, f, dirpath, vtl, g_string_sized_new ( GPX_WRITE_BUFFER ) };
+  GString *gs = context.buf;
 
-  gpx_write_header ( f, vtl, &context );
+  gpx_write_header ( vtl, &context );
 
   const gchar *name = vik_layer_get_name(VIK_LAYER(vtl));
 
@@ -2150,35 +2450,35 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
     version = options->version;
 
   if ( version == GPX_V1_0 )
-    write_string ( f, TRK_SPACES, "name", name );
+    write_string ( gs, TRK_SPACES, "name", name );
 
   VikTRWMetadata *md = vik_trw_layer_get_metadata (vtl);
   if ( md ) {
     if ( version == GPX_V1_1 ) {
-      fprintf ( f, "  <metadata>\n" );
-      write_string ( f, 4, "name", name );
+      g_string_append_printf ( gs, "  <metadata>\n" );
+      write_string ( gs, 4, "name", name );
       if ( md->author && strlen(md->author) > 0 )
-        fprintf ( f, "    <author><name>%s</name></author>\n", md->author );
-      write_string ( f, 4, "desc", md->description );
-      write_link ( f, 4, md->url, md->url_name, NULL );
-      write_string ( f, 4, "time", md->timestamp );
-      write_string ( f, 4, "keywords", md->keywords );
-      fprintf ( f, "  </metadata>\n" );
+        g_string_append_printf ( gs, "    <author><name>%s</name></author>\n", md->author );
+      write_string ( gs, 4, "desc", md->description );
+      write_link ( gs, 4, md->url, md->url_name, NULL );
+      write_string ( gs, 4, "time", md->timestamp );
+      write_string ( gs, 4, "keywords", md->keywords );
+      g_string_append_printf ( gs, "  </metadata>\n" );
     }
     else {
-      write_string ( f, TRK_SPACES, "author", md->author );
-      write_string ( f, TRK_SPACES, "desc", md->description );
-      write_string ( f, TRK_SPACES, "url", md->url );
-      write_string ( f, TRK_SPACES, "urlname", md->url_name );
-      write_string ( f, TRK_SPACES, "time", md->timestamp );
-      write_string ( f, TRK_SPACES, "keywords", md->keywords );
+      write_string ( gs, TRK_SPACES, "author", md->author );
+      write_string ( gs, TRK_SPACES, "desc", md->description );
+      write_string ( gs, TRK_SPACES, "url", md->url );
+      write_string ( gs, TRK_SPACES, "urlname", md->url_name );
+      write_string ( gs, TRK_SPACES, "time", md->timestamp );
+      write_string ( gs, TRK_SPACES, "keywords", md->keywords );
     }
   }
   else {
     if ( version == GPX_V1_1 ) {
-      fprintf ( f, "  <metadata>\n" );
-      write_string ( f, 4, "name", name );
-      fprintf ( f, "  </metadata>\n" );
+      g_string_append_printf ( gs, "  <metadata>\n" );
+      write_string ( gs, 4, "name", name );
+      g_string_append_printf ( gs, "  </metadata>\n" );
     }
   }
 
@@ -2189,6 +2489,7 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
 
     for (GList *iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
       gpx_write_waypoint ( (VikWaypoint*)iter->data, &context );
+      gpx_flush ( &context, FALSE );
     }
     g_list_free ( gl );
   }
@@ -2230,15 +2531,11 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
   context_tmp.options->is_route = FALSE;
 
   // Loop around each list and write each one
-  for (GList *iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  gpx_write_tracks ( gl, &context_tmp );
 
   // Routes (to get routepoints)
   context_tmp.options->is_route = TRUE;
-  for (GList *iter = g_list_first (glrte); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  gpx_write_tracks ( glrte, &context_tmp );
 
   g_list_free ( gl );
   g_list_free ( glrte );
@@ -2246,10 +2543,11 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
   if ( opt_tmp.version == GPX_V1_1 ) {
     gchar *ext = vik_trw_layer_get_gpx_extensions ( vtl );
     if ( ext )
-      write_string_as_is ( f, 0, "extensions", ext );
+      write_string_as_is ( gs, 0, "extensions", ext );
   }
 
-  gpx_write_footer ( f );
+  gpx_write_footer ( &context );
+  g_string_free ( gs, TRUE );
 }
 
 /*
@@ -2262,10 +2560,11 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
  */
 void a_gpx_write_track_file ( VikTrwLayer *vtl, VikTrack *trk, FILE *f, GpxWritingOptions *options )
 {
-  GpxWritingContext context = { options, f, NULL, NULL };
-  gpx_write_header ( f, vtl, &context );
+  GpxWritingContext context = { options, f, NULL, NULL, g_string_sized_new ( GPX_WRITE_BUFFER ) };
+  gpx_write_header ( vtl, &context );
   gpx_write_track ( trk, &context );
-  gpx_write_footer ( f );
+  gpx_write_footer ( &context );
+  g_string_free ( context.buf, TRUE );
 }
 
 /**
@@ -2363,16 +2662,18 @@ void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FIL
   g_return_if_fail ( ff != NULL );
   g_return_if_fail ( options != NULL );
 
-  GpxWritingContext context = { options, ff, dirpath, NULL };
-  gpx_write_header ( ff, NULL, &context );
+  GpxWritingContext context = { options, ff, dirpath, NULL, g_string_sized_new ( GPX_WRITE_BUFFER ) };
+  gpx_write_header ( NULL, &context );
 
-  write_string ( ff, TRK_SPACES, "name", name );
+  write_string ( context.buf, TRK_SPACES, "name", name );
   // NB No overall metadata readily available, so don't bother
 
   GList *gl = NULL;
   gl = g_list_sort ( vtwl, waypoint_compare_vtwl );
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) )
+  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
     gpx_write_waypoint ( ((vik_trw_waypoint_list_t*)iter->data)->wpt, &context );
+    gpx_flush ( &context, FALSE );
+  }
 
   // Sort method determined by preference
   if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_TIME )
@@ -2380,21 +2681,29 @@ void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FIL
   else if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_ALPHA )
     gl = g_list_sort ( vtt, track_compare_name_vtt );
 
-  // Tracks First
+  GList *tracks = NULL;
+  GList *routes = NULL;
   for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
     VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( !trk->is_route )
-      gpx_write_track ( trk, &context );
+    if ( trk->is_route )
+      routes = g_list_prepend ( routes, trk );
+    else
+      tracks = g_list_prepend ( tracks, trk );
   }
+  tracks = g_list_reverse ( tracks );
+  routes = g_list_reverse ( routes );
+
+  // Tracks First
+  gpx_write_tracks ( tracks, &context );
 
   context.options->is_route = TRUE;
 
   // Finally Routes
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
-    VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( trk->is_route )
-      gpx_write_track ( trk, &context );
-  }
+  gpx_write_tracks ( routes, &context );
+
+  g_list_free ( tracks );
+  g_list_free ( routes );
 
-  gpx_write_footer ( ff );
+  gpx_write_footer ( &context );
+  g_string_free ( context.buf, TRUE );
 }
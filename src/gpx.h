@@ -23,6 +23,7 @@
 #define _VIKING_GPX_H
 
 #include "viktrwlayer.h"
+#include "util.h"
 
 G_BEGIN_DECLS
 
@@ -48,6 +49,7 @@ typedef struct {
 } GpxLapType;
 
 char *a_gpx_entitize(const char * str);
+void a_gpx_entitize_append ( GString *gs, const gchar *str );
 
 typedef enum {
   GPX_READ_SUCCESS,
@@ -56,6 +58,15 @@ typedef enum {
 } GpxReadStatus_t;
 
 GpxReadStatus_t a_gpx_read_file ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, gboolean append );
+GpxReadStatus_t a_gpx_read_stream ( VikTrwLayer *trw, UtilReadFunc read_func, gpointer user_data, const gchar* dirpath, gboolean append );
+
+typedef void (*GpxTrackpointFunc) ( VikTrackpoint *tp, gpointer user_data );
+
+typedef struct _GpxStream GpxStream;
+
+GpxStream *a_gpx_stream_new ( VikTrwLayer *trw, GpxTrackpointFunc func, gpointer user_data );
+gboolean a_gpx_stream_feed ( GpxStream *gs, const gchar *buf, gsize len );
+void a_gpx_stream_free ( GpxStream *gs );
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f, GpxWritingOptions *options, const gchar *dirpath );
 void a_gpx_write_track_file ( VikTrwLayer *trw, VikTrack *trk, FILE *f, GpxWritingOptions *options );
 
@@ -0,0 +1,751 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Overviews (an image pyramid) of a large image, so it can be drawn at any scale
+ *  without holding the whole image decoded in memory.
+ *
+ * Each level is half the size of the one before, with level 0 as the full image,
+ *  and each level is a set of tiles cached on disk.
+ * Tiled TIFF images (e.g. Cloud Optimized GeoTIFF orthophotos) are read directly:
+ *  the full image and any reduced resolution images within the file that match a level
+ *  are decoded a tile at a time as needed, so they can be drawn straight away,
+ *  and only the missing levels are generated, each from the one before.
+ * Otherwise the image has to be decoded in the background to generate the overviews;
+ *  first at a reduced size for the smaller levels (which for JPEG is done whilst decompressing),
+ *  so there is something to draw quickly, then in full for the rest.
+ * Drawing decodes just the tiles covering the area wanted from the level nearest
+ *  (but not below) the resolution wanted, keeping the most recently used ones.
+ *  Whilst that level is still being generated, the nearest available one is used instead.
+ *
+ * Cache layout, under the user's cache directory:
+ *  viking/georef/<md5 of image name, size and time>/
+ *    pyramid.txt     - "<width> <height> <levels> <has_alpha>", written once complete
+ *    <level>/<x>_<y>.png (or .jpg when the image has no alpha channel)
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <math.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#ifdef HAVE_LIBTIFF
+#include <tiffio.h>
+#endif
+
+#include "imagepyramid.h"
+#include "background.h"
+#include "md5_hash.h"
+#include "vik_compat.h"
+
+#define PYRAMID_TILE_SIZE 512
+#define PYRAMID_INFO_FILE "pyramid.txt"
+// Enough for a couple of screens worth
+#define PYRAMID_MAX_TILES 80
+// Levels no bigger than this are generated first from a reduced decode of the image
+#define PYRAMID_QUICK_SIZE 2048
+
+typedef struct {
+  guint width;
+  guint height;
+  guint tile_width;
+  guint tile_height;
+  gint ready;         // Atomic, set once all its tiles are available
+  gint tiff_dir;      // Read from this directory of the TIFF rather than the cache, when >= 0
+} PyramidLevel;
+
+struct _ImagePyramid {
+  gint ref_count;
+  GMutex *mutex;
+  gchar *filename;
+  gchar *dir;
+  guint width;
+  guint height;
+  guint levels;
+  PyramidLevel *level;
+  gboolean has_alpha;
+  gboolean cancelled; // No longer wanted whilst generating
+  VikLayer *vl;       // To redraw as levels become ready
+  GHashTable *tiles;  // "<level>/<x>_<y>" -> GdkPixbuf
+  GQueue lru;         // Keys of the tiles, least recently used first
+#ifdef HAVE_LIBTIFF
+  TIFF *tiff;
+  GMutex *tiff_mutex; // libtiff handles are not thread safe
+#endif
+};
+
+typedef struct {
+  gpointer threaddata;
+  guint done;
+  guint total;
+} GenerateProgress;
+
+static guint level_size ( guint size, guint level )
+{
+  return ((size - 1) >> level) + 1;
+}
+
+static guint count_levels ( guint width, guint height )
+{
+  guint levels = 1;
+  while ( MAX(level_size(width, levels-1), level_size(height, levels-1)) > PYRAMID_TILE_SIZE )
+    levels++;
+  return levels;
+}
+
+static guint level_tiles ( PyramidLevel *lv )
+{
+  return ((lv->width - 1) / lv->tile_width + 1) * ((lv->height - 1) / lv->tile_height + 1);
+}
+
+/**
+ * All levels initially come from the cache
+ */
+static void setup_levels ( ImagePyramid *ip )
+{
+  ip->levels = count_levels ( ip->width, ip->height );
+  ip->level = g_new0 ( PyramidLevel, ip->levels );
+  for ( guint level = 0; level < ip->levels; level++ ) {
+    ip->level[level].width = level_size ( ip->width, level );
+    ip->level[level].height = level_size ( ip->height, level );
+    ip->level[level].tile_width = PYRAMID_TILE_SIZE;
+    ip->level[level].tile_height = PYRAMID_TILE_SIZE;
+    ip->level[level].tiff_dir = -1;
+  }
+}
+
+static gchar *tile_key ( guint level, gint tx, gint ty )
+{
+  return g_strdup_printf ( "%u" G_DIR_SEPARATOR_S "%d_%d", level, tx, ty );
+}
+
+static gchar *tile_filename ( ImagePyramid *ip, const gchar *key )
+{
+  return g_strconcat ( ip->dir, G_DIR_SEPARATOR_S, key, ip->has_alpha ? ".png" : ".jpg", NULL );
+}
+
+static void image_pyramid_unref ( ImagePyramid *ip )
+{
+  if ( !g_atomic_int_dec_and_test ( &ip->ref_count ) )
+    return;
+#ifdef HAVE_LIBTIFF
+  if ( ip->tiff )
+    TIFFClose ( ip->tiff );
+  vik_mutex_free ( ip->tiff_mutex );
+#endif
+  g_queue_clear ( &ip->lru );
+  g_hash_table_destroy ( ip->tiles );
+  vik_mutex_free ( ip->mutex );
+  g_free ( ip->level );
+  g_free ( ip->dir );
+  g_free ( ip->filename );
+  g_free ( ip );
+}
+
+#ifdef HAVE_LIBTIFF
+/**
+ * Use the image directly if it is a tiled TIFF (which can be read a part at a time)
+ */
+static gboolean open_tiff ( ImagePyramid *ip )
+{
+  // Not a TIFF is not worth a warning
+  TIFFErrorHandler handler = TIFFSetErrorHandler ( NULL );
+  TIFF *tif = TIFFOpen ( ip->filename, "r" );
+  TIFFSetErrorHandler ( handler );
+  if ( !tif )
+    return FALSE;
+
+  guint32 width = 0, height = 0, tile_width = 0, tile_height = 0;
+  if ( !TIFFIsTiled ( tif ) ||
+       !TIFFGetField ( tif, TIFFTAG_IMAGEWIDTH, &width ) || !TIFFGetField ( tif, TIFFTAG_IMAGELENGTH, &height ) ||
+       !TIFFGetField ( tif, TIFFTAG_TILEWIDTH, &tile_width ) || !TIFFGetField ( tif, TIFFTAG_TILELENGTH, &tile_height ) ||
+       !width || !height || !tile_width || !tile_height ) {
+    TIFFClose ( tif );
+    return FALSE;
+  }
+
+  guint16 extra_samples = 0;
+  guint16 *sample_info = NULL;
+  TIFFGetFieldDefaulted ( tif, TIFFTAG_EXTRASAMPLES, &extra_samples, &sample_info );
+  ip->width = width;
+  ip->height = height;
+  ip->has_alpha = extra_samples > 0;
+  setup_levels ( ip );
+  ip->level[0].tile_width = tile_width;
+  ip->level[0].tile_height = tile_height;
+  ip->level[0].tiff_dir = 0;
+  ip->level[0].ready = TRUE;
+
+  // Reduced resolution images (internal overviews) are used for the levels they match
+  for ( guint16 dir = 1; TIFFSetDirectory ( tif, dir ); dir++ ) {
+    guint32 subfile_type = 0;
+    TIFFGetFieldDefaulted ( tif, TIFFTAG_SUBFILETYPE, &subfile_type );
+    if ( !(subfile_type & FILETYPE_REDUCEDIMAGE) || !TIFFIsTiled ( tif ) ||
+         !TIFFGetField ( tif, TIFFTAG_IMAGEWIDTH, &width ) || !TIFFGetField ( tif, TIFFTAG_IMAGELENGTH, &height ) ||
+         !TIFFGetField ( tif, TIFFTAG_TILEWIDTH, &tile_width ) || !TIFFGetField ( tif, TIFFTAG_TILELENGTH, &tile_height ) ||
+         !tile_width || !tile_height )
+      continue;
+    for ( guint level = 1; level < ip->levels; level++ ) {
+      PyramidLevel *lv = &ip->level[level];
+      // Allow for other rounding of the sizes
+      if ( lv->tiff_dir < 0 && ABS((gint)width - (gint)lv->width) <= 1 && ABS((gint)height - (gint)lv->height) <= 1 ) {
+        lv->width = width;
+        lv->height = height;
+        lv->tile_width = tile_width;
+        lv->tile_height = tile_height;
+        lv->tiff_dir = dir;
+        lv->ready = TRUE;
+        break;
+      }
+    }
+  }
+
+  ip->tiff = tif;
+  ip->tiff_mutex = vik_mutex_new ();
+  return TRUE;
+}
+
+/**
+ * Returns a new tile decoded from the TIFF (maybe NULL)
+ */
+static GdkPixbuf *read_tiff_tile ( ImagePyramid *ip, PyramidLevel *lv, gint tx, gint ty )
+{
+  const gint width = MIN ( lv->tile_width, lv->width - tx * lv->tile_width );
+  const gint height = MIN ( lv->tile_height, lv->height - ty * lv->tile_height );
+  if ( width <= 0 || height <= 0 )
+    return NULL;
+
+  guint32 *raster = g_try_malloc ( (gsize)lv->tile_width * lv->tile_height * sizeof(guint32) );
+  if ( !raster )
+    return NULL;
+  g_mutex_lock ( ip->tiff_mutex );
+  gboolean ok = TIFFSetDirectory ( ip->tiff, lv->tiff_dir ) &&
+                TIFFReadRGBATile ( ip->tiff, tx * lv->tile_width, ty * lv->tile_height, raster );
+  g_mutex_unlock ( ip->tiff_mutex );
+
+  GdkPixbuf *tile = ok ? gdk_pixbuf_new ( GDK_COLORSPACE_RGB, ip->has_alpha, 8, width, height ) : NULL;
+  if ( tile ) {
+    guchar *pixels = gdk_pixbuf_get_pixels ( tile );
+    const gint rowstride = gdk_pixbuf_get_rowstride ( tile );
+    const gint n_channels = gdk_pixbuf_get_n_channels ( tile );
+    for ( gint yy = 0; yy < height; yy++ ) {
+      // NB The raster starts from the bottom left
+      const guint32 *src = raster + (gsize)(lv->tile_height - 1 - yy) * lv->tile_width;
+      guchar *dest = pixels + yy * rowstride;
+      for ( gint xx = 0; xx < width; xx++, dest += n_channels ) {
+        dest[0] = TIFFGetR ( src[xx] );
+        dest[1] = TIFFGetG ( src[xx] );
+        dest[2] = TIFFGetB ( src[xx] );
+        if ( ip->has_alpha )
+          dest[3] = TIFFGetA ( src[xx] );
+      }
+    }
+  }
+  g_free ( raster );
+  return tile;
+}
+#endif
+
+/**
+ * Any cached levels are only used once all of them are complete
+ */
+static gboolean read_info ( ImagePyramid *ip )
+{
+  gchar *fn = g_build_filename ( ip->dir, PYRAMID_INFO_FILE, NULL );
+  gchar *contents = NULL;
+  gboolean ans = FALSE;
+  if ( g_file_get_contents ( fn, &contents, NULL, NULL ) ) {
+    guint width, height, levels, has_alpha;
+    if ( sscanf ( contents, "%u %u %u %u", &width, &height, &levels, &has_alpha ) == 4 &&
+         width == ip->width && height == ip->height && levels == ip->levels ) {
+      ip->has_alpha = has_alpha;
+      for ( guint level = 0; level < ip->levels; level++ )
+        ip->level[level].ready = TRUE;
+      ans = TRUE;
+    }
+    g_free ( contents );
+  }
+  g_free ( fn );
+  return ans;
+}
+
+static gboolean save_tile ( ImagePyramid *ip, GdkPixbuf *pixbuf, guint level, gint tx, gint ty )
+{
+  GError *gx = NULL;
+  gchar *buffer = NULL;
+  gsize size = 0;
+  gboolean ans;
+  if ( ip->has_alpha )
+    ans = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &gx, NULL );
+  else
+    ans = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "jpeg", &gx, "quality", "90", NULL );
+
+  // NB Written in one go, in case another layer of the same image is reading it
+  if ( ans ) {
+    gchar *key = tile_key ( level, tx, ty );
+    gchar *fn = tile_filename ( ip, key );
+    ans = g_file_set_contents ( fn, buffer, size, &gx );
+    g_free ( fn );
+    g_free ( key );
+  }
+  if ( gx ) {
+    g_warning ( "%s: %s", __FUNCTION__, gx->message );
+    g_error_free ( gx );
+  }
+  g_free ( buffer );
+  return ans;
+}
+
+/**
+ * Returns a new reference to the decoded tile (maybe NULL)
+ */
+static GdkPixbuf *get_tile ( ImagePyramid *ip, guint level, gint tx, gint ty )
+{
+  gchar *key = tile_key ( level, tx, ty );
+  gpointer stored_key = NULL;
+  GdkPixbuf *tile = NULL;
+
+  g_mutex_lock ( ip->mutex );
+  if ( g_hash_table_lookup_extended ( ip->tiles, key, &stored_key, (gpointer*)&tile ) ) {
+    g_object_ref ( tile );
+    g_queue_remove ( &ip->lru, stored_key );
+    g_queue_push_tail ( &ip->lru, stored_key );
+  }
+  g_mutex_unlock ( ip->mutex );
+
+  if ( !tile ) {
+#ifdef HAVE_LIBTIFF
+    if ( ip->level[level].tiff_dir >= 0 )
+      tile = read_tiff_tile ( ip, &ip->level[level], tx, ty );
+    else
+#endif
+    {
+      gchar *fn = tile_filename ( ip, key );
+      tile = gdk_pixbuf_new_from_file ( fn, NULL );
+      g_free ( fn );
+    }
+    if ( tile ) {
+      g_mutex_lock ( ip->mutex );
+      if ( !g_hash_table_contains ( ip->tiles, key ) ) {
+        if ( g_hash_table_size ( ip->tiles ) >= PYRAMID_MAX_TILES )
+          g_hash_table_remove ( ip->tiles, g_queue_pop_head ( &ip->lru ) );
+        g_hash_table_insert ( ip->tiles, key, g_object_ref ( tile ) );
+        g_queue_push_tail ( &ip->lru, key );
+        key = NULL;
+      }
+      g_mutex_unlock ( ip->mutex );
+    }
+  }
+  g_free ( key );
+  return tile;
+}
+
+/**
+ * The part of the level covering the area of the full image
+ *
+ * Returns: FALSE if there is none
+ */
+static gboolean level_area ( ImagePyramid *ip, guint level, gdouble src_x, gdouble src_y, gdouble src_width, gdouble src_height,
+                             gint *x0, gint *y0, gint *x1, gint *y1 )
+{
+  PyramidLevel *lv = &ip->level[level];
+  const gdouble xfactor = (gdouble)ip->width / lv->width;
+  const gdouble yfactor = (gdouble)ip->height / lv->height;
+  *x0 = MAX ( 0, (gint)floor ( src_x / xfactor ) );
+  *y0 = MAX ( 0, (gint)floor ( src_y / yfactor ) );
+  *x1 = MIN ( (gint)ceil ( (src_x + src_width) / xfactor ), (gint)lv->width );
+  *y1 = MIN ( (gint)ceil ( (src_y + src_height) / yfactor ), (gint)lv->height );
+  return *x1 > *x0 && *y1 > *y0;
+}
+
+/**
+ * Returns: A new image of the area of the full image, drawn from the level (maybe NULL)
+ */
+static GdkPixbuf *render_level ( ImagePyramid *ip, guint level, gdouble src_x, gdouble src_y, gdouble src_width, gdouble src_height,
+                                 gint dest_width, gint dest_height )
+{
+  gint x0, y0, x1, y1;
+  if ( !level_area ( ip, level, src_x, src_y, src_width, src_height, &x0, &y0, &x1, &y1 ) )
+    return NULL;
+
+  PyramidLevel *lv = &ip->level[level];
+  GdkPixbuf *area = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, ip->has_alpha, 8, x1 - x0, y1 - y0 );
+  if ( !area )
+    return NULL;
+  gdk_pixbuf_fill ( area, 0 );
+  const gint tw = lv->tile_width;
+  const gint th = lv->tile_height;
+  for ( gint ty = y0 / th; ty <= (y1 - 1) / th; ty++ ) {
+    for ( gint tx = x0 / tw; tx <= (x1 - 1) / tw; tx++ ) {
+      GdkPixbuf *tile = get_tile ( ip, level, tx, ty );
+      if ( !tile )
+        continue;
+      const gint ix0 = MAX ( x0, tx * tw );
+      const gint iy0 = MAX ( y0, ty * th );
+      const gint ix1 = MIN ( x1, tx * tw + gdk_pixbuf_get_width(tile) );
+      const gint iy1 = MIN ( y1, ty * th + gdk_pixbuf_get_height(tile) );
+      if ( ix1 > ix0 && iy1 > iy0 )
+        gdk_pixbuf_copy_area ( tile, ix0 - tx * tw, iy0 - ty * th, ix1 - ix0, iy1 - iy0,
+                               area, ix0 - x0, iy0 - y0 );
+      g_object_unref ( tile );
+    }
+  }
+
+  GdkPixbuf *ans = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, ip->has_alpha, 8, dest_width, dest_height );
+  if ( ans ) {
+    const gdouble xfactor = (gdouble)ip->width / lv->width;
+    const gdouble yfactor = (gdouble)ip->height / lv->height;
+    const gdouble xscale = dest_width * xfactor / src_width;
+    const gdouble yscale = dest_height * yfactor / src_height;
+    gdk_pixbuf_scale ( area, ans, 0, 0, dest_width, dest_height,
+                       -(src_x / xfactor - x0) * xscale, -(src_y / yfactor - y0) * yscale,
+                       xscale, yscale, GDK_INTERP_BILINEAR );
+  }
+  g_object_unref ( area );
+  return ans;
+}
+
+static void level_ready ( ImagePyramid *ip, guint level )
+{
+  g_atomic_int_set ( &ip->level[level].ready, TRUE );
+  g_mutex_lock ( ip->mutex );
+  if ( ip->vl )
+    vik_layer_emit_update ( ip->vl, FALSE ); // NB update from background thread
+  g_mutex_unlock ( ip->mutex );
+}
+
+static gboolean make_level_dir ( ImagePyramid *ip, guint level )
+{
+  gchar *level_dir = g_strdup_printf ( "%s" G_DIR_SEPARATOR_S "%u", ip->dir, level );
+  gboolean ans = g_mkdir_with_parents ( level_dir, 0777 ) == 0;
+  if ( !ans )
+    g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, level_dir );
+  g_free ( level_dir );
+  return ans;
+}
+
+/**
+ * Returns: FALSE if cancelled
+ */
+static gboolean generate_progress ( ImagePyramid *ip, GenerateProgress *gp )
+{
+  gboolean ans = TRUE;
+  g_mutex_lock ( ip->mutex );
+  if ( ip->cancelled )
+    ans = FALSE;
+  g_mutex_unlock ( ip->mutex );
+  if ( a_background_thread_progress ( gp->threaddata, (gdouble)++gp->done / gp->total ) != 0 )
+    ans = FALSE;
+  return ans;
+}
+
+/**
+ * Cut the levels from first to last into tiles,
+ *  starting with the pixbuf which is the size of the first
+ */
+static gboolean generate_from_pixbuf ( ImagePyramid *ip, GdkPixbuf *pixbuf, guint first, guint last, GenerateProgress *gp )
+{
+  gboolean ok = TRUE;
+  g_object_ref ( pixbuf );
+  for ( guint level = first; ok && level <= last; level++ ) {
+    ok = make_level_dir ( ip, level );
+    const gint width = gdk_pixbuf_get_width ( pixbuf );
+    const gint height = gdk_pixbuf_get_height ( pixbuf );
+    for ( gint ty = 0; ok && ty * PYRAMID_TILE_SIZE < height; ty++ ) {
+      for ( gint tx = 0; ok && tx * PYRAMID_TILE_SIZE < width; tx++ ) {
+        GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf ( pixbuf, tx * PYRAMID_TILE_SIZE, ty * PYRAMID_TILE_SIZE,
+                                                    MIN(PYRAMID_TILE_SIZE, width - tx * PYRAMID_TILE_SIZE),
+                                                    MIN(PYRAMID_TILE_SIZE, height - ty * PYRAMID_TILE_SIZE) );
+        ok = sub && save_tile ( ip, sub, level, tx, ty );
+        if ( sub )
+          g_object_unref ( sub );
+        if ( !generate_progress ( ip, gp ) )
+          ok = FALSE;
+      }
+    }
+    if ( ok )
+      level_ready ( ip, level );
+
+    if ( ok && level < last ) {
+      GdkPixbuf *next = gdk_pixbuf_scale_simple ( pixbuf, ip->level[level+1].width, ip->level[level+1].height, GDK_INTERP_BILINEAR );
+      g_object_unref ( pixbuf );
+      pixbuf = next;
+      ok = pixbuf != NULL;
+    }
+  }
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  return ok;
+}
+
+/**
+ * Generate the level a tile at a time from the one before,
+ *  so the memory needed does not depend on the size of the image
+ */
+static gboolean generate_from_level ( ImagePyramid *ip, guint level, GenerateProgress *gp )
+{
+  PyramidLevel *lv = &ip->level[level];
+  const gdouble xfactor = (gdouble)ip->width / lv->width;
+  const gdouble yfactor = (gdouble)ip->height / lv->height;
+  gboolean ok = make_level_dir ( ip, level );
+  for ( gint ty = 0; ok && ty * PYRAMID_TILE_SIZE < (gint)lv->height; ty++ ) {
+    for ( gint tx = 0; ok && tx * PYRAMID_TILE_SIZE < (gint)lv->width; tx++ ) {
+      const gint width = MIN ( PYRAMID_TILE_SIZE, (gint)lv->width - tx * PYRAMID_TILE_SIZE );
+      const gint height = MIN ( PYRAMID_TILE_SIZE, (gint)lv->height - ty * PYRAMID_TILE_SIZE );
+      GdkPixbuf *tile = render_level ( ip, level - 1,
+                                       tx * PYRAMID_TILE_SIZE * xfactor, ty * PYRAMID_TILE_SIZE * yfactor,
+                                       width * xfactor, height * yfactor, width, height );
+      ok = tile && save_tile ( ip, tile, level, tx, ty );
+      if ( tile )
+        g_object_unref ( tile );
+      if ( !generate_progress ( ip, gp ) )
+        ok = FALSE;
+    }
+  }
+  if ( ok )
+    level_ready ( ip, level );
+  return ok;
+}
+
+/**
+ * Returns a new image decoded from the file at the size given (maybe NULL)
+ */
+static GdkPixbuf *decode_image ( ImagePyramid *ip, guint width, guint height )
+{
+  GError *gx = NULL;
+  GdkPixbuf *pixbuf;
+  if ( width == ip->width && height == ip->height )
+    pixbuf = gdk_pixbuf_new_from_file ( ip->filename, &gx );
+  else
+    pixbuf = gdk_pixbuf_new_from_file_at_scale ( ip->filename, width, height, FALSE, &gx );
+  if ( !pixbuf ) {
+    g_warning ( "%s: %s", __FUNCTION__, gx ? gx->message : ip->filename );
+    if ( gx )
+      g_error_free ( gx );
+    return NULL;
+  }
+  if ( gdk_pixbuf_get_width ( pixbuf ) != (gint)width || gdk_pixbuf_get_height ( pixbuf ) != (gint)height ) {
+    g_warning ( "%s: Unexpected size of %s", __FUNCTION__, ip->filename );
+    g_object_unref ( pixbuf );
+    return NULL;
+  }
+  return pixbuf;
+}
+
+/**
+ * Returns -1 on failure or cancellation
+ */
+static int generate_thread ( ImagePyramid *ip, gpointer threaddata )
+{
+  GenerateProgress gp = { threaddata, 0, 0 };
+  for ( guint level = 0; level < ip->levels; level++ )
+    if ( !ip->level[level].ready )
+      gp.total += level_tiles ( &ip->level[level] );
+
+  gboolean ok = TRUE;
+#ifdef HAVE_LIBTIFF
+  if ( ip->tiff ) {
+    for ( guint level = 1; ok && level < ip->levels; level++ )
+      if ( !ip->level[level].ready )
+        ok = generate_from_level ( ip, level, &gp );
+  }
+  else
+#endif
+  {
+    // The smaller levels from a reduced decode first
+    guint quick = 0;
+    while ( quick + 1 < ip->levels && MAX(ip->level[quick].width, ip->level[quick].height) > PYRAMID_QUICK_SIZE )
+      quick++;
+    GdkPixbuf *pixbuf = decode_image ( ip, ip->level[quick].width, ip->level[quick].height );
+    ok = pixbuf != NULL;
+    if ( ok ) {
+      ip->has_alpha = gdk_pixbuf_get_has_alpha ( pixbuf );
+      ok = generate_from_pixbuf ( ip, pixbuf, quick, ip->levels - 1, &gp );
+      g_object_unref ( pixbuf );
+    }
+    if ( ok && quick > 0 ) {
+      pixbuf = decode_image ( ip, ip->width, ip->height );
+      ok = pixbuf && gdk_pixbuf_get_has_alpha ( pixbuf ) == ip->has_alpha;
+      if ( ok )
+        ok = generate_from_pixbuf ( ip, pixbuf, 0, quick - 1, &gp );
+      if ( pixbuf )
+        g_object_unref ( pixbuf );
+    }
+  }
+
+  // Only complete overviews are used next time
+  if ( ok ) {
+    gchar *fn = g_build_filename ( ip->dir, PYRAMID_INFO_FILE, NULL );
+    gchar *contents = g_strdup_printf ( "%u %u %u %u\n", ip->width, ip->height, ip->levels, ip->has_alpha ? 1 : 0 );
+    ok = g_file_set_contents ( fn, contents, -1, NULL );
+    g_free ( contents );
+    g_free ( fn );
+  }
+  return ok ? 0 : -1;
+}
+
+/**
+ * image_pyramid_new:
+ * @filename: The image
+ * @vl:       The layer to redraw as more of the overviews become available
+ * @parent:   Window for the background progress
+ *
+ * Uses the overviews cached for the image if they are up to date,
+ *  otherwise generates them in the background.
+ *
+ * Returns: NULL if the image can't be accessed
+ */
+ImagePyramid *image_pyramid_new ( const gchar *filename, VikLayer *vl, GtkWindow *parent )
+{
+  GStatBuf stat_buf;
+  if ( g_stat ( filename, &stat_buf ) != 0 )
+    return NULL;
+
+  // A changed image gets new overviews
+  gchar *id = g_strdup_printf ( "%s %" G_GINT64_FORMAT " %" G_GINT64_FORMAT, filename, (gint64)stat_buf.st_size, (gint64)stat_buf.st_mtime );
+  gchar *md5 = md5_hash ( id );
+  g_free ( id );
+
+  ImagePyramid *ip = g_new0 ( ImagePyramid, 1 );
+  ip->ref_count = 1;
+  ip->mutex = vik_mutex_new ();
+  ip->filename = g_strdup ( filename );
+  ip->dir = g_build_filename ( g_get_user_cache_dir(), "viking", "georef", md5, NULL );
+  ip->vl = vl;
+  ip->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_object_unref );
+  g_queue_init ( &ip->lru );
+  g_free ( md5 );
+
+  gboolean opened = FALSE;
+#ifdef HAVE_LIBTIFF
+  opened = open_tiff ( ip );
+#endif
+  if ( !opened ) {
+    gint width, height;
+    if ( !gdk_pixbuf_get_file_info ( filename, &width, &height ) || width <= 0 || height <= 0 ) {
+      image_pyramid_unref ( ip );
+      return NULL;
+    }
+    ip->width = width;
+    ip->height = height;
+    setup_levels ( ip );
+  }
+
+  guint level;
+  for ( level = 0; level < ip->levels && ip->level[level].ready; level++ );
+  if ( level < ip->levels && !read_info ( ip ) ) {
+    g_atomic_int_inc ( &ip->ref_count );
+    gchar *basename = g_path_get_basename ( filename );
+    gchar *msg = g_strdup_printf ( _("Generating overviews of %s"), basename );
+    a_background_thread ( BACKGROUND_POOL_LOCAL, parent, msg,
+                          (vik_thr_func) generate_thread,
+                          ip, (vik_thr_free_func) image_pyramid_unref, NULL,
+                          1 );
+    g_free ( msg );
+    g_free ( basename );
+  }
+  return ip;
+}
+
+/**
+ * image_pyramid_free:
+ *
+ * Any generation still in progress is stopped
+ */
+void image_pyramid_free ( ImagePyramid *ip )
+{
+  if ( !ip )
+    return;
+  g_mutex_lock ( ip->mutex );
+  ip->vl = NULL;
+  ip->cancelled = TRUE;
+  g_mutex_unlock ( ip->mutex );
+  image_pyramid_unref ( ip );
+}
+
+/**
+ * image_pyramid_is_ready:
+ *
+ * Returns: TRUE once any level can be drawn
+ */
+gboolean image_pyramid_is_ready ( ImagePyramid *ip )
+{
+  for ( guint level = 0; level < ip->levels; level++ )
+    if ( g_atomic_int_get ( &ip->level[level].ready ) )
+      return TRUE;
+  return FALSE;
+}
+
+/**
+ * image_pyramid_get_size:
+ *
+ * The size of the full image
+ */
+void image_pyramid_get_size ( ImagePyramid *ip, guint *width, guint *height )
+{
+  *width = ip->width;
+  *height = ip->height;
+}
+
+/**
+ * image_pyramid_render:
+ * @src_x:       Area of the full image wanted
+ * @src_y:
+ * @src_width:
+ * @src_height:
+ * @dest_width:  The size to draw it at
+ * @dest_height:
+ *
+ * Thread safe
+ *
+ * Returns: A new image of the area (maybe NULL)
+ */
+GdkPixbuf *image_pyramid_render ( ImagePyramid *ip, gint src_x, gint src_y, gint src_width, gint src_height, gint dest_width, gint dest_height )
+{
+  if ( src_width <= 0 || src_height <= 0 || dest_width <= 0 || dest_height <= 0 )
+    return NULL;
+
+  // The smallest level that still has the resolution wanted
+  const gdouble scale = MIN ( (gdouble)src_width / dest_width, (gdouble)src_height / dest_height );
+  guint wanted = 0;
+  while ( wanted + 1 < ip->levels && (gdouble)ip->width / ip->level[wanted+1].width <= scale )
+    wanted++;
+
+  // Otherwise the nearest that is available:
+  //  a more detailed one if that does not mean decoding too many tiles, else a less detailed one
+  gint level = -1;
+  for ( gint ll = wanted; level < 0 && ll >= 0; ll-- ) {
+    gint x0, y0, x1, y1;
+    if ( g_atomic_int_get ( &ip->level[ll].ready ) &&
+         level_area ( ip, ll, src_x, src_y, src_width, src_height, &x0, &y0, &x1, &y1 ) &&
+         ((x1 - 1) / ip->level[ll].tile_width - x0 / ip->level[ll].tile_width + 1) *
+         ((y1 - 1) / ip->level[ll].tile_height - y0 / ip->level[ll].tile_height + 1) <= PYRAMID_MAX_TILES / 2 )
+      level = ll;
+  }
+  for ( guint ll = wanted + 1; level < 0 && ll < ip->levels; ll++ )
+    if ( g_atomic_int_get ( &ip->level[ll].ready ) )
+      level = ll;
+  if ( level < 0 )
+    return NULL;
+
+  return render_level ( ip, level, src_x, src_y, src_width, src_height, dest_width, dest_height );
+}
@@ -0,0 +1,42 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_IMAGE_PYRAMID_H
+#define _VIKING_IMAGE_PYRAMID_H
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "viklayer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ImagePyramid ImagePyramid;
+
+ImagePyramid *image_pyramid_new ( const gchar *filename, VikLayer *vl, GtkWindow *parent );
+void image_pyramid_free ( ImagePyramid *ip );
+
+gboolean image_pyramid_is_ready ( ImagePyramid *ip );
+void image_pyramid_get_size ( ImagePyramid *ip, guint *width, guint *height );
+
+GdkPixbuf *image_pyramid_render ( ImagePyramid *ip, gint src_x, gint src_y, gint src_width, gint src_height, gint dest_width, gint dest_height );
+
+G_END_DECLS
+
+#endif
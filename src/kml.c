@@ -24,6 +24,9 @@
 #include "viking.h"
 #include <expat.h>
 #include "ctype.h"
+#include "misc/strtod.h"
+
+#define KML_READ_BUFFER_SIZE 65536
 
 typedef enum {
 	KML_COLOR_MODE_NORMAL=0,
@@ -46,9 +49,27 @@ typedef struct {
 	// <heading>, <icon>, <hotspot>
 } AnyStyle;
 
+// Longest text of a single coordinate value
+#define KML_COORD_MAX 64
+
+/**
+ * State of reading the coordinates of a LineString as the text arrives,
+ *  so that even huge ones never have to be held in memory
+ */
+typedef struct {
+	gboolean active;
+	gboolean failed;     // Give up on the rest after bad text
+	gboolean newseg;
+	gchar text[KML_COORD_MAX]; // Of the value being read
+	guint len;
+	gdouble values[3];
+	guint val;
+} KmlCoordStream;
+
 typedef struct {
 	GString *c_cdata;
 	gboolean use_cdata;
+	KmlCoordStream coords;
 	gchar *name;
 	gchar *snippet;
 	gchar *desc;
@@ -296,68 +317,81 @@ static void point_start ( xml_data *xd, const char *el, const char **attr )
 	xd->waypoint = vik_waypoint_new();
 }
 
-static void linestring_coordinates_end ( xml_data *xd, const char *el )
+static void coords_value_end ( KmlCoordStream *cs )
 {
-	if ( xd->track ) {
-		gchar *ptr = xd->c_cdata->str;
-		if ( ptr ) {
-			int len = strlen(ptr);
-			gchar *endptr = ptr + len;
-			gchar *cp;
-			for ( cp = ptr; cp < endptr; cp++ )
-				if ( !isspace(*cp) )
-					break;
-
-			gboolean newseg = TRUE;
-			int val = 0;
-			gdouble values[3];
-			gchar *vp;
-			for ( vp = cp; cp <= endptr; cp++ ) {
-				if ( *cp == ',' ) {
-					// Get string before this comma
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-					val++;
-					vp = cp + 1; // +1 for the next one after the comma
-				} else if ( cp == NULL || isspace(*cp) ) {
-					if ( val < 1 || val > 2 )
-						// Not enough or too many coordinate parts
-						goto end;
-					// Otherwise the value is to end of text block
-					//  (should be the last coordinate part)
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-
-					VikTrackpoint *tp = vik_trackpoint_new();
-					// Remember KML coordinates are the 'lon,lat(,alt)' order
-					set_vc_to_ll ( xd, &(tp->coord), xd->vtl, values[1], values[0] );
-					if ( val == 2 )
-						// ATM altitude is always interpreted to be in absolute mode (to sea level)
-						tp->altitude = values[2];
-					if ( newseg ) {
-						tp->newsegment = TRUE;
-						newseg = FALSE;
-					}
+	cs->text[cs->len] = '\0';
+	if ( cs->val < G_N_ELEMENTS(cs->values) )
+		cs->values[cs->val] = strtod_i8n ( cs->text, NULL );
+	cs->val++;
+	cs->len = 0;
+}
 
-					xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+static void coords_point_end ( xml_data *xd )
+{
+	KmlCoordStream *cs = &xd->coords;
+	coords_value_end ( cs );
+	if ( cs->val < 2 || cs->val > 3 ) {
+		// Not enough or too many coordinate parts
+		cs->failed = TRUE;
+		return;
+	}
+	if ( xd->track ) {
+		VikTrackpoint *tp = vik_trackpoint_new();
+		// Remember KML coordinates are the 'lon,lat(,alt)' order
+		set_vc_to_ll ( xd, &(tp->coord), xd->vtl, cs->values[1], cs->values[0] );
+		if ( cs->val == 3 )
+			// ATM altitude is always interpreted to be in absolute mode (to sea level)
+			tp->altitude = cs->values[2];
+		if ( cs->newseg ) {
+			tp->newsegment = TRUE;
+			cs->newseg = FALSE;
+		}
+		xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+	}
+	cs->val = 0;
+}
 
-					// Consume any extra space to get to the next coordinate part
-					while ( cp != NULL && isspace(*cp) )
-						cp++;
-					val = 0;
-					vp = cp;
-				}
-			}
+/**
+ * Split the coordinates into points as the text arrives
+ *  (which may be anywhere within a value)
+ */
+static void coords_cdata ( xml_data *xd, const XML_Char *ss, int len )
+{
+	KmlCoordStream *cs = &xd->coords;
+	int ii;
+	for ( ii = 0; ii < len && !cs->failed; ii++ ) {
+		gchar cc = ss[ii];
+		if ( cc == ',' )
+			coords_value_end ( cs );
+		else if ( isspace(cc) ) {
+			// Consume any extra space to get to the next coordinate part
+			if ( cs->len || cs->val )
+				coords_point_end ( xd );
 		}
+		else if ( cs->len < KML_COORD_MAX-1 )
+			cs->text[cs->len++] = cc;
+		else
+			cs->failed = TRUE;
 	}
-	else
-		g_warning ( "%s: no track", G_STRLOC );
+}
+
+static void linestring_coordinates_start ( xml_data *xd )
+{
+	memset ( &xd->coords, 0, sizeof(KmlCoordStream) );
+	xd->coords.active = TRUE;
+	xd->coords.newseg = TRUE;
+	// The text is consumed as it arrives rather than gathered
+	xd->use_cdata = FALSE;
+}
 
-end:
+static void linestring_coordinates_end ( xml_data *xd, const char *el )
+{
+	if ( !xd->track )
+		g_warning ( "%s: no track", G_STRLOC );
+	// Any last point not followed by space
+	else if ( !xd->coords.failed && (xd->coords.len || xd->coords.val) )
+		coords_point_end ( xd );
+	xd->coords.active = FALSE;
 	end_leaf_tag ( xd );
 }
 
@@ -407,6 +441,7 @@ static void linestring_start ( xml_data *xd, const char *el, const char **attr )
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
 		setup_to_read_leaf_tag ( xd, linestring_end, linestring_coordinates_end );
+		linestring_coordinates_start ( xd );
 	}
 }
 
@@ -427,6 +462,7 @@ static void linearring_start ( xml_data *xd, const char *el, const char **attr )
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
 		setup_to_read_leaf_tag ( xd, linearring_end, linestring_coordinates_end );
+		linestring_coordinates_start ( xd );
 	}
 }
 
@@ -717,14 +753,9 @@ static void multitrack_end ( xml_data *xd, const char *el )
 		if ( xd->tracks ) {
 			// Copy first track - so its not freed when the list of tracks are
 			xd->track = vik_track_copy ( VIK_TRACK(xd->tracks->data), TRUE );
-			guint count = 1;
-			for ( GList *gl = xd->tracks; gl != NULL; gl = gl->next ) {
-				// Don't append the first track to itself
-				if ( count > 1 ) {
-					vik_track_steal_and_append_trackpoints ( xd->track, VIK_TRACK(gl->data) );
-				}
-				count++;
-			}
+			vik_track_calculate_bounds ( xd->track );
+			// Don't append the first track to itself
+			vik_track_steal_and_append_tracks ( xd->track, xd->tracks->next );
 			vik_trw_layer_filein_add_track ( xd->vtl, NULL, xd->track );
 			xd->track = NULL;
 			g_list_free_full ( xd->tracks, (GDestroyNotify)vik_track_free );
@@ -911,22 +942,24 @@ static void kml_end ( xml_data *xd, const char *el )
 
 static void kml_cdata ( xml_data *xd, const XML_Char *ss, int len )
 {
-	if ( xd->use_cdata ) {
+	if ( xd->coords.active ) {
+		coords_cdata ( xd, ss, len );
+	}
+	else if ( xd->use_cdata ) {
 		g_string_append_len ( xd->c_cdata, ss, len );
 	}
 }
 
 /**
- * a_kml_read_file:
- * @FILE: The KML file to open
+ * a_kml_read_stream:
  * @VikTrwLayer: The Layer to put the geo data in
+ * @read_func:   Supplies the KML data a block at a time (e.g. as it is decompressed)
  *
  * Returns:
  *  TRUE on success
  */
-gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
+gboolean a_kml_read_stream ( VikTrwLayer *vtl, UtilReadFunc read_func, gpointer user_data, gboolean external )
 {
-	gchar buffer[4096];
 	XML_Parser parser = XML_ParserCreate(NULL);
 	enum XML_Status status = XML_STATUS_ERROR;
 
@@ -960,9 +993,17 @@ gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
 
 	int done=0, len;
 	while ( !done ) {
-		len = fread ( buffer, 1, sizeof(buffer)-7, ff );
-		done = feof ( ff ) || !len;
-		status = XML_Parse ( parser, buffer, len, done );
+		void *buffer = XML_GetBuffer ( parser, KML_READ_BUFFER_SIZE );
+		if ( !buffer ) {
+			status = XML_STATUS_ERROR;
+			break;
+		}
+		gssize got = read_func ( user_data, buffer, KML_READ_BUFFER_SIZE );
+		len = got > 0 ? got : 0;
+		done = !len;
+		status = XML_ParseBuffer ( parser, len, done );
+		if ( status == XML_STATUS_ERROR )
+			break;
 	}
 
 	gboolean ans = (status != XML_STATUS_ERROR);
@@ -979,3 +1020,24 @@ gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
 	g_free ( xd );
 	return ans;
 }
+
+static gssize kml_fread ( FILE *ff, void *buffer, gsize size )
+{
+	size_t len = fread ( buffer, 1, size, ff );
+	if ( len == 0 && ferror(ff) )
+		return -1;
+	return len;
+}
+
+/**
+ * a_kml_read_file:
+ * @FILE: The KML file to open
+ * @VikTrwLayer: The Layer to put the geo data in
+ *
+ * Returns:
+ *  TRUE on success
+ */
+gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
+{
+	return a_kml_read_stream ( vtl, (UtilReadFunc)kml_fread, ff, external );
+}
@@ -22,10 +22,12 @@
 #define _VIKING_KML_H
 
 #include "viktrwlayer.h"
+#include "util.h"
 
 G_BEGIN_DECLS
 
 gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external );
+gboolean a_kml_read_stream ( VikTrwLayer *vtl, UtilReadFunc read_func, gpointer user_data, gboolean external );
 
 G_END_DECLS
 
@@ -0,0 +1,314 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * The time zones of known places (from the latlontz.txt files) for finding the time zone
+ *  of the nearest place to any position.
+ *
+ * The places are held as a static k-d tree packed into one array, in which the middle
+ *  of each range is the node that splits the rest of that range into its two subtrees.
+ *  With no pointers this is saved to a cache file as is, so after the first time
+ *  loading is just mapping that file; rebuilding whenever the text files change.
+ *
+ * Cache file layout (native byte order, as only used on the machine that makes it):
+ *  header:  "VIKLLTZ" and NUL, then guint32 version, byte order mark, node count,
+ *           strings size, and the signature of the text files it was made from
+ *  nodes:   node count of LatLonTzNode, in tree order
+ *  strings: the NUL terminated time zone names the nodes refer to
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "latlontz.h"
+
+#define LLTZ_MAGIC "VIKLLTZ"
+#define LLTZ_VERSION 1
+#define LLTZ_BYTE_ORDER 0x01020304
+#define LLTZ_SIGNATURE_SIZE 48
+
+typedef struct {
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 nodes;
+  guint32 strings_size;
+  gchar signature[LLTZ_SIGNATURE_SIZE];
+} LatLonTzHeader;
+
+typedef struct {
+  gdouble pt[2];  // Latitude, longitude
+  guint32 name;   // Offset into the strings
+  guint32 unused;
+} LatLonTzNode;
+
+struct _VikLatLonTz {
+  GMappedFile *mapped; // When loaded from the cache
+  gchar *buffer;       // Otherwise
+  const LatLonTzNode *nodes;
+  guint32 count;
+  const gchar *strings;
+};
+
+/**
+ * Identify the text files by their names, sizes and modification times,
+ *  so any change to them means the cache is no longer used
+ */
+static void files_signature ( gchar **files, gchar signature[LLTZ_SIGNATURE_SIZE] )
+{
+  GString *gs = g_string_new ( NULL );
+  for ( guint ii = 0; files[ii]; ii++ ) {
+    GStatBuf stat_buf;
+    if ( g_stat ( files[ii], &stat_buf ) == 0 )
+      g_string_append_printf ( gs, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n",
+                               files[ii], (gint64)stat_buf.st_size, (gint64)stat_buf.st_mtime );
+  }
+  gchar *sum = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, gs->str, gs->len );
+  memset ( signature, 0, LLTZ_SIGNATURE_SIZE );
+  g_strlcpy ( signature, sum, LLTZ_SIGNATURE_SIZE );
+  g_free ( sum );
+  g_string_free ( gs, TRUE );
+}
+
+static gboolean lltz_from_cache ( VikLatLonTz *lltz, const gchar *cache_file, const gchar *signature )
+{
+  GMappedFile *mapped = g_mapped_file_new ( cache_file, FALSE, NULL );
+  if ( !mapped )
+    return FALSE;
+
+  gsize size = g_mapped_file_get_length ( mapped );
+  const gchar *contents = g_mapped_file_get_contents ( mapped );
+  const LatLonTzHeader *header = (const LatLonTzHeader*)contents;
+  if ( size < sizeof(LatLonTzHeader) ||
+       memcmp ( header->magic, LLTZ_MAGIC, sizeof(header->magic) ) ||
+       header->version != LLTZ_VERSION ||
+       header->byte_order != LLTZ_BYTE_ORDER ||
+       memcmp ( header->signature, signature, LLTZ_SIGNATURE_SIZE ) ||
+       size != sizeof(LatLonTzHeader) + (gsize)header->nodes * sizeof(LatLonTzNode) + header->strings_size ||
+       (header->strings_size && contents[size-1] != '\0') ) {
+    g_mapped_file_unref ( mapped );
+    return FALSE;
+  }
+
+  lltz->nodes = (const LatLonTzNode*)(contents + sizeof(LatLonTzHeader));
+  lltz->count = header->nodes;
+  lltz->strings = contents + sizeof(LatLonTzHeader) + header->nodes * sizeof(LatLonTzNode);
+  for ( guint32 nn = 0; nn < lltz->count; nn++ ) {
+    if ( lltz->nodes[nn].name >= header->strings_size ) {
+      g_mapped_file_unref ( mapped );
+      return FALSE;
+    }
+  }
+  lltz->mapped = mapped;
+  return TRUE;
+}
+
+/**
+ * Read each "lat lon timezone" line of the text files
+ */
+static void read_text_files ( gchar **files, GArray *nodes, GString *strings )
+{
+  GHashTable *offsets = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  for ( guint ii = 0; files[ii]; ii++ ) {
+    FILE *ff = g_fopen ( files[ii], "r" );
+    if ( !ff ) {
+      g_warning ( "%s: Could not open %s", __FUNCTION__, files[ii] );
+      continue;
+    }
+    gchar buffer[4096];
+    long line_num = 0;
+    while ( fgets ( buffer, sizeof(buffer), ff ) ) {
+      line_num++;
+      gchar **components = g_strsplit ( buffer, " ", 3 );
+      if ( g_strv_length ( components ) == 3 ) {
+        LatLonTzNode node;
+        node.pt[0] = g_ascii_strtod ( components[0], NULL );
+        node.pt[1] = g_ascii_strtod ( components[1], NULL );
+        node.unused = 0;
+        gchar *timezone = g_strchomp ( components[2] );
+        gpointer offset;
+        if ( g_hash_table_lookup_extended ( offsets, timezone, NULL, &offset ) )
+          node.name = GPOINTER_TO_UINT ( offset );
+        else {
+          node.name = strings->len;
+          g_string_append_len ( strings, timezone, strlen(timezone)+1 );
+          g_hash_table_insert ( offsets, g_strdup(timezone), GUINT_TO_POINTER(node.name) );
+        }
+        g_array_append_val ( nodes, node );
+      }
+      else
+        g_warning ( "Line %ld of %s does not have 3 parts", line_num, files[ii] );
+      g_strfreev ( components );
+    }
+    fclose ( ff );
+  }
+  g_hash_table_destroy ( offsets );
+}
+
+static gint node_compare_lat ( const LatLonTzNode *aa, const LatLonTzNode *bb )
+{
+  return aa->pt[0] < bb->pt[0] ? -1 : aa->pt[0] > bb->pt[0];
+}
+
+static gint node_compare_lon ( const LatLonTzNode *aa, const LatLonTzNode *bb )
+{
+  return aa->pt[1] < bb->pt[1] ? -1 : aa->pt[1] > bb->pt[1];
+}
+
+/**
+ * Arrange the range so its middle node splits it on the axis for this depth,
+ *  then likewise for each half
+ */
+static void tree_build ( LatLonTzNode *nodes, guint32 count, guint depth )
+{
+  if ( count < 2 )
+    return;
+  qsort ( nodes, count, sizeof(LatLonTzNode), (GCompareFunc)(depth % 2 ? node_compare_lon : node_compare_lat) );
+  guint32 mid = count / 2;
+  tree_build ( nodes, mid, depth+1 );
+  tree_build ( nodes+mid+1, count-mid-1, depth+1 );
+}
+
+static void lltz_write_cache ( VikLatLonTz *lltz, const gchar *cache_file, const gchar *signature, gsize strings_size )
+{
+  LatLonTzHeader header;
+  memset ( &header, 0, sizeof(header) );
+  memcpy ( header.magic, LLTZ_MAGIC, sizeof(header.magic) );
+  header.version = LLTZ_VERSION;
+  header.byte_order = LLTZ_BYTE_ORDER;
+  header.nodes = lltz->count;
+  header.strings_size = strings_size;
+  memcpy ( header.signature, signature, LLTZ_SIGNATURE_SIZE );
+
+  GString *gs = g_string_sized_new ( sizeof(header) + lltz->count * sizeof(LatLonTzNode) + strings_size );
+  g_string_append_len ( gs, (const gchar*)&header, sizeof(header) );
+  g_string_append_len ( gs, (const gchar*)lltz->nodes, lltz->count * sizeof(LatLonTzNode) );
+  g_string_append_len ( gs, lltz->strings, strings_size );
+
+  GError *error = NULL;
+  if ( !g_file_set_contents ( cache_file, gs->str, gs->len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_string_free ( gs, TRUE );
+}
+
+/**
+ * vik_latlontz_new:
+ * @files:      The latlontz.txt files to use
+ * @cache_file: Where the tree made from them is kept, maybe NULL to not keep it
+ */
+VikLatLonTz *vik_latlontz_new ( gchar **files, const gchar *cache_file )
+{
+  VikLatLonTz *lltz = g_malloc0 ( sizeof(VikLatLonTz) );
+
+  gchar signature[LLTZ_SIGNATURE_SIZE];
+  files_signature ( files, signature );
+  if ( cache_file && lltz_from_cache ( lltz, cache_file, signature ) )
+    return lltz;
+
+  GArray *nodes = g_array_new ( FALSE, FALSE, sizeof(LatLonTzNode) );
+  GString *strings = g_string_new ( NULL );
+  read_text_files ( files, nodes, strings );
+  tree_build ( (LatLonTzNode*)nodes->data, nodes->len, 0 );
+
+  // Keep nodes and strings together in one buffer, as they are in the cache
+  gsize nodes_size = nodes->len * sizeof(LatLonTzNode);
+  lltz->buffer = g_malloc ( nodes_size + strings->len + 1 );
+  memcpy ( lltz->buffer, nodes->data, nodes_size );
+  memcpy ( lltz->buffer + nodes_size, strings->str, strings->len + 1 );
+  lltz->nodes = (const LatLonTzNode*)lltz->buffer;
+  lltz->count = nodes->len;
+  lltz->strings = lltz->buffer + nodes_size;
+
+  if ( cache_file && lltz->count )
+    lltz_write_cache ( lltz, cache_file, signature, strings->len );
+
+  g_array_free ( nodes, TRUE );
+  g_string_free ( strings, TRUE );
+  return lltz;
+}
+
+void vik_latlontz_free ( VikLatLonTz *lltz )
+{
+  if ( !lltz )
+    return;
+  if ( lltz->mapped )
+    g_mapped_file_unref ( lltz->mapped );
+  g_free ( lltz->buffer );
+  g_free ( lltz );
+}
+
+guint vik_latlontz_size ( VikLatLonTz *lltz )
+{
+  return lltz->count;
+}
+
+typedef struct {
+  gdouble pt[2];
+  gdouble best_sq;
+  const LatLonTzNode *best;
+} NearestSearch;
+
+static void tree_nearest ( const LatLonTzNode *nodes, guint32 count, guint depth, NearestSearch *ns )
+{
+  while ( count ) {
+    guint32 mid = count / 2;
+    const LatLonTzNode *node = &nodes[mid];
+    gdouble dlat = ns->pt[0] - node->pt[0];
+    gdouble dlon = ns->pt[1] - node->pt[1];
+    gdouble dist_sq = dlat*dlat + dlon*dlon;
+    if ( dist_sq < ns->best_sq ) {
+      ns->best_sq = dist_sq;
+      ns->best = node;
+    }
+    guint axis = depth % 2;
+    gdouble diff = ns->pt[axis] - node->pt[axis];
+    depth++;
+    // Search the side the point is on first, then the other side if it could be any nearer
+    if ( diff < 0 ) {
+      tree_nearest ( nodes, mid, depth, ns );
+      if ( diff*diff >= ns->best_sq )
+        return;
+      nodes = nodes+mid+1;
+      count = count-mid-1;
+    }
+    else {
+      tree_nearest ( nodes+mid+1, count-mid-1, depth, ns );
+      if ( diff*diff >= ns->best_sq )
+        return;
+      count = mid;
+    }
+  }
+}
+
+/**
+ * vik_latlontz_nearest:
+ * @max_distance: In degrees (treating latitude and longitude alike)
+ *
+ * Returns: The time zone of the nearest place closer than max_distance, otherwise NULL
+ */
+const gchar *vik_latlontz_nearest ( VikLatLonTz *lltz, gdouble lat, gdouble lon, gdouble max_distance )
+{
+  NearestSearch ns = { { lat, lon }, max_distance*max_distance, NULL };
+  tree_nearest ( lltz->nodes, lltz->count, 0, &ns );
+  return ns.best ? lltz->strings + ns.best->name : NULL;
+}
@@ -0,0 +1,37 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_LATLONTZ_H
+#define __VIKING_LATLONTZ_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikLatLonTz VikLatLonTz;
+
+VikLatLonTz *vik_latlontz_new ( gchar **files, const gchar *cache_file );
+void vik_latlontz_free ( VikLatLonTz *lltz );
+
+guint vik_latlontz_size ( VikLatLonTz *lltz );
+const gchar *vik_latlontz_nearest ( VikLatLonTz *lltz, gdouble lat, gdouble lon, gdouble max_distance );
+
+G_END_DECLS
+
+#endif
@@ -27,11 +27,17 @@
 #include "viking.h"
 #include "icons/icons.h"
 #include "mapcache.h"
+#include "tileindex.h"
+#include "trackcache.h"
+#include "tilebundle.h"
+#include "cachejanitor.h"
 #include "background.h"
 #include "dems.h"
 #include "babel.h"
 #include "curl_download.h"
 #include "logging.h"
+#include "perfstats.h"
+#include "tracelog.h"
 #include "vikdemlayer.h"
 #include "vikmapslayer.h"
 #include "vikgeoreflayer.h"
@@ -43,6 +49,11 @@
 #include "modules.h"
 #include "dir.h"
 #include "socket.h"
+#include "autosave.h"
+#include "benchrender.h"
+#ifdef VIK_CONFIG_GEOTAG
+#include "geotag_exif.h"
+#endif
 
 /* FIXME LOCALEDIR must be configured by ./configure --localedir */
 /* But something does not work actually. */
@@ -60,6 +71,11 @@ static gint map_id = G_MININT;
 static gboolean external = FALSE;
 static gchar *confdir = NULL;
 static gboolean running_instance = FALSE;
+static gchar *bench_render = NULL;
+
+// For the startup timing report with --debug
+static GTimer *startup_timer = NULL;
+static gdouble startup_last = 0.0;
 
 /* Options */
 static GOptionEntry entries[] =
@@ -76,6 +92,7 @@ static GOptionEntry entries[] =
 #ifdef G_OS_UNIX
   { "running-instance", 'r', 0, G_OPTION_ARG_NONE, &running_instance, N_("Open file(s) in an existing running instance"), NULL },
 #endif
+  { "bench-render", 0, 0, G_OPTION_ARG_FILENAME, &bench_render, N_("Time drawing the layers for the views in SCRIPT ('-' for a default sequence), then exit"), N_("SCRIPT") },
   { NULL }
 };
 
@@ -123,6 +140,46 @@ gboolean check_for_geo_uri ( char *argv )
   return FALSE;
 }
 
+/**
+ * Report how long startup has taken since the previous step
+ */
+static void startup_step ( const gchar *step )
+{
+  if ( !vik_debug )
+    return;
+  gdouble now = g_timer_elapsed ( startup_timer, NULL );
+  g_debug ( "Startup: %-28s %8.1fms (total %8.1fms)", step, (now - startup_last) * 1000.0, now * 1000.0 );
+  startup_last = now;
+}
+
+static gboolean babel_features_probed ( gpointer data )
+{
+  startup_step ( "gpsbabel features probed" );
+  vik_window_babel_features_probed ();
+  return FALSE;
+}
+
+/**
+ * As an idle of lower priority than redrawing, this runs after the window has first been drawn
+ */
+static gboolean startup_first_drawn ( gpointer data )
+{
+  startup_step ( "first window drawn" );
+  // Only needed for some menus and dialogs, so find what GPSBabel can do now the window is there
+  a_babel_probe_features ( babel_features_probed, NULL );
+  return FALSE;
+}
+
+/**
+ * After the loaded files have been drawn, the rendering benchmark runs instead of normal interaction
+ */
+static gboolean bench_render_idle ( gpointer data )
+{
+  (void)a_bench_render_run ( VIK_WINDOW(data), bench_render );
+  gtk_main_quit ();
+  return FALSE;
+}
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
@@ -131,6 +188,8 @@ int main( int argc, char *argv[] )
   GError *error = NULL;
   gboolean gui_initialized;
 
+  startup_timer = g_timer_new ();
+
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
@@ -195,6 +254,8 @@ int main( int argc, char *argv[] )
   vik_icons_register_resource ();
   ui_load_icons();
 
+  startup_step ( "gtk and icons" );
+
   a_settings_init ();
   a_preferences_init ();
   a_thumbnails_init ();
@@ -216,13 +277,19 @@ int main( int argc, char *argv[] )
   curl_download_init();
 
   a_babel_init ();
+  startup_step ( "preferences and downloads" );
 
   /* Init modules/plugins */
   modules_init();
+  startup_step ( "modules" );
 
   vik_georef_layer_init ();
+  a_tileindex_init ();
+  a_tilebundle_init ();
+  a_cachejanitor_init ();
   maps_layer_init ();
   vik_dem_layer_init ();
+  a_dems_init ();
   a_mapcache_init ();
   a_background_init ();
 
@@ -233,6 +300,7 @@ int main( int argc, char *argv[] )
 
   // Registration of preferences has now been done
   a_preferences_finished_registering();
+  startup_step ( "layers and caches" );
 
   /*
    * Second stage initialization
@@ -240,12 +308,14 @@ int main( int argc, char *argv[] )
    * Can now use a_preferences_get()
    */
   a_background_post_init ();
+  a_trackcache_init ();
   a_babel_post_init ();
   modules_post_init ();
 
   // May need to initialize the Positonal TimeZone lookup
   if ( a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
     vu_setup_lat_lon_tz_lookup();
+  startup_step ( "second stage" );
 
   /* Set the icon */
   GdkPixbuf *main_icon = ui_get_icon ( "viking", 48 );
@@ -253,14 +323,17 @@ int main( int argc, char *argv[] )
     gtk_window_set_default_icon(main_icon);
 
   // Ask for confirmation of default settings on first run
-  vu_set_auto_features_on_first_run ();
+  if ( !bench_render )
+    vu_set_auto_features_on_first_run ();
 
   /* Create the first window */
   first_window = vik_window_new_window();
+  startup_step ( "first window" );
 
   a_logging_update();
 
-  vu_check_latest_version ( GTK_WINDOW(first_window) );
+  if ( !bench_render )
+    vu_check_latest_version ( GTK_WINDOW(first_window) );
 
   // Load startup file first so that subsequent files are loaded on top
   // Especially so that new tracks+waypoints will be above any maps in a startup file
@@ -301,10 +374,19 @@ int main( int argc, char *argv[] )
 
   vu_command_line ( first_window, latitude, longitude, zoom_level_osm, map_id );
 
-  (void)socket_init ( first_window );
+  // Only when the sole instance, as otherwise the journals could belong to a running one
+  if ( socket_init ( first_window ) && !bench_render )
+    vik_window_autosave_recover_untitled ( first_window );
+  startup_step ( "files loaded" );
+
+  g_idle_add ( startup_first_drawn, NULL );
+  if ( bench_render )
+    g_idle_add ( bench_render_idle, first_window );
 
   gtk_main ();
 
+  g_timer_destroy ( startup_timer );
+
   vik_trwlayer_uninit ();
   vik_aggregate_layer_uninit ();
   a_babel_uninit ();
@@ -312,9 +394,19 @@ int main( int argc, char *argv[] )
   a_background_uninit ();
   maps_layer_uninit ();
   a_mapcache_uninit ();
+  a_perfstats_uninit ();
+  a_tracelog_uninit ();
+  a_trackcache_uninit ();
+  a_cachejanitor_uninit ();
+  a_tilebundle_uninit ();
+  a_tileindex_uninit ();
   a_dems_uninit ();
   a_layer_defaults_uninit ();
   a_thumbnails_uninit ();
+#ifdef VIK_CONFIG_GEOTAG
+  a_geotag_uninit ();
+#endif
+  a_autosave_uninit ();
   a_preferences_uninit ();
   a_settings_uninit ();
 
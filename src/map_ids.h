@@ -31,6 +31,12 @@
 
 #define MAP_ID_MAPNIK_RENDER 7
 
+// Not a map source, DEM layer drawings in the mapcache
+#define MAP_ID_DEM_RENDER 8
+
+// Not a map source, Aggregate layer heatmap drawings in the mapcache
+#define MAP_ID_HEATMAP_RENDER 9
+
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
 #define MAP_ID_BLUE_MARBLE 15
@@ -28,44 +28,118 @@
 #include "mapcache.h"
 #include "preferences.h"
 #include "vik_compat.h"
+#include "perfstats.h"
 
-#define MC_KEY_SIZE 64
+#include <math.h>
 
-typedef struct _List {
-  struct _List *next;
-  gchar *key;
-} List;
+/**
+ * Fixed size binary key - no allocation or string formatting is needed to look up a tile.
+ * Shrinkfactors are quantised to thousandths (the resolution the old string key used)
+ *  and the layer name is reduced to a small interned id.
+ */
+typedef struct {
+  gint x;
+  gint y;
+  gint z;
+  gint zoom;
+  gint32 xshrink;
+  gint32 yshrink;
+  guint32 name_id;
+  guint16 type;
+  guint8 alpha;
+} mapcache_key_t;
+
+typedef struct _cache_item_t cache_item_t;
+
+struct _cache_item_t {
+  mapcache_key_t key;
+  GdkPixbuf *pixbuf;
+  mapcache_extra_t extra;
+  guint32 size;
+  // LRU list - head is the most recently used
+  cache_item_t *lru_prev;
+  cache_item_t *lru_next;
+  // All items of the same map type
+  cache_item_t *type_prev;
+  cache_item_t *type_next;
+  // All items of the same tile (i.e. differing only by alpha or shrinkfactors)
+  cache_item_t *tile_prev;
+  cache_item_t *tile_next;
+};
 
-/* a circular linked list, a pointer to the tail, and the tail points to the head */
-/* this is so we can free the last */
-static List *queue_tail = NULL;
-static int queue_count = 0;
+/**
+ * The cache is split into independently locked shards,
+ *  so the drawing, download and rendering threads rarely wait on each other.
+ * A tile (with all its alpha and shrinkfactor variants) always lives in the same shard,
+ *  as the shard is selected by the tile hash.
+ * Each shard evicts on its own share of the overall memory allowance.
+ */
+#define MC_SHARDS 16
+
+typedef struct {
+  GMutex *mutex;
+  // Main lookup: key -> item
+  GHashTable *cache;
+  // Secondary indexes: map type -> first item, tile -> first item
+  GHashTable *type_index;
+  GHashTable *tile_index;
+  cache_item_t *lru_head;
+  cache_item_t *lru_tail;
+  guint32 size;
+  // Statistics
+  guint contended; // Number of times the lock was already held when wanted
+  guint hits;
+  guint misses;
+} mapcache_shard_t;
+
+static mapcache_shard_t shards[MC_SHARDS];
 
-static guint32 cache_size = 0;
 static guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
 
-static GHashTable *cache = NULL;
+// Interned layer names: name -> id
+//  read mostly, so a reader/writer lock is used
+static GHashTable *name_ids = NULL;
+static guint32 name_id_next = 1;
+static GRWLock name_lock;
 
-typedef struct {
-  GdkPixbuf *pixbuf;
-  mapcache_extra_t extra;
-} cache_item_t;
+/**
+ * Optional second tier holding the original encoded (PNG/JPEG etc...) file bytes of a tile.
+ * These are much smaller than the decoded pixbufs,
+ *  so many more tiles can be held and then decoded from memory rather than read from disk again.
+ * Keyed by the tile only (alpha and shrinkfactors are applied after decoding).
+ */
+typedef struct _encoded_item_t encoded_item_t;
+
+struct _encoded_item_t {
+  mapcache_key_t key;
+  GBytes *bytes;
+  time_t mtime;
+  encoded_item_t *lru_prev;
+  encoded_item_t *lru_next;
+};
 
-static GMutex *mc_mutex = NULL;
+static GMutex *enc_mutex = NULL;
+static GHashTable *enc_cache = NULL;
+static encoded_item_t *enc_lru_head = NULL;
+static encoded_item_t *enc_lru_tail = NULL;
+static gsize enc_size = 0;
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-%d-"
-#define HASHKEY_FORMAT_STRING_TYPE "%d-"
+// Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
+#define MC_ITEM_OVERHEAD 100
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
  { 1, 4096, 4, 0 },
+ { 0, 4096, 4, 0 },
 };
 
 static VikLayerParamData mcs_default ( void ) { return VIK_LPD_UINT(VIK_CONFIG_MAPCACHE_SIZE); }
+static VikLayerParamData mces_default ( void ) { return VIK_LPD_UINT(0); }
 
 static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL, NULL, mcs_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache compressed tiles memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[1], NULL,
+    N_("Additional memory for keeping the original compressed tile data, so tiles can be decoded again without reading from disk. 0 disables this."), mces_default, NULL, NULL },
 };
 
 static void cache_item_free (cache_item_t *ci)
@@ -75,73 +149,369 @@ static void cache_item_free (cache_item_t *ci)
   g_free ( ci );
 }
 
+static void encoded_item_free (encoded_item_t *ei)
+{
+  g_bytes_unref ( ei->bytes );
+  g_free ( ei );
+}
+
+static guint key_hash ( gconstpointer ptr )
+{
+  const mapcache_key_t *key = ptr;
+  guint hash = (guint)key->x;
+  hash = (hash * 31) + (guint)key->y;
+  hash = (hash * 31) + (guint)key->z;
+  hash = (hash * 31) + (guint)key->zoom;
+  hash = (hash * 31) + (guint)key->type;
+  hash = (hash * 31) + key->name_id;
+  hash = (hash * 31) + (guint)key->alpha;
+  hash = (hash * 31) + (guint)key->xshrink;
+  hash = (hash * 31) + (guint)key->yshrink;
+  return hash;
+}
+
+static gboolean key_equal ( gconstpointer aa, gconstpointer bb )
+{
+  const mapcache_key_t *a = aa;
+  const mapcache_key_t *b = bb;
+  return a->x == b->x && a->y == b->y && a->z == b->z && a->zoom == b->zoom &&
+         a->type == b->type && a->name_id == b->name_id && a->alpha == b->alpha &&
+         a->xshrink == b->xshrink && a->yshrink == b->yshrink;
+}
+
+// Tile hashing ignores the alpha and shrinkfactors
+static guint tile_hash ( gconstpointer ptr )
+{
+  const mapcache_key_t *key = ptr;
+  guint hash = (guint)key->x;
+  hash = (hash * 31) + (guint)key->y;
+  hash = (hash * 31) + (guint)key->z;
+  hash = (hash * 31) + (guint)key->zoom;
+  hash = (hash * 31) + (guint)key->type;
+  hash = (hash * 31) + key->name_id;
+  return hash;
+}
+
+static gboolean tile_equal ( gconstpointer aa, gconstpointer bb )
+{
+  const mapcache_key_t *a = aa;
+  const mapcache_key_t *b = bb;
+  return a->x == b->x && a->y == b->y && a->z == b->z && a->zoom == b->zoom &&
+         a->type == b->type && a->name_id == b->name_id;
+}
+
 void a_mapcache_init ()
 {
-  a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  a_preferences_register ( &prefs[1], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    mapcache_shard_t *sh = &shards[i];
+    memset ( sh, 0, sizeof(mapcache_shard_t) );
+    sh->mutex = vik_mutex_new ();
+    sh->cache = g_hash_table_new_full ( key_hash, key_equal, NULL, (GDestroyNotify) cache_item_free );
+    sh->type_index = g_hash_table_new ( g_direct_hash, g_direct_equal );
+    sh->tile_index = g_hash_table_new ( tile_hash, tile_equal );
+  }
+  g_rw_lock_init ( &name_lock );
+  name_ids = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+  enc_mutex = vik_mutex_new ();
+  enc_cache = g_hash_table_new_full ( key_hash, key_equal, NULL, (GDestroyNotify) encoded_item_free );
+}
+
+/**
+ * Returns 0 for no name; otherwise the id for the name,
+ *  or if not yet known and create is FALSE then G_MAXUINT32
+ *  (which will never match anything in the cache).
+ */
+static guint32 name_to_id ( const gchar *name, gboolean create )
+{
+  if ( !name )
+    return 0;
+  g_rw_lock_reader_lock ( &name_lock );
+  gpointer id = g_hash_table_lookup ( name_ids, name );
+  g_rw_lock_reader_unlock ( &name_lock );
+  if ( id )
+    return GPOINTER_TO_UINT(id);
+  if ( !create )
+    return G_MAXUINT32;
+
+  g_rw_lock_writer_lock ( &name_lock );
+  // Check again in case another thread added it in the meantime
+  id = g_hash_table_lookup ( name_ids, name );
+  if ( !id ) {
+    id = GUINT_TO_POINTER(name_id_next++);
+    g_hash_table_insert ( name_ids, g_strdup(name), id );
+  }
+  g_rw_lock_writer_unlock ( &name_lock );
+  return GPOINTER_TO_UINT(id);
+}
+
+static void key_fill ( mapcache_key_t *key, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, guint32 name_id )
+{
+  key->x = x;
+  key->y = y;
+  key->z = z;
+  key->zoom = zoom;
+  key->type = type;
+  key->alpha = alpha;
+  key->xshrink = (gint32)lround ( xshrinkfactor * 1000.0 );
+  key->yshrink = (gint32)lround ( yshrinkfactor * 1000.0 );
+  key->name_id = name_id;
+}
+
+/**
+ * Returns the shard for the key, with its mutex locked.
+ */
+static mapcache_shard_t *shard_lock ( const mapcache_key_t *key )
+{
+  mapcache_shard_t *sh = &shards[tile_hash(key) % MC_SHARDS];
+  if ( !g_mutex_trylock ( sh->mutex ) ) {
+    g_atomic_int_inc ( &sh->contended );
+    g_mutex_lock ( sh->mutex );
+  }
+  return sh;
+}
+
+static void lru_unlink ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  if ( ci->lru_prev )
+    ci->lru_prev->lru_next = ci->lru_next;
+  else
+    sh->lru_head = ci->lru_next;
+  if ( ci->lru_next )
+    ci->lru_next->lru_prev = ci->lru_prev;
+  else
+    sh->lru_tail = ci->lru_prev;
+  ci->lru_prev = ci->lru_next = NULL;
+}
+
+static void lru_push_head ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  ci->lru_prev = NULL;
+  ci->lru_next = sh->lru_head;
+  if ( sh->lru_head )
+    sh->lru_head->lru_prev = ci;
+  sh->lru_head = ci;
+  if ( !sh->lru_tail )
+    sh->lru_tail = ci;
+}
+
+static void lru_touch ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  if ( ci != sh->lru_head ) {
+    lru_unlink ( sh, ci );
+    lru_push_head ( sh, ci );
+  }
+}
+
+static void index_link ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  // Type chain
+  cache_item_t *head = g_hash_table_lookup ( sh->type_index, GUINT_TO_POINTER((guint)ci->key.type) );
+  ci->type_prev = NULL;
+  ci->type_next = head;
+  if ( head )
+    head->type_prev = ci;
+  g_hash_table_insert ( sh->type_index, GUINT_TO_POINTER((guint)ci->key.type), ci );
+
+  // Tile chain
+  //  the hash table key lives inside the head item, hence use replace so the key pointer is updated too
+  head = g_hash_table_lookup ( sh->tile_index, &ci->key );
+  ci->tile_prev = NULL;
+  ci->tile_next = head;
+  if ( head )
+    head->tile_prev = ci;
+  g_hash_table_replace ( sh->tile_index, &ci->key, ci );
+}
 
-  mc_mutex = vik_mutex_new ();
-  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cache_item_free );
+static void index_unlink ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  if ( ci->type_prev )
+    ci->type_prev->type_next = ci->type_next;
+  else {
+    if ( ci->type_next )
+      g_hash_table_insert ( sh->type_index, GUINT_TO_POINTER((guint)ci->key.type), ci->type_next );
+    else
+      g_hash_table_remove ( sh->type_index, GUINT_TO_POINTER((guint)ci->key.type) );
+  }
+  if ( ci->type_next )
+    ci->type_next->type_prev = ci->type_prev;
+
+  if ( ci->tile_prev )
+    ci->tile_prev->tile_next = ci->tile_next;
+  else {
+    if ( ci->tile_next )
+      g_hash_table_replace ( sh->tile_index, &ci->tile_next->key, ci->tile_next );
+    else
+      g_hash_table_remove ( sh->tile_index, &ci->key );
+  }
+  if ( ci->tile_next )
+    ci->tile_next->tile_prev = ci->tile_prev;
+}
+
+/**
+ * Must be called with the shard mutex held.
+ * Removes the item from all lists and indexes and frees it.
+ */
+static void cache_remove ( mapcache_shard_t *sh, cache_item_t *ci )
+{
+  sh->size -= ci->size;
+  lru_unlink ( sh, ci );
+  index_unlink ( sh, ci );
+  g_hash_table_remove ( sh->cache, &ci->key );
 }
 
-static void cache_add(gchar *key, GdkPixbuf *pixbuf, mapcache_extra_t extra)
+static void cache_add ( mapcache_shard_t *sh, const mapcache_key_t *key, GdkPixbuf *pixbuf, mapcache_extra_t extra )
 {
-  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
+  cache_item_t *old = g_hash_table_lookup ( sh->cache, key );
+  if ( old )
+    cache_remove ( sh, old );
+
+  cache_item_t *ci = g_malloc0 ( sizeof(cache_item_t) );
+  ci->key = *key;
   ci->pixbuf = pixbuf;
   ci->extra = extra;
-  if ( g_hash_table_insert ( cache, key, ci ) )
-  {
-    // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
-    if ( pixbuf ) {
-      cache_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
-      // Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
-      cache_size += 100;
-    }
-  }
+  // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
+  if ( pixbuf )
+    ci->size = gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf) + MC_ITEM_OVERHEAD;
+
+  g_hash_table_insert ( sh->cache, &ci->key, ci );
+  lru_push_head ( sh, ci );
+  index_link ( sh, ci );
+  sh->size += ci->size;
+}
+
+static void shard_flush ( mapcache_shard_t *sh )
+{
+  g_hash_table_remove_all ( sh->type_index );
+  g_hash_table_remove_all ( sh->tile_index );
+  g_hash_table_remove_all ( sh->cache );
+  sh->lru_head = sh->lru_tail = NULL;
+  sh->size = 0;
+}
+
+/**
+ * Must be called with the enc_mutex held.
+ */
+static void encoded_remove ( encoded_item_t *ei )
+{
+  if ( ei->lru_prev )
+    ei->lru_prev->lru_next = ei->lru_next;
+  else
+    enc_lru_head = ei->lru_next;
+  if ( ei->lru_next )
+    ei->lru_next->lru_prev = ei->lru_prev;
+  else
+    enc_lru_tail = ei->lru_prev;
+  enc_size -= g_bytes_get_size ( ei->bytes ) + MC_ITEM_OVERHEAD;
+  g_hash_table_remove ( enc_cache, &ei->key );
 }
 
-static void cache_remove(const gchar *key)
+static void encoded_flush_matching ( gboolean all, guint16 type )
 {
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if (ci && ci->pixbuf) {
-    cache_size -= gdk_pixbuf_get_rowstride(ci->pixbuf) * gdk_pixbuf_get_height(ci->pixbuf);
-    cache_size -= 100;
-    g_hash_table_remove ( cache, key );
+  g_mutex_lock ( enc_mutex );
+  encoded_item_t *ei = enc_lru_head;
+  while ( ei ) {
+    encoded_item_t *next = ei->lru_next;
+    if ( all || ei->key.type == type )
+      encoded_remove ( ei );
+    ei = next;
   }
+  g_mutex_unlock ( enc_mutex );
 }
 
-/* returns key from head, adds on newtailkey to tail. */
-static gchar *list_shift_add_entry ( gchar *newtailkey )
+static gsize encoded_max_size ( void )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  queue_tail->next->key = newtailkey;
-  queue_tail = queue_tail->next;
-  return oldheadkey;
+  return (gsize)a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u * 1024 * 1024;
 }
 
-static gchar *list_shift ()
+/**
+ * Whether the compressed tile tier is in use
+ */
+gboolean a_mapcache_encoded_enabled ()
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  List *oldhead = queue_tail->next;
-  queue_tail->next = queue_tail->next->next;
-  g_free ( oldhead );
-  queue_count--;
-  return oldheadkey;
+  return encoded_max_size() > 0;
 }
 
-/* adds key to tail */
-static void list_add_entry ( gchar *key )
+/**
+ * a_mapcache_encoded_add:
+ * @bytes: The encoded image file data - a reference is taken
+ * @mtime: The modification time of the file the data came from
+ *
+ * Keep the original compressed tile data, so it can be decoded again
+ *  without having to read it from disk.
+ */
+void a_mapcache_encoded_add ( GBytes *bytes, time_t mtime, gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name )
 {
-  List *newlist = g_malloc ( sizeof ( List ) );
-  newlist->key = key;
-  if ( queue_tail ) {
-    newlist->next = queue_tail->next;
-    queue_tail->next = newlist;
-    queue_tail = newlist;
-  } else {
-    newlist->next = newlist;
-    queue_tail = newlist;
+  gsize max_size = encoded_max_size();
+  if ( !max_size || !bytes )
+    return;
+
+  mapcache_key_t key;
+  key_fill ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name_to_id(name, TRUE) );
+
+  g_mutex_lock ( enc_mutex );
+  encoded_item_t *ei = g_hash_table_lookup ( enc_cache, &key );
+  if ( ei )
+    encoded_remove ( ei );
+
+  ei = g_malloc0 ( sizeof(encoded_item_t) );
+  ei->key = key;
+  ei->bytes = g_bytes_ref ( bytes );
+  ei->mtime = mtime;
+  ei->lru_next = enc_lru_head;
+  if ( enc_lru_head )
+    enc_lru_head->lru_prev = ei;
+  enc_lru_head = ei;
+  if ( !enc_lru_tail )
+    enc_lru_tail = ei;
+  g_hash_table_insert ( enc_cache, &ei->key, ei );
+  enc_size += g_bytes_get_size ( bytes ) + MC_ITEM_OVERHEAD;
+
+  while ( enc_size > max_size && enc_lru_tail != enc_lru_head )
+    encoded_remove ( enc_lru_tail );
+  g_mutex_unlock ( enc_mutex );
+}
+
+/**
+ * a_mapcache_encoded_get:
+ * @mtime: If not NULL, returns the modification time of the file the data came from
+ *
+ * Returns: A new reference to the encoded tile data (use g_bytes_unref() when finished),
+ *  or NULL if not held.
+ */
+GBytes *a_mapcache_encoded_get ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name, time_t *mtime )
+{
+  if ( !a_mapcache_encoded_enabled() )
+    return NULL;
+
+  mapcache_key_t key;
+  GBytes *bytes = NULL;
+  key_fill ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name_to_id(name, FALSE) );
+
+  g_mutex_lock ( enc_mutex );
+  encoded_item_t *ei = g_hash_table_lookup ( enc_cache, &key );
+  if ( ei ) {
+    // Move to the head of the LRU
+    if ( ei != enc_lru_head ) {
+      ei->lru_prev->lru_next = ei->lru_next;
+      if ( ei->lru_next )
+        ei->lru_next->lru_prev = ei->lru_prev;
+      else
+        enc_lru_tail = ei->lru_prev;
+      ei->lru_prev = NULL;
+      ei->lru_next = enc_lru_head;
+      enc_lru_head->lru_prev = ei;
+      enc_lru_head = ei;
+    }
+    bytes = g_bytes_ref ( ei->bytes );
+    if ( mtime )
+      *mtime = ei->mtime;
   }
-  queue_count++;
+  g_mutex_unlock ( enc_mutex );
+  return bytes;
 }
 
 /**
@@ -160,38 +530,36 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
     }
   }
 
-  guint nn = name ? g_str_hash ( name ) : 0;
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  mapcache_key_t key;
+  key_fill ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name_to_id(name, TRUE) );
 
-  g_mutex_lock(mc_mutex);
+  // TODO: that should be done on preference change only...
+  max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
+  guint32 shard_max = max_cache_size / MC_SHARDS;
 
   if ( pixbuf )
     g_object_ref(pixbuf);
-  cache_add(key, pixbuf, extra);
-
-  // TODO: that should be done on preference change only...
-  max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
 
-  if ( cache_size > max_cache_size ) {
-    if ( queue_tail ) {
-      gchar *oldkey = list_shift_add_entry ( key );
-      cache_remove(oldkey);
+  mapcache_shard_t *sh = shard_lock ( &key );
+  cache_add ( sh, &key, pixbuf, extra );
 
-      while ( cache_size > max_cache_size &&
-             (queue_tail->next != queue_tail) ) { /* make sure there's more than one thing to delete */
-        oldkey = list_shift ();
-        cache_remove(oldkey);
-      }
-    }
-    /* chop off 'start' etc */
-  } else {
-    list_add_entry ( key );
-    /* business as usual */
+  // Evict least recently used items, but always keep the newly added one
+  guint evicted = 0;
+  while ( sh->size > shard_max && sh->lru_tail != sh->lru_head ) {
+    cache_remove ( sh, sh->lru_tail );
+    evicted++;
   }
-  g_mutex_unlock(mc_mutex);
 
-  static int tmp = 0;
-  if ( (++tmp == 100 )) { g_debug("DEBUG: cache count=%d size=%u list count=%d", g_hash_table_size(cache), cache_size, queue_count ); tmp=0; }
+  g_mutex_unlock ( sh->mutex );
+
+  if ( evicted )
+    a_perfstats_count ( "mapcache", "evictions", evicted );
+
+  static gint tmp = 0;
+  if ( g_atomic_int_add ( &tmp, 1 ) == 99 ) {
+    g_debug ( "DEBUG: cache count=%d size=%u contended=%u", a_mapcache_get_count(), a_mapcache_get_size(), a_mapcache_get_contended() );
+    g_atomic_int_set ( &tmp, 0 );
+  }
 }
 
 /**
@@ -201,78 +569,37 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
  */
 GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  g_mutex_lock(mc_mutex); /* prevent returning pixbuf when cache is being cleared */
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
+  mapcache_key_t key;
+  GdkPixbuf *pixbuf = NULL;
+  key_fill ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name_to_id(name, FALSE) );
+  mapcache_shard_t *sh = shard_lock ( &key ); /* prevent returning pixbuf when cache is being cleared */
+  cache_item_t *ci = g_hash_table_lookup ( sh->cache, &key );
   if ( ci ) {
-    if ( ci->pixbuf )
-      g_object_ref(ci->pixbuf);
-    g_mutex_unlock(mc_mutex);
-    return ci->pixbuf;
-  } else {
-    g_mutex_unlock(mc_mutex);
-    return NULL;
+    lru_touch ( sh, ci );
+    pixbuf = ci->pixbuf;
+    if ( pixbuf )
+      g_object_ref(pixbuf);
   }
+  if ( pixbuf )
+    sh->hits++;
+  else
+    sh->misses++;
+  g_mutex_unlock ( sh->mutex );
+  a_perfstats_count ( "mapcache", pixbuf ? "hits" : "misses", 1 );
+  return pixbuf;
 }
 
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
+  mapcache_key_t key;
+  mapcache_extra_t extra = { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
+  key_fill ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name_to_id(name, FALSE) );
+  mapcache_shard_t *sh = shard_lock ( &key );
+  cache_item_t *ci = g_hash_table_lookup ( sh->cache, &key );
   if ( ci )
-    return ci->extra;
-  else
-    return (mapcache_extra_t) { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
-}
-
-/**
- * Common function to remove cache items for keys starting with the specified string
- */
-static void flush_matching ( gchar *str )
-{
-  g_mutex_lock(mc_mutex);
-
-  if ( queue_tail == NULL ) {
-    g_mutex_unlock(mc_mutex);
-    return;
-  }
-
-  // The 'loop' variable must be assigned within the mutex lock section,
-  //  otherwise where it points to might not be valid anymore when the actual processing occurs
-  List *loop = queue_tail;
-  List *tmp;
-  gint len = strlen(str);
-
-  do {
-    tmp = loop->next;
-    if ( tmp ) {
-    if ( strncmp(tmp->key, str, len) == 0 )
-    {
-      cache_remove(tmp->key);
-      if ( tmp == loop ) /* we deleted the last thing in the queue! */
-        loop = queue_tail = NULL;
-      else {
-        loop->next = tmp->next;
-        if ( tmp == queue_tail )
-          queue_tail = tmp->next;
-      }
-      g_free ( tmp );
-      tmp = NULL;
-      queue_count--;
-    }
-    else
-      loop = tmp;
-    } else
-      loop = NULL;
-  } while ( loop && (loop != queue_tail || tmp == NULL) );
-  /* loop thru list, looking for the one, compare first whatever chars */
-
-  cache_remove(str);
-  g_mutex_unlock(mc_mutex);
+    extra = ci->extra;
+  g_mutex_unlock ( sh->mutex );
+  return extra;
 }
 
 /**
@@ -280,32 +607,31 @@ static void flush_matching ( gchar *str )
  */
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
 {
-  char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, type, x, y, z, zoom, nn );
-  flush_matching ( key );
+  mapcache_key_t key;
+  key_fill ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name_to_id(name, FALSE) );
+  mapcache_shard_t *sh = shard_lock ( &key );
+  cache_item_t *ci;
+  while ( (ci = g_hash_table_lookup ( sh->tile_index, &key )) )
+    cache_remove ( sh, ci );
+  g_mutex_unlock ( sh->mutex );
+
+  // The original data is now out of date too
+  g_mutex_lock ( enc_mutex );
+  encoded_item_t *ei = g_hash_table_lookup ( enc_cache, &key );
+  if ( ei )
+    encoded_remove ( ei );
+  g_mutex_unlock ( enc_mutex );
 }
 
 void a_mapcache_flush ()
 {
-  // Everything happens within the mutex lock section
-  g_mutex_lock(mc_mutex);
-
-  List *loop = queue_tail;
-  List *tmp;
-
-  while ( loop ) {
-    tmp = loop->next;
-    cache_remove(tmp->key);
-    if ( tmp == queue_tail ) /* we deleted the last thing in the queue */
-      loop = queue_tail = NULL;
-    else
-      loop->next = tmp->next;
-    g_free ( tmp );
-    tmp = NULL;
+  // Everything happens within the mutex lock section of each shard
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    g_mutex_lock ( shards[i].mutex );
+    shard_flush ( &shards[i] );
+    g_mutex_unlock ( shards[i].mutex );
   }
-
-  g_mutex_unlock(mc_mutex);
+  encoded_flush_matching ( TRUE, 0 );
 }
 
 /**
@@ -317,27 +643,147 @@ void a_mapcache_flush ()
  */
 void a_mapcache_flush_type ( guint16 type )
 {
-  char key[MC_KEY_SIZE];
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_TYPE, type );
-  flush_matching ( key );
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    mapcache_shard_t *sh = &shards[i];
+    g_mutex_lock ( sh->mutex );
+    cache_item_t *ci;
+    while ( (ci = g_hash_table_lookup ( sh->type_index, GUINT_TO_POINTER((guint)type) )) )
+      cache_remove ( sh, ci );
+    g_mutex_unlock ( sh->mutex );
+  }
+  encoded_flush_matching ( FALSE, type );
 }
 
 void a_mapcache_uninit ()
 {
-  g_hash_table_destroy ( cache );
-  /* free list */
-  cache = NULL;
-  vik_mutex_free (mc_mutex);
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    mapcache_shard_t *sh = &shards[i];
+    shard_flush ( sh );
+    g_hash_table_destroy ( sh->type_index );
+    g_hash_table_destroy ( sh->tile_index );
+    g_hash_table_destroy ( sh->cache );
+    vik_mutex_free ( sh->mutex );
+    sh->cache = NULL;
+  }
+  g_hash_table_destroy ( name_ids );
+  name_ids = NULL;
+  g_rw_lock_clear ( &name_lock );
+
+  g_hash_table_destroy ( enc_cache );
+  enc_cache = NULL;
+  enc_lru_head = enc_lru_tail = NULL;
+  enc_size = 0;
+  vik_mutex_free ( enc_mutex );
 }
 
 // Size of mapcache in memory
 guint a_mapcache_get_size ()
 {
-  return cache_size;
+  guint size = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    g_mutex_lock ( shards[i].mutex );
+    size += shards[i].size;
+    g_mutex_unlock ( shards[i].mutex );
+  }
+  return size;
+}
+
+/**
+ * a_mapcache_get_size_type:
+ *
+ * Returns: The size of the images held for the map type
+ */
+gsize a_mapcache_get_size_type ( guint16 type )
+{
+  gsize size = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    mapcache_shard_t *sh = &shards[i];
+    g_mutex_lock ( sh->mutex );
+    cache_item_t *ci;
+    for ( ci = g_hash_table_lookup ( sh->type_index, GUINT_TO_POINTER((guint)type) ); ci; ci = ci->type_next )
+      size += ci->size;
+    g_mutex_unlock ( sh->mutex );
+  }
+  return size;
+}
+
+/**
+ * a_mapcache_trim:
+ * @bytes: How much to release
+ *
+ * Evict the least recently used images below the configured cache size,
+ *  e.g. to keep within the overall memory budget.
+ * Each shard gives up its share.
+ *
+ * Returns: The amount released
+ */
+gsize a_mapcache_trim ( gsize bytes )
+{
+  gsize freed = 0;
+  gsize shard_bytes = bytes / MC_SHARDS + 1;
+  guint evicted = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    mapcache_shard_t *sh = &shards[i];
+    gsize shard_freed = 0;
+    g_mutex_lock ( sh->mutex );
+    // Always keep the most recently used one
+    while ( shard_freed < shard_bytes && sh->lru_tail != sh->lru_head ) {
+      shard_freed += sh->lru_tail->size;
+      cache_remove ( sh, sh->lru_tail );
+      evicted++;
+    }
+    g_mutex_unlock ( sh->mutex );
+    freed += shard_freed;
+  }
+  if ( evicted )
+    a_perfstats_count ( "mapcache", "evictions", evicted );
+  return freed;
+}
+
+// Size of the compressed tile data held
+guint a_mapcache_encoded_get_size ()
+{
+  g_mutex_lock ( enc_mutex );
+  guint size = enc_size;
+  g_mutex_unlock ( enc_mutex );
+  return size;
 }
 
 // Count of items in the mapcache
 guint a_mapcache_get_count ()
 {
-  return g_hash_table_size ( cache );
+  guint count = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    g_mutex_lock ( shards[i].mutex );
+    count += g_hash_table_size ( shards[i].cache );
+    g_mutex_unlock ( shards[i].mutex );
+  }
+  return count;
+}
+
+/**
+ * Number of times any cache access had to wait for another thread
+ *  (i.e. a measure of lock contention)
+ */
+guint a_mapcache_get_contended ()
+{
+  guint contended = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ )
+    contended += g_atomic_int_get ( &shards[i].contended );
+  return contended;
+}
+
+/**
+ * Cache hit and miss counts of a_mapcache_get() since startup
+ */
+void a_mapcache_get_hit_stats ( guint *hits, guint *misses )
+{
+  *hits = 0;
+  *misses = 0;
+  for ( guint i = 0; i < MC_SHARDS; i++ ) {
+    g_mutex_lock ( shards[i].mutex );
+    *hits += shards[i].hits;
+    *misses += shards[i].misses;
+    g_mutex_unlock ( shards[i].mutex );
+  }
 }
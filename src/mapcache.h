@@ -23,6 +23,7 @@
 #define __VIKING_MAPCACHE_H
 
 #include <glib.h>
+#include <time.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
 G_BEGIN_DECLS
@@ -30,6 +31,7 @@ G_BEGIN_DECLS
 // Extended 'DownloadResult_t' values (see download.h)
 #define MAPCACHE_STATUS_NOT_IN_CACHE 16
 #define MAPCACHE_STATUS_FILE_EXPIRED 8
+#define MAPCACHE_STATUS_NO_TILE 32 // Known not to exist in the source (e.g. absent from an MBTiles file)
 
 typedef struct {
   gdouble duration; // Mostly for Mapnik Rendering duration - negative values indicate not rendered (i.e. read from disk)
@@ -40,13 +42,21 @@ void a_mapcache_init ();
 void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
 GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name );
+gboolean a_mapcache_encoded_enabled ();
+void a_mapcache_encoded_add ( GBytes *bytes, time_t mtime, gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name );
+GBytes *a_mapcache_encoded_get ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name, time_t *mtime );
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name );
 void a_mapcache_flush ();
 void a_mapcache_flush_type ( guint16 type );
 void a_mapcache_uninit ();
 
 guint a_mapcache_get_size ();
+gsize a_mapcache_get_size_type ( guint16 type );
+gsize a_mapcache_trim ( gsize bytes );
 guint a_mapcache_get_count ();
+guint a_mapcache_encoded_get_size ();
+guint a_mapcache_get_contended ();
+void a_mapcache_get_hit_stats ( guint *hits, guint *misses );
 
 G_END_DECLS
 
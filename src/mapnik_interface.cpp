@@ -89,6 +89,13 @@ struct _MapnikInterface {
 	GObject obj;
 	mapnik::Map *myMap;
 	gchar *copyright; // Cached Mapnik parameter to save looking it up each time
+	// A mapnik::Map can't be used by several threads at once, so each render uses its own copy
+	//  these are kept for reuse, as copying the map on every render is slow
+	GMutex maps_mutex;
+	GSList *maps;      // Spare copies of myMap
+	guint generation;  // Changes on each (re)load, so out of date copies get dropped
+	guint width;       // Default render size as given when loaded
+	guint height;
 };
 
 G_DEFINE_TYPE (MapnikInterface, mapnik_interface, G_TYPE_OBJECT)
@@ -105,18 +112,75 @@ MapnikInterface* mapnik_interface_new ()
 	MapnikInterface* mi = MAPNIK_INTERFACE ( g_object_new ( MAPNIK_INTERFACE_TYPE, NULL ) );
 	mi->myMap = new mapnik::Map;
 	mi->copyright = NULL;
+	g_mutex_init ( &mi->maps_mutex );
+	mi->maps = NULL;
+	mi->generation = 0;
+	mi->width = 0;
+	mi->height = 0;
 	return mi;
 }
 
+/**
+ * NB Call with the maps_mutex held
+ */
+static void maps_clear ( MapnikInterface* mi )
+{
+	for ( GSList *iter = mi->maps; iter; iter = iter->next )
+		delete (mapnik::Map*)iter->data;
+	g_slist_free ( mi->maps );
+	mi->maps = NULL;
+}
+
 void mapnik_interface_free (MapnikInterface* mi)
 {
 	if ( mi ) {
 		g_free ( mi->copyright );
+		g_mutex_lock ( &mi->maps_mutex );
+		maps_clear ( mi );
+		g_mutex_unlock ( &mi->maps_mutex );
+		g_mutex_clear ( &mi->maps_mutex );
 		delete mi->myMap;
 	}
 	g_object_unref ( G_OBJECT(mi) );
 }
 
+/**
+ * Get a map for the sole use of the calling thread
+ *  give it back with maps_release() once finished with
+ */
+static mapnik::Map* maps_acquire ( MapnikInterface* mi, guint *generation )
+{
+	mapnik::Map *map = NULL;
+	g_mutex_lock ( &mi->maps_mutex );
+	*generation = mi->generation;
+	if ( mi->maps ) {
+		map = (mapnik::Map*)mi->maps->data;
+		mi->maps = g_slist_delete_link ( mi->maps, mi->maps );
+	}
+	else {
+		// Copy whilst locked, as otherwise it might be reloaded at the same time
+		try {
+			map = new mapnik::Map(*mi->myMap);
+		} catch (...) {
+			g_warning ("%s: Failed to copy the map", __FUNCTION__);
+		}
+	}
+	g_mutex_unlock ( &mi->maps_mutex );
+	return map;
+}
+
+static void maps_release ( MapnikInterface* mi, mapnik::Map *map, guint generation )
+{
+	g_mutex_lock ( &mi->maps_mutex );
+	if ( generation == mi->generation ) {
+		mi->maps = g_slist_prepend ( mi->maps, map );
+		map = NULL;
+	}
+	g_mutex_unlock ( &mi->maps_mutex );
+	// Otherwise it's of an older load
+	delete map;
+}
+
 /**
  * mapnik_interface_initialize:
  */
@@ -184,11 +248,17 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 {
 	gchar *msg = NULL;
 	if ( !mi ) return g_strdup ("Internal Error");
+	// Any copies in use by renders get dropped when given back
+	g_mutex_lock ( &mi->maps_mutex );
+	maps_clear ( mi );
+	mi->generation++;
 	try {
 		mi->myMap->remove_all(); // Support reloading
 		mapnik::load_map(*mi->myMap, filename);
 
 		mi->myMap->resize(width,height);
+		mi->width = width;
+		mi->height = height;
 		// ONLY WEB MERCATOR output supported ATM
 #if MAPNIK_VERSION < 400000
 		mi->myMap->set_srs ( mapnik::MAPNIK_GMERC_PROJ );
@@ -215,6 +285,7 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 	} catch (...) {
 		msg = g_strdup ("unknown error");
 	}
+	g_mutex_unlock ( &mi->maps_mutex );
 	return msg;
 }
 
@@ -230,12 +301,33 @@ static void destroy_fn ( guchar *pixels, gpointer data )
  * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
  */
 GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br )
+{
+	return mapnik_interface_render_size ( mi, lat_tl, lon_tl, lat_br, lon_br, 0, 0 );
+}
+
+/**
+ * mapnik_interface_render_size:
+ * @width:  Size in pixels of the image, or 0 for the size the map was loaded with
+ * @height: Size in pixels of the image, or 0 for the size the map was loaded with
+ *
+ * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
+ */
+GdkPixbuf* mapnik_interface_render_size ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br, guint width, guint height )
 {
 	if ( !mi ) return NULL;
 
-	// Copy main object to local map variable
+	// Use a map of our own
 	//  This enables rendering to work when this function is called from different threads
-	mapnik::Map myMap(*mi->myMap);
+	guint generation;
+	mapnik::Map *myMap = maps_acquire ( mi, &generation );
+	if ( !myMap ) return NULL;
+
+	if ( !width || !height ) {
+		g_mutex_lock ( &mi->maps_mutex );
+		width = mi->width;
+		height = mi->height;
+		g_mutex_unlock ( &mi->maps_mutex );
+	}
 
 	// Note prj & bbox want stuff in lon,lat order!
 	double p0x = lon_tl;
@@ -249,24 +341,43 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 
 	GdkPixbuf *pixbuf = NULL;
 	try {
-		unsigned width  = myMap.width();
-		unsigned height = myMap.height();
-		mapnik::image_32 image(width,height);
+		// Copies are reused, so may still be the size of a previous render
+		if ( myMap->width() != width || myMap->height() != height )
+			myMap->resize(width,height);
 		mapnik::box2d<double> bbox(p0x, p0y, p1x, p1y);
-		myMap.zoom_to_box(bbox);
+		myMap->zoom_to_box(bbox);
+#if MAPNIK_VERSION >= 300000
+		// Render straight into memory that the pixbuf then takes over, rather than copying it afterwards
+		//  NB The image does not own external data, and it needs to start off clear
+		unsigned char *ImageRawDataPtr = (unsigned char *) g_malloc0(width * 4 * height);
+		mapnik::image_32 image(width,height,ImageRawDataPtr);
+#else
+		mapnik::image_32 image(width,height);
+#endif
 		// FUTURE: option to use cairo / grid renderers?
-		mapnik::agg_renderer<mapnik::image_32> render(myMap,image);
-		render.apply();
+		try {
+			mapnik::agg_renderer<mapnik::image_32> render(*myMap,image);
+			render.apply();
+		} catch (...) {
+#if MAPNIK_VERSION >= 300000
+			g_free ( ImageRawDataPtr );
+#endif
+			throw;
+		}
 
 		if ( image.painted() ) {
+#if MAPNIK_VERSION < 300000
 			unsigned char *ImageRawDataPtr = (unsigned char *) g_malloc(width * 4 * height);
-			if (!ImageRawDataPtr)
-				return NULL;
 			memcpy(ImageRawDataPtr, image.raw_data(), width * height * 4);
+#endif
 			pixbuf = gdk_pixbuf_new_from_data(ImageRawDataPtr, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width * 4, destroy_fn, NULL);
 		}
-		else
+		else {
+#if MAPNIK_VERSION >= 300000
+			g_free ( ImageRawDataPtr );
+#endif
 			g_warning ("%s not rendered", __FUNCTION__ );
+		}
 	}
 	catch (const std::exception & ex) {
 		g_warning ("An error occurred while rendering: %s", ex.what());
@@ -274,6 +385,7 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 		g_warning ("An unknown error occurred while rendering");
 	}
 
+	maps_release ( mi, myMap, generation );
 	return pixbuf;
 }
 
@@ -43,6 +43,8 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 
 GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br );
 
+GdkPixbuf* mapnik_interface_render_size ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br, guint width, guint height );
+
 gchar* mapnik_interface_get_copyright ( MapnikInterface* mi );
 
 GArray* mapnik_interface_get_parameters ( MapnikInterface* mi );
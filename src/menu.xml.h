@@ -18,6 +18,9 @@ static const char *menu_xml =
 	"        <menuitem action='ExportGPX'/>"
 	"        <menuitem action='ExportSingleGPX'/>"
 	"      </menu>"
+	"      <menu action='ExportVisible'>"
+	"        <menuitem action='ExportVisibleGPX'/>"
+	"      </menu>"
 	"      <menu action='Acquire'>"
 	"        <menuitem action='AcquireRouting'/>"
 #ifdef VIK_CONFIG_OPENSTREETMAP
@@ -31,6 +34,7 @@ static const char *menu_xml =
 	"        <menuitem action='AcquireGeotag'/>"
 #endif
 	"        <menuitem action='AcquireURL'/>"
+	"        <menuitem action='AcquireDevice'/>"
 #ifdef VIK_CONFIG_GEONAMES
 	"        <menuitem action='AcquireWikipedia'/>"
 #endif
@@ -50,6 +54,9 @@ static const char *menu_xml =
 	"      <menuitem action='Exit'/>"
 	"    </menu>"
 	"    <menu action='Edit'>"
+	"      <menuitem action='Undo'/>"
+	"      <menuitem action='Redo'/>"
+	"      <separator/>"
 	"      <menuitem action='Cut'/>"
 	"      <menuitem action='Copy'/>"
 	"      <menuitem action='Paste'/>"
@@ -115,9 +122,12 @@ static const char *menu_xml =
         "          <menuitem action='PanWest'/>"
         "          <menuitem action='PanSouth'/>"
 	"      </menu>"
+	"      <menuitem action='TimeFilter'/>"
+	"      <menuitem action='Replay'/>"
 	"      <separator/>"
 	"      <menuitem action='BGJobs'/>"
 	"      <menuitem action='Log'/>"
+	"      <menuitem action='Performance'/>"
 	"    </menu>"
 	"    <menu action='Layers'>"
 	"      <menuitem action='Properties'/>"
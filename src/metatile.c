@@ -32,8 +32,10 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <glib/gstdio.h>
 
 #include "metatile.h"
+#include "vik_compat.h"
 /**
  * metatile.h
  */
@@ -191,3 +193,184 @@ int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, in
     close(fd);
     return pos;
 }
+
+/**
+ * Metatile handle cache
+ *
+ * Drawing one 8x8 block otherwise opens and reads the header of the same metatile file up to 64 times.
+ * Instead each file is mapped once, its index is checked once,
+ *  and tiles are returned as slices of the mapping without copying.
+ * Handles are dropped least recently used first, or when the file changes on disk.
+ */
+typedef struct {
+    gchar *path;
+    GBytes *bytes;   // The whole mapped file
+    int compressed;
+    time_t mtime;
+    goffset size;
+} MetatileHandle;
+
+static GMutex *mt_mutex = NULL;
+static GHashTable *mt_handles = NULL; // path -> GList link in mt_lru
+static GQueue mt_lru = G_QUEUE_INIT;  // Most recently used first
+static guint mt_max_handles = 0;
+
+static void metatile_handle_free(MetatileHandle *mth)
+{
+    g_free(mth->path);
+    g_bytes_unref(mth->bytes);
+    g_free(mth);
+}
+
+/**
+ * metatile_cache_init:
+ * @max_handles: How many files to keep mapped (0 disables the cache)
+ */
+void metatile_cache_init(guint max_handles)
+{
+    mt_mutex = vik_mutex_new();
+    mt_handles = g_hash_table_new(g_str_hash, g_str_equal);
+    mt_max_handles = max_handles;
+}
+
+void metatile_cache_flush(void)
+{
+    if (!mt_mutex)
+        return;
+    g_mutex_lock(mt_mutex);
+    g_hash_table_remove_all(mt_handles);
+    MetatileHandle *mth;
+    while ((mth = g_queue_pop_head(&mt_lru)))
+        metatile_handle_free(mth);
+    g_mutex_unlock(mt_mutex);
+}
+
+void metatile_cache_uninit(void)
+{
+    metatile_cache_flush();
+    g_hash_table_destroy(mt_handles);
+    mt_handles = NULL;
+    vik_mutex_free(mt_mutex);
+    mt_mutex = NULL;
+}
+
+/**
+ * Map the file and validate its header
+ */
+static MetatileHandle *metatile_handle_open(const char *path, GStatBuf *st, GError **error)
+{
+    GMappedFile *mf = g_mapped_file_new(path, FALSE, error);
+    if (!mf)
+        return NULL;
+
+    GBytes *bytes = g_mapped_file_get_bytes(mf);
+    g_mapped_file_unref(mf);
+
+    gsize len = 0;
+    const struct meta_layout *meta = g_bytes_get_data(bytes, &len);
+    const gsize header_len = sizeof(struct meta_layout) + METATILE*METATILE*sizeof(struct entry);
+    int compressed = 0;
+
+    if (len < header_len) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Meta file %s too small to contain header", path);
+        goto fail;
+    }
+    if (memcmp(meta->magic, META_MAGIC, strlen(META_MAGIC))) {
+        if (memcmp(meta->magic, META_MAGIC_COMPRESSED, strlen(META_MAGIC_COMPRESSED))) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Meta file %s header magic mismatch", path);
+            goto fail;
+        }
+        compressed = 1;
+    }
+    // Currently this code only works with fixed metatile sizes (due to xyz_to_meta above)
+    if (meta->count != (METATILE * METATILE)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Meta file %s header bad count %d != %d", path, meta->count, METATILE * METATILE);
+        goto fail;
+    }
+    // Check the whole index up front, so lookups need no further checks
+    for (int i = 0; i < METATILE * METATILE; i++) {
+        if (meta->index[i].offset < 0 || meta->index[i].size < 0 ||
+            (gsize)meta->index[i].offset + (gsize)meta->index[i].size > len) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Meta file %s index entry %d out of range", path, i);
+            goto fail;
+        }
+    }
+
+    MetatileHandle *mth = g_malloc0(sizeof(MetatileHandle));
+    mth->path = g_strdup(path);
+    mth->bytes = bytes;
+    mth->compressed = compressed;
+    mth->mtime = st->st_mtime;
+    mth->size = st->st_size;
+    return mth;
+
+ fail:
+    g_bytes_unref(bytes);
+    return NULL;
+}
+
+/**
+ * metatile_cache_read:
+ *
+ * Returns a new reference to the tile data (a slice of the mapped file),
+ *  or NULL on error (which is set).
+ * Also returns whether the file is in a compressed format.
+ */
+GBytes *metatile_cache_read(const char *dir, int x, int y, int z, int *compressed, GError **error)
+{
+    char path[PATH_MAX];
+    int meta_offset = xyz_to_meta(path, sizeof(path), dir, x, y, z);
+
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Could not open metatile %s. Reason: %s", path, g_strerror(saved_errno));
+        return NULL;
+    }
+
+    MetatileHandle *mth = NULL;
+    GBytes *bytes = NULL;
+    g_mutex_lock(mt_mutex);
+
+    GList *link = g_hash_table_lookup(mt_handles, path);
+    if (link) {
+        mth = link->data;
+        g_queue_unlink(&mt_lru, link);
+        if (mth->mtime != st.st_mtime || mth->size != st.st_size) {
+            // Rerendered since it was mapped
+            g_hash_table_remove(mt_handles, path);
+            g_list_free(link);
+            metatile_handle_free(mth);
+            mth = NULL;
+        }
+        else
+            g_queue_push_head_link(&mt_lru, link);
+    }
+
+    if (!mth) {
+        mth = metatile_handle_open(path, &st, error);
+        if (mth && mt_max_handles) {
+            g_queue_push_head(&mt_lru, mth);
+            g_hash_table_insert(mt_handles, mth->path, mt_lru.head);
+            while (mt_lru.length > mt_max_handles) {
+                MetatileHandle *old = g_queue_pop_tail(&mt_lru);
+                g_hash_table_remove(mt_handles, old->path);
+                metatile_handle_free(old);
+            }
+        }
+    }
+
+    if (mth) {
+        gsize len = 0;
+        const struct meta_layout *meta = g_bytes_get_data(mth->bytes, &len);
+        bytes = g_bytes_new_from_bytes(mth->bytes, meta->index[meta_offset].offset, meta->index[meta_offset].size);
+        *compressed = mth->compressed;
+        // Not kept if the cache is disabled
+        if (!mt_max_handles)
+            metatile_handle_free(mth);
+    }
+
+    g_mutex_unlock(mt_mutex);
+    return bytes;
+}
@@ -20,9 +20,17 @@
  *
  */
 
+#include <glib.h>
+
 // MAX_SIZE is the biggest file which we will return to the user
 #define METATILE_MAX_SIZE (1 * 1024 * 1024)
 
 int xyz_to_meta(char *path, size_t len, const char *dir, int x, int y, int z);
 
 int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, int * compressed, char * log_msg);
+
+void metatile_cache_init(guint max_handles);
+void metatile_cache_uninit(void);
+void metatile_cache_flush(void);
+
+GBytes *metatile_cache_read(const char *dir, int x, int y, int z, int *compressed, GError **error);
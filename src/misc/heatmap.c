@@ -29,6 +29,24 @@
 #include <math.h>   /* sqrtf */
 #include <assert.h> /* assert, #define NDEBUG to ignore. */
 
+/* Vectorised kernels for the inner loops are used when the compiler and CPU allow.
+ * SSE2 and NEON (AArch64) are part of the baseline for those architectures,
+ * whereas AVX2 is compiled via a function attribute and only selected at runtime.
+ */
+#if defined(__SSE2__) || defined(_M_X64)
+#define HEATMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HEATMAP_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HEATMAP_NEON 1
+#include <arm_neon.h>
+#endif
+
 /* Having a default stamp ready makes it easier for simple usage of the library
  * since there is no need to create a new stamp.
  */
@@ -48,6 +66,201 @@ static heatmap_stamp_t stamp_default_4 = {
     stamp_default_4_data, 9, 9
 };
 
+/* Adds one line of a stamp (times the weight) onto a line of the heatmap,
+ * keeping track of the highest heat.
+ * Multiplying and adding are done separately (not fused) in all of the kernels,
+ * so the results are identical whichever one is used.
+ */
+typedef void (*heatmap_add_line_fn)(float* line, const float* stampline, unsigned n, float w, float* max);
+
+/* Colours one line of the heatmap. */
+typedef void (*heatmap_color_line_fn)(const float* bufline, unsigned n, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorline);
+
+static void add_line_scalar(float* line, const float* stampline, unsigned n, float w, float* max)
+{
+    unsigned ix;
+    float m = *max;
+    for(ix = 0 ; ix < n ; ++ix, ++line, ++stampline) {
+        /* TODO: Let's actually accept negatives and try out funky stamps. */
+        /* Note that that might mess with the max though. */
+        /* And that we'll have to clamp the bottom to 0 when rendering. */
+        assert(*stampline >= 0.0f);
+
+        *line += *stampline * w;
+        if(*line > m) {m = *line;}
+
+        assert(*line >= 0.0f);
+    }
+    *max = m;
+}
+
+static void color_line_scalar(const float* bufline, unsigned n, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorline)
+{
+    unsigned x;
+    for(x = 0 ; x < n ; ++x, ++bufline) {
+        /* Saturate the heat value to the given saturation, and then
+         * normalize by that.
+         */
+        const float val = (*bufline > saturation ? saturation : *bufline)/saturation;
+
+        /* We add 0.5 in order to do real rounding, not just dropping the
+         * decimal part. That way we are certain the highest value in the
+         * colorscheme is actually used.
+         */
+        const size_t idx = (size_t)((float)(colorscheme->ncolors-1)*val + 0.5f);
+
+        /* This is probably caused by a negative entry in the stamp! */
+        assert(val >= 0.0f);
+
+        /* This should never happen. It is likely a bug in this library. */
+        assert(idx < colorscheme->ncolors);
+
+        /* Just copy over the color from the colorscheme. */
+        memcpy(colorline, colorscheme->colors + idx*4, 4);
+        colorline += 4;
+    }
+}
+
+#ifdef HEATMAP_SSE2
+static void add_line_sse2(float* line, const float* stampline, unsigned n, float w, float* max)
+{
+    const __m128 vw = _mm_set1_ps(w);
+    __m128 vmax = _mm_set1_ps(*max);
+    float m[4];
+    unsigned ix = 0;
+    for( ; ix + 4 <= n ; ix += 4) {
+        const __m128 v = _mm_add_ps(_mm_loadu_ps(line + ix), _mm_mul_ps(_mm_loadu_ps(stampline + ix), vw));
+        _mm_storeu_ps(line + ix, v);
+        vmax = _mm_max_ps(vmax, v);
+    }
+    _mm_storeu_ps(m, vmax);
+    m[0] = m[0] > m[1] ? m[0] : m[1];
+    m[2] = m[2] > m[3] ? m[2] : m[3];
+    *max = m[0] > m[2] ? m[0] : m[2];
+    add_line_scalar(line + ix, stampline + ix, n - ix, w, max);
+}
+
+static void color_line_sse2(const float* bufline, unsigned n, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorline)
+{
+    const __m128 vsat = _mm_set1_ps(saturation);
+    const __m128 vscale = _mm_set1_ps((float)(colorscheme->ncolors-1));
+    const __m128 vhalf = _mm_set1_ps(0.5f);
+    int idx[4];
+    unsigned x = 0;
+    for( ; x + 4 <= n ; x += 4) {
+        const __m128 val = _mm_div_ps(_mm_min_ps(_mm_loadu_ps(bufline + x), vsat), vsat);
+        unsigned i;
+        /* Truncation matches the cast for the (non-negative) values. */
+        _mm_storeu_si128((__m128i*)idx, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vscale, val), vhalf)));
+        for(i = 0 ; i < 4 ; ++i) {
+            assert((size_t)idx[i] < colorscheme->ncolors);
+            memcpy(colorline + 4*(x + i), colorscheme->colors + idx[i]*4, 4);
+        }
+    }
+    color_line_scalar(bufline + x, n - x, colorscheme, saturation, colorline + 4*x);
+}
+#endif
+
+#ifdef HEATMAP_AVX2
+__attribute__((target("avx2")))
+static void add_line_avx2(float* line, const float* stampline, unsigned n, float w, float* max)
+{
+    const __m256 vw = _mm256_set1_ps(w);
+    __m256 vmax = _mm256_set1_ps(*max);
+    __m128 m4;
+    float m[4];
+    unsigned ix = 0;
+    for( ; ix + 8 <= n ; ix += 8) {
+        const __m256 v = _mm256_add_ps(_mm256_loadu_ps(line + ix), _mm256_mul_ps(_mm256_loadu_ps(stampline + ix), vw));
+        _mm256_storeu_ps(line + ix, v);
+        vmax = _mm256_max_ps(vmax, v);
+    }
+    m4 = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+    _mm_storeu_ps(m, m4);
+    m[0] = m[0] > m[1] ? m[0] : m[1];
+    m[2] = m[2] > m[3] ? m[2] : m[3];
+    *max = m[0] > m[2] ? m[0] : m[2];
+    add_line_scalar(line + ix, stampline + ix, n - ix, w, max);
+}
+
+__attribute__((target("avx2")))
+static void color_line_avx2(const float* bufline, unsigned n, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorline)
+{
+    const __m256 vsat = _mm256_set1_ps(saturation);
+    const __m256 vscale = _mm256_set1_ps((float)(colorscheme->ncolors-1));
+    const __m256 vhalf = _mm256_set1_ps(0.5f);
+    const int* colors = (const int*)(const void*)colorscheme->colors;
+    unsigned x = 0;
+    for( ; x + 8 <= n ; x += 8) {
+        const __m256 val = _mm256_div_ps(_mm256_min_ps(_mm256_loadu_ps(bufline + x), vsat), vsat);
+        const __m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(vscale, val), vhalf));
+        /* Each colour is 4 bytes, so can be gathered as one int. */
+        _mm256_storeu_si256((__m256i*)(void*)(colorline + 4*x), _mm256_i32gather_epi32(colors, idx, 4));
+    }
+    color_line_scalar(bufline + x, n - x, colorscheme, saturation, colorline + 4*x);
+}
+#endif
+
+#ifdef HEATMAP_NEON
+static void add_line_neon(float* line, const float* stampline, unsigned n, float w, float* max)
+{
+    const float32x4_t vw = vdupq_n_f32(w);
+    float32x4_t vmax = vdupq_n_f32(*max);
+    unsigned ix = 0;
+    for( ; ix + 4 <= n ; ix += 4) {
+        const float32x4_t v = vaddq_f32(vld1q_f32(line + ix), vmulq_f32(vld1q_f32(stampline + ix), vw));
+        vst1q_f32(line + ix, v);
+        vmax = vmaxq_f32(vmax, v);
+    }
+    *max = vmaxvq_f32(vmax);
+    add_line_scalar(line + ix, stampline + ix, n - ix, w, max);
+}
+
+static void color_line_neon(const float* bufline, unsigned n, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorline)
+{
+    const float32x4_t vsat = vdupq_n_f32(saturation);
+    const float32x4_t vscale = vdupq_n_f32((float)(colorscheme->ncolors-1));
+    const float32x4_t vhalf = vdupq_n_f32(0.5f);
+    uint32_t idx[4];
+    unsigned x = 0;
+    for( ; x + 4 <= n ; x += 4) {
+        const float32x4_t val = vdivq_f32(vminq_f32(vld1q_f32(bufline + x), vsat), vsat);
+        unsigned i;
+        vst1q_u32(idx, vcvtq_u32_f32(vaddq_f32(vmulq_f32(vscale, val), vhalf)));
+        for(i = 0 ; i < 4 ; ++i) {
+            assert(idx[i] < colorscheme->ncolors);
+            memcpy(colorline + 4*(x + i), colorscheme->colors + idx[i]*4, 4);
+        }
+    }
+    color_line_scalar(bufline + x, n - x, colorscheme, saturation, colorline + 4*x);
+}
+#endif
+
+/* The best kernels for the build's baseline, possibly improved on at startup. */
+#if defined(HEATMAP_NEON)
+static heatmap_add_line_fn add_line = add_line_neon;
+static heatmap_color_line_fn color_line = color_line_neon;
+#elif defined(HEATMAP_SSE2)
+static heatmap_add_line_fn add_line = add_line_sse2;
+static heatmap_color_line_fn color_line = color_line_sse2;
+#else
+static heatmap_add_line_fn add_line = add_line_scalar;
+static heatmap_color_line_fn color_line = color_line_scalar;
+#endif
+
+#ifdef HEATMAP_AVX2
+/* Choose once before any threads can be using the kernels. */
+__attribute__((constructor))
+static void heatmap_dispatch_init(void)
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        add_line = add_line_avx2;
+        color_line = color_line_avx2;
+    }
+}
+#endif
+
 void heatmap_init(heatmap_t* hm, unsigned w, unsigned h)
 {
     memset(hm, 0, sizeof(heatmap_t));
@@ -97,18 +310,7 @@ void heatmap_add_point_with_stamp(heatmap_t* h, unsigned x, unsigned y, const he
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
-            unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: Let's actually accept negatives and try out funky stamps. */
-                /* Note that that might mess with the max though. */
-                /* And that we'll have to clamp the bottom to 0 when rendering. */
-                assert(*stampline >= 0.0f);
-
-                *line += *stampline;
-                if(*line > h->max) {h->max = *line;}
-
-                assert(*line >= 0.0f);
-            }
+            add_line(line, stampline, x1 - x0, 1.0f, &h->max);
         }
     } /* I hate you very much! */
 }
@@ -150,16 +352,7 @@ void heatmap_add_weighted_point_with_stamp(heatmap_t* h, unsigned x, unsigned y,
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
-            unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: see unweighted function */
-                assert(*stampline >= 0.0f);
-
-                *line += *stampline * w;
-                if(*line > h->max) {h->max = *line;}
-
-                assert(*line >= 0.0f);
-            }
+            add_line(line, stampline, x1 - x0, w, &h->max);
         }
     } /* I hate you very much! */
 }
@@ -197,32 +390,7 @@ unsigned char* heatmap_render_saturated_to(const heatmap_t* h, const heatmap_col
     /* TODO: could actually even flatten this loop before parallelizing it. */
     /* I.e., to go i = 0 ; i < h*w since I don't have any padding! (yet?) */
     for(y = 0 ; y < h->h ; ++y) {
-        float* bufline = h->buf + y*h->w;
-        unsigned char* colorline = colorbuf + 4*y*h->w;
-
-        unsigned x;
-        for(x = 0 ; x < h->w ; ++x, ++bufline) {
-            /* Saturate the heat value to the given saturation, and then
-             * normalize by that.
-             */
-            const float val = (*bufline > saturation ? saturation : *bufline)/saturation;
-
-            /* We add 0.5 in order to do real rounding, not just dropping the
-             * decimal part. That way we are certain the highest value in the
-             * colorscheme is actually used.
-             */
-            const size_t idx = (size_t)((float)(colorscheme->ncolors-1)*val + 0.5f);
-
-            /* This is probably caused by a negative entry in the stamp! */
-            assert(val >= 0.0f);
-
-            /* This should never happen. It is likely a bug in this library. */
-            assert(idx < colorscheme->ncolors);
-
-            /* Just copy over the color from the colorscheme. */
-            memcpy(colorline, colorscheme->colors + idx*4, 4);
-            colorline += 4;
-        }
+        color_line(h->buf + y*h->w, h->w, colorscheme, saturation, colorbuf + 4*y*h->w);
     }
 
     return colorbuf;
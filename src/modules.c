@@ -51,11 +51,15 @@
 #include "vikslippymapsource.h"
 #include "viktmsmapsource.h"
 #include "vikwmscmapsource.h"
+#include "vikpmtilesmapsource.h"
+#include "vikmvtmapsource.h"
 #include "vikwebtoolcenter.h"
 #include "vikwebtoolbounds.h"
 #include "vikgotoxmltool.h"
+#include "vikgotoofflinetool.h"
 #include "vikwebtool_datasource.h"
 #include "vikroutingwebengine.h"
+#include "vikroutinggraphengine.h"
 
 #include "vikgobjectbuilder.h"
 
@@ -210,9 +214,12 @@ register_loadable_types(void)
     VIK_TYPE_SLIPPY_MAP_SOURCE,
     VIK_TYPE_TMS_MAP_SOURCE,
     VIK_TYPE_WMSC_MAP_SOURCE,
+    VIK_TYPE_PMTILES_MAP_SOURCE,
+    VIK_TYPE_MVT_MAP_SOURCE,
 
     /* Goto */
     VIK_GOTO_XML_TOOL_TYPE,
+    VIK_GOTO_OFFLINE_TOOL_TYPE,
 
     /* Tools */
     VIK_WEBTOOL_CENTER_TYPE,
@@ -222,7 +229,8 @@ register_loadable_types(void)
     VIK_WEBTOOL_DATASOURCE_TYPE,
 
     /* Routing */
-    VIK_ROUTING_WEB_ENGINE_TYPE
+    VIK_ROUTING_WEB_ENGINE_TYPE,
+    VIK_ROUTING_GRAPH_ENGINE_TYPE
   };
 
   /* kill 'unused variable' + argument type warnings */
@@ -0,0 +1,194 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Names of items (e.g. waypoints or tracks) kept in order of their case folded form,
+ *  for finding items by the start of their name in logarithmic time
+ *  and by any part of their name without folding every name again.
+ *
+ * Unlike the spatial index, items may be added, removed and renamed at any time.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "nameindex.h"
+
+typedef struct {
+  gchar *key;  // Case folded
+  gchar *name; // As given
+  gpointer item;
+} NameEntry;
+
+struct _VikNameIndex {
+  GSequence *entries;  // NameEntry, ordered by key; NB the sequence owns the entries
+  GHashTable *iters;   // item -> GSequenceIter
+};
+
+static gchar *name_fold ( const gchar *name )
+{
+  gchar *normal = g_utf8_normalize ( name, -1, G_NORMALIZE_ALL );
+  if ( !normal )
+    // Not valid UTF-8
+    return g_ascii_strdown ( name, -1 );
+  gchar *key = g_utf8_casefold ( normal, -1 );
+  g_free ( normal );
+  return key;
+}
+
+static void entry_free ( NameEntry *entry )
+{
+  g_free ( entry->key );
+  g_free ( entry->name );
+  g_free ( entry );
+}
+
+/**
+ * Ties are ordered by the item, so a search for a key with a NULL item
+ *  gives the first entry of that key
+ */
+static gint entry_compare ( const NameEntry *aa, const NameEntry *bb, gpointer user_data )
+{
+  gint ans = strcmp ( aa->key, bb->key );
+  if ( ans )
+    return ans;
+  if ( aa->item == bb->item )
+    return 0;
+  return aa->item < bb->item ? -1 : 1;
+}
+
+VikNameIndex *vik_name_index_new ()
+{
+  VikNameIndex *index = g_malloc ( sizeof(VikNameIndex) );
+  index->entries = g_sequence_new ( (GDestroyNotify)entry_free );
+  index->iters = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  return index;
+}
+
+void vik_name_index_free ( VikNameIndex *index )
+{
+  if ( !index )
+    return;
+  g_hash_table_destroy ( index->iters );
+  g_sequence_free ( index->entries );
+  g_free ( index );
+}
+
+/**
+ * vik_name_index_add:
+ * @name: Items without a name are not indexed
+ * @item: Each item is only in the index once, so this replaces any previous name
+ */
+void vik_name_index_add ( VikNameIndex *index, const gchar *name, gpointer item )
+{
+  vik_name_index_remove ( index, item );
+  if ( !name )
+    return;
+  NameEntry *entry = g_malloc ( sizeof(NameEntry) );
+  entry->key = name_fold ( name );
+  entry->name = g_strdup ( name );
+  entry->item = item;
+  GSequenceIter *iter = g_sequence_insert_sorted ( index->entries, entry, (GCompareDataFunc)entry_compare, NULL );
+  g_hash_table_insert ( index->iters, item, iter );
+}
+
+void vik_name_index_remove ( VikNameIndex *index, gpointer item )
+{
+  GSequenceIter *iter = g_hash_table_lookup ( index->iters, item );
+  if ( iter ) {
+    g_hash_table_remove ( index->iters, item );
+    g_sequence_remove ( iter );
+  }
+}
+
+void vik_name_index_rename ( VikNameIndex *index, gpointer item, const gchar *name )
+{
+  vik_name_index_add ( index, name, item );
+}
+
+/**
+ * The first entry whose key is not before the given key
+ */
+static GSequenceIter *index_lower_bound ( VikNameIndex *index, gchar *key )
+{
+  NameEntry probe = { key, NULL, NULL };
+  return g_sequence_search ( index->entries, &probe, (GCompareDataFunc)entry_compare, NULL );
+}
+
+/**
+ * vik_name_index_lookup:
+ *
+ * Returns: An item with exactly this name (NB that is case sensitive), or NULL
+ */
+gpointer vik_name_index_lookup ( VikNameIndex *index, const gchar *name )
+{
+  gchar *key = name_fold ( name );
+  gpointer item = NULL;
+  for ( GSequenceIter *iter = index_lower_bound ( index, key ); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter) ) {
+    NameEntry *entry = g_sequence_get ( iter );
+    if ( strcmp ( entry->key, key ) )
+      break;
+    if ( !strcmp ( entry->name, name ) ) {
+      item = entry->item;
+      break;
+    }
+  }
+  g_free ( key );
+  return item;
+}
+
+/**
+ * vik_name_index_find:
+ * @text:      Ignoring case
+ * @substring: Also find names with the text anywhere in them, not just at the start
+ * @max:       The most items to give, 0 for no limit
+ *
+ * Returns: A list of items, AKA the names starting with the text in name order,
+ *  followed by any other names containing the text again in name order.
+ *  Free the list (but not the items) after use.
+ */
+GList *vik_name_index_find ( VikNameIndex *index, const gchar *text, gboolean substring, guint max )
+{
+  gchar *key = name_fold ( text );
+  GList *items = NULL;
+  guint count = 0;
+
+  for ( GSequenceIter *iter = index_lower_bound ( index, key ); !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter) ) {
+    NameEntry *entry = g_sequence_get ( iter );
+    if ( !g_str_has_prefix ( entry->key, key ) || (max && count == max) )
+      break;
+    items = g_list_prepend ( items, entry->item );
+    count++;
+  }
+
+  if ( substring && key[0] ) {
+    for ( GSequenceIter *iter = g_sequence_get_begin_iter(index->entries); !g_sequence_iter_is_end(iter) && !(max && count == max); iter = g_sequence_iter_next(iter) ) {
+      NameEntry *entry = g_sequence_get ( iter );
+      const gchar *found = strstr ( entry->key, key );
+      // Those at the start are already included
+      if ( found && found != entry->key ) {
+        items = g_list_prepend ( items, entry->item );
+        count++;
+      }
+    }
+  }
+
+  g_free ( key );
+  return g_list_reverse ( items );
+}
@@ -0,0 +1,41 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_NAMEINDEX_H
+#define __VIKING_NAMEINDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikNameIndex VikNameIndex;
+
+VikNameIndex *vik_name_index_new ();
+void vik_name_index_free ( VikNameIndex *index );
+
+void vik_name_index_add ( VikNameIndex *index, const gchar *name, gpointer item );
+void vik_name_index_remove ( VikNameIndex *index, gpointer item );
+void vik_name_index_rename ( VikNameIndex *index, gpointer item, const gchar *name );
+
+gpointer vik_name_index_lookup ( VikNameIndex *index, const gchar *name );
+GList *vik_name_index_find ( VikNameIndex *index, const gchar *text, gboolean substring, guint max );
+
+G_END_DECLS
+
+#endif
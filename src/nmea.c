@@ -0,0 +1,349 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Built-in reader for NMEA 0183 logs, so the most common GPS logger output
+ *  can be loaded without going through GPSBabel.
+ *
+ * Only the position sentences are used: RMC for the position, time, speed and course
+ *  and GGA for the altitude and satellites. Sentences of the same time are merged
+ *  into one trackpoint and a loss of fix starts a new track segment.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include "nmea.h"
+#include "globals.h"
+#include "fileutils.h"
+
+// Sentences are at most 82 characters, but allow for overlong proprietary ones
+#define NMEA_LINE_MAX 256
+#define NMEA_FIELDS_MAX 32
+
+/**
+ * The checksum is optional, but when given it must match
+ */
+gboolean a_nmea_checksum_ok ( const gchar *sentence )
+{
+  const gchar *star = strchr ( sentence, '*' );
+  if ( !star )
+    return TRUE;
+  guchar sum = 0;
+  for ( const gchar *ptr = sentence+1; ptr < star; ptr++ )
+    sum ^= (guchar)*ptr;
+  if ( !g_ascii_isxdigit(star[1]) || !g_ascii_isxdigit(star[2]) )
+    return FALSE;
+  return g_ascii_xdigit_value(star[1])*16 + g_ascii_xdigit_value(star[2]) == sum;
+}
+
+/**
+ * Convert NMEA's dddmm.mmmm and hemisphere into degrees
+ */
+gdouble a_nmea_degrees ( const gchar *value, const gchar *hemisphere )
+{
+  if ( !value[0] )
+    return NAN;
+  gdouble raw = g_ascii_strtod ( value, NULL );
+  gdouble degrees = floor ( raw / 100 );
+  degrees += (raw - degrees*100) / 60;
+  if ( hemisphere[0] == 'S' || hemisphere[0] == 'W' )
+    degrees = -degrees;
+  return degrees;
+}
+
+/**
+ * From NMEA's hhmmss.ss time and ddmmyy date
+ */
+gdouble a_nmea_timestamp ( const gchar *hms, const gchar *dmy )
+{
+  guint hh, mm, dd, mo, yy;
+  if ( sscanf ( dmy, "%2u%2u%2u", &dd, &mo, &yy ) != 3 ||
+       sscanf ( hms, "%2u%2u", &hh, &mm ) != 2 || strlen(hms) < 6 )
+    return NAN;
+  gdouble ss = g_ascii_strtod ( hms+4, NULL );
+  GDateTime *gdt = g_date_time_new_utc ( yy < 80 ? 2000+yy : 1900+yy, mo, dd, hh, mm, ss );
+  if ( !gdt )
+    return NAN;
+  gdouble timestamp = g_date_time_to_unix ( gdt ) + (ss - floor(ss));
+  g_date_time_unref ( gdt );
+  return timestamp;
+}
+
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrack *trk;
+  // When streaming each trackpoint is handed over as soon as it is complete
+  NmeaTrackpointFunc tp_func;
+  gpointer tp_data;
+  gboolean has_points;
+  gboolean newsegment;
+  // The trackpoint being built up from the sentences of one time
+  gchar hms[16];
+  gboolean has_position;
+  struct LatLon ll;
+  gdouble altitude;
+  gdouble speed;
+  gdouble course;
+  guint nsats;
+  guint fix_mode;
+  // Only RMC has the date, so remember it for any following GGA only times
+  gchar dmy[8];
+} NmeaReader;
+
+static void reader_clear_point ( NmeaReader *rd )
+{
+  rd->has_position = FALSE;
+  rd->altitude = NAN;
+  rd->speed = NAN;
+  rd->course = NAN;
+  rd->nsats = 0;
+  rd->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+}
+
+static void reader_flush ( NmeaReader *rd )
+{
+  if ( rd->has_position ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    vik_coord_load_from_latlon ( &(tp->coord), vik_trw_layer_get_coord_mode(rd->vtl), &rd->ll );
+    tp->timestamp = a_nmea_timestamp ( rd->hms, rd->dmy );
+    tp->altitude = rd->altitude;
+    tp->speed = rd->speed;
+    tp->course = rd->course;
+    tp->nsats = rd->nsats;
+    tp->fix_mode = rd->fix_mode;
+    tp->newsegment = rd->newsegment;
+    rd->newsegment = FALSE;
+    rd->has_points = TRUE;
+    if ( rd->tp_func )
+      rd->tp_func ( tp, rd->tp_data );
+    else
+      // Prepended for speed, put in order at the end
+      rd->trk->trackpoints = g_list_prepend ( rd->trk->trackpoints, tp );
+  }
+  reader_clear_point ( rd );
+}
+
+/**
+ * Move on to the trackpoint for this time, if it is not the current one
+ */
+static void reader_set_time ( NmeaReader *rd, const gchar *hms )
+{
+  // Without a time each sentence is a separate trackpoint
+  if ( !hms[0] || strncmp ( rd->hms, hms, sizeof(rd->hms)-1 ) != 0 ) {
+    reader_flush ( rd );
+    g_strlcpy ( rd->hms, hms, sizeof(rd->hms) );
+  }
+}
+
+/**
+ * Split the sentence in place, returning the number of fields
+ */
+static guint split_sentence ( gchar *line, gchar **fields )
+{
+  line[strcspn(line, "*\r\n")] = '\0';
+  guint nfields = 0;
+  gchar *ptr = line;
+  while ( nfields < NMEA_FIELDS_MAX ) {
+    fields[nfields++] = ptr;
+    ptr = strchr ( ptr, ',' );
+    if ( !ptr )
+      break;
+    *ptr++ = '\0';
+  }
+  return nfields;
+}
+
+static void reader_parse ( NmeaReader *rd, gchar *line )
+{
+  // Allow for logs with a timestamp or similar before each sentence
+  gchar *start = strchr ( line, '$' );
+  if ( !start || !a_nmea_checksum_ok(start) )
+    return;
+
+  gchar *fields[NMEA_FIELDS_MAX];
+  guint nfields = split_sentence ( start, fields );
+  // Skip the '$' and the talker
+  const gchar *type = strlen(fields[0]) == 6 ? fields[0]+3 : "";
+
+  if ( strcmp ( type, "GGA" ) == 0 && nfields >= 10 ) {
+    // $--GGA,time,lat,N,lon,E,quality,satellites,hdop,altitude,M,...
+    if ( atoi(fields[6]) == 0 )
+      return;
+    reader_set_time ( rd, fields[1] );
+    gdouble lat = a_nmea_degrees ( fields[2], fields[3] );
+    gdouble lon = a_nmea_degrees ( fields[4], fields[5] );
+    if ( isnan(lat) || isnan(lon) )
+      return;
+    if ( !rd->has_position ) {
+      rd->ll.lat = lat;
+      rd->ll.lon = lon;
+      rd->has_position = TRUE;
+    }
+    rd->nsats = (guint)atoi ( fields[7] );
+    if ( fields[9][0] ) {
+      rd->altitude = g_ascii_strtod ( fields[9], NULL );
+      rd->fix_mode = VIK_GPS_MODE_3D;
+    }
+    else if ( rd->fix_mode == VIK_GPS_MODE_NOT_SEEN )
+      rd->fix_mode = VIK_GPS_MODE_2D;
+  }
+  else if ( strcmp ( type, "RMC" ) == 0 && nfields >= 10 ) {
+    // $--RMC,time,status,lat,N,lon,E,knots,course,date,...
+    if ( fields[2][0] != 'A' ) {
+      // Lost the fix
+      reader_flush ( rd );
+      rd->newsegment = rd->has_points;
+      return;
+    }
+    reader_set_time ( rd, fields[1] );
+    gdouble lat = a_nmea_degrees ( fields[3], fields[4] );
+    gdouble lon = a_nmea_degrees ( fields[5], fields[6] );
+    if ( isnan(lat) || isnan(lon) )
+      return;
+    rd->ll.lat = lat;
+    rd->ll.lon = lon;
+    rd->has_position = TRUE;
+    if ( fields[7][0] )
+      rd->speed = VIK_KNOTS_TO_MPS ( g_ascii_strtod(fields[7], NULL) );
+    if ( fields[8][0] )
+      rd->course = g_ascii_strtod ( fields[8], NULL );
+    if ( fields[9][0] )
+      g_strlcpy ( rd->dmy, fields[9], sizeof(rd->dmy) );
+    if ( rd->fix_mode == VIK_GPS_MODE_NOT_SEEN )
+      rd->fix_mode = VIK_GPS_MODE_2D;
+  }
+}
+
+/**
+ * a_nmea_read_file_into_layer:
+ * @vtl:      The layer to add the track to
+ * @ff:       The NMEA log
+ * @filename: Used to name the track
+ *
+ * Returns: %TRUE if a track with at least one trackpoint has been added
+ */
+gboolean a_nmea_read_file_into_layer ( VikTrwLayer *vtl, FILE *ff, const gchar *filename )
+{
+  NmeaReader rd;
+  memset ( &rd, 0, sizeof(rd) );
+  rd.vtl = vtl;
+  rd.trk = vik_track_new ();
+  reader_clear_point ( &rd );
+
+  gchar line[NMEA_LINE_MAX];
+  while ( fgets ( line, sizeof(line), ff ) ) {
+    gsize len = strlen ( line );
+    if ( len == sizeof(line)-1 && line[len-1] != '\n' ) {
+      // Not a sentence, so skip the rest of it
+      int ch;
+      while ( (ch = fgetc(ff)) != EOF && ch != '\n' );
+      continue;
+    }
+    reader_parse ( &rd, line );
+  }
+  reader_flush ( &rd );
+
+  if ( !rd.trk->trackpoints ) {
+    vik_track_free ( rd.trk );
+    return FALSE;
+  }
+
+  rd.trk->trackpoints = g_list_reverse ( rd.trk->trackpoints );
+  gchar *name = filename ? g_strdup ( a_file_basename(filename) ) : g_strdup ( _("Track") );
+  gchar *dot = strrchr ( name, '.' );
+  if ( dot && dot != name )
+    *dot = '\0';
+  vik_trw_layer_filein_add_track ( vtl, name, rd.trk );
+  g_free ( name );
+  return TRUE;
+}
+
+struct _NmeaStream {
+  NmeaReader rd;
+  // Any partial sentence at the end of the previous data
+  GString *line;
+  gboolean skipping;
+};
+
+/**
+ * a_nmea_stream_new:
+ * @vtl:       The layer the trackpoints are for (only used for its coordinate mode)
+ * @func:      Called with each trackpoint, which it then owns
+ * @user_data: Passed to @func
+ *
+ * Parse NMEA sentences incrementally as they arrive, e.g. from a live GPS feed.
+ * As sentences of the same time are merged,
+ *  a trackpoint is only complete once a sentence of the next time is seen.
+ */
+NmeaStream *a_nmea_stream_new ( VikTrwLayer *vtl, NmeaTrackpointFunc func, gpointer user_data )
+{
+  NmeaStream *ns = g_malloc0 ( sizeof(NmeaStream) );
+  ns->rd.vtl = vtl;
+  ns->rd.tp_func = func;
+  ns->rd.tp_data = user_data;
+  reader_clear_point ( &ns->rd );
+  ns->line = g_string_sized_new ( NMEA_LINE_MAX );
+  return ns;
+}
+
+/**
+ * a_nmea_stream_feed:
+ * @buf: The next data, which need not end on a sentence boundary
+ * @len: The length of @buf
+ */
+void a_nmea_stream_feed ( NmeaStream *ns, const gchar *buf, gsize len )
+{
+  const gchar *end = buf + len;
+  while ( buf < end ) {
+    const gchar *nl = memchr ( buf, '\n', end-buf );
+    gsize part = (nl ? nl+1 : end) - buf;
+    if ( !ns->skipping ) {
+      if ( ns->line->len + part < NMEA_LINE_MAX )
+        g_string_append_len ( ns->line, buf, part );
+      else
+        // Not a sentence, so skip the rest of it
+        ns->skipping = TRUE;
+    }
+    if ( nl ) {
+      if ( !ns->skipping )
+        reader_parse ( &ns->rd, ns->line->str );
+      g_string_truncate ( ns->line, 0 );
+      ns->skipping = FALSE;
+    }
+    buf += part;
+  }
+}
+
+/**
+ * a_nmea_stream_free:
+ *
+ * Any final sentence and trackpoint are handed over before freeing
+ */
+void a_nmea_stream_free ( NmeaStream *ns )
+{
+  if ( !ns->skipping && ns->line->len )
+    reader_parse ( &ns->rd, ns->line->str );
+  reader_flush ( &ns->rd );
+  g_string_free ( ns->line, TRUE );
+  g_free ( ns );
+}
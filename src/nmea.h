@@ -0,0 +1,47 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_NMEA_H
+#define _VIKING_NMEA_H
+
+#include <stdio.h>
+
+#include "viktrwlayer.h"
+
+G_BEGIN_DECLS
+
+gboolean a_nmea_checksum_ok ( const gchar *sentence );
+
+gdouble a_nmea_degrees ( const gchar *value, const gchar *hemisphere );
+
+gdouble a_nmea_timestamp ( const gchar *hms, const gchar *dmy );
+
+gboolean a_nmea_read_file_into_layer ( VikTrwLayer *vtl, FILE *ff, const gchar *filename );
+
+typedef void (*NmeaTrackpointFunc) ( VikTrackpoint *tp, gpointer user_data );
+
+typedef struct _NmeaStream NmeaStream;
+
+NmeaStream *a_nmea_stream_new ( VikTrwLayer *vtl, NmeaTrackpointFunc func, gpointer user_data );
+void a_nmea_stream_feed ( NmeaStream *ns, const gchar *buf, gsize len );
+void a_nmea_stream_free ( NmeaStream *ns );
+
+G_END_DECLS
+
+#endif
@@ -18,10 +18,23 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  *
  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
 #include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include <curl/curl.h>
 #include <curl/easy.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 #include "viking.h"
 #include "viktrwlayer.h"
@@ -44,6 +57,11 @@
 
 #define VIK_SETTINGS_OSM_TRACE_VIS "osm_trace_visibility"
 #define VIK_SETTINGS_OSM_TRACE_URL "osm_trace_url"
+
+// Streaming the file part of the form needs curl_mime_data_cb()
+#if LIBCURL_VERSION_NUM >= 0x073800
+#define OSM_TRACES_STREAM
+#endif
 static gint last_active = -1;
 
 /**
@@ -100,6 +118,31 @@ static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, OSM_PASSWORD, VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("OSM password:"), VIK_LAYER_WIDGET_PASSWORD, NULL, NULL, NULL, NULL, NULL, NULL },
 };
 
+#ifdef OSM_TRACES_STREAM
+// For estimating the progress from how much GPX has been written
+#define GPX_BYTES_PER_POINT 150
+
+/**
+ * The GPX is written by another thread into a pipe,
+ *  which is read (and compressed) as curl sends the request.
+ * Thus neither a temporary file nor the whole GPX in memory are needed.
+ */
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrack *trk; // Or NULL for all of the layer
+  FILE *gpx;     // Write end of the pipe
+  gint fd;       // Read end
+  gboolean eof;
+#ifdef HAVE_LIBZ
+  z_stream zs;
+  guchar in[16384];
+#endif
+  gsize written;
+  gsize estimate;
+  gpointer threaddata;
+} UploadStream;
+#endif
+
 /**
  * Free an OsmTracesInfo struct.
  */
@@ -403,13 +446,95 @@ void osm_traces_uninit()
  *   > 0  : HTTP error
  *   1001 : URL signing error
  */
+#ifdef OSM_TRACES_STREAM
+static gpointer upload_stream_writer ( UploadStream *us )
+{
+  /* Due to OSM limits, we have to enforce ele and time fields
+   also don't upload invisible tracks */
+  GpxWritingOptions options = { TRUE, TRUE, FALSE, FALSE, vik_trw_layer_get_gpx_version(us->vtl) };
+  if ( us->trk )
+    a_gpx_write_track_file ( us->vtl, us->trk, us->gpx, &options );
+  else
+    a_gpx_write_file ( us->vtl, us->gpx, &options, NULL );
+  // Closing gives the reader the end of the file
+  fclose ( us->gpx );
+  return NULL;
+}
+
+/**
+ * Read more of the GPX, returning 0 at the end
+ */
+static gssize upload_stream_read_gpx ( UploadStream *us, guchar *buf, gsize len )
+{
+  gssize got;
+  do {
+    got = read ( us->fd, buf, len );
+  } while ( got < 0 && errno == EINTR );
+  if ( got <= 0 )
+    return 0;
+  us->written += got;
+  return got;
+}
+
+static size_t upload_stream_read ( char *buffer, size_t size, size_t nitems, void *userp )
+{
+  UploadStream *us = (UploadStream*)userp;
+  size_t room = size * nitems;
+#ifdef HAVE_LIBZ
+  us->zs.next_out = (Bytef*)buffer;
+  us->zs.avail_out = room;
+  // Compression may need a lot of input before giving any output
+  while ( us->zs.avail_out == room ) {
+    if ( us->zs.avail_in == 0 && !us->eof ) {
+      gssize got = upload_stream_read_gpx ( us, us->in, sizeof(us->in) );
+      if ( got ) {
+        us->zs.next_in = us->in;
+        us->zs.avail_in = got;
+      }
+      else
+        us->eof = TRUE;
+    }
+    gint ans = deflate ( &us->zs, us->eof ? Z_FINISH : Z_NO_FLUSH );
+    if ( ans == Z_STREAM_END )
+      break;
+    if ( ans != Z_OK && ans != Z_BUF_ERROR ) {
+      g_warning ( "%s: deflate failed %d", __FUNCTION__, ans );
+      return CURL_READFUNC_ABORT;
+    }
+  }
+  return room - us->zs.avail_out;
+#else
+  return upload_stream_read_gpx ( us, (guchar*)buffer, room );
+#endif
+}
+
+static int upload_stream_progress ( void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow )
+{
+  UploadStream *us = (UploadStream*)clientp;
+  gdouble fraction = us->estimate ? MIN ( 0.99, (gdouble)us->written / us->estimate ) : 0.0;
+  // Non zero aborts the transfer
+  return a_background_set_progress ( us->threaddata, fraction );
+}
+
+static void upload_mime_add ( curl_mime *mime, const gchar *name, const gchar *value )
+{
+  curl_mimepart *part = curl_mime_addpart ( mime );
+  curl_mime_name ( part, name );
+  curl_mime_data ( part, value, CURL_ZERO_TERMINATED );
+}
+#endif
+
+/**
+ * @stream: When not NULL the GPX is read from this as it is sent (and @file is not used)
+ */
 static gint osm_traces_upload_file(const char *user,
 				   const char *password,
 				   const char *file,
 				   const char *filename,
 				   const char *description,
 				   const char *tags,
-				   const OsmTraceVis_t *vistype)
+				   const OsmTraceVis_t *vistype,
+				   gpointer stream)
 {
   CURL *curl;
   CURLcode res;
@@ -440,6 +565,31 @@ static gint osm_traces_upload_file(const char *user,
   /* Init CURL */
   curl = curl_easy_init();
 
+#ifdef OSM_TRACES_STREAM
+  curl_mime *mime = NULL;
+  if ( stream ) {
+    mime = curl_mime_init ( curl );
+    upload_mime_add ( mime, "description", description );
+    upload_mime_add ( mime, "tags", tags );
+    upload_mime_add ( mime, "visibility", vistype->apistr );
+    curl_mimepart *part = curl_mime_addpart ( mime );
+    curl_mime_name ( part, "file" );
+    curl_mime_filename ( part, filename );
+#ifdef HAVE_LIBZ
+    curl_mime_type ( part, "application/gzip" );
+#else
+    curl_mime_type ( part, "text/xml" );
+#endif
+    // Unknown size so sent chunked
+    curl_mime_data_cb ( part, -1, upload_stream_read, NULL, NULL, stream );
+    curl_easy_setopt ( curl, CURLOPT_MIMEPOST, mime );
+    curl_easy_setopt ( curl, CURLOPT_XFERINFOFUNCTION, upload_stream_progress );
+    curl_easy_setopt ( curl, CURLOPT_XFERINFODATA, stream );
+    curl_easy_setopt ( curl, CURLOPT_NOPROGRESS, 0L );
+  }
+  else
+#endif
+  {
   /* Filling the form */
   curl_formadd(&post, &last,
                CURLFORM_COPYNAME, "description",
@@ -455,13 +605,14 @@ static gint osm_traces_upload_file(const char *user,
                CURLFORM_FILE, file,
                CURLFORM_FILENAME, filename,
 	       CURLFORM_CONTENTTYPE, "text/xml", CURLFORM_END);
+  curl_easy_setopt(curl, CURLOPT_HTTPPOST, post);
+  }
 
   /* Prepare request */
   /* As explained in http://wiki.openstreetmap.org/index.php/User:LA2 */
   /* Expect: header seems to produce incompatibilites between curl and httpd */
   headers = curl_slist_append(headers, "Expect: ");
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-  curl_easy_setopt(curl, CURLOPT_HTTPPOST, post);
   curl_easy_setopt(curl, CURLOPT_URL, base_url);
 #ifndef HAVE_OAUTH_H
     curl_easy_setopt(curl, CURLOPT_USERPWD, user_pass);
@@ -507,10 +658,87 @@ static gint osm_traces_upload_file(const char *user,
   g_free(base_url);
 
   curl_formfree(post);
+#ifdef OSM_TRACES_STREAM
+  curl_mime_free ( mime );
+#endif
+  curl_slist_free_all ( headers );
   curl_easy_cleanup(curl);
   return result;
 }
 
+#ifdef OSM_TRACES_STREAM
+static void upload_stream_add_points ( gpointer id, VikTrack *trk, gsize *points )
+{
+  if ( trk->visible )
+    *points += vik_track_get_tp_count ( trk );
+}
+
+/**
+ * Returns: The same as osm_traces_upload_file(),
+ *  or G_MININT if the GPX could not be streamed (so try another way)
+ */
+static gint osm_traces_upload_stream ( OsmTracesInfo *oti, VikTrack *trk, gpointer threaddata )
+{
+  gint fds[2];
+#ifdef WINDOWS
+  if ( _pipe ( fds, 65536, _O_BINARY ) != 0 )
+#else
+  if ( pipe ( fds ) != 0 )
+#endif
+  {
+    g_warning ( "%s: pipe failed: %s", __FUNCTION__, strerror(errno) );
+    return G_MININT;
+  }
+
+  UploadStream *us = g_malloc0 ( sizeof(UploadStream) );
+  us->vtl = oti->vtl;
+  us->trk = trk;
+  us->fd = fds[0];
+  us->gpx = fdopen ( fds[1], "w" );
+  us->threaddata = threaddata;
+  gsize points = 0;
+  if ( trk )
+    points = vik_track_get_tp_count ( trk );
+  else {
+    g_hash_table_foreach ( vik_trw_layer_get_tracks(oti->vtl), (GHFunc)upload_stream_add_points, &points );
+    g_hash_table_foreach ( vik_trw_layer_get_routes(oti->vtl), (GHFunc)upload_stream_add_points, &points );
+    points += g_hash_table_size ( vik_trw_layer_get_waypoints(oti->vtl) );
+  }
+  us->estimate = points * GPX_BYTES_PER_POINT;
+
+  gint ans = G_MININT;
+#ifdef HAVE_LIBZ
+  // With the gzip header, which OSM recognises
+  if ( deflateInit2 ( &us->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+    g_warning ( "%s: deflateInit2 failed", __FUNCTION__ );
+    if ( us->gpx ) fclose ( us->gpx ); else close ( fds[1] );
+    close ( fds[0] );
+    g_free ( us );
+    return ans;
+  }
+#endif
+
+  GThread *writer = us->gpx ? g_thread_try_new ( "osm_traces_gpx", (GThreadFunc)upload_stream_writer, us, NULL ) : NULL;
+  if ( writer ) {
+    ans = osm_traces_upload_file ( osm_user, osm_password, NULL,
+                                   oti->name, oti->description, oti->tags, oti->vistype, us );
+    // If the upload stopped early, the writer can only finish once the rest has been read
+    guchar discard[4096];
+    while ( upload_stream_read_gpx ( us, discard, sizeof(discard) ) > 0 );
+    g_thread_join ( writer );
+  }
+  else {
+    if ( us->gpx ) fclose ( us->gpx ); else close ( fds[1] );
+  }
+  close ( fds[0] );
+#ifdef HAVE_LIBZ
+  deflateEnd ( &us->zs );
+#endif
+  g_free ( us );
+  return ans;
+}
+#endif
+
 /**
  * uploading function executed by the background thread
  */
@@ -524,33 +752,39 @@ static void osm_traces_upload_thread ( OsmTracesInfo *oti, gpointer threaddata )
   GpxWritingOptions options = { TRUE, TRUE, FALSE, FALSE, vik_trw_layer_get_gpx_version(oti->vtl) };
 
   gchar *filename = NULL;
+  VikTrack *trk = oti->trk;
+  gint ans = G_MININT;
 
-  /* writing gpx file */
-  if (oti->trk != NULL)
+  /* Upload only the selected track */
+  if ( trk && oti->anonymize_times )
   {
-    /* Upload only the selected track */
-    if ( oti->anonymize_times )
-    {
-      VikTrack *trk = vik_track_copy(oti->trk, TRUE);
-      vik_track_anonymize_times(trk);
+    trk = vik_track_copy(oti->trk, TRUE);
+    vik_track_anonymize_times(trk);
+  }
+
+#ifdef OSM_TRACES_STREAM
+  ans = osm_traces_upload_stream ( oti, trk, threaddata );
+#endif
+
+  if ( ans == G_MININT ) {
+    /* writing gpx file */
+    if ( trk )
       filename = a_gpx_write_track_tmp_file (oti->vtl, trk, &options);
-      vik_track_free(trk);
-    }
     else
-      filename = a_gpx_write_track_tmp_file (oti->vtl, oti->trk, &options);
-  }
-  else
-  {
-    /* Upload the whole VikTrwLayer */
-    filename = a_gpx_write_tmp_file (oti->vtl, &options);
+      /* Upload the whole VikTrwLayer */
+      filename = a_gpx_write_tmp_file (oti->vtl, &options);
   }
 
-  if ( !filename )
-    return;
+  if ( trk && trk != oti->trk )
+    vik_track_free(trk);
 
-  /* finally, upload it */
-  gint ans = osm_traces_upload_file(osm_user, osm_password, filename,
-                   oti->name, oti->description, oti->tags, oti->vistype);
+  if ( ans == G_MININT ) {
+    if ( !filename )
+      return;
+    /* finally, upload it */
+    ans = osm_traces_upload_file(osm_user, osm_password, filename,
+                                 oti->name, oti->description, oti->tags, oti->vistype, NULL);
+  }
 
   //
   // Show result in statusbar or failure in dialog for user feedback
@@ -591,11 +825,13 @@ static void osm_traces_upload_thread ( OsmTracesInfo *oti, gpointer threaddata )
     g_free (msg);
   }
   /* Removing temporary file */
-  int ret = g_unlink(filename);
-  if (ret != 0) {
-    g_critical(_("failed to unlink temporary file: %s"), strerror(errno));
+  if ( filename ) {
+    int ret = g_unlink(filename);
+    if (ret != 0) {
+      g_critical(_("failed to unlink temporary file: %s"), strerror(errno));
+    }
+    g_free ( filename );
   }
-  g_free ( filename );
 }
 
 /**
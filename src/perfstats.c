@@ -0,0 +1,452 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Performance counters for tuning, gathered from the various subsystems:
+ *  counts of events, levels (such as queue depths) and timings of operations.
+ * Each is identified by a group (e.g. "mapcache") and a name within the group.
+ *
+ * Timings keep a histogram in powers of two of microseconds,
+ *  from which approximate percentiles are given.
+ * Values are kept from startup (or the last reset) and can be exported as JSON.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "perfstats.h"
+#include "tracelog.h"
+#include "dialog.h"
+#include "fileutils.h"
+#include "ui_util.h"
+
+// Bucket n holds timings under 2^n microseconds (and at least 2^(n-1))
+#define PERFSTATS_BUCKETS 32
+
+typedef enum {
+  PERFSTAT_COUNT = 0,
+  PERFSTAT_LEVEL,
+  PERFSTAT_TIME,
+} PerfStatType;
+
+typedef struct {
+  gchar *group;
+  gchar *name;
+  PerfStatType type;
+  guint64 count;     // Events, or number of timings
+  gint64 value;      // Current level, or total time in microseconds
+  gint64 min;
+  gint64 max;        // Highest level, or longest time
+  guint64 buckets[PERFSTATS_BUCKETS];
+} PerfStat;
+
+G_LOCK_DEFINE_STATIC(stats_lock);
+// "group/name" -> PerfStat
+static GHashTable *stats = NULL;
+
+static void perfstat_free ( PerfStat *ps )
+{
+  g_free ( ps->group );
+  g_free ( ps->name );
+  g_free ( ps );
+}
+
+/**
+ * Must be called with the lock held
+ */
+static PerfStat *perfstat_get ( const gchar *group, const gchar *name, PerfStatType type )
+{
+  if ( !stats )
+    stats = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)perfstat_free );
+
+  if ( !name )
+    name = "";
+  // Avoid an allocation for each event
+  gchar key[128];
+  g_snprintf ( key, sizeof(key), "%s/%s", group, name );
+  PerfStat *ps = g_hash_table_lookup ( stats, key );
+  if ( !ps ) {
+    ps = g_malloc0 ( sizeof(PerfStat) );
+    ps->group = g_strdup ( group );
+    ps->name = g_strdup ( name );
+    ps->type = type;
+    ps->min = G_MAXINT64;
+    g_hash_table_insert ( stats, g_strdup(key), ps );
+  }
+  return ps;
+}
+
+/**
+ * a_perfstats_count:
+ *
+ * Add @amount to the count of events (e.g. cache hits)
+ */
+void a_perfstats_count ( const gchar *group, const gchar *name, guint64 amount )
+{
+  G_LOCK(stats_lock);
+  perfstat_get ( group, name, PERFSTAT_COUNT )->count += amount;
+  G_UNLOCK(stats_lock);
+}
+
+/**
+ * a_perfstats_level:
+ *
+ * Set the current level of something (e.g. the number of jobs waiting),
+ *  the highest level is kept as well
+ */
+void a_perfstats_level ( const gchar *group, const gchar *name, gint64 level )
+{
+  G_LOCK(stats_lock);
+  PerfStat *ps = perfstat_get ( group, name, PERFSTAT_LEVEL );
+  ps->count++;
+  ps->value = level;
+  ps->min = MIN ( ps->min, level );
+  ps->max = MAX ( ps->max, level );
+  G_UNLOCK(stats_lock);
+}
+
+/**
+ * a_perfstats_time:
+ * @usecs: Duration of the operation, as from differences of g_get_monotonic_time()
+ *
+ * Record how long an operation took
+ */
+void a_perfstats_time ( const gchar *group, const gchar *name, gint64 usecs )
+{
+  usecs = MAX ( 0, usecs );
+  guint bucket = 0;
+  while ( bucket < PERFSTATS_BUCKETS-1 && ((gint64)1 << bucket) <= usecs )
+    bucket++;
+
+  G_LOCK(stats_lock);
+  PerfStat *ps = perfstat_get ( group, name, PERFSTAT_TIME );
+  ps->count++;
+  ps->value += usecs;
+  ps->min = MIN ( ps->min, usecs );
+  ps->max = MAX ( ps->max, usecs );
+  ps->buckets[bucket]++;
+  G_UNLOCK(stats_lock);
+}
+
+/**
+ * a_perfstats_reset:
+ *
+ * Forget all values so far, e.g. to measure a particular action
+ */
+void a_perfstats_reset ()
+{
+  G_LOCK(stats_lock);
+  if ( stats )
+    g_hash_table_remove_all ( stats );
+  G_UNLOCK(stats_lock);
+}
+
+void a_perfstats_uninit ()
+{
+  G_LOCK(stats_lock);
+  if ( stats )
+    g_hash_table_destroy ( stats );
+  stats = NULL;
+  G_UNLOCK(stats_lock);
+}
+
+/**
+ * Upper bound in microseconds of the bucket the given fraction of timings falls within
+ */
+static gint64 percentile ( const PerfStat *ps, gdouble fraction )
+{
+  guint64 wanted = (guint64)ceil ( ps->count * fraction );
+  guint64 seen = 0;
+  for ( guint bb = 0; bb < PERFSTATS_BUCKETS; bb++ ) {
+    seen += ps->buckets[bb];
+    if ( seen >= wanted )
+      return MIN ( (gint64)1 << bb, ps->max );
+  }
+  return ps->max;
+}
+
+static gint sort_by_key ( gconstpointer a, gconstpointer b )
+{
+  const PerfStat *psa = *(PerfStat**)a;
+  const PerfStat *psb = *(PerfStat**)b;
+  gint ans = g_strcmp0 ( psa->group, psb->group );
+  return ans ? ans : g_strcmp0 ( psa->name, psb->name );
+}
+
+/**
+ * A sorted copy of all the values, so they can be used without holding the lock
+ * Free with g_ptr_array_unref()
+ */
+static GPtrArray *snapshot ()
+{
+  GPtrArray *copy = g_ptr_array_new_with_free_func ( (GDestroyNotify)perfstat_free );
+  G_LOCK(stats_lock);
+  if ( stats ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, stats );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      PerfStat *ps = g_memdup ( value, sizeof(PerfStat) );
+      ps->group = g_strdup ( ps->group );
+      ps->name = g_strdup ( ps->name );
+      g_ptr_array_add ( copy, ps );
+    }
+  }
+  G_UNLOCK(stats_lock);
+  g_ptr_array_sort ( copy, sort_by_key );
+  return copy;
+}
+
+static void append_json_string ( GString *gs, const gchar *str )
+{
+  g_string_append_c ( gs, '"' );
+  for ( const gchar *pp = str; *pp; pp++ ) {
+    if ( *pp == '"' || *pp == '\\' )
+      g_string_append_printf ( gs, "\\%c", *pp );
+    else if ( (guchar)*pp < 0x20 )
+      g_string_append_printf ( gs, "\\u%04x", (guchar)*pp );
+    else
+      g_string_append_c ( gs, *pp );
+  }
+  g_string_append_c ( gs, '"' );
+}
+
+/**
+ * a_perfstats_to_json:
+ *
+ * Returns: All the values as a JSON array of objects, which should be freed after use.
+ *  Times are in microseconds, with the histogram as an object
+ *  of each bucket's upper bound to the number of timings in it.
+ */
+gchar *a_perfstats_to_json ()
+{
+  static const gchar *types[] = { "count", "level", "time" };
+  GPtrArray *all = snapshot ();
+  GString *gs = g_string_new ( "[\n" );
+  for ( guint ii = 0; ii < all->len; ii++ ) {
+    PerfStat *ps = g_ptr_array_index ( all, ii );
+    g_string_append ( gs, "  {\"group\": " );
+    append_json_string ( gs, ps->group );
+    g_string_append ( gs, ", \"name\": " );
+    append_json_string ( gs, ps->name );
+    g_string_append_printf ( gs, ", \"type\": \"%s\", \"count\": %" G_GUINT64_FORMAT, types[ps->type], ps->count );
+    switch ( ps->type ) {
+    case PERFSTAT_LEVEL:
+      g_string_append_printf ( gs, ", \"level\": %" G_GINT64_FORMAT ", \"min\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT,
+                               ps->value, ps->min, ps->max );
+      break;
+    case PERFSTAT_TIME:
+      g_string_append_printf ( gs, ", \"total_us\": %" G_GINT64_FORMAT ", \"min_us\": %" G_GINT64_FORMAT ", \"max_us\": %" G_GINT64_FORMAT
+                               ", \"p50_us\": %" G_GINT64_FORMAT ", \"p95_us\": %" G_GINT64_FORMAT ", \"histogram_us\": {",
+                               ps->value, ps->min, ps->max, percentile(ps, 0.5), percentile(ps, 0.95) );
+      gboolean first = TRUE;
+      for ( guint bb = 0; bb < PERFSTATS_BUCKETS; bb++ ) {
+        if ( !ps->buckets[bb] )
+          continue;
+        g_string_append_printf ( gs, "%s\"%" G_GINT64_FORMAT "\": %" G_GUINT64_FORMAT, first ? "" : ", ", (gint64)1 << bb, ps->buckets[bb] );
+        first = FALSE;
+      }
+      g_string_append_c ( gs, '}' );
+      break;
+    default:
+      break;
+    }
+    g_string_append_printf ( gs, "}%s\n", ii+1 < all->len ? "," : "" );
+  }
+  g_string_append ( gs, "]\n" );
+  g_ptr_array_unref ( all );
+  return g_string_free ( gs, FALSE );
+}
+
+enum {
+  PS_GROUP_COLUMN = 0,
+  PS_NAME_COLUMN,
+  PS_COUNT_COLUMN,
+  PS_VALUE_COLUMN,
+  PS_MEAN_COLUMN,
+  PS_P50_COLUMN,
+  PS_P95_COLUMN,
+  PS_MAX_COLUMN,
+  PS_NUM_COLUMNS
+};
+
+static void fill_store ( GtkListStore *store )
+{
+  gtk_list_store_clear ( store );
+  GPtrArray *all = snapshot ();
+  for ( guint ii = 0; ii < all->len; ii++ ) {
+    PerfStat *ps = g_ptr_array_index ( all, ii );
+    GtkTreeIter iter;
+    gtk_list_store_append ( store, &iter );
+    // Numbers that don't apply are left blank
+    gtk_list_store_set ( store, &iter, PS_GROUP_COLUMN, ps->group, PS_NAME_COLUMN, ps->name, PS_COUNT_COLUMN, ps->count,
+                         PS_VALUE_COLUMN, NAN, PS_MEAN_COLUMN, NAN, PS_P50_COLUMN, NAN, PS_P95_COLUMN, NAN, PS_MAX_COLUMN, NAN, -1 );
+    if ( ps->type == PERFSTAT_LEVEL )
+      gtk_list_store_set ( store, &iter, PS_VALUE_COLUMN, (gdouble)ps->value, PS_MAX_COLUMN, (gdouble)ps->max, -1 );
+    else if ( ps->type == PERFSTAT_TIME )
+      // Shown in milliseconds
+      gtk_list_store_set ( store, &iter,
+                           PS_VALUE_COLUMN, ps->value / 1000.0,
+                           PS_MEAN_COLUMN, ps->count ? ps->value / 1000.0 / ps->count : 0.0,
+                           PS_P50_COLUMN, percentile(ps, 0.5) / 1000.0,
+                           PS_P95_COLUMN, percentile(ps, 0.95) / 1000.0,
+                           PS_MAX_COLUMN, ps->max / 1000.0,
+                           -1 );
+  }
+  g_ptr_array_unref ( all );
+}
+
+/**
+ * a_perfstats_export:
+ *
+ * Write the JSON form of the values to the file
+ */
+gboolean a_perfstats_export ( const gchar *filename )
+{
+  gchar *json = a_perfstats_to_json ();
+  GError *error = NULL;
+  gboolean ans = g_file_set_contents ( filename, json, -1, &error );
+  if ( !ans ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( json );
+  return ans;
+}
+
+/**
+ * Export either these values, or the trace of the background jobs
+ */
+static void export_dialog ( GtkWindow *parent, gboolean trace )
+{
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export"),
+                                                    parent,
+                                                    GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                    GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gtk_file_chooser_set_current_name ( GTK_FILE_CHOOSER(dialog), trace ? "viking-trace.json" : "viking-performance.json" );
+  gchar *fn = NULL;
+  while ( gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT ) {
+    fn = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+    if ( g_file_test(fn, G_FILE_TEST_EXISTS) == FALSE || a_dialog_yes_or_no ( GTK_WINDOW(dialog), _("The file \"%s\" exists, do you wish to overwrite it?"), a_file_basename ( fn ) ) )
+      break;
+    g_free ( fn );
+    fn = NULL;
+  }
+  gtk_widget_destroy ( dialog );
+
+  if ( fn && !(trace ? a_tracelog_export ( fn ) : a_perfstats_export ( fn )) )
+    a_dialog_error_msg_extra ( parent, _("Unable to write to file %s"), fn );
+  g_free ( fn );
+}
+
+/**
+ * Show a number, or nothing when it does not apply (NAN)
+ */
+static void number_cell_data ( GtkTreeViewColumn *column, GtkCellRenderer *renderer, GtkTreeModel *model, GtkTreeIter *iter, gpointer data )
+{
+  gdouble value;
+  gtk_tree_model_get ( model, iter, GPOINTER_TO_INT(data), &value, -1 );
+  gchar buf[32];
+  if ( isnan(value) )
+    buf[0] = '\0';
+  else
+    g_snprintf ( buf, sizeof(buf), "%.3f", value );
+  g_object_set ( renderer, "text", buf, NULL );
+}
+
+static void add_number_column ( GtkWidget *view, const gchar *title, gint column )
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  g_object_set ( G_OBJECT(renderer), "xalign", 1.0, NULL );
+  GtkTreeViewColumn *col = gtk_tree_view_column_new_with_attributes ( title, renderer, NULL );
+  gtk_tree_view_column_set_cell_data_func ( col, renderer, number_cell_data, GINT_TO_POINTER(column), NULL );
+  gtk_tree_view_column_set_sort_column_id ( col, column );
+  gtk_tree_view_append_column ( GTK_TREE_VIEW(view), col );
+}
+
+/**
+ * a_perfstats_show_window:
+ *
+ * Display the current values in a dialog, which can be refreshed, reset or exported.
+ * The trace of background jobs can be exported from here too.
+ */
+void a_perfstats_show_window ( GtkWindow *parent )
+{
+  GtkListStore *store = gtk_list_store_new ( PS_NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT64,
+                                             G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE );
+  fill_store ( store );
+
+  GtkWidget *view = gtk_tree_view_new_with_model ( GTK_TREE_MODEL(store) );
+  g_object_unref ( store );
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  (void)ui_new_column_text ( _("Group"), renderer, view, PS_GROUP_COLUMN );
+  (void)ui_new_column_text ( _("Name"), renderer, view, PS_NAME_COLUMN );
+  (void)ui_new_column_text ( _("Count"), renderer, view, PS_COUNT_COLUMN );
+  add_number_column ( view, _("Level/Total ms"), PS_VALUE_COLUMN );
+  add_number_column ( view, _("Mean ms"), PS_MEAN_COLUMN );
+  add_number_column ( view, _("~Median ms"), PS_P50_COLUMN );
+  add_number_column ( view, _("~95% ms"), PS_P95_COLUMN );
+  add_number_column ( view, _("Max"), PS_MAX_COLUMN );
+  gtk_tree_view_set_rules_hint ( GTK_TREE_VIEW(view), TRUE );
+
+  GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
+  gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+  gtk_container_add ( GTK_CONTAINER(scrolledwindow), view );
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Performance"), parent, 0,
+                                                    GTK_STOCK_REFRESH, 1,
+                                                    GTK_STOCK_CLEAR, 2,
+                                                    GTK_STOCK_SAVE_AS, 3,
+                                                    _("Save _Trace..."), 4,
+                                                    GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                                    NULL );
+  GtkBox *vbox = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  gtk_box_pack_start ( vbox, scrolledwindow, TRUE, TRUE, 0 );
+  gtk_window_set_default_size ( GTK_WINDOW(dialog), 800, 500 );
+  gtk_widget_show_all ( dialog );
+
+  gboolean finished = FALSE;
+  while ( !finished ) {
+    gint response = gtk_dialog_run ( GTK_DIALOG(dialog) );
+    switch ( response ) {
+    case 2:
+      a_perfstats_reset ();
+      // Fall through
+    case 1:
+      fill_store ( store );
+      break;
+    case 3:
+    case 4:
+      export_dialog ( GTK_WINDOW(dialog), response == 4 );
+      break;
+    default:
+      finished = TRUE;
+      break;
+    }
+  }
+  gtk_widget_destroy ( dialog );
+}
@@ -0,0 +1,40 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PERFSTATS_H
+#define __VIKING_PERFSTATS_H
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+void a_perfstats_count ( const gchar *group, const gchar *name, guint64 amount );
+void a_perfstats_level ( const gchar *group, const gchar *name, gint64 level );
+void a_perfstats_time ( const gchar *group, const gchar *name, gint64 usecs );
+void a_perfstats_reset ();
+void a_perfstats_uninit ();
+
+gchar *a_perfstats_to_json ();
+gboolean a_perfstats_export ( const gchar *filename );
+void a_perfstats_show_window ( GtkWindow *parent );
+
+G_END_DECLS
+
+#endif
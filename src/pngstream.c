@@ -0,0 +1,334 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Write a PNG file a band of rows at a time, so the whole image never
+ *  needs to be held in memory.
+ *
+ * Each band is filtered and deflated on a worker thread, flushed to a byte
+ *  boundary so the compressed bands can simply be concatenated into one
+ *  zlib stream in the IDAT chunks, with the adler32 checksums combined.
+ * Only a few bands per CPU are in flight at a time.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "pngstream.h"
+#include "util.h"
+
+#ifdef HAVE_LIBZ
+
+typedef struct {
+  GdkPixbuf *rows;
+  gboolean last;
+  uLong adler;
+  gsize raw_len;
+  guchar *out;
+  gsize out_len;
+  gboolean done;
+} PngBand;
+
+struct _PngStream {
+  FILE *ff;
+  gchar *filename;
+  guint width;
+  guint height;
+  guint n_channels;
+  guint rows_written;
+  gboolean ok;
+  uLong adler;
+  GThreadPool *pool;
+  GQueue bands;     // In file order, waiting to be compressed or written
+  guint max_bands;
+  GMutex mutex;
+  GCond cond;
+};
+
+gboolean png_stream_available ( void )
+{
+  return TRUE;
+}
+
+static void put_be32 ( guchar *buf, guint32 val )
+{
+  buf[0] = val >> 24;
+  buf[1] = val >> 16;
+  buf[2] = val >> 8;
+  buf[3] = val;
+}
+
+static void write_chunk ( PngStream *ps, const gchar *type, const guchar *data, gsize len )
+{
+  guchar buf[4];
+  put_be32 ( buf, len );
+  uLong crc = crc32 ( 0, (const Bytef*)type, 4 );
+  if ( len )
+    crc = crc32 ( crc, data, len );
+  if ( fwrite ( buf, 4, 1, ps->ff ) != 1 || fwrite ( type, 4, 1, ps->ff ) != 1 ||
+       (len && fwrite ( data, len, 1, ps->ff ) != 1) )
+    ps->ok = FALSE;
+  put_be32 ( buf, crc );
+  if ( fwrite ( buf, 4, 1, ps->ff ) != 1 )
+    ps->ok = FALSE;
+}
+
+/**
+ * PNG 'Sub' filter (type 1) of every row, which only needs the row itself
+ *  so bands can be processed independently
+ */
+static guchar *band_filter ( GdkPixbuf *rows, guint n_channels, gsize *len )
+{
+  guint width = gdk_pixbuf_get_width ( rows );
+  guint height = gdk_pixbuf_get_height ( rows );
+  guint stride = gdk_pixbuf_get_rowstride ( rows );
+  const guchar *pixels = gdk_pixbuf_get_pixels ( rows );
+  gsize row_len = 1 + (gsize)width * n_channels;
+  guchar *raw = g_malloc ( row_len * height );
+
+  for ( guint yy = 0; yy < height; yy++ ) {
+    const guchar *src = pixels + (gsize)yy * stride;
+    guchar *dst = raw + row_len * yy;
+    dst[0] = 1;
+    memcpy ( dst+1, src, n_channels );
+    for ( gsize ii = n_channels; ii < row_len-1; ii++ )
+      dst[ii+1] = src[ii] - src[ii-n_channels];
+  }
+  *len = row_len * height;
+  return raw;
+}
+
+static void band_compress ( gpointer data, gpointer user_data )
+{
+  PngBand *band = data;
+  PngStream *ps = user_data;
+  gsize raw_len;
+  guchar *raw = band_filter ( band->rows, ps->n_channels, &raw_len );
+
+  z_stream zs;
+  memset ( &zs, 0, sizeof(z_stream) );
+  // Raw deflate, as the zlib wrapper is written once for the whole stream
+  if ( deflateInit2 ( &zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) == Z_OK ) {
+    uLong bound = deflateBound ( &zs, raw_len ) + 16; // Plus room for the flush marker
+    guchar *out = g_malloc ( bound );
+    zs.next_in = raw;
+    zs.avail_in = raw_len;
+    zs.next_out = out;
+    zs.avail_out = bound;
+    int ans = deflate ( &zs, band->last ? Z_FINISH : Z_SYNC_FLUSH );
+    if ( ans == Z_STREAM_END || (ans == Z_OK && zs.avail_in == 0 && zs.avail_out > 0) ) {
+      band->out = out;
+      band->out_len = bound - zs.avail_out;
+    }
+    else {
+      g_warning ( "%s: deflate failed %d", __FUNCTION__, ans );
+      g_free ( out );
+    }
+    deflateEnd ( &zs );
+  }
+  band->adler = adler32 ( adler32 ( 0, NULL, 0 ), raw, raw_len );
+  band->raw_len = raw_len;
+  g_free ( raw );
+
+  g_mutex_lock ( &ps->mutex );
+  band->done = TRUE;
+  g_cond_broadcast ( &ps->cond );
+  g_mutex_unlock ( &ps->mutex );
+}
+
+/**
+ * Write out the oldest band, once it has been compressed
+ * Must be called with the mutex held
+ */
+static void band_write_head ( PngStream *ps )
+{
+  PngBand *band = g_queue_peek_head ( &ps->bands );
+  while ( !band->done )
+    g_cond_wait ( &ps->cond, &ps->mutex );
+  (void)g_queue_pop_head ( &ps->bands );
+
+  if ( band->out ) {
+    write_chunk ( ps, "IDAT", band->out, band->out_len );
+    ps->adler = adler32_combine ( ps->adler, band->adler, band->raw_len );
+  }
+  else
+    ps->ok = FALSE;
+
+  g_object_unref ( band->rows );
+  g_free ( band->out );
+  g_free ( band );
+}
+
+/**
+ * png_stream_new:
+ * @has_alpha: Whether the rows will have an alpha channel
+ *
+ * Start writing a PNG image of the given size, to be supplied top down
+ *  via png_stream_write()
+ *
+ * Returns: NULL if the file could not be created
+ */
+PngStream *png_stream_new ( const gchar *filename, guint width, guint height, gboolean has_alpha )
+{
+  FILE *ff = g_fopen ( filename, "wb" );
+  if ( !ff ) {
+    g_warning ( "%s: Unable to create %s", __FUNCTION__, filename );
+    return NULL;
+  }
+
+  PngStream *ps = g_new0 ( PngStream, 1 );
+  ps->ff = ff;
+  ps->filename = g_strdup ( filename );
+  ps->width = width;
+  ps->height = height;
+  ps->n_channels = has_alpha ? 4 : 3;
+  ps->ok = TRUE;
+  ps->adler = adler32 ( 0, NULL, 0 );
+  g_mutex_init ( &ps->mutex );
+  g_cond_init ( &ps->cond );
+  g_queue_init ( &ps->bands );
+  guint cpus = util_get_number_of_cpus ();
+  ps->max_bands = 2 * cpus;
+  ps->pool = g_thread_pool_new ( band_compress, ps, cpus, FALSE, NULL );
+
+  static const guchar signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+  if ( fwrite ( signature, sizeof(signature), 1, ff ) != 1 )
+    ps->ok = FALSE;
+
+  guchar ihdr[13];
+  put_be32 ( ihdr, width );
+  put_be32 ( ihdr+4, height );
+  ihdr[8] = 8;                    // Bit depth
+  ihdr[9] = has_alpha ? 6 : 2;    // Truecolour, with or without alpha
+  ihdr[10] = 0;                   // Deflate
+  ihdr[11] = 0;                   // Adaptive filtering
+  ihdr[12] = 0;                   // Not interlaced
+  write_chunk ( ps, "IHDR", ihdr, sizeof(ihdr) );
+
+  // zlib header: deflate with a 32K window, default compression
+  static const guchar zlib_header[2] = { 0x78, 0x9c };
+  write_chunk ( ps, "IDAT", zlib_header, sizeof(zlib_header) );
+
+  return ps;
+}
+
+/**
+ * png_stream_write:
+ * @rows: The next rows of the image, of the full image width
+ *
+ * The rows are compressed in the background (and so must not be changed afterwards)
+ *
+ * Returns: FALSE if the rows don't fit the image
+ */
+gboolean png_stream_write ( PngStream *ps, GdkPixbuf *rows )
+{
+  guint height = gdk_pixbuf_get_height ( rows );
+  if ( gdk_pixbuf_get_width ( rows ) != ps->width ||
+       gdk_pixbuf_get_n_channels ( rows ) != ps->n_channels ||
+       gdk_pixbuf_get_bits_per_sample ( rows ) != 8 ||
+       ps->rows_written + height > ps->height ) {
+    g_warning ( "%s: Rows do not fit the image", __FUNCTION__ );
+    ps->ok = FALSE;
+    return FALSE;
+  }
+  ps->rows_written += height;
+
+  PngBand *band = g_new0 ( PngBand, 1 );
+  band->rows = g_object_ref ( rows );
+  band->last = ( ps->rows_written == ps->height );
+
+  g_mutex_lock ( &ps->mutex );
+  g_queue_push_tail ( &ps->bands, band );
+  // Write out what is ready, and limit how much is waiting
+  while ( !g_queue_is_empty ( &ps->bands ) &&
+          ( ((PngBand*)g_queue_peek_head ( &ps->bands ))->done || ps->bands.length > ps->max_bands ) )
+    band_write_head ( ps );
+  g_mutex_unlock ( &ps->mutex );
+
+  g_thread_pool_push ( ps->pool, band, NULL );
+  return ps->ok;
+}
+
+/**
+ * png_stream_close:
+ *
+ * Finish writing the image and free the stream
+ *
+ * Returns: TRUE if the whole image was written successfully
+ */
+gboolean png_stream_close ( PngStream *ps )
+{
+  g_mutex_lock ( &ps->mutex );
+  while ( !g_queue_is_empty ( &ps->bands ) )
+    band_write_head ( ps );
+  g_mutex_unlock ( &ps->mutex );
+  g_thread_pool_free ( ps->pool, FALSE, TRUE );
+
+  if ( ps->rows_written != ps->height ) {
+    g_warning ( "%s: Only %d of %d rows supplied", __FUNCTION__, ps->rows_written, ps->height );
+    ps->ok = FALSE;
+  }
+  else {
+    guchar trailer[4];
+    put_be32 ( trailer, ps->adler );
+    write_chunk ( ps, "IDAT", trailer, sizeof(trailer) );
+    write_chunk ( ps, "IEND", NULL, 0 );
+  }
+
+  if ( fclose ( ps->ff ) != 0 )
+    ps->ok = FALSE;
+  gboolean ok = ps->ok;
+  if ( !ok )
+    (void)g_remove ( ps->filename );
+
+  g_mutex_clear ( &ps->mutex );
+  g_cond_clear ( &ps->cond );
+  g_free ( ps->filename );
+  g_free ( ps );
+  return ok;
+}
+
+#else
+
+gboolean png_stream_available ( void )
+{
+  return FALSE;
+}
+
+PngStream *png_stream_new ( const gchar *filename, guint width, guint height, gboolean has_alpha )
+{
+  return NULL;
+}
+
+gboolean png_stream_write ( PngStream *ps, GdkPixbuf *rows )
+{
+  return FALSE;
+}
+
+gboolean png_stream_close ( PngStream *ps )
+{
+  return FALSE;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_PNGSTREAM_H
+#define _VIKING_PNGSTREAM_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PngStream PngStream;
+
+gboolean png_stream_available ( void );
+
+PngStream *png_stream_new ( const gchar *filename, guint width, guint height, gboolean has_alpha );
+gboolean png_stream_write ( PngStream *ps, GdkPixbuf *rows );
+gboolean png_stream_close ( PngStream *ps );
+
+G_END_DECLS
+
+#endif
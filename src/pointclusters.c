@@ -0,0 +1,238 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Points (e.g. waypoints) counted in grid cells at a series of levels,
+ *  each level having cells twice the size of the previous one.
+ * So drawing when zoomed out can show how many points are in each area,
+ *  rather than every point.
+ *
+ * A level is only built when first queried; from then on it is kept up to date
+ *  as each point is set or removed, so a change never means rebuilding everything.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "pointclusters.h"
+
+typedef struct {
+  guint count;
+  gdouble sum_lat;
+  gdouble sum_lon;
+} PointCell;
+
+struct _VikPointClusters {
+  gdouble cell_size;   // Degrees of the first level
+  guint n_levels;
+  GHashTable *points;  // Item -> struct LatLon of where it was set
+  GHashTable **levels; // Per level when built: Packed cell position -> PointCell
+};
+
+/**
+ * vik_point_clusters_new:
+ * @cell_size: The size of each grid cell of the first level in degrees
+ * @levels:    The number of levels
+ */
+VikPointClusters *vik_point_clusters_new ( gdouble cell_size, guint levels )
+{
+  VikPointClusters *pc = g_malloc0 ( sizeof(VikPointClusters) );
+  pc->cell_size = cell_size;
+  pc->n_levels = levels;
+  pc->points = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  pc->levels = g_new0 ( GHashTable*, levels );
+  return pc;
+}
+
+void vik_point_clusters_free ( VikPointClusters *pc )
+{
+  if ( !pc )
+    return;
+  for ( guint ll = 0; ll < pc->n_levels; ll++ )
+    if ( pc->levels[ll] )
+      g_hash_table_destroy ( pc->levels[ll] );
+  g_free ( pc->levels );
+  g_hash_table_destroy ( pc->points );
+  g_free ( pc );
+}
+
+static inline gdouble level_cell_size ( VikPointClusters *pc, guint level )
+{
+  return ldexp ( pc->cell_size, level );
+}
+
+static inline gint64 cell_key ( gint xx, gint yy )
+{
+  return ((gint64)xx << 32) | (guint32)yy;
+}
+
+/**
+ * Add (or with a negative sign take away) a point in its cell of the level
+ */
+static void level_update ( VikPointClusters *pc, guint level, const struct LatLon *ll, gint sign )
+{
+  gdouble size = level_cell_size ( pc, level );
+  gint64 ck = cell_key ( (gint)floor(ll->lon / size), (gint)floor(ll->lat / size) );
+  PointCell *cell = g_hash_table_lookup ( pc->levels[level], &ck );
+  if ( !cell ) {
+    if ( sign < 0 )
+      return;
+    cell = g_new0 ( PointCell, 1 );
+    g_hash_table_insert ( pc->levels[level], g_memdup(&ck, sizeof(ck)), cell );
+  }
+  if ( sign < 0 && cell->count <= 1 ) {
+    g_hash_table_remove ( pc->levels[level], &ck );
+    return;
+  }
+  cell->count += sign;
+  cell->sum_lat += sign * ll->lat;
+  cell->sum_lon += sign * ll->lon;
+}
+
+static void update_built_levels ( VikPointClusters *pc, const struct LatLon *ll, gint sign )
+{
+  for ( guint level = 0; level < pc->n_levels; level++ )
+    if ( pc->levels[level] )
+      level_update ( pc, level, ll, sign );
+}
+
+/**
+ * vik_point_clusters_remove:
+ *
+ * Take the item out, if it was set
+ */
+void vik_point_clusters_remove ( VikPointClusters *pc, gpointer item )
+{
+  struct LatLon *old = g_hash_table_lookup ( pc->points, item );
+  if ( !old )
+    return;
+  update_built_levels ( pc, old, -1 );
+  g_hash_table_remove ( pc->points, item );
+}
+
+/**
+ * vik_point_clusters_set:
+ *
+ * Add the item at the position, or move it there if already set.
+ * Only the cells it leaves and enters change.
+ */
+void vik_point_clusters_set ( VikPointClusters *pc, gpointer item, const struct LatLon *ll )
+{
+  struct LatLon *pos = g_hash_table_lookup ( pc->points, item );
+  if ( pos ) {
+    if ( pos->lat == ll->lat && pos->lon == ll->lon )
+      return;
+    update_built_levels ( pc, pos, -1 );
+  }
+  else {
+    pos = g_new ( struct LatLon, 1 );
+    g_hash_table_insert ( pc->points, item, pos );
+  }
+  *pos = *ll;
+  update_built_levels ( pc, pos, 1 );
+}
+
+guint vik_point_clusters_count ( VikPointClusters *pc )
+{
+  return g_hash_table_size ( pc->points );
+}
+
+/**
+ * vik_point_clusters_get_level:
+ * @cell_size: The smallest size of cell wanted in degrees
+ *
+ * Returns: The first level with cells at least this big (the last level if none is),
+ *          or -1 when even the first level's cells are bigger than wanted
+ */
+gint vik_point_clusters_get_level ( VikPointClusters *pc, gdouble cell_size )
+{
+  if ( cell_size < pc->cell_size )
+    return -1;
+  for ( guint level = 0; level < pc->n_levels; level++ )
+    if ( level_cell_size(pc, level) >= cell_size )
+      return level;
+  return pc->n_levels - 1;
+}
+
+static void call_cluster ( VikPointClusters *pc, guint level, gint64 ck, PointCell *cell, VikPointClusterFunc func, gpointer user_data )
+{
+  gdouble size = level_cell_size ( pc, level );
+  gint xx = (gint)(ck >> 32);
+  gint yy = (gint)(guint32)ck;
+  VikPointCluster cluster;
+  cluster.count = cell->count;
+  cluster.centre.lat = cell->sum_lat / cell->count;
+  cluster.centre.lon = cell->sum_lon / cell->count;
+  cluster.cell.south = yy * size;
+  cluster.cell.north = (yy + 1) * size;
+  cluster.cell.west = xx * size;
+  cluster.cell.east = (xx + 1) * size;
+  func ( &cluster, user_data );
+}
+
+/**
+ * vik_point_clusters_query:
+ *
+ * Call func for every cell of the level with some points, when the cell meets the area
+ */
+void vik_point_clusters_query ( VikPointClusters *pc, guint level, LatLonBBox bbox, VikPointClusterFunc func, gpointer user_data )
+{
+  if ( level >= pc->n_levels )
+    return;
+
+  if ( !pc->levels[level] ) {
+    pc->levels[level] = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, pc->points );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) )
+      level_update ( pc, level, value, 1 );
+  }
+
+  gdouble size = level_cell_size ( pc, level );
+  gint x1 = (gint)floor ( bbox.west / size );
+  gint x2 = (gint)floor ( bbox.east / size );
+  gint y1 = (gint)floor ( bbox.south / size );
+  gint y2 = (gint)floor ( bbox.north / size );
+  gdouble cells = ((gdouble)x2 - x1 + 1) * ((gdouble)y2 - y1 + 1);
+
+  if ( !(cells >= 1 && cells <= g_hash_table_size(pc->levels[level])) ) {
+    // Fewer cells with points than in the area
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, pc->levels[level] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      gint64 ck = *(gint64*)key;
+      gint xx = (gint)(ck >> 32);
+      gint yy = (gint)(guint32)ck;
+      if ( xx >= x1 && xx <= x2 && yy >= y1 && yy <= y2 )
+        call_cluster ( pc, level, ck, value, func, user_data );
+    }
+    return;
+  }
+
+  for ( gint xx = x1; xx <= x2; xx++ ) {
+    for ( gint yy = y1; yy <= y2; yy++ ) {
+      gint64 ck = cell_key ( xx, yy );
+      PointCell *cell = g_hash_table_lookup ( pc->levels[level], &ck );
+      if ( cell )
+        call_cluster ( pc, level, ck, cell, func, user_data );
+    }
+  }
+}
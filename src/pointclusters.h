@@ -0,0 +1,54 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_POINTCLUSTERS_H
+#define __VIKING_POINTCLUSTERS_H
+
+#include <glib.h>
+#include "bbox.h"
+#include "coords.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VikPointClusters VikPointClusters;
+
+/**
+ * The points within one grid cell of a level
+ */
+typedef struct {
+  guint count;
+  struct LatLon centre; // The mean position of the points
+  LatLonBBox cell;
+} VikPointCluster;
+
+typedef void (*VikPointClusterFunc) ( const VikPointCluster *cluster, gpointer user_data );
+
+VikPointClusters *vik_point_clusters_new ( gdouble cell_size, guint levels );
+void vik_point_clusters_free ( VikPointClusters *pc );
+
+void vik_point_clusters_set ( VikPointClusters *pc, gpointer item, const struct LatLon *ll );
+void vik_point_clusters_remove ( VikPointClusters *pc, gpointer item );
+guint vik_point_clusters_count ( VikPointClusters *pc );
+
+gint vik_point_clusters_get_level ( VikPointClusters *pc, gdouble cell_size );
+void vik_point_clusters_query ( VikPointClusters *pc, guint level, LatLonBBox bbox, VikPointClusterFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -28,6 +28,7 @@
 #include "dir.h"
 #include "file.h"
 #include "util.h"
+#include "fileutils.h"
 
 // TODO: STRING_LIST
 // TODO: share code in file reading
@@ -149,44 +150,64 @@ static VikLayerParamData preferences_run_getparam ( gpointer notused, guint16 i,
   return val->data;
 }
 
-static gboolean preferences_save_to_file ( gchar *fn )
+// Since preferences file may contain sensitive information,
+//  it'll be better to store it so it can only be read by the user
+#define PREFS_FILE_MODE 0600
+
+static GString *preferences_to_string ( void )
 {
-  FILE *f = g_fopen(fn, "w");
-  // Since preferences file may contain sensitive information,
-  //  it'll be better to store it so it can only be read by the user
-  if ( g_chmod(fn, 0600) != 0 )
-    g_warning ( "%s: Failed to set permissions on %s", __FUNCTION__, fn );
+  GString *str = g_string_new ( NULL );
+  for ( guint i = 0; i < params->len; i++ ) {
+    VikLayerParam *param = (VikLayerParam *) g_ptr_array_index(params,i);
+    VikLayerTypedParamData *val = (VikLayerTypedParamData *) g_hash_table_lookup ( values, param->name );
+    if ( val )
+      if ( val->type != VIK_LAYER_PARAM_PTR && val->type != VIK_LAYER_PARAM_PTR_DEFAULT )
+        file_append_layer_param ( str, param->name, val->type, val->data );
+  }
+  return str;
+}
 
-  if ( f ) {
-    VikLayerParam *param;
-    VikLayerTypedParamData *val;
-    int i;
-    for ( i = 0; i < params->len; i++ ) {
-      param = (VikLayerParam *) g_ptr_array_index(params,i);
-      val = (VikLayerTypedParamData *) g_hash_table_lookup ( values, param->name );
-      if ( val )
-        if ( val->type != VIK_LAYER_PARAM_PTR && val->type != VIK_LAYER_PARAM_PTR_DEFAULT )
-          file_write_layer_param ( f, param->name, val->type, val->data );
-    }
-    fclose(f);
-    f = NULL;
-    return TRUE;
+static gboolean preferences_save_to_file ( gchar *fn )
+{
+  GError *error = NULL;
+  GString *str = preferences_to_string ();
+  gboolean ans = a_file_set_contents ( fn, str->str, str->len, PREFS_FILE_MODE, &error );
+  if ( !ans ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
   }
+  g_string_free ( str, TRUE );
+  return ans;
+}
 
+static guint save_id = 0;
+// Seconds after a change before saving the preferences, covering any further changes
+#define PREFS_SAVE_DELAY 1
+
+static gboolean preferences_save_timeout ( gpointer data )
+{
+  save_id = 0;
+  gchar *fn = g_build_filename(a_get_viking_dir(), VIKING_PREFS_FILE, NULL);
+  GString *str = preferences_to_string ();
+  gsize len = str->len;
+  a_file_set_contents_async ( fn, g_string_free ( str, FALSE ), len, PREFS_FILE_MODE );
+  g_free ( fn );
   return FALSE;
 }
 
 /**
  * a_preferences_save_to_file:
  *
- * Returns: TRUE on success
+ * The preferences are saved shortly afterwards by another thread,
+ *  and in any case by a_preferences_uninit()
+ *
+ * Returns: TRUE
  */
 gboolean a_preferences_save_to_file()
 {
-  gchar *fn = g_build_filename(a_get_viking_dir(), VIKING_PREFS_FILE, NULL);
-  gboolean ans = preferences_save_to_file ( fn );
-  g_free ( fn );
-  return ans;
+  if ( !save_id )
+    save_id = g_timeout_add_seconds ( PREFS_SAVE_DELAY, preferences_save_timeout, NULL );
+  return TRUE;
 }
 
 
@@ -199,8 +220,10 @@ void a_preferences_show_window(GtkWindow *parent) {
     for ( i = 0; i < params->len; i++ ) {
       contiguous_params[i] = *((VikLayerParam*)(g_ptr_array_index(params,i)));
     }
+    // The values in memory are the latest, as the file may not have been saved yet
+    if ( !loaded )
+      preferences_load_from_file();
     loaded = TRUE;
-    preferences_load_from_file();
     if ( a_uibuilder_properties_factory ( _("Preferences"), parent, contiguous_params, params_count,
                                           (gchar **) groups_names->pdata, groups_names->len, // groups, groups_count, // groups? what groups?!
                                           NULL,
@@ -250,6 +273,12 @@ void a_preferences_init()
 
 void a_preferences_uninit()
 {
+  if ( save_id ) {
+    (void)g_source_remove ( save_id );
+    (void)preferences_save_timeout ( NULL );
+  }
+  a_file_set_contents_async_wait ();
+
   preferences_groups_uninit();
 
   g_ptr_array_foreach ( params, (GFunc)g_free, NULL );
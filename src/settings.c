@@ -30,12 +30,34 @@
   * Since these settings are 'internal' I have no problem with them *not* being supported
   *  between various Viking versions, should one switch to different API/storage methods.
   * Indeed even the internal settings themselves can be liable to change.
+  *
+  * Changes are saved a little while after they are made, by another thread,
+  *  so frequent updates (e.g. window sizes) neither block the UI nor cause lots of writes.
   */
 #include "settings.h"
 #include "dir.h"
 #include "globals.h"
+#include "fileutils.h"
 
 static GKeyFile *keyfile;
+// Lock for the keyfile, the parsed values and the save timeout
+static GMutex settings_mutex;
+
+// Each value once read from the keyfile, so repeated lookups don't parse it again
+typedef struct {
+	gchar type; // 'b', 'i' or 'd'
+	gboolean found;
+	union {
+		gboolean b;
+		gint i;
+		gdouble d;
+	} val;
+} SettingsParsed;
+static GHashTable *parsed;
+
+static guint save_id = 0;
+// Seconds after a change before saving the settings, covering any further changes
+#define SETTINGS_SAVE_DELAY 2
 
 #define VIKING_INI_FILE "viking.ini"
 
@@ -63,14 +85,38 @@ static gboolean settings_load_from_file()
 void a_settings_init()
 {
 	keyfile = g_key_file_new();
+	parsed = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
 	settings_load_from_file();
 }
 
+static gboolean settings_save_timeout ( gpointer data )
+{
+	gsize size;
+	g_mutex_lock ( &settings_mutex );
+	save_id = 0;
+	gchar *keyfilestr = g_key_file_to_data ( keyfile, &size, NULL );
+	g_mutex_unlock ( &settings_mutex );
+
+	gchar *fn = g_build_filename ( a_get_viking_dir(), VIKING_INI_FILE, NULL );
+	a_file_set_contents_async ( fn, keyfilestr, size, -1 );
+	g_free ( fn );
+	return FALSE;
+}
+
+/**
+ * Call with the lock held after a value is changed
+ */
+static void settings_changed ( const gchar *name )
+{
+	g_hash_table_remove ( parsed, name );
+	if ( !save_id )
+		save_id = g_timeout_add_seconds ( SETTINGS_SAVE_DELAY, settings_save_timeout, NULL );
+}
+
 /**
  * a_settings_uninit:
  *
- *  ATM: The only time settings are saved is on program exit
- *   Could change this to occur on window exit or dialog exit or have memory hash of values...?
+ * Any changes not yet saved are written now
  */
 void a_settings_uninit()
 {
@@ -78,6 +124,14 @@ void a_settings_uninit()
 	gchar *fn = g_build_filename ( a_get_viking_dir(), VIKING_INI_FILE, NULL );
 	gsize size;
 
+	if ( save_id ) {
+		(void)g_source_remove ( save_id );
+		save_id = 0;
+	}
+	// Don't let an earlier save finish after this one
+	a_file_set_contents_async_wait ();
+	g_hash_table_destroy ( parsed );
+
 	gchar *keyfilestr = g_key_file_to_data ( keyfile, &size, &error );
 
 	if ( error ) {
@@ -86,7 +140,7 @@ void a_settings_uninit()
 		goto tidy;
 	}
 
-	g_file_set_contents ( fn, keyfilestr, size, &error );
+	a_file_set_contents ( fn, keyfilestr, size, -1, &error );
 	if ( error ) {
 		g_warning ( "%s: %s", error->message, fn );
 		g_error_free ( error );
@@ -101,19 +155,52 @@ void a_settings_uninit()
 // ATM, can't see a point in having any more than one group for various settings
 #define VIKING_SETTINGS_GROUP "viking"
 
-static gboolean settings_get_boolean ( const gchar *group, const gchar *name, gboolean *val )
+/**
+ * Returns: FALSE if there was an error (which is freed)
+ */
+static gboolean settings_check_error ( GError *error )
 {
-	GError *error = NULL;
-	gboolean success = TRUE;
-	gboolean bb = g_key_file_get_boolean ( keyfile, group, name, &error );
 	if ( error ) {
 		// Only print on debug - as often may have requests for keys not in the file
 		if ( vik_debug && vik_verbose )
 			g_message ( "%s", error->message );
 		g_error_free ( error );
-		success = FALSE;
+		return FALSE;
 	}
-	*val = bb;
+	return TRUE;
+}
+
+/**
+ * Call with the lock held
+ *
+ * Returns: The value read from the keyfile, the first time for this name and type
+ */
+static SettingsParsed *settings_parsed_get ( const gchar *group, const gchar *name, gchar type )
+{
+	SettingsParsed *sp = g_hash_table_lookup ( parsed, name );
+	if ( sp && sp->type == type )
+		return sp;
+
+	GError *error = NULL;
+	sp = g_new0 ( SettingsParsed, 1 );
+	sp->type = type;
+	switch ( type ) {
+	case 'b': sp->val.b = g_key_file_get_boolean ( keyfile, group, name, &error ); break;
+	case 'i': sp->val.i = g_key_file_get_integer ( keyfile, group, name, &error ); break;
+	default:  sp->val.d = g_key_file_get_double ( keyfile, group, name, &error ); break;
+	}
+	sp->found = settings_check_error ( error );
+	g_hash_table_replace ( parsed, g_strdup(name), sp );
+	return sp;
+}
+
+static gboolean settings_get_boolean ( const gchar *group, const gchar *name, gboolean *val )
+{
+	g_mutex_lock ( &settings_mutex );
+	SettingsParsed *sp = settings_parsed_get ( group, name, 'b' );
+	gboolean success = sp->found;
+	*val = sp->val.b;
+	g_mutex_unlock ( &settings_mutex );
 	return success;
 }
 
@@ -124,23 +211,20 @@ gboolean a_settings_get_boolean ( const gchar *name, gboolean *val )
 
 void a_settings_set_boolean ( const gchar *name, gboolean val )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_boolean ( keyfile, VIKING_SETTINGS_GROUP, name, val );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 static gboolean settings_get_string ( const gchar *group, const gchar *name, gchar **val )
 {
 	GError *error = NULL;
-	gboolean success = TRUE;
+	g_mutex_lock ( &settings_mutex );
 	gchar *str = g_key_file_get_string ( keyfile, group, name, &error );
-	if ( error ) {
-		// Only print on debug - as often may have requests for keys not in the file
-		if ( vik_debug && vik_verbose )
-			g_message ( "%s", error->message );
-		g_error_free ( error );
-		success = FALSE;
-	}
+	g_mutex_unlock ( &settings_mutex );
 	*val = str;
-	return success;
+	return settings_check_error ( error );
 }
 
 /**
@@ -153,22 +237,19 @@ gboolean a_settings_get_string ( const gchar *name, gchar **val )
 
 void a_settings_set_string ( const gchar *name, const gchar *val )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_string ( keyfile, VIKING_SETTINGS_GROUP, name, val );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 static gboolean settings_get_integer ( const gchar *group, const gchar *name, gint *val )
 {
-	GError *error = NULL;
-	gboolean success = TRUE;
-	gint ii = g_key_file_get_integer ( keyfile, group, name, &error );
-	if ( error ) {
-		// Only print on debug - as often may have requests for keys not in the file
-		if ( vik_debug && vik_verbose )
-			g_message ( "%s", error->message );
-		g_error_free ( error );
-		success = FALSE;
-	}
-	*val = ii;
+	g_mutex_lock ( &settings_mutex );
+	SettingsParsed *sp = settings_parsed_get ( group, name, 'i' );
+	gboolean success = sp->found;
+	*val = sp->val.i;
+	g_mutex_unlock ( &settings_mutex );
 	return success;
 }
 
@@ -179,22 +260,19 @@ gboolean a_settings_get_integer ( const gchar *name, gint *val )
 
 void a_settings_set_integer ( const gchar *name, gint val )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_integer ( keyfile, VIKING_SETTINGS_GROUP, name, val );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 static gboolean settings_get_double ( const gchar *group, const gchar *name, gdouble *val )
 {
-	GError *error = NULL;
-	gboolean success = TRUE;
-	gdouble dd = g_key_file_get_double ( keyfile, group, name, &error );
-	if ( error ) {
-		// Only print on debug - as often may have requests for keys not in the file
-		if ( vik_debug && vik_verbose )
-			g_message ( "%s", error->message );
-		g_error_free ( error );
-		success = FALSE;
-	}
-	*val = dd;
+	g_mutex_lock ( &settings_mutex );
+	SettingsParsed *sp = settings_parsed_get ( group, name, 'd' );
+	gboolean success = sp->found;
+	*val = sp->val.d;
+	g_mutex_unlock ( &settings_mutex );
 	return success;
 }
 
@@ -205,23 +283,20 @@ gboolean a_settings_get_double ( const gchar *name, gdouble *val )
 
 void a_settings_set_double ( const gchar *name, gdouble val )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_double ( keyfile, VIKING_SETTINGS_GROUP, name, val );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 static gboolean settings_get_integer_list ( const gchar *group, const gchar *name, gint **vals, gsize *length )
 {
 	GError *error = NULL;
-	gboolean success = TRUE;
+	g_mutex_lock ( &settings_mutex );
 	gint *ints = g_key_file_get_integer_list ( keyfile, group, name, length, &error );
-	if ( error ) {
-		// Only print on debug - as often may have requests for keys not in the file
-		if ( vik_debug && vik_verbose )
-			g_message ( "%s", error->message );
-		g_error_free ( error );
-		success = FALSE;
-	}
+	g_mutex_unlock ( &settings_mutex );
 	*vals = ints;
-	return success;
+	return settings_check_error ( error );
 }
 
 /*
@@ -234,7 +309,10 @@ gboolean a_settings_get_integer_list ( const gchar *name, gint **vals, gsize* le
 
 void a_settings_set_integer_list ( const gchar *name, gint vals[], gsize length )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_integer_list ( keyfile, VIKING_SETTINGS_GROUP, name, vals, length );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 gboolean a_settings_get_integer_list_contains ( const gchar *name, gint val )
@@ -309,13 +387,10 @@ void a_settings_set_integer_list_containing ( const gchar *name, gint val )
 static gchar** settings_get_string_list ( const gchar *group, const gchar *name, gsize *length )
 {
 	GError *error = NULL;
+	g_mutex_lock ( &settings_mutex );
 	gchar **msgs = g_key_file_get_string_list ( keyfile, group, name, length, &error );
-	if ( error ) {
-		// Only print on debug - as often may have requests for keys not in the file
-		if ( vik_debug && vik_verbose )
-			g_message ( "%s", error->message );
-		g_error_free ( error );
-	}
+	g_mutex_unlock ( &settings_mutex );
+	(void)settings_check_error ( error );
 	return msgs;
 }
 
@@ -343,7 +418,10 @@ GList* a_settings_get_string_list ( const gchar *name )
 
 void a_settings_clear_string_list ( const gchar *name )
 {
+	g_mutex_lock ( &settings_mutex );
 	g_key_file_set_string_list ( keyfile, VIKING_SETTINGS_GROUP, name, NULL, 0 );
+	settings_changed ( name );
+	g_mutex_unlock ( &settings_mutex );
 }
 
 gboolean a_settings_get_string_list_contains ( const gchar *name, const gchar *val )
@@ -404,7 +482,10 @@ void a_settings_set_string_list_containing ( const gchar *name, const gchar *val
 		gchar **new_vals = (gchar**)g_ptr_array_free ( string_list, FALSE );
 		*/
 		// Apply
+		g_mutex_lock ( &settings_mutex );
 		g_key_file_set_string_list ( keyfile, VIKING_SETTINGS_GROUP, name, new_vals, length+1 );
+		settings_changed ( name );
+		g_mutex_unlock ( &settings_mutex );
 	}
 
 	// Free old array
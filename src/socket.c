@@ -38,6 +38,10 @@
  * The end of data is a blank line.
  * Each line should be ended with \n.
  *
+ * The whole batch is acknowledged as soon as it is received, with a reply of:
+ * accepted N\n
+ * where N is the number of files that exist, and are then opened by the running instance.
+ *
  * At the moment the only commands supported are 'open' and 'open-external'
  */
 #include "socket.h"
@@ -67,67 +71,128 @@ static GSocketAddress* get_socket_address(void)
 }
 
 /**
- * The callback to process data received on the socket
+ * A command being received
  */
-static gboolean incoming_callback ( GSocketService *service,
-                                    GSocketConnection *connection,
-                                    GObject *object,
-                                    gpointer user_data )
+typedef struct {
+	GSocketConnection *connection;
+	GDataInputStream *distream;
+	VikWindow *vw;
+	gboolean have_command;
+	gboolean external;
+	GSList *files; // Most recent first whilst being received
+} SocketRequest;
+
+static void socket_request_free ( SocketRequest *sr )
+{
+	g_slist_free_full ( sr->files, g_free );
+	g_object_unref ( sr->distream );
+	g_object_unref ( sr->connection );
+	g_free ( sr );
+}
+
+/**
+ * The whole batch of files has been received:
+ *  reply straight away, then start opening them
+ *  (with progress and any problems then shown by this instance)
+ */
+static void socket_request_finish ( SocketRequest *sr )
 {
 	GError *error = NULL;
-	GInputStream *istream = g_io_stream_get_input_stream ( G_IO_STREAM(connection) );
-	GDataInputStream *distream = g_data_input_stream_new ( istream );
-	gchar *line = NULL;
-	gboolean external = FALSE;
-	gsize length;
+	gchar *reply = g_strdup_printf ( "accepted %d\n", g_slist_length(sr->files) );
+	GOutputStream *ostream = g_io_stream_get_output_stream ( G_IO_STREAM(sr->connection) );
+	if ( !g_output_stream_write_all ( ostream, reply, strlen(reply), NULL, NULL, &error ) ) {
+		// Earlier versions of viking don't wait for the reply
+		g_debug ( "%s: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
+	}
+	g_free ( reply );
+	(void)g_io_stream_close ( G_IO_STREAM(sr->connection), NULL, NULL );
 
-	// First line is the command
-	line = g_data_input_stream_read_line ( distream, &length, NULL, &error );
+	GSList *files = NULL;
+	for ( GSList *cur = sr->files; cur; cur = cur->next ) {
+		// .vik files open in their own window
+		if ( check_file_magic_vik(cur->data) ) {
+			VikWindow *vw = vik_window_new_window();
+			vik_window_open_file ( vw, cur->data, TRUE, TRUE, TRUE, FALSE, sr->external );
+		}
+		else
+			files = g_slist_prepend ( files, cur->data );
+	}
+	// NB Now in the original order, so they can all be read at once
+	if ( files ) {
+		vik_window_open_files ( sr->vw, files, sr->external );
+		g_slist_free ( files );
+	}
+	socket_request_free ( sr );
+}
+
+/**
+ * Each line is read without waiting, so a slow sender doesn't hold up this instance
+ */
+static void socket_request_read_line ( GObject *source, GAsyncResult *res, gpointer user_data )
+{
+	SocketRequest *sr = (SocketRequest*)user_data;
+	GError *error = NULL;
+	gsize length;
+	gchar *line = g_data_input_stream_read_line_finish ( sr->distream, res, &length, &error );
 	if ( error ) {
 		g_warning ( "%s: %s", __FUNCTION__, error->message );
 		g_error_free ( error );
-		error = NULL;
 	}
-	if ( line ) {
-		g_debug ( "%s: command is %s", __FUNCTION__, line );
 
-		// Check the command is a supported one and then action it
-		if ( g_strcmp0(line, "open-external") == 0 )
-			external = TRUE;
+	// A blank line ends the data, or just the end of the connection from earlier versions
+	if ( !line || !*line ) {
+		g_free ( line );
+		if ( sr->have_command )
+			socket_request_finish ( sr );
+		else
+			socket_request_free ( sr );
+		return;
+	}
 
+	if ( !sr->have_command ) {
+		// First line is the command
+		g_debug ( "%s: command is %s", __FUNCTION__, line );
 		// Any 'open*' command - but meant for 'open' and 'open-external'
-		if ( g_str_has_prefix(line, "open") ) {
+		if ( !g_str_has_prefix(line, "open") ) {
 			g_free ( line );
-			do {
-				line = g_data_input_stream_read_line ( distream, &length, NULL, &error );
-				if ( error ) {
-					g_warning ( "%s: %s", __FUNCTION__, error->message );
-					g_error_free ( error );
-					error = NULL;
-				}
-				if ( line ) {
-					g_debug ( "%s: received: \"%s\"", __FUNCTION__, line );
-					if ( g_strcmp0(line, "-") == 0 )
-						g_warning ( "Can not open from stdin via socket" );
-					else {
-						if ( g_file_test(line, G_FILE_TEST_EXISTS) ) {
-							VikWindow *vw = VIK_WINDOW(user_data);
-							gboolean change_filename = FALSE;
-							// .vik files open in their own window
-							if ( check_file_magic_vik(line) ) {
-								vw = vik_window_new_window();
-								change_filename = TRUE;
-							}
-							vik_window_open_file ( vw, line, change_filename, TRUE, TRUE, FALSE, external );
-						} else {
-							g_warning ( _("Can not open non-existant file=%s"), line );
-						}
-					}
-					g_free ( line );
-				}
-			} while ( line );
+			socket_request_free ( sr );
+			return;
 		}
+		sr->have_command = TRUE;
+		sr->external = ( g_strcmp0(line, "open-external") == 0 );
+		g_free ( line );
 	}
+	else {
+		g_debug ( "%s: received: \"%s\"", __FUNCTION__, line );
+		if ( g_strcmp0(line, "-") == 0 ) {
+			g_warning ( "Can not open from stdin via socket" );
+			g_free ( line );
+		}
+		else if ( g_file_test(line, G_FILE_TEST_EXISTS) )
+			sr->files = g_slist_prepend ( sr->files, line );
+		else {
+			g_warning ( _("Can not open non-existant file=%s"), line );
+			g_free ( line );
+		}
+	}
+
+	g_data_input_stream_read_line_async ( sr->distream, G_PRIORITY_DEFAULT, NULL, socket_request_read_line, sr );
+}
+
+/**
+ * The callback to process data received on the socket
+ */
+static gboolean incoming_callback ( GSocketService *service,
+                                    GSocketConnection *connection,
+                                    GObject *object,
+                                    gpointer user_data )
+{
+	SocketRequest *sr = g_new0 ( SocketRequest, 1 );
+	sr->connection = g_object_ref ( connection );
+	sr->distream = g_data_input_stream_new ( g_io_stream_get_input_stream(G_IO_STREAM(connection)) );
+	sr->vw = VIK_WINDOW(user_data);
+	g_data_input_stream_read_line_async ( sr->distream, G_PRIORITY_DEFAULT, NULL, socket_request_read_line, sr );
 	return TRUE;
 }
 
@@ -283,8 +348,19 @@ gboolean socket_open_files ( guint argc, gchar **argv, gboolean external )
 
 		// The end marker
 		g_data_output_stream_put_string ( dostream,
-		                                  "",
+		                                  "\n",
 		                                  NULL, NULL );
+		g_object_unref ( dostream );
+		// Also let earlier versions of viking know there's nothing more
+		(void)g_socket_shutdown ( gsock, FALSE, TRUE, NULL );
+
+		// Only waiting for the files to be accepted, not for them to be loaded
+		GDataInputStream *distream = g_data_input_stream_new ( g_io_stream_get_input_stream(G_IO_STREAM(gsc)) );
+		gsize length;
+		gchar *reply = g_data_input_stream_read_line ( distream, &length, NULL, NULL );
+		g_debug ( "%s: reply %s", __FUNCTION__, reply ? reply : "<none>" );
+		g_free ( reply );
+		g_object_unref ( distream );
 	}
 
 	g_object_unref ( gsock );
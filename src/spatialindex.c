@@ -0,0 +1,170 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * A simple grid of lat/lon cells, for finding the items (e.g. tracks or waypoints)
+ *  whose bounds meet an area without having to test every item.
+ *
+ * Items are only added - when they change the index should be recreated.
+ * Queries may give items whose bounds are near but do not actually meet the area,
+ *  so callers still need to do their own exact test.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "spatialindex.h"
+
+// Items covering more cells than this are just always considered
+#define SPATIAL_INDEX_MAX_CELLS 256
+
+typedef struct {
+  LatLonBBox bbox;
+  gpointer key;
+  gpointer value;
+  guint stamp; // The last query that gave this item
+} SpatialItem;
+
+struct _VikSpatialIndex {
+  gdouble cell_size; // Degrees
+  GArray *items;     // SpatialItem
+  GHashTable *cells; // Packed cell position -> GArray of item positions
+  GArray *large;     // Positions of items not put into cells
+  guint stamp;
+};
+
+static void cell_free ( GArray *cell )
+{
+  g_array_free ( cell, TRUE );
+}
+
+/**
+ * vik_spatial_index_new:
+ * @cell_size: The size of each grid cell in degrees
+ */
+VikSpatialIndex *vik_spatial_index_new ( gdouble cell_size )
+{
+  VikSpatialIndex *index = g_malloc0 ( sizeof(VikSpatialIndex) );
+  index->cell_size = cell_size;
+  index->items = g_array_new ( FALSE, FALSE, sizeof(SpatialItem) );
+  index->cells = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)cell_free );
+  index->large = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  return index;
+}
+
+void vik_spatial_index_free ( VikSpatialIndex *index )
+{
+  if ( !index )
+    return;
+  g_array_free ( index->items, TRUE );
+  g_hash_table_destroy ( index->cells );
+  g_array_free ( index->large, TRUE );
+  g_free ( index );
+}
+
+/**
+ * The range of cells covering the bounds
+ * Returns the number of cells
+ */
+static gdouble cell_range ( VikSpatialIndex *index, LatLonBBox bbox, gint *x1, gint *x2, gint *y1, gint *y2 )
+{
+  *x1 = (gint)floor ( bbox.west / index->cell_size );
+  *x2 = (gint)floor ( bbox.east / index->cell_size );
+  *y1 = (gint)floor ( bbox.south / index->cell_size );
+  *y2 = (gint)floor ( bbox.north / index->cell_size );
+  return ((gdouble)*x2 - *x1 + 1) * ((gdouble)*y2 - *y1 + 1);
+}
+
+static inline gint64 cell_key ( gint xx, gint yy )
+{
+  return ((gint64)xx << 32) | (guint32)yy;
+}
+
+void vik_spatial_index_add ( VikSpatialIndex *index, LatLonBBox bbox, gpointer key, gpointer value )
+{
+  SpatialItem item = { bbox, key, value, 0 };
+  guint pos = index->items->len;
+  g_array_append_val ( index->items, item );
+
+  gint x1, x2, y1, y2;
+  gdouble cells = cell_range ( index, bbox, &x1, &x2, &y1, &y2 );
+  if ( !(cells >= 1 && cells <= SPATIAL_INDEX_MAX_CELLS) ) {
+    g_array_append_val ( index->large, pos );
+    return;
+  }
+
+  for ( gint xx = x1; xx <= x2; xx++ ) {
+    for ( gint yy = y1; yy <= y2; yy++ ) {
+      gint64 ck = cell_key ( xx, yy );
+      GArray *cell = g_hash_table_lookup ( index->cells, &ck );
+      if ( !cell ) {
+        cell = g_array_new ( FALSE, FALSE, sizeof(guint) );
+        g_hash_table_insert ( index->cells, g_memdup(&ck, sizeof(ck)), cell );
+      }
+      g_array_append_val ( cell, pos );
+    }
+  }
+}
+
+static void query_item ( VikSpatialIndex *index, guint pos, GHFunc func, gpointer user_data )
+{
+  SpatialItem *item = &g_array_index ( index->items, SpatialItem, pos );
+  // Only once, even when in several cells
+  if ( item->stamp == index->stamp )
+    return;
+  item->stamp = index->stamp;
+  func ( item->key, item->value, user_data );
+}
+
+/**
+ * vik_spatial_index_query:
+ *
+ * Call func for (at least) every item whose bounds meet the area
+ */
+void vik_spatial_index_query ( VikSpatialIndex *index, LatLonBBox bbox, GHFunc func, gpointer user_data )
+{
+  if ( ++index->stamp == 0 ) {
+    // Wrapped around - so forget all previous queries
+    for ( guint ii = 0; ii < index->items->len; ii++ )
+      g_array_index ( index->items, SpatialItem, ii ).stamp = 0;
+    index->stamp = 1;
+  }
+
+  gint x1, x2, y1, y2;
+  gdouble cells = cell_range ( index, bbox, &x1, &x2, &y1, &y2 );
+  if ( !(cells >= 1 && cells <= g_hash_table_size(index->cells)) ) {
+    // Looking at most of the index anyway (e.g. zoomed out)
+    for ( guint ii = 0; ii < index->items->len; ii++ )
+      query_item ( index, ii, func, user_data );
+    return;
+  }
+
+  for ( guint ii = 0; ii < index->large->len; ii++ )
+    query_item ( index, g_array_index(index->large, guint, ii), func, user_data );
+
+  for ( gint xx = x1; xx <= x2; xx++ ) {
+    for ( gint yy = y1; yy <= y2; yy++ ) {
+      gint64 ck = cell_key ( xx, yy );
+      GArray *cell = g_hash_table_lookup ( index->cells, &ck );
+      if ( cell )
+        for ( guint ii = 0; ii < cell->len; ii++ )
+          query_item ( index, g_array_index(cell, guint, ii), func, user_data );
+    }
+  }
+}
@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_SPATIALINDEX_H
+#define __VIKING_SPATIALINDEX_H
+
+#include <glib.h>
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VikSpatialIndex VikSpatialIndex;
+
+VikSpatialIndex *vik_spatial_index_new ( gdouble cell_size );
+void vik_spatial_index_free ( VikSpatialIndex *index );
+
+void vik_spatial_index_add ( VikSpatialIndex *index, LatLonBBox bbox, gpointer key, gpointer value );
+void vik_spatial_index_query ( VikSpatialIndex *index, LatLonBBox bbox, GHFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -27,6 +27,7 @@
 #include "tcx.h"
 #include "viking.h"
 #include <expat.h>
+#include "xmltagtree.h"
 
 typedef enum {
 	tt_unknown = 0,
@@ -111,78 +112,88 @@ static tag_mapping tag_path_map[] = {
 	{0}
 };
 
-static tag_type get_tag ( const char *tt )
+/**
+ * The tag map as a tree, made on first use
+ */
+static VikXmlTagTree *get_tag_tree ( void )
 {
-	tag_mapping *tm;
-	for ( tm = tag_path_map; tm->tag_type != 0; tm++ )
-		if ( 0 == strcmp(tm->tag_name, tt) )
-			return tm->tag_type;
-	return tt_unknown;
+	static VikXmlTagTree *tree = NULL;
+	if ( g_once_init_enter ( &tree ) ) {
+		VikXmlTagTree *tt = vik_xml_tag_tree_new ();
+		tag_mapping *tm;
+		for ( tm = tag_path_map; tm->tag_type != 0; tm++ )
+			vik_xml_tag_tree_add ( tt, tm->tag_name, tm->tag_type );
+		g_once_init_leave ( &tree, tt );
+	}
+	return tree;
 }
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-static GString *c_cdata = NULL;
-
-// current ("c_") objects
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTrwLayer *c_vtl = NULL;
-static VikTRWMetadata *c_md = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-static gboolean has_layer_name = FALSE;
-
-// temporary things so we don't have to create them lots of times
-static struct LatLon c_ll;
-
-// specialty flags / etc
-static gboolean f_tr_newseg;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_layers = 0;
-
+/**
+ * Everything about the file being read,
+ *  kept per parse so that several files can be read at the same time
+ */
 typedef struct {
 	VikAggregateLayer *val;
 	VikViewport *vvp;
 	const gchar *filename;
+
+	tag_type current_tag;
+	// Where the parse is within the tag tree
+	GArray *tag_stack;
+	GString *c_cdata;
+
+	// current ("c_") objects
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	VikTrwLayer *c_vtl;
+	VikTRWMetadata *c_md;
+
+	gchar *c_wp_name;
+	gchar *c_tr_name;
+	gboolean has_layer_name;
+
+	// temporary things so we don't have to create them lots of times
+	struct LatLon c_ll;
+
+	// specialty flags / etc
+	gboolean f_tr_newseg;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_layers;
 } UserDataT;
 
 static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 {
-	g_string_append_c ( xpath, '/' );
-	g_string_append ( xpath, el );
-	current_tag = get_tag ( xpath->str );
+	ud->current_tag = vik_xml_tag_tree_push ( get_tag_tree(), ud->tag_stack, el );
 
-	switch ( current_tag ) {
+	switch ( ud->current_tag ) {
 
 		case tt_tcx: {
 			if (ud->val) {
-				c_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, ud->vvp, FALSE ));
+				ud->c_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, ud->vvp, FALSE ));
 				// Always force V1.1, since we may read in 'extended' data like cadence, etc...
-				vik_trw_layer_set_gpx_version ( c_vtl, GPX_V1_1 );
-				c_md = vik_trw_metadata_new();
+				vik_trw_layer_set_gpx_version ( ud->c_vtl, GPX_V1_1 );
+				ud->c_md = vik_trw_metadata_new();
 			}
 			break;
 		}
 
 		case tt_wpt:
-			c_wp = vik_waypoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ud->c_wp = vik_waypoint_new ();
+			ud->c_ll.lat = NAN;
+			ud->c_ll.lon = NAN;
 			break;
 
 		case tt_trk:
-			c_tr = vik_track_new ();
-			f_tr_newseg = TRUE;
+			ud->c_tr = vik_track_new ();
+			ud->f_tr_newseg = TRUE;
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			c_tp = vik_trackpoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ud->c_tp = vik_trackpoint_new ();
+			ud->c_ll.lat = NAN;
+			ud->c_ll.lon = NAN;
 			break;
 
 		case tt_tcx_creator:
@@ -202,7 +213,7 @@ static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 		case tt_wpt_time:
 		case tt_wpt_pos_lat:
 		case tt_wpt_pos_lon:
-			g_string_erase ( c_cdata, 0, -1 ); // clear the cdata buffer
+			g_string_erase ( ud->c_cdata, 0, -1 ); // clear the cdata buffer
 			break;
 
 		default: break;
@@ -211,213 +222,211 @@ static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 
 static void tcx_end ( UserDataT *ud, const char *el )
 {
-	static GTimeVal tp_time;
-	static GTimeVal wp_time;
-
-	g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+	GTimeVal tp_time;
+	GTimeVal wp_time;
 
-	switch ( current_tag ) {
+	switch ( ud->current_tag ) {
 
 		case tt_tcx:
-			if ( ud->val && c_vtl ) {
-				if ( vik_trw_layer_is_empty(c_vtl) ) {
+			if ( ud->val && ud->c_vtl ) {
+				if ( vik_trw_layer_is_empty(ud->c_vtl) ) {
 					// free up layer
-					g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(c_vtl)) );
-					g_object_unref ( c_vtl );
+					g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(ud->c_vtl)) );
+					g_object_unref ( ud->c_vtl );
 				} else {
 					// Add it
-					if ( !has_layer_name ) {
-						unnamed_layers++;
-						gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(ud->filename), unnamed_layers );
-						vik_layer_rename ( VIK_LAYER(c_vtl), name );
+					if ( !ud->has_layer_name ) {
+						ud->unnamed_layers++;
+						gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(ud->filename), ud->unnamed_layers );
+						vik_layer_rename ( VIK_LAYER(ud->c_vtl), name );
 						g_free ( name );
 					}
-					vik_layer_post_read ( VIK_LAYER(c_vtl), ud->vvp, TRUE );
-					vik_aggregate_layer_add_layer ( ud->val, VIK_LAYER(c_vtl), FALSE );
-					vik_trw_layer_set_metadata ( c_vtl, c_md );
+					vik_layer_post_read ( VIK_LAYER(ud->c_vtl), ud->vvp, TRUE );
+					vik_aggregate_layer_add_layer ( ud->val, VIK_LAYER(ud->c_vtl), FALSE );
+					vik_trw_layer_set_metadata ( ud->c_vtl, ud->c_md );
 					// TODO - only really need to do this once at the end on the aggregate layer, but no functionality for this yet
-					vik_trw_layer_auto_set_view ( c_vtl, ud->vvp );
+					vik_trw_layer_auto_set_view ( ud->c_vtl, ud->vvp );
 				}
-				c_md = NULL;
-				c_vtl = NULL;
-				has_layer_name = FALSE;
+				ud->c_md = NULL;
+				ud->c_vtl = NULL;
+				ud->has_layer_name = FALSE;
 			}
 			break;
 
 		case tt_tcx_name:
-			if ( c_vtl ) {
-				vik_layer_rename ( VIK_LAYER(c_vtl), c_cdata->str );
-				has_layer_name = TRUE;
+			if ( ud->c_vtl ) {
+				vik_layer_rename ( VIK_LAYER(ud->c_vtl), ud->c_cdata->str );
+				ud->has_layer_name = TRUE;
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_tcx_creator:
-			if ( c_md ) {
-				if ( c_md->author )
-					g_free ( c_md->author );
-				c_md->author = g_strdup ( c_cdata->str );
+			if ( ud->c_md ) {
+				if ( ud->c_md->author )
+					g_free ( ud->c_md->author );
+				ud->c_md->author = g_strdup ( ud->c_cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_tcx_cmt:
-			if ( c_md ) {
-				if ( c_md->description )
-					g_free ( c_md->description );
-				c_md->description = g_strdup ( c_cdata->str );
+			if ( ud->c_md ) {
+				if ( ud->c_md->description )
+					g_free ( ud->c_md->description );
+				ud->c_md->description = g_strdup ( ud->c_cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_wpt:
-			if ( !c_wp_name )
-				c_wp_name = g_strdup_printf ( _("Waypoint%04d"), unnamed_waypoints++ );
+			if ( !ud->c_wp_name )
+				ud->c_wp_name = g_strdup_printf ( _("Waypoint%04d"), ud->unnamed_waypoints++ );
 
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode(c_vtl), &c_ll );
-				vik_trw_layer_filein_add_waypoint ( c_vtl, c_wp_name, c_wp );
+			if ( !isnan(ud->c_ll.lat) && !isnan(ud->c_ll.lon) ) {
+				vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode(ud->c_vtl), &ud->c_ll );
+				vik_trw_layer_filein_add_waypoint ( ud->c_vtl, ud->c_wp_name, ud->c_wp );
 			} else {
-				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, c_wp_name );
-				vik_waypoint_free ( c_wp );
+				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, ud->c_wp_name );
+				vik_waypoint_free ( ud->c_wp );
 			}
 
-			g_free ( c_wp_name );
-			c_wp = NULL;
-			c_wp_name = NULL;
+			g_free ( ud->c_wp_name );
+			ud->c_wp = NULL;
+			ud->c_wp_name = NULL;
 			break;
 
 		case tt_trk:
-			if ( c_vtl ) {
-				c_tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
-				c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-				vik_trw_layer_filein_add_track ( c_vtl, c_tr_name, c_tr );
+			if ( ud->c_vtl ) {
+				ud->c_tr_name = g_strdup_printf ( _("Track%03d"), ud->unnamed_tracks++ );
+				ud->c_tr->trackpoints = g_list_reverse ( ud->c_tr->trackpoints );
+				vik_trw_layer_filein_add_track ( ud->c_vtl, ud->c_tr_name, ud->c_tr );
 			}
-			g_free ( c_tr_name );
-			c_tr = NULL;
-			c_tr_name = NULL;
+			g_free ( ud->c_tr_name );
+			ud->c_tr = NULL;
+			ud->c_tr_name = NULL;
 			break;
 
 		case tt_wpt_name:
-			if ( c_wp_name )
-				g_free ( c_wp_name );
-			c_wp_name = g_strdup ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			if ( ud->c_wp_name )
+				g_free ( ud->c_wp_name );
+			ud->c_wp_name = g_strdup ( ud->c_cdata->str );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_wpt_ele:
-			c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_wp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_ele:
-			c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_wpt_cmt:
-			vik_waypoint_set_comment ( c_wp, c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			vik_waypoint_set_comment ( ud->c_wp, ud->c_cdata->str );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_wpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
+			if ( g_time_val_from_iso8601(ud->c_cdata->str, &wp_time) ) {
 				gdouble d1 = wp_time.tv_sec;
 				gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-				c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+				ud->c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
+			if ( g_time_val_from_iso8601(ud->c_cdata->str, &tp_time) ) {
 				gdouble d1 = tp_time.tv_sec;
 				gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-				c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+				ud->c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( ud->c_cdata->str, NULL );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid trkpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ud->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( ud->c_cdata->str, NULL );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid trkpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ud->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode(c_vtl), &c_ll );
-				if ( f_tr_newseg ) {
-					c_tp->newsegment = TRUE;
-					f_tr_newseg = FALSE;
+			if ( !isnan(ud->c_ll.lat) && !isnan(ud->c_ll.lon) ) {
+				vik_coord_load_from_latlon ( &(ud->c_tp->coord), vik_trw_layer_get_coord_mode(ud->c_vtl), &ud->c_ll );
+				if ( ud->f_tr_newseg ) {
+					ud->c_tp->newsegment = TRUE;
+					ud->f_tr_newseg = FALSE;
 				}
-				c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+				ud->c_tr->trackpoints = g_list_prepend ( ud->c_tr->trackpoints, ud->c_tp );
 			} else {
 				g_warning ( "%s: Missing a coordinate value", __FUNCTION__ );
-				vik_trackpoint_free ( c_tp );
+				vik_trackpoint_free ( ud->c_tp );
 			}
-			c_tp = NULL;
+			ud->c_tp = NULL;
 			break;
 
 		case tt_wpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( ud->c_cdata->str, NULL );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid wpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ud->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_wpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( ud->c_cdata->str, NULL );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid wpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ud->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_cadence:
-			c_tp->cadence = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->cadence = atoi ( ud->c_cdata->str );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_hr:
-			c_tp->heart_rate = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->heart_rate = atoi ( ud->c_cdata->str );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_power:
-			c_tp->power = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->power = g_ascii_strtod ( ud->c_cdata->str, NULL );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_speed:
-			c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+			g_string_erase ( ud->c_cdata, 0, -1 );
 			break;
 
 	        default: break;
 	}
 
-	current_tag = get_tag ( xpath->str );
+	ud->current_tag = vik_xml_tag_tree_pop ( get_tag_tree(), ud->tag_stack );
 }
 
-static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
+static void tcx_cdata ( UserDataT *ud, const XML_Char *ss, int len )
 {
-	switch ( current_tag ) {
+	switch ( ud->current_tag ) {
 		case tt_tcx_name:
 		case tt_tcx_creator:
 		case tt_tcx_cmt:
@@ -435,41 +444,29 @@ static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
 		case tt_trk_trkseg_trkpt_hr:
 		case tt_trk_trkseg_trkpt_power:
 		case tt_trk_trkseg_trkpt_speed:
-			g_string_append_len ( c_cdata, ss, len );
+			g_string_append_len ( ud->c_cdata, ss, len );
 			break;
 		default: break; // ignore cdata from other things
 	}
 }
 
-static void reset_globals ( VikTrwLayer *vtl )
-{
-	f_tr_newseg = FALSE;
-	current_tag = tt_unknown;
-	xpath = g_string_new ( "" );
-	c_cdata = g_string_new ( "" );
-	c_vtl = vtl;
-
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-	unnamed_layers = 1;
-}
-
-/**
- * Returns TRUE on a successful file read
- *   NB The file of course could contain no actual geo data that we can use!
- * NB2 Filename is used in case a name from within the file itself can not be found
- *   as file access is via the FILE* stream methods
- */
-gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+static gboolean tcx_read ( VikAggregateLayer *val, VikViewport *vvp, VikTrwLayer *vtl, FILE *ff, const gchar* filename )
 {
 	XML_Parser parser = XML_ParserCreate ( NULL );
 	int done=0, len;
 	enum XML_Status status = XML_STATUS_ERROR;
 
-	UserDataT *ud = g_malloc (sizeof(UserDataT));
+	UserDataT *ud = g_malloc0 (sizeof(UserDataT));
 	ud->val      = val;
 	ud->vvp      = vvp;
 	ud->filename = filename;
+	ud->current_tag = tt_unknown;
+	ud->tag_stack = vik_xml_tag_tree_stack_new ();
+	ud->c_cdata = g_string_new ( "" );
+	ud->c_vtl = vtl;
+	ud->unnamed_waypoints = 1;
+	ud->unnamed_tracks = 1;
+	ud->unnamed_layers = 1;
 
 	XML_SetElementHandler ( parser, (XML_StartElementHandler)tcx_start, (XML_EndElementHandler)tcx_end );
 	XML_SetUserData ( parser, ud );
@@ -477,8 +474,6 @@ gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
 
 	gchar buf[4096];
 
-	reset_globals ( NULL );
-
 	while ( !done ) {
 		len = fread ( buf, 1, sizeof(buf)-7, ff );
 		done = feof ( ff ) || !len;
@@ -491,13 +486,24 @@ gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
 	}
 
 	XML_ParserFree (parser);
+	g_array_free ( ud->tag_stack, TRUE );
+	g_string_free ( ud->c_cdata, TRUE );
 	g_free ( ud );
-	g_string_free ( xpath, TRUE );
-	g_string_free ( c_cdata, TRUE );
 
 	return ans;
 }
 
+/**
+ * Returns TRUE on a successful file read
+ *   NB The file of course could contain no actual geo data that we can use!
+ * NB2 Filename is used in case a name from within the file itself can not be found
+ *   as file access is via the FILE* stream methods
+ */
+gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+{
+	return tcx_read ( val, vvp, NULL, ff, filename );
+}
+
 /**
  * Returns TRUE on a successful file read
  *   NB The file of course could contain no actual geo data that we can use!
@@ -509,38 +515,5 @@ gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
  */
 gboolean a_tcx_read_file_into_layer ( VikTrwLayer *vtl, FILE *ff, const gchar* filename )
 {
-	XML_Parser parser = XML_ParserCreate ( NULL );
-	int done=0, len;
-	enum XML_Status status = XML_STATUS_ERROR;
-
-	UserDataT *ud = g_malloc (sizeof(UserDataT));
-	ud->val      = NULL;
-	ud->vvp      = NULL;
-	ud->filename = filename;
-
-	XML_SetElementHandler ( parser, (XML_StartElementHandler)tcx_start, (XML_EndElementHandler)tcx_end );
-	XML_SetUserData ( parser, ud );
-	XML_SetCharacterDataHandler ( parser, (XML_CharacterDataHandler)tcx_cdata );
-
-	gchar buf[4096];
-
-	reset_globals ( vtl );
-
-	while ( !done ) {
-		len = fread ( buf, 1, sizeof(buf)-7, ff );
-		done = feof ( ff ) || !len;
-		status = XML_Parse ( parser, buf, len, done );
-	}
-
-	gboolean ans = (status != XML_STATUS_ERROR);
-	if ( !ans ) {
-		g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser) );
-	}
-
-	XML_ParserFree (parser);
-	g_free ( ud );
-	g_string_free ( xpath, TRUE );
-	g_string_free ( c_cdata, TRUE );
-
-	return ans;
+	return tcx_read ( NULL, NULL, vtl, ff, filename );
 }
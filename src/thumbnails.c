@@ -73,17 +73,445 @@ static void set_thumb_dir ()
 static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full);
 static GdkPixbuf *child_create_thumbnail(const gchar *path);
 
+/*
+ * Index of the thumbnails known to be valid, so whether one exists is known
+ *  without reading the thumbnail for every waypoint whenever it is drawn.
+ * It is saved between sessions, although each image is still checked
+ *  (once per session) in case it changed since.
+ */
+typedef enum {
+  THUMB_UNCHECKED, // From a previous session
+  THUMB_VALID,
+  THUMB_PENDING,   // Awaiting generation in the background
+  THUMB_FAILED,
+} ThumbState;
+
+typedef struct {
+  ThumbState state;
+  gint64 size;  // Of the image when the thumbnail was made
+  gint64 mtime;
+} ThumbEntry;
+
+static GMutex *thumb_mutex = NULL;
+static GHashTable *thumb_index = NULL;  // Image filename -> ThumbEntry, loaded when first needed
+static GQueue thumb_queue = G_QUEUE_INIT; // Image filenames for the workers
+static GHashTable *thumb_waiting = NULL; // Layers to redraw as their thumbnails become available
+static guint thumb_workers = 0;
+static guint thumb_queued = 0; // Since the workers started, for progress
+
+#define THUMB_INDEX_FILE "thumbnails.idx"
+// Redraw every so often whilst lots are being generated
+#define THUMB_REDRAW_INTERVAL 20
+
+static gchar *thumb_index_filename ()
+{
+  return g_build_filename ( a_get_viking_dir(), THUMB_INDEX_FILE, NULL );
+}
+
+static void thumb_index_load ()
+{
+  gchar *fn = thumb_index_filename ();
+  gchar *contents = NULL;
+  if ( g_file_get_contents ( fn, &contents, NULL, NULL ) ) {
+    gchar **lines = g_strsplit ( contents, "\n", -1 );
+    for ( guint ii = 0; lines[ii]; ii++ ) {
+      // <size> <mtime> <filename>
+      gint64 size, mtime;
+      gint pos = 0;
+      if ( sscanf ( lines[ii], "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %n", &size, &mtime, &pos ) == 2 && pos && lines[ii][pos] ) {
+        ThumbEntry *te = g_new0 ( ThumbEntry, 1 );
+        te->state = THUMB_UNCHECKED;
+        te->size = size;
+        te->mtime = mtime;
+        g_hash_table_replace ( thumb_index, g_strdup(&lines[ii][pos]), te );
+      }
+    }
+    g_strfreev ( lines );
+    g_free ( contents );
+  }
+  g_free ( fn );
+}
+
+/**
+ * Must hold thumb_mutex
+ */
+static GHashTable *thumb_index_get ()
+{
+  if ( !thumb_index ) {
+    thumb_index = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+    thumb_index_load ();
+  }
+  return thumb_index;
+}
+
+static void thumb_index_save ()
+{
+  GString *str = g_string_new ( NULL );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, thumb_index );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    ThumbEntry *te = value;
+    if ( te->state == THUMB_VALID || te->state == THUMB_UNCHECKED )
+      g_string_append_printf ( str, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %s\n", te->size, te->mtime, (gchar*)key );
+  }
+  gchar *fn = thumb_index_filename ();
+  GError *error = NULL;
+  if ( !g_file_set_contents ( fn, str->str, str->len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( fn );
+  g_string_free ( str, TRUE );
+}
+
+/**
+ * Record the thumbnail of the image as valid (or not) for the current state of the image
+ * Must hold thumb_mutex
+ */
+static void thumb_index_set ( const gchar *filename, gboolean valid )
+{
+  ThumbEntry *te = g_hash_table_lookup ( thumb_index_get(), filename );
+  if ( !te ) {
+    te = g_new0 ( ThumbEntry, 1 );
+    g_hash_table_insert ( thumb_index, g_strdup(filename), te );
+  }
+  GStatBuf info;
+  if ( valid && g_stat ( filename, &info ) == 0 ) {
+    te->state = THUMB_VALID;
+    te->size = info.st_size;
+    te->mtime = info.st_mtime;
+  }
+  else
+    te->state = THUMB_FAILED;
+}
+
+static gchar *thumb_path_for ( const gchar *pathname )
+{
+  gchar *path = file_realpath_dup ( pathname );
+  gchar *uri = g_strconcat ( "file://", path, NULL );
+  gchar *md5 = md5_hash ( uri );
+  gchar *thumb_path = g_strdup_printf ( "%s%s.png", thumb_dir, md5 );
+  g_free ( md5 );
+  g_free ( uri );
+  g_free ( path );
+  return thumb_path;
+}
+
+/**
+ * An entry from a previous session is still valid if neither the image nor the thumbnail have gone,
+ *  and the image is the same as when the thumbnail was made
+ */
+static gboolean thumb_entry_check ( const gchar *filename, ThumbEntry *te )
+{
+  GStatBuf info;
+  if ( g_stat ( filename, &info ) != 0 || info.st_size != te->size || info.st_mtime != te->mtime )
+    return FALSE;
+  gchar *thumb_path = thumb_path_for ( filename );
+  gboolean exists = g_file_test ( thumb_path, G_FILE_TEST_EXISTS );
+  g_free ( thumb_path );
+  return exists;
+}
+
+/**
+ * Whether the index knows the thumbnail is valid, checking any previous session's entry
+ * Must hold thumb_mutex
+ *
+ * Returns NULL when the image is unknown
+ */
+static ThumbEntry *thumb_index_lookup ( const gchar *filename )
+{
+  ThumbEntry *te = g_hash_table_lookup ( thumb_index_get(), filename );
+  if ( te && te->state == THUMB_UNCHECKED ) {
+    if ( thumb_entry_check ( filename, te ) )
+      te->state = THUMB_VALID;
+    else {
+      g_hash_table_remove ( thumb_index, filename );
+      te = NULL;
+    }
+  }
+  return te;
+}
+
+static void thumb_waiting_weak_ref_cb ( gpointer ptr, GObject *dead_vl )
+{
+  g_mutex_lock ( thumb_mutex );
+  g_hash_table_remove ( thumb_waiting, dead_vl );
+  g_mutex_unlock ( thumb_mutex );
+}
+
+/**
+ * Redraw the layers waiting on thumbnails
+ * Must hold thumb_mutex
+ */
+static void thumb_waiting_update ( gboolean finished )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, thumb_waiting );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    vik_layer_emit_update ( VIK_LAYER(key), FALSE ); // NB update from background thread
+    if ( finished ) {
+      g_object_weak_unref ( G_OBJECT(key), thumb_waiting_weak_ref_cb, NULL );
+      g_hash_table_iter_remove ( &iter );
+    }
+  }
+}
+
+static GdkPixbuf *thumbnail_get_or_create ( const gchar *filename )
+{
+  GdkPixbuf *pixbuf = a_thumbnails_get ( filename );
+  if ( !pixbuf )
+    pixbuf = child_create_thumbnail ( filename );
+  return pixbuf;
+}
+
+/**
+ * Generate the queued thumbnails, until there are no more
+ *  (so requests made whilst running are handled by the same workers)
+ */
+static int thumbnails_thread ( gpointer data, gpointer threaddata )
+{
+  guint done = 0;
+  int result = 0;
+  while ( result == 0 ) {
+    g_mutex_lock ( thumb_mutex );
+    gchar *filename = g_queue_pop_head ( &thumb_queue );
+    if ( !filename ) {
+      if ( --thumb_workers == 0 ) {
+        thumb_queued = 0;
+        thumb_waiting_update ( TRUE );
+      }
+      g_mutex_unlock ( thumb_mutex );
+      return 0;
+    }
+    g_mutex_unlock ( thumb_mutex );
+
+    GdkPixbuf *pixbuf = thumbnail_get_or_create ( filename );
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+
+    g_mutex_lock ( thumb_mutex );
+    thumb_index_set ( filename, pixbuf != NULL );
+    if ( ++done % THUMB_REDRAW_INTERVAL == 0 )
+      thumb_waiting_update ( FALSE );
+    gdouble fraction = (gdouble)(thumb_queued - g_queue_get_length(&thumb_queue)) / thumb_queued;
+    g_mutex_unlock ( thumb_mutex );
+    g_free ( filename );
+
+    result = a_background_thread_progress ( threaddata, fraction );
+  }
+
+  // Cancelled - so forget about any not yet done, allowing them to be requested again
+  g_mutex_lock ( thumb_mutex );
+  gchar *filename;
+  while ( (filename = g_queue_pop_head ( &thumb_queue )) ) {
+    g_hash_table_remove ( thumb_index_get(), filename );
+    g_free ( filename );
+  }
+  if ( --thumb_workers == 0 ) {
+    thumb_queued = 0;
+    thumb_waiting_update ( TRUE );
+  }
+  g_mutex_unlock ( thumb_mutex );
+  return -1;
+}
+
+/**
+ * a_thumbnails_request:
+ * @filename: The image
+ * @vl:       The layer to be redrawn once the thumbnail has been generated
+ *
+ * Never reads the image or the thumbnail for images already known about,
+ *  so is intended to be used whilst drawing.
+ * Otherwise the thumbnail is checked or generated in the background (but only once
+ *  no matter how many times it is requested), after which the layer is updated.
+ *
+ * Returns: TRUE if a valid thumbnail exists, FALSE if it is either being generated or can not be
+ */
+gboolean a_thumbnails_request ( const gchar *filename, VikLayer *vl )
+{
+  gboolean valid = FALSE;
+  g_mutex_lock ( thumb_mutex );
+  ThumbEntry *te = thumb_index_lookup ( filename );
+  if ( te )
+    valid = te->state == THUMB_VALID;
+  else {
+    te = g_new0 ( ThumbEntry, 1 );
+    te->state = THUMB_PENDING;
+    g_hash_table_insert ( thumb_index, g_strdup(filename), te );
+    g_queue_push_tail ( &thumb_queue, g_strdup(filename) );
+    thumb_queued++;
+
+    // More workers whilst there are plenty of thumbnails waiting
+    guint cpus = util_get_number_of_cpus ();
+    guint max_workers = cpus > 1 ? cpus-1 : 1;
+    if ( thumb_workers < max_workers && g_queue_get_length(&thumb_queue) > thumb_workers * THUMB_REDRAW_INTERVAL ) {
+      thumb_workers++;
+      a_background_thread ( BACKGROUND_POOL_LOCAL,
+                            vl ? VIK_GTK_WINDOW_FROM_LAYER(vl) : NULL,
+                            _("Creating Image Thumbnails..."),
+                            (vik_thr_func) thumbnails_thread,
+                            NULL, NULL, NULL,
+                            1 );
+    }
+  }
+
+  if ( te->state == THUMB_PENDING && vl && !g_hash_table_contains ( thumb_waiting, vl ) ) {
+    g_object_weak_ref ( G_OBJECT(vl), thumb_waiting_weak_ref_cb, NULL );
+    g_hash_table_add ( thumb_waiting, vl );
+  }
+  g_mutex_unlock ( thumb_mutex );
+  return valid;
+}
+
 gboolean a_thumbnails_exists ( const gchar *filename )
 {
+  g_mutex_lock ( thumb_mutex );
+  ThumbEntry *te = thumb_index_lookup ( filename );
+  gboolean known = te && te->state != THUMB_FAILED;
+  gboolean valid = te && te->state == THUMB_VALID;
+  g_mutex_unlock ( thumb_mutex );
+  if ( known )
+    return valid;
+
   GdkPixbuf *pixbuf = a_thumbnails_get(filename);
   if ( pixbuf )
   {
     g_object_unref ( G_OBJECT ( pixbuf ) );
+    g_mutex_lock ( thumb_mutex );
+    thumb_index_set ( filename, TRUE );
+    g_mutex_unlock ( thumb_mutex );
     return TRUE;
   }
   return FALSE;
 }
 
+/*
+ * Memory cache of the thumbnails as drawn (i.e. at the size and alpha wanted),
+ *  shared by all layers so images in several layers are only read and scaled once.
+ * Least recently used items are evicted when over the memory allowance.
+ * Only used whilst drawing, which is always in the main thread.
+ */
+typedef struct {
+  gchar *key;
+  GdkPixbuf *pixbuf;
+  gsize size;
+  GList *link; // In tc_lru
+} thumb_cache_item_t;
+
+static GHashTable *tc_cache = NULL; // Key -> thumb_cache_item_t
+static GQueue tc_lru = G_QUEUE_INIT; // Most recently used first
+static gsize tc_size = 0;
+static guint tc_hits = 0;
+static guint tc_misses = 0;
+
+// Much like the mapcache overhead
+#define TC_ITEM_OVERHEAD 100
+
+static VikLayerParamScale params_scales[] = {
+  /* min, max, step, digits (decimal places) */
+ { 1, 1024, 1, 0 },
+};
+
+static VikLayerParamData tcs_default ( void ) { return VIK_LPD_UINT(32); }
+
+static VikLayerParam prefs[] = {
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "thumbnail_cache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Image thumbnail memory cache size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL,
+    N_("Memory shared by all layers for keeping the images of waypoints as drawn."), tcs_default, NULL, NULL },
+};
+
+static gchar *thumb_cache_key ( const gchar *filename, guint size, guint8 alpha )
+{
+  return g_strdup_printf ( "%u:%u:%s", size, alpha, filename );
+}
+
+static void thumb_cache_item_free ( thumb_cache_item_t *tci )
+{
+  g_queue_delete_link ( &tc_lru, tci->link );
+  tc_size -= tci->size;
+  g_object_unref ( tci->pixbuf );
+  g_free ( tci->key );
+  g_free ( tci );
+}
+
+/**
+ * a_thumbnails_cache_get:
+ *
+ * Returns: The image as drawn at the size and alpha, with a new reference for the caller; or NULL if not cached
+ */
+GdkPixbuf *a_thumbnails_cache_get ( const gchar *filename, guint size, guint8 alpha )
+{
+  gchar *key = thumb_cache_key ( filename, size, alpha );
+  thumb_cache_item_t *tci = g_hash_table_lookup ( tc_cache, key );
+  g_free ( key );
+  if ( !tci ) {
+    tc_misses++;
+    return NULL;
+  }
+  tc_hits++;
+  g_queue_unlink ( &tc_lru, tci->link );
+  g_queue_push_head_link ( &tc_lru, tci->link );
+  return g_object_ref ( tci->pixbuf );
+}
+
+/**
+ * a_thumbnails_cache_add:
+ *
+ * Keep the image as drawn at the size and alpha; the cache takes its own reference
+ */
+void a_thumbnails_cache_add ( const gchar *filename, guint size, guint8 alpha, GdkPixbuf *pixbuf )
+{
+  thumb_cache_item_t *tci = g_new0 ( thumb_cache_item_t, 1 );
+  tci->key = thumb_cache_key ( filename, size, alpha );
+  tci->pixbuf = g_object_ref ( pixbuf );
+  tci->size = gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf) + TC_ITEM_OVERHEAD;
+  g_queue_push_head ( &tc_lru, tci );
+  tci->link = tc_lru.head;
+  tc_size += tci->size;
+  // Any previous version is freed
+  g_hash_table_replace ( tc_cache, tci->key, tci );
+
+  // Evict least recently used items, but always keep the newly added one
+  gsize max_size = (gsize)a_preferences_get(VIKING_PREFERENCES_NAMESPACE "thumbnail_cache_size")->u * 1024 * 1024;
+  while ( tc_size > max_size && tc_lru.tail != tc_lru.head ) {
+    thumb_cache_item_t *old = g_queue_peek_tail ( &tc_lru );
+    g_hash_table_remove ( tc_cache, old->key );
+  }
+}
+
+/**
+ * a_thumbnails_cache_get_stats:
+ *
+ * Memory used, number of items, and hit and miss counts of a_thumbnails_cache_get() since startup
+ */
+void a_thumbnails_cache_get_stats ( gsize *size, guint *count, guint *hits, guint *misses )
+{
+  *size = tc_size;
+  *count = g_hash_table_size ( tc_cache );
+  *hits = tc_hits;
+  *misses = tc_misses;
+}
+
+/**
+ * a_thumbnails_cache_trim:
+ * @bytes: How much to release
+ *
+ * Evict the least recently used images (other than the most recent one),
+ *  e.g. to keep within the overall memory budget
+ *
+ * Returns: The amount released
+ */
+gsize a_thumbnails_cache_trim ( gsize bytes )
+{
+  gsize before = tc_size;
+  while ( before - tc_size < bytes && tc_lru.tail != tc_lru.head ) {
+    thumb_cache_item_t *old = g_queue_peek_tail ( &tc_lru );
+    g_hash_table_remove ( tc_cache, old->key );
+  }
+  return before - tc_size;
+}
+
 GdkPixbuf *a_thumbnails_get_default ()
 {
   return ui_get_icon ( "thumbnails", 128 );
@@ -93,10 +521,11 @@ GdkPixbuf *a_thumbnails_get_default ()
 
 void a_thumbnails_create(const gchar *filename)
 {
-  GdkPixbuf *pixbuf = a_thumbnails_get(filename);
+  GdkPixbuf *pixbuf = thumbnail_get_or_create ( filename );
 
-  if ( ! pixbuf )
-    pixbuf = child_create_thumbnail(filename);
+  g_mutex_lock ( thumb_mutex );
+  thumb_index_set ( filename, pixbuf != NULL );
+  g_mutex_unlock ( thumb_mutex );
 
   if ( pixbuf )
     g_object_unref (  G_OBJECT ( pixbuf ) );
@@ -311,9 +740,23 @@ out:
 void a_thumbnails_init ()
 {
   set_thumb_dir ();
+  thumb_mutex = vik_mutex_new ();
+  thumb_waiting = g_hash_table_new ( g_direct_hash, g_direct_equal );
+
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  tc_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) thumb_cache_item_free );
 }
 
 void a_thumbnails_uninit ()
 {
-  g_free ( thumb_dir );
+  // Any workers may still be finishing, so only the index is tidied up
+  g_mutex_lock ( thumb_mutex );
+  // Only when used, otherwise it is unchanged
+  if ( thumb_index )
+    thumb_index_save ();
+  while ( !g_queue_is_empty ( &thumb_queue ) )
+    g_free ( g_queue_pop_head ( &thumb_queue ) );
+  g_mutex_unlock ( thumb_mutex );
+
+  g_hash_table_destroy ( tc_cache );
 }
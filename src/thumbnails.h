@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include "viklayer.h"
 
 G_BEGIN_DECLS
 
@@ -32,10 +33,16 @@ void a_thumbnails_uninit ();
 
 gboolean a_thumbnails_exists ( const gchar *filename );
 void a_thumbnails_create ( const gchar *filename );
+gboolean a_thumbnails_request ( const gchar *filename, VikLayer *vl );
 GdkPixbuf *a_thumbnails_get(const gchar *filename);
 GdkPixbuf *a_thumbnails_get_default ();
 GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h);
 
+GdkPixbuf *a_thumbnails_cache_get ( const gchar *filename, guint size, guint8 alpha );
+void a_thumbnails_cache_add ( const gchar *filename, guint size, guint8 alpha, GdkPixbuf *pixbuf );
+void a_thumbnails_cache_get_stats ( gsize *size, guint *count, guint *hits, guint *misses );
+gsize a_thumbnails_cache_trim ( gsize bytes );
+
 G_END_DECLS
 
 #endif
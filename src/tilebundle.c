@@ -0,0 +1,443 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Map tiles packed into bundle files, each holding a square block of tiles of one zoom level,
+ *  to avoid the cost of a file per tile (many open/stat calls on network filesystems
+ *  and running out of inodes for big caches).
+ *
+ * A bundle is a fixed size header and index followed by the tile data:
+ *  "VIKTBNDL" magic, guint32 version, guint32 dimension (tiles along each side)
+ *  then dimension^2 index entries of { guint64 offset, guint32 size, guint32 mtime }
+ *  (all little endian); an offset of 0 means no tile.
+ * Tile data is only ever appended, a replaced tile simply leaves its old data unused.
+ * Bundles are read via a memory mapping of the file.
+ *
+ * A tile in a bundle is named as if the bundle were a directory:
+ *  <dir><zoom>/<bundle x>_<bundle y>.bundle/<x>_<y>
+ *  so the names can be passed around just like those of individual tile files.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "tilebundle.h"
+#include "vik_compat.h"
+
+#define TILEBUNDLE_MAGIC "VIKTBNDL"
+#define TILEBUNDLE_VERSION 1
+#define TILEBUNDLE_DIM 64
+#define TILEBUNDLE_SUFFIX ".bundle"
+#define TILEBUNDLE_HEADER_SIZE 16
+#define TILEBUNDLE_ENTRY_SIZE 16
+#define TILEBUNDLE_DATA_START (TILEBUNDLE_HEADER_SIZE + TILEBUNDLE_DIM*TILEBUNDLE_DIM*TILEBUNDLE_ENTRY_SIZE)
+
+// Limit on the number of bundles kept open
+#define TILEBUNDLE_MAX_OPEN 64
+
+typedef struct {
+  gchar *path;
+  GMappedFile *mf; // NULL until read from
+  FILE *ff;        // NULL until written to
+} TileBundle;
+
+typedef struct {
+  guint64 offset;
+  guint32 size;
+  guint32 mtime;
+} TileBundleEntry;
+
+static GMutex *tb_mutex = NULL;
+static GHashTable *tb_bundles = NULL; // Path -> TileBundle
+
+static void tilebundle_free ( TileBundle *tb )
+{
+  if ( tb->mf )
+    g_mapped_file_unref ( tb->mf );
+  if ( tb->ff )
+    fclose ( tb->ff );
+  g_free ( tb->path );
+  g_free ( tb );
+}
+
+void a_tilebundle_init ()
+{
+  tb_mutex = vik_mutex_new ();
+  tb_bundles = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify)tilebundle_free );
+}
+
+void a_tilebundle_uninit ()
+{
+  g_mutex_lock ( tb_mutex );
+  g_hash_table_destroy ( tb_bundles );
+  tb_bundles = NULL;
+  g_mutex_unlock ( tb_mutex );
+  vik_mutex_free ( tb_mutex );
+  tb_mutex = NULL;
+}
+
+/**
+ * a_tilebundle_member_name:
+ * @dir:    Directory for the bundles, ending with a directory separator
+ * @subdir: Optional subdirectory of @dir (e.g. for the map)
+ *
+ * Write the name of the tile in the bundle that holds it
+ */
+void a_tilebundle_member_name ( gchar *buf, gsize buf_len, const gchar *dir, const gchar *subdir, gint z, gint x, gint y )
+{
+  g_snprintf ( buf, buf_len, "%s%s%s%d" G_DIR_SEPARATOR_S "%d_%d" TILEBUNDLE_SUFFIX G_DIR_SEPARATOR_S "%d_%d",
+               dir, subdir ? subdir : "", subdir ? G_DIR_SEPARATOR_S : "", z, x / TILEBUNDLE_DIM, y / TILEBUNDLE_DIM, x, y );
+}
+
+/**
+ * Split a member name into the bundle file and the tile's index entry position
+ */
+static gchar *member_parse ( const gchar *member, guint *pos )
+{
+  const gchar *sep = strrchr ( member, G_DIR_SEPARATOR );
+  if ( !sep || sep - member < strlen(TILEBUNDLE_SUFFIX) ||
+       strncmp ( sep - strlen(TILEBUNDLE_SUFFIX), TILEBUNDLE_SUFFIX, strlen(TILEBUNDLE_SUFFIX) ) )
+    return NULL;
+  gint x, y;
+  if ( sscanf ( sep+1, "%d_%d", &x, &y ) != 2 || x < 0 || y < 0 )
+    return NULL;
+  if ( pos )
+    *pos = (y % TILEBUNDLE_DIM) * TILEBUNDLE_DIM + (x % TILEBUNDLE_DIM);
+  return g_strndup ( member, sep - member );
+}
+
+/**
+ * a_tilebundle_is_member:
+ *
+ * Returns: Whether the tile filename is for a tile in a bundle
+ */
+gboolean a_tilebundle_is_member ( const gchar *filename )
+{
+  gchar *path = member_parse ( filename, NULL );
+  g_free ( path );
+  return path != NULL;
+}
+
+/**
+ * a_tilebundle_staging_name:
+ *
+ * Returns: A real filename next to the bundle, for a tile on its way into the bundle (e.g. when downloading it)
+ */
+gchar *a_tilebundle_staging_name ( const gchar *member )
+{
+  gchar *name = g_strdup ( member );
+  gchar *sep = strrchr ( name, G_DIR_SEPARATOR );
+  if ( sep )
+    *sep = '.';
+  return name;
+}
+
+/**
+ * Must be called with the mutex held
+ */
+static TileBundle *tilebundle_get ( const gchar *path )
+{
+  TileBundle *tb = g_hash_table_lookup ( tb_bundles, path );
+  if ( !tb ) {
+    if ( g_hash_table_size ( tb_bundles ) >= TILEBUNDLE_MAX_OPEN )
+      g_hash_table_remove_all ( tb_bundles );
+    tb = g_new0 ( TileBundle, 1 );
+    tb->path = g_strdup ( path );
+    g_hash_table_insert ( tb_bundles, tb->path, tb );
+  }
+  return tb;
+}
+
+/**
+ * Ensure the mapping covers at least @len bytes (remapping a bundle that has grown)
+ * Must be called with the mutex held
+ */
+static gboolean tilebundle_map ( TileBundle *tb, gsize len )
+{
+  if ( tb->mf && g_mapped_file_get_length ( tb->mf ) >= len )
+    return TRUE;
+  if ( tb->mf ) {
+    g_mapped_file_unref ( tb->mf );
+    tb->mf = NULL;
+  }
+  if ( tb->ff )
+    fflush ( tb->ff );
+  tb->mf = g_mapped_file_new ( tb->path, FALSE, NULL );
+  if ( !tb->mf )
+    return FALSE;
+  const gchar *contents = g_mapped_file_get_contents ( tb->mf );
+  if ( g_mapped_file_get_length ( tb->mf ) < TILEBUNDLE_DATA_START ||
+       memcmp ( contents, TILEBUNDLE_MAGIC, strlen(TILEBUNDLE_MAGIC) ) ) {
+    g_warning ( "%s: %s is not a tile bundle", __FUNCTION__, tb->path );
+    g_mapped_file_unref ( tb->mf );
+    tb->mf = NULL;
+    return FALSE;
+  }
+  return g_mapped_file_get_length ( tb->mf ) >= len;
+}
+
+static void entry_decode ( const guchar *buf, TileBundleEntry *entry )
+{
+  guint64 offset;
+  guint32 size, mtime;
+  memcpy ( &offset, buf, 8 );
+  memcpy ( &size, buf+8, 4 );
+  memcpy ( &mtime, buf+12, 4 );
+  entry->offset = GUINT64_FROM_LE ( offset );
+  entry->size = GUINT32_FROM_LE ( size );
+  entry->mtime = GUINT32_FROM_LE ( mtime );
+}
+
+static void entry_encode ( const TileBundleEntry *entry, guchar *buf )
+{
+  guint64 offset = GUINT64_TO_LE ( entry->offset );
+  guint32 size = GUINT32_TO_LE ( entry->size );
+  guint32 mtime = GUINT32_TO_LE ( entry->mtime );
+  memcpy ( buf, &offset, 8 );
+  memcpy ( buf+8, &size, 4 );
+  memcpy ( buf+12, &mtime, 4 );
+}
+
+/**
+ * Read the index entry of a tile, with its data mapped in
+ * Must be called with the mutex held
+ */
+static TileBundle *entry_read ( const gchar *member, TileBundleEntry *entry, guint *pos )
+{
+  gchar *path = member_parse ( member, pos );
+  if ( !path )
+    return NULL;
+  if ( !tb_bundles || !g_file_test ( path, G_FILE_TEST_EXISTS ) ) {
+    g_free ( path );
+    return NULL;
+  }
+  TileBundle *tb = tilebundle_get ( path );
+  g_free ( path );
+  if ( !tilebundle_map ( tb, TILEBUNDLE_DATA_START ) )
+    return NULL;
+
+  const guchar *contents = (const guchar*)g_mapped_file_get_contents ( tb->mf );
+  entry_decode ( contents + TILEBUNDLE_HEADER_SIZE + *pos * TILEBUNDLE_ENTRY_SIZE, entry );
+  if ( !entry->offset )
+    return NULL;
+  // Data appended since the file was mapped
+  if ( !tilebundle_map ( tb, entry->offset + entry->size ) )
+    return NULL;
+  return tb;
+}
+
+/**
+ * a_tilebundle_lookup:
+ * @mtime: Returns the time the tile was stored (optional)
+ * @size:  Returns the size of the tile (optional)
+ *
+ * Returns: Whether the tile is in its bundle
+ */
+gboolean a_tilebundle_lookup ( const gchar *member, gint64 *mtime, gint64 *size )
+{
+  TileBundleEntry entry;
+  guint pos;
+  g_mutex_lock ( tb_mutex );
+  gboolean found = entry_read ( member, &entry, &pos ) != NULL;
+  g_mutex_unlock ( tb_mutex );
+  if ( found ) {
+    if ( mtime )
+      *mtime = entry.mtime;
+    if ( size )
+      *size = entry.size;
+  }
+  return found;
+}
+
+/**
+ * a_tilebundle_get:
+ * @mtime: Returns the time the tile was stored (optional)
+ *
+ * Returns: The tile data (referencing the mapped bundle), or NULL if it's not in its bundle
+ */
+GBytes *a_tilebundle_get ( const gchar *member, gint64 *mtime )
+{
+  TileBundleEntry entry;
+  guint pos;
+  GBytes *bytes = NULL;
+  g_mutex_lock ( tb_mutex );
+  TileBundle *tb = entry_read ( member, &entry, &pos );
+  if ( tb ) {
+    GBytes *all = g_mapped_file_get_bytes ( tb->mf );
+    bytes = g_bytes_new_from_bytes ( all, entry.offset, entry.size );
+    g_bytes_unref ( all );
+    if ( mtime )
+      *mtime = entry.mtime;
+  }
+  g_mutex_unlock ( tb_mutex );
+  return bytes;
+}
+
+/**
+ * Open the bundle for writing, creating it if necessary
+ * Must be called with the mutex held
+ */
+static TileBundle *tilebundle_open ( const gchar *path )
+{
+  TileBundle *tb = tilebundle_get ( path );
+  if ( tb->ff )
+    return tb;
+
+  tb->ff = g_fopen ( path, "r+b" );
+  if ( tb->ff )
+    return tb;
+
+  gchar *dir = g_path_get_dirname ( path );
+  if ( g_mkdir_with_parents ( dir, 0777 ) != 0 )
+    g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+  g_free ( dir );
+
+  tb->ff = g_fopen ( path, "w+b" );
+  if ( !tb->ff ) {
+    g_warning ( "%s: Unable to create %s", __FUNCTION__, path );
+    g_hash_table_remove ( tb_bundles, path );
+    return NULL;
+  }
+  guchar header[TILEBUNDLE_HEADER_SIZE];
+  guint32 val;
+  memcpy ( header, TILEBUNDLE_MAGIC, 8 );
+  val = GUINT32_TO_LE ( TILEBUNDLE_VERSION );
+  memcpy ( header+8, &val, 4 );
+  val = GUINT32_TO_LE ( TILEBUNDLE_DIM );
+  memcpy ( header+12, &val, 4 );
+  // An empty index
+  guchar *index = g_malloc0 ( TILEBUNDLE_DATA_START - TILEBUNDLE_HEADER_SIZE );
+  gboolean ok = fwrite ( header, sizeof(header), 1, tb->ff ) == 1 &&
+                fwrite ( index, TILEBUNDLE_DATA_START - TILEBUNDLE_HEADER_SIZE, 1, tb->ff ) == 1 &&
+                fflush ( tb->ff ) == 0;
+  g_free ( index );
+  if ( !ok ) {
+    g_warning ( "%s: Unable to write %s", __FUNCTION__, path );
+    (void)g_remove ( path );
+    g_hash_table_remove ( tb_bundles, path );
+    return NULL;
+  }
+  return tb;
+}
+
+/**
+ * Must be called with the mutex held
+ */
+static gboolean entry_write ( TileBundle *tb, guint pos, const TileBundleEntry *entry )
+{
+  guchar buf[TILEBUNDLE_ENTRY_SIZE];
+  entry_encode ( entry, buf );
+  return fseek ( tb->ff, TILEBUNDLE_HEADER_SIZE + pos * TILEBUNDLE_ENTRY_SIZE, SEEK_SET ) == 0 &&
+         fwrite ( buf, sizeof(buf), 1, tb->ff ) == 1 &&
+         fflush ( tb->ff ) == 0;
+}
+
+/**
+ * a_tilebundle_put:
+ * @mtime: The time to record for the tile
+ *
+ * Store the tile data, replacing any previous version
+ */
+gboolean a_tilebundle_put ( const gchar *member, const guchar *data, gsize size, gint64 mtime )
+{
+  guint pos;
+  gchar *path = member_parse ( member, &pos );
+  if ( !path || !tb_bundles ) {
+    g_free ( path );
+    return FALSE;
+  }
+  gboolean ok = FALSE;
+  g_mutex_lock ( tb_mutex );
+  TileBundle *tb = tilebundle_open ( path );
+  if ( tb && fseek ( tb->ff, 0, SEEK_END ) == 0 ) {
+    TileBundleEntry entry = { ftell ( tb->ff ), size, mtime };
+    // Data first, so the index never refers to missing data
+    ok = entry.offset >= TILEBUNDLE_DATA_START &&
+         (size == 0 || fwrite ( data, size, 1, tb->ff ) == 1) &&
+         fflush ( tb->ff ) == 0 &&
+         entry_write ( tb, pos, &entry );
+  }
+  if ( !ok )
+    g_warning ( "%s: Unable to write %s", __FUNCTION__, member );
+  g_mutex_unlock ( tb_mutex );
+  g_free ( path );
+  return ok;
+}
+
+/**
+ * a_tilebundle_put_file:
+ *
+ * Move the contents of the given file into the bundle, recording the file's modification time
+ */
+gboolean a_tilebundle_put_file ( const gchar *member, const gchar *filename )
+{
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( !g_file_get_contents ( filename, &contents, &length, NULL ) )
+    return FALSE;
+  GStatBuf buf;
+  gint64 mtime = ( g_stat ( filename, &buf ) == 0 ) ? buf.st_mtime : time(NULL);
+  gboolean ok = a_tilebundle_put ( member, (const guchar*)contents, length, mtime );
+  g_free ( contents );
+  if ( ok && g_remove ( filename ) != 0 )
+    g_warning ( "%s: Failed to remove: %s", __FUNCTION__, filename );
+  return ok;
+}
+
+static void entry_change ( const gchar *member, gboolean remove )
+{
+  TileBundleEntry entry;
+  guint pos;
+  g_mutex_lock ( tb_mutex );
+  TileBundle *tb = entry_read ( member, &entry, &pos );
+  if ( tb ) {
+    if ( remove )
+      memset ( &entry, 0, sizeof(TileBundleEntry) );
+    else
+      entry.mtime = time(NULL);
+    tb = tilebundle_open ( tb->path );
+    if ( !tb || !entry_write ( tb, pos, &entry ) )
+      g_warning ( "%s: Unable to write %s", __FUNCTION__, member );
+  }
+  g_mutex_unlock ( tb_mutex );
+}
+
+/**
+ * a_tilebundle_touch:
+ *
+ * Mark the tile as being up to date now
+ */
+void a_tilebundle_touch ( const gchar *member )
+{
+  entry_change ( member, FALSE );
+}
+
+/**
+ * a_tilebundle_remove:
+ */
+void a_tilebundle_remove ( const gchar *member )
+{
+  entry_change ( member, TRUE );
+}
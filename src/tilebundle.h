@@ -0,0 +1,42 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_TILEBUNDLE_H
+#define __VIKING_TILEBUNDLE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void a_tilebundle_init ();
+void a_tilebundle_uninit ();
+
+void a_tilebundle_member_name ( gchar *buf, gsize buf_len, const gchar *dir, const gchar *subdir, gint z, gint x, gint y );
+gboolean a_tilebundle_is_member ( const gchar *filename );
+gchar *a_tilebundle_staging_name ( const gchar *member );
+
+gboolean a_tilebundle_lookup ( const gchar *member, gint64 *mtime, gint64 *size );
+GBytes *a_tilebundle_get ( const gchar *member, gint64 *mtime );
+gboolean a_tilebundle_put ( const gchar *member, const guchar *data, gsize size, gint64 mtime );
+gboolean a_tilebundle_put_file ( const gchar *member, const gchar *filename );
+void a_tilebundle_touch ( const gchar *member );
+void a_tilebundle_remove ( const gchar *member );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,698 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * An index of the tile files in a map cache directory,
+ *  so that the modification time, size and ETag of tiles are known without touching each file.
+ *
+ * Each cache directory has an append only log of changes, read into memory when first used.
+ * The log is rewritten when it has grown to be mostly superseded records.
+ *
+ * The index only records files Viking has seen, a file not in the index may still exist.
+ *
+ * Tile directories in the OSM layout (zoom/x/y.ext) can also be scanned in the background,
+ *  giving a bitmap of which tiles are present at each zoom level.
+ * Once a scan is done, a tile not in its bitmap is taken to be missing without checking the file system
+ *  (so tiles added by other programs during the session are not seen).
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#include "tileindex.h"
+#include "background.h"
+#include "settings.h"
+#include "vik_compat.h"
+
+#define TILEINDEX_FILENAME ".viking-tileindex"
+#define TILEINDEX_TMP_FILENAME ".viking-tileindex.tmp"
+
+#define VIK_SETTINGS_TILEINDEX "maps_tile_index"
+
+// Tiles along each side of a block of the scan bitmaps
+#define TILESCAN_BLOCK_BITS 6
+#define TILESCAN_BLOCK (1 << TILESCAN_BLOCK_BITS)
+
+typedef struct {
+  gchar *prefix;       // Of the tile directory, relative to the index's dir (empty or ending with a separator)
+  gboolean complete;   // Once the scan has finished, so tiles not in the bitmap are missing
+  GHashTable *blocks;  // scan_block_key() -> guint64[TILESCAN_BLOCK], a row of presence bits for each y
+} TileScan;
+
+typedef struct {
+  gchar *dir;          // Always ends with a separator
+  GHashTable *entries; // Path relative to dir -> TileIndexEntry
+  FILE *log;           // NULL if the log can't be written (the index is then only kept for this session)
+  guint records;       // Number of records in the log
+  GPtrArray *scans;    // Of TileScan, for tile directories within dir
+} TileIndex;
+
+static gboolean ti_enabled = TRUE;
+static GMutex *ti_mutex = NULL;
+static GPtrArray *ti_indexes = NULL;
+
+static void entry_free ( TileIndexEntry *entry )
+{
+  g_free ( entry->etag );
+  g_free ( entry );
+}
+
+static TileScan *tilescan_new ( const gchar *prefix )
+{
+  TileScan *ts = g_malloc0 ( sizeof(TileScan) );
+  ts->prefix = g_strdup ( prefix );
+  ts->blocks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+  return ts;
+}
+
+static void tilescan_free ( TileScan *ts )
+{
+  g_hash_table_destroy ( ts->blocks );
+  g_free ( ts->prefix );
+  g_free ( ts );
+}
+
+static gint64 scan_block_key ( gint zoom, gint x, gint y )
+{
+  // Zooms are within 0-31 and x,y within 2^25 (zoom 25)
+  return ((gint64)(zoom & 0x1F) << 50) | ((gint64)((x >> TILESCAN_BLOCK_BITS) & 0x1FFFFFF) << 25) |
+         (gint64)((y >> TILESCAN_BLOCK_BITS) & 0x1FFFFFF);
+}
+
+static void scan_set ( GHashTable *blocks, gint zoom, gint x, gint y, gboolean present )
+{
+  gint64 key = scan_block_key ( zoom, x, y );
+  guint64 *rows = g_hash_table_lookup ( blocks, &key );
+  if ( !rows ) {
+    if ( !present )
+      return;
+    rows = g_malloc0 ( sizeof(guint64) * TILESCAN_BLOCK );
+    g_hash_table_insert ( blocks, g_memdup(&key, sizeof(key)), rows );
+  }
+  guint64 bit = G_GUINT64_CONSTANT(1) << (x & (TILESCAN_BLOCK-1));
+  if ( present )
+    rows[y & (TILESCAN_BLOCK-1)] |= bit;
+  else
+    rows[y & (TILESCAN_BLOCK-1)] &= ~bit;
+}
+
+static gboolean scan_get ( GHashTable *blocks, gint zoom, gint x, gint y )
+{
+  gint64 key = scan_block_key ( zoom, x, y );
+  guint64 *rows = g_hash_table_lookup ( blocks, &key );
+  return rows && ( rows[y & (TILESCAN_BLOCK-1)] >> (x & (TILESCAN_BLOCK-1)) & 1 );
+}
+
+/**
+ * Read a non negative number ended by the character
+ */
+static gboolean scan_number ( const gchar **pp, gchar end, gint *value )
+{
+  const gchar *p = *pp;
+  gint64 val = 0;
+  if ( !g_ascii_isdigit(*p) )
+    return FALSE;
+  while ( g_ascii_isdigit(*p) && val < G_MAXINT / 10 )
+    val = val * 10 + (*p++ - '0');
+  if ( *p != end )
+    return FALSE;
+  *value = val;
+  *pp = p + 1;
+  return TRUE;
+}
+
+/**
+ * Must hold the mutex
+ *
+ * Returns the scan of the tile directory holding the file (relative to the index), and the tile it is.
+ * Higher resolution tiles (e.g. y@2x.png) are not included in the scans.
+ */
+static TileScan *find_scan ( TileIndex *ti, const gchar *rel, gint *zoom, gint *x, gint *y )
+{
+  if ( !ti->scans )
+    return NULL;
+  for ( guint ii = 0; ii < ti->scans->len; ii++ ) {
+    TileScan *ts = g_ptr_array_index ( ti->scans, ii );
+    if ( !g_str_has_prefix ( rel, ts->prefix ) )
+      continue;
+    const gchar *p = rel + strlen ( ts->prefix );
+    if ( scan_number(&p, G_DIR_SEPARATOR, zoom) && scan_number(&p, G_DIR_SEPARATOR, x) && scan_number(&p, '.', y) )
+      return ts;
+  }
+  return NULL;
+}
+
+static void tileindex_free ( TileIndex *ti )
+{
+  if ( ti->log )
+    fclose ( ti->log );
+  if ( ti->scans )
+    g_ptr_array_free ( ti->scans, TRUE );
+  g_hash_table_destroy ( ti->entries );
+  g_free ( ti->dir );
+  g_free ( ti );
+}
+
+/**
+ * The separators used in the log can't be stored
+ */
+static const gchar *etag_storable ( const gchar *etag )
+{
+  if ( etag && ( strchr(etag, '\t') || strchr(etag, '\n') ) )
+    return NULL;
+  return etag;
+}
+
+static void write_set ( FILE *ff, const gchar *rel, TileIndexEntry *entry )
+{
+  fprintf ( ff, "S\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\t%s\n", entry->mtime, entry->size, entry->etag ? entry->etag : "", rel );
+}
+
+static void log_set ( TileIndex *ti, const gchar *rel, TileIndexEntry *entry )
+{
+  if ( !ti->log )
+    return;
+  write_set ( ti->log, rel, entry );
+  fflush ( ti->log );
+  ti->records++;
+}
+
+static void log_remove ( TileIndex *ti, const gchar *rel )
+{
+  if ( !ti->log )
+    return;
+  fprintf ( ti->log, "D\t%s\n", rel );
+  fflush ( ti->log );
+  ti->records++;
+}
+
+/**
+ * Read the log into the index
+ */
+static void tileindex_load ( TileIndex *ti, const gchar *logname )
+{
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( !g_file_get_contents ( logname, &contents, &length, NULL ) )
+    return;
+
+  gchar **lines = g_strsplit ( contents, "\n", -1 );
+  g_free ( contents );
+  for ( guint ii = 0; lines[ii]; ii++ ) {
+    gchar *line = lines[ii];
+    if ( line[0] == 'S' && line[1] == '\t' ) {
+      gchar **parts = g_strsplit ( line+2, "\t", 4 );
+      if ( g_strv_length(parts) == 4 && parts[3][0] ) {
+        TileIndexEntry *entry = g_malloc0 ( sizeof(TileIndexEntry) );
+        entry->mtime = g_ascii_strtoll ( parts[0], NULL, 10 );
+        entry->size = g_ascii_strtoll ( parts[1], NULL, 10 );
+        entry->etag = parts[2][0] ? g_strdup ( parts[2] ) : NULL;
+        g_hash_table_replace ( ti->entries, g_strdup(parts[3]), entry );
+        ti->records++;
+      }
+      g_strfreev ( parts );
+    }
+    else if ( line[0] == 'D' && line[1] == '\t' ) {
+      (void)g_hash_table_remove ( ti->entries, line+2 );
+      ti->records++;
+    }
+    // Otherwise ignore - e.g. a partially written last line
+  }
+  g_strfreev ( lines );
+}
+
+/**
+ * Rewrite the log with only the current entries
+ */
+static gboolean tileindex_compact ( TileIndex *ti, const gchar *logname )
+{
+  gchar *tmpname = g_strconcat ( ti->dir, TILEINDEX_TMP_FILENAME, NULL );
+  FILE *ff = g_fopen ( tmpname, "wb" );
+  gboolean ok = FALSE;
+  if ( ff ) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, ti->entries );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+      write_set ( ff, key, value );
+    ok = ( fclose(ff) == 0 ) && ( g_rename(tmpname, logname) == 0 );
+    if ( !ok ) {
+      g_warning ( "%s: failed to rewrite %s", __FUNCTION__, logname );
+      (void)g_remove ( tmpname );
+    }
+    else
+      ti->records = g_hash_table_size ( ti->entries );
+  }
+  g_free ( tmpname );
+  return ok;
+}
+
+/**
+ * Must hold the mutex
+ *
+ * Returns the index covering this file and the path relative to it
+ */
+static TileIndex *find_index ( const gchar *filename, const gchar **rel )
+{
+  if ( !ti_indexes || !filename )
+    return NULL;
+  for ( guint ii = 0; ii < ti_indexes->len; ii++ ) {
+    TileIndex *ti = g_ptr_array_index ( ti_indexes, ii );
+    if ( g_str_has_prefix ( filename, ti->dir ) ) {
+      *rel = filename + strlen ( ti->dir );
+      return ti;
+    }
+  }
+  return NULL;
+}
+
+void a_tileindex_init ()
+{
+  gboolean tmp = TRUE;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_TILEINDEX, &tmp ) )
+    ti_enabled = tmp;
+
+  ti_mutex = vik_mutex_new ();
+  ti_indexes = g_ptr_array_new_with_free_func ( (GDestroyNotify)tileindex_free );
+}
+
+void a_tileindex_uninit ()
+{
+  g_mutex_lock ( ti_mutex );
+  g_ptr_array_free ( ti_indexes, TRUE );
+  ti_indexes = NULL;
+  g_mutex_unlock ( ti_mutex );
+  vik_mutex_free ( ti_mutex );
+  ti_mutex = NULL;
+}
+
+/**
+ * a_tileindex_register:
+ * @cache_dir: The map cache directory, ending with a directory separator
+ *
+ * Start indexing the tile files within this directory, reading any previous index
+ */
+void a_tileindex_register ( const gchar *cache_dir )
+{
+  if ( !ti_enabled || !ti_mutex || !cache_dir || !cache_dir[0] )
+    return;
+
+  g_mutex_lock ( ti_mutex );
+  for ( guint ii = 0; ii < ti_indexes->len; ii++ ) {
+    TileIndex *ti = g_ptr_array_index ( ti_indexes, ii );
+    if ( g_strcmp0 ( ti->dir, cache_dir ) == 0 ) {
+      g_mutex_unlock ( ti_mutex );
+      return;
+    }
+  }
+
+  TileIndex *ti = g_malloc0 ( sizeof(TileIndex) );
+  ti->dir = g_strdup ( cache_dir );
+  ti->entries = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)entry_free );
+
+  gchar *logname = g_strconcat ( cache_dir, TILEINDEX_FILENAME, NULL );
+  tileindex_load ( ti, logname );
+  if ( ti->records > 1024 && ti->records > 2 * g_hash_table_size(ti->entries) )
+    (void)tileindex_compact ( ti, logname );
+  ti->log = g_fopen ( logname, "ab" );
+  if ( !ti->log )
+    g_debug ( "%s: index not saved for %s", __FUNCTION__, cache_dir );
+  g_free ( logname );
+
+  // Longer (i.e. nested) directories first, so the most specific one matches
+  g_ptr_array_add ( ti_indexes, ti );
+  for ( guint ii = ti_indexes->len-1; ii > 0; ii-- ) {
+    TileIndex *prev = g_ptr_array_index ( ti_indexes, ii-1 );
+    if ( strlen(prev->dir) >= strlen(ti->dir) )
+      break;
+    ti_indexes->pdata[ii] = prev;
+    ti_indexes->pdata[ii-1] = ti;
+  }
+  g_mutex_unlock ( ti_mutex );
+}
+
+/**
+ * a_tileindex_lookup:
+ * @entry: Returns the details - free entry->etag after use
+ *
+ * Returns TRUE if the file is in the index
+ */
+gboolean a_tileindex_lookup ( const gchar *filename, TileIndexEntry *entry )
+{
+  gboolean found = FALSE;
+  if ( !ti_mutex )
+    return FALSE;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( filename, &rel );
+  if ( ti ) {
+    TileIndexEntry *te = g_hash_table_lookup ( ti->entries, rel );
+    if ( te ) {
+      entry->mtime = te->mtime;
+      entry->size = te->size;
+      entry->etag = g_strdup ( te->etag );
+      found = TRUE;
+    }
+  }
+  g_mutex_unlock ( ti_mutex );
+  return found;
+}
+
+/**
+ * a_tileindex_file_exists:
+ * @mtime: Returns the modification time of the file (maybe NULL)
+ *
+ * Use the index in preference to the file system.
+ * Files not yet in the index are checked and then added to it.
+ */
+gboolean a_tileindex_file_exists ( const gchar *filename, gint64 *mtime )
+{
+  gboolean indexed = FALSE;
+  if ( ti_mutex ) {
+    g_mutex_lock ( ti_mutex );
+    const gchar *rel = NULL;
+    TileIndex *ti = find_index ( filename, &rel );
+    if ( ti ) {
+      indexed = TRUE;
+      TileIndexEntry *te = g_hash_table_lookup ( ti->entries, rel );
+      if ( te ) {
+        if ( mtime )
+          *mtime = te->mtime;
+        g_mutex_unlock ( ti_mutex );
+        return TRUE;
+      }
+      gint zoom, x, y;
+      TileScan *ts = find_scan ( ti, rel, &zoom, &x, &y );
+      if ( ts && ts->complete ) {
+        gboolean present = scan_get ( ts->blocks, zoom, x, y );
+        // Only need to look at the file for its time
+        if ( !present || !mtime ) {
+          g_mutex_unlock ( ti_mutex );
+          return present;
+        }
+      }
+    }
+    g_mutex_unlock ( ti_mutex );
+  }
+
+  GStatBuf st;
+  if ( g_stat ( filename, &st ) != 0 )
+    return FALSE;
+  if ( mtime )
+    *mtime = st.st_mtime;
+  if ( indexed )
+    a_tileindex_set ( filename, st.st_mtime, st.st_size, NULL );
+  return TRUE;
+}
+
+/**
+ * a_tileindex_set:
+ * @etag: The ETag for this version of the file (maybe NULL)
+ *
+ * Record the details of the file, ignored if the file is not in an indexed directory
+ */
+void a_tileindex_set ( const gchar *filename, gint64 mtime, gint64 size, const gchar *etag )
+{
+  if ( !ti_mutex )
+    return;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( filename, &rel );
+  if ( ti && rel[0] ) {
+    TileIndexEntry *entry = g_malloc0 ( sizeof(TileIndexEntry) );
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->etag = g_strdup ( etag_storable(etag) );
+    log_set ( ti, rel, entry );
+    g_hash_table_replace ( ti->entries, g_strdup(rel), entry );
+    gint zoom, x, y;
+    TileScan *ts = find_scan ( ti, rel, &zoom, &x, &y );
+    if ( ts )
+      scan_set ( ts->blocks, zoom, x, y, TRUE );
+  }
+  g_mutex_unlock ( ti_mutex );
+}
+
+/**
+ * a_tileindex_update:
+ * @etag: The ETag for this version of the file (maybe NULL)
+ *
+ * The file has just been written, so record its current details
+ */
+void a_tileindex_update ( const gchar *filename, const gchar *etag )
+{
+  GStatBuf st;
+  if ( g_stat ( filename, &st ) == 0 )
+    a_tileindex_set ( filename, st.st_mtime, st.st_size, etag );
+  else
+    a_tileindex_remove ( filename );
+}
+
+/**
+ * a_tileindex_touch:
+ *
+ * The file is still current (e.g. the server said it has not been modified),
+ *  so record its new modification time keeping its ETag
+ */
+void a_tileindex_touch ( const gchar *filename )
+{
+  TileIndexEntry entry;
+  if ( a_tileindex_lookup ( filename, &entry ) ) {
+    a_tileindex_update ( filename, entry.etag );
+    g_free ( entry.etag );
+  }
+  else
+    a_tileindex_update ( filename, NULL );
+}
+
+/**
+ * a_tileindex_remove:
+ *
+ * The file has been (or is about to be) deleted
+ */
+void a_tileindex_remove ( const gchar *filename )
+{
+  if ( !ti_mutex )
+    return;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( filename, &rel );
+  if ( ti ) {
+    if ( g_hash_table_remove ( ti->entries, rel ) )
+      log_remove ( ti, rel );
+    gint zoom, x, y;
+    TileScan *ts = find_scan ( ti, rel, &zoom, &x, &y );
+    if ( ts )
+      scan_set ( ts->blocks, zoom, x, y, FALSE );
+  }
+  g_mutex_unlock ( ti_mutex );
+}
+
+typedef struct {
+  gchar *tile_dir;
+  GHashTable *blocks; // Found by the scan
+} TileScanJob;
+
+static void tilescan_job_free ( TileScanJob *job )
+{
+  g_free ( job->tile_dir );
+  g_hash_table_destroy ( job->blocks );
+  g_free ( job );
+}
+
+/**
+ * Returns: Whether the name is entirely a number, giving its value
+ */
+static gboolean scan_name_number ( const gchar *name, gint *value )
+{
+  gchar *end = NULL;
+  gint64 val = g_ascii_strtoll ( name, &end, 10 );
+  if ( !g_ascii_isdigit(name[0]) || *end || val > G_MAXINT )
+    return FALSE;
+  *value = val;
+  return TRUE;
+}
+
+static gint tilescan_thread ( TileScanJob *job, gpointer threaddata )
+{
+  GDir *zdir = g_dir_open ( job->tile_dir, 0, NULL );
+  if ( !zdir )
+    return 0;
+  const gchar *zname;
+  while ( (zname = g_dir_read_name(zdir)) ) {
+    gint zoom;
+    if ( !scan_name_number(zname, &zoom) || zoom > 31 )
+      continue;
+    gchar *zpath = g_build_filename ( job->tile_dir, zname, NULL );
+    GDir *xdir = g_dir_open ( zpath, 0, NULL );
+    const gchar *xname;
+    while ( xdir && (xname = g_dir_read_name(xdir)) ) {
+      gint x;
+      if ( !scan_name_number(xname, &x) )
+        continue;
+      if ( a_background_testcancel ( threaddata ) ) {
+        g_dir_close ( xdir );
+        g_free ( zpath );
+        g_dir_close ( zdir );
+        return -1;
+      }
+      gchar *xpath = g_build_filename ( zpath, xname, NULL );
+      GDir *ydir = g_dir_open ( xpath, 0, NULL );
+      const gchar *yname;
+      while ( ydir && (yname = g_dir_read_name(ydir)) ) {
+        const gchar *p = yname;
+        gint y;
+        if ( scan_number(&p, '.', &y) )
+          scan_set ( job->blocks, zoom, x, y, TRUE );
+      }
+      if ( ydir )
+        g_dir_close ( ydir );
+      g_free ( xpath );
+    }
+    if ( xdir )
+      g_dir_close ( xdir );
+    g_free ( zpath );
+  }
+  g_dir_close ( zdir );
+
+  // Merge with any changes made meanwhile, should the index still be in use
+  //  (the mutex goes on program exit)
+  if ( !ti_mutex )
+    return 0;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( job->tile_dir, &rel );
+  for ( guint ii = 0; ti && ti->scans && ii < ti->scans->len; ii++ ) {
+    TileScan *ts = g_ptr_array_index ( ti->scans, ii );
+    if ( g_strcmp0 ( ts->prefix, rel ) )
+      continue;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, job->blocks );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      guint64 *rows = g_hash_table_lookup ( ts->blocks, key );
+      if ( rows ) {
+        for ( guint rr = 0; rr < TILESCAN_BLOCK; rr++ )
+          rows[rr] |= ((guint64*)value)[rr];
+      }
+      else {
+        g_hash_table_iter_steal ( &iter );
+        g_hash_table_insert ( ts->blocks, key, value );
+      }
+    }
+    ts->complete = TRUE;
+  }
+  g_mutex_unlock ( ti_mutex );
+  return 0;
+}
+
+/**
+ * a_tileindex_scan:
+ * @tile_dir: A directory of tiles in the OSM layout in an indexed cache directory, ending with a directory separator
+ *
+ * Start finding out which tiles are in the directory, as a background job,
+ *  unless this has been done already
+ */
+void a_tileindex_scan ( const gchar *tile_dir )
+{
+  if ( !ti_mutex )
+    return;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( tile_dir, &rel );
+  if ( !ti ) {
+    g_mutex_unlock ( ti_mutex );
+    return;
+  }
+  if ( !ti->scans )
+    ti->scans = g_ptr_array_new_with_free_func ( (GDestroyNotify)tilescan_free );
+  for ( guint ii = 0; ii < ti->scans->len; ii++ ) {
+    TileScan *ts = g_ptr_array_index ( ti->scans, ii );
+    if ( g_strcmp0 ( ts->prefix, rel ) == 0 ) {
+      g_mutex_unlock ( ti_mutex );
+      return;
+    }
+  }
+  g_ptr_array_add ( ti->scans, tilescan_new(rel) );
+  g_mutex_unlock ( ti_mutex );
+
+  TileScanJob *job = g_malloc0 ( sizeof(TileScanJob) );
+  job->tile_dir = g_strdup ( tile_dir );
+  job->blocks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+  gchar *msg = g_strdup_printf ( _("Scanning map cache %s"), tile_dir );
+  a_background_thread ( BACKGROUND_POOL_LOCAL, NULL, msg,
+                        (vik_thr_func)tilescan_thread, job,
+                        (vik_thr_free_func)tilescan_job_free, NULL, 1 );
+  g_free ( msg );
+}
+
+static guint scan_popcount ( guint64 bits )
+{
+  guint count = 0;
+  for ( ; bits; count++ )
+    bits &= bits - 1;
+  return count;
+}
+
+/**
+ * a_tileindex_count_tiles:
+ * @tile_dir: As given to a_tileindex_scan()
+ *
+ * Returns: The number of tiles present in the range of x and y (inclusive) at the zoom level,
+ *          or -1 if not known (i.e. the scan has not finished)
+ */
+gint64 a_tileindex_count_tiles ( const gchar *tile_dir, gint zoom, gint x0, gint xf, gint y0, gint yf )
+{
+  gint64 count = -1;
+  if ( !ti_mutex || x0 < 0 || y0 < 0 )
+    return count;
+  g_mutex_lock ( ti_mutex );
+  const gchar *rel = NULL;
+  TileIndex *ti = find_index ( tile_dir, &rel );
+  for ( guint ii = 0; ti && ti->scans && ii < ti->scans->len; ii++ ) {
+    TileScan *ts = g_ptr_array_index ( ti->scans, ii );
+    if ( g_strcmp0 ( ts->prefix, rel ) || !ts->complete )
+      continue;
+    count = 0;
+    // Whole rows of the blocks the range covers, masked to the range
+    for ( gint bx = x0 >> TILESCAN_BLOCK_BITS; bx <= xf >> TILESCAN_BLOCK_BITS; bx++ ) {
+      gint lo = MAX ( x0 - (bx << TILESCAN_BLOCK_BITS), 0 );
+      gint hi = MIN ( xf - (bx << TILESCAN_BLOCK_BITS), TILESCAN_BLOCK-1 );
+      guint64 mask = ( hi == TILESCAN_BLOCK-1 ? G_MAXUINT64 : (G_GUINT64_CONSTANT(1) << (hi+1)) - 1 ) & ~((G_GUINT64_CONSTANT(1) << lo) - 1);
+      for ( gint by = y0 >> TILESCAN_BLOCK_BITS; by <= yf >> TILESCAN_BLOCK_BITS; by++ ) {
+        gint64 key = scan_block_key ( zoom, bx << TILESCAN_BLOCK_BITS, by << TILESCAN_BLOCK_BITS );
+        guint64 *rows = g_hash_table_lookup ( ts->blocks, &key );
+        if ( !rows )
+          continue;
+        gint ylo = MAX ( y0 - (by << TILESCAN_BLOCK_BITS), 0 );
+        gint yhi = MIN ( yf - (by << TILESCAN_BLOCK_BITS), TILESCAN_BLOCK-1 );
+        for ( gint rr = ylo; rr <= yhi; rr++ )
+          count += scan_popcount ( rows[rr] & mask );
+      }
+    }
+    break;
+  }
+  g_mutex_unlock ( ti_mutex );
+  return count;
+}
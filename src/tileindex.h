@@ -0,0 +1,50 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILEINDEX_H
+#define __VIKING_TILEINDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+  gint64 mtime;
+  gint64 size;
+  gchar *etag; // May be NULL
+} TileIndexEntry;
+
+void a_tileindex_init ();
+void a_tileindex_uninit ();
+
+void a_tileindex_register ( const gchar *cache_dir );
+
+gboolean a_tileindex_lookup ( const gchar *filename, TileIndexEntry *entry );
+gboolean a_tileindex_file_exists ( const gchar *filename, gint64 *mtime );
+void a_tileindex_set ( const gchar *filename, gint64 mtime, gint64 size, const gchar *etag );
+void a_tileindex_update ( const gchar *filename, const gchar *etag );
+void a_tileindex_touch ( const gchar *filename );
+void a_tileindex_remove ( const gchar *filename );
+
+void a_tileindex_scan ( const gchar *tile_dir );
+gint64 a_tileindex_count_tiles ( const gchar *tile_dir, gint zoom, gint x0, gint xf, gint y0, gint yf );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * What is known about which tiles of a map are available (in memory or on disk),
+ *  so other zoom levels can be used in place of a missing tile
+ *  without looking again and again for tiles that aren't there.
+ *
+ * Tiles are unknown until seen or looked for.
+ * Knowing a tile is missing is forgotten after a while,
+ *  as it may since have been downloaded (e.g. by another layer of the same map).
+ * Can be used from any thread.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "tileresidency.h"
+#include "vik_compat.h"
+
+// Seconds until a missing tile is looked for again
+#define TILE_RESIDENCY_ABSENT_SECS 60
+// Once this many tiles are known about, start again
+#define TILE_RESIDENCY_MAX_TILES 262144
+
+struct _VikTileResidency {
+  GMutex *mutex;
+  GHashTable *tiles; // Packed MapCoord -> When known to be absent (seconds), or 0 when present
+};
+
+static gint64 tile_key ( const MapCoord *mc )
+{
+  // Scales are within +-32, zones within 0-255 and x,y within 2^25 (zoom 25)
+  return ((gint64)((mc->scale + 32) & 0x3F) << 58) | ((gint64)(mc->z & 0xFF) << 50) |
+         ((gint64)(mc->x & 0x1FFFFFF) << 25) | (gint64)(mc->y & 0x1FFFFFF);
+}
+
+VikTileResidency *vik_tile_residency_new ( void )
+{
+  VikTileResidency *tr = g_malloc0 ( sizeof(VikTileResidency) );
+  tr->mutex = vik_mutex_new ();
+  tr->tiles = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+  return tr;
+}
+
+void vik_tile_residency_free ( VikTileResidency *tr )
+{
+  if ( !tr )
+    return;
+  g_hash_table_destroy ( tr->tiles );
+  vik_mutex_free ( tr->mutex );
+  g_free ( tr );
+}
+
+/**
+ * vik_tile_residency_clear:
+ *
+ * Forget everything, e.g. when the tiles are from somewhere else
+ */
+void vik_tile_residency_clear ( VikTileResidency *tr )
+{
+  g_mutex_lock ( tr->mutex );
+  g_hash_table_remove_all ( tr->tiles );
+  g_mutex_unlock ( tr->mutex );
+}
+
+/**
+ * vik_tile_residency_set:
+ * @state: Either VIK_TILE_PRESENT or VIK_TILE_ABSENT
+ */
+void vik_tile_residency_set ( VikTileResidency *tr, const MapCoord *mc, VikTileResidencyState state )
+{
+  gint64 key = tile_key ( mc );
+  gint64 value = ( state == VIK_TILE_ABSENT ) ? g_get_monotonic_time() / G_USEC_PER_SEC + 1 : 0;
+
+  g_mutex_lock ( tr->mutex );
+  gint64 *old = g_hash_table_lookup ( tr->tiles, &key );
+  if ( old ) {
+    // Only changing it when it's different is the usual case, as tiles are set each time they're drawn
+    if ( ( *old == 0 ) != ( value == 0 ) )
+      *old = value;
+  }
+  else {
+    if ( g_hash_table_size(tr->tiles) >= TILE_RESIDENCY_MAX_TILES )
+      g_hash_table_remove_all ( tr->tiles );
+    g_hash_table_insert ( tr->tiles, g_memdup(&key, sizeof(key)), g_memdup(&value, sizeof(value)) );
+  }
+  g_mutex_unlock ( tr->mutex );
+}
+
+VikTileResidencyState vik_tile_residency_get ( VikTileResidency *tr, const MapCoord *mc )
+{
+  gint64 key = tile_key ( mc );
+  VikTileResidencyState state = VIK_TILE_UNKNOWN;
+
+  g_mutex_lock ( tr->mutex );
+  gint64 *value = g_hash_table_lookup ( tr->tiles, &key );
+  if ( value ) {
+    if ( *value == 0 )
+      state = VIK_TILE_PRESENT;
+    else if ( g_get_monotonic_time() / G_USEC_PER_SEC + 1 - *value < TILE_RESIDENCY_ABSENT_SECS )
+      state = VIK_TILE_ABSENT;
+  }
+  g_mutex_unlock ( tr->mutex );
+  return state;
+}
+
+/**
+ * vik_tile_residency_best_ancestor:
+ * @levels: How many zoom levels out to look
+ *
+ * Returns: The number of levels out of the nearest covering tile that is known to be present,
+ *          or failing that, of the nearest one that might be present; 0 if there is none
+ */
+guint vik_tile_residency_best_ancestor ( VikTileResidency *tr, const MapCoord *mc, guint levels )
+{
+  guint unknown = 0;
+  for ( guint ll = 1; ll <= levels; ll++ ) {
+    MapCoord ancestor = *mc;
+    ancestor.x = mc->x >> ll;
+    ancestor.y = mc->y >> ll;
+    ancestor.scale = mc->scale + ll;
+    VikTileResidencyState state = vik_tile_residency_get ( tr, &ancestor );
+    if ( state == VIK_TILE_PRESENT )
+      return ll;
+    if ( state == VIK_TILE_UNKNOWN && !unknown )
+      unknown = ll;
+  }
+  return unknown;
+}
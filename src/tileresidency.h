@@ -0,0 +1,46 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILERESIDENCY_H
+#define __VIKING_TILERESIDENCY_H
+
+#include <glib.h>
+#include "mapcoord.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  VIK_TILE_UNKNOWN = 0,
+  VIK_TILE_PRESENT,
+  VIK_TILE_ABSENT,
+} VikTileResidencyState;
+
+typedef struct _VikTileResidency VikTileResidency;
+
+VikTileResidency *vik_tile_residency_new ( void );
+void vik_tile_residency_free ( VikTileResidency *tr );
+void vik_tile_residency_clear ( VikTileResidency *tr );
+
+void vik_tile_residency_set ( VikTileResidency *tr, const MapCoord *mc, VikTileResidencyState state );
+VikTileResidencyState vik_tile_residency_get ( VikTileResidency *tr, const MapCoord *mc );
+guint vik_tile_residency_best_ancestor ( VikTileResidency *tr, const MapCoord *mc, guint levels );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * A record of what the background threads have been doing,
+ *  for export in the Chrome trace event format (as also read by Perfetto)
+ *  to see how the thread pools are used over a session.
+ *
+ * Only the most recent events are kept, so the memory used is bounded.
+ * Times are from g_get_monotonic_time(), in microseconds as the format uses.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "tracelog.h"
+
+#define TRACELOG_SIZE 65536
+
+typedef struct {
+  gchar phase;     // 'X' complete, 'b'/'e' async begin/end, 'C' counter
+  const gchar *cat;
+  gchar *name;
+  gint64 ts;
+  gint64 dur;
+  guint tid;
+  guint id;        // Of async events
+  gchar *args;     // JSON object members (may be NULL)
+} TraceEvent;
+
+G_LOCK_DEFINE_STATIC(trace_lock);
+static TraceEvent *events = NULL;
+static guint next_event = 0;
+static gboolean wrapped = FALSE;
+// Names of threads indexed by (tid-1)
+static GPtrArray *thread_names = NULL;
+
+static GPrivate thread_id;
+static guint last_thread_id = 0; // Under the lock too
+
+static void event_clear ( TraceEvent *te )
+{
+  g_free ( te->name );
+  g_free ( te->args );
+  memset ( te, 0, sizeof(TraceEvent) );
+}
+
+/**
+ * Must be called with the lock held
+ */
+static guint current_tid ()
+{
+  guint tid = GPOINTER_TO_UINT ( g_private_get ( &thread_id ) );
+  if ( !tid ) {
+    tid = ++last_thread_id;
+    g_private_set ( &thread_id, GUINT_TO_POINTER(tid) );
+  }
+  if ( !thread_names )
+    thread_names = g_ptr_array_new_with_free_func ( g_free );
+  while ( thread_names->len < tid )
+    g_ptr_array_add ( thread_names, NULL );
+  return tid;
+}
+
+/**
+ * Takes ownership of @name and @args
+ */
+static void add_event ( gchar phase, const gchar *cat, gchar *name, gint64 ts, gint64 dur, guint id, gchar *args )
+{
+  G_LOCK(trace_lock);
+  if ( !events )
+    events = g_new0 ( TraceEvent, TRACELOG_SIZE );
+  TraceEvent *te = &events[next_event];
+  event_clear ( te );
+  te->phase = phase;
+  te->cat = cat;
+  te->name = name;
+  te->ts = ts;
+  te->dur = dur;
+  te->tid = current_tid ();
+  te->id = id;
+  te->args = args;
+  if ( ++next_event == TRACELOG_SIZE ) {
+    next_event = 0;
+    wrapped = TRUE;
+  }
+  G_UNLOCK(trace_lock);
+}
+
+/**
+ * a_tracelog_thread_name:
+ *
+ * Name the calling thread in the trace, unless it already has a name
+ */
+void a_tracelog_thread_name ( const gchar *name )
+{
+  G_LOCK(trace_lock);
+  guint tid = current_tid ();
+  if ( !g_ptr_array_index ( thread_names, tid-1 ) )
+    g_ptr_array_index ( thread_names, tid-1 ) = g_strdup ( name );
+  G_UNLOCK(trace_lock);
+}
+
+/**
+ * a_tracelog_complete:
+ * @cat:   Category (a static string)
+ * @name:  What was done
+ * @start: When it started
+ * @args:  Extra values as JSON object members (e.g. "\"tiles\": 4"), freed by this function (may be NULL)
+ *
+ * Record something done by the calling thread, ending now
+ */
+void a_tracelog_complete ( const gchar *cat, const gchar *name, gint64 start, gchar *args )
+{
+  gint64 now = g_get_monotonic_time ();
+  add_event ( 'X', cat, g_strdup(name), start, now - start, 0, args );
+}
+
+/**
+ * a_tracelog_counter:
+ *
+ * Record the current value of something that varies over time, e.g. a queue length
+ */
+void a_tracelog_counter ( const gchar *name, gint64 value )
+{
+  add_event ( 'C', "counter", g_strdup(name), g_get_monotonic_time(), 0, 0, g_strdup_printf ( "\"value\": %" G_GINT64_FORMAT, value ) );
+}
+
+/**
+ * a_tracelog_async:
+ * @id: Identifies this span among others of the same category
+ *
+ * Record a span not tied to a thread, such as waiting in a queue
+ */
+void a_tracelog_async ( const gchar *cat, const gchar *name, guint id, gint64 start, gint64 end, gchar *args )
+{
+  add_event ( 'b', cat, g_strdup(name), start, 0, id, args );
+  add_event ( 'e', cat, g_strdup(name), end, 0, id, NULL );
+}
+
+static void append_json_string ( GString *gs, const gchar *str )
+{
+  g_string_append_c ( gs, '"' );
+  for ( const gchar *pp = str; *pp; pp++ ) {
+    if ( *pp == '"' || *pp == '\\' )
+      g_string_append_printf ( gs, "\\%c", *pp );
+    else if ( (guchar)*pp < 0x20 )
+      g_string_append_printf ( gs, "\\u%04x", (guchar)*pp );
+    else
+      g_string_append_c ( gs, *pp );
+  }
+  g_string_append_c ( gs, '"' );
+}
+
+static void append_event ( GString *gs, const TraceEvent *te )
+{
+  g_string_append ( gs, ",\n{\"name\": " );
+  append_json_string ( gs, te->name ? te->name : "" );
+  g_string_append_printf ( gs, ", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %" G_GINT64_FORMAT ", \"pid\": 1, \"tid\": %u",
+                           te->cat, te->phase, te->ts, te->tid );
+  if ( te->phase == 'X' )
+    g_string_append_printf ( gs, ", \"dur\": %" G_GINT64_FORMAT, te->dur );
+  else if ( te->phase != 'C' )
+    g_string_append_printf ( gs, ", \"id\": %u", te->id );
+  if ( te->args )
+    g_string_append_printf ( gs, ", \"args\": {%s}", te->args );
+  g_string_append_c ( gs, '}' );
+}
+
+/**
+ * a_tracelog_to_json:
+ *
+ * Returns: The recorded events as a trace event JSON array, which should be freed after use
+ */
+gchar *a_tracelog_to_json ()
+{
+  GString *gs = g_string_new ( "[{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"viking\"}}" );
+  G_LOCK(trace_lock);
+  for ( guint ii = 0; thread_names && ii < thread_names->len; ii++ ) {
+    const gchar *name = g_ptr_array_index ( thread_names, ii );
+    if ( !name )
+      continue;
+    g_string_append_printf ( gs, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", ii+1 );
+    append_json_string ( gs, name );
+    g_string_append ( gs, "}}" );
+  }
+  if ( events ) {
+    // Oldest first
+    guint first = wrapped ? next_event : 0;
+    guint count = wrapped ? TRACELOG_SIZE : next_event;
+    for ( guint nn = 0; nn < count; nn++ )
+      append_event ( gs, &events[(first + nn) % TRACELOG_SIZE] );
+  }
+  G_UNLOCK(trace_lock);
+  g_string_append ( gs, "\n]\n" );
+  return g_string_free ( gs, FALSE );
+}
+
+/**
+ * a_tracelog_export:
+ *
+ * Write the recorded events to the file, for opening in chrome://tracing or https://ui.perfetto.dev
+ */
+gboolean a_tracelog_export ( const gchar *filename )
+{
+  gchar *json = a_tracelog_to_json ();
+  GError *error = NULL;
+  gboolean ans = g_file_set_contents ( filename, json, -1, &error );
+  if ( !ans ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( json );
+  return ans;
+}
+
+void a_tracelog_uninit ()
+{
+  G_LOCK(trace_lock);
+  if ( events ) {
+    for ( guint ii = 0; ii < TRACELOG_SIZE; ii++ )
+      event_clear ( &events[ii] );
+    g_free ( events );
+    events = NULL;
+  }
+  next_event = 0;
+  wrapped = FALSE;
+  if ( thread_names )
+    g_ptr_array_free ( thread_names, TRUE );
+  thread_names = NULL;
+  G_UNLOCK(trace_lock);
+}
@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACELOG_H
+#define __VIKING_TRACELOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void a_tracelog_thread_name ( const gchar *name );
+void a_tracelog_complete ( const gchar *cat, const gchar *name, gint64 start, gchar *args );
+void a_tracelog_counter ( const gchar *name, gint64 value );
+void a_tracelog_async ( const gchar *cat, const gchar *name, guint id, gint64 start, gint64 end, gchar *args );
+
+gchar *a_tracelog_to_json ();
+gboolean a_tracelog_export ( const gchar *filename );
+void a_tracelog_uninit ();
+
+G_END_DECLS
+
+#endif
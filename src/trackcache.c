@@ -0,0 +1,199 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Values derived from the trackpoints of large tracks (e.g. the simplification for drawing),
+ *  kept on disk between sessions so reopening the same tracks need not work them out again.
+ *
+ * Each value is a file in the user's cache directory, named by the hash of the trackpoints (vik_track_get_trackpoints_hash())
+ *  plus the kind of value and the version of the algorithm that made it.
+ * So a changed track or a changed algorithm simply never finds the old file,
+ *  and old files are eventually removed by the cache janitor as the least recently used.
+ *
+ * The files are in the native byte order - they are only a cache for this machine.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "trackcache.h"
+#include "cachejanitor.h"
+#include "settings.h"
+#include "vik_compat.h"
+
+#define VIK_SETTINGS_TRACKCACHE "track_derived_cache"
+#define VIK_SETTINGS_TRACKCACHE_SIZE "track_derived_cache_size_mb"
+
+// Smaller tracks are quicker to work out again than to read from a file
+#define TRACKCACHE_MIN_POINTS 10000
+// Keys kept for tracks seen recently, before starting again
+#define TRACKCACHE_MAX_KEYS 1024
+
+static gboolean tc_enabled = TRUE;
+static gint tc_size_mb = 200;
+static gchar *tc_dir = NULL;
+static GMutex *tc_mutex = NULL;
+// Track serial -> key, as the serial changes with any change to the trackpoints
+static GHashTable *tc_keys = NULL;
+
+/**
+ * The hash of the track's trackpoints, or NULL if too small to be worth caching
+ */
+static gchar *track_key ( const VikTrack *tr )
+{
+  guint serial = vik_track_get_serial ( tr );
+  g_mutex_lock ( tc_mutex );
+  gchar *key = g_strdup ( g_hash_table_lookup ( tc_keys, GUINT_TO_POINTER(serial) ) );
+  g_mutex_unlock ( tc_mutex );
+  if ( key )
+    return key;
+
+  guint len = 0;
+  for ( GList *iter = tr->trackpoints; iter && len < TRACKCACHE_MIN_POINTS; iter = iter->next )
+    len++;
+  if ( len < TRACKCACHE_MIN_POINTS )
+    return NULL;
+
+  key = g_strdup_printf ( "%016" G_GINT64_MODIFIER "x", vik_track_get_trackpoints_hash ( tr ) );
+  g_mutex_lock ( tc_mutex );
+  if ( g_hash_table_size ( tc_keys ) >= TRACKCACHE_MAX_KEYS )
+    g_hash_table_remove_all ( tc_keys );
+  g_hash_table_insert ( tc_keys, GUINT_TO_POINTER(serial), g_strdup(key) );
+  g_mutex_unlock ( tc_mutex );
+  return key;
+}
+
+/**
+ * Spread over subdirectories by the start of the key, as there may be many files
+ */
+static gchar *track_filename ( const gchar *key, const gchar *kind, guint version )
+{
+  gchar sub[3] = { key[0], key[1], '\0' };
+  gchar *name = g_strdup_printf ( "%s.%s%u", key, kind, version );
+  gchar *fn = g_build_filename ( tc_dir, sub, name, NULL );
+  g_free ( name );
+  return fn;
+}
+
+/**
+ * a_trackcache_load:
+ * @kind:    Name of the derived value
+ * @version: Of the algorithm that works out the value
+ * @data:    Filled with the value when found
+ * @size:    The size of the value - which should be known from the track
+ *
+ * May be called from any thread.
+ *
+ * Returns: TRUE if the value for the track's current trackpoints was found
+ */
+gboolean a_trackcache_load ( const VikTrack *tr, const gchar *kind, guint version, gpointer data, gsize size )
+{
+  if ( !tc_enabled || !tc_mutex )
+    return FALSE;
+  gchar *key = track_key ( tr );
+  if ( !key )
+    return FALSE;
+
+  gboolean ans = FALSE;
+  gchar *fn = track_filename ( key, kind, version );
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( g_file_get_contents ( fn, &contents, &length, NULL ) ) {
+    if ( length == size ) {
+      memcpy ( data, contents, size );
+      ans = TRUE;
+    }
+    else
+      g_warning ( "%s: Ignoring %s of an unexpected size", __FUNCTION__, fn );
+    g_free ( contents );
+  }
+  g_free ( fn );
+  g_free ( key );
+  return ans;
+}
+
+/**
+ * a_trackcache_save:
+ *
+ * Keep the value worked out from the track's current trackpoints for next time,
+ *  see a_trackcache_load().
+ * Nothing is saved for small tracks.
+ *
+ * May be called from any thread.
+ */
+void a_trackcache_save ( const VikTrack *tr, const gchar *kind, guint version, gconstpointer data, gsize size )
+{
+  if ( !tc_enabled || !tc_mutex )
+    return;
+  gchar *key = track_key ( tr );
+  if ( !key )
+    return;
+
+  gchar *fn = track_filename ( key, kind, version );
+  gchar *dir = g_path_get_dirname ( fn );
+  if ( g_mkdir_with_parents ( dir, 0700 ) != 0 )
+    g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+  else {
+    // Written to a temporary file then renamed, so a partly written value is never read
+    GError *error = NULL;
+    if ( !g_file_set_contents ( fn, data, size, &error ) ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+  }
+  g_free ( dir );
+  g_free ( fn );
+  g_free ( key );
+}
+
+/**
+ * Must be after a_background_init() as the size of the cache may be checked in the background
+ */
+void a_trackcache_init ()
+{
+  gboolean tmp = TRUE;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_TRACKCACHE, &tmp ) )
+    tc_enabled = tmp;
+  gint size = tc_size_mb;
+  if ( a_settings_get_integer ( VIK_SETTINGS_TRACKCACHE_SIZE, &size ) )
+    tc_size_mb = MAX ( 1, size );
+  if ( !tc_enabled )
+    return;
+
+  tc_dir = g_build_filename ( g_get_user_cache_dir(), "viking", "derived", NULL );
+  tc_mutex = vik_mutex_new ();
+  tc_keys = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+
+  a_cachejanitor_check ( tc_dir, (guint64)tc_size_mb * 1024 * 1024, NULL, FALSE );
+}
+
+void a_trackcache_uninit ()
+{
+  if ( !tc_mutex )
+    return;
+  g_hash_table_destroy ( tc_keys );
+  tc_keys = NULL;
+  vik_mutex_free ( tc_mutex );
+  tc_mutex = NULL;
+  g_free ( tc_dir );
+  tc_dir = NULL;
+}
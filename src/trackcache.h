@@ -0,0 +1,36 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKCACHE_H
+#define __VIKING_TRACKCACHE_H
+
+#include <glib.h>
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+void a_trackcache_init ();
+void a_trackcache_uninit ();
+
+gboolean a_trackcache_load ( const VikTrack *tr, const gchar *kind, guint version, gpointer data, gsize size );
+void a_trackcache_save ( const VikTrack *tr, const gchar *kind, guint version, gconstpointer data, gsize size );
+
+G_END_DECLS
+
+#endif
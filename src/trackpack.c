@@ -0,0 +1,440 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * The trackpoints of a track held compactly, for tracks that are kept but not worked on.
+ *
+ * Positions are fixed point (1e-7 degrees or centimetres for UTM),
+ *  altitudes are floats, and timestamps are millisecond steps from the previous one.
+ * Everything else is usually the same for most points (e.g. not available),
+ *  so it is only kept for the points where it isn't.
+ *
+ * Unpacking gives the trackpoints back to this resolution,
+ *  and packing them again gives the same values.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "trackpack.h"
+
+#define PACK_LATLON_SCALE 1e7
+#define PACK_UTM_SCALE 100.0
+
+// Time step values with special meanings
+#define PACK_TIME_NONE G_MININT32
+#define PACK_TIME_OTHER G_MAXINT32 // In the 'timestamp' sparse column
+
+typedef enum {
+  PACK_SPEED = 0,
+  PACK_COURSE,
+  PACK_HDOP,
+  PACK_VDOP,
+  PACK_PDOP,
+  PACK_TEMP,
+  PACK_NSATS,
+  PACK_FIX_MODE,
+  PACK_HEART_RATE,
+  PACK_CADENCE,
+  PACK_POWER,
+  PACK_NEWSEGMENT,
+  PACK_TIMESTAMP,
+  PACK_NUM_SPARSE
+} PackSparseField;
+
+// Only the points whose value is not the default
+typedef struct {
+  guint len;
+  guint32 *index;
+  gdouble *value;
+} PackSparse;
+
+// Only the points where the string differs from the previous point
+typedef struct {
+  guint len;
+  guint32 *index;
+  gchar **value;
+} PackStrings;
+
+struct _VikTrackPack {
+  gint ref_count; // Shared between copies of a track until one of them is unpacked
+  guint len;
+  VikCoordMode mode;
+  gchar utm_zone;
+  gchar utm_letter;
+  gint32 *north_south;
+  gint32 *east_west;
+  gfloat *altitude;  // NULL when none are available
+  gdouble first_time;
+  gint32 *time_step; // NULL when none are available
+  gdouble min_time, max_time; // So the track can still be found by time without unpacking
+  PackSparse sparse[PACK_NUM_SPARSE];
+  PackStrings names;
+  PackStrings extensions;
+};
+
+static gdouble sparse_get ( const VikTrackpoint *tp, PackSparseField field )
+{
+  switch ( field ) {
+  case PACK_SPEED: return tp->speed;
+  case PACK_COURSE: return tp->course;
+  case PACK_HDOP: return tp->hdop;
+  case PACK_VDOP: return tp->vdop;
+  case PACK_PDOP: return tp->pdop;
+  case PACK_TEMP: return tp->temp;
+  case PACK_NSATS: return tp->nsats;
+  case PACK_FIX_MODE: return tp->fix_mode;
+  case PACK_HEART_RATE: return tp->heart_rate;
+  case PACK_CADENCE: return tp->cadence;
+  case PACK_POWER: return tp->power;
+  case PACK_NEWSEGMENT: return tp->newsegment;
+  default: return tp->timestamp;
+  }
+}
+
+static void sparse_set ( VikTrackpoint *tp, PackSparseField field, gdouble value )
+{
+  switch ( field ) {
+  case PACK_SPEED: tp->speed = value; break;
+  case PACK_COURSE: tp->course = value; break;
+  case PACK_HDOP: tp->hdop = value; break;
+  case PACK_VDOP: tp->vdop = value; break;
+  case PACK_PDOP: tp->pdop = value; break;
+  case PACK_TEMP: tp->temp = value; break;
+  case PACK_NSATS: tp->nsats = value; break;
+  case PACK_FIX_MODE: tp->fix_mode = value; break;
+  case PACK_HEART_RATE: tp->heart_rate = value; break;
+  case PACK_CADENCE: tp->cadence = value; break;
+  case PACK_POWER: tp->power = value; break;
+  case PACK_NEWSEGMENT: tp->newsegment = value != 0; break;
+  default: tp->timestamp = value; break;
+  }
+}
+
+/**
+ * Whether the value is the one a new trackpoint has anyway
+ */
+static gboolean sparse_is_default ( PackSparseField field, gdouble value )
+{
+  switch ( field ) {
+  case PACK_NSATS:
+  case PACK_FIX_MODE:
+  case PACK_HEART_RATE:
+  case PACK_NEWSEGMENT: return value == 0;
+  case PACK_CADENCE: return value == VIK_TRKPT_CADENCE_NONE;
+  case PACK_POWER: return value == VIK_TRKPT_POWER_NONE;
+  default: return isnan ( value );
+  }
+}
+
+static void sparse_add ( PackSparse *ps, guint ii, gdouble value, guint *alloc )
+{
+  if ( ps->len == *alloc ) {
+    *alloc = MAX ( 16, *alloc * 2 );
+    ps->index = g_renew ( guint32, ps->index, *alloc );
+    ps->value = g_renew ( gdouble, ps->value, *alloc );
+  }
+  ps->index[ps->len] = ii;
+  ps->value[ps->len] = value;
+  ps->len++;
+}
+
+static void sparse_trim ( PackSparse *ps )
+{
+  ps->index = g_renew ( guint32, ps->index, ps->len );
+  ps->value = g_renew ( gdouble, ps->value, ps->len );
+}
+
+static void strings_add ( PackStrings *ps, guint ii, const gchar *value )
+{
+  // Usually only a few changes
+  ps->index = g_renew ( guint32, ps->index, ps->len + 1 );
+  ps->value = g_renew ( gchar*, ps->value, ps->len + 1 );
+  ps->index[ps->len] = ii;
+  ps->value[ps->len] = g_strdup ( value );
+  ps->len++;
+}
+
+static gboolean pack_fixed ( gdouble value, gdouble scale, gint32 *fixed )
+{
+  gdouble scaled = round ( value * scale );
+  if ( isnan(scaled) || scaled <= G_MININT32 || scaled >= G_MAXINT32 )
+    return FALSE;
+  *fixed = (gint32)scaled;
+  return TRUE;
+}
+
+/**
+ * vik_track_pack_new:
+ * @trackpoints: The trackpoints to pack, which are left as they are
+ *
+ * Returns: The packed trackpoints,
+ *  or NULL if they can't be packed (e.g. UTM positions in more than one zone)
+ */
+VikTrackPack *vik_track_pack_new ( GList *trackpoints )
+{
+  if ( !trackpoints )
+    return NULL;
+
+  const VikCoord *first = &VIK_TRACKPOINT(trackpoints->data)->coord;
+  VikTrackPack *pack = g_malloc0 ( sizeof(VikTrackPack) );
+  pack->ref_count = 1;
+  pack->len = g_list_length ( trackpoints );
+  pack->mode = first->mode;
+  pack->utm_zone = first->utm_zone;
+  pack->utm_letter = first->utm_letter;
+  pack->north_south = g_new ( gint32, pack->len );
+  pack->east_west = g_new ( gint32, pack->len );
+  pack->altitude = g_new ( gfloat, pack->len );
+  pack->time_step = g_new ( gint32, pack->len );
+  pack->min_time = NAN;
+  pack->max_time = NAN;
+
+  const gdouble scale = pack->mode == VIK_COORD_LATLON ? PACK_LATLON_SCALE : PACK_UTM_SCALE;
+  guint alloc[PACK_NUM_SPARSE] = { 0 };
+  gboolean any_altitude = FALSE;
+  gboolean any_time = FALSE;
+  gint64 last_ms = 0;
+  const gchar *last_name = NULL;
+  const gchar *last_extensions = NULL;
+  guint ii = 0;
+  GList *iter;
+  for ( iter = trackpoints; iter; iter = iter->next, ii++ ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( tp->coord.mode != pack->mode ||
+         ( pack->mode == VIK_COORD_UTM && ( tp->coord.utm_zone != pack->utm_zone || tp->coord.utm_letter != pack->utm_letter ) ) ||
+         !pack_fixed ( tp->coord.north_south, scale, &pack->north_south[ii] ) ||
+         !pack_fixed ( tp->coord.east_west, scale, &pack->east_west[ii] ) ) {
+      vik_track_pack_free ( pack );
+      return NULL;
+    }
+
+    pack->altitude[ii] = tp->altitude;
+    if ( !isnan(tp->altitude) )
+      any_altitude = TRUE;
+
+    // Times in whole milliseconds not too far from the previous one are just a step
+    pack->time_step[ii] = PACK_TIME_NONE;
+    if ( !isnan(tp->timestamp) ) {
+      if ( !any_time || tp->timestamp < pack->min_time )
+        pack->min_time = tp->timestamp;
+      if ( !any_time || tp->timestamp > pack->max_time )
+        pack->max_time = tp->timestamp;
+      any_time = TRUE;
+      gdouble ms = round ( tp->timestamp * 1000.0 );
+      if ( ii == 0 ) {
+        pack->first_time = tp->timestamp;
+        pack->time_step[ii] = 0;
+        last_ms = (gint64)ms;
+      }
+      else if ( ms / 1000.0 == tp->timestamp && fabs ( ms - last_ms ) < G_MAXINT32 ) {
+        pack->time_step[ii] = (gint32)((gint64)ms - last_ms);
+        last_ms = (gint64)ms;
+      }
+      else {
+        pack->time_step[ii] = PACK_TIME_OTHER;
+        sparse_add ( &pack->sparse[PACK_TIMESTAMP], ii, tp->timestamp, &alloc[PACK_TIMESTAMP] );
+        last_ms = (gint64)ms;
+      }
+    }
+
+    PackSparseField field;
+    for ( field = 0; field < PACK_TIMESTAMP; field++ ) {
+      gdouble value = sparse_get ( tp, field );
+      if ( !sparse_is_default ( field, value ) )
+        sparse_add ( &pack->sparse[field], ii, value, &alloc[field] );
+    }
+
+    if ( g_strcmp0 ( tp->name, last_name ) )
+      strings_add ( &pack->names, ii, tp->name );
+    last_name = tp->name;
+    if ( g_strcmp0 ( tp->extensions, last_extensions ) )
+      strings_add ( &pack->extensions, ii, tp->extensions );
+    last_extensions = tp->extensions;
+  }
+
+  if ( !any_altitude ) {
+    g_free ( pack->altitude );
+    pack->altitude = NULL;
+  }
+  if ( !any_time ) {
+    g_free ( pack->time_step );
+    pack->time_step = NULL;
+  }
+  PackSparseField field;
+  for ( field = 0; field < PACK_NUM_SPARSE; field++ )
+    sparse_trim ( &pack->sparse[field] );
+
+  return pack;
+}
+
+static void strings_free ( PackStrings *ps )
+{
+  guint ii;
+  for ( ii = 0; ii < ps->len; ii++ )
+    g_free ( ps->value[ii] );
+  g_free ( ps->index );
+  g_free ( ps->value );
+}
+
+/**
+ * vik_track_pack_ref:
+ *
+ * The packed trackpoints are never changed, so can be held by any number of tracks
+ *
+ * Returns: The same pack
+ */
+VikTrackPack *vik_track_pack_ref ( VikTrackPack *pack )
+{
+  g_atomic_int_inc ( &pack->ref_count );
+  return pack;
+}
+
+/**
+ * vik_track_pack_free:
+ *
+ * Drop a reference, freeing the packed trackpoints once no track holds them
+ *  (which may be in another thread - see trw_layer_free_items_later())
+ */
+void vik_track_pack_free ( VikTrackPack *pack )
+{
+  if ( !pack )
+    return;
+  if ( !g_atomic_int_dec_and_test ( &pack->ref_count ) )
+    return;
+  g_free ( pack->north_south );
+  g_free ( pack->east_west );
+  g_free ( pack->altitude );
+  g_free ( pack->time_step );
+  PackSparseField field;
+  for ( field = 0; field < PACK_NUM_SPARSE; field++ ) {
+    g_free ( pack->sparse[field].index );
+    g_free ( pack->sparse[field].value );
+  }
+  strings_free ( &pack->names );
+  strings_free ( &pack->extensions );
+  g_free ( pack );
+}
+
+/**
+ * vik_track_pack_unpack:
+ *
+ * Returns: A new list of new trackpoints
+ */
+GList *vik_track_pack_unpack ( const VikTrackPack *pack )
+{
+  const gdouble scale = pack->mode == VIK_COORD_LATLON ? PACK_LATLON_SCALE : PACK_UTM_SCALE;
+  guint next[PACK_NUM_SPARSE] = { 0 };
+  guint next_name = 0, next_extensions = 0;
+  const gchar *name = NULL, *extensions = NULL;
+  gint64 last_ms = 0;
+  GList *list = NULL;
+  guint ii;
+  for ( ii = 0; ii < pack->len; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    tp->coord.mode = pack->mode;
+    tp->coord.utm_zone = pack->utm_zone;
+    tp->coord.utm_letter = pack->utm_letter;
+    tp->coord.north_south = pack->north_south[ii] / scale;
+    tp->coord.east_west = pack->east_west[ii] / scale;
+    if ( pack->altitude )
+      tp->altitude = pack->altitude[ii];
+
+    if ( pack->time_step ) {
+      gint32 step = pack->time_step[ii];
+      if ( ii == 0 && step != PACK_TIME_NONE ) {
+        tp->timestamp = pack->first_time;
+        last_ms = (gint64)round ( pack->first_time * 1000.0 );
+      }
+      else if ( step == PACK_TIME_OTHER ) {
+        // Value from the sparse column below
+        last_ms = (gint64)round ( pack->sparse[PACK_TIMESTAMP].value[next[PACK_TIMESTAMP]] * 1000.0 );
+      }
+      else if ( step != PACK_TIME_NONE ) {
+        last_ms += step;
+        tp->timestamp = last_ms / 1000.0;
+      }
+    }
+
+    PackSparseField field;
+    for ( field = 0; field < PACK_NUM_SPARSE; field++ ) {
+      const PackSparse *ps = &pack->sparse[field];
+      if ( next[field] < ps->len && ps->index[next[field]] == ii ) {
+        sparse_set ( tp, field, ps->value[next[field]] );
+        next[field]++;
+      }
+    }
+
+    if ( next_name < pack->names.len && pack->names.index[next_name] == ii )
+      name = pack->names.value[next_name++];
+    if ( name )
+      vik_trackpoint_set_name ( tp, name );
+    if ( next_extensions < pack->extensions.len && pack->extensions.index[next_extensions] == ii )
+      extensions = pack->extensions.value[next_extensions++];
+    if ( extensions )
+      vik_trackpoint_set_extensions ( tp, extensions );
+
+    list = g_list_prepend ( list, tp );
+  }
+  return g_list_reverse ( list );
+}
+
+guint vik_track_pack_get_len ( const VikTrackPack *pack )
+{
+  return pack->len;
+}
+
+/**
+ * vik_track_pack_get_size:
+ *
+ * Returns: Roughly how many bytes the packed trackpoints use
+ */
+gsize vik_track_pack_get_size ( const VikTrackPack *pack )
+{
+  gsize size = sizeof(VikTrackPack) + pack->len * 2 * sizeof(gint32);
+  if ( pack->altitude )
+    size += pack->len * sizeof(gfloat);
+  if ( pack->time_step )
+    size += pack->len * sizeof(gint32);
+  PackSparseField field;
+  for ( field = 0; field < PACK_NUM_SPARSE; field++ )
+    size += pack->sparse[field].len * ( sizeof(guint32) + sizeof(gdouble) );
+  guint ii;
+  for ( ii = 0; ii < pack->names.len; ii++ )
+    size += sizeof(guint32) + sizeof(gchar*) + ( pack->names.value[ii] ? strlen(pack->names.value[ii]) + 1 : 0 );
+  for ( ii = 0; ii < pack->extensions.len; ii++ )
+    size += sizeof(guint32) + sizeof(gchar*) + ( pack->extensions.value[ii] ? strlen(pack->extensions.value[ii]) + 1 : 0 );
+  return size;
+}
+
+/**
+ * vik_track_pack_get_time_span:
+ *
+ * Returns: FALSE if no trackpoint has a time,
+ *  otherwise the earliest and latest trackpoint times
+ */
+gboolean vik_track_pack_get_time_span ( const VikTrackPack *pack, gdouble *first, gdouble *last )
+{
+  if ( !pack->time_step )
+    return FALSE;
+  *first = pack->min_time;
+  *last = pack->max_time;
+  return TRUE;
+}
@@ -0,0 +1,39 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKPACK_H
+#define __VIKING_TRACKPACK_H
+
+#include <glib.h>
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+VikTrackPack *vik_track_pack_new ( GList *trackpoints );
+VikTrackPack *vik_track_pack_ref ( VikTrackPack *pack );
+void vik_track_pack_free ( VikTrackPack *pack );
+
+GList *vik_track_pack_unpack ( const VikTrackPack *pack );
+guint vik_track_pack_get_len ( const VikTrackPack *pack );
+gsize vik_track_pack_get_size ( const VikTrackPack *pack );
+gboolean vik_track_pack_get_time_span ( const VikTrackPack *pack, gdouble *first, gdouble *last );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Follow a stream of NMEA sentences or GPX into a track of a TrackWaypoint layer as it arrives,
+ *  e.g. from a logger piped into stdin, a named pipe or a TCP server.
+ *
+ * The source is read asynchronously in the main loop, so no locking of the layer is needed.
+ * Each block read is parsed incrementally, with every complete trackpoint appended to the track
+ *  in constant time (see vik_trw_layer_track_extend()), and the display is updated once per block
+ *  for only the area that the new part of the track covers.
+ * Thus the cost per trackpoint does not depend on how long the track has become.
+ *
+ * The format is decided by the first character: '<' for GPX, otherwise NMEA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+
+#include "trackstream.h"
+#include "nmea.h"
+#include "gpx.h"
+#include "dialog.h"
+#include "vikwindow.h"
+
+#define TRACKSTREAM_BUFFER_SIZE 16384
+// The registered port for NMEA over TCP
+#define TRACKSTREAM_DEFAULT_PORT 10110
+#define TRACKSTREAM_TCP_PREFIX "tcp://"
+#define TRACKSTREAM_KEY "viking-trackstream"
+
+typedef enum {
+  FORMAT_UNKNOWN = 0,
+  FORMAT_NMEA,
+  FORMAT_GPX,
+} StreamFormat;
+
+typedef struct {
+  // Unset once the layer no longer follows this stream
+  VikTrwLayer *vtl;
+  gchar *source;
+  gchar *track_name;
+  GCancellable *cancellable;
+  GSocketClient *client;
+  GSocketConnection *connection;
+  GInputStream *input;
+  StreamFormat format;
+  NmeaStream *nmea;
+  GpxStream *gpx;
+  guint points;
+  // The track is looked up again for each block, as it may have been deleted or edited in between
+  VikTrack *trk;
+  GList *last;    // Of trk whilst its serial is unchanged
+  guint serial;
+  // Whilst processing a block
+  VikViewport *vvp;
+  GdkRectangle area;
+  gboolean have_area;
+  gboolean redraw;
+  guint added;
+  gchar buf[TRACKSTREAM_BUFFER_SIZE];
+} TrackStream;
+
+static void trackstream_free ( TrackStream *ts )
+{
+  if ( ts->nmea )
+    a_nmea_stream_free ( ts->nmea );
+  if ( ts->gpx )
+    a_gpx_stream_free ( ts->gpx );
+  if ( ts->input )
+    g_object_unref ( ts->input );
+  if ( ts->connection )
+    g_object_unref ( ts->connection );
+  if ( ts->client )
+    g_object_unref ( ts->client );
+  g_object_unref ( ts->cancellable );
+  g_free ( ts->source );
+  g_free ( ts->track_name );
+  g_free ( ts );
+}
+
+/**
+ * When the layer is freed or stops following the stream.
+ * Any read in progress is cancelled, and the stream freed once that read finishes.
+ */
+static void trackstream_detach ( gpointer data )
+{
+  TrackStream *ts = (TrackStream*)data;
+  ts->vtl = NULL;
+  g_cancellable_cancel ( ts->cancellable );
+}
+
+static void trackpoint_add ( VikTrackpoint *tp, gpointer user_data )
+{
+  TrackStream *ts = (TrackStream*)user_data;
+  // Such as the last trackpoint of a stream no longer followed
+  if ( !ts->vtl ) {
+    vik_trackpoint_free ( tp );
+    return;
+  }
+  GdkRectangle area;
+  if ( ts->vvp && vik_trw_layer_track_extend(ts->vtl, ts->trk, tp, &ts->last, ts->vvp, &area) ) {
+    if ( area.width > 0 && area.height > 0 ) {
+      if ( ts->have_area )
+        gdk_rectangle_union ( &ts->area, &area, &ts->area );
+      else
+        ts->area = area;
+      ts->have_area = TRUE;
+    }
+  }
+  else {
+    if ( !ts->vvp )
+      ts->last = vik_track_append_trackpoint ( ts->trk, tp, ts->last );
+    ts->redraw = TRUE;
+  }
+  ts->added++;
+}
+
+static void trackstream_begin ( TrackStream *ts )
+{
+  VikTrack *trk = vik_trw_layer_get_track ( ts->vtl, ts->track_name );
+  if ( !trk ) {
+    trk = vik_track_new ();
+    trk->visible = TRUE;
+    vik_trw_layer_add_track ( ts->vtl, ts->track_name, trk );
+  }
+  // The track may have been replaced or edited since
+  if ( ts->trk != trk || vik_track_get_serial(trk) != ts->serial ) {
+    ts->trk = trk;
+    ts->last = NULL;
+  }
+  GtkWidget *window = VIK_LAYER(ts->vtl)->vt ? VIK_GTK_WINDOW_FROM_LAYER(ts->vtl) : NULL;
+  ts->vvp = IS_VIK_WINDOW(window) ? vik_window_viewport ( VIK_WINDOW(window) ) : NULL;
+  ts->have_area = FALSE;
+  ts->redraw = FALSE;
+  ts->added = 0;
+}
+
+static void trackstream_end ( TrackStream *ts )
+{
+  ts->serial = vik_track_get_serial ( ts->trk );
+  ts->points += ts->added;
+  if ( !ts->added )
+    return;
+  if ( ts->redraw )
+    vik_layer_emit_update ( VIK_LAYER(ts->vtl), TRUE );
+  else
+    vik_layer_emit_update_area ( VIK_LAYER(ts->vtl), TRUE, ts->have_area ? &ts->area : NULL );
+}
+
+/**
+ * Returns: FALSE if the data can not be parsed
+ */
+static gboolean trackstream_feed ( TrackStream *ts, const gchar *buf, gsize len )
+{
+  if ( ts->format == FORMAT_UNKNOWN ) {
+    const gchar *ptr = buf;
+    while ( ptr < buf+len && g_ascii_isspace(*ptr) )
+      ptr++;
+    if ( ptr == buf+len )
+      return TRUE;
+    if ( *ptr == '<' ) {
+      ts->format = FORMAT_GPX;
+      ts->gpx = a_gpx_stream_new ( ts->vtl, trackpoint_add, ts );
+    }
+    else {
+      ts->format = FORMAT_NMEA;
+      ts->nmea = a_nmea_stream_new ( ts->vtl, trackpoint_add, ts );
+    }
+  }
+
+  gboolean ok = TRUE;
+  trackstream_begin ( ts );
+  if ( ts->gpx )
+    ok = a_gpx_stream_feed ( ts->gpx, buf, len );
+  else
+    a_nmea_stream_feed ( ts->nmea, buf, len );
+  trackstream_end ( ts );
+  return ok;
+}
+
+/**
+ * The stream has ended, been stopped or failed
+ */
+static void trackstream_finish ( TrackStream *ts, GError *error )
+{
+  if ( ts->vtl ) {
+    if ( error )
+      g_warning ( "%s: %s: %s", __FUNCTION__, ts->source, error->message );
+    // Any trackpoint still held back by the parser is complete now
+    if ( ts->nmea ) {
+      trackstream_begin ( ts );
+      a_nmea_stream_free ( ts->nmea );
+      ts->nmea = NULL;
+      trackstream_end ( ts );
+    }
+    g_debug ( "%s: %s ended after %u trackpoints", __FUNCTION__, ts->source, ts->points );
+    g_object_steal_data ( G_OBJECT(ts->vtl), TRACKSTREAM_KEY );
+  }
+  trackstream_free ( ts );
+}
+
+static void read_cb ( GObject *source, GAsyncResult *res, gpointer user_data )
+{
+  TrackStream *ts = (TrackStream*)user_data;
+  GError *error = NULL;
+  gssize got = g_input_stream_read_finish ( G_INPUT_STREAM(source), res, &error );
+  if ( got <= 0 || !ts->vtl ) {
+    trackstream_finish ( ts, error );
+    g_clear_error ( &error );
+    return;
+  }
+  if ( !trackstream_feed ( ts, ts->buf, got ) ) {
+    trackstream_finish ( ts, NULL );
+    return;
+  }
+  g_input_stream_read_async ( ts->input, ts->buf, sizeof(ts->buf), G_PRIORITY_DEFAULT, ts->cancellable, read_cb, ts );
+}
+
+static void trackstream_read ( TrackStream *ts, GInputStream *input )
+{
+  ts->input = input;
+  g_input_stream_read_async ( ts->input, ts->buf, sizeof(ts->buf), G_PRIORITY_DEFAULT, ts->cancellable, read_cb, ts );
+}
+
+static void connect_cb ( GObject *source, GAsyncResult *res, gpointer user_data )
+{
+  TrackStream *ts = (TrackStream*)user_data;
+  GError *error = NULL;
+  ts->connection = g_socket_client_connect_to_host_finish ( G_SOCKET_CLIENT(source), res, &error );
+  if ( !ts->connection || !ts->vtl ) {
+    trackstream_finish ( ts, error );
+    g_clear_error ( &error );
+    return;
+  }
+  trackstream_read ( ts, g_object_ref(g_io_stream_get_input_stream(G_IO_STREAM(ts->connection))) );
+}
+
+static void open_cb ( GObject *source, GAsyncResult *res, gpointer user_data )
+{
+  TrackStream *ts = (TrackStream*)user_data;
+  GError *error = NULL;
+  GFileInputStream *input = g_file_read_finish ( G_FILE(source), res, &error );
+  if ( !input || !ts->vtl ) {
+    if ( input )
+      g_object_unref ( input );
+    trackstream_finish ( ts, error );
+    g_clear_error ( &error );
+    return;
+  }
+  trackstream_read ( ts, G_INPUT_STREAM(input) );
+}
+
+/**
+ * a_trackstream_follow:
+ * @vtl:        The layer to add the track to
+ * @source:     "-" for stdin, "tcp://host:port" for a TCP server, otherwise a file (e.g. a named pipe)
+ * @track_name: The track to extend, which is created if not already in the layer
+ *
+ * Start adding the trackpoints from the source to the track, as they arrive.
+ * Any stream the layer already follows is stopped.
+ */
+void a_trackstream_follow ( VikTrwLayer *vtl, const gchar *source, const gchar *track_name )
+{
+  TrackStream *ts = g_malloc0 ( sizeof(TrackStream) );
+  ts->vtl = vtl;
+  ts->source = g_strdup ( source );
+  ts->track_name = g_strdup ( track_name );
+  ts->cancellable = g_cancellable_new ();
+  g_object_set_data_full ( G_OBJECT(vtl), TRACKSTREAM_KEY, ts, trackstream_detach );
+
+  if ( g_str_has_prefix(source, TRACKSTREAM_TCP_PREFIX) ) {
+    ts->client = g_socket_client_new ();
+    g_socket_client_connect_to_host_async ( ts->client, source + strlen(TRACKSTREAM_TCP_PREFIX), TRACKSTREAM_DEFAULT_PORT,
+                                            ts->cancellable, connect_cb, ts );
+  }
+  else {
+    GFile *file = g_file_new_for_path ( g_strcmp0(source, "-") == 0 ? "/dev/stdin" : source );
+    // Opening a named pipe waits for the writer, which is not done in the main loop
+    g_file_read_async ( file, G_PRIORITY_DEFAULT, ts->cancellable, open_cb, ts );
+    g_object_unref ( file );
+  }
+}
+
+void a_trackstream_stop ( VikTrwLayer *vtl )
+{
+  g_object_set_data ( G_OBJECT(vtl), TRACKSTREAM_KEY, NULL );
+}
+
+gboolean a_trackstream_is_following ( VikTrwLayer *vtl )
+{
+  return g_object_get_data ( G_OBJECT(vtl), TRACKSTREAM_KEY ) != NULL;
+}
+
+/**
+ * a_trackstream_dialog:
+ *
+ * Ask for the source and track name, and then start following it
+ */
+void a_trackstream_dialog ( GtkWindow *parent, VikTrwLayer *vtl )
+{
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Follow Stream"),
+                                                    parent,
+                                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_STOCK_CANCEL,
+                                                    GTK_RESPONSE_REJECT,
+                                                    GTK_STOCK_OK,
+                                                    GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  GtkWidget *source_label = gtk_label_new ( _("Source:") );
+  GtkWidget *source_entry = gtk_entry_new ();
+  gtk_entry_set_text ( GTK_ENTRY(source_entry), "-" );
+  gtk_widget_set_tooltip_text ( source_entry, _("NMEA or GPX from - for the standard input, tcp://host:port for a TCP server, or the path of a named pipe or file") );
+  GtkWidget *name_label = gtk_label_new ( _("Track Name:") );
+  GtkWidget *name_entry = gtk_entry_new ();
+  gtk_entry_set_text ( GTK_ENTRY(name_entry), _("Stream") );
+
+  GtkWidget *content = gtk_dialog_get_content_area ( GTK_DIALOG(dialog) );
+  gtk_box_pack_start ( GTK_BOX(content), source_label, FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(content), source_entry, FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(content), name_label, FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(content), name_entry, FALSE, FALSE, 0 );
+
+  g_signal_connect_swapped ( source_entry, "activate", G_CALLBACK(a_dialog_response_accept), GTK_DIALOG(dialog) );
+  g_signal_connect_swapped ( name_entry, "activate", G_CALLBACK(a_dialog_response_accept), GTK_DIALOG(dialog) );
+
+  gtk_widget_show_all ( content );
+  gtk_dialog_set_default_response ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+
+  while ( gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT ) {
+    const gchar *source = gtk_entry_get_text ( GTK_ENTRY(source_entry) );
+    const gchar *name = gtk_entry_get_text ( GTK_ENTRY(name_entry) );
+    if ( *source == '\0' )
+      a_dialog_info_msg ( parent, _("Please enter a source for the stream.") );
+    else if ( *name == '\0' )
+      a_dialog_info_msg ( parent, _("Please enter a name for the track.") );
+    else {
+      a_trackstream_follow ( vtl, source, name );
+      break;
+    }
+  }
+  gtk_widget_destroy ( dialog );
+}
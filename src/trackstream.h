@@ -0,0 +1,36 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKSTREAM_H
+#define __VIKING_TRACKSTREAM_H
+
+#include <gtk/gtk.h>
+#include "viktrwlayer.h"
+
+G_BEGIN_DECLS
+
+void a_trackstream_follow ( VikTrwLayer *vtl, const gchar *source, const gchar *track_name );
+void a_trackstream_stop ( VikTrwLayer *vtl );
+gboolean a_trackstream_is_following ( VikTrwLayer *vtl );
+
+void a_trackstream_dialog ( GtkWindow *parent, VikTrwLayer *vtl );
+
+G_END_DECLS
+
+#endif
@@ -31,6 +31,7 @@
 #include <glib/gprintf.h>
 #include <gio/gio.h>
 #include <math.h>
+#include <string.h>
 #include <ctype.h> // For isalpha() etc...
 
 #include "util.h"
@@ -387,3 +388,50 @@ gboolean util_gdouble_different ( gdouble aa, gdouble bb )
          ( ( !isnan(aa) || !isnan(bb) ) &&
              ( (aa < (bb - TOL)) || (aa > (bb + TOL)) ) );
 }
+
+/**
+ * util_hash_bytes:
+ * @hash: The hash so far, or UTIL_HASH_INIT to start
+ *
+ * 64 bit FNV-1a - not cryptographic, but quick and good enough to tell content apart
+ *  (e.g. to compare many items without comparing them field by field)
+ *
+ * Returns: The hash continued with the bytes
+ */
+guint64 util_hash_bytes ( guint64 hash, gconstpointer data, gsize len )
+{
+  const guint8 *bytes = data;
+  gsize ii;
+  for ( ii = 0; ii < len; ii++ ) {
+    hash ^= bytes[ii];
+    hash *= G_GUINT64_CONSTANT(1099511628211);
+  }
+  return hash;
+}
+
+/**
+ * util_hash_string:
+ *
+ * As util_hash_bytes(), with NULL hashed the same as an empty string
+ */
+guint64 util_hash_string ( guint64 hash, const gchar *str )
+{
+  if ( !str )
+    return util_hash_bytes ( hash, "", 1 );
+  // Including the terminator, so consecutive strings can't run together
+  return util_hash_bytes ( hash, str, strlen(str) + 1 );
+}
+
+/**
+ * util_hash_double:
+ *
+ * As util_hash_bytes(), with all NaNs (and both zeros) hashed the same
+ */
+guint64 util_hash_double ( guint64 hash, gdouble dd )
+{
+  if ( isnan(dd) )
+    dd = NAN;
+  else if ( dd == 0.0 )
+    dd = 0.0;
+  return util_hash_bytes ( hash, &dd, sizeof(dd) );
+}
@@ -30,6 +30,15 @@
 
 G_BEGIN_DECLS
 
+/**
+ * UtilReadFunc:
+ *
+ * Supply up to @size bytes of a stream into @buffer
+ *
+ * Returns: The number of bytes given, 0 at the end of the stream or -1 on failure
+ */
+typedef gssize (*UtilReadFunc) ( gpointer user_data, void *buffer, gsize size );
+
 guint util_get_number_of_cpus (void);
 
 gboolean split_string_from_file_on_equals ( const gchar *buf, gchar **key, gchar **val );
@@ -84,6 +93,13 @@ gboolean util_glist_of_strings_compare ( GList *aa, GList *bb );
 
 gboolean util_gdouble_different ( gdouble aa, gdouble bb );
 
+// Start value for the util_hash_*() functions
+#define UTIL_HASH_INIT G_GUINT64_CONSTANT(14695981039346656037)
+
+guint64 util_hash_bytes ( guint64 hash, gconstpointer data, gsize len );
+guint64 util_hash_string ( guint64 hash, const gchar *str );
+guint64 util_hash_double ( guint64 hash, gdouble dd );
+
 G_END_DECLS
 
 #endif
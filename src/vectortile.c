@@ -0,0 +1,624 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Drawing of Mapbox Vector Tiles (MVT), https://github.com/mapbox/vector-tile-spec
+ *
+ * The tile (a protocol buffer message, possibly gzipped) is read directly,
+ *  without a generated protobuf decoder, and drawn with cairo according to a style.
+ *
+ * A style is a key file with one group per rule; the rules are drawn in the order of the file.
+ * The rule applies to features of the layer of the group name, unless 'layer' is given.
+ * Keys of a rule:
+ *  layer      - The name of the tile layer
+ *  key/values - Only features where the tag 'key' is one of 'values' (e.g. key=class / values=motorway;trunk)
+ *  min-zoom / max-zoom - The TMS zoom levels the rule is used for
+ *  fill       - The colour to fill polygons with
+ *  stroke     - The colour to draw lines and polygon outlines with
+ *  width      - Line width in pixels (default 1)
+ *  radius     - Size of points in pixels (points are only drawn when this is set)
+ *  opacity    - Of both fill and stroke, 0 to 1 (default 1)
+ * The special group [background] only has 'fill', for the whole tile.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <cairo.h>
+#include <gdk/gdk.h>
+
+#include "vectortile.h"
+#include "compression.h"
+
+#define MVT_DEFAULT_EXTENT 4096
+
+enum {
+  MVT_GEOM_UNKNOWN = 0,
+  MVT_GEOM_POINT,
+  MVT_GEOM_LINESTRING,
+  MVT_GEOM_POLYGON,
+};
+
+enum {
+  MVT_CMD_MOVE_TO = 1,
+  MVT_CMD_LINE_TO = 2,
+  MVT_CMD_CLOSE_PATH = 7,
+};
+
+enum {
+  PB_VARINT = 0,
+  PB_FIXED64 = 1,
+  PB_BYTES = 2,
+  PB_FIXED32 = 5,
+};
+
+typedef struct {
+  gboolean set;
+  gdouble r, g, b;
+} StyleColor;
+
+typedef struct {
+  gchar *layer;
+  gchar *key;
+  gchar **values;  // NULL for any value
+  guint min_zoom;
+  guint max_zoom;
+  StyleColor fill;
+  StyleColor stroke;
+  gdouble width;
+  gdouble radius;
+  gdouble opacity;
+} StyleRule;
+
+struct _VikVectorTileStyle {
+  StyleColor background;
+  GArray *rules; // of StyleRule
+};
+
+/**
+ * A position within a protocol buffer message
+ */
+typedef struct {
+  const guint8 *p;
+  const guint8 *end;
+} PbReader;
+
+/**
+ * A part of the tile data, e.g. a string or an embedded message
+ */
+typedef struct {
+  const guint8 *p;
+  gsize len;
+} PbSlice;
+
+typedef struct {
+  guint type;
+  PbSlice tags;
+  PbSlice geometry;
+} MvtFeature;
+
+typedef struct {
+  PbSlice name;
+  guint extent;
+  GArray *keys;     // Of PbSlice
+  GArray *values;   // Of gchar* (only string, integer and boolean values are of use for styling)
+  GArray *features; // Of MvtFeature
+} MvtLayer;
+
+static gboolean pb_varint ( PbReader *rd, guint64 *value )
+{
+  guint64 val = 0;
+  guint shift;
+  for ( shift = 0; shift < 64 && rd->p < rd->end; shift += 7 ) {
+    guint8 byte = *rd->p++;
+    val |= (guint64)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) ) {
+      *value = val;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Read the next field's number and wire type
+ */
+static gboolean pb_next ( PbReader *rd, guint *field, guint *wire_type )
+{
+  guint64 key;
+  if ( rd->p >= rd->end || !pb_varint ( rd, &key ) )
+    return FALSE;
+  *field = key >> 3;
+  *wire_type = key & 0x7;
+  return TRUE;
+}
+
+static gboolean pb_bytes ( PbReader *rd, PbSlice *slice )
+{
+  guint64 len;
+  if ( !pb_varint ( rd, &len ) || len > (guint64)(rd->end - rd->p) )
+    return FALSE;
+  slice->p = rd->p;
+  slice->len = len;
+  rd->p += len;
+  return TRUE;
+}
+
+static gboolean pb_skip ( PbReader *rd, guint wire_type )
+{
+  guint64 dummy;
+  PbSlice slice;
+  gsize size = 0;
+  switch ( wire_type ) {
+  case PB_VARINT:  return pb_varint ( rd, &dummy );
+  case PB_BYTES:   return pb_bytes ( rd, &slice );
+  case PB_FIXED64: size = 8; break;
+  case PB_FIXED32: size = 4; break;
+  default: return FALSE;
+  }
+  if ( size > (gsize)(rd->end - rd->p) )
+    return FALSE;
+  rd->p += size;
+  return TRUE;
+}
+
+static PbReader pb_reader ( const PbSlice *slice )
+{
+  PbReader rd = { slice->p, slice->p + slice->len };
+  return rd;
+}
+
+static gint32 zigzag ( guint32 value )
+{
+  return (gint32)(value >> 1) ^ -(gint32)(value & 1);
+}
+
+/**
+ * The value message as text, for comparing against style values
+ */
+static gchar *mvt_value_to_string ( const PbSlice *slice )
+{
+  PbReader rd = pb_reader ( slice );
+  guint field, wire_type;
+  while ( pb_next ( &rd, &field, &wire_type ) ) {
+    guint64 val;
+    PbSlice str;
+    if ( field == 1 && wire_type == PB_BYTES && pb_bytes ( &rd, &str ) )
+      return g_strndup ( (const gchar*)str.p, str.len );
+    if ( field >= 4 && field <= 7 && wire_type == PB_VARINT && pb_varint ( &rd, &val ) ) {
+      switch ( field ) {
+      case 4:  return g_strdup_printf ( "%" G_GINT64_FORMAT, (gint64)val );
+      case 5:  return g_strdup_printf ( "%" G_GUINT64_FORMAT, val );
+      case 6:  return g_strdup_printf ( "%" G_GINT64_FORMAT, (gint64)(val >> 1) ^ -(gint64)(val & 1) );
+      default: return g_strdup ( val ? "true" : "false" );
+      }
+    }
+    if ( !pb_skip ( &rd, wire_type ) )
+      break;
+  }
+  return NULL;
+}
+
+static void mvt_layer_clear ( MvtLayer *layer )
+{
+  g_array_free ( layer->keys, TRUE );
+  for ( guint ii = 0; ii < layer->values->len; ii++ )
+    g_free ( g_array_index ( layer->values, gchar*, ii ) );
+  g_array_free ( layer->values, TRUE );
+  g_array_free ( layer->features, TRUE );
+}
+
+static gboolean mvt_feature_read ( const PbSlice *slice, MvtFeature *feature )
+{
+  PbReader rd = pb_reader ( slice );
+  guint field, wire_type;
+  memset ( feature, 0, sizeof(MvtFeature) );
+  while ( pb_next ( &rd, &field, &wire_type ) ) {
+    guint64 val;
+    if ( field == 2 && wire_type == PB_BYTES ) {
+      if ( !pb_bytes ( &rd, &feature->tags ) ) return FALSE;
+    }
+    else if ( field == 3 && wire_type == PB_VARINT ) {
+      if ( !pb_varint ( &rd, &val ) ) return FALSE;
+      feature->type = val;
+    }
+    else if ( field == 4 && wire_type == PB_BYTES ) {
+      if ( !pb_bytes ( &rd, &feature->geometry ) ) return FALSE;
+    }
+    else if ( !pb_skip ( &rd, wire_type ) )
+      return FALSE;
+  }
+  return rd.p == rd.end;
+}
+
+static gboolean mvt_layer_read ( const PbSlice *slice, MvtLayer *layer )
+{
+  PbReader rd = pb_reader ( slice );
+  guint field, wire_type;
+  layer->name.p = NULL;
+  layer->name.len = 0;
+  layer->extent = MVT_DEFAULT_EXTENT;
+  layer->keys = g_array_new ( FALSE, FALSE, sizeof(PbSlice) );
+  layer->values = g_array_new ( FALSE, FALSE, sizeof(gchar*) );
+  layer->features = g_array_new ( FALSE, FALSE, sizeof(MvtFeature) );
+  while ( pb_next ( &rd, &field, &wire_type ) ) {
+    PbSlice part;
+    guint64 val;
+    if ( wire_type == PB_BYTES && field >= 1 && field <= 4 ) {
+      if ( !pb_bytes ( &rd, &part ) )
+        return FALSE;
+      if ( field == 1 )
+        layer->name = part;
+      else if ( field == 2 ) {
+        MvtFeature feature;
+        if ( !mvt_feature_read ( &part, &feature ) )
+          return FALSE;
+        g_array_append_val ( layer->features, feature );
+      }
+      else if ( field == 3 )
+        g_array_append_val ( layer->keys, part );
+      else {
+        gchar *str = mvt_value_to_string ( &part );
+        g_array_append_val ( layer->values, str );
+      }
+    }
+    else if ( field == 5 && wire_type == PB_VARINT ) {
+      if ( !pb_varint ( &rd, &val ) )
+        return FALSE;
+      if ( val > 0 )
+        layer->extent = val;
+    }
+    else if ( !pb_skip ( &rd, wire_type ) )
+      return FALSE;
+  }
+  return rd.p == rd.end;
+}
+
+static gboolean slice_equal ( const PbSlice *slice, const gchar *str )
+{
+  return str && strlen(str) == slice->len && memcmp ( slice->p, str, slice->len ) == 0;
+}
+
+/**
+ * Whether the feature's tags satisfy the rule's key/values
+ */
+static gboolean mvt_feature_matches ( const MvtLayer *layer, const MvtFeature *feature, const StyleRule *rule )
+{
+  if ( !rule->key )
+    return TRUE;
+  PbReader rd = pb_reader ( &feature->tags );
+  guint64 key, value;
+  while ( pb_varint ( &rd, &key ) && pb_varint ( &rd, &value ) ) {
+    if ( key >= layer->keys->len || value >= layer->values->len )
+      continue;
+    if ( !slice_equal ( &g_array_index(layer->keys, PbSlice, key), rule->key ) )
+      continue;
+    if ( !rule->values )
+      return TRUE;
+    const gchar *str = g_array_index ( layer->values, gchar*, value );
+    return str && g_strv_contains ( (const gchar * const *)rule->values, str );
+  }
+  return FALSE;
+}
+
+/**
+ * Add the feature's geometry to the cairo path (or draw it for points)
+ */
+static void mvt_feature_path ( cairo_t *cr, const MvtFeature *feature, gdouble scale, gdouble radius )
+{
+  PbReader rd = pb_reader ( &feature->geometry );
+  gint32 x = 0, y = 0;
+  guint64 cmd;
+  while ( pb_varint ( &rd, &cmd ) ) {
+    guint id = cmd & 0x7;
+    guint count = cmd >> 3;
+    if ( id == MVT_CMD_CLOSE_PATH ) {
+      cairo_close_path ( cr );
+      continue;
+    }
+    if ( id != MVT_CMD_MOVE_TO && id != MVT_CMD_LINE_TO )
+      return;
+    for ( guint ii = 0; ii < count; ii++ ) {
+      guint64 dx, dy;
+      if ( !pb_varint ( &rd, &dx ) || !pb_varint ( &rd, &dy ) )
+        return;
+      x += zigzag ( dx );
+      y += zigzag ( dy );
+      if ( feature->type == MVT_GEOM_POINT ) {
+        cairo_new_sub_path ( cr );
+        cairo_arc ( cr, x * scale, y * scale, radius, 0, 2 * G_PI );
+      }
+      else if ( id == MVT_CMD_MOVE_TO )
+        cairo_move_to ( cr, x * scale, y * scale );
+      else
+        cairo_line_to ( cr, x * scale, y * scale );
+    }
+  }
+}
+
+static void mvt_layer_draw ( cairo_t *cr, const MvtLayer *layer, const StyleRule *rule, guint size )
+{
+  const gdouble scale = (gdouble)size / layer->extent;
+  const gdouble ratio = size / 256.0;
+  for ( guint ii = 0; ii < layer->features->len; ii++ ) {
+    const MvtFeature *feature = &g_array_index ( layer->features, MvtFeature, ii );
+    gboolean fill, stroke;
+    switch ( feature->type ) {
+    case MVT_GEOM_POINT:
+      fill = rule->radius > 0 && rule->fill.set;
+      stroke = rule->radius > 0 && rule->stroke.set;
+      break;
+    case MVT_GEOM_LINESTRING:
+      fill = FALSE;
+      stroke = rule->stroke.set;
+      break;
+    case MVT_GEOM_POLYGON:
+      fill = rule->fill.set;
+      stroke = rule->stroke.set;
+      break;
+    default:
+      continue;
+    }
+    if ( !( fill || stroke ) || !mvt_feature_matches ( layer, feature, rule ) )
+      continue;
+
+    cairo_new_path ( cr );
+    mvt_feature_path ( cr, feature, scale, rule->radius * ratio );
+    if ( fill ) {
+      cairo_set_source_rgba ( cr, rule->fill.r, rule->fill.g, rule->fill.b, rule->opacity );
+      if ( stroke )
+        cairo_fill_preserve ( cr );
+      else
+        cairo_fill ( cr );
+    }
+    if ( stroke ) {
+      cairo_set_source_rgba ( cr, rule->stroke.r, rule->stroke.g, rule->stroke.b, rule->opacity );
+      cairo_set_line_width ( cr, rule->width * ratio );
+      cairo_stroke ( cr );
+    }
+  }
+}
+
+/**
+ * Convert from cairo's premultiplied native endian ARGB to GdkPixbuf's RGBA
+ */
+static GdkPixbuf *surface_to_pixbuf ( cairo_surface_t *surface )
+{
+  cairo_surface_flush ( surface );
+  gint width = cairo_image_surface_get_width ( surface );
+  gint height = cairo_image_surface_get_height ( surface );
+  gint stride = cairo_image_surface_get_stride ( surface );
+  const guchar *src = cairo_image_surface_get_data ( surface );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, width, height );
+  if ( !pixbuf )
+    return NULL;
+  gint rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+  guchar *dest = gdk_pixbuf_get_pixels ( pixbuf );
+  for ( gint yy = 0; yy < height; yy++ ) {
+    const guint32 *in = (const guint32*)(src + yy * stride);
+    guchar *out = dest + yy * rowstride;
+    for ( gint xx = 0; xx < width; xx++, out += 4 ) {
+      guint32 argb = in[xx];
+      guint alpha = argb >> 24;
+      out[3] = alpha;
+      if ( alpha == 0 )
+        out[0] = out[1] = out[2] = 0;
+      else {
+        out[0] = (((argb >> 16) & 0xff) * 255 + alpha/2) / alpha;
+        out[1] = (((argb >> 8) & 0xff) * 255 + alpha/2) / alpha;
+        out[2] = ((argb & 0xff) * 255 + alpha/2) / alpha;
+      }
+    }
+  }
+  return pixbuf;
+}
+
+/**
+ * vik_vector_tile_render:
+ * @bytes: The tile data, which may be gzipped
+ * @zoom:  The TMS zoom level of the tile, for choosing the style rules
+ * @size:  The width and height in pixels to draw the tile at
+ *
+ * Returns: The drawn tile, or NULL with @error set if the data can't be read
+ */
+GdkPixbuf *vik_vector_tile_render ( const VikVectorTileStyle *style, GBytes *bytes, guint zoom, guint size, GError **error )
+{
+  gsize len = 0;
+  const guint8 *data = g_bytes_get_data ( bytes, &len );
+  void *unzipped = NULL;
+  if ( len > 2 && data[0] == 0x1f && data[1] == 0x8b ) {
+    gulong unzip_size = 0;
+    unzipped = ungzip_file ( (gchar*)data, len, &unzip_size );
+    if ( !unzipped ) {
+      g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "Vector tile can not be uncompressed" );
+      return NULL;
+    }
+    data = unzipped;
+    len = unzip_size;
+  }
+
+  // Read the layers
+  GArray *layers = g_array_new ( FALSE, FALSE, sizeof(MvtLayer) );
+  PbSlice tile = { data, len };
+  PbReader rd = pb_reader ( &tile );
+  guint field, wire_type;
+  gboolean ok = TRUE;
+  while ( ok && pb_next ( &rd, &field, &wire_type ) ) {
+    PbSlice part;
+    if ( field == 3 && wire_type == PB_BYTES ) {
+      MvtLayer layer;
+      memset ( &layer, 0, sizeof(MvtLayer) );
+      ok = pb_bytes ( &rd, &part ) && mvt_layer_read ( &part, &layer );
+      if ( layer.keys )
+        g_array_append_val ( layers, layer );
+    }
+    else
+      ok = pb_skip ( &rd, wire_type );
+  }
+  ok = ok && rd.p == rd.end;
+
+  GdkPixbuf *pixbuf = NULL;
+  if ( ok ) {
+    cairo_surface_t *surface = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, size, size );
+    cairo_t *cr = cairo_create ( surface );
+    if ( style->background.set ) {
+      cairo_set_source_rgb ( cr, style->background.r, style->background.g, style->background.b );
+      cairo_paint ( cr );
+    }
+    cairo_set_line_join ( cr, CAIRO_LINE_JOIN_ROUND );
+    cairo_set_line_cap ( cr, CAIRO_LINE_CAP_ROUND );
+    for ( guint rr = 0; rr < style->rules->len; rr++ ) {
+      const StyleRule *rule = &g_array_index ( style->rules, StyleRule, rr );
+      if ( zoom < rule->min_zoom || zoom > rule->max_zoom )
+        continue;
+      for ( guint ll = 0; ll < layers->len; ll++ ) {
+        const MvtLayer *layer = &g_array_index ( layers, MvtLayer, ll );
+        if ( slice_equal ( &layer->name, rule->layer ) )
+          mvt_layer_draw ( cr, layer, rule, size );
+      }
+    }
+    cairo_destroy ( cr );
+    pixbuf = surface_to_pixbuf ( surface );
+    cairo_surface_destroy ( surface );
+  }
+  else
+    g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "Vector tile data is not valid" );
+
+  for ( guint ll = 0; ll < layers->len; ll++ )
+    mvt_layer_clear ( &g_array_index ( layers, MvtLayer, ll ) );
+  g_array_free ( layers, TRUE );
+  g_free ( unzipped );
+  return pixbuf;
+}
+
+static gboolean style_color ( GKeyFile *kf, const gchar *group, const gchar *key, StyleColor *color )
+{
+  gchar *str = g_key_file_get_string ( kf, group, key, NULL );
+  GdkColor gcolor;
+  color->set = str && gdk_color_parse ( g_strstrip(str), &gcolor );
+  if ( color->set ) {
+    color->r = gcolor.red / 65535.0;
+    color->g = gcolor.green / 65535.0;
+    color->b = gcolor.blue / 65535.0;
+  }
+  else if ( str )
+    g_warning ( "%s: Invalid colour '%s' in [%s]", __FUNCTION__, str, group );
+  g_free ( str );
+  return color->set;
+}
+
+static gdouble style_double ( GKeyFile *kf, const gchar *group, const gchar *key, gdouble deflt )
+{
+  GError *error = NULL;
+  gdouble val = g_key_file_get_double ( kf, group, key, &error );
+  if ( error ) {
+    g_error_free ( error );
+    return deflt;
+  }
+  return val;
+}
+
+static VikVectorTileStyle *style_new_from_key_file ( GKeyFile *kf )
+{
+  VikVectorTileStyle *style = g_new0 ( VikVectorTileStyle, 1 );
+  style->rules = g_array_new ( FALSE, FALSE, sizeof(StyleRule) );
+  gchar **groups = g_key_file_get_groups ( kf, NULL );
+  for ( guint gg = 0; groups[gg]; gg++ ) {
+    const gchar *group = groups[gg];
+    if ( g_strcmp0 ( group, "background" ) == 0 ) {
+      style_color ( kf, group, "fill", &style->background );
+      continue;
+    }
+    StyleRule rule;
+    memset ( &rule, 0, sizeof(StyleRule) );
+    rule.layer = g_key_file_has_key ( kf, group, "layer", NULL ) ? g_key_file_get_string ( kf, group, "layer", NULL ) : g_strdup ( group );
+    rule.key = g_key_file_get_string ( kf, group, "key", NULL );
+    rule.values = g_key_file_get_string_list ( kf, group, "values", NULL, NULL );
+    rule.min_zoom = style_double ( kf, group, "min-zoom", 0 );
+    rule.max_zoom = style_double ( kf, group, "max-zoom", G_MAXUINT8 );
+    style_color ( kf, group, "fill", &rule.fill );
+    style_color ( kf, group, "stroke", &rule.stroke );
+    rule.width = style_double ( kf, group, "width", 1.0 );
+    rule.radius = style_double ( kf, group, "radius", 0.0 );
+    rule.opacity = CLAMP ( style_double ( kf, group, "opacity", 1.0 ), 0.0, 1.0 );
+    g_array_append_val ( style->rules, rule );
+  }
+  g_strfreev ( groups );
+  return style;
+}
+
+/**
+ * vik_vector_tile_style_new_from_file:
+ *
+ * Returns: The style read from the key file, or NULL with @error set
+ */
+VikVectorTileStyle *vik_vector_tile_style_new_from_file ( const gchar *filename, GError **error )
+{
+  GKeyFile *kf = g_key_file_new ();
+  VikVectorTileStyle *style = NULL;
+  if ( g_key_file_load_from_file ( kf, filename, G_KEY_FILE_NONE, error ) )
+    style = style_new_from_key_file ( kf );
+  g_key_file_free ( kf );
+  return style;
+}
+
+// Suits the OpenMapTiles schema, as used by a number of vector tile services
+static const gchar *default_style =
+  "[background]\nfill=#f2efe9\n"
+  "[landcover]\nfill=#d8e8c8\n"
+  "[landuse]\nfill=#e0dfdf\nopacity=0.6\n"
+  "[park]\nfill=#c8facc\n"
+  "[water]\nfill=#aad3df\n"
+  "[waterway]\nstroke=#aad3df\nwidth=1.5\n"
+  "[building]\nlayer=building\nfill=#d9d0c9\nstroke=#c4b6ab\nwidth=0.5\nmin-zoom=13\n"
+  "[minor roads]\nlayer=transportation\nkey=class\nvalues=minor;service;track;path\nstroke=#ffffff\nwidth=1\nmin-zoom=12\n"
+  "[major roads]\nlayer=transportation\nkey=class\nvalues=primary;secondary;tertiary\nstroke=#fcd6a4\nwidth=2\n"
+  "[motorways]\nlayer=transportation\nkey=class\nvalues=motorway;trunk\nstroke=#e892a2\nwidth=2.5\n"
+  "[railways]\nlayer=transportation\nkey=class\nvalues=rail\nstroke=#707070\nwidth=1\n"
+  "[boundary]\nstroke=#9e9cab\nwidth=1\nopacity=0.8\n"
+  "[places]\nlayer=place\nfill=#404040\nradius=2\n";
+
+/**
+ * vik_vector_tile_style_new_default:
+ *
+ * Returns: A simple style for when none is configured
+ */
+VikVectorTileStyle *vik_vector_tile_style_new_default ( void )
+{
+  GKeyFile *kf = g_key_file_new ();
+  VikVectorTileStyle *style = NULL;
+  if ( g_key_file_load_from_data ( kf, default_style, -1, G_KEY_FILE_NONE, NULL ) )
+    style = style_new_from_key_file ( kf );
+  g_key_file_free ( kf );
+  return style;
+}
+
+void vik_vector_tile_style_free ( VikVectorTileStyle *style )
+{
+  if ( !style )
+    return;
+  for ( guint ii = 0; ii < style->rules->len; ii++ ) {
+    StyleRule *rule = &g_array_index ( style->rules, StyleRule, ii );
+    g_free ( rule->layer );
+    g_free ( rule->key );
+    g_strfreev ( rule->values );
+  }
+  g_array_free ( style->rules, TRUE );
+  g_free ( style );
+}
@@ -35,14 +35,25 @@
 #include "sqlite3.h"
 #endif
 #include "misc/heatmap.h"
+#include "mapcache.h"
+#include "map_ids.h"
+#include "perfstats.h"
 
 #define AGGREGATE_FIXED_NAME "Aggregate"
 
+#define VIK_SETTINGS_AGGREGATE_THREADS "aggregate_threads"
+
+// Inner loops (per trackpoint or per tile) only check for cancellation every so many steps
+#define AGGREGATE_CANCEL_STEPS 4096
+// How often to check for cancellation whilst waiting for the calculating jobs (microseconds)
+#define AGGREGATE_CANCEL_WAIT 100000
+
 static void aggregate_layer_marshall( VikAggregateLayer *val, guint8 **data, guint *len );
 static VikAggregateLayer *aggregate_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static void aggregate_layer_change_coord_mode ( VikAggregateLayer *val, VikCoordMode mode );
 static void aggregate_layer_drag_drop_request ( VikAggregateLayer *val_src, VikAggregateLayer *val_dest, GtkTreeIter *src_item_iter, GtkTreePath *dest_path );
 static const gchar* aggregate_layer_tooltip ( VikAggregateLayer *val );
+static gsize aggregate_layer_get_memory_usage ( VikAggregateLayer *val );
 static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *menu, gpointer vlp );
 static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetParam *vlsp );
 static VikLayerParamData aggregate_layer_get_param ( VikAggregateLayer *val, guint16 id, gboolean is_file_operation );
@@ -272,8 +283,377 @@ VikLayerInterface vik_aggregate_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    aggregate_layer_selected_viewport_menu,
 
   (VikLayerFuncRefresh)                 NULL,
+
+  (VikLayerFuncDrawSurface)             NULL,
+
+  (VikLayerFuncGetMemoryUsage)          aggregate_layer_get_memory_usage,
 };
 
+/**
+ * Set of tiles (each with a label) for the Tracks Area Coverage,
+ *  keyed directly by the packed tile x,y in an open addressing table (linear probing)
+ *  since there can be millions of them.
+ * Each tile also has a count of how many tracks visit it (see tac_tiles_ref()),
+ *  so that the tiles of a single track can be removed again.
+ */
+typedef struct {
+  guint64 *keys;  // TAC_TILE_EMPTY for unused slots
+  guint *labels;
+  guint *counts;
+  guint mask;     // Number of slots - 1 (always a power of two)
+  guint size;     // Number of tiles
+} TacTileSet;
+
+#define TAC_TILE_EMPTY G_MAXUINT64
+#define TAC_TILES_INITIAL 1024
+
+static inline guint64 tile_key ( gint x, gint y )
+{
+  return ((guint64)(guint32)x << 32) | (guint32)y;
+}
+
+static inline void tile_key_xy ( guint64 key, gint *x, gint *y )
+{
+  *x = (gint)(guint32)(key >> 32);
+  *y = (gint)(guint32)key;
+}
+
+static inline guint tile_hash ( guint64 key )
+{
+  // Mixing from splitmix64, so neighbouring tiles spread across the table
+  key ^= key >> 33;
+  key *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+  key ^= key >> 33;
+  return (guint)key;
+}
+
+static void tac_tiles_alloc ( TacTileSet *set, guint slots )
+{
+  set->keys = g_malloc ( slots * sizeof(guint64) );
+  memset ( set->keys, 0xff, slots * sizeof(guint64) );
+  set->labels = g_malloc0 ( slots * sizeof(guint) );
+  set->counts = g_malloc0 ( slots * sizeof(guint) );
+  set->mask = slots - 1;
+  set->size = 0;
+}
+
+static TacTileSet *tac_tiles_new ( void )
+{
+  TacTileSet *set = g_malloc ( sizeof(TacTileSet) );
+  tac_tiles_alloc ( set, TAC_TILES_INITIAL );
+  return set;
+}
+
+static void tac_tiles_free ( TacTileSet *set )
+{
+  g_free ( set->keys );
+  g_free ( set->labels );
+  g_free ( set->counts );
+  g_free ( set );
+}
+
+static void tac_tiles_clear ( TacTileSet *set )
+{
+  // Also release memory from any previous large coverage
+  g_free ( set->keys );
+  g_free ( set->labels );
+  g_free ( set->counts );
+  tac_tiles_alloc ( set, TAC_TILES_INITIAL );
+}
+
+static inline guint tac_tiles_size ( const TacTileSet *set )
+{
+  return set->size;
+}
+
+/**
+ * Returns the slot holding the tile, or otherwise the empty slot where it would go
+ */
+static inline guint tac_tiles_slot ( const TacTileSet *set, guint64 key )
+{
+  guint slot = tile_hash ( key ) & set->mask;
+  while ( set->keys[slot] != key && set->keys[slot] != TAC_TILE_EMPTY )
+    slot = (slot + 1) & set->mask;
+  return slot;
+}
+
+static void tac_tiles_grow ( TacTileSet *set )
+{
+  guint64 *keys = set->keys;
+  guint *labels = set->labels;
+  guint *counts = set->counts;
+  guint slots = set->mask + 1;
+  tac_tiles_alloc ( set, slots * 2 );
+  for ( guint ii = 0; ii < slots; ii++ ) {
+    if ( keys[ii] != TAC_TILE_EMPTY ) {
+      guint slot = tac_tiles_slot ( set, keys[ii] );
+      set->keys[slot] = keys[ii];
+      set->labels[slot] = labels[ii];
+      set->counts[slot] = counts[ii];
+      set->size++;
+    }
+  }
+  g_free ( keys );
+  g_free ( labels );
+  g_free ( counts );
+}
+
+/**
+ * tac_tiles_iter_next:
+ * @pos: Start from 0
+ *
+ * Returns: FALSE once all the tiles have been visited
+ */
+static gboolean tac_tiles_iter_next ( const TacTileSet *set, guint *pos, gint *x, gint *y, guint **label )
+{
+  for ( ; *pos <= set->mask; (*pos)++ ) {
+    guint64 key = set->keys[*pos];
+    if ( key != TAC_TILE_EMPTY ) {
+      tile_key_xy ( key, x, y );
+      if ( label )
+        *label = &set->labels[*pos];
+      (*pos)++;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static gboolean is_tile_occupied ( const TacTileSet *set, gint x, gint y )
+{
+  guint64 key = tile_key ( x, y );
+  return set->keys[tac_tiles_slot(set, key)] == key;
+}
+
+static guint tile_label ( const TacTileSet *set, gint x, gint y )
+{
+  guint64 key = tile_key ( x, y );
+  guint slot = tac_tiles_slot ( set, key );
+  return set->keys[slot] == key ? set->labels[slot] : 0;
+}
+
+static void add_tile_label ( TacTileSet *set, gint x, gint y, guint id )
+{
+  // Keep at most half full, so probe sequences stay short
+  if ( (set->size + 1) * 2 > set->mask + 1 )
+    tac_tiles_grow ( set );
+  guint64 key = tile_key ( x, y );
+  guint slot = tac_tiles_slot ( set, key );
+  if ( set->keys[slot] == TAC_TILE_EMPTY ) {
+    set->keys[slot] = key;
+    set->size++;
+  }
+  set->labels[slot] = id;
+}
+
+static void add_tile ( TacTileSet *set, gint x, gint y )
+{
+  add_tile_label ( set, x, y, 0 );
+}
+
+/**
+ * tac_tiles_ref:
+ *
+ * Count another visit to the tile
+ *
+ * Returns: TRUE if the tile is new to the set (with no label)
+ */
+static gboolean tac_tiles_ref ( TacTileSet *set, guint64 key )
+{
+  if ( (set->size + 1) * 2 > set->mask + 1 )
+    tac_tiles_grow ( set );
+  guint slot = tac_tiles_slot ( set, key );
+  if ( set->keys[slot] == TAC_TILE_EMPTY ) {
+    set->keys[slot] = key;
+    set->labels[slot] = 0;
+    set->counts[slot] = 1;
+    set->size++;
+    return TRUE;
+  }
+  set->counts[slot]++;
+  return FALSE;
+}
+
+/**
+ * tac_tiles_unref:
+ *
+ * Remove a visit to the tile, taking the tile out of the set once nothing visits it
+ *
+ * Returns: TRUE if the tile has been removed
+ */
+static gboolean tac_tiles_unref ( TacTileSet *set, guint64 key )
+{
+  guint hole = tac_tiles_slot ( set, key );
+  if ( set->keys[hole] != key )
+    return FALSE;
+  if ( --set->counts[hole] )
+    return FALSE;
+
+  // Backward shift deletion - move up any following tiles that could have been placed in the hole,
+  //  so the probe sequences of the remaining tiles are unbroken
+  guint slot = hole;
+  while ( TRUE ) {
+    slot = (slot + 1) & set->mask;
+    if ( set->keys[slot] == TAC_TILE_EMPTY )
+      break;
+    guint home = tile_hash ( set->keys[slot] ) & set->mask;
+    if ( ((slot - home) & set->mask) >= ((slot - hole) & set->mask) ) {
+      set->keys[hole] = set->keys[slot];
+      set->labels[hole] = set->labels[slot];
+      set->counts[hole] = set->counts[slot];
+      hole = slot;
+    }
+  }
+  set->keys[hole] = TAC_TILE_EMPTY;
+  set->labels[hole] = 0;
+  set->counts[hole] = 0;
+  set->size--;
+  return TRUE;
+}
+
+/**
+ * Union Find for labelling groups of tiles
+ * The labels start at one, as a label of 0 means no label.
+ * Sets are joined by size, so the root of a group holds its number of tiles.
+ */
+typedef struct {
+  guint *parent;
+  guint *size;
+  guint len;   // Number of labels used (including 0)
+  guint alloc;
+} TacUnionFind;
+
+/**
+ * uf_init:
+ *   Allocate array for potential labels
+ */
+static void uf_init ( TacUnionFind *uf, guint max_labels )
+{
+  g_free ( uf->parent );
+  g_free ( uf->size );
+  uf->alloc = max_labels + 1;
+  uf->parent = g_malloc_n ( uf->alloc, sizeof(guint) );
+  uf->size = g_malloc_n ( uf->alloc, sizeof(guint) );
+  uf->parent[0] = 0;
+  uf->size[0] = 0;
+  uf->len = 1;
+}
+
+/**
+ * uf_finish: clean up
+ */
+static void uf_finish ( TacUnionFind *uf )
+{
+  g_free ( uf->parent );
+  g_free ( uf->size );
+  uf->parent = NULL;
+  uf->size = NULL;
+  uf->len = 0;
+  uf->alloc = 0;
+}
+
+/**
+ * uf_make_set:
+ *  creates a new equivalence class and returns its label
+ */
+static guint uf_make_set ( TacUnionFind *uf )
+{
+  if ( uf->len >= uf->alloc ) {
+    uf->alloc = MAX ( 1024, uf->alloc * 2 );
+    uf->parent = g_realloc_n ( uf->parent, uf->alloc, sizeof(guint) );
+    uf->size = g_realloc_n ( uf->size, uf->alloc, sizeof(guint) );
+    if ( uf->len == 0 ) {
+      uf->parent[0] = 0;
+      uf->size[0] = 0;
+      uf->len = 1;
+    }
+  }
+  guint id = uf->len++;
+  uf->parent[id] = id;
+  uf->size[id] = 1;
+  return id;
+}
+
+/**
+ * uf_find:
+ *  returns the canonical label for the equivalence class containing x
+ */
+static guint uf_find ( TacUnionFind *uf, guint x )
+{
+  guint y = x;
+  while ( uf->parent[y] != y )
+    y = uf->parent[y];
+
+  while ( uf->parent[x] != x ) {
+    guint z = uf->parent[x];
+    uf->parent[x] = y;
+    x = z;
+  }
+  return y;
+}
+
+/**
+ * uf_root:
+ *  As uf_find() but without modifying anything, for use when drawing
+ */
+static guint uf_root ( const TacUnionFind *uf, guint x )
+{
+  if ( x >= uf->len )
+    return 0;
+  while ( uf->parent[x] != x )
+    x = uf->parent[x];
+  return x;
+}
+
+/**
+ * uf_union:
+ *   joins two equivalence classes and returns the canonical label of the resulting class.
+ */
+static guint uf_union ( TacUnionFind *uf, guint x, guint y )
+{
+  x = uf_find ( uf, x );
+  y = uf_find ( uf, y );
+  if ( x == y )
+    return x;
+  if ( uf->size[x] < uf->size[y] ) {
+    guint tmp = x;
+    x = y;
+    y = tmp;
+  }
+  uf->parent[y] = x;
+  uf->size[x] += uf->size[y];
+  return x;
+}
+
+/**
+ * The tiles visited by a track, as at the given serial of the track
+ */
+typedef struct {
+  guint serial;
+  GArray *keys; // Unique tile keys
+} TacTrackTiles;
+
+static void tac_track_tiles_free ( TacTrackTiles *tt )
+{
+  g_array_free ( tt->keys, TRUE );
+  g_free ( tt );
+}
+
+typedef struct _HMContext HMContext;
+
+/**
+ * What the whole screen pixbufs were last filled for
+ */
+typedef struct {
+  gdouble zoom_level;
+  gdouble tilesize;
+  gint xmin, xmax, ymin, ymax;
+  gint base_xx, base_yy;
+  guint width, height;
+  guint changes;
+  guint unreachable;
+} TacDrawn;
+
 struct _VikAggregateLayer {
   VikLayer vl;
   GList *children;
@@ -293,6 +673,9 @@ struct _VikAggregateLayer {
   GdkPixbuf *pixbuf[CP_NUM];      // Individual tile
   GdkPixbuf *full_pixbuf[CP_NUM]; // Whole screen
   GdkPixbuf *unreachable_pixbuf; // Whole screen
+  TacDrawn tac_drawn;             // What the whole screen pixbufs hold, when tac_drawn_valid
+  gboolean tac_drawn_valid;
+  gint tac_changes;               // Counts changes to the coverage or how it is drawn
   guint num_tiles[CP_NUM]; // NB ATM Not used for lines coverage type
   guint num_prev[CP_NUM]; // Counts to determine change after a new calculation
   guint num_calcs;
@@ -315,42 +698,54 @@ struct _VikAggregateLayer {
   guint ew_size_prev;
 
   guint8 tac_time_range; // Years
-  // Maybe a sparse table would be more efficient
-  //  but this seems to work OK at least if all tracks are confined within a not too diverse area
-  GHashTable *tiles;
-  GHashTable *tiles_clust;
+  TacTileSet *tiles;
+  TacTileSet *tiles_clust;
+  TacUnionFind uf_contig; // Labels of tiles
+  TacUnionFind uf_clust;  // Labels of tiles_clust
+  gboolean valid[CP_NUM]; // Whether the derived values are up to date with the tiles
+
+  // The tiles of each track (at tac_tracks_zoom), so only changed tracks need processing
+  GHashTable *tac_tracks;
+  gdouble tac_tracks_zoom;
+  guint num_unreachable;
 
-  // Enable to determine changed tiles (mainly for those added rather than removed)
-  GHashTable *prev;
-  GHashTable *tiles_new;
+  // Tiles added by the latest calculation
+  TacTileSet *tiles_new;
 
   // Heatmap
   gboolean hm_calculating;
-  // Values as at original request
-  guint hm_scale;
-  gint hm_zoom;
-  gint hm_width;
-  gint hm_height;
-  LatLonBBox hm_bbox;
-  const VikCoord *hm_center;
-  VikCoord hm_tl;
-  // Drawing values (zoom level may have changed)
-  gint hm_scaled_zoom;
-  gint hm_zoom_max;
+  gint hm_base; // Level of the bins being calculated
+  HMContext *hm_ctx;
   guint8 hm_alpha;
-  GdkPixbuf *hm_pixbuf;
-  GdkPixbuf *hm_pbf_scaled;
-  gboolean hm_scaled;
   guint8 hm_stamp_factor;
   guint8 hm_style;
   GdkColor hm_color;
 
   MapCoord rc_menu_mc; // Position of Right Click menu
+
+  // All the tracks (not routes) of the TRW layers within, see aggregate_layer_flat_tracks()
+  GArray *flat_tracks;  // Of #vik_trw_and_track_t
+  GArray *flat_sources; // Of #FlatSource
+  guint flat_children_changes;
 };
 
+// The TRW layers the flattened tracks came from, at the point they were taken
+typedef struct {
+  VikTrwLayer *vtl;
+  guint tracks_changes;
+} FlatSource;
+
 // Single global
 GHashTable *tiles_unreachable = NULL;
 
+// Counts changes to the children of any aggregate layer,
+//  as layers deep within an aggregate can be added or removed without it knowing
+static guint aggregate_children_changes = 0;
+
+static HMContext *hm_ctx_new ( VikAggregateLayer *val );
+static void hm_ctx_unref ( HMContext *ctx );
+static gboolean hm_has_bins ( VikAggregateLayer *val );
+
 static GdkColor black_color;
 
 static void aggregate_layer_class_init ( VikAggregateLayerClass *klass )
@@ -471,12 +866,13 @@ const heatmap_colorscheme_t* hm_colorschemes[] =
     &d2, // Yellow/Orange/Red
   };
 
-// Ensure when 'apply' button heatmap regenerated to use new values
+// Ensure when 'apply' button heatmap redrawn to use new values
+//  (the drawings in the mapcache are specific to the values, so new ones get made)
 static void hm_apply ( VikAggregateLayer *val )
 {
   if ( VIK_LAYER(val)->realized )
-    if ( !val->hm_calculating && val->hm_pixbuf )
-      hm_calculate ( val );
+    if ( hm_has_bins ( val ) )
+      vik_layer_emit_update ( VIK_LAYER(val), FALSE );
 }
 
 static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
@@ -495,6 +891,8 @@ static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
 static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
 {
   gboolean changed = FALSE;
+  // Any colour, alpha or which types are on
+  g_atomic_int_inc ( &val->tac_changes );
   switch ( vlsp->id ) {
     case PARAM_DO_TAC:
       changed = vik_layer_param_change_boolean ( vlsp->data, &val->on[BASIC] );
@@ -678,6 +1076,18 @@ VikAggregateLayer *vik_aggregate_layer_create (VikViewport *vp)
   return rv;
 }
 
+/**
+ * All of the layers within
+ */
+static gsize aggregate_layer_get_memory_usage ( VikAggregateLayer *val )
+{
+  gsize size = 0;
+  GList *iter;
+  for ( iter = val->children; iter; iter = iter->next )
+    size += vik_layer_get_memory_usage ( VIK_LAYER(iter->data) );
+  return size;
+}
+
 static void aggregate_layer_marshall( VikAggregateLayer *val, guint8 **data, guint *datalen )
 {
   GList *child = val->children;
@@ -728,6 +1138,7 @@ static VikAggregateLayer *aggregate_layer_unmarshall( guint8 *data, guint len, V
     child_layer = vik_layer_unmarshall ( data + sizeof(guint), alm_size, vvp );
     if (child_layer) {
       rv->children = g_list_append ( rv->children, child_layer );
+      aggregate_children_changes++;
       g_signal_connect_swapped ( G_OBJECT(child_layer), "update", G_CALLBACK(vik_layer_emit_update_secondary), rv );
     }
     alm_next;
@@ -744,10 +1155,12 @@ VikAggregateLayer *vik_aggregate_layer_new (VikViewport *vvp)
   vik_layer_set_type ( VIK_LAYER(val), VIK_LAYER_AGGREGATE );
   vik_layer_set_defaults ( VIK_LAYER(val), vvp );
   val->children = NULL;
-  val->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_clust = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_new = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->prev = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  val->tiles = tac_tiles_new ();
+  val->tiles_clust = tac_tiles_new ();
+  val->tiles_new = tac_tiles_new ();
+  val->tac_tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)tac_track_tiles_free );
+  val->hm_ctx = hm_ctx_new ( val );
+  val->flat_sources = g_array_new ( FALSE, FALSE, sizeof(FlatSource) );
 
   return val;
 }
@@ -817,6 +1230,7 @@ void vik_aggregate_layer_insert_layer ( VikAggregateLayer *val, VikLayer *l, Vik
     // ATM this only happens when a layer is drag/dropped to the end of an aggregate layer
     val->children = g_list_prepend ( val->children, l );
   }
+  aggregate_children_changes++;
   g_signal_connect_swapped ( G_OBJECT(l), "update", G_CALLBACK(vik_layer_emit_update_secondary), val );
 }
 
@@ -885,6 +1299,7 @@ void vik_aggregate_layer_add_layer ( VikAggregateLayer *val, VikLayer *l, gboole
     else
       val->children = g_list_prepend ( val->children, l );
   }
+  aggregate_children_changes++;
 
   g_signal_connect_swapped ( G_OBJECT(l), "update", G_CALLBACK(vik_layer_emit_update_secondary), val );
 }
@@ -929,29 +1344,10 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-static gboolean is_tile_occupied ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gboolean ans = g_hash_table_contains ( ght, key );
-  g_free ( key );
-  return ans;
-}
-
-static guint tile_label ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gpointer gp = g_hash_table_lookup ( ght, key );
-  g_free ( key );
-  if ( gp )
-    return GPOINTER_TO_UINT(gp);
-  else
-    return 0;
-}
-
 /**
  * is_cluster: returns whether a tile is surrounded by occupied tiles
  */
-static gboolean is_cluster ( GHashTable *val, gint x, gint y )
+static gboolean is_cluster ( const TacTileSet *val, gint x, gint y )
 {
   //if ( !is_tile_occupied(val, x, y) ) return FALSE;
   if ( !is_tile_occupied(val, x-1, y) ) return FALSE;
@@ -968,31 +1364,122 @@ static gboolean is_cluster ( GHashTable *val, gint x, gint y )
   return TRUE;
 }
 
+/**
+ * A whole screen pixbuf, reused while the screen size stays the same.
+ * It is cleared by tac_fill_strip()
+ */
 static GdkPixbuf *setup_pixbuf ( GdkPixbuf *pixbuf, guint width, guint height )
 {
+  if ( pixbuf && gdk_pixbuf_get_width(pixbuf) == width && gdk_pixbuf_get_height(pixbuf) == height )
+    return pixbuf;
   if ( pixbuf )
     g_object_unref ( pixbuf );
-  pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, width, height );
-  gdk_pixbuf_fill ( pixbuf, 0x00000000 );
-  return pixbuf;
+  return gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, width, height );
 }
 
-static void get_pixel_limits ( guint *sizex, guint *sizey, guint *destx, guint *desty, gint xx, gint yy, guint width, guint height, gint tilesize_ceil )
+// Drawn in the whole screen unreachable_pixbuf, alongside the coverage types
+#define TAC_UNREACHABLE CP_NUM
+
+/**
+ * A tile on screen, for each of the types it is drawn in
+ */
+typedef struct {
+  gint x, y, w, h;
+  guint types; // Bit for each of common_property_types or TAC_UNREACHABLE
+} TacRect;
+
+static void tac_rect_add ( GArray *rects, gint xx, gint yy, gint tilesize_ceil, guint width, guint height, guint types )
 {
-  *sizex = ( xx + tilesize_ceil > width ) ? width - xx : tilesize_ceil;
-  *sizey = ( yy + tilesize_ceil > height ) ? height - yy : tilesize_ceil;
+  TacRect rect;
+  rect.x = MAX ( 0, xx );
+  rect.y = MAX ( 0, yy );
+  rect.w = MIN ( (gint)width, xx + tilesize_ceil ) - rect.x;
+  rect.h = MIN ( (gint)height, yy + tilesize_ceil ) - rect.y;
+  rect.types = types;
+  if ( rect.w > 0 && rect.h > 0 )
+    g_array_append_val ( rects, rect );
+}
 
-  *destx = 0;
-  if ( xx < 0 )
-    *sizex += xx;
-  else
-    *destx = xx;
+typedef struct {
+  GArray *rects;
+  guchar *pixels[CP_NUM+1]; // NULL for those not being drawn
+  gint rowstride[CP_NUM+1];
+  guint8 rgba[CP_NUM+1][4];
+  guint width;
+  guint height;
+  guint strip; // Rows in each strip
+} TacFill;
 
-  *desty = 0;
-  if ( yy < 0 )
-    *sizey += yy;
-  else
-    *desty = yy;
+/**
+ * Clear and fill one horizontal strip of the whole screen pixbufs
+ *
+ * The strips don't overlap so each can be done on a different thread
+ */
+static void tac_fill_strip ( guint nn, TacFill *tf )
+{
+  const gint y0 = nn * tf->strip;
+  const gint y1 = MIN ( (gint)tf->height, y0 + (gint)tf->strip );
+
+  for ( guint ii = 0; ii <= CP_NUM; ii++ )
+    if ( tf->pixels[ii] )
+      for ( gint yy = y0; yy < y1; yy++ )
+        memset ( tf->pixels[ii] + yy * tf->rowstride[ii], 0, tf->width * 4 );
+
+  // Note ATM each type is simply drawn on top of each other,
+  //  hence colours and alpha values will get blended into the final output
+  for ( guint rr = 0; rr < tf->rects->len; rr++ ) {
+    TacRect *rect = &g_array_index ( tf->rects, TacRect, rr );
+    const gint ry0 = MAX ( y0, rect->y );
+    const gint ry1 = MIN ( y1, rect->y + rect->h );
+    if ( ry0 >= ry1 )
+      continue;
+    for ( guint ii = 0; ii <= CP_NUM; ii++ ) {
+      if ( !(rect->types & (1 << ii)) || !tf->pixels[ii] )
+        continue;
+      for ( gint yy = ry0; yy < ry1; yy++ ) {
+        guchar *px = tf->pixels[ii] + yy * tf->rowstride[ii] + rect->x * 4;
+        for ( gint xx = 0; xx < rect->w; xx++, px += 4 )
+          memcpy ( px, tf->rgba[ii], 4 );
+      }
+    }
+  }
+}
+
+static void tac_fill_set ( TacFill *tf, guint ii, GdkPixbuf *pixbuf, const GdkColor *color, guint8 alpha )
+{
+  tf->pixels[ii] = gdk_pixbuf_get_pixels ( pixbuf );
+  tf->rowstride[ii] = gdk_pixbuf_get_rowstride ( pixbuf );
+  // As ui_pixbuf_new() and ui_pixbuf_set_alpha()
+  tf->rgba[ii][0] = color->red >> 8;
+  tf->rgba[ii][1] = color->green >> 8;
+  tf->rgba[ii][2] = color->blue >> 8;
+  tf->rgba[ii][3] = alpha;
+}
+
+/**
+ * Fill the whole screen pixbufs with the tiles, in strips on the CPU workers
+ */
+static void tac_fill ( VikAggregateLayer *val, GArray *rects, guint width, guint height )
+{
+  TacFill tf;
+  memset ( &tf, 0, sizeof(tf) );
+  tf.rects = rects;
+  tf.width = width;
+  tf.height = height;
+
+  for ( guint ii = 0; ii < CP_NUM; ii++ )
+    if ( val->on[ii] )
+      tac_fill_set ( &tf, ii, val->full_pixbuf[ii], &val->color[ii], val->alpha[ii] );
+  if ( tiles_unreachable ) {
+    // Always red - not bothered to allow config of this ATM
+    GdkColor gdc;
+    gdk_color_parse ( "red", &gdc );
+    tac_fill_set ( &tf, TAC_UNREACHABLE, val->unreachable_pixbuf, &gdc, val->alpha[BASIC] );
+  }
+
+  const guint strips = MAX ( 1, MIN ( height, 4 * a_background_get_cpu_workers() ) );
+  tf.strip = (height + strips - 1) / strips;
+  a_background_parallel ( (vik_thr_index_func)tac_fill_strip, &tf, (height + tf.strip - 1) / tf.strip );
 }
 
 /**
@@ -1051,23 +1538,36 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
     if ( tilesize > width && tilesize > height ) {
       is_big = TRUE;
     }
-    else {
-      // Scale up pixbuf size if needed
-      for ( guint ii=0; ii<CP_NUM; ii++ )
-        val->pixbuf[ii] = layer_pixbuf_update ( val->pixbuf[ii], val->color[ii], tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[ii] );
-    }
 
-    // Create pixbufs the size of the screen
-    for ( guint ii=0; ii<CP_NUM; ii++ ) {
-      if ( val->on[ii] ) {
-        val->full_pixbuf[ii] = setup_pixbuf ( val->full_pixbuf[ii], width, height );
+    // Redrawing the same view (e.g. for another layer changing) only needs the previous pixbufs putting on the screen
+    TacDrawn drawn;
+    memset ( &drawn, 0, sizeof(drawn) );
+    drawn.zoom_level = zoom;
+    drawn.tilesize = tilesize;
+    drawn.xmin = xmin; drawn.xmax = xmax;
+    drawn.ymin = ymin; drawn.ymax = ymax;
+    drawn.base_xx = base_xx; drawn.base_yy = base_yy;
+    drawn.width = width; drawn.height = height;
+    drawn.changes = (guint)g_atomic_int_get ( &val->tac_changes );
+    drawn.unreachable = tiles_unreachable ? g_hash_table_size ( tiles_unreachable ) : 0;
+    gboolean reuse = !is_big && !val->calculating && val->tac_drawn_valid &&
+                     memcmp ( &drawn, &val->tac_drawn, sizeof(drawn) ) == 0;
+
+    GArray *rects = NULL;
+    if ( !is_big && !reuse ) {
+      // Create pixbufs the size of the screen
+      for ( guint ii=0; ii<CP_NUM; ii++ ) {
+        if ( val->on[ii] ) {
+          val->full_pixbuf[ii] = setup_pixbuf ( val->full_pixbuf[ii], width, height );
+        }
       }
+      if ( tiles_unreachable )
+        val->unreachable_pixbuf = setup_pixbuf ( val->unreachable_pixbuf, width, height );
+      rects = g_array_new ( FALSE, FALSE, sizeof(TacRect) );
     }
-    if ( tiles_unreachable )
-      val->unreachable_pixbuf = setup_pixbuf ( val->unreachable_pixbuf, width, height );
 
     guint tile_draw_count = 0;
-    for ( x = ((xinc == 1) ? xmin : xmax); x != xend; x+=xinc ) {
+    for ( x = ((xinc == 1) ? xmin : xmax); x != xend && !reuse; x+=xinc ) {
       yy = base_yy;
       for ( y = ((yinc == 1) ? ymin : ymax); y != yend; y+=yinc ) {
         ulm.x = x;
@@ -1076,48 +1576,43 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
         if ( is_tile_occupied(val->tiles, x, y) ) {
           //g_printf ( "%s1: %d, %d, %d, %d, %d, %d %0.2f\n", __FUNCTION__, xx, yy, tilesize_ceil, tilesize_ceil, width, height, shrinkfactor );
           if ( !is_big ) {
+            // Decide which types the tile is drawn in here, as the labelling isn't thread safe
+            guint types = 1 << BASIC;
 
-            // Limit size request of pixbufs at the edge, as to not request a size overflowing the destination pixbuf
-            // otherwise gdk_pixbuf_copy_area() will complain
-            guint sizex, sizey, destx, desty;
-            get_pixel_limits ( &sizex, &sizey, &destx, &desty, xx, yy, width, height, tilesize_ceil );
-
-            // Note ATM each type is simply drawn on top of each other,
-            //  hence colours and alpha values will get blended into the final output
-
-            gdk_pixbuf_copy_area ( val->pixbuf[BASIC], 0, 0, sizex, sizey, val->full_pixbuf[BASIC], destx, desty );
-
-            if ( val->cont_label && (tile_label(val->tiles, x, y) == val->cont_label) )
-              gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
+            if ( val->on[CONTIG] )
+              if ( val->cont_label && (uf_root(&val->uf_contig, tile_label(val->tiles, x, y)) == val->cont_label) )
+                types |= 1 << CONTIG;
 
             // Cluster drawing
             if ( val->on[CLUSTER] )
-              if ( val->clust_label && (tile_label(val->tiles_clust, x, y) == val->clust_label) )
-                gdk_pixbuf_copy_area ( val->pixbuf[CLUSTER], 0, 0, sizex, sizey, val->full_pixbuf[CLUSTER], destx, desty );
+              if ( val->clust_label && (uf_root(&val->uf_clust, tile_label(val->tiles_clust, x, y)) == val->clust_label) )
+                types |= 1 << CLUSTER;
 
             // Max Square drawing
             if ( val->on[MAX_SQR] )
               if ( ( x >= val->xx && x < (val->xx + val->max_square) )
                      && ( y >= val->yy && y < (val->yy + val->max_square) ) ) {
-                gdk_pixbuf_copy_area ( val->pixbuf[MAX_SQR], 0, 0, sizex, sizey, val->full_pixbuf[MAX_SQR], destx, desty );
+                types |= 1 << MAX_SQR;
               }
 
             // Line of tiles drawing
             if ( val->on[LINES] && val->ns_size && val->ew_size ) {
               if ( x == val->ns_x ) {
                 if ( y <= val->ns_y && y >= val->ns_y-val->ns_size )
-                  gdk_pixbuf_copy_area ( val->pixbuf[LINES], 0, 0, sizex, sizey, val->full_pixbuf[LINES], destx, desty );
+                  types |= 1 << LINES;
               }
               if ( y == val->ew_y ) {
                 if ( x <= val->ew_x && x >= val->ew_x-val->ew_size )
-                  gdk_pixbuf_copy_area ( val->pixbuf[LINES], 0, 0, sizex, sizey, val->full_pixbuf[LINES], destx, desty );
+                  types |= 1 << LINES;
               }
             }
 
             if ( val->on[TNEW] )
               if ( is_tile_occupied(val->tiles_new, x, y) ) {
-                gdk_pixbuf_copy_area ( val->pixbuf[TNEW], 0, 0, sizex, sizey, val->full_pixbuf[TNEW], destx, desty );
+                types |= 1 << TNEW;
               }
+
+            tac_rect_add ( rects, xx, yy, tilesize_ceil, width, height, types );
           } else {
             gint x2 = xx;
             gint y2 = yy;
@@ -1147,22 +1642,15 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
     }
 
     // Draw any unreachable tiles if they are in the display area
-    if ( tiles_unreachable && !is_big ) {
+    if ( tiles_unreachable && rects ) {
 
       GHashTableIter iter;
       gpointer key, value;
       gint uz, ux, uy;
       const guint zl = (guint)map_utils_mpp_to_zoom_level ( zoom );
 
-      // Always red - not bothered to allow config of this ATM
-      GdkColor gdc;
-      gdk_color_parse ( "red", &gdc );
-      GdkPixbuf *pixbuf = NULL;
-      pixbuf = layer_pixbuf_update ( pixbuf, gdc, tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[BASIC] );
-
       MapCoord mc;
       mc.scale = ulm.scale; // Current display zoom level
-      guint sizex, sizey, destx, desty;
 
       g_hash_table_iter_init ( &iter, tiles_unreachable );
       while ( g_hash_table_iter_next(&iter, &key, &value) ) {
@@ -1172,18 +1660,23 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
           mc.y = uy;
           map_utils_iTMS_to_vikcoord ( &mc, &coord );
           vik_viewport_coord_to_screen ( vvp, &coord, &xx_tmp, &yy_tmp );
-          get_pixel_limits ( &sizex, &sizey, &destx, &desty, xx_tmp, yy_tmp, width, height, tilesize_ceil );
-          gdk_pixbuf_copy_area ( pixbuf, 0, 0, sizex, sizey, val->unreachable_pixbuf, destx, desty );
+          tac_rect_add ( rects, xx_tmp, yy_tmp, tilesize_ceil, width, height, 1 << TAC_UNREACHABLE );
         }
       }
-      g_object_unref ( pixbuf );
+    }
+
+    if ( rects ) {
+      tac_fill ( val, rects, width, height );
+      g_array_free ( rects, TRUE );
+      memcpy ( &val->tac_drawn, &drawn, sizeof(drawn) );
+      val->tac_drawn_valid = TRUE;
     }
 
     if ( !is_big ) {
       for ( guint ii=0; ii<CP_NUM; ii++ )
         if ( val->on[ii] && val->full_pixbuf[ii] )
           vik_viewport_draw_pixbuf ( vvp, val->full_pixbuf[ii], 0, 0, 0, 0, width, height );
-      if ( tiles_unreachable )
+      if ( tiles_unreachable && val->unreachable_pixbuf )
         vik_viewport_draw_pixbuf ( vvp, val->unreachable_pixbuf, 0, 0, 0, 0, width, height );
     }
 
@@ -1230,90 +1723,953 @@ static void tac_draw ( VikAggregateLayer *val, VikViewport *vp )
   tac_draw_section ( val, vp, &ul, &br );
 }
 
+/*
+ * The heatmap is drawn as tiles (in the mapcache) at the standard zoom levels,
+ *  from counts of the points in each pixel (bins) rather than from the tracks.
+ * The bins are made once by a calculation at a detailed level,
+ *  and the bins for less detailed levels are made from them as needed.
+ * Thus panning only needs new tiles drawing from the bins,
+ *  and zooming out only needs the bins merging rather than reading all the trackpoints again.
+ */
+
+#define HM_TILE_SIZE 256
+// Levels as per map_utils_mpp_to_scale()
+#define HM_LEVEL_MIN -5
+#define HM_LEVEL_MAX 17
+#define HM_NUM_LEVELS (HM_LEVEL_MAX - HM_LEVEL_MIN + 1)
+// Bin at levels more detailed than the view when calculated, so zooming in a little still shows the detail
+#define HM_BIN_FINER_LEVELS 2
+// Merge the bins being collected when there get to be this many
+#define HM_BINS_COMPACT (4*1024*1024)
+
 /**
- * c.f. vik_viewport_coord_to_screen() but for a separately configurable zoom level & Mercator only
+ * Number of points in a pixel
+ * The key packs the tile and the pixel within it (see hm_bin_key()),
+ *  so sorting by the key puts the bins of each tile together
  */
-static void coord_to_screen ( gint width, gint height, gdouble mf, struct LatLon *center, VikCoord *coord, gint *xx, gint *yy )
-{
-  struct LatLon *ll = (struct LatLon *)coord;
-  *xx = (int)(width/2 + ( mf * (ll->lon - center->lon) ));
-  *yy = (int)(height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-}
+typedef struct {
+  guint64 key;
+  guint32 count;
+} HMBin;
+
+typedef struct {
+  HMBin *bins; // Sorted by key
+  guint num;
+} HMBinLevel;
+
+typedef struct {
+  gint ref_count;
+  GMutex *mutex;                     // For making levels
+  gint base;                         // The most detailed level
+  HMBinLevel *levels[HM_NUM_LEVELS]; // Made on demand, apart from the base
+} HMBins;
 
 /**
- *
+ * Number of points in a pixel within a month
  */
-static void hm_clear ( VikAggregateLayer *val )
-{
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
-  val->hm_pixbuf = NULL;
-  val->hm_pbf_scaled = NULL;
-}
+typedef struct {
+  guint64 key;  // As HMBin
+  guint32 count;
+  gint32 month; // Counted from year 0, see hm_month()
+} HMCubeBin;
 
 /**
- * Draw heatmap
+ * The points of all the tracks counted per month as well as per pixel,
+ *  so the bins for any period can be made by adding up the whole months in it
+ *  rather than going through all the trackpoints again
  */
-static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
-{
-  LatLonBBox bbox = vik_viewport_get_bbox ( vp );
+typedef struct {
+  gint ref_count;
+  gint base;       // The level of the bins
+  HMCubeBin *bins; // Sorted by month and then key
+  guint num;
+} HMCube;
 
-  if ( BBOX_INTERSECT ( bbox, val->hm_bbox ) ) {
+/**
+ * The period the heatmap is for, split into the whole months that come from the #HMCube
+ *  and the remainder either side which is counted from the trackpoints
+ */
+typedef struct {
+  gboolean filter;      // Otherwise all the months
+  gdouble start, end;
+  gint full_first;      // The whole months (none when after full_last)
+  gint full_last;
+  gdouble full_start;   // The start of full_first
+  gdouble full_end;     // The end of full_last
+} HMPeriod;
 
-    clock_t begin, end;
+/**
+ * Shared between a layer and its queued background drawing,
+ *  so they can still store results and tell the layer to redraw - if it still exists.
+ */
+struct _HMContext {
+  GMutex *mutex;
+  gint ref_count;
+  VikAggregateLayer *val;  // NULL once the layer has gone
+  gboolean update_pending; // Redraw request outstanding
+  guint generation;        // Changed with each calculation, so older drawings are not reused
+  HMBins *bins;            // NULL until calculated
+  HMCube *cube;            // Counts per month the bins were made from, kept for other periods
+  guint8 saturation_factor;
+  gfloat saturation[HM_NUM_LEVELS]; // Heat drawn in the hottest colour for each level, once known
+  GHashTable *requests;    // Tiles waiting to be drawn
+};
 
-    gint zz = (gint)vik_viewport_get_zoom ( vp );
-    // Avoid excessive image scaling as it will be too slow
-    //  (and memory intensive) so simply avoid trying.
-    if ( zz < val->hm_zoom_max ) {
-      return;
-    }
+typedef struct {
+  HMContext *ctx;
+  HMBins *bins;
+  guint generation;
+  gint level;
+  guint8 factor;
+  guint8 style;
+  guint8 alpha;
+  gchar *signature;
+  GArray *tiles;    // Tile keys (as tile_key())
+  GPtrArray *requests;
+} HMRenderJob;
+
+// Unique across all layers, so one layer's drawings in the mapcache are never taken for another's
+static gint hm_render_serial = 0;
+
+// Pixels across the whole world at the level
+static inline gdouble hm_level_pixels ( gint level )
+{
+  return ldexp ( 1.0, 25 - level );
+}
 
-    if ( val->hm_width != vik_viewport_get_width(vp) ||
-         val->hm_height != vik_viewport_get_height(vp) ) {
-      hm_clear ( val );
-      return;
-    }
+static inline guint64 hm_bin_key ( guint px, guint py )
+{
+  return ((guint64)(px / HM_TILE_SIZE) << 38) | ((guint64)(py / HM_TILE_SIZE) << 16) |
+    ((py % HM_TILE_SIZE) << 8) | (px % HM_TILE_SIZE);
+}
 
-    // Calculate width & height (even if no scaling as not excessive computation)
-    gint ww = round (val->hm_width * (gdouble)val->hm_zoom/(gdouble)zz );
-    gint hh = round (val->hm_height * (gdouble)val->hm_zoom/(gdouble)zz );
-    // Scale only once as necessary when zoom level has changed
-    if ( val->hm_scaled_zoom != zz ) {
-      val->hm_scaled_zoom = zz;
-      // Different zoom level so generate new image from the original image
-      if ( val->hm_scaled_zoom != val->hm_zoom ) {
-        if ( val->hm_pbf_scaled )
-          g_object_unref ( val->hm_pbf_scaled );
-
-        val->hm_scaled = TRUE;
-        GdkInterpType interp_type = GDK_INTERP_BILINEAR;
-        // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
-        //  especially since this is being performed in the main thread
-        if ( val->hm_scaled_zoom < val->hm_zoom )
-          interp_type = GDK_INTERP_NEAREST;
-        begin = clock();
-        val->hm_pbf_scaled = gdk_pixbuf_scale_simple ( val->hm_pixbuf, ww, hh, interp_type );
-        end = clock();
-        double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-        // Last usable zoom-level as the next one is going to be an order of magnitude worse or more
-        if ( interp_type == GDK_INTERP_NEAREST && time_spent > 0.05 )
-          val->hm_zoom_max = zz;
-        g_debug ( "%s: time %f scaling to %d, %d", __FUNCTION__, time_spent, ww, hh );
-      } else {
-        // Use original image
-        val->hm_scaled = FALSE;
-      }
-    }
-    gint xx, yy;
-    gdouble mf = mercator_factor ( val->hm_scaled_zoom, val->hm_scale );
-    coord_to_screen ( val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &val->hm_tl, &xx, &yy);
-    vik_viewport_draw_pixbuf ( vp, val->hm_scaled ? val->hm_pbf_scaled : val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
+static inline void hm_bin_pixel ( guint64 key, guint *px, guint *py )
+{
+  *px = (guint)(key >> 38) * HM_TILE_SIZE + (guint)(key & 0xff);
+  *py = (guint)((key >> 16) & 0x3fffff) * HM_TILE_SIZE + (guint)((key >> 8) & 0xff);
+}
+
+static gint hm_bin_compare ( gconstpointer a, gconstpointer b )
+{
+  guint64 ka = ((const HMBin*)a)->key;
+  guint64 kb = ((const HMBin*)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+/**
+ * Sort the bins, adding together any for the same pixel
+ */
+static void hm_bins_compact ( GArray *bins )
+{
+  g_array_sort ( bins, hm_bin_compare );
+  guint nn = 0;
+  for ( guint ii = 0; ii < bins->len; ii++ ) {
+    HMBin bin = g_array_index ( bins, HMBin, ii );
+    if ( nn && g_array_index(bins, HMBin, nn-1).key == bin.key )
+      g_array_index(bins, HMBin, nn-1).count += bin.count;
+    else
+      g_array_index(bins, HMBin, nn++) = bin;
+  }
+  g_array_set_size ( bins, nn );
+}
+
+/**
+ * Takes ownership of the compacted array of bins
+ */
+static HMBinLevel *hm_level_new ( GArray *bins )
+{
+  HMBinLevel *hl = g_malloc ( sizeof(HMBinLevel) );
+  hl->num = bins->len;
+  hl->bins = (HMBin*)(void*)g_array_free ( bins, FALSE );
+  return hl;
+}
+
+static void hm_level_free ( HMBinLevel *hl )
+{
+  g_free ( hl->bins );
+  g_free ( hl );
+}
+
+/**
+ * Make the bins of the next less detailed level
+ */
+static HMBinLevel *hm_level_derive ( const HMBinLevel *finer )
+{
+  GArray *bins = g_array_sized_new ( FALSE, FALSE, sizeof(HMBin), finer->num );
+  for ( guint ii = 0; ii < finer->num; ii++ ) {
+    guint px, py;
+    hm_bin_pixel ( finer->bins[ii].key, &px, &py );
+    HMBin bin = { hm_bin_key(px/2, py/2), finer->bins[ii].count };
+    g_array_append_val ( bins, bin );
+  }
+  hm_bins_compact ( bins );
+  return hm_level_new ( bins );
+}
+
+/**
+ * Returns: The index of the first bin with a key not less than @key
+ */
+static guint hm_level_find ( const HMBinLevel *hl, guint64 key )
+{
+  guint lo = 0;
+  guint hi = hl->num;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( hl->bins[mid].key < key )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Takes ownership of the compacted array of bins for the base level
+ */
+static HMBins *hm_bins_new ( gint base, GArray *bins )
+{
+  HMBins *hb = g_malloc0 ( sizeof(HMBins) );
+  hb->ref_count = 1;
+  hb->mutex = vik_mutex_new ();
+  hb->base = base;
+  hb->levels[base - HM_LEVEL_MIN] = hm_level_new ( bins );
+  return hb;
+}
+
+static HMBins *hm_bins_ref ( HMBins *hb )
+{
+  g_atomic_int_inc ( &hb->ref_count );
+  return hb;
+}
+
+static void hm_bins_unref ( HMBins *hb )
+{
+  if ( hb && g_atomic_int_dec_and_test ( &hb->ref_count ) ) {
+    for ( guint ii = 0; ii < HM_NUM_LEVELS; ii++ )
+      if ( hb->levels[ii] )
+        hm_level_free ( hb->levels[ii] );
+    vik_mutex_free ( hb->mutex );
+    g_free ( hb );
+  }
+}
+
+/**
+ * Returns: The bins for the level, making them if necessary
+ *  (any more detailed levels than the base use the base)
+ */
+static const HMBinLevel *hm_bins_level ( HMBins *hb, gint level )
+{
+  level = MAX ( level, hb->base );
+  g_mutex_lock ( hb->mutex );
+  gint ll = level;
+  while ( !hb->levels[ll - HM_LEVEL_MIN] )
+    ll--;
+  for ( ; ll < level; ll++ )
+    hb->levels[ll + 1 - HM_LEVEL_MIN] = hm_level_derive ( hb->levels[ll - HM_LEVEL_MIN] );
+  const HMBinLevel *hl = hb->levels[level - HM_LEVEL_MIN];
+  g_mutex_unlock ( hb->mutex );
+  return hl;
+}
+
+/**
+ * Returns: Whether the time is in the range handled, and if so its month
+ *  with the (UTC) times of the start of it and of the next month
+ */
+static gboolean hm_month ( gdouble timestamp, gint *month, gdouble *start, gdouble *end )
+{
+  GDateTime *dt = g_date_time_new_from_unix_utc ( (gint64)floor(timestamp) );
+  if ( !dt )
+    return FALSE;
+  gint year = g_date_time_get_year ( dt );
+  gint mon = g_date_time_get_month ( dt );
+  g_date_time_unref ( dt );
+  GDateTime *first = g_date_time_new_utc ( year, mon, 1, 0, 0, 0 );
+  GDateTime *next = g_date_time_add_months ( first, 1 );
+  *month = year * 12 + mon - 1;
+  *start = (gdouble)g_date_time_to_unix ( first );
+  // There is no month after December 9999
+  *end = next ? (gdouble)g_date_time_to_unix ( next ) : INFINITY;
+  g_date_time_unref ( first );
+  if ( next )
+    g_date_time_unref ( next );
+  return TRUE;
+}
+
+static void hm_period_init ( HMPeriod *hp, gboolean filter, gdouble start, gdouble end )
+{
+  hp->filter = filter;
+  hp->start = start;
+  hp->end = end;
+  hp->full_first = G_MININT;
+  hp->full_last = G_MAXINT;
+  hp->full_start = -INFINITY;
+  hp->full_end = INFINITY;
+  if ( !filter )
+    return;
+  gint first, last;
+  gdouble first_start, first_end, last_start, last_end;
+  if ( hm_month(start, &first, &first_start, &first_end) && hm_month(end, &last, &last_start, &last_end) ) {
+    hp->full_first = (start == first_start) ? first : first + 1;
+    hp->full_start = (start == first_start) ? first_start : first_end;
+    hp->full_last = last - 1;
+    hp->full_end = last_start;
+  }
+  else {
+    hp->full_first = 1;
+    hp->full_last = 0;
+  }
+  if ( hp->full_first > hp->full_last ) {
+    // No whole months, so all of it is counted from the trackpoints
+    hp->full_first = 1;
+    hp->full_last = 0;
+    hp->full_start = hp->full_end = 0.0;
+  }
+}
+
+/**
+ * Returns: Whether a point at the time needs counting from the trackpoints,
+ *  being within the period but not one of its whole months
+ */
+static inline gboolean hm_period_remainder ( const HMPeriod *hp, gdouble timestamp )
+{
+  return hp->filter && timestamp >= hp->start && timestamp <= hp->end &&
+    !(timestamp >= hp->full_start && timestamp < hp->full_end);
+}
+
+static gint hm_cube_bin_compare ( gconstpointer a, gconstpointer b )
+{
+  const HMCubeBin *ba = a;
+  const HMCubeBin *bb = b;
+  if ( ba->month != bb->month )
+    return (ba->month > bb->month) - (ba->month < bb->month);
+  return (ba->key > bb->key) - (ba->key < bb->key);
+}
+
+/**
+ * Sort the bins, adding together any for the same pixel and month
+ */
+static void hm_cube_bins_compact ( GArray *bins )
+{
+  g_array_sort ( bins, hm_cube_bin_compare );
+  guint nn = 0;
+  for ( guint ii = 0; ii < bins->len; ii++ ) {
+    HMCubeBin bin = g_array_index ( bins, HMCubeBin, ii );
+    HMCubeBin *prev = nn ? &g_array_index(bins, HMCubeBin, nn-1) : NULL;
+    if ( prev && prev->key == bin.key && prev->month == bin.month )
+      prev->count += bin.count;
+    else
+      g_array_index(bins, HMCubeBin, nn++) = bin;
+  }
+  g_array_set_size ( bins, nn );
+}
+
+/**
+ * Takes ownership of the compacted array of bins
+ */
+static HMCube *hm_cube_new ( gint base, GArray *bins )
+{
+  HMCube *cube = g_malloc ( sizeof(HMCube) );
+  cube->ref_count = 1;
+  cube->base = base;
+  cube->num = bins->len;
+  cube->bins = (HMCubeBin*)(void*)g_array_free ( bins, FALSE );
+  return cube;
+}
+
+static HMCube *hm_cube_ref ( HMCube *cube )
+{
+  g_atomic_int_inc ( &cube->ref_count );
+  return cube;
+}
+
+static void hm_cube_unref ( HMCube *cube )
+{
+  if ( cube && g_atomic_int_dec_and_test ( &cube->ref_count ) ) {
+    g_free ( cube->bins );
+    g_free ( cube );
+  }
+}
+
+/**
+ * Returns: The index of the first bin of the month or any later one
+ */
+static guint hm_cube_find ( const HMCube *cube, gint month )
+{
+  guint lo = 0;
+  guint hi = cube->num;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( cube->bins[mid].month < month )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Add the counts of the months from @first to @last to the (uncompacted) bins
+ */
+static void hm_cube_add ( const HMCube *cube, gint first, gint last, GArray *bins )
+{
+  if ( first > last )
+    return;
+  guint lo = hm_cube_find ( cube, first );
+  guint hi = (last == G_MAXINT) ? cube->num : hm_cube_find ( cube, last + 1 );
+  g_array_set_size ( bins, bins->len + (hi - lo) );
+  HMBin *out = &g_array_index ( bins, HMBin, bins->len - (hi - lo) );
+  for ( guint ii = lo; ii < hi; ii++, out++ ) {
+    out->key = cube->bins[ii].key;
+    out->count = cube->bins[ii].count;
+  }
+}
+
+static HMContext *hm_ctx_new ( VikAggregateLayer *val )
+{
+  HMContext *ctx = g_malloc0 ( sizeof(HMContext) );
+  ctx->mutex = vik_mutex_new ();
+  ctx->ref_count = 1;
+  ctx->val = val;
+  ctx->generation = g_atomic_int_add ( &hm_render_serial, 1 );
+  ctx->requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  return ctx;
+}
+
+static HMContext *hm_ctx_ref ( HMContext *ctx )
+{
+  g_atomic_int_inc ( &ctx->ref_count );
+  return ctx;
+}
+
+static void hm_ctx_unref ( HMContext *ctx )
+{
+  if ( g_atomic_int_dec_and_test ( &ctx->ref_count ) ) {
+    hm_bins_unref ( ctx->bins );
+    hm_cube_unref ( ctx->cube );
+    g_hash_table_destroy ( ctx->requests );
+    vik_mutex_free ( ctx->mutex );
+    g_free ( ctx );
+  }
+}
+
+/**
+ * Use new bins (or none), forgetting anything drawn from the previous ones
+ * Can be called from any thread
+ */
+static void hm_ctx_set_bins ( HMContext *ctx, HMBins *hb )
+{
+  g_mutex_lock ( ctx->mutex );
+  HMBins *old = ctx->bins;
+  ctx->bins = hb;
+  ctx->generation = g_atomic_int_add ( &hm_render_serial, 1 );
+  for ( guint ii = 0; ii < HM_NUM_LEVELS; ii++ )
+    ctx->saturation[ii] = 0.0;
+  g_mutex_unlock ( ctx->mutex );
+  hm_bins_unref ( old );
+}
+
+/**
+ * Keep the counts per month (or forget them), for making the bins of other periods
+ * Can be called from any thread
+ */
+static void hm_ctx_set_cube ( HMContext *ctx, HMCube *cube )
+{
+  g_mutex_lock ( ctx->mutex );
+  HMCube *old = ctx->cube;
+  ctx->cube = cube;
+  g_mutex_unlock ( ctx->mutex );
+  hm_cube_unref ( old );
+}
+
+/**
+ * Returns: A reference to the counts per month if they are at the level, otherwise NULL
+ */
+static HMCube *hm_ctx_get_cube ( HMContext *ctx, gint base )
+{
+  g_mutex_lock ( ctx->mutex );
+  HMCube *cube = ( ctx->cube && ctx->cube->base == base ) ? hm_cube_ref ( ctx->cube ) : NULL;
+  g_mutex_unlock ( ctx->mutex );
+  return cube;
+}
+
+static gboolean hm_has_bins ( VikAggregateLayer *val )
+{
+  g_mutex_lock ( val->hm_ctx->mutex );
+  gboolean ans = (val->hm_ctx->bins != NULL);
+  g_mutex_unlock ( val->hm_ctx->mutex );
+  return ans;
+}
+
+/**
+ *
+ */
+static void hm_clear ( VikAggregateLayer *val )
+{
+  hm_ctx_set_bins ( val->hm_ctx, NULL );
+  hm_ctx_set_cube ( val->hm_ctx, NULL );
+}
+
+/**
+ * Identifies the drawing values for the mapcache, so any change gives new drawings
+ *  (the alpha is separately part of the mapcache key)
+ */
+static gchar *hm_render_signature ( guint generation, guint8 style, guint8 factor )
+{
+  return g_strdup_printf ( "HM-%u-%u-%u", generation, style, factor );
+}
+
+/**
+ * Stamp size in pixels, which is relative to the zoom level
+ */
+static guint hm_radius ( gint level, guint8 factor )
+{
+  return (guint)(MAX(0, 17 - level) * (gdouble)factor/(gdouble)width_default().u);
+}
+
+static void rhomboidal (float *values, unsigned d, unsigned r)
+{
+  for (guint y = 0 ; y < d ; ++y) {
+    for (guint x = 0 ; x < d ; ++x) {
+      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
+    }
   }
 }
 
+/**
+ * Work out the heat of a tile from the bins, including the spread from any points just outside it
+ *
+ * Returns: NULL if there is no heat in the tile
+ */
+static heatmap_t *hm_tile_heat ( HMBins *hb, gint level, gint tx, gint ty, guint radius, const heatmap_stamp_t *stamp )
+{
+  const HMBinLevel *hl = hm_bins_level ( hb, level );
+  // More detailed levels than the base use the centre of each base pixel
+  const guint shift = level < hb->base ? hb->base - level : 0;
+  const gint64 half = shift ? (1 << (shift-1)) : 0;
+  const gint64 size = HM_TILE_SIZE + 2*radius;
+  // Level pixel at the top left of the heat (including the spread around the tile)
+  const gint64 ox = (gint64)tx * HM_TILE_SIZE - radius;
+  const gint64 oy = (gint64)ty * HM_TILE_SIZE - radius;
+  const gint64 src_max = (gint64)(hm_level_pixels(level + shift) / HM_TILE_SIZE) - 1;
+
+  // Tiles of the bins covering the area
+  const gint64 stx0 = (MAX(0, ox) >> shift) / HM_TILE_SIZE;
+  const gint64 sty0 = (MAX(0, oy) >> shift) / HM_TILE_SIZE;
+  const gint64 stx1 = MIN ( src_max, ((ox + size - 1) >> shift) / HM_TILE_SIZE );
+  const gint64 sty1 = MIN ( src_max, ((oy + size - 1) >> shift) / HM_TILE_SIZE );
+
+  heatmap_t *full = NULL;
+  for ( gint64 sty = sty0; sty <= sty1; sty++ ) {
+    for ( gint64 stx = stx0; stx <= stx1; stx++ ) {
+      const guint64 tile = ((guint64)stx << 22) | (guint64)sty;
+      for ( guint ii = hm_level_find ( hl, tile << 16 ); ii < hl->num && (hl->bins[ii].key >> 16) == tile; ii++ ) {
+        guint px, py;
+        hm_bin_pixel ( hl->bins[ii].key, &px, &py );
+        gint64 xx = ((gint64)px << shift) + half - ox;
+        gint64 yy = ((gint64)py << shift) + half - oy;
+        if ( xx < 0 || yy < 0 || xx >= size || yy >= size )
+          continue;
+        if ( !full )
+          full = heatmap_new ( size, size );
+        heatmap_add_weighted_point_with_stamp ( full, xx, yy, hl->bins[ii].count, stamp );
+      }
+    }
+  }
+  if ( !full )
+    return NULL;
+
+  // Only the tile itself is wanted
+  heatmap_t *hm = heatmap_new ( HM_TILE_SIZE, HM_TILE_SIZE );
+  for ( guint yy = 0; yy < HM_TILE_SIZE; yy++ ) {
+    const float *src = full->buf + (yy + radius) * full->w + radius;
+    float *dest = hm->buf + yy * HM_TILE_SIZE;
+    for ( guint xx = 0; xx < HM_TILE_SIZE; xx++ ) {
+      dest[xx] = src[xx];
+      if ( src[xx] > hm->max )
+        hm->max = src[xx];
+    }
+  }
+  heatmap_free ( full );
+  if ( hm->max <= 0.0 ) {
+    heatmap_free ( hm );
+    return NULL;
+  }
+  return hm;
+}
+
+static void hm_img_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
+
+// In main thread
+static gboolean hm_render_update_idle ( HMContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  ctx->update_pending = FALSE;
+  VikAggregateLayer *val = ctx->val;
+  if ( val )
+    g_object_ref ( val );
+  g_mutex_unlock ( ctx->mutex );
+
+  if ( val ) {
+    vik_layer_emit_update ( VIK_LAYER(val), FALSE );
+    g_object_unref ( val );
+  }
+  hm_ctx_unref ( ctx );
+  return FALSE;
+}
+
+/**
+ * Draw tiles from the bins into the mapcache
+ */
+typedef struct {
+  HMRenderJob *job;
+  gpointer threaddata;
+  guint radius;
+  heatmap_stamp_t *stamp;
+  heatmap_t **heats;
+  const heatmap_colorscheme_t *cs;
+  gfloat saturation;
+  gint done;
+} HMRenderBatch;
+
+static void hm_render_heat_item ( guint ii, HMRenderBatch *rb )
+{
+  if ( a_background_cancelled(rb->threaddata) )
+    return;
+  gint tx, ty;
+  tile_key_xy ( g_array_index(rb->job->tiles, guint64, ii), &tx, &ty );
+  rb->heats[ii] = hm_tile_heat ( rb->job->bins, rb->job->level, tx, ty, rb->radius, rb->stamp );
+  gint done = g_atomic_int_add ( &rb->done, 1 ) + 1;
+  (void)a_background_set_progress ( rb->threaddata, (gdouble)done/rb->job->tiles->len );
+}
+
+static void hm_render_tile_item ( guint ii, HMRenderBatch *rb )
+{
+  HMRenderJob *job = rb->job;
+  gint tx, ty;
+  tile_key_xy ( g_array_index(job->tiles, guint64, ii), &tx, &ty );
+  if ( rb->heats[ii] && rb->saturation > 0.0 ) {
+    unsigned char *image = g_malloc ( HM_TILE_SIZE*HM_TILE_SIZE*4 );
+    heatmap_render_saturated_to ( rb->heats[ii], rb->cs, rb->saturation, image );
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, HM_TILE_SIZE, HM_TILE_SIZE,
+                                                   4*HM_TILE_SIZE, hm_img_free, NULL );
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, job->alpha );
+    if ( pixbuf ) {
+      a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0, 0 }, tx, ty, 0, MAP_ID_HEATMAP_RENDER, job->level, job->alpha, 1.0, 1.0, job->signature );
+      g_object_unref ( pixbuf );
+    }
+  }
+  else
+    // Remember nothing is there, so it isn't tried again
+    a_mapcache_add ( NULL, (mapcache_extra_t){ 0.0, MAPCACHE_STATUS_NO_TILE }, tx, ty, 0, MAP_ID_HEATMAP_RENDER, job->level, job->alpha, 1.0, 1.0, job->signature );
+}
+
+/**
+ * The tiles are made (both the heat from the bins and then the image) several at once on the CPU workers,
+ *  so only putting the finished tiles on the screen is left for the GTK thread
+ */
+static gint hm_render_thread ( HMRenderJob *job, gpointer threaddata )
+{
+  const guint radius = hm_radius ( job->level, job->factor );
+  const guint dd = 2*radius + 1;
+  float *pts = g_new ( float, dd * dd );
+  rhomboidal ( pts, dd, radius );
+  heatmap_stamp_t *stamp = heatmap_stamp_load ( dd, dd, pts );
+  g_free ( pts );
+
+  heatmap_t **heats = g_new0 ( heatmap_t*, job->tiles->len );
+  HMRenderBatch rb = { job, threaddata, radius, stamp, heats, NULL, 0.0, 0 };
+  a_background_parallel ( (vik_thr_index_func)hm_render_heat_item, &rb, job->tiles->len );
+  heatmap_stamp_free ( stamp );
+
+  gfloat max = 0.0;
+  gint result = a_background_cancelled(threaddata) ? -1 : 0;
+  for ( guint ii = 0; ii < job->tiles->len; ii++ )
+    if ( heats[ii] && heats[ii]->max > max )
+      max = heats[ii]->max;
+
+  // The hottest colour is set by the first drawing at each level,
+  //  so all tiles at the level match (as when the heatmap was a single image of the view)
+  HMContext *ctx = job->ctx;
+  gfloat saturation = 0.0;
+  gboolean current = FALSE;
+  g_mutex_lock ( ctx->mutex );
+  if ( result == 0 && job->generation == ctx->generation ) {
+    current = TRUE;
+    if ( ctx->saturation_factor != job->factor ) {
+      ctx->saturation_factor = job->factor;
+      for ( guint nn = 0; nn < HM_NUM_LEVELS; nn++ )
+        ctx->saturation[nn] = 0.0;
+    }
+    gfloat *sat = &ctx->saturation[job->level - HM_LEVEL_MIN];
+    if ( *sat <= 0.0 )
+      *sat = max;
+    saturation = *sat;
+  }
+  g_mutex_unlock ( ctx->mutex );
+
+  rb.cs = heatmap_cs_default;
+  if ( job->style > 0 && job->style < 4 )
+    rb.cs = hm_colorschemes[job->style-1];
+  rb.saturation = saturation;
+
+  if ( current )
+    a_background_parallel ( (vik_thr_index_func)hm_render_tile_item, &rb, job->tiles->len );
+
+  for ( guint ii = 0; ii < job->tiles->len; ii++ )
+    if ( heats[ii] )
+      heatmap_free ( heats[ii] );
+  g_free ( heats );
+
+  if ( current ) {
+    g_mutex_lock ( ctx->mutex );
+    // Coalesce redraws - many tiles may finish in quick succession
+    if ( ctx->val && !ctx->update_pending ) {
+      ctx->update_pending = TRUE;
+      (void)gdk_threads_add_idle ( (GSourceFunc)hm_render_update_idle, hm_ctx_ref(ctx) );
+    }
+    g_mutex_unlock ( ctx->mutex );
+  }
+  return result;
+}
+
+static void hm_render_job_free ( HMRenderJob *job )
+{
+  // Only once any result is stored, so it won't be drawn again
+  g_mutex_lock ( job->ctx->mutex );
+  for ( guint ii = 0; ii < job->requests->len; ii++ )
+    (void)g_hash_table_remove ( job->ctx->requests, g_ptr_array_index(job->requests, ii) );
+  g_mutex_unlock ( job->ctx->mutex );
+
+  hm_ctx_unref ( job->ctx );
+  hm_bins_unref ( job->bins );
+  g_free ( job->signature );
+  g_array_free ( job->tiles, TRUE );
+  g_ptr_array_free ( job->requests, TRUE );
+  g_free ( job );
+}
+
+/**
+ * Queue drawing of the tiles in the background, apart from any already waiting to be drawn
+ *
+ * The bins and the array of tiles are owned by the job
+ */
+static void hm_render_queue ( VikAggregateLayer *val, HMBins *hb, guint generation, gint level, const gchar *signature, GArray *tiles )
+{
+  HMContext *ctx = val->hm_ctx;
+  GArray *wanted = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  GPtrArray *requests = g_ptr_array_new_with_free_func ( g_free );
+  g_mutex_lock ( ctx->mutex );
+  for ( guint ii = 0; ii < tiles->len; ii++ ) {
+    gint tx, ty;
+    tile_key_xy ( g_array_index(tiles, guint64, ii), &tx, &ty );
+    gchar *request = g_strdup_printf ( "%s/%d/%d/%d/%u", signature, level, tx, ty, val->hm_alpha );
+    if ( g_hash_table_contains ( ctx->requests, request ) ) {
+      g_free ( request );
+      continue;
+    }
+    g_hash_table_add ( ctx->requests, g_strdup(request) );
+    g_ptr_array_add ( requests, request );
+    g_array_append_val ( wanted, g_array_index(tiles, guint64, ii) );
+  }
+  g_mutex_unlock ( ctx->mutex );
+  g_array_free ( tiles, TRUE );
+
+  if ( wanted->len == 0 ) {
+    g_array_free ( wanted, TRUE );
+    g_ptr_array_free ( requests, TRUE );
+    hm_bins_unref ( hb );
+    return;
+  }
+
+  HMRenderJob *job = g_malloc0 ( sizeof(HMRenderJob) );
+  job->ctx = hm_ctx_ref ( ctx );
+  job->bins = hb;
+  job->generation = generation;
+  job->level = level;
+  job->factor = val->hm_stamp_factor;
+  job->style = val->hm_style;
+  job->alpha = val->hm_alpha;
+  job->signature = g_strdup ( signature );
+  job->tiles = wanted;
+  job->requests = requests;
+
+  gchar *description = g_strdup_printf ( _("Heatmap Render %d tiles"), wanted->len );
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_VISIBLE,
+                                      VIK_GTK_WINDOW_FROM_LAYER(val), description,
+                                      (vik_thr_func) hm_render_thread,
+                                      job,
+                                      (vik_thr_free_func) hm_render_job_free,
+                                      NULL,
+                                      1 );
+  g_free ( description );
+}
+
+// Which tile a level pixel is in
+static inline gint64 hm_tile_index ( gint64 pixel )
+{
+  return pixel >= 0 ? pixel / HM_TILE_SIZE : -((HM_TILE_SIZE - 1 - pixel) / HM_TILE_SIZE);
+}
+
+/**
+ * Draw heatmap tiles from the mapcache, queuing drawing of any not there
+ */
+static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
+{
+  // Only the standard zoom levels in Mercator are drawn
+  if ( vik_viewport_get_drawmode(vp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return;
+  if ( vik_viewport_get_xmpp(vp) != vik_viewport_get_ympp(vp) )
+    return;
+  gint level = map_utils_mpp_to_scale ( vik_viewport_get_xmpp(vp) / vik_viewport_get_scale(vp) );
+  if ( level < HM_LEVEL_MIN || level > HM_LEVEL_MAX )
+    return;
+
+  HMContext *ctx = val->hm_ctx;
+  g_mutex_lock ( ctx->mutex );
+  HMBins *hb = ctx->bins ? hm_bins_ref ( ctx->bins ) : NULL;
+  guint generation = ctx->generation;
+  g_mutex_unlock ( ctx->mutex );
+  if ( !hb )
+    return;
+
+  // Level pixel at the top left of the view
+  VikCoord coord;
+  struct LatLon ll;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &coord );
+  vik_coord_to_latlon ( &coord, &ll );
+  const gdouble pixels = hm_level_pixels ( level );
+  const gint64 ox = (gint64)floor ( (ll.lon + 180) / 360 * pixels );
+  const gint64 oy = (gint64)floor ( (180 - MERCLAT(ll.lat)) / 360 * pixels );
+  const gint64 tile_max = (gint64)(pixels / HM_TILE_SIZE) - 1;
+
+  const gint64 tx0 = MAX ( 0, hm_tile_index(ox) );
+  const gint64 ty0 = MAX ( 0, hm_tile_index(oy) );
+  const gint64 tx1 = MIN ( tile_max, hm_tile_index(ox + vik_viewport_get_width(vp) - 1) );
+  const gint64 ty1 = MIN ( tile_max, hm_tile_index(oy + vik_viewport_get_height(vp) - 1) );
+
+  gchar *signature = hm_render_signature ( generation, val->hm_style, val->hm_stamp_factor );
+  GArray *missing = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  for ( gint64 ty = ty0; ty <= ty1; ty++ ) {
+    for ( gint64 tx = tx0; tx <= tx1; tx++ ) {
+      GdkPixbuf *pixbuf = a_mapcache_get ( tx, ty, 0, MAP_ID_HEATMAP_RENDER, level, val->hm_alpha, 1.0, 1.0, signature );
+      if ( pixbuf ) {
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, tx * HM_TILE_SIZE - ox, ty * HM_TILE_SIZE - oy, HM_TILE_SIZE, HM_TILE_SIZE );
+        g_object_unref ( pixbuf );
+      }
+      else {
+        mapcache_extra_t extra = a_mapcache_get_extra ( tx, ty, 0, MAP_ID_HEATMAP_RENDER, level, val->hm_alpha, 1.0, 1.0, signature );
+        if ( extra.status != MAPCACHE_STATUS_NO_TILE ) {
+          guint64 key = tile_key ( tx, ty );
+          g_array_append_val ( missing, key );
+        }
+      }
+    }
+  }
+
+  if ( missing->len )
+    hm_render_queue ( val, hb, generation, level, signature, missing );
+  else {
+    g_array_free ( missing, TRUE );
+    hm_bins_unref ( hb );
+  }
+  g_free ( signature );
+}
+
+#if GTK_CHECK_VERSION (3,0,0)
+typedef struct {
+  VikLayer *vl;
+  const VikViewportProjection *proj;
+  cairo_surface_t *surface;  // For thread safe layers
+  gboolean drawn;            // Whether the thread safe drawing worked
+  cairo_pattern_t *pattern;  // Otherwise the drawing done in the main thread
+} AggregateDrawJob;
+
+static void aggregate_layer_draw_thread ( AggregateDrawJob *job, gpointer user_data )
+{
+  cairo_t *cr = cairo_create ( job->surface );
+  job->drawn = vik_layer_draw_surface ( job->vl, job->proj, cr );
+  cairo_destroy ( cr );
+}
+
+/**
+ * Draw the thread safe children into their own surfaces in worker threads,
+ *  while the others are drawn as normal (but captured separately),
+ *  then put them all onto the viewport in the usual order.
+ *
+ * Returns: FALSE if nothing would be gained by this, so the children haven't been drawn
+ */
+static gboolean aggregate_layer_draw_parallel ( VikAggregateLayer *val, VikViewport *vp )
+{
+  guint len = 0, safe = 0;
+  for ( GList *iter = val->children; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->visible ) {
+      len++;
+      if ( vik_layer_can_draw_surface ( vl ) )
+        safe++;
+    }
+  }
+  // Need something to do alongside the worker(s)
+  if ( safe == 0 || len < 2 )
+    return FALSE;
+
+  const VikViewportProjection *proj = vik_viewport_get_projection ( vp );
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)aggregate_layer_draw_thread, NULL, MIN(safe, util_get_number_of_cpus()), TRUE, NULL );
+  if ( !pool )
+    return FALSE;
+
+  AggregateDrawJob *jobs = g_new0 ( AggregateDrawJob, len );
+  guint nn = 0;
+  for ( GList *iter = val->children; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( !vl->visible )
+      continue;
+    jobs[nn].vl = vl;
+    jobs[nn].proj = proj;
+    if ( vik_layer_can_draw_surface ( vl ) ) {
+      jobs[nn].surface = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, proj->width, proj->height );
+      g_thread_pool_push ( pool, &jobs[nn], NULL );
+    }
+    nn++;
+  }
+
+  // Meanwhile draw the rest
+  for ( nn = 0; nn < len; nn++ ) {
+    if ( jobs[nn].surface )
+      continue;
+    if ( vik_viewport_group_begin ( vp ) ) {
+      vik_layer_draw ( jobs[nn].vl, vp );
+      jobs[nn].pattern = vik_viewport_group_end ( vp );
+    }
+  }
+
+  // Wait for the workers
+  g_thread_pool_free ( pool, FALSE, TRUE );
+
+  for ( nn = 0; nn < len; nn++ ) {
+    if ( jobs[nn].surface ) {
+      if ( jobs[nn].drawn ) {
+        cairo_pattern_t *pattern = cairo_pattern_create_for_surface ( jobs[nn].surface );
+        vik_viewport_draw_pattern ( vp, pattern );
+        cairo_pattern_destroy ( pattern );
+      }
+      else
+        vik_layer_draw ( jobs[nn].vl, vp );
+      cairo_surface_destroy ( jobs[nn].surface );
+    }
+    else if ( jobs[nn].pattern ) {
+      vik_viewport_draw_pattern ( vp, jobs[nn].pattern );
+      cairo_pattern_destroy ( jobs[nn].pattern );
+    }
+  }
+  g_free ( jobs );
+  return TRUE;
+}
+#endif
+
 /* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
  * to draw the layers above and including the trigger layer.
  * To do this we don't draw any layers if in half drawn mode, unless we find the
@@ -1328,9 +2684,11 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
   GList *iter = val->children;
 #if GTK_CHECK_VERSION (3,0,0)
   // GTK3 Version does not use pixmaps, so no point in trigger layers ATM
-  while ( iter ) {
-    vik_layer_draw ( VIK_LAYER(iter->data), vp );
-    iter = iter->next;
+  if ( !a_vik_get_parallel_layer_drawing() || !aggregate_layer_draw_parallel ( val, vp ) ) {
+    while ( iter ) {
+      vik_layer_draw ( VIK_LAYER(iter->data), vp );
+      iter = iter->next;
+    }
   }
 #else
   VikLayer *vl;
@@ -1355,7 +2713,7 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
     tac_draw ( val, vp );
   }
 
-  if ( !val->hm_calculating && val->hm_pixbuf ) {
+  if ( !val->hm_calculating ) {
     hm_draw ( val, vp );
   }
 }
@@ -1656,12 +3014,38 @@ static void aggregate_layer_analyse ( menu_array_values values )
   if ( val->tracks_analysis_dialog )
     return;
 
-  val->tracks_analysis_dialog = vik_trw_layer_analyse_this ( VIK_GTK_WINDOW_FROM_LAYER(VIK_LAYER(val)),
-                                                             VIK_LAYER(val)->name,
-                                                             VIK_LAYER(val),
-                                                             NULL,
-                                                             aggregate_layer_track_create_list,
-                                                             aggregate_layer_analyse_close );
+  val->tracks_analysis_dialog = vik_trw_layer_analyse_this ( VIK_GTK_WINDOW_FROM_LAYER(VIK_LAYER(val)),
+                                                             VIK_LAYER(val)->name,
+                                                             VIK_LAYER(val),
+                                                             NULL,
+                                                             aggregate_layer_track_create_list,
+                                                             aggregate_layer_analyse_close );
+}
+
+static void aggregate_layer_apply_dem_data ( menu_array_values values, gboolean skip_existing )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
+  if ( values[MA_VLP] ) {
+    GList *dems = vik_layers_panel_get_all_layers_of_type ( VIK_LAYERS_PANEL(values[MA_VLP]), VIK_LAYER_DEM, TRUE );
+    if ( !dems ) {
+      a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(val), _("No DEM layers available, thus no DEM values can be applied.") );
+      return;
+    }
+    g_list_free ( dems );
+  }
+  GList *vtls = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_TRW, TRUE );
+  vik_trw_layer_apply_dem_data_all ( vtls, skip_existing );
+  g_list_free ( vtls );
+}
+
+static void aggregate_layer_apply_dem_data_all ( menu_array_values values )
+{
+  aggregate_layer_apply_dem_data ( values, FALSE );
+}
+
+static void aggregate_layer_apply_dem_data_only_missing ( menu_array_values values )
+{
+  aggregate_layer_apply_dem_data ( values, TRUE );
 }
 
 static void aggregate_layer_load_external_layers ( VikAggregateLayer *val )
@@ -1779,76 +3163,266 @@ static void aggregate_layer_export_gpsbabel ( menu_array_values values )
   vik_aggregate_layer_export_gpx_setup ( val, TRUE );
 }
 
-/**
- *
- */
-static void add_tile_label ( GHashTable *ght, gint x, gint y, guint id )
+static gint tile_key_compare ( gconstpointer a, gconstpointer b )
 {
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  (void)g_hash_table_insert ( ght, key, GUINT_TO_POINTER(id) );
+  guint64 ka = *(const guint64*)a;
+  guint64 kb = *(const guint64*)b;
+  return (ka > kb) - (ka < kb);
 }
 
 /**
- *
+ * As map_utils_vikcoord_to_iTMS() but keeping the position within the tile
  */
-static void add_tile ( GHashTable *ght, gint x, gint y )
+static gboolean tile_position ( const VikCoord *coord, gdouble zoom, gdouble *tx, gdouble *ty )
+{
+  if ( coord->mode != VIK_COORD_LATLON )
+    return FALSE;
+  *tx = (coord->east_west + 180) / 360 * VIK_GZ(17) / zoom;
+  *ty = (180 - MERCLAT(coord->north_south)) / 360 * VIK_GZ(17) / zoom;
+  return TRUE;
+}
+
+static inline void tile_append ( GArray *keys, gint x, gint y )
 {
-  add_tile_label ( ght, x, y, 0 );
+  guint64 key = tile_key ( x, y );
+  // Successive points are mostly in the same tile
+  if ( keys->len == 0 || g_array_index(keys, guint64, keys->len-1) != key )
+    g_array_append_val ( keys, key );
 }
 
 /**
- *
+ * Append every tile the line between the two positions passes through
+ *  (stepping from tile edge to tile edge), so tiles crossed without a point in them still count
+ * c.f. 'A Fast Voxel Traversal Algorithm for Ray Tracing' by Amanatides and Woo
  */
-static void check_point ( VikAggregateLayer *val, VikCoord *coord )
+static void tile_line ( GArray *keys, gdouble x0, gdouble y0, gdouble x1, gdouble y1 )
 {
-  MapCoord mc;
-  gdouble zoom = val->zoom_level;
-  // Give up if can't convert - shouldn't happen
-  if ( !map_utils_vikcoord_to_iTMS(coord, zoom, zoom, &mc) ) {
-    g_warning ( "%s: %s", __FUNCTION__, "Failed to convert positions" );
-    return;
-  }
-
-  if ( ! is_tile_occupied ( val->tiles, mc.x, mc.y ) ) {
-    add_tile ( val->tiles, mc.x, mc.y );
-    val->num_tiles[BASIC]++;
+  gint tx = (gint)floor ( x0 );
+  gint ty = (gint)floor ( y0 );
+  const gint ex = (gint)floor ( x1 );
+  const gint ey = (gint)floor ( y1 );
+  const gdouble dx = x1 - x0;
+  const gdouble dy = y1 - y0;
+  const gint sx = dx > 0 ? 1 : -1;
+  const gint sy = dy > 0 ? 1 : -1;
+  // Distance along the line (as a fraction) to cross one whole tile, and to the next tile edge
+  const gdouble delta_x = dx != 0 ? fabs(1.0/dx) : INFINITY;
+  const gdouble delta_y = dy != 0 ? fabs(1.0/dy) : INFINITY;
+  gdouble next_x = dx > 0 ? (tx + 1 - x0) * delta_x : (x0 - tx) * delta_x;
+  gdouble next_y = dy > 0 ? (ty + 1 - y0) * delta_y : (y0 - ty) * delta_y;
+
+  tile_append ( keys, tx, ty );
+  while ( tx != ex || ty != ey ) {
+    // NB Explicit end checks as rounding could otherwise step past the final tile
+    if ( ty == ey || (tx != ex && next_x < next_y) ) {
+      next_x += delta_x;
+      tx += sx;
+    }
+    else {
+      next_y += delta_y;
+      ty += sy;
+    }
+    tile_append ( keys, tx, ty );
   }
 }
 
 /**
+ * Work out the tiles of a track
+ * This only reads the track, so can be run for several tracks at once
  *
+ * Returns: The tiles, or NULL if stopped by @cancelled being set
  */
-static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
+static TacTrackTiles *check_track ( VikAggregateLayer *val, VikTrack *trk, gint *cancelled )
 {
-  VikTrack *trk = vtlist->trk;
   //g_debug ( "%s: %s", __FUNCTION__, trk->name );
+  TacTrackTiles *tt = g_malloc ( sizeof(TacTrackTiles) );
+  tt->serial = vik_track_get_serial ( trk );
+  tt->keys = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+
+  gdouble zoom = val->zoom_level;
+  if ( map_utils_mpp_to_scale(zoom) == 255 ) {
+    g_warning ( "%s: %s", __FUNCTION__, "Failed to convert positions" );
+    return tt;
+  }
+
   guint no_times = 0;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
+  guint steps = 0;
+  gboolean have_prev = FALSE;
+  gdouble px = 0, py = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    if ( ++steps % AGGREGATE_CANCEL_STEPS == 0 && g_atomic_int_get(cancelled) ) {
+      tac_track_tiles_free ( tt );
+      return NULL;
+    }
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      check_point ( val, &VIK_TRACKPOINT(iter->data)->coord );
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( !isnan(tp->timestamp) ) {
+      gdouble xx, yy;
+      // Give up if can't convert - shouldn't happen
+      if ( !tile_position(&tp->coord, zoom, &xx, &yy) ) {
+        g_warning ( "%s: %s", __FUNCTION__, "Failed to convert positions" );
+        have_prev = FALSE;
+        continue;
+      }
+      // Include the tiles between points of the same segment
+      if ( have_prev && !tp->newsegment )
+        tile_line ( tt->keys, px, py, xx, yy );
+      else
+        tile_append ( tt->keys, (gint)floor(xx), (gint)floor(yy) );
+      px = xx;
+      py = yy;
+      have_prev = TRUE;
     }
-    else
+    else {
       no_times++;
-    iter = iter->next;
+      have_prev = FALSE;
+    }
   }
   // Handy to find out if your not expecting any of these
   if ( no_times )
     g_debug ( "%s: %d points encountered with no times", __FUNCTION__, no_times );
+
+  // Each tile only counted once per track
+  g_array_sort ( tt->keys, tile_key_compare );
+  guint nn = 0;
+  for ( guint ii = 0; ii < tt->keys->len; ii++ ) {
+    guint64 key = g_array_index ( tt->keys, guint64, ii );
+    if ( nn == 0 || g_array_index(tt->keys, guint64, nn-1) != key )
+      g_array_index ( tt->keys, guint64, nn++ ) = key;
+  }
+  g_array_set_size ( tt->keys, nn );
+
+  return tt;
+}
+
+/**
+ * Add the tiles of a track, collecting any tiles new to the coverage into @added
+ */
+static void tac_track_ref ( VikAggregateLayer *val, TacTrackTiles *tt, GArray *added )
+{
+  for ( guint ii = 0; ii < tt->keys->len; ii++ ) {
+    guint64 key = g_array_index ( tt->keys, guint64, ii );
+    if ( tac_tiles_ref(val->tiles, key) )
+      g_array_append_val ( added, key );
+  }
+}
+
+/**
+ * Remove the tiles of a track
+ *
+ * Returns: The number of tiles no longer in the coverage
+ */
+static guint tac_track_unref ( VikAggregateLayer *val, TacTrackTiles *tt )
+{
+  guint removed = 0;
+  for ( guint ii = 0; ii < tt->keys->len; ii++ )
+    if ( tac_tiles_unref(val->tiles, g_array_index(tt->keys, guint64, ii)) )
+      removed++;
+  return removed;
 }
 
 typedef struct {
-  GList *tracks_and_layers;
+  GArray *tracks_and_layers; // Of #vik_trw_and_track_t, possibly shared with the layer's flat_tracks
   VikAggregateLayer *val;
   guint num_of_tracks;
+  HMCube *cube;    // Heatmap only: the counts per month to use, or NULL to make them
+  HMPeriod period; // Heatmap only
 } CalculateThreadT;
 
+/**
+ * Per track work spread over several threads
+ * Each job handles every 'threads'th track, so anything accumulated by a job is private to it
+ */
+typedef struct {
+  VikAggregateLayer *val;
+  GPtrArray *tracks;    // The #VikTrack to process
+  guint threads;        // Number of jobs
+  gpointer *results;    // Per track (Tracks Area Coverage) or per job (Heatmap)
+  GAsyncQueue *finished;// An entry per track done
+  gint cancelled;
+  gint level;           // Heatmap only
+  gboolean cube;        // Heatmap only: count per month too
+  const HMPeriod *period; // Heatmap only
+} AggregateBatchT;
+
+/**
+ * Returns: The number of threads to use for up to @jobs pieces of work
+ */
+static guint aggregate_threads ( guint jobs )
+{
+  guint threads = util_get_number_of_cpus ();
+  gint gitmp = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_AGGREGATE_THREADS, &gitmp ) && gitmp > 0 )
+    threads = gitmp;
+  return MAX ( 1, MIN(threads, jobs) );
+}
+
+static AggregateBatchT *aggregate_batch_new ( VikAggregateLayer *val, GPtrArray *tracks, guint threads, guint num_results )
+{
+  AggregateBatchT *batch = g_malloc0 ( sizeof(AggregateBatchT) );
+  batch->val = val;
+  batch->tracks = tracks;
+  batch->threads = threads;
+  batch->results = g_new0 ( gpointer, MAX(1, num_results) );
+  batch->finished = g_async_queue_new ();
+  return batch;
+}
+
+static void aggregate_batch_free ( AggregateBatchT *batch )
+{
+  g_async_queue_unref ( batch->finished );
+  g_free ( batch->results );
+  g_free ( batch );
+}
+
+/**
+ * Run @func for each job, updating the progress as each track is done
+ *  (counting on from @done out of @total)
+ *
+ * Returns: 0, or -1 if cancelled
+ */
+static gint aggregate_batch_run ( AggregateBatchT *batch, GFunc func, gpointer threaddata, guint done, guint total )
+{
+  GThreadPool *pool = g_thread_pool_new ( func, batch, batch->threads, FALSE, NULL );
+  for ( guint nn = 0; nn < batch->threads; nn++ )
+    g_thread_pool_push ( pool, GUINT_TO_POINTER(nn+1), NULL );
+
+  gint result = 0;
+  for ( guint ii = 0; ii < batch->tracks->len && result == 0; ii++ ) {
+    // Notice a cancellation even whilst a very long track is being processed
+    while ( !g_async_queue_timeout_pop(batch->finished, AGGREGATE_CANCEL_WAIT) ) {
+      if ( a_background_cancelled(threaddata) ) {
+        result = -1;
+        break;
+      }
+    }
+    gdouble percent = (gdouble)(done+ii+1)/(gdouble)total;
+    if ( result == 0 && a_background_thread_progress(threaddata, percent) != 0 )
+      result = -1;
+  }
+  // The jobs then stop part way through their tracks
+  if ( result != 0 )
+    g_atomic_int_set ( &batch->cancelled, 1 );
+  // Wait for the jobs to finish (or notice the cancellation)
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  return result;
+}
+
+static void tac_track_job ( gpointer data, AggregateBatchT *batch )
+{
+  for ( guint ii = GPOINTER_TO_UINT(data)-1; ii < batch->tracks->len; ii += batch->threads ) {
+    if ( g_atomic_int_get(&batch->cancelled) )
+      break;
+    batch->results[ii] = check_track ( batch->val, g_ptr_array_index(batch->tracks, ii), &batch->cancelled );
+    g_async_queue_push ( batch->finished, GUINT_TO_POINTER(1) );
+  }
+}
+
 static void ct_free ( CalculateThreadT *ct )
 {
   ct->val->calculating = FALSE;
-  g_list_free_full ( ct->tracks_and_layers, g_free );
+  g_array_unref ( ct->tracks_and_layers );
   g_free ( ct );
 }
 
@@ -1892,70 +3466,77 @@ static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
   return TRUE;
 }
 
-/*
- * Union Find stuff for labelling
- */
-
-/* The 'labels' array has the meaning that labels[x] is an alias for the label x; by
-   following this chain until x == labels[x], you can find the canonical name of an
-   equivalence class.  The labels start at one; labels[0] is a special value indicating
-   the highest label already used. */
-
-guint *labels;
-guint n_labels = 0; /* length of the labels array */
-
 /**
- * uf_find:
- *  returns the canonical label for the equivalence class containing x
+ * Label the groups of tiles that are connected (horizontally or vertically)
+ *  by visiting each tile and its neighbours in the set, rather than every position within the extents
+ * c.f. 'labelling clusters on a grid'
+ *  https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
+ * The labels are kept in @uf so groups can be extended by tac_label_join()
+ *
+ * Returns: The number of tiles in the largest group, with its label in @largest_label
  */
-static guint uf_find ( guint x ) {
-  guint y = x;
-  while (labels[y] != y)
-    y = labels[y];
-
-  while (labels[x] != x) {
-    guint z = labels[x];
-    labels[x] = y;
-    x = z;
+static guint tac_label_groups ( TacTileSet *set, TacUnionFind *uf, guint *largest_label, gint *total_groups )
+{
+  *largest_label = 0;
+  *total_groups = 0;
+  uf_init ( uf, tac_tiles_size(set) );
+
+  guint pos = 0;
+  gint x, y;
+  guint *label;
+  // Each tile starts in its own group
+  while ( tac_tiles_iter_next(set, &pos, &x, &y, &label) )
+    *label = uf_make_set ( uf );
+
+  // Then join with any neighbours (only need to look in one direction of each axis)
+  pos = 0;
+  while ( tac_tiles_iter_next(set, &pos, &x, &y, &label) ) {
+    guint label_up = tile_label ( set, x-1, y ); // NB don't have to worry about -1 going out of bounds
+    guint label_left = tile_label ( set, x, y-1 );
+    if ( label_up )
+      (void)uf_union ( uf, *label, label_up );
+    if ( label_left )
+      (void)uf_union ( uf, *label, label_left );
   }
-  return y;
-}
-
-/**
- * uf_union:
- *   joins two equivalence classes and returns the canonical label of the resulting class.
- */
-static guint uf_union ( guint x, guint y ) {
-  return labels[uf_find(x)] = uf_find(y);
-}
-
-/**
- * uf_make_set:
- *  creates a new equivalence class and returns its label
- */
-static guint uf_make_set(void) {
-  labels[0]++;
-  labels[labels[0]] = labels[0];
-  return labels[0];
-}
 
-/**
- * uf_init:
- *   Allocate array for potential labels
- */
-static void uf_init ( guint max_labels ) {
-  n_labels = max_labels;
-  labels = g_malloc0_n ( sizeof(guint), n_labels );
-  labels[0] = 0;
+  // Compare the size of the groups
+  guint largist = 0;
+  for ( guint ll = 1; ll < uf->len; ll++ ) {
+    if ( uf->parent[ll] == ll ) {
+      (*total_groups)++;
+      if ( uf->size[ll] > largist ) {
+        largist = uf->size[ll];
+        *largest_label = ll;
+      }
+    }
+  }
+  return largist;
 }
 
 /**
- * uf_finish: clean up
+ * Label a tile that has been added to a set previously labelled by tac_label_groups(),
+ *  joining it to the groups of its neighbours
+ *
+ * Returns: The number of tiles in the largest group, with its label in @largest_label
  */
-static void uf_finish ( void ) {
-  n_labels = 0;
-  g_free ( labels );
-  labels = NULL;
+static guint tac_label_join ( TacTileSet *set, TacUnionFind *uf, gint x, gint y, guint *largest_label, guint largist )
+{
+  guint ll = uf_make_set ( uf );
+  add_tile_label ( set, x, y, ll );
+
+  // NB Neighbours also being added but not yet labelled will join with this tile when they are
+  const gint nbrs[4][2] = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+  for ( guint nn = 0; nn < 4; nn++ ) {
+    guint label = tile_label ( set, x+nbrs[nn][0], y+nbrs[nn][1] );
+    if ( label )
+      ll = uf_union ( uf, ll, label );
+  }
+  // Any group merged into the largest one makes a larger group, so the largest is always a root
+  if ( uf->size[ll] > largist ) {
+    largist = uf->size[ll];
+    *largest_label = ll;
+  }
+  return largist;
 }
 
 // NB ATM This only tracks one such area
@@ -1964,200 +3545,110 @@ static void tac_contiguous_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  // Process the grid according to 'labelling clusters on a grid'
-  // https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        guint label_up = tile_label (val->tiles, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
-  }
-
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
-
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->cont_label = ss;
-      val->num_tiles[CONTIG] = largist;
-    }
-  }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  gint total_clusters;
+  guint largist = tac_label_groups ( val->tiles, &val->uf_contig, &val->cont_label, &total_clusters );
+  val->num_tiles[CONTIG] = largist;
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->cont_label );
 }
 
+/**
+ * For the per tile loops of the calculations
+ *
+ * Returns: TRUE if the calculation should stop
+ */
+static gboolean tac_calc_cancelled ( gpointer threaddata, guint *steps )
+{
+  return ++(*steps) % AGGREGATE_CANCEL_STEPS == 0 && a_background_cancelled ( threaddata );
+}
+
 // NB ATM This only tracks one such area
 //  (there might be multiple such areas)
-static void tac_cluster_calc ( VikAggregateLayer *val )
+// Returns: FALSE if cancelled
+static gboolean tac_cluster_calc ( VikAggregateLayer *val, gpointer threaddata )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  guint pos = 0;
+  guint steps = 0;
   gint x,y;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
+  tac_tiles_clear ( val->tiles_clust );
+  while ( tac_tiles_iter_next(val->tiles, &pos, &x, &y, NULL) ) {
+    if ( tac_calc_cancelled(threaddata, &steps) )
+      return FALSE;
     if ( is_cluster(val->tiles, x, y) ) {
-      // Make new hashtable from just the tiles that are in a cluster
+      // Make new set from just the tiles that are in a cluster
       add_tile ( val->tiles_clust, x, y );
-      val->num_tiles[CLUSTER]++;
     }
   }
 
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles_clust );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
+  gint total_clusters;
+  guint largist = tac_label_groups ( val->tiles_clust, &val->uf_clust, &val->clust_label, &total_clusters );
+  val->num_tiles[CLUSTER] = largist;
 
-  uf_init ( size );
+  clock_t end = clock();
+  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->clust_label );
+  return TRUE;
+}
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        guint label_up = tile_label (val->tiles_clust, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles_clust, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles_clust, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles_clust, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles_clust, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
+/**
+ * Extend the contiguous area with tiles that have just been added
+ *  (rather than relabelling all the tiles)
+ */
+static void tac_contiguous_add ( VikAggregateLayer *val, GArray *added )
+{
+  gint x, y;
+  guint largist = val->num_tiles[CONTIG];
+  for ( guint ii = 0; ii < added->len; ii++ ) {
+    tile_key_xy ( g_array_index(added, guint64, ii), &x, &y );
+    largist = tac_label_join ( val->tiles, &val->uf_contig, x, y, &val->cont_label, largist );
   }
+  val->num_tiles[CONTIG] = largist;
+}
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles_clust, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles_clust, xx, yy, new_labels[ll] );
+/**
+ * Extend the clusters with tiles that have just been added
+ * Only the added tiles and their neighbours can have become part of a cluster
+ */
+static void tac_cluster_add ( VikAggregateLayer *val, GArray *added )
+{
+  gint x, y;
+  guint largist = val->num_tiles[CLUSTER];
+  for ( guint ii = 0; ii < added->len; ii++ ) {
+    tile_key_xy ( g_array_index(added, guint64, ii), &x, &y );
+    for ( gint xx = x-1; xx <= x+1; xx++ ) {
+      for ( gint yy = y-1; yy <= y+1; yy++ ) {
+        if ( is_tile_occupied(val->tiles, xx, yy) &&
+             !is_tile_occupied(val->tiles_clust, xx, yy) &&
+             is_cluster(val->tiles, xx, yy) )
+          largist = tac_label_join ( val->tiles_clust, &val->uf_clust, xx, yy, &val->clust_label, largist );
       }
     }
   }
-  gint total_clusters = new_labels[0];
-
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->clust_label = ss;
-      val->num_tiles[CLUSTER] = largist;
-    }
-  }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
-
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->clust_label );
+  val->num_tiles[CLUSTER] = largist;
 }
 
-
 // NB ATM This only tracks one square
 //  (there might be multiple such squares)
-static void tac_square_calc ( VikAggregateLayer *val )
+// Returns: FALSE if cancelled
+static gboolean tac_square_calc ( VikAggregateLayer *val, gpointer threaddata )
 {
   val->max_square = 1;
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  guint pos = 0;
+  guint steps = 0;
   gint x,y;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
+  while ( tac_tiles_iter_next(val->tiles, &pos, &x, &y, NULL) ) {
+    if ( tac_calc_cancelled(threaddata, &steps) ) {
+      val->max_square = 0;
+      return FALSE;
+    }
     if ( is_square(val, x, y, val->max_square) ) {
       g_debug ( "%s: is_square %d at %d:%d", __FUNCTION__, val->max_square, x, y );
       val->xx = x;
@@ -2179,84 +3670,60 @@ static void tac_square_calc ( VikAggregateLayer *val )
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  return TRUE;
 }
 
 /**
  * Finds biggest line of tiles, both vertically and horizontally
+ *
+ * Returns: FALSE if cancelled
  */
-static void tac_lines_calc ( VikAggregateLayer *val )
+static gboolean tac_lines_calc ( VikAggregateLayer *val, gpointer threaddata )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  guint pos = 0;
+  guint steps = 0;
   gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
 
-  // Get extents of tile coverage
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
+  val->ns_size = 0;
+  val->ew_size = 0;
 
-  // Simple brute force method
-  // Detects the first instance of the biggest consective run of tiles
+  // Each line is only measured from the tile that starts it
+  // Detects the first instance (i.e. furthest West then North) of the biggest consective run of tiles
   //  in both vertical and horizontal directions
-  guint crt_sz = 0;
-
-  // North/South passage...
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    gint yy;
-    for ( yy = tly ; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
+  while ( tac_tiles_iter_next(val->tiles, &pos, &x, &y, NULL) ) {
+    if ( tac_calc_cancelled(threaddata, &steps) ) {
+      val->ns_size = 0;
+      val->ew_size = 0;
+      return FALSE;
+    }
+    // North/South passage...
+    if ( !is_tile_occupied(val->tiles, x, y-1) ) {
+      guint crt_sz = 1;
+      while ( is_tile_occupied(val->tiles, x, y+crt_sz) )
         crt_sz++;
-      else {
-        if ( crt_sz > val->ns_size ) {
-          val->ns_size = crt_sz;
-          val->ns_x = xx;
-          val->ns_y = yy-1;
-        }
-        crt_sz = 0;
+      gint end_y = y + crt_sz - 1;
+      if ( crt_sz > val->ns_size ||
+           (crt_sz == val->ns_size && (x < val->ns_x || (x == val->ns_x && end_y < val->ns_y))) ) {
+        val->ns_size = crt_sz;
+        val->ns_x = x;
+        val->ns_y = end_y;
       }
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ns_size ) {
-      val->ns_size = crt_sz;
-      val->ns_x = xx;
-      val->ns_y = yy;
-    }
-    // Reset for next line
-    crt_sz = 0;
-  }
-
-  crt_sz = 0;
-  // East/West passage...
-  for ( gint yy = tly; yy <= bry; yy++ ) {
-    gint xx;
-    for ( xx = tlx; xx <= brx; xx++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
+    // East/West passage...
+    if ( !is_tile_occupied(val->tiles, x-1, y) ) {
+      guint crt_sz = 1;
+      while ( is_tile_occupied(val->tiles, x+crt_sz, y) )
         crt_sz++;
-      else {
-        if ( crt_sz > val->ew_size ) {
-          val->ew_size = crt_sz;
-          val->ew_x = xx-1;
-          val->ew_y = yy;
-        }
-        crt_sz = 0;
+      gint end_x = x + crt_sz - 1;
+      if ( crt_sz > val->ew_size ||
+           (crt_sz == val->ew_size && (y < val->ew_y || (y == val->ew_y && end_x < val->ew_x))) ) {
+        val->ew_size = crt_sz;
+        val->ew_x = end_x;
+        val->ew_y = y;
       }
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ew_size ) {
-      val->ew_size = crt_sz;
-      val->ew_x = xx;
-      val->ew_y = yy;
-    }
-    // Reset for next line
-    crt_sz = 0;
   }
 
   g_debug ( "%s: ns_x %d, ns_y %d, ns_size %d | ew_x %d, ew_y %d, ew_size %d:",
@@ -2265,16 +3732,17 @@ static void tac_lines_calc ( VikAggregateLayer *val )
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  return TRUE;
 }
 
 /**
  * Insert unreachable tiles to pretend they have been visited
  *  thus contributing to max squares, clusters and contiguous calculations
- * NB: ATM this doesn't effect the numbers reported too much as it uses the
- *  separate count 'num_tiles' rather than the number in the hash table
+ * NB: These are not included in the reported number of tiles
  */
 static void tac_unreachable ( VikAggregateLayer *val )
 {
+  val->num_unreachable = 0;
   if ( !tiles_unreachable ) return;
 
   GHashTableIter iter;
@@ -2287,7 +3755,8 @@ static void tac_unreachable ( VikAggregateLayer *val )
   while ( g_hash_table_iter_next(&iter, &key, &value) ) {
     (void)sscanf ( key, "%d %d %d", &z, &x, &y );
     if ( z == zoom )
-      add_tile ( val->tiles, x, y );
+      if ( tac_tiles_ref(val->tiles, tile_key(x, y)) )
+        val->num_unreachable++;
   }
 }
 
@@ -2295,154 +3764,350 @@ static void tac_unreachable ( VikAggregateLayer *val )
 static void tac_clear ( VikAggregateLayer *val );
 
 /**
- *
+ * Bring the tiles up to date with the tracks, only processing tracks that have been
+ *  added, changed or removed since the previous calculation.
+ * The derived values are then extended with any new tiles where possible,
+ *  otherwise they are recalculated.
  */
 static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
   clock_t begin = clock();
+  gint64 start = g_get_monotonic_time ();
+  VikAggregateLayer *val = ct->val;
 
-  g_hash_table_remove_all ( ct->val->prev );
-  g_hash_table_remove_all ( ct->val->tiles_new );
-  ct->val->num_tiles[TNEW] = 0;
+  // Drawing meanwhile always refills the whole screen pixbufs
+  g_atomic_int_inc ( &val->tac_changes );
+  tac_tiles_clear ( val->tiles_new );
+  val->num_tiles[TNEW] = 0;
 
   // Only if there's something before then 'turn on' detection of new tiles...
   //  (too otherwise avoid marking everything new on first time calculation
   //   on particularly initial file loads)
   // Also don't try to find new ones when the zoom level has changed
-  //  and discount the number of unreachable tiles
-  ct->val->zoom_level_chgd = (ct->val->zoom_level_prev != ct->val->zoom_level);
-  if ( ct->val->zoom_level_chgd )
-    ct->val->zoom_level_prev = ct->val->zoom_level;
-  guint sz = 0;
-  if ( tiles_unreachable )
-    sz = g_hash_table_size ( tiles_unreachable );
-  if ( (ct->val->num_tiles[BASIC] > sz) && ct->val->on[TNEW]) {
-    // Copy current tiles into prev
+  val->zoom_level_chgd = (val->zoom_level_prev != val->zoom_level);
+  if ( val->zoom_level_chgd )
+    val->zoom_level_prev = val->zoom_level;
+  gboolean detect_new = (val->num_tiles[BASIC] > 0) && val->on[TNEW] && !val->zoom_level_chgd;
+  if ( (val->num_tiles[BASIC] > 0) && val->on[TNEW] ) {
+    for (gint x = 0; x<CP_NUM; x++ )
+      val->num_prev[x] = val->num_tiles[x];
+  }
+  val->max_square_prev = val->max_square;
+  val->ns_size_prev = val->ns_size;
+  val->ew_size_prev = val->ew_size;
+
+  // The tiles of every track depend on the zoom level
+  if ( val->tac_tracks_zoom != val->zoom_level ) {
+    tac_clear ( val );
+    val->tac_tracks_zoom = val->zoom_level;
+    tac_unreachable ( val );
+  }
+
+  // Derived values only become valid again once recalculated,
+  //  so a cancelled calculation gets redone in full next time
+  gboolean was_valid[CP_NUM];
+  for ( gint x = 0; x<CP_NUM; x++ ) {
+    was_valid[x] = val->valid[x];
+    val->valid[x] = FALSE;
+  }
+
+  GHashTable *wanted = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  GSList *stale = NULL;
+  GArray *added = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  guint removed = 0;
+  gint result = 0;
+
+  guint tracks_processed = 0;
+  // This is used to prevent the progress going negative or otherwise over 100%
+  // It's difficult to get an estimate for the total and track progress of each of these parts
+  //  and then combine it in a coherent single thread progress meter.
+  // So for simplicity they are considered the same as processing extra set of tracks
+  guint extras = (val->on[MAX_SQR] * ct->num_of_tracks) +
+    (val->on[CONTIG] * ct->num_of_tracks) +
+    (val->on[CLUSTER] * ct->num_of_tracks) +
+    (val->on[LINES] * ct->num_of_tracks);
+
+  // Find which tracks are new or changed
+  GPtrArray *todo = g_ptr_array_new ();
+  for ( guint ii = 0; ii < ct->tracks_and_layers->len; ii++ ) {
+    VikTrack *trk = g_array_index ( ct->tracks_and_layers, vik_trw_and_track_t, ii ).trk;
+    if ( g_hash_table_contains(wanted, trk) )
+      continue;
+    g_hash_table_add ( wanted, trk );
+    TacTrackTiles *tt = g_hash_table_lookup ( val->tac_tracks, trk );
+    if ( !tt || tt->serial != vik_track_get_serial(trk) )
+      g_ptr_array_add ( todo, trk );
+  }
+  tracks_processed = ct->num_of_tracks - todo->len;
+
+  // The tiles of each of these tracks are worked out on several threads...
+  AggregateBatchT *batch = aggregate_batch_new ( val, todo, aggregate_threads(todo->len), todo->len );
+  result = aggregate_batch_run ( batch, (GFunc)tac_track_job, threaddata, tracks_processed, ct->num_of_tracks+extras );
+  tracks_processed = ct->num_of_tracks;
+
+  // ...and then merged in here
+  // Add tracks first, so tiles shared with tracks being removed are not seen as changing
+  for ( guint ii = 0; ii < todo->len; ii++ ) {
+    TacTrackTiles *ntt = batch->results[ii];
+    if ( !ntt )
+      continue;
+    VikTrack *trk = g_ptr_array_index ( todo, ii );
+    tac_track_ref ( val, ntt, added );
+    TacTrackTiles *tt = g_hash_table_lookup ( val->tac_tracks, trk );
+    if ( tt ) {
+      // Keep the old tiles until the end
+      (void)g_hash_table_steal ( val->tac_tracks, trk );
+      stale = g_slist_prepend ( stale, tt );
+    }
+    g_hash_table_insert ( val->tac_tracks, trk, ntt );
+  }
+  aggregate_batch_free ( batch );
+  g_ptr_array_free ( todo, TRUE );
+
+  // Remove tracks no longer included (unless cancelled, as then not all the tracks have been seen)
+  for ( GSList *sl = stale; sl; sl = sl->next )
+    removed += tac_track_unref ( val, sl->data );
+  g_slist_free_full ( stale, (GDestroyNotify)tac_track_tiles_free );
+  if ( result == 0 ) {
     GHashTableIter iter;
     gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) )
-      (void)g_hash_table_insert ( ct->val->prev, g_strdup(key), GUINT_TO_POINTER(0) );
-
-    for (gint x = 0; x<CP_NUM; x++ )
-      ct->val->num_prev[x] = ct->val->num_tiles[x];
+    g_hash_table_iter_init ( &iter, val->tac_tracks );
+    while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+      if ( !g_hash_table_contains(wanted, key) ) {
+        removed += tac_track_unref ( val, value );
+        g_hash_table_iter_remove ( &iter );
+      }
+    }
   }
-  ct->val->max_square_prev = ct->val->max_square;
-  ct->val->ns_size_prev = ct->val->ns_size;
-  ct->val->ew_size_prev = ct->val->ew_size;
+  g_hash_table_destroy ( wanted );
 
-  tac_clear ( ct->val );
+  val->num_tiles[BASIC] = tac_tiles_size ( val->tiles ) - val->num_unreachable;
+  g_debug ( "%s: %d tiles added, %d removed", __FUNCTION__, added->len, removed );
 
-  tac_unreachable ( ct->val );
+  if ( detect_new ) {
+    for ( guint ii = 0; ii < added->len; ii++ ) {
+      gint x, y;
+      tile_key_xy ( g_array_index(added, guint64, ii), &x, &y );
+      add_tile ( val->tiles_new, x, y );
+    }
+    val->num_tiles[TNEW] = added->len;
+  }
 
-  guint tracks_processed = 0;
-  // This is used to prevent the progress going negative or otherwise over 100%
-  // It's difficult to get an estimate for the total and track progress of each of these parts
-  //  and then combine it in a coherent single thread progress meter.
-  // So for simplicity they are considered the same as processing extra set of tracks
-  guint extras = (ct->val->on[MAX_SQR] * ct->num_of_tracks) +
-    (ct->val->on[CONTIG] * ct->num_of_tracks) +
-    (ct->val->on[CLUSTER] * ct->num_of_tracks) +
-    (ct->val->on[LINES] * ct->num_of_tracks);
+  gboolean changed = (added->len > 0) || (removed > 0);
+  // Only additions can be applied to the existing labelling
+  gboolean extend = (removed == 0);
 
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
+  if ( result == 0 && val->on[MAX_SQR] ) {
     gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    check_track ( ct->val, tl->data );
-    tracks_processed++;
+    if ( a_background_thread_progress(threaddata, percent) != 0 )
+      result = -1;
+    else if ( (changed || !was_valid[MAX_SQR]) && !tac_square_calc(val, threaddata) )
+      result = -1;
+    else {
+      val->valid[MAX_SQR] = TRUE;
+      tracks_processed = tracks_processed + ct->num_of_tracks;
+    }
   }
+  if ( !val->on[MAX_SQR] )
+    val->max_square = 0;
 
-  if ( ct->val->on[MAX_SQR] ) {
+  if ( result == 0 && val->on[CONTIG] ) {
     gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_square_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+    if ( a_background_thread_progress(threaddata, percent) != 0 )
+      result = -1;
+    else {
+      if ( was_valid[CONTIG] && extend )
+        tac_contiguous_add ( val, added );
+      else
+        tac_contiguous_calc ( val );
+      val->valid[CONTIG] = TRUE;
+      tracks_processed = tracks_processed + ct->num_of_tracks;
+    }
   }
-
-  if ( ct->val->on[CONTIG] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_contiguous_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+  if ( !val->valid[CONTIG] ) {
+    val->cont_label = 0;
+    val->num_tiles[CONTIG] = 0;
   }
 
-  if ( ct->val->on[CLUSTER] ) {
+  if ( result == 0 && val->on[CLUSTER] ) {
     gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_cluster_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+    if ( a_background_thread_progress(threaddata, percent) != 0 )
+      result = -1;
+    else if ( was_valid[CLUSTER] && extend ) {
+      tac_cluster_add ( val, added );
+      val->valid[CLUSTER] = TRUE;
+      tracks_processed = tracks_processed + ct->num_of_tracks;
+    }
+    else if ( !tac_cluster_calc(val, threaddata) )
+      result = -1;
+    else {
+      val->valid[CLUSTER] = TRUE;
+      tracks_processed = tracks_processed + ct->num_of_tracks;
+    }
   }
-
-  if ( ct->val->on[LINES] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_lines_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+  if ( !val->valid[CLUSTER] ) {
+    val->clust_label = 0;
+    val->num_tiles[CLUSTER] = 0;
   }
 
-  if ( (ct->val->num_prev[BASIC] > sz) && ct->val->on[TNEW] && !ct->val->zoom_level_chgd ) {
-    // Determine difference in latest tiles vs prev
-    // Could be slow, but seems not too bad
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-      gboolean contained = g_hash_table_contains ( ct->val->prev, key );
-      if ( !contained ) {
-        (void)g_hash_table_insert ( ct->val->tiles_new, g_strdup(key), GUINT_TO_POINTER(0) );
-        ct->val->num_tiles[TNEW]++;
-      }
+  if ( result == 0 && val->on[LINES] ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
+    if ( a_background_thread_progress(threaddata, percent) != 0 )
+      result = -1;
+    else if ( (changed || !was_valid[LINES]) && !tac_lines_calc(val, threaddata) )
+      result = -1;
+    else {
+      val->valid[LINES] = TRUE;
+      tracks_processed = tracks_processed + ct->num_of_tracks;
     }
-    // Also doing it here means the detection is only done for the 'first' calculation update
-    // (this calculation alsootherwise gets done for any config change - even if just colour changed).
-    //  so ATM the new tiles get reset for such subsequent recalculations
-    g_hash_table_remove_all ( ct->val->prev );
   }
+  if ( !val->on[LINES] ) {
+    val->ns_size = 0;
+    val->ew_size = 0;
+  }
+
+  g_array_free ( added, TRUE );
+
+  if ( result != 0 )
+    return result;
 
   // Timing for all tile calcs
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  a_perfstats_time ( "aggregate", "tac calculation", g_get_monotonic_time() - start );
 
-  ct->val->calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  g_atomic_int_inc ( &val->tac_changes );
+  val->calculating = FALSE;
+  vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
 
   return 0;
 }
 
 /**
- *
+ * Forget all tiles, so everything gets recalculated from scratch
  */
 static void tac_clear ( VikAggregateLayer *val )
 {
+  g_atomic_int_inc ( &val->tac_changes );
   val->max_square = 0;
   for (gint x = 0; x<CP_NUM; x++ ) {
     val->num_tiles[x] = 0;
+    val->valid[x] = FALSE;
   }
   val->cont_label = 0;
   val->clust_label = 0;
-  g_hash_table_remove_all ( val->tiles ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_clust ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_new ); // No memory to remove ATM
-  // NB val->prev is not cleared at this point as needed for the later comparison
+  g_hash_table_remove_all ( val->tac_tracks );
+  val->tac_tracks_zoom = 0.0;
+  val->num_unreachable = 0;
+  tac_tiles_clear ( val->tiles );
+  tac_tiles_clear ( val->tiles_clust );
+  tac_tiles_clear ( val->tiles_new );
+  uf_finish ( &val->uf_contig );
+  uf_finish ( &val->uf_clust );
   val->ns_size = 0;
   val->ew_size = 0;
 }
 
 /**
+ * The period the map view is limited to, if any
+ *  (without a window, e.g. for benchmarking, there is none)
+ */
+static gboolean aggregate_layer_time_filter ( VikAggregateLayer *val, gdouble *start, gdouble *end )
+{
+  if ( !VIK_LAYER(val)->realized )
+    return FALSE;
+  GtkWindow *gw = VIK_GTK_WINDOW_FROM_LAYER(val);
+  if ( !IS_VIK_WINDOW(gw) )
+    return FALSE;
+  return vik_viewport_get_time_filter ( vik_window_viewport(VIK_WINDOW(gw)), start, end );
+}
+
+/**
+ * The tracks of a TRW layer, only those within the time filter when there is one
+ */
+static GList *aggregate_layer_trw_tracks ( VikTrwLayer *vtl, gboolean filter, gdouble start, gdouble end )
+{
+  // Getting the tracks also ensures they are loaded
+  GHashTable *tracks = vik_trw_layer_get_tracks ( vtl );
+  if ( filter )
+    return vik_trw_layer_get_tracks_by_time ( vtl, start, end );
+  return g_hash_table_get_values ( tracks );
+}
+
+/**
+ * aggregate_layer_flat_tracks:
  *
+ * All the tracks (not routes) of the TRW layers within this aggregate, including those not visible,
+ *  kept from one call to the next until any layer is added or removed or any of the tracks change.
+ * Rather than walking the layers and allocating a list each time,
+ *  checking this is still valid just compares a count per TRW layer.
+ *
+ * Returns: An array of #vik_trw_and_track_t owned by the layer -
+ *  take a reference to keep it beyond the next call
  */
-static void tac_calculate ( VikAggregateLayer *val )
+static GArray *aggregate_layer_flat_tracks ( VikAggregateLayer *val )
+{
+  if ( val->flat_tracks && val->flat_children_changes == aggregate_children_changes ) {
+    guint ii;
+    for ( ii = 0; ii < val->flat_sources->len; ii++ ) {
+      FlatSource *fs = &g_array_index ( val->flat_sources, FlatSource, ii );
+      if ( vik_trw_layer_get_tracks_changes(fs->vtl) != fs->tracks_changes )
+        break;
+    }
+    if ( ii == val->flat_sources->len )
+      return val->flat_tracks;
+  }
+
+  // Any calculation still using the old array keeps its own reference
+  if ( val->flat_tracks )
+    g_array_unref ( val->flat_tracks );
+  val->flat_tracks = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+  g_array_set_size ( val->flat_sources, 0 );
+
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_TRW, TRUE );
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(layer->data);
+    // Getting the tracks also ensures they are loaded, so take the count afterwards
+    GHashTable *tracks = vik_trw_layer_get_tracks ( vtl );
+    FlatSource fs = { vtl, vik_trw_layer_get_tracks_changes(vtl) };
+    g_array_append_val ( val->flat_sources, fs );
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, tracks );
+    while ( g_hash_table_iter_next(&iter, NULL, &value) ) {
+      vik_trw_and_track_t vt = { VIK_TRACK(value), vtl };
+      g_array_append_val ( val->flat_tracks, vt );
+    }
+  }
+  g_list_free ( layers );
+  val->flat_children_changes = aggregate_children_changes;
+
+  return val->flat_tracks;
+}
+
+/**
+ * Whether the track starts within the TAC time range (of years back from now)
+ */
+static gboolean tac_track_in_time_range ( VikAggregateLayer *val, VikTrack *trk, GDate *now )
+{
+  gdouble ts, last;
+  if ( !vik_track_get_time_span ( trk, &ts, &last ) )
+    return FALSE;
+  GDate* gdate = g_date_new ();
+  g_date_set_time_t ( gdate, (time_t)ts );
+  gint diff = g_date_days_between ( gdate, now );
+  g_date_free ( gdate );
+  // NB this doesn't get the year date range exact
+  //  however this generally should be good/close enough for practical purposes
+  return ( diff > 0 && diff < (365.25*val->tac_time_range) );
+}
+
+/**
+ * The tracks to calculate the coverage from
+ */
+static CalculateThreadT *tac_calculate_new ( VikAggregateLayer *val )
 {
   val->calculating = TRUE;
   val->num_calcs++;
@@ -2450,46 +4115,52 @@ static void tac_calculate ( VikAggregateLayer *val )
   GDate *now = g_date_new ();
   g_date_set_time_t ( now, time(NULL) );
 
-  GList *layers = NULL;
-  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  gdouble start = NAN, end = NAN;
+  gboolean filter = aggregate_layer_time_filter ( val, &start, &end );
 
-  // For each TRW layers keep adding the tracks to build a list of all of them
-  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
-  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
-    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
+  GArray *tracks_and_layers;
+  if ( filter ) {
+    // Only those within the time filter, as found by each TRW layer
+    tracks_and_layers = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+    GList *layers = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_TRW, TRUE );
+    for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+      GList *tracks = aggregate_layer_trw_tracks ( VIK_TRW_LAYER(layer->data), filter, start, end );
+      for ( GList *track = tracks; track != NULL; track = track->next ) {
+        vik_trw_and_track_t vt = { VIK_TRACK(track->data), VIK_TRW_LAYER(layer->data) };
+        if ( !val->tac_time_range || tac_track_in_time_range(val, vt.trk, now) )
+          g_array_append_val ( tracks_and_layers, vt );
+      }
+      g_list_free ( tracks );
+    }
+    g_list_free ( layers );
+  }
+  else {
+    GArray *flat = aggregate_layer_flat_tracks ( val );
     if ( !val->tac_time_range )
       // All
-      tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
+      tracks_and_layers = g_array_ref ( flat );
     else {
       // Only those within specified time period
-      for ( GList *track = tracks; track != NULL; track = track->next ) {
-        VikTrack *trk = VIK_TRACK(track->data);
-        gdouble ts = VIK_TRACKPOINT(trk->trackpoints->data)->timestamp;
-        if ( trk->trackpoints && !isnan(ts) ) {
-          GDate* gdate = g_date_new ();
-          g_date_set_time_t ( gdate, (time_t)ts );
-          gint diff = g_date_days_between ( gdate, now );
-          g_date_free ( gdate );
-          // NB this doesn't get the year date range exact
-          //  however this generally should be good/close enough for practical purposes
-          if ( diff > 0 && diff < (365.25*val->tac_time_range) ) {
-            vik_trw_and_track_t *vtdl = g_malloc (sizeof(vik_trw_and_track_t));
-            vtdl->trk = trk;
-            vtdl->vtl = VIK_TRW_LAYER(layer->data);
-            tracks_and_layers = g_list_prepend ( tracks_and_layers, vtdl );
-          }
-        }
+      tracks_and_layers = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+      for ( guint ii = 0; ii < flat->len; ii++ ) {
+        vik_trw_and_track_t *vt = &g_array_index ( flat, vik_trw_and_track_t, ii );
+        if ( tac_track_in_time_range(val, vt->trk, now) )
+          g_array_append_val ( tracks_and_layers, *vt );
       }
     }
-    g_list_free ( tracks );
   }
-  g_list_free ( layers );
   g_date_free ( now );
 
   CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
   ct->tracks_and_layers = tracks_and_layers;
   ct->val = val;
-  ct->num_of_tracks = g_list_length (tracks_and_layers);
+  ct->num_of_tracks = tracks_and_layers->len;
+  return ct;
+}
+
+static void tac_calculate ( VikAggregateLayer *val )
+{
+  CalculateThreadT *ct = tac_calculate_new ( val );
   guint extras = ct->val->on[MAX_SQR] + ct->val->on[CONTIG] + ct->val->on[CLUSTER];
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
@@ -2502,163 +4173,331 @@ static void tac_calculate ( VikAggregateLayer *val )
                         ct->num_of_tracks + extras );
 }
 
-static void rhomboidal (float *values, unsigned d, unsigned r)
+/**
+ * vik_aggregate_layer_tac_calculate_now:
+ * @from_scratch: Recalculate everything, rather than only what the track changes affect
+ *
+ * Calculate the Tracks Area Coverage in the calling thread,
+ *  for use without the GUI (e.g. for benchmarking)
+ *
+ * Returns: 0 on success
+ */
+gint vik_aggregate_layer_tac_calculate_now ( VikAggregateLayer *val, gboolean from_scratch )
 {
-  for (guint y = 0 ; y < d ; ++y) {
-    for (guint x = 0 ; x < d ; ++x) {
-      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
-    }
+  if ( from_scratch )
+    tac_clear ( val );
+  CalculateThreadT *ct = tac_calculate_new ( val );
+  gint ans = tac_calculate_thread ( ct, NULL );
+  ct_free ( ct );
+  return ans;
+}
+
+/**
+ * The month the last point was in, so it need not be worked out for each point
+ */
+typedef struct {
+  gint month;
+  gdouble start, end;
+} HMMonthSpan;
+
+static inline void hm_bins_add ( GArray *bins, guint64 key )
+{
+  // Successive points are often in the same pixel
+  if ( bins->len && g_array_index(bins, HMBin, bins->len-1).key == key )
+    g_array_index(bins, HMBin, bins->len-1).count++;
+  else {
+    HMBin bin = { key, 1 };
+    g_array_append_val ( bins, bin );
+  }
+}
+
+static inline void hm_cube_bins_add ( GArray *bins, guint64 key, gint month )
+{
+  HMCubeBin *last = bins->len ? &g_array_index(bins, HMCubeBin, bins->len-1) : NULL;
+  if ( last && last->key == key && last->month == month )
+    last->count++;
+  else {
+    HMCubeBin bin = { key, 1, month };
+    g_array_append_val ( bins, bin );
   }
 }
 
 /**
- *
+ * Count the points of a track in the pixels of the level,
+ *  into @bins for those in the remainder of the period (see hm_period_remainder())
+ *  and into @cube for every point per month when making the counts per month
+ * This only reads the track, so can be run for several tracks at once
+ * Stops part way through if @cancelled gets set
  */
-static void hm_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist, gdouble mf, heatmap_t* hm, heatmap_stamp_t *stamp )
+static void hm_track ( VikTrack *trk, AggregateBatchT *batch, GArray *bins, GArray *cube, HMMonthSpan *span )
 {
-  int xx, yy;
-  VikTrack *trk = vtlist->trk;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
+  const gdouble pixels = hm_level_pixels ( batch->level );
+  guint steps = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    if ( ++steps % AGGREGATE_CANCEL_STEPS == 0 && g_atomic_int_get(&batch->cancelled) )
+      return;
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      coord_to_screen (val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy);
-      /*
-      struct LatLon *ll = (struct LatLon *)&VIK_TRACKPOINT(iter->data)->coord;
-      xx = (int)(val->hm_width/2 + ( mf * (ll->lon - center->lon) ));
-      yy = (int)(val->hm_height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-      */
-      //heatmap_add_point ( hm, xx, yy );
-      heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
-      //hm_point ( val, &VIK_TRACKPOINT(iter->data)->coord, hm );
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( isnan(tp->timestamp) )
+      continue;
+    gboolean remainder = hm_period_remainder ( batch->period, tp->timestamp );
+    if ( !remainder && !cube )
+      continue;
+    struct LatLon ll;
+    vik_coord_to_latlon ( &tp->coord, &ll );
+    gdouble px = (ll.lon + 180) / 360 * pixels;
+    gdouble py = (180 - MERCLAT(ll.lat)) / 360 * pixels;
+    if ( px < 0 || py < 0 || px >= pixels || py >= pixels )
+      continue;
+    guint64 key = hm_bin_key ( (guint)px, (guint)py );
+    if ( remainder )
+      hm_bins_add ( bins, key );
+    if ( cube ) {
+      if ( !(tp->timestamp >= span->start && tp->timestamp < span->end) )
+        if ( !hm_month ( tp->timestamp, &span->month, &span->start, &span->end ) )
+          continue;
+      hm_cube_bins_add ( cube, key, span->month );
     }
-    iter = iter->next;
   }
 }
 
-static void hm_img_free ( guchar *pixels, gpointer data )
+static void hm_track_job ( gpointer data, AggregateBatchT *batch )
 {
-  g_free ( pixels );
+  guint nn = GPOINTER_TO_UINT(data)-1;
+  GArray *bins = g_array_new ( FALSE, FALSE, sizeof(HMBin) );
+  batch->results[nn] = bins;
+  GArray *cube = NULL;
+  if ( batch->cube ) {
+    cube = g_array_new ( FALSE, FALSE, sizeof(HMCubeBin) );
+    batch->results[batch->threads + nn] = cube;
+  }
+  HMMonthSpan span = { 0, 0.0, 0.0 };
+
+  guint limit = HM_BINS_COMPACT;
+  guint cube_limit = HM_BINS_COMPACT;
+  for ( guint ii = nn; ii < batch->tracks->len; ii += batch->threads ) {
+    if ( g_atomic_int_get(&batch->cancelled) )
+      break;
+    hm_track ( g_ptr_array_index(batch->tracks, ii), batch, bins, cube, &span );
+    // Keep memory in check
+    if ( bins->len >= limit ) {
+      hm_bins_compact ( bins );
+      limit = MAX ( HM_BINS_COMPACT, bins->len * 2 );
+    }
+    if ( cube && cube->len >= cube_limit ) {
+      hm_cube_bins_compact ( cube );
+      cube_limit = MAX ( HM_BINS_COMPACT, cube->len * 2 );
+    }
+    g_async_queue_push ( batch->finished, GUINT_TO_POINTER(1) );
+  }
 }
 
 /**
- *
+ * Join the bins of each job into the first, freeing the rest
+ */
+static GArray *hm_results_join ( gpointer *results, guint num, gboolean keep )
+{
+  GArray *joined = NULL;
+  for ( guint nn = 0; nn < num; nn++ ) {
+    GArray *jbins = results[nn];
+    if ( !jbins )
+      continue;
+    if ( !joined )
+      joined = jbins;
+    else {
+      if ( keep )
+        g_array_append_vals ( joined, jbins->data, jbins->len );
+      g_array_free ( jbins, TRUE );
+    }
+  }
+  return joined;
+}
+
+/**
+ * Count the points of the tracks, as the bins for drawing the heatmap from
+ * Unless already available, all the tracks are counted per month too,
+ *  and then the bins are the sum of the whole months of the period
+ *  plus the points of the remainder either side
  */
 static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
   VikAggregateLayer *val = ct->val;
 
   clock_t begin = clock();
-
-  // Generate a stamp with a size relative to the zoom level
-  unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
-    (gdouble)val->hm_stamp_factor/(gdouble)width_default().u;
-  unsigned d = 2*radius + 1;
-  float pts[d * d];
-  rhomboidal ( pts, d, radius );
-  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
-  heatmap_t* hm = heatmap_new ( val->hm_width, val->hm_height );
-
-  int ww = val->hm_width;
-  int hh = val->hm_height;
-
-  // Only needs calculating once
-  gdouble mf = mercator_factor ( val->hm_zoom, val->hm_scale );
-
-  guint tracks_processed = 0;
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    vik_trw_and_track_t *vtlist = tl->data;
-    if ( BBOX_INTERSECT ( vtlist->trk->bbox, val->hm_bbox ) )
-      hm_track ( ct->val, vtlist, mf, hm, stamp );
-
-    tracks_processed++;
+  gint64 start = g_get_monotonic_time ();
+
+  GPtrArray *tracks = g_ptr_array_sized_new ( ct->num_of_tracks );
+  for ( guint ii = 0; ii < ct->tracks_and_layers->len; ii++ )
+    g_ptr_array_add ( tracks, g_array_index(ct->tracks_and_layers, vik_trw_and_track_t, ii).trk );
+
+  // Each job counts its tracks into its own bins, which are then merged
+  guint threads = aggregate_threads ( tracks->len );
+  AggregateBatchT *batch = aggregate_batch_new ( val, tracks, threads, threads * 2 );
+  batch->level = val->hm_base;
+  batch->cube = ( ct->cube == NULL );
+  batch->period = &ct->period;
+
+  gint result = aggregate_batch_run ( batch, (GFunc)hm_track_job, threaddata, 0, MAX(1, tracks->len) );
+
+  GArray *bins = hm_results_join ( batch->results, threads, result == 0 );
+  GArray *cbins = hm_results_join ( batch->results + threads, threads, result == 0 );
+  aggregate_batch_free ( batch );
+  g_ptr_array_free ( tracks, TRUE );
+
+  if ( result != 0 ) {
+    if ( bins )
+      g_array_free ( bins, TRUE );
+    if ( cbins )
+      g_array_free ( cbins, TRUE );
+    return -1;
   }
 
-  // Would be better if testing for any tracks actually used
-  if ( tracks_processed > 0 ) {
-    unsigned char *image = g_malloc ( ww*hh*4 );
-
-    if ( val->hm_style > 0 && val->hm_style < 4 )
-      heatmap_render_to ( hm, hm_colorschemes[val->hm_style-1], image );
-    else
-      heatmap_render_default_to ( hm, image );
-
-    val->hm_pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
-    val->hm_pixbuf = ui_pixbuf_set_alpha ( val->hm_pixbuf, val->hm_alpha );
+  if ( !bins )
+    bins = g_array_new ( FALSE, FALSE, sizeof(HMBin) );
+  if ( !ct->cube ) {
+    if ( !cbins )
+      cbins = g_array_new ( FALSE, FALSE, sizeof(HMCubeBin) );
+    hm_cube_bins_compact ( cbins );
+    ct->cube = hm_cube_new ( val->hm_base, cbins );
+    hm_ctx_set_cube ( val->hm_ctx, hm_cube_ref(ct->cube) );
+    g_debug ( "%s: %d bins per month at level %d", __FUNCTION__, ct->cube->num, val->hm_base );
   }
-
-  heatmap_free ( hm );
-  heatmap_stamp_free ( stamp );
+  hm_cube_add ( ct->cube, ct->period.full_first, ct->period.full_last, bins );
+  hm_bins_compact ( bins );
+  g_debug ( "%s: %d bins at level %d", __FUNCTION__, bins->len, val->hm_base );
+  hm_ctx_set_bins ( val->hm_ctx, hm_bins_new(val->hm_base, bins) );
 
   // Timing
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  a_perfstats_time ( "aggregate", "heatmap calculation", g_get_monotonic_time() - start );
 
-  ct->val->hm_calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
 
   return 0;
 }
 
+static void hm_ct_free ( CalculateThreadT *ct )
+{
+  ct->val->hm_calculating = FALSE;
+  hm_cube_unref ( ct->cube );
+  g_array_unref ( ct->tracks_and_layers );
+  g_free ( ct );
+}
+
 /**
- *
+ * The tracks of a TRW layer with points in the remainder of the period outside its whole months
  */
-static void hm_calculate ( VikAggregateLayer *val )
+static GList *hm_period_tracks ( VikTrwLayer *vtl, const HMPeriod *hp )
 {
-  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
-  VikViewport *vvp = vik_window_viewport ( vw );
-
-  val->hm_width = vik_viewport_get_width ( vvp );
-  val->hm_height = vik_viewport_get_height ( vvp );
-  val->hm_bbox = vik_viewport_get_bbox ( vvp );
-  val->hm_zoom = (gint)vik_viewport_get_zoom ( vvp );
-  val->hm_scaled_zoom = val->hm_zoom;
-  val->hm_center = vik_viewport_get_center ( vvp );
-  vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
-  val->hm_scale = vik_viewport_get_scale ( vvp );
-  val->hm_scaled = FALSE;
-  val->hm_zoom_max = 0;
-  if ( val->hm_zoom == 0 ) {
-    g_warning ( "%s: Zoom invalid", __FUNCTION__ );
-    return;
+  if ( hp->full_first > hp->full_last )
+    return aggregate_layer_trw_tracks ( vtl, TRUE, hp->start, hp->end );
+
+  GList *tracks = NULL;
+  GHashTable *seen = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  const gdouble ranges[2][2] = { { hp->start, hp->full_start }, { hp->full_end, hp->end } };
+  for ( guint rr = 0; rr < G_N_ELEMENTS(ranges); rr++ ) {
+    if ( ranges[rr][0] > ranges[rr][1] )
+      continue;
+    GList *part = aggregate_layer_trw_tracks ( vtl, TRUE, ranges[rr][0], ranges[rr][1] );
+    for ( GList *iter = part; iter; iter = iter->next )
+      if ( g_hash_table_add ( seen, iter->data ) )
+        tracks = g_list_prepend ( tracks, iter->data );
+    g_list_free ( part );
   }
+  g_hash_table_destroy ( seen );
+  return g_list_reverse ( tracks );
+}
+
+/**
+ * The tracks to count the points of, into bins at the level given
+ * When the counts per month are already available at the level,
+ *  only the tracks for any part months of the time filter period are needed
+ */
+static CalculateThreadT *hm_calculate_new ( VikAggregateLayer *val, gint level )
+{
+  val->hm_base = CLAMP ( level - HM_BIN_FINER_LEVELS, HM_LEVEL_MIN, HM_LEVEL_MAX );
 
-  hm_clear ( val );
   val->hm_calculating = TRUE;
 
-  GList *layers = NULL;
-  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  gdouble start = NAN, end = NAN;
+  gboolean filter = aggregate_layer_time_filter ( val, &start, &end );
+
+  CalculateThreadT *ct = g_malloc0 ( sizeof(CalculateThreadT) );
+  ct->val = val;
+  ct->cube = hm_ctx_get_cube ( val->hm_ctx, val->hm_base );
+  hm_period_init ( &ct->period, filter, start, end );
 
   // For each TRW layers keep adding the tracks to build a list of all of them
-  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
-  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
-    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
-    tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
-    g_list_free ( tracks );
+  GArray *tracks_and_layers;
+  if ( !ct->cube )
+    // Counting all the tracks, whatever the period
+    tracks_and_layers = g_array_ref ( aggregate_layer_flat_tracks(val) );
+  else {
+    tracks_and_layers = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+    if ( filter ) {
+      GList *layers = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_TRW, TRUE );
+      for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+        VikTrwLayer *vtl = VIK_TRW_LAYER(layer->data);
+        GList *tracks = hm_period_tracks ( vtl, &ct->period );
+        for ( GList *track = tracks; track != NULL; track = track->next ) {
+          vik_trw_and_track_t vt = { VIK_TRACK(track->data), vtl };
+          g_array_append_val ( tracks_and_layers, vt );
+        }
+        g_list_free ( tracks );
+      }
+      g_list_free ( layers );
+    }
   }
-  g_list_free ( layers );
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
   ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length ( tracks_and_layers );
+  ct->num_of_tracks = tracks_and_layers->len;
+  return ct;
+}
+
+static void hm_calculate ( VikAggregateLayer *val )
+{
+  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
+  VikViewport *vvp = vik_window_viewport ( vw );
+
+  // Bins with somewhat more detail than the current view
+  gdouble mpp = vik_viewport_get_xmpp ( vvp ) / vik_viewport_get_scale ( vvp );
+  gint level = map_utils_mpp_to_scale ( mpp );
+  if ( level == 255 )
+    level = (gint)floor ( log2(mpp) );
+  CalculateThreadT *ct = hm_calculate_new ( val, level );
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
                         _("Heatmap generation"),
                         (vik_thr_func)hm_calculate_thread,
                         ct,
-                        (vik_thr_free_func)ct_free,
+                        (vik_thr_free_func)hm_ct_free,
                         (vik_thr_free_func)ct_cancel,
                         ct->num_of_tracks );
 }
 
+/**
+ * vik_aggregate_layer_hm_calculate_now:
+ * @level: The map scale level (as per map_utils_mpp_to_scale()) of the view
+ *
+ * Count the points for the heatmap in the calling thread from all the tracks
+ *  (rather than from any counts per month already made),
+ *  for use without the GUI (e.g. for benchmarking)
+ *
+ * Returns: 0 on success
+ */
+gint vik_aggregate_layer_hm_calculate_now ( VikAggregateLayer *val, gint level )
+{
+  hm_ctx_set_cube ( val->hm_ctx, NULL );
+  CalculateThreadT *ct = hm_calculate_new ( val, level );
+  gint ans = hm_calculate_thread ( ct, NULL );
+  hm_ct_free ( ct );
+  return ans;
+}
+
 /**
  * Ensure TAC values calculated if needed
  */
@@ -2677,6 +4516,39 @@ void vik_aggregate_layer_file_load_complete ( VikAggregateLayer *val )
   aggregate_layer_post_read ( val, NULL, TRUE );
 }
 
+/**
+ * vik_aggregate_layer_time_filter_changed:
+ *
+ * Recalculate the Tracks Area Coverage and heatmap of this and any aggregates within it,
+ *  for the tracks within the period the map view is now limited to.
+ *
+ * Returns: FALSE if some were still calculating, so should be tried again later
+ */
+gboolean vik_aggregate_layer_time_filter_changed ( VikAggregateLayer *val )
+{
+  gboolean done = TRUE;
+  GList *aggregates = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_AGGREGATE, TRUE );
+  for ( GList *iter = aggregates; iter; iter = iter->next ) {
+    VikAggregateLayer *agg = VIK_AGGREGATE_LAYER(iter->data);
+    if ( !VIK_LAYER(agg)->realized )
+      continue;
+    if ( agg->on[BASIC] ) {
+      if ( agg->calculating )
+        done = FALSE;
+      else
+        tac_calculate ( agg );
+    }
+    if ( hm_has_bins ( agg ) ) {
+      if ( agg->hm_calculating )
+        done = FALSE;
+      else
+        hm_calculate ( agg );
+    }
+  }
+  g_list_free ( aggregates );
+  return done;
+}
+
 static void tac_clear_cb ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
@@ -2689,6 +4561,9 @@ static void tac_clear_cb ( menu_array_values values )
  */
 #ifdef HAVE_SQLITE3_H
 
+// Number of tiles written per transaction
+#define TAC_MBTILES_BATCH 50000
+
 typedef struct {
   VikAggregateLayer *val;
   gchar *fn;
@@ -2762,69 +4637,79 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
 
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  GdkPixbuf *pixbuf = NULL;
-  guint sz = g_hash_table_size ( val->tiles );
+  // Every coverage tile looks the same, so only one image needs encoding
+  GdkPixbuf *pixbuf = layer_pixbuf_update ( NULL, val->color[BASIC], 256, 256, val->alpha[BASIC] );
+  gchar *buffer = NULL;
+  gsize size;
+  GError *error = NULL;
+  (void)gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
+  g_object_unref ( pixbuf );
+  if ( error ) {
+    msg = g_strdup ( error->message );
+    g_error_free ( error );
+    goto cleanup;
+  }
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+  sqlite3_stmt *sql_stmt;
+  ans = sqlite3_prepare_v2 ( mbtiles, "INSERT INTO tiles VALUES (?, ?, ?, ?);", -1, &sql_stmt, NULL );
+  if ( ans != SQLITE_OK ) {
+    msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    g_free ( buffer );
+    goto cleanup;
+  }
 
-    num_tiles++;
-    gdouble percent = (gdouble)num_tiles/(gdouble)sz;
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) {
-      result = -1;
-      goto cleanup;
-    }
+  guint pos = 0;
+  gint x,y;
+  guint sz = tac_tiles_size ( val->tiles );
+  gboolean in_transaction = FALSE;
 
-    (void)sscanf ( key, "%d:%d", &x, &y );
+  while ( tac_tiles_iter_next(val->tiles, &pos, &x, &y, NULL) ) {
 
-    pixbuf = layer_pixbuf_update ( pixbuf, val->color[BASIC], 256, 256, val->alpha[BASIC] );
+    // Writes are batched in large transactions, rather than one per tile
+    if ( !in_transaction ) {
+      gint res = a_background_thread_progress ( threaddata, (gdouble)num_tiles/(gdouble)sz );
+      if ( res != 0 ) {
+        result = -1;
+        break;
+      }
+      (void)sqlite3_exec ( mbtiles, "BEGIN TRANSACTION;", 0, 0, NULL );
+      in_transaction = TRUE;
+    }
 
     gint flip_y = (gint) pow(2, zoom)-1 - y;
 
-    gchar *ins = g_strdup_printf
-      ("INSERT INTO tiles VALUES (%d, %d, %d, ?);", zoom, x, flip_y);
-
-    sqlite3_stmt *sql_stmt;
-    ans = sqlite3_prepare_v2 ( mbtiles, ins, -1, &sql_stmt, NULL );
-    g_free ( ins );
+    (void)sqlite3_bind_int ( sql_stmt, 1, zoom );
+    (void)sqlite3_bind_int ( sql_stmt, 2, x );
+    (void)sqlite3_bind_int ( sql_stmt, 3, flip_y );
+    ans = sqlite3_bind_blob ( sql_stmt, 4, buffer, size, SQLITE_STATIC );
     if ( ans != SQLITE_OK ) {
       msg = g_strdup ( sqlite3_errmsg(mbtiles) );
-      goto cleanup;
-    }
-
-    gchar *buffer;
-    gsize size;
-    GError *error = NULL;
-    ans = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
-    if ( error ) {
-      msg = g_strdup ( error->message );
-      g_error_free ( error );
-      goto cleanup;
-    }
-
-    ans = sqlite3_bind_blob ( sql_stmt, 1, buffer, size, g_free );
-    if ( ans != SQLITE_OK ) {
-      msg = g_strdup ( err_msg );
-      sqlite3_free ( err_msg );
-      goto cleanup;
+      break;
     }
 
     int step = sqlite3_step ( sql_stmt );
     // This should always complete
     if ( step != SQLITE_DONE ) {
       msg = g_strdup_printf ( "sqlite3_step result was %d", step );
-      goto cleanup;
+      break;
+    }
+    (void)sqlite3_reset ( sql_stmt );
+
+    num_tiles++;
+    if ( num_tiles % TAC_MBTILES_BATCH == 0 ) {
+      (void)sqlite3_exec ( mbtiles, "COMMIT;", 0, 0, NULL );
+      in_transaction = FALSE;
     }
+  }
 
-    (void)sqlite3_finalize ( sql_stmt );
+  if ( in_transaction )
+    (void)sqlite3_exec ( mbtiles, "COMMIT;", 0, 0, NULL );
+  (void)sqlite3_finalize ( sql_stmt );
+  g_free ( buffer );
 
-    // Minimize filesize
+  // Minimize filesize
+  if ( !msg && result == 0 )
     (void)sqlite3_exec ( mbtiles, "ANALYZE; VACUUM;", 0, 0, NULL );
-  }
 
  cleanup:
   (void)sqlite3_close ( mbtiles );
@@ -2879,7 +4764,7 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
                         mbt,
                         (vik_thr_free_func)mbt_free,
                         NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
-                        g_hash_table_size(val->tiles) );
+                        tac_tiles_size(val->tiles) );
 }
 #endif
 
@@ -3038,6 +4923,8 @@ static void hm_calculate_cb ( menu_array_values values )
   if ( val->hm_calculating ) {
     return;
   }
+  // Count from the tracks as they are now
+  hm_ctx_set_cube ( val->hm_ctx, NULL );
   hm_calculate ( val );
 }
 
@@ -3109,7 +4996,7 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
     gtk_widget_set_sensitive ( itemhmc, hm_available );
 
     GtkWidget *itemhmlr = vu_menu_add_item ( hm_submenu, _("_Remove"), GTK_STOCK_DELETE, G_CALLBACK(hm_clear_cb), values );
-    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL) );
+    gtk_widget_set_sensitive ( itemhmlr, hm_has_bins(val) );
   }
 }
 
@@ -3260,6 +5147,14 @@ static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *me
 
   (void)vu_menu_add_item ( menu, _("_Statistics"), GTK_STOCK_INFO, G_CALLBACK(aggregate_layer_analyse), values );
   (void)vu_menu_add_item ( menu, _("Track _List..."), GTK_STOCK_INDEX, G_CALLBACK(aggregate_layer_track_list_dialog), values );
+
+  GtkMenu *dem_submenu = GTK_MENU(gtk_menu_new());
+  GtkWidget *itemdem = vu_menu_add_item ( menu, _("_Apply DEM Data"), "vik-icon-DEM Download", NULL, NULL );
+  gtk_menu_item_set_submenu ( GTK_MENU_ITEM(itemdem), GTK_WIDGET(dem_submenu) );
+  GtkWidget *itemow = vu_menu_add_item ( dem_submenu, _("_Overwrite"), NULL, G_CALLBACK(aggregate_layer_apply_dem_data_all), values );
+  gtk_widget_set_tooltip_text ( itemow, _("Overwrite any existing elevation values with DEM values") );
+  GtkWidget *itemke = vu_menu_add_item ( dem_submenu, _("_Keep Existing"), NULL, G_CALLBACK(aggregate_layer_apply_dem_data_only_missing), values );
+  gtk_widget_set_tooltip_text ( itemke, _("Keep existing elevation values, only attempt for missing values") );
   (void)vu_menu_add_item ( menu, _("_Waypoint List..."), GTK_STOCK_INDEX, G_CALLBACK(aggregate_layer_waypoint_list_dialog), values );
 
   GtkMenu *search_submenu = GTK_MENU(gtk_menu_new());
@@ -3298,10 +5193,14 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   g_list_foreach ( val->children, (GFunc)(disconnect_layer_signal), val );
   g_list_foreach ( val->children, (GFunc)(g_object_unref), NULL );
   g_list_free ( val->children );
+  aggregate_children_changes++;
+  if ( val->flat_tracks )
+    g_array_unref ( val->flat_tracks );
+  g_array_free ( val->flat_sources, TRUE );
   if ( val->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( val->tracks_analysis_dialog );
 
-  g_hash_table_destroy ( val->tiles );
+  tac_tiles_free ( val->tiles );
   for ( guint ii=0; ii<CP_NUM; ii++ ) {
     if ( val->pixbuf[ii] )
       g_object_unref ( val->pixbuf[ii] );
@@ -3310,14 +5209,17 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   }
   if ( val->unreachable_pixbuf )
     g_object_unref ( val->unreachable_pixbuf );
-  g_hash_table_destroy ( val->tiles_clust );
-  g_hash_table_destroy ( val->tiles_new );
-  g_hash_table_destroy ( val->prev );
+  tac_tiles_free ( val->tiles_clust );
+  tac_tiles_free ( val->tiles_new );
+  g_hash_table_destroy ( val->tac_tracks );
+  uf_finish ( &val->uf_contig );
+  uf_finish ( &val->uf_clust );
 
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  // Any queued drawing still has the context, so just mark that the layer has gone
+  g_mutex_lock ( val->hm_ctx->mutex );
+  val->hm_ctx->val = NULL;
+  g_mutex_unlock ( val->hm_ctx->mutex );
+  hm_ctx_unref ( val->hm_ctx );
 }
 
 static void delete_layer_iter ( VikLayer *vl )
@@ -3333,11 +5235,13 @@ void vik_aggregate_layer_clear ( VikAggregateLayer *val )
   g_list_foreach ( val->children, (GFunc)(g_object_unref), NULL );
   g_list_free ( val->children );
   val->children = NULL;
+  aggregate_children_changes++;
 }
 
 static void aggregate_layer_delete_common ( VikAggregateLayer *val, VikLayer *vl )
 {
   val->children = g_list_remove ( val->children, vl );
+  aggregate_children_changes++;
   disconnect_layer_signal ( vl, val );
   g_object_unref ( vl );
 }
@@ -72,10 +72,14 @@ guint vik_aggregate_layer_count ( VikAggregateLayer *val );
 gboolean vik_aggregate_layer_search_date ( VikAggregateLayer *val, gchar *date_str );
 
 void vik_aggregate_layer_file_load_complete ( VikAggregateLayer *val );
+gboolean vik_aggregate_layer_time_filter_changed ( VikAggregateLayer *val );
 
 void vik_aggregate_layer_export_gpx_setup ( VikAggregateLayer *val, gboolean to_gpsbabel );
 gboolean vik_aggregate_layer_export_gpx_main ( VikAggregateLayer *val, FILE *ff, const gchar *filename );
 
+gint vik_aggregate_layer_tac_calculate_now ( VikAggregateLayer *val, gboolean from_scratch );
+gint vik_aggregate_layer_hm_calculate_now ( VikAggregateLayer *val, gint level );
+
 G_END_DECLS
 
 #endif
@@ -130,12 +130,29 @@ VikLayerInterface vik_coord_layer_interface = {
   (VikLayerFuncRefresh)                 NULL,
 };
 
+enum { GRID_DEGREES = 0, GRID_MINUTES, GRID_SECONDS };
+
+typedef struct {
+  gint x1, y1, x2, y2;
+  guint8 weight;
+} GridLine;
+
 struct _VikCoordLayer {
   VikLayer vl;
   GdkGC *gc;
+  GdkGC *minutes_gc;
+  GdkGC *seconds_gc;
   gdouble deg_inc;
   guint8 line_thickness;
   GdkColor color;
+  // Screen positions of the grid lines for the view they were made for,
+  //  so panning only has to move them - see coord_layer_grid_offset()
+  GArray *grid;
+  gboolean grid_valid;
+  VikCoord grid_centre;
+  VikViewportDrawMode grid_drawmode;
+  gdouble grid_xmpp, grid_ympp;
+  gint grid_width, grid_height;
 };
 
 GType vik_coord_layer_get_type ()
@@ -191,6 +208,8 @@ gboolean coord_layer_set_param ( VikCoordLayer *vcl, VikLayerSetParam *vlsp )
       gdouble old = vcl->deg_inc;
       vcl->deg_inc = vlsp->data.d / 60.0;
       changed = util_gdouble_different ( old, vcl->deg_inc );
+      if ( changed )
+        vcl->grid_valid = FALSE;
       break;
     }
     case PARAM_LINE_THICKNESS:
@@ -232,38 +251,116 @@ static VikCoordLayer *coord_layer_new ( VikViewport *vvp )
   vik_layer_set_defaults ( VIK_LAYER(vcl), vvp );
 
   vcl->gc = NULL;
+  vcl->minutes_gc = NULL;
+  vcl->seconds_gc = NULL;
+  vcl->grid = NULL;
+  vcl->grid_valid = FALSE;
   return vcl;
 }
 
-static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+// Most times a grid line is halved to follow its curve on screen
+#define GRID_MAX_DEPTH 6
+// Once there are this many pieces, further lines are drawn straight
+#define GRID_MAX_LINES 20000
+
+static void grid_latlon_to_screen ( VikViewport *vp, const struct LatLon *ll, gint *x, gint *y )
 {
-  if ( !vcl->gc ) {
+  VikCoord coord;
+  vik_coord_load_from_latlon ( &coord, vik_viewport_get_coord_mode(vp), ll );
+  vik_viewport_coord_to_screen ( vp, &coord, x, y );
+}
+
+/**
+ * Add the line from a to b, split in halves while it bends more than a pixel away from straight
+ */
+static void grid_add_line_part ( GArray *grid, VikViewport *vp, const struct LatLon *a, gint ax, gint ay, const struct LatLon *b, gint bx, gint by, guint8 weight, guint depth )
+{
+  if ( ax == VIK_VIEWPORT_UTM_WRONG_ZONE && bx == VIK_VIEWPORT_UTM_WRONG_ZONE )
     return;
+
+  if ( depth < GRID_MAX_DEPTH && grid->len < GRID_MAX_LINES ) {
+    struct LatLon mid = { (a->lat + b->lat) / 2, (a->lon + b->lon) / 2 };
+    gint mx, my;
+    grid_latlon_to_screen ( vp, &mid, &mx, &my );
+    // Distance of the middle from the chord
+    gdouble len = hypot ( bx - ax, by - ay );
+    gdouble dist = len > 0 ? fabs ( (gdouble)(bx - ax) * (my - ay) - (gdouble)(by - ay) * (mx - ax) ) / len : 0;
+    if ( dist > 1.0 || ax == VIK_VIEWPORT_UTM_WRONG_ZONE || bx == VIK_VIEWPORT_UTM_WRONG_ZONE ) {
+      grid_add_line_part ( grid, vp, a, ax, ay, &mid, mx, my, weight, depth+1 );
+      grid_add_line_part ( grid, vp, &mid, mx, my, b, bx, by, weight, depth+1 );
+      return;
+    }
+  }
+
+  if ( ax == VIK_VIEWPORT_UTM_WRONG_ZONE || bx == VIK_VIEWPORT_UTM_WRONG_ZONE )
+    return;
+  GridLine line = { ax, ay, bx, by, weight };
+  g_array_append_val ( grid, line );
+}
+
+static void grid_add_line ( GArray *grid, VikViewport *vp, gdouble lat1, gdouble lon1, gdouble lat2, gdouble lon2, guint8 weight )
+{
+  struct LatLon a = { lat1, lon1 }, b = { lat2, lon2 };
+  gint ax, ay, bx, by;
+  grid_latlon_to_screen ( vp, &a, &ax, &ay );
+  grid_latlon_to_screen ( vp, &b, &bx, &by );
+  grid_add_line_part ( grid, vp, &a, ax, ay, &b, bx, by, weight, 0 );
+}
+
+/**
+ * Work out the grid lines for the view and half a view more all around it
+ */
+static void coord_layer_grid_build ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  gint width = vik_viewport_get_width ( vp );
+  gint height = vik_viewport_get_height ( vp );
+  struct LatLon min, max;
+  gint corner;
+
+  if ( vcl->grid )
+    g_array_set_size ( vcl->grid, 0 );
+  else
+    vcl->grid = g_array_new ( FALSE, FALSE, sizeof(GridLine) );
+
+  vcl->grid_valid = TRUE;
+  vcl->grid_centre = *vik_viewport_get_center ( vp );
+  vcl->grid_drawmode = vik_viewport_get_drawmode ( vp );
+  vcl->grid_xmpp = vik_viewport_get_xmpp ( vp );
+  vcl->grid_ympp = vik_viewport_get_ympp ( vp );
+  vcl->grid_width = width;
+  vcl->grid_height = height;
+
+  for ( corner = 0; corner < 4; corner++ ) {
+    VikCoord coord;
+    struct LatLon ll;
+    vik_viewport_screen_to_coord ( vp, (corner & 1) ? width + width/2 : -width/2, (corner & 2) ? height + height/2 : -height/2, &coord );
+    vik_coord_to_latlon ( &coord, &ll );
+    if ( corner == 0 )
+      min = max = ll;
+    min.lat = MIN ( min.lat, ll.lat );
+    min.lon = MIN ( min.lon, ll.lon );
+    max.lat = MAX ( max.lat, ll.lat );
+    max.lon = MAX ( max.lon, ll.lon );
   }
 
+  /* Can zoom out more than whole world and so the above can give invalid positions */
+  /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
+  gdouble lat_limit = ( vcl->grid_drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) ? 85.0511 : 90.0;
+  min.lon = MAX ( min.lon, -180.0 );
+  max.lon = MIN ( max.lon, 180.0 );
+  min.lat = MAX ( min.lat, -lat_limit );
+  max.lat = MIN ( max.lat, lat_limit );
+
   if ( vik_viewport_get_coord_mode(vp) != VIK_COORD_UTM )
   {
-    VikCoord left, right, left2, right2;
+    VikCoord left, right;
     gdouble l, r, i, j;
-    gint x1, y1, x2, y2, smod = 1, mmod = 1;
+    gint smod = 1, mmod = 1;
     gboolean mins = FALSE, secs = FALSE;
-    gint mlt = MAX(vcl->line_thickness/2, 1);
-    gint slt = MAX(vcl->line_thickness/5, 1);
-    GdkGC *dgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), vcl->line_thickness);
-    GdkGC *mgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), mlt);
-    GdkGC *sgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), slt);
 
+    // How many lines depends on just the visible width
     vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &right );
-    vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &left2 );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &right2 );
-
-#define CLINE(gc, c1, c2, lt) {                              \
-	  vik_viewport_coord_to_screen(vp, (c1), &x1, &y1);  \
-	  vik_viewport_coord_to_screen(vp, (c2), &x2, &y2);  \
-	  vik_viewport_draw_line (vp, (gc), x1, y1, x2, y2, &vcl->color, lt); \
-	}
-
+    vik_viewport_screen_to_coord ( vp, width, 0, &right );
     l = left.east_west;
     r = right.east_west;
     if (60*fabs(l-r) < 4) {
@@ -274,154 +371,111 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
       mins = TRUE;
       mmod = MIN(6, (int)ceil(60*fabs(l-r)/30.0));
     }
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
+
+    for (i=floor(min.lon*60); i<ceil(max.lon*60); i+=1.0) {
       if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.east_west = j/3600.0;
-	  left2.east_west = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &left2, slt);
-	}
-      }
-      if (mins) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &left2, mlt);
-      }
-      if ((int)i % 60 == 0) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	CLINE(dgc, &left, &left2, vcl->line_thickness);
+        for (j=i*60+1; j<(i+1)*60; j+=1.0)
+          if ((int)j % smod == 0) grid_add_line ( vcl->grid, vp, min.lat, j/3600.0, max.lat, j/3600.0, GRID_SECONDS );
       }
+      if ((int)i % 60 == 0)
+        grid_add_line ( vcl->grid, vp, min.lat, i/60.0, max.lat, i/60.0, GRID_DEGREES );
+      else if (mins && (int)i % mmod == 0)
+        grid_add_line ( vcl->grid, vp, min.lat, i/60.0, max.lat, i/60.0, GRID_MINUTES );
     }
 
-    vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    l = left2.north_south;
-    r = left.north_south;
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
+    for (i=floor(min.lat*60); i<ceil(max.lat*60); i+=1.0) {
       if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.north_south = j/3600.0;
-	  right.north_south = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &right, slt);
-	}
-      }
-      if (mins) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &right, mlt);
-      }
-      if ((int)i % 60 == 0) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	CLINE(dgc, &left, &right, vcl->line_thickness);
+        for (j=i*60+1; j<(i+1)*60; j+=1.0)
+          if ((int)j % smod == 0) grid_add_line ( vcl->grid, vp, j/3600.0, min.lon, j/3600.0, max.lon, GRID_SECONDS );
       }
+      if ((int)i % 60 == 0)
+        grid_add_line ( vcl->grid, vp, i/60.0, min.lon, i/60.0, max.lon, GRID_DEGREES );
+      else if (mins && (int)i % mmod == 0)
+        grid_add_line ( vcl->grid, vp, i/60.0, min.lon, i/60.0, max.lon, GRID_MINUTES );
     }
-#undef CLINE
-    ui_gc_unref(dgc);
-    ui_gc_unref(sgc);
-    ui_gc_unref(mgc);
-    return;
   }
-
-  if ( vik_viewport_get_coord_mode(vp) == VIK_COORD_UTM )
+  else
   {
-    const struct UTM *center = (const struct UTM *)vik_viewport_get_center ( vp );
-    gdouble xmpp = vik_viewport_get_xmpp ( vp ), ympp = vik_viewport_get_ympp ( vp );
-    guint16 width = vik_viewport_get_width ( vp ), height = vik_viewport_get_height ( vp );
-    struct LatLon ll, ll2, min, max;
-    double lon;
-    int x1, x2;
-    struct UTM utm;
-
-    utm = *center;
-    utm.northing = center->northing - ( ympp * height / 2 );
-
-    a_coords_utm_to_latlon ( &utm, &ll );
-
-    utm.northing = center->northing + ( ympp * height / 2 );
-
-    a_coords_utm_to_latlon ( &utm, &ll2 );
-
-    {
-      /* find corner coords in lat/lon.
-        start at whichever is less: top or bottom left lon. goto whichever more: top or bottom right lon
-      */
-      struct LatLon topleft, topright, bottomleft, bottomright;
-      struct UTM temp_utm;
-      temp_utm = *center;
-      temp_utm.easting -= (width/2)*xmpp;
-      temp_utm.northing += (height/2)*ympp;
-      a_coords_utm_to_latlon ( &temp_utm, &topleft );
-      temp_utm.easting += (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &topright );
-      temp_utm.northing -= (height*ympp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomright );
-      temp_utm.easting -= (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomleft );
-      min.lon = (topleft.lon < bottomleft.lon) ? topleft.lon : bottomleft.lon;
-      max.lon = (topright.lon > bottomright.lon) ? topright.lon : bottomright.lon;
-      min.lat = (bottomleft.lat < bottomright.lat) ? bottomleft.lat : bottomright.lat;
-      max.lat = (topleft.lat > topright.lat) ? topleft.lat : topright.lat;
-    }
-
-    /* Can zoom out more than whole world and so the above can give invalid positions */
-    /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
-    if ( min.lon < -180.0 )
-      min.lon = -180.0;
-    if ( max.lon > 180.0 )
-      max.lon = 180.0;
-    if ( min.lat < -90.0 )
-      min.lat = -90.0;
-    if ( max.lat > 90.0 )
-      max.lat = 90.0;
-
-    lon = ((double) ((long) ((min.lon)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lon = ll2.lon = lon;
-
-    for (; ll.lon <= max.lon; ll.lon+=vcl->deg_inc, ll2.lon+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      vik_viewport_draw_line (vp, vcl->gc, x1, height, x2, 0, &(vcl->color), vcl->line_thickness);
-    }
-
-    utm = *center;
-    utm.easting = center->easting - ( xmpp * width / 2 );
-
-    a_coords_utm_to_latlon ( &utm, &ll );
+    gdouble deg;
+    for ( deg = ((double) ((long) ((min.lon)/ vcl->deg_inc))) * vcl->deg_inc; deg <= max.lon; deg += vcl->deg_inc )
+      grid_add_line ( vcl->grid, vp, min.lat, deg, max.lat, deg, GRID_DEGREES );
+    for ( deg = ((double) ((long) ((min.lat)/ vcl->deg_inc))) * vcl->deg_inc; deg <= max.lat; deg += vcl->deg_inc )
+      grid_add_line ( vcl->grid, vp, deg, min.lon, deg, max.lon, GRID_DEGREES );
+  }
+}
 
-    utm.easting = center->easting + ( xmpp * width / 2 );
+/**
+ * Returns: Whether the grid lines worked out before can be used for this view,
+ *  and if so how far they have moved on the screen since
+ */
+static gboolean coord_layer_grid_offset ( VikCoordLayer *vcl, VikViewport *vp, gint *dx, gint *dy )
+{
+  if ( !vcl->grid_valid )
+    return FALSE;
+
+  const VikCoord *centre = vik_viewport_get_center ( vp );
+  gint width = vik_viewport_get_width ( vp );
+  gint height = vik_viewport_get_height ( vp );
+  // Moving about in the Expedia projection changes the shape of the lines, not just their position
+  if ( centre->mode != vcl->grid_centre.mode ||
+       vik_viewport_get_drawmode(vp) != vcl->grid_drawmode ||
+       vcl->grid_drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ||
+       vik_viewport_get_xmpp(vp) != vcl->grid_xmpp ||
+       vik_viewport_get_ympp(vp) != vcl->grid_ympp ||
+       width != vcl->grid_width || height != vcl->grid_height )
+    return FALSE;
+  if ( centre->mode == VIK_COORD_UTM && centre->utm_zone != vcl->grid_centre.utm_zone )
+    return FALSE;
+
+  gint x, y;
+  vik_viewport_coord_to_screen ( vp, &vcl->grid_centre, &x, &y );
+  *dx = x - width/2;
+  *dy = y - height/2;
+  return ABS(*dx) <= width/2 && ABS(*dy) <= height/2;
+}
 
-    a_coords_utm_to_latlon ( &utm, &ll2 );
+static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  if ( !vcl->gc ) {
+    return;
+  }
 
-    /* really lat, just reusing a variable */
-    lon = ((double) ((long) ((min.lat)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lat = ll2.lat = lon;
+  gint dx, dy;
+  if ( !coord_layer_grid_offset ( vcl, vp, &dx, &dy ) ) {
+    coord_layer_grid_build ( vcl, vp );
+    dx = dy = 0;
+  }
 
-    for (; ll.lat <= max.lat ; ll.lat+=vcl->deg_inc, ll2.lat+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      vik_viewport_draw_line (vp, vcl->gc, width, x2, 0, x1, &(vcl->color), vcl->line_thickness);
-    }
+  GdkGC *gcs[] = { vcl->gc, vcl->minutes_gc, vcl->seconds_gc };
+  gint thicknesses[] = { vcl->line_thickness, MAX(vcl->line_thickness/2, 1), MAX(vcl->line_thickness/5, 1) };
+  guint ii;
+  for ( ii = 0; ii < vcl->grid->len; ii++ ) {
+    GridLine *line = &g_array_index ( vcl->grid, GridLine, ii );
+    vik_viewport_draw_line ( vp, gcs[line->weight], line->x1 + dx, line->y1 + dy, line->x2 + dx, line->y2 + dy, &vcl->color, thicknesses[line->weight] );
   }
 }
 
 static void coord_layer_free ( VikCoordLayer *vcl )
 {
-  if ( vcl->gc != NULL )
+  if ( vcl->gc != NULL ) {
     ui_gc_unref ( vcl->gc );
+    ui_gc_unref ( vcl->minutes_gc );
+    ui_gc_unref ( vcl->seconds_gc );
+  }
+  if ( vcl->grid )
+    g_array_free ( vcl->grid, TRUE );
 }
 
 static void coord_layer_update_gc ( VikCoordLayer *vcl, VikViewport *vp )
 {
-  if ( vcl->gc )
+  if ( vcl->gc ) {
     ui_gc_unref ( vcl->gc );
+    ui_gc_unref ( vcl->minutes_gc );
+    ui_gc_unref ( vcl->seconds_gc );
+  }
   vcl->gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), vcl->line_thickness );
+  vcl->minutes_gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/2, 1) );
+  vcl->seconds_gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/5, 1) );
 }
 
 static VikCoordLayer *coord_layer_create ( VikViewport *vp )
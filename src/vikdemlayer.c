@@ -37,10 +37,11 @@
 #include "dem.h"
 #include "dems.h"
 #include "bbox.h"
+#include "mapcache.h"
+#include "map_ids.h"
 
 #define DEM_FIXED_NAME "DEM"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
-#define SRTM_CACHE_TEMPLATE "%ssrtm3-%s%s%c%02d%c%03d.hgt.zip"
 // Legacy USGS location that stopped in 2021
 //#define SRTM_HTTP_BASE_URL "https://dds.cr.usgs.gov/srtm/version2_1/SRTM3"
 
@@ -60,6 +61,25 @@
 static gchar *base_url = NULL;
 #define VIK_SETTINGS_SRTM_HTTP_BASE_URL "srtm_http_base_url"
 
+// Destination files of prefetches that are waiting or running, or that have failed
+//  (failures are not retried during this run of the program)
+static GMutex *prefetch_mutex = NULL;
+static GHashTable *prefetch_requested = NULL;
+
+// Which tiles are in the cache directory, found by a single scan of it on first drawing the existence
+//  and then kept up to date as downloads complete, so drawing never has to look at the disk
+static gboolean coverage_scanned = FALSE;
+// A bit per whole degree SRTM tile, set atomically by the download threads
+static guint srtm_coverage[180][(360+31)/32];
+#ifdef VIK_CONFIG_DEM24K
+// Keys of the 1/8 degree DEM24K tiles - see dem24k_coverage_key()
+static GMutex *dem24k_coverage_mutex = NULL;
+static GHashTable *dem24k_coverage = NULL;
+#endif
+
+// Fwd declaration
+static void dem_coverage_add ( guint source, gdouble lat, gdouble lon );
+
 #ifdef VIK_CONFIG_DEM24K
 #define DEM24K_DOWNLOAD_SCRIPT "dem24k.pl"
 #endif
@@ -71,6 +91,7 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp );
 static void dem_layer_free ( VikDEMLayer *vdl );
 static VikDEMLayer *dem_layer_create ( VikViewport *vp );
 static const gchar* dem_layer_tooltip( VikDEMLayer *vdl );
+static gsize dem_layer_get_memory_usage ( VikDEMLayer *vdl );
 static void dem_layer_marshall( VikDEMLayer *vdl, guint8 **data, guint *len );
 static VikDEMLayer *dem_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp );
@@ -79,6 +100,8 @@ static void dem_layer_change_param ( GtkWidget *widget, ui_change_values values
 static void dem_layer_post_read ( VikDEMLayer *vdl, VikViewport *vp, gboolean from_file );
 static void srtm_draw_existence ( VikViewport *vp );
 static void dem_layer_apply_colors ( VikDEMLayer *vdl );
+static void dem_layer_apply_lighting ( VikDEMLayer *vdl );
+static void dem_layer_prefetch ( VikDEMLayer *vdl, VikViewport *vp );
 
 #ifdef VIK_CONFIG_DEM24K
 static void dem24k_draw_existence ( VikViewport *vp );
@@ -89,6 +112,8 @@ static VikLayerParamScale param_scales[] = {
   { -100, 30000, 10, 1 },
   { 0, 30000, 10, 1 },
   { 0, 255, 3, 0 }, // alpha
+  { 0, 359, 5, 0 }, // light azimuth
+  { 0, 90, 5, 0 }, // light altitude
 };
 
 static gchar *params_source[] = {
@@ -102,6 +127,8 @@ static gchar *params_source[] = {
 static gchar *params_type[] = {
 	N_("Absolute height"),
 	N_("Height gradient"),
+	N_("Hillshade"),
+	N_("Slope"),
 	NULL
 };
 
@@ -113,6 +140,8 @@ enum { DEM_SOURCE_SRTM,
 
 enum { DEM_TYPE_HEIGHT = 0,
        DEM_TYPE_GRADIENT,
+       DEM_TYPE_HILLSHADE,
+       DEM_TYPE_SLOPE,
        DEM_TYPE_NONE,
 };
 
@@ -152,6 +181,9 @@ static VikLayerParamData min_elev_default ( void ) { return VIK_LPD_DOUBLE ( 0.0
 static VikLayerParamData max_elev_default ( void ) { return VIK_LPD_DOUBLE ( 1000.0 ); }
 static VikLayerParamData color_scheme_default ( void ) { return VIK_LPD_UINT ( DEM_CS_DEFAULT ); }
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
+// Conventionally lit from the north west
+static VikLayerParamData light_azimuth_default ( void ) { return VIK_LPD_UINT ( 315 ); }
+static VikLayerParamData light_altitude_default ( void ) { return VIK_LPD_UINT ( 45 ); }
 
 static VikLayerParamData dir_scheme_default ( void ) { return VIK_LPD_UINT ( DEM_SCHEME_NONE ); }
 static VikLayerParamData filename_style_default ( void ) { return VIK_LPD_UINT ( DEM_FILENAME_SRTMGL1 ); }
@@ -187,6 +219,8 @@ static VikLayerParam dem_layer_params[] = {
   { VIK_LAYER_DEM, "srtm_url_base", VIK_LAYER_PARAM_STRING, GROUP_DOWNLOAD, N_("Base URL:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, url_default, NULL, NULL },
   { VIK_LAYER_DEM, "srtm_server_dir_scheme", VIK_LAYER_PARAM_UINT, GROUP_DOWNLOAD, N_("Layout:"), VIK_LAYER_WIDGET_COMBOBOX, params_dir_schemes, NULL, NULL, dir_scheme_default, NULL, NULL },
   { VIK_LAYER_DEM, "srtm_server_filename_style", VIK_LAYER_PARAM_UINT, GROUP_DOWNLOAD, N_("Filename Convention:"), VIK_LAYER_WIDGET_COMBOBOX, params_filename_styles, NULL, NULL, filename_style_default, NULL, NULL },
+  { VIK_LAYER_DEM, "prefetch", VIK_LAYER_PARAM_BOOLEAN, GROUP_DOWNLOAD, N_("Prefetch:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Automatically download the SRTM DEMs around the view and along the selected track or route"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_DEM, "color", VIK_LAYER_PARAM_COLOR, GROUP_DRAWING, N_("Min Elev Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_default, NULL, NULL },
   { VIK_LAYER_DEM, "color_scheme", VIK_LAYER_PARAM_UINT, GROUP_DRAWING, N_("Color Scheme:"), VIK_LAYER_WIDGET_COMBOBOX, params_color_schemes, NULL, NULL, color_scheme_default, NULL, NULL },
   { VIK_LAYER_DEM, "color_min", VIK_LAYER_PARAM_COLOR, GROUP_DRAWING, N_("Start Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_min_default, NULL, NULL },
@@ -196,6 +230,10 @@ static VikLayerParam dem_layer_params[] = {
   { VIK_LAYER_DEM, "max_elev", VIK_LAYER_PARAM_DOUBLE, GROUP_DRAWING, N_("Max Elev:"), VIK_LAYER_WIDGET_SPINBUTTON, param_scales + 0, NULL, NULL, max_elev_default, NULL, NULL },
   { VIK_LAYER_DEM, "alpha", VIK_LAYER_PARAM_UINT, GROUP_DRAWING, N_("Alpha:"), VIK_LAYER_WIDGET_HSCALE, param_scales+2, NULL,
     N_("Control the Alpha value for transparency effects"), alpha_default, NULL, NULL },
+  { VIK_LAYER_DEM, "light_azimuth", VIK_LAYER_PARAM_UINT, GROUP_DRAWING, N_("Light Direction:"), VIK_LAYER_WIDGET_SPINBUTTON, param_scales+3, NULL,
+    N_("The compass direction (in degrees) that hillshading is lit from"), light_azimuth_default, NULL, NULL },
+  { VIK_LAYER_DEM, "light_altitude", VIK_LAYER_PARAM_UINT, GROUP_DRAWING, N_("Light Elevation:"), VIK_LAYER_WIDGET_SPINBUTTON, param_scales+4, NULL,
+    N_("The angle (in degrees) above the horizon that hillshading is lit from"), light_altitude_default, NULL, NULL },
   { VIK_LAYER_DEM, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -208,6 +246,7 @@ enum {
       PARAM_SRTM_BASE_URL,
       PARAM_SVR_DIR_SCHEME,
       PARAM_SVR_FILENAME_STYLE,
+      PARAM_PREFETCH,
       // Drawing options
       PARAM_COLOR,
       PARAM_COLOR_SCHEME,
@@ -217,6 +256,8 @@ enum {
       PARAM_MIN_ELEV,
       PARAM_MAX_ELEV,
       PARAM_ALPHA,
+      PARAM_LIGHT_AZIMUTH,
+      PARAM_LIGHT_ALTITUDE,
       PARAM_RESET,
       NUM_PARAMS
 };
@@ -342,8 +383,14 @@ VikLayerInterface vik_dem_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+
+  (VikLayerFuncDrawSurface)             NULL,
+
+  (VikLayerFuncGetMemoryUsage)          dem_layer_get_memory_usage,
 };
 
+typedef struct _DEMRenderContext DEMRenderContext;
+
 struct _VikDEMLayer {
   VikLayer vl;
   GList *files;
@@ -356,6 +403,14 @@ struct _VikDEMLayer {
   guint source;
   guint type;
   guint alpha;
+  guint light_azimuth;
+  guint light_altitude;
+  gboolean prefetch;
+
+  // What the last prefetch was for, so it's only repeated when these change
+  gboolean prefetch_done;
+  gint prefetch_cells[4]; // Degree cell range of the view: south, north, west, east
+  VikTrack *prefetch_track;
 
   gchar *srtm_base_url;
   // Server side only
@@ -365,13 +420,18 @@ struct _VikDEMLayer {
 
   GdkColor *height_colors;
   GdkColor *gradient_colors;
+  guint8 *shade_lut; // Brightness for each quantised normal, under the current lighting
 
-  guchar *pixels;
+  DEMRenderContext *render_ctx;
 
   // right click menu only stuff - similar to mapslayer
   GtkMenu *right_click_menu;
 };
 
+static DEMRenderContext *dem_render_ctx_new ( VikDEMLayer *vdl );
+static void dem_render_ctx_unref ( DEMRenderContext *ctx );
+static void dem_render_invalidate ( DEMRenderContext *ctx );
+
 #define VIKING_DEM_PARAMS_GROUP_KEY "dem_srtm"
 #define VIKING_DEM_PARAMS_NAMESPACE "dem_srtm."
 
@@ -383,6 +443,9 @@ static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, DEM_PASSWORD, VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("Password:"), VIK_LAYER_WIDGET_PASSWORD, NULL, NULL, NULL, NULL, NULL, NULL },
 };
 
+// Fwd declaration
+static void srtm_continent_init ();
+
 /**
  * Very early initialization, even before vik_dem_class_init()
  * Thus values available for the layer initialization
@@ -403,6 +466,14 @@ void vik_dem_layer_init ()
     base_url = g_strdup ( SRTM_HTTP_BASE_URL );
   }
 
+  prefetch_mutex = vik_mutex_new ();
+  prefetch_requested = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+  srtm_continent_init ();
+#ifdef VIK_CONFIG_DEM24K
+  dem24k_coverage_mutex = vik_mutex_new ();
+  dem24k_coverage = g_hash_table_new ( g_direct_hash, g_direct_equal );
+#endif
 }
 
 static GdkColor black_color;
@@ -457,11 +528,29 @@ GType vik_dem_layer_get_type ()
 
 static const gchar* dem_layer_tooltip( VikDEMLayer *vdl )
 {
-  static gchar tmp_buf[100];
-  g_snprintf (tmp_buf, sizeof(tmp_buf), _("Number of files: %d"), g_list_length (vdl->files));
+  static gchar tmp_buf[160];
+  guint count, resident;
+  guint64 bytes;
+  a_dems_get_usage ( &count, &resident, &bytes );
+  gchar *size = g_format_size ( bytes );
+  g_snprintf (tmp_buf, sizeof(tmp_buf), _("Number of files: %d\nAll DEMs loaded: %d of %d (%s)"), g_list_length (vdl->files), resident, count, size);
+  g_free ( size );
   return tmp_buf;
 }
 
+/**
+ * The layer's files that are currently loaded
+ *  (DEMs are shared, so a file used by more than one layer is counted for each)
+ */
+static gsize dem_layer_get_memory_usage ( VikDEMLayer *vdl )
+{
+  gsize size = 0;
+  GList *iter;
+  for ( iter = vdl->files; iter; iter = iter->next )
+    size += a_dems_get_file_usage ( (const gchar*)iter->data );
+  return size;
+}
+
 static void dem_layer_marshall( VikDEMLayer *vdl, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vdl), data, len );
@@ -498,8 +587,11 @@ static int dem_layer_load_list_thread ( dem_load_thread_data *dltd, gpointer thr
   // ATM as each file is processed the screen is not updated (no mechanism exposed to a_dems_load_list)
   // Thus force draw only at the end, as loading is complete/aborted
   // Test is helpful to prevent Gtk-CRITICAL warnings if the program is exitted whilst loading
-  if ( IS_VIK_LAYER(dltd->vdl) )
+  if ( IS_VIK_LAYER(dltd->vdl) ) {
+    // Anything drawn part way through loading may be missing DEMs
+    dem_render_invalidate ( dltd->vdl->render_ctx );
     vik_layer_emit_update ( VIK_LAYER(dltd->vdl), FALSE ); // NB update requested from background thread
+  }
 
   return result;
 }
@@ -575,6 +667,8 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       break;
     case PARAM_SOURCE:
       changed = vik_layer_param_change_uint ( vlsp->data, &vdl->source );
+      if ( changed )
+        vdl->prefetch_done = FALSE;
       break;
     case PARAM_SRTM_BASE_URL:
       changed = vik_layer_param_change_string ( vlsp->data, &vdl->srtm_base_url );
@@ -591,6 +685,11 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       else
         g_warning ( "%s: Unknown filename style", __FUNCTION__ );
       break;
+    case PARAM_PREFETCH:
+      changed = vik_layer_param_change_boolean ( vlsp->data, &vdl->prefetch );
+      if ( changed )
+        vdl->prefetch_done = FALSE;
+      break;
     case PARAM_TYPE:
       changed = vik_layer_param_change_uint ( vlsp->data, &vdl->type );
       break;
@@ -622,6 +721,18 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       if ( !vlsp->is_file_operation )
         dem_layer_apply_colors ( vdl );
       break;
+    case PARAM_LIGHT_AZIMUTH:
+      if ( vlsp->data.u < 360 )
+        changed = vik_layer_param_change_uint ( vlsp->data, &vdl->light_azimuth );
+      if ( changed )
+        dem_layer_apply_lighting ( vdl );
+      break;
+    case PARAM_LIGHT_ALTITUDE:
+      if ( vlsp->data.u <= 90 )
+        changed = vik_layer_param_change_uint ( vlsp->data, &vdl->light_altitude );
+      if ( changed )
+        dem_layer_apply_lighting ( vdl );
+      break;
     case PARAM_FILES:
     {
       // If no change in the DEMs used, we can skip reloading them again
@@ -636,6 +747,7 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       vdl->files = vlsp->data.sl;
       // Ensure resolving of any relative path names
       util_make_absolute_filenames ( vdl->files, vlsp->dirpath );
+      dem_render_invalidate ( vdl->render_ctx );
 
       // No need for thread if no files
       if ( vdl->files ) {
@@ -692,6 +804,7 @@ Go to the registration website now?"), vdl->srtm_base_url) )
       break;
     case PARAM_SVR_DIR_SCHEME: rv.u = vdl->dir_scheme; break;
     case PARAM_SVR_FILENAME_STYLE: rv.u = vdl->filename_style; break;
+    case PARAM_PREFETCH: rv.b = vdl->prefetch; break;
     case PARAM_TYPE: rv.u = vdl->type; break;
     case PARAM_COLOR: rv.c = vdl->color; break;
     case PARAM_COLOR_SCHEME: rv.u = vdl->color_scheme; break;
@@ -714,6 +827,8 @@ Go to the registration website now?"), vdl->srtm_base_url) )
         rv.d = vdl->max_elev;
       break;
     case PARAM_ALPHA: rv.u = vdl->alpha; break;
+    case PARAM_LIGHT_AZIMUTH: rv.u = vdl->light_azimuth; break;
+    case PARAM_LIGHT_ALTITUDE: rv.u = vdl->light_altitude; break;
     case PARAM_RESET: rv.ptr = reset_cb; break;
     default: break;
   }
@@ -743,7 +858,6 @@ static void dem_layer_change_param ( GtkWidget *widget, ui_change_values values
 
     break;
   }
-
   default: break;
   }
 }
@@ -792,6 +906,24 @@ static void dem_layer_apply_colors ( VikDEMLayer *vdl )
   }
 }
 
+/**
+ * Standard hillshading, per combination of slope and aspect,
+ *  so changing the light only needs this recalculating rather than the normals
+ */
+static void dem_layer_apply_lighting ( VikDEMLayer *vdl )
+{
+  const gdouble zenith = (90.0 - vdl->light_altitude) * G_PI / 180;
+  const gdouble azimuth = vdl->light_azimuth * G_PI / 180;
+  for ( guint ss = 0; ss <= VIK_DEM_SLOPE_MAX; ss++ ) {
+    const gdouble slope = ss * (G_PI / 2) / VIK_DEM_SLOPE_MAX;
+    for ( guint aa = 0; aa < 256; aa++ ) {
+      const gdouble aspect = aa * 2 * G_PI / 256;
+      gdouble shade = cos(zenith) * cos(slope) + sin(zenith) * sin(slope) * cos(azimuth - aspect);
+      vdl->shade_lut[(ss << 8) | aa] = (guint8)lround ( MAX(shade, 0.0) * 255 );
+    }
+  }
+}
+
 static void dem_layer_post_read ( VikDEMLayer *vdl, VikViewport *vp, gboolean from_file )
 {
   dem_layer_apply_colors ( vdl );
@@ -807,6 +939,9 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
 
   vdl->height_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
   vdl->gradient_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_GRADIENT_COLORS );
+  vdl->shade_lut = g_malloc0 ( (VIK_DEM_SLOPE_MAX+1) * 256 );
+
+  vdl->render_ctx = dem_render_ctx_new ( vdl );
 
   vik_layer_set_defaults ( VIK_LAYER(vdl), vvp );
 
@@ -814,6 +949,141 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
 }
 
 
+/**************************************************************
+ **** RENDERING
+ **************************************************************/
+// Drawn in tiles of this many pixels square, fixed relative to the world
+//  so that they can be reused as the view is panned
+#define DEM_TILE_SIZE 256
+// Sampled tiles kept per layer, so a change of colours need not read the DEMs again
+#define DEM_RASTERS_MAX 128
+
+// Steepest slope in degrees at the end of the colour range for the slope type
+#define DEM_SLOPE_COLOR_MAX 60.0
+
+/**
+ * The value (height, gradient or normal) for each pixel of a tile, before colouring
+ */
+typedef struct {
+  gchar *key;
+  gint16 *values; // NULL when there is no data anywhere in the tile
+  GList *lru_link;
+} DEMRaster;
+
+/**
+ * Shared between a layer and its queued background renders,
+ *  so that they can still store results and tell the layer to redraw - if it still exists.
+ */
+struct _DEMRenderContext {
+  GMutex *mutex;
+  gint ref_count;
+  VikDEMLayer *vdl;        // NULL once the layer has gone
+  gboolean update_pending; // Redraw request outstanding
+  guint generation;        // Changed whenever the DEMs are, so older results get discarded
+  GHashTable *rasters;     // key -> DEMRaster
+  GQueue rasters_lru;      // Most recently used first
+  GHashTable *requests;    // Tiles waiting to be rendered
+};
+
+typedef struct {
+  DEMRenderContext *ctx;
+  gchar *key;
+  gchar *request;
+  guint generation;
+  guint type;
+  gdouble xmpp;
+  GList *files;     // Of the DEMs that overlap the tile
+  VikCoord *cols;   // Position of each pixel along the top of the tile
+  VikCoord *rows;   // Position of each pixel down the left of the tile
+  VikCoord *coords; // Or of every pixel, when the projection isn't separable like that
+} DEMRenderJob;
+
+// Unique across all layers, so one layer's drawings in the mapcache are never taken for another's
+static gint dem_render_serial = 0;
+
+static void dem_raster_free ( DEMRaster *raster )
+{
+  g_free ( raster->key );
+  g_free ( raster->values );
+  g_free ( raster );
+}
+
+static DEMRenderContext *dem_render_ctx_new ( VikDEMLayer *vdl )
+{
+  DEMRenderContext *ctx = g_malloc0 ( sizeof(DEMRenderContext) );
+  ctx->mutex = vik_mutex_new ();
+  ctx->ref_count = 1;
+  ctx->vdl = vdl;
+  ctx->generation = g_atomic_int_add ( &dem_render_serial, 1 );
+  ctx->rasters = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify)dem_raster_free );
+  g_queue_init ( &ctx->rasters_lru );
+  ctx->requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  return ctx;
+}
+
+static DEMRenderContext *dem_render_ctx_ref ( DEMRenderContext *ctx )
+{
+  g_atomic_int_inc ( &ctx->ref_count );
+  return ctx;
+}
+
+static void dem_render_ctx_unref ( DEMRenderContext *ctx )
+{
+  if ( g_atomic_int_dec_and_test ( &ctx->ref_count ) ) {
+    g_queue_clear ( &ctx->rasters_lru );
+    g_hash_table_destroy ( ctx->rasters );
+    g_hash_table_destroy ( ctx->requests );
+    vik_mutex_free ( ctx->mutex );
+    g_free ( ctx );
+  }
+}
+
+/**
+ * Forget everything rendered so far, as the DEMs have changed
+ * Can be called from any thread
+ */
+static void dem_render_invalidate ( DEMRenderContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  ctx->generation = g_atomic_int_add ( &dem_render_serial, 1 );
+  g_queue_clear ( &ctx->rasters_lru );
+  g_hash_table_remove_all ( ctx->rasters );
+  g_mutex_unlock ( ctx->mutex );
+}
+
+/**
+ * Must have the lock
+ */
+static DEMRaster *dem_raster_lookup ( DEMRenderContext *ctx, const gchar *key )
+{
+  DEMRaster *raster = g_hash_table_lookup ( ctx->rasters, key );
+  if ( raster && raster->lru_link != ctx->rasters_lru.head ) {
+    g_queue_unlink ( &ctx->rasters_lru, raster->lru_link );
+    g_queue_push_head_link ( &ctx->rasters_lru, raster->lru_link );
+  }
+  return raster;
+}
+
+/**
+ * Must have the lock
+ */
+static void dem_raster_store ( DEMRenderContext *ctx, DEMRaster *raster )
+{
+  DEMRaster *old = g_hash_table_lookup ( ctx->rasters, raster->key );
+  if ( old ) {
+    g_queue_delete_link ( &ctx->rasters_lru, old->lru_link );
+    g_hash_table_remove ( ctx->rasters, raster->key );
+  }
+  g_queue_push_head ( &ctx->rasters_lru, raster );
+  raster->lru_link = ctx->rasters_lru.head;
+  g_hash_table_insert ( ctx->rasters, raster->key, raster );
+
+  while ( ctx->rasters_lru.length > DEM_RASTERS_MAX ) {
+    DEMRaster *last = g_queue_pop_tail ( &ctx->rasters_lru );
+    g_hash_table_remove ( ctx->rasters, last->key );
+  }
+}
+
 static inline guint16 get_height_difference(gint16 elev, gint16 new_elev)
 {
   if(new_elev == VIK_DEM_INVALID_ELEVATION)
@@ -822,380 +1092,518 @@ static inline guint16 get_height_difference(gint16 elev, gint16 new_elev)
     return abs(new_elev - elev);
 }
 
-// Only for RGBA layout (i.e. 4 bytes)
-// A few manual calculation optimizations are applied
-// No bounds checking here in writing to the pixels array,
-//  it must be performed by the caller.
-static inline void pixels_set_area ( guchar* pixels, GdkColor gcolor, guint alpha, guint width, guint box_x, guint box_y, guint box_width, guint box_height )
-{
-  guint width4 = width * 4;
-  guint index = (width4 * box_y) + (box_x * 4);
-  guchar rr = gcolor.red / 256;
-  guchar gg = gcolor.green / 256;
-  guchar bb = gcolor.blue / 256;
-
-  for ( guint yy = 0; yy < box_height; yy++ ) {
-    guint yindex = index + (yy * width4);
-    for ( guint xx = 0; xx < box_width; xx++ ) {
-      guint tindex = yindex + (xx * 4);
-      pixels[tindex+0] = rr;
-      pixels[tindex+1] = gg;
-      pixels[tindex+2] = bb;
-      pixels[tindex+3] = alpha;
-    }
+/**
+ * Sum of the height differences to the samples all around,
+ *  spaced according to the zoom level
+ */
+static gint16 dem_get_gradient ( VikDEM *dem, guint x, guint y, gint16 elev, guint skip_factor )
+{
+  // Note this suffers from edge effects, as samples across this DEM's boundary
+  //  should really come from a different DEM file.
+  // However it's probably not worth trying to do this as the other DEMs
+  //  could have differing numbers of columns/points and scale factors...
+  guint n_points = vik_dem_get_n_points ( dem, x );
+  guint prev_x = x >= skip_factor ? x - skip_factor : 0;
+  guint next_x = MIN ( x + skip_factor, dem->n_columns - 1 );
+  guint prev_y = y >= skip_factor ? y - skip_factor : 0;
+  guint next_y = y + skip_factor < n_points ? y + skip_factor : y;
+
+  gint change = 0;
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, prev_x, prev_y) );
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, x, prev_y) );
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, next_x, prev_y) );
+
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, prev_x, y) );
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, next_x, y) );
+
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, prev_x, next_y) );
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, x, next_y) );
+  change += get_height_difference ( elev, vik_dem_get_xy(dem, next_x, next_y) );
+
+  change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
+  return MIN ( change, G_MAXINT16 );
+}
+
+/**
+ * The value to draw at the position, from the first DEM that has data there
+ */
+static gint16 dem_render_sample ( GPtrArray *dems, const VikCoord *coord, guint type, gdouble xmpp )
+{
+  struct LatLon ll;
+  struct UTM utm;
+  gboolean have_ll = FALSE;
+  gboolean have_utm = FALSE;
+
+  for ( guint ii = 0; ii < dems->len; ii++ ) {
+    VikDEM *dem = g_ptr_array_index ( dems, ii );
+    gdouble east, north;
+    guint skip_factor;
+    if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+      if ( !have_ll ) {
+        vik_coord_to_latlon ( coord, &ll );
+        have_ll = TRUE;
+      }
+      east = ll.lon * 3600;
+      north = ll.lat * 3600;
+      skip_factor = ceil ( xmpp / 80 ); /* todo: smarter calculation. */
+    } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+      if ( !have_utm ) {
+        vik_coord_to_utm ( coord, &utm );
+        have_utm = TRUE;
+      }
+      if ( utm.zone != dem->utm_zone )
+        continue;
+      east = utm.easting;
+      north = utm.northing;
+      skip_factor = ceil ( xmpp / 10 ); /* todo: smarter calculation. */
+    } else
+      continue;
+
+    if ( east > dem->max_east || east < dem->min_east ||
+         north > dem->max_north || north < dem->min_north )
+      continue;
+
+    guint x, y;
+    vik_dem_east_north_to_xy ( dem, east, north, &x, &y );
+    gint16 elev = vik_dem_get_xy ( dem, x, y );
+    if ( elev == VIK_DEM_INVALID_ELEVATION )
+      continue;
+    if ( type == DEM_TYPE_GRADIENT )
+      return dem_get_gradient ( dem, x, y, elev, MAX(skip_factor, 1) );
+    if ( type == DEM_TYPE_HILLSHADE || type == DEM_TYPE_SLOPE )
+      return vik_dem_get_normal_xy ( dem, x, y );
+    return elev;
   }
+  return VIK_DEM_INVALID_ELEVATION;
 }
 
-static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
+/**
+ * Sample the DEMs for each pixel of the tile
+ *
+ * Runs in a background thread, or the main one when threaddata is NULL
+ *
+ * Returns: NULL if cancelled
+ */
+static DEMRaster *dem_render_tile ( DEMRenderJob *job, gpointer threaddata )
 {
-  VikDEMColumn *column, *prevcolumn, *nextcolumn;
+  // Pinned, so they can be read without locking for every sample
+  GPtrArray *dems = g_ptr_array_new ();
+  GList *pinned = NULL;
+  for ( GList *iter = job->files; iter; iter = iter->next ) {
+    VikDEM *dem = a_dems_pin ( iter->data );
+    if ( dem ) {
+      g_ptr_array_add ( dems, dem );
+      pinned = g_list_prepend ( pinned, iter->data );
+    }
+  }
+
+  gint16 *values = g_malloc ( sizeof(gint16) * DEM_TILE_SIZE * DEM_TILE_SIZE );
+  gboolean empty = TRUE;
+  gboolean cancelled = FALSE;
+  for ( guint yy = 0; yy < DEM_TILE_SIZE; yy++ ) {
+    if ( threaddata && yy % 32 == 0 && a_background_thread_progress ( threaddata, (gdouble)yy / DEM_TILE_SIZE ) != 0 ) {
+      cancelled = TRUE;
+      break;
+    }
+    for ( guint xx = 0; xx < DEM_TILE_SIZE; xx++ ) {
+      VikCoord coord;
+      if ( job->coords )
+        coord = job->coords[yy * DEM_TILE_SIZE + xx];
+      else {
+        // Across the screen only the longitude (or easting) changes, and down it only the latitude (or northing)
+        coord = job->cols[xx];
+        coord.north_south = job->rows[yy].north_south;
+      }
+      gint16 value = dem_render_sample ( dems, &coord, job->type, job->xmpp );
+      values[yy * DEM_TILE_SIZE + xx] = value;
+      if ( value != VIK_DEM_INVALID_ELEVATION )
+        empty = FALSE;
+    }
+  }
+
+  for ( GList *iter = pinned; iter; iter = iter->next )
+    a_dems_unpin ( iter->data );
+  g_list_free ( pinned );
+  g_ptr_array_free ( dems, TRUE );
+
+  if ( cancelled ) {
+    g_free ( values );
+    return NULL;
+  }
+  DEMRaster *raster = g_malloc0 ( sizeof(DEMRaster) );
+  if ( empty )
+    g_free ( values );
+  else
+    raster->values = values;
+  return raster;
+}
 
-  LatLonBBox vp_bbox = vik_viewport_get_bbox ( vp );
-  LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
+// In main thread
+static gboolean dem_render_update_idle ( DEMRenderContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  ctx->update_pending = FALSE;
+  VikDEMLayer *vdl = ctx->vdl;
+  if ( vdl )
+    g_object_ref ( vdl );
+  g_mutex_unlock ( ctx->mutex );
+
+  if ( vdl ) {
+    vik_layer_emit_update ( VIK_LAYER(vdl), FALSE );
+    g_object_unref ( vdl );
+  }
+  dem_render_ctx_unref ( ctx );
+  return FALSE;
+}
 
-  /**** Check if viewport and DEM data overlap ****/
-  if ( ! BBOX_INTERSECT(dem_bbox, vp_bbox) ) {
+static void dem_render_thread ( DEMRenderJob *job, gpointer threaddata )
+{
+  DEMRaster *raster = dem_render_tile ( job, threaddata );
+  if ( !raster )
     return;
+  raster->key = g_strdup ( job->key );
+
+  DEMRenderContext *ctx = job->ctx;
+  g_mutex_lock ( ctx->mutex );
+  if ( job->generation == ctx->generation ) {
+    dem_raster_store ( ctx, raster );
+    raster = NULL;
+  }
+  // Coalesce redraws - many tiles may finish in quick succession
+  if ( ctx->vdl && !ctx->update_pending ) {
+    ctx->update_pending = TRUE;
+    (void)gdk_threads_add_idle ( (GSourceFunc)dem_render_update_idle, dem_render_ctx_ref(ctx) );
   }
+  g_mutex_unlock ( ctx->mutex );
 
-  const guint width = vik_viewport_get_width ( vp );
-  const guint height = vik_viewport_get_height ( vp );
+  if ( raster )
+    dem_raster_free ( raster );
+}
 
-  /* boxes to show where we have DEM instead of actually drawing the DEM.
-   * useful if we want to see what areas we have coverage for (if we want
-   * to get elevation data for a track) but don't want to cover the map.
-   */
+static void dem_render_job_free ( DEMRenderJob *job )
+{
+  // Only once any result is stored, so it won't be rendered again
+  g_mutex_lock ( job->ctx->mutex );
+  (void)g_hash_table_remove ( job->ctx->requests, job->request );
+  g_mutex_unlock ( job->ctx->mutex );
+
+  dem_render_ctx_unref ( job->ctx );
+  g_free ( job->key );
+  g_free ( job->request );
+  g_list_free_full ( job->files, g_free );
+  g_free ( job->cols );
+  g_free ( job->rows );
+  g_free ( job->coords );
+  g_free ( job );
+}
 
-  #if 0
-  /* draw a box if a DEM is loaded. in future I'd like to add an option for this
-   * this is useful if we want to see what areas we have dem for but don't want to
-   * cover the map (or maybe we just need translucent DEM?) */
-  {
-    VikCoord demne, demsw;
-    gint x1, y1, x2, y2;
-    vik_coord_load_from_latlon(&demne, vik_viewport_get_coord_mode(vp), &dem_northeast);
-    vik_coord_load_from_latlon(&demsw, vik_viewport_get_coord_mode(vp), &dem_southwest);
-
-    vik_viewport_coord_to_screen ( vp, &demne, &x1, &y1 );
-    vik_viewport_coord_to_screen ( vp, &demsw, &x2, &y2 );
-
-    if ( x1 > vik_viewport_get_width(vp) ) x1=vik_viewport_get_width(vp);
-    if ( y2 > vik_viewport_get_height(vp) ) y2=vik_viewport_get_height(vp);
-    if ( x2 < 0 ) x2 = 0;
-    if ( y1 < 0 ) y1 = 0;
-    vik_viewport_draw_rectangle ( vp, vik_viewport_get_black_gc(vp), FALSE, x2, y1, x1-x2, y2-y1 );
+/**
+ * Queue rendering of the tile at the screen position in the background,
+ *  unless it is already waiting to be rendered
+ *
+ * The list of files is owned by the job
+ */
+static void dem_render_queue ( VikDEMLayer *vdl, VikViewport *vp, const gchar *key, gint sx, gint sy, GList *files )
+{
+  DEMRenderContext *ctx = vdl->render_ctx;
+  g_mutex_lock ( ctx->mutex );
+  gchar *request = g_strdup_printf ( "%u/%s", ctx->generation, key );
+  if ( g_hash_table_contains ( ctx->requests, request ) ) {
+    g_mutex_unlock ( ctx->mutex );
+    g_free ( request );
+    g_list_free_full ( files, g_free );
     return;
   }
-  #endif
-
-  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
-
-    gdouble max_lat_as, max_lon_as, min_lat_as, min_lon_as;
-    gdouble start_lat_as, end_lat_as, start_lon_as, end_lon_as;
-
-    gdouble start_lat, end_lat, start_lon, end_lon;
-
-    struct LatLon counter;
-
-    guint x, y, start_x, start_y;
-
-    gint16 elev;
-
-    guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 80 ); /* todo: smarter calculation. */
-
-    gdouble nscale_deg = dem->north_scale / ((gdouble) 3600);
-    gdouble escale_deg = dem->east_scale / ((gdouble) 3600);
-
-    max_lat_as = vp_bbox.north * 3600;
-    min_lat_as = vp_bbox.south * 3600;
-    max_lon_as = vp_bbox.east * 3600;
-    min_lon_as = vp_bbox.west * 3600;
-
-    start_lat_as = MAX(min_lat_as, dem->min_north);
-    end_lat_as   = MIN(max_lat_as, dem->max_north);
-    start_lon_as = MAX(min_lon_as, dem->min_east);
-    end_lon_as   = MIN(max_lon_as, dem->max_east);
-
-    start_lat = floor(start_lat_as / dem->north_scale) * nscale_deg;
-    end_lat   = ceil (end_lat_as / dem->north_scale) * nscale_deg;
-    start_lon = floor(start_lon_as / dem->east_scale) * escale_deg;
-    end_lon   = ceil (end_lon_as / dem->east_scale) * escale_deg;
-
-    vik_dem_east_north_to_xy ( dem, start_lon_as, start_lat_as, &start_x, &start_y );
-    guint gradient_skip_factor = 1;
-    if(vdl->type == DEM_TYPE_GRADIENT)
-	    gradient_skip_factor = skip_factor;
-
-    /* verify sane elev interval */
-    if ( vdl->max_elev <= vdl->min_elev )
-      vdl->max_elev = vdl->min_elev + 1;
-
-    for ( x=start_x, counter.lon = start_lon; counter.lon <= end_lon+escale_deg*skip_factor; counter.lon += escale_deg * skip_factor, x += skip_factor ) {
-      // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
-      // the leftmost column does also get drawn, if the center point is out of viewport.
-      if ( x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
-        // get previous and next column. catch out-of-bound.
-	gint32 new_x = x;
-	new_x -= gradient_skip_factor;
-        if(new_x < 0)
-          prevcolumn = g_ptr_array_index ( dem->columns, 0);
-        else
-          prevcolumn = g_ptr_array_index ( dem->columns, new_x);
-	new_x = x;
-	new_x += gradient_skip_factor;
-        if(new_x >= dem->n_columns)
-          nextcolumn = g_ptr_array_index ( dem->columns, dem->n_columns-1);
-        else
-          nextcolumn = g_ptr_array_index ( dem->columns, new_x);
-
-        for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
-            break;
-
-          elev = column->points[y];
-
-	  // calculate bounding box for drawing
-	  gint box_x, box_y, box_width, box_height;
-	  struct LatLon box_c;
-	  box_c = counter;
-	  box_c.lat += (nscale_deg * skip_factor)/2;
-          box_c.lon -= (escale_deg * skip_factor)/2;
-	  vik_coord_load_from_latlon(&tmp, vik_viewport_get_coord_mode(vp), &box_c);
-	  vik_viewport_coord_to_screen(vp, &tmp, &box_x, &box_y);
-	  // catch box at borders
-	  if(box_x < 0)
-            box_x = 0;
-	  if(box_y < 0)
-            box_y = 0;
-          box_c.lat -= nscale_deg * skip_factor;
-	  box_c.lon += escale_deg * skip_factor;
-	  vik_coord_load_from_latlon(&tmp, vik_viewport_get_coord_mode(vp), &box_c);
-	  vik_viewport_coord_to_screen(vp, &tmp, &box_width, &box_height);
-	  box_width -= box_x;
-	  box_height -= box_y;
-          // catch box at borders
-	  if(box_width <= 0 || box_height <= 0)
-	    // skip this as is out of the viewport (e.g. zoomed in so this point is way off screen)
-	    continue;
-
-          // Also too far out
-          if ( (box_x > width) || (box_y > height) )
-            continue;
-
-          gboolean minimum_level = FALSE;
-          if(vdl->type == DEM_TYPE_HEIGHT) {
-            if ( elev != VIK_DEM_INVALID_ELEVATION && elev <= vdl->min_elev ) {
-              // Prevent 'elev - vdl->min_elev' from being negative so can safely use as array index
-              elev = ceil ( vdl->min_elev );
-              minimum_level = TRUE;
-	    }
-            if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
-              elev = vdl->max_elev;
-          }
+  g_hash_table_add ( ctx->requests, g_strdup(request) );
+  guint generation = ctx->generation;
+  g_mutex_unlock ( ctx->mutex );
+
+  DEMRenderJob *job = g_malloc0 ( sizeof(DEMRenderJob) );
+  job->ctx = dem_render_ctx_ref ( ctx );
+  job->key = g_strdup ( key );
+  job->request = request;
+  job->generation = generation;
+  job->type = vdl->type;
+  job->xmpp = vik_viewport_get_xmpp ( vp );
+  job->files = files;
+  job->cols = g_malloc ( sizeof(VikCoord) * DEM_TILE_SIZE );
+  job->rows = g_malloc ( sizeof(VikCoord) * DEM_TILE_SIZE );
+  for ( guint ii = 0; ii < DEM_TILE_SIZE; ii++ ) {
+    vik_viewport_screen_to_coord ( vp, sx + ii, sy, &job->cols[ii] );
+    vik_viewport_screen_to_coord ( vp, sx, sy + ii, &job->rows[ii] );
+  }
 
-          {
-            if(vdl->type == DEM_TYPE_GRADIENT) {
-              if( elev == VIK_DEM_INVALID_ELEVATION ) {
-                /* don't draw it */
-              } else {
-                // calculate and sum gradient in all directions
-                gint16 change = 0;
-		gint32 new_y;
-
-		// calculate gradient from height points all around the current one
-                // Note this code suffers from edge effects, as currently prev & next columns
-                //  (and for rows when y < 0 && y > n_points) should really attempt to read values
-                //  from a different DEM file to get a change value across this particular DEM's boundary.
-                // However it's probably not worth trying to do this as accessing the right DEM is not
-                //  straight-forward and the other DEMs could have differing numbers of columns/points
-                //  and so would need to reconsider scale factors as well...
-		new_y = y - gradient_skip_factor;
-		if(new_y < 0)
-                  new_y = 0;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
-
-		change += get_height_difference(elev, prevcolumn->points[y]);
-		change += get_height_difference(elev, nextcolumn->points[y]);
-
-		new_y = y + gradient_skip_factor;
-		if(new_y >= column->n_points)
-			new_y = y;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
-
-		change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
-
-                if(change < vdl->min_elev)
-                  // Prevent 'change - vdl->min_elev' from being negative so can safely use as array index
-                  change = ceil ( vdl->min_elev );
-
-                if(change > vdl->max_elev)
-                  change = vdl->max_elev;
-
-                if ( ((box_x + box_width) > width) )
-                  box_width = width - box_x;
-
-                guint index = (gint)floor(((change - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_GRADIENT_COLORS-2))+1;
-                GdkColor gcolor = vdl->gradient_colors[index];
-                pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
-              }
-            } else {
-              if(vdl->type == DEM_TYPE_HEIGHT) {
-                if ( elev == VIK_DEM_INVALID_ELEVATION )
-                  continue; /* don't draw it */
-                // Draw to edge
-                if ( ((box_x + box_width) > width) )
-                  box_width = width - box_x;
-                GdkColor gcolor;
-                /* If 'sea' colour or below the defined mininum draw in the configurable colour */
-                if ( minimum_level )
-                  gcolor = vdl->color;
-                else {
-                  guint index = (gint)floor(((elev - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_HEIGHT_COLORS-2))+1;
-                  gcolor = vdl->height_colors[index];
-                }
-                pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
-              }
-            }
-          }
-        } /* for y= */
-      }
-    } /* for x= */
-  } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
-    gdouble max_nor, max_eas, min_nor, min_eas;
-    gdouble start_nor, start_eas, end_nor, end_eas;
+  gchar *description = g_strdup_printf ( _("DEM Render %s"), key );
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_VISIBLE,
+                                      VIK_GTK_WINDOW_FROM_LAYER(vdl), description,
+                                      (vik_thr_func) dem_render_thread,
+                                      job,
+                                      (vik_thr_free_func) dem_render_job_free,
+                                      NULL,
+                                      1 );
+  g_free ( description );
+}
 
-    gint16 elev;
+/**
+ * Render the tile at the screen position straight away (without caching)
+ */
+static DEMRaster *dem_render_now ( VikDEMLayer *vdl, VikViewport *vp, gint sx, gint sy, GList *files )
+{
+  DEMRenderJob job;
+  memset ( &job, 0, sizeof(DEMRenderJob) );
+  job.type = vdl->type;
+  job.xmpp = vik_viewport_get_xmpp ( vp );
+  job.files = files;
+  job.coords = g_malloc ( sizeof(VikCoord) * DEM_TILE_SIZE * DEM_TILE_SIZE );
+  for ( guint yy = 0; yy < DEM_TILE_SIZE; yy++ )
+    for ( guint xx = 0; xx < DEM_TILE_SIZE; xx++ )
+      vik_viewport_screen_to_coord ( vp, sx + xx, sy + yy, &job.coords[yy * DEM_TILE_SIZE + xx] );
+  DEMRaster *raster = dem_render_tile ( &job, NULL );
+  g_free ( job.coords );
+  return raster;
+}
 
-    guint x, y, start_x, start_y;
+/**
+ * Colour the values according to the current layer settings
+ */
+static GdkPixbuf *dem_raster_colour ( VikDEMLayer *vdl, const DEMRaster *raster )
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, DEM_TILE_SIZE, DEM_TILE_SIZE );
+  if ( !pixbuf )
+    return NULL;
+  guchar *pixels = gdk_pixbuf_get_pixels ( pixbuf );
+  const gint rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+
+  const gboolean gradient = (vdl->type == DEM_TYPE_GRADIENT || vdl->type == DEM_TYPE_SLOPE);
+  const GdkColor *colors = gradient ? vdl->gradient_colors : vdl->height_colors;
+  const guint n_colors = gradient ? DEM_N_GRADIENT_COLORS : DEM_N_HEIGHT_COLORS;
+  gdouble min_elev = vdl->min_elev;
+  /* verify sane elev interval */
+  gdouble max_elev = MAX ( vdl->max_elev, vdl->min_elev + 1 );
+  if ( vdl->type == DEM_TYPE_SLOPE ) {
+    min_elev = 0.0;
+    max_elev = DEM_SLOPE_COLOR_MAX;
+  }
 
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
-    struct UTM counter;
+  for ( guint yy = 0; yy < DEM_TILE_SIZE; yy++ ) {
+    guchar *px = pixels + yy * rowstride;
+    for ( guint xx = 0; xx < DEM_TILE_SIZE; xx++, px += 4 ) {
+      gint16 value = raster->values[yy * DEM_TILE_SIZE + xx];
+      if ( value == VIK_DEM_INVALID_ELEVATION ) {
+        /* don't draw it */
+        px[0] = px[1] = px[2] = px[3] = 0;
+        continue;
+      }
+      if ( vdl->type == DEM_TYPE_HILLSHADE ) {
+        px[0] = px[1] = px[2] = vdl->shade_lut[value];
+        px[3] = vdl->alpha;
+        continue;
+      }
+      gdouble vv = value;
+      if ( vdl->type == DEM_TYPE_SLOPE )
+        vv = VIK_DEM_NORMAL_SLOPE(value) * 90.0 / VIK_DEM_SLOPE_MAX;
+      const GdkColor *gcolor;
+      /* If 'sea' colour or below the defined mininum draw in the configurable colour */
+      if ( !gradient && vv <= min_elev )
+        gcolor = &vdl->color;
+      else {
+        vv = CLAMP ( vv, min_elev, max_elev );
+        guint index = (gint)floor(((vv - min_elev)/(max_elev - min_elev))*(n_colors-2))+1;
+        gcolor = &colors[index];
+      }
+      px[0] = gcolor->red / 256;
+      px[1] = gcolor->green / 256;
+      px[2] = gcolor->blue / 256;
+      px[3] = vdl->alpha;
+    }
+  }
+  return pixbuf;
+}
 
-    guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 10 ); /* todo: smarter calculation. */
+/**
+ * Identifies the colouring of the layer's drawings in the mapcache,
+ *  so any change gives new ones (from the same samples)
+ */
+static gchar *dem_render_signature ( VikDEMLayer *vdl, guint generation )
+{
+  return g_strdup_printf ( "DEM-%u-%u-%u-%.2f-%.2f-%u-%u-%04x%04x%04x-%04x%04x%04x-%04x%04x%04x",
+                           generation, vdl->type, vdl->color_scheme, vdl->min_elev, vdl->max_elev,
+                           vdl->light_azimuth, vdl->light_altitude,
+                           vdl->color.red, vdl->color.green, vdl->color.blue,
+                           vdl->color_min.red, vdl->color_min.green, vdl->color_min.blue,
+                           vdl->color_max.red, vdl->color_max.green, vdl->color_max.blue );
+}
 
-    VikCoord tleft, tright, bleft, bright;
+/**
+ * The DEMs that may have data for the tile at the screen position
+ */
+static GList *dem_tile_files ( VikDEMLayer *vdl, VikViewport *vp, gint sx, gint sy )
+{
+  LatLonBBox bbox = { 90.0, -90.0, -180.0, 180.0 };
+  for ( guint ii = 0; ii < 4; ii++ ) {
+    VikCoord coord;
+    struct LatLon ll;
+    vik_viewport_screen_to_coord ( vp, sx + (ii & 1) * DEM_TILE_SIZE, sy + (ii >> 1) * DEM_TILE_SIZE, &coord );
+    vik_coord_to_latlon ( &coord, &ll );
+    bbox.south = MIN ( bbox.south, ll.lat );
+    bbox.north = MAX ( bbox.north, ll.lat );
+    bbox.west = MIN ( bbox.west, ll.lon );
+    bbox.east = MAX ( bbox.east, ll.lon );
+  }
 
-    vik_viewport_screen_to_coord ( vp, 0, 0, &tleft );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &tright );
-    vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &bleft );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &bright );
+  GList *files = NULL;
+  for ( GList *iter = vdl->files; iter; iter = iter->next ) {
+    LatLonBBox dem_bbox;
+    if ( a_dems_get_bbox ( iter->data, &dem_bbox ) && BBOX_INTERSECT(dem_bbox, bbox) )
+      files = g_list_prepend ( files, g_strdup(iter->data) );
+  }
+  // Keep the layer's order, as the first DEM with data for a position is used
+  return g_list_reverse ( files );
+}
 
+// Which tile an offset in pixels from the origin is in
+static gint dem_tile_index ( gint offset )
+{
+  return offset >= 0 ? offset / DEM_TILE_SIZE : -((DEM_TILE_SIZE - 1 - offset) / DEM_TILE_SIZE);
+}
 
-    vik_coord_convert(&tleft, VIK_COORD_UTM);
-    vik_coord_convert(&tright, VIK_COORD_UTM);
-    vik_coord_convert(&bleft, VIK_COORD_UTM);
-    vik_coord_convert(&bright, VIK_COORD_UTM);
+/**
+ * Draw the DEMs as tiles, from the mapcache where possible,
+ *  else colouring previously sampled values,
+ *  otherwise queuing the sampling of them in the background.
+ */
+static void dem_layer_draw_tiles ( VikDEMLayer *vdl, VikViewport *vp )
+{
+  DEMRenderContext *ctx = vdl->render_ctx;
+  const gint width = vik_viewport_get_width ( vp );
+  const gint height = vik_viewport_get_height ( vp );
+  const gdouble xmpp = vik_viewport_get_xmpp ( vp );
+  const gdouble ympp = vik_viewport_get_ympp ( vp );
+  const VikViewportDrawMode mode = vik_viewport_get_drawmode ( vp );
+  // The Expedia projection depends on the centre of the view, so its tiles can't be reused after a pan
+  const gboolean cached = (mode != VIK_VIEWPORT_DRAWMODE_EXPEDIA);
+
+  // Count tiles from a fixed point of the world
+  gint ox = 0, oy = 0, zone = 0;
+  if ( cached ) {
+    VikCoord origin = *vik_viewport_get_center ( vp );
+    if ( origin.mode == VIK_COORD_UTM ) {
+      // Positions are all within the centre's zone
+      origin.east_west = 500000;
+      origin.north_south = 0;
+      zone = origin.utm_zone * 2 + (origin.utm_letter >= 'N' ? 1 : 0);
+    }
+    else {
+      origin.east_west = 0.0;
+      origin.north_south = 0.0;
+    }
+    vik_viewport_coord_to_screen ( vp, &origin, &ox, &oy );
+  }
 
-    max_nor = MAX(tleft.north_south, tright.north_south);
-    min_nor = MIN(bleft.north_south, bright.north_south);
-    max_eas = MAX(bright.east_west, tright.east_west);
-    min_eas = MIN(bleft.east_west, tleft.east_west);
+  g_mutex_lock ( ctx->mutex );
+  guint generation = ctx->generation;
+  g_mutex_unlock ( ctx->mutex );
+  gchar *signature = dem_render_signature ( vdl, generation );
+
+  const gint tx_max = dem_tile_index ( width - 1 - ox );
+  const gint ty_max = dem_tile_index ( height - 1 - oy );
+  for ( gint ty = dem_tile_index ( -oy ); ty <= ty_max; ty++ ) {
+    for ( gint tx = dem_tile_index ( -ox ); tx <= tx_max; tx++ ) {
+      const gint sx = ox + tx * DEM_TILE_SIZE;
+      const gint sy = oy + ty * DEM_TILE_SIZE;
+
+      GdkPixbuf *pixbuf = NULL;
+      if ( cached )
+        pixbuf = a_mapcache_get ( tx, ty, zone, MAP_ID_DEM_RENDER, mode, vdl->alpha, xmpp, ympp, signature );
+      if ( !pixbuf ) {
+        GList *files = dem_tile_files ( vdl, vp, sx, sy );
+        if ( !files )
+          continue; // Nothing there
+        if ( cached ) {
+          gchar *key = g_strdup_printf ( "%d:%d:%d:%d:%u:%.4f:%.4f", tx, ty, zone, mode, vdl->type, xmpp, ympp );
+          gboolean sampled = FALSE;
+          g_mutex_lock ( ctx->mutex );
+          DEMRaster *raster = dem_raster_lookup ( ctx, key );
+          if ( raster ) {
+            sampled = TRUE;
+            if ( raster->values )
+              pixbuf = dem_raster_colour ( vdl, raster );
+          }
+          g_mutex_unlock ( ctx->mutex );
 
-    start_nor = MAX(min_nor, dem->min_north);
-    end_nor   = MIN(max_nor, dem->max_north);
-    if ( tleft.utm_zone == dem->utm_zone && bleft.utm_zone == dem->utm_zone
-         && (tleft.utm_letter >= 'N') == (dem->utm_letter >= 'N')
-         && (bleft.utm_letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
-      start_eas = MAX(min_eas, dem->min_east);
-    else
-      start_eas = dem->min_east;
-    if ( tright.utm_zone == dem->utm_zone && bright.utm_zone == dem->utm_zone
-         && (tright.utm_letter >= 'N') == (dem->utm_letter >= 'N')
-         && (bright.utm_letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
-      end_eas = MIN(max_eas, dem->max_east);
-    else
-      end_eas = dem->max_east;
-
-    start_nor = floor(start_nor / dem->north_scale) * dem->north_scale;
-    end_nor   = ceil (end_nor / dem->north_scale) * dem->north_scale;
-    start_eas = floor(start_eas / dem->east_scale) * dem->east_scale;
-    end_eas   = ceil (end_eas / dem->east_scale) * dem->east_scale;
-
-    vik_dem_east_north_to_xy ( dem, start_eas, start_nor, &start_x, &start_y );
-
-    /* TODO: why start_x and start_y are -1 -- rounding error from above? */
-
-    counter.zone = dem->utm_zone;
-    counter.letter = dem->utm_letter;
-
-    for ( x=start_x, counter.easting = start_eas; counter.easting <= end_eas; counter.easting += dem->east_scale * skip_factor, x += skip_factor ) {
-      if ( x >= 0 && x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
-        for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
-            continue;
-          elev = column->points[y];
-          if ( elev != VIK_DEM_INVALID_ELEVATION && elev < vdl->min_elev )
-            elev=vdl->min_elev;
-          if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
-            elev=vdl->max_elev;
-
-          {
-            gint a, b;
-            vik_coord_load_from_utm(&tmp, vik_viewport_get_coord_mode(vp), &counter);
-            vik_viewport_coord_to_screen(vp, &tmp, &a, &b);
-            // Check a & b are in bounds:
-            if ( a < 0 || b < 0 || (a > width) || (b > height) )
-              continue;
-            if ( elev == VIK_DEM_INVALID_ELEVATION )
-              ; /* don't draw it */
-            else if ( elev <= 0 ) {
-              pixels_set_area ( vdl->pixels, vdl->color, vdl->alpha, width, a-1, b-1, 2, 2 );
-            }
-            else {
-              guint index = (gint)floor((elev - vdl->min_elev)/(vdl->max_elev - vdl->min_elev)*(DEM_N_HEIGHT_COLORS-2))+1;
-              GdkColor gcolor = vdl->height_colors[index];
-              pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, a-1, b-1, 2, 2 );
-            }
+          if ( pixbuf )
+            a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0, 0 }, tx, ty, zone, MAP_ID_DEM_RENDER, mode, vdl->alpha, xmpp, ympp, signature );
+          else if ( !sampled ) {
+            dem_render_queue ( vdl, vp, key, sx, sy, files );
+            files = NULL;
           }
-        } /* for y= */
+          g_free ( key );
+        }
+        else {
+          DEMRaster *raster = dem_render_now ( vdl, vp, sx, sy, files );
+          if ( raster->values )
+            pixbuf = dem_raster_colour ( vdl, raster );
+          dem_raster_free ( raster );
+        }
+        g_list_free_full ( files, g_free );
+      }
+
+      if ( pixbuf ) {
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, sx, sy, DEM_TILE_SIZE, DEM_TILE_SIZE );
+        g_object_unref ( pixbuf );
       }
-    } /* for x= */
+    }
   }
+  g_free ( signature );
 }
 
-/* return the continent for the specified lat, lon */
-/* TODO */
-static const gchar *srtm_continent_dir ( gint lat, gint lon )
+#define SRTM_CONTINENTS_MAX 16
+// Index+1 into srtm_continents for each whole degree tile, or 0 when there is no tile
+static guint8 srtm_continent_ids[180][360];
+static const gchar *srtm_continents[SRTM_CONTINENTS_MAX];
+
+/**
+ * Fill in the continent of each tile from the server listing,
+ *  once at start up so that afterwards any thread can look them up without locking
+ */
+static void srtm_continent_init ()
 {
   extern const char *_srtm_continent_data[];
-  static GHashTable *srtm_continent = NULL;
-  const gchar *continent;
-  gchar name[16];
-
-  if (!srtm_continent) {
-    const gchar **s;
-
-    srtm_continent = g_hash_table_new(g_str_hash, g_str_equal);
-    s = _srtm_continent_data;
-    while (*s != (gchar *)-1) {
-      continent = *s++;
-      while (*s) {
-        g_hash_table_insert(srtm_continent, (gpointer) *s, (gpointer) continent);
-        s++;
+  const gchar **s = _srtm_continent_data;
+  guint8 id = 0;
+
+  while (*s != (gchar *)-1) {
+    if ( id == SRTM_CONTINENTS_MAX ) {
+      g_warning ( "%s: too many continents", __FUNCTION__ );
+      break;
+    }
+    srtm_continents[id++] = *s++;
+    while (*s) {
+      gchar ns, ew;
+      gint lat, lon;
+      if ( sscanf ( *s, "%c%02d%c%03d", &ns, &lat, &ew, &lon ) == 4 ) {
+        if ( ns == 'S' ) lat = -lat;
+        if ( ew == 'W' ) lon = -lon;
+        if ( lat >= -90 && lat < 90 && lon >= -180 && lon < 180 )
+          srtm_continent_ids[lat+90][lon+180] = id;
       }
       s++;
     }
+    s++;
   }
-  g_snprintf(name, sizeof(name), "%c%02d%c%03d",
-                  (lat >= 0) ? 'N' : 'S', ABS(lat),
-		  (lon >= 0) ? 'E' : 'W', ABS(lon));
+}
 
-  return(g_hash_table_lookup(srtm_continent, name));
+/* return the continent for the specified lat, lon */
+static const gchar *srtm_continent_dir ( gint lat, gint lon )
+{
+  if ( lat < -90 || lat >= 90 || lon < -180 || lon >= 180 )
+    return NULL;
+  guint8 id = srtm_continent_ids[lat+90][lon+180];
+  return id ? srtm_continents[id-1] : NULL;
 }
 
 static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
 {
-  GList *dems_iter = vdl->files;
-  VikDEM *dem;
-
-
   /* search for SRTM3 90m */
 
   if ( vdl->source == DEM_SOURCE_SRTM )
@@ -1205,32 +1613,26 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
     dem24k_draw_existence ( vp );
 #endif
 
-  const guint width = vik_viewport_get_width ( vp );
-  const guint height = vik_viewport_get_height ( vp );
+  dem_layer_draw_tiles ( vdl, vp );
 
-  // RGBA, natural alignment of rows on 4 byte boundary
-  vdl->pixels = g_malloc0 ( sizeof(guchar*) * width * height * 4 );
-
-  while ( dems_iter ) {
-    dem = a_dems_get ( (const char *) (dems_iter->data) );
-    if ( dem )
-      vik_dem_layer_draw_dem ( vdl, vp, dem );
-    dems_iter = dems_iter->next;
-  }
-
-  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( vdl->pixels, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width*4, NULL, NULL );
-  vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, 0, 0, width, height );
-  g_object_unref ( pixbuf );
-  g_free ( vdl->pixels );
+  if ( vdl->prefetch && vdl->source == DEM_SOURCE_SRTM )
+    dem_layer_prefetch ( vdl, vp );
 }
 
 static void dem_layer_free ( VikDEMLayer *vdl )
 {
+  // Any renders still queued no longer have a layer to update
+  g_mutex_lock ( vdl->render_ctx->mutex );
+  vdl->render_ctx->vdl = NULL;
+  g_mutex_unlock ( vdl->render_ctx->mutex );
+  dem_render_ctx_unref ( vdl->render_ctx );
+
   a_dems_list_free ( vdl->files );
 
   g_free ( vdl->srtm_base_url );
   g_free ( vdl->height_colors );
   g_free ( vdl->gradient_colors );
+  g_free ( vdl->shade_lut );
 }
 
 VikDEMLayer *dem_layer_create ( VikViewport *vp )
@@ -1249,6 +1651,9 @@ typedef struct {
   VikDEMLayer *vdl; /* NULL if not alive */
 
   guint source;
+  gboolean download; // Otherwise the file is already on disk and only needs loading
+  gboolean prefetch;
+  gboolean failed;
 } DEMDownloadParams;
 
 /**************************************************
@@ -1325,6 +1730,7 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
     gchar *msg = g_strdup_printf ( _("No SRTM data available for %f, %f"), p->lat, p->lon );
     vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(p->vdl), msg, VIK_STATUSBAR_INFO );
     g_free ( msg );
+    p->failed = TRUE;
     return;
   }
 
@@ -1339,12 +1745,14 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
       gchar *msg = g_strdup_printf ( _("DEM download failure for %f, %f"), p->lat, p->lon );
       vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(p->vdl), msg, VIK_STATUSBAR_INFO );
       g_free ( msg );
+      p->failed = TRUE;
       break;
     }
     case DOWNLOAD_FILE_WRITE_ERROR: {
       gchar *msg = g_strdup_printf ( _("DEM write failure for %s"), p->dest );
       vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(p->vdl), msg, VIK_STATUSBAR_INFO );
       g_free ( msg );
+      p->failed = TRUE;
       break;
     }
     case DOWNLOAD_SUCCESS:
@@ -1379,29 +1787,135 @@ static gchar *srtm_lat_lon_to_dest_fn ( gdouble lat, gdouble lon )
 
 }
 
+/**************************************************
+ *  LOCAL COVERAGE                                *
+ **************************************************/
+
+static void srtm_coverage_set ( gint lat, gint lon )
+{
+  if ( lat < -90 || lat >= 90 || lon < -180 || lon >= 180 )
+    return;
+  g_atomic_int_or ( &srtm_coverage[lat+90][(lon+180)/32], 1u << ((lon+180)%32) );
+}
+
+static gboolean srtm_coverage_get ( gint lat, gint lon )
+{
+  if ( lat < -90 || lat >= 90 || lon < -180 || lon >= 180 )
+    return FALSE;
+  guint bits = (guint)g_atomic_int_get ( (gint*)&srtm_coverage[lat+90][(lon+180)/32] );
+  return (bits >> ((lon+180)%32)) & 1;
+}
+
+#ifdef VIK_CONFIG_DEM24K
+// From the tile's south edge and east edge in eighths of a degree, as in its filename
+static gpointer dem24k_coverage_key ( gint lat8, gint lon8 )
+{
+  return GINT_TO_POINTER ( (lat8 + 1000) * 4000 + (lon8 + 2000) );
+}
+#endif
+
+static void srtm_coverage_scan ( const gchar *cache_dir )
+{
+  guint cc;
+  for ( cc = 0; cc < SRTM_CONTINENTS_MAX && srtm_continents[cc]; cc++ ) {
+    gchar *dir = g_strdup_printf ( "%ssrtm3-%s", cache_dir, srtm_continents[cc] );
+    GDir *gdir = g_dir_open ( dir, 0, NULL );
+    g_free ( dir );
+    if ( !gdir )
+      continue;
+    const gchar *name;
+    while ( (name = g_dir_read_name ( gdir )) ) {
+      gchar ns, ew;
+      gint lat, lon;
+      if ( g_str_has_suffix ( name, ".hgt.zip" ) &&
+           sscanf ( name, "%c%02d%c%03d", &ns, &lat, &ew, &lon ) == 4 )
+        srtm_coverage_set ( ns == 'S' ? -lat : lat, ew == 'W' ? -lon : lon );
+    }
+    g_dir_close ( gdir );
+  }
+}
+
+#ifdef VIK_CONFIG_DEM24K
+static void dem24k_coverage_scan ( const gchar *cache_dir )
+{
+  gchar *top = g_strdup_printf ( "%sdem24k", cache_dir );
+  GDir *lat_dir = g_dir_open ( top, 0, NULL );
+  if ( lat_dir ) {
+    const gchar *lat_name;
+    while ( (lat_name = g_dir_read_name ( lat_dir )) ) {
+      gchar *lat_path = g_build_filename ( top, lat_name, NULL );
+      GDir *lon_dir = g_dir_open ( lat_path, 0, NULL );
+      if ( lon_dir ) {
+        const gchar *lon_name;
+        while ( (lon_name = g_dir_read_name ( lon_dir )) ) {
+          gchar *lon_path = g_build_filename ( lat_path, lon_name, NULL );
+          GDir *gdir = g_dir_open ( lon_path, 0, NULL );
+          if ( gdir ) {
+            const gchar *name;
+            while ( (name = g_dir_read_name ( gdir )) ) {
+              gdouble lat, lon;
+              if ( g_str_has_suffix ( name, ".dem" ) && sscanf ( name, "%lf,%lf", &lat, &lon ) == 2 )
+                g_hash_table_add ( dem24k_coverage, dem24k_coverage_key ( (gint)round(lat*8), (gint)round(lon*8) ) );
+            }
+            g_dir_close ( gdir );
+          }
+          g_free ( lon_path );
+        }
+        g_dir_close ( lon_dir );
+      }
+      g_free ( lat_path );
+    }
+    g_dir_close ( lat_dir );
+  }
+  g_free ( top );
+}
+#endif
+
+/**
+ * Only on the main thread
+ */
+static void dem_coverage_init ()
+{
+  if ( coverage_scanned )
+    return;
+  coverage_scanned = TRUE;
+  srtm_coverage_scan ( MAPS_CACHE_DIR );
+#ifdef VIK_CONFIG_DEM24K
+  g_mutex_lock ( dem24k_coverage_mutex );
+  dem24k_coverage_scan ( MAPS_CACHE_DIR );
+  g_mutex_unlock ( dem24k_coverage_mutex );
+#endif
+}
+
+/**
+ * Record the tile covering lat, lon of the given source is now on disk.
+ * Can be called from any thread.
+ */
+static void dem_coverage_add ( guint source, gdouble lat, gdouble lon )
+{
+  if ( source == DEM_SOURCE_SRTM )
+    srtm_coverage_set ( (gint)floor(lat), (gint)floor(lon) );
+#ifdef VIK_CONFIG_DEM24K
+  else if ( source == DEM_SOURCE_DEM24K ) {
+    g_mutex_lock ( dem24k_coverage_mutex );
+    g_hash_table_add ( dem24k_coverage, dem24k_coverage_key ( (gint)floor(lat*8), (gint)ceil(lon*8) ) );
+    g_mutex_unlock ( dem24k_coverage_mutex );
+  }
+#endif
+}
+
 /* TODO: generalize */
 static void srtm_draw_existence ( VikViewport *vp )
 {
   gdouble max_lat, max_lon, min_lat, min_lon;
-  gchar buf[strlen(MAPS_CACHE_DIR)+strlen(SRTM_CACHE_TEMPLATE)+30];
   gint i, j;
 
+  dem_coverage_init ();
   vik_viewport_get_min_max_lat_lon ( vp, &min_lat, &max_lat, &min_lon, &max_lon );
 
-  for (i = floor(min_lat); i <= floor(max_lat); i++) {
-    for (j = floor(min_lon); j <= floor(max_lon); j++) {
-      const gchar *continent_dir;
-      if ((continent_dir = srtm_continent_dir(i, j)) == NULL)
-        continue;
-      g_snprintf(buf, sizeof(buf), SRTM_CACHE_TEMPLATE,
-                MAPS_CACHE_DIR,
-                continent_dir,
-                G_DIR_SEPARATOR_S,
-		(i >= 0) ? 'N' : 'S',
-		ABS(i),
-		(j >= 0) ? 'E' : 'W',
-		ABS(j) );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+  for (i = MAX(floor(min_lat), -90); i <= MIN(floor(max_lat), 89); i++) {
+    for (j = MAX(floor(min_lon), -180); j <= MIN(floor(max_lon), 179); j++) {
+      if ( srtm_coverage_get ( i, j ) ) {
         VikCoord ne, sw;
         gint x1, y1, x2, y2;
         sw.north_south = i;
@@ -1452,33 +1966,15 @@ static gchar *dem24k_lat_lon_to_dest_fn ( gdouble lat, gdouble lon )
 static void dem24k_draw_existence ( VikViewport *vp )
 {
   gdouble max_lat, max_lon, min_lat, min_lon;
-  gchar buf[strlen(MAPS_CACHE_DIR)+40];
   gdouble i, j;
 
+  dem_coverage_init ();
   vik_viewport_get_min_max_lat_lon ( vp, &min_lat, &max_lat, &min_lon, &max_lon );
 
+  g_mutex_lock ( dem24k_coverage_mutex );
   for (i = floor(min_lat*8)/8; i <= floor(max_lat*8)/8; i+=0.125) {
-    /* check lat dir first -- faster */
-    g_snprintf(buf, sizeof(buf), "%sdem24k/%d/",
-        MAPS_CACHE_DIR,
-	(gint) i );
-    if ( g_file_test(buf, G_FILE_TEST_EXISTS) == FALSE )
-      continue;
     for (j = floor(min_lon*8)/8; j <= floor(max_lon*8)/8; j+=0.125) {
-      /* check lon dir first -- faster */
-      g_snprintf(buf, sizeof(buf), "%sdem24k/%d/%d/",
-        MAPS_CACHE_DIR,
-	(gint) i,
-        (gint) j );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS) == FALSE )
-        continue;
-      g_snprintf(buf, sizeof(buf), "%sdem24k/%d/%d/%.03f,%.03f.dem",
-	        MAPS_CACHE_DIR,
-		(gint) i,
-		(gint) j,
-		floor(i*8)/8,
-		floor(j*8)/8 );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+      if ( g_hash_table_contains ( dem24k_coverage, dem24k_coverage_key ( (gint)round(i*8), (gint)round(j*8) ) ) ) {
         VikCoord ne, sw;
         gint x1, y1, x2, y2;
         sw.north_south = i;
@@ -1495,6 +1991,7 @@ static void dem24k_draw_existence ( VikViewport *vp )
       }
     }
   }
+  g_mutex_unlock ( dem24k_coverage_mutex );
 }
 #endif
 
@@ -1521,11 +2018,13 @@ static gboolean dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename )
     /* only load if file size is not 0 (not in progress) */
     GStatBuf sb;
     (void)g_stat ( filename, &sb );
-    if ( sb.st_size ) {
+    if ( sb.st_size && !g_list_find_custom ( vdl->files, filename, (GCompareFunc)g_strcmp0 ) ) {
       gchar *duped_path = g_strdup(filename);
       vdl->files = g_list_prepend ( vdl->files, duped_path );
       a_dems_load ( duped_path );
       g_debug("%s: %s", __FUNCTION__, duped_path);
+      // Tiles already drawn here would otherwise stay empty
+      dem_render_invalidate ( vdl->render_ctx );
     }
     return TRUE;
   } else
@@ -1534,7 +2033,9 @@ static gboolean dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename )
 
 static void dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
 {
-  if ( p->source == DEM_SOURCE_SRTM )
+  if ( !p->download )
+    ; // Only needs adding
+  else if ( p->source == DEM_SOURCE_SRTM )
     srtm_dem_download_thread ( p, threaddata );
 #ifdef VIK_CONFIG_DEM24K
   else if ( p->source == DEM_SOURCE_DEM24K )
@@ -1543,6 +2044,9 @@ static void dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
   else
     return;
 
+  if ( p->download && g_file_test ( p->dest, G_FILE_TEST_EXISTS ) )
+    dem_coverage_add ( p->source, p->lat, p->lon );
+
   g_mutex_lock ( p->mutex );
   if ( p->vdl ) {
     g_object_weak_unref ( G_OBJECT(p->vdl), weak_ref_cb, p );
@@ -1550,18 +2054,194 @@ static void dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
     if ( dem_layer_add_file ( p->vdl, p->dest ) ) {
       vik_layer_emit_update ( VIK_LAYER(p->vdl), TRUE ); // NB update requested from background thread
     }
+    p->vdl = NULL;
   }
   g_mutex_unlock ( p->mutex );
 }
 
-
 static void free_dem_download_params ( DEMDownloadParams *p )
 {
+  if ( p->prefetch ) {
+    g_mutex_lock ( prefetch_mutex );
+    if ( !p->failed )
+      g_hash_table_remove ( prefetch_requested, p->dest );
+    g_mutex_unlock ( prefetch_mutex );
+  }
+  // Still referenced if never run (i.e. cancelled whilst waiting)
+  g_mutex_lock ( p->mutex );
+  if ( p->vdl )
+    g_object_weak_unref ( G_OBJECT(p->vdl), weak_ref_cb, p );
+  g_mutex_unlock ( p->mutex );
+
   vik_mutex_free ( p->mutex );
   g_free ( p->dest );
   g_free ( p );
 }
 
+/**************************************************
+ *   PREFETCHING                                  *
+ **************************************************/
+
+// Don't prefetch the view when it covers more degree cells than this (e.g. zoomed right out)
+#define DEM_PREFETCH_VIEW_MAX 16
+// Additional degrees all around the view
+#define DEM_PREFETCH_MARGIN 1
+// Most degree cells along the selected track or route
+#define DEM_PREFETCH_TRACK_MAX 64
+
+typedef struct {
+  gint lat, lon; // South west corner
+  Background_Priority priority;
+} DEMPrefetchCell;
+
+typedef struct {
+  VikDEMLayer *vdl;
+  GHashTable *wanted; // dest -> DEMPrefetchCell
+} DEMPrefetchView;
+
+/**
+ * Keep waiting prefetches in order of what's wanted now, dropping any no longer wanted
+ */
+static Background_Priority dem_prefetch_priority ( DEMDownloadParams *p, Background_Priority current, DEMPrefetchView *view )
+{
+  if ( !p->prefetch || p->vdl != view->vdl )
+    return current;
+
+  DEMPrefetchCell *cell = g_hash_table_lookup ( view->wanted, p->dest );
+  return cell ? cell->priority : BACKGROUND_PRIORITY_CANCEL;
+}
+
+/**
+ * Note the SRTM cell is wanted at this priority, unless already more urgently
+ *
+ * Returns TRUE if the cell was not already wanted
+ */
+static gboolean dem_prefetch_want ( GHashTable *wanted, gint lat, gint lon, Background_Priority priority )
+{
+  if ( lat < -90 || lat >= 90 )
+    return FALSE;
+  lon = ((lon + 180) % 360 + 360) % 360 - 180;
+  // Over the sea
+  if ( !srtm_continent_dir ( lat, lon ) )
+    return FALSE;
+
+  gchar *dem_file = srtm_lat_lon_to_dest_fn ( lat, lon );
+  gchar *dest = g_strdup_printf ( "%s%s", MAPS_CACHE_DIR, dem_file );
+  g_free ( dem_file );
+
+  DEMPrefetchCell *cell = g_hash_table_lookup ( wanted, dest );
+  if ( cell ) {
+    cell->priority = MIN ( cell->priority, priority );
+    g_free ( dest );
+    return FALSE;
+  }
+  cell = g_malloc ( sizeof(DEMPrefetchCell) );
+  cell->lat = lat;
+  cell->lon = lon;
+  cell->priority = priority;
+  g_hash_table_insert ( wanted, dest, cell );
+  return TRUE;
+}
+
+/**
+ * Start loading the DEM for the cell, downloading it first if necessary
+ */
+static void dem_prefetch_queue ( VikDEMLayer *vdl, const gchar *dest, DEMPrefetchCell *cell )
+{
+  if ( g_list_find_custom ( vdl->files, dest, (GCompareFunc)g_strcmp0 ) )
+    return;
+
+  g_mutex_lock ( prefetch_mutex );
+  gboolean requested = g_hash_table_contains ( prefetch_requested, dest );
+  if ( !requested )
+    g_hash_table_add ( prefetch_requested, g_strdup(dest) );
+  g_mutex_unlock ( prefetch_mutex );
+  if ( requested )
+    return;
+
+  DEMDownloadParams *p = g_malloc0 ( sizeof(DEMDownloadParams) );
+  p->dest = g_strdup ( dest );
+  // Middle of the cell
+  p->lat = cell->lat + 0.5;
+  p->lon = cell->lon + 0.5;
+  p->vdl = vdl;
+  p->mutex = vik_mutex_new ();
+  p->source = DEM_SOURCE_SRTM;
+  p->download = !g_file_test ( dest, G_FILE_TEST_EXISTS );
+  p->prefetch = TRUE;
+  g_object_weak_ref ( G_OBJECT(p->vdl), weak_ref_cb, p );
+
+  gchar *name = g_path_get_basename ( dest );
+  gchar *msg = g_strdup_printf ( p->download ? _("Prefetching DEM %s") : _("Loading DEM %s"), name );
+  a_background_thread_with_priority ( p->download ? BACKGROUND_POOL_REMOTE : BACKGROUND_POOL_LOCAL,
+                                      cell->priority,
+                                      VIK_GTK_WINDOW_FROM_LAYER(vdl), msg,
+                                      (vik_thr_func) dem_download_thread, p,
+                                      (vik_thr_free_func) free_dem_download_params, NULL, 1 );
+  g_free ( msg );
+  g_free ( name );
+}
+
+/**
+ * Get the SRTM DEMs for the view (and around it) and along the selected track or route,
+ *  so they are available for drawing and elevation lookups before they are asked for
+ */
+static void dem_layer_prefetch ( VikDEMLayer *vdl, VikViewport *vp )
+{
+  gdouble min_lat, max_lat, min_lon, max_lon;
+  vik_viewport_get_min_max_lat_lon ( vp, &min_lat, &max_lat, &min_lon, &max_lon );
+  gint cells[4] = { floor(min_lat), floor(max_lat), floor(min_lon), floor(max_lon) };
+
+  GtkWindow *gw = VIK_GTK_WINDOW_FROM_LAYER(vdl);
+  VikTrack *trk = gw ? vik_window_get_selected_track ( VIK_WINDOW(gw) ) : NULL;
+
+  if ( vdl->prefetch_done && trk == vdl->prefetch_track && memcmp ( cells, vdl->prefetch_cells, sizeof(cells) ) == 0 )
+    return;
+  vdl->prefetch_done = TRUE;
+  vdl->prefetch_track = trk;
+  memcpy ( vdl->prefetch_cells, cells, sizeof(cells) );
+
+  GHashTable *wanted = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+
+  if ( (cells[1] - cells[0] + 1) * (cells[3] - cells[2] + 1) <= DEM_PREFETCH_VIEW_MAX ) {
+    for ( gint lat = cells[0] - DEM_PREFETCH_MARGIN; lat <= cells[1] + DEM_PREFETCH_MARGIN; lat++ ) {
+      for ( gint lon = cells[2] - DEM_PREFETCH_MARGIN; lon <= cells[3] + DEM_PREFETCH_MARGIN; lon++ ) {
+        gboolean visible = lat >= cells[0] && lat <= cells[1] && lon >= cells[2] && lon <= cells[3];
+        (void)dem_prefetch_want ( wanted, lat, lon, visible ? BACKGROUND_PRIORITY_VISIBLE : BACKGROUND_PRIORITY_NEARBY );
+      }
+    }
+  }
+
+  // Only the cells the track actually passes through, rather than all of its bounding box
+  if ( trk ) {
+    guint count = 0;
+    gint last_lat = G_MININT, last_lon = G_MININT;
+    for ( GList *iter = trk->trackpoints; iter && count < DEM_PREFETCH_TRACK_MAX; iter = iter->next ) {
+      struct LatLon ll;
+      vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &ll );
+      gint lat = floor ( ll.lat );
+      gint lon = floor ( ll.lon );
+      if ( lat == last_lat && lon == last_lon )
+        continue;
+      last_lat = lat;
+      last_lon = lon;
+      if ( dem_prefetch_want ( wanted, lat, lon, BACKGROUND_PRIORITY_NEARBY ) )
+        count++;
+    }
+  }
+
+  DEMPrefetchView view = { vdl, wanted };
+  a_background_reprioritise ( (vik_thr_func)dem_download_thread, (vik_thr_priority_func)dem_prefetch_priority, &view );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, wanted );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    dem_prefetch_queue ( vdl, key, value );
+
+  g_hash_table_destroy ( wanted );
+}
+
 static gpointer dem_layer_download_create ( VikWindow *vw, VikViewport *vvp)
 {
   return vvp;
@@ -1645,16 +2325,16 @@ static VikLayerToolFuncStatus dem_layer_download_release ( VikDEMLayer *vdl, Gdk
   g_debug("%s: %s", __FUNCTION__, full_path);
 
   if ( event->button == 1 ) {
-    // TODO: check if already in filelist
     if ( ! dem_layer_add_file(vdl, full_path) ) {
       gchar *tmp = g_strdup_printf ( _("Downloading DEM %s"), dem_file );
-      DEMDownloadParams *p = g_malloc(sizeof(DEMDownloadParams));
+      DEMDownloadParams *p = g_malloc0(sizeof(DEMDownloadParams));
       p->dest = g_strdup(full_path);
       p->lat = ll.lat;
       p->lon = ll.lon;
       p->vdl = vdl;
       p->mutex = vik_mutex_new();
       p->source = vdl->source;
+      p->download = TRUE;
       g_object_weak_ref(G_OBJECT(p->vdl), weak_ref_cb, p );
 
       a_background_thread ( BACKGROUND_POOL_REMOTE,
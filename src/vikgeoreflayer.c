@@ -24,6 +24,10 @@
 #include <ctype.h>
 
 #include "vikmapslayer.h"
+#include "imagepyramid.h"
+
+// Images of at least this size are drawn from overviews, rather than being decoded in full
+#define GEOREF_OVERVIEW_MIN_PIXELS (4096*4096)
 
 /*
 static VikLayerParamData image_default ( void )
@@ -59,6 +63,7 @@ enum {
   NUM_PARAMS };
 
 static const gchar* georef_layer_tooltip ( VikGeorefLayer *vgl );
+static gsize georef_layer_get_memory_usage ( VikGeorefLayer *vgl );
 static void georef_layer_marshall( VikGeorefLayer *vgl, guint8 **data, guint *len );
 static VikGeorefLayer *georef_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean georef_layer_set_param ( VikGeorefLayer *vgl, VikLayerSetParam *vlsp );
@@ -68,6 +73,7 @@ static VikGeorefLayer *georef_layer_create ( VikViewport *vp );
 static void georef_layer_free ( VikGeorefLayer *vgl );
 static gboolean georef_layer_properties ( VikGeorefLayer *vgl, gpointer vp, gboolean have_apply );
 static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp );
+static gboolean georef_layer_draw_surface ( VikGeorefLayer *vgl, const VikViewportProjection *proj, cairo_t *cr );
 static void georef_layer_add_menu_items ( VikGeorefLayer *vgl, GtkMenu *menu, gpointer vlp );
 static void georef_layer_set_image ( VikGeorefLayer *vgl, const gchar *image );
 static gboolean georef_layer_dialog ( VikGeorefLayer *vgl, gpointer vp, GtkWindow *w, gboolean have_apply_button );
@@ -166,6 +172,10 @@ VikLayerInterface vik_georef_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+
+  (VikLayerFuncDrawSurface)             georef_layer_draw_surface,
+
+  (VikLayerFuncGetMemoryUsage)          georef_layer_get_memory_usage,
 };
 
 typedef struct {
@@ -192,6 +202,7 @@ struct _VikGeorefLayer {
   VikLayer vl;
   gchar *image;
   GdkPixbuf *pixbuf;
+  ImagePyramid *overview; // Instead of the pixbuf for large images
   guint8 alpha;
 
   struct UTM corner; // Top Left
@@ -260,6 +271,16 @@ static const gchar* georef_layer_tooltip ( VikGeorefLayer *vgl )
   return vgl->image;
 }
 
+#define GEOREF_PIXBUF_SIZE(pb) ((pb) ? (gsize)gdk_pixbuf_get_rowstride(pb) * gdk_pixbuf_get_height(pb) : 0)
+
+/**
+ * The image, as loaded and as last drawn
+ */
+static gsize georef_layer_get_memory_usage ( VikGeorefLayer *vgl )
+{
+  return GEOREF_PIXBUF_SIZE(vgl->pixbuf) + GEOREF_PIXBUF_SIZE(vgl->rotated) + GEOREF_PIXBUF_SIZE(vgl->scaled);
+}
+
 static void georef_layer_marshall( VikGeorefLayer *vgl, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vgl), data, len );
@@ -455,31 +476,47 @@ static void georef_layer_mpp_from_coords ( VikCoordMode mode, struct LatLon ll_t
   *ympp = (diffy / height) / factor;
 }
 
-static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
+/**
+ * Work out the image to draw for the view and where it goes
+ * Only uses the projection (rather than the viewport) so it can be used from any thread
+ *
+ * Returns: The image (owned by the layer) or NULL if there's nothing to draw
+ */
+static GdkPixbuf *georef_layer_draw_prepare ( VikGeorefLayer *vgl, const VikViewportProjection *proj, gint *dest_x, gint *dest_y )
 {
-  if ( vgl->pixbuf )
+  guint image_width = 0;
+  guint image_height = 0;
+  if ( vgl->pixbuf ) {
+    image_width = gdk_pixbuf_get_width ( vgl->pixbuf );
+    image_height = gdk_pixbuf_get_height ( vgl->pixbuf );
+  }
+  else if ( vgl->overview && image_pyramid_is_ready ( vgl->overview ) )
+    image_pyramid_get_size ( vgl->overview, &image_width, &image_height );
+
+  if ( image_width && image_height )
   {
-    const gdouble xmpp = vik_viewport_get_xmpp(vp);
-    const gdouble ympp = vik_viewport_get_ympp(vp);
-    const guint vp_width = vik_viewport_get_width(vp);
-    const guint vp_height = vik_viewport_get_height(vp);
+    const gdouble xmpp = proj->xmpp;
+    const gdouble ympp = proj->ympp;
+    const guint vp_width = proj->width;
+    const guint vp_height = proj->height;
     gint x, y;
     VikCoord corner_coord;
-    vik_coord_load_from_utm ( &corner_coord, vik_viewport_get_coord_mode(vp), &(vgl->corner) );
-    vik_viewport_coord_to_screen ( vp, &corner_coord, &x, &y );
+    vik_coord_load_from_utm ( &corner_coord, proj->coord_mode, &(vgl->corner) );
+    const VikCoord *corner = &corner_coord;
+    vik_viewport_projection_coords_to_screen ( proj, &corner, 1, &x, &y );
 
     // The main point is to avoid the relatively compute expensive pixbuf operations: scaling and/or rotation
     // otherwise for e.g. panning around or other redraw events we may be able use the existing pixbuf as is
     //  but just with updated positioning within the viewport,
     //  although this only really works when the entire image is in bounds.
 
-    const guint layer_width_scaled = round(gdk_pixbuf_get_width(vgl->pixbuf) * vgl->mpp_easting / xmpp);
-    const guint layer_height_scaled = round(gdk_pixbuf_get_height(vgl->pixbuf) * vgl->mpp_northing / ympp);
+    const guint layer_width_scaled = round(image_width * vgl->mpp_easting / xmpp);
+    const guint layer_height_scaled = round(image_height * vgl->mpp_northing / ympp);
 
     // Has the scaling calculation worked?
     // unclear if this can fail, but maintain defensive check
     if ( layer_width_scaled == 0 || layer_height_scaled == 0 )
-      return;
+      return NULL;
 
     const gdouble xscale = xmpp / vgl->mpp_easting; // source pixels per viewport pixel
     const gdouble yscale = ympp / vgl->mpp_northing;
@@ -491,7 +528,8 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
 
     // NB rtn_x_offset and rtn_y_offset are in 'full' pixels
     //  thus when applied to current viewport need to scaled too
-    if ( vgl->rotation != 0.0 ) {
+    // Overviews are only used when there is no rotation
+    if ( vgl->rotation != 0.0 && vgl->pixbuf ) {
 
       if ( rotation_change ) {
 
@@ -522,8 +560,8 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
       vgl->rtn_x_offset_full = 0;
       vgl->rtn_y_offset_full = 0;
 
-      vgl->width = gdk_pixbuf_get_width(vgl->pixbuf);
-      vgl->height = gdk_pixbuf_get_height(vgl->pixbuf);
+      vgl->width = image_width;
+      vgl->height = image_height;
     }
 
     // Adjust to current vp pixel scale
@@ -574,9 +612,9 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
         // Check for transistions into the area
         //  - can't reuse an old image as it may have parts missing as wasn't in previous viewport area
         if ( vgl->can_draw_reuse ) {
-          vik_viewport_draw_pixbuf ( vp, vgl->scaled,
-                                     0, 0, vp_xoffset, vp_yoffset, vp_width_copy, vp_height_copy );
-          return;
+          *dest_x = vp_xoffset;
+          *dest_y = vp_yoffset;
+          return vgl->scaled;
         }
         // Could be alright next time!
         vgl->can_draw_reuse = TRUE;
@@ -585,37 +623,78 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
 
       // Scaling to smaller than 2x2 seems to be broken
       if ( vp_width_copy < 2 || vp_height_copy < 2 )
-        return;
-
-      // Otherwise create sub-region of source image to apply scaling to
-      GdkPixbuf *subpixbuf = gdk_pixbuf_new_subpixbuf ( vgl->rotated ? vgl->rotated : vgl->pixbuf,
-                                                        src_xoffset,
-                                                        src_yoffset,
-                                                        src_width,
-                                                        src_height );
-
-      GdkPixbuf *scld_pixbuf = ui_pixbuf_scale_simple_safe ( subpixbuf,
-                                                             vp_width_copy,
-                                                             vp_height_copy,
-                                                             50,
-                                                             GDK_INTERP_BILINEAR );
-      if ( subpixbuf != NULL )
-        g_object_unref ( subpixbuf );
+        return NULL;
+
+      GdkPixbuf *scld_pixbuf = NULL;
+      if ( vgl->pixbuf ) {
+        // Otherwise create sub-region of source image to apply scaling to
+        GdkPixbuf *subpixbuf = gdk_pixbuf_new_subpixbuf ( vgl->rotated ? vgl->rotated : vgl->pixbuf,
+                                                          src_xoffset,
+                                                          src_yoffset,
+                                                          src_width,
+                                                          src_height );
+
+        scld_pixbuf = ui_pixbuf_scale_simple_safe ( subpixbuf,
+                                                    vp_width_copy,
+                                                    vp_height_copy,
+                                                    50,
+                                                    GDK_INTERP_BILINEAR );
+        if ( subpixbuf != NULL )
+          g_object_unref ( subpixbuf );
+      }
+      else {
+        // Only the overview tiles covering the area get decoded
+        scld_pixbuf = image_pyramid_render ( vgl->overview,
+                                             src_xoffset,
+                                             src_yoffset,
+                                             src_width,
+                                             src_height,
+                                             vp_width_copy,
+                                             vp_height_copy );
+        if ( scld_pixbuf && vgl->alpha < 255 )
+          scld_pixbuf = ui_pixbuf_set_alpha ( scld_pixbuf, vgl->alpha );
+      }
 
       if ( scld_pixbuf == NULL )
-        return;
+        return NULL;
 
       // Save for reuse
       if ( vgl->scaled )
         g_object_unref ( vgl->scaled );
       vgl->scaled = scld_pixbuf;
 
-      vik_viewport_draw_pixbuf ( vp, vgl->scaled,
-                                 0, 0, vp_xoffset, vp_yoffset, vp_width_copy, vp_height_copy );
+      *dest_x = vp_xoffset;
+      *dest_y = vp_yoffset;
+      return vgl->scaled;
     }
   }
+  return NULL;
+}
+
+static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
+{
+  gint x, y;
+  GdkPixbuf *pixbuf = georef_layer_draw_prepare ( vgl, vik_viewport_get_projection(vp), &x, &y );
+  if ( pixbuf )
+    vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, x, y, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf) );
+}
+
+/**
+ * Thread safe version of georef_layer_draw(), as the expensive scaling/rotation
+ *  can then happen at the same time as other layers are drawn
+ */
+static gboolean georef_layer_draw_surface ( VikGeorefLayer *vgl, const VikViewportProjection *proj, cairo_t *cr )
+{
+  gint x, y;
+  GdkPixbuf *pixbuf = georef_layer_draw_prepare ( vgl, proj, &x, &y );
+  if ( pixbuf ) {
+    gdk_cairo_set_source_pixbuf ( cr, pixbuf, x, y );
+    cairo_paint ( cr );
+  }
+  return TRUE;
 }
 
+
 static void georef_layer_free ( VikGeorefLayer *vgl )
 {
   if ( vgl->image )
@@ -626,6 +705,7 @@ static void georef_layer_free ( VikGeorefLayer *vgl )
     g_object_unref ( vgl->rotated );
   if ( vgl->pixbuf )
     g_object_unref ( vgl->pixbuf );
+  image_pyramid_free ( vgl->overview );
 }
 
 static VikGeorefLayer *georef_layer_create ( VikViewport *vp )
@@ -661,6 +741,23 @@ static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboo
     g_object_unref ( G_OBJECT(vgl->rotated) );
     vgl->rotated = NULL;
   }
+  vgl->pixbuf = NULL;
+  image_pyramid_free ( vgl->overview );
+  vgl->overview = NULL;
+  vgl->can_draw_reuse = FALSE;
+
+  // Large images are drawn from overviews, unless rotated as that needs the whole image
+  gint width, height;
+  if ( vgl->rotation == 0.0 &&
+       gdk_pixbuf_get_file_info ( vgl->image, &width, &height ) &&
+       (gint64)width * height >= GEOREF_OVERVIEW_MIN_PIXELS ) {
+    vgl->overview = image_pyramid_new ( vgl->image, VIK_LAYER(vgl), VIK_GTK_WINDOW_FROM_WIDGET(vp) );
+    if ( vgl->overview ) {
+      vgl->width = width;
+      vgl->height = height;
+      return;
+    }
+  }
 
   vgl->pixbuf = gdk_pixbuf_new_from_file ( vgl->image, &gx );
 
@@ -984,17 +1081,13 @@ static void calculate_mpp_from_coords ( GtkWidget *ww, VikGeorefLayer *vgl )
   if ( !filename ) {
     return;
   }
-  GError *gx = NULL;
-  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( filename, &gx );
-  if ( gx ) {
-    a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(ww), _("Couldn't open image file: %s"), gx->message );
-    g_error_free ( gx );
+  // Only the size is needed, so avoid decoding the whole image
+  gint width, height;
+  if ( !gdk_pixbuf_get_file_info ( filename, &width, &height ) ) {
+    a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(ww), _("Couldn't open image file: %s"), filename );
     return;
   }
 
-  guint width = gdk_pixbuf_get_width ( pixbuf );
-  guint height = gdk_pixbuf_get_height ( pixbuf );
-
   if ( width == 0 || height == 0 ) {
     a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(ww), _("Invalid image size: %s"), filename);
   }
@@ -1012,8 +1105,6 @@ static void calculate_mpp_from_coords ( GtkWidget *ww, VikGeorefLayer *vgl )
 
     check_br_is_good_or_msg_user ( vgl );
   }
-
-  g_object_unref ( G_OBJECT(pixbuf) );
 }
 
 #define VIK_SETTINGS_GEOREF_TAB "georef_coordinate_tab"
@@ -1198,6 +1289,9 @@ static gboolean georef_layer_dialog ( VikGeorefLayer *vgl, gpointer vp, GtkWindo
         georef_layer_set_image ( vgl, vik_file_entry_get_filename(VIK_FILE_ENTRY(cw.imageentry)) );
         georef_layer_load_image ( vgl, VIK_VIEWPORT(vp), FALSE );
       }
+      else if ( vgl->overview && vgl->rotation != 0.0 )
+        // Rotation needs the whole image
+        georef_layer_load_image ( vgl, VIK_VIEWPORT(vp), FALSE );
 
       vgl->alpha = (guint8) gtk_range_get_value ( GTK_RANGE(alpha_scale) );
       if ( vgl->pixbuf && vgl->alpha <= 255 )
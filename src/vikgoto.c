@@ -241,6 +241,55 @@ static gboolean goto_search_selection_release ( struct VikGotoSearchWinData *vgs
   return FALSE;
 }
 
+// Loaded items are shown before the results of the goto provider
+#define GOTO_LOADED_MAX 50
+
+static void goto_loaded_add ( GList **candidates, const gchar *name, VikLayer *vl, const VikCoord *coord )
+{
+  struct VikGotoCandidate *cand = g_malloc ( sizeof(struct VikGotoCandidate) );
+  cand->description = g_strdup_printf ( "%s (%s)", name, vik_layer_get_name(vl) );
+  vik_coord_to_latlon ( coord, &cand->ll );
+  *candidates = g_list_prepend ( *candidates, cand );
+}
+
+/**
+ * Find the waypoints, tracks and routes of all the loaded layers
+ *  with names starting with or containing the text - which needs no network request
+ */
+static GList *goto_loaded_candidates ( VikLayersPanel *vlp, const gchar *text )
+{
+  GList *candidates = NULL;
+  if ( !vlp || !text[0] )
+    return candidates;
+
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vlp), NULL, VIK_LAYER_TRW, TRUE );
+  guint count = 0;
+  for ( GList *ll = layers; ll && count < GOTO_LOADED_MAX; ll = ll->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(ll->data);
+    GList *wps = vik_trw_layer_find_by_name ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, text, TRUE, GOTO_LOADED_MAX - count );
+    for ( GList *gl = wps; gl; gl = gl->next, count++ ) {
+      VikWaypoint *wp = gl->data;
+      goto_loaded_add ( &candidates, wp->name, VIK_LAYER(vtl), &wp->coord );
+    }
+    g_list_free ( wps );
+    const gint types[] = { VIK_TRW_LAYER_SUBLAYER_TRACK, VIK_TRW_LAYER_SUBLAYER_ROUTE };
+    for ( guint tt = 0; tt < G_N_ELEMENTS(types) && count < GOTO_LOADED_MAX; tt++ ) {
+      GList *trks = vik_trw_layer_find_by_name ( vtl, types[tt], text, TRUE, GOTO_LOADED_MAX - count );
+      for ( GList *gl = trks; gl; gl = gl->next ) {
+        VikTrack *trk = gl->data;
+        VikTrackpoint *tp = vik_track_get_tp_first ( trk );
+        if ( tp ) {
+          goto_loaded_add ( &candidates, trk->name, VIK_LAYER(vtl), &tp->coord );
+          count++;
+        }
+      }
+      g_list_free ( trks );
+    }
+  }
+  g_list_free ( layers );
+  return g_list_reverse ( candidates );
+}
+
 static void goto_search_response ( struct VikGotoSearchWinData *data, gint response )
 {
   if ( response == GTK_RESPONSE_ACCEPT )
@@ -266,6 +315,17 @@ static void goto_search_response ( struct VikGotoSearchWinData *data, gint respo
     int ans = vik_goto_tool_get_candidates ( tool, goto_str, &candidates );
     vik_window_clear_busy_cursor_widget ( data->dialog, data->vw );
 
+    GList *loaded = goto_loaded_candidates ( data->vlp, goto_str );
+    if ( loaded ) {
+      // Still show these if the provider can not be reached
+      if ( ans != 0 ) {
+        g_list_free_full ( candidates, vik_goto_tool_free_candidate );
+        candidates = NULL;
+        ans = 0;
+      }
+      candidates = g_list_concat ( loaded, candidates );
+    }
+
     if ( ans == 0 ) {
       // make results visible
       gdouble scale = vik_viewport_get_scale ( NULL );
@@ -462,6 +522,10 @@ struct _VikGotoPanel {
   GtkTreeView *results_view;
   GtkListStore *results_store;
   VikLayersPanel *vlp;
+  // Each search supersedes any still in progress, whose results are then dropped
+  guint search_serial;
+  VikGotoTool *search_tool; // Of the search in progress
+  gchar *search_str;        // NULL when none is in progress
 };
 
 static void vik_goto_panel_init ( VikGotoPanel *vgp )
@@ -476,6 +540,7 @@ static void goto_panel_finalize ( GObject *gob )
 {
   VikGotoPanel *vgp = VIK_GOTO_PANEL ( gob );
   g_object_unref ( vgp->results_store );
+  g_free ( vgp->search_str );
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
 
@@ -497,7 +562,9 @@ VikGotoPanel *vik_goto_panel_new ()
 
 typedef struct {
   VikGotoTool *tool;
+  guint serial;
   int answer;
+  GList *loaded; // From goto_loaded_candidates()
   GList *candidates;
   gchar *goto_str;
   VikViewport *vvp;
@@ -511,6 +578,7 @@ typedef struct {
 static void stt_free ( SearchThreadT *stt )
 {
   vik_mutex_free ( stt->mutex );
+  g_list_free_full ( stt->loaded, vik_goto_tool_free_candidate );
   g_list_free_full ( stt->candidates, vik_goto_tool_free_candidate );
   g_free ( stt->goto_str );
   g_free ( stt );
@@ -574,17 +642,10 @@ static void goto_panel_search_clear ( VikGotoPanel *vgp )
   gtk_widget_set_sensitive ( vgp->find_button, TRUE );
 }
 
-static gboolean _idle_update ( gpointer user_data )
+static void goto_panel_add_candidates ( VikGotoPanel *vgp, GList *candidates )
 {
-  SearchThreadT *stt = (SearchThreadT*)user_data;
-  VikGotoPanel *vgp = stt->vgp;
-
-  gtk_list_store_clear ( vgp->results_store );
-
-  GtkTreeViewColumn *desc_col = gtk_tree_view_get_column ( GTK_TREE_VIEW(vgp->results_view), VIK_GOTO_SEARCH_DESC_COL );
-
   GtkTreeIter results_iter;
-  for ( GList *gl = stt->candidates; gl != NULL; gl = gl->next ) {
+  for ( GList *gl = candidates; gl != NULL; gl = gl->next ) {
     struct VikGotoCandidate *cand = (struct VikGotoCandidate *) gl->data;
     gtk_list_store_append ( vgp->results_store, &results_iter );
     gtk_list_store_set ( vgp->results_store, &results_iter,
@@ -593,8 +654,18 @@ static gboolean _idle_update ( gpointer user_data )
                          VIK_GOTO_SEARCH_LON_COL, cand->ll.lon,
                          -1 );
   }
+}
+
+static void goto_panel_show_results ( VikGotoPanel *vgp, GList *loaded, GList *candidates, int answer )
+{
+  gtk_list_store_clear ( vgp->results_store );
 
-  if ( g_list_length( stt->candidates ) > 0 ) {
+  GtkTreeViewColumn *desc_col = gtk_tree_view_get_column ( GTK_TREE_VIEW(vgp->results_view), VIK_GOTO_SEARCH_DESC_COL );
+
+  goto_panel_add_candidates ( vgp, loaded );
+  goto_panel_add_candidates ( vgp, candidates );
+
+  if ( loaded || candidates ) {
     gtk_tree_view_column_set_title ( desc_col, _("Description") );
     GtkTreeIter first_iter;
     gtk_tree_model_get_iter_first ( GTK_TREE_MODEL(vgp->results_store), &first_iter);
@@ -604,10 +675,21 @@ static gboolean _idle_update ( gpointer user_data )
   else
     gtk_tree_view_column_set_title ( desc_col, _("No results") );
 
-  if ( stt->answer != 0 )
+  if ( answer != 0 && !loaded )
     gtk_tree_view_column_set_title ( desc_col, _("Service request failure") );
+}
 
-  gtk_widget_set_sensitive ( vgp->find_button, TRUE );
+static gboolean _idle_update ( gpointer user_data )
+{
+  SearchThreadT *stt = (SearchThreadT*)user_data;
+  VikGotoPanel *vgp = stt->vgp;
+
+  // Unless a newer search has been started since
+  if ( stt->serial == vgp->search_serial ) {
+    goto_panel_show_results ( vgp, stt->loaded, stt->candidates, stt->answer );
+    g_free ( vgp->search_str );
+    vgp->search_str = NULL;
+  }
 
   stt_free ( stt );
 
@@ -647,25 +729,53 @@ static void goto_panel_search_response ( VikGotoPanel *vgp )
     return;
   }
 
-  // Use column title for status reporting
-  GtkTreeViewColumn *desc_col = gtk_tree_view_get_column ( GTK_TREE_VIEW(vgp->results_view), VIK_GOTO_SEARCH_DESC_COL );
-  gtk_tree_view_column_set_title ( desc_col, _("Searching...") );
+  VikGotoTool *tool = g_list_nth_data ( goto_tools_list, atool );
+  const gchar *goto_str = gtk_entry_get_text ( GTK_ENTRY(vgp->goto_entry) );
 
-  // Prevent further requests
-  gtk_widget_set_sensitive ( vgp->find_button, FALSE );
+  // Repeatedly asking for the search already in progress (e.g. from impatient clicking) does nothing more
+  if ( vgp->search_str && vgp->search_tool == tool && !g_strcmp0 ( vgp->search_str, goto_str ) )
+    return;
 
-  VikGotoTool *tool = g_list_nth_data ( goto_tools_list, atool );
   gchar *provider = vik_goto_tool_get_label ( tool );
   a_settings_set_string ( VIK_SETTINGS_GOTO_PROVIDER, provider );
 
+  // Any search in progress is no longer wanted
+  vgp->search_serial++;
+  g_free ( vgp->search_str );
+  vgp->search_str = NULL;
+
+  GList *loaded = goto_loaded_candidates ( vgp->vlp, goto_str );
+
+  // Repeated searches are answered straight away
+  GList *cached = NULL;
+  if ( vik_goto_tool_get_cached_candidates ( tool, goto_str, &cached ) ) {
+    goto_panel_show_results ( vgp, loaded, cached, 0 );
+    g_list_free_full ( loaded, vik_goto_tool_free_candidate );
+    g_list_free_full ( cached, vik_goto_tool_free_candidate );
+    return;
+  }
+
+  // Use column title for status reporting
+  GtkTreeViewColumn *desc_col = gtk_tree_view_get_column ( GTK_TREE_VIEW(vgp->results_view), VIK_GOTO_SEARCH_DESC_COL );
+  gtk_tree_view_column_set_title ( desc_col, _("Searching...") );
+
+  vgp->search_tool = tool;
+  vgp->search_str = g_strdup ( goto_str );
+
   SearchThreadT *stt = g_malloc ( sizeof(SearchThreadT) );
 
-  stt->tool = g_list_nth_data ( goto_tools_list, atool );
+  stt->tool = tool;
+  stt->serial = vgp->search_serial;
   stt->candidates = NULL;
   stt->vvp = vik_layers_panel_get_viewport ( vgp->vlp );
   stt->vgp = vgp;
-  stt->goto_str = g_strdup ( gtk_entry_get_text ( GTK_ENTRY(vgp->goto_entry) ) );
+  stt->goto_str = g_strdup ( goto_str );
   stt->alive = TRUE;
+
+  // Show anything already loaded straight away, whilst waiting on the provider
+  stt->loaded = loaded;
+  gtk_list_store_clear ( vgp->results_store );
+  goto_panel_add_candidates ( vgp, stt->loaded );
   stt->mutex = vik_mutex_new();
 
   gchar *msg = g_strdup_printf ( _("Goto request on: %s"), stt->goto_str );
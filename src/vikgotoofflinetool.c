@@ -0,0 +1,602 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * SECTION:vikgotoofflinetool
+ * @short_description: A goto provider searching place names without the network
+ *
+ * The #VikGotoOfflineTool class finds places in Geonames dump files
+ * (e.g. cities1000.txt, or a country such as GB.txt, from http://download.geonames.org/export/dump/)
+ * matching names, or alternate names, with a word starting with the search text.
+ *
+ * The dump files are read once into an index file, which is then mapped into memory for searches.
+ * The index is made again when the dump files change. All values are little endian:
+ *  - header: "VIKPLACE", version (guint32 = 1), number of places, number of keys, length of the text,
+ *            hash of the dump file names, sizes and times, reserved (all guint32)
+ *  - places: latitude, longitude (gint32 in 1e-7 degrees), description (guint32 text offset), population (guint32)
+ *  - keys: text offset (guint32), place (guint32, with INDEX_NAME_START set when the key is the whole name)
+ *          sorted by the text, then by population (largest first)
+ *  - text: NUL terminated strings. Names are of lowercase ASCII words separated by single spaces,
+ *          with a key for each word onwards of each name.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "viking.h"
+#include "vikgotoofflinetool.h"
+
+static void vik_goto_offline_tool_finalize ( GObject *gob );
+
+static int vik_goto_offline_tool_search ( VikGotoTool *self, const gchar *srch_str, GList **candidates );
+
+#define INDEX_MAGIC "VIKPLACE"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 32
+#define INDEX_NAME_START 0x80000000
+
+// Columns of the Geonames 'geoname' table dumps
+#define GN_NAME 1
+#define GN_ASCIINAME 2
+#define GN_ALTERNATENAMES 3
+#define GN_LATITUDE 4
+#define GN_LONGITUDE 5
+#define GN_COUNTRY_CODE 8
+#define GN_POPULATION 14
+
+// Most matches given for a search
+#define OFFLINE_MAX_RESULTS 25
+// Most keys looked at for a search, as very short texts can match a large part of the index
+#define OFFLINE_MAX_SCAN 10000
+
+typedef struct {
+  gint32 lat;
+  gint32 lon;
+  guint32 desc;
+  guint32 population;
+} IndexPlace;
+
+typedef struct {
+  guint32 text;
+  guint32 place;
+} IndexKey;
+
+typedef struct _VikGotoOfflineToolPrivate VikGotoOfflineToolPrivate;
+struct _VikGotoOfflineToolPrivate
+{
+  gchar *dump_files;
+
+  // Searches can be from several threads
+  GMutex mutex;
+
+  GMappedFile *mapped;
+  gboolean load_failed;
+  guint32 place_count;
+  guint32 key_count;
+  guint32 text_len;
+  const IndexPlace *places;
+  const IndexKey *keys;
+  const gchar *text;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikGotoOfflineTool, vik_goto_offline_tool, VIK_GOTO_TOOL_TYPE)
+#define GOTO_OFFLINE_TOOL_GET_PRIVATE(o) (vik_goto_offline_tool_get_instance_private (VIK_GOTO_OFFLINE_TOOL(o)))
+
+enum
+{
+  PROP_0,
+
+  PROP_DUMP_FILES,
+};
+
+static void
+vik_goto_offline_tool_set_property (GObject      *object,
+                                    guint         property_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+  VikGotoOfflineToolPrivate *priv = GOTO_OFFLINE_TOOL_GET_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_DUMP_FILES:
+      g_free (priv->dump_files);
+      priv->dump_files = g_value_dup_string (value);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_goto_offline_tool_get_property (GObject    *object,
+                                    guint       property_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+  VikGotoOfflineToolPrivate *priv = GOTO_OFFLINE_TOOL_GET_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_DUMP_FILES:
+      g_value_set_string (value, priv->dump_files);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void vik_goto_offline_tool_class_init ( VikGotoOfflineToolClass *klass )
+{
+  GObjectClass *object_class;
+  VikGotoToolClass *parent_class;
+  GParamSpec *pspec;
+
+  object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = vik_goto_offline_tool_finalize;
+  object_class->set_property = vik_goto_offline_tool_set_property;
+  object_class->get_property = vik_goto_offline_tool_get_property;
+
+  /**
+   * VikGotoOfflineTool:dump-files:
+   *
+   * The Geonames dump files, separated by ';'. A relative filename is in the user's Viking directory.
+   */
+  pspec = g_param_spec_string ("dump-files",
+                               "Dump files",
+                               "The Geonames dump files",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_DUMP_FILES, pspec);
+
+  parent_class = VIK_GOTO_TOOL_CLASS (klass);
+
+  parent_class->search = vik_goto_offline_tool_search;
+}
+
+static void vik_goto_offline_tool_init ( VikGotoOfflineTool *self )
+{
+  VikGotoOfflineToolPrivate *priv = GOTO_OFFLINE_TOOL_GET_PRIVATE ( self );
+  priv->dump_files = NULL;
+  g_mutex_init ( &priv->mutex );
+  priv->mapped = NULL;
+  priv->load_failed = FALSE;
+}
+
+static void vik_goto_offline_tool_finalize ( GObject *gob )
+{
+  VikGotoOfflineToolPrivate *priv = GOTO_OFFLINE_TOOL_GET_PRIVATE ( gob );
+  g_free ( priv->dump_files );
+  priv->dump_files = NULL;
+  if ( priv->mapped )
+    g_mapped_file_unref ( priv->mapped );
+  priv->mapped = NULL;
+  g_mutex_clear ( &priv->mutex );
+  G_OBJECT_CLASS(vik_goto_offline_tool_parent_class)->finalize(gob);
+}
+
+/**
+ * The form of names and search texts that are compared:
+ *  lowercase ASCII letters and digits, with anything else as single spaces between words
+ */
+static gchar *offline_normalise ( const gchar *str )
+{
+  gchar *ascii = g_str_to_ascii ( str, NULL );
+  GString *gs = g_string_sized_new ( strlen(ascii) );
+  for ( const gchar *ptr = ascii; *ptr; ptr++ ) {
+    if ( g_ascii_isalnum(*ptr) )
+      g_string_append_c ( gs, g_ascii_tolower(*ptr) );
+    else if ( gs->len && gs->str[gs->len-1] != ' ' )
+      g_string_append_c ( gs, ' ' );
+  }
+  if ( gs->len && gs->str[gs->len-1] == ' ' )
+    g_string_truncate ( gs, gs->len-1 );
+  g_free ( ascii );
+  return g_string_free ( gs, FALSE );
+}
+
+static gchar *offline_filename ( const gchar *name )
+{
+  return g_path_is_absolute ( name ) ? g_strdup ( name ) : g_build_filename ( a_get_viking_dir(), name, NULL );
+}
+
+/**
+ * So the index is made again whenever a dump file is updated
+ */
+static guint32 offline_sources_hash ( gchar **files )
+{
+  GString *gs = g_string_new ( NULL );
+  for ( guint ii = 0; files[ii]; ii++ ) {
+    GStatBuf stat_buf;
+    if ( g_stat ( files[ii], &stat_buf ) == 0 )
+      g_string_append_printf ( gs, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n", files[ii], (gint64)stat_buf.st_size, (gint64)stat_buf.st_mtime );
+    else
+      g_string_append_printf ( gs, "%s:-\n", files[ii] );
+  }
+  guint32 hash = g_str_hash ( gs->str );
+  g_string_free ( gs, TRUE );
+  return hash;
+}
+
+typedef struct {
+  GArray *places;  // IndexPlace
+  GArray *keys;    // IndexKey
+  GString *text;
+  gboolean full;   // Reached the size limit of the index
+} IndexBuild;
+
+static guint32 build_add_text ( IndexBuild *ib, const gchar *str )
+{
+  guint32 offset = ib->text->len;
+  g_string_append_len ( ib->text, str, strlen(str)+1 );
+  return offset;
+}
+
+/**
+ * Add the keys for a name of a place, unless already given under another of its names
+ */
+static void build_add_name ( IndexBuild *ib, guint32 place, const gchar *name, GPtrArray *seen )
+{
+  gchar *norm = offline_normalise ( name );
+  gboolean add = norm[0] != '\0';
+  for ( guint ii = 0; add && ii < seen->len; ii++ )
+    add = strcmp ( norm, g_ptr_array_index(seen, ii) ) != 0;
+  if ( !add ) {
+    g_free ( norm );
+    return;
+  }
+  g_ptr_array_add ( seen, norm );
+
+  guint32 offset = build_add_text ( ib, norm );
+  for ( const gchar *word = norm; word; ) {
+    IndexKey key = { offset + (word - norm), place | (word == norm ? INDEX_NAME_START : 0) };
+    g_array_append_val ( ib->keys, key );
+    word = strchr ( word, ' ' );
+    if ( word )
+      word++;
+  }
+}
+
+static void build_add_line ( IndexBuild *ib, const gchar *line )
+{
+  gchar **cols = g_strsplit ( line, "\t", -1 );
+  if ( g_strv_length(cols) <= GN_POPULATION || !cols[GN_NAME][0] ) {
+    g_strfreev ( cols );
+    return;
+  }
+
+  IndexPlace place;
+  place.lat = (gint32)round ( g_ascii_strtod(cols[GN_LATITUDE], NULL) * 1e7 );
+  place.lon = (gint32)round ( g_ascii_strtod(cols[GN_LONGITUDE], NULL) * 1e7 );
+  place.population = (guint32)MIN ( g_ascii_strtoull(cols[GN_POPULATION], NULL, 10), G_MAXUINT32 );
+  gchar *desc = cols[GN_COUNTRY_CODE][0] ?
+    g_strdup_printf ( "%s, %s", cols[GN_NAME], cols[GN_COUNTRY_CODE] ) : g_strdup ( cols[GN_NAME] );
+  place.desc = build_add_text ( ib, desc );
+  g_free ( desc );
+
+  guint32 id = ib->places->len;
+  g_array_append_val ( ib->places, place );
+
+  GPtrArray *seen = g_ptr_array_new_with_free_func ( g_free );
+  build_add_name ( ib, id, cols[GN_NAME], seen );
+  build_add_name ( ib, id, cols[GN_ASCIINAME], seen );
+  gchar **alternates = g_strsplit ( cols[GN_ALTERNATENAMES], ",", -1 );
+  for ( guint ii = 0; alternates[ii]; ii++ )
+    build_add_name ( ib, id, alternates[ii], seen );
+  g_strfreev ( alternates );
+  g_ptr_array_free ( seen, TRUE );
+  g_strfreev ( cols );
+
+  // Leave plenty of room in the guint32 offsets
+  if ( ib->text->len > G_MAXUINT32 / 2 || ib->keys->len > G_MAXINT32 / 2 )
+    ib->full = TRUE;
+}
+
+static void build_read_dump ( IndexBuild *ib, const gchar *filename )
+{
+  GError *error = NULL;
+  GMappedFile *mf = g_mapped_file_new ( filename, FALSE, &error );
+  if ( !mf ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return;
+  }
+  const gchar *contents = g_mapped_file_get_contents ( mf );
+  const gchar *end = contents + g_mapped_file_get_length ( mf );
+  const gchar *start = contents;
+  while ( start < end && !ib->full ) {
+    const gchar *eol = memchr ( start, '\n', end - start );
+    if ( !eol )
+      eol = end;
+    gchar *line = g_strndup ( start, eol - start );
+    build_add_line ( ib, line );
+    g_free ( line );
+    start = eol + 1;
+  }
+  if ( ib->full )
+    g_warning ( "%s: Too many places to index, stopped in %s", __FUNCTION__, filename );
+  g_mapped_file_unref ( mf );
+}
+
+static gint build_key_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  const IndexBuild *ib = user_data;
+  const IndexKey *ka = a;
+  const IndexKey *kb = b;
+  gint result = strcmp ( ib->text->str + ka->text, ib->text->str + kb->text );
+  if ( result )
+    return result;
+  guint32 pa = g_array_index ( ib->places, IndexPlace, ka->place & ~INDEX_NAME_START ).population;
+  guint32 pb = g_array_index ( ib->places, IndexPlace, kb->place & ~INDEX_NAME_START ).population;
+  return ( pa < pb ) - ( pa > pb );
+}
+
+/**
+ * Read the dump files into a new index file
+ */
+static gboolean index_build ( gchar **files, guint32 hash, const gchar *index_file )
+{
+  IndexBuild ib;
+  ib.places = g_array_new ( FALSE, FALSE, sizeof(IndexPlace) );
+  ib.keys = g_array_new ( FALSE, FALSE, sizeof(IndexKey) );
+  ib.text = g_string_new ( NULL );
+  ib.full = FALSE;
+
+  for ( guint ii = 0; files[ii] && !ib.full; ii++ )
+    build_read_dump ( &ib, files[ii] );
+
+  g_array_sort_with_data ( ib.keys, build_key_compare, &ib );
+
+  guint32 header[6] = { GUINT32_TO_LE(INDEX_VERSION), GUINT32_TO_LE(ib.places->len), GUINT32_TO_LE(ib.keys->len),
+                        GUINT32_TO_LE((guint32)ib.text->len), GUINT32_TO_LE(hash), 0 };
+  for ( guint ii = 0; ii < ib.places->len; ii++ ) {
+    IndexPlace *place = &g_array_index ( ib.places, IndexPlace, ii );
+    place->lat = (gint32)GUINT32_TO_LE ( (guint32)place->lat );
+    place->lon = (gint32)GUINT32_TO_LE ( (guint32)place->lon );
+    place->desc = GUINT32_TO_LE ( place->desc );
+    place->population = GUINT32_TO_LE ( place->population );
+  }
+  for ( guint ii = 0; ii < ib.keys->len; ii++ ) {
+    IndexKey *key = &g_array_index ( ib.keys, IndexKey, ii );
+    key->text = GUINT32_TO_LE ( key->text );
+    key->place = GUINT32_TO_LE ( key->place );
+  }
+
+  // Write in full before replacing any previous index, which may be in use by another instance
+  gboolean ok = FALSE;
+  gchar *dirname = g_path_get_dirname ( index_file );
+  gchar *tmp_file = g_strdup_printf ( "%s.tmp", index_file );
+  FILE *ff = NULL;
+  if ( g_mkdir_with_parents ( dirname, 0755 ) == 0 )
+    ff = g_fopen ( tmp_file, "wb" );
+  if ( ff ) {
+    ok = fwrite ( INDEX_MAGIC, 8, 1, ff ) == 1 &&
+         fwrite ( header, sizeof(header), 1, ff ) == 1 &&
+         fwrite ( ib.places->data, sizeof(IndexPlace), ib.places->len, ff ) == ib.places->len &&
+         fwrite ( ib.keys->data, sizeof(IndexKey), ib.keys->len, ff ) == ib.keys->len &&
+         fwrite ( ib.text->str, 1, ib.text->len, ff ) == ib.text->len;
+    ok = ( fclose ( ff ) == 0 ) && ok;
+    if ( ok )
+      ok = g_rename ( tmp_file, index_file ) == 0;
+    if ( !ok )
+      (void)g_remove ( tmp_file );
+  }
+  if ( !ok )
+    g_warning ( "%s: Could not write %s", __FUNCTION__, index_file );
+  else
+    g_debug ( "%s: %s has %d places and %d keys", __FUNCTION__, index_file, ib.places->len, ib.keys->len );
+
+  g_free ( tmp_file );
+  g_free ( dirname );
+  g_array_free ( ib.places, TRUE );
+  g_array_free ( ib.keys, TRUE );
+  g_string_free ( ib.text, TRUE );
+  return ok;
+}
+
+/**
+ * Map the index file, if it is complete and made from the current dump files
+ * NB Call with the mutex held
+ */
+static gboolean index_map ( VikGotoOfflineToolPrivate *priv, const gchar *index_file, guint32 hash )
+{
+  GMappedFile *mapped = g_mapped_file_new ( index_file, FALSE, NULL );
+  if ( !mapped )
+    return FALSE;
+
+  const gchar *contents = g_mapped_file_get_contents ( mapped );
+  gsize size = g_mapped_file_get_length ( mapped );
+  guint32 version = 0, places = 0, keys = 0, text_len = 0, sources = 0;
+  if ( size >= INDEX_HEADER_SIZE && memcmp ( contents, INDEX_MAGIC, 8 ) == 0 ) {
+    const guint32 *header = (const guint32*)(contents + 8);
+    version = GUINT32_FROM_LE ( header[0] );
+    places = GUINT32_FROM_LE ( header[1] );
+    keys = GUINT32_FROM_LE ( header[2] );
+    text_len = GUINT32_FROM_LE ( header[3] );
+    sources = GUINT32_FROM_LE ( header[4] );
+  }
+  guint64 expected = INDEX_HEADER_SIZE + (guint64)places*sizeof(IndexPlace) + (guint64)keys*sizeof(IndexKey) + text_len;
+  gboolean valid = version == INDEX_VERSION && sources == hash && size == expected;
+
+  const IndexPlace *place_data = (const IndexPlace*)(contents + INDEX_HEADER_SIZE);
+  const IndexKey *key_data = (const IndexKey*)(place_data + places);
+  const gchar *text = (const gchar*)(key_data + keys);
+
+  // Check once here, so searches need not
+  if ( valid && text_len )
+    valid = text[text_len-1] == '\0';
+  for ( guint32 pp = 0; valid && pp < places; pp++ )
+    valid = GUINT32_FROM_LE(place_data[pp].desc) < text_len;
+  for ( guint32 kk = 0; valid && kk < keys; kk++ )
+    valid = GUINT32_FROM_LE(key_data[kk].text) < text_len &&
+            (GUINT32_FROM_LE(key_data[kk].place) & ~INDEX_NAME_START) < places;
+  if ( !valid ) {
+    g_mapped_file_unref ( mapped );
+    return FALSE;
+  }
+
+  priv->mapped = mapped;
+  priv->place_count = places;
+  priv->key_count = keys;
+  priv->text_len = text_len;
+  priv->places = place_data;
+  priv->keys = key_data;
+  priv->text = text;
+  return TRUE;
+}
+
+/**
+ * Map the index on first use, making it first if needed
+ * NB Call with the mutex held
+ */
+static gboolean index_load ( VikGotoOfflineToolPrivate *priv )
+{
+  if ( priv->mapped )
+    return TRUE;
+  // Don't keep trying (and warning) on each request
+  if ( priv->load_failed || !priv->dump_files )
+    return FALSE;
+  priv->load_failed = TRUE;
+
+  gchar **names = g_strsplit ( priv->dump_files, ";", -1 );
+  gchar **files = g_new0 ( gchar*, g_strv_length(names) + 1 );
+  for ( guint ii = 0; names[ii]; ii++ )
+    files[ii] = offline_filename ( g_strstrip(names[ii]) );
+  g_strfreev ( names );
+  guint32 hash = offline_sources_hash ( files );
+
+  // Kept with the goto cache, named for the set of dump files
+  gchar *sum = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, priv->dump_files, -1 );
+  gchar *name = g_strdup_printf ( "%s.idx", sum );
+  gchar *index_file = g_build_filename ( a_get_viking_dir(), "goto", name, NULL );
+  g_free ( name );
+  g_free ( sum );
+
+  if ( !index_map ( priv, index_file, hash ) ) {
+    if ( !index_build ( files, hash, index_file ) || !index_map ( priv, index_file, hash ) )
+      g_warning ( "%s: No usable index of %s", __FUNCTION__, priv->dump_files );
+  }
+  priv->load_failed = priv->mapped == NULL;
+
+  g_free ( index_file );
+  g_strfreev ( files );
+  return priv->mapped != NULL;
+}
+
+typedef struct {
+  guint32 place;
+  guint score;
+  guint32 population;
+} OfflineMatch;
+
+static gint offline_match_compare ( gconstpointer a, gconstpointer b )
+{
+  const OfflineMatch *ma = a;
+  const OfflineMatch *mb = b;
+  if ( ma->score != mb->score )
+    return ( ma->score < mb->score ) - ( ma->score > mb->score );
+  return ( ma->population < mb->population ) - ( ma->population > mb->population );
+}
+
+/**
+ * The keys are found by a binary search for the first one starting with the text,
+ *  then the run of those following that also do
+ */
+static int vik_goto_offline_tool_search ( VikGotoTool *self, const gchar *srch_str, GList **candidates )
+{
+  VikGotoOfflineToolPrivate *priv = GOTO_OFFLINE_TOOL_GET_PRIVATE ( self );
+
+  gchar *norm = offline_normalise ( srch_str );
+  gsize len = strlen ( norm );
+  if ( !len ) {
+    g_free ( norm );
+    return 0;
+  }
+
+  g_mutex_lock ( &priv->mutex );
+  if ( !index_load ( priv ) ) {
+    g_mutex_unlock ( &priv->mutex );
+    g_free ( norm );
+    return 1;
+  }
+
+  guint32 lo = 0, hi = priv->key_count;
+  while ( lo < hi ) {
+    guint32 mid = lo + (hi - lo) / 2;
+    if ( strcmp ( priv->text + GUINT32_FROM_LE(priv->keys[mid].text), norm ) < 0 )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // The best match of each place, preferring the whole name, then whole words
+  GArray *matches = g_array_new ( FALSE, FALSE, sizeof(OfflineMatch) );
+  GHashTable *found = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( guint32 kk = lo; kk < priv->key_count && kk - lo < OFFLINE_MAX_SCAN; kk++ ) {
+    const gchar *text = priv->text + GUINT32_FROM_LE(priv->keys[kk].text);
+    if ( strncmp ( text, norm, len ) != 0 )
+      break;
+    guint32 value = GUINT32_FROM_LE ( priv->keys[kk].place );
+    guint32 place = value & ~INDEX_NAME_START;
+    gboolean word = text[len] == '\0' || text[len] == ' ';
+    guint score = ( word ? 1 : 0 ) + ( (value & INDEX_NAME_START) ? 2 : 0 ) + ( (value & INDEX_NAME_START) && text[len] == '\0' ? 4 : 0 );
+    gpointer pos;
+    if ( g_hash_table_lookup_extended ( found, GUINT_TO_POINTER(place), NULL, &pos ) ) {
+      OfflineMatch *match = &g_array_index ( matches, OfflineMatch, GPOINTER_TO_UINT(pos) );
+      match->score = MAX ( match->score, score );
+    }
+    else {
+      OfflineMatch match = { place, score, GUINT32_FROM_LE(priv->places[place].population) };
+      g_hash_table_insert ( found, GUINT_TO_POINTER(place), GUINT_TO_POINTER(matches->len) );
+      g_array_append_val ( matches, match );
+    }
+  }
+  g_hash_table_destroy ( found );
+
+  g_array_sort ( matches, offline_match_compare );
+  for ( guint ii = 0; ii < matches->len && ii < OFFLINE_MAX_RESULTS; ii++ ) {
+    const IndexPlace *place = &priv->places[g_array_index ( matches, OfflineMatch, ii ).place];
+    struct VikGotoCandidate *cand = g_malloc ( sizeof(struct VikGotoCandidate) );
+    cand->description = g_strdup ( priv->text + GUINT32_FROM_LE(place->desc) );
+    cand->ll.lat = (gint32)GUINT32_FROM_LE ( (guint32)place->lat ) / 1e7;
+    cand->ll.lon = (gint32)GUINT32_FROM_LE ( (guint32)place->lon ) / 1e7;
+    *candidates = g_list_prepend ( *candidates, cand );
+  }
+  *candidates = g_list_reverse ( *candidates );
+  g_mutex_unlock ( &priv->mutex );
+
+  g_array_free ( matches, TRUE );
+  g_free ( norm );
+  return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIK_GOTO_OFFLINE_TOOL_H
+#define __VIK_GOTO_OFFLINE_TOOL_H
+
+#include <glib.h>
+
+#include "vikgototool.h"
+
+G_BEGIN_DECLS
+
+#define VIK_GOTO_OFFLINE_TOOL_TYPE            (vik_goto_offline_tool_get_type ())
+#define VIK_GOTO_OFFLINE_TOOL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), VIK_GOTO_OFFLINE_TOOL_TYPE, VikGotoOfflineTool))
+#define VIK_GOTO_OFFLINE_TOOL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), VIK_GOTO_OFFLINE_TOOL_TYPE, VikGotoOfflineToolClass))
+#define IS_VIK_GOTO_OFFLINE_TOOL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VIK_GOTO_OFFLINE_TOOL_TYPE))
+#define IS_VIK_GOTO_OFFLINE_TOOL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), VIK_GOTO_OFFLINE_TOOL_TYPE))
+#define VIK_GOTO_OFFLINE_TOOL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), VIK_GOTO_OFFLINE_TOOL_TYPE, VikGotoOfflineToolClass))
+
+
+typedef struct _VikGotoOfflineTool VikGotoOfflineTool;
+typedef struct _VikGotoOfflineToolClass VikGotoOfflineToolClass;
+
+struct _VikGotoOfflineToolClass
+{
+  VikGotoToolClass object_class;
+};
+
+GType vik_goto_offline_tool_get_type ();
+
+struct _VikGotoOfflineTool {
+  VikGotoTool obj;
+};
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,8 @@
 
 #include "vikgototool.h"
 #include "util.h"
+#include "dir.h"
+#include "settings.h"
 
 #include <string.h>
 
@@ -204,6 +206,220 @@ gboolean vik_goto_tool_parse_file_for_candidates (VikGotoTool *self, gchar *file
   return VIK_GOTO_TOOL_GET_CLASS( self )->parse_file_for_candidates( self, filename, candidates );
 }
 
+/**
+ * Results are kept, first in memory and then on disk for a while, since searches
+ *  often get repeated (e.g. going back to a previous place, or after correcting a typo)
+ *  and the remote services ask not to be queried more than needed.
+ * Most recently used first
+ */
+#define GOTO_CACHE_SIZE 64
+#define VIK_SETTINGS_GOTO_CACHE_TTL "goto_cache_ttl"
+// Seconds
+#define GOTO_CACHE_TTL_DEFAULT (7*24*60*60)
+#define GOTO_CACHE_HEADER "# Viking Goto Cache 1"
+
+typedef struct {
+  gchar *key;
+  gint64 time; // Seconds
+  GList *candidates;
+} GotoCacheEntry;
+
+static GMutex goto_cache_mutex;
+static GQueue goto_cache = G_QUEUE_INIT;
+
+static GList *candidates_copy ( GList *candidates )
+{
+  GList *copy = NULL;
+  for ( GList *iter = candidates; iter; iter = iter->next ) {
+    struct VikGotoCandidate *cand = iter->data;
+    struct VikGotoCandidate *dup = g_malloc ( sizeof(struct VikGotoCandidate) );
+    dup->description = g_strdup ( cand->description );
+    dup->ll = cand->ll;
+    copy = g_list_prepend ( copy, dup );
+  }
+  return g_list_reverse ( copy );
+}
+
+static void goto_cache_entry_free ( GotoCacheEntry *entry )
+{
+  g_free ( entry->key );
+  g_list_free_full ( entry->candidates, vik_goto_tool_free_candidate );
+  g_free ( entry );
+}
+
+static gint goto_cache_ttl ()
+{
+  gint ttl = GOTO_CACHE_TTL_DEFAULT;
+  (void)a_settings_get_integer ( VIK_SETTINGS_GOTO_CACHE_TTL, &ttl );
+  return ttl;
+}
+
+/**
+ * The same search need not be typed exactly the same,
+ *  so ignore differences of case and spacing
+ */
+static gchar *goto_cache_key ( VikGotoTool *self, const gchar *srch_str )
+{
+  gchar *folded = g_utf8_casefold ( srch_str, -1 );
+  gchar **words = g_strsplit_set ( g_strstrip(folded), " \t\n", -1 );
+  GString *key = g_string_new ( vik_goto_tool_get_label(self) );
+  g_string_append_c ( key, '\n' );
+  gboolean first = TRUE;
+  for ( guint ii = 0; words[ii]; ii++ ) {
+    if ( !words[ii][0] )
+      continue;
+    if ( !first )
+      g_string_append_c ( key, ' ' );
+    g_string_append ( key, words[ii] );
+    first = FALSE;
+  }
+  g_strfreev ( words );
+  g_free ( folded );
+  return g_string_free ( key, FALSE );
+}
+
+static gchar *goto_cache_filename ( const gchar *key )
+{
+  gchar *sum = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, key, -1 );
+  gchar *name = g_strdup_printf ( "%s.txt", sum );
+  gchar *filename = g_build_filename ( a_get_viking_dir(), "goto", name, NULL );
+  g_free ( name );
+  g_free ( sum );
+  return filename;
+}
+
+static void goto_cache_memory_add ( const gchar *key, gint64 time, GList *candidates )
+{
+  GotoCacheEntry *entry = g_malloc ( sizeof(GotoCacheEntry) );
+  entry->key = g_strdup ( key );
+  entry->time = time;
+  entry->candidates = candidates_copy ( candidates );
+  g_mutex_lock ( &goto_cache_mutex );
+  g_queue_push_head ( &goto_cache, entry );
+  while ( g_queue_get_length ( &goto_cache ) > GOTO_CACHE_SIZE )
+    goto_cache_entry_free ( g_queue_pop_tail ( &goto_cache ) );
+  g_mutex_unlock ( &goto_cache_mutex );
+}
+
+static gboolean goto_cache_memory_lookup ( const gchar *key, GList **candidates )
+{
+  gboolean found = FALSE;
+  gint64 oldest = g_get_real_time() / G_USEC_PER_SEC - goto_cache_ttl();
+  g_mutex_lock ( &goto_cache_mutex );
+  for ( GList *iter = goto_cache.head; iter; iter = iter->next ) {
+    GotoCacheEntry *entry = iter->data;
+    if ( !strcmp ( entry->key, key ) ) {
+      if ( entry->time < oldest ) {
+        g_queue_delete_link ( &goto_cache, iter );
+        goto_cache_entry_free ( entry );
+        break;
+      }
+      g_queue_unlink ( &goto_cache, iter );
+      g_queue_push_head_link ( &goto_cache, iter );
+      *candidates = candidates_copy ( entry->candidates );
+      found = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock ( &goto_cache_mutex );
+  return found;
+}
+
+static gboolean goto_cache_disk_lookup ( const gchar *key, GList **candidates )
+{
+  gchar *filename = goto_cache_filename ( key );
+  GStatBuf stat_buf;
+  gchar *contents = NULL;
+  gboolean found = FALSE;
+  if ( g_stat ( filename, &stat_buf ) == 0 &&
+       stat_buf.st_mtime >= g_get_real_time() / G_USEC_PER_SEC - goto_cache_ttl() &&
+       g_file_get_contents ( filename, &contents, NULL, NULL ) &&
+       g_str_has_prefix ( contents, GOTO_CACHE_HEADER"\n" ) ) {
+    gchar **lines = g_strsplit ( contents, "\n", -1 );
+    // The first line is the header, the second the key (incase of a checksum clash)
+    if ( lines[1] ) {
+      gchar *stored = g_strcompress ( lines[1] );
+      found = !strcmp ( stored, key );
+      g_free ( stored );
+    }
+    for ( guint ii = 2; found && lines[ii]; ii++ ) {
+      gchar **parts = g_strsplit ( lines[ii], "\t", 3 );
+      if ( g_strv_length ( parts ) == 3 ) {
+        struct VikGotoCandidate *cand = g_malloc ( sizeof(struct VikGotoCandidate) );
+        cand->ll.lat = g_ascii_strtod ( parts[0], NULL );
+        cand->ll.lon = g_ascii_strtod ( parts[1], NULL );
+        cand->description = g_strdup ( parts[2] );
+        *candidates = g_list_prepend ( *candidates, cand );
+      }
+      g_strfreev ( parts );
+    }
+    *candidates = g_list_reverse ( *candidates );
+    if ( found )
+      goto_cache_memory_add ( key, stat_buf.st_mtime, *candidates );
+    g_strfreev ( lines );
+  }
+  g_free ( contents );
+  g_free ( filename );
+  return found;
+}
+
+static void goto_cache_add ( const gchar *key, GList *candidates )
+{
+  goto_cache_memory_add ( key, g_get_real_time() / G_USEC_PER_SEC, candidates );
+
+  GString *gs = g_string_new ( GOTO_CACHE_HEADER"\n" );
+  gchar *escaped = g_strescape ( key, NULL );
+  g_string_append_printf ( gs, "%s\n", escaped );
+  g_free ( escaped );
+  for ( GList *iter = candidates; iter; iter = iter->next ) {
+    struct VikGotoCandidate *cand = iter->data;
+    gchar lat[G_ASCII_DTOSTR_BUF_SIZE], lon[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar *desc = g_strdup ( cand->description ? cand->description : "" );
+    g_strdelimit ( desc, "\t\r\n", ' ' );
+    g_string_append_printf ( gs, "%s\t%s\t%s\n",
+                             g_ascii_dtostr ( lat, sizeof(lat), cand->ll.lat ),
+                             g_ascii_dtostr ( lon, sizeof(lon), cand->ll.lon ),
+                             desc );
+    g_free ( desc );
+  }
+
+  gchar *filename = goto_cache_filename ( key );
+  gchar *dirname = g_path_get_dirname ( filename );
+  GError *error = NULL;
+  if ( g_mkdir_with_parents ( dirname, 0755 ) != 0 ||
+       !g_file_set_contents ( filename, gs->str, gs->len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error ? error->message : dirname );
+    g_clear_error ( &error );
+  }
+  g_free ( dirname );
+  g_free ( filename );
+  g_string_free ( gs, TRUE );
+}
+
+/**
+ * vik_goto_tool_get_cached_candidates:
+ *
+ * Only from what is held in memory, so this never waits on the disk or the network
+ *
+ * Returns: %TRUE if this search has been done recently, with the matches (maybe none)
+ *  put in @candidates
+ */
+gboolean vik_goto_tool_get_cached_candidates ( VikGotoTool *self, const gchar *srch_str, GList **candidates )
+{
+  gchar *key = goto_cache_key ( self, srch_str );
+  gboolean found = goto_cache_memory_lookup ( key, candidates );
+  g_free ( key );
+  return found;
+}
+
+static gboolean goto_cache_lookup ( VikGotoTool *self, const gchar *srch_str, GList **candidates )
+{
+  gchar *key = goto_cache_key ( self, srch_str );
+  gboolean found = goto_cache_memory_lookup ( key, candidates ) || goto_cache_disk_lookup ( key, candidates );
+  g_free ( key );
+  return found;
+}
+
 /**
  * vik_goto_tool_get_coord:
  *
@@ -226,6 +442,34 @@ int vik_goto_tool_get_coord ( VikGotoTool *self, VikViewport *vvp, gchar *srch_s
   int ret = 0;  /* OK */
   struct LatLon ll;
 
+  // Local searches are quick enough not to need the cache
+  if ( VIK_GOTO_TOOL_GET_CLASS(self)->search ) {
+    GList *candidates = NULL;
+    ret = VIK_GOTO_TOOL_GET_CLASS(self)->search ( self, srch_str, &candidates );
+    if ( ret == 0 ) {
+      if ( candidates ) {
+        ll = ((struct VikGotoCandidate*)candidates->data)->ll;
+        vik_coord_load_from_latlon ( coord, vik_viewport_get_coord_mode(vvp), &ll );
+      }
+      else
+        ret = -1;
+    }
+    g_list_free_full ( candidates, vik_goto_tool_free_candidate );
+    return ret;
+  }
+
+  // Use the first of any known results
+  GList *cached = NULL;
+  if ( goto_cache_lookup ( self, srch_str, &cached ) ) {
+    if ( cached ) {
+      ll = ((struct VikGotoCandidate*)cached->data)->ll;
+      g_list_free_full ( cached, vik_goto_tool_free_candidate );
+      vik_coord_load_from_latlon ( coord, vik_viewport_get_coord_mode(vvp), &ll );
+      return 0;
+    }
+    return -1;
+  }
+
   escaped_srch_str = g_uri_escape_string(srch_str, NULL, FALSE);
   g_debug("%s: '%s' --> '%s'", __FILE__, srch_str, escaped_srch_str);
 
@@ -274,6 +518,12 @@ int vik_goto_tool_get_candidates ( VikGotoTool *self, gchar *srch_str, GList **c
   gchar *escaped_srch_str;
   int ret = 0;  /* OK */
 
+  if ( VIK_GOTO_TOOL_GET_CLASS(self)->search )
+    return VIK_GOTO_TOOL_GET_CLASS(self)->search ( self, srch_str, candidates );
+
+  if ( goto_cache_lookup ( self, srch_str, candidates ) )
+    return 0;
+
   escaped_srch_str = g_uri_escape_string(srch_str, NULL, FALSE);
   g_debug("%s: '%s' --> '%s'", __FILE__, srch_str, escaped_srch_str);
 
@@ -293,6 +543,10 @@ int vik_goto_tool_get_candidates ( VikGotoTool *self, gchar *srch_str, GList **c
     goto done;
   }
 
+  gchar *key = goto_cache_key ( self, srch_str );
+  goto_cache_add ( key, *candidates );
+  g_free ( key );
+
 done:
   (void)util_remove(tmpname);
 done_no_file:
@@ -47,6 +47,9 @@ struct _VikGotoToolClass
   DownloadFileOptions *(* get_download_options) (VikGotoTool *self);
   gboolean (* parse_file_for_latlon) (VikGotoTool *self, gchar *filename, struct LatLon *ll);
   gboolean (* parse_file_for_candidates) (VikGotoTool *self, gchar *filename, GList **candidates);
+  // Optional: answer searches directly, instead of downloading from the url format
+  //  Returns: 0 = search successful (result can be empty), 1 = search unavailable
+  int (* search) (VikGotoTool *self, const gchar *srch_str, GList **candidates);
 };
 
 GType vik_goto_tool_get_type ();
@@ -64,6 +67,7 @@ gchar *vik_goto_tool_get_label ( VikGotoTool *self );
 gboolean vik_goto_tool_parse_file_for_latlon (VikGotoTool *self, gchar *filename, struct LatLon *ll);
 int vik_goto_tool_get_coord ( VikGotoTool *self, VikViewport *vvp, gchar *srch_str, VikCoord *coord );
 int vik_goto_tool_get_candidates ( VikGotoTool *self, gchar *srch_str, GList **candidates );
+gboolean vik_goto_tool_get_cached_candidates ( VikGotoTool *self, const gchar *srch_str, GList **candidates );
 void vik_goto_tool_free_candidate ( gpointer candidate );
 gboolean vik_goto_tool_parse_file_for_candidates (VikGotoTool *self, gchar *filename, GList **candidates);
 
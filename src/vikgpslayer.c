@@ -24,12 +24,14 @@
 #include "vikgpslayer.h"
 #include "babel.h"
 #include "viktrwlayer.h"
+#include "gpsfleet.h"
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 #ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
 #include <gps.h>
+#include <errno.h>
 #endif
 
 #define GPS_FIXED_NAME "GPS"
@@ -48,6 +50,7 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, VikLayerSetParam *vlsp )
 static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gboolean is_file_operation );
 
 static const gchar* gps_layer_tooltip ( VikGpsLayer *vgl );
+static gsize gps_layer_get_memory_usage ( VikGpsLayer *vgl );
 
 static void gps_layer_change_coord_mode ( VikGpsLayer *vgl, VikCoordMode mode );
 static void gps_layer_add_menu_items( VikGpsLayer *vtl, GtkMenu *menu, gpointer vlp );
@@ -63,6 +66,10 @@ static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2] );
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp);
 static void rt_gpsd_disconnect(VikGpsLayer *vgl);
 static gboolean rt_gpsd_connect(VikGpsLayer *vgl, gboolean ask_if_failed);
+static void realtime_fleet_start(VikGpsLayer *vgl);
+static void realtime_fleet_stop(VikGpsLayer *vgl);
+static void gps_recover_journal_cb( gpointer layer_and_vlp[2] );
+static gchar *make_track_name(VikTrwLayer *vtl);
 static VikLayerParamData color_default_tri ( void ) {
   VikLayerParamData data; gdk_color_parse ( "#203070", &data.c ); return data;
 }
@@ -192,6 +199,16 @@ static VikLayerParamData gpsd_port_default ( void )
   return data;
 }
 
+static VikLayerParamScale params_trail[] = { {0, 1000000, 100, 0} };
+static VikLayerParamData trail_default ( void ) { return VIK_LPD_UINT ( 0 ); }
+
+static VikLayerParamData fleet_sources_default ( void )
+{
+  VikLayerParamData data;
+  data.s = g_strdup ( "" );
+  return data;
+}
+
 static VikLayerParamData gpsd_retry_interval_default ( void )
 {
   VikLayerParamData data;
@@ -229,10 +246,15 @@ static VikLayerParam gps_layer_params[] = {
   { VIK_LAYER_GPS, "moving_map_method", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Moving Map Method:"), VIK_LAYER_WIDGET_RADIOGROUP_STATIC, params_vehicle_position, NULL, NULL, moving_map_method_default, NULL, NULL },
   { VIK_LAYER_GPS, "indicator_color", VIK_LAYER_PARAM_COLOR, GROUP_REALTIME_MODE, N_("Indicator Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_default_tri, NULL, NULL },
   { VIK_LAYER_GPS, "realtime_update_statusbar", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Update Statusbar:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Display information in the statusbar on GPS updates"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_incremental", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Incremental Drawing:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Only draw the new part of the track on each GPS update, rather than all of it. The end of the track is shown in full detail whilst recording"), vik_lpd_false_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_trail", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Trail Length:"), VIK_LAYER_WIDGET_SPINBUTTON, params_trail, NULL, N_("The number of the latest trackpoints kept in the recorded track; older ones are dropped in batches. 0 keeps all of them"), trail_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_journal", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Journal:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Append every recorded trackpoint to a journal file, so the whole session can be recovered even after a crash"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_GPS, "auto_connect", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Auto Connect"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Automatically connect to GPSD"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_host", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Host:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_host_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_port", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Port:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_port_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_retry_interval", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Retry Interval (seconds):"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_retry_interval_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_fleet_sources", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Fleet Sources:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL,
+    N_("Further positions to follow whilst realtime tracking, each recorded in its own track. Space separated list of gpsd host:port, or nmea://host:port for other NMEA streams"), fleet_sources_default, NULL, NULL },
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   { VIK_LAYER_GPS, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
@@ -248,10 +270,14 @@ enum {
   PARAM_VEHICLE_POSITION,
   PARAM_INDICATOR_COLOR,
   PARAM_REALTIME_UPDATE_STATUSBAR,
+  PARAM_REALTIME_INCREMENTAL,
+  PARAM_REALTIME_TRAIL,
+  PARAM_REALTIME_JOURNAL,
   PARAM_GPSD_CONNECT,
   PARAM_GPSD_HOST,
   PARAM_GPSD_PORT,
   PARAM_GPSD_RETRY_INTERVAL,
+  PARAM_REALTIME_FLEET_SOURCES,
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   PARAM_RESET,
   NUM_PARAMS};
@@ -321,6 +347,10 @@ VikLayerInterface vik_gps_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+
+  (VikLayerFuncDrawSurface)             NULL,
+
+  (VikLayerFuncGetMemoryUsage)          gps_layer_get_memory_usage,
 };
 
 enum {TRW_DOWNLOAD=0, TRW_UPLOAD,
@@ -384,8 +414,24 @@ struct _VikGpsLayer {
   guint vehicle_position;
   GdkColor indicator_color;
   gboolean realtime_update_statusbar;
+  gboolean realtime_incremental;
+  GList *realtime_last;        // Last link of the realtime track, valid whilst its serial is realtime_last_serial
+  guint realtime_last_serial;
+  gboolean realtime_extended;  // Whether the latest trackpoint was drawn straight onto the realtime layer
+  GdkRectangle realtime_extended_area;
+  guint realtime_trail;        // Trackpoints kept in the realtime track, 0 for all of them
+  guint realtime_points;       // Trackpoints in the realtime track
+  gboolean realtime_journal;
+  FILE *realtime_journal_file;
+  gdouble realtime_journal_synced; // Timestamp of the trackpoint last written to disk
+  gchar *realtime_fleet_sources;
+  VikGpsFleet *realtime_fleet;
+  guint realtime_fleet_timer;
+  GHashTable *realtime_fleet_tracks; // Of FleetTrack by source
   VikTrackpoint *trkpt;
   VikTrackpoint *trkpt_prev;
+  gboolean realtime_indicator_drawn;
+  GdkRectangle realtime_indicator_area; // Where the indicator was last drawn
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   gchar *protocol;
   gchar *serial_port;
@@ -481,6 +527,18 @@ static const gchar* gps_layer_tooltip ( VikGpsLayer *vgl )
 }
 
 /* "Copy" */
+/**
+ * The TRW layers within
+ */
+static gsize gps_layer_get_memory_usage ( VikGpsLayer *vgl )
+{
+  gsize size = 0;
+  gint ii;
+  for ( ii = 0; ii < NUM_TRW; ii++ )
+    size += vik_layer_get_memory_usage ( VIK_LAYER(vgl->trw_children[ii]) );
+  return size;
+}
+
 static void gps_layer_marshall( VikGpsLayer *vgl, guint8 **data, guint *datalen )
 {
   VikLayer *child_layer;
@@ -617,6 +675,10 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, VikLayerSetParam *vlsp )
     case PARAM_GPSD_HOST:
       changed = vik_layer_param_change_string ( vlsp->data, &vgl->gpsd_host );
       break;
+    // Only applies from the next start of realtime tracking
+    case PARAM_REALTIME_FLEET_SOURCES:
+      changed = vik_layer_param_change_string ( vlsp->data, &vgl->realtime_fleet_sources );
+      break;
     case PARAM_GPSD_PORT:
       changed = vik_layer_param_change_string ( vlsp->data, &vgl->gpsd_port );
       break;
@@ -644,6 +706,19 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, VikLayerSetParam *vlsp )
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       changed = vik_layer_param_change_boolean ( vlsp->data, &vgl->realtime_update_statusbar );
       break;
+    case PARAM_REALTIME_INCREMENTAL:
+      changed = vik_layer_param_change_boolean ( vlsp->data, &vgl->realtime_incremental );
+      // Apply setting
+      if ( changed && vgl->connected_to_gpsd && vgl->realtime_track )
+        vik_trw_layer_set_draw_cache ( vgl->trw_children[TRW_REALTIME], vgl->realtime_incremental );
+      break;
+    case PARAM_REALTIME_TRAIL:
+      changed = vik_layer_param_change_uint ( vlsp->data, &vgl->realtime_trail );
+      break;
+    // Only applies from the next connection
+    case PARAM_REALTIME_JOURNAL:
+      changed = vik_layer_param_change_boolean ( vlsp->data, &vgl->realtime_journal );
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default: break;
   }
@@ -690,6 +765,9 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gbo
     case PARAM_GPSD_HOST:
       rv.s = vgl->gpsd_host ? vgl->gpsd_host : "";
       break;
+    case PARAM_REALTIME_FLEET_SOURCES:
+      rv.s = vgl->realtime_fleet_sources ? vgl->realtime_fleet_sources : "";
+      break;
     case PARAM_GPSD_PORT:
       rv.s = vgl->gpsd_port ? vgl->gpsd_port : g_strdup(DEFAULT_GPSD_PORT);
       break;
@@ -711,6 +789,15 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gbo
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       rv.b = vgl->realtime_update_statusbar;
       break;
+    case PARAM_REALTIME_INCREMENTAL:
+      rv.b = vgl->realtime_incremental;
+      break;
+    case PARAM_REALTIME_TRAIL:
+      rv.u = vgl->realtime_trail;
+      break;
+    case PARAM_REALTIME_JOURNAL:
+      rv.b = vgl->realtime_journal;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     case PARAM_RESET: rv.ptr = reset_cb; break;
     default: break;
@@ -859,6 +946,7 @@ static void gps_layer_add_menu_items( VikGpsLayer *vgl, GtkMenu *menu, gpointer
 
   (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
 
+  (void)vu_menu_add_item ( menu, _("Recover Realtime _Journal..."), GTK_STOCK_OPEN, G_CALLBACK(gps_recover_journal_cb), pass_along );
   (void)vu_menu_add_item ( menu, _("Empty _Realtime"), GTK_STOCK_REMOVE, G_CALLBACK(gps_empty_realtime_cb), pass_along );
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 
@@ -886,6 +974,10 @@ static void vik_gps_layer_free ( VikGpsLayer *vgl )
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
   rt_gpsd_disconnect(vgl);
+  realtime_fleet_stop(vgl);
+  if ( vgl->realtime_fleet_tracks )
+    g_hash_table_destroy ( vgl->realtime_fleet_tracks );
+  g_free ( vgl->realtime_fleet_sources );
   gcs_free(vgl);
   g_free ( vgl->gpsd_host );
   g_free ( vgl->gpsd_port );
@@ -920,6 +1012,7 @@ static void vik_gps_layer_realize ( VikGpsLayer *vgl, VikTreeview *vt, GtkTreeIt
     vgl->realtime_tracking = TRUE;
     vgl->first_realtime_trackpoint = TRUE;
     (void)rt_gpsd_connect ( vgl, FALSE );
+    realtime_fleet_start ( vgl );
   }
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 }
@@ -1669,6 +1762,7 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
   vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp)+20, vik_viewport_get_width(vp)+20, &se );
   vik_coord_to_latlon ( &nw, &lnw );
   vik_coord_to_latlon ( &se, &lse );
+  vgl->realtime_indicator_drawn = FALSE;
   if ( vgl->realtime_fix.fix.latitude > lse.lat &&
        vgl->realtime_fix.fix.latitude < lnw.lat &&
        vgl->realtime_fix.fix.longitude > lnw.lon &&
@@ -1714,6 +1808,7 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
      GdkPoint trian[3] = { { pt_x, pt_y }, {side1_x, side1_y}, {side2_x, side2_y} };
      GdkPoint trian_bg[3] = { { ptbg_x, pt_y }, {side1bg_x, side1bg_y}, {side2bg_x, side2bg_y} };
 
+     vik_viewport_extents_begin ( vp );
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_bg_gc, TRUE, trian_bg, 3, &vgl->realtime_track_bg_color );
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_gc, TRUE, trian, 3, &vgl->indicator_color );
      if ( vgl->realtime_fix.fix.mode > MODE_2D )
@@ -1724,10 +1819,277 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
        vik_viewport_draw_rectangle ( vp,
                                      vgl->realtime_track_pt1_gc,
                                      TRUE, x-2, y-2, 4, 4, &vgl->realtime_track_pt1_color );
+     vgl->realtime_indicator_drawn = vik_viewport_extents_end ( vp, &vgl->realtime_indicator_area );
+  }
+}
+
+/**
+ * Work out what changes on screen for a new fix (when the view stays the same):
+ *  the indicator and the end of the track
+ *
+ * Returns: FALSE if the whole of the layer should be redrawn
+ */
+static gboolean realtime_tracking_damage ( VikGpsLayer *vgl, VikViewport *vvp, const VikCoord *vehicle_coord, VikTrackpoint *prev, GdkRectangle *area )
+{
+  // When the new part of the track has already been drawn, only where it went needs updating
+  gboolean extended = vgl->trkpt && vgl->realtime_extended;
+
+  if ( vgl->trkpt && vgl->realtime_track && !extended &&
+       !vik_trw_layer_track_draws_locally ( vgl->trw_children[TRW_REALTIME], vgl->realtime_track ) )
+    return FALSE;
+
+  // Generous enough for the indicator at any heading
+  const gint indicator = 40;
+  gint x, y;
+  vik_viewport_coord_to_screen ( vvp, vehicle_coord, &x, &y );
+  area->x = x - indicator;
+  area->y = y - indicator;
+  area->width = area->height = 2*indicator;
+
+  if ( vgl->realtime_indicator_drawn )
+    gdk_rectangle_union ( area, &vgl->realtime_indicator_area, area );
+
+  if ( extended ) {
+    if ( vgl->realtime_extended_area.width > 0 && vgl->realtime_extended_area.height > 0 )
+      gdk_rectangle_union ( area, &vgl->realtime_extended_area, area );
+  }
+  else if ( vgl->trkpt ) {
+    // The new line segment along with any trackpoint drawing at either end
+    const gint margin = 20;
+    gint x1 = x, y1 = y, x2 = x, y2 = y;
+    vik_viewport_coord_to_screen ( vvp, &vgl->trkpt->coord, &x1, &y1 );
+    if ( prev )
+      vik_viewport_coord_to_screen ( vvp, &prev->coord, &x2, &y2 );
+    else {
+      x2 = x1;
+      y2 = y1;
+    }
+    GdkRectangle segment = { MIN(x1,x2) - margin, MIN(y1,y2) - margin, ABS(x2-x1) + 2*margin, ABS(y2-y1) + 2*margin };
+    gdk_rectangle_union ( area, &segment, area );
+  }
+  return TRUE;
+}
+
+/**
+ * The last link of the realtime track,
+ *  without walking the whole of the track when it is already known
+ */
+static GList *realtime_track_last ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_last && vik_track_get_serial(vgl->realtime_track) == vgl->realtime_last_serial )
+    return vgl->realtime_last;
+  return g_list_last ( vgl->realtime_track->trackpoints );
+}
+
+/*
+ * The realtime journal is a plain text file that only ever gets appended to,
+ *  one line per change to the realtime track:
+ *   P <timestamp> <lat> <lon> <altitude> <speed> <course> <nsats> <fix mode> - a new trackpoint
+ *   U - the previous trackpoint is replaced by the next one
+ * After a crash at most the unsynced lines are lost, and any incomplete last line is ignored.
+ */
+#define REALTIME_JOURNAL_HEADER "# Viking Realtime Journal 1\n"
+#define REALTIME_JOURNAL_SYNC_INTERVAL 10 // Seconds of trackpoints between writes to disk
+
+static gchar *realtime_journal_dir ( void )
+{
+  return g_build_filename ( a_get_viking_dir(), "realtime", NULL );
+}
+
+static void realtime_journal_sync ( VikGpsLayer *vgl )
+{
+  if ( fflush ( vgl->realtime_journal_file ) != 0 )
+    g_warning ( "%s: %s", __FUNCTION__, g_strerror(errno) );
+#if defined(HAVE_UNISTD_H) && !defined(WINDOWS)
+  else
+    (void)fsync ( fileno(vgl->realtime_journal_file) );
+#endif
+}
+
+static void realtime_journal_open ( VikGpsLayer *vgl )
+{
+  gchar *dir = realtime_journal_dir ();
+  if ( g_mkdir_with_parents ( dir, 0755 ) != 0 ) {
+    g_warning ( "%s: Failed to create directory %s", __FUNCTION__, dir );
+    g_free ( dir );
+    return;
+  }
+  GDateTime *now = g_date_time_new_now_local ();
+  gchar *basename = g_date_time_format ( now, "%Y%m%d-%H%M%S.txt" );
+  gchar *filename = g_build_filename ( dir, basename, NULL );
+  vgl->realtime_journal_file = g_fopen ( filename, "ab" );
+  if ( vgl->realtime_journal_file ) {
+    fputs ( REALTIME_JOURNAL_HEADER, vgl->realtime_journal_file );
+    realtime_journal_sync ( vgl );
+  }
+  else
+    g_warning ( "%s: Failed to open %s: %s", __FUNCTION__, filename, g_strerror(errno) );
+  vgl->realtime_journal_synced = NAN;
+  g_free ( filename );
+  g_free ( basename );
+  g_date_time_unref ( now );
+  g_free ( dir );
+}
+
+static void realtime_journal_close ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_journal_file ) {
+    realtime_journal_sync ( vgl );
+    fclose ( vgl->realtime_journal_file );
+    vgl->realtime_journal_file = NULL;
+  }
+}
+
+static void realtime_journal_add ( VikGpsLayer *vgl, VikTrackpoint *tp )
+{
+  if ( !vgl->realtime_journal_file )
+    return;
+
+  struct LatLon ll;
+  vik_coord_to_latlon ( &tp->coord, &ll );
+  gchar s_ts[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar s_lat[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar s_lon[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar s_alt[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar s_speed[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar s_course[G_ASCII_DTOSTR_BUF_SIZE];
+  fprintf ( vgl->realtime_journal_file, "P %s %s %s %s %s %s %u %u\n",
+            g_ascii_formatd ( s_ts, G_ASCII_DTOSTR_BUF_SIZE, "%.3f", tp->timestamp ),
+            g_ascii_formatd ( s_lat, G_ASCII_DTOSTR_BUF_SIZE, "%.7f", ll.lat ),
+            g_ascii_formatd ( s_lon, G_ASCII_DTOSTR_BUF_SIZE, "%.7f", ll.lon ),
+            g_ascii_formatd ( s_alt, G_ASCII_DTOSTR_BUF_SIZE, "%.1f", tp->altitude ),
+            g_ascii_formatd ( s_speed, G_ASCII_DTOSTR_BUF_SIZE, "%.2f", tp->speed ),
+            g_ascii_formatd ( s_course, G_ASCII_DTOSTR_BUF_SIZE, "%.1f", tp->course ),
+            tp->nsats, tp->fix_mode );
+
+  // Writing to disk on every fix would be needlessly slow
+  if ( isnan(vgl->realtime_journal_synced) || isnan(tp->timestamp) ||
+       tp->timestamp - vgl->realtime_journal_synced >= REALTIME_JOURNAL_SYNC_INTERVAL ) {
+    realtime_journal_sync ( vgl );
+    vgl->realtime_journal_synced = tp->timestamp;
   }
 }
 
-static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
+static void realtime_journal_replace ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_journal_file )
+    fputs ( "U\n", vgl->realtime_journal_file );
+}
+
+/**
+ * Returns: A new track of the trackpoints in the journal, or NULL if there are none
+ */
+static VikTrack *realtime_journal_read ( const gchar *filename, VikCoordMode mode )
+{
+  gchar *contents = NULL;
+  GError *error = NULL;
+  if ( !g_file_get_contents ( filename, &contents, NULL, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return NULL;
+  }
+
+  GList *tps = NULL; // In reverse order
+  gchar **lines = g_strsplit ( contents, "\n", -1 );
+  // The last piece is either empty or a line that was only partly written
+  for ( guint i = 0; lines[i] && lines[i+1]; i++ ) {
+    if ( lines[i][0] == 'U' ) {
+      if ( tps ) {
+        vik_trackpoint_free ( tps->data );
+        tps = g_list_delete_link ( tps, tps );
+      }
+      continue;
+    }
+    if ( lines[i][0] != 'P' )
+      continue;
+    gchar **fields = g_strsplit ( lines[i], " ", -1 );
+    if ( g_strv_length(fields) == 9 ) {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      struct LatLon ll;
+      tp->timestamp = g_ascii_strtod ( fields[1], NULL );
+      ll.lat = g_ascii_strtod ( fields[2], NULL );
+      ll.lon = g_ascii_strtod ( fields[3], NULL );
+      tp->altitude = g_ascii_strtod ( fields[4], NULL );
+      tp->speed = g_ascii_strtod ( fields[5], NULL );
+      tp->course = g_ascii_strtod ( fields[6], NULL );
+      tp->nsats = (guint)g_ascii_strtoull ( fields[7], NULL, 10 );
+      tp->fix_mode = (guint)g_ascii_strtoull ( fields[8], NULL, 10 );
+      vik_coord_load_from_latlon ( &tp->coord, mode, &ll );
+      tps = g_list_prepend ( tps, tp );
+    }
+    g_strfreev ( fields );
+  }
+  g_strfreev ( lines );
+  g_free ( contents );
+
+  if ( !tps )
+    return NULL;
+
+  VikTrack *trk = vik_track_new ();
+  trk->visible = TRUE;
+  trk->trackpoints = g_list_reverse ( tps );
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+static void gps_recover_journal_cb ( gpointer layer_and_vlp[2] )
+{
+  VikGpsLayer *vgl = (VikGpsLayer *)layer_and_vlp[0];
+  VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Recover Realtime Journal"),
+                                                    VIK_GTK_WINDOW_FROM_LAYER(vgl),
+                                                    GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                    GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gchar *dir = realtime_journal_dir ();
+  gtk_file_chooser_set_current_folder ( GTK_FILE_CHOOSER(dialog), dir );
+  g_free ( dir );
+
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT ) {
+    gchar *filename = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+    VikTrack *trk = realtime_journal_read ( filename, vik_trw_layer_get_coord_mode(vtl) );
+    if ( trk ) {
+      gchar *name = make_track_name ( vtl );
+      vik_trw_layer_add_track ( vtl, name, trk );
+      g_free ( name );
+      vik_layer_emit_update ( VIK_LAYER(vtl), TRUE );
+    }
+    else
+      a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vgl), _("No trackpoints could be recovered from the journal.") );
+    g_free ( filename );
+  }
+  gtk_widget_destroy ( dialog );
+}
+
+/**
+ * Drop the oldest trackpoints of the realtime track once it is a batch over the trail length,
+ *  so the time spent on it stays bounded however long the session lasts
+ *
+ * Returns: TRUE if any trackpoints were dropped
+ */
+static gboolean realtime_track_trim ( VikGpsLayer *vgl )
+{
+  if ( !vgl->realtime_trail || !vgl->realtime_track )
+    return FALSE;
+  guint trail = MAX ( vgl->realtime_trail, 2 );
+  if ( vgl->realtime_points <= trail + MAX(trail/10, 1) )
+    return FALSE;
+
+  VikTrack *trk = vgl->realtime_track;
+  while ( vgl->realtime_points > trail && trk->trackpoints ) {
+    vik_trackpoint_free ( trk->trackpoints->data );
+    trk->trackpoints = g_list_delete_link ( trk->trackpoints, trk->trackpoints );
+    vgl->realtime_points--;
+  }
+  vik_track_changed ( trk );
+  vik_track_calculate_bounds ( trk );
+  // The last link is still the same
+  vgl->realtime_last_serial = vik_track_get_serial ( trk );
+  return TRUE;
+}
+
+static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced, VikViewport *vvp)
 {
     struct LatLon ll;
     GList *last_tp;
@@ -1760,12 +2122,16 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
       int alt = isnan(vgl->realtime_fix.fix.altitude) ? 0 : (int)floor(vgl->realtime_fix.fix.altitude);
       int last_alt = isnan(vgl->last_fix.fix.altitude) ? 0 : (int)floor(vgl->last_fix.fix.altitude);
 #endif
-      if (((last_tp = g_list_last(vgl->realtime_track->trackpoints)) != NULL) &&
+      if (((last_tp = realtime_track_last(vgl)) != NULL) &&
           (vgl->realtime_fix.fix.mode > MODE_2D) &&
           (vgl->last_fix.fix.mode <= MODE_2D) &&
           ((cur_timestamp - last_timestamp) < 2)) {
         g_free(last_tp->data);
         vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
+        vgl->realtime_last = NULL;
+        vgl->realtime_points--;
+        realtime_journal_replace ( vgl );
+        vik_track_changed ( vgl->realtime_track );
         replace = TRUE;
       }
       if (replace ||
@@ -1795,7 +2161,18 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
         vik_coord_load_from_latlon(&tp->coord,
              vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
-        vik_track_add_trackpoint ( vgl->realtime_track, tp, TRUE ); // Ensure bounds is recalculated
+        // Appending with the known last link keeps this quick however long the track gets
+        GList *last = realtime_track_last ( vgl );
+        vgl->realtime_extended = FALSE;
+        if ( vgl->realtime_incremental )
+          vgl->realtime_extended = vik_trw_layer_track_extend ( vgl->trw_children[TRW_REALTIME], vgl->realtime_track, tp,
+                                                                &last, vvp, &vgl->realtime_extended_area );
+        else
+          last = vik_track_append_trackpoint ( vgl->realtime_track, tp, last );
+        vgl->realtime_last = last;
+        vgl->realtime_last_serial = vik_track_get_serial ( vgl->realtime_track );
+        vgl->realtime_points++;
+        realtime_journal_add ( vgl, tp );
         vgl->realtime_fix.dirty = FALSE;
         vgl->realtime_fix.satellites_used = 0;
         vgl->last_fix = vgl->realtime_fix;
@@ -1879,15 +2256,25 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
 
     vgl->first_realtime_trackpoint = FALSE;
 
-    vgl->trkpt = create_realtime_trackpoint ( vgl, FALSE );
+    VikTrackpoint *prev = vgl->trkpt_prev;
+    vgl->trkpt = create_realtime_trackpoint ( vgl, FALSE, vvp );
 
     if ( vgl->trkpt ) {
       if ( vgl->realtime_update_statusbar )
 	update_statusbar ( vgl, vw );
       vgl->trkpt_prev = vgl->trkpt;
+      // The start of the track moves
+      if ( realtime_track_trim ( vgl ) )
+        update_all = TRUE;
     }
 
-    vik_layer_emit_update ( update_all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]), vgl->trkpt ? TRUE : FALSE ); // NB update from background thread
+    GdkRectangle area;
+    if ( update_all )
+      vik_layer_emit_update ( VIK_LAYER(vgl), vgl->trkpt ? TRUE : FALSE );
+    else
+      // When the view hasn't moved only the area around the vehicle changes
+      vik_layer_emit_update_area ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]), vgl->trkpt ? TRUE : FALSE,
+                                   realtime_tracking_damage ( vgl, vvp, &vehicle_coord, prev, &area ) ? &area : NULL );
   }
 }
 
@@ -2009,9 +2396,16 @@ static gboolean rt_gpsd_try_connect(gpointer *data)
     VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
     vgl->realtime_track = vik_track_new();
     vgl->realtime_track->visible = TRUE;
+    vgl->realtime_last = NULL;
+    vgl->realtime_extended = FALSE;
+    vgl->realtime_points = 0;
+    if ( vgl->realtime_journal )
+      realtime_journal_open ( vgl );
     gchar *name = make_track_name(vtl);
     vik_trw_layer_add_track(vtl, name, vgl->realtime_track);
     g_free(name);
+    if ( vgl->realtime_incremental )
+      vik_trw_layer_set_draw_cache ( vtl, TRUE );
   }
 
   vgl->connected_to_gpsd = TRUE;
@@ -2097,6 +2491,10 @@ static void rt_gpsd_disconnect(VikGpsLayer *vgl)
   }
 
   if (vgl->realtime_record && vgl->realtime_track) {
+    vik_trw_layer_set_draw_cache ( vgl->trw_children[TRW_REALTIME], FALSE );
+    vgl->realtime_last = NULL;
+    vgl->realtime_extended = FALSE;
+    realtime_journal_close ( vgl );
     if ((vgl->realtime_track->trackpoints == NULL) || (vgl->realtime_track->trackpoints->next == NULL))
       vik_trw_layer_delete_track(vgl->trw_children[TRW_REALTIME], vgl->realtime_track);
     vgl->realtime_track = NULL;
@@ -2119,12 +2517,95 @@ static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2])
       vgl->realtime_tracking = FALSE;
       vgl->trkpt = NULL;
     }
+    else
+      realtime_fleet_start(vgl);
   }
   else {  /* stop realtime tracking */
     vgl->first_realtime_trackpoint = FALSE;
     vgl->trkpt = NULL;
     rt_gpsd_disconnect(vgl);
+    realtime_fleet_stop(vgl);
+  }
+}
+
+/*
+ * Fleet sources are read on their own thread,
+ *  with all their latest positions added together at a steady rate
+ *  so the number of sources doesn't affect how often the display updates
+ */
+#define REALTIME_FLEET_UPDATE_INTERVAL 1 // Seconds
+
+typedef struct {
+  VikTrack *trk;
+  GList *last;    // Of trk whilst its serial is unchanged
+  guint serial;
+} FleetTrack;
+
+static void realtime_fleet_add_fix ( const gchar *source, const VikGpsFleetFix *fix, gpointer user_data )
+{
+  VikGpsLayer *vgl = (VikGpsLayer *)user_data;
+  VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
+
+  VikTrack *trk = vik_trw_layer_get_track ( vtl, source );
+  if ( !trk ) {
+    trk = vik_track_new ();
+    trk->visible = TRUE;
+    vik_trw_layer_add_track ( vtl, (gchar*)source, trk );
+  }
+
+  FleetTrack *ft = g_hash_table_lookup ( vgl->realtime_fleet_tracks, source );
+  if ( !ft ) {
+    ft = g_new0 ( FleetTrack, 1 );
+    g_hash_table_insert ( vgl->realtime_fleet_tracks, g_strdup(source), ft );
+  }
+  // The track may have been replaced or edited since
+  if ( ft->trk != trk || vik_track_get_serial(trk) != ft->serial ) {
+    ft->trk = trk;
+    ft->last = NULL;
+  }
+
+  VikTrackpoint *tp = vik_trackpoint_new ();
+  tp->timestamp = fix->timestamp;
+  tp->altitude = fix->altitude;
+  tp->speed = fix->speed;
+  tp->course = fix->course;
+  tp->nsats = fix->nsats;
+  tp->fix_mode = fix->fix_mode;
+  vik_coord_load_from_latlon ( &tp->coord, vik_trw_layer_get_coord_mode(vtl), &fix->ll );
+  ft->last = vik_track_append_trackpoint ( trk, tp, ft->last );
+  ft->serial = vik_track_get_serial ( trk );
+}
+
+static gboolean realtime_fleet_update ( gpointer data )
+{
+  VikGpsLayer *vgl = (VikGpsLayer *)data;
+  if ( vik_gps_fleet_take_fixes ( vgl->realtime_fleet, realtime_fleet_add_fix, vgl ) )
+    vik_layer_emit_update ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]), TRUE );
+  return TRUE;
+}
+
+static void realtime_fleet_start ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_fleet || !vgl->realtime_fleet_sources )
+    return;
+  vgl->realtime_fleet = vik_gps_fleet_new ( vgl->realtime_fleet_sources, MAX(vgl->gpsd_retry_interval, 1) );
+  if ( !vgl->realtime_fleet )
+    return;
+  if ( !vgl->realtime_fleet_tracks )
+    vgl->realtime_fleet_tracks = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+  vgl->realtime_fleet_timer = g_timeout_add_seconds ( REALTIME_FLEET_UPDATE_INTERVAL, realtime_fleet_update, vgl );
+}
+
+static void realtime_fleet_stop ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_fleet_timer ) {
+    g_source_remove ( vgl->realtime_fleet_timer );
+    vgl->realtime_fleet_timer = 0;
   }
+  vik_gps_fleet_free ( vgl->realtime_fleet );
+  vgl->realtime_fleet = NULL;
+  if ( vgl->realtime_fleet_tracks )
+    g_hash_table_remove_all ( vgl->realtime_fleet_tracks );
 }
 
 static void layer_update_indictor_gc (VikGpsLayer *vgl, VikViewport *vp)
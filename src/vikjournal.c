@@ -0,0 +1,197 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * A journal of edits for undo and redo.
+ *
+ * Rather than snapshots, each edit records just what it needs to be undone and redone
+ *  (typically the objects involved, which are shared rather than copied, and the values changed),
+ *  given by its owner along with its size so the journal can keep within a memory limit.
+ * The oldest edits are forgotten once the journal is over its limits.
+ *
+ * Edits are undone in reverse order; one that no longer applies means anything older won't either
+ *  so the journal is cleared.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vikjournal.h"
+
+typedef struct {
+  gchar *label;
+  const VikJournalEditFuncs *funcs;
+  gpointer data;
+  gsize size;
+} VikJournalEdit;
+
+struct _VikJournal {
+  GQueue undo; // Most recent first
+  GQueue redo; // Most recently undone first
+  gsize size;
+  gsize max_size;
+  guint max_edits;
+};
+
+/**
+ * vik_journal_new:
+ * @max_size:  The most memory (in bytes) for the edits to use
+ * @max_edits: The most edits to keep
+ */
+VikJournal *vik_journal_new ( gsize max_size, guint max_edits )
+{
+  VikJournal *vj = g_new0 ( VikJournal, 1 );
+  g_queue_init ( &vj->undo );
+  g_queue_init ( &vj->redo );
+  vj->max_size = max_size;
+  vj->max_edits = max_edits;
+  return vj;
+}
+
+static void journal_edit_free ( VikJournal *vj, VikJournalEdit *edit )
+{
+  vj->size -= edit->size;
+  if ( edit->funcs->free )
+    edit->funcs->free ( edit->data );
+  g_free ( edit->label );
+  g_free ( edit );
+}
+
+static void journal_queue_clear ( VikJournal *vj, GQueue *queue )
+{
+  VikJournalEdit *edit;
+  while ( (edit = g_queue_pop_head ( queue )) )
+    journal_edit_free ( vj, edit );
+}
+
+void vik_journal_free ( VikJournal *vj )
+{
+  if ( !vj )
+    return;
+  vik_journal_clear ( vj );
+  g_free ( vj );
+}
+
+void vik_journal_clear ( VikJournal *vj )
+{
+  journal_queue_clear ( vj, &vj->undo );
+  journal_queue_clear ( vj, &vj->redo );
+}
+
+/**
+ * vik_journal_add:
+ * @label: Describes the edit, for the user
+ * @funcs: How to undo, redo and free the edit
+ * @data:  The edit, now owned by the journal
+ * @size:  Roughly how much memory the edit uses
+ *
+ * Record an edit that has just been made.
+ * Anything previously undone can no longer be redone.
+ * An edit too big for the journal by itself is freed straight away,
+ *  and as nothing older can then be undone either the journal is cleared.
+ */
+void vik_journal_add ( VikJournal *vj, const gchar *label, const VikJournalEditFuncs *funcs, gpointer data, gsize size )
+{
+  journal_queue_clear ( vj, &vj->redo );
+
+  if ( size > vj->max_size ) {
+    g_debug ( "%s: '%s' is too big to undo", __FUNCTION__, label );
+    journal_queue_clear ( vj, &vj->undo );
+    if ( funcs->free )
+      funcs->free ( data );
+    return;
+  }
+
+  VikJournalEdit *edit = g_new ( VikJournalEdit, 1 );
+  edit->label = g_strdup ( label );
+  edit->funcs = funcs;
+  edit->data = data;
+  edit->size = size;
+  g_queue_push_head ( &vj->undo, edit );
+  vj->size += size;
+
+  // Forget the oldest edits when over the limits
+  while ( vj->undo.length > 1 && (vj->size > vj->max_size || vj->undo.length > vj->max_edits) )
+    journal_edit_free ( vj, g_queue_pop_tail ( &vj->undo ) );
+}
+
+/**
+ * vik_journal_get_undo_label:
+ *
+ * Returns: The label of the edit that would be undone next, or NULL if there is nothing to undo
+ */
+const gchar *vik_journal_get_undo_label ( VikJournal *vj )
+{
+  VikJournalEdit *edit = g_queue_peek_head ( &vj->undo );
+  return edit ? edit->label : NULL;
+}
+
+/**
+ * vik_journal_get_redo_label:
+ *
+ * Returns: The label of the edit that would be redone next, or NULL if there is nothing to redo
+ */
+const gchar *vik_journal_get_redo_label ( VikJournal *vj )
+{
+  VikJournalEdit *edit = g_queue_peek_head ( &vj->redo );
+  return edit ? edit->label : NULL;
+}
+
+/**
+ * vik_journal_undo:
+ * @user_data: Passed on to the edit's undo function
+ *
+ * Returns: TRUE if an edit was undone.
+ *  FALSE if there was nothing to undo or the edit no longer applies (and so the journal has been cleared)
+ */
+gboolean vik_journal_undo ( VikJournal *vj, gpointer user_data )
+{
+  VikJournalEdit *edit = g_queue_peek_head ( &vj->undo );
+  if ( !edit )
+    return FALSE;
+
+  if ( !edit->funcs->undo ( edit->data, user_data ) ) {
+    g_debug ( "%s: '%s' no longer applies", __FUNCTION__, edit->label );
+    vik_journal_clear ( vj );
+    return FALSE;
+  }
+  g_queue_push_head ( &vj->redo, g_queue_pop_head ( &vj->undo ) );
+  return TRUE;
+}
+
+/**
+ * vik_journal_redo:
+ * @user_data: Passed on to the edit's redo function
+ *
+ * Returns: TRUE if an edit was redone.
+ *  FALSE if there was nothing to redo or the edit no longer applies (and so can't be redone)
+ */
+gboolean vik_journal_redo ( VikJournal *vj, gpointer user_data )
+{
+  VikJournalEdit *edit = g_queue_peek_head ( &vj->redo );
+  if ( !edit )
+    return FALSE;
+
+  if ( !edit->funcs->redo ( edit->data, user_data ) ) {
+    g_debug ( "%s: '%s' no longer applies", __FUNCTION__, edit->label );
+    journal_queue_clear ( vj, &vj->redo );
+    return FALSE;
+  }
+  g_queue_push_head ( &vj->undo, g_queue_pop_head ( &vj->redo ) );
+  return TRUE;
+}
@@ -0,0 +1,56 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_JOURNAL_H
+#define __VIKING_JOURNAL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikJournal VikJournal;
+
+// Returns FALSE if the edit no longer applies (e.g. what it changed has since been changed in some other way)
+typedef gboolean (*VikJournalEditFunc) ( gpointer data, gpointer user_data );
+typedef void (*VikJournalFreeFunc) ( gpointer data );
+
+/**
+ * The functions to undo, redo and free an edit recorded in a journal.
+ */
+typedef struct {
+  VikJournalEditFunc undo;
+  VikJournalEditFunc redo;
+  VikJournalFreeFunc free;
+} VikJournalEditFuncs;
+
+VikJournal *vik_journal_new ( gsize max_size, guint max_edits );
+void vik_journal_free ( VikJournal *vj );
+
+void vik_journal_add ( VikJournal *vj, const gchar *label, const VikJournalEditFuncs *funcs, gpointer data, gsize size );
+void vik_journal_clear ( VikJournal *vj );
+
+const gchar *vik_journal_get_undo_label ( VikJournal *vj );
+const gchar *vik_journal_get_redo_label ( VikJournal *vj );
+
+gboolean vik_journal_undo ( VikJournal *vj, gpointer user_data );
+gboolean vik_journal_redo ( VikJournal *vj, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -22,6 +22,7 @@
  */
 #include "viking.h"
 #include "viklayer_defaults.h"
+#include "perfstats.h"
 
 /* functions common to all layers. */
 /* TODO longone: rename interface free -> finalize */
@@ -114,6 +115,7 @@ void vik_layer_redraw ( VikLayer *vl )
       return;
 
     vik_window_set_redraw_trigger(vl);
+    vik_window_add_damage ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)), NULL );
 
     // Only ever draw when there is time to do so
     if ( g_thread_self() != thread ) {
@@ -133,6 +135,21 @@ void vik_layer_redraw ( VikLayer *vl )
  */
 void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
 {
+  vik_layer_emit_update_area ( vl, is_modified, NULL );
+}
+
+/**
+ * vik_layer_emit_update_area:
+ * @is_modified: Whether the layer has been modified
+ * @area: The only screen area affected by the update, or NULL for all of it
+ *
+ * As vik_layer_emit_update(), but when the layer knows exactly what changed on screen
+ *  (both where it was and where it is now) the window needs to redraw just that area.
+ */
+void vik_layer_emit_update_area ( VikLayer *vl, gboolean is_modified, const GdkRectangle *area )
+{
+  if ( is_modified )
+    vl->changed = TRUE;
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -140,6 +157,7 @@ void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
       return;
 
     vik_window_set_redraw_trigger(vl);
+    vik_window_add_damage ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)), area );
 
     // Notionally the 'refresh' function could be directly connected to the 'update' signal
     // However we then have to manage the lifecycle (creation, copying, removing, etc...)
@@ -175,6 +193,7 @@ void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
 void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 {
   vik_window_set_redraw_trigger(vl);
+  vik_window_add_damage ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)), NULL );
   (void)g_idle_add ( (GSourceFunc)idle_draw, vl );
 }
 
@@ -227,6 +246,7 @@ static void vik_layer_init ( VikLayer *vl )
   vl->visible = TRUE;
   vl->name = NULL;
   vl->realized = FALSE;
+  vl->changed = TRUE;
 }
 
 void vik_layer_set_type ( VikLayer *vl, VikLayerTypeEnum type )
@@ -319,8 +339,43 @@ gboolean vik_layer_properties ( VikLayer *layer, VikViewport *vp, gboolean have_
 void vik_layer_draw ( VikLayer *l, VikViewport *vp )
 {
   if ( l->visible )
-    if ( vik_layer_interfaces[l->type]->draw )
+    if ( vik_layer_interfaces[l->type]->draw ) {
+      gint64 start = g_get_monotonic_time ();
       vik_layer_interfaces[l->type]->draw ( l, vp );
+      a_perfstats_time ( "draw", vik_layer_interfaces[l->type]->fixed_layer_name, g_get_monotonic_time() - start );
+    }
+}
+
+/**
+ * vik_layer_can_draw_surface:
+ *
+ * Returns: Whether the layer (if shown) can be drawn by vik_layer_draw_surface()
+ */
+gboolean vik_layer_can_draw_surface ( VikLayer *l )
+{
+  return l->visible && vik_layer_interfaces[l->type]->draw_surface != NULL;
+}
+
+/**
+ * vik_layer_draw_surface:
+ * @proj: The view to draw
+ * @cr:   Onto an image surface the size of the view
+ *
+ * Thread safe drawing of the layer, so it can happen alongside the drawing of other layers.
+ * The layer draw_surface function must only use the given projection and cairo context,
+ *  never the viewport itself or anything else of GTK.
+ *
+ * Returns: FALSE if it couldn't be drawn this way, so vik_layer_draw() is needed instead
+ */
+gboolean vik_layer_draw_surface ( VikLayer *l, const VikViewportProjection *proj, cairo_t *cr )
+{
+  if ( !vik_layer_can_draw_surface ( l ) )
+    return FALSE;
+  gint64 start = g_get_monotonic_time ();
+  gboolean ans = vik_layer_interfaces[l->type]->draw_surface ( l, proj, cr );
+  if ( ans )
+    a_perfstats_time ( "draw", vik_layer_interfaces[l->type]->fixed_layer_name, g_get_monotonic_time() - start );
+  return ans;
 }
 
 void vik_layer_configure ( VikLayer *l, VikViewport *vp )
@@ -348,11 +403,11 @@ void vik_layer_marshall ( VikLayer *vl, guint8 **data, guint *len )
   if ( vl && vik_layer_interfaces[vl->type]->marshall ) {
     vik_layer_interfaces[vl->type]->marshall ( vl, data, len );
     if (*data) {
-      header = g_malloc(*len + sizeof(*header));
+      // Grow the buffer in place for the header rather than allocating another one just as big
+      header = g_realloc(*data, *len + sizeof(*header));
+      memmove(header->data, header, *len);
       header->layer_type = vl->type;
       header->len = *len;
-      memcpy(header->data, *data, *len);
-      g_free(*data);
       *data = (guint8 *)header;
       *len = *len + sizeof(*header);
     }
@@ -594,11 +649,40 @@ const gchar* vik_layer_sublayer_tooltip ( VikLayer *l, gint subtype, gpointer su
   return NULL;
 }
 
+/**
+ * vik_layer_layer_tooltip:
+ *
+ * The layer's own tooltip, followed by how much memory it uses (when the layer can tell)
+ */
 const gchar* vik_layer_layer_tooltip ( VikLayer *l )
 {
+  const gchar *tooltip = NULL;
   if ( vik_layer_interfaces[l->type]->layer_tooltip )
-    return vik_layer_interfaces[l->type]->layer_tooltip ( l );
-  return NULL;
+    tooltip = vik_layer_interfaces[l->type]->layer_tooltip ( l );
+  if ( !vik_layer_interfaces[l->type]->get_memory_usage )
+    return tooltip;
+
+  static gchar tmp_buf[512];
+  gchar *size = g_format_size ( vik_layer_get_memory_usage ( l ) );
+  if ( tooltip && tooltip[0] )
+    g_snprintf ( tmp_buf, sizeof(tmp_buf), _("%s\nMemory: %s"), tooltip, size );
+  else
+    g_snprintf ( tmp_buf, sizeof(tmp_buf), _("Memory: %s"), size );
+  g_free ( size );
+  return tmp_buf;
+}
+
+/**
+ * vik_layer_get_memory_usage:
+ *
+ * Returns: Approximately how many bytes are held for the layer:
+ *  its own data, and its share of any caches (e.g. map tiles or DEMs)
+ */
+gsize vik_layer_get_memory_usage ( VikLayer *l )
+{
+  if ( vik_layer_interfaces[l->type]->get_memory_usage )
+    return vik_layer_interfaces[l->type]->get_memory_usage ( l );
+  return 0;
 }
 
 /**
@@ -62,6 +62,8 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  gboolean changed; // Since last saved or autosaved
 };
 
 /* I think most of these are ignored,
@@ -135,6 +137,8 @@ typedef void          (*VikLayerFuncFree)                  (VikLayer *);
 typedef gboolean      (*VikLayerFuncProperties)            (VikLayer *,VikViewport *, gboolean); // gboolean is for using an apply button
 
 typedef void          (*VikLayerFuncDraw)                  (VikLayer *,VikViewport *);
+// Optional thread safe drawing (c.f. vik_layer_draw_surface())
+typedef gboolean      (*VikLayerFuncDrawSurface)           (VikLayer *,const VikViewportProjection *,cairo_t *);
 typedef void          (*VikLayerFuncConfigure)             (VikLayer *,VikViewport *); // 'configure-event' events
 typedef void          (*VikLayerFuncChangeCoordMode)       (VikLayer *,VikCoordMode);
 
@@ -192,6 +196,8 @@ typedef double        (*VikLayerFuncGetTimestamp)          (VikLayer *);
 //  i.e. don't call that function from this function as it will get stuck in a infinite loop
 //  useful to hook in a separate redraw
 typedef gboolean      (*VikLayerFuncRefresh)               (VikLayer *);
+// Approximate bytes held for the layer (c.f. vik_layer_get_memory_usage())
+typedef gsize         (*VikLayerFuncGetMemoryUsage)        (VikLayer *);
 
 typedef enum {
   VIK_MENU_ITEM_PROPERTY=1,
@@ -274,6 +280,11 @@ struct _VikLayerInterface {
   VikLayerFuncSelectedViewportMenu  show_viewport_menu;
 
   VikLayerFuncRefresh               refresh;
+
+  // Declares the layer can be drawn in another thread
+  VikLayerFuncDrawSurface           draw_surface;
+
+  VikLayerFuncGetMemoryUsage        get_memory_usage;
 };
 
 VikLayerInterface *vik_layer_get_interface ( VikLayerTypeEnum type );
@@ -281,6 +292,8 @@ VikLayerInterface *vik_layer_get_interface ( VikLayerTypeEnum type );
 
 void vik_layer_set_type ( VikLayer *vl, VikLayerTypeEnum type );
 void vik_layer_draw ( VikLayer *l, VikViewport *vp );
+gboolean vik_layer_can_draw_surface ( VikLayer *l );
+gboolean vik_layer_draw_surface ( VikLayer *l, const VikViewportProjection *proj, cairo_t *cr );
 void vik_layer_configure ( VikLayer *l, VikViewport *vp );
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode );
 void vik_layer_rename ( VikLayer *l, const gchar *new_name );
@@ -294,6 +307,7 @@ gboolean vik_layer_set_param ( VikLayer *vl, VikLayerSetParam *vlsp );
 void vik_layer_set_defaults ( VikLayer *vl, VikViewport *vvp );
 
 void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified );
+void vik_layer_emit_update_area ( VikLayer *vl, gboolean is_modified, const GdkRectangle *area );
 
 void vik_layer_redraw ( VikLayer *vl );
 
@@ -321,6 +335,7 @@ gboolean vik_layer_sublayer_toggle_visible ( VikLayer *l, gint subtype, gpointer
 const gchar* vik_layer_sublayer_tooltip ( VikLayer *l, gint subtype, gpointer sublayer );
 
 const gchar* vik_layer_layer_tooltip ( VikLayer *l );
+gsize vik_layer_get_memory_usage ( VikLayer *l );
 
 gboolean vik_layer_selected ( VikLayer *l, gint subtype, gpointer sublayer, gint type, gpointer vlp );
 
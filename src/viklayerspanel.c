@@ -279,9 +279,17 @@ static void layers_panel_calendar_update ( VikLayersPanel *vlp )
   else
     ds2 = g_strdup_printf ( "%d-%02d-%02dT00:00:00", year+1, 1, 1 );
 
-  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+  GTimeVal tv1, tv2;
+  gboolean check_times = g_time_val_from_iso8601 ( ds1, &tv1 ) && g_time_val_from_iso8601 ( ds2, &tv2 );
+  for ( GList *layer = layers; layer != NULL; ) {
+    GList *next = layer->next;
     VikTrwLayer *vtl = VIK_TRW_LAYER(layer->data);
-    calendar_mark_layer_in_month ( vlp, vtl, gd, ds1, ds2, year, month, day );
+    // Rather than reading in the contents of a deferred layer, skip it when nothing can be in this month
+    if ( check_times && !vik_trw_layer_may_have_time ( vtl, (gdouble)tv1.tv_sec, (gdouble)tv2.tv_sec ) )
+      layers = g_list_delete_link ( layers, layer );
+    else
+      calendar_mark_layer_in_month ( vlp, vtl, gd, ds1, ds2, year, month, day );
+    layer = next;
   }
   g_free ( ds1 );
   g_free ( ds2 );
@@ -843,6 +851,7 @@ void layers_panel_emit_update ( VikLayersPanel *vlp )
  */
 void vik_layers_panel_emit_update ( VikLayersPanel *vlp, gboolean is_modified )
 {
+  vik_window_add_damage ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(vlp)), NULL );
   layers_panel_emit_update ( vlp );
   if ( is_modified )
     vik_window_set_modified ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(vlp)) );
@@ -29,6 +29,7 @@
 #include "dir.h"
 #include "mapnik_interface.h"
 #include "background.h"
+#include "tracelog.h"
 
 #include "vikmapslayer.h"
 
@@ -60,6 +61,7 @@ static VikLayerParamScale scales[] = {
 	{ 0, 255, 5, 0 }, // Alpha
 	{ 64, 1024, 8, 0 }, // Tile size
 	{ 0, 1024, 12, 0 }, // Rerender timeout hours
+	{ 1, 16, 1, 0 }, // Metatile size
 };
 
 static void reset_cb ( GtkWidget *widget, gpointer ptr )
@@ -265,6 +267,7 @@ static VikLayerParamData carto_default ( void ) {
 }
 
 static VikLayerParamData rr_to_default ( void ) { return VIK_LPD_UINT(168); } // One week in hours
+static VikLayerParamData metatile_default ( void ) { return VIK_LPD_UINT(8); }
 
 static VikLayerParam prefs[] = {
 	// Changing these values only applies before first mapnik layer is 'created'
@@ -274,6 +277,8 @@ static VikLayerParam prefs[] = {
 	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"rerender_after", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Rerender Timeout (hours):"), VIK_LAYER_WIDGET_SPINBUTTON, &scales[2], NULL, N_("You need to restart Viking for a change to this value to be used"), rr_to_default, NULL, NULL },
 	// Changeable any time
 	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"carto", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("CartoCSS:"), VIK_LAYER_WIDGET_FILEENTRY, NULL, NULL,  N_("The program to convert CartoCSS files into Mapnik XML"), carto_default, NULL, NULL },
+	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"metatile_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Metatile Size (tiles):"), VIK_LAYER_WIDGET_SPINBUTTON, &scales[3], NULL,
+	  N_("Tiles are rendered in blocks of this many tiles square, which is quicker overall and avoids labels being cut at tile edges"), metatile_default, NULL, NULL },
 };
 
 static time_t planet_import_time;
@@ -281,6 +286,17 @@ static time_t planet_import_time;
 static GMutex *tp_mutex;
 static GHashTable *requests = NULL;
 
+// PNG encoding for the file cache is done here, rather than holding up the renders
+static GThreadPool *save_pool = NULL;
+
+typedef struct
+{
+	GdkPixbuf *pixbuf;
+	gchar *filename;
+} SaveInfo;
+
+static void save_thread ( SaveInfo *si, gpointer user_data );
+
 static GdkColor black_color;
 
 /**
@@ -310,6 +326,9 @@ void vik_mapnik_layer_post_init (void)
 	// Just storing keys only
 	requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 
+	// Single thread, as this is limited by the disk anyway
+	save_pool = g_thread_pool_new ( (GFunc)save_thread, NULL, 1, FALSE, NULL );
+
 	guint hours = a_preferences_get (MAPNIK_PREFS_NAMESPACE"rerender_after")->u;
 	GDateTime *now = g_date_time_new_now_local ();
 	GDateTime *then = g_date_time_add_hours (now, -hours);
@@ -330,6 +349,8 @@ void vik_mapnik_layer_post_init (void)
 
 void vik_mapnik_layer_uninit ()
 {
+	// Wait for any outstanding saves
+	g_thread_pool_free ( save_pool, FALSE, TRUE );
 	vik_mutex_free (tp_mutex);
 	g_hash_table_destroy ( requests );
 }
@@ -631,24 +652,37 @@ static gchar *get_filename ( gchar *dir, guint x, guint y, guint z)
 	return g_strdup_printf ( MAPNIK_LAYER_FILE_CACHE_LAYOUT, dir, (17-z), x, y );
 }
 
+static void save_thread ( SaveInfo *si, gpointer user_data )
+{
+	GError *error = NULL;
+	gchar *dir = g_path_get_dirname ( si->filename );
+	if ( !g_file_test ( si->filename, G_FILE_TEST_EXISTS ) )
+		if ( g_mkdir_with_parents ( dir , 0777 ) != 0 )
+			g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
+	g_free ( dir );
+
+	if ( !gdk_pixbuf_save (si->pixbuf, si->filename, "png", &error, NULL ) ) {
+		g_warning ("%s: %s", __FUNCTION__, error->message );
+		g_error_free (error);
+	}
+	g_object_unref ( si->pixbuf );
+	g_free ( si->filename );
+	g_free ( si );
+}
+
+/**
+ * possibly_save_pixbuf:
+ *
+ * The save happens later on, so the pixbuf must not be modified after this
+ */
 static void possibly_save_pixbuf ( VikMapnikLayer *vml, GdkPixbuf *pixbuf, MapCoord *ulm )
 {
 	if ( vml->use_file_cache ) {
 		if ( vml->file_cache_dir ) {
-			GError *error = NULL;
-			gchar *filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
-
-			gchar *dir = g_path_get_dirname ( filename );
-			if ( !g_file_test ( filename, G_FILE_TEST_EXISTS ) )
-				if ( g_mkdir_with_parents ( dir , 0777 ) != 0 )
-					g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
-			g_free ( dir );
-
-			if ( !gdk_pixbuf_save (pixbuf, filename, "png", &error, NULL ) ) {
-				g_warning ("%s: %s", __FUNCTION__, error->message );
-				g_error_free (error);
-			}
-			g_free (filename);
+			SaveInfo *si = g_malloc ( sizeof(SaveInfo) );
+			si->pixbuf = g_object_ref ( pixbuf );
+			si->filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+			g_thread_pool_push ( save_pool, si, NULL );
 		}
 	}
 }
@@ -659,32 +693,69 @@ typedef struct
 	VikCoord *ul;
 	VikCoord *br;
 	MapCoord *ulmc;
-	const gchar* request;
+	gint tiles_x; // Metatile size
+	gint tiles_y;
+	const gchar* request; // NULL once removed from the requests table
 } RenderInfo;
 
 /**
  * render:
+ * @ul:      Top left of the area
+ * @br:      Bottom right of the area
+ * @ulm:     The top left tile of the area
+ * @tiles_x: Number of tiles across the area
+ * @tiles_y: Number of tiles down the area
  *
  * Common render function which can run in separate thread
+ *
+ * The area is rendered as one image, which is then split into the individual tiles
  */
-static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm )
+static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm, gint tiles_x, gint tiles_y )
 {
+	guint size = vml->tile_size_x;
 	gint64 tt1 = g_get_real_time ();
-	GdkPixbuf *pixbuf = mapnik_interface_render ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west );
+	gint64 start = g_get_monotonic_time ();
+	GdkPixbuf *image = mapnik_interface_render_size ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west, tiles_x*size, tiles_y*size );
+	a_tracelog_complete ( "tile", "Mapnik render", start,
+	                      g_strdup_printf ( "\"render\": %d, \"z\": %d, \"x\": %d, \"y\": %d", tiles_x*tiles_y, 17 - ulm->scale, ulm->x, ulm->y ) );
 	gint64 tt2 = g_get_real_time ();
 	gdouble tt = (gdouble)(tt2-tt1)/1000000;
-	g_debug ( "Mapnik rendering completed in %.3f seconds", tt );
-	if ( !pixbuf ) {
-		// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
-		pixbuf = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), vml->tile_size_x, vml->tile_size_x, GDK_INTERP_BILINEAR );
+	g_debug ( "Mapnik rendering of %dx%d tiles completed in %.3f seconds", tiles_x, tiles_y, tt );
+	// Time recorded in the cache is per tile
+	tt = tt / (tiles_x * tiles_y);
+
+	MapCoord tlm = *ulm;
+	for ( gint xx = 0; xx < tiles_x; xx++ ) {
+		for ( gint yy = 0; yy < tiles_y; yy++ ) {
+			GdkPixbuf *pixbuf;
+			if ( image && tiles_x == 1 && tiles_y == 1 )
+				pixbuf = g_object_ref ( image );
+			else if ( image ) {
+				// Copied out, so each tile is independent of the others in the cache
+				pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, size, size );
+				gdk_pixbuf_copy_area ( image, xx*size, yy*size, size, size, pixbuf, 0, 0 );
+			}
+			else
+				// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
+				pixbuf = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), size, size, GDK_INTERP_BILINEAR );
+
+			tlm.x = ulm->x + xx;
+			tlm.y = ulm->y + yy;
+			possibly_save_pixbuf ( vml, pixbuf, &tlm );
+
+			// NB Mapnik can apply alpha, but use our own function for now
+			//  as this changes the pixels, apply to a copy when it may still be waiting to be saved
+			if ( vml->alpha < 255 ) {
+				GdkPixbuf *saved = pixbuf;
+				pixbuf = ui_pixbuf_scale_alpha ( vml->use_file_cache ? gdk_pixbuf_copy(saved) : g_object_ref(saved), vml->alpha );
+				g_object_unref ( saved );
+			}
+			a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt, 0 }, tlm.x, tlm.y, tlm.z, MAP_ID_MAPNIK_RENDER, tlm.scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+			g_object_unref(pixbuf);
+		}
 	}
-	possibly_save_pixbuf ( vml, pixbuf, ulm );
-
-	// NB Mapnik can apply alpha, but use our own function for now
-	if ( vml->alpha < 255 )
-		pixbuf = ui_pixbuf_scale_alpha ( pixbuf, vml->alpha );
-	a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt, 0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
-	g_object_unref(pixbuf);
+	if ( image )
+		g_object_unref ( image );
 }
 
 static void render_info_free ( RenderInfo *data )
@@ -696,36 +767,141 @@ static void render_info_free ( RenderInfo *data )
 	g_free ( data );
 }
 
+/**
+ * The metatile is no longer waiting to be rendered, so can be requested again
+ */
+static void request_done ( RenderInfo *data )
+{
+	g_mutex_lock(tp_mutex);
+	if ( data->request ) {
+		g_hash_table_remove (requests, data->request);
+		data->request = NULL;
+	}
+	g_mutex_unlock(tp_mutex);
+}
+
 static void background ( RenderInfo *data, gpointer threaddata )
 {
 	int res = a_background_thread_progress ( threaddata, 0 );
 	if (res == 0) {
-		render ( data->vml, data->ul, data->br, data->ulmc );
+		render ( data->vml, data->ul, data->br, data->ulmc, data->tiles_x, data->tiles_y );
 	}
 
-	g_mutex_lock(tp_mutex);
-	g_hash_table_remove (requests, data->request);
-	g_mutex_unlock(tp_mutex);
+	request_done ( data );
 
 	if (res == 0)
 		vik_layer_emit_update ( VIK_LAYER(data->vml), FALSE ); // NB update display from background
 }
 
+/**
+ * Also for a job cancelled whilst waiting, which never gets to background()
+ */
 static void render_cancel_cleanup (RenderInfo *data)
 {
-	// Anything?
+	request_done ( data );
+}
+
+typedef struct {
+	VikMapnikLayer *vml;
+	gint x0, xf, y0, yf; // Tiles being displayed
+	gint scale;
+	gint z;
+} MapnikRenderView;
+
+/**
+ * Reconsider waiting render jobs for this layer when the display changes:
+ *  those for what is now displayed come first, those next to it second,
+ *  and the rest (including any for another zoom level) are no longer needed
+ */
+static Background_Priority render_priority ( RenderInfo *ri, Background_Priority current, MapnikRenderView *view )
+{
+	if ( ri->vml != view->vml )
+		return current;
+
+	if ( ri->ulmc->scale != view->scale || ri->ulmc->z != view->z )
+		return BACKGROUND_PRIORITY_CANCEL;
+
+	gint x0 = ri->ulmc->x, xf = ri->ulmc->x + ri->tiles_x - 1;
+	gint y0 = ri->ulmc->y, yf = ri->ulmc->y + ri->tiles_y - 1;
+	if ( xf >= view->x0 && x0 <= view->xf && yf >= view->y0 && y0 <= view->yf )
+		return BACKGROUND_PRIORITY_VISIBLE;
+
+	if ( xf >= view->x0 - 1 && x0 <= view->xf + 1 && yf >= view->y0 - 1 && y0 <= view->yf + 1 )
+		return BACKGROUND_PRIORITY_NEARBY;
+
+	return BACKGROUND_PRIORITY_CANCEL;
 }
 
 #define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d"
 
+// Limit the size of the image for a metatile, whatever the tile size
+#define MAPNIK_METATILE_MAX_PIXELS 4096
+
+/**
+ * metatile_get:
+ * @ulm:     The tile
+ * @mul:     Set to the top left tile of the metatile containing the tile
+ * @tiles_x: Set to the number of tiles across the metatile
+ * @tiles_y: Set to the number of tiles down the metatile
+ *
+ * Metatiles are aligned to multiples of their size, so any tile only ever belongs to one of them
+ */
+static void metatile_get ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *mul, gint *tiles_x, gint *tiles_y )
+{
+	gint size = a_preferences_get (MAPNIK_PREFS_NAMESPACE"metatile_size")->u;
+	size = MIN ( size, MAPNIK_METATILE_MAX_PIXELS / (gint)vml->tile_size_x );
+	if ( size < 1 )
+		size = 1;
+
+	// Tiles across the whole world at this scale, so a metatile doesn't go off the edge
+	gint world = VIK_GZ(17 - ulm->scale);
+
+	*mul = *ulm;
+	mul->x = (ulm->x / size) * size;
+	mul->y = (ulm->y / size) * size;
+	*tiles_x = CLAMP ( world - mul->x, 1, size );
+	*tiles_y = CLAMP ( world - mul->y, 1, size );
+}
+
+/**
+ * metatile_corners:
+ *
+ * Get the top left and bottom right coordinates of the metatile
+ */
+static void metatile_corners ( MapCoord *mul, gint tiles_x, gint tiles_y, VikCoord *ul, VikCoord *br )
+{
+	map_utils_iTMS_to_vikcoord ( mul, ul );
+	MapCoord mbr = *mul;
+	mbr.x += tiles_x;
+	mbr.y += tiles_y;
+	map_utils_iTMS_to_vikcoord ( &mbr, br );
+}
+
+/**
+ * Free returned string after use
+ *  (or give it to the requests table)
+ */
+static gchar *request_key ( MapCoord *mul, const gchar *name )
+{
+	guint nn = name ? g_str_hash ( name ) : 0;
+	return g_strdup_printf ( REQUEST_HASHKEY_FORMAT, mul->x, mul->y, mul->z, mul->scale, nn );
+}
+
 /**
  * Thread
+ *
+ * Requests the rendering of the metatile containing the tile,
+ *  unless it is already wanted by an outstanding request
  */
-static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoord *br, gint x, gint y, gint z, gint zoom, const gchar* name )
+static void thread_add (VikMapnikLayer *vml, MapCoord *ulm, const gchar* name, Background_Priority priority )
 {
+	MapCoord mul;
+	gint tiles_x, tiles_y;
+	metatile_get ( vml, ulm, &mul, &tiles_x, &tiles_y );
+
 	// Create request
-	guint nn = name ? g_str_hash ( name ) : 0;
-	gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, x, y, z, zoom, nn );
+	//  keyed on the metatile, thus any tile within it merges with the same request
+	gchar *request = request_key ( &mul, name );
 
 	g_mutex_lock(tp_mutex);
 
@@ -740,9 +916,10 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 	ri->ul = g_malloc ( sizeof(VikCoord) );
 	ri->br = g_malloc ( sizeof(VikCoord) );
 	ri->ulmc = g_malloc ( sizeof(MapCoord) );
-	memcpy(ri->ul, ul, sizeof(VikCoord));
-	memcpy(ri->br, br, sizeof(VikCoord));
-	memcpy(ri->ulmc, mul, sizeof(MapCoord));
+	memcpy(ri->ulmc, &mul, sizeof(MapCoord));
+	ri->tiles_x = tiles_x;
+	ri->tiles_y = tiles_y;
+	metatile_corners ( &mul, tiles_x, tiles_y, ri->ul, ri->br );
 	ri->request = request;
 
 	g_hash_table_insert ( requests, request, NULL );
@@ -750,16 +927,17 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 	g_mutex_unlock (tp_mutex);
 
 	gchar *basename = g_path_get_basename (name);
-	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), zoom, x, y, basename );
+	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), mul.scale, mul.x, mul.y, basename );
 	g_free ( basename );
-	a_background_thread ( BACKGROUND_POOL_LOCAL_MAPNIK,
-	                      VIK_GTK_WINDOW_FROM_LAYER(vml),
-	                      description,
-	                      (vik_thr_func) background,
-	                      ri,
-	                      (vik_thr_free_func) render_info_free,
-	                      (vik_thr_free_func) render_cancel_cleanup,
-	                      1 );
+	a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL_MAPNIK,
+	                                    priority,
+	                                    VIK_GTK_WINDOW_FROM_LAYER(vml),
+	                                    description,
+	                                    (vik_thr_func) background,
+	                                    ri,
+	                                    (vik_thr_free_func) render_info_free,
+	                                    (vik_thr_free_func) render_cancel_cleanup,
+	                                    1 );
 	g_free ( description );
 }
 
@@ -802,8 +980,10 @@ static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *br
 /**
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
+ *
+ * A tile that needs rendering is added to @wanted
  */
-static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm )
+static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm, GArray *wanted )
 {
 	VikCoord ul; VikCoord br;
 	GdkPixbuf *pixbuf = NULL;
@@ -819,10 +999,10 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 			pixbuf = load_pixbuf ( vml, ulm, brm, &rerender );
 		if ( ! pixbuf || rerender ) {
 			if ( TRUE )
-				thread_add (vml, ulm, &ul, &br, ulm->x, ulm->y, ulm->z, ulm->scale, vml->filename_xml );
+				g_array_append_val ( wanted, *ulm );
 			else {
 				// Run in the foreground
-				render ( vml, &ul, &br, ulm );
+				render ( vml, &ul, &br, ulm, 1, 1 );
 				vik_layer_emit_update ( VIK_LAYER(vml), FALSE );
 			}
 		}
@@ -831,6 +1011,18 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 	return pixbuf;
 }
 
+/**
+ * Order tiles by their distance from the middle, given in doubled tile units
+ */
+static gint tile_distance_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+	const MapCoord *ma = a, *mb = b;
+	const gint *middle = user_data;
+	gint64 da = (gint64)(2*ma->x - middle[0]) * (2*ma->x - middle[0]) + (gint64)(2*ma->y - middle[1]) * (2*ma->y - middle[1]);
+	gint64 db = (gint64)(2*mb->x - middle[0]) * (2*mb->x - middle[0]) + (gint64)(2*mb->y - middle[1]) * (2*mb->y - middle[1]);
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
 /**
  *
  */
@@ -873,6 +1065,11 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 		gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
 		gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
 
+		// Renders still waiting from a previous display may no longer be wanted
+		MapnikRenderView view = { vml, xmin, xmax, ymin, ymax, ulm.scale, ulm.z };
+		a_background_reprioritise ( (vik_thr_func)background, (vik_thr_priority_func)render_priority, &view );
+		GArray *wanted = g_array_new ( FALSE, FALSE, sizeof(MapCoord) );
+
 		// Split rendering into a grid for the current viewport
 		//  thus each individual 'tile' can then be stored in the map cache
 		for (gint x = xmin; x <= xmax; x++ ) {
@@ -882,7 +1079,7 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 				brm.x = x+1;
 				brm.y = y+1;
 
-				pixbuf = get_pixbuf ( vml, &ulm, &brm );
+				pixbuf = get_pixbuf ( vml, &ulm, &brm, wanted );
 
 				if ( pixbuf ) {
 					map_utils_iTMS_to_vikcoord ( &ulm, &coord );
@@ -893,6 +1090,13 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 			}
 		}
 
+		// Request the renders nearest the middle of the display first
+		gint middle[2] = { xmin + xmax, ymin + ymax };
+		g_array_sort_with_data ( wanted, tile_distance_compare, middle );
+		for ( guint ii = 0; ii < wanted->len; ii++ )
+			thread_add ( vml, &g_array_index(wanted, MapCoord, ii), vml->filename_xml, BACKGROUND_PRIORITY_VISIBLE );
+		g_array_free ( wanted, TRUE );
+
 		// Done after so drawn on top
 		// Just a handy guide to tile blocks.
 		if ( vik_debug && vik_verbose ) {
@@ -1017,6 +1221,211 @@ static void mapnik_layer_about ( menu_array_values values )
 	g_free ( msg );
 }
 
+// Zoom levels offered for pre-rendering, as for map downloads
+static gchar *seed_zoom_list[] = {"1", "2", "4", "8", "16", "32", "64", "128", "256", "512", "1024", NULL };
+static const gdouble seed_zoom_vals[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+// Ask before rendering more than this number of tiles
+#define SEED_CONFIRM_TILES 1000
+
+typedef struct
+{
+	VikMapnikLayer *vml;
+	VikCoord ul;     // Area to render
+	VikCoord br;
+	gint zoom1;      // Range of indices into seed_zoom_vals
+	gint zoom2;
+	gboolean all;    // Otherwise only tiles not in the file cache or that are too old
+	gint metatiles;  // Number in the area
+	gint tiles;      // Number needing rendering
+} SeedInfo;
+
+/**
+ * tile_is_fresh:
+ *
+ * Whether the tile is in the file cache and isn't due to be rerendered
+ */
+static gboolean tile_is_fresh ( VikMapnikLayer *vml, MapCoord *ulm )
+{
+	GStatBuf gsb;
+	gchar *filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+	gboolean fresh = ( g_stat ( filename, &gsb ) == 0 && gsb.st_mtime >= planet_import_time );
+	g_free ( filename );
+	return fresh;
+}
+
+/**
+ * Returns the number of tiles of the metatile needing rendering
+ */
+static gint seed_metatile_stale ( SeedInfo *si, MapCoord *mul, gint tiles_x, gint tiles_y )
+{
+	if ( si->all )
+		return tiles_x * tiles_y;
+	gint stale = 0;
+	MapCoord tile = *mul;
+	for ( tile.x = mul->x; tile.x < mul->x + tiles_x; tile.x++ )
+		for ( tile.y = mul->y; tile.y < mul->y + tiles_y; tile.y++ )
+			if ( !tile_is_fresh ( si->vml, &tile ) )
+				stale++;
+	return stale;
+}
+
+static void seed_metatile ( SeedInfo *si, MapCoord *mul, gint tiles_x, gint tiles_y )
+{
+	VikMapnikLayer *vml = si->vml;
+	gchar *request = request_key ( mul, vml->filename_xml );
+
+	// Leave it to any request already on it
+	g_mutex_lock(tp_mutex);
+	if ( g_hash_table_lookup_extended (requests, request, NULL, NULL ) ) {
+		g_mutex_unlock (tp_mutex);
+		g_free ( request );
+		return;
+	}
+	g_hash_table_insert ( requests, request, NULL );
+	g_mutex_unlock (tp_mutex);
+
+	VikCoord ul, br;
+	metatile_corners ( mul, tiles_x, tiles_y, &ul, &br );
+	render ( vml, &ul, &br, mul, tiles_x, tiles_y );
+
+	g_mutex_lock(tp_mutex);
+	g_hash_table_remove (requests, request);
+	g_mutex_unlock(tp_mutex);
+
+	vik_layer_emit_update ( VIK_LAYER(vml), FALSE ); // NB update display from background
+}
+
+/**
+ * seed_iterate:
+ * @threaddata: When NULL just count what needs doing, otherwise render it
+ *
+ * Go through the area in metatile order
+ *
+ * Returns: FALSE if cancelled
+ */
+static gboolean seed_iterate ( SeedInfo *si, gpointer threaddata )
+{
+	gint done = 0;
+	for ( gint zz = si->zoom2; zz >= si->zoom1; zz-- ) {
+		MapCoord ulm, brm;
+		gdouble zoom = seed_zoom_vals[zz];
+		if ( !map_utils_vikcoord_to_iTMS ( &si->ul, zoom, zoom, &ulm ) ||
+		     !map_utils_vikcoord_to_iTMS ( &si->br, zoom, zoom, &brm ) )
+			continue;
+
+		MapCoord mul, tile = ulm;
+		gint tiles_x = 1, tiles_y = 1;
+		for ( tile.y = ulm.y; tile.y <= brm.y; tile.y = mul.y + tiles_y ) {
+			for ( tile.x = ulm.x; tile.x <= brm.x; tile.x = mul.x + tiles_x ) {
+				metatile_get ( si->vml, &tile, &mul, &tiles_x, &tiles_y );
+				if ( !threaddata ) {
+					si->metatiles++;
+					si->tiles += seed_metatile_stale ( si, &mul, tiles_x, tiles_y );
+					continue;
+				}
+				// Anything done before a cancel (or exit) is kept in the file cache,
+				//  thus doing it again carries on from where it got to
+				if ( a_background_thread_progress ( threaddata, (gdouble)++done / si->metatiles ) )
+					return FALSE;
+				if ( seed_metatile_stale ( si, &mul, tiles_x, tiles_y ) )
+					seed_metatile ( si, &mul, tiles_x, tiles_y );
+			}
+		}
+	}
+	return TRUE;
+}
+
+static void seed_thread ( SeedInfo *si, gpointer threaddata )
+{
+	(void)seed_iterate ( si, threaddata );
+}
+
+/**
+ * Render all tiles of the viewed area for the zoom levels specified by the user
+ *  into the file cache, so they are available offline
+ */
+static void mapnik_layer_seed ( menu_array_values values )
+{
+	VikMapnikLayer *vml = values[MA_VML];
+	VikViewport *vvp = values[MA_VVP];
+	if ( !vml->loaded )
+		return;
+
+	if ( !vml->use_file_cache || !vml->file_cache_dir ) {
+		a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vml), _("Pre-rendering requires the file cache to be in use") );
+		return;
+	}
+
+	gint default_zoom;
+	gdouble cur_zoom = vik_viewport_get_zoom ( vvp );
+	for ( default_zoom = 0; default_zoom < G_N_ELEMENTS(seed_zoom_vals); default_zoom++ ) {
+		if ( cur_zoom == seed_zoom_vals[default_zoom] )
+			break;
+	}
+	if ( default_zoom == G_N_ELEMENTS(seed_zoom_vals) )
+		default_zoom = G_N_ELEMENTS(seed_zoom_vals) - 1;
+	// Default to only 2 zoom levels below the current one
+	gint lower_zoom = default_zoom > 1 ? default_zoom - 2 : default_zoom;
+
+	gchar *method_list[] = { _("Missing or Old"), _("Rerender All"), NULL };
+	gint zoom1, zoom2, method;
+	if ( !maps_dialog_zoom_between ( VIK_GTK_WINDOW_FROM_LAYER(vml),
+	                                 _("Pre-render for Zoom Levels"),
+	                                 seed_zoom_list,
+	                                 lower_zoom,
+	                                 default_zoom,
+	                                 &zoom1,
+	                                 &zoom2,
+	                                 method_list,
+	                                 0,
+	                                 &method ) )
+		return;
+
+	SeedInfo *si = g_malloc0 ( sizeof(SeedInfo) );
+	si->vml = vml;
+	si->zoom1 = MIN ( zoom1, zoom2 );
+	si->zoom2 = MAX ( zoom1, zoom2 );
+	si->all = ( method == 1 );
+
+	gdouble min_lat, max_lat, min_lon, max_lon;
+	vik_viewport_get_min_max_lat_lon ( vvp, &min_lat, &max_lat, &min_lon, &max_lon );
+	struct LatLon ll_ul = { max_lat, min_lon };
+	struct LatLon ll_br = { min_lat, max_lon };
+	vik_coord_load_from_latlon ( &si->ul, VIK_COORD_LATLON, &ll_ul );
+	vik_coord_load_from_latlon ( &si->br, VIK_COORD_LATLON, &ll_br );
+
+	(void)seed_iterate ( si, NULL );
+	if ( !si->tiles ) {
+		a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vml), _("All tiles are already rendered") );
+		g_free ( si );
+		return;
+	}
+
+	if ( si->tiles > SEED_CONFIRM_TILES ) {
+		gchar *str = g_strdup_printf ( _("Do you really want to render %d tiles?"), si->tiles );
+		gboolean ans = a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vml), str, NULL );
+		g_free ( str );
+		if ( !ans ) {
+			g_free ( si );
+			return;
+		}
+	}
+
+	gchar *basename = g_path_get_basename ( vml->filename_xml );
+	gchar *description = g_strdup_printf ( _("Mapnik Pre-render %d tiles %s"), si->tiles, basename );
+	g_free ( basename );
+	a_background_thread ( BACKGROUND_POOL_LOCAL_MAPNIK,
+	                      VIK_GTK_WINDOW_FROM_LAYER(vml),
+	                      description,
+	                      (vik_thr_func) seed_thread,
+	                      si,
+	                      (vik_thr_free_func) g_free,
+	                      NULL,
+	                      si->metatiles );
+	g_free ( description );
+}
+
 /**
  *
  */
@@ -1034,6 +1443,7 @@ static void mapnik_layer_add_menu_items ( VikMapnikLayer *vml, GtkMenu *menu, gp
 	}
 
 	(void)vu_menu_add_item ( menu, NULL, GTK_STOCK_REFRESH, G_CALLBACK(mapnik_layer_reload), values );
+	(void)vu_menu_add_item ( menu, _("_Pre-render in Zoom Levels..."), GTK_STOCK_DND_MULTIPLE, G_CALLBACK(mapnik_layer_seed), values );
 
 	if ( g_strcmp0 ("", vml->filename_css) ) {
 		(void)vu_menu_add_item ( menu, _("_Run Carto Command"), GTK_STOCK_EXECUTE, G_CALLBACK(mapnik_layer_carto), values );
@@ -1058,7 +1468,8 @@ static void mapnik_layer_rerender ( VikMapnikLayer *vml )
 	brm.x = brm.x+1;
 	brm.y = brm.y+1;
 	map_utils_iTMS_to_vikcoord (&brm, &vml->rerender_br );
-	thread_add (vml, &ulm, &vml->rerender_ul, &vml->rerender_br, ulm.x, ulm.y, ulm.z, ulm.scale, vml->filename_xml );
+	// NB Rerenders all of the metatile it's in
+	thread_add (vml, &ulm, vml->filename_xml, BACKGROUND_PRIORITY_VISIBLE );
 }
 
 /**
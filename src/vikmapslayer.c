@@ -35,10 +35,16 @@
 #include "vikmapsourcedefault.h"
 #include "maputils.h"
 #include "mapcache.h"
+#include "tileindex.h"
+#include "tilebundle.h"
+#include "cachejanitor.h"
 #include "background.h"
 #include "vikmapslayer.h"
 #include "metatile.h"
 #include "map_ids.h"
+#include "perfstats.h"
+#include "tracelog.h"
+#include "tileresidency.h"
 
 #ifdef HAVE_SQLITE3_H
 #include "sqlite3.h"
@@ -50,6 +56,15 @@
 #define VIK_SETTINGS_MAP_MAX_TILES "maps_max_tiles"
 static gint MAX_TILES = 1000;
 
+#define VIK_SETTINGS_MAP_DOWNLOAD_BATCH "maps_download_batch"
+static gint DOWNLOAD_BATCH = 8;
+
+#define VIK_SETTINGS_MAP_CACHE_BUDGET "maps_cache_budget_mb"
+static gint CACHE_BUDGET = 0; // 0 for unlimited
+
+#define VIK_SETTINGS_MAP_AUTODOWNLOAD_RING "maps_autodownload_ring"
+static gint AUTODOWNLOAD_RING = 0;
+
 #define VIK_SETTINGS_MAP_MIN_SHRINKFACTOR "maps_min_shrinkfactor"
 #define VIK_SETTINGS_MAP_MAX_SHRINKFACTOR "maps_max_shrinkfactor"
 static gdouble MAX_SHRINKFACTOR = 8.0000001; /* zoom 1 viewing 8-tiles */
@@ -65,6 +80,11 @@ static guint SCALE_INC_DOWN = 4;
 #define VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST "maps_scale_smaller_zoom_first"
 static gboolean SCALE_SMALLER_ZOOM_FIRST = TRUE;
 
+#define VIK_SETTINGS_MAP_ASYNC_DECODE "maps_async_decode"
+#define VIK_SETTINGS_MAP_METATILE_HANDLES "maps_metatile_handles"
+static gboolean ASYNC_DECODE = TRUE;
+#define VIK_SETTINGS_MAP_DECODE_THREADS "maps_decode_threads"
+
 #define VIK_SETTINGS_MAP_CACHE_NO_FILE_COLOR "maps_cache_status_no_file_color"
 #define VIK_SETTINGS_MAP_CACHE_EXPIRED_COLOR "maps_cache_status_expired_color"
 #define VIK_SETTINGS_MAP_CACHE_DOWNLOAD_ERROR_COLOR "maps_cache_status_download_error_color"
@@ -95,6 +115,7 @@ static gdouble __mapzooms_y[] = { 0.0, 0.125, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.
 
 static void maps_layer_post_read (VikLayer *vl, VikViewport *vp, gboolean from_file);
 static const gchar* maps_layer_tooltip ( VikMapsLayer *vml );
+static gsize maps_layer_get_memory_usage ( VikMapsLayer *vml );
 static void maps_layer_marshall( VikMapsLayer *vml, guint8 **data, guint *len );
 static VikMapsLayer *maps_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp );
@@ -108,7 +129,8 @@ static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, G
 static VikLayerToolFuncStatus maps_layer_download_click ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
 static gpointer maps_layer_download_create ( VikWindow *vw, VikViewport *vvp );
 static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir );
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload );
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, Background_Priority priority, gint margin );
+static void start_autodownload ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, MapCoord *ulm, gint xmin, gint xmax, gint ymin, gint ymax );
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp );
 static guint map_uniq_id_to_index ( guint uniq_id );
 
@@ -136,7 +158,7 @@ static VikLayerParamData file_default ( void )
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
 static VikLayerParamData mapzoom_default ( void ) { return VIK_LPD_UINT ( 0 ); }
 
-static gchar *cache_types[] = { "Viking", N_("OSM"), NULL };
+static gchar *cache_types[] = { "Viking", N_("OSM"), N_("Bundles"), NULL };
 static VikMapsCacheLayout cache_layout_default_value = VIK_MAPS_CACHE_LAYOUT_OSM;
 static VikLayerParamData cache_layout_default ( void ) { return VIK_LPD_UINT ( cache_layout_default_value ); }
 
@@ -294,8 +316,14 @@ VikLayerInterface vik_maps_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+
+  (VikLayerFuncDrawSurface)             NULL,
+
+  (VikLayerFuncGetMemoryUsage)          maps_layer_get_memory_usage,
 };
 
+typedef struct _MapsDecodeContext MapsDecodeContext;
+
 struct _VikMapsLayer {
   VikLayer vl;
   guint maptype;
@@ -324,7 +352,12 @@ struct _VikMapsLayer {
   gchar *filename;
 #ifdef HAVE_SQLITE3_H
   sqlite3 *mbtiles;
+  sqlite3_stmt *mbtiles_stmt; // Kept for the lifetime of the connection
 #endif
+  MapsDecodeContext *decode_ctx;
+  VikTileResidency *residency; // Which tiles are available, for drawing other zoom levels in place of missing ones
+  gboolean tiles_scanned; // Whether the tile directory has been given to a_tileindex_scan()
+  guint vp_scale; // Of the viewport last drawn in, for choosing the resolution of tiles to get
 };
 
 enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
@@ -337,6 +370,30 @@ static VikLayerParamData mpl_dir_default ( void ) {
   VikLayerParamData data; data.s = maps_layer_default_dir(); return data;
 }
 
+typedef enum {
+  GET_PIXBUF_SYNC,       // Decode tile files immediately
+  GET_PIXBUF_QUEUE,      // Queue decoding of tile files in the background
+  GET_PIXBUF_CACHE_ONLY, // Only use what's already in the mapcache
+} GetPixbufMode;
+
+/**
+ * Shared between a layer and its queued background decodes and downloads,
+ *  so that they can still tell the layer to redraw - if it still exists.
+ */
+struct _MapsDecodeContext {
+  GMutex *mutex;
+  gint ref_count;
+  VikMapsLayer *vml;       // NULL once the layer has gone
+  gboolean update_pending; // Redraw request outstanding
+};
+
+static void decode_ctx_unref ( MapsDecodeContext *ctx );
+static void tile_waiters_free ( GSList *waiters );
+
+static GMutex *decode_mutex = NULL;
+static GHashTable *decode_requests = NULL;
+static GThreadPool *decode_pool = NULL;
+
 static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "maplayer_default_dir", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("Default map layer directory:"), VIK_LAYER_WIDGET_FOLDERENTRY, NULL, NULL, N_("Choose a directory to store cached Map tiles for this layer"), mpl_dir_default, NULL, NULL },
 };
@@ -371,6 +428,18 @@ void maps_layer_init ()
   if ( a_settings_get_integer ( VIK_SETTINGS_MAP_MAX_TILES, &max_tiles ) )
     MAX_TILES = max_tiles;
 
+  gint ring = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_AUTODOWNLOAD_RING, &ring ) )
+    AUTODOWNLOAD_RING = MAX(0, ring);
+
+  gint download_batch = DOWNLOAD_BATCH;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_DOWNLOAD_BATCH, &download_batch ) )
+    DOWNLOAD_BATCH = MAX(1, download_batch);
+
+  gint budget = CACHE_BUDGET;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_CACHE_BUDGET, &budget ) )
+    CACHE_BUDGET = MAX(0, budget);
+
   gdouble gdtmp;
   if ( a_settings_get_double ( VIK_SETTINGS_MAP_MIN_SHRINKFACTOR, &gdtmp ) )
     MIN_SHRINKFACTOR = gdtmp;
@@ -392,10 +461,22 @@ void maps_layer_init ()
   if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST, &gbtmp ) )
     SCALE_SMALLER_ZOOM_FIRST = gbtmp;
 
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_ASYNC_DECODE, &gbtmp ) )
+    ASYNC_DECODE = gbtmp;
+
   rq_mutex = vik_mutex_new();
 
-  // Just storing keys only
-  requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  // The tiles being got, shared by all layers (and windows) using the same source;
+  //  each with the contexts of any other layers waiting for it
+  requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)tile_waiters_free );
+
+  decode_mutex = vik_mutex_new();
+  decode_requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)tile_waiters_free );
+
+  guint metatile_handles = 64;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_METATILE_HANDLES, &gitmp ) && gitmp >= 0 )
+    metatile_handles = gitmp;
+  metatile_cache_init ( metatile_handles );
 
   (void)gdk_color_parse ( "#000000", &black_color );
 
@@ -414,6 +495,17 @@ void maps_layer_init ()
 
 void maps_layer_uninit ()
 {
+  if ( decode_pool ) {
+    // Drop any waiting decodes and wait for the running ones
+    g_thread_pool_free ( decode_pool, TRUE, TRUE );
+    decode_pool = NULL;
+  }
+  vik_mutex_free ( decode_mutex );
+  g_hash_table_destroy ( decode_requests );
+  decode_mutex = NULL;
+
+  metatile_cache_uninit ();
+
   vik_mutex_free ( rq_mutex );
   g_hash_table_destroy ( requests );
   rq_mutex = NULL;
@@ -491,6 +583,15 @@ void maps_layer_register_map_source ( VikMapSource *map )
 #define MAPS_LAYER_NTH_ID(n) (params_maptypes_ids[n])
 #define MAPS_LAYER_NTH_TYPE(n) (VIK_MAP_SOURCE(g_list_nth_data(__map_types, (n))))
 
+#if GTK_CHECK_VERSION (3,0,0)
+// The layer transparency is applied when drawing, so tiles are kept in the mapcache as they are
+#define TILE_ALPHA(vml) (255)
+#define DRAW_ALPHA(vml) ((vml)->alpha)
+#else
+#define TILE_ALPHA(vml) ((vml)->alpha)
+#define DRAW_ALPHA(vml) (255)
+#endif
+
 gboolean req_hash_remove_id  (gpointer key,
                               gpointer value,
                               gpointer user_data)
@@ -535,8 +636,11 @@ void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type)
   guint maptype = map_uniq_id_to_index ( map_type );
   if ( maptype == NUM_MAP_TYPES )
     g_warning ( _("%s: Unknown map type %d"), __FUNCTION__, map_type );
-  else
+  else {
     vml->maptype = maptype;
+    vik_tile_residency_clear ( vml->residency );
+    vml->tiles_scanned = FALSE;
+  }
 }
 
 /**
@@ -564,6 +668,8 @@ gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml)
 #define DIRECTDIRACCESS "%s%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRECTDIRACCESS_WITH_NAME "%s%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRSTRUCTURE "%st%ds%dz%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d"
+// Room for the tile part of a path after the cache directory (including any map name)
+#define TILE_PATH_EXTRA_LEN 80
 #define MAPS_CACHE_DIR maps_layer_default_dir()
 
 #ifdef WINDOWS
@@ -637,6 +743,8 @@ static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir )
   g_assert ( vml != NULL);
   g_free ( vml->cache_dir );
   vml->cache_dir = NULL;
+  vik_tile_residency_clear ( vml->residency );
+  vml->tiles_scanned = FALSE;
   const gchar *mydir = dir;
 
   if ( dir == NULL || dir[0] == '\0' )
@@ -662,6 +770,7 @@ static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir )
     }
 
     maps_layer_mkdir_if_default_dir ( vml );
+    a_tileindex_register ( vml->cache_dir );
   }
 }
 
@@ -740,6 +849,9 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
     case PARAM_CACHE_LAYOUT:
       if ( vlsp->data.u < VIK_MAPS_CACHE_LAYOUT_NUM )
         changed = vik_layer_param_change_uint ( vlsp->data, &vml->cache_layout );
+      if ( changed )
+        vik_tile_residency_clear ( vml->residency );
+        vml->tiles_scanned = FALSE;
       break;
     case PARAM_CACHE_EXPIRY_AGE:
       changed = vik_layer_param_change_uint ( vlsp->data, &vml->cache_expiry_age );
@@ -750,6 +862,9 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
       break;
     case PARAM_FILE:
       changed = vik_layer_param_change_string ( vlsp->data, &vml->filename );
+      if ( changed )
+        vik_tile_residency_clear ( vml->residency );
+        vml->tiles_scanned = FALSE;
       break;
     case PARAM_MAPTYPE: {
       guint old = vml->maptype;
@@ -758,6 +873,8 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
         g_warning ( _("%s: Unknown map type %d"), __FUNCTION__, vlsp->data.u );
       else {
         vml->maptype = maptype;
+        vik_tile_residency_clear ( vml->residency );
+        vml->tiles_scanned = FALSE;
 
         // When loading from a file don't need the license reminder - ensure it's saved into the 'seen' list
         if ( vlsp->is_file_operation ) {
@@ -924,6 +1041,8 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
   vik_layer_set_type ( VIK_LAYER(vml), VIK_LAYER_MAPS );
 
   vml->filename = NULL;
+  vml->residency = vik_tile_residency_new ();
+  vml->vp_scale = vvp ? vik_viewport_get_scale ( vvp ) : 1;
   vik_layer_set_defaults ( VIK_LAYER(vml), vvp );
 
   vml->dl_tool_x = vml->dl_tool_y = -1;
@@ -937,6 +1056,15 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
 
 static void maps_layer_free ( VikMapsLayer *vml )
 {
+  if ( vml->decode_ctx ) {
+    // Any outstanding background decodes can no longer refer to this layer
+    g_mutex_lock ( vml->decode_ctx->mutex );
+    vml->decode_ctx->vml = NULL;
+    g_mutex_unlock ( vml->decode_ctx->mutex );
+    decode_ctx_unref ( vml->decode_ctx );
+    vml->decode_ctx = NULL;
+  }
+
   g_free ( vml->cache_dir );
   vml->cache_dir = NULL;
   if ( vml->dl_right_click_menu )
@@ -945,11 +1073,16 @@ static void maps_layer_free ( VikMapsLayer *vml )
   vml->last_center = NULL;
   g_free ( vml->filename );
   vml->filename = NULL;
+  vik_tile_residency_free ( vml->residency );
+  vml->residency = NULL;
 
 #ifdef HAVE_SQLITE3_H
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
   if ( vik_map_source_is_mbtiles ( map ) ) {
     if ( vml->mbtiles ) {
+      if ( vml->mbtiles_stmt )
+        (void)sqlite3_finalize ( vml->mbtiles_stmt );
+      vml->mbtiles_stmt = NULL;
       int ans = sqlite3_close ( vml->mbtiles );
       if ( ans != SQLITE_OK ) {
         // Only to console for information purposes only
@@ -1143,6 +1276,15 @@ static const gchar* maps_layer_tooltip ( VikMapsLayer *vml )
   return vik_maps_layer_get_map_label ( vml );
 }
 
+/**
+ * The tiles of the map type held in the map cache
+ *  (shared with any other layer of the same type)
+ */
+static gsize maps_layer_get_memory_usage ( VikMapsLayer *vml )
+{
+  return a_mapcache_get_size_type ( vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) );
+}
+
 static void maps_layer_marshall( VikMapsLayer *vml, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vml), data, len );
@@ -1166,6 +1308,50 @@ static gboolean maps_layer_is_cached_storage ( VikMapSource *map )
              vik_map_source_is_osm_meta_tiles(map) );
 }
 
+/**
+ * The directory holding only this layer's map tiles, or NULL if there isn't one
+ *  (as only the OSM cache layout keeps each map type separate)
+ */
+static gchar *maps_layer_tile_dir ( VikMapsLayer *vml )
+{
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  if ( !vml->cache_dir || vml->cache_layout != VIK_MAPS_CACHE_LAYOUT_OSM || !maps_layer_is_cached_storage(map) )
+    return NULL;
+  // As get_filename()
+  const gchar *name = vik_map_source_get_name ( map );
+  if ( !name || g_strcmp0 ( vml->cache_dir, MAPS_CACHE_DIR ) )
+    return g_strdup ( vml->cache_dir );
+  return g_strconcat ( vml->cache_dir, name, G_DIR_SEPARATOR_S, NULL );
+}
+
+/**
+ * The maximum size in bytes of the disk cache for this map type, 0 for no limit
+ * Each map type can have its own value, otherwise the general one is used
+ */
+static guint64 maps_layer_cache_budget ( VikMapsLayer *vml )
+{
+  gint budget = CACHE_BUDGET;
+  gchar *key = g_strdup_printf ( "%s_%d", VIK_SETTINGS_MAP_CACHE_BUDGET, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) );
+  (void)a_settings_get_integer ( key, &budget );
+  g_free ( key );
+  return budget > 0 ? (guint64)budget * 1024 * 1024 : 0;
+}
+
+/**
+ * Occasionally ensure the disk cache stays within its budget
+ */
+static void maps_layer_cache_janitor ( VikMapsLayer *vml )
+{
+  guint64 budget = maps_layer_cache_budget ( vml );
+  if ( !budget )
+    return;
+  gchar *dir = maps_layer_tile_dir ( vml );
+  if ( dir ) {
+    a_cachejanitor_check ( dir, budget, (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), FALSE );
+    g_free ( dir );
+  }
+}
+
 /*********************/
 /****** DRAWING ******/
 /*********************/
@@ -1179,6 +1365,18 @@ static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdou
   return tmp;
 }
 
+/**
+ * Decode an image held in memory (e.g. the contents of a tile file)
+ */
+static GdkPixbuf *pixbuf_new_from_bytes ( GBytes *bytes, GError **error )
+{
+  GInputStream *stream = g_memory_input_stream_new_from_bytes ( bytes );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, error );
+  g_input_stream_close ( stream, NULL, NULL );
+  g_object_unref ( stream );
+  return pixbuf;
+}
+
 #ifdef HAVE_SQLITE3_H
 /*
 static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **col_names )
@@ -1192,73 +1390,131 @@ static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **
 }
 */
 
+#define MBTILES_TILE_STATEMENT "SELECT tile_data FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;"
+#define MBTILES_RANGE_STATEMENT "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level=?1 AND tile_column BETWEEN ?2 AND ?3 AND tile_row BETWEEN ?4 AND ?5;"
+
 /**
+ * Statements are prepared on first use and then kept,
+ *  since preparing a statement is much more expensive than running it.
  *
+ * Returns the statement ready to have its parameters bound, or NULL on failure
  */
-static GdkPixbuf *get_pixbuf_sql_exec ( sqlite3 *sql, gint xx, gint yy, gint zoom )
+static sqlite3_stmt *mbtiles_statement ( sqlite3 *sql, sqlite3_stmt **stmt, const gchar *statement )
 {
-  GdkPixbuf *pixbuf = NULL;
-
-  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
-  gint flip_y = (gint) pow(2, zoom)-1 - yy;
-  gchar *statement = g_strdup_printf ( "SELECT tile_data FROM tiles WHERE zoom_level=%d AND tile_column=%d AND tile_row=%d;", zoom, xx, flip_y );
-
-  gboolean finished = FALSE;
-
-  sqlite3_stmt *sql_stmt = NULL;
-  int ans = sqlite3_prepare_v2 ( sql, statement, -1, &sql_stmt, NULL );
+  if ( *stmt ) {
+    (void)sqlite3_reset ( *stmt );
+    (void)sqlite3_clear_bindings ( *stmt );
+    return *stmt;
+  }
+  int ans = sqlite3_prepare_v2 ( sql, statement, -1, stmt, NULL );
   if ( ans != SQLITE_OK ) {
     g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errstr(ans), statement );
-    finished = TRUE;
+    *stmt = NULL;
   }
+  return *stmt;
+}
 
-  while ( !finished ) {
-    ans = sqlite3_step ( sql_stmt );
-    switch (ans) {
-      case SQLITE_ROW: {
-        // Get tile_data blob
-        int count = sqlite3_column_count(sql_stmt);
-        if ( count != 1 )  {
-          g_warning ( "%s: %s - %d", __FUNCTION__, "count not one", count );
-          finished = TRUE;
-        }
-        else {
-          const void *data = sqlite3_column_blob ( sql_stmt, 0 );
-          int bytes = sqlite3_column_bytes ( sql_stmt, 0 );
-          if ( bytes < 1 )  {
-            g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
-            finished = TRUE;
-          }
-          else {
-            // Convert these blob bytes into a pixbuf via these streaming operations
-            GInputStream *stream = g_memory_input_stream_new_from_data ( data, bytes, NULL );
-            GError *error = NULL;
-            pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-            if ( error ) {
-              g_warning ( "%s: %s", __FUNCTION__, error->message );
-              g_error_free ( error );
-            }
-            g_input_stream_close ( stream, NULL, NULL );
-          }
-        }
-        break;
-      }
-      default:
-       // e.g. SQLITE_DONE | SQLITE_ERROR | SQLITE_MISUSE | etc...
-       // Finished normally
-       //  and give up on any errors
-       if ( ans != SQLITE_DONE )
-         g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
-       finished = TRUE;
-       break;
+/**
+ * Convert these blob bytes into a pixbuf via these streaming operations
+ */
+static GdkPixbuf *mbtiles_blob_to_pixbuf ( sqlite3_stmt *sql_stmt, int column )
+{
+  GdkPixbuf *pixbuf = NULL;
+  const void *data = sqlite3_column_blob ( sql_stmt, column );
+  int bytes = sqlite3_column_bytes ( sql_stmt, column );
+  if ( bytes < 1 )  {
+    g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
+  }
+  else {
+    GInputStream *stream = g_memory_input_stream_new_from_data ( data, bytes, NULL );
+    GError *error = NULL;
+    pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
+    if ( error ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
     }
+    g_input_stream_close ( stream, NULL, NULL );
+    g_object_unref ( stream );
   }
-  (void)sqlite3_finalize ( sql_stmt );
+  return pixbuf;
+}
+
+/**
+ * @stmt: Where the prepared statement for this connection is kept
+ */
+static GdkPixbuf *get_pixbuf_sql_exec ( sqlite3 *sql, sqlite3_stmt **stmt, gint xx, gint yy, gint zoom )
+{
+  GdkPixbuf *pixbuf = NULL;
+
+  sqlite3_stmt *sql_stmt = mbtiles_statement ( sql, stmt, MBTILES_TILE_STATEMENT );
+  if ( !sql_stmt )
+    return NULL;
+
+  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
+  gint flip_y = (gint) pow(2, zoom)-1 - yy;
+  (void)sqlite3_bind_int ( sql_stmt, 1, zoom );
+  (void)sqlite3_bind_int ( sql_stmt, 2, xx );
+  (void)sqlite3_bind_int ( sql_stmt, 3, flip_y );
 
-  g_free ( statement );
+  int ans = sqlite3_step ( sql_stmt );
+  if ( ans == SQLITE_ROW )
+    pixbuf = mbtiles_blob_to_pixbuf ( sql_stmt, 0 );
+  else if ( ans != SQLITE_DONE )
+    // e.g. SQLITE_ERROR | SQLITE_MISUSE | etc...
+    //  give up on any errors
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+
+  // Release any read lock now rather than on the next use
+  (void)sqlite3_reset ( sql_stmt );
 
   return pixbuf;
 }
+
+/**
+ * Each thread reading MBTiles files in the background uses its own read only connections,
+ *  (with their own prepared statements) so several tile reads can run at once.
+ */
+typedef struct {
+  sqlite3 *sql;
+  sqlite3_stmt *range_stmt;
+} MBTilesThreadHandle;
+
+static void mbtiles_thread_handle_free ( MBTilesThreadHandle *mth )
+{
+  if ( mth->range_stmt )
+    (void)sqlite3_finalize ( mth->range_stmt );
+  if ( mth->sql )
+    (void)sqlite3_close ( mth->sql );
+  g_free ( mth );
+}
+
+static GPrivate mbtiles_thread_handles = G_PRIVATE_INIT ( (GDestroyNotify)g_hash_table_destroy );
+
+/**
+ * Returns the connection for this file in the calling thread, opening it if necessary
+ */
+static MBTilesThreadHandle *mbtiles_thread_handle ( const gchar *filename )
+{
+  GHashTable *handles = g_private_get ( &mbtiles_thread_handles );
+  if ( !handles ) {
+    handles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)mbtiles_thread_handle_free );
+    g_private_set ( &mbtiles_thread_handles, handles );
+  }
+  MBTilesThreadHandle *mth = g_hash_table_lookup ( handles, filename );
+  if ( !mth ) {
+    sqlite3 *sql = NULL;
+    int ans = sqlite3_open_v2 ( filename, &sql, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL );
+    if ( ans != SQLITE_OK ) {
+      g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg ( sql ) );
+      (void)sqlite3_close ( sql );
+      return NULL;
+    }
+    mth = g_malloc0 ( sizeof(MBTilesThreadHandle) );
+    mth->sql = sql;
+    g_hash_table_insert ( handles, g_strdup(filename), mth );
+  }
+  return mth;
+}
 #endif
 
 static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint zoom )
@@ -1281,7 +1537,7 @@ static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint
 
     // Reading BLOBS is a bit more involved and so can't use the simpler sqlite3_exec ()
     // Hence this specific function
-    pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, xx, yy, zoom );
+    pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, &vml->mbtiles_stmt, xx, yy, zoom );
   }
 #endif
 
@@ -1290,72 +1546,78 @@ static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint
 
 static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy, gint zz )
 {
-  const int tile_max = METATILE_MAX_SIZE;
-  char err_msg[PATH_MAX];
-  char *buf;
-  int len;
-  int compressed;
-
-  buf = g_malloc(tile_max);
-  if (!buf) {
-      return NULL;
+  int compressed = 0;
+  GError *error = NULL;
+  GBytes *bytes = metatile_cache_read ( vml->cache_dir, xx, yy, zz, &compressed, &error );
+  if ( !bytes ) {
+    g_warning ( "FAILED:%s %s", __FUNCTION__, error ? error->message : "" );
+    g_clear_error ( &error );
+    return NULL;
   }
 
-  err_msg[0] = 0;
-  len = metatile_read(vml->cache_dir, xx, yy, zz, buf, tile_max, &compressed, err_msg);
-
-  if (len > 0) {
-    if (compressed) {
-      // Not handled yet - I don't think this is used often - so implement later if necessary
-      g_warning ( "Compressed metatiles not implemented:%s", __FUNCTION__);
-      g_free(buf);
-      return NULL;
-    }
-
-    // Convert these buf bytes into a pixbuf via these streaming operations
-    GdkPixbuf *pixbuf = NULL;
-
-    GInputStream *stream = g_memory_input_stream_new_from_data ( buf, len, NULL );
-    GError *error = NULL;
-    pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-    if (error) {
+  GdkPixbuf *pixbuf = NULL;
+  if ( compressed )
+    // Not handled yet - I don't think this is used often - so implement later if necessary
+    g_warning ( "Compressed metatiles not implemented:%s", __FUNCTION__);
+  else if ( g_bytes_get_size(bytes) > METATILE_MAX_SIZE )
+    g_warning ( "%s: tile too large %" G_GSIZE_FORMAT, __FUNCTION__, g_bytes_get_size(bytes) );
+  else {
+    pixbuf = pixbuf_new_from_bytes ( bytes, &error );
+    if ( error ) {
       g_warning ( "%s: %s", __FUNCTION__, error->message );
       g_error_free ( error );
     }
-    g_input_stream_close ( stream, NULL, NULL );
-
-    g_free(buf);
-    return pixbuf;
-  }
-  else {
-    g_free(buf);
-    g_warning ( "FAILED:%s %s", __FUNCTION__, err_msg);
-    return NULL;
   }
+  g_bytes_unref ( bytes );
+  return pixbuf;
 }
 
 /**
- * Caller has to decrease reference counter of returned
- * GdkPixbuf, when buffer is no longer needed.
+ * Whether the tile as decoded is what goes in the mapcache for full opacity and no shrinking,
+ *  and so other variants of it can be made from that entry
  */
-static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
-                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+/**
+ * The scale of the tiles as read from the map source, for the viewport scale
+ */
+static gdouble tile_source_scale ( VikMapSource *map, guint vp_scale )
 {
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-  // Apply alpha setting
-  if ( pixbuf && vml->alpha < 255 )
-    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
+  return vik_map_source_get_scale(map) * vik_map_source_get_tile_scale(map, vp_scale);
+}
+
+static gboolean tile_base_is_decoded ( VikMapSource *map, guint vp_scale )
+{
+  return vik_map_source_renders_tiles(map) || vp_scale == tile_source_scale(map, vp_scale);
+}
 
+/**
+ * Make the variant of the decoded tile for the settings and put it in the mapcache.
+ * NB @pixbuf is not altered (as it may be in the mapcache itself),
+ *  and the reference to it is passed on to the returned pixbuf.
+ */
+static GdkPixbuf *pixbuf_derive ( GdkPixbuf *pixbuf, VikMapSource *map, guint8 alpha, const gchar *name, guint vp_scale,
+                                  MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+{
   if ( pixbuf && ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) )
      pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
+  else if ( pixbuf && alpha < 255 ) {
+    GdkPixbuf *copy = gdk_pixbuf_copy ( pixbuf );
+    g_object_unref ( pixbuf );
+    pixbuf = copy;
+  }
+
+  // Apply alpha setting
+  if ( pixbuf && alpha < 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, alpha );
 
   // TODO reconsider combining with shrinkfactors above...
-  if ( pixbuf && ( vp_scale != 1 || vik_map_source_get_scale(map) != 1 ) ) {
+  // NB Tiles drawn by the map source are already at the viewport scale
+  const gdouble source_scale = tile_source_scale ( map, vp_scale );
+  if ( pixbuf && vp_scale != source_scale && !vik_map_source_renders_tiles(map) ) {
     gdouble xscale = vp_scale;
     gdouble yscale = vp_scale;
-    if ( vik_map_source_get_scale(map) != 0.0 ) {
-      xscale = vp_scale / vik_map_source_get_scale(map);
-      yscale = vp_scale / vik_map_source_get_scale(map);
+    if ( source_scale != 0.0 ) {
+      xscale = vp_scale / source_scale;
+      yscale = vp_scale / source_scale;
     }
     pixbuf = pixbuf_shrink ( pixbuf, xscale, yscale );
   }
@@ -1363,11 +1625,51 @@ static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml,
   if ( pixbuf )
     a_mapcache_add ( pixbuf, (mapcache_extra_t){0.0, status}, mapcoord->x, mapcoord->y,
                      mapcoord->z, vik_map_source_get_uniq_id(map),
-                     mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                     mapcoord->scale, alpha, xshrinkfactor, yshrinkfactor, name );
 
   return pixbuf;
 }
 
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ *
+ * NB Does not use the layer itself, so can be used from any thread.
+ */
+static GdkPixbuf *pixbuf_apply_settings_full ( GdkPixbuf *pixbuf, VikMapSource *map, guint8 alpha, const gchar *name, guint vp_scale,
+                                               MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+{
+  // Keep the decoded tile too, so other transparencies and shrinkings of it need not read it again
+  if ( pixbuf && ( alpha < 255 || xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) && tile_base_is_decoded(map, vp_scale) )
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){0.0, status}, mapcoord->x, mapcoord->y,
+                     mapcoord->z, vik_map_source_get_uniq_id(map),
+                     mapcoord->scale, 255, 1.0, 1.0, name );
+
+  return pixbuf_derive ( pixbuf, map, alpha, name, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
+}
+
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
+                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+{
+  return pixbuf_apply_settings_full ( pixbuf, MAPS_LAYER_NTH_TYPE(vml->maptype), TILE_ALPHA(vml), vml->filename,
+                                      vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
+}
+
+/**
+ * Choose the resolution of the map source's tiles to suit the viewport,
+ *  which for such map sources is given by the z value (instead of the default 0)
+ */
+static void maps_layer_set_tile_scale ( VikMapsLayer *vml, VikMapSource *map, MapCoord *mc )
+{
+  guint tile_scale = vik_map_source_get_tile_scale ( map, vml->vp_scale );
+  if ( tile_scale > 1 )
+    mc->z = tile_scale;
+}
+
 static void get_filename ( const gchar *cache_dir,
                            VikMapsCacheLayout cl,
                            guint16 id,
@@ -1382,6 +1684,11 @@ static void get_filename ( const gchar *cache_dir,
 {
   switch ( cl ) {
     case VIK_MAPS_CACHE_LAYOUT_OSM:
+    {
+      // Higher resolution tiles (see maps_layer_set_tile_scale()) are named as tile@2x.png etc.
+      gchar *extension = z > 1 ? g_strdup_printf ( "@%dx%s", z, file_extension ) : NULL;
+      if ( extension )
+        file_extension = extension;
       if ( name ) {
         if ( g_strcmp0 ( cache_dir, MAPS_CACHE_DIR ) )
           // Cache dir not the default - assume it's been directed somewhere specific
@@ -1392,7 +1699,19 @@ static void get_filename ( const gchar *cache_dir,
       }
       else
         g_snprintf ( filename_buf, buf_len, DIRECTDIRACCESS, cache_dir, (17 - scale), x, y, file_extension );
+      g_free ( extension );
+      break;
+    }
+    case VIK_MAPS_CACHE_LAYOUT_BUNDLE:
+    {
+      // Same directories as the OSM layout, but each holds bundle files rather than a directory per X
+      const gchar *subdir = ( name && !g_strcmp0 ( cache_dir, MAPS_CACHE_DIR ) ) ? name : NULL;
+      // Higher resolution tiles are kept in their own bundles
+      gchar *scaled = z > 1 ? g_strdup_printf ( "%s@%dx", subdir ? subdir : "", z ) : NULL;
+      a_tilebundle_member_name ( filename_buf, buf_len, cache_dir, scaled ? scaled : subdir, (17 - scale), x, y );
+      g_free ( scaled );
       break;
+    }
     default:
       g_snprintf ( filename_buf, buf_len, DIRSTRUCTURE, cache_dir, id, scale, z, x, y );
       break;
@@ -1400,92 +1719,650 @@ static void get_filename ( const gchar *cache_dir,
 }
 
 /**
- * Caller has to decrease reference counter of returned
- * GdkPixbuf, when buffer is no longer needed.
+ * Whether the tile is stored (as named by get_filename()), preferring the tile index for tile files
  */
-static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
-                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static gboolean tile_exists ( const gchar *filename, gint64 *mtime )
 {
-  GdkPixbuf *pixbuf;
-
-  /* get the thing */
-  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
-                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-
-  if ( ! pixbuf ) {
-    VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-    if ( vik_map_source_is_direct_file_access(map) ) {
-      // ATM MBTiles must be 'a direct access type'
-      if ( vik_map_source_is_mbtiles(map) ) {
-        pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
-        // return now to avoid file tests that aren't appropriate for this map type
-        return pixbuf;
-      }
-      else if ( vik_map_source_is_osm_meta_tiles(map) ) {
-        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
-        return pixbuf;
-      }
-      else
-        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
-                       mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                       vik_map_source_get_file_extension(map) );
-    }
-    else
-      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
-                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                     vik_map_source_get_file_extension(map) );
+  if ( a_tilebundle_is_member ( filename ) )
+    return a_tilebundle_lookup ( filename, mtime, NULL );
+  return a_tileindex_file_exists ( filename, mtime );
+}
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
-    {
-      GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
+/**
+ * Whether the tile is stored, checking the filesystem for tile files
+ */
+static gboolean tile_file_exists ( const gchar *filename )
+{
+  if ( a_tilebundle_is_member ( filename ) )
+    return a_tilebundle_lookup ( filename, NULL, NULL );
+  if ( g_file_test ( filename, G_FILE_TEST_EXISTS ) )
+    return TRUE;
+  // Perhaps not yet written
+  GBytes *fresh = a_download_get_fresh ( filename );
+  if ( fresh )
+    g_bytes_unref ( fresh );
+  return fresh != NULL;
+}
 
-      /* free the pixbuf on error */
-      if (gx)
-      {
-        if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
-          // Report a warning
-          if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
-            gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
-            vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
-            g_free (msg);
-          }
-        }
+/**
+ * Decode the tile file contents, or have the map source draw them for vector tiles
+ */
+static GdkPixbuf *tile_pixbuf_new_from_bytes ( VikMapSource *map, MapCoord *mapcoord, guint vp_scale, GBytes *bytes, GError **error )
+{
+  if ( vik_map_source_renders_tiles ( map ) )
+    return vik_map_source_render_tile ( map, bytes, mapcoord, vp_scale, error );
+  return pixbuf_new_from_bytes ( bytes, error );
+}
 
-        g_error_free ( gx );
-        if ( pixbuf )
-          g_object_unref ( G_OBJECT(pixbuf) );
-        pixbuf = NULL;
-      } else {
-        // Maintain any download result status value that is already in the mapcache
-        mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
-                                                        vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-        guint status = extra.status;
-        if ( extra.status >= DOWNLOAD_SUCCESS ) {
-          // On read in from file, check expiry value
-          GStatBuf buf;
-          if ( g_stat(filename_buf, &buf) == 0 ) {
-            status = DOWNLOAD_SUCCESS;
-            time_t file_time = buf.st_mtime;
-            if ( (time(NULL) - file_time) > vml->cache_expiry_age )
-              status = MAPCACHE_STATUS_FILE_EXPIRED;
-          }
-        }
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
-      }
-    }
+static GdkPixbuf *tile_pixbuf_new ( VikMapSource *map, MapCoord *mapcoord, const gchar *filename, GError **error )
+{
+  GBytes *bytes = NULL;
+  if ( a_tilebundle_is_member ( filename ) )
+    bytes = a_tilebundle_get ( filename, NULL );
+  else if ( vik_map_source_renders_tiles ( map ) ) {
+    gchar *contents = NULL;
+    gsize length = 0;
+    if ( g_file_get_contents ( filename, &contents, &length, error ) )
+      bytes = g_bytes_new_take ( contents, length );
   }
+  else
+    return gdk_pixbuf_new_from_file ( filename, error );
+
+  if ( !bytes )
+    return NULL;
+  GdkPixbuf *pixbuf = tile_pixbuf_new_from_bytes ( map, mapcoord, 1, bytes, error );
+  g_bytes_unref ( bytes );
   return pixbuf;
 }
 
-static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
+/**
+ * Returns FALSE if a tile file couldn't be removed
+ */
+static gboolean tile_remove ( const gchar *filename )
 {
-  const VikCoord *center = vik_viewport_get_center ( vvp );
+  if ( a_tilebundle_is_member ( filename ) ) {
+    a_tilebundle_remove ( filename );
+    return TRUE;
+  }
+  a_tileindex_remove ( filename );
+  return g_remove ( filename ) == 0;
+}
 
-  if (vik_window_get_pan_move (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vvp)))))
-    /* D'n'D pan in action: do not download */
+/**
+ * Everything needed to read a tile file and put the result into the mapcache,
+ *  without reference to the layer (which may disappear whilst decoding in the background)
+ */
+typedef struct {
+  VikMapSource *map;
+  guint16 id;
+  guint8 alpha;
+  guint cache_expiry_age;
+  const gchar *name;     // Layer name for mapcache keys (may be NULL)
+  const gchar *filename; // Tile file
+  guint vp_scale;
+  MapCoord mapcoord;
+  gdouble xshrinkfactor;
+  gdouble yshrinkfactor;
+} TileFileInfo;
+
+/**
+ * Read and decode a tile file (or its original data held in the mapcache), apply the layer settings
+ *  and add the result to the mapcache.
+ *
+ * Returns the pixbuf, which may be NULL if the file doesn't exist or on error
+ *  (in which case @error is set).
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *tile_file_decode ( TileFileInfo *tfi, GError **error )
+{
+  GdkPixbuf *pixbuf = NULL;
+  GError *gx = NULL;
+  gboolean have_file = FALSE;
+  time_t file_time = 0;
+  gboolean have_file_time = FALSE;
+  MapCoord *mapcoord = &tfi->mapcoord;
+  gint64 start = g_get_monotonic_time ();
+
+  // Try the original file data held in memory, otherwise read the file
+  GBytes *bytes = a_mapcache_encoded_get ( mapcoord->x, mapcoord->y, mapcoord->z, tfi->id, mapcoord->scale, tfi->name, &file_time );
+  if ( bytes ) {
+    have_file = TRUE;
+    have_file_time = TRUE;
+    pixbuf = tile_pixbuf_new_from_bytes ( tfi->map, mapcoord, tfi->vp_scale, bytes, &gx );
+    g_bytes_unref ( bytes );
+  }
+  // Or just downloaded, so there's no need to wait for it to be written
+  else if ( (bytes = a_download_get_fresh ( tfi->filename )) ) {
+    have_file = TRUE;
+    file_time = time ( NULL );
+    have_file_time = TRUE;
+    pixbuf = tile_pixbuf_new_from_bytes ( tfi->map, mapcoord, tfi->vp_scale, bytes, &gx );
+    if ( !gx && a_mapcache_encoded_enabled() )
+      a_mapcache_encoded_add ( bytes, file_time, mapcoord->x, mapcoord->y, mapcoord->z, tfi->id, mapcoord->scale, tfi->name );
+    g_bytes_unref ( bytes );
+  }
+  else if ( a_tilebundle_is_member ( tfi->filename ) ) {
+    gint64 mtime = 0;
+    bytes = a_tilebundle_get ( tfi->filename, &mtime );
+    if ( bytes ) {
+      have_file = TRUE;
+      file_time = mtime;
+      have_file_time = TRUE;
+      pixbuf = tile_pixbuf_new_from_bytes ( tfi->map, mapcoord, tfi->vp_scale, bytes, &gx );
+      if ( !gx && a_mapcache_encoded_enabled() )
+        a_mapcache_encoded_add ( bytes, file_time, mapcoord->x, mapcoord->y, mapcoord->z, tfi->id, mapcoord->scale, tfi->name );
+      g_bytes_unref ( bytes );
+    }
+  }
+  else if ( g_file_test ( tfi->filename, G_FILE_TEST_EXISTS ) == TRUE ) {
+    have_file = TRUE;
+    if ( a_mapcache_encoded_enabled() || vik_map_source_renders_tiles(tfi->map) ) {
+      gchar *contents = NULL;
+      gsize length = 0;
+      if ( g_file_get_contents ( tfi->filename, &contents, &length, &gx ) ) {
+        GStatBuf buf;
+        if ( g_stat(tfi->filename, &buf) == 0 ) {
+          file_time = buf.st_mtime;
+          have_file_time = TRUE;
+        }
+        bytes = g_bytes_new_take ( contents, length );
+        pixbuf = tile_pixbuf_new_from_bytes ( tfi->map, mapcoord, tfi->vp_scale, bytes, &gx );
+        if ( !gx && a_mapcache_encoded_enabled() )
+          a_mapcache_encoded_add ( bytes, file_time, mapcoord->x, mapcoord->y, mapcoord->z, tfi->id, mapcoord->scale, tfi->name );
+        g_bytes_unref ( bytes );
+      }
+    }
+    else
+      pixbuf = gdk_pixbuf_new_from_file ( tfi->filename, &gx );
+  }
+  else
+    a_tileindex_remove ( tfi->filename );
+
+  if ( !have_file )
+    return NULL;
+  // Includes reading the file, which is often from the disk cache
+  a_perfstats_time ( "decode", vik_map_source_get_label(tfi->map), g_get_monotonic_time() - start );
+  a_tracelog_complete ( "tile", vik_map_source_get_label(tfi->map), start,
+                        g_strdup_printf ( "\"decode\": 1, \"z\": %d, \"x\": %d, \"y\": %d", 17 - mapcoord->scale, mapcoord->x, mapcoord->y ) );
+
+  /* free the pixbuf on error */
+  if ( gx ) {
+    g_propagate_error ( error, gx );
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    return NULL;
+  }
+
+  // Maintain any download result status value that is already in the mapcache
+  mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, tfi->id, mapcoord->scale,
+                                                  tfi->alpha, tfi->xshrinkfactor, tfi->yshrinkfactor, tfi->name );
+  guint status = extra.status;
+  if ( extra.status >= DOWNLOAD_SUCCESS ) {
+    // On read in from file, check expiry value
+    if ( !have_file_time ) {
+      GStatBuf buf;
+      if ( g_stat(tfi->filename, &buf) == 0 ) {
+        file_time = buf.st_mtime;
+        have_file_time = TRUE;
+      }
+    }
+    if ( have_file_time ) {
+      status = DOWNLOAD_SUCCESS;
+      if ( (time(NULL) - file_time) > tfi->cache_expiry_age )
+        status = MAPCACHE_STATUS_FILE_EXPIRED;
+    }
+  }
+  return pixbuf_apply_settings_full ( pixbuf, tfi->map, tfi->alpha, tfi->name, tfi->vp_scale, mapcoord,
+                                      tfi->xshrinkfactor, tfi->yshrinkfactor, status );
+}
+
+static MapsDecodeContext *decode_ctx_ref ( MapsDecodeContext *ctx )
+{
+  g_atomic_int_inc ( &ctx->ref_count );
+  return ctx;
+}
+
+static void decode_ctx_unref ( MapsDecodeContext *ctx )
+{
+  if ( g_atomic_int_dec_and_test ( &ctx->ref_count ) ) {
+    vik_mutex_free ( ctx->mutex );
+    g_free ( ctx );
+  }
+}
+
+/**
+ * Returns: The layer's context (made when first needed), referenced for the caller
+ */
+static MapsDecodeContext *maps_layer_decode_ctx ( VikMapsLayer *vml )
+{
+  if ( !vml->decode_ctx ) {
+    vml->decode_ctx = g_malloc0 ( sizeof(MapsDecodeContext) );
+    vml->decode_ctx->mutex = vik_mutex_new ();
+    vml->decode_ctx->ref_count = 1;
+    vml->decode_ctx->vml = vml;
+  }
+  return decode_ctx_ref ( vml->decode_ctx );
+}
+
+static void tile_waiters_free ( GSList *waiters )
+{
+  g_slist_free_full ( waiters, (GDestroyNotify)decode_ctx_unref );
+}
+
+/**
+ * Another layer wants the tile of the request that is already under way,
+ *  so have it redrawn when the tile is ready rather than getting it again.
+ * The table's mutex must be held.
+ */
+static void tile_waiters_add ( GHashTable *table, const gchar *request, MapsDecodeContext *ctx )
+{
+  gpointer key, value;
+  if ( !g_hash_table_lookup_extended ( table, request, &key, &value ) )
+    return;
+  GSList *waiters = value;
+  if ( g_slist_find ( waiters, ctx ) )
+    return;
+  // Keep the key, so as not to free the list it is replacing
+  (void)g_hash_table_steal ( table, key );
+  g_hash_table_insert ( table, key, g_slist_prepend ( waiters, decode_ctx_ref(ctx) ) );
+}
+
+/**
+ * Remove the request, giving its waiting contexts to the caller.
+ * The table's mutex must be held.
+ */
+static GSList *tile_request_take ( GHashTable *table, const gchar *request )
+{
+  gpointer key, value;
+  if ( !g_hash_table_lookup_extended ( table, request, &key, &value ) )
+    return NULL;
+  (void)g_hash_table_steal ( table, key );
+  g_free ( key );
+  return value;
+}
+
+static gboolean decode_update_idle ( MapsDecodeContext *ctx );
+
+/**
+ * Have the layer redrawn soon, combined with any redraw already asked for.
+ * Can be called from any thread.
+ */
+static void decode_ctx_update ( MapsDecodeContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  if ( ctx->vml && !ctx->update_pending ) {
+    ctx->update_pending = TRUE;
+    (void)gdk_threads_add_idle ( (GSourceFunc)decode_update_idle, decode_ctx_ref(ctx) );
+  }
+  g_mutex_unlock ( ctx->mutex );
+}
+
+static void tile_waiters_update ( GSList *waiters )
+{
+  for ( GSList *iter = waiters; iter; iter = iter->next )
+    decode_ctx_update ( iter->data );
+  tile_waiters_free ( waiters );
+}
+
+typedef struct {
+  MapsDecodeContext *ctx;
+  TileFileInfo tfi;
+  gchar *name;
+  gchar *filename;
+  gchar *request;
+  gboolean mbtiles_range; // Read tfi.mapcoord x,y up to xmax,ymax from the MBTiles file tfi.name
+  gint xmax;
+  gint ymax;
+} TileDecodeJob;
+
+static void tile_decode_job_free ( TileDecodeJob *job )
+{
+  g_free ( job->name );
+  g_free ( job->filename );
+  g_free ( job->request );
+  decode_ctx_unref ( job->ctx );
+  g_free ( job );
+}
+
+// In main thread
+static gboolean decode_update_idle ( MapsDecodeContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  ctx->update_pending = FALSE;
+  VikMapsLayer *vml = ctx->vml;
+  if ( vml )
+    g_object_ref ( vml );
+  g_mutex_unlock ( ctx->mutex );
+
+  if ( vml ) {
+    vik_layer_emit_update ( VIK_LAYER(vml), FALSE );
+    g_object_unref ( vml );
+  }
+  decode_ctx_unref ( ctx );
+  return FALSE;
+}
+
+#ifdef HAVE_SQLITE3_H
+/**
+ * Reads all the tiles in the range with a single query,
+ *  and records the ones that don't exist so they aren't asked for again.
+ *
+ * Returns whether any tiles were added to the mapcache
+ */
+static gboolean mbtiles_range_read ( TileDecodeJob *job )
+{
+  TileFileInfo *tfi = &job->tfi;
+  MBTilesThreadHandle *mth = mbtiles_thread_handle ( tfi->name );
+  if ( !mth )
+    return FALSE;
+  sqlite3_stmt *sql_stmt = mbtiles_statement ( mth->sql, &mth->range_stmt, MBTILES_RANGE_STATEMENT );
+  if ( !sql_stmt )
+    return FALSE;
+
+  gboolean added = FALSE;
+  const gint xmin = tfi->mapcoord.x;
+  const gint ymin = tfi->mapcoord.y;
+  const gint width = job->xmax - xmin + 1;
+  const gint height = job->ymax - ymin + 1;
+  const gint zoom = 17 - tfi->mapcoord.scale;
+  const gint max_y = (gint) pow(2, zoom)-1;
+  gboolean *found = g_malloc0_n ( width * height, sizeof(gboolean) );
+
+  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
+  (void)sqlite3_bind_int ( sql_stmt, 1, zoom );
+  (void)sqlite3_bind_int ( sql_stmt, 2, xmin );
+  (void)sqlite3_bind_int ( sql_stmt, 3, job->xmax );
+  (void)sqlite3_bind_int ( sql_stmt, 4, max_y - job->ymax );
+  (void)sqlite3_bind_int ( sql_stmt, 5, max_y - ymin );
+
+  int ans;
+  while ( (ans = sqlite3_step ( sql_stmt )) == SQLITE_ROW ) {
+    MapCoord mc = tfi->mapcoord;
+    mc.x = sqlite3_column_int ( sql_stmt, 0 );
+    mc.y = max_y - sqlite3_column_int ( sql_stmt, 1 );
+    if ( mc.x < xmin || mc.x > job->xmax || mc.y < ymin || mc.y > job->ymax )
+      continue;
+    found[(mc.y - ymin) * width + (mc.x - xmin)] = TRUE;
+    mapcache_extra_t extra = a_mapcache_get_extra ( mc.x, mc.y, mc.z, tfi->id, mc.scale, tfi->alpha,
+                                                    tfi->xshrinkfactor, tfi->yshrinkfactor, tfi->name );
+    if ( extra.status != MAPCACHE_STATUS_NOT_IN_CACHE )
+      continue;
+    GdkPixbuf *pixbuf = mbtiles_blob_to_pixbuf ( sql_stmt, 2 );
+    pixbuf = pixbuf_apply_settings_full ( pixbuf, tfi->map, tfi->alpha, tfi->name, tfi->vp_scale, &mc,
+                                          tfi->xshrinkfactor, tfi->yshrinkfactor, DOWNLOAD_SUCCESS );
+    if ( pixbuf ) {
+      g_object_unref ( pixbuf );
+      added = TRUE;
+    }
+  }
+  if ( ans != SQLITE_DONE )
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+  (void)sqlite3_reset ( sql_stmt );
+
+  // Mark the missing ones
+  if ( ans == SQLITE_DONE ) {
+    for ( gint yy = 0; yy < height; yy++ )
+      for ( gint xx = 0; xx < width; xx++ )
+        if ( !found[yy * width + xx] )
+          a_mapcache_add ( NULL, (mapcache_extra_t){0.0, MAPCACHE_STATUS_NO_TILE}, xmin + xx, ymin + yy, tfi->mapcoord.z, tfi->id,
+                           tfi->mapcoord.scale, tfi->alpha, tfi->xshrinkfactor, tfi->yshrinkfactor, tfi->name );
+  }
+  g_free ( found );
+  return added;
+}
+#endif
+
+/**
+ * Runs in the decode thread pool
+ */
+static void tile_decode_thread ( TileDecodeJob *job, gpointer user_data )
+{
+  gboolean added = FALSE;
+#ifdef HAVE_SQLITE3_H
+  if ( job->mbtiles_range )
+    added = mbtiles_range_read ( job );
+  else
+#endif
+  {
+    GError *error = NULL;
+    GdkPixbuf *pixbuf = tile_file_decode ( &job->tfi, &error );
+    if ( error ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    if ( pixbuf ) {
+      g_object_unref ( pixbuf );
+      added = TRUE;
+    }
+  }
+
+  // Remove the request only after the result is in the mapcache, so it won't be decoded again
+  g_mutex_lock ( decode_mutex );
+  GSList *waiters = tile_request_take ( decode_requests, job->request );
+  g_mutex_unlock ( decode_mutex );
+
+  if ( added ) {
+    // Coalesce redraws - many tiles may finish in quick succession
+    decode_ctx_update ( job->ctx );
+    tile_waiters_update ( waiters );
+  }
+  else
+    tile_waiters_free ( waiters );
+
+  tile_decode_job_free ( job );
+}
+
+/**
+ * Returns a new job for the request,
+ *  or NULL if the same request is already waiting
+ *
+ * The request string is owned by the job
+ */
+static TileDecodeJob *tile_decode_job_new ( VikMapsLayer *vml, gchar *request )
+{
+  MapsDecodeContext *ctx = maps_layer_decode_ctx ( vml );
+  g_mutex_lock ( decode_mutex );
+  if ( g_hash_table_contains ( decode_requests, request ) ) {
+    // Such as another layer of the same map source - so just redraw this one too
+    tile_waiters_add ( decode_requests, request, ctx );
+    g_mutex_unlock ( decode_mutex );
+    decode_ctx_unref ( ctx );
+    g_free ( request );
+    return NULL;
+  }
+  g_hash_table_insert ( decode_requests, g_strdup(request), NULL );
+
+  if ( !decode_pool ) {
+    gint threads = g_get_num_processors();
+    gint gitmp = 0;
+    if ( a_settings_get_integer ( VIK_SETTINGS_MAP_DECODE_THREADS, &gitmp ) && gitmp > 0 )
+      threads = gitmp;
+    decode_pool = g_thread_pool_new ( (GFunc)tile_decode_thread, NULL, threads, FALSE, NULL );
+  }
+  g_mutex_unlock ( decode_mutex );
+
+  TileDecodeJob *job = g_malloc0 ( sizeof(TileDecodeJob) );
+  job->ctx = ctx;
+  job->request = request;
+  return job;
+}
+
+/**
+ * Queue the tile file to be decoded in the background,
+ *  unless it is already waiting to be decoded
+ */
+static void tile_decode_queue ( VikMapsLayer *vml, TileFileInfo *tfi )
+{
+  if ( !decode_mutex )
+    return;
+
+  gchar *request = g_strdup_printf ( "%d-%d-%d-%d-%d-%u-%d-%.3f-%.3f", tfi->id, tfi->mapcoord.x, tfi->mapcoord.y, tfi->mapcoord.z, tfi->mapcoord.scale,
+                                     tfi->name ? g_str_hash(tfi->name) : 0, tfi->alpha, tfi->xshrinkfactor, tfi->yshrinkfactor );
+  TileDecodeJob *job = tile_decode_job_new ( vml, request );
+  if ( !job )
+    return;
+
+  job->tfi = *tfi;
+  job->name = g_strdup ( tfi->name );
+  job->filename = g_strdup ( tfi->filename );
+  job->tfi.name = job->name;
+  job->tfi.filename = job->filename;
+
+  g_thread_pool_push ( decode_pool, job, NULL );
+}
+
+#ifdef HAVE_SQLITE3_H
+/**
+ * Queue reading a block of tiles from the MBTiles file in the background
+ *
+ * @ulm: The top left tile
+ * @xmax: The rightmost tile column
+ * @ymax: The bottom tile row
+ */
+static void mbtiles_range_queue ( VikMapsLayer *vml, MapCoord *ulm, gint xmax, gint ymax, guint vp_scale, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  if ( !decode_mutex || !vml->filename )
+    return;
+
+  gchar *request = g_strdup_printf ( "mbt-%u-%d-%d-%d-%d-%d-%d-%.3f-%.3f", g_str_hash(vml->filename), ulm->x, ulm->y, xmax, ymax, ulm->scale,
+                                     TILE_ALPHA(vml), xshrinkfactor, yshrinkfactor );
+  TileDecodeJob *job = tile_decode_job_new ( vml, request );
+  if ( !job )
+    return;
+
+  job->mbtiles_range = TRUE;
+  job->name = g_strdup ( vml->filename );
+  job->tfi.map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  job->tfi.id = vik_map_source_get_uniq_id ( job->tfi.map );
+  job->tfi.alpha = TILE_ALPHA(vml);
+  job->tfi.name = job->name;
+  job->tfi.vp_scale = vp_scale;
+  job->tfi.mapcoord = *ulm;
+  job->tfi.xshrinkfactor = xshrinkfactor;
+  job->tfi.yshrinkfactor = yshrinkfactor;
+  job->xmax = xmax;
+  job->ymax = ymax;
+
+  g_thread_pool_push ( decode_pool, job, NULL );
+}
+
+/**
+ * Queue reading of the tile range if any of it is not yet known to the mapcache
+ */
+static void mbtiles_queue_missing ( VikMapsLayer *vml, MapCoord *mc, gint xmin, gint xmax, gint ymin, gint ymax,
+                                    guint vp_scale, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  const guint16 id = vik_map_source_get_uniq_id ( MAPS_LAYER_NTH_TYPE(vml->maptype) );
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      mapcache_extra_t extra = a_mapcache_get_extra ( x, y, mc->z, id, mc->scale, TILE_ALPHA(vml), xshrinkfactor, yshrinkfactor, vml->filename );
+      if ( extra.status == MAPCACHE_STATUS_NOT_IN_CACHE ) {
+        MapCoord ulm = *mc;
+        ulm.x = xmin;
+        ulm.y = ymin;
+        mbtiles_range_queue ( vml, &ulm, xmax, ymax, vp_scale, xshrinkfactor, yshrinkfactor );
+        return;
+      }
+    }
+  }
+}
+#endif
+
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ *
+ * @mode: Controls how tile files are read when not already in the mapcache.
+ *   With the background modes, NULL is returned if the tile is not yet in the mapcache.
+ */
+static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor, GetPixbufMode mode )
+{
+  GdkPixbuf *pixbuf;
+
+  /* get the thing */
+  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                            id, mapcoord->scale, TILE_ALPHA(vml), xshrinkfactor, yshrinkfactor, vml->filename );
+
+  // Otherwise make it from the decoded tile if that is in memory
+  if ( ! pixbuf && ( TILE_ALPHA(vml) < 255 || xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) &&
+       tile_base_is_decoded ( MAPS_LAYER_NTH_TYPE(vml->maptype), vp_scale ) ) {
+    GdkPixbuf *base = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                       id, mapcoord->scale, 255, 1.0, 1.0, vml->filename );
+    if ( base ) {
+      mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                                      id, mapcoord->scale, 255, 1.0, 1.0, vml->filename );
+      pixbuf = pixbuf_derive ( base, MAPS_LAYER_NTH_TYPE(vml->maptype), TILE_ALPHA(vml), vml->filename, vp_scale,
+                               mapcoord, xshrinkfactor, yshrinkfactor, extra.status );
+    }
+  }
+
+  if ( pixbuf )
+    vik_tile_residency_set ( vml->residency, mapcoord, VIK_TILE_PRESENT );
+
+  if ( ! pixbuf && mode != GET_PIXBUF_CACHE_ONLY ) {
+    VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+    if ( vik_map_source_is_direct_file_access(map) ) {
+      // ATM MBTiles must be 'a direct access type'
+      if ( vik_map_source_is_mbtiles(map) ) {
+        pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+        // return now to avoid file tests that aren't appropriate for this map type
+        return pixbuf;
+      }
+      else if ( vik_map_source_is_osm_meta_tiles(map) ) {
+        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+        return pixbuf;
+      }
+      else
+        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
+                       mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
+                       vik_map_source_get_file_extension(map) );
+    }
+    else
+      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
+                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
+                     vik_map_source_get_file_extension(map) );
+
+    TileFileInfo tfi = { map, id, TILE_ALPHA(vml), vml->cache_expiry_age, vml->filename, filename_buf,
+                         vp_scale, *mapcoord, xshrinkfactor, yshrinkfactor };
+
+    if ( mode == GET_PIXBUF_QUEUE ) {
+      // Only queue what can actually be read
+      gboolean exists = tile_file_exists ( filename_buf );
+      if ( exists )
+        tile_decode_queue ( vml, &tfi );
+      vik_tile_residency_set ( vml->residency, mapcoord, exists ? VIK_TILE_PRESENT : VIK_TILE_ABSENT );
+      return NULL;
+    }
+
+    GError *gx = NULL;
+    pixbuf = tile_file_decode ( &tfi, &gx );
+    if ( pixbuf || !gx )
+      vik_tile_residency_set ( vml->residency, mapcoord, pixbuf ? VIK_TILE_PRESENT : VIK_TILE_ABSENT );
+    if ( gx ) {
+      if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
+        // Report a warning
+        if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
+          gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
+          vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
+          g_free (msg);
+        }
+      }
+      g_error_free ( gx );
+    }
+  }
+  return pixbuf;
+}
+
+static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
+{
+  const VikCoord *center = vik_viewport_get_center ( vvp );
+
+  if (vik_window_get_pan_move (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vvp)))))
+    /* D'n'D pan in action: do not download */
     return FALSE;
 
   // Don't attempt to download unsupported zoom levels
@@ -1520,10 +2397,13 @@ static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
  *
  */
 gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                              gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+                              gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y,
+                              GetPixbufMode mode)
 {
   GdkPixbuf *pixbuf;
   int scale_inc;
+  // When only drawing what's in memory, get the nearest tile that is available ready for next time
+  guint best = mode == GET_PIXBUF_CACHE_ONLY ? vik_tile_residency_best_ancestor ( vml->residency, &ulm, SCALE_INC_DOWN ) : 0;
   for (scale_inc = 1; scale_inc <= SCALE_INC_DOWN; scale_inc++) {
     // Try with smaller zooms
     int scale_factor = 1 << scale_inc;  /*  2^scale_inc */
@@ -1531,7 +2411,11 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
     ulm2.x = ulm.x / scale_factor;
     ulm2.y = ulm.y / scale_factor;
     ulm2.scale = ulm.scale + scale_inc;
-    pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+    // Don't look again for tiles known to be missing
+    if ( vik_tile_residency_get ( vml->residency, &ulm2 ) == VIK_TILE_ABSENT )
+      continue;
+    GetPixbufMode mode2 = ( scale_inc == best ) ? GET_PIXBUF_QUEUE : mode;
+    pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor, mode2 );
     if ( pixbuf ) {
       gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
       gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -1546,7 +2430,7 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
       gdk_pixbuf_copy_area ( pixbuf, src_x, src_y, tilesize_x_ceil, tilesize_y_ceil, pixbuf2, 0, 0 );
       g_object_unref(pixbuf);
 #endif
-      vik_viewport_draw_pixbuf ( vvp, pixbuf2, src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
+      vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf2, DRAW_ALPHA(vml), src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
       g_object_unref(pixbuf2);
       return TRUE;
     }
@@ -1558,7 +2442,8 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
  *
  */
 gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                            gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+                            gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y,
+                            GetPixbufMode mode)
 {
   GdkPixbuf *pixbuf;
   gboolean ans = FALSE;
@@ -1576,13 +2461,15 @@ gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale,
         MapCoord ulm3 = ulm2;
         ulm3.x += pict_x;
         ulm3.y += pict_y;
-        pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
+        if ( vik_tile_residency_get ( vml->residency, &ulm3 ) == VIK_TILE_ABSENT )
+          continue;
+        pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor, mode );
         if ( pixbuf ) {
           gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
           gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
           gint xa = off_x / scale_factor;
           gint ya = off_y / scale_factor;
-          vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, dest_x+xa, dest_y+ya, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
+          vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, DRAW_ALPHA(vml), 0, 0, dest_x+xa, dest_y+ya, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
           g_object_unref(pixbuf);
           ans = TRUE;
         }
@@ -1625,8 +2512,11 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
   /* coord -> ID */
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  vml->vp_scale = vik_viewport_get_scale ( vvp );
   if ( vik_map_source_coord_to_mapcoord ( map, ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, br, xzoom, yzoom, &brm ) ) {
+    maps_layer_set_tile_scale ( vml, map, &ulm );
+    maps_layer_set_tile_scale ( vml, map, &brm );
 
     /* loop & draw */
     gint x, y;
@@ -1648,19 +2538,32 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
       existence_only = TRUE;
     }
 
-    guint max_path_len = strlen(vml->cache_dir) + 40;
+    guint max_path_len = strlen(vml->cache_dir) + TILE_PATH_EXTRA_LEN;
     gchar *path_buf = g_malloc ( max_path_len * sizeof(char) );
 
     guint vp_scale = vik_viewport_get_scale ( vvp );
 
+    // Tile files are decoded in the background (rather than stalling the drawing),
+    //  meanwhile draw whatever other scales are already in the mapcache.
+    // NB ATM metatiles are always read directly
+    gboolean async = ASYNC_DECODE && !vik_map_source_is_osm_meta_tiles(map);
+    const gboolean mbtiles = vik_map_source_is_mbtiles(map);
+    if ( mbtiles ) {
+#ifdef HAVE_SQLITE3_H
+      // MBTiles are read a viewport at a time, straight into the mapcache
+      async = async && vml->mbtiles;
+      if ( async && !existence_only )
+        mbtiles_queue_missing ( vml, &ulm, xmin, xmax, ymin, ymax, vp_scale, xshrinkfactor, yshrinkfactor );
+#else
+      async = FALSE;
+#endif
+    }
+    const GetPixbufMode mode = async ? (mbtiles ? GET_PIXBUF_CACHE_ONLY : GET_PIXBUF_QUEUE) : GET_PIXBUF_SYNC;
+    const GetPixbufMode fallback_mode = async ? GET_PIXBUF_CACHE_ONLY : GET_PIXBUF_SYNC;
+
     if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
       g_debug("%s: Starting autodownload", __FUNCTION__);
-      if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
-        // Try to download newer tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW );
-      else
-        // Download only missing tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE );
+      start_autodownload ( vml, vvp, ul, br, &ulm, xmin, xmax, ymin, ymax );
     }
 
     // Get drawing offset (ATM a single value that applies to all zoom levels)
@@ -1673,7 +2576,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor, mode );
           if ( pixbuf ) {
             width = gdk_pixbuf_get_width ( pixbuf );
             height = gdk_pixbuf_get_height ( pixbuf );
@@ -1683,7 +2586,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
             xx -= (width/2);
             yy -= (height/2);
 
-            vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx+xa, yy+ya, width, height );
+            vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, DRAW_ALPHA(vml), 0, 0, xx+xa, yy+ya, width, height );
             g_object_unref(pixbuf);
           }
         }
@@ -1723,30 +2626,30 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
               get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
                              ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
 
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            if ( tile_file_exists ( path_buf ) ) {
 	      GdkGC *black_gc = vik_viewport_get_black_gc(vvp);
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil, &black_color, 1 );
             }
           } else {
             // Try correct scale first
             int scale_factor = 1;
-            pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+            pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor, mode );
             if ( pixbuf ) {
               gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
               gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
-              vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
+              vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, DRAW_ALPHA(vml), src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
               g_object_unref(pixbuf);
             }
             else {
               // Otherwise try different scales
               if ( SCALE_SMALLER_ZOOM_FIRST ) {
-                if ( !try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, fallback_mode) ) {
+                  try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, fallback_mode);
                 }
               }
               else {
-                if ( !try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, fallback_mode) ) {
+                  try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, fallback_mode);
                 }
               }
             }
@@ -1772,7 +2675,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
           for ( y = ((yinc == 1) ? ymin : ymax); y != yend; y+=yinc ) {
 
             GdkColor *status_color;
-            mapcache_extra_t extra = a_mapcache_get_extra ( x, y, ulm.z, id, ulm.scale, vml->alpha, 1.0, 1.0, vml->filename );
+            mapcache_extra_t extra = a_mapcache_get_extra ( x, y, ulm.z, id, ulm.scale, TILE_ALPHA(vml), 1.0, 1.0, vml->filename );
             switch ( extra.status ) {
             case MAPCACHE_STATUS_NOT_IN_CACHE: status_color = &cache_no_file_color; break;
             case MAPCACHE_STATUS_FILE_EXPIRED: status_color = &cache_expired_color; break;
@@ -1831,6 +2734,15 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
   {
     VikCoord ul, br;
 
+    // Learn what is in the cache in the background, for later counting of missing tiles
+    if ( !vml->tiles_scanned ) {
+      vml->tiles_scanned = TRUE;
+      gchar *tile_dir = maps_layer_tile_dir ( vml );
+      if ( tile_dir )
+        a_tileindex_scan ( tile_dir );
+      g_free ( tile_dir );
+    }
+
     /* Copyright */
     gdouble level = vik_viewport_get_zoom ( vvp );
     LatLonBBox bbox = vik_viewport_get_bbox ( vvp );
@@ -1857,6 +2769,8 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
 
       maps_layer_draw_section ( vml, vvp, &ul, &br );
     }
+
+    maps_layer_cache_janitor ( vml );
   }
 }
 
@@ -1880,11 +2794,27 @@ typedef struct {
   VikViewport *vvp;
   gboolean map_layer_alive;
   GMutex *mutex;
+  GHashTable *tiles; // When set, only these tiles (see TILE_KEY) within the area are wanted
+  MapsDecodeContext *ctx; // Of the layer, to be redrawn when tiles being got by other downloads are done
 } MapDownloadInfo;
 
+// A tile position as a key for a set of tiles (a GHashTable using g_int64_hash)
+#define TILE_KEY(x,y) (((gint64)(x) << 32) | (guint32)(y))
+
+/* The tiles being displayed */
+typedef struct {
+  VikMapsLayer *vml;
+  gint x0, xf, y0, yf;
+  gint scale;
+  gint z;
+} MapDownloadView;
+
 static void mdi_free ( MapDownloadInfo *mdi )
 {
   vik_mutex_free(mdi->mutex);
+  decode_ctx_unref ( mdi->ctx );
+  if ( mdi->tiles )
+    g_hash_table_destroy ( mdi->tiles );
   g_free ( mdi->cache_dir );
   mdi->cache_dir = NULL;
   g_free ( mdi->filename_buf );
@@ -1919,10 +2849,24 @@ static gboolean is_in_area (VikMapSource *map, MapCoord mc)
   return vik_coord_inside ( &vc, &vctl, &vcbr );
 }
 
+/**
+ * Whether the tile is one this download should get
+ */
+static gboolean is_wanted ( MapDownloadInfo *mdi, VikMapSource *map, MapCoord mc )
+{
+  if ( mdi->tiles ) {
+    gint64 key = TILE_KEY ( mc.x, mc.y );
+    if ( !g_hash_table_contains ( mdi->tiles, &key ) )
+      return FALSE;
+  }
+  return is_in_area ( map, mc );
+}
+
 // Free after use
 static gchar *create_request_string ( MapDownloadInfo *mdi, guint16 id, gint x, gint y )
 {
-  return g_strdup_printf ( "%d-%d-%d-%d-%d", id, x, y, mdi->mapcoord.scale, mdi->mapcoord.z );
+  // Including where it goes, as layers of the same source may have their own caches
+  return g_strdup_printf ( "%d-%d-%d-%d-%d-%u", id, x, y, mdi->mapcoord.scale, mdi->mapcoord.z, g_str_hash(mdi->cache_dir) );
 }
 
 static void mark_request_complete ( MapDownloadInfo *mdi, guint16 id, gint x, gint y )
@@ -1933,20 +2877,106 @@ static void mark_request_complete ( MapDownloadInfo *mdi, guint16 id, gint x, gi
   if ( rq_mutex ) {
     gchar *request = create_request_string ( mdi, id, x, y );
     g_mutex_lock ( rq_mutex );
-    (void)g_hash_table_remove ( requests, request );
+    GSList *waiters = tile_request_take ( requests, request );
     g_mutex_unlock ( rq_mutex );
     if ( vik_verbose )
       g_debug ( "%s: %s", __FUNCTION__, request );
     g_free ( request );
+    // Other layers of the source can now show it
+    tile_waiters_update ( waiters );
+  }
+}
+
+static void unref_weak_ref_cb ( MapDownloadInfo *mdi )
+{
+  g_mutex_lock ( mdi->mutex );
+  if ( mdi->map_layer_alive )
+    g_object_weak_unref ( G_OBJECT(mdi->vml), weak_ref_cb, mdi );
+  g_mutex_unlock ( mdi->mutex );
+}
+
+/**
+ * Report and record the outcome of getting a tile
+ */
+static void map_download_tile_done ( MapDownloadInfo *mdi, guint16 id, gint x, gint y, DownloadResult_t dr, gboolean need_download, gboolean remove_mem_cache )
+{
+  mdi->mapcoord.x = x; mdi->mapcoord.y = y;
+
+  switch ( dr ) {
+    case DOWNLOAD_PARAMETERS_ERROR:
+    case DOWNLOAD_HTTP_ERROR:
+    case DOWNLOAD_CONTENT_ERROR: {
+      // TODO: ?? count up the number of download errors somehow...
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_FILE_WRITE_ERROR: {
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_SUCCESS: break;
+    case DOWNLOAD_NOT_REQUIRED:
+      need_download = FALSE;
+      break;
+    case DOWNLOAD_USER_ABORTED:
+      break;
+    default:
+      break;
+  }
+
+  mark_request_complete ( mdi, id, x, y );
+
+  // Avoid attempting to update mapcache when download aborted
+  //  1. Since no real change to track
+  //  2. more importantly, if the program is ending then the mapcache may have been removed
+  if ( dr != DOWNLOAD_USER_ABORTED ) {
+
+    g_mutex_lock(mdi->mutex);
+    if ( mdi->map_layer_alive && ( dr == DOWNLOAD_SUCCESS || dr == DOWNLOAD_NOT_REQUIRED ) )
+      vik_tile_residency_set ( mdi->vml->residency, &mdi->mapcoord, VIK_TILE_PRESENT );
+    if (remove_mem_cache)
+      a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
+
+    // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
+    a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, mdi->mapcoord.x, mdi->mapcoord.y, mdi->mapcoord.z, id,
+                     mdi->mapcoord.scale, TILE_ALPHA(mdi->vml), 1.0, 1.0, mdi->vml->filename );
+
+    if (mdi->refresh_display && mdi->map_layer_alive) {
+      /* TODO: check if it's on visible area */
+      if ( need_download ) {
+        vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
+      }
+    }
+
+    g_mutex_unlock(mdi->mutex);
+    mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
   }
 }
 
-static void unref_weak_ref_cb ( MapDownloadInfo *mdi )
+/**
+ * Download all these tiles at once (so they can share connections)
+ * The filenames are freed
+ */
+static void map_download_batch ( MapDownloadInfo *mdi, VikMapSource *map, guint16 id, MapCoord *batch, gchar **fns, guint count, void *handle )
 {
-  g_mutex_lock ( mdi->mutex );
-  if ( mdi->map_layer_alive )
-    g_object_weak_unref ( G_OBJECT(mdi->vml), weak_ref_cb, mdi );
-  g_mutex_unlock ( mdi->mutex );
+  DownloadResult_t *results = g_new0 ( DownloadResult_t, count );
+  gint64 start = g_get_monotonic_time ();
+  if ( count == 1 )
+    results[0] = vik_map_source_download ( map, &batch[0], fns[0], handle );
+  else
+    vik_map_source_download_multi ( map, batch, (const gchar**)fns, results, count, handle );
+  a_tracelog_complete ( "tile", vik_map_source_get_label(map), start,
+                        g_strdup_printf ( "\"download\": %u, \"z\": %d, \"x\": %d, \"y\": %d", count, 17 - batch[0].scale, batch[0].x, batch[0].y ) );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    map_download_tile_done ( mdi, id, batch[ii].x, batch[ii].y, results[ii], TRUE, TRUE );
+    g_free ( fns[ii] );
+    fns[ii] = NULL;
+  }
+  g_free ( results );
 }
 
 static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
@@ -1958,13 +2988,20 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
   gint x, y;
   gboolean needed[mdi->xf-mdi->x0+1][mdi->yf-mdi->y0+1];
   const guint16 id = vik_map_source_get_uniq_id ( map );
+  MapCoord *batch = g_new ( MapCoord, DOWNLOAD_BATCH );
+  gchar **batch_fns = g_new0 ( gchar*, DOWNLOAD_BATCH );
+  guint batch_len = 0;
 
   for ( x = mdi->x0; x <= mdi->xf; x++ ) {
+    // Don't carry on marking a large area when already cancelled
+    //  (the first progress update below then stops the download)
+    if ( a_background_cancelled(threaddata) )
+      break;
     mcoord.x = x;
     for ( y = mdi->y0; y <= mdi->yf; y++ ) {
       mcoord.y = y;
       // Only attempt to download a tile from supported areas
-      if ( is_in_area(map, mcoord) ) {
+      if ( is_wanted(mdi, map, mcoord) ) {
         gchar *request = create_request_string ( mdi, id, x, y );
 
         // Avoid requesting the same tile when already waiting for this request to complete from another thread
@@ -1976,6 +3013,8 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
             g_debug ( "%s: %d %d Inserting request %s", __FUNCTION__, mdi->xf-x, mdi->yf-y, request );
           g_hash_table_insert ( requests, request, NULL );
         }
+        else if ( mdi->refresh_display )
+          tile_waiters_add ( requests, request, mdi->ctx );
         g_mutex_unlock ( rq_mutex );
 
         if ( !needed[mdi->xf-x][mdi->yf-y] ) {
@@ -1993,13 +3032,17 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
       mcoord.y = y;
 
       // Only attempt to download a tile from supported areas
-      if ( is_in_area(map, mcoord) ) {
+      if ( is_wanted(mdi, map, mcoord) ) {
 
         gboolean remove_mem_cache = FALSE;
         gboolean need_download = FALSE;
         donemaps++;
         int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
         if (res != 0) {
+          for ( guint bb = 0; bb < batch_len; bb++ )
+            g_free ( batch_fns[bb] );
+          g_free ( batch_fns );
+          g_free ( batch );
           requests_clear ( mdi->maptype );
           vik_map_source_download_handle_cleanup ( map, handle );
           return -1;
@@ -2014,7 +3057,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
                        mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
                        vik_map_source_get_file_extension(map) );
 
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+        if ( !tile_exists ( mdi->filename_buf, NULL ) ) {
           need_download = TRUE;
           remove_mem_cache = TRUE;
 
@@ -2028,9 +3071,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
             {
               /* see if this one is bad or what */
               GError *gx = NULL;
-              GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, &gx );
+              GdkPixbuf *pixbuf = tile_pixbuf_new ( map, &mcoord, mdi->filename_buf, &gx );
               if (gx || (!pixbuf)) {
-                if ( g_remove ( mdi->filename_buf ) )
+                if ( !tile_remove ( mdi->filename_buf ) )
                   g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
                 need_download = TRUE;
                 remove_mem_cache = TRUE;
@@ -2061,66 +3104,27 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           }
         }
 
-        mdi->mapcoord.x = x; mdi->mapcoord.y = y;
-
-        DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
-        if (need_download) {
-          dr = vik_map_source_download ( map, &(mdi->mapcoord), mdi->filename_buf, handle );
-          switch ( dr ) {
-            case DOWNLOAD_PARAMETERS_ERROR:
-            case DOWNLOAD_HTTP_ERROR:
-            case DOWNLOAD_CONTENT_ERROR: {
-              // TODO: ?? count up the number of download errors somehow...
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_FILE_WRITE_ERROR: {
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_SUCCESS: break;
-            case DOWNLOAD_NOT_REQUIRED:
-	      need_download = FALSE;
-	      break;
-            case DOWNLOAD_USER_ABORTED:
-              break;
-            default:
-              break;
-          }
-        }
-
-        mark_request_complete ( mdi, id, x, y );
-
-        // Avoid attempting to update mapcache when download aborted
-        //  1. Since no real change to track
-        //  2. more importantly, if the program is ending then the mapcache may have been removed
-        if ( dr != DOWNLOAD_USER_ABORTED ) {
-
-          g_mutex_lock(mdi->mutex);
-          if (remove_mem_cache)
-            a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
-
-          // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
-          a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, mdi->mapcoord.x, mdi->mapcoord.y, mdi->mapcoord.z, id,
-                           mdi->mapcoord.scale, mdi->vml->alpha, 1.0, 1.0, mdi->vml->filename );
-
-          if (mdi->refresh_display && mdi->map_layer_alive) {
-            /* TODO: check if it's on visible area */
-            if ( need_download ) {
-              vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
-            }
+        if ( need_download ) {
+          // Download several together
+          batch[batch_len] = mdi->mapcoord;
+          batch[batch_len].x = x;
+          batch[batch_len].y = y;
+          batch_fns[batch_len] = g_strdup ( mdi->filename_buf );
+          batch_len++;
+          if ( batch_len == DOWNLOAD_BATCH ) {
+            map_download_batch ( mdi, map, id, batch, batch_fns, batch_len, handle );
+            batch_len = 0;
           }
-
-          g_mutex_unlock(mdi->mutex);
-          mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
         }
+        else
+          map_download_tile_done ( mdi, id, x, y, DOWNLOAD_NOT_REQUIRED, FALSE, remove_mem_cache );
       }
     }
   }
+  if ( batch_len )
+    map_download_batch ( mdi, map, id, batch, batch_fns, batch_len, handle );
+  g_free ( batch_fns );
+  g_free ( batch );
   vik_map_source_download_handle_cleanup ( map, handle );
 
   unref_weak_ref_cb ( mdi );
@@ -2137,9 +3141,10 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
                    vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
                    mdi->mapcoord.scale, mdi->mapcoord.z, mdi->mapcoord.x, mdi->mapcoord.y, mdi->filename_buf, mdi->maxlen,
                    vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
-    if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+    // NB Tiles only go into bundles once completely downloaded
+    if ( !a_tilebundle_is_member ( mdi->filename_buf ) && g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
     {
-      if ( g_remove ( mdi->filename_buf ) )
+      if ( !tile_remove ( mdi->filename_buf ) )
         g_warning ( "Cleanup failed to remove: %s", mdi->filename_buf );
     }
   }
@@ -2149,7 +3154,35 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
   unref_weak_ref_cb ( mdi );
 }
 
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload )
+/**
+ * Reconsider waiting download jobs for this layer when the display changes:
+ *  those for what is now displayed come first, those next to it second,
+ *  and others for the display are no longer needed.
+ * Jobs that weren't for the display (e.g. bulk downloads) are left alone.
+ */
+static Background_Priority map_download_priority ( MapDownloadInfo *mdi, Background_Priority current, MapDownloadView *view )
+{
+  if ( mdi->vml != view->vml || current > BACKGROUND_PRIORITY_NEARBY )
+    return current;
+
+  if ( mdi->mapcoord.scale != view->scale || mdi->mapcoord.z != view->z )
+    return BACKGROUND_PRIORITY_CANCEL;
+
+  if ( mdi->xf >= view->x0 && mdi->x0 <= view->xf && mdi->yf >= view->y0 && mdi->y0 <= view->yf )
+    return BACKGROUND_PRIORITY_VISIBLE;
+
+  const gint ring = MAX(1, AUTODOWNLOAD_RING);
+  if ( mdi->xf >= view->x0 - ring && mdi->x0 <= view->xf + ring && mdi->yf >= view->y0 - ring && mdi->y0 <= view->yf + ring )
+    return BACKGROUND_PRIORITY_NEARBY;
+
+  return BACKGROUND_PRIORITY_CANCEL;
+}
+
+/**
+ * @priority: Download order relative to other waiting downloads
+ * @margin:   Extend the area by this many tiles all around
+ */
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, Background_Priority priority, gint margin )
 {
   gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
   gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
@@ -2165,16 +3198,20 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
   {
     MapDownloadInfo *mdi = g_malloc ( sizeof(MapDownloadInfo) );
     gint a, b;
+    maps_layer_set_tile_scale ( vml, map, &ulm );
+    maps_layer_set_tile_scale ( vml, map, &brm );
 
     mdi->vml = vml;
+    mdi->ctx = maps_layer_decode_ctx ( vml );
     mdi->vvp = vvp;
     mdi->map_layer_alive = TRUE;
     mdi->mutex = vik_mutex_new();
     mdi->refresh_display = TRUE;
+    mdi->tiles = NULL;
 
     /* cache_dir and buffer for dest filename */
     mdi->cache_dir = g_strdup ( vml->cache_dir );
-    mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+    mdi->maxlen = strlen ( vml->cache_dir ) + TILE_PATH_EXTRA_LEN;
     mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
     mdi->cache_layout = vml->cache_layout;
     mdi->maptype = vml->maptype;
@@ -2182,10 +3219,10 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
     mdi->mapcoord = ulm;
     mdi->redownload = redownload;
 
-    mdi->x0 = MIN(ulm.x, brm.x);
-    mdi->xf = MAX(ulm.x, brm.x);
-    mdi->y0 = MIN(ulm.y, brm.y);
-    mdi->yf = MAX(ulm.y, brm.y);
+    mdi->x0 = MAX(0, MIN(ulm.x, brm.x) - margin);
+    mdi->xf = MAX(ulm.x, brm.x) + margin;
+    mdi->y0 = MAX(0, MIN(ulm.y, brm.y) - margin);
+    mdi->yf = MAX(ulm.y, brm.y) + margin;
 
     mdi->mapstoget = 0;
 
@@ -2214,7 +3251,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
                              vik_map_source_get_name(map),
                              ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
                              vik_map_source_get_file_extension(map) );
-              if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+              if ( !tile_exists ( mdi->filename_buf, NULL ) ) {
                 mdi->mapstoget++;
               }
             }
@@ -2246,7 +3283,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
 
       g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
       /* launch the thread */
-      a_background_thread ( BACKGROUND_POOL_REMOTE,
+      a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE, priority,
                             VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
                             tmp,                                              /* description string */
                             (vik_thr_func) map_download_thread,               /* function to call within thread */
@@ -2261,6 +3298,27 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
   }
 }
 
+/**
+ * Download what is being displayed (xmin..ymax at the zoom level of ulm)
+ */
+static void start_autodownload ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, MapCoord *ulm, gint xmin, gint xmax, gint ymin, gint ymax )
+{
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+
+  // Previous downloads for what was displayed may no longer be wanted
+  MapDownloadView view = { vml, xmin, xmax, ymin, ymax, ulm->scale, ulm->z };
+  a_background_reprioritise ( (vik_thr_func)map_download_thread, (vik_thr_priority_func)map_download_priority, &view );
+
+  gint redownload = REDOWNLOAD_NONE; // Download only missing tiles
+  if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
+    // Try to download newer tiles
+    redownload = REDOWNLOAD_NEW;
+  start_download_thread ( vml, vvp, ul, br, redownload, BACKGROUND_PRIORITY_VISIBLE, 0 );
+  if ( AUTODOWNLOAD_RING > 0 )
+    // Then the tiles around the display
+    start_download_thread ( vml, vvp, ul, br, redownload, BACKGROUND_PRIORITY_NEARBY, AUTODOWNLOAD_RING );
+}
+
 static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
 {
   MapCoord ulm, brm;
@@ -2275,18 +3333,22 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
     g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
     return;
   }
+  maps_layer_set_tile_scale ( vml, map, &ulm );
+  maps_layer_set_tile_scale ( vml, map, &brm );
 
   MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
   gint i, j;
 
   mdi->vml = vml;
+  mdi->ctx = maps_layer_decode_ctx ( vml );
   mdi->vvp = vvp;
   mdi->map_layer_alive = TRUE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = TRUE;
+  mdi->tiles = NULL;
 
   mdi->cache_dir = g_strdup ( vml->cache_dir );
-  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->maxlen = strlen ( vml->cache_dir ) + TILE_PATH_EXTRA_LEN;
   mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
   mdi->maptype = vml->maptype;
   mdi->cache_layout = vml->cache_layout;
@@ -2314,7 +3376,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
                        vik_map_source_get_name(map),
                        ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
                        vik_map_source_get_file_extension(map) );
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
+        if ( !tile_exists ( mdi->filename_buf, NULL ) )
               mdi->mapstoget++;
       }
     }
@@ -2332,8 +3394,8 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
 
     g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
 
-    // launch the thread
-    a_background_thread ( BACKGROUND_POOL_REMOTE,
+    // launch the thread - after anything for the display
+    a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE, BACKGROUND_PRIORITY_BULK,
                           VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
                           tmp,                                /* description string */
                           (vik_thr_func) map_download_thread, /* function to call within thread */
@@ -2364,17 +3426,17 @@ void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD, BACKGROUND_PRIORITY_NORMAL, 0 );
 }
 
 static void maps_layer_redownload_all ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL, BACKGROUND_PRIORITY_NORMAL, 0 );
 }
 
 static void maps_layer_redownload_new ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW, BACKGROUND_PRIORITY_NORMAL, 0 );
 }
 
 /**
@@ -2390,6 +3452,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
 
   if ( !vik_map_source_coord_to_mapcoord ( map, &(vml->redownload_ul), xzoom, yzoom, &ulm ) )
     return;
+  maps_layer_set_tile_scale ( vml, map, &ulm );
 
   gchar *filename = NULL;
   gchar *source = NULL;
@@ -2402,7 +3465,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
       gchar *exists = NULL;
       gint zoom = 17 - ulm.scale;
       if ( vml->mbtiles ) {
-        GdkPixbuf *pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, ulm.x, ulm.y, zoom );
+        GdkPixbuf *pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, &vml->mbtiles_stmt, ulm.x, ulm.y, zoom );
         if ( pixbuf ) {
           exists = g_strdup ( _("YES") );
           g_object_unref ( G_OBJECT(pixbuf) );
@@ -2428,7 +3491,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
       filename = g_strdup ( path );
     }
     else {
-      guint max_path_len = strlen(vml->cache_dir) + 40;
+      guint max_path_len = strlen(vml->cache_dir) + TILE_PATH_EXTRA_LEN;
       filename = g_malloc ( max_path_len * sizeof(char) );
       get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM,
                      vik_map_source_get_uniq_id(map),
@@ -2439,7 +3502,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
     }
   }
   else {
-    guint max_path_len = strlen(vml->cache_dir) + 40;
+    guint max_path_len = strlen(vml->cache_dir) + TILE_PATH_EXTRA_LEN;
     filename = g_malloc ( max_path_len * sizeof(char) );
     get_filename ( vml->cache_dir, vml->cache_layout,
                    vik_map_source_get_uniq_id(map),
@@ -2457,13 +3520,16 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
   gchar *filemsg = NULL;
   gchar *timemsg = NULL;
 
-  if ( g_file_test ( filename, G_FILE_TEST_EXISTS ) ) {
+  gint64 bundle_time = 0;
+  gboolean bundled = a_tilebundle_is_member ( filename );
+  if ( bundled ? a_tilebundle_lookup ( filename, &bundle_time, NULL ) : g_file_test ( filename, G_FILE_TEST_EXISTS ) ) {
     filemsg = g_strconcat ( "Tile File: ", filename, NULL );
     // Get some timestamp information of the tile
     GStatBuf stat_buf;
-    if ( g_stat ( filename, &stat_buf ) == 0 ) {
+    if ( bundled || g_stat ( filename, &stat_buf ) == 0 ) {
+      time_t file_time = bundled ? bundle_time : stat_buf.st_mtime;
       gchar time_buf[64];
-      strftime ( time_buf, sizeof(time_buf), "%c", gmtime((const time_t *)&stat_buf.st_mtime) );
+      strftime ( time_buf, sizeof(time_buf), "%c", gmtime(&file_time) );
       timemsg = g_strdup_printf ( _("Tile File Timestamp: %s"), time_buf );
     }
     else {
@@ -2497,7 +3563,7 @@ static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, G
       VikCoord ul, br;
       vik_viewport_screen_to_coord ( vvp, MAX(0, MIN(event->x, vml->dl_tool_x)), MAX(0, MIN(event->y, vml->dl_tool_y)), &ul );
       vik_viewport_screen_to_coord ( vvp, MIN(vik_viewport_get_width(vvp), MAX(event->x, vml->dl_tool_x)), MIN(vik_viewport_get_height(vvp), MAX ( event->y, vml->dl_tool_y ) ), &br );
-      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH );
+      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH, BACKGROUND_PRIORITY_VISIBLE, 0 );
       vml->dl_tool_x = vml->dl_tool_y = -1;
       return VIK_LAYER_TOOL_ACK;
     }
@@ -2586,7 +3652,7 @@ static void download_onscreen_maps ( menu_array_values values, gint redownload )
   if ( vik_map_source_get_drawmode(map) == vp_drawmode &&
        vik_map_source_coord_to_mapcoord ( map, &ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, &br, xzoom, yzoom, &brm ) )
-    start_download_thread ( vml, vvp, &ul, &br, redownload );
+    start_download_thread ( vml, vvp, &ul, &br, redownload, BACKGROUND_PRIORITY_VISIBLE, 0 );
   else if (vik_map_source_get_drawmode(map) != vp_drawmode) {
     const gchar *drawmode_name = vik_viewport_get_drawmode_name (vvp, vik_map_source_get_drawmode(map));
     gchar *err = g_strdup_printf(_("Wrong drawmode for this map.\nSelect \"%s\" from View menu and try again."), _(drawmode_name));
@@ -2675,18 +3741,22 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
     g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
     return 0;
   }
+  maps_layer_set_tile_scale ( vml, map, &ulm );
+  maps_layer_set_tile_scale ( vml, map, &brm );
 
   MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
   gint i, j;
 
   mdi->vml = vml;
+  mdi->ctx = maps_layer_decode_ctx ( vml );
   mdi->vvp = vvp;
   mdi->map_layer_alive = TRUE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = FALSE;
+  mdi->tiles = NULL;
 
   mdi->cache_dir = g_strdup ( vml->cache_dir );
-  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->maxlen = strlen ( vml->cache_dir ) + TILE_PATH_EXTRA_LEN;
   mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
   mdi->maptype = vml->maptype;
   mdi->cache_layout = vml->cache_layout;
@@ -2701,9 +3771,47 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
   mdi->mapstoget = 0;
 
+  gint64 present = -1;
+  gchar *tile_dir = ( mdi->redownload == REDOWNLOAD_NONE && ulm.z <= 1 &&
+                      vik_map_source_get_drawmode(map) == VIK_VIEWPORT_DRAWMODE_MERCATOR ) ? maps_layer_tile_dir ( vml ) : NULL;
+
   if ( mdi->redownload == REDOWNLOAD_ALL ) {
     mdi->mapstoget = (mdi->xf - mdi->x0 + 1) * (mdi->yf - mdi->y0 + 1);
   }
+  else if ( tile_dir && (present = a_tileindex_count_tiles ( tile_dir, 17 - ulm.scale, mdi->x0, mdi->xf, mdi->y0, mdi->yf )) >= 0 ) {
+    // The supported area is a lat/lon box (as is_in_area()), and with this projection
+    //  the longitude of a tile depends only on x and its latitude only on y,
+    //  so the tiles within it are those of a range of x by a range of y
+    MapCoord mcoord = mdi->mapcoord;
+    gint xin = 0, yin = 0;
+    gint ax0 = G_MAXINT, axf = -1, ay0 = G_MAXINT, ayf = -1;
+    for ( i = mdi->x0; i <= mdi->xf; i++ ) {
+      VikCoord vc;
+      struct LatLon ll;
+      mcoord.x = i;
+      vik_map_source_mapcoord_to_center_coord ( map, &mcoord, &vc );
+      vik_coord_to_latlon ( &vc, &ll );
+      if ( ll.lon >= vik_map_source_get_lon_min(map) && ll.lon <= vik_map_source_get_lon_max(map) ) {
+        xin++;
+        ax0 = MIN ( ax0, i ); axf = i;
+      }
+    }
+    for ( j = mdi->y0; j <= mdi->yf; j++ ) {
+      VikCoord vc;
+      struct LatLon ll;
+      mcoord.y = j;
+      vik_map_source_mapcoord_to_center_coord ( map, &mcoord, &vc );
+      vik_coord_to_latlon ( &vc, &ll );
+      if ( ll.lat >= vik_map_source_get_lat_min(map) && ll.lat <= vik_map_source_get_lat_max(map) ) {
+        yin++;
+        ay0 = MIN ( ay0, j ); ayf = j;
+      }
+    }
+    // Only tiles within the area are counted as present too
+    if ( xin && yin && ( ax0 != mdi->x0 || axf != mdi->xf || ay0 != mdi->y0 || ayf != mdi->yf ) )
+      present = a_tileindex_count_tiles ( tile_dir, 17 - ulm.scale, ax0, axf, ay0, ayf );
+    mdi->mapstoget = xin && yin ? MAX ( 0, (gint64)xin * yin - present ) : 0;
+  }
   else {
     /* calculate how many we need */
     MapCoord mcoord = mdi->mapcoord;
@@ -2718,20 +3826,23 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
                          vik_map_source_get_name(map),
                          ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
                          vik_map_source_get_file_extension(map) );
+          gint64 file_time = 0;
           if ( mdi->redownload == REDOWNLOAD_NEW ) {
-            // Assume the worst - always a new file
+            // Assume the worst - always a new file, unless it's too recent to be checked
             // Absolute value would require a server lookup - but that is too slow
-            mdi->mapstoget++;
+            if ( !tile_exists ( mdi->filename_buf, &file_time ) ||
+                 (time(NULL) - file_time) >= vml->cache_expiry_age )
+              mdi->mapstoget++;
           }
           else {
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+            if ( !tile_exists ( mdi->filename_buf, NULL ) ) {
               // Missing
               mdi->mapstoget++;
             }
             else {
               if ( mdi->redownload == REDOWNLOAD_BAD ) {
                 /* see if this one is bad or what */
-                GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, NULL );
+                GdkPixbuf *pixbuf = tile_pixbuf_new ( map, &mcoord, mdi->filename_buf, NULL );
                 if ( !pixbuf ) {
                   mdi->mapstoget++;
                 } else {
@@ -2749,6 +3860,7 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
   gint rv = mdi->mapstoget;
 
+  g_free ( tile_dir );
   mdi_free ( mdi );
 
   return rv;
@@ -2756,6 +3868,8 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
 /**
  * maps_dialog_zoom_between:
+ * @download_list: The download methods to choose from, or NULL to not offer a choice
+ *
  * This dialog is specific to the map layer, so it's here rather than in dialog.c
  */
 gboolean maps_dialog_zoom_between ( GtkWindow *parent,
@@ -2790,19 +3904,22 @@ gboolean maps_dialog_zoom_between ( GtkWindow *parent,
     vik_combo_box_text_append ( zoom_combo2, *s );
   gtk_combo_box_set_active ( GTK_COMBO_BOX(zoom_combo2), default_zoom2 );
 
-  GtkWidget *download_label = gtk_label_new(_("Download Maps Method:"));
-  GtkWidget *download_combo = vik_combo_box_text_new();
-  for (s = download_list; *s; s++)
-    vik_combo_box_text_append ( download_combo, *s );
-  gtk_combo_box_set_active ( GTK_COMBO_BOX(download_combo), default_download );
-
-  GtkTable *box = GTK_TABLE(gtk_table_new(3, 2, FALSE));
+  GtkTable *box = GTK_TABLE(gtk_table_new(download_list ? 3 : 2, 2, FALSE));
   gtk_table_attach_defaults (box, GTK_WIDGET(zoom_label1), 0, 1, 0, 1);
   gtk_table_attach_defaults (box, GTK_WIDGET(zoom_combo1), 1, 2, 0, 1);
   gtk_table_attach_defaults (box, GTK_WIDGET(zoom_label2), 0, 1, 1, 2);
   gtk_table_attach_defaults (box, GTK_WIDGET(zoom_combo2), 1, 2, 1, 2);
-  gtk_table_attach_defaults (box, GTK_WIDGET(download_label), 0, 1, 2, 3);
-  gtk_table_attach_defaults (box, GTK_WIDGET(download_combo), 1, 2, 2, 3);
+
+  GtkWidget *download_combo = NULL;
+  if ( download_list ) {
+    GtkWidget *download_label = gtk_label_new(_("Download Maps Method:"));
+    download_combo = vik_combo_box_text_new();
+    for (s = download_list; *s; s++)
+      vik_combo_box_text_append ( download_combo, *s );
+    gtk_combo_box_set_active ( GTK_COMBO_BOX(download_combo), default_download );
+    gtk_table_attach_defaults (box, GTK_WIDGET(download_label), 0, 1, 2, 3);
+    gtk_table_attach_defaults (box, GTK_WIDGET(download_combo), 1, 2, 2, 3);
+  }
 
   gtk_box_pack_start ( GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), GTK_WIDGET(box), FALSE, FALSE, 5 );
 
@@ -2818,7 +3935,8 @@ gboolean maps_dialog_zoom_between ( GtkWindow *parent,
   // Return selected options
   *selected_zoom1 = gtk_combo_box_get_active ( GTK_COMBO_BOX(zoom_combo1) );
   *selected_zoom2 = gtk_combo_box_get_active ( GTK_COMBO_BOX(zoom_combo2) );
-  *selected_download = gtk_combo_box_get_active ( GTK_COMBO_BOX(download_combo) );
+  if ( download_combo )
+    *selected_download = gtk_combo_box_get_active ( GTK_COMBO_BOX(download_combo) );
 
   gtk_widget_destroy(dialog);
   return TRUE;
@@ -2926,14 +4044,671 @@ static void maps_layer_download_all ( menu_array_values values )
   }
 }
 
+// Tiles of a corridor are downloaded in square blocks of up to this many tiles across
+#define CORRIDOR_BLOCK 16
+
+/**
+ * Returns: The distance across a tile at the position, in metres
+ */
+static gdouble corridor_tile_diagonal ( VikMapSource *map, const VikCoord *coord, gdouble zoom )
+{
+  MapCoord mc, next;
+  VikCoord c1, c2;
+  if ( !vik_map_source_coord_to_mapcoord ( map, coord, zoom, zoom, &mc ) )
+    return 0.0;
+  next = mc;
+  next.x++;
+  next.y++;
+  vik_map_source_mapcoord_to_center_coord ( map, &mc, &c1 );
+  vik_map_source_mapcoord_to_center_coord ( map, &next, &c2 );
+  return vik_coord_diff ( &c1, &c2 );
+}
+
+/**
+ * Add the tiles with their centres within @reach metres of the position
+ */
+static void corridor_add_point ( VikMapSource *map, VikCoordMode mode, const struct LatLon *ll, gdouble reach, gdouble zoom, GHashTable *tiles )
+{
+  // Metres to degrees - near enough for finding the tiles to check
+  gdouble dlat = reach / 111320.0;
+  gdouble dlon = reach / ( 111320.0 * MAX(0.01, cos(DEG2RAD(ll->lat))) );
+  struct LatLon ll_ul = { MIN(ll->lat + dlat, 90.0), ll->lon - dlon };
+  struct LatLon ll_br = { MAX(ll->lat - dlat, -90.0), ll->lon + dlon };
+  VikCoord centre, ul, br;
+  MapCoord ulm, brm, tile;
+  vik_coord_load_from_latlon ( &centre, mode, ll );
+  vik_coord_load_from_latlon ( &ul, mode, &ll_ul );
+  vik_coord_load_from_latlon ( &br, mode, &ll_br );
+  if ( !vik_map_source_coord_to_mapcoord ( map, &ul, zoom, zoom, &ulm ) ||
+       !vik_map_source_coord_to_mapcoord ( map, &br, zoom, zoom, &brm ) )
+    return;
+
+  tile = ulm;
+  for ( tile.x = MIN(ulm.x, brm.x); tile.x <= MAX(ulm.x, brm.x); tile.x++ ) {
+    for ( tile.y = MIN(ulm.y, brm.y); tile.y <= MAX(ulm.y, brm.y); tile.y++ ) {
+      gint64 key = TILE_KEY ( tile.x, tile.y );
+      if ( g_hash_table_contains ( tiles, &key ) )
+        continue;
+      VikCoord tc;
+      vik_map_source_mapcoord_to_center_coord ( map, &tile, &tc );
+      if ( vik_coord_diff ( &tc, &centre ) <= reach )
+        g_hash_table_add ( tiles, g_memdup ( &key, sizeof(key) ) );
+    }
+  }
+}
+
+/**
+ * Get the set of tiles that are at least partly within @radius metres of the line through @coords
+ *
+ * The line is followed in steps of no more than a tile across,
+ *  taking every tile whose centre is within the distance plus a step plus half a tile of each step.
+ */
+static GHashTable *corridor_tiles ( VikMapSource *map, VikCoordMode mode, GList *coords, gdouble radius, gdouble zoom )
+{
+  GHashTable *tiles = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  GList *iter;
+  for ( iter = coords; iter; iter = iter->next ) {
+    VikCoord *coord = (VikCoord*)iter->data;
+    struct LatLon ll1, ll2;
+    vik_coord_to_latlon ( coord, &ll1 );
+    gdouble diagonal = corridor_tile_diagonal ( map, coord, zoom );
+    if ( diagonal <= 0.0 )
+      continue;
+    gdouble reach = radius + diagonal;
+    if ( !iter->next ) {
+      corridor_add_point ( map, mode, &ll1, reach, zoom, tiles );
+      break;
+    }
+    VikCoord *next = (VikCoord*)iter->next->data;
+    vik_coord_to_latlon ( next, &ll2 );
+    gint steps = MAX ( 1, (gint)ceil ( vik_coord_diff ( coord, next ) / diagonal ) );
+    gint ii;
+    for ( ii = 0; ii < steps; ii++ ) {
+      struct LatLon ll = { ll1.lat + (ll2.lat - ll1.lat) * ii / steps, ll1.lon + (ll2.lon - ll1.lon) * ii / steps };
+      corridor_add_point ( map, mode, &ll, reach, zoom, tiles );
+    }
+  }
+  return tiles;
+}
+
+/**
+ * Set up (but don't start) the downloads of the missing tiles near a line at one zoom level,
+ *  each for a block of nearby tiles
+ *
+ * Returns: A list of #MapDownloadInfo, with the number of tiles to get added to @count
+ */
+static GList *maps_layer_corridor_downloads ( VikMapsLayer *vml, VikViewport *vvp, GList *coords, gdouble radius, gdouble zoom, gint *count )
+{
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  if ( vik_map_source_is_direct_file_access ( map ) || !coords )
+    return NULL;
+
+  VikCoordMode mode = vik_viewport_get_coord_mode ( vvp );
+  struct LatLon ll;
+  VikCoord first;
+  MapCoord ulm;
+  vik_coord_to_latlon ( (VikCoord*)coords->data, &ll );
+  vik_coord_load_from_latlon ( &first, mode, &ll );
+  if ( !vik_map_source_coord_to_mapcoord ( map, &first, zoom, zoom, &ulm ) ) {
+    g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
+    return NULL;
+  }
+  maps_layer_set_tile_scale ( vml, map, &ulm );
+
+  const guint16 id = vik_map_source_get_uniq_id ( map );
+  gint maxlen = strlen ( vml->cache_dir ) + TILE_PATH_EXTRA_LEN;
+  gchar *filename_buf = g_malloc ( maxlen * sizeof(gchar) );
+  GHashTable *tiles = corridor_tiles ( map, mode, coords, radius, zoom );
+  GHashTable *blocks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  GList *mdis = NULL;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init ( &iter, tiles );
+  while ( g_hash_table_iter_next ( &iter, &key, NULL ) ) {
+    MapCoord mc = ulm;
+    mc.x = (gint)(*(gint64*)key >> 32);
+    mc.y = (gint)(guint32)*(gint64*)key;
+    if ( mc.x < 0 || mc.y < 0 || !is_in_area ( map, mc ) )
+      continue;
+    // Only missing tiles
+    get_filename ( vml->cache_dir, vml->cache_layout, id,
+                   vik_map_source_get_name(map),
+                   ulm.scale, ulm.z, mc.x, mc.y, filename_buf, maxlen,
+                   vik_map_source_get_file_extension(map) );
+    if ( tile_exists ( filename_buf, NULL ) )
+      continue;
+
+    gint64 block_key = TILE_KEY ( mc.x / CORRIDOR_BLOCK, mc.y / CORRIDOR_BLOCK );
+    MapDownloadInfo *mdi = g_hash_table_lookup ( blocks, &block_key );
+    if ( !mdi ) {
+      mdi = g_malloc ( sizeof(MapDownloadInfo) );
+      mdi->vml = vml;
+      mdi->ctx = maps_layer_decode_ctx ( vml );
+      mdi->vvp = vvp;
+      mdi->map_layer_alive = TRUE;
+      mdi->mutex = vik_mutex_new();
+      mdi->refresh_display = TRUE;
+      mdi->tiles = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+
+      mdi->cache_dir = g_strdup ( vml->cache_dir );
+      mdi->maxlen = maxlen;
+      mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+      mdi->maptype = vml->maptype;
+      mdi->cache_layout = vml->cache_layout;
+
+      mdi->mapcoord = ulm;
+      mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
+      mdi->redownload = REDOWNLOAD_NONE;
+      mdi->x0 = mdi->xf = mc.x;
+      mdi->y0 = mdi->yf = mc.y;
+      mdi->mapstoget = 0;
+
+      g_hash_table_insert ( blocks, g_memdup ( &block_key, sizeof(block_key) ), mdi );
+      mdis = g_list_prepend ( mdis, mdi );
+    }
+    mdi->x0 = MIN ( mdi->x0, mc.x );
+    mdi->xf = MAX ( mdi->xf, mc.x );
+    mdi->y0 = MIN ( mdi->y0, mc.y );
+    mdi->yf = MAX ( mdi->yf, mc.y );
+    g_hash_table_add ( mdi->tiles, g_memdup ( key, sizeof(gint64) ) );
+    mdi->mapstoget++;
+    (*count)++;
+  }
+
+  g_hash_table_destroy ( blocks );
+  g_hash_table_destroy ( tiles );
+  g_free ( filename_buf );
+  return mdis;
+}
+
+/**
+ * vik_maps_layer_download_corridor:
+ * @vml:     The Map Layer
+ * @vvp:     The Viewport that the map is on
+ * @coords:  The #VikCoord positions along the line, such as of a track
+ * @radius:  How far either side of the line to get tiles for, in metres
+ * @zooms:   The zoom levels to download, in the order to download them
+ * @n_zooms: The number of zoom levels
+ *
+ * Download the missing tiles near a line (rather than everything in its bounds),
+ *  after checking how many that is
+ */
+void vik_maps_layer_download_corridor ( VikMapsLayer *vml, VikViewport *vvp, GList *coords, gdouble radius, const gdouble *zooms, guint n_zooms )
+{
+  GList *mdis = NULL;
+  GList *iter;
+  gint map_count = 0;
+  guint zz;
+
+  for ( zz = 0; zz < n_zooms; zz++ )
+    mdis = g_list_concat ( mdis, g_list_reverse ( maps_layer_corridor_downloads ( vml, vvp, coords, radius, zooms[zz], &map_count ) ) );
+
+  g_debug ( "vikmapslayer: corridor download map count %d", map_count );
+
+  if ( !map_count ) {
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), _("No maps to download"), VIK_STATUSBAR_INFO );
+    return;
+  }
+
+  // Absolute protection of hammering a map server
+  if ( map_count > REALLY_LARGE_AMOUNT_OF_TILES ) {
+    gchar *str = g_strdup_printf (_("You are not allowed to download more than %d tiles in one go (requested %d)"), REALLY_LARGE_AMOUNT_OF_TILES, map_count);
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vml), str );
+    g_free (str);
+    g_list_free_full ( mdis, (GDestroyNotify)mdi_free );
+    return;
+  }
+
+  // Confirm really want to do this
+  if ( map_count > CONFIRM_LARGE_AMOUNT_OF_TILES ) {
+    gchar *str = g_strdup_printf (_("Do you really want to download %d tiles?"), map_count);
+    gboolean ans = a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vml), str, NULL );
+    g_free (str);
+    if ( ! ans ) {
+      g_list_free_full ( mdis, (GDestroyNotify)mdi_free );
+      return;
+    }
+  }
+
+  for ( iter = mdis; iter; iter = iter->next ) {
+    MapDownloadInfo *mdi = (MapDownloadInfo*)iter->data;
+    gchar *tmp = g_strdup_printf ( ngettext("Downloading %d %s map...", "Downloading %d %s maps...", mdi->mapstoget),
+                                   mdi->mapstoget, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+
+    g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
+
+    // launch the thread - after anything for the display
+    a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE, BACKGROUND_PRIORITY_BULK,
+                          VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
+                          tmp,                                /* description string */
+                          (vik_thr_func) map_download_thread, /* function to call within thread */
+                          mdi,                                /* pass along data */
+                          (vik_thr_free_func) mdi_free,       /* function to free pass along data */
+                          (vik_thr_free_func) mdi_cancel_cleanup,
+                          mdi->mapstoget );
+    g_free ( tmp );
+  }
+  g_list_free ( mdis );
+}
+
+#ifdef HAVE_SQLITE3_H
+// Number of tiles read (in parallel) and then written in one transaction
+#define MBTILES_EXPORT_BATCH 4096
+
+typedef struct {
+  MapCoord ulm; // Top left tile of the range
+  gint xf, yf;  // Bottom right tile
+} MBTilesExportRange;
+
+typedef struct {
+  gchar *filename;
+  gint zoom, x, flip_y;
+  gchar *data;
+  gsize size;
+} MBTilesExportTile;
+
+typedef struct {
+  gchar *fn;
+  gchar *cache_dir;
+  VikMapsCacheLayout cache_layout;
+  guint16 id;
+  gchar *map_name;
+  gchar *file_extension;
+  gchar *format;
+  gchar *name;
+  GArray *ranges;
+  gint minzoom, maxzoom;
+  struct LatLon ll_ul, ll_br;
+  VikWindow *vw;
+  // For the tile reading pool
+  MBTilesExportTile tiles[MBTILES_EXPORT_BATCH];
+  guint pending;
+  GMutex mutex;
+  GCond cond;
+} MBTilesExport;
+
+static void mbtiles_export_free ( MBTilesExport *mbe )
+{
+  g_free ( mbe->fn );
+  g_free ( mbe->cache_dir );
+  g_free ( mbe->map_name );
+  g_free ( mbe->file_extension );
+  g_free ( mbe->format );
+  g_free ( mbe->name );
+  g_array_free ( mbe->ranges, TRUE );
+  g_mutex_clear ( &mbe->mutex );
+  g_cond_clear ( &mbe->cond );
+  g_free ( mbe );
+}
+
+/**
+ * Runs in the reading thread pool
+ */
+static void mbtiles_export_read_tile ( MBTilesExportTile *tile, MBTilesExport *mbe )
+{
+  // Missing tiles are simply skipped
+  if ( a_tilebundle_is_member ( tile->filename ) ) {
+    GBytes *bytes = a_tilebundle_get ( tile->filename, NULL );
+    tile->data = bytes ? g_bytes_unref_to_data ( bytes, &tile->size ) : NULL;
+  }
+  else if ( !g_file_get_contents ( tile->filename, &tile->data, &tile->size, NULL ) )
+    tile->data = NULL;
+
+  g_mutex_lock ( &mbe->mutex );
+  if ( --mbe->pending == 0 )
+    g_cond_signal ( &mbe->cond );
+  g_mutex_unlock ( &mbe->mutex );
+}
+
+static void mbtiles_export_insert_metadata_pair ( sqlite3 *sql, const gchar *name, const gchar *value )
+{
+  sqlite3_stmt *sql_stmt;
+  if ( sqlite3_prepare_v2 ( sql, "INSERT INTO metadata (name, value) VALUES (?, ?);", -1, &sql_stmt, NULL ) != SQLITE_OK ) {
+    g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg(sql) );
+    return;
+  }
+  (void)sqlite3_bind_text ( sql_stmt, 1, name, -1, SQLITE_STATIC );
+  (void)sqlite3_bind_text ( sql_stmt, 2, value, -1, SQLITE_STATIC );
+  int step = sqlite3_step ( sql_stmt );
+  if ( step != SQLITE_DONE )
+    g_warning ( "%s: sqlite3_step result was %d", __FUNCTION__, step );
+  (void)sqlite3_finalize ( sql_stmt );
+}
+
+/**
+ * Read the batch of tile files in parallel, then write those that exist in one transaction
+ *
+ * Returns: The number of tiles written, or -1 on a write failure (with @msg set)
+ */
+static gint mbtiles_export_batch ( MBTilesExport *mbe, GThreadPool *pool, guint n_tiles, sqlite3 *mbtiles, sqlite3_stmt *sql_stmt, gchar **msg )
+{
+  mbe->pending = n_tiles;
+  for ( guint nn = 0; nn < n_tiles; nn++ )
+    g_thread_pool_push ( pool, &mbe->tiles[nn], NULL );
+  g_mutex_lock ( &mbe->mutex );
+  while ( mbe->pending )
+    g_cond_wait ( &mbe->cond, &mbe->mutex );
+  g_mutex_unlock ( &mbe->mutex );
+
+  gint written = 0;
+  (void)sqlite3_exec ( mbtiles, "BEGIN TRANSACTION;", 0, 0, NULL );
+  for ( guint nn = 0; nn < n_tiles; nn++ ) {
+    MBTilesExportTile *tile = &mbe->tiles[nn];
+    if ( tile->data && written >= 0 ) {
+      (void)sqlite3_bind_int ( sql_stmt, 1, tile->zoom );
+      (void)sqlite3_bind_int ( sql_stmt, 2, tile->x );
+      (void)sqlite3_bind_int ( sql_stmt, 3, tile->flip_y );
+      (void)sqlite3_bind_blob ( sql_stmt, 4, tile->data, tile->size, SQLITE_STATIC );
+      int step = sqlite3_step ( sql_stmt );
+      (void)sqlite3_reset ( sql_stmt );
+      if ( step == SQLITE_DONE )
+        written++;
+      else {
+        *msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+        written = -1;
+      }
+    }
+    g_free ( tile->data );
+    tile->data = NULL;
+    g_free ( tile->filename );
+    tile->filename = NULL;
+  }
+  (void)sqlite3_exec ( mbtiles, "COMMIT;", 0, 0, NULL );
+  return written;
+}
+
+static gint mbtiles_export_thread ( MBTilesExport *mbe, gpointer threaddata )
+{
+  gint result = 0;
+  guint num_tiles = 0;
+  guint num_written = 0;
+  gchar *msg = NULL;
+  sqlite3 *mbtiles;
+  int ans = sqlite3_open ( mbe->fn, &mbtiles );
+  if ( ans != SQLITE_OK ) {
+    msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    goto cleanup;
+  }
+
+  char *err_msg = NULL;
+  // As for the TAC coverage export, use fast writing options as the file can be easily regenerated
+  ans = sqlite3_exec ( mbtiles,
+                       "DROP TABLE IF EXISTS tiles;"
+                       "DROP TABLE IF EXISTS metadata;"
+                       "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);"
+                       "CREATE TABLE metadata (name text, value text);"
+                       "CREATE unique index name on metadata (name);"
+                       "CREATE unique index tile_index on tiles (zoom_level, tile_column, tile_row);"
+                       "PRAGMA synchronous=0;"
+                       "PRAGMA locking_mode=EXCLUSIVE;"
+                       "PRAGMA journal_mode=OFF;",
+                       0, 0, &err_msg );
+  if ( ans != SQLITE_OK ) {
+    msg = g_strdup ( err_msg );
+    sqlite3_free ( err_msg );
+    goto cleanup;
+  }
+
+  // v1.3 Metadata
+  mbtiles_export_insert_metadata_pair ( mbtiles, "name", mbe->name );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "type", "baselayer" );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "version", "1" );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "description", "Created by Viking - " PACKAGE_URL );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "format", mbe->format );
+  gchar *west = a_coords_dtostr ( mbe->ll_ul.lon );
+  gchar *south = a_coords_dtostr ( mbe->ll_br.lat );
+  gchar *east = a_coords_dtostr ( mbe->ll_br.lon );
+  gchar *north = a_coords_dtostr ( mbe->ll_ul.lat );
+  gchar *bounds = g_strdup_printf ( "%s,%s,%s,%s", west, south, east, north );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "bounds", bounds );
+  g_free ( bounds );
+  g_free ( north );
+  g_free ( east );
+  g_free ( south );
+  g_free ( west );
+  gchar *zoom_str = g_strdup_printf ( "%d", mbe->minzoom );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "minzoom", zoom_str );
+  g_free ( zoom_str );
+  zoom_str = g_strdup_printf ( "%d", mbe->maxzoom );
+  mbtiles_export_insert_metadata_pair ( mbtiles, "maxzoom", zoom_str );
+  g_free ( zoom_str );
+
+  sqlite3_stmt *sql_stmt;
+  ans = sqlite3_prepare_v2 ( mbtiles, "INSERT OR REPLACE INTO tiles VALUES (?, ?, ?, ?);", -1, &sql_stmt, NULL );
+  if ( ans != SQLITE_OK ) {
+    msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    goto cleanup;
+  }
+
+  guint total = 0;
+  for ( guint rr = 0; rr < mbe->ranges->len; rr++ ) {
+    MBTilesExportRange *range = &g_array_index ( mbe->ranges, MBTilesExportRange, rr );
+    total += (range->xf - range->ulm.x + 1) * (range->yf - range->ulm.y + 1);
+  }
+
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)mbtiles_export_read_tile, mbe, g_get_num_processors(), FALSE, NULL );
+  guint maxlen = strlen ( mbe->cache_dir ) + (mbe->map_name ? strlen ( mbe->map_name ) : 0) + strlen ( mbe->file_extension ) + TILE_PATH_EXTRA_LEN;
+  gchar *filename_buf = g_malloc ( maxlen );
+  guint n_tiles = 0;
+
+  for ( guint rr = 0; rr < mbe->ranges->len && result == 0 && !msg; rr++ ) {
+    MBTilesExportRange *range = &g_array_index ( mbe->ranges, MBTilesExportRange, rr );
+    MapCoord *ulm = &range->ulm;
+    gint zoom = 17 - ulm->scale;
+    gint max_y = (gint) pow(2, zoom)-1;
+    for ( gint xx = ulm->x; xx <= range->xf && result == 0 && !msg; xx++ ) {
+      for ( gint yy = ulm->y; yy <= range->yf && result == 0 && !msg; yy++ ) {
+        get_filename ( mbe->cache_dir, mbe->cache_layout, mbe->id, mbe->map_name,
+                       ulm->scale, ulm->z, xx, yy, filename_buf, maxlen, mbe->file_extension );
+        MBTilesExportTile *tile = &mbe->tiles[n_tiles++];
+        tile->filename = g_strdup ( filename_buf );
+        tile->zoom = zoom;
+        tile->x = xx;
+        tile->flip_y = max_y - yy;
+
+        if ( n_tiles == MBTILES_EXPORT_BATCH ) {
+          gint written = mbtiles_export_batch ( mbe, pool, n_tiles, mbtiles, sql_stmt, &msg );
+          if ( written > 0 )
+            num_written += written;
+          num_tiles += n_tiles;
+          n_tiles = 0;
+          if ( a_background_thread_progress ( threaddata, (gdouble)num_tiles/(gdouble)total ) != 0 )
+            result = -1;
+        }
+      }
+    }
+  }
+  if ( n_tiles ) {
+    gint written = mbtiles_export_batch ( mbe, pool, n_tiles, mbtiles, sql_stmt, &msg );
+    if ( written > 0 )
+      num_written += written;
+    num_tiles += n_tiles;
+  }
+
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  g_free ( filename_buf );
+  (void)sqlite3_finalize ( sql_stmt );
+
+ cleanup:
+  (void)sqlite3_close ( mbtiles );
+
+  if ( msg ) {
+    gchar *fullmsg = g_strdup_printf ( _("MBTiles file write problem: %s"), msg );
+    vik_window_statusbar_update ( mbe->vw, fullmsg, VIK_STATUSBAR_INFO );
+    g_free ( fullmsg );
+    g_free ( msg );
+  }
+  else if ( result == 0 ) {
+    gchar *fullmsg = g_strdup_printf ( _("Exported %d of %d tiles to %s"), num_written, num_tiles, mbe->fn );
+    vik_window_statusbar_update ( mbe->vw, fullmsg, VIK_STATUSBAR_INFO );
+    g_free ( fullmsg );
+  }
+
+  return result;
+}
+
+/**
+ * Export the cached tiles of the onscreen area, for the zoom levels specified by the user,
+ *  into a single MBTiles file
+ */
+static void maps_layer_export_mbtiles_cb ( menu_array_values values )
+{
+  VikMapsLayer *vml = VIK_MAPS_LAYER(values[MA_VML]);
+  VikViewport *vvp = VIK_VIEWPORT(values[MA_VVP]);
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+
+  gchar *zoom_list[] = {"0.25", "0.5", "1", "2", "4", "8", "16", "32", "64", "128", "256", "512", "1024", "2048", "4096", "8192", NULL };
+  gdouble zoom_vals[] = {0.25, 0.5, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192};
+  gint n_zooms = sizeof(zoom_vals)/sizeof(gdouble);
+
+  gint default_zoom;
+  gdouble cur_zoom = vik_viewport_get_zoom(vvp);
+  for ( default_zoom = 0; default_zoom < n_zooms-1; default_zoom++ ) {
+    if ( cur_zoom <= zoom_vals[default_zoom] )
+      break;
+  }
+
+  gint selected_zoom1, selected_zoom2;
+  gchar *title = g_strdup_printf ( ("%s: %s"), vik_maps_layer_get_map_label (vml), _("Export to MBTiles") );
+  gboolean ok = maps_dialog_zoom_between ( VIK_GTK_WINDOW_FROM_LAYER(vml),
+                                           title,
+                                           zoom_list,
+                                           MAX(0, default_zoom-2),
+                                           default_zoom,
+                                           &selected_zoom1,
+                                           &selected_zoom2,
+                                           NULL,
+                                           0,
+                                           NULL );
+  g_free ( title );
+  if ( !ok )
+    return;
+
+  gchar *fn = NULL;
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export"),
+                                                    VIK_GTK_WINDOW_FROM_LAYER(vml),
+                                                    GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                    GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gchar *name = g_strdup_printf ( "%s.mbtiles", vik_layer_get_name(VIK_LAYER(vml)) );
+  gtk_file_chooser_set_current_name ( GTK_FILE_CHOOSER(dialog), name );
+  g_free ( name );
+
+  while ( gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT ) {
+    fn = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+    if ( g_file_test(fn, G_FILE_TEST_EXISTS) == FALSE || a_dialog_yes_or_no ( GTK_WINDOW(dialog), _("The file \"%s\" exists, do you wish to overwrite it?"), a_file_basename ( fn ) ) )
+      break;
+    g_free ( fn );
+    fn = NULL;
+  }
+  gtk_widget_destroy ( dialog );
+
+  if ( !fn )
+    return;
+
+  MBTilesExport *mbe = g_new0 ( MBTilesExport, 1 );
+  mbe->fn = fn;
+  mbe->cache_dir = g_strdup ( vml->cache_dir );
+  mbe->cache_layout = vml->cache_layout;
+  mbe->id = vik_map_source_get_uniq_id ( map );
+  mbe->map_name = g_strdup ( vik_map_source_get_name ( map ) );
+  const gchar *extension = vik_map_source_get_file_extension ( map );
+  mbe->file_extension = g_strdup ( extension ? extension : "" );
+  mbe->format = g_strdup ( (extension && extension[0] == '.' && extension[1]) ? extension+1 : "png" );
+  mbe->name = g_strdup ( vik_layer_get_name(VIK_LAYER(vml)) );
+  mbe->vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vml));
+  mbe->ranges = g_array_new ( FALSE, FALSE, sizeof(MBTilesExportRange) );
+  g_mutex_init ( &mbe->mutex );
+  g_cond_init ( &mbe->cond );
+
+  // The onscreen area
+  gdouble min_lat, max_lat, min_lon, max_lon;
+  VikCoord vc_ul, vc_br;
+  vik_viewport_get_min_max_lat_lon ( vvp, &min_lat, &max_lat, &min_lon, &max_lon );
+  mbe->ll_ul = (struct LatLon){ max_lat, min_lon };
+  mbe->ll_br = (struct LatLon){ min_lat, max_lon };
+  vik_coord_load_from_latlon ( &vc_ul, vik_viewport_get_coord_mode (vvp), &mbe->ll_ul );
+  vik_coord_load_from_latlon ( &vc_br, vik_viewport_get_coord_mode (vvp), &mbe->ll_br );
+
+  guint total = 0;
+  mbe->minzoom = G_MAXINT;
+  mbe->maxzoom = G_MININT;
+  for ( gint zz = MIN(selected_zoom1, selected_zoom2); zz <= MAX(selected_zoom1, selected_zoom2); zz++ ) {
+    MapCoord ulm, brm;
+    if ( !vik_map_source_coord_to_mapcoord ( map, &vc_ul, zoom_vals[zz], zoom_vals[zz], &ulm ) ||
+         !vik_map_source_coord_to_mapcoord ( map, &vc_br, zoom_vals[zz], zoom_vals[zz], &brm ) )
+      continue;
+    MBTilesExportRange range;
+    range.ulm = ulm;
+    range.ulm.x = MIN(ulm.x, brm.x);
+    range.ulm.y = MIN(ulm.y, brm.y);
+    range.xf = MAX(ulm.x, brm.x);
+    range.yf = MAX(ulm.y, brm.y);
+    g_array_append_val ( mbe->ranges, range );
+    total += (range.xf - range.ulm.x + 1) * (range.yf - range.ulm.y + 1);
+    mbe->minzoom = MIN ( mbe->minzoom, 17 - ulm.scale );
+    mbe->maxzoom = MAX ( mbe->maxzoom, 17 - ulm.scale );
+  }
+
+  if ( !mbe->ranges->len ) {
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vml), _("No tiles to export for these zoom levels") );
+    mbtiles_export_free ( mbe );
+    return;
+  }
+
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vml),
+                        _("Exporting Maps to MBTiles File"),
+                        (vik_thr_func)mbtiles_export_thread,
+                        mbe,
+                        (vik_thr_free_func)mbtiles_export_free,
+                        NULL,
+                        total );
+}
+#endif
+
 /**
  * Toggle display of cache status
+ * When turned on, also report how much disk space the cache is using
  */
 static void maps_layer_cache_status_cb ( menu_array_values values )
 {
   VikMapsLayer *vml = VIK_MAPS_LAYER(values[MA_VML]);
   vml->show_cache_status_overlay = !vml->show_cache_status_overlay;
   vik_layer_emit_update ( VIK_LAYER(vml), FALSE );
+
+  gchar *dir = maps_layer_tile_dir ( vml );
+  if ( !dir || !vml->show_cache_status_overlay ) {
+    g_free ( dir );
+    return;
+  }
+
+  VikWindow *vw = (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml);
+  guint64 budget = maps_layer_cache_budget ( vml );
+  guint64 bytes = 0;
+  guint files = 0;
+  if ( a_cachejanitor_get_usage ( dir, &bytes, &files ) ) {
+    gchar *size = g_format_size ( bytes );
+    gchar *msg;
+    if ( budget ) {
+      gchar *limit = g_format_size ( budget );
+      msg = g_strdup_printf ( _("Map cache %s: %s in %u tiles (limit %s)"), dir, size, files, limit );
+      g_free ( limit );
+    }
+    else
+      msg = g_strdup_printf ( _("Map cache %s: %s in %u tiles"), dir, size, files );
+    vik_statusbar_set_message ( vik_window_get_statusbar(vw), VIK_STATUSBAR_INFO, msg );
+    g_free ( msg );
+    g_free ( size );
+    // Refresh it in the background (when due)
+    a_cachejanitor_check ( dir, budget, vw, FALSE );
+  }
+  else
+    // Measure it now
+    a_cachejanitor_check ( dir, budget, vw, TRUE );
+  g_free ( dir );
 }
 
 /**
@@ -2963,6 +4738,11 @@ static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLay
     (void)vu_menu_add_item ( menu, _("Reload _All Onscreen Maps"), GTK_STOCK_REFRESH, G_CALLBACK(maps_layer_redownload_all_onscreen_maps), values );
     (void)vu_menu_add_item ( menu, _("Download Maps in _Zoom Levels..."), GTK_STOCK_DND_MULTIPLE, G_CALLBACK(maps_layer_download_all), values );
     (void)vu_menu_add_item ( menu, _("_Toggle Display of Cache Status"), GTK_STOCK_INFO, G_CALLBACK(maps_layer_cache_status_cb), values );
+#ifdef HAVE_SQLITE3_H
+    // MBTiles uses the same tiling scheme
+    if ( vik_map_source_get_drawmode(map) == VIK_VIEWPORT_DRAWMODE_MERCATOR )
+      (void)vu_menu_add_item ( menu, _("_Export Cached Maps to MBTiles..."), GTK_STOCK_CONVERT, G_CALLBACK(maps_layer_export_mbtiles_cb), values );
+#endif
   }
 
 #ifdef HAVE_SQLITE3_H
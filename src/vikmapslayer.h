@@ -50,6 +50,7 @@ typedef struct _VikMapsLayer VikMapsLayer;
 typedef enum {
   VIK_MAPS_CACHE_LAYOUT_VIKING=0, // CacheDir/t<MapId>s<VikingZoom>z0/X/Y (NB no file extension) - Legacy default layout
   VIK_MAPS_CACHE_LAYOUT_OSM,      // CacheDir/<OptionalMapName>/OSMZoomLevel/X/Y.ext (Default ext=png)
+  VIK_MAPS_CACHE_LAYOUT_BUNDLE,   // CacheDir/<OptionalMapName>/OSMZoomLevel/BX_BY.bundle - Blocks of tiles packed into a file each
   VIK_MAPS_CACHE_LAYOUT_NUM       // Last enum
 } VikMapsCacheLayout;
 
@@ -65,6 +66,7 @@ void maps_layer_set_cache_default ( VikMapsCacheLayout layout );
 guint vik_maps_layer_get_default_map_type ();
 void maps_layer_register_map_source ( VikMapSource *map );
 void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom );
+void vik_maps_layer_download_corridor ( VikMapsLayer *vml, VikViewport *vvp, GList *coords, gdouble radius, const gdouble *zooms, guint n_zooms );
 guint vik_maps_layer_get_map_type(VikMapsLayer *vml);
 void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type);
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml);
@@ -73,6 +75,17 @@ void vik_maps_layer_download ( VikMapsLayer *vml, VikViewport *vvp, gboolean onl
 
 void vik_maps_layer_info_dialog ( GtkWindow *parent );
 
+gboolean maps_dialog_zoom_between ( GtkWindow *parent,
+                                    gchar *title,
+                                    gchar *zoom_list[],
+                                    gint default_zoom1,
+                                    gint default_zoom2,
+                                    gint *selected_zoom1,
+                                    gint *selected_zoom2,
+                                    gchar *download_list[],
+                                    gint default_download,
+                                    gint *selected_download );
+
 G_END_DECLS
 
 #endif
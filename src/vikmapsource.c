@@ -70,6 +70,7 @@ vik_map_source_class_init (VikMapSourceClass *klass)
 	klass->get_tilesize_x = NULL;
 	klass->get_tilesize_y = NULL;
 	klass->get_scale = NULL;
+	klass->get_tile_scale = NULL;
 	klass->get_drawmode = NULL;
 	klass->is_direct_file_access = NULL;
 	klass->is_mbtiles = NULL;
@@ -85,6 +86,7 @@ vik_map_source_class_init (VikMapSourceClass *klass)
 	klass->coord_to_mapcoord = NULL;
 	klass->mapcoord_to_center_coord = NULL;
 	klass->download = NULL;
+	klass->download_multi = NULL;
 	klass->download_handle_init = NULL;
 	klass->download_handle_cleanup = NULL;
 
@@ -238,6 +240,29 @@ vik_map_source_get_scale (VikMapSource *self)
 	return (*klass->get_scale)(self);
 }
 
+/**
+ * vik_map_source_get_tile_scale:
+ * @vp_scale: The scale of the viewport the tiles are for
+ *
+ * For map sources that offer tiles at several resolutions,
+ *  the MapCoord z value selects which one (as set by the maps layer from this).
+ *
+ * Returns: The resolution of the tiles to use, relative to the normal tiles
+ */
+guint
+vik_map_source_get_tile_scale (VikMapSource *self, guint vp_scale)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, 1);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), 1);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->get_tile_scale == NULL)
+		return 1;
+
+	return (*klass->get_tile_scale)(self, vp_scale);
+}
+
 VikViewportDrawMode
 vik_map_source_get_drawmode (VikMapSource *self)
 {
@@ -503,6 +528,35 @@ vik_map_source_download (VikMapSource * self, MapCoord * src, const gchar * dest
 	return (*klass->download)(self, src, dest_fn, handle);
 }
 
+/**
+ * vik_map_source_download_multi:
+ * @self:     The VikMapSource of interest.
+ * @srcs:     The map locations to download
+ * @dest_fns: The filenames to save each result in
+ * @results:  Returns how successful each download was as per the type #DownloadResult_t
+ * @count:    The number of locations
+ * @handle:   Potential reusable Curl Handle (may be NULL)
+ *
+ * Download several tiles, concurrently if the map source supports it
+ */
+void
+vik_map_source_download_multi (VikMapSource * self, MapCoord * srcs, const gchar ** dest_fns, DownloadResult_t * results, guint count, void *handle)
+{
+	VikMapSourceClass *klass;
+	g_return_if_fail (self != NULL);
+	g_return_if_fail (VIK_IS_MAP_SOURCE (self));
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->download_multi != NULL) {
+		(*klass->download_multi)(self, srcs, dest_fns, results, count, handle);
+		return;
+	}
+
+	// Otherwise one at a time
+	for (guint ii = 0; ii < count; ii++)
+		results[ii] = vik_map_source_download (self, &srcs[ii], dest_fns[ii], handle);
+}
+
 void *
 vik_map_source_download_handle_init (VikMapSource *self)
 {
@@ -528,3 +582,38 @@ vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle)
 
 	(*klass->download_handle_cleanup)(self, handle);
 }
+
+/**
+ * vik_map_source_renders_tiles:
+ *
+ * Returns: Whether the tile files are data to be drawn by the map source,
+ *  rather than images
+ */
+gboolean
+vik_map_source_renders_tiles (VikMapSource * self)
+{
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), FALSE);
+	return VIK_MAP_SOURCE_GET_CLASS(self)->render_tile != NULL;
+}
+
+/**
+ * vik_map_source_render_tile:
+ * @self:  The VikMapSource of interest.
+ * @bytes: The contents of the tile file
+ * @src:   The map location of the tile
+ * @scale: The viewport scale, as the tile is drawn at its tile size times this
+ *
+ * Returns: The drawn tile, or NULL with @error set
+ */
+GdkPixbuf *
+vik_map_source_render_tile (VikMapSource * self, GBytes * bytes, MapCoord * src, guint scale, GError ** error)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, NULL);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), NULL);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	g_return_val_if_fail (klass->render_tile != NULL, NULL);
+
+	return (*klass->render_tile)(self, bytes, src, scale, error);
+}
@@ -56,6 +56,7 @@ struct _VikMapSourceClass
 	guint16 (* get_tilesize_x) (VikMapSource * self);
 	guint16 (* get_tilesize_y) (VikMapSource * self);
 	gdouble (* get_scale) (VikMapSource * self);
+	guint (* get_tile_scale) (VikMapSource * self, guint vp_scale);
 	VikViewportDrawMode (* get_drawmode) (VikMapSource * self);
 	gboolean (* is_direct_file_access) (VikMapSource * self);
 	gboolean (* is_mbtiles) (VikMapSource * self);
@@ -73,8 +74,10 @@ struct _VikMapSourceClass
 	gboolean (* coord_to_mapcoord) (VikMapSource * self, const VikCoord * src, gdouble xzoom, gdouble yzoom, MapCoord * dest);
 	void (* mapcoord_to_center_coord) (VikMapSource * self, MapCoord * src, VikCoord * dest);
 	int (* download) (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
+	void (* download_multi) (VikMapSource * self, MapCoord * srcs, const gchar ** dest_fns, DownloadResult_t * results, guint count, void * handle);
 	void * (* download_handle_init) (VikMapSource * self);
 	void (* download_handle_cleanup) (VikMapSource * self, void * handle);
+	GdkPixbuf * (* render_tile) (VikMapSource * self, GBytes * bytes, MapCoord * src, guint scale, GError ** error);
 };
 
 struct _VikMapSource
@@ -95,6 +98,7 @@ const gchar *vik_map_source_get_label (VikMapSource * self);
 guint16 vik_map_source_get_tilesize_x (VikMapSource * self);
 guint16 vik_map_source_get_tilesize_y (VikMapSource * self);
 gdouble vik_map_source_get_scale (VikMapSource * self);
+guint vik_map_source_get_tile_scale (VikMapSource * self, guint vp_scale);
 VikViewportDrawMode vik_map_source_get_drawmode (VikMapSource * self);
 gboolean vik_map_source_is_direct_file_access (VikMapSource * self);
 gboolean vik_map_source_is_mbtiles (VikMapSource * self);
@@ -112,8 +116,11 @@ gdouble vik_map_source_get_offset_y (VikMapSource *self);
 gboolean vik_map_source_coord_to_mapcoord (VikMapSource * self, const VikCoord *src, gdouble xzoom, gdouble yzoom, MapCoord *dest );
 void vik_map_source_mapcoord_to_center_coord (VikMapSource * self, MapCoord *src, VikCoord *dest);
 DownloadResult_t vik_map_source_download (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
+void vik_map_source_download_multi (VikMapSource * self, MapCoord * srcs, const gchar ** dest_fns, DownloadResult_t * results, guint count, void * handle);
 void * vik_map_source_download_handle_init (VikMapSource * self);
 void vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle);
+gboolean vik_map_source_renders_tiles (VikMapSource * self);
+GdkPixbuf * vik_map_source_render_tile (VikMapSource * self, GBytes * bytes, MapCoord * src, guint scale, GError ** error);
 
 G_END_DECLS
 
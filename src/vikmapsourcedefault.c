@@ -48,6 +48,7 @@ static gdouble map_source_get_offset_x (VikMapSource *self);
 static gdouble map_source_get_offset_y (VikMapSource *self);
 
 static DownloadResult_t _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle );
+static void _download_multi ( VikMapSource *self, MapCoord *srcs, const gchar **dest_fns, DownloadResult_t *results, guint count, void *handle );
 static void * _download_handle_init ( VikMapSource *self );
 static void _download_handle_cleanup ( VikMapSource *self, void *handle );
 
@@ -306,6 +307,7 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	parent_class->get_offset_x = map_source_get_offset_x;
 	parent_class->get_offset_y = map_source_get_offset_y;
 	parent_class->download =                 _download;
+	parent_class->download_multi =           _download_multi;
 	parent_class->download_handle_init =     _download_handle_init;
 	parent_class->download_handle_cleanup =  _download_handle_cleanup;
 
@@ -544,6 +546,9 @@ _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handl
    gchar *uri = vik_map_source_default_get_uri(VIK_MAP_SOURCE_DEFAULT(self), src);
    gchar *host = vik_map_source_default_get_hostname(VIK_MAP_SOURCE_DEFAULT(self));
    DownloadFileOptions *options = vik_map_source_default_get_download_options(VIK_MAP_SOURCE_DEFAULT(self), src);
+   // Tiles can be shown without waiting for them to be written
+   if ( options )
+      options->in_memory = TRUE;
    DownloadResult_t res = a_http_download_get_url ( host, uri, dest_fn, options, handle );
    a_download_file_options_free ( options );
    g_free ( uri );
@@ -551,6 +556,28 @@ _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handl
    return res;
 }
 
+static void
+_download_multi ( VikMapSource *self, MapCoord *srcs, const gchar **dest_fns, DownloadResult_t *results, guint count, void *handle )
+{
+   DownloadRequest *requests = g_new0 ( DownloadRequest, count );
+   for ( guint ii = 0; ii < count; ii++ ) {
+      requests[ii].uri = vik_map_source_default_get_uri(VIK_MAP_SOURCE_DEFAULT(self), &srcs[ii]);
+      requests[ii].hostname = vik_map_source_default_get_hostname(VIK_MAP_SOURCE_DEFAULT(self));
+      requests[ii].fn = dest_fns[ii];
+      requests[ii].options = vik_map_source_default_get_download_options(VIK_MAP_SOURCE_DEFAULT(self), &srcs[ii]);
+      if ( requests[ii].options )
+         requests[ii].options->in_memory = TRUE;
+   }
+   a_http_download_get_urls ( requests, count, handle );
+   for ( guint ii = 0; ii < count; ii++ ) {
+      results[ii] = requests[ii].result;
+      a_download_file_options_free ( requests[ii].options );
+      g_free ( (gchar*)requests[ii].uri );
+      g_free ( (gchar*)requests[ii].hostname );
+   }
+   g_free ( requests );
+}
+
 static const gchar *
 map_source_get_file_extension (VikMapSource *self)
 {
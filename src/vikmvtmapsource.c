@@ -0,0 +1,184 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+ /**
+  * SECTION:vikmvtmapsource
+  * @short_description: the class for map sources of vector tiles
+  *
+  * The #VikMVTMapSource class handles slippy map tiles in the Mapbox Vector Tile format.
+  * https://github.com/mapbox/vector-tile-spec
+  *
+  * The tiles are downloaded as for #VikSlippyMapSource,
+  *  and drawn when read according to a simple style file (see vectortile.c),
+  *  at the size needed for the viewport scale.
+  * So one download serves any screen resolution.
+  */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vikmvtmapsource.h"
+#include "vectortile.h"
+#include "dir.h"
+#include "vik_compat.h"
+
+static GdkPixbuf *_render_tile ( VikMapSource *self, GBytes *bytes, MapCoord *src, guint scale, GError **error );
+
+typedef struct _VikMVTMapSourcePrivate VikMVTMapSourcePrivate;
+struct _VikMVTMapSourcePrivate
+{
+  gchar *style_file;
+  GMutex *mutex;
+  VikVectorTileStyle *style; // Read when first needed
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikMVTMapSource, vik_mvt_map_source, VIK_TYPE_SLIPPY_MAP_SOURCE);
+#define VIK_MVT_MAP_SOURCE_PRIVATE(o)  (vik_mvt_map_source_get_instance_private (VIK_MVT_MAP_SOURCE(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_STYLE,
+};
+
+static void
+vik_mvt_map_source_init (VikMVTMapSource *self)
+{
+  VikMVTMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (self);
+
+  priv->style_file = NULL;
+  priv->mutex = vik_mutex_new ();
+  priv->style = NULL;
+}
+
+static void
+vik_mvt_map_source_finalize (GObject *object)
+{
+  VikMVTMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  g_free ( priv->style_file );
+  priv->style_file = NULL;
+  vik_vector_tile_style_free ( priv->style );
+  priv->style = NULL;
+  vik_mutex_free ( priv->mutex );
+
+  G_OBJECT_CLASS (vik_mvt_map_source_parent_class)->finalize (object);
+}
+
+static void
+vik_mvt_map_source_set_property (GObject      *object,
+                                 guint         property_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  VikMVTMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_STYLE:
+      g_free (priv->style_file);
+      priv->style_file = g_value_dup_string (value);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_mvt_map_source_get_property (GObject    *object,
+                                 guint       property_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  VikMVTMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_STYLE:
+      g_value_set_string (value, priv->style_file);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_mvt_map_source_class_init (VikMVTMapSourceClass *klass)
+{
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+	VikMapSourceClass* map_source_class = VIK_MAP_SOURCE_CLASS (klass);
+	GParamSpec *pspec = NULL;
+
+	object_class->set_property = vik_mvt_map_source_set_property;
+	object_class->get_property = vik_mvt_map_source_get_property;
+	object_class->finalize = vik_mvt_map_source_finalize;
+
+	map_source_class->render_tile = _render_tile;
+
+	pspec = g_param_spec_string ("style",
+	                             "Style",
+	                             "The style file to draw the tiles with (relative to the Viking configuration directory unless absolute)",
+	                             NULL /* default value */,
+	                             G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_STYLE, pspec);
+}
+
+/**
+ * Returns the style, reading it if not yet done
+ */
+static VikVectorTileStyle *get_style ( VikMVTMapSourcePrivate *priv )
+{
+  g_mutex_lock ( priv->mutex );
+  if ( !priv->style ) {
+    if ( priv->style_file ) {
+      gchar *filename = g_path_is_absolute ( priv->style_file ) ?
+        g_strdup ( priv->style_file ) :
+        g_build_filename ( a_get_viking_dir(), priv->style_file, NULL );
+      GError *error = NULL;
+      priv->style = vik_vector_tile_style_new_from_file ( filename, &error );
+      if ( error ) {
+        g_warning ( "%s: Unable to read vector tile style %s: %s", __FUNCTION__, filename, error->message );
+        g_error_free ( error );
+      }
+      g_free ( filename );
+    }
+    if ( !priv->style )
+      priv->style = vik_vector_tile_style_new_default ();
+  }
+  g_mutex_unlock ( priv->mutex );
+  return priv->style;
+}
+
+static GdkPixbuf *
+_render_tile ( VikMapSource *self, GBytes *bytes, MapCoord *src, guint scale, GError **error )
+{
+	VikMVTMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (self);
+	VikVectorTileStyle *style = get_style ( priv );
+	guint size = vik_map_source_get_tilesize_x (self) * MAX(scale, 1);
+	return vik_vector_tile_render ( style, bytes, 17 - src->scale, size, error );
+}
@@ -0,0 +1,524 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+ /**
+  * SECTION:vikpmtilesmapsource
+  * @short_description: the class for map sources read from a PMTiles archive
+  *
+  * The #VikPMTilesMapSource class handles slippy map tiles stored in a single
+  * PMTiles (version 3) archive on a web server, read via HTTP range requests.
+  * So the server only needs to serve a static file.
+  * https://github.com/protomaps/PMTiles/blob/main/spec/v3/spec.md
+  *
+  * The archive header and root directory are read once and kept,
+  *  as are recently used leaf directories.
+  * Tiles wanted at the same time that are near each other in the archive
+  *  are read with a single request.
+  */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vikpmtilesmapsource.h"
+#include "background.h"
+#include "compression.h"
+#include "curl_download.h"
+#include "tilebundle.h"
+#include "tileindex.h"
+#include "vik_compat.h"
+
+#define PMTILES_HEADER_LEN 127
+// The header and root directory are always within the first 16K of the archive
+#define PMTILES_FIRST_READ 16384
+#define PMTILES_MAX_DEPTH 4
+#define PMTILES_MAX_LEAVES 256
+// Unwanted bytes between tiles that is still cheaper to read than making another request
+#define PMTILES_MAX_GAP 65536
+#define PMTILES_MAX_READ (4*1024*1024)
+
+enum {
+  PMTILES_COMPRESSION_UNKNOWN = 0,
+  PMTILES_COMPRESSION_NONE,
+  PMTILES_COMPRESSION_GZIP,
+};
+
+static gboolean _supports_download_only_new ( VikMapSource *self );
+static DownloadResult_t _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle );
+static void _download_multi ( VikMapSource *self, MapCoord *srcs, const gchar **dest_fns, DownloadResult_t *results, guint count, void *handle );
+
+typedef struct {
+  guint64 tile_id;
+  guint64 offset;
+  guint32 length;
+  guint32 run_length; // 0 when the entry is of a leaf directory
+} PMTilesEntry;
+
+typedef struct {
+  PMTilesEntry *entries;
+  guint count;
+} PMTilesDirectory;
+
+typedef struct _VikPMTilesMapSourcePrivate VikPMTilesMapSourcePrivate;
+struct _VikPMTilesMapSourcePrivate
+{
+  GMutex *mutex;
+  gboolean have_header;
+  guint8 internal_compression;
+  guint8 tile_compression;
+  guint64 leaf_dirs_offset;
+  guint64 tile_data_offset;
+  PMTilesDirectory *root;
+  GHashTable *leaves; // Archive offset -> PMTilesDirectory
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikPMTilesMapSource, vik_pmtiles_map_source, VIK_TYPE_SLIPPY_MAP_SOURCE);
+#define VIK_PMTILES_MAP_SOURCE_PRIVATE(o)  (vik_pmtiles_map_source_get_instance_private (VIK_PMTILES_MAP_SOURCE(o)))
+
+static void directory_free ( PMTilesDirectory *dir )
+{
+  if ( !dir )
+    return;
+  g_free ( dir->entries );
+  g_free ( dir );
+}
+
+static void
+vik_pmtiles_map_source_init (VikPMTilesMapSource *self)
+{
+  VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE (self);
+
+  priv->mutex = vik_mutex_new ();
+  priv->have_header = FALSE;
+  priv->root = NULL;
+  priv->leaves = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)directory_free );
+}
+
+static void
+vik_pmtiles_map_source_finalize (GObject *object)
+{
+  VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE (object);
+
+  directory_free ( priv->root );
+  priv->root = NULL;
+  g_hash_table_destroy ( priv->leaves );
+  priv->leaves = NULL;
+  vik_mutex_free ( priv->mutex );
+
+  G_OBJECT_CLASS (vik_pmtiles_map_source_parent_class)->finalize (object);
+}
+
+static void
+vik_pmtiles_map_source_class_init (VikPMTilesMapSourceClass *klass)
+{
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+	VikMapSourceClass* map_source_class = VIK_MAP_SOURCE_CLASS (klass);
+
+	object_class->finalize = vik_pmtiles_map_source_finalize;
+
+	/* The tiles come from the archive rather than a URL each */
+	map_source_class->supports_download_only_new = _supports_download_only_new;
+	map_source_class->download = _download;
+	map_source_class->download_multi = _download_multi;
+}
+
+static gboolean
+_supports_download_only_new ( VikMapSource *self )
+{
+	// No per tile times to check against
+	return FALSE;
+}
+
+static guint64 read_u64 ( const guint8 *data )
+{
+  guint64 value;
+  memcpy ( &value, data, sizeof(value) );
+  return GUINT64_FROM_LE ( value );
+}
+
+static gboolean read_varint ( const guint8 **pos, const guint8 *end, guint64 *value )
+{
+  guint64 ans = 0;
+  for ( guint shift = 0; shift < 64 && *pos < end; shift += 7 ) {
+    guint8 byte = *(*pos)++;
+    ans |= (guint64)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) ) {
+      *value = ans;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Tile IDs run along a Hilbert curve at each zoom level, after all the IDs of the lower zoom levels
+ */
+static guint64 zxy_to_tile_id ( guint z, guint64 x, guint64 y )
+{
+  guint64 n = G_GUINT64_CONSTANT(1) << z;
+  guint64 acc = ( n * n - 1 ) / 3;
+  guint64 d = 0;
+  for ( guint64 s = n / 2; s > 0; s /= 2 ) {
+    guint rx = (x & s) ? 1 : 0;
+    guint ry = (y & s) ? 1 : 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant
+    if ( ry == 0 ) {
+      if ( rx == 1 ) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      guint64 tmp = x;
+      x = y;
+      y = tmp;
+    }
+  }
+  return acc + d;
+}
+
+/**
+ * Returns the data in its uncompressed form (maybe NULL)
+ */
+static GBytes *decompress ( GBytes *bytes, guint8 compression )
+{
+  if ( compression == PMTILES_COMPRESSION_GZIP ) {
+    gsize size = 0;
+    gconstpointer data = g_bytes_get_data ( bytes, &size );
+    gulong unzip_size = 0;
+    void *unzipped = ungzip_file ( (gchar*)data, size, &unzip_size );
+    return unzipped ? g_bytes_new_take ( unzipped, unzip_size ) : NULL;
+  }
+  return g_bytes_ref ( bytes );
+}
+
+static PMTilesDirectory *directory_parse ( GBytes *bytes )
+{
+  gsize len = 0;
+  const guint8 *pos = g_bytes_get_data ( bytes, &len );
+  const guint8 *end = pos + len;
+  guint64 count = 0;
+  // Each entry takes at least four bytes
+  if ( !read_varint ( &pos, end, &count ) || count > len / 4 )
+    return NULL;
+
+  PMTilesDirectory *dir = g_new0 ( PMTilesDirectory, 1 );
+  dir->count = count;
+  dir->entries = g_new0 ( PMTilesEntry, dir->count );
+  guint64 value = 0;
+  guint64 tile_id = 0;
+  for ( guint ii = 0; ii < dir->count; ii++ ) {
+    if ( !read_varint ( &pos, end, &value ) )
+      goto fail;
+    tile_id += value;
+    dir->entries[ii].tile_id = tile_id;
+  }
+  for ( guint ii = 0; ii < dir->count; ii++ ) {
+    if ( !read_varint ( &pos, end, &value ) )
+      goto fail;
+    dir->entries[ii].run_length = value;
+  }
+  for ( guint ii = 0; ii < dir->count; ii++ ) {
+    if ( !read_varint ( &pos, end, &value ) )
+      goto fail;
+    dir->entries[ii].length = value;
+  }
+  for ( guint ii = 0; ii < dir->count; ii++ ) {
+    if ( !read_varint ( &pos, end, &value ) )
+      goto fail;
+    // Zero means straight after the previous entry
+    if ( value == 0 && ii > 0 )
+      dir->entries[ii].offset = dir->entries[ii-1].offset + dir->entries[ii-1].length;
+    else
+      dir->entries[ii].offset = value - 1;
+  }
+  return dir;
+
+ fail:
+  directory_free ( dir );
+  return NULL;
+}
+
+/**
+ * Returns the entry either covering the tile or of the leaf directory that may hold it
+ */
+static const PMTilesEntry *directory_find ( const PMTilesDirectory *dir, guint64 tile_id )
+{
+  // Find the last entry starting at or before the tile
+  guint lo = 0;
+  guint hi = dir->count;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( dir->entries[mid].tile_id <= tile_id )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if ( lo == 0 )
+    return NULL;
+
+  const PMTilesEntry *entry = &dir->entries[lo-1];
+  if ( entry->run_length == 0 || tile_id < entry->tile_id + entry->run_length )
+    return entry;
+  return NULL;
+}
+
+/**
+ * Read part of the archive
+ */
+static GBytes *fetch ( VikPMTilesMapSource *self, guint64 offset, guint64 length, void *handle )
+{
+  gchar *hostname = NULL;
+  gchar *url = NULL;
+  g_object_get ( self, "hostname", &hostname, "url", &url, NULL );
+
+  GBytes *ans = NULL;
+  gchar *full = curl_download_make_url ( hostname, url, FALSE );
+  if ( full ) {
+    DownloadFileOptions *options = vik_map_source_default_get_download_options ( VIK_MAP_SOURCE_DEFAULT(self), NULL );
+    ans = curl_download_get_range ( full, offset, length, options, handle );
+    a_download_file_options_free ( options );
+    g_free ( full );
+  }
+  g_free ( url );
+  g_free ( hostname );
+  return ans;
+}
+
+static PMTilesDirectory *fetch_directory ( VikPMTilesMapSource *self, guint64 offset, guint64 length, void *handle )
+{
+  VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE(self);
+  GBytes *bytes = fetch ( self, offset, length, handle );
+  if ( !bytes )
+    return NULL;
+
+  PMTilesDirectory *dir = NULL;
+  GBytes *raw = decompress ( bytes, priv->internal_compression );
+  if ( raw ) {
+    dir = directory_parse ( raw );
+    g_bytes_unref ( raw );
+  }
+  g_bytes_unref ( bytes );
+  if ( !dir )
+    g_warning ( "%s: Invalid directory at %" G_GUINT64_FORMAT, __FUNCTION__, offset );
+  return dir;
+}
+
+/**
+ * Read the header and root directory
+ * Call with the mutex held
+ */
+static gboolean load_header ( VikPMTilesMapSource *self, void *handle )
+{
+  VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE(self);
+  GBytes *bytes = fetch ( self, 0, PMTILES_FIRST_READ, handle );
+  if ( !bytes )
+    return FALSE;
+
+  gsize len = 0;
+  const guint8 *data = g_bytes_get_data ( bytes, &len );
+  if ( len < PMTILES_HEADER_LEN || memcmp ( data, "PMTiles", 7 ) || data[7] != 3 ) {
+    g_warning ( "%s: Not a version 3 PMTiles archive", __FUNCTION__ );
+    g_bytes_unref ( bytes );
+    return FALSE;
+  }
+
+  guint64 root_offset = read_u64 ( data + 8 );
+  guint64 root_length = read_u64 ( data + 16 );
+  priv->leaf_dirs_offset = read_u64 ( data + 40 );
+  priv->tile_data_offset = read_u64 ( data + 56 );
+  priv->internal_compression = data[97];
+  priv->tile_compression = data[98];
+
+  if ( priv->internal_compression > PMTILES_COMPRESSION_GZIP || priv->tile_compression > PMTILES_COMPRESSION_GZIP )
+    g_warning ( "%s: Unsupported compression %d/%d", __FUNCTION__, priv->internal_compression, priv->tile_compression );
+  else if ( root_offset > len || root_length > len - root_offset )
+    g_warning ( "%s: Root directory not at the start of the archive", __FUNCTION__ );
+  else {
+    GBytes *root = g_bytes_new_from_bytes ( bytes, root_offset, root_length );
+    GBytes *raw = decompress ( root, priv->internal_compression );
+    if ( raw ) {
+      priv->root = directory_parse ( raw );
+      g_bytes_unref ( raw );
+    }
+    g_bytes_unref ( root );
+    if ( priv->root )
+      priv->have_header = TRUE;
+    else
+      g_warning ( "%s: Invalid root directory", __FUNCTION__ );
+  }
+  g_bytes_unref ( bytes );
+  return priv->have_header;
+}
+
+/**
+ * Find the entry of a tile, descending through (and keeping) leaf directories as necessary
+ */
+static gboolean find_entry ( VikPMTilesMapSource *self, guint64 tile_id, void *handle, PMTilesEntry *found )
+{
+  VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE(self);
+  guint64 dir_offset = 0;
+  guint64 dir_length = 0;
+
+  for ( guint depth = 0; depth < PMTILES_MAX_DEPTH; depth++ ) {
+    const PMTilesEntry *entry = NULL;
+    // NB Copy the entry out, as another thread may drop the leaf once unlocked
+    g_mutex_lock ( priv->mutex );
+    PMTilesDirectory *dir = depth ? g_hash_table_lookup ( priv->leaves, &dir_offset ) : priv->root;
+    if ( dir && (entry = directory_find ( dir, tile_id )) )
+      *found = *entry;
+    g_mutex_unlock ( priv->mutex );
+
+    if ( !dir ) {
+      dir = fetch_directory ( self, dir_offset, dir_length, handle );
+      if ( !dir )
+        return FALSE;
+      if ( (entry = directory_find ( dir, tile_id )) )
+        *found = *entry;
+      g_mutex_lock ( priv->mutex );
+      if ( g_hash_table_size ( priv->leaves ) >= PMTILES_MAX_LEAVES )
+        g_hash_table_remove_all ( priv->leaves );
+      g_hash_table_insert ( priv->leaves, g_memdup ( &dir_offset, sizeof(dir_offset) ), dir );
+      g_mutex_unlock ( priv->mutex );
+    }
+
+    if ( !entry )
+      return FALSE;
+    if ( found->run_length )
+      return TRUE;
+    dir_offset = priv->leaf_dirs_offset + found->offset;
+    dir_length = found->length;
+  }
+  return FALSE;
+}
+
+static DownloadResult_t save_tile ( const gchar *dest_fn, GBytes *tile )
+{
+  gsize size = 0;
+  const guchar *data = g_bytes_get_data ( tile, &size );
+  if ( a_tilebundle_is_member ( dest_fn ) )
+    return a_tilebundle_put ( dest_fn, data, size, g_get_real_time() / G_USEC_PER_SEC ) ? DOWNLOAD_SUCCESS : DOWNLOAD_FILE_WRITE_ERROR;
+
+  gchar *dir = g_path_get_dirname ( dest_fn );
+  if ( g_mkdir_with_parents ( dir, 0777 ) != 0 )
+    g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+  g_free ( dir );
+
+  GError *error = NULL;
+  if ( !g_file_set_contents ( dest_fn, (const gchar*)data, size, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return DOWNLOAD_FILE_WRITE_ERROR;
+  }
+  a_tileindex_update ( dest_fn, NULL );
+  return DOWNLOAD_SUCCESS;
+}
+
+typedef struct {
+  guint index;
+  guint64 offset; // Within the archive
+  guint32 length;
+} PMTilesWanted;
+
+static gint wanted_compare ( gconstpointer a, gconstpointer b )
+{
+  const PMTilesWanted *wa = a;
+  const PMTilesWanted *wb = b;
+  return wa->offset < wb->offset ? -1 : wa->offset > wb->offset;
+}
+
+static void
+_download_multi ( VikMapSource *self, MapCoord *srcs, const gchar **dest_fns, DownloadResult_t *results, guint count, void *handle )
+{
+	VikPMTilesMapSource *pms = VIK_PMTILES_MAP_SOURCE(self);
+	VikPMTilesMapSourcePrivate *priv = VIK_PMTILES_MAP_SOURCE_PRIVATE(self);
+
+	g_mutex_lock ( priv->mutex );
+	gboolean have_header = priv->have_header || load_header ( pms, handle );
+	g_mutex_unlock ( priv->mutex );
+
+	PMTilesWanted *wanted = g_new ( PMTilesWanted, count );
+	guint nwanted = 0;
+	for ( guint ii = 0; ii < count; ii++ ) {
+		// Tiles not in the archive are treated as not found on the server
+		results[ii] = DOWNLOAD_HTTP_ERROR;
+		gint zoom = 17 - srcs[ii].scale;
+		if ( !have_header || zoom < 0 || zoom > 31 )
+			continue;
+		PMTilesEntry entry;
+		if ( find_entry ( pms, zxy_to_tile_id ( zoom, srcs[ii].x, srcs[ii].y ), handle, &entry ) ) {
+			wanted[nwanted].index = ii;
+			wanted[nwanted].offset = priv->tile_data_offset + entry.offset;
+			wanted[nwanted].length = entry.length;
+			nwanted++;
+		}
+	}
+	qsort ( wanted, nwanted, sizeof(PMTilesWanted), wanted_compare );
+
+	// Read tiles near each other in the archive with a single request
+	for ( guint first = 0; first < nwanted; ) {
+		guint64 start = wanted[first].offset;
+		guint64 end = start + wanted[first].length;
+		guint last = first + 1;
+		while ( last < nwanted && wanted[last].offset <= end + PMTILES_MAX_GAP &&
+		        MAX(end, wanted[last].offset + wanted[last].length) - start <= PMTILES_MAX_READ ) {
+			end = MAX ( end, wanted[last].offset + wanted[last].length );
+			last++;
+		}
+
+		GBytes *bytes = fetch ( pms, start, end - start, handle );
+		gsize size = bytes ? g_bytes_get_size ( bytes ) : 0;
+		gboolean aborted = !bytes && a_background_testcancel ( NULL );
+		for ( guint jj = first; jj < last; jj++ ) {
+			guint ii = wanted[jj].index;
+			if ( !bytes ) {
+				results[ii] = aborted ? DOWNLOAD_USER_ABORTED : DOWNLOAD_HTTP_ERROR;
+				continue;
+			}
+			guint64 pos = wanted[jj].offset - start;
+			if ( pos + wanted[jj].length > size ) {
+				results[ii] = DOWNLOAD_CONTENT_ERROR;
+				continue;
+			}
+			GBytes *data = g_bytes_new_from_bytes ( bytes, pos, wanted[jj].length );
+			GBytes *tile = decompress ( data, priv->tile_compression );
+			g_bytes_unref ( data );
+			if ( tile ) {
+				results[ii] = save_tile ( dest_fns[ii], tile );
+				g_bytes_unref ( tile );
+			}
+			else
+				results[ii] = DOWNLOAD_CONTENT_ERROR;
+		}
+		if ( bytes )
+			g_bytes_unref ( bytes );
+		first = last;
+	}
+	g_free ( wanted );
+}
+
+static DownloadResult_t
+_download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle )
+{
+	DownloadResult_t result;
+	_download_multi ( self, src, &dest_fn, &result, 1, handle );
+	return result;
+}
@@ -0,0 +1,286 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * Replaying tracks over time: a time cursor moves along and every track
+ *  shows where it was at that time, with a trail of where it has been.
+ *
+ * Drawing is in two parts. The trails only ever grow as the cursor moves on,
+ *  so each step just adds the new pieces on top of a kept copy of the drawing
+ *  (the viewport backdrop) which is then saved again.
+ * The position markers move, so are drawn on top of that each step.
+ * Only a full draw (e.g. when the view changes or on going back in time)
+ *  draws all the trails from the start.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "vikreplay.h"
+#include "ui_util.h"
+
+#define REPLAY_TRAIL_THICKNESS 3
+#define REPLAY_MARKER_SIZE 9
+
+typedef struct {
+  VikTrack *trk;
+  gdouble start;
+  gdouble end;
+  gdouble max_end; // Latest end of this and all the tracks that start before it
+  GdkColor color;
+  GdkGC *gc;
+} ReplayTrack;
+
+struct _VikReplay {
+  VikViewport *vvp;
+  GArray *tracks;    // ReplayTrack in order of their start time
+  gdouble first;     // When the first track starts
+  gdouble last;      // When the last track ends
+  gdouble time;      // The cursor
+  gdouble drawn;     // Trails are on the backdrop up until this time (NAN when not at all)
+};
+
+static gint replay_track_compare ( gconstpointer a, gconstpointer b )
+{
+  gdouble sa = ((const ReplayTrack*)a)->start;
+  gdouble sb = ((const ReplayTrack*)b)->start;
+  return (sa > sb) - (sa < sb);
+}
+
+/**
+ * vik_replay_new:
+ * @tracks: The #VikTrack to replay - only those with timestamps are used
+ *          (and they should not be packed)
+ *
+ * Returns: NULL if none of the tracks have times
+ */
+VikReplay *vik_replay_new ( VikViewport *vvp, GList *tracks )
+{
+  GArray *rts = g_array_new ( FALSE, FALSE, sizeof(ReplayTrack) );
+  for ( GList *iter = tracks; iter; iter = iter->next ) {
+    ReplayTrack rt = { VIK_TRACK(iter->data), NAN, NAN, NAN, { 0 }, NULL };
+    if ( !vik_track_get_time_span ( rt.trk, &rt.start, &rt.end ) )
+      continue;
+    if ( rt.trk->has_color )
+      rt.color = rt.trk->color;
+    // Held until the replay ends, which also stops the track being packed away
+    vik_track_ref ( rt.trk );
+    g_array_append_val ( rts, rt );
+  }
+  if ( !rts->len ) {
+    g_array_free ( rts, TRUE );
+    return NULL;
+  }
+
+  g_array_sort ( rts, replay_track_compare );
+  VikReplay *rp = g_malloc0 ( sizeof(VikReplay) );
+  rp->vvp = vvp;
+  rp->tracks = rts;
+  rp->first = g_array_index ( rts, ReplayTrack, 0 ).start;
+  rp->last = rp->first;
+  for ( guint ii = 0; ii < rts->len; ii++ ) {
+    ReplayTrack *rt = &g_array_index ( rts, ReplayTrack, ii );
+    rt->max_end = ii ? MAX ( rt->end, g_array_index(rts, ReplayTrack, ii-1).max_end ) : rt->end;
+    rp->last = MAX ( rp->last, rt->end );
+  }
+  rp->time = rp->first;
+  rp->drawn = NAN;
+  return rp;
+}
+
+static void replay_free_gcs ( VikReplay *rp )
+{
+  for ( guint ii = 0; ii < rp->tracks->len; ii++ ) {
+    ReplayTrack *rt = &g_array_index ( rp->tracks, ReplayTrack, ii );
+    if ( rt->gc )
+      ui_gc_unref ( rt->gc );
+    rt->gc = NULL;
+  }
+}
+
+void vik_replay_free ( VikReplay *rp )
+{
+  if ( !rp )
+    return;
+  replay_free_gcs ( rp );
+  for ( guint ii = 0; ii < rp->tracks->len; ii++ )
+    vik_track_free ( g_array_index(rp->tracks, ReplayTrack, ii).trk );
+  g_array_free ( rp->tracks, TRUE );
+  vik_viewport_backdrop_clear ( rp->vvp );
+  g_free ( rp );
+}
+
+void vik_replay_get_range ( VikReplay *rp, gdouble *first, gdouble *last )
+{
+  *first = rp->first;
+  *last = rp->last;
+}
+
+gdouble vik_replay_get_time ( VikReplay *rp )
+{
+  return rp->time;
+}
+
+/**
+ * The index of the first track starting after the time
+ */
+static guint replay_tracks_after ( VikReplay *rp, gdouble time )
+{
+  guint lo = 0, hi = rp->tracks->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( g_array_index(rp->tracks, ReplayTrack, mid).start <= time )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * The index of the first trackpoint time after the time
+ */
+static guint replay_times_after ( const VikTrackTimes *tt, gdouble time )
+{
+  guint lo = 0, hi = tt->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( tt->times[mid].timestamp <= time )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Returns: Whether the track was anywhere at the time (within a segment)
+ */
+static gboolean replay_position ( VikReplay *rp, ReplayTrack *rt, gdouble time, gint *x, gint *y )
+{
+  VikTrackPosition pos;
+  if ( !vik_track_get_position_at_time ( rt->trk, time, FALSE, &pos ) )
+    return FALSE;
+  VikCoord coord;
+  vik_coord_copy_convert ( &pos.coord, vik_viewport_get_coord_mode(rp->vvp), &coord );
+  vik_viewport_coord_to_screen ( rp->vvp, &coord, x, y );
+  return *x != VIK_VIEWPORT_UTM_WRONG_ZONE;
+}
+
+/**
+ * Draw where the track went after one time up until another
+ */
+static void replay_draw_trail ( VikReplay *rp, ReplayTrack *rt, gdouble from, gdouble to )
+{
+  const VikTrackTimes *tt = vik_track_get_times ( rt->trk );
+  gint x = 0, y = 0;
+  gboolean have = replay_position ( rp, rt, from, &x, &y );
+  for ( guint ii = replay_times_after ( tt, from ); ii < tt->len && tt->times[ii].timestamp <= to; ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(tt->times[ii].link->data);
+    gint nx, ny;
+    vik_viewport_coord_to_screen ( rp->vvp, &tp->coord, &nx, &ny );
+    if ( nx == VIK_VIEWPORT_UTM_WRONG_ZONE ) {
+      have = FALSE;
+      continue;
+    }
+    if ( have && !tp->newsegment )
+      vik_viewport_draw_line ( rp->vvp, rt->gc, x, y, nx, ny, &rt->color, REPLAY_TRAIL_THICKNESS );
+    x = nx;
+    y = ny;
+    have = TRUE;
+  }
+  gint nx, ny;
+  if ( have && replay_position ( rp, rt, to, &nx, &ny ) )
+    vik_viewport_draw_line ( rp->vvp, rt->gc, x, y, nx, ny, &rt->color, REPLAY_TRAIL_THICKNESS );
+}
+
+/**
+ * Draw the trails of all the tracks going on between the times
+ */
+static void replay_draw_trails ( VikReplay *rp, gdouble from, gdouble to )
+{
+  // Work back from the last one starting in time, until none of the earlier ones can still be going
+  guint ii = replay_tracks_after ( rp, to );
+  while ( ii-- > 0 ) {
+    ReplayTrack *rt = &g_array_index ( rp->tracks, ReplayTrack, ii );
+    if ( rt->max_end < from )
+      break;
+    if ( rt->end >= from && rt->trk->visible )
+      replay_draw_trail ( rp, rt, MAX(from, rt->start), MIN(to, rt->end) );
+  }
+}
+
+static void replay_draw_markers ( VikReplay *rp )
+{
+  guint ii = replay_tracks_after ( rp, rp->time );
+  while ( ii-- > 0 ) {
+    ReplayTrack *rt = &g_array_index ( rp->tracks, ReplayTrack, ii );
+    if ( rt->max_end < rp->time )
+      break;
+    gint x, y;
+    if ( rt->end >= rp->time && rt->trk->visible && replay_position ( rp, rt, rp->time, &x, &y ) )
+      vik_viewport_draw_arc ( rp->vvp, rt->gc, TRUE, x - REPLAY_MARKER_SIZE/2, y - REPLAY_MARKER_SIZE/2,
+                              REPLAY_MARKER_SIZE, REPLAY_MARKER_SIZE, 0, 360*64, &rt->color );
+  }
+}
+
+/**
+ * vik_replay_draw:
+ *
+ * Draw the replay on top of everything drawn in the viewport so far,
+ *  as part of a full redraw.
+ */
+void vik_replay_draw ( VikReplay *rp )
+{
+  // The drawing context may have changed since the last full draw
+  replay_free_gcs ( rp );
+  for ( guint ii = 0; ii < rp->tracks->len; ii++ ) {
+    ReplayTrack *rt = &g_array_index ( rp->tracks, ReplayTrack, ii );
+    rt->gc = vik_viewport_new_gc_from_color ( rp->vvp, &rt->color, REPLAY_TRAIL_THICKNESS );
+  }
+
+  replay_draw_trails ( rp, rp->first, rp->time );
+  vik_viewport_backdrop_save ( rp->vvp );
+  rp->drawn = rp->time;
+  replay_draw_markers ( rp );
+}
+
+/**
+ * vik_replay_set_time:
+ *
+ * Move the time cursor, drawing just what has changed when going forwards.
+ * The viewport needs syncing afterwards.
+ *
+ * Returns: FALSE if everything needs to be drawn again (with vik_replay_draw())
+ */
+gboolean vik_replay_set_time ( VikReplay *rp, gdouble time )
+{
+  rp->time = CLAMP ( time, rp->first, rp->last );
+  if ( isnan(rp->drawn) || rp->time < rp->drawn || !vik_viewport_backdrop_restore ( rp->vvp ) ) {
+    rp->drawn = NAN;
+    return FALSE;
+  }
+  if ( rp->time > rp->drawn ) {
+    replay_draw_trails ( rp, rp->drawn, rp->time );
+    vik_viewport_backdrop_save ( rp->vvp );
+    rp->drawn = rp->time;
+  }
+  replay_draw_markers ( rp );
+  return TRUE;
+}
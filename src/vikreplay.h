@@ -0,0 +1,41 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_REPLAY_H
+#define __VIKING_REPLAY_H
+
+#include <glib.h>
+#include "viktrack.h"
+#include "vikviewport.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VikReplay VikReplay;
+
+VikReplay *vik_replay_new ( VikViewport *vvp, GList *tracks );
+void vik_replay_free ( VikReplay *rp );
+
+void vik_replay_get_range ( VikReplay *rp, gdouble *first, gdouble *last );
+gdouble vik_replay_get_time ( VikReplay *rp );
+gboolean vik_replay_set_time ( VikReplay *rp, gdouble time );
+void vik_replay_draw ( VikReplay *rp );
+
+G_END_DECLS
+
+#endif
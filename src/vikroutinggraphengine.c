@@ -0,0 +1,519 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * SECTION:vikroutinggraphengine
+ * @short_description: A routing engine working offline on a road graph file
+ *
+ * The #VikRoutingGraphEngine class finds routes locally with an A* search
+ * over a road graph, e.g. as made from an OpenStreetMap extract by tools/viking-routegraph.py
+ *
+ * The graph file is in a compressed sparse row layout, all values being little endian:
+ *  - header: "VIKGRAPH", version (guint32 = 1), number of nodes (guint32), number of edges (guint32), reserved (guint32)
+ *  - nodes: latitude, longitude (gint32 in 1e-7 degrees) for each node
+ *  - offsets: (guint32) for each node plus one - the edges of node n are offsets[n] to offsets[n+1]-1
+ *  - edges: target node, length in decimetres (guint32, guint32) for each edge
+ * The file is mapped into memory as is, so loading takes no time at all.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "viking.h"
+#include "vikroutinggraphengine.h"
+
+static void vik_routing_graph_engine_finalize ( GObject *gob );
+
+static gboolean vik_routing_graph_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end );
+static gchar *vik_routing_graph_engine_get_url_from_directions ( VikRoutingEngine *self, const gchar *start, const gchar *end );
+static gboolean vik_routing_graph_engine_supports_direction ( VikRoutingEngine *self );
+static gboolean vik_routing_graph_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt );
+static gboolean vik_routing_graph_engine_supports_refine ( VikRoutingEngine *self );
+
+#define GRAPH_MAGIC "VIKGRAPH"
+#define GRAPH_VERSION 1
+#define GRAPH_HEADER_SIZE 24
+#define GRAPH_NO_NODE G_MAXUINT32
+
+typedef struct _VikRoutingGraphEnginePrivate VikRoutingGraphEnginePrivate;
+struct _VikRoutingGraphEnginePrivate
+{
+  gchar *graph_file;
+
+  // Searches share the working arrays
+  GMutex mutex;
+
+  GMappedFile *mapped;
+  gboolean load_failed;
+  guint32 node_count;
+  guint32 edge_count;
+  const gint32 *coords;
+  const guint32 *offsets;
+  const guint32 *edges;
+
+  // Working arrays, only valid for nodes whose visited value is the current serial
+  //  so they need not be cleared for each search
+  guint32 *dist;
+  guint32 *prev;
+  guint32 *visited;
+  guint32 serial;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikRoutingGraphEngine, vik_routing_graph_engine, VIK_ROUTING_ENGINE_TYPE)
+#define VIK_ROUTING_GRAPH_ENGINE_PRIVATE(o)  (vik_routing_graph_engine_get_instance_private (VIK_ROUTING_GRAPH_ENGINE(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_GRAPH_FILE,
+};
+
+static void
+vik_routing_graph_engine_set_property ( GObject      *object,
+                                        guint         property_id,
+                                        const GValue *value,
+                                        GParamSpec   *pspec )
+{
+  VikRoutingGraphEnginePrivate *priv = VIK_ROUTING_GRAPH_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_GRAPH_FILE:
+      g_free (priv->graph_file);
+      priv->graph_file = g_strdup(g_value_get_string (value));
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_routing_graph_engine_get_property ( GObject    *object,
+                                        guint       property_id,
+                                        GValue     *value,
+                                        GParamSpec *pspec )
+{
+  VikRoutingGraphEnginePrivate *priv = VIK_ROUTING_GRAPH_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_GRAPH_FILE:
+      g_value_set_string (value, priv->graph_file);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void vik_routing_graph_engine_class_init ( VikRoutingGraphEngineClass *klass )
+{
+  GObjectClass *object_class;
+  VikRoutingEngineClass *parent_class;
+  GParamSpec *pspec = NULL;
+
+  object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = vik_routing_graph_engine_set_property;
+  object_class->get_property = vik_routing_graph_engine_get_property;
+  object_class->finalize = vik_routing_graph_engine_finalize;
+
+  parent_class = VIK_ROUTING_ENGINE_CLASS (klass);
+
+  parent_class->find = vik_routing_graph_engine_find;
+  parent_class->supports_direction = vik_routing_graph_engine_supports_direction;
+  parent_class->get_url_from_directions = vik_routing_graph_engine_get_url_from_directions;
+  parent_class->refine = vik_routing_graph_engine_refine;
+  parent_class->supports_refine = vik_routing_graph_engine_supports_refine;
+
+  /**
+   * VikRoutingGraphEngine:graph-file:
+   *
+   * The road graph file. A relative filename is in the user's Viking directory.
+   */
+  pspec = g_param_spec_string ("graph-file",
+                               "Graph file",
+                               "The road graph file",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_GRAPH_FILE, pspec);
+}
+
+static void vik_routing_graph_engine_init ( VikRoutingGraphEngine *self )
+{
+  VikRoutingGraphEnginePrivate *priv = VIK_ROUTING_GRAPH_ENGINE_PRIVATE ( self );
+
+  priv->graph_file = NULL;
+  g_mutex_init ( &priv->mutex );
+  priv->mapped = NULL;
+  priv->load_failed = FALSE;
+  priv->dist = NULL;
+  priv->prev = NULL;
+  priv->visited = NULL;
+  priv->serial = 0;
+}
+
+static void vik_routing_graph_engine_finalize ( GObject *gob )
+{
+  VikRoutingGraphEnginePrivate *priv = VIK_ROUTING_GRAPH_ENGINE_PRIVATE ( gob );
+
+  g_free ( priv->graph_file );
+  priv->graph_file = NULL;
+
+  if ( priv->mapped )
+    g_mapped_file_unref ( priv->mapped );
+  priv->mapped = NULL;
+  g_free ( priv->dist );
+  g_free ( priv->prev );
+  g_free ( priv->visited );
+  g_mutex_clear ( &priv->mutex );
+
+  G_OBJECT_CLASS (vik_routing_graph_engine_parent_class)->finalize(gob);
+}
+
+/**
+ * Map the graph on first use
+ * NB Call with the mutex held
+ */
+static gboolean
+graph_load ( VikRoutingGraphEnginePrivate *priv )
+{
+  if ( priv->mapped )
+    return TRUE;
+  // Don't keep trying (and warning) on each request
+  if ( priv->load_failed || !priv->graph_file )
+    return FALSE;
+  priv->load_failed = TRUE;
+
+  gchar *filename = g_path_is_absolute ( priv->graph_file ) ?
+    g_strdup ( priv->graph_file ) : g_build_filename ( a_get_viking_dir(), priv->graph_file, NULL );
+  GError *error = NULL;
+  GMappedFile *mapped = g_mapped_file_new ( filename, FALSE, &error );
+  if ( !mapped ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    g_free ( filename );
+    return FALSE;
+  }
+
+  const gchar *contents = g_mapped_file_get_contents ( mapped );
+  gsize size = g_mapped_file_get_length ( mapped );
+  guint32 version = 0, nodes = 0, edges = 0;
+  if ( size >= GRAPH_HEADER_SIZE && memcmp ( contents, GRAPH_MAGIC, 8 ) == 0 ) {
+    const guint32 *header = (const guint32*)(contents + 8);
+    version = GUINT32_FROM_LE ( header[0] );
+    nodes = GUINT32_FROM_LE ( header[1] );
+    edges = GUINT32_FROM_LE ( header[2] );
+  }
+  guint64 expected = GRAPH_HEADER_SIZE + (guint64)nodes*8 + ((guint64)nodes+1)*4 + (guint64)edges*8;
+  if ( version != GRAPH_VERSION || nodes == 0 || nodes == GRAPH_NO_NODE || size != expected ) {
+    g_warning ( "%s: %s is not a usable road graph", __FUNCTION__, filename );
+    g_mapped_file_unref ( mapped );
+    g_free ( filename );
+    return FALSE;
+  }
+
+  const gint32 *coords = (const gint32*)(contents + GRAPH_HEADER_SIZE);
+  const guint32 *offsets = (const guint32*)(coords + 2*(gsize)nodes);
+  const guint32 *edge_data = offsets + nodes + 1;
+
+  // Check once here, so searches need not
+  gboolean valid = GUINT32_FROM_LE(offsets[0]) == 0 && GUINT32_FROM_LE(offsets[nodes]) == edges;
+  for ( guint32 nn = 0; valid && nn < nodes; nn++ )
+    valid = GUINT32_FROM_LE(offsets[nn]) <= GUINT32_FROM_LE(offsets[nn+1]);
+  for ( guint32 ee = 0; valid && ee < edges; ee++ )
+    valid = GUINT32_FROM_LE(edge_data[2*ee]) < nodes;
+  if ( !valid ) {
+    g_warning ( "%s: %s is inconsistent", __FUNCTION__, filename );
+    g_mapped_file_unref ( mapped );
+    g_free ( filename );
+    return FALSE;
+  }
+
+  priv->mapped = mapped;
+  priv->node_count = nodes;
+  priv->edge_count = edges;
+  priv->coords = coords;
+  priv->offsets = offsets;
+  priv->edges = edge_data;
+  priv->dist = g_new ( guint32, nodes );
+  priv->prev = g_new ( guint32, nodes );
+  priv->visited = g_new0 ( guint32, nodes );
+  priv->serial = 0;
+  priv->load_failed = FALSE;
+  g_debug ( "%s: %s has %d nodes and %d edges", __FUNCTION__, filename, nodes, edges );
+  g_free ( filename );
+  return TRUE;
+}
+
+static struct LatLon
+graph_node_latlon ( VikRoutingGraphEnginePrivate *priv, guint32 node )
+{
+  struct LatLon ll;
+  ll.lat = (gint32)GUINT32_FROM_LE ( (guint32)priv->coords[2*(gsize)node] ) / 1e7;
+  ll.lon = (gint32)GUINT32_FROM_LE ( (guint32)priv->coords[2*(gsize)node+1] ) / 1e7;
+  return ll;
+}
+
+/**
+ * ATM just a simple scan, which is small compared to the search itself
+ */
+static guint32
+graph_nearest_node ( VikRoutingGraphEnginePrivate *priv, struct LatLon ll )
+{
+  // Compare in a local flat projection, good enough to pick the closest
+  gdouble scale = cos ( DEG2RAD(ll.lat) );
+  guint32 best = GRAPH_NO_NODE;
+  gdouble best_d2 = G_MAXDOUBLE;
+  for ( guint32 nn = 0; nn < priv->node_count; nn++ ) {
+    struct LatLon node_ll = graph_node_latlon ( priv, nn );
+    gdouble dx = (node_ll.lon - ll.lon) * scale;
+    gdouble dy = node_ll.lat - ll.lat;
+    gdouble d2 = dx*dx + dy*dy;
+    if ( d2 < best_d2 ) {
+      best_d2 = d2;
+      best = nn;
+    }
+  }
+  return best;
+}
+
+typedef struct {
+  guint32 f;    // Estimated total length
+  guint32 g;    // Length so far
+  guint32 node;
+} HeapEntry;
+
+static void
+heap_push ( GArray *heap, HeapEntry entry )
+{
+  g_array_append_val ( heap, entry );
+  guint ii = heap->len - 1;
+  HeapEntry *data = (HeapEntry*)heap->data;
+  while ( ii > 0 ) {
+    guint parent = (ii - 1) / 2;
+    if ( data[parent].f <= data[ii].f )
+      break;
+    HeapEntry tmp = data[parent];
+    data[parent] = data[ii];
+    data[ii] = tmp;
+    ii = parent;
+  }
+}
+
+static HeapEntry
+heap_pop ( GArray *heap )
+{
+  HeapEntry *data = (HeapEntry*)heap->data;
+  HeapEntry top = data[0];
+  data[0] = data[heap->len - 1];
+  g_array_set_size ( heap, heap->len - 1 );
+  guint ii = 0;
+  while ( TRUE ) {
+    guint smallest = ii;
+    guint left = 2*ii + 1, right = 2*ii + 2;
+    if ( left < heap->len && data[left].f < data[smallest].f )
+      smallest = left;
+    if ( right < heap->len && data[right].f < data[smallest].f )
+      smallest = right;
+    if ( smallest == ii )
+      break;
+    HeapEntry tmp = data[smallest];
+    data[smallest] = data[ii];
+    data[ii] = tmp;
+    ii = smallest;
+  }
+  return top;
+}
+
+/**
+ * Estimate of the remaining length in decimetres
+ *  never more than the actual length (as the edges can't be shorter than the straight line),
+ *  so the first path found to the target is the shortest
+ */
+static guint32
+graph_heuristic ( VikRoutingGraphEnginePrivate *priv, guint32 node, const struct LatLon *target )
+{
+  struct LatLon ll = graph_node_latlon ( priv, node );
+  // Allow for the rounding of edge lengths
+  return (guint32)(a_coords_latlon_diff ( &ll, target ) * 10 * 0.999);
+}
+
+/**
+ * A* search from one node to another
+ * NB Call with the mutex held
+ *
+ * Returns: the nodes of the route, or NULL if there is none
+ */
+static GSList *
+graph_search ( VikRoutingGraphEnginePrivate *priv, guint32 from, guint32 to )
+{
+  if ( ++priv->serial == 0 ) {
+    memset ( priv->visited, 0, priv->node_count * sizeof(guint32) );
+    priv->serial = 1;
+  }
+  guint32 serial = priv->serial;
+  struct LatLon target = graph_node_latlon ( priv, to );
+
+  GArray *heap = g_array_new ( FALSE, FALSE, sizeof(HeapEntry) );
+  priv->dist[from] = 0;
+  priv->prev[from] = GRAPH_NO_NODE;
+  priv->visited[from] = serial;
+  HeapEntry start = { graph_heuristic ( priv, from, &target ), 0, from };
+  heap_push ( heap, start );
+
+  gboolean found = FALSE;
+  while ( heap->len ) {
+    HeapEntry entry = heap_pop ( heap );
+    // Superseded by a shorter way to the node
+    if ( entry.g > priv->dist[entry.node] )
+      continue;
+    if ( entry.node == to ) {
+      found = TRUE;
+      break;
+    }
+    guint32 last = GUINT32_FROM_LE ( priv->offsets[entry.node+1] );
+    for ( guint32 ee = GUINT32_FROM_LE ( priv->offsets[entry.node] ); ee < last; ee++ ) {
+      guint32 next = GUINT32_FROM_LE ( priv->edges[2*(gsize)ee] );
+      guint32 length = GUINT32_FROM_LE ( priv->edges[2*(gsize)ee+1] );
+      guint32 g = entry.g + length;
+      if ( g < entry.g )
+        continue; // Overflow
+      if ( priv->visited[next] != serial || g < priv->dist[next] ) {
+        priv->visited[next] = serial;
+        priv->dist[next] = g;
+        priv->prev[next] = entry.node;
+        HeapEntry item = { g + graph_heuristic ( priv, next, &target ), g, next };
+        heap_push ( heap, item );
+      }
+    }
+  }
+  g_array_free ( heap, TRUE );
+
+  if ( !found )
+    return NULL;
+  GSList *nodes = NULL;
+  for ( guint32 nn = to; nn != GRAPH_NO_NODE; nn = priv->prev[nn] )
+    nodes = g_slist_prepend ( nodes, GUINT_TO_POINTER(nn) );
+  return nodes;
+}
+
+/**
+ * Route via all the positions in turn, adding the route to the layer
+ */
+static gboolean
+graph_route ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon *lls, guint count )
+{
+  VikRoutingGraphEnginePrivate *priv = VIK_ROUTING_GRAPH_ENGINE_PRIVATE ( self );
+  gboolean ok = TRUE;
+  GList *tps = NULL; // In reverse order
+  VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+
+  g_mutex_lock ( &priv->mutex );
+  if ( !graph_load ( priv ) ) {
+    g_mutex_unlock ( &priv->mutex );
+    return FALSE;
+  }
+  guint32 from = graph_nearest_node ( priv, lls[0] );
+  for ( guint ii = 1; ok && ii < count; ii++ ) {
+    guint32 to = graph_nearest_node ( priv, lls[ii] );
+    GSList *nodes = graph_search ( priv, from, to );
+    if ( !nodes ) {
+      g_debug ( "%s: no route from node %d to %d", __FUNCTION__, from, to );
+      ok = FALSE;
+      break;
+    }
+    // Legs after the first already have their start node
+    for ( GSList *iter = tps ? nodes->next : nodes; iter; iter = iter->next ) {
+      struct LatLon ll = graph_node_latlon ( priv, GPOINTER_TO_UINT(iter->data) );
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      vik_coord_load_from_latlon ( &tp->coord, mode, &ll );
+      tps = g_list_prepend ( tps, tp );
+    }
+    g_slist_free ( nodes );
+    from = to;
+  }
+  g_mutex_unlock ( &priv->mutex );
+
+  if ( !ok || !tps ) {
+    g_list_free_full ( tps, (GDestroyNotify)vik_trackpoint_free );
+    return FALSE;
+  }
+
+  VikTrack *trk = vik_track_new ();
+  trk->is_route = TRUE;
+  trk->visible = TRUE;
+  trk->trackpoints = g_list_reverse ( tps );
+  vik_track_calculate_bounds ( trk );
+  vik_trw_layer_filein_add_track ( vtl, vik_routing_engine_get_label ( self ), trk );
+  return TRUE;
+}
+
+static gboolean
+vik_routing_graph_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end )
+{
+  struct LatLon lls[2] = { start, end };
+  return graph_route ( self, vtl, lls, 2 );
+}
+
+static gchar *
+vik_routing_graph_engine_get_url_from_directions ( VikRoutingEngine *self, const gchar *start, const gchar *end )
+{
+  return NULL;
+}
+
+static gboolean
+vik_routing_graph_engine_supports_direction ( VikRoutingEngine *self )
+{
+  return FALSE;
+}
+
+static gboolean
+vik_routing_graph_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt )
+{
+  guint count = g_list_length ( vt->trackpoints );
+  if ( count < 2 )
+    return FALSE;
+  struct LatLon *lls = g_new ( struct LatLon, count );
+  guint ii = 0;
+  for ( GList *iter = vt->trackpoints; iter; iter = iter->next )
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &lls[ii++] );
+  gboolean ret = graph_route ( self, vtl, lls, count );
+  g_free ( lls );
+  return ret;
+}
+
+static gboolean
+vik_routing_graph_engine_supports_refine ( VikRoutingEngine *self )
+{
+  return TRUE;
+}
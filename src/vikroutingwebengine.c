@@ -64,6 +64,10 @@ struct _VikRoutingWebEnginePrivate
 	gchar *url_stop_dir_fmt;
 
 	DownloadFileOptions options;
+
+	/* Kept open between requests */
+	GMutex handle_mutex;
+	void *handle;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VikRoutingWebEngine, vik_routing_web_engine, VIK_ROUTING_ENGINE_TYPE)
@@ -420,6 +424,9 @@ static void vik_routing_web_engine_init ( VikRoutingWebEngine *self )
   priv->options.use_etag = FALSE;
   priv->options.user_agent = NULL;
   priv->options.custom_http_headers = NULL;
+
+  g_mutex_init ( &priv->handle_mutex );
+  priv->handle = NULL;
 }
 
 static void vik_routing_web_engine_finalize ( GObject *gob )
@@ -451,6 +458,11 @@ static void vik_routing_web_engine_finalize ( GObject *gob )
   priv->options.user_agent = NULL;
   g_free (priv->options.custom_http_headers);
   priv->options.custom_http_headers = NULL;
+
+  if ( priv->handle )
+    a_download_handle_cleanup ( priv->handle );
+  priv->handle = NULL;
+  g_mutex_clear ( &priv->handle_mutex );
   G_OBJECT_CLASS (vik_routing_web_engine_parent_class)->finalize(gob);
 }
 
@@ -514,17 +526,112 @@ vik_routing_web_engine_get_url_for_coords ( VikRoutingEngine *self, struct LatLo
 	return url;
 }
 
+/*
+ * Responses are kept for reuse, as when planning a route the same legs often get asked for again
+ *  (e.g. after undoing the last part, or refining a route that was just found)
+ * Most recently used first
+ */
+#define ROUTING_CACHE_SIZE 32
+// Large responses are not worth keeping
+#define ROUTING_CACHE_MAX_BYTES (1024*1024)
+
+typedef struct {
+  gchar *key;
+  GBytes *data;
+} RoutingCacheEntry;
+
+static GMutex routing_cache_mutex;
+static GQueue routing_cache = G_QUEUE_INIT;
+
+static void routing_cache_entry_free ( RoutingCacheEntry *entry )
+{
+  g_free ( entry->key );
+  g_bytes_unref ( entry->data );
+  g_free ( entry );
+}
+
+static GBytes *routing_cache_lookup ( const gchar *key )
+{
+  GBytes *data = NULL;
+  g_mutex_lock ( &routing_cache_mutex );
+  for ( GList *iter = routing_cache.head; iter; iter = iter->next ) {
+    RoutingCacheEntry *entry = (RoutingCacheEntry*)iter->data;
+    if ( g_strcmp0 ( entry->key, key ) == 0 ) {
+      g_queue_unlink ( &routing_cache, iter );
+      g_queue_push_head_link ( &routing_cache, iter );
+      data = g_bytes_ref ( entry->data );
+      break;
+    }
+  }
+  g_mutex_unlock ( &routing_cache_mutex );
+  return data;
+}
+
+static void routing_cache_add ( const gchar *key, GBytes *data )
+{
+  if ( g_bytes_get_size ( data ) > ROUTING_CACHE_MAX_BYTES )
+    return;
+  RoutingCacheEntry *entry = g_new ( RoutingCacheEntry, 1 );
+  entry->key = g_strdup ( key );
+  entry->data = g_bytes_ref ( data );
+  g_mutex_lock ( &routing_cache_mutex );
+  g_queue_push_head ( &routing_cache, entry );
+  while ( g_queue_get_length ( &routing_cache ) > ROUTING_CACHE_SIZE )
+    routing_cache_entry_free ( g_queue_pop_tail ( &routing_cache ) );
+  g_mutex_unlock ( &routing_cache_mutex );
+}
+
+/**
+ * Positions are rounded to about a metre,
+ *  so asking again from a point that is not quite at the same place still finds the response
+ */
+static void
+routing_cache_key_append ( GString *key, struct LatLon ll )
+{
+  g_string_append_printf ( key, " %.5f,%.5f", ll.lat, ll.lon );
+}
+
+/**
+ * Get the route via the persistent connection, or from the cache when it has been asked for before
+ */
+static gboolean
+vik_routing_web_engine_convert ( VikRoutingEngine *self, VikTrwLayer *vtl, const gchar *uri, const gchar *key )
+{
+  VikRoutingWebEnginePrivate *priv = VIK_ROUTING_WEB_ENGINE_PRIVATE ( self );
+  DownloadFileOptions *options = vik_routing_web_engine_get_download_options ( self );
+  gchar *format = vik_routing_engine_get_format ( self );
+
+  GBytes *data = routing_cache_lookup ( key );
+  gboolean cached = (data != NULL);
+  if ( cached )
+    g_debug ( "%s: reusing response for %s", __FUNCTION__, key );
+
+  g_mutex_lock ( &priv->handle_mutex );
+  if ( !priv->handle )
+    priv->handle = a_download_handle_init ();
+  gboolean ret = a_babel_convert_from_url_cached ( vtl, uri, format, NULL, options, priv->handle, &data );
+  g_mutex_unlock ( &priv->handle_mutex );
+
+  if ( data ) {
+    if ( ret && !cached )
+      routing_cache_add ( key, data );
+    g_bytes_unref ( data );
+  }
+  return ret;
+}
+
 static gboolean
 vik_routing_web_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end )
 {
   gchar *uri = vik_routing_web_engine_get_url_for_coords(self, start, end);
 
-  DownloadFileOptions *options = vik_routing_web_engine_get_download_options(self);
+  GString *key = g_string_new ( vik_routing_engine_get_id ( self ) );
+  routing_cache_key_append ( key, start );
+  routing_cache_key_append ( key, end );
 
-  gchar *format = vik_routing_engine_get_format ( self );
-  ProcessOptions po = { NULL, NULL, format, uri, NULL, NULL };
-  gboolean ret = a_babel_convert_from ( vtl, &po, NULL, NULL, options );
+  gboolean ret = vik_routing_web_engine_convert ( self, vtl, uri, key->str );
 
+  g_string_free ( key, TRUE );
   g_free(uri);
 
   return ret;
@@ -658,14 +765,18 @@ vik_routing_web_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTra
   /* Compute URL */
   gchar *uri = vik_routing_web_engine_get_url_for_track ( self, vt );
 
-  /* Download data */
-  DownloadFileOptions *options = vik_routing_web_engine_get_download_options ( self );
+  GString *key = g_string_new ( vik_routing_engine_get_id ( self ) );
+  g_string_append ( key, " via" );
+  for ( GList *iter = vt->trackpoints; iter; iter = iter->next ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &ll );
+    routing_cache_key_append ( key, ll );
+  }
 
-  /* Convert and insert data in model */
-  gchar *format = vik_routing_engine_get_format ( self );
-  ProcessOptions po = { NULL, NULL, format, uri, NULL, NULL };
-  gboolean ret = a_babel_convert_from ( vtl, &po, NULL, NULL, options );
+  /* Download data, then convert and insert data in model */
+  gboolean ret = vik_routing_web_engine_convert ( self, vtl, uri, key->str );
 
+  g_string_free ( key, TRUE );
   g_free(uri);
 
   return ret;
@@ -61,6 +61,7 @@ static gdouble _get_lat_min(VikMapSource *self );
 static gdouble _get_lat_max(VikMapSource *self );
 static gdouble _get_lon_min(VikMapSource *self );
 static gdouble _get_lon_max(VikMapSource *self );
+static guint _get_tile_scale(VikMapSource *self, guint vp_scale );
 
 static gchar *_get_uri( VikMapSourceDefault *self, MapCoord *src );
 static gchar *_get_hostname( VikMapSourceDefault *self );
@@ -86,6 +87,7 @@ struct _VikSlippyMapSourcePrivate
   gboolean is_osm_meta_tiles; // http://wiki.openstreetmap.org/wiki/Meta_tiles as used by tirex or renderd
   // Mainly for ARCGIS Tile Server URL Layout // http://help.arcgis.com/EN/arcgisserver/10.0/apis/rest/tile.html
   gboolean switch_xy;
+  guint max_tile_scale; // Highest resolution of tiles from the URL (via {r} or {scale})
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VikSlippyMapSource, vik_slippy_map_source, VIK_TYPE_MAP_SOURCE_DEFAULT);
@@ -114,6 +116,7 @@ enum
   PROP_IS_MBTILES,
   PROP_IS_OSM_META_TILES,
   PROP_SWITCH_XY,
+  PROP_MAX_TILE_SCALE,
 };
 
 static void
@@ -143,6 +146,7 @@ vik_slippy_map_source_init (VikSlippyMapSource *self)
   priv->is_mbtiles = FALSE;
   priv->is_osm_meta_tiles = FALSE;
   priv->switch_xy = FALSE;
+  priv->max_tile_scale = 1;
 
   g_object_set (G_OBJECT (self),
                 "tilesize-x", 256,
@@ -267,6 +271,10 @@ vik_slippy_map_source_set_property (GObject      *object,
       priv->switch_xy = g_value_get_boolean (value);
       break;
 
+    case PROP_MAX_TILE_SCALE:
+      priv->max_tile_scale = g_value_get_uint (value);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -356,6 +364,10 @@ vik_slippy_map_source_get_property (GObject    *object,
       g_value_set_boolean (value, priv->switch_xy);
       break;
 
+    case PROP_MAX_TILE_SCALE:
+      g_value_set_uint (value, priv->max_tile_scale);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -387,6 +399,7 @@ vik_slippy_map_source_class_init (VikSlippyMapSourceClass *klass)
 	grandparent_class->get_lat_max = _get_lat_max;
 	grandparent_class->get_lon_min = _get_lon_min;
 	grandparent_class->get_lon_max = _get_lon_max;
+	grandparent_class->get_tile_scale = _get_tile_scale;
 
 	parent_class->get_uri = _get_uri;
 	parent_class->get_hostname = _get_hostname;
@@ -533,6 +546,15 @@ vik_slippy_map_source_class_init (VikSlippyMapSourceClass *klass)
 	                              G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_SWITCH_XY, pspec);
 
+	pspec = g_param_spec_uint ("max-tile-scale",
+	                           "Highest tile resolution",
+	                           "The highest resolution of tiles available, relative to the normal tiles. The URL selects the resolution with {r} (as @2x etc.) or {scale}",
+	                           1  /* minimum value */,
+	                           4 /* maximum value */,
+	                           1  /* default value */,
+	                           G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_MAX_TILE_SCALE, pspec);
+
 	object_class->finalize = vik_slippy_map_source_finalize;
 }
 
@@ -641,6 +663,14 @@ _get_lon_max (VikMapSource *self)
   return priv->lon_max;
 }
 
+static guint
+_get_tile_scale (VikMapSource *self, guint vp_scale)
+{
+  g_return_val_if_fail (VIK_IS_SLIPPY_MAP_SOURCE(self), 1);
+  VikSlippyMapSourcePrivate *priv = VIK_SLIPPY_MAP_SOURCE_PRIVATE(self);
+  return CLAMP ( vp_scale, 1, priv->max_tile_scale );
+}
+
 static gboolean
 _coord_to_mapcoord ( VikMapSource *self, const VikCoord *src, gdouble xzoom, gdouble yzoom, MapCoord *dest )
 {
@@ -662,14 +692,33 @@ _get_uri( VikMapSourceDefault *self, MapCoord *src )
 	if ( !priv->url )
 		return NULL;
 
+	// Choose the resolution of the tiles
+	gchar *url = priv->url;
+	if ( priv->max_tile_scale > 1 ) {
+		guint tile_scale = CLAMP ( src->z, 1, priv->max_tile_scale );
+		gchar *r = tile_scale > 1 ? g_strdup_printf ( "@%dx", tile_scale ) : g_strdup ( "" );
+		gchar *scale = g_strdup_printf ( "%d", tile_scale );
+		gchar **parts = g_strsplit ( priv->url, "{r}", -1 );
+		gchar *tmp = g_strjoinv ( r, parts );
+		g_strfreev ( parts );
+		parts = g_strsplit ( tmp, "{scale}", -1 );
+		url = g_strjoinv ( scale, parts );
+		g_strfreev ( parts );
+		g_free ( tmp );
+		g_free ( scale );
+		g_free ( r );
+	}
+
 	gchar *uri = NULL;
 	if ( priv->switch_xy )
 		// 'ARC GIS' Tile Server layout ordering
-		uri = g_strdup_printf (priv->url, 17 - src->scale, src->y, src->x);
+		uri = g_strdup_printf (url, 17 - src->scale, src->y, src->x);
 	else
 		// (Default) Standard OSM Tile Server layout ordering
-		uri = g_strdup_printf (priv->url, 17 - src->scale, src->x, src->y);
+		uri = g_strdup_printf (url, 17 - src->scale, src->x, src->y);
 
+	if ( url != priv->url )
+		g_free ( url );
 	return uri;
 }
 
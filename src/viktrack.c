@@ -34,12 +34,22 @@
 #include "globals.h"
 #include "dems.h"
 #include "settings.h"
+#include "trackpack.h"
+#include "trackcache.h"
+#include "util.h"
+
+// Counts every change to the trackpoints of any track
+static gint time_changes = 0;
+
+// Gives the track a new serial, distinct from any serial previously handed out
+#define TRACK_NEW_SERIAL(tr) (tr)->serial = (guint)g_atomic_int_add ( &time_changes, 1 ) + 1
 
 VikTrack *vik_track_new()
 {
   VikTrack *tr = g_malloc0 ( sizeof ( VikTrack ) );
   tr->ref_count = 1;
   tr->visible = TRUE;
+  TRACK_NEW_SERIAL ( tr );
   vik_track_set_defaults ( tr );
   return tr;
 }
@@ -173,6 +183,309 @@ void vik_track_clear_property_dialog(VikTrack *tr)
   tr->property_dialog = NULL;
 }
 
+/**
+ * Summary values of the whole track, worked out once and then kept until the track is changed.
+ * Appending trackpoints (e.g. from realtime GPS tracking) extends these rather than starting again.
+ */
+struct _VikTrackStats {
+  const VikTrackpoint *first;
+  const VikTrackpoint *last;
+  gdouble length;                // Excluding gaps between segments
+  gdouble length_including_gaps;
+  gdouble timed_length;          // Length between points with times (within segments)
+  gdouble duration;              // Time within segments
+  gdouble max_speed;             // -1 if unknown
+  gdouble max_speed_by_gps;      // -1 if unknown
+  guint max_heart_rate;
+  gdouble heart_rate_sum;
+  gulong heart_rate_count;
+  gdouble elev_up;
+  gdouble elev_down;
+  gdouble min_alt;               // 25000 unless there are any altitudes
+  gdouble max_alt;               // -5000 unless there are any altitudes
+  guint tp_count;
+  gboolean from_summary;         // Given by vik_track_set_summary() rather than worked out
+};
+
+// Of the algorithms for the derived values kept by trackcache.c - change when the results would differ
+#define TRACK_STATS_CACHE_VERSION 1
+#define TRACK_SIMPLIFIED_CACHE_VERSION 1
+
+/**
+ * Include the next point (after prev) in the statistics
+ * dist is the distance from prev (ignored for the first point)
+ * NB The values derived from individual points that are actually recorded by a device
+ *  ignore the first point (unlikely to be a maximum / possible false reading anyway)
+ */
+static void track_stats_add_point ( VikTrackStats *st, const VikTrackpoint *prev, const VikTrackpoint *tp, gdouble dist )
+{
+  st->last = tp;
+  st->tp_count++;
+  if ( !isnan(tp->altitude) ) {
+    if ( tp->altitude > st->max_alt )
+      st->max_alt = tp->altitude;
+    if ( tp->altitude < st->min_alt )
+      st->min_alt = tp->altitude;
+  }
+  if ( !prev ) {
+    st->first = tp;
+    return;
+  }
+
+  st->length_including_gaps += dist;
+  if ( !tp->newsegment ) {
+    st->length += dist;
+    if ( !isnan(tp->timestamp) && !isnan(prev->timestamp) ) {
+      gdouble diff = ABS(tp->timestamp - prev->timestamp);
+      st->timed_length += dist;
+      st->duration += diff;
+      gdouble speed = dist / diff;
+      if ( speed > st->max_speed )
+        st->max_speed = speed;
+    }
+  }
+
+  if ( !isnan(tp->speed) && tp->speed > st->max_speed_by_gps )
+    st->max_speed_by_gps = tp->speed;
+
+  if ( tp->heart_rate > st->max_heart_rate )
+    st->max_heart_rate = tp->heart_rate;
+  if ( (gint)tp->heart_rate > 0 ) {
+    st->heart_rate_sum += tp->heart_rate;
+    st->heart_rate_count++;
+  }
+
+  if ( !isnan(tp->altitude) && !isnan(prev->altitude) ) {
+    gdouble diff = tp->altitude - prev->altitude;
+    if ( diff > 0 )
+      st->elev_up += diff;
+    else
+      st->elev_down -= diff;
+  }
+}
+
+static VikTrackStats *track_stats_new ()
+{
+  VikTrackStats *st = g_malloc0 ( sizeof(VikTrackStats) );
+  st->max_speed = -1.0;
+  st->max_speed_by_gps = -1.0;
+  st->min_alt = 25000;
+  st->max_alt = -5000;
+  return st;
+}
+
+/**
+ * The distance of each trackpoint from the previous one (0 for the first point)
+ * Worked out in one pass (see a_coords_latlon_diffs()), giving the same values as vik_coord_diff()
+ *  as that also compares points in the same coordinate mode via their lat/lons.
+ *
+ * Returns: An array of len values to be freed with g_free(), or NULL if there are no trackpoints
+ */
+static gdouble *track_segment_lengths ( const VikTrack *tr, guint *len )
+{
+  guint nn = g_list_length ( tr->trackpoints );
+  *len = nn;
+  if ( !nn )
+    return NULL;
+
+  struct LatLon *lls = g_new ( struct LatLon, nn );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ )
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &lls[ii] );
+
+  gdouble *diffs = g_new ( gdouble, nn );
+  diffs[0] = 0.0;
+  a_coords_latlon_diffs ( lls, nn, diffs+1 );
+  g_free ( lls );
+  return diffs;
+}
+
+/**
+ * Returns the statistics for a track with at least one trackpoint, otherwise NULL
+ */
+static const VikTrackStats *track_stats ( const VikTrack *tr )
+{
+  if ( tr->stats )
+    return tr->stats;
+  if ( !tr->trackpoints )
+    return NULL;
+
+  VikTrackStats *st = track_stats_new ();
+  if ( a_trackcache_load ( tr, "stats", TRACK_STATS_CACHE_VERSION, st, sizeof(VikTrackStats) ) ) {
+    st->first = VIK_TRACKPOINT(tr->trackpoints->data);
+    st->last = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data);
+  }
+  else {
+    guint len;
+    gdouble *diffs = track_segment_lengths ( tr, &len );
+    guint ii = 0;
+    for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ )
+      track_stats_add_point ( st, iter->prev ? VIK_TRACKPOINT(iter->prev->data) : NULL, VIK_TRACKPOINT(iter->data), diffs[ii] );
+    g_free ( diffs );
+    // Without the trackpoint pointers, which are only valid for this session
+    VikTrackStats saved = *st;
+    saved.first = saved.last = NULL;
+    a_trackcache_save ( tr, "stats", TRACK_STATS_CACHE_VERSION, &saved, sizeof(saved) );
+  }
+
+  // Only a cache, so the track itself is not changed
+  ((VikTrack*)tr)->stats = st;
+  return st;
+}
+
+// Zoom bands for the simplified versions of a track, in powers of 2 metres
+#define SIMPLIFIED_LEVELS 24
+#define SIMPLIFY_EARTH_RADIUS 6371000.0
+
+/**
+ * A track simplified (by Douglas-Peucker) at all tolerances at once:
+ *  each point records the largest tolerance at which it is still needed.
+ */
+struct _VikTrackSimplified {
+  guint len;
+  VikTrackpoint **tps;
+  gdouble *significance;                // In metres
+  GPtrArray *levels[SIMPLIFIED_LEVELS]; // Built as each zoom band is used
+};
+
+static void track_simplified_free ( VikTrackSimplified *ts )
+{
+  if ( !ts )
+    return;
+  for ( guint ii = 0; ii < SIMPLIFIED_LEVELS; ii++ )
+    if ( ts->levels[ii] )
+      g_ptr_array_free ( ts->levels[ii], TRUE );
+  g_free ( ts->tps );
+  g_free ( ts->significance );
+  g_free ( ts );
+}
+
+static void track_times_free ( VikTrackTimes *tt )
+{
+  if ( !tt )
+    return;
+  g_free ( tt->times );
+  g_free ( tt );
+}
+
+// Trackpoints summarised by each leaf of the range trees
+#define TRACK_RANGE_BLOCK 32
+
+/**
+ * For each value, a segment tree of the statistics of blocks of trackpoints
+ *  (leaves in [nblocks, 2*nblocks), each parent the combination of its two children),
+ *  so the statistics of any range need only a few nodes plus the partial blocks at its ends
+ */
+struct _VikTrackRanges {
+  guint nblocks;
+  VikTrackRangeStats *tree[TRACK_VALUE_END]; // NULL until needed
+};
+
+static void track_ranges_free ( VikTrackRanges *trs )
+{
+  if ( !trs )
+    return;
+  for ( guint ii = 0; ii < TRACK_VALUE_END; ii++ )
+    g_free ( trs->tree[ii] );
+  g_free ( trs );
+}
+
+static void track_columns_free ( VikTrackColumns *cols )
+{
+  if ( !cols )
+    return;
+  track_ranges_free ( cols->ranges );
+  g_free ( cols->tps );
+  g_free ( cols->timestamp );
+  g_free ( cols->distance );
+  g_free ( cols->altitude );
+  g_free ( cols->speed );
+  g_free ( cols->heart_rate );
+  g_free ( cols->cadence );
+  g_free ( cols->power );
+  g_free ( cols->temp );
+  g_free ( cols->newsegment );
+  g_free ( cols->dem );
+  g_free ( cols );
+}
+
+// Resolution of the profiles behind the graph maps - finer than any graph (see MAX_NUM_CHUNKS)
+#define PROFILE_BINS 16384
+
+typedef enum {
+  PROFILE_ELEVATION_DISTANCE = 0, // Integral of the elevation along the track
+  PROFILE_DISTANCE_TIME,          // Distance travelled by each time
+  PROFILE_TIME_DISTANCE,          // Time taken to reach each distance
+  PROFILE_ELEVATION_TIME,         // Integrals of each VikTrackValueType over time (in the same order)
+  PROFILE_END = PROFILE_ELEVATION_TIME + TRACK_VALUE_END,
+} TrackProfileType;
+
+/**
+ * A quantity along the track's distance or time, sampled at PROFILE_BINS+1 even steps.
+ * For the integral of a value, the extent of the track where the value is known is sampled too,
+ *  so the average of the value between any two positions is the ratio of their differences.
+ * Thus the map for a graph of any width is worked out from these samples alone.
+ */
+typedef struct {
+  gdouble extent; // Of the track's distance or time
+  gdouble *q;     // The quantity
+  gdouble *w;     // Where known - only for integrals
+} TrackProfile;
+
+struct _VikTrackProfiles {
+  gboolean made[PROFILE_END];
+  TrackProfile *profile[PROFILE_END]; // NULL when not available for the track
+};
+
+static void track_profile_free ( TrackProfile *tp )
+{
+  g_free ( tp->q );
+  g_free ( tp->w );
+  g_free ( tp );
+}
+
+static void track_profiles_free ( VikTrackProfiles *tps )
+{
+  if ( !tps )
+    return;
+  for ( guint ii = 0; ii < PROFILE_END; ii++ ) {
+    if ( tps->profile[ii] )
+      track_profile_free ( tps->profile[ii] );
+  }
+  g_free ( tps );
+}
+
+// Number of split lengths for which the splits are kept
+#define SPLITS_CACHED 6
+
+/**
+ * Running totals along the parts of the track with times (within segments),
+ *  so the speed splits of any length are found by searching for the split positions.
+ */
+struct _VikTrackSplits {
+  guint len;
+  gdouble *distance;  // Metres
+  gdouble *time;      // Seconds
+  gdouble *elev_up;   // Metres
+  gdouble *elev_down; // Metres
+  gdouble lengths[SPLITS_CACHED]; // Split lengths of the splits worked out before
+  GArray *splits[SPLITS_CACHED];  // (most recent first)
+};
+
+static void track_splits_free ( VikTrackSplits *ts )
+{
+  if ( !ts )
+    return;
+  for ( guint ii = 0; ii < SPLITS_CACHED; ii++ )
+    if ( ts->splits[ii] )
+      g_array_free ( ts->splits[ii], TRUE );
+  g_free ( ts->distance );
+  g_free ( ts->time );
+  g_free ( ts->elev_up );
+  g_free ( ts->elev_down );
+  g_free ( ts );
+}
+
 void vik_track_free(VikTrack *tr)
 {
   if ( tr->ref_count-- > 1 )
@@ -196,6 +509,17 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->extensions );
   g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
   g_list_free( tr->trackpoints );
+  vik_track_pack_free ( tr->packed );
+  track_columns_free ( tr->columns );
+  g_free ( tr->stats );
+  track_simplified_free ( tr->simplified );
+  if ( tr->chunks )
+    g_array_free ( tr->chunks, TRUE );
+  track_times_free ( tr->times );
+  track_profiles_free ( tr->profiles );
+  track_splits_free ( tr->splits );
+  vik_track_sunlight_free ( tr->sunlight );
+  g_atomic_int_inc ( &time_changes );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -224,7 +548,9 @@ VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points )
   new_tr->color = tr->color;
   new_tr->bbox = tr->bbox;
   new_tr->trackpoints = NULL;
-  if ( copy_points )
+  if ( copy_points && tr->packed )
+    new_tr->trackpoints = vik_track_pack_unpack ( tr->packed );
+  else if ( copy_points )
   {
     GList *tp_iter = tr->trackpoints;
     while ( tp_iter )
@@ -247,9 +573,79 @@ VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points )
   return new_tr;
 }
 
+/**
+ * vik_track_copy_shared:
+ * @tr: The Track to copy
+ *
+ * As vik_track_copy() with the track points, except that when @tr is packed
+ *  the copy holds the same packed trackpoints rather than its own.
+ * Either track gets a private list of trackpoints when it is unpacked (vik_track_unpack()),
+ *  so a copy only costs memory once it is worked on.
+ *
+ * Returns: the copied VikTrack
+ */
+VikTrack *vik_track_copy_shared ( VikTrack *tr )
+{
+  VikTrack *new_tr = vik_track_copy ( tr, !tr->packed );
+  if ( tr->packed )
+    new_tr->packed = vik_track_pack_ref ( tr->packed );
+  return new_tr;
+}
+
+// Counts every change to the bounds of any track
+static gint bounds_changes = 0;
+
+/*
+ * Trackpoint names and especially extensions are often the same for many trackpoints
+ *  (e.g. a device writes an identical extensions blob for every point),
+ *  so only keep one reference counted copy of each distinct value.
+ * Trackpoints may be created in background threads so access is locked.
+ */
+G_LOCK_DEFINE_STATIC(tp_strings);
+static GHashTable *tp_strings = NULL; // string -> reference count
+
+static gchar *tp_string_ref ( const gchar *str )
+{
+  if ( !str )
+    return NULL;
+
+  gpointer key, value;
+  G_LOCK(tp_strings);
+  if ( !tp_strings )
+    tp_strings = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  if ( g_hash_table_lookup_extended ( tp_strings, str, &key, &value ) )
+    g_hash_table_insert ( tp_strings, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(value)+1) );
+  else {
+    key = g_strdup ( str );
+    g_hash_table_insert ( tp_strings, key, GUINT_TO_POINTER(1) );
+  }
+  G_UNLOCK(tp_strings);
+  return key;
+}
+
+static void tp_string_unref ( gchar *str )
+{
+  if ( !str )
+    return;
+
+  gpointer key, value;
+  G_LOCK(tp_strings);
+  if ( tp_strings && g_hash_table_lookup_extended ( tp_strings, str, &key, &value ) ) {
+    guint count = GPOINTER_TO_UINT(value);
+    if ( count > 1 )
+      g_hash_table_insert ( tp_strings, key, GUINT_TO_POINTER(count-1) );
+    else
+      g_hash_table_remove ( tp_strings, str );
+  }
+  else
+    g_critical ( "%s: string not shared %p", __FUNCTION__, str );
+  G_UNLOCK(tp_strings);
+}
+
 VikTrackpoint *vik_trackpoint_new()
 {
-  VikTrackpoint *tp = g_malloc0(sizeof(VikTrackpoint));
+  // Allocated in slabs as there can be very many of them
+  VikTrackpoint *tp = g_slice_new0 ( VikTrackpoint );
   tp->timestamp = NAN;
   tp->speed = NAN;
   tp->course = NAN;
@@ -265,62 +661,63 @@ VikTrackpoint *vik_trackpoint_new()
 
 void vik_trackpoint_free(VikTrackpoint *tp)
 {
-  g_free(tp->name);
-  g_free(tp->extensions);
-  g_free(tp);
+  tp_string_unref ( tp->name );
+  tp_string_unref ( tp->extensions );
+  g_slice_free ( VikTrackpoint, tp );
 }
 
+/**
+ * NB The name is shared with other trackpoints, so it must only be changed via this function
+ */
 void vik_trackpoint_set_name(VikTrackpoint *tp, const gchar *name)
 {
-  if ( tp->name )
-    g_free ( tp->name );
+  // Take the new reference first in case it's the same string
+  gchar *old = tp->name;
 
   // If the name is blank then completely remove it
   if ( name && name[0] == '\0' )
     tp->name = NULL;
-  else if ( name )
-    tp->name = g_strdup(name);
   else
-    tp->name = NULL;
+    tp->name = tp_string_ref ( name );
+
+  tp_string_unref ( old );
 }
 
+/**
+ * NB The extensions are shared with other trackpoints, so they must only be changed via this function
+ */
 void vik_trackpoint_set_extensions(VikTrackpoint *tp, const gchar *value)
 {
-  if ( tp->extensions )
-    g_free ( tp->extensions );
+  gchar *old = tp->extensions;
   if ( value && value[0] == '\0' )
     tp->extensions = NULL;
-  else if ( value )
-    tp->extensions = g_strdup ( value );
   else
-    tp->extensions = NULL;
+    tp->extensions = tp_string_ref ( value );
+  tp_string_unref ( old );
 }
 
 VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
 {
   VikTrackpoint *new_tp = vik_trackpoint_new();
   memcpy ( new_tp, tp, sizeof(VikTrackpoint) );
-  if ( tp->name )
-    new_tp->name = g_strdup (tp->name);
-  if ( tp->extensions )
-    new_tp->extensions = g_strdup (tp->extensions);
+  new_tp->name = tp_string_ref ( tp->name );
+  new_tp->extensions = tp_string_ref ( tp->extensions );
   return new_tp;
 }
 
 /**
  * track_recalculate_bounds_last_tp:
  * @trk:   The track to consider the recalculation on
+ * @tp:    The last trackpoint of the track
  *
  * A faster bounds check, since it only considers the last track point
  */
-static void track_recalculate_bounds_last_tp ( VikTrack *trk )
+static void track_recalculate_bounds_last_tp ( VikTrack *trk, VikTrackpoint *tp )
 {
-  GList *tpl = g_list_last ( trk->trackpoints );
-
-  if ( tpl ) {
+  if ( tp ) {
     struct LatLon ll;
     // See if this trackpoint increases the track bounds and update if so
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tpl->data)->coord), &ll );
+    vik_coord_to_latlon ( &(tp->coord), &ll );
     if ( ll.lat > trk->bbox.north )
       trk->bbox.north = ll.lat;
     if ( ll.lon < trk->bbox.west )
@@ -329,9 +726,60 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
       trk->bbox.south = ll.lat;
     if ( ll.lon > trk->bbox.east )
       trk->bbox.east = ll.lon;
+    g_atomic_int_inc ( &bounds_changes );
   }
 }
 
+/**
+ * track_add_trackpoint_after:
+ * @last: The last link of the track's trackpoints (NULL when there are none)
+ */
+static GList *track_add_trackpoint_after ( VikTrack *tr, VikTrackpoint *tp, GList *last, gboolean recalculate )
+{
+  // When it's the first trackpoint need to ensure the bounding box is initialized correctly
+  gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
+  GList *link = g_list_append ( last, tp );
+  if ( adding_first_point )
+    tr->trackpoints = link;
+  else
+    link = last->next;
+
+  track_columns_free ( tr->columns );
+  tr->columns = NULL;
+  track_simplified_free ( tr->simplified );
+  tr->simplified = NULL;
+  if ( tr->chunks )
+    g_array_free ( tr->chunks, TRUE );
+  tr->chunks = NULL;
+  track_times_free ( tr->times );
+  tr->times = NULL;
+  track_profiles_free ( tr->profiles );
+  tr->profiles = NULL;
+  track_splits_free ( tr->splits );
+  tr->splits = NULL;
+  vik_track_sunlight_free ( tr->sunlight );
+  tr->sunlight = NULL;
+  TRACK_NEW_SERIAL ( tr );
+  // Any statistics can simply be extended to include the new point
+  if ( tr->stats ) {
+    if ( last && tr->stats->last == last->data ) {
+      track_stats_add_point ( tr->stats, VIK_TRACKPOINT(last->data), tp,
+                              vik_coord_diff ( &(tp->coord), &(VIK_TRACKPOINT(last->data)->coord) ) );
+      tr->stats->from_summary = FALSE;
+    }
+    else {
+      g_free ( tr->stats );
+      tr->stats = NULL;
+    }
+  }
+
+  if ( adding_first_point )
+    vik_track_calculate_bounds ( tr );
+  else if ( recalculate )
+    track_recalculate_bounds_last_tp ( tr, tp );
+  return link;
+}
+
 /**
  * vik_track_add_trackpoint:
  * @tr:          The track to which the trackpoint will be added
@@ -344,13 +792,27 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
  */
 void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalculate )
 {
-  // When it's the first trackpoint need to ensure the bounding box is initialized correctly
-  gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
-  tr->trackpoints = g_list_append ( tr->trackpoints, tp );
-  if ( adding_first_point )
-    vik_track_calculate_bounds ( tr );
-  else if ( recalculate )
-    track_recalculate_bounds_last_tp ( tr );
+  // Only walk the list once
+  track_add_trackpoint_after ( tr, tp, g_list_last ( tr->trackpoints ), recalculate );
+}
+
+/**
+ * vik_track_append_trackpoint:
+ * @tr:   The track to which the trackpoint will be added
+ * @tp:   The trackpoint to add
+ * @last: The last link of the track's trackpoints, e.g. as returned from the previous append,
+ *        or NULL to have it found. It is up to the caller to know it is still the last one.
+ *
+ * Like vik_track_add_trackpoint() with recalculation,
+ *  but in constant time when @last is given - e.g. for a track being recorded
+ *
+ * Returns: The new last link of the track's trackpoints
+ */
+GList *vik_track_append_trackpoint ( VikTrack *tr, VikTrackpoint *tp, GList *last )
+{
+  if ( !last )
+    last = g_list_last ( tr->trackpoints );
+  return track_add_trackpoint_after ( tr, tp, last, TRUE );
 }
 
 /**
@@ -365,6 +827,9 @@ gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpo
     // Is it the very first track point?
     if ( VIK_TRACKPOINT(tr->trackpoints->data) == tp )
       return len;
+    // Or the last, e.g. the current position of a track being recorded
+    if ( tr->stats && tr->stats->last == tp )
+      return tr->stats->length;
 
     GList *iter = tr->trackpoints->next;
     while (iter)
@@ -386,35 +851,14 @@ gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpo
 
 gdouble vik_track_get_length(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
-  }
-  return len;
+  const VikTrackStats *st = track_stats ( tr );
+  return st ? st->length : 0.0;
 }
 
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                              &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
-  }
-  return len;
+  const VikTrackStats *st = track_stats ( tr );
+  return st ? st->length_including_gaps : 0.0;
 }
 
 gulong vik_track_get_tp_count(const VikTrack *tr)
@@ -422,74 +866,989 @@ gulong vik_track_get_tp_count(const VikTrack *tr)
   return g_list_length(tr->trackpoints);
 }
 
-gulong vik_track_get_dup_point_count ( const VikTrack *tr )
+/**
+ * vik_track_get_tp_array:
+ *
+ * The trackpoints in order in a contiguous array,
+ *  so they can be counted and indexed in constant time (use VIK_TRACKPOINT_AT()).
+ * Worthwhile whenever points are needed by position or in more than one pass.
+ *
+ * The array is a snapshot - it is not updated when points are added or removed.
+ *
+ * Returns: A new array (maybe empty) to be freed with g_ptr_array_free ( array, TRUE )
+ */
+GPtrArray *vik_track_get_tp_array ( const VikTrack *tr )
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter )
-  {
-    if ( iter->next && vik_coord_equals ( &(VIK_TRACKPOINT(iter->data)->coord),
-                       &(VIK_TRACKPOINT(iter->next->data)->coord) ) )
-      num++;
-    iter = iter->next;
+  GPtrArray *tps = g_ptr_array_new ();
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next )
+    g_ptr_array_add ( tps, iter->data );
+  return tps;
+}
+
+/**
+ * vik_track_get_columns:
+ *
+ * The trackpoint values in separate arrays, with the cumulative distance worked out.
+ * This is built when first needed and then kept until the track is changed,
+ *  so the various graphs and statistics can share it.
+ *
+ * Returns: The cached values (owned by the track - don't free).
+ *          Only valid until the track is next changed.
+ */
+const VikTrackColumns *vik_track_get_columns ( const VikTrack *tr )
+{
+  if ( tr->columns )
+    return tr->columns;
+
+  VikTrackColumns *cols = g_malloc0 ( sizeof(VikTrackColumns) );
+  guint len;
+  gdouble *diffs = track_segment_lengths ( tr, &len );
+  guint alloc = MAX ( 1, len );
+  cols->len = len;
+  cols->tps = g_new ( VikTrackpoint*, alloc );
+  cols->timestamp = g_new ( gdouble, alloc );
+  cols->distance = g_new ( gdouble, alloc );
+  cols->altitude = g_new ( gdouble, alloc );
+  cols->speed = g_new ( gdouble, alloc );
+  cols->heart_rate = g_new ( guint, alloc );
+  cols->cadence = g_new ( gint, alloc );
+  cols->power = g_new ( gint, alloc );
+  cols->temp = g_new ( gdouble, alloc );
+  cols->newsegment = g_new ( gboolean, alloc );
+
+  guint ii = 0;
+  VikTrackpoint *prev = NULL;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    cols->tps[ii] = tp;
+    cols->timestamp[ii] = tp->timestamp;
+    cols->distance[ii] = prev ? cols->distance[ii-1] + diffs[ii] : 0.0;
+    cols->altitude[ii] = tp->altitude;
+    cols->speed[ii] = tp->speed;
+    cols->heart_rate[ii] = tp->heart_rate;
+    cols->cadence[ii] = tp->cadence;
+    cols->power[ii] = tp->power;
+    cols->temp[ii] = tp->temp;
+    cols->newsegment[ii] = tp->newsegment;
+    prev = tp;
   }
-  return num;
+  g_free ( diffs );
+
+  // Only a cache, so the track itself is not changed
+  ((VikTrack*)tr)->columns = cols;
+  return cols;
 }
 
-gulong vik_track_get_tp_num (const VikTrack *tr, const VikTrackpoint *tp)
+/**
+ * Returns: Whether the trackpoint at the position has the value
+ */
+static inline gboolean track_range_value ( const VikTrackColumns *cols, VikTrackValueType value_type, guint ii, gdouble *val )
 {
-  g_return_val_if_fail ( tr, 0 );
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter ) {
-    num++;
-    if ( VIK_TRACKPOINT(iter->data) == tp )
-      break;
-    iter = iter->next;
+  switch ( value_type ) {
+  case TRACK_VALUE_ELEVATION:
+    *val = cols->altitude[ii];
+    return !isnan ( *val );
+  case TRACK_VALUE_HEART_RATE:
+    *val = cols->heart_rate[ii];
+    return cols->heart_rate[ii] != 0;
+  case TRACK_VALUE_CADENCE:
+    *val = cols->cadence[ii];
+    return cols->cadence[ii] != VIK_TRKPT_CADENCE_NONE;
+  case TRACK_VALUE_TEMP:
+    *val = cols->temp[ii];
+    return !isnan ( *val );
+  case TRACK_VALUE_POWER:
+    *val = cols->power[ii];
+    return cols->power[ii] != VIK_TRKPT_POWER_NONE;
+  default:
+    return FALSE;
   }
-  return num;
 }
 
-/*
- * Deletes adjacent points that have the same position
- * Returns the number of points that were deleted
+/**
+ * Include @b in @a.
+ * Ties go to the earlier position, so the order of combining doesn't matter
  */
-gulong vik_track_remove_dup_points ( VikTrack *tr )
+static inline void track_range_combine ( VikTrackRangeStats *a, const VikTrackRangeStats *b )
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter )
-  {
-    if ( iter->next && vik_coord_equals ( &(VIK_TRACKPOINT(iter->data)->coord),
-                       &(VIK_TRACKPOINT(iter->next->data)->coord) ) )
-    {
-      num++;
-      // Maintain track segments
-      if ( VIK_TRACKPOINT(iter->next->data)->newsegment && (iter->next)->next )
-        VIK_TRACKPOINT(((iter->next)->next)->data)->newsegment = TRUE;
+  if ( !b->count )
+    return;
+  if ( !a->count ) {
+    *a = *b;
+    return;
+  }
+  if ( b->min < a->min || (b->min == a->min && b->min_index < a->min_index) ) {
+    a->min = b->min;
+    a->min_index = b->min_index;
+  }
+  if ( b->max > a->max || (b->max == a->max && b->max_index < a->max_index) ) {
+    a->max = b->max;
+    a->max_index = b->max_index;
+  }
+  a->sum += b->sum;
+  a->count += b->count;
+}
 
-      vik_trackpoint_free ( iter->next->data );
-      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter->next );
+static void track_range_scan ( const VikTrackColumns *cols, VikTrackValueType value_type, guint first, guint end, VikTrackRangeStats *stats )
+{
+  for ( guint ii = first; ii < end; ii++ ) {
+    gdouble val;
+    if ( track_range_value ( cols, value_type, ii, &val ) ) {
+      VikTrackRangeStats one = { val, val, val, ii, ii, 1 };
+      track_range_combine ( stats, &one );
     }
-    else
-      iter = iter->next;
   }
-
-  // NB isn't really be necessary as removing duplicate points shouldn't alter the bounds!
-  vik_track_calculate_bounds ( tr );
-
-  return num;
 }
 
-/*
- * Get a count of trackpoints with the same defined timestamp
- * Note is using timestamps with a resolution with 1 second
- */
-gulong vik_track_get_same_time_point_count ( const VikTrack *tr )
+static const VikTrackRangeStats *track_range_tree ( const VikTrackColumns *cols, VikTrackValueType value_type )
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter ) {
+  VikTrackRanges *trs = cols->ranges;
+  if ( !trs ) {
+    trs = g_malloc0 ( sizeof(VikTrackRanges) );
+    trs->nblocks = cols->len / TRACK_RANGE_BLOCK;
+    // Only a cache, so the columns are otherwise unchanged
+    ((VikTrackColumns*)cols)->ranges = trs;
+  }
+  if ( !trs->tree[value_type] ) {
+    guint nn = trs->nblocks;
+    VikTrackRangeStats *tree = g_malloc0 ( sizeof(VikTrackRangeStats) * MAX(1, 2*nn) );
+    for ( guint bb = 0; bb < nn; bb++ )
+      track_range_scan ( cols, value_type, bb * TRACK_RANGE_BLOCK, (bb+1) * TRACK_RANGE_BLOCK, &tree[nn+bb] );
+    for ( guint ii = nn - 1; ii > 0 && nn; ii-- ) {
+      tree[ii] = tree[2*ii];
+      track_range_combine ( &tree[ii], &tree[2*ii+1] );
+    }
+    trs->tree[value_type] = tree;
+  }
+  return trs->tree[value_type];
+}
+
+/**
+ * vik_track_get_range_stats:
+ * @first: Position (as in vik_track_get_columns()) of the first trackpoint of the range
+ * @last:  Position of the last trackpoint of the range
+ * @stats: Filled in with the statistics of those trackpoints having the value
+ *
+ * The trees behind this are built on the first use for each value
+ *  (and kept until the track is changed), after which any range takes O(log n).
+ *
+ * Returns: TRUE if any trackpoints of the range have the value
+ */
+gboolean vik_track_get_range_stats ( const VikTrack *tr, VikTrackValueType value_type, guint first, guint last, VikTrackRangeStats *stats )
+{
+  memset ( stats, 0, sizeof(VikTrackRangeStats) );
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  if ( value_type >= TRACK_VALUE_END || !cols->len || first > last || first >= cols->len )
+    return FALSE;
+  last = MIN ( last, cols->len - 1 );
+
+  // The whole blocks within the range
+  guint bfirst = (first + TRACK_RANGE_BLOCK - 1) / TRACK_RANGE_BLOCK;
+  guint bend = (last + 1) / TRACK_RANGE_BLOCK;
+  if ( bfirst >= bend ) {
+    track_range_scan ( cols, value_type, first, last + 1, stats );
+    return stats->count > 0;
+  }
+
+  track_range_scan ( cols, value_type, first, bfirst * TRACK_RANGE_BLOCK, stats );
+  const VikTrackRangeStats *tree = track_range_tree ( cols, value_type );
+  guint nn = cols->ranges->nblocks;
+  for ( guint ll = bfirst + nn, rr = bend + nn; ll < rr; ll >>= 1, rr >>= 1 ) {
+    if ( ll & 1 )
+      track_range_combine ( stats, &tree[ll++] );
+    if ( rr & 1 )
+      track_range_combine ( stats, &tree[--rr] );
+  }
+  track_range_scan ( cols, value_type, bend * TRACK_RANGE_BLOCK, last + 1, stats );
+  return stats->count > 0;
+}
+
+/**
+ * Statistics of the value over the trackpoints after the first
+ *  (which the whole track statistics of these values have never included)
+ */
+static gboolean track_range_stats_after_first ( const VikTrack *tr, VikTrackValueType value_type, VikTrackRangeStats *stats )
+{
+  return vik_track_get_range_stats ( tr, value_type, 1, G_MAXUINT, stats );
+}
+
+/**
+ * vik_track_get_dem_elevations:
+ *
+ * The DEM elevation under each trackpoint (in the order of vik_track_get_columns()),
+ *  or VIK_DEM_INVALID_ELEVATION where there is none.
+ * These are all looked up in one go when first needed and then kept with the columns,
+ *  until either the track is changed or DEMs are loaded or discarded.
+ *
+ * Returns: The cached values (owned by the track - don't free).
+ *          Only valid until the track is next changed.
+ */
+const gint16 *vik_track_get_dem_elevations ( const VikTrack *tr )
+{
+  VikTrackColumns *cols = (VikTrackColumns*)vik_track_get_columns ( tr );
+  guint serial = a_dems_get_serial ();
+  if ( cols->dem && cols->dem_serial == serial )
+    return cols->dem;
+
+  VikCoord *coords = g_new ( VikCoord, MAX(1, cols->len) );
+  for ( guint ii = 0; ii < cols->len; ii++ )
+    coords[ii] = cols->tps[ii]->coord;
+  if ( !cols->dem )
+    cols->dem = g_new ( gint16, MAX(1, cols->len) );
+  a_dems_get_elev_batch ( coords, cols->len, VIK_DEM_INTERPOL_BEST, cols->dem );
+  cols->dem_serial = serial;
+  g_free ( coords );
+  return cols->dem;
+}
+
+static gint track_time_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  gdouble ta = ((const VikTrackTime*)a)->timestamp;
+  gdouble tb = ((const VikTrackTime*)b)->timestamp;
+  return (ta > tb) - (ta < tb);
+}
+
+/**
+ * vik_track_get_times:
+ *
+ * The trackpoints that have a timestamp, in time order.
+ * Normally this is the track order, but tracks are not required to be in time order.
+ *
+ * Returns: The cached values (owned by the track - don't free).
+ *          Only valid until the track is next changed.
+ */
+const VikTrackTimes *vik_track_get_times ( const VikTrack *tr )
+{
+  if ( tr->times )
+    return tr->times;
+
+  VikTrackTimes *tt = g_malloc0 ( sizeof(VikTrackTimes) );
+  tt->times = g_new ( VikTrackTime, MAX(1, g_list_length(tr->trackpoints)) );
+  gboolean sorted = TRUE;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( isnan(tp->timestamp) )
+      continue;
+    if ( tt->len && tp->timestamp < tt->times[tt->len-1].timestamp )
+      sorted = FALSE;
+    tt->times[tt->len].timestamp = tp->timestamp;
+    tt->times[tt->len].link = iter;
+    tt->len++;
+  }
+  // NB A stable sort
+  if ( !sorted )
+    g_qsort_with_data ( tt->times, tt->len, sizeof(VikTrackTime), track_time_compare, NULL );
+
+  // Only a cache, so the track itself is not changed
+  ((VikTrack*)tr)->times = tt;
+  return tt;
+}
+
+/**
+ * vik_track_get_time_span:
+ *
+ * Returns: FALSE if the track has no timestamps,
+ *  otherwise the earliest and latest trackpoint times
+ */
+gboolean vik_track_get_time_span ( const VikTrack *tr, gdouble *first, gdouble *last )
+{
+  if ( tr->packed )
+    return vik_track_pack_get_time_span ( tr->packed, first, last );
+  const VikTrackTimes *tt = vik_track_get_times ( tr );
+  if ( !tt->len )
+    return FALSE;
+  *first = tt->times[0].timestamp;
+  *last = tt->times[tt->len-1].timestamp;
+  return TRUE;
+}
+
+/**
+ * vik_track_get_sunlight:
+ *
+ * Returns: How light it was along the track as set by vik_track_set_sunlight(),
+ *          or NULL if not set since the track was last changed.
+ *          (Owned by the track - don't free)
+ */
+const VikTrackSunlight *vik_track_get_sunlight ( const VikTrack *tr )
+{
+  return tr->sunlight;
+}
+
+/**
+ * vik_track_set_sunlight:
+ * @sunlight: Worked out elsewhere (see astro_track_sunlight()) and now owned by the track
+ *
+ * Keep how light it was along the track with the track's other derived values,
+ *  so it is discarded once the track changes.
+ */
+void vik_track_set_sunlight ( const VikTrack *tr, VikTrackSunlight *sunlight )
+{
+  // Only a cache, so the track itself is not changed
+  vik_track_sunlight_free ( tr->sunlight );
+  ((VikTrack*)tr)->sunlight = sunlight;
+}
+
+void vik_track_sunlight_free ( VikTrackSunlight *sunlight )
+{
+  if ( !sunlight )
+    return;
+  g_free ( sunlight->levels );
+  g_free ( sunlight );
+}
+
+/**
+ * vik_track_get_position_at_time:
+ * @across_segments: Whether to interpolate between the end of a segment and the start of the next one
+ *
+ * Find where the track was at the time, either at a trackpoint of that time
+ *  or interpolated between consecutive trackpoints either side of it.
+ *
+ * Returns: TRUE if the track covers the time
+ */
+gboolean vik_track_get_position_at_time ( const VikTrack *tr, gdouble timestamp, gboolean across_segments, VikTrackPosition *pos )
+{
+  const VikTrackTimes *tt = vik_track_get_times ( tr );
+  if ( !tt->len || timestamp < tt->times[0].timestamp || timestamp > tt->times[tt->len-1].timestamp )
+    return FALSE;
+
+  // The first trackpoint at or after the time
+  guint lo = 0, hi = tt->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( tt->times[mid].timestamp < timestamp )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  VikTrackpoint *tp = VIK_TRACKPOINT(tt->times[lo].link->data);
+  if ( tp->timestamp == timestamp ) {
+    pos->link = tt->times[lo].link;
+    pos->exact = TRUE;
+    pos->coord = tp->coord;
+    pos->altitude = tp->altitude;
+    return TRUE;
+  }
+
+  // Otherwise between the previous one and the trackpoint following it in the track
+  GList *link = tt->times[lo-1].link;
+  if ( !link->next )
+    return FALSE;
+  tp = VIK_TRACKPOINT(link->data);
+  VikTrackpoint *tp_next = VIK_TRACKPOINT(link->next->data);
+  if ( isnan(tp_next->timestamp) || tp_next->timestamp <= timestamp || tp->timestamp >= tp_next->timestamp )
+    return FALSE;
+  if ( !across_segments && tp_next->newsegment )
+    return FALSE;
+
+  // The relative distance in time between the two points: 0 is the first point, 1 is the next point
+  gdouble scale = (timestamp - tp->timestamp) / (tp_next->timestamp - tp->timestamp);
+  struct LatLon ll1, ll2, ll;
+  vik_coord_to_latlon ( &tp->coord, &ll1 );
+  vik_coord_to_latlon ( &tp_next->coord, &ll2 );
+  ll.lat = ll1.lat + (ll2.lat - ll1.lat) * scale;
+  // NB This won't cope with going over the 180 degrees longitude boundary
+  ll.lon = ll1.lon + (ll2.lon - ll1.lon) * scale;
+
+  pos->link = link;
+  pos->exact = FALSE;
+  vik_coord_load_from_latlon ( &pos->coord, VIK_COORD_LATLON, &ll );
+  pos->altitude = tp->altitude + (tp_next->altitude - tp->altitude) * scale;
+  return TRUE;
+}
+
+/**
+ * Distance from point p to the line segment a-b
+ */
+static gdouble simplify_distance ( const gdouble *p, const gdouble *a, const gdouble *b )
+{
+  gdouble dx = b[0] - a[0];
+  gdouble dy = b[1] - a[1];
+  gdouble t = 0.0;
+  gdouble len2 = dx*dx + dy*dy;
+  if ( len2 > 0.0 )
+    t = CLAMP ( ((p[0]-a[0])*dx + (p[1]-a[1])*dy) / len2, 0.0, 1.0 );
+  dx = p[0] - (a[0] + t*dx);
+  dy = p[1] - (a[1] + t*dy);
+  return sqrt ( dx*dx + dy*dy );
+}
+
+/**
+ * Distance from point p (at time tp) to where the line a-b would be at that time,
+ *  when travelled from time ta at a to time tb at b
+ */
+static gdouble simplify_time_distance ( const gdouble *p, gdouble tp, const gdouble *a, gdouble ta, const gdouble *b, gdouble tb )
+{
+  if ( isnan(tp) || isnan(ta) || isnan(tb) || !(tb > ta) )
+    return simplify_distance ( p, a, b );
+  gdouble t = CLAMP ( (tp - ta) / (tb - ta), 0.0, 1.0 );
+  gdouble dx = p[0] - (a[0] + t*(b[0] - a[0]));
+  gdouble dy = p[1] - (a[1] + t*(b[1] - a[1]));
+  return sqrt ( dx*dx + dy*dy );
+}
+
+/**
+ * vik_track_simplify_significance:
+ * @lat:        Latitude of each point in degrees
+ * @lon:        Longitude of each point in degrees
+ * @times:      Timestamp of each point (NAN when unknown), or NULL to simplify just the shape
+ * @newsegment: Whether each point starts a new segment, or NULL for a single segment
+ * @len:        The number of points
+ *
+ * Douglas-Peucker simplification at all tolerances at once, as used for drawing tracks when zoomed out,
+ *  so the points for any tolerance are then had in a single pass (see vik_track_copy_simplified()).
+ * With @times the error of a point is its distance from where the simplified track is at the same time,
+ *  so stops and changes of speed are kept as well as the shape.
+ * Each segment is simplified separately and always keeps its ends.
+ * Only the values given are used, so this can be run in a background thread.
+ *
+ * Returns: The largest error in metres at which each point is still needed
+ *  (G_MAXDOUBLE for the ends of segments). Free with g_free().
+ */
+gdouble *vik_track_simplify_significance ( const gdouble *lat, const gdouble *lon, const gdouble *times, const gboolean *newsegment, guint len )
+{
+  gdouble *significance = g_malloc ( sizeof(gdouble) * MAX(1, len) );
+  if ( !len )
+    return significance;
+
+  // A local flat projection in metres is accurate enough for deciding which points matter
+  gdouble south = lat[0], north = lat[0];
+  for ( guint ii = 1; ii < len; ii++ ) {
+    if ( lat[ii] < south ) south = lat[ii];
+    if ( lat[ii] > north ) north = lat[ii];
+  }
+  gdouble coslat = cos ( DEG2RAD((north + south) / 2) );
+  gdouble *xy = g_malloc ( sizeof(gdouble) * 2 * len );
+  for ( guint ii = 0; ii < len; ii++ ) {
+    xy[2*ii] = DEG2RAD(lon[ii]) * SIMPLIFY_EARTH_RADIUS * coslat;
+    xy[2*ii+1] = DEG2RAD(lat[ii]) * SIMPLIFY_EARTH_RADIUS;
+  }
+
+  // An explicit stack of ranges avoids deep recursion on long tracks
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(guint) * 2 );
+  guint start = 0;
+  for ( guint ii = 0; ii < len; ii++ ) {
+    if ( ii + 1 < len && !(newsegment && newsegment[ii+1]) )
+      continue;
+    significance[start] = G_MAXDOUBLE;
+    significance[ii] = G_MAXDOUBLE;
+    guint range[2] = { start, ii };
+    g_array_append_val ( stack, range );
+    while ( stack->len ) {
+      guint *top = &g_array_index ( stack, guint, 2*(stack->len-1) );
+      guint aa = top[0], bb = top[1];
+      g_array_set_size ( stack, stack->len-1 );
+      if ( bb <= aa + 1 )
+        continue;
+      guint mid = aa + 1;
+      gdouble max = -1.0;
+      for ( guint jj = aa + 1; jj < bb; jj++ ) {
+        gdouble dist = times ?
+          simplify_time_distance ( &xy[2*jj], times[jj], &xy[2*aa], times[aa], &xy[2*bb], times[bb] ) :
+          simplify_distance ( &xy[2*jj], &xy[2*aa], &xy[2*bb] );
+        if ( dist > max ) {
+          max = dist;
+          mid = jj;
+        }
+      }
+      // Never more significant than the ends it's within, so each level contains the coarser ones
+      significance[mid] = MIN ( max, MIN(significance[aa], significance[bb]) );
+      guint left[2] = { aa, mid };
+      guint right[2] = { mid, bb };
+      g_array_append_val ( stack, left );
+      g_array_append_val ( stack, right );
+    }
+    start = ii + 1;
+  }
+  g_array_free ( stack, TRUE );
+  g_free ( xy );
+  return significance;
+}
+
+/**
+ * vik_track_copy_simplified:
+ * @significance: For each trackpoint, from vik_track_simplify_significance()
+ * @tolerance:    The allowable error in metres
+ *
+ * Returns: A new track of copies of just the trackpoints needed for the tolerance
+ */
+VikTrack *vik_track_copy_simplified ( const VikTrack *tr, const gdouble *significance, gdouble tolerance )
+{
+  VikTrack *new_tr = vik_track_copy ( tr, FALSE );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ )
+    if ( significance[ii] >= tolerance )
+      new_tr->trackpoints = g_list_prepend ( new_tr->trackpoints, vik_trackpoint_copy ( VIK_TRACKPOINT(iter->data) ) );
+  new_tr->trackpoints = g_list_reverse ( new_tr->trackpoints );
+  vik_track_calculate_bounds ( new_tr );
+  return new_tr;
+}
+
+static VikTrackSimplified *track_simplified_new ( const VikTrack *tr )
+{
+  VikTrackSimplified *ts = g_malloc0 ( sizeof(VikTrackSimplified) );
+  ts->len = g_list_length ( tr->trackpoints );
+  ts->tps = g_malloc ( sizeof(VikTrackpoint*) * MAX(1, ts->len) );
+
+  // As worked out in a previous session
+  ts->significance = g_malloc ( sizeof(gdouble) * MAX(1, ts->len) );
+  if ( a_trackcache_load ( tr, "simplified", TRACK_SIMPLIFIED_CACHE_VERSION, ts->significance, sizeof(gdouble) * ts->len ) ) {
+    guint ii = 0;
+    for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ )
+      ts->tps[ii] = VIK_TRACKPOINT(iter->data);
+    return ts;
+  }
+  g_free ( ts->significance );
+
+  gdouble *lat = g_malloc ( sizeof(gdouble) * MAX(1, ts->len) );
+  gdouble *lon = g_malloc ( sizeof(gdouble) * MAX(1, ts->len) );
+  gboolean *newsegment = g_malloc ( sizeof(gboolean) * MAX(1, ts->len) );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    struct LatLon ll;
+    ts->tps[ii] = VIK_TRACKPOINT(iter->data);
+    vik_coord_to_latlon ( &(ts->tps[ii]->coord), &ll );
+    lat[ii] = ll.lat;
+    lon[ii] = ll.lon;
+    newsegment[ii] = ts->tps[ii]->newsegment;
+  }
+  ts->significance = vik_track_simplify_significance ( lat, lon, NULL, newsegment, ts->len );
+  g_free ( lat );
+  g_free ( lon );
+  g_free ( newsegment );
+  a_trackcache_save ( tr, "simplified", TRACK_SIMPLIFIED_CACHE_VERSION, ts->significance, sizeof(gdouble) * ts->len );
+  return ts;
+}
+
+/**
+ * vik_track_get_simplified:
+ * @tolerance: The allowable error in metres - typically the size of a pixel
+ *
+ * A reduced set of the trackpoints that draws the same shape to within the tolerance,
+ *  for drawing when zoomed out. The start and end of every segment is always included.
+ * The simplification is worked out once, and each zoom band is then kept until the track is changed.
+ *
+ * Returns: The trackpoints (owned by the track - don't free) or NULL if no simplification is possible.
+ *          Only valid until the track is next changed.
+ */
+const GPtrArray *vik_track_get_simplified ( const VikTrack *tr, gdouble tolerance )
+{
+  if ( !tr->trackpoints || !(tolerance >= 1.0) )
+    return NULL;
+
+  // Round down to a band so the levels can be shared between similar zooms
+  gint level = MIN ( (gint)floor(log2(tolerance)), SIMPLIFIED_LEVELS-1 );
+  gdouble band = pow ( 2.0, level );
+
+  // Only a cache, so the track itself is not changed
+  if ( !tr->simplified )
+    ((VikTrack*)tr)->simplified = track_simplified_new ( tr );
+  VikTrackSimplified *ts = tr->simplified;
+
+  if ( !ts->levels[level] ) {
+    GPtrArray *tps = g_ptr_array_new ();
+    for ( guint ii = 0; ii < ts->len; ii++ )
+      if ( ts->significance[ii] >= band )
+        g_ptr_array_add ( tps, ts->tps[ii] );
+    ts->levels[level] = tps;
+  }
+  return ts->levels[level];
+}
+
+/**
+ * vik_track_get_chunks:
+ *
+ * The track split into runs of VIK_TRACK_CHUNK_SIZE trackpoints (VikTrackChunk) each with its own bounds,
+ *  so long tracks only partly within an area can be processed quickly.
+ * Built when first needed and then kept until the track is changed.
+ *
+ * Returns: The chunks in order (owned by the track - don't free).
+ *          Only valid until the track is next changed.
+ */
+const GArray *vik_track_get_chunks ( const VikTrack *tr )
+{
+  if ( tr->chunks )
+    return tr->chunks;
+
+  GArray *chunks = g_array_new ( FALSE, FALSE, sizeof(VikTrackChunk) );
+  VikTrackChunk chunk = { NULL, NULL, { 0.0, 0.0, 0.0, 0.0 }, 0.0, 0, 0 };
+  gdouble dist = 0.0;
+  guint count = 0;
+  guint len;
+  gdouble *diffs = track_segment_lengths ( tr, &len );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    const VikCoord *coord = &(VIK_TRACKPOINT(iter->data)->coord);
+    gchar zone = coord->mode == VIK_COORD_UTM ? coord->utm_zone : 0;
+    struct LatLon ll;
+    vik_coord_to_latlon ( coord, &ll );
+    dist += diffs[ii];
+    if ( count == 0 ) {
+      chunk.first = iter;
+      chunk.distance = dist;
+      chunk.bbox.north = chunk.bbox.south = ll.lat;
+      chunk.bbox.east = chunk.bbox.west = ll.lon;
+      chunk.zone_min = chunk.zone_max = zone;
+    }
+    else {
+      if ( ll.lat > chunk.bbox.north ) chunk.bbox.north = ll.lat;
+      if ( ll.lat < chunk.bbox.south ) chunk.bbox.south = ll.lat;
+      if ( ll.lon > chunk.bbox.east ) chunk.bbox.east = ll.lon;
+      if ( ll.lon < chunk.bbox.west ) chunk.bbox.west = ll.lon;
+      if ( zone < chunk.zone_min ) chunk.zone_min = zone;
+      if ( zone > chunk.zone_max ) chunk.zone_max = zone;
+    }
+    chunk.last = iter;
+    if ( ++count == VIK_TRACK_CHUNK_SIZE || !iter->next ) {
+      g_array_append_val ( chunks, chunk );
+      count = 0;
+    }
+  }
+  g_free ( diffs );
+
+  // Only a cache, so the track itself is not changed
+  ((VikTrack*)tr)->chunks = chunks;
+  return chunks;
+}
+
+/**
+ * vik_track_get_utm_zones:
+ * @zone_min: The lowest UTM zone of the trackpoints
+ * @zone_max: The highest UTM zone of the trackpoints
+ *
+ * The span of UTM zones the track is in, from its chunks (see vik_track_get_chunks()),
+ *  so a track can be passed over when drawing several zones without looking at its trackpoints.
+ *
+ * Returns: FALSE if the track has no trackpoints
+ */
+gboolean vik_track_get_utm_zones ( const VikTrack *tr, gchar *zone_min, gchar *zone_max )
+{
+  const GArray *chunks = vik_track_get_chunks ( tr );
+  if ( !chunks->len )
+    return FALSE;
+  *zone_min = g_array_index ( chunks, VikTrackChunk, 0 ).zone_min;
+  *zone_max = g_array_index ( chunks, VikTrackChunk, 0 ).zone_max;
+  for ( guint ii = 1; ii < chunks->len; ii++ ) {
+    const VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    if ( chunk->zone_min < *zone_min ) *zone_min = chunk->zone_min;
+    if ( chunk->zone_max > *zone_max ) *zone_max = chunk->zone_max;
+  }
+  return TRUE;
+}
+
+/**
+ * vik_track_changed:
+ *
+ * Discard any values worked out from the trackpoints.
+ * vik_track_ functions that alter trackpoints do this already;
+ *  it's only needed when the trackpoint list or values are changed directly.
+ */
+void vik_track_changed ( VikTrack *tr )
+{
+  track_columns_free ( tr->columns );
+  tr->columns = NULL;
+  g_free ( tr->stats );
+  tr->stats = NULL;
+  track_simplified_free ( tr->simplified );
+  tr->simplified = NULL;
+  if ( tr->chunks )
+    g_array_free ( tr->chunks, TRUE );
+  tr->chunks = NULL;
+  track_times_free ( tr->times );
+  tr->times = NULL;
+  track_profiles_free ( tr->profiles );
+  tr->profiles = NULL;
+  track_splits_free ( tr->splits );
+  tr->splits = NULL;
+  vik_track_sunlight_free ( tr->sunlight );
+  tr->sunlight = NULL;
+  TRACK_NEW_SERIAL ( tr );
+}
+
+/**
+ * vik_track_pack:
+ *
+ * Hold the trackpoints compactly (see trackpack.c) instead of in the trackpoints list,
+ *  which is then empty until vik_track_unpack() is called.
+ * Only for tracks that are not going to be worked on for a while,
+ *  as nothing else should be keeping hold of their trackpoints.
+ *
+ * Returns: Whether the trackpoints were packed
+ */
+gboolean vik_track_pack ( VikTrack *tr )
+{
+  if ( tr->packed || !tr->trackpoints )
+    return FALSE;
+  VikTrackPack *pack = vik_track_pack_new ( tr->trackpoints );
+  if ( !pack )
+    return FALSE;
+  g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
+  g_list_free ( tr->trackpoints );
+  tr->trackpoints = NULL;
+  tr->packed = pack;
+  // Bounds are unchanged, but values derived from the trackpoints refer to them
+  vik_track_changed ( tr );
+  return TRUE;
+}
+
+/**
+ * vik_track_unpack:
+ *
+ * Put the trackpoints of a packed track back into its trackpoints list
+ */
+void vik_track_unpack ( VikTrack *tr )
+{
+  if ( !tr->packed )
+    return;
+  tr->trackpoints = vik_track_pack_unpack ( tr->packed );
+  vik_track_pack_free ( tr->packed );
+  tr->packed = NULL;
+  vik_track_changed ( tr );
+}
+
+#define TRACK_STRING_SIZE(s) ((s) ? strlen(s) + 1 : 0)
+
+/**
+ * vik_track_get_memory_usage:
+ *
+ * Returns: Approximate bytes held for the track: its trackpoints (or their packed form) and strings.
+ *  Caches built on demand are not counted, as they are rebuilt whenever needed.
+ *  Packed trackpoints shared with other tracks (see vik_track_copy_shared()) are counted for each.
+ */
+gsize vik_track_get_memory_usage ( const VikTrack *tr )
+{
+  gsize size = sizeof(VikTrack)
+    + TRACK_STRING_SIZE(tr->name) + TRACK_STRING_SIZE(tr->comment) + TRACK_STRING_SIZE(tr->description)
+    + TRACK_STRING_SIZE(tr->source) + TRACK_STRING_SIZE(tr->url) + TRACK_STRING_SIZE(tr->url_name)
+    + TRACK_STRING_SIZE(tr->type) + TRACK_STRING_SIZE(tr->extensions);
+  if ( tr->packed )
+    size += vik_track_pack_get_size ( tr->packed );
+  else
+    // Trackpoint names and extensions are shared (see tp_string_ref()) so not counted
+    size += g_list_length ( tr->trackpoints ) * (sizeof(VikTrackpoint) + sizeof(GList));
+  return size;
+}
+
+static guint64 trackpoint_hash ( guint64 hash, const VikTrackpoint *tp )
+{
+  hash = util_hash_string ( hash, tp->name );
+  hash = util_hash_bytes ( hash, &tp->coord.mode, sizeof(tp->coord.mode) );
+  hash = util_hash_double ( hash, tp->coord.north_south );
+  hash = util_hash_double ( hash, tp->coord.east_west );
+  hash = util_hash_bytes ( hash, &tp->newsegment, sizeof(tp->newsegment) );
+  hash = util_hash_double ( hash, tp->timestamp );
+  hash = util_hash_double ( hash, tp->altitude );
+  hash = util_hash_double ( hash, tp->speed );
+  hash = util_hash_double ( hash, tp->course );
+  hash = util_hash_bytes ( hash, &tp->nsats, sizeof(tp->nsats) );
+  hash = util_hash_bytes ( hash, &tp->fix_mode, sizeof(tp->fix_mode) );
+  hash = util_hash_double ( hash, tp->hdop );
+  hash = util_hash_double ( hash, tp->vdop );
+  hash = util_hash_double ( hash, tp->pdop );
+  hash = util_hash_string ( hash, tp->extensions );
+  hash = util_hash_bytes ( hash, &tp->heart_rate, sizeof(tp->heart_rate) );
+  hash = util_hash_bytes ( hash, &tp->cadence, sizeof(tp->cadence) );
+  hash = util_hash_double ( hash, tp->temp );
+  hash = util_hash_bytes ( hash, &tp->power, sizeof(tp->power) );
+  return hash;
+}
+
+/**
+ * vik_track_get_content_hash:
+ *
+ * Returns: A hash of everything read from or written to a file about the track and its trackpoints,
+ *  apart from how it is shown (visibility, colour and so on).
+ *  So tracks with the same hash can be taken to be the same track (e.g. when merging layers).
+ */
+guint64 vik_track_get_content_hash ( const VikTrack *tr )
+{
+  guint64 hash = UTIL_HASH_INIT;
+  hash = util_hash_bytes ( hash, &tr->is_route, sizeof(tr->is_route) );
+  hash = util_hash_string ( hash, tr->name );
+  hash = util_hash_string ( hash, tr->comment );
+  hash = util_hash_string ( hash, tr->description );
+  hash = util_hash_string ( hash, tr->source );
+  hash = util_hash_string ( hash, tr->url );
+  hash = util_hash_string ( hash, tr->url_name );
+  hash = util_hash_string ( hash, tr->type );
+  hash = util_hash_string ( hash, tr->extensions );
+  hash = util_hash_bytes ( hash, &tr->number, sizeof(tr->number) );
+
+  // Packed trackpoints are only unpacked for the moment, so the track itself is left packed
+  GList *trackpoints = tr->packed ? vik_track_pack_unpack ( tr->packed ) : tr->trackpoints;
+  GList *iter;
+  for ( iter = trackpoints; iter; iter = iter->next )
+    hash = trackpoint_hash ( hash, VIK_TRACKPOINT(iter->data) );
+  if ( tr->packed ) {
+    g_list_foreach ( trackpoints, (GFunc) vik_trackpoint_free, NULL );
+    g_list_free ( trackpoints );
+  }
+  return hash;
+}
+
+/**
+ * vik_track_get_trackpoints_hash:
+ *
+ * Returns: A hash of just the trackpoints (and how many there are),
+ *  so anything derived only from the trackpoints can be recognised as still the same
+ *  whatever else about the track changes (e.g. its name).
+ */
+guint64 vik_track_get_trackpoints_hash ( const VikTrack *tr )
+{
+  guint64 hash = UTIL_HASH_INIT;
+  GList *trackpoints = tr->packed ? vik_track_pack_unpack ( tr->packed ) : tr->trackpoints;
+  guint len = 0;
+  for ( GList *iter = trackpoints; iter; iter = iter->next, len++ )
+    hash = trackpoint_hash ( hash, VIK_TRACKPOINT(iter->data) );
+  hash = util_hash_bytes ( hash, &len, sizeof(len) );
+  if ( tr->packed ) {
+    g_list_foreach ( trackpoints, (GFunc) vik_trackpoint_free, NULL );
+    g_list_free ( trackpoints );
+  }
+  return hash;
+}
+
+// Points of a track sampled for its fingerprint
+#define FINGERPRINT_SAMPLES 16
+
+static guint64 fingerprint_hash_latlon ( guint64 hash, const VikCoord *coord, gdouble scale )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  gint64 lat = llround ( ll.lat * scale );
+  gint64 lon = llround ( ll.lon * scale );
+  hash = util_hash_bytes ( hash, &lat, sizeof(lat) );
+  return util_hash_bytes ( hash, &lon, sizeof(lon) );
+}
+
+/**
+ * vik_track_get_fingerprint:
+ * @exact: Returns a hash of the point count, start and end times, and some of the positions
+ * @near:  Returns a hash of just the start and end to about a minute
+ *         (or about 10 metres when there are no timestamps)
+ *
+ * Quick to compute compared to vik_track_get_content_hash(), and made to recognise the same recording
+ *  read in again (e.g. overlapping downloads from a device): @exact when it is unchanged,
+ *  and @near even after some points have been removed or it has been renamed.
+ *
+ * Returns: FALSE if the track has no trackpoints
+ */
+gboolean vik_track_get_fingerprint ( const VikTrack *tr, guint64 *exact, guint64 *near )
+{
+  GList *trackpoints = tr->packed ? vik_track_pack_unpack ( tr->packed ) : tr->trackpoints;
+  if ( !trackpoints )
+    return FALSE;
+
+  guint len = g_list_length ( trackpoints );
+  const VikTrackpoint *first = VIK_TRACKPOINT(trackpoints->data);
+  const VikTrackpoint *last = VIK_TRACKPOINT(g_list_last(trackpoints)->data);
+
+  guint64 hash = UTIL_HASH_INIT;
+  hash = util_hash_bytes ( hash, &tr->is_route, sizeof(tr->is_route) );
+  hash = util_hash_bytes ( hash, &len, sizeof(len) );
+  hash = util_hash_double ( hash, first->timestamp );
+  hash = util_hash_double ( hash, last->timestamp );
+  // Evenly spaced points, in one pass
+  guint ii = 0, sample = 0;
+  GList *iter;
+  for ( iter = trackpoints; iter && sample < FINGERPRINT_SAMPLES; iter = iter->next, ii++ ) {
+    if ( (guint64)ii * FINGERPRINT_SAMPLES >= (guint64)sample * len ) {
+      hash = fingerprint_hash_latlon ( hash, &VIK_TRACKPOINT(iter->data)->coord, 1e7 );
+      sample++;
+    }
+  }
+  *exact = hash;
+
+  hash = UTIL_HASH_INIT;
+  hash = util_hash_bytes ( hash, &tr->is_route, sizeof(tr->is_route) );
+  if ( !isnan(first->timestamp) && !isnan(last->timestamp) ) {
+    gint64 start = llround ( first->timestamp / 60.0 );
+    gint64 end = llround ( last->timestamp / 60.0 );
+    hash = util_hash_bytes ( hash, &start, sizeof(start) );
+    hash = util_hash_bytes ( hash, &end, sizeof(end) );
+  }
+  else {
+    hash = fingerprint_hash_latlon ( hash, &first->coord, 1e4 );
+    hash = fingerprint_hash_latlon ( hash, &last->coord, 1e4 );
+  }
+  *near = hash;
+
+  if ( tr->packed ) {
+    g_list_foreach ( trackpoints, (GFunc) vik_trackpoint_free, NULL );
+    g_list_free ( trackpoints );
+  }
+  return TRUE;
+}
+
+gulong vik_track_get_dup_point_count ( const VikTrack *tr )
+{
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  while ( iter )
+  {
+    if ( iter->next && vik_coord_equals ( &(VIK_TRACKPOINT(iter->data)->coord),
+                       &(VIK_TRACKPOINT(iter->next->data)->coord) ) )
+      num++;
+    iter = iter->next;
+  }
+  return num;
+}
+
+gulong vik_track_get_tp_num (const VikTrack *tr, const VikTrackpoint *tp)
+{
+  g_return_val_if_fail ( tr, 0 );
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  while ( iter ) {
+    num++;
+    if ( VIK_TRACKPOINT(iter->data) == tp )
+      break;
+    iter = iter->next;
+  }
+  return num;
+}
+
+/*
+ * Deletes adjacent points that have the same position
+ * Returns the number of points that were deleted
+ */
+gulong vik_track_remove_dup_points ( VikTrack *tr )
+{
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  while ( iter )
+  {
+    if ( iter->next && vik_coord_equals ( &(VIK_TRACKPOINT(iter->data)->coord),
+                       &(VIK_TRACKPOINT(iter->next->data)->coord) ) )
+    {
+      num++;
+      // Maintain track segments
+      if ( VIK_TRACKPOINT(iter->next->data)->newsegment && (iter->next)->next )
+        VIK_TRACKPOINT(((iter->next)->next)->data)->newsegment = TRUE;
+
+      vik_trackpoint_free ( iter->next->data );
+      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter->next );
+    }
+    else
+      iter = iter->next;
+  }
+
+  // NB isn't really be necessary as removing duplicate points shouldn't alter the bounds!
+  if ( num )
+    vik_track_calculate_bounds ( tr );
+
+  return num;
+}
+
+/*
+ * Get a count of trackpoints with the same defined timestamp
+ * Note is using timestamps with a resolution with 1 second
+ */
+gulong vik_track_get_same_time_point_count ( const VikTrack *tr )
+{
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  while ( iter ) {
     if ( iter->next &&
 	 ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
            !isnan(VIK_TRACKPOINT(iter->next->data)->timestamp) ) &&
@@ -571,6 +1930,7 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
             deleted = TRUE;
             vik_trackpoint_free ( tp1 );
             vt->trackpoints = g_list_delete_link ( vt->trackpoints, iter );
+            vik_track_changed ( vt );
             if ( recalc_bounds )
               vik_track_calculate_bounds ( vt );
 	  }
@@ -582,6 +1942,95 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
   return deleted;
 }
 
+/**
+ * vik_track_clean:
+ * @tr:      The track
+ * @params:  What to remove
+ * @removed: When not NULL, gets the removed trackpoints (in track order) instead of them being freed
+ *
+ * Remove duplicate and anomalous trackpoints in a single pass along the track,
+ *  with each trackpoint compared to the previous one that is kept.
+ * Speeds and accelerations are not checked across the start of a segment,
+ *  and if a trackpoint starting a segment is removed then the next one starts it instead.
+ *
+ * Returns: The number of trackpoints removed
+ */
+gulong vik_track_clean ( VikTrack *tr, const VikTrackCleanParams *params, GPtrArray *removed )
+{
+  gulong num = 0;
+  GList *prev = NULL;          // The previous trackpoint kept
+  gdouble prev_speed = NAN;    // Reaching the previous trackpoint
+  gboolean newsegment = FALSE; // A removed trackpoint was starting a segment
+  gboolean check_speed = params->max_speed > 0 || params->max_accel > 0;
+
+  gboolean first = TRUE;
+  GList *iter = tr->trackpoints;
+  while ( iter ) {
+    GList *next = iter->next;
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gboolean remove = FALSE;
+    gdouble speed = NAN;
+
+    if ( first ) {
+      // As vik_track_remove_dodgy_first_point()
+      if ( params->first_speed > 0 && next && !isnan(tp->timestamp) && !isnan(VIK_TRACKPOINT(next->data)->timestamp) ) {
+        VikTrackpoint *tp2 = VIK_TRACKPOINT(next->data);
+        gdouble spd = fabs ( vik_coord_diff(&tp->coord, &tp2->coord) / (tp2->timestamp - tp->timestamp) );
+        remove = spd > params->first_speed;
+      }
+    }
+    else if ( prev ) {
+      VikTrackpoint *ptp = VIK_TRACKPOINT(prev->data);
+      gboolean times = !isnan(tp->timestamp) && !isnan(ptp->timestamp);
+      if ( params->duplicates && vik_coord_equals(&ptp->coord, &tp->coord) )
+        remove = TRUE;
+      else if ( params->same_time && times && tp->timestamp == ptp->timestamp )
+        remove = TRUE;
+      else if ( check_speed && times && !tp->newsegment && !newsegment && tp->timestamp > ptp->timestamp ) {
+        gdouble dt = tp->timestamp - ptp->timestamp;
+        speed = vik_coord_diff ( &ptp->coord, &tp->coord ) / dt;
+        if ( params->max_speed > 0 && speed > params->max_speed )
+          remove = TRUE;
+        else if ( params->max_accel > 0 && !isnan(prev_speed) && fabs(speed - prev_speed) / dt > params->max_accel )
+          remove = TRUE;
+      }
+    }
+
+    if ( remove ) {
+      // Maintain track segments (but the track itself always starts one)
+      if ( tp->newsegment && prev )
+        newsegment = TRUE;
+      if ( prev )
+        prev->next = next;
+      else
+        tr->trackpoints = next;
+      if ( next )
+        next->prev = prev;
+      g_list_free_1 ( iter );
+      if ( removed )
+        g_ptr_array_add ( removed, tp );
+      else
+        vik_trackpoint_free ( tp );
+      num++;
+    }
+    else {
+      if ( newsegment )
+        tp->newsegment = TRUE;
+      newsegment = FALSE;
+      prev_speed = speed;
+      prev = iter;
+    }
+    first = FALSE;
+    iter = next;
+  }
+
+  if ( num ) {
+    vik_track_calculate_bounds ( tr );
+    vik_track_changed ( tr );
+  }
+  return num;
+}
+
 /*
  * Deletes all 'extra' trackpoint information
  *  such as time stamps, speed, course etc...
@@ -589,6 +2038,7 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
  */
 void vik_track_to_routepoints ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   GList *iter = tr->trackpoints;
   while ( iter ) {
 
@@ -601,8 +2051,7 @@ void vik_track_to_routepoints ( VikTrack *tr )
     VIK_TRACKPOINT(iter->data)->pdop = NAN;
     VIK_TRACKPOINT(iter->data)->nsats = 0;
     VIK_TRACKPOINT(iter->data)->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-    g_free ( VIK_TRACKPOINT(iter->data)->extensions );
-    VIK_TRACKPOINT(iter->data)->extensions = NULL;
+    vik_trackpoint_set_extensions ( VIK_TRACKPOINT(iter->data), NULL );
     VIK_TRACKPOINT(iter->data)->heart_rate = 0;
     VIK_TRACKPOINT(iter->data)->cadence = VIK_TRKPT_CADENCE_NONE;
     VIK_TRACKPOINT(iter->data)->temp = NAN;
@@ -626,13 +2075,16 @@ guint vik_track_get_segment_count(const VikTrack *tr)
   return num;
 }
 
+// Fwd declaration
+static void bbox_extend_trackpoints ( LatLonBBox *bbox, gboolean *valid, GList *iter, GList *end );
+static void track_set_bounds ( VikTrack *trk, const LatLonBBox *bbox );
+
+/**
+ * Copies of each segment of the track, made and bounded in one pass over the trackpoints
+ */
 VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
 {
-  VikTrack **rv;
-  VikTrack *tr;
-  guint i;
   guint segs = vik_track_get_segment_count(t);
-  GList *iter;
 
   if ( segs < 2 )
   {
@@ -640,39 +2092,30 @@ VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
     return NULL;
   }
 
-  rv = g_malloc ( segs * sizeof(VikTrack *) );
-  tr = vik_track_copy ( t, TRUE );
-  rv[0] = tr;
-  iter = tr->trackpoints;
-
-  i = 1;
-  while ( (iter = iter->next) )
+  VikTrack **rv = g_malloc ( segs * sizeof(VikTrack *) );
+  guint i = 0;
+  GList *start = t->trackpoints;
+  GList *iter = start;
+  while ( start )
   {
-    if ( VIK_TRACKPOINT(iter->data)->newsegment )
+    iter = iter->next;
+    if ( !iter || VIK_TRACKPOINT(iter->data)->newsegment )
     {
-      iter->prev->next = NULL;
-      iter->prev = NULL;
-      rv[i] = vik_track_copy ( tr, FALSE );
-      rv[i]->trackpoints = iter;
-      i++;
-    }
-  }
-
-  // Reset bounds of all tracks (including the original track since that may have changed)
-  //  this must be performed once all tracks have been split;
-  //  otherwise if done inside the while loop above,
-  //  the current track analysed would still contain subsequent segments
-  if ( segs == i ) {
-    for ( gint jj=0; jj<segs; jj++ ) {
-      if ( rv[jj] )
-        vik_track_calculate_bounds ( rv[jj] );
+      VikTrack *tr = vik_track_copy ( t, FALSE );
+      GList *tps = NULL;
+      for ( GList *tp_iter = start; tp_iter != iter; tp_iter = tp_iter->next )
+        tps = g_list_prepend ( tps, vik_trackpoint_copy ( VIK_TRACKPOINT(tp_iter->data) ) );
+      tr->trackpoints = g_list_reverse ( tps );
+      LatLonBBox bbox = t->bbox;
+      gboolean valid = FALSE;
+      bbox_extend_trackpoints ( &bbox, &valid, start, iter );
+      track_set_bounds ( tr, &bbox );
+      rv[i++] = tr;
+      start = iter;
     }
-  } else {
-    g_critical ( "Split segments (%d) does not match iterated value (%d)", segs, i );
-    vik_track_calculate_bounds ( tr ); // Only safe to recalc just this track
   }
 
-  *ret_len = segs;
+  *ret_len = i;
   return rv;
 }
 
@@ -688,8 +2131,6 @@ guint vik_track_merge_segments(VikTrack *tr)
     return num;
 
   // Always skip the first point as this should be the first segment
-  iter = iter->next;
-
   while ( (iter = iter->next) )
   {
     if ( VIK_TRACKPOINT(iter->data)->newsegment ) {
@@ -697,6 +2138,9 @@ guint vik_track_merge_segments(VikTrack *tr)
       num++;
     }
   }
+  // Same trackpoints, so the bounds are unchanged
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -706,6 +2150,7 @@ void vik_track_reverse ( VikTrack *tr )
     return;
 
   tr->trackpoints = g_list_reverse(tr->trackpoints);
+  vik_track_changed ( tr );
 
   /* fix 'newsegment' */
   GList *iter = g_list_last ( tr->trackpoints );
@@ -735,32 +2180,17 @@ void vik_track_reverse ( VikTrack *tr )
 gdouble vik_track_get_duration(const VikTrack *trk, gboolean segment_gaps)
 {
   gdouble duration = 0;
-  if ( trk->trackpoints ) {
-    // Ensure times are available
-    if ( !isnan(vik_track_get_tp_first(trk)->timestamp) ) {
-      // Get trkpt only once - as using vik_track_get_tp_last() iterates whole track each time
-      if (segment_gaps) {
-        // Simple duration
-        VikTrackpoint *trkpt_last = vik_track_get_tp_last(trk);
-        if ( !isnan(trkpt_last->timestamp) ) {
-          gdouble t1 = vik_track_get_tp_first(trk)->timestamp;
-          gdouble t2 = trkpt_last->timestamp;
-          duration = t2 - t1;
-        }
-      }
-      else {
-        // Total within segments
-        GList *iter = trk->trackpoints->next;
-        while (iter) {
-          if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-               !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-              (!VIK_TRACKPOINT(iter->data)->newsegment) ) {
-            duration += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-          }
-          iter = iter->next;
-        }
-      }
+  const VikTrackStats *st = track_stats ( trk );
+  // Ensure times are available
+  if ( st && !isnan(st->first->timestamp) ) {
+    if (segment_gaps) {
+      // Simple duration
+      if ( !isnan(st->last->timestamp) )
+        duration = st->last->timestamp - st->first->timestamp;
     }
+    else
+      // Total within segments
+      duration = st->duration;
   }
   return duration;
 }
@@ -782,25 +2212,10 @@ VikCoord vik_track_get_center ( VikTrack *trk, VikCoordMode cmode )
 
 gdouble vik_track_get_average_speed(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  gdouble time = 0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-        time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-      }
-      iter = iter->next;
-    }
-  }
-  return (time == 0) ? 0 : ABS(len/time);
+  const VikTrackStats *st = track_stats ( tr );
+  if ( !st || st->duration == 0 )
+    return 0;
+  return ABS(st->timed_length/st->duration);
 }
 
 /**
@@ -852,27 +2267,10 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
  */
 gdouble vik_track_get_max_speed(const VikTrack *tr)
 {
-  gdouble maxspeed = -1.0, speed = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
-                 / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-        if ( speed > maxspeed )
-          maxspeed = speed;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( maxspeed < 0.0 )
-    maxspeed = NAN;
-  return maxspeed;
+  const VikTrackStats *st = track_stats ( tr );
+  if ( !st || st->max_speed < 0.0 )
+    return NAN;
+  return st->max_speed;
 }
 
 /**
@@ -885,38 +2283,18 @@ gdouble vik_track_get_max_speed(const VikTrack *tr)
  */
 gdouble vik_track_get_max_speed_by_gps(const VikTrack *tr)
 {
-  gdouble maxspeed = -1.0, speed;
-  if ( tr->trackpoints ) {
-    // NB skips first point (unlikely to be maximum speed / possible false reading anyway)
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->speed) ) {
-        speed = VIK_TRACKPOINT(iter->data)->speed;
-        if ( speed > maxspeed )
-          maxspeed = speed;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( maxspeed < 0.0 )
-    maxspeed = NAN;
-  return maxspeed;
+  // NB skips first point (unlikely to be maximum speed / possible false reading anyway)
+  const VikTrackStats *st = track_stats ( tr );
+  if ( !st || st->max_speed_by_gps < 0.0 )
+    return NAN;
+  return st->max_speed_by_gps;
 }
 
 // Returns 0 if not available
 guint vik_track_get_max_heart_rate ( const VikTrack *tr )
 {
-  guint max = 0, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->heart_rate;
-      if ( val > max )
-        max = val;
-      iter = iter->next;
-    }
-  }
-  return max;
+  const VikTrackStats *st = track_stats ( tr );
+  return st ? st->max_heart_rate : 0;
 }
 
 // "Average comment", for heart rate / cadence / temperature / power
@@ -930,22 +2308,9 @@ guint vik_track_get_max_heart_rate ( const VikTrack *tr )
 // Returns NAN if not available
 gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
 {
-  gdouble avg = 0.0;
-  gulong count = 0;
-  gint val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->heart_rate;
-      if ( val > 0 ) {
-        avg += VIK_TRACKPOINT(iter->data)->heart_rate;
-        count++;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( count > 0 )
-    return avg / count;
+  const VikTrackStats *st = track_stats ( tr );
+  if ( st && st->heart_rate_count > 0 )
+    return st->heart_rate_sum / st->heart_rate_count;
   return NAN;
 }
 
@@ -971,187 +2336,298 @@ VikTrackpoint *vik_track_get_tp_by_max_heart_rate ( const VikTrack *tr )
 #define MAX_NUM_CHUNKS 16000
 
 /**
- * vik_track_make_time_map_for:
- *
- * Commonal method to create an array of values for time based graph display for the specified type
+ * The part of the step between points @kk and @kk+1 up to the position @pos.
+ * For an integral of @y this is the area under the line between the points
+ *  (or the earlier value across a gap between segments), otherwise the portion of @dq for the step.
+ * Steps without a positive extent take effect all at once.
  */
-gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, VikTrackValueType value_type )
+static void track_profile_step ( const gdouble *x, const gdouble *y, const gboolean *newsegment, const gdouble *dq,
+                                 guint kk, gdouble pos, gdouble *sq, gdouble *sw )
 {
-  GList *iter = tr->trackpoints;
-  if ( !iter || !iter->next ) // zero or one-point track
-    return NULL;
-  g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
+  *sq = *sw = 0.0;
+  gdouble dx = x[kk+1] - x[kk];
+  gdouble frac;
+  if ( dx > 0.0 )
+    frac = CLAMP ( (pos - x[kk]) / dx, 0.0, 1.0 );
+  else
+    frac = pos < x[kk+1] ? 0.0 : 1.0;
+
+  if ( dq ) {
+    *sq = dq[kk] * frac;
+    return;
+  }
+  if ( !(dx > 0.0) || isnan(y[kk]) )
+    return;
+  gdouble len = dx * frac;
+  if ( newsegment[kk+1] ) {
+    *sq = len * y[kk];
+    *sw = len;
+    return;
+  }
+  if ( isnan(y[kk+1]) )
+    return;
+  gdouble y_pos = y[kk] + (y[kk+1] - y[kk]) * frac;
+  *sq = len * (y[kk] + y_pos) * 0.5;
+  *sw = len;
+}
+
+/**
+ * One quantity to sample along an axis:
+ *  either the integral of the values @y or the sum of the increments @dq between the points
+ */
+typedef struct {
+  TrackProfileType type;
+  gdouble *y;
+  gdouble *dq;
+  gdouble q, w; // Up to the current point
+  TrackProfile *tp;
+} TrackProfileSeries;
 
-  // test if there's anything worth calculating
+/**
+ * Sample all the series along @x (distance or time of each point) together,
+ *  so the points are walked through once however many quantities there are
+ */
+static void track_profiles_sample ( const gdouble *x, const gboolean *newsegment, guint len, TrackProfileSeries *series, guint n )
+{
+  gdouble start = x[0];
+  gdouble end = x[len-1];
+  for ( guint ss = 0; ss < n; ss++ ) {
+    TrackProfile *tp = g_malloc ( sizeof(TrackProfile) );
+    tp->extent = end - start;
+    tp->q = g_new ( gdouble, PROFILE_BINS+1 );
+    tp->w = series[ss].y ? g_new ( gdouble, PROFILE_BINS+1 ) : NULL;
+    series[ss].tp = tp;
+    series[ss].q = series[ss].w = 0.0;
+  }
+
+  guint kk = 0;
+  for ( guint jj = 0; jj <= PROFILE_BINS; jj++ ) {
+    gdouble pos = jj < PROFILE_BINS ? start + (end - start) * jj / PROFILE_BINS : end;
+    gdouble sq, sw;
+    // Move on to the step containing this position
+    while ( kk+1 < len && !(pos < x[kk+1]) ) {
+      for ( guint ss = 0; ss < n; ss++ ) {
+        track_profile_step ( x, series[ss].y, newsegment, series[ss].dq, kk, x[kk+1], &sq, &sw );
+        series[ss].q += sq;
+        series[ss].w += sw;
+      }
+      kk++;
+    }
+    for ( guint ss = 0; ss < n; ss++ ) {
+      sq = sw = 0.0;
+      if ( kk+1 < len )
+        track_profile_step ( x, series[ss].y, newsegment, series[ss].dq, kk, pos, &sq, &sw );
+      series[ss].tp->q[jj] = series[ss].q + sq;
+      if ( series[ss].tp->w )
+        series[ss].tp->w[jj] = series[ss].w + sw;
+    }
+  }
+}
+
+/**
+ * Get all the values of the type in an array, checking for crazy values - which we'll ignore
+ * Sometimes a GPS device (or indeed any random file) can have stupid numbers for elevations
+ *  e.g. 9.9999e+24 when a track (with no elevations) is uploaded to a GPS device and then redownloaded
+ *
+ * Returns: Whether any values are known
+ */
+static gboolean track_profile_values ( const VikTrackColumns *cols, VikTrackValueType value_type, gdouble *vals )
+{
   gboolean okay = FALSE;
-  while ( iter ) {
-    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+  for ( guint nn = 0; nn < cols->len; nn++ ) {
     switch ( value_type ) {
     case TRACK_VALUE_ELEVATION:
-      if ( !isnan(tp->altitude) ) {
-        okay = TRUE; goto done;
-      }
+      vals[nn] = (!isnan(cols->altitude[nn]) && cols->altitude[nn] < 1E9) ? cols->altitude[nn] : NAN;
       break;
     case TRACK_VALUE_HEART_RATE:
-      if ( tp->heart_rate ) {
-        okay = TRUE; goto done;
-      }
+      vals[nn] = (cols->heart_rate[nn] && cols->heart_rate[nn] < 1000) ? cols->heart_rate[nn] : NAN;
       break;
     case TRACK_VALUE_CADENCE:
-      if ( tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
-        okay = TRUE; goto done;
-      }
+      vals[nn] = (cols->cadence[nn] != VIK_TRKPT_CADENCE_NONE && cols->cadence[nn] < 25000) ? cols->cadence[nn] : NAN;
       break;
     case TRACK_VALUE_TEMP:
-      if ( !isnan(tp->temp) ) {
-        okay = TRUE; goto done;
-      }
+      vals[nn] = cols->temp[nn];
       break;
     case TRACK_VALUE_POWER:
-      if ( tp->power != VIK_TRKPT_POWER_NONE ) {
-        okay = TRUE; goto done;
-      }
+      vals[nn] = (cols->power[nn] != VIK_TRKPT_POWER_NONE && cols->power[nn] < 10000) ? cols->power[nn] : NAN;
+      break;
+    default:
+      vals[nn] = NAN;
       break;
-    default: break;
     }
-    iter = iter->next;
+    okay = okay || !isnan(vals[nn]);
+  }
+  return okay;
+}
+
+/**
+ * Make all the profiles along the track's distance, or all those along its time, in one pass
+ */
+static void track_profiles_make ( const VikTrack *tr, VikTrackProfiles *tps, gboolean by_time )
+{
+  if ( by_time ) {
+    tps->made[PROFILE_DISTANCE_TIME] = TRUE;
+    for ( guint vv = 0; vv < TRACK_VALUE_END; vv++ )
+      tps->made[PROFILE_ELEVATION_TIME + vv] = TRUE;
+  } else {
+    tps->made[PROFILE_ELEVATION_DISTANCE] = TRUE;
+    tps->made[PROFILE_TIME_DISTANCE] = TRUE;
   }
- done:
-  if ( ! okay )
-    return NULL;
 
-  gdouble t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  gdouble t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  gdouble duration = t2 - t1;
+  if ( !tr->trackpoints || !tr->trackpoints->next ) // zero or one-point track
+    return;
 
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  guint len = cols->len;
+  // Zero length (eg, track of 2 tp with the same loc) can't be shown
+  if ( !by_time && cols->distance[len-1] <= 0.0 )
+    return;
   // Best to avoid tracks without times or not with increasing times
-  if ( isnan(t1) || isnan(t2) || duration < 0 )
-    return NULL;
-
-  guint pt_count = vik_track_get_tp_count(tr);
-  gdouble *map = g_malloc0 ( sizeof(gdouble) * num_chunks );
-  gdouble chunk_dur = duration / num_chunks;
+  gdouble duration = cols->timestamp[len-1] - cols->timestamp[0];
+  gboolean timed = !isnan(duration) && duration != 0.0;
+  if ( timed && duration < 0 ) {
+    if ( by_time )
+      g_warning ( "%s: negative duration: unsorted trackpoint timestamps?", __FUNCTION__ );
+    timed = FALSE;
+  }
+  if ( by_time && !timed )
+    return;
 
-  gdouble *tt = g_malloc ( sizeof(double) * pt_count ); // Times
-  gdouble *vals = g_malloc0 ( sizeof(double) * pt_count ); // Values
-  // Get all the times and values in arrays
-  // checking for crazy values - which we'll ignore
-  guint numpts = 0;
-  iter = tr->trackpoints;
-  while (iter) {
-    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
-    tt[numpts] = tp->timestamp;
-    switch ( value_type ) {
-    case TRACK_VALUE_ELEVATION:
-      if ( !isnan(tp->altitude) && tp->altitude < 1E9 )
-        vals[numpts] = tp->altitude;
-      break;
-    case TRACK_VALUE_HEART_RATE:
-      if ( tp->heart_rate < 1000 )
-        vals[numpts] = tp->heart_rate;
-      break;
-    case TRACK_VALUE_CADENCE:
-      if ( tp->cadence != VIK_TRKPT_CADENCE_NONE && tp->cadence < 25000 )
-        vals[numpts] = tp->cadence;
-      break;
-    case TRACK_VALUE_TEMP:
-      if ( !isnan(tp->temp) )
-        vals[numpts] = tp->temp;
-      break;
-    case TRACK_VALUE_POWER:
-      if ( tp->power != VIK_TRKPT_POWER_NONE && tp->power < 10000 )
-        vals[numpts] = tp->power;
-      break;
-    default: break;
+  TrackProfileSeries series[1 + TRACK_VALUE_END];
+  guint n = 0;
+  if ( by_time ) {
+    series[n] = (TrackProfileSeries){ PROFILE_DISTANCE_TIME, NULL, g_new ( gdouble, len ) };
+    for ( guint nn = 0; nn+1 < len; nn++ )
+      series[n].dq[nn] = cols->distance[nn+1] - cols->distance[nn];
+    n++;
+    for ( guint vv = 0; vv < TRACK_VALUE_END; vv++ ) {
+      series[n] = (TrackProfileSeries){ PROFILE_ELEVATION_TIME + vv, g_new ( gdouble, len ), NULL };
+      if ( track_profile_values ( cols, vv, series[n].y ) )
+        n++;
+      else
+        g_free ( series[n].y );
+    }
+  } else {
+    series[n] = (TrackProfileSeries){ PROFILE_ELEVATION_DISTANCE, g_new ( gdouble, len ), NULL };
+    if ( track_profile_values ( cols, TRACK_VALUE_ELEVATION, series[n].y ) )
+      n++;
+    else
+      g_free ( series[n].y );
+    if ( timed ) {
+      series[n] = (TrackProfileSeries){ PROFILE_TIME_DISTANCE, NULL, g_new ( gdouble, len ) };
+      for ( guint nn = 0; nn+1 < len; nn++ ) {
+        series[n].dq[nn] = cols->timestamp[nn+1] - cols->timestamp[nn];
+        if ( isnan(series[n].dq[nn]) )
+          series[n].dq[nn] = 0.0;
+      }
+      n++;
     }
-    numpts++;
-    iter = iter->next;
   }
+  if ( !n )
+    return;
 
-  guint index = 0; // index of the current trackpoint.
-  for (guint ii = 0; ii < num_chunks; ii++) {
-    // Cover the interval from tt[0] + ii*chunk_dur to tt[0] + (ii+1)*chunk_dur.
-    // Find the first trackpoint outside the current interval,
-    //  then average the values within this interval.
-    if ( tt[0] + ii*chunk_dur >= tt[index] ) {
-      gdouble acc_val = 0;
-      guint acc_pts = 0;
-      while ( tt[0] + ii*chunk_dur >= tt[index] ) {
-        acc_val += vals[index];
-	index++;
-        acc_pts++;
-        // Protection for broken timings
-        if ( index > numpts ) break;
-      }
-      if ( acc_pts )
-        map[ii] = acc_val / acc_pts;
-      else
-        map[ii] = 0; // TODO may set to NAN / -1 etc...
-    } else if (ii) {
-      map[ii] = map[ii-1];
-    } else {
-      map[ii] = 0;
+  track_profiles_sample ( by_time ? cols->timestamp : cols->distance, cols->newsegment, len, series, n );
+
+  for ( guint ss = 0; ss < n; ss++ ) {
+    TrackProfile *tp = series[ss].tp;
+    // Values at only isolated points can't be averaged over anything
+    if ( tp->w && tp->w[PROFILE_BINS] <= 0.0 ) {
+      track_profile_free ( tp );
+      tp = NULL;
     }
+    tps->profile[series[ss].type] = tp;
+    g_free ( series[ss].y );
+    g_free ( series[ss].dq );
+  }
+}
+
+/**
+ * The profile of the track for this type (if it has one),
+ *  made (with the others along the same axis) when first needed and then kept until the track is changed
+ */
+static const TrackProfile *track_profile ( const VikTrack *tr, TrackProfileType type )
+{
+  // Only a cache, so the track itself is not changed
+  VikTrackProfiles *tps = tr->profiles;
+  if ( !tps ) {
+    tps = g_malloc0 ( sizeof(VikTrackProfiles) );
+    ((VikTrack*)tr)->profiles = tps;
+  }
+  if ( !tps->made[type] )
+    track_profiles_make ( tr, tps, type != PROFILE_ELEVATION_DISTANCE && type != PROFILE_TIME_DISTANCE );
+  return tps->profile[type];
+}
+
+/**
+ * The quantity at a (fractional) sample position
+ */
+static gdouble track_profile_sample ( const gdouble *samples, gdouble pos )
+{
+  guint jj = (guint)pos;
+  if ( jj >= PROFILE_BINS )
+    return samples[PROFILE_BINS];
+  return samples[jj] + (samples[jj+1] - samples[jj]) * (pos - jj);
+}
+
+/**
+ * The average value over each of @num_chunks even parts of the profile of an integral,
+ *  NAN for any part without values
+ */
+static gdouble *track_profile_averages ( const TrackProfile *tp, guint16 num_chunks )
+{
+  gdouble *map = g_malloc ( sizeof(gdouble) * num_chunks );
+  gdouble step = (gdouble)PROFILE_BINS / num_chunks;
+  gdouble q1 = tp->q[0];
+  gdouble w1 = tp->w[0];
+  for ( guint ii = 0; ii < num_chunks; ii++ ) {
+    gdouble q2 = track_profile_sample ( tp->q, (ii+1) * step );
+    gdouble w2 = track_profile_sample ( tp->w, (ii+1) * step );
+    map[ii] = w2 > w1 ? (q2 - q1) / (w2 - w1) : NAN;
+    q1 = q2;
+    w1 = w2;
   }
-  g_free ( tt );
-  g_free ( vals );
   return map;
 }
 
+/**
+ * vik_track_make_time_map_for:
+ *
+ * Commonal method to create an array of values for time based graph display for the specified type
+ */
+gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, VikTrackValueType value_type )
+{
+  g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
+  if ( !num_chunks || value_type >= TRACK_VALUE_END )
+    return NULL;
+
+  const TrackProfile *tp = track_profile ( tr, PROFILE_ELEVATION_TIME + value_type );
+  if ( !tp )
+    return NULL;
+  return track_profile_averages ( tp, num_chunks );
+}
+
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
 gint vik_track_get_max_cadence ( const VikTrack *tr )
 {
-  gint max = VIK_TRKPT_CADENCE_NONE, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->cadence;
-      if ( val > max )
-        max = val;
-      iter = iter->next;
-    }
-  }
-  return max;
+  VikTrackRangeStats st;
+  return track_range_stats_after_first ( tr, TRACK_VALUE_CADENCE, &st ) ? (gint)st.max : VIK_TRKPT_CADENCE_NONE;
 }
 // Simple average across those points that have it
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
 gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
 {
-  gdouble avg = 0;
-  gint val;
-  gulong count = 0;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->cadence;
-      if ( val != VIK_TRKPT_CADENCE_NONE ) {
-        avg += val;
-        count++;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( count > 0 )
-    return avg / count;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_CADENCE, &st ) )
+    return st.sum / st.count;
   return NAN;
 }
 
 VikTrackpoint *vik_track_get_tp_by_max_cadence ( const VikTrack *tr )
 {
-  VikTrackpoint *tp = NULL;
-  gint max = VIK_TRKPT_CADENCE_NONE, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->cadence;
-      if ( val > max ) {
-        max = val;
-        tp = VIK_TRACKPOINT(iter->data);
-      }
-      iter = iter->next;
-    }
-  }
-  return tp;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_CADENCE, &st ) )
+    return vik_track_get_columns(tr)->tps[st.max_index];
+  return NULL;
 }
 
 /**
@@ -1163,286 +2639,131 @@ VikTrackpoint *vik_track_get_tp_by_max_cadence ( const VikTrack *tr )
  */
 gboolean vik_track_get_minmax_temp ( const VikTrack *tr, gdouble *min_temp, gdouble *max_temp )
 {
-  gdouble max = -274;
-  gdouble min = 274;
-  gdouble val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->temp;
-      if ( !isnan(val) ) {
-        if ( val > max )
-          max = val;
-        if ( val < min )
-          min = val;
-      }
-      iter = iter->next;
-    }
-  }
-  gboolean ans = FALSE;
-  if ( max > -273 ) {
-     *max_temp = max;
-     ans = TRUE;
-  }
-  if ( min < 273 ) {
-     *min_temp = min;
-     ans = TRUE;
-  }
-  return ans;
+  VikTrackRangeStats st;
+  if ( !track_range_stats_after_first ( tr, TRACK_VALUE_TEMP, &st ) )
+    return FALSE;
+  *min_temp = st.min;
+  *max_temp = st.max;
+  return TRUE;
 }
 
 VikTrackpoint *vik_track_get_tp_by_min_temp ( const VikTrack *tr )
 {
-  VikTrackpoint *tp = NULL;
-  gdouble min = 274, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->temp;
-      if ( !isnan(val) && val < min ) {
-        min = val;
-        tp = VIK_TRACKPOINT(iter->data);
-      }
-      iter = iter->next;
-    }
-  }
-  return tp;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_TEMP, &st ) )
+    return vik_track_get_columns(tr)->tps[st.min_index];
+  return NULL;
 }
 
 VikTrackpoint *vik_track_get_tp_by_max_temp ( const VikTrack *tr )
 {
-  VikTrackpoint *tp = NULL;
-  gdouble max = -273, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->temp;
-      if ( !isnan(val) && val > max ) {
-        max = val;
-        tp = VIK_TRACKPOINT(iter->data);
-      }
-      iter = iter->next;
-    }
-  }
-  return tp;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_TEMP, &st ) )
+    return vik_track_get_columns(tr)->tps[st.max_index];
+  return NULL;
 }
 
 // Returns NAN if not available
 gdouble vik_track_get_avg_temp ( const VikTrack *tr )
 {
-  gdouble avg = 0, val;
-  gulong count = 0;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->temp;
-      if ( !isnan(val) ) {
-        avg += val;
-        count++;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( count > 0 )
-    return avg / count;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_TEMP, &st ) )
+    return st.sum / st.count;
   return NAN;
 }
 
 // Returns VIK_TRKPT_POWER_NONE if not valid
 gint vik_track_get_max_power ( const VikTrack *tr )
 {
-  gint max = VIK_TRKPT_POWER_NONE, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->power;
-      if ( val > max )
-        max = val;
-      iter = iter->next;
-    }
-  }
-  return max;
+  VikTrackRangeStats st;
+  return track_range_stats_after_first ( tr, TRACK_VALUE_POWER, &st ) ? (gint)st.max : VIK_TRKPT_POWER_NONE;
 }
 
 // Simple average across those points that have it
 // Returns VIK_TRKPT_POWER_NONE if not valid
 gdouble vik_track_get_avg_power ( const VikTrack *tr )
 {
-  gdouble avg = 0;
-  gint val;
-  gulong count = 0;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->power;
-      if ( val != VIK_TRKPT_POWER_NONE ) {
-        avg += val;
-        count++;
-      }
-      iter = iter->next;
-    }
-  }
-  if ( count > 0 )
-    return avg / count;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_POWER, &st ) )
+    return st.sum / st.count;
   return NAN;
 }
 
 VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 {
-  VikTrackpoint *tp = NULL;
-  gint max = VIK_TRKPT_POWER_NONE, val;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      val = VIK_TRACKPOINT(iter->data)->power;
-      if ( val > max ) {
-        max = val;
-        tp = VIK_TRACKPOINT(iter->data);
-      }
-      iter = iter->next;
+  VikTrackRangeStats st;
+  if ( track_range_stats_after_first ( tr, TRACK_VALUE_POWER, &st ) )
+    return vik_track_get_columns(tr)->tps[st.max_index];
+  return NULL;
+}
+
+// Trackpoints converted at a time by vik_track_convert()
+#define TRACK_CONVERT_BLOCK 256
+
+/**
+ * Convert coordinates (that are not already in @dest_mode) via the bulk conversions,
+ *  giving the same results as vik_coord_convert() on each of them
+ */
+static void track_convert_coords ( VikCoord **coords, guint nn, VikCoordMode dest_mode )
+{
+  struct LatLon lls[TRACK_CONVERT_BLOCK];
+  struct UTM utms[TRACK_CONVERT_BLOCK];
+  if ( dest_mode == VIK_COORD_LATLON ) {
+    for ( guint ii = 0; ii < nn; ii++ )
+      utms[ii] = *((struct UTM *)coords[ii]);
+    a_coords_utms_to_latlons ( utms, lls, nn );
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      *((struct LatLon *)coords[ii]) = lls[ii];
+      coords[ii]->mode = dest_mode;
+    }
+  } else {
+    for ( guint ii = 0; ii < nn; ii++ )
+      lls[ii] = *((struct LatLon *)coords[ii]);
+    a_coords_latlons_to_utms ( lls, utms, nn );
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      *((struct UTM *)coords[ii]) = utms[ii];
+      coords[ii]->mode = dest_mode;
     }
   }
-  return tp;
 }
 
+/**
+ * vik_track_convert:
+ *
+ * Convert all the trackpoints to the @dest_mode coordinate system.
+ * Only touches this track, so different tracks may be converted on different threads.
+ */
 void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
 {
-  GList *iter = tr->trackpoints;
-  while (iter)
-  {
-    vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
-    iter = iter->next;
+  VikCoord *coords[TRACK_CONVERT_BLOCK];
+  guint nn = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikCoord *coord = &(VIK_TRACKPOINT(iter->data)->coord);
+    if ( coord->mode == dest_mode )
+      continue;
+    coords[nn++] = coord;
+    if ( nn == TRACK_CONVERT_BLOCK ) {
+      track_convert_coords ( coords, nn, dest_mode );
+      nn = 0;
+    }
   }
+  if ( nn )
+    track_convert_coords ( coords, nn, dest_mode );
 }
 
-/* I understood this when I wrote it ... maybe ... Basically it eats up the
- * proper amounts of length on the track and averages elevation over that. */
+/**
+ * Average elevation over each of @num_chunks even lengths of the track
+ */
 gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *pts;
-  gdouble total_length, chunk_length, current_dist, current_area_under_curve, current_seg_length, dist_along_seg = 0.0;
-  gdouble altitude1, altitude2;
-  guint16 current_chunk;
-  gboolean ignore_it = FALSE;
-
-  GList *iter = tr->trackpoints;
-
-  if (!iter || !iter->next) /* zero- or one-point track */
-	  return NULL;
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
-
-  { /* test if there's anything worth calculating */
-    gboolean okay = FALSE;
-    while ( iter )
-    {
-      // Sometimes a GPS device (or indeed any random file) can have stupid numbers for elevations
-      // Since when is 9.9999e+24 a valid elevation!!
-      // This can happen when a track (with no elevations) is uploaded to a GPS device and then redownloaded (e.g. using a Garmin Legend EtrexHCx)
-      // Some protection against trying to work with crazily massive numbers (otherwise get SIGFPE, Arithmetic exception)
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->altitude) &&
-	   VIK_TRACKPOINT(iter->data)->altitude < 1E9 ) {
-        okay = TRUE; break;
-      }
-      iter = iter->next;
-    }
-    if ( ! okay )
-      return NULL;
-  }
-
-  iter = tr->trackpoints;
-
-  pts = g_malloc ( sizeof(gdouble) * num_chunks );
-
-  total_length = vik_track_get_length_including_gaps ( tr );
-  chunk_length = total_length / num_chunks;
-
-  /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
-  if (chunk_length <= 0) {
-    g_free(pts);
+  if ( !num_chunks )
     return NULL;
-  }
-
-  current_dist = 0.0;
-  current_area_under_curve = 0;
-  current_chunk = 0;
-  current_seg_length = 0;
-
-  current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->next->data)->coord) );
-  altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-  altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
-  dist_along_seg = 0;
-
-  while ( current_chunk < num_chunks ) {
-
-    /* go along current seg */
-    if ( current_seg_length && (current_seg_length - dist_along_seg) > chunk_length ) {
-      dist_along_seg += chunk_length;
-
-      /*        /
-       *   pt2 *
-       *      /x       altitude = alt_at_pt_1 + alt_at_pt_2 / 2 = altitude1 + slope * dist_value_of_pt_inbetween_pt1_and_pt2
-       *     /xx   avg altitude = area under curve / chunk len
-       *pt1 *xxx   avg altitude = altitude1 + (altitude2-altitude1)/(current_seg_length)*(dist_along_seg + (chunk_len/2))
-       *   / xxx
-       *  /  xxx
-       **/
-
-      if ( ignore_it )
-	// Seemly can't determine average for this section - so use last known good value (much better than just sticking in zero)
-        pts[current_chunk] = altitude1;
-      else
-        pts[current_chunk] = altitude1 + (altitude2-altitude1)*((dist_along_seg - (chunk_length/2))/current_seg_length);
-
-      current_chunk++;
-    } else {
-      /* finish current seg */
-      if ( current_seg_length ) {
-        gdouble altitude_at_dist_along_seg = altitude1 + (altitude2-altitude1)/(current_seg_length)*dist_along_seg;
-        current_dist = current_seg_length - dist_along_seg;
-        current_area_under_curve = current_dist*(altitude_at_dist_along_seg + altitude2)*0.5;
-      } else { current_dist = current_area_under_curve = 0; } /* should only happen if first current_seg_length == 0 */
-
-      /* get intervening segs */
-      iter = iter->next;
-      while ( iter && iter->next ) {
-        current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-            &(VIK_TRACKPOINT(iter->next->data)->coord) );
-        altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-        altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
-        ignore_it = VIK_TRACKPOINT(iter->next->data)->newsegment;
-
-        if ( chunk_length - current_dist >= current_seg_length ) {
-          current_dist += current_seg_length;
-          current_area_under_curve += current_seg_length * (altitude1+altitude2) * 0.5;
-          iter = iter->next;
-        } else {
-          break;
-        }
-      }
-
-      /* final seg */
-      dist_along_seg = chunk_length - current_dist;
-      if ( ignore_it || ( iter && !iter->next ) ) {
-        pts[current_chunk] = current_area_under_curve / current_dist;
-        if (!iter->next) {
-          int i;
-          for (i = current_chunk + 1; i < num_chunks; i++)
-            pts[i] = pts[current_chunk];
-          break;
-        }
-      }
-      else {
-        current_area_under_curve += dist_along_seg * (altitude1 + (altitude2 - altitude1)*dist_along_seg/current_seg_length);
-        pts[current_chunk] = current_area_under_curve / chunk_length;
-      }
-
-      current_dist = 0;
-      current_chunk++;
-    }
-  }
 
-  return pts;
+  const TrackProfile *tp = track_profile ( tr, PROFILE_ELEVATION_DISTANCE );
+  if ( !tp )
+    return NULL;
+  return track_profile_averages ( tp, num_chunks );
 }
 
 /**
@@ -1453,22 +2774,10 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
  */
 void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down)
 {
-  gdouble diff;
-  *up = *down = 0;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-      VikTrackpoint *tp2 = VIK_TRACKPOINT(iter->prev->data);
-      if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
-        diff = tp1->altitude - tp2->altitude;
-        if ( diff > 0 )
-          *up += diff;
-        else
-          *down -= diff;
-      }
-      iter = iter->next;
-    }
+  const VikTrackStats *st = track_stats ( tr );
+  if ( st ) {
+    *up = st->elev_up;
+    *down = st->elev_down;
   } else
     *up = *down = NAN;
 }
@@ -1477,24 +2786,15 @@ gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
 {
   gdouble *pts;
   gdouble *altitudes;
-  gdouble total_length, chunk_length, current_gradient;
+  gdouble chunk_length, current_gradient;
   gdouble altitude1, altitude2;
   guint16 current_chunk;
 
-  g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
-
-  total_length = vik_track_get_length_including_gaps ( tr );
-  chunk_length = total_length / num_chunks;
-
-  /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
-  if (chunk_length <= 0) {
-    return NULL;
-  }
-
   altitudes = vik_track_make_elevation_map (tr, num_chunks);
   if (altitudes == NULL) {
     return NULL;
   }
+  chunk_length = track_profile ( tr, PROFILE_ELEVATION_DISTANCE )->extent / num_chunks;
 
   current_gradient = 0.0;
   pts = g_malloc ( sizeof(gdouble) * num_chunks );
@@ -1513,227 +2813,73 @@ gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
   return pts;
 }
 
-/* by Alex Foobarian */
+/**
+ * Average speed over each of @num_chunks even periods of the track's time
+ */
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
-  gdouble duration, chunk_dur;
-  int i, pt_count, numpts, index;
-  GList *iter;
-
-  if ( ! tr->trackpoints )
-    return NULL;
-
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
-
-  gdouble t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  gdouble t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  duration = t2 - t1;
-
-  if ( isnan(t1) || isnan(t2) || !duration )
+  if ( !num_chunks )
     return NULL;
 
-  if (duration < 0) {
-    g_warning("negative duration: unsorted trackpoint timestamps?");
+  const TrackProfile *tp = track_profile ( tr, PROFILE_DISTANCE_TIME );
+  if ( !tp )
     return NULL;
-  }
-  pt_count = vik_track_get_tp_count(tr);
-
-  v = g_malloc ( sizeof(gdouble) * num_chunks );
-  chunk_dur = duration / num_chunks;
-
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
-
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
 
-  /* In the following computation, we iterate through periods of time of duration chunk_dur.
-   * The first period begins at the beginning of the track.  The last period ends at the end of the track.
-   */
-  index = 0; /* index of the current trackpoint. */
-  for (i = 0; i < num_chunks; i++) {
-    /* we are now covering the interval from t[0] + i*chunk_dur to t[0] + (i+1)*chunk_dur.
-     * find the first trackpoint outside the current interval, averaging the speeds between intermediate trackpoints.
-     */
-    if (t[0] + i*chunk_dur >= t[index]) {
-      gdouble acc_t = 0, acc_s = 0;
-      while (t[0] + i*chunk_dur >= t[index]) {
-	acc_s += (s[index+1]-s[index]);
-	acc_t += (t[index+1]-t[index]);
-	index++;
-      }
-      v[i] = acc_s/acc_t;
-    }
-    else if (i) {
-      v[i] = v[i-1];
-    }
-    else {
-      v[i] = 0;
-    }
+  gdouble *v = g_malloc ( sizeof(gdouble) * num_chunks );
+  gdouble chunk_dur = tp->extent / num_chunks;
+  gdouble step = (gdouble)PROFILE_BINS / num_chunks;
+  gdouble s1 = tp->q[0];
+  for ( guint ii = 0; ii < num_chunks; ii++ ) {
+    gdouble s2 = track_profile_sample ( tp->q, (ii+1) * step );
+    v[ii] = (s2 - s1) / chunk_dur;
+    s1 = s2;
   }
-  g_free(s);
-  g_free(t);
   return v;
 }
 
 /**
- * Make a distance/time map, heavily based on the vik_track_make_speed_map method
+ * Make a distance/time map: the distance travelled by the end of each of @num_chunks even periods of the track's time
  */
 gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
-  gdouble duration, chunk_dur;
-  int i, pt_count, numpts, index;
-  GList *iter;
-
-  if ( ! tr->trackpoints )
-    return NULL;
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
-
-  gdouble t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  gdouble t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  duration = t2 - t1;
-
-  if ( isnan(t1) || isnan(t2) || !duration )
+  if ( !num_chunks )
     return NULL;
 
-  if (duration < 0) {
-    g_warning("negative duration: unsorted trackpoint timestamps?");
+  const TrackProfile *tp = track_profile ( tr, PROFILE_DISTANCE_TIME );
+  if ( !tp )
     return NULL;
-  }
-  pt_count = vik_track_get_tp_count(tr);
-
-  v = g_malloc ( sizeof(gdouble) * num_chunks );
-  chunk_dur = duration / num_chunks;
-
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
 
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
-
-  /* In the following computation, we iterate through periods of time of duration chunk_dur.
-   * The first period begins at the beginning of the track.  The last period ends at the end of the track.
-   */
-  index = 0; /* index of the current trackpoint. */
-  for (i = 0; i < num_chunks; i++) {
-    /* we are now covering the interval from t[0] + i*chunk_dur to t[0] + (i+1)*chunk_dur.
-     * find the first trackpoint outside the current interval, averaging the distance between intermediate trackpoints.
-     */
-    if (t[0] + i*chunk_dur >= t[index]) {
-      gdouble acc_s = 0; // No need for acc_t
-      while (t[0] + i*chunk_dur >= t[index]) {
-	acc_s += (s[index+1]-s[index]);
-	index++;
-      }
-      // The only bit that's really different from the speed map - just keep an accululative record distance
-      v[i] = i ? v[i-1]+acc_s : acc_s;
-    }
-    else if (i) {
-      v[i] = v[i-1];
-    }
-    else {
-      v[i] = 0;
-    }
-  }
-  g_free(s);
-  g_free(t);
+  gdouble *v = g_malloc ( sizeof(gdouble) * num_chunks );
+  gdouble step = (gdouble)PROFILE_BINS / num_chunks;
+  for ( guint ii = 0; ii < num_chunks; ii++ )
+    v[ii] = track_profile_sample ( tp->q, (ii+1) * step );
   return v;
 }
 
 /**
- * Make a speed/distance map
+ * Make a speed/distance map: the average speed over each of @num_chunks even lengths of the track
  */
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
-  gint i, pt_count, numpts, index;
-  GList *iter;
-  gdouble duration, total_length, chunk_length;
-
-  if ( ! tr->trackpoints )
-    return NULL;
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
-
-  gdouble t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  gdouble t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  duration = t2 - t1;
-
-  if ( isnan(t1) || isnan(t2) || !duration )
+  if ( !num_chunks )
     return NULL;
 
-  if (duration < 0) {
-    g_warning("negative duration: unsorted trackpoint timestamps?");
-    return NULL;
-  }
-
-  total_length = vik_track_get_length_including_gaps ( tr );
-  chunk_length = total_length / num_chunks;
-  pt_count = vik_track_get_tp_count(tr);
-
-  if (chunk_length <= 0) {
-    return NULL;
-  }
-
-  v = g_malloc ( sizeof(gdouble) * num_chunks );
-  s = g_malloc ( sizeof(double) * pt_count );
-  t = g_malloc ( sizeof(double) * pt_count );
-
-  // No special handling of segments ATM...
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  const TrackProfile *tp = track_profile ( tr, PROFILE_TIME_DISTANCE );
+  if ( !tp )
+    return NULL;
 
-  // Iterate through a portion of the track to get an average speed for that part
-  // This will essentially interpolate between segments, which I think is right given the usage of 'get_length_including_gaps'
-  index = 0; /* index of the current trackpoint. */
-  for (i = 0; i < num_chunks; i++) {
-    // Similar to the make_speed_map, but instead of using a time chunk, use a distance chunk
-    if (s[0] + i*chunk_length >= s[index]) {
-      gdouble acc_t = 0, acc_s = 0;
-      while (s[0] + i*chunk_length >= s[index]) {
-	acc_s += (s[index+1]-s[index]);
-	acc_t += (t[index+1]-t[index]);
-	index++;
-      }
-      v[i] = acc_s/acc_t;
-    }
-    else if (i) {
-      v[i] = v[i-1];
-    }
-    else {
-      v[i] = 0;
-    }
+  gdouble *v = g_malloc ( sizeof(gdouble) * num_chunks );
+  gdouble chunk_length = tp->extent / num_chunks;
+  gdouble step = (gdouble)PROFILE_BINS / num_chunks;
+  gdouble t1 = tp->q[0];
+  for ( guint ii = 0; ii < num_chunks; ii++ ) {
+    gdouble t2 = track_profile_sample ( tp->q, (ii+1) * step );
+    v[ii] = t2 > t1 ? chunk_length / (t2 - t1) : NAN;
+    t1 = t2;
   }
-  g_free(s);
-  g_free(t);
   return v;
 }
 
@@ -1748,128 +2894,114 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
  *
  * Returns: The #VikTrackpoint fitting the criteria or NULL
  */
+/**
+ * track_columns_find_distance:
+ *
+ * Binary search of the cumulative distances
+ *
+ * Returns: The position of the first trackpoint after the first one that is at least the distance along the track,
+ *          or cols->len if there is none
+ */
+static guint track_columns_find_distance ( const VikTrackColumns *cols, gdouble distance )
+{
+  guint lo = 1, hi = MAX ( 1, cols->len );
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( cols->distance[mid] < distance )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 VikTrackpoint *vik_track_get_tp_by_dist ( VikTrack *trk, gdouble meters_from_start, gboolean get_next_point, gdouble *tp_metres_from_start )
 {
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
   if ( tp_metres_from_start )
     *tp_metres_from_start = 0.0;
 
-  if ( trk->trackpoints ) {
-    GList *iter = g_list_next ( g_list_first ( trk->trackpoints ) );
-    while (iter) {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      current_dist += current_inc;
-      if ( current_dist >= meters_from_start )
-        break;
-      iter = g_list_next ( iter );
-    }
-    // passed the end of the track
-    if ( !iter )
-      return NULL;
-
-    if ( tp_metres_from_start )
-      *tp_metres_from_start = current_dist;
-
-    // we've gone past the distance already, is the previous trackpoint wanted?
-    if ( !get_next_point ) {
-      if ( iter->prev ) {
-        if ( tp_metres_from_start )
-          *tp_metres_from_start = current_dist-current_inc;
-        return VIK_TRACKPOINT(iter->prev->data);
-      }
-    }
-    return VIK_TRACKPOINT(iter->data);
-  }
+  const VikTrackColumns *cols = vik_track_get_columns ( trk );
+  guint ii = track_columns_find_distance ( cols, meters_from_start );
+  // passed the end of the track
+  if ( ii >= cols->len )
+    return NULL;
 
-  return NULL;
+  // we've gone past the distance already, is the previous trackpoint wanted?
+  if ( !get_next_point )
+    ii--;
+  if ( tp_metres_from_start )
+    *tp_metres_from_start = cols->distance[ii];
+  return cols->tps[ii];
 }
 
 /* by Alex Foobarian */
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start )
 {
   gdouble dist = vik_track_get_length_including_gaps(tr) * reldist;
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    GList *last_iter = NULL;
-    gdouble last_dist = 0.0;
-    while (iter)
-    {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      last_dist = current_dist;
-      current_dist += current_inc;
-      if ( current_dist >= dist )
-        break;
-      last_iter = iter;
-      iter = iter->next;
-    }
-    if (!iter) { /* passing the end the track */
-      if (last_iter) {
-        if (meters_from_start)
-          *meters_from_start = last_dist;
-        return(VIK_TRACKPOINT(last_iter->data));
-      }
-      else
-        return NULL;
-    }
-    /* we've gone past the dist already, was prev trackpoint closer? */
-    /* should do a vik_coord_average_weighted() thingy. */
-    if ( iter->prev && fabs(current_dist-current_inc-dist) < fabs(current_dist-dist) ) {
-      if (meters_from_start)
-        *meters_from_start = last_dist;
-      iter = iter->prev;
-    }
-    else
-      if (meters_from_start)
-        *meters_from_start = current_dist;
-
-    return VIK_TRACKPOINT(iter->data);
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  if ( cols->len < 2 )
+    return NULL;
 
-  }
-  return NULL;
+  guint ii = track_columns_find_distance ( cols, dist );
+  if ( ii >= cols->len ) /* passing the end the track */
+    ii = cols->len - 1;
+  /* we've gone past the dist already, was prev trackpoint closer? */
+  /* should do a vik_coord_average_weighted() thingy. */
+  else if ( fabs(cols->distance[ii-1]-dist) < fabs(cols->distance[ii]-dist) )
+    ii--;
+
+  if (meters_from_start)
+    *meters_from_start = cols->distance[ii];
+  return cols->tps[ii];
 }
 
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reltime, gdouble *seconds_from_start )
 {
-  if ( !tr->trackpoints )
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  if ( !cols->len )
     return NULL;
 
   gdouble t_pos, t_start, t_end, t_total;
-  t_start = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t_end = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  t_start = cols->timestamp[0];
+  t_end = cols->timestamp[cols->len-1];
   t_total = t_end - t_start;
 
   t_pos = t_start + t_total * reltime;
+  if ( isnan(t_pos) )
+    return NULL;
 
-  GList *iter = tr->trackpoints;
+  // Binary search for the first trackpoint at or after the time
+  const VikTrackTimes *tt = vik_track_get_times ( tr );
+  guint lo = 0, hi = tt->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( tt->times[mid].timestamp < t_pos )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-  while (iter) {
-    if (VIK_TRACKPOINT(iter->data)->timestamp == t_pos)
-      break;
-    if (VIK_TRACKPOINT(iter->data)->timestamp > t_pos) {
-      if (iter->prev == NULL)  /* first trackpoint */
-        break;
-      gdouble t_before = t_pos - VIK_TRACKPOINT(iter->prev->data)->timestamp;
-      gdouble t_after = VIK_TRACKPOINT(iter->data)->timestamp - t_pos;
+  VikTrackpoint *tp;
+  if ( lo == tt->len ) {
+    /* last trackpoint: accommodate for round-off */
+    if ( !lo || t_pos >= tt->times[lo-1].timestamp + 3 )
+      return NULL;
+    tp = VIK_TRACKPOINT(tt->times[lo-1].link->data);
+  }
+  else {
+    tp = VIK_TRACKPOINT(tt->times[lo].link->data);
+    // Unless exact (or the first), was the previous trackpoint closer?
+    if ( lo > 0 && tp->timestamp > t_pos ) {
+      gdouble t_before = t_pos - tt->times[lo-1].timestamp;
+      gdouble t_after = tp->timestamp - t_pos;
       if (t_before <= t_after)
-        iter = iter->prev;
-      break;
+        tp = VIK_TRACKPOINT(tt->times[lo-1].link->data);
     }
-    else if ((iter->next == NULL) && (t_pos < (VIK_TRACKPOINT(iter->data)->timestamp + 3))) /* last trackpoint: accommodate for round-off */
-      break;
-    iter = iter->next;
   }
 
-  if (!iter)
-    return NULL;
   if (seconds_from_start)
-    *seconds_from_start = VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  return VIK_TRACKPOINT(iter->data);
+    *seconds_from_start = tp->timestamp - t_start;
+  return tp;
 }
 
 /**
@@ -2015,68 +3147,205 @@ gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdoubl
 {
   *min_alt = 25000;
   *max_alt = -5000;
-  if ( tr && tr->trackpoints ) {
-    GList *iter = tr->trackpoints;
-    gdouble tmp_alt;
-    while (iter) {
-      VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
-      if ( !isnan(tp->altitude) ) {
-	tmp_alt = tp->altitude;
-	if ( tmp_alt > *max_alt )
-	  *max_alt = tmp_alt;
-	if ( tmp_alt < *min_alt )
-	  *min_alt = tmp_alt;
-      }
-      iter = iter->next;
-    }
+  const VikTrackStats *st = tr ? track_stats ( tr ) : NULL;
+  if ( st ) {
+    *min_alt = st->min_alt;
+    *max_alt = st->max_alt;
     return (*min_alt != 25000);
   }
   return FALSE;
 }
 
-void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
+/**
+ * vik_track_get_summary:
+ *
+ * Fill in the summary values of the track, as for saving alongside the trackpoints
+ *
+ * Returns: FALSE if the track has no trackpoints
+ */
+gboolean vik_track_get_summary ( const VikTrack *tr, VikTrackSummary *sum )
 {
-  GList *tps;
-  GByteArray *b = g_byte_array_new();
-  guint len;
-  guint intp, ntp;
-
-  g_byte_array_append(b, (guint8 *)tr, sizeof(*tr));
-
-  /* we'll fill out number of trackpoints later */
-  intp = b->len;
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len));
-
-  // This allocates space for variant sized strings
-  //  and copies that amount of data from the track to byte array
-#define vtm_append(s) \
-  len = (s) ? strlen(s)+1 : 0; \
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len)); \
-  if (s) g_byte_array_append(b, (guint8 *)s, len);
-
-  tps = tr->trackpoints;
-  ntp = 0;
-  while (tps) {
-    g_byte_array_append(b, (guint8 *)tps->data, sizeof(VikTrackpoint));
-    vtm_append(VIK_TRACKPOINT(tps->data)->name);
-    vtm_append(VIK_TRACKPOINT(tps->data)->extensions);
-    tps = tps->next;
-    ntp++;
+  const VikTrackStats *st = track_stats ( tr );
+  if ( !st )
+    return FALSE;
+
+  sum->tp_count = st->tp_count;
+  sum->first_timestamp = st->first->timestamp;
+  sum->last_timestamp = st->last->timestamp;
+  sum->length = st->length;
+  sum->length_including_gaps = st->length_including_gaps;
+  sum->timed_length = st->timed_length;
+  sum->duration = st->duration;
+  sum->max_speed = st->max_speed;
+  sum->max_speed_by_gps = st->max_speed_by_gps;
+  sum->elev_up = st->elev_up;
+  sum->elev_down = st->elev_down;
+  sum->min_alt = st->min_alt != 25000 ? st->min_alt : NAN;
+  sum->max_alt = st->min_alt != 25000 ? st->max_alt : NAN;
+  sum->max_heart_rate = st->max_heart_rate;
+  sum->heart_rate_sum = st->heart_rate_sum;
+  sum->heart_rate_count = st->heart_rate_count;
+  sum->bbox = tr->bbox;
+  return TRUE;
+}
+
+static gboolean same_time ( gdouble t1, gdouble t2 )
+{
+  return (isnan(t1) && isnan(t2)) || t1 == t2;
+}
+
+static gboolean within_bbox ( const LatLonBBox *bbox, const struct LatLon *ll )
+{
+  return ll->lat <= bbox->north && ll->lat >= bbox->south && ll->lon <= bbox->east && ll->lon >= bbox->west;
+}
+
+/**
+ * vik_track_set_summary:
+ *
+ * Use previously saved summary values (including the bounds) for the track,
+ *  rather than working them out again from all the trackpoints.
+ * These are then kept until the track is changed, just as if they had been worked out.
+ *
+ * The summary is only accepted when it looks to be for these trackpoints:
+ *  the same number of them, with the same first and last times and those points within the bounds
+ *
+ * Returns: Whether the summary was accepted
+ */
+gboolean vik_track_set_summary ( VikTrack *tr, const VikTrackSummary *sum )
+{
+  if ( !tr->trackpoints )
+    return FALSE;
+  if ( isnan(sum->bbox.north) || isnan(sum->bbox.south) || isnan(sum->bbox.east) || isnan(sum->bbox.west) ||
+       sum->bbox.north < sum->bbox.south )
+    return FALSE;
+
+  GList *last = g_list_last ( tr->trackpoints );
+  const VikTrackpoint *first_tp = VIK_TRACKPOINT(tr->trackpoints->data);
+  const VikTrackpoint *last_tp = VIK_TRACKPOINT(last->data);
+  if ( !same_time ( first_tp->timestamp, sum->first_timestamp ) || !same_time ( last_tp->timestamp, sum->last_timestamp ) )
+    return FALSE;
+  struct LatLon ll_first, ll_last;
+  vik_coord_to_latlon ( &first_tp->coord, &ll_first );
+  vik_coord_to_latlon ( &last_tp->coord, &ll_last );
+  if ( !within_bbox ( &sum->bbox, &ll_first ) || !within_bbox ( &sum->bbox, &ll_last ) )
+    return FALSE;
+  if ( sum->tp_count != g_list_length ( tr->trackpoints ) )
+    return FALSE;
+
+  vik_track_changed ( tr );
+
+  VikTrackStats *st = track_stats_new ();
+  st->first = first_tp;
+  st->last = last_tp;
+  st->tp_count = sum->tp_count;
+  st->length = sum->length;
+  st->length_including_gaps = sum->length_including_gaps;
+  st->timed_length = sum->timed_length;
+  st->duration = sum->duration;
+  st->max_speed = sum->max_speed;
+  st->max_speed_by_gps = sum->max_speed_by_gps;
+  st->elev_up = sum->elev_up;
+  st->elev_down = sum->elev_down;
+  if ( !isnan(sum->min_alt) && !isnan(sum->max_alt) ) {
+    st->min_alt = sum->min_alt;
+    st->max_alt = sum->max_alt;
+  }
+  st->max_heart_rate = sum->max_heart_rate;
+  st->heart_rate_sum = sum->heart_rate_sum;
+  st->heart_rate_count = sum->heart_rate_count;
+  st->from_summary = TRUE;
+  tr->stats = st;
+
+  tr->bbox = sum->bbox;
+  g_atomic_int_inc ( &bounds_changes );
+  return TRUE;
+}
+
+// Each string is stored as its length (including the terminator, or 0 for NULL) then its content
+#define vtm_string_size(s) (sizeof(guint) + ((s) ? strlen(s)+1 : 0))
+
+static guint8 *vtm_append_string ( guint8 *data, const gchar *str )
+{
+  guint len = str ? strlen(str)+1 : 0;
+  memcpy ( data, &len, sizeof(len) );
+  data += sizeof(len);
+  if ( len ) {
+    memcpy ( data, str, len );
+    data += len;
+  }
+  return data;
+}
+
+/**
+ * vik_track_marshall_size:
+ *
+ * Returns: The number of bytes vik_track_marshall_to() will write for this track
+ */
+guint vik_track_marshall_size ( const VikTrack *tr )
+{
+  guint size = sizeof(*tr) + sizeof(guint);
+  for ( GList *tps = tr->trackpoints; tps; tps = tps->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(tps->data);
+    size += sizeof(VikTrackpoint) + vtm_string_size(tp->name) + vtm_string_size(tp->extensions);
   }
-  *(guint *)(b->data + intp) = ntp;
+  size += vtm_string_size(tr->name);
+  size += vtm_string_size(tr->comment);
+  size += vtm_string_size(tr->description);
+  size += vtm_string_size(tr->source);
+  size += vtm_string_size(tr->url);
+  size += vtm_string_size(tr->url_name);
+  size += vtm_string_size(tr->type);
+  size += vtm_string_size(tr->extensions);
+  return size;
+}
+
+/**
+ * vik_track_marshall_to:
+ * @data: Where to write, with room for vik_track_marshall_size() bytes
+ *
+ * Returns: The position just after the written track
+ */
+guint8 *vik_track_marshall_to ( const VikTrack *tr, guint8 *data )
+{
+  memcpy ( data, tr, sizeof(*tr) );
+  data += sizeof(*tr);
+
+  // Number of trackpoints filled in afterwards
+  guint8 *ntp_pos = data;
+  guint ntp = 0;
+  data += sizeof(ntp);
 
-  vtm_append(tr->name);
-  vtm_append(tr->comment);
-  vtm_append(tr->description);
-  vtm_append(tr->source);
-  vtm_append(tr->url);
-  vtm_append(tr->url_name);
-  vtm_append(tr->type);
-  vtm_append(tr->extensions);
+  for ( GList *tps = tr->trackpoints; tps; tps = tps->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(tps->data);
+    memcpy ( data, tp, sizeof(VikTrackpoint) );
+    data += sizeof(VikTrackpoint);
+    data = vtm_append_string ( data, tp->name );
+    data = vtm_append_string ( data, tp->extensions );
+    ntp++;
+  }
+  memcpy ( ntp_pos, &ntp, sizeof(ntp) );
+
+  data = vtm_append_string ( data, tr->name );
+  data = vtm_append_string ( data, tr->comment );
+  data = vtm_append_string ( data, tr->description );
+  data = vtm_append_string ( data, tr->source );
+  data = vtm_append_string ( data, tr->url );
+  data = vtm_append_string ( data, tr->url_name );
+  data = vtm_append_string ( data, tr->type );
+  data = vtm_append_string ( data, tr->extensions );
+  return data;
+}
 
-  *data = b->data;
-  *datalen = b->len;
-  g_byte_array_free(b, FALSE);
+/*
+ * Take a Track and convert it into a byte array
+ *  sized up front so it is made in a single allocation
+ */
+void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
+{
+  *datalen = vik_track_marshall_size ( tr );
+  *data = g_malloc ( *datalen );
+  guint8 *end = vik_track_marshall_to ( tr, *data );
+  g_assert ( end == *data + *datalen );
 }
 
 /*
@@ -2120,8 +3389,16 @@ VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen)
     new_tp = vik_trackpoint_new();
     memcpy(new_tp, data, sizeof(*new_tp));
     data += sizeof(*new_tp);
-    vtu_get(new_tp->name);
-    vtu_get(new_tp->extensions);
+    // Shared strings, referenced straight from the data
+#define vtu_get_shared(s) \
+  len = *(guint *)data; \
+  data += sizeof(len); \
+  (s) = len ? tp_string_ref ( (gchar *)data ) : NULL; \
+  data += len;
+
+    vtu_get_shared(new_tp->name);
+    vtu_get_shared(new_tp->extensions);
+#undef vtu_get_shared
     new_tr->trackpoints = g_list_prepend(new_tr->trackpoints, new_tp);
   }
   if ( new_tr->trackpoints )
@@ -2139,42 +3416,204 @@ VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen)
   return new_tr;
 }
 
+/**
+ * vik_track_get_bounds_changes:
+ *
+ * Returns: A value that changes whenever the bounds of any track may have changed,
+ *  so anything derived from track bounds (e.g. a spatial index) knows it needs updating
+ */
+gint vik_track_get_bounds_changes ()
+{
+  return g_atomic_int_get ( &bounds_changes );
+}
+
+/**
+ * vik_track_get_time_changes:
+ *
+ * Returns: A value that changes whenever the trackpoints of any track may have changed
+ *  (or a track is freed), so anything derived from track times knows it needs updating
+ */
+gint vik_track_get_time_changes ()
+{
+  return g_atomic_int_get ( &time_changes );
+}
+
+/**
+ * vik_track_get_serial:
+ *
+ * Returns: A value unique to this track and the current state of its trackpoints.
+ *  It changes whenever the trackpoints may have changed, and is never reused by another track,
+ *  so it can be used to tell whether something derived from the trackpoints is still current.
+ */
+guint vik_track_get_serial ( const VikTrack *tr )
+{
+  return tr->serial;
+}
+
+/**
+ * vik_track_adopt_caches:
+ * @tr:     The track
+ * @serial: The serial of the track when @copy was made
+ * @copy:   A copy of the track (with its trackpoints), on which caches may have been built
+ *
+ * Take over those caches built on the copy that do not refer to its trackpoints,
+ *  so work done on a copy (e.g. in a background thread) need not be repeated.
+ * Nothing is taken if the track has changed since the copy was made.
+ *
+ * Returns: TRUE if the track is unchanged
+ */
+gboolean vik_track_adopt_caches ( VikTrack *tr, guint serial, VikTrack *copy )
+{
+  if ( tr->serial != serial )
+    return FALSE;
+
+  if ( !tr->columns ) {
+    tr->columns = copy->columns;
+    copy->columns = NULL;
+  }
+  if ( !tr->profiles ) {
+    tr->profiles = copy->profiles;
+    copy->profiles = NULL;
+  }
+  if ( !tr->splits ) {
+    tr->splits = copy->splits;
+    copy->splits = NULL;
+  }
+  if ( !tr->sunlight ) {
+    tr->sunlight = copy->sunlight;
+    copy->sunlight = NULL;
+  }
+  if ( !tr->stats && copy->stats && tr->trackpoints ) {
+    // Apart from the ends, which are moved onto the track's own trackpoints
+    tr->stats = copy->stats;
+    tr->stats->first = VIK_TRACKPOINT(tr->trackpoints->data);
+    tr->stats->last = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data);
+    copy->stats = NULL;
+  }
+  return TRUE;
+}
+
 /**
  * (Re)Calculate the bounds of the given track,
  *  updating the track's bounds data.
  * This should be called whenever a track's trackpoints are changed
  */
-void vik_track_calculate_bounds ( VikTrack *trk )
+/**
+ * bbox_extend:
+ * @valid: Whether @bbox holds anything yet - set once it does
+ *
+ * Enlarge the bounds to include the other bounds
+ */
+static void bbox_extend ( LatLonBBox *bbox, gboolean *valid, const LatLonBBox *other )
 {
-  GList *tp_iter;
-  tp_iter = trk->trackpoints;
-
-  struct LatLon topleft, bottomright, ll;
+  if ( !*valid ) {
+    *bbox = *other;
+    *valid = TRUE;
+    return;
+  }
+  if ( other->north > bbox->north ) bbox->north = other->north;
+  if ( other->south < bbox->south ) bbox->south = other->south;
+  if ( other->east > bbox->east ) bbox->east = other->east;
+  if ( other->west < bbox->west ) bbox->west = other->west;
+}
 
-  // Set bounds to first point
-  if ( tp_iter ) {
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &topleft );
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &bottomright );
+/**
+ * bbox_extend_trackpoints:
+ * @iter: The first trackpoint to include
+ * @end:  The trackpoint to stop before (NULL for all the rest)
+ *
+ * Enlarge the bounds to include a run of trackpoints
+ */
+static void bbox_extend_trackpoints ( LatLonBBox *bbox, gboolean *valid, GList *iter, GList *end )
+{
+  for ( ; iter && iter != end; iter = iter->next ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll );
+    LatLonBBox point = { ll.lat, ll.lat, ll.lon, ll.lon };
+    bbox_extend ( bbox, valid, &point );
   }
-  while ( tp_iter ) {
+}
+
+/**
+ * track_set_bounds:
+ *
+ * Give the track bounds worked out for its changed trackpoints
+ */
+static void track_set_bounds ( VikTrack *trk, const LatLonBBox *bbox )
+{
+  vik_track_changed ( trk );
+  g_atomic_int_inc ( &bounds_changes );
+  trk->bbox = *bbox;
+}
 
-    // See if this trackpoint increases the track bounds.
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &ll );
+void vik_track_calculate_bounds ( VikTrack *trk )
+{
+  // Generally called whenever the trackpoints have been changed
+  // Bounds are kept while packed
+  if ( trk->packed )
+    return;
+  LatLonBBox bbox = trk->bbox;
+  gboolean valid = FALSE;
+  bbox_extend_trackpoints ( &bbox, &valid, trk->trackpoints, NULL );
 
-    if ( ll.lat > topleft.lat) topleft.lat = ll.lat;
-    if ( ll.lon < topleft.lon) topleft.lon = ll.lon;
-    if ( ll.lat < bottomright.lat) bottomright.lat = ll.lat;
-    if ( ll.lon > bottomright.lon) bottomright.lon = ll.lon;
+  g_debug ( "Bounds of track: '%s' is: %f,%f to: %f,%f", trk->name, bbox.north, bbox.west, bbox.south, bbox.east );
 
-    tp_iter = tp_iter->next;
+  track_set_bounds ( trk, &bbox );
+}
+
+/**
+ * vik_track_cut_trackpoints:
+ * @start: The first trackpoint to take off the track
+ *
+ * Cut off the trackpoints from @start to the end of the track.
+ * The bounds of the remaining trackpoints are taken from the cached chunks (if any)
+ *  wherever they lie wholly before the cut, so only the chunk being cut is walked.
+ *
+ * Returns: The trackpoints taken off the track (i.e. @start), now owned by the caller
+ */
+GList *vik_track_cut_trackpoints ( VikTrack *tr, GList *start )
+{
+  LatLonBBox bbox = tr->bbox;
+  gboolean valid = FALSE;
+  GList *from = tr->trackpoints;
+  if ( tr->chunks ) {
+    for ( guint ii = 0; ii < tr->chunks->len; ii++ ) {
+      VikTrackChunk *chunk = &g_array_index ( tr->chunks, VikTrackChunk, ii );
+      GList *iter = chunk->first;
+      while ( iter != start && iter != chunk->last )
+        iter = iter->next;
+      if ( iter == start )
+        break;
+      bbox_extend ( &bbox, &valid, &chunk->bbox );
+      from = chunk->last->next;
+    }
   }
+  bbox_extend_trackpoints ( &bbox, &valid, from, start );
+
+  if ( start->prev )
+    start->prev->next = NULL;
+  else
+    tr->trackpoints = NULL;
+  start->prev = NULL;
 
-  g_debug ( "Bounds of track: '%s' is: %f,%f to: %f,%f", trk->name, topleft.lat, topleft.lon, bottomright.lat, bottomright.lon );
+  if ( valid )
+    track_set_bounds ( tr, &bbox );
+  else
+    vik_track_changed ( tr );
+  return start;
+}
 
-  trk->bbox.north = topleft.lat;
-  trk->bbox.east = bottomright.lon;
-  trk->bbox.south = bottomright.lat;
-  trk->bbox.west = topleft.lon;
+/**
+ * vik_track_calculate_bounds_unless_summarised:
+ *
+ * As vik_track_calculate_bounds(), except when the bounds were given by vik_track_set_summary()
+ *  and the trackpoints have not been changed since
+ */
+void vik_track_calculate_bounds_unless_summarised ( VikTrack *trk )
+{
+  if ( trk->stats && trk->stats->from_summary )
+    return;
+  vik_track_calculate_bounds ( trk );
 }
 
 /**
@@ -2193,6 +3632,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
 
   gdouble anon_timestamp = gtv.tv_sec;
   gdouble offset = 0;
+  vik_track_changed ( tr );
 
   GList *tp_iter;
   tp_iter = tr->trackpoints;
@@ -2253,6 +3693,7 @@ void vik_track_interpolate_times ( VikTrack *tr )
 
           tp->timestamp = (cur_dist / tr_dist) * tsdiff + tsfirst;
         }
+        vik_track_changed ( tr );
         // Some points may now have the same time so remove them.
         vik_track_remove_same_time_points ( tr );
       }
@@ -2270,23 +3711,32 @@ gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
 {
   gulong num = 0;
   GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
+  // Look up all the positions in one go
+  GArray *coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+  GPtrArray *tps = g_ptr_array_new ();
+  for ( tp_iter = tr->trackpoints; tp_iter; tp_iter = tp_iter->next ) {
     // Don't apply if the point already has a value and the overwrite is off
     if ( !(skip_existing && !isnan(VIK_TRACKPOINT(tp_iter->data)->altitude)) ) {
-      /* TODO: of the 4 possible choices we have for choosing an elevation
-       * (trackpoint in between samples), choose the one with the least elevation change
-       * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-        VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-	num++;
-      }
+      g_array_append_val ( coords, VIK_TRACKPOINT(tp_iter->data)->coord );
+      g_ptr_array_add ( tps, tp_iter->data );
+    }
+  }
+  /* TODO: of the 4 possible choices we have for choosing an elevation
+   * (trackpoint in between samples), choose the one with the least elevation change
+   * as the last */
+  gint16 *elevs = g_new ( gint16, tps->len );
+  a_dems_get_elev_batch ( (VikCoord*)coords->data, tps->len, VIK_DEM_INTERPOL_BEST, elevs );
+  for ( guint ii = 0; ii < tps->len; ii++ ) {
+    if ( elevs[ii] != VIK_DEM_INVALID_ELEVATION ) {
+      VIK_TRACKPOINT(g_ptr_array_index(tps, ii))->altitude = elevs[ii];
+      num++;
     }
-    tp_iter = tp_iter->next;
   }
+  g_free ( elevs );
+  g_ptr_array_free ( tps, TRUE );
+  g_array_free ( coords, TRUE );
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -2318,8 +3768,10 @@ void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr )
   if ( tr->trackpoints ) {
     // As in vik_track_apply_dem_data above - use 'best' interpolation method
     elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->coord), VIK_DEM_INTERPOL_BEST );
-    if ( elev != VIK_DEM_INVALID_ELEVATION )
+    if ( elev != VIK_DEM_INVALID_ELEVATION ) {
       VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->altitude = elev;
+      vik_track_changed ( tr );
+    }
   }
 }
 */
@@ -2415,6 +3867,8 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
     tp_iter = tp_iter->next;
   }
 
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -2425,14 +3879,38 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
  */
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
 {
-  if ( t1->trackpoints ) {
-    t1->trackpoints = g_list_concat ( t1->trackpoints, t2->trackpoints );
-  } else
-    t1->trackpoints = t2->trackpoints;
-  t2->trackpoints = NULL;
+  GList *tracks = g_list_prepend ( NULL, t2 );
+  vik_track_steal_and_append_tracks ( t1, tracks );
+  g_list_free ( tracks );
+}
+
+/**
+ * vik_track_steal_and_append_tracks:
+ * @tracks: The tracks to append in order
+ *
+ * appends all the tracks to t1, leaving them with no trackpoints.
+ * The tracks are joined from the end, so each list is only walked once,
+ *  and the bounds of t1 are just extended by the appended trackpoints.
+ */
+void vik_track_steal_and_append_tracks ( VikTrack *t1, GList *tracks )
+{
+  LatLonBBox bbox = t1->bbox;
+  gboolean valid = t1->trackpoints != NULL;
+  GList *tail = NULL;
+  for ( GList *iter = g_list_last ( tracks ); iter; iter = iter->prev ) {
+    VikTrack *t2 = VIK_TRACK(iter->data);
+    bbox_extend_trackpoints ( &bbox, &valid, t2->trackpoints, NULL );
+    tail = g_list_concat ( t2->trackpoints, tail );
+    t2->trackpoints = NULL;
+    vik_track_changed ( t2 );
+  }
+  t1->trackpoints = g_list_concat ( t1->trackpoints, tail );
 
   // Trackpoints updated - so update the bounds
-  vik_track_calculate_bounds ( t1 );
+  if ( valid )
+    track_set_bounds ( t1, &bbox );
+  else
+    vik_track_changed ( t1 );
 }
 
 /**
@@ -2450,6 +3928,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
 
   if ( !iter )
     return NULL;
+  vik_track_changed ( tr );
   while ( iter->next )
     iter = iter->next;
 
@@ -2555,105 +4034,150 @@ static void vik_trackpoint_interpolate ( const VikTrackpoint *tp1, const VikTrac
   }
 }
 
+/**
+ * Work out the running totals of the parts between trackpoints that both have times
+ *  (and are within a segment)
+ */
+static VikTrackSplits *track_splits_new ( const VikTrack *tr )
+{
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  VikTrackSplits *ts = g_malloc0 ( sizeof(VikTrackSplits) );
+  guint alloc = MAX ( 1, cols->len );
+  ts->len = cols->len;
+  ts->distance = g_new ( gdouble, alloc );
+  ts->time = g_new ( gdouble, alloc );
+  ts->elev_up = g_new ( gdouble, alloc );
+  ts->elev_down = g_new ( gdouble, alloc );
+  ts->distance[0] = ts->time[0] = ts->elev_up[0] = ts->elev_down[0] = 0.0;
+
+  for ( guint ii = 1; ii < cols->len; ii++ ) {
+    ts->distance[ii] = ts->distance[ii-1];
+    ts->time[ii] = ts->time[ii-1];
+    ts->elev_up[ii] = ts->elev_up[ii-1];
+    ts->elev_down[ii] = ts->elev_down[ii-1];
+    if ( isnan(cols->timestamp[ii]) || isnan(cols->timestamp[ii-1]) || cols->newsegment[ii] )
+      continue;
+    ts->distance[ii] += cols->distance[ii] - cols->distance[ii-1];
+    ts->time[ii] += ABS(cols->timestamp[ii] - cols->timestamp[ii-1]);
+    if ( !isnan(cols->altitude[ii]) && !isnan(cols->altitude[ii-1]) ) {
+      gdouble diff = cols->altitude[ii] - cols->altitude[ii-1];
+      if ( diff > 0 )
+        ts->elev_up[ii] += diff;
+      else
+        ts->elev_down[ii] -= diff;
+    }
+  }
+  return ts;
+}
+
+typedef struct {
+  gdouble distance;
+  gdouble time;
+  gdouble elev_up;
+  gdouble elev_down;
+} TrackSplitsTotals;
+
+/**
+ * The running totals at a distance, interpolated between the trackpoints either side of it
+ *
+ * @pos: Position of the first running total beyond the distance
+ */
+static TrackSplitsTotals track_splits_at ( const VikTrackSplits *ts, guint pos, gdouble distance )
+{
+  TrackSplitsTotals at;
+  gdouble part = ts->distance[pos] - ts->distance[pos-1];
+  // Ratio of the distance to the split point, compared to the point that is over the split point
+  gdouble scale = part > 0 ? (distance - ts->distance[pos-1]) / part : 0.0;
+  at.distance = distance;
+  at.time = ts->time[pos-1] + scale * (ts->time[pos] - ts->time[pos-1]);
+  at.elev_up = ts->elev_up[pos-1] + scale * (ts->elev_up[pos] - ts->elev_up[pos-1]);
+  at.elev_down = ts->elev_down[pos-1] + scale * (ts->elev_down[pos] - ts->elev_down[pos-1]);
+  return at;
+}
+
+/**
+ * Append the split between two positions
+ */
+static void track_splits_append ( GArray *ga, const TrackSplitsTotals *from, const TrackSplitsTotals *to )
+{
+  VikTrackSpeedSplits_t vtss;
+  gdouble time = to->time - from->time;
+  vtss.length = to->distance;
+  vtss.time = time;
+  vtss.speed = time > 0 ? (to->distance - from->distance) / time : 0;
+  vtss.elev_up = to->elev_up - from->elev_up;
+  vtss.elev_down = to->elev_down - from->elev_down;
+  g_array_append_val ( ga, vtss );
+}
+
 /**
  * vik_track_speed_splits:
+ *
+ * The distance, time, average speed and elevation changes of each split_length along the track
+ *  (only counting the parts with times), finishing with whatever is left over.
+ * Each split position is found by searching the running totals of the track,
+ *  which are kept along with the splits of the last few split lengths until the track is changed.
+ *
  * Free the returned contents of the array & the array itself after use
  */
 GArray *vik_track_speed_splits (const VikTrack *tr, gdouble split_length )
 {
-  GArray *ga = g_array_new ( FALSE, FALSE, sizeof(VikTrackSpeedSplits_t) );
-
-  if ( !tr->trackpoints ) {
-    return ga;
-  }
+  if ( !tr->trackpoints || split_length <= 0.0 )
+    return g_array_new ( FALSE, FALSE, sizeof(VikTrackSpeedSplits_t) );
 
-  VikTrackpoint *vtp = vik_trackpoint_new(); // 'Virtual' trackpoint
+  // Only a cache, so the track itself is not changed
+  if ( !tr->splits )
+    ((VikTrack*)tr)->splits = track_splits_new ( tr );
+  VikTrackSplits *ts = tr->splits;
 
-  gdouble len = 0.0;
-  gdouble time = 0;
-  gdouble up = 0.0, down = 0.0;
-  gdouble cur_len = 0.0;
+  guint cached;
+  for ( cached = 0; cached < SPLITS_CACHED && ts->splits[cached]; cached++ )
+    if ( ts->lengths[cached] == split_length )
+      break;
 
-  GList *iter = tr->trackpoints->next;
-  while (iter) {
-    VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-    VikTrackpoint *tp2 = VIK_TRACKPOINT(iter->prev->data);
-    if ( !isnan(tp1->timestamp) &&
-         !isnan(tp2->timestamp) &&
-         !tp1->newsegment ) {
-
-      gdouble diff;
-      len += vik_coord_diff ( &(tp2->coord), &(tp1->coord) );
-      time += ABS(tp1->timestamp - tp2->timestamp);
-
-      if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
-        diff = tp1->altitude - tp2->altitude;
-        if ( diff > 0 )
-          up += diff;
+  if ( cached == SPLITS_CACHED || !ts->splits[cached] ) {
+    GArray *ga = g_array_new ( FALSE, FALSE, sizeof(VikTrackSpeedSplits_t) );
+    TrackSplitsTotals from = { 0.0, 0.0, 0.0, 0.0 };
+    gdouble total = ts->distance[ts->len-1];
+    guint pos = 1;
+    for ( guint nn = 1; nn * split_length < total; nn++ ) {
+      gdouble distance = nn * split_length;
+      // The first running total beyond the split position
+      guint lo = pos, hi = ts->len - 1;
+      while ( lo < hi ) {
+        guint mid = lo + (hi - lo) / 2;
+        if ( ts->distance[mid] > distance )
+          hi = mid;
         else
-          down -= diff;
-      }
-
-      if ( len > split_length ) {
-        // Create split info
-        // Normally distance between crossover points is very small compared to the split length
-        // Which is typically for tracks recorded every second or two.
-        // However to cater for trackpoints seperated in both large time & distance gaps,
-        //  need to interpolate back to the split point to get proper split metrics
-
-        // This bit assumes individual distances between track points won't ever be bigger than the split distances
-        gdouble tmp_len = vik_coord_diff ( &(tp1->coord), &tp2->coord);
-        gdouble over_dist = len - split_length;
-        // Ratio of the distance to the virtual split point, compared to point that is over the split point
-        gdouble scale = (split_length - (len - tmp_len)) / tmp_len;
-
-        vik_trackpoint_interpolate ( tp2, tp1, scale, vtp );
-
-        VikTrackSpeedSplits_t vtss;
-        // Remove the extra bit added by going over distance
-        cur_len = cur_len + len - over_dist;
-        vtss.length = cur_len;
-        vtss.time = time - (tp1->timestamp - vtp->timestamp);
-        vtss.speed = ABS((len-over_dist)/vtss.time);
-        // Elevation change is only applied to one of them
-        gdouble alt_diff = 0.0;
-        if ( !isnan(vtp->altitude) && !isnan(tp1->altitude) ) {
-          alt_diff = tp1->altitude - vtp->altitude;
-        }
-        if ( alt_diff > 0 ) {
-          vtss.elev_up = up - alt_diff;
-          vtss.elev_down = down;
-        } else {
-          vtss.elev_up = up;
-          vtss.elev_down = down - fabs ( alt_diff );
-        }
-        g_array_append_val ( ga, vtss );
-
-        // Reset: starting from the virtual trackpoint
-        if ( alt_diff > 0 ) {
-          up = alt_diff;
-          down = 0.0;
-        } else {
-          up = 0.0;
-          down = fabs ( alt_diff );
-        }
-        len = over_dist;
-        time = ABS(tp1->timestamp - vtp->timestamp);
+          lo = mid + 1;
       }
+      pos = lo;
+      TrackSplitsTotals to = track_splits_at ( ts, pos, distance );
+      track_splits_append ( ga, &from, &to );
+      from = to;
     }
-    iter = iter->next;
+    // Stick in whatever is left
+    TrackSplitsTotals end = { total, ts->time[ts->len-1], ts->elev_up[ts->len-1], ts->elev_down[ts->len-1] };
+    track_splits_append ( ga, &from, &end );
+
+    // Replace the oldest
+    cached = MIN ( cached, SPLITS_CACHED - 1 );
+    if ( ts->splits[cached] )
+      g_array_free ( ts->splits[cached], TRUE );
+    ts->splits[cached] = ga;
+    ts->lengths[cached] = split_length;
   }
 
-  // Values for trackpoints in the final segment
-  // Stick in whatever is left.
-  VikTrackSpeedSplits_t vtss;
-  vtss.length = cur_len + len;
-  vtss.time = time;
-  vtss.speed = time ? ABS(len/time) : 0;
-  vtss.elev_up = up;
-  vtss.elev_down = down;
-  g_array_append_val ( ga, vtss );
+  // Move to the front, as the most recently used
+  GArray *ga = ts->splits[cached];
+  for ( ; cached > 0; cached-- ) {
+    ts->splits[cached] = ts->splits[cached-1];
+    ts->lengths[cached] = ts->lengths[cached-1];
+  }
+  ts->splits[0] = ga;
+  ts->lengths[0] = split_length;
 
-  vik_trackpoint_free ( vtp );
-  return ga;
+  GArray *copy = g_array_sized_new ( FALSE, FALSE, sizeof(VikTrackSpeedSplits_t), ga->len );
+  g_array_append_vals ( copy, ga->data, ga->len );
+  return copy;
 }
@@ -38,6 +38,8 @@ G_BEGIN_DECLS
 
 #define VIK_TRACK(x) ((VikTrack *)(x))
 #define VIK_TRACKPOINT(x) ((VikTrackpoint *)(x))
+// For the array from vik_track_get_tp_array()
+#define VIK_TRACKPOINT_AT(array,ii) VIK_TRACKPOINT(g_ptr_array_index((array),(ii)))
 
 typedef struct _VikTrackpoint VikTrackpoint;
 struct _VikTrackpoint {
@@ -70,6 +72,132 @@ typedef enum {
   NUM_TRACK_DRAWNAMES
 } VikTrackDrawnameType;
 
+typedef struct _VikTrackRanges VikTrackRanges;
+
+/**
+ * Values of each trackpoint of a track held in separate arrays (one per value),
+ *  for quickly working through a track when only a few values are needed.
+ * See vik_track_get_columns()
+ */
+typedef struct {
+  guint len;
+  VikTrackpoint **tps;   // The trackpoints themselves, for the trackpoint at a position found in the values
+  gdouble *timestamp;
+  gdouble *distance;     // From the start of the track (including gaps) in metres
+  gdouble *altitude;
+  gdouble *speed;
+  guint *heart_rate;
+  gint *cadence;
+  gint *power;
+  gdouble *temp;
+  gboolean *newsegment;
+  gint16 *dem;           // NULL until needed - see vik_track_get_dem_elevations()
+  guint dem_serial;      // a_dems_get_serial() when dem was looked up
+  VikTrackRanges *ranges; // NULL until needed - see vik_track_get_range_stats()
+} VikTrackColumns;
+
+// Number of trackpoints in each chunk of a track - see vik_track_get_chunks()
+#define VIK_TRACK_CHUNK_SIZE 256
+
+/**
+ * A run of consecutive trackpoints of a track with its own bounds,
+ *  so parts of a track well away from an area of interest can be skipped.
+ */
+typedef struct {
+  GList *first;
+  GList *last;
+  LatLonBBox bbox;
+  gdouble distance; // Of the first point from the start of the track (including gaps) in metres
+  gchar zone_min, zone_max; // UTM zones of its trackpoints (0 when they are lat/lon)
+} VikTrackChunk;
+
+/**
+ * A timestamped trackpoint of a track - see vik_track_get_times()
+ */
+typedef struct {
+  gdouble timestamp;
+  GList *link; // Within the track's trackpoints
+} VikTrackTime;
+
+typedef struct {
+  guint len;
+  VikTrackTime *times; // In time order (trackpoints at the same time in track order)
+} VikTrackTimes;
+
+/**
+ * How light it is - see VikTrackSunlight
+ */
+typedef enum {
+  VIK_SUNLIGHT_NIGHT = 0,
+  VIK_SUNLIGHT_ASTRONOMICAL_TWILIGHT,
+  VIK_SUNLIGHT_NAUTICAL_TWILIGHT,
+  VIK_SUNLIGHT_CIVIL_TWILIGHT,
+  VIK_SUNLIGHT_DAY,
+} VikSunlight;
+
+/**
+ * How light it was along a track at even steps over its time - see vik_track_get_sunlight()
+ */
+typedef struct {
+  gdouble start;   // Timestamp of the first level
+  gdouble step;    // Seconds between levels
+  guint len;
+  guint8 *levels;  // VikSunlight values
+} VikTrackSunlight;
+
+/**
+ * Where a track was at a particular time - see vik_track_get_position_at_time()
+ */
+typedef struct {
+  GList *link;    // The trackpoint at or immediately before the time
+  gboolean exact; // At the trackpoint's time, otherwise between it and the next trackpoint
+  VikCoord coord;
+  gdouble altitude;
+} VikTrackPosition;
+
+/**
+ * What vik_track_clean() removes
+ * Speeds are in m/s and the acceleration in m/s², with 0 meaning not to check
+ */
+typedef struct {
+  gboolean duplicates; // Points at the same position as the previous one
+  gboolean same_time;  // Points at the same time as the previous one
+  gdouble first_speed; // The first point if reaching the second one needs more than this speed
+  gdouble max_speed;   // Points reached from the previous one faster than this
+  gdouble max_accel;   // Points needing a bigger change in speed than this
+} VikTrackCleanParams;
+
+/**
+ * The summary values of a track, as saved in Viking files alongside the trackpoints
+ *  so they needn't all be worked through again when the file is opened.
+ * See vik_track_get_summary() and vik_track_set_summary()
+ */
+typedef struct {
+  guint tp_count;           // These three are to check the summary is for the same trackpoints
+  gdouble first_timestamp;
+  gdouble last_timestamp;
+  gdouble length;
+  gdouble length_including_gaps;
+  gdouble timed_length;
+  gdouble duration;
+  gdouble max_speed;        // -1 if unknown
+  gdouble max_speed_by_gps; // -1 if unknown
+  gdouble elev_up;
+  gdouble elev_down;
+  gdouble min_alt;          // NAN if no altitudes
+  gdouble max_alt;          // NAN if no altitudes
+  guint max_heart_rate;
+  gdouble heart_rate_sum;
+  gulong heart_rate_count;
+  LatLonBBox bbox;
+} VikTrackSummary;
+
+typedef struct _VikTrackStats VikTrackStats;
+typedef struct _VikTrackSimplified VikTrackSimplified;
+typedef struct _VikTrackProfiles VikTrackProfiles;
+typedef struct _VikTrackSplits VikTrackSplits;
+typedef struct _VikTrackPack VikTrackPack;
+
 // Instead of having a separate VikRoute type, routes are considered tracks
 //  Thus all track operations must cope with a 'route' version
 //  [track functions handle having no timestamps anyway - so there is no practical difference in most cases]
@@ -97,6 +225,16 @@ struct _VikTrack {
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  VikTrackColumns *columns; // Cache built on demand - see vik_track_get_columns()
+  VikTrackStats *stats;     // Cache built on demand - private to viktrack.c
+  VikTrackSimplified *simplified; // Cache built on demand - see vik_track_get_simplified()
+  GArray *chunks;           // Cache built on demand - see vik_track_get_chunks()
+  VikTrackTimes *times;     // Cache built on demand - see vik_track_get_times()
+  VikTrackProfiles *profiles; // Cache built on demand - private to viktrack.c
+  VikTrackSplits *splits;   // Cache built on demand - private to viktrack.c
+  VikTrackSunlight *sunlight; // Cache - see vik_track_get_sunlight()
+  guint serial;             // See vik_track_get_serial()
+  VikTrackPack *packed;     // Trackpoints when held compactly (and so trackpoints is NULL) - see vik_track_pack()
 };
 
 typedef struct {
@@ -120,6 +258,7 @@ void vik_track_set_extensions(VikTrack *tr, const gchar *value);
 void vik_track_ref(VikTrack *tr);
 void vik_track_free(VikTrack *tr);
 VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points );
+VikTrack *vik_track_copy_shared ( VikTrack *tr );
 void vik_track_set_comment_no_copy(VikTrack *tr, gchar *comment);
 VikTrackpoint *vik_trackpoint_new();
 void vik_trackpoint_free(VikTrackpoint *tp);
@@ -129,10 +268,28 @@ void vik_trackpoint_set_extensions(VikTrackpoint *tp, const gchar *value);
 gboolean vik_trackpoint_apply_dem_data(VikTrackpoint *tp);
 
 void vik_track_add_trackpoint(VikTrack *tr, VikTrackpoint *tp, gboolean recalculate);
+GList *vik_track_append_trackpoint ( VikTrack *tr, VikTrackpoint *tp, GList *last );
 gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpoint *tp);
 gdouble vik_track_get_length(const VikTrack *tr);
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr);
 gulong vik_track_get_tp_count(const VikTrack *tr);
+GPtrArray *vik_track_get_tp_array ( const VikTrack *tr );
+const VikTrackColumns *vik_track_get_columns ( const VikTrack *tr );
+const gint16 *vik_track_get_dem_elevations ( const VikTrack *tr );
+void vik_track_changed ( VikTrack *tr );
+gboolean vik_track_pack ( VikTrack *tr );
+void vik_track_unpack ( VikTrack *tr );
+const GPtrArray *vik_track_get_simplified ( const VikTrack *tr, gdouble tolerance );
+gdouble *vik_track_simplify_significance ( const gdouble *lat, const gdouble *lon, const gdouble *times, const gboolean *newsegment, guint len );
+VikTrack *vik_track_copy_simplified ( const VikTrack *tr, const gdouble *significance, gdouble tolerance );
+const GArray *vik_track_get_chunks ( const VikTrack *tr );
+gboolean vik_track_get_utm_zones ( const VikTrack *tr, gchar *zone_min, gchar *zone_max );
+const VikTrackTimes *vik_track_get_times ( const VikTrack *tr );
+gboolean vik_track_get_time_span ( const VikTrack *tr, gdouble *first, gdouble *last );
+gboolean vik_track_get_position_at_time ( const VikTrack *tr, gdouble timestamp, gboolean across_segments, VikTrackPosition *pos );
+const VikTrackSunlight *vik_track_get_sunlight ( const VikTrack *tr );
+void vik_track_set_sunlight ( const VikTrack *tr, VikTrackSunlight *sunlight );
+void vik_track_sunlight_free ( VikTrackSunlight *sunlight );
 guint vik_track_get_segment_count(const VikTrack *tr);
 gulong vik_track_get_tp_num (const VikTrack *tr, const VikTrackpoint *tp);
 VikTrack **vik_track_split_into_segments(VikTrack *tr, guint *ret_len);
@@ -143,11 +300,16 @@ gdouble vik_track_get_duration(const VikTrack *trk, gboolean include_segments);
 VikCoord vik_track_get_center ( VikTrack *trk, VikCoordMode cmode );
 
 gulong vik_track_get_dup_point_count ( const VikTrack *vt );
+gsize vik_track_get_memory_usage ( const VikTrack *tr );
+guint64 vik_track_get_content_hash ( const VikTrack *tr );
+guint64 vik_track_get_trackpoints_hash ( const VikTrack *tr );
+gboolean vik_track_get_fingerprint ( const VikTrack *tr, guint64 *exact, guint64 *near );
 gulong vik_track_remove_dup_points ( VikTrack *vt );
 gulong vik_track_get_same_time_point_count ( const VikTrack *vt );
 gulong vik_track_remove_same_time_points ( VikTrack *vt );
 
 gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolean recalc_bounds );
+gulong vik_track_clean ( VikTrack *tr, const VikTrackCleanParams *params, GPtrArray *removed );
 
 void vik_track_to_routepoints ( VikTrack *tr );
 
@@ -172,7 +334,6 @@ gboolean vik_track_get_minmax_temp ( const VikTrack *tr, gdouble *min_temp, gdou
 gdouble vik_track_get_avg_temp ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_by_min_temp ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_by_max_temp ( const VikTrack *tr );
-gdouble *vik_track_make_temp_map ( const VikTrack *tr, guint16 num_chunks );
 
 void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode );
 gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks );
@@ -189,7 +350,6 @@ VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp );
 gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks );
-gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks );
 typedef enum {
   TRACK_VALUE_ELEVATION=0,
@@ -199,12 +359,34 @@ typedef enum {
   TRACK_VALUE_POWER,
   TRACK_VALUE_END
 } VikTrackValueType;
+
+/**
+ * Statistics of a value over a range of trackpoints - see vik_track_get_range_stats()
+ */
+typedef struct {
+  gdouble min;
+  gdouble max;
+  gdouble sum;
+  guint min_index;  // Position (as in vik_track_get_columns()) of the first point with the minimum
+  guint max_index;  // Position of the first point with the maximum
+  guint count;      // Of the points having the value
+} VikTrackRangeStats;
+gboolean vik_track_get_range_stats ( const VikTrack *tr, VikTrackValueType value_type, guint first, guint last, VikTrackRangeStats *stats );
 gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, VikTrackValueType value_type );
 gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt );
+gboolean vik_track_get_summary ( const VikTrack *tr, VikTrackSummary *sum );
+gboolean vik_track_set_summary ( VikTrack *tr, const VikTrackSummary *sum );
+guint vik_track_marshall_size ( const VikTrack *tr );
+guint8 *vik_track_marshall_to ( const VikTrack *tr, guint8 *data );
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen);
 
 void vik_track_calculate_bounds ( VikTrack *trk );
+void vik_track_calculate_bounds_unless_summarised ( VikTrack *trk );
+gint vik_track_get_bounds_changes ();
+gint vik_track_get_time_changes ();
+guint vik_track_get_serial ( const VikTrack *tr );
+gboolean vik_track_adopt_caches ( VikTrack *tr, guint serial, VikTrack *copy );
 
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
@@ -213,6 +395,8 @@ gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat );
 
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 );
+void vik_track_steal_and_append_tracks ( VikTrack *t1, GList *tracks );
+GList *vik_track_cut_trackpoints ( VikTrack *tr, GList *start );
 
 VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr );
 
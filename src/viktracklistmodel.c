@@ -0,0 +1,598 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * A list of tracks (with their layers) for the track list dialog, as a GtkTreeModel.
+ *
+ * Only the names are used directly: the other values of a row (its statistics,
+ *  the formatted date and so on) are only worked out when the row is first needed,
+ *  which in a tree view with fixed height mode is when it is shown.
+ *
+ * Sorting and filtering give a new order of the rows, which for larger lists is made
+ *  in a thread from copies of the relevant values (so never touching the tracks).
+ * The new order then replaces the old one in one go, whilst the model is detached from the view.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+#include "viking.h"
+#include "viktracklistmodel.h"
+
+// Below this many rows, sorting and filtering are quick enough to just do them straight away
+#define TRACK_LIST_ASYNC_ROWS 2000
+
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrack *trk;
+  gboolean ready;
+  // Only valid once ready
+  gchar *date;
+  gboolean visible;
+  gdouble distance;
+  guint duration;
+  gdouble av_speed;
+  gdouble max_speed;
+  gint max_height;
+  gchar *search; // Casefolded text to filter on, made when first filtering
+} TrackListRow;
+
+struct _VikTrackListModel {
+  GObject obj;
+  gint stamp;
+  GArray *rows;   // TrackListRow
+  GArray *order;  // guint indices into rows, of the rows shown in the shown order
+  gint sort_column;
+  GtkSortType sort_order;
+  gchar *filter;  // Casefolded, or NULL
+  guint serial;   // Of the latest ordering wanted
+  GtkTreeView *view;
+  vik_units_distance_t dist_units;
+  vik_units_speed_t speed_units;
+  vik_units_height_t height_units;
+  gchar *date_format;
+};
+
+static void track_list_model_tree_model_init ( GtkTreeModelIface *iface );
+static void track_list_model_tree_sortable_init ( GtkTreeSortableIface *iface );
+
+G_DEFINE_TYPE_WITH_CODE (VikTrackListModel, vik_track_list_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, track_list_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE, track_list_model_tree_sortable_init))
+
+static GType column_types[VIK_TRACK_LIST_N_COLS];
+
+static void vik_track_list_model_init ( VikTrackListModel *model )
+{
+  model->stamp = g_random_int ();
+  model->rows = g_array_new ( FALSE, TRUE, sizeof(TrackListRow) );
+  model->order = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  model->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  model->sort_order = GTK_SORT_ASCENDING;
+}
+
+static void track_list_model_finalize ( GObject *gob )
+{
+  VikTrackListModel *model = VIK_TRACK_LIST_MODEL ( gob );
+  for ( guint ii = 0; ii < model->rows->len; ii++ ) {
+    TrackListRow *row = &g_array_index ( model->rows, TrackListRow, ii );
+    g_free ( row->date );
+    g_free ( row->search );
+  }
+  g_array_free ( model->rows, TRUE );
+  g_array_free ( model->order, TRUE );
+  g_free ( model->filter );
+  g_free ( model->date_format );
+  if ( model->view )
+    g_object_remove_weak_pointer ( G_OBJECT(model->view), (gpointer*)&model->view );
+  G_OBJECT_CLASS(vik_track_list_model_parent_class)->finalize ( gob );
+}
+
+static void vik_track_list_model_class_init ( VikTrackListModelClass *klass )
+{
+  GObjectClass *object_class = G_OBJECT_CLASS ( klass );
+  object_class->finalize = track_list_model_finalize;
+
+  column_types[VIK_TRACK_LIST_COL_LAYER_NAME] = G_TYPE_STRING;
+  column_types[VIK_TRACK_LIST_COL_NAME] = G_TYPE_STRING;
+  column_types[VIK_TRACK_LIST_COL_DATE] = G_TYPE_STRING;
+  column_types[VIK_TRACK_LIST_COL_VISIBLE] = G_TYPE_BOOLEAN;
+  column_types[VIK_TRACK_LIST_COL_DISTANCE] = G_TYPE_DOUBLE;
+  column_types[VIK_TRACK_LIST_COL_DURATION] = G_TYPE_UINT;
+  column_types[VIK_TRACK_LIST_COL_AV_SPEED] = G_TYPE_DOUBLE;
+  column_types[VIK_TRACK_LIST_COL_MAX_SPEED] = G_TYPE_DOUBLE;
+  column_types[VIK_TRACK_LIST_COL_MAX_HEIGHT] = G_TYPE_INT;
+  column_types[VIK_TRACK_LIST_COL_IS_ROUTE] = G_TYPE_BOOLEAN;
+  column_types[VIK_TRACK_LIST_COL_LAYER] = G_TYPE_POINTER;
+  column_types[VIK_TRACK_LIST_COL_TRACK] = G_TYPE_POINTER;
+}
+
+/**
+ * Work out the values of the row,
+ *  formatting & converting the internal values into something for display
+ */
+static void row_make_ready ( VikTrackListModel *model, TrackListRow *row )
+{
+  if ( row->ready )
+    return;
+  row->ready = TRUE;
+  VikTrack *trk = row->trk;
+  VikTrwLayer *vtl = row->vtl;
+
+  // Store unit converted value
+  row->distance = vu_distance_convert ( model->dist_units, vik_track_get_length(trk) );
+
+  // Get start date
+  if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(trk->trackpoints->data);
+    time_t tt = tp->timestamp;
+    row->date = vu_get_time_string ( &tt, model->date_format, &tp->coord, NULL );
+  }
+  if ( !row->date )
+    row->date = g_strdup ( "" );
+
+  row->visible = trk->visible && (trk->is_route ? vik_trw_layer_get_routes_visibility(vtl) : vik_trw_layer_get_tracks_visibility(vtl));
+  row->visible = row->visible && vik_treeview_item_get_visible_tree ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
+
+  row->duration = 0; // In minutes
+  if ( trk->trackpoints ) {
+    gdouble t1 = vik_track_get_tp_first(trk)->timestamp;
+    gdouble t2 = vik_track_get_tp_last(trk)->timestamp;
+    if ( !isnan(t1) && !isnan(t2) )
+      row->duration = (int)round(fabs(t2-t1)/60.0);
+  }
+
+  row->av_speed = 0.0;
+  row->max_speed = 0.0;
+  // Routes clearly don't have speeds
+  if ( !trk->is_route ) {
+    row->av_speed = vu_speed_convert ( model->speed_units, vik_track_get_average_speed ( trk ) );
+    gdouble max_speed = vu_track_get_max_speed ( trk, vik_trw_layer_get_prefer_gps_speed(vtl) );
+    if ( !isnan(max_speed) )
+      row->max_speed = vu_speed_convert ( model->speed_units, max_speed );
+  }
+
+  gdouble min_alt, max_alt;
+  if ( !vik_track_get_minmax_alt ( trk, &min_alt, &max_alt ) )
+    max_alt = 0.0;
+  if ( model->height_units == VIK_UNITS_HEIGHT_FEET )
+    max_alt = VIK_METERS_TO_FEET(max_alt);
+  row->max_height = (gint)round(max_alt);
+}
+
+static void row_make_search ( VikTrackListModel *model, TrackListRow *row )
+{
+  if ( row->search )
+    return;
+  row_make_ready ( model, row );
+  // Separated so a match can not span two of them
+  GString *gs = g_string_new ( VIK_LAYER(row->vtl)->name );
+  g_string_append_printf ( gs, "\n%s\n%s", row->trk->name ? row->trk->name : "", row->date );
+  if ( row->trk->comment )
+    g_string_append_printf ( gs, "\n%s", row->trk->comment );
+  if ( row->trk->description )
+    g_string_append_printf ( gs, "\n%s", row->trk->description );
+  row->search = g_utf8_casefold ( gs->str, -1 );
+  g_string_free ( gs, TRUE );
+}
+
+/**
+ * vik_track_list_model_new:
+ * @tracks_and_layers: The list of vik_trw_and_track_t, which must be kept whilst the model is used
+ * @date_format:       For the date column
+ */
+VikTrackListModel *vik_track_list_model_new ( GList *tracks_and_layers, const gchar *date_format )
+{
+  VikTrackListModel *model = g_object_new ( VIK_TRACK_LIST_MODEL_TYPE, NULL );
+  model->dist_units = a_vik_get_units_distance ();
+  model->speed_units = a_vik_get_units_speed ();
+  model->height_units = a_vik_get_units_height ();
+  model->date_format = g_strdup ( date_format );
+
+  guint ii = 0;
+  for ( GList *gl = tracks_and_layers; gl; gl = g_list_next(gl), ii++ ) {
+    TrackListRow row = { 0 };
+    row.vtl = ((vik_trw_and_track_t*)gl->data)->vtl;
+    row.trk = ((vik_trw_and_track_t*)gl->data)->trk;
+    g_array_append_val ( model->rows, row );
+    g_array_append_val ( model->order, ii );
+  }
+  return model;
+}
+
+/**
+ * vik_track_list_model_set_view:
+ *
+ * The view the model is shown in, which is briefly detached from the model whenever the order changes
+ *  (as that is much quicker than signalling the changes for large numbers of rows)
+ */
+void vik_track_list_model_set_view ( VikTrackListModel *model, GtkTreeView *view )
+{
+  if ( model->view )
+    g_object_remove_weak_pointer ( G_OBJECT(model->view), (gpointer*)&model->view );
+  model->view = view;
+  if ( view )
+    g_object_add_weak_pointer ( G_OBJECT(view), (gpointer*)&model->view );
+}
+
+/*
+ * Ordering
+ */
+typedef struct {
+  VikTrackListModel *model;
+  guint serial;
+  guint n;
+  guint *indices;      // Of the rows
+  gchar **collate;     // Sort keys for string columns, otherwise NULL
+  gdouble *values;     // Sort keys for other columns, otherwise NULL
+  const gchar **search;
+  gchar *filter;
+  gboolean descending;
+} OrderJob;
+
+static void order_job_free ( OrderJob *job )
+{
+  g_object_unref ( job->model );
+  g_free ( job->indices );
+  if ( job->collate )
+    for ( guint ii = 0; ii < job->n; ii++ )
+      g_free ( job->collate[ii] );
+  g_free ( job->collate );
+  g_free ( job->values );
+  g_free ( job->search );
+  g_free ( job->filter );
+  g_free ( job );
+}
+
+static gint order_job_compare ( gconstpointer a, gconstpointer b, gpointer data )
+{
+  OrderJob *job = data;
+  guint ia = *(const guint*)a;
+  guint ib = *(const guint*)b;
+  gint ans = 0;
+  if ( job->collate )
+    ans = strcmp ( job->collate[ia], job->collate[ib] );
+  else if ( job->values )
+    ans = job->values[ia] < job->values[ib] ? -1 : job->values[ia] > job->values[ib];
+  if ( job->descending )
+    ans = -ans;
+  // Otherwise keep to the order given
+  return ans ? ans : (ia < ib ? -1 : ia > ib);
+}
+
+/**
+ * Filter and sort the rows, using only the copies made for the job
+ *  (so this can be run in a thread)
+ * Afterwards indices has the new order of the first n rows
+ */
+static void order_job_run ( OrderJob *job )
+{
+  // Keys are by the original row index
+  for ( guint ii = 0; ii < job->n; ii++ )
+    job->indices[ii] = ii;
+
+  if ( job->collate )
+    for ( guint ii = 0; ii < job->n; ii++ ) {
+      gchar *key = g_utf8_collate_key ( job->collate[ii], -1 );
+      g_free ( job->collate[ii] );
+      job->collate[ii] = key;
+    }
+
+  if ( job->collate || job->values )
+    g_qsort_with_data ( job->indices, job->n, sizeof(guint), order_job_compare, job );
+
+  if ( job->filter ) {
+    guint kept = 0;
+    for ( guint ii = 0; ii < job->n; ii++ )
+      if ( strstr ( job->search[job->indices[ii]], job->filter ) )
+        job->indices[kept++] = job->indices[ii];
+    job->n = kept;
+  }
+}
+
+static void order_job_apply ( OrderJob *job )
+{
+  VikTrackListModel *model = job->model;
+  if ( job->serial != model->serial )
+    return;
+
+  GtkTreeView *view = model->view;
+  if ( view ) {
+    g_object_ref ( model );
+    gtk_tree_view_set_model ( view, NULL );
+  }
+
+  g_array_set_size ( model->order, 0 );
+  g_array_append_vals ( model->order, job->indices, job->n );
+  model->stamp++;
+
+  if ( view ) {
+    gtk_tree_view_set_model ( view, GTK_TREE_MODEL(model) );
+    g_object_unref ( model );
+  }
+}
+
+static gboolean order_job_apply_idle ( OrderJob *job )
+{
+  order_job_apply ( job );
+  order_job_free ( job );
+  return FALSE;
+}
+
+static gpointer order_job_thread ( OrderJob *job )
+{
+  order_job_run ( job );
+  g_idle_add ( (GSourceFunc)order_job_apply_idle, job );
+  return NULL;
+}
+
+/**
+ * Make the order for the current sorting and filter
+ */
+static void track_list_model_reorder ( VikTrackListModel *model )
+{
+  OrderJob *job = g_malloc0 ( sizeof(OrderJob) );
+  job->model = g_object_ref ( model );
+  job->serial = ++model->serial;
+  job->n = model->rows->len;
+  job->indices = g_malloc_n ( MAX(job->n, 1), sizeof(guint) );
+  job->descending = model->sort_order == GTK_SORT_DESCENDING;
+
+  gint col = model->sort_column;
+  if ( col == VIK_TRACK_LIST_COL_LAYER_NAME || col == VIK_TRACK_LIST_COL_NAME || col == VIK_TRACK_LIST_COL_DATE )
+    job->collate = g_malloc_n ( MAX(job->n, 1), sizeof(gchar*) );
+  else if ( col >= 0 && col < VIK_TRACK_LIST_COL_LAYER )
+    job->values = g_malloc_n ( MAX(job->n, 1), sizeof(gdouble) );
+  if ( model->filter ) {
+    job->filter = g_strdup ( model->filter );
+    job->search = g_malloc_n ( MAX(job->n, 1), sizeof(gchar*) );
+  }
+
+  // Copy out the keys
+  for ( guint ii = 0; ii < job->n; ii++ ) {
+    TrackListRow *row = &g_array_index ( model->rows, TrackListRow, ii );
+    if ( job->search ) {
+      row_make_search ( model, row );
+      job->search[ii] = row->search;
+    }
+    if ( col == VIK_TRACK_LIST_COL_LAYER_NAME )
+      job->collate[ii] = g_strdup ( VIK_LAYER(row->vtl)->name ? VIK_LAYER(row->vtl)->name : "" );
+    else if ( col == VIK_TRACK_LIST_COL_NAME )
+      job->collate[ii] = g_strdup ( row->trk->name ? row->trk->name : "" );
+    else if ( job->collate || job->values ) {
+      row_make_ready ( model, row );
+      switch ( col ) {
+      case VIK_TRACK_LIST_COL_DATE:       job->collate[ii] = g_strdup ( row->date ); break;
+      case VIK_TRACK_LIST_COL_VISIBLE:    job->values[ii] = row->visible; break;
+      case VIK_TRACK_LIST_COL_DISTANCE:   job->values[ii] = row->distance; break;
+      case VIK_TRACK_LIST_COL_DURATION:   job->values[ii] = row->duration; break;
+      case VIK_TRACK_LIST_COL_AV_SPEED:   job->values[ii] = row->av_speed; break;
+      case VIK_TRACK_LIST_COL_MAX_SPEED:  job->values[ii] = row->max_speed; break;
+      case VIK_TRACK_LIST_COL_MAX_HEIGHT: job->values[ii] = row->max_height; break;
+      default:                            job->values[ii] = row->trk->is_route; break;
+      }
+    }
+  }
+
+  if ( job->n >= TRACK_LIST_ASYNC_ROWS ) {
+    GThread *thread = g_thread_try_new ( "track_list_order", (GThreadFunc)order_job_thread, job, NULL );
+    if ( thread ) {
+      g_thread_unref ( thread );
+      return;
+    }
+  }
+  order_job_run ( job );
+  order_job_apply ( job );
+  order_job_free ( job );
+}
+
+/**
+ * vik_track_list_model_set_filter:
+ * @filter: Only show the rows with this text in their layer name, name, date, comment or description
+ *          (ignoring case). NULL or empty for all rows.
+ */
+void vik_track_list_model_set_filter ( VikTrackListModel *model, const gchar *filter )
+{
+  gchar *filter_case = (filter && filter[0]) ? g_utf8_casefold ( filter, -1 ) : NULL;
+  if ( g_strcmp0 ( filter_case, model->filter ) == 0 ) {
+    g_free ( filter_case );
+    return;
+  }
+  g_free ( model->filter );
+  model->filter = filter_case;
+  track_list_model_reorder ( model );
+}
+
+/*
+ * GtkTreeModel interface
+ * The iter user_data is the position in the order
+ */
+static GtkTreeModelFlags track_list_model_get_flags ( GtkTreeModel *tree_model )
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint track_list_model_get_n_columns ( GtkTreeModel *tree_model )
+{
+  return VIK_TRACK_LIST_N_COLS;
+}
+
+static GType track_list_model_get_column_type ( GtkTreeModel *tree_model, gint index )
+{
+  g_return_val_if_fail ( index >= 0 && index < VIK_TRACK_LIST_N_COLS, G_TYPE_INVALID );
+  return column_types[index];
+}
+
+static gboolean track_list_model_set_iter ( VikTrackListModel *model, GtkTreeIter *iter, gint pos )
+{
+  if ( pos < 0 || pos >= model->order->len )
+    return FALSE;
+  iter->stamp = model->stamp;
+  iter->user_data = GINT_TO_POINTER ( pos );
+  return TRUE;
+}
+
+static gboolean track_list_model_get_iter ( GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path )
+{
+  if ( gtk_tree_path_get_depth ( path ) != 1 )
+    return FALSE;
+  gint *indices = gtk_tree_path_get_indices ( path );
+  return track_list_model_set_iter ( VIK_TRACK_LIST_MODEL(tree_model), iter, indices[0] );
+}
+
+static GtkTreePath *track_list_model_get_path ( GtkTreeModel *tree_model, GtkTreeIter *iter )
+{
+  g_return_val_if_fail ( iter->stamp == VIK_TRACK_LIST_MODEL(tree_model)->stamp, NULL );
+  return gtk_tree_path_new_from_indices ( GPOINTER_TO_INT(iter->user_data), -1 );
+}
+
+static void track_list_model_get_value ( GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value )
+{
+  VikTrackListModel *model = VIK_TRACK_LIST_MODEL ( tree_model );
+  g_return_if_fail ( iter->stamp == model->stamp );
+  g_return_if_fail ( column >= 0 && column < VIK_TRACK_LIST_N_COLS );
+  g_value_init ( value, column_types[column] );
+
+  guint pos = GPOINTER_TO_INT ( iter->user_data );
+  if ( pos >= model->order->len )
+    return;
+  TrackListRow *row = &g_array_index ( model->rows, TrackListRow, g_array_index(model->order, guint, pos) );
+
+  switch ( column ) {
+  case VIK_TRACK_LIST_COL_LAYER_NAME: g_value_set_string ( value, VIK_LAYER(row->vtl)->name ); return;
+  case VIK_TRACK_LIST_COL_NAME:       g_value_set_string ( value, row->trk->name ); return;
+  case VIK_TRACK_LIST_COL_IS_ROUTE:   g_value_set_boolean ( value, row->trk->is_route ); return;
+  case VIK_TRACK_LIST_COL_LAYER:      g_value_set_pointer ( value, row->vtl ); return;
+  case VIK_TRACK_LIST_COL_TRACK:      g_value_set_pointer ( value, row->trk ); return;
+  default: break;
+  }
+
+  row_make_ready ( model, row );
+  switch ( column ) {
+  case VIK_TRACK_LIST_COL_DATE:       g_value_set_string ( value, row->date ); break;
+  case VIK_TRACK_LIST_COL_VISIBLE:    g_value_set_boolean ( value, row->visible ); break;
+  case VIK_TRACK_LIST_COL_DISTANCE:   g_value_set_double ( value, row->distance ); break;
+  case VIK_TRACK_LIST_COL_DURATION:   g_value_set_uint ( value, row->duration ); break;
+  case VIK_TRACK_LIST_COL_AV_SPEED:   g_value_set_double ( value, row->av_speed ); break;
+  case VIK_TRACK_LIST_COL_MAX_SPEED:  g_value_set_double ( value, row->max_speed ); break;
+  case VIK_TRACK_LIST_COL_MAX_HEIGHT: g_value_set_int ( value, row->max_height ); break;
+  default: break;
+  }
+}
+
+static gboolean track_list_model_iter_next ( GtkTreeModel *tree_model, GtkTreeIter *iter )
+{
+  return track_list_model_set_iter ( VIK_TRACK_LIST_MODEL(tree_model), iter, GPOINTER_TO_INT(iter->user_data) + 1 );
+}
+
+static gboolean track_list_model_iter_nth_child ( GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n )
+{
+  if ( parent )
+    return FALSE;
+  return track_list_model_set_iter ( VIK_TRACK_LIST_MODEL(tree_model), iter, n );
+}
+
+static gboolean track_list_model_iter_children ( GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent )
+{
+  return track_list_model_iter_nth_child ( tree_model, iter, parent, 0 );
+}
+
+static gboolean track_list_model_iter_has_child ( GtkTreeModel *tree_model, GtkTreeIter *iter )
+{
+  return FALSE;
+}
+
+static gint track_list_model_iter_n_children ( GtkTreeModel *tree_model, GtkTreeIter *iter )
+{
+  if ( iter )
+    return 0;
+  return VIK_TRACK_LIST_MODEL(tree_model)->order->len;
+}
+
+static gboolean track_list_model_iter_parent ( GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child )
+{
+  return FALSE;
+}
+
+static void track_list_model_tree_model_init ( GtkTreeModelIface *iface )
+{
+  iface->get_flags       = track_list_model_get_flags;
+  iface->get_n_columns   = track_list_model_get_n_columns;
+  iface->get_column_type = track_list_model_get_column_type;
+  iface->get_iter        = track_list_model_get_iter;
+  iface->get_path        = track_list_model_get_path;
+  iface->get_value       = track_list_model_get_value;
+  iface->iter_next       = track_list_model_iter_next;
+  iface->iter_children   = track_list_model_iter_children;
+  iface->iter_has_child  = track_list_model_iter_has_child;
+  iface->iter_n_children = track_list_model_iter_n_children;
+  iface->iter_nth_child  = track_list_model_iter_nth_child;
+  iface->iter_parent     = track_list_model_iter_parent;
+}
+
+/*
+ * GtkTreeSortable interface
+ * Only by the columns, there are no other sort functions
+ */
+static gboolean track_list_model_get_sort_column_id ( GtkTreeSortable *sortable, gint *sort_column_id, GtkSortType *order )
+{
+  VikTrackListModel *model = VIK_TRACK_LIST_MODEL ( sortable );
+  if ( sort_column_id )
+    *sort_column_id = model->sort_column;
+  if ( order )
+    *order = model->sort_order;
+  return model->sort_column != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID &&
+         model->sort_column != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+}
+
+static void track_list_model_set_sort_column_id ( GtkTreeSortable *sortable, gint sort_column_id, GtkSortType order )
+{
+  VikTrackListModel *model = VIK_TRACK_LIST_MODEL ( sortable );
+  if ( model->sort_column == sort_column_id && model->sort_order == order )
+    return;
+  model->sort_column = sort_column_id;
+  model->sort_order = order;
+  gtk_tree_sortable_sort_column_changed ( sortable );
+  track_list_model_reorder ( model );
+}
+
+static void track_list_model_set_sort_func ( GtkTreeSortable *sortable, gint sort_column_id, GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy )
+{
+  g_warning ( "%s: Not supported", __FUNCTION__ );
+}
+
+static void track_list_model_set_default_sort_func ( GtkTreeSortable *sortable, GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy )
+{
+  g_warning ( "%s: Not supported", __FUNCTION__ );
+}
+
+static gboolean track_list_model_has_default_sort_func ( GtkTreeSortable *sortable )
+{
+  return FALSE;
+}
+
+static void track_list_model_tree_sortable_init ( GtkTreeSortableIface *iface )
+{
+  iface->get_sort_column_id    = track_list_model_get_sort_column_id;
+  iface->set_sort_column_id    = track_list_model_set_sort_column_id;
+  iface->set_sort_func         = track_list_model_set_sort_func;
+  iface->set_default_sort_func = track_list_model_set_default_sort_func;
+  iface->has_default_sort_func = track_list_model_has_default_sort_func;
+}
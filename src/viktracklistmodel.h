@@ -0,0 +1,67 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_TRACK_LIST_MODEL_H
+#define _VIKING_TRACK_LIST_MODEL_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define VIK_TRACK_LIST_MODEL_TYPE            (vik_track_list_model_get_type ())
+#define VIK_TRACK_LIST_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), VIK_TRACK_LIST_MODEL_TYPE, VikTrackListModel))
+#define VIK_TRACK_LIST_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), VIK_TRACK_LIST_MODEL_TYPE, VikTrackListModelClass))
+#define VIK_IS_TRACK_LIST_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VIK_TRACK_LIST_MODEL_TYPE))
+
+typedef struct _VikTrackListModel VikTrackListModel;
+typedef struct _VikTrackListModelClass VikTrackListModelClass;
+
+struct _VikTrackListModelClass
+{
+  GObjectClass object_class;
+};
+
+/**
+ * The columns of the model, in the same order as the track list dialog has always used
+ */
+typedef enum {
+  VIK_TRACK_LIST_COL_LAYER_NAME = 0, // G_TYPE_STRING
+  VIK_TRACK_LIST_COL_NAME,           // G_TYPE_STRING
+  VIK_TRACK_LIST_COL_DATE,           // G_TYPE_STRING
+  VIK_TRACK_LIST_COL_VISIBLE,        // G_TYPE_BOOLEAN
+  VIK_TRACK_LIST_COL_DISTANCE,       // G_TYPE_DOUBLE, in the distance units
+  VIK_TRACK_LIST_COL_DURATION,       // G_TYPE_UINT, in minutes
+  VIK_TRACK_LIST_COL_AV_SPEED,       // G_TYPE_DOUBLE, in the speed units
+  VIK_TRACK_LIST_COL_MAX_SPEED,      // G_TYPE_DOUBLE, in the speed units
+  VIK_TRACK_LIST_COL_MAX_HEIGHT,     // G_TYPE_INT, in the height units
+  VIK_TRACK_LIST_COL_IS_ROUTE,       // G_TYPE_BOOLEAN
+  VIK_TRACK_LIST_COL_LAYER,          // G_TYPE_POINTER, the VikTrwLayer
+  VIK_TRACK_LIST_COL_TRACK,          // G_TYPE_POINTER, the VikTrack
+  VIK_TRACK_LIST_N_COLS
+} VikTrackListColumn;
+
+GType vik_track_list_model_get_type ();
+
+VikTrackListModel *vik_track_list_model_new ( GList *tracks_and_layers, const gchar *date_format );
+void vik_track_list_model_set_view ( VikTrackListModel *model, GtkTreeView *view );
+void vik_track_list_model_set_filter ( VikTrackListModel *model, const gchar *filter );
+
+G_END_DECLS
+
+#endif
@@ -892,6 +892,51 @@ void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_laye
   g_free ( positions );
 }
 
+/**
+ * vik_treeview_add_sublayers:
+ * @vt:          The treeview to operate on
+ * @parent_iter: The (empty) level within the treeview to add them to
+ * @sublayers:   The items to add, with each iter set once added
+ * @count:       The number of items
+ * @order:       How the items should be sorted
+ *
+ * Add many sublayer items at once, already in order.
+ *
+ * Each is inserted with all its values in one go at the start (so the tree store never
+ *  has to walk along the items to find its position), in reverse of the sorted order.
+ * Hence no sorting is needed afterwards.
+ */
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data, gboolean editable,
+                                  VikTreeviewSublayer *sublayers, guint count, vik_layer_sort_order_t order )
+{
+  SortTuple *sort_array = g_new ( SortTuple, count );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    sort_array[ii].offset = ii;
+    sort_array[ii].name = (gchar*)sublayers[ii].name;
+    sort_array[ii].timestamp = sublayers[ii].timestamp;
+    sort_array[ii].number = sublayers[ii].number;
+    sort_array[ii].uuid = GPOINTER_TO_UINT(sublayers[ii].item);
+  }
+  g_qsort_with_data ( sort_array, count, sizeof (SortTuple), sort_tuple_compare, GINT_TO_POINTER(order) );
+
+  for ( guint ii = count; ii > 0; ii-- ) {
+    VikTreeviewSublayer *sl = &sublayers[sort_array[ii-1].offset];
+    gtk_tree_store_insert_with_values ( GTK_TREE_STORE(vt->model), &sl->iter, parent_iter, 0,
+                                        NAME_COLUMN, sl->name,
+                                        VISIBLE_COLUMN, sl->visible,
+                                        TYPE_COLUMN, VIK_TREEVIEW_TYPE_SUBLAYER,
+                                        ITEM_PARENT_COLUMN, parent,
+                                        ITEM_POINTER_COLUMN, sl->item,
+                                        ITEM_DATA_COLUMN, data,
+                                        EDITABLE_COLUMN, editable,
+                                        ICON_COLUMN, sl->icon,
+                                        ITEM_TIMESTAMP_COLUMN, sl->timestamp,
+                                        ITEM_NUMBER_COLUMN, sl->number,
+                                        -1 );
+  }
+  g_free ( sort_array );
+}
+
 static void vik_treeview_finalize ( GObject *gob )
 {
   VikTreeview *vt = VIK_TREEVIEW ( gob );
@@ -102,6 +102,22 @@ gboolean vik_treeview_get_iter_with_name ( VikTreeview *vt, GtkTreeIter *iter, G
 
 void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_layer_sort_order_t order );
 
+/**
+ * A sublayer item for vik_treeview_add_sublayers()
+ */
+typedef struct {
+  const gchar *name;
+  gpointer item;
+  GdkPixbuf *icon;
+  gboolean visible;
+  gdouble timestamp;
+  guint number;
+  GtkTreeIter iter; // Set when added
+} VikTreeviewSublayer;
+
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data, gboolean editable,
+                                  VikTreeviewSublayer *sublayers, guint count, vik_layer_sort_order_t order );
+
 gboolean vik_treeview_key_press ( VikTreeview *vt, GdkEventKey *event );
 
 G_END_DECLS
@@ -44,9 +44,11 @@
 #include "background.h"
 #include "fit.h"
 #include "gpx.h"
+#include "binfile.h"
 #include "geojson.h"
 #include "kml.h"
 #include "tcx.h"
+#include "trackstream.h"
 #include "babel.h"
 #include "dem.h"
 #include "dems.h"
@@ -60,6 +62,10 @@
 #include "vikexttools.h"
 #include "vikexttool_datasources.h"
 #include "vikrouting.h"
+#include "spatialindex.h"
+#include "pointclusters.h"
+#include "nameindex.h"
+#include "vikjournal.h"
 
 #include <ctype.h>
 #include <gdk/gdkkeysyms.h>
@@ -96,6 +102,12 @@
 
 enum { WP_SYMBOL_FILLED_SQUARE, WP_SYMBOL_SQUARE, WP_SYMBOL_CIRCLE, WP_SYMBOL_X, WP_NUM_SYMBOLS };
 
+// What is left out where it would overlap what has already been drawn
+enum { DECLUTTER_OFF, DECLUTTER_LABELS, DECLUTTER_SYMBOLS, DECLUTTER_NUM };
+
+// Size in pixels of the screen cells used to find overlapping labels
+#define LABEL_GRID_CELL 8
+
 // See http://developer.gnome.org/pango/stable/PangoMarkupFormat.html
 typedef enum {
   FS_XX_SMALL = 0, // 'xx-small'
@@ -115,6 +127,13 @@ typedef enum {
   VIK_EXTERNAL_TYPE_LAST
 } trw_external_type_t;
 
+// Fingerprints of the tracks and routes, to spot the same ones being imported again
+typedef struct {
+  GHashTable *existing; // Tracks in the layer before the import
+  GHashTable *exact;    // Exact fingerprint -> track
+  GHashTable *near;     // Near fingerprint -> track
+} TrwImportIndex;
+
 struct _VikTrwLayer {
   VikLayer vl;
   GHashTable *tracks;
@@ -126,6 +145,33 @@ struct _VikTrwLayer {
   GtkTreeIter tracks_iter, routes_iter, waypoints_iter;
   gboolean tracks_visible, routes_visible, waypoints_visible;
   LatLonBBox waypoints_bbox;
+  // Built on demand, see trw_layer_foreach_in_bbox()
+  VikSpatialIndex *tracks_index;
+  VikSpatialIndex *routes_index;
+  VikSpatialIndex *waypoints_index;
+  VikPointClusters *waypoint_clusters; // When wanted, kept up to date as waypoints change - see trw_layer_get_waypoint_clusters()
+  gint tracks_index_bounds;
+  // Built on demand, see trw_layer_time_index()
+  GArray *time_index;
+  gint time_index_changes;
+  guint tracks_changes; // Counts additions and removals of tracks, see vik_trw_layer_get_tracks_changes()
+  // Built on demand, see trw_layer_name_index()
+  VikNameIndex *waypoints_names;
+  VikNameIndex *tracks_names;
+  VikNameIndex *routes_names;
+  // What was last drawn, when enabled by VIK_SETTINGS_DRAW_CACHE or vik_trw_layer_set_draw_cache()
+  VikViewportCache *draw_cache;
+  gint draw_cache_bounds;
+  gboolean draw_cache_wanted;
+  // Trackpoints around where one was last looked for under the pointer - see closest_tp_in_interval()
+  GArray *hover_tps;
+  gboolean hover_valid;
+  gint hover_cx, hover_cy;   // The cell of the screen they are for
+  guint hover_size;
+  guint hover_serial;        // Viewport projection serial
+  gint hover_bounds, hover_times;
+  VikTrack *live_track; // Being added to by vik_trw_layer_track_extend()
+  GPtrArray *simplify_preview; // Trackpoints kept by a simplification being shown - see trw_layer_simplify()
 
   gboolean track_draw_labels;
   guint8 drawmode;
@@ -144,6 +190,10 @@ struct _VikTrwLayer {
   gboolean auto_dem;
   gboolean auto_dedupl;
   gboolean prefer_gps_speed;
+  gboolean track_compact;
+  guint compact_draws;
+  GHashTable *compact_drawn; // Draw count when each unpacked track was last drawn
+  guint packed_tracks;
 
   // Metadata
   VikTRWMetadata *metadata;
@@ -153,6 +203,7 @@ struct _VikTrwLayer {
   GQueue *laps;
 
   PangoLayout *tracklabellayout;
+  GHashTable *track_labels; // Laid out track labels by markup - see trw_layer_get_label()
   font_size_t track_font_size;
   gchar *track_fsize_str;
 
@@ -163,6 +214,8 @@ struct _VikTrwLayer {
   font_size_t wp_font_size;
   gchar *wp_fsize_str;
   vik_layer_sort_order_t wp_sort_order;
+  guint wp_declutter;
+  gboolean wp_cluster;
 
   gdouble track_draw_speed_factor;
 
@@ -208,11 +261,18 @@ struct _VikTrwLayer {
   gpointer current_wp_id;
   gboolean moving_wp;
   gboolean waypoint_rightclick;
+  // Where the current waypoint was last drawn, so moving it only needs that area redrawing
+  VikWaypoint *current_wp_drawn;
+  gint current_wp_drawn_x, current_wp_drawn_y;
+  GdkRectangle current_wp_extents;
 
   /* track editing tool */
   GList *current_tpl;
   VikTrack *current_tp_track;
   VikTrwLayerTpwin *tpwin;
+  // Where the current trackpoint was last drawn
+  gboolean current_tp_drawn;
+  VikCoord current_tp_drawn_coord;
 
   /* track editing tool -- more specifically, moving tps */
   gboolean moving_tp;
@@ -225,15 +285,22 @@ struct _VikTrwLayer {
   guint route_finder_timer_id;
   gboolean route_finder_end;
 
+  guint sort_idle_id; // Sorting the treeview after items have been added
+
+  VikJournal *journal;         // Of edits for undo and redo
+  GHashTable *journal_serials; // Serial of each track after its last journalled edit
+  TrwImportIndex *import;      // Whilst importing - see vik_trw_layer_import_begin()
+
   gboolean drawlabels;
   gboolean drawimages;
   guint8 image_alpha;
-  GHashTable *image_cache;
   guint8 image_size;
   guint image_cache_size;
 
   /* for waypoint text */
   PangoLayout *wplabellayout;
+  GHashTable *wp_labels; // Laid out waypoint labels by name - see trw_layer_get_label()
+  GHashTable *cluster_labels; // Laid out waypoint counts
 
   gboolean has_verified_thumbnails;
 
@@ -253,6 +320,8 @@ struct _VikTrwLayer {
   gboolean external_loaded;
   gchar *external_dirpath;
 
+  VikBinDeferred *deferred; // Contents not yet read in
+
 #if GTK_CHECK_VERSION (3,0,0)
   cairo_t *cr; // Reference into vvp - thus do not free this here
 #endif
@@ -260,6 +329,7 @@ struct _VikTrwLayer {
 
 struct DrawingParams {
   VikViewport *vp;
+  const VikViewportProjection *proj;
   VikTrwLayer *vtl;
   VikWindow *vw;
   gdouble xmpp, ympp;
@@ -268,12 +338,20 @@ struct DrawingParams {
   gdouble ss; // Sine factor in track directions
   const VikCoord *center;
   gboolean one_zone, lat_lon;
+  gchar zone_min, zone_max; // UTM with several zones in view: the zones drawn (with the leniency of lenient_bbox)
   gdouble ce1, ce2, cn1, cn2;
   LatLonBBox bbox;
   gboolean highlight;
+  gdouble simplify_tolerance; // Metres
+  LatLonBBox lenient_bbox; // Points are drawn even when a little out of view (c.f. ce1, ce2, cn1, cn2)
+  GList *from; // When set, tracks are only drawn from this trackpoint onwards (see vik_trw_layer_track_extend())
+  guint8 *label_grid; // When set, which screen cells labels (and maybe symbols) already cover - see trw_layer_label_place()
+  guint grid_cols, grid_rows;
+  guint grid_free; // Number of cells not yet covered
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
+static void trw_layer_track_close_dialog ( VikTrack *trk );
 
 typedef enum {
   MA_VTL = 0,
@@ -293,6 +371,8 @@ typedef gpointer menu_array_sublayer[MA_LAST];
 static void trw_layer_delete_item ( menu_array_sublayer values );
 static void trw_layer_copy_item_cb ( menu_array_sublayer values );
 static void trw_layer_cut_item_cb ( menu_array_sublayer values );
+static void trw_layer_undo_cb ( menu_array_layer values );
+static void trw_layer_redo_cb ( menu_array_layer values );
 
 static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] );
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2]);
@@ -333,6 +413,7 @@ static void trw_layer_gps_upload_any ( menu_array_sublayer values );
 
 static void trw_layer_centerize ( menu_array_layer values );
 static void trw_layer_auto_view ( menu_array_layer values );
+static void trw_layer_merge_layer ( menu_array_layer values );
 static void trw_layer_goto_wp ( menu_array_layer values );
 static void trw_layer_new_wp ( menu_array_layer values );
 static void trw_layer_edit_track ( menu_array_layer values );
@@ -370,6 +451,8 @@ static void trw_layer_acquire_geotagged_cb ( menu_array_layer values );
 #endif
 static void trw_layer_acquire_file_cb ( menu_array_layer values );
 static void trw_layer_gps_upload ( menu_array_layer values );
+static void trw_layer_follow_stream_cb ( menu_array_layer values );
+static void trw_layer_stop_stream_cb ( menu_array_layer values );
 
 static void trw_layer_track_list_dialog_single ( menu_array_sublayer values );
 static void trw_layer_track_list_dialog ( menu_array_layer values );
@@ -388,9 +471,6 @@ static void trw_layer_goto_waypoint ( menu_array_sublayer values );
 static void trw_layer_waypoint_gc_webpage ( menu_array_sublayer values );
 static void trw_layer_waypoint_webpage ( menu_array_sublayer values );
 
-typedef gpointer menu_array_realize[5];
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, menu_array_realize pass_along );
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, menu_array_realize pass_along );
 
 static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean before, gboolean is_route );
 static void trw_layer_cancel_current_tp ( VikTrwLayer *vtl, gboolean destroy );
@@ -398,6 +478,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response );
 
 static void trw_layer_sort_order_specified ( VikTrwLayer *vtl, guint sublayer_type, vik_layer_sort_order_t order );
 static void trw_layer_sort_all ( VikTrwLayer *vtl );
+static void trw_layer_sort_soon ( VikTrwLayer *vtl );
 
 static VikLayerToolFuncStatus tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *event, gpointer data );
 static VikLayerToolFuncStatus tool_edit_trackpoint_move ( VikTrwLayer *vtl, GdkEventMotion *event, gpointer data );
@@ -559,6 +640,7 @@ enum { GROUP_WAYPOINTS, GROUP_TRACKS, GROUP_IMAGES, GROUP_TRACKS_ADV, GROUP_META
 
 static gchar *params_drawmodes[] = { N_("Draw by Track"), N_("Draw by Speed"), N_("All Tracks Same Color"), NULL };
 static gchar *params_wpsymbols[] = { N_("Filled Square"), N_("Square"), N_("Circle"), N_("X"), 0 };
+static gchar *params_declutter[] = { N_("Off"), N_("Labels"), N_("Labels and Symbols"), NULL };
 
 #define MIN_POINT_SIZE 2
 #define MAX_POINT_SIZE 10
@@ -669,6 +751,7 @@ static VikLayerParamData wpbgcolor_default ( void ) {
 static VikLayerParamData wpsize_default ( void ) { return VIK_LPD_UINT ( 4 * vik_viewport_get_scale(NULL) );
 }
 static VikLayerParamData wpsymbol_default ( void ) { return VIK_LPD_UINT ( WP_SYMBOL_FILLED_SQUARE ); }
+static VikLayerParamData declutter_default ( void ) { return VIK_LPD_UINT ( DECLUTTER_LABELS ); }
 
 static VikLayerParamData image_size_default ( void ) { return VIK_LPD_UINT ( 64 * vik_viewport_get_scale(NULL) ); }
 static VikLayerParamData image_alpha_default ( void ) { return VIK_LPD_UINT ( 255 * vik_viewport_get_scale(NULL) ); }
@@ -733,6 +816,8 @@ VikLayerParam trw_layer_params[] = {
     N_("Automatically delete duplicate trackpoints on file load"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_TRW, "preferGPSspeed", VIK_LAYER_PARAM_BOOLEAN, GROUP_TRACKS_ADV, N_("Use GPS Speed"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
     N_("Use reported GPS speed values - particularly for maximum speed"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_TRW, "trackcompact", VIK_LAYER_PARAM_BOOLEAN, GROUP_TRACKS_ADV, N_("Compact Storage"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Keep tracks that have not been drawn for a while in a compact form using much less memory, with positions to about a centimetre. Suits large layers of old tracks that are mostly just viewed."), vik_lpd_false_default, NULL, NULL },
 
   { VIK_LAYER_TRW, "drawlabels", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Labels"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpfontsize", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Waypoint Font Size:"), VIK_LAYER_WIDGET_COMBOBOX, params_font_sizes, NULL, NULL, wpfontsize_default, NULL, NULL },
@@ -745,11 +830,16 @@ VikLayerParam trw_layer_params[] = {
   { VIK_LAYER_TRW, "wpsyms", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Waypoint Symbols:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpprox", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Waypoint Proximity:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Draw a circle covering the proximity area"), vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpsortorder", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Waypoint Sort Order:"), VIK_LAYER_WIDGET_COMBOBOX, params_sort_order_wp, NULL, NULL, sort_order_default, NULL, NULL },
+  { VIK_LAYER_TRW, "wpdeclutter", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Hide Overlaps:"), VIK_LAYER_WIDGET_COMBOBOX, params_declutter, NULL,
+    N_("Leave out labels (and optionally waypoint symbols) that would overlap ones already drawn. Names of tracks win over waypoint names, and the selected waypoint is always drawn."), declutter_default, NULL, NULL },
+  { VIK_LAYER_TRW, "wpcluster", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Group Waypoints When Zoomed Out"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Show the number of waypoints in each area instead of each waypoint, until zoomed in enough to see them apart"), vik_lpd_false_default, NULL, NULL },
 
   { VIK_LAYER_TRW, "drawimages", VIK_LAYER_PARAM_BOOLEAN, GROUP_IMAGES, N_("Draw Waypoint Images"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "image_size", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Size (pixels):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[3], NULL, NULL, image_size_default, NULL, NULL },
   { VIK_LAYER_TRW, "image_alpha", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Alpha:"), VIK_LAYER_WIDGET_HSCALE, &params_scales[4], NULL, NULL, image_alpha_default, NULL, NULL },
-  { VIK_LAYER_TRW, "image_cache_size", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Memory Cache Size:"), VIK_LAYER_WIDGET_HSCALE, &params_scales[5], NULL, NULL, image_cache_size_default, NULL, NULL },
+  // No longer used as images are cached for all layers together (see a_thumbnails_cache_get()), but still read from files
+  { VIK_LAYER_TRW, "image_cache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_NOT_IN_PROPERTIES, NULL, 0, NULL, NULL, NULL, image_cache_size_default, NULL, NULL },
 
   { VIK_LAYER_TRW, "metadatadesc", VIK_LAYER_PARAM_STRING, GROUP_METADATA, N_("Description"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, string_default, NULL, NULL },
   { VIK_LAYER_TRW, "metadataauthor", VIK_LAYER_PARAM_STRING, GROUP_METADATA, N_("Author"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, string_default, NULL, NULL },
@@ -793,6 +883,7 @@ enum {
   PARAM_TADEM,
   PARAM_TRDUP,
   PARAM_PGS,
+  PARAM_TCOMPACT,
   // Waypoints
   PARAM_DLA,
   PARAM_WPFONTSIZE,
@@ -805,6 +896,8 @@ enum {
   PARAM_WPSYMS,
   PARAM_WPPROX,
   PARAM_WPSO,
+  PARAM_WPDECLUTTER,
+  PARAM_WPCLUSTER,
   // WP images
   PARAM_DI,
   PARAM_IS,
@@ -836,7 +929,10 @@ enum {
 static VikTrwLayer* trw_layer_create ( VikViewport *vp );
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter );
 static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean from_file );
+static void trw_ensure_deferred_loaded ( VikTrwLayer *trw );
+static void trw_ensure_unpacked ( VikTrwLayer *vtl );
 static void trw_layer_free ( VikTrwLayer *trwlayer );
+static void trw_import_index_free ( TrwImportIndex *ti );
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp );
 static void trw_layer_configure ( VikTrwLayer *l, VikViewport *vvp );
 static void trw_layer_change_coord_mode ( VikTrwLayer *vtl, VikCoordMode dest_mode );
@@ -848,9 +944,11 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gchar *newname, gpointer vlp, gint subtype, gpointer sublayer, GtkTreeIter *iter );
 static gboolean trw_layer_sublayer_toggle_visible ( VikTrwLayer *l, gint subtype, gpointer sublayer );
 static const gchar* trw_layer_layer_tooltip ( VikTrwLayer *vtl );
+static gsize trw_layer_get_memory_usage ( VikTrwLayer *vtl );
 static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, gpointer sublayer );
 static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer sublayer, gint type, gpointer vlp );
 static void trw_layer_layer_toggle_visible ( VikTrwLayer *vtl );
+static void trw_layer_draw_cache_invalidate ( VikTrwLayer *vtl );
 static void trw_layer_marshall ( VikTrwLayer *vtl, guint8 **data, guint *len );
 static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, VikViewport *vvp );
 static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp );
@@ -940,26 +1038,76 @@ VikLayerInterface vik_trw_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    trw_layer_show_selected_viewport_menu,
 
   (VikLayerFuncRefresh)                 vik_trw_layer_propwin_main_refresh,
-};
 
-static gboolean have_geojson_export = FALSE;
+  (VikLayerFuncDrawSurface)             NULL,
+
+  (VikLayerFuncGetMemoryUsage)          trw_layer_get_memory_usage,
+};
 
 // NB Only performed once per program run
 static void vik_trwlayer_class_init ( VikTrwLayerClass *klass )
 {
-  gchar* geojson_prog = g_find_program_in_path ( a_geojson_program_export() );
-  if ( geojson_prog ) {
-    have_geojson_export = TRUE;
-    g_free ( geojson_prog );
-  }
+  a_garmin_icons_init ();
 }
 
 /**
  * Can't use GClassFinalizeFunc, since VikTrwLayer is a static type
  *  Thus have to manually perform cleanup for anything done in vik_trwlayer_class_init
  */
+/*
+ * Freeing every trackpoint and string of a big layer can take seconds,
+ *  so once the layer is finished with its items are freed on another thread
+ */
+static GThreadPool *free_pool = NULL;
+
+static void trw_layer_free_items_thread ( GHashTable *items, gpointer user_data )
+{
+  g_hash_table_destroy ( items );
+}
+
+/**
+ * Destroy the table (and so free all the items in it) in the background
+ */
+static void trw_layer_free_items_later ( GHashTable *items )
+{
+  if ( !free_pool )
+    free_pool = g_thread_pool_new ( (GFunc)trw_layer_free_items_thread, NULL, 1, FALSE, NULL );
+  if ( !free_pool || !g_thread_pool_push ( free_pool, items, NULL ) )
+    g_hash_table_destroy ( items );
+}
+
+/**
+ * As trw_layer_free_items_later(), but the GTK parts of the tracks have to go on this thread,
+ *  and tracks still referenced elsewhere are just released from here
+ */
+static void trw_layer_free_tracks_later ( GHashTable *tracks )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    if ( trk->ref_count > 1 ) {
+      g_hash_table_iter_steal ( &iter );
+      vik_track_free ( trk );
+    }
+    else if ( trk->property_dialog ) {
+      if ( GTK_IS_WIDGET(trk->property_dialog) )
+        gtk_widget_destroy ( GTK_WIDGET(trk->property_dialog) );
+      trk->property_dialog = NULL;
+    }
+  }
+  trw_layer_free_items_later ( tracks );
+}
+
 void vik_trwlayer_uninit ()
 {
+  // Finish freeing any layers
+  if ( free_pool ) {
+    g_thread_pool_free ( free_pool, FALSE, TRUE );
+    free_pool = NULL;
+  }
+
   // Might as well do this, as only used by this layer
   a_garmin_icons_uninit();
 }
@@ -1061,6 +1209,162 @@ void vik_trw_layer_set_laps ( VikTrwLayer *vtl, GQueue *value )
   vtl->laps = value;
 }
 
+// The time span of a track
+typedef struct {
+  gdouble start;
+  gdouble end;
+  gdouble max_end; // Latest end of this and all the spans that start before it
+  gpointer id;
+  VikTrack *trk;
+} TrwTimeSpan;
+
+static gint trw_time_span_compare ( gconstpointer a, gconstpointer b )
+{
+  gdouble sa = ((const TrwTimeSpan*)a)->start;
+  gdouble sb = ((const TrwTimeSpan*)b)->start;
+  return (sa > sb) - (sa < sb);
+}
+
+static void trw_layer_time_index_clear ( VikTrwLayer *vtl )
+{
+  if ( vtl->time_index )
+    g_array_free ( vtl->time_index, TRUE );
+  vtl->time_index = NULL;
+}
+
+/**
+ * trw_layer_time_index:
+ *
+ * The time spans of the tracks (not routes) in order of their start time.
+ * Like the spatial indices, this is (re)built when next needed after any change.
+ */
+static GArray *trw_layer_time_index ( VikTrwLayer *vtl )
+{
+  // Any track may have been edited
+  gint changes = vik_track_get_time_changes ();
+  if ( changes != vtl->time_index_changes ) {
+    trw_layer_time_index_clear ( vtl );
+    vtl->time_index_changes = changes;
+  }
+  if ( vtl->time_index )
+    return vtl->time_index;
+
+  GArray *spans = g_array_sized_new ( FALSE, FALSE, sizeof(TrwTimeSpan), g_hash_table_size(vtl->tracks) );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, vtl->tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    TrwTimeSpan span = { NAN, NAN, NAN, key, VIK_TRACK(value) };
+    if ( vik_track_get_time_span ( span.trk, &span.start, &span.end ) )
+      g_array_append_val ( spans, span );
+  }
+  g_array_sort ( spans, trw_time_span_compare );
+  for ( guint ii = 0; ii < spans->len; ii++ ) {
+    TrwTimeSpan *span = &g_array_index ( spans, TrwTimeSpan, ii );
+    span->max_end = ii ? MAX ( span->end, g_array_index(spans, TrwTimeSpan, ii-1).max_end ) : span->end;
+  }
+  vtl->time_index = spans;
+  return spans;
+}
+
+/**
+ * trw_layer_time_spans:
+ *
+ * Returns: A list of the TrwTimeSpan of tracks with times overlapping the period,
+ *  in order of their start time. Only valid until the tracks are next changed.
+ */
+static GList *trw_layer_time_spans ( VikTrwLayer *vtl, gdouble start, gdouble end )
+{
+  GArray *spans = trw_layer_time_index ( vtl );
+
+  // The first span starting after the period
+  guint lo = 0, hi = spans->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( g_array_index(spans, TrwTimeSpan, mid).start <= end )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // Then work back until none of the earlier ones can still be going
+  GList *found = NULL;
+  while ( lo-- > 0 ) {
+    TrwTimeSpan *span = &g_array_index ( spans, TrwTimeSpan, lo );
+    if ( span->max_end < start )
+      break;
+    if ( span->end >= start )
+      found = g_list_prepend ( found, span );
+  }
+  return found;
+}
+
+/**
+ * vik_trw_layer_get_tracks_by_time:
+ * @start: Seconds since the epoch
+ * @end:   Seconds since the epoch
+ *
+ * Returns: A list of the tracks (not routes) with trackpoint times overlapping the period,
+ *  in order of their first time. Free the list after use.
+ */
+GList *vik_trw_layer_get_tracks_by_time ( VikTrwLayer *vtl, gdouble start, gdouble end )
+{
+  GList *spans = trw_layer_time_spans ( vtl, start, end );
+  for ( GList *iter = spans; iter; iter = iter->next )
+    iter->data = ((TrwTimeSpan*)iter->data)->trk;
+  return spans;
+}
+
+/**
+ * vik_trw_layer_get_time_range:
+ * @first: Set to the earliest trackpoint time of any track
+ * @last:  Set to the latest
+ *
+ * Returns: FALSE if no track has any times
+ */
+gboolean vik_trw_layer_get_time_range ( VikTrwLayer *vtl, gdouble *first, gdouble *last )
+{
+  trw_ensure_deferred_loaded ( vtl );
+  GArray *spans = trw_layer_time_index ( vtl );
+  if ( !spans->len )
+    return FALSE;
+  *first = g_array_index ( spans, TrwTimeSpan, 0 ).start;
+  *last = g_array_index ( spans, TrwTimeSpan, spans->len-1 ).max_end;
+  return TRUE;
+}
+
+/**
+ * vik_trw_layer_get_position_at_time:
+ * @across_segments: Whether to interpolate between the end of a segment and the start of the next one
+ *
+ * Find where any of the tracks was at the time - see vik_track_get_position_at_time()
+ *
+ * Returns: The track used for the position, or NULL if none cover the time
+ */
+VikTrack *vik_trw_layer_get_position_at_time ( VikTrwLayer *vtl, gdouble timestamp, gboolean across_segments, VikTrackPosition *pos )
+{
+  VikTrack *trk = NULL;
+  GList *spans = trw_layer_time_spans ( vtl, timestamp, timestamp );
+  for ( GList *iter = spans; iter && !trk; iter = iter->next ) {
+    TrwTimeSpan *span = iter->data;
+    if ( vik_track_get_position_at_time ( span->trk, timestamp, across_segments, pos ) )
+      trk = span->trk;
+  }
+  g_list_free ( spans );
+  return trk;
+}
+
+/**
+ * vik_trw_layer_update_time_index:
+ *
+ * Ensure the time index is built, so subsequent time queries only read the layer and its tracks.
+ * Thus, while the tracks are not being changed, queries can be made from several threads at once.
+ */
+void vik_trw_layer_update_time_index ( VikTrwLayer *vtl )
+{
+  (void)trw_layer_time_index ( vtl );
+}
+
 typedef struct {
   gboolean found;
   const gchar *date_str;
@@ -1072,54 +1376,60 @@ typedef struct {
 
 #define SECS_IN_DAY 86400
 
-static gboolean trw_layer_find_date_track ( const gpointer id, const VikTrack *trk, date_finder_type *df )
-{
-  gchar date_buf[20];
-  date_buf[0] = '\0';
-  // Might be an easier way to compare dates rather than converting the strings all the time...
-  if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-    // Simple start of track comparison
-    time_t time = round(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp);
-    strftime (date_buf, sizeof(date_buf), "%Y-%m-%d", gmtime(&time));
+/**
+ * Whether the track has any trackpoint times within the period [start, end)
+ */
+static gboolean trw_layer_track_has_time_within ( const VikTrack *trk, gdouble start, gdouble end )
+{
+  const VikTrackTimes *tt = vik_track_get_times ( trk );
+  guint lo = 0, hi = tt->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( tt->times[mid].timestamp < start )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < tt->len && tt->times[lo].timestamp < end;
+}
 
-    if ( ! g_strcmp0 ( df->date_str, date_buf ) ) {
+/**
+ * Find the earliest track on the date, using the time index rather than checking every track
+ */
+static void trw_layer_find_date_track ( VikTrwLayer *vtl, date_finder_type *df )
+{
+  GTimeVal tv;
+  // See also g_date_time_new_from_iso8601() but glib 2.56 needed
+  // NB the time val is for the beginning of day
+  // Force date_str into value considered to be ISO8601 by this function
+  gchar *ds = g_strdup_printf ( "%sT00:00:00", df->date_str );
+  gboolean valid = g_time_val_from_iso8601 ( ds, &tv );
+  g_free ( ds );
+  if ( !valid )
+    return;
+
+  // Allow for any timezone difference, as the start of track check is by the UTC date
+  GList *spans = trw_layer_time_spans ( vtl, tv.tv_sec - SECS_IN_DAY, tv.tv_sec + 2*SECS_IN_DAY );
+  for ( GList *iter = spans; iter && !df->found; iter = iter->next ) {
+    TrwTimeSpan *span = iter->data;
+    const VikTrack *trk = span->trk;
+    gboolean found = FALSE;
+    if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
+      // Simple start of track comparison
+      gchar date_buf[20];
+      date_buf[0] = '\0';
+      time_t time = round(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp);
+      strftime (date_buf, sizeof(date_buf), "%Y-%m-%d", gmtime(&time));
+      found = !g_strcmp0 ( df->date_str, date_buf );
+    }
+    // Otherwise any part of the track on this date
+    if ( found || trw_layer_track_has_time_within ( trk, tv.tv_sec, tv.tv_sec + SECS_IN_DAY ) ) {
       df->found = TRUE;
       df->trk = trk;
-      df->trk_id = id;
-    }
-    // Extended test - slower as analyses whole track
-    if ( TRUE ) {
-      GTimeVal tv;
-      // See also g_date_time_new_from_iso8601() but glib 2.56 needed
-      // NB the time val is for the beginning of day
-      // Force date_str into value considered to be ISO8601 by this function
-      gchar *ds = g_strdup_printf ( "%sT00:00:00", df->date_str );
-      if ( g_time_val_from_iso8601(ds, &tv) ) {
-        // Step through track to find parts that may be on this date
-        // Process in chunks for every 100th point in order to speed up search
-        GList *tp_iter;
-        tp_iter = trk->trackpoints;
-        guint count = 0;
-        while ( tp_iter ) {
-          count++;
-          if ( count % 100 == 0 || tp_iter->next == NULL ) {
-            VikTrackpoint *tpt = VIK_TRACKPOINT(tp_iter->data);
-            if ( !isnan(tpt->timestamp) &&
-                 tpt->timestamp < tv.tv_sec+86400 &&
-                 tpt->timestamp > tv.tv_sec ) {
-              df->found = TRUE;
-              df->trk = trk;
-              df->trk_id = id;
-              break;
-            }
-          }
-          tp_iter = tp_iter->next;
-        }
-      }
-      g_free ( ds );
+      df->trk_id = span->id;
     }
   }
-  return df->found;
+  g_list_free ( spans );
 }
 
 static gboolean trw_layer_find_date_waypoint ( const gpointer id, const VikWaypoint *wpt, date_finder_type *df )
@@ -1152,7 +1462,7 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
   df.wpt = NULL;
   // Only tracks ATM
   if ( do_tracks )
-    g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_find_date_track, &df );
+    trw_layer_find_date_track ( vtl, &df );
   else
     g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_find_date_waypoint, &df );
 
@@ -1273,8 +1583,6 @@ static void trw_layer_copy_item ( VikTrwLayer *vtl, gint subtype, gpointer subla
     return;
   }
 
-  GByteArray *ba = g_byte_array_new ();
-
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
     vik_waypoint_marshall ( g_hash_table_lookup ( vtl->waypoints, sublayer ), &id, &il );
   } else if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK ) {
@@ -1283,12 +1591,8 @@ static void trw_layer_copy_item ( VikTrwLayer *vtl, gint subtype, gpointer subla
     vik_track_marshall ( g_hash_table_lookup ( vtl->routes, sublayer ), &id, &il );
   }
 
-  g_byte_array_append ( ba, id, il );
-
-  g_free(id);
-
-  *len = ba->len;
-  *item = ba->data;
+  *len = il;
+  *item = id;
 }
 
 static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *item, guint len )
@@ -1364,6 +1668,7 @@ static void trw_layer_free_copied_item ( gint subtype, gpointer item )
 static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
 {
   gboolean changed = FALSE;
+  trw_layer_draw_cache_invalidate ( vtl );
   switch ( vlsp->id )
   {
     case PARAM_TV:
@@ -1381,6 +1686,8 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
     case PARAM_TLFONTSIZE:
       if ( vlsp->data.u < FS_NUM_SIZES ) {
         changed = vik_layer_param_change_uint ( vlsp->data, &vtl->track_font_size );
+        if ( changed && vtl->track_labels )
+          g_hash_table_remove_all ( vtl->track_labels );
         g_free ( vtl->track_fsize_str );
         switch ( vtl->track_font_size ) {
           case FS_XX_SMALL: vtl->track_fsize_str = g_strdup ( "xx-small" ); break;
@@ -1474,6 +1781,13 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
     case PARAM_PGS:
       changed = vik_layer_param_change_boolean ( vlsp->data, &vtl->prefer_gps_speed );
       break;
+    case PARAM_TCOMPACT:
+      changed = vik_layer_param_change_boolean ( vlsp->data, &vtl->track_compact );
+      if ( vtl->track_compact && !vtl->compact_drawn )
+        vtl->compact_drawn = g_hash_table_new ( g_direct_hash, g_direct_equal );
+      if ( !vtl->track_compact )
+        trw_ensure_unpacked ( vtl );
+      break;
     case PARAM_DLA:
       changed = vik_layer_param_change_boolean ( vlsp->data, &vtl->drawlabels );
       break;
@@ -1482,18 +1796,11 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
       break;
     case PARAM_IS:
       changed = vik_layer_param_change_uint8 ( vlsp->data, &vtl->image_size );
-      if ( changed )
-        g_hash_table_remove_all ( vtl->image_cache );
       break;
     case PARAM_IA:
       changed = vik_layer_param_change_uint8 ( vlsp->data, &vtl->image_alpha );
-      if ( changed )
-        g_hash_table_remove_all ( vtl->image_cache );
       break;
     case PARAM_ICS:
-      // If cache size is made smaller, then reset cache
-      if ( vlsp->data.u < vtl->image_cache_size )
-        g_hash_table_remove_all ( vtl->image_cache );
       changed = vik_layer_param_change_uint ( vlsp->data, &vtl->image_cache_size );
       break;
     case PARAM_WPC:
@@ -1541,6 +1848,10 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
     case PARAM_WPFONTSIZE:
       if ( vlsp->data.u < FS_NUM_SIZES ) {
         changed = vik_layer_param_change_uint ( vlsp->data, &vtl->wp_font_size );
+        if ( changed && vtl->wp_labels ) {
+          g_hash_table_remove_all ( vtl->wp_labels );
+          g_hash_table_remove_all ( vtl->cluster_labels );
+        }
         g_free ( vtl->wp_fsize_str );
         switch ( vtl->wp_font_size ) {
           case FS_XX_SMALL: vtl->wp_fsize_str = g_strdup ( "xx-small" ); break;
@@ -1562,6 +1873,17 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
               trw_layer_sort_order_specified ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINTS, vtl->wp_sort_order );
       }
       break;
+    case PARAM_WPDECLUTTER:
+      if ( vlsp->data.u < DECLUTTER_NUM )
+        changed = vik_layer_param_change_uint ( vlsp->data, &vtl->wp_declutter );
+      break;
+    case PARAM_WPCLUSTER:
+      changed = vik_layer_param_change_boolean ( vlsp->data, &vtl->wp_cluster );
+      if ( !vtl->wp_cluster ) {
+        vik_point_clusters_free ( vtl->waypoint_clusters );
+        vtl->waypoint_clusters = NULL;
+      }
+      break;
     // Metadata
     case PARAM_MDDESC:
       if ( vlsp->data.s && vtl->metadata ) {
@@ -1653,6 +1975,7 @@ static VikLayerParamData trw_layer_get_param ( VikTrwLayer *vtl, guint16 id, gbo
     case PARAM_TADEM: rv.b = vtl->auto_dem; break;
     case PARAM_TRDUP: rv.b = vtl->auto_dedupl; break;
     case PARAM_PGS: rv.b = vtl->prefer_gps_speed; break;
+    case PARAM_TCOMPACT: rv.b = vtl->track_compact; break;
     case PARAM_IS: rv.u = vtl->image_size; break;
     case PARAM_IA: rv.u = vtl->image_alpha; break;
     case PARAM_ICS: rv.u = vtl->image_cache_size; break;
@@ -1666,6 +1989,8 @@ static VikLayerParamData trw_layer_get_param ( VikTrwLayer *vtl, guint16 id, gbo
     case PARAM_WPPROX: rv.b = vtl->wp_draw_proximity; break;
     case PARAM_WPFONTSIZE: rv.u = vtl->wp_font_size; break;
     case PARAM_WPSO: rv.u = vtl->wp_sort_order; break;
+    case PARAM_WPDECLUTTER: rv.u = vtl->wp_declutter; break;
+    case PARAM_WPCLUSTER: rv.b = vtl->wp_cluster; break;
     // Metadata
     case PARAM_MDDESC: if (vtl->metadata) { rv.s = vtl->metadata->description; } break;
     case PARAM_MDAUTH: if (vtl->metadata) { rv.s = vtl->metadata->author; } break;
@@ -1700,14 +2025,10 @@ static void trw_layer_change_param ( GtkWidget *widget, ui_change_values values
       GtkWidget *w2 = ww2[OFFSET + PARAM_IS];
       GtkWidget *w3 = ww1[OFFSET + PARAM_IA];
       GtkWidget *w4 = ww2[OFFSET + PARAM_IA];
-      GtkWidget *w5 = ww1[OFFSET + PARAM_ICS];
-      GtkWidget *w6 = ww2[OFFSET + PARAM_ICS];
       if ( w1 ) gtk_widget_set_sensitive ( w1, vlpd.b );
       if ( w2 ) gtk_widget_set_sensitive ( w2, vlpd.b );
       if ( w3 ) gtk_widget_set_sensitive ( w3, vlpd.b );
       if ( w4 ) gtk_widget_set_sensitive ( w4, vlpd.b );
-      if ( w5 ) gtk_widget_set_sensitive ( w5, vlpd.b );
-      if ( w6 ) gtk_widget_set_sensitive ( w6, vlpd.b );
       break;
     }
     // Alter sensitivity of waypoint label related widgets according to the draw label setting.
@@ -1786,71 +2107,114 @@ typedef enum {
   VIK_TRW_LAYER_EXT_END,
 } trw_external_file_type_t;
 
+static gsize trw_layer_tracks_memory_usage ( GHashTable *tracks )
+{
+  gsize size = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    size += vik_track_get_memory_usage ( VIK_TRACK(value) );
+  return size;
+}
+
+/**
+ * The tracks, routes and waypoints
+ *  (images of waypoints are kept in the shared thumbnail cache - see a_thumbnails_cache_add())
+ */
+static gsize trw_layer_get_memory_usage ( VikTrwLayer *vtl )
+{
+  // Items not yet read in are not using anything yet
+  gsize size = trw_layer_tracks_memory_usage ( vtl->tracks ) + trw_layer_tracks_memory_usage ( vtl->routes );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    size += vik_waypoint_get_memory_usage ( VIK_WAYPOINT(value) );
+  return size;
+}
+
 static void trw_layer_marshall( VikTrwLayer *vtl, guint8 **data, guint *len )
 {
+  trw_ensure_deferred_loaded ( vtl );
+  trw_ensure_unpacked ( vtl );
   guint8 *pd;
   guint pl;
 
-  *data = NULL;
-
-  // Use byte arrays to store sublayer data
-  // much like done elsewhere e.g. vik_layer_marshall_params()
-  GByteArray *ba = g_byte_array_new ( );
-
-  guint8 *sl_data;
-  guint sl_len;
+  // Layer parameters first
+  vik_layer_marshall_params(VIK_LAYER(vtl), &pd, &pl);
 
-  guint object_length;
-  guint subtype;
-  // store:
+  // store for each sublayer:
   // the length of the item
   // the sublayer type of item
   // the the actual item
-#define tlm_append(object_pointer, size, type)	\
-  subtype = (type); \
-  object_length = (size); \
-  g_byte_array_append ( ba, (guint8 *)&object_length, sizeof(object_length) ); \
-  g_byte_array_append ( ba, (guint8 *)&subtype, sizeof(subtype) ); \
-  g_byte_array_append ( ba, (object_pointer), object_length );
-
-  // Layer parameters first
-  vik_layer_marshall_params(VIK_LAYER(vtl), &pd, &pl);
-  g_byte_array_append ( ba, (guint8 *)&pl, sizeof(pl) ); \
-  g_byte_array_append ( ba, pd, pl );
-  g_free ( pd );
+  const guint sizeof_len_and_subtype = sizeof(guint) + sizeof(guint);
 
-  // Now sublayer data
+  // Work out the total size first, so the whole layer is written into a single allocation
+  //  (a layer can have millions of trackpoints)
   GHashTableIter iter;
   gpointer key, value;
+  gsize total = sizeof(pl) + pl;
 
-  // Waypoints
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next (&iter, &key, &value) )
+    total += sizeof_len_and_subtype + vik_waypoint_marshall_size ( VIK_WAYPOINT(value) );
+  g_hash_table_iter_init ( &iter, vtl->tracks );
+  while ( g_hash_table_iter_next (&iter, &key, &value) )
+    total += sizeof_len_and_subtype + vik_track_marshall_size ( VIK_TRACK(value) );
+  g_hash_table_iter_init ( &iter, vtl->routes );
+  while ( g_hash_table_iter_next (&iter, &key, &value) )
+    total += sizeof_len_and_subtype + vik_track_marshall_size ( VIK_TRACK(value) );
+
+  if ( total > G_MAXUINT ) {
+    g_warning ( "%s: layer %s is too large to copy", __FUNCTION__, VIK_LAYER(vtl)->name );
+    g_free ( pd );
+    *data = NULL;
+    *len = 0;
+    return;
+  }
+
+  guint8 *buf = g_malloc ( total );
+  guint8 *pos = buf;
+
+  memcpy ( pos, &pl, sizeof(pl) );
+  pos += sizeof(pl);
+  memcpy ( pos, pd, pl );
+  pos += pl;
+  g_free ( pd );
+
+  guint object_length;
+  guint subtype;
+  guint8 *object_start;
+#define tlm_append(marshall_to, object, type) \
+  subtype = (type); \
+  object_start = pos + sizeof_len_and_subtype; \
+  pos = marshall_to ( (object), object_start ); \
+  object_length = pos - object_start; \
+  memcpy ( object_start - sizeof_len_and_subtype, &object_length, sizeof(object_length) ); \
+  memcpy ( object_start - sizeof(subtype), &subtype, sizeof(subtype) );
+
+  // Now sublayer data
   g_hash_table_iter_init ( &iter, vtl->waypoints );
   while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-    vik_waypoint_marshall ( VIK_WAYPOINT(value), &sl_data, &sl_len );
-    tlm_append ( sl_data, sl_len, VIK_TRW_LAYER_SUBLAYER_WAYPOINT );
-    g_free ( sl_data );
+    tlm_append ( vik_waypoint_marshall_to, VIK_WAYPOINT(value), VIK_TRW_LAYER_SUBLAYER_WAYPOINT );
   }
 
-  // Tracks
   g_hash_table_iter_init ( &iter, vtl->tracks );
   while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-    vik_track_marshall ( VIK_TRACK(value), &sl_data, &sl_len );
-    tlm_append ( sl_data, sl_len, VIK_TRW_LAYER_SUBLAYER_TRACK );
-    g_free ( sl_data );
+    tlm_append ( vik_track_marshall_to, VIK_TRACK(value), VIK_TRW_LAYER_SUBLAYER_TRACK );
   }
 
-  // Routes
   g_hash_table_iter_init ( &iter, vtl->routes );
   while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-    vik_track_marshall ( VIK_TRACK(value), &sl_data, &sl_len );
-    tlm_append ( sl_data, sl_len, VIK_TRW_LAYER_SUBLAYER_ROUTE );
-    g_free ( sl_data );
+    tlm_append ( vik_track_marshall_to, VIK_TRACK(value), VIK_TRW_LAYER_SUBLAYER_ROUTE );
   }
 
 #undef tlm_append
 
-  *data = ba->data;
-  *len = ba->len;
+  g_assert ( pos == buf + total );
+  *data = buf;
+  *len = total;
 }
 
 static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, VikViewport *vvp )
@@ -1866,18 +2230,16 @@ static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, Vik
   vik_layer_unmarshall_params ( VIK_LAYER(vtl), data, pl, vvp );
   data += pl;
 
-  consumed_length = pl;
+  consumed_length = sizeof(pl) + pl;
   const guint sizeof_len_and_subtype = sizeof(guint) + sizeof(guint);
 
 #define tlm_size (*(guint *)data)
   // See marshalling above for order of how this is written
 
   // Now the individual sublayers:
-  while ( data && (consumed_length < len) ) {
-    // Normally four extra bytes at the end of the datastream
-    //  (since it's a GByteArray and that's where it's length is stored)
-    //  So only attempt read when there's an actual block of sublayer data
-    if ( consumed_length + tlm_size < len ) {
+  while ( data && (consumed_length + sizeof_len_and_subtype <= len) ) {
+    // Only attempt read when there's a whole block of sublayer data
+    if ( consumed_length + sizeof_len_and_subtype + tlm_size <= len ) {
 
       // Reuse pl to read the subtype from the data stream
       memcpy(&pl, data+sizeof(guint), sizeof(pl));
@@ -1900,7 +2262,7 @@ static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, Vik
       }
     }
     // Don't shift data pointer to beyond our buffer of data - as otherwise it could point to anything
-    if ( consumed_length + tlm_size < len ) {
+    if ( consumed_length + sizeof_len_and_subtype + tlm_size <= len ) {
       consumed_length += tlm_size + sizeof_len_and_subtype;
       //g_debug ("data %d, consumed_length %d vs len %d", tlm_size, consumed_length, len);
       data += sizeof_len_and_subtype + tlm_size;
@@ -1941,11 +2303,6 @@ static guint strcase_hash(gconstpointer v)
 }
 */
 
-static void pixbuf_free ( GdkPixbuf *pixbuf )
-{
-  g_object_unref ( G_OBJECT(pixbuf) );
-}
-
 // Stick a 1 at the end of the function name to make it more unique
 //  thus more easily searchable in a simple text editor
 static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
@@ -1972,7 +2329,6 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->routes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) vik_track_free );
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
-  rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) pixbuf_free ); // Must be performed before set_params via set_defaults
 
   vik_layer_set_defaults ( VIK_LAYER(rv), vvp );
 
@@ -1985,6 +2341,9 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->draw_sync_do = TRUE;
   rv->coord_mode = VIK_COORD_LATLON;
 
+  // Edits are followed by an update (one way or another)
+  g_signal_connect ( G_OBJECT(rv), "update", G_CALLBACK(trw_layer_draw_cache_invalidate), NULL );
+
   // Everything else is 0, FALSE or NULL
 
   return rv;
@@ -1992,11 +2351,31 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
 
 static void trw_layer_free ( VikTrwLayer *trwlayer )
 {
-  g_hash_table_destroy(trwlayer->waypoints);
+  if ( trwlayer->sort_idle_id )
+    g_source_remove ( trwlayer->sort_idle_id );
+  vik_journal_free ( trwlayer->journal );
+  if ( trwlayer->journal_serials )
+    g_hash_table_destroy ( trwlayer->journal_serials );
+  a_binfile_deferred_free ( trwlayer->deferred );
+  if ( trwlayer->compact_drawn )
+    g_hash_table_destroy ( trwlayer->compact_drawn );
+  trw_import_index_free ( trwlayer->import );
+  vik_viewport_cache_free ( trwlayer->draw_cache );
+  if ( trwlayer->hover_tps )
+    g_array_free ( trwlayer->hover_tps, TRUE );
+  if ( trwlayer->simplify_preview )
+    g_ptr_array_free ( trwlayer->simplify_preview, TRUE );
+  vik_spatial_index_free ( trwlayer->tracks_index );
+  vik_spatial_index_free ( trwlayer->routes_index );
+  vik_spatial_index_free ( trwlayer->waypoints_index );
+  vik_point_clusters_free ( trwlayer->waypoint_clusters );
+  vik_name_index_free ( trwlayer->waypoints_names );
+  vik_name_index_free ( trwlayer->tracks_names );
+  vik_name_index_free ( trwlayer->routes_names );
+  if ( trwlayer->time_index )
+    g_array_free ( trwlayer->time_index, TRUE );
   g_hash_table_destroy(trwlayer->waypoints_iters);
-  g_hash_table_destroy(trwlayer->tracks);
   g_hash_table_destroy(trwlayer->tracks_iters);
-  g_hash_table_destroy(trwlayer->routes);
   g_hash_table_destroy(trwlayer->routes_iters);
 
   trw_layer_free_track_gcs ( trwlayer );
@@ -2013,6 +2392,13 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->wplabellayout != NULL)
     g_object_unref ( G_OBJECT ( trwlayer->wplabellayout ) );
 
+  if ( trwlayer->track_labels )
+    g_hash_table_destroy ( trwlayer->track_labels );
+  if ( trwlayer->wp_labels )
+    g_hash_table_destroy ( trwlayer->wp_labels );
+  if ( trwlayer->cluster_labels )
+    g_hash_table_destroy ( trwlayer->cluster_labels );
+
   if ( trwlayer->waypoint_gc != NULL )
     ui_gc_unref ( trwlayer->waypoint_gc );
 
@@ -2037,7 +2423,6 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( GTK_WIDGET(trwlayer->tracks_analysis_dialog) );
 
-  g_hash_table_destroy ( trwlayer->image_cache );
 
   g_free ( trwlayer->external_file );
   g_free ( trwlayer->external_dirpath );
@@ -2053,13 +2438,133 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   g_free ( trwlayer->gpx_extensions );
   if ( trwlayer->laps )
     g_queue_free ( trwlayer->laps );
+
+  // Last, as nothing else of the layer may then refer to them
+  trw_layer_free_tracks_later ( trwlayer->tracks );
+  trw_layer_free_tracks_later ( trwlayer->routes );
+  trw_layer_free_items_later ( trwlayer->waypoints );
+}
+
+#define VIK_SETTINGS_DRAW_CACHE "trackwaypoint_draw_cache"
+
+static gboolean trw_layer_draw_cache_enabled ()
+{
+  static gint enabled = -1;
+  if ( enabled < 0 ) {
+    gboolean cache = FALSE;
+    (void)a_settings_get_boolean ( VIK_SETTINGS_DRAW_CACHE, &cache );
+    enabled = cache;
+  }
+  return enabled;
+}
+
+/**
+ * Anything that changes how the layer looks must come through here,
+ *  otherwise an out of date drawing could be reused
+ */
+static void trw_layer_draw_cache_invalidate ( VikTrwLayer *vtl )
+{
+  if ( vtl->draw_cache )
+    vik_viewport_cache_invalidate ( vtl->draw_cache );
+  // Nor can what was found under the pointer be relied upon
+  vtl->hover_valid = FALSE;
+}
+
+// Grid cell size in degrees - a typical day's track would be in a few cells
+#define TRW_INDEX_CELL_SIZE 0.1
+
+static void trw_layer_index_clear ( VikTrwLayer *vtl, VikSpatialIndex **index )
+{
+  // The contents have changed
+  trw_layer_draw_cache_invalidate ( vtl );
+  vik_spatial_index_free ( *index );
+  *index = NULL;
+}
+
+static void trw_layer_index_track ( gpointer id, VikTrack *trk, VikSpatialIndex *index )
+{
+  vik_spatial_index_add ( index, trk->bbox, id, trk );
+}
+
+static void trw_layer_index_waypoint ( gpointer id, VikWaypoint *wp, VikSpatialIndex *index )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(wp->coord), &ll );
+  LatLonBBox bbox = { ll.lat, ll.lat, ll.lon, ll.lon };
+  vik_spatial_index_add ( index, bbox, id, wp );
+}
+
+// Cell size in degrees of the first level of waypoint clusters, with each level doubling it
+#define TRW_CLUSTER_CELL_SIZE 0.01
+#define TRW_CLUSTER_LEVELS 12
+// Screen size of a cluster cell
+#define TRW_CLUSTER_PIXELS 48
+
+static void trw_layer_cluster_waypoint ( gpointer id, VikWaypoint *wp, VikPointClusters *pc )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(wp->coord), &ll );
+  vik_point_clusters_set ( pc, wp, &ll );
+}
+
+/**
+ * trw_layer_get_waypoint_clusters:
+ *
+ * Unlike the spatial indices, once made the clusters are kept up to date with each change
+ *  (as building them for many waypoints when zoomed right out is slow)
+ */
+static VikPointClusters *trw_layer_get_waypoint_clusters ( VikTrwLayer *vtl )
+{
+  if ( !vtl->waypoint_clusters ) {
+    vtl->waypoint_clusters = vik_point_clusters_new ( TRW_CLUSTER_CELL_SIZE, TRW_CLUSTER_LEVELS );
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc)trw_layer_cluster_waypoint, vtl->waypoint_clusters );
+  }
+  return vtl->waypoint_clusters;
+}
+
+/**
+ * trw_layer_foreach_in_bbox:
+ * @items: One of the tracks, routes or waypoints of the layer
+ *
+ * Like g_hash_table_foreach() on the items, but skipping most of those nowhere near the bounds.
+ * The function must still check the item itself.
+ *
+ * The spatial indices are (re)built when next needed after any change,
+ *  so nothing else needs to maintain them.
+ */
+static void trw_layer_foreach_in_bbox ( VikTrwLayer *vtl, GHashTable *items, LatLonBBox bbox, GHFunc func, gpointer user_data )
+{
+  // Any track may have been edited
+  gint bounds = vik_track_get_bounds_changes ();
+  if ( bounds != vtl->tracks_index_bounds ) {
+    trw_layer_index_clear ( vtl, &vtl->tracks_index );
+    trw_layer_index_clear ( vtl, &vtl->routes_index );
+    vtl->tracks_index_bounds = bounds;
+  }
+
+  VikSpatialIndex **index;
+  if ( items == vtl->tracks )
+    index = &vtl->tracks_index;
+  else if ( items == vtl->routes )
+    index = &vtl->routes_index;
+  else
+    index = &vtl->waypoints_index;
+
+  if ( !*index ) {
+    *index = vik_spatial_index_new ( TRW_INDEX_CELL_SIZE );
+    g_hash_table_foreach ( items, items == vtl->waypoints ? (GHFunc)trw_layer_index_waypoint : (GHFunc)trw_layer_index_track, *index );
+  }
+  vik_spatial_index_query ( *index, bbox, func, user_data );
 }
 
 static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, VikViewport *vp, gboolean highlight )
 {
   dp->vtl = vtl;
   dp->vp = vp;
+  dp->proj = vik_viewport_get_projection ( vp );
   dp->highlight = highlight;
+  dp->from = NULL;
+  dp->label_grid = NULL;
   dp->vw = (VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(dp->vtl);
   dp->xmpp = vik_viewport_get_xmpp ( vp );
   dp->ympp = vik_viewport_get_ympp ( vp );
@@ -2095,6 +2600,51 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   }
 
   dp->bbox = vik_viewport_get_bbox ( vp );
+
+  // Track detail smaller than half a pixel can't be seen
+  VikCoord c1, c2;
+  vik_viewport_screen_to_coord ( vp, dp->width/2, dp->height/2, &c1 );
+  vik_viewport_screen_to_coord ( vp, dp->width/2+1, dp->height/2, &c2 );
+  dp->simplify_tolerance = vik_coord_diff ( &c1, &c2 ) / 2;
+
+  // The same leniency as ce1 etc. but in lat/lon
+  gint margin = 500;
+  if ( dp->one_zone )
+    margin = MAX ( margin, MIN(100000, 1600 / (dp->xmpp * dp->xmpp)) );
+  struct LatLon ll1, ll2;
+  vik_viewport_screen_to_coord ( vp, -margin, -margin, &c1 );
+  vik_viewport_screen_to_coord ( vp, dp->width+margin, dp->height+margin, &c2 );
+  vik_coord_to_latlon ( &c1, &ll1 );
+  vik_coord_to_latlon ( &c2, &ll2 );
+  dp->lenient_bbox.north = MAX ( ll1.lat, ll2.lat );
+  dp->lenient_bbox.south = MIN ( ll1.lat, ll2.lat );
+  dp->lenient_bbox.east = MAX ( ll1.lon, ll2.lon );
+  dp->lenient_bbox.west = MIN ( ll1.lon, ll2.lon );
+
+  dp->zone_min = dp->zone_max = 0;
+  if ( !dp->one_zone && !dp->lat_lon ) {
+    dp->zone_min = c1.utm_zone;
+    dp->zone_max = c2.utm_zone;
+    // Across several zones the edges of the view are not along meridians, so check the other corners too
+    vik_viewport_screen_to_coord ( vp, dp->width+margin, -margin, &c1 );
+    vik_viewport_screen_to_coord ( vp, -margin, dp->height+margin, &c2 );
+    vik_coord_to_latlon ( &c1, &ll1 );
+    vik_coord_to_latlon ( &c2, &ll2 );
+    dp->lenient_bbox.north = MAX ( dp->lenient_bbox.north, MAX ( ll1.lat, ll2.lat ) );
+    dp->lenient_bbox.south = MIN ( dp->lenient_bbox.south, MIN ( ll1.lat, ll2.lat ) );
+    dp->lenient_bbox.east = MAX ( dp->lenient_bbox.east, MAX ( ll1.lon, ll2.lon ) );
+    dp->lenient_bbox.west = MIN ( dp->lenient_bbox.west, MIN ( ll1.lon, ll2.lon ) );
+  }
+}
+
+/**
+ * Whether a part of a track can be passed over, as it is well out of view
+ */
+static gboolean trw_layer_chunk_out_of_view ( struct DrawingParams *dp, const VikTrackChunk *chunk )
+{
+  if ( !dp->one_zone && !dp->lat_lon && ( chunk->zone_max < dp->zone_min || chunk->zone_min > dp->zone_max ) )
+    return TRUE;
+  return !BBOX_INTERSECT ( chunk->bbox, dp->lenient_bbox );
 }
 
 /*
@@ -2140,32 +2690,165 @@ static GdkColor track_section_gdkcolour_by_speed ( VikTrwLayer *vtl, VikTrackpoi
 }
 #endif
 
-static void draw_utm_skip_insignia ( VikViewport *vvp, GdkGC *gc, gint x, gint y, GdkColor *clr, guint lt )
+/**
+ * trw_layer_label_grid_new:
+ *
+ * Start keeping track of where labels have been drawn, so later ones can be left out where they would overlap
+ */
+static void trw_layer_label_grid_new ( struct DrawingParams *dp )
 {
-  vik_viewport_draw_line ( vvp, gc, x+5, y, x-5, y, clr, lt );
-  vik_viewport_draw_line ( vvp, gc, x, y+5, x, y-5, clr, lt );
-  vik_viewport_draw_line ( vvp, gc, x+5, y+5, x-5, y-5, clr, lt );
-  vik_viewport_draw_line ( vvp, gc, x+5, y-5, x-5, y+5, clr, lt );
+  dp->grid_cols = (dp->width + LABEL_GRID_CELL - 1) / LABEL_GRID_CELL;
+  dp->grid_rows = (dp->height + LABEL_GRID_CELL - 1) / LABEL_GRID_CELL;
+  dp->grid_free = dp->grid_cols * dp->grid_rows;
+  dp->label_grid = g_malloc0 ( MAX(1, dp->grid_free) );
 }
 
-static void trw_layer_draw_track_label ( gchar *name, gchar *fgcolour, gchar *bgcolour, struct DrawingParams *dp, VikCoord *coord )
+static void trw_layer_label_grid_free ( struct DrawingParams *dp )
 {
-  gchar *label_markup = g_strdup_printf ( "<span foreground=\"%s\" background=\"%s\" size=\"%s\">%s</span>", fgcolour, bgcolour, dp->vtl->track_fsize_str, name );
-
-  if ( pango_parse_markup ( label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-    pango_layout_set_markup ( dp->vtl->tracklabellayout, label_markup, -1 );
-  else
-    // Fallback if parse failure
-    pango_layout_set_text ( dp->vtl->tracklabellayout, name, -1 );
+  g_free ( dp->label_grid );
+  dp->label_grid = NULL;
+}
 
+/**
+ * trw_layer_label_grid_full:
+ *
+ * Returns: TRUE when labels cover the whole screen, so there is no point in even working out any more labels
+ */
+static gboolean trw_layer_label_grid_full ( struct DrawingParams *dp )
+{
+  return dp->label_grid && !dp->grid_free;
+}
+
+/**
+ * trw_layer_label_place:
+ * @force: Draw it anyway (whilst still covering the area)
+ *
+ * Check the screen area of a label is clear of those already drawn.
+ * If so the area is then counted as covered.
+ * Labels entirely off screen are never left out (as part of them can still be drawn by the viewport).
+ *
+ * Returns: Whether to draw the label
+ */
+static gboolean trw_layer_label_place ( struct DrawingParams *dp, gint x, gint y, gint width, gint height, gboolean force )
+{
+  if ( !dp->label_grid )
+    return TRUE;
+
+  gint c1 = MAX ( 0, x / LABEL_GRID_CELL );
+  gint r1 = MAX ( 0, y / LABEL_GRID_CELL );
+  gint c2 = MIN ( (gint)dp->grid_cols - 1, (x + width - 1) / LABEL_GRID_CELL );
+  gint r2 = MIN ( (gint)dp->grid_rows - 1, (y + height - 1) / LABEL_GRID_CELL );
+  if ( x + width <= 0 || y + height <= 0 || c1 > c2 || r1 > r2 )
+    return TRUE;
+
+  if ( !force )
+    for ( gint rr = r1; rr <= r2; rr++ )
+      for ( gint cc = c1; cc <= c2; cc++ )
+        if ( dp->label_grid[rr * dp->grid_cols + cc] )
+          return FALSE;
+
+  for ( gint rr = r1; rr <= r2; rr++ )
+    for ( gint cc = c1; cc <= c2; cc++ ) {
+      guint8 *cell = &dp->label_grid[rr * dp->grid_cols + cc];
+      if ( !*cell ) {
+        *cell = 1;
+        dp->grid_free--;
+      }
+    }
+  return TRUE;
+}
+
+static void draw_utm_skip_insignia ( VikViewport *vvp, GdkGC *gc, gint x, gint y, GdkColor *clr, guint lt )
+{
+  vik_viewport_draw_line ( vvp, gc, x+5, y, x-5, y, clr, lt );
+  vik_viewport_draw_line ( vvp, gc, x, y+5, x, y-5, clr, lt );
+  vik_viewport_draw_line ( vvp, gc, x+5, y+5, x-5, y-5, clr, lt );
+  vik_viewport_draw_line ( vvp, gc, x+5, y-5, x-5, y+5, clr, lt );
+}
+
+// Enough for all the names of a dense layer in view, but stale labels (e.g. of renamed waypoints) don't build up forever
+#define TRW_LABELS_MAX 5000
+
+/**
+ * A label with its text already parsed, shaped and measured
+ */
+typedef struct {
+  PangoLayout *layout;
+  gint width;
+  gint height;
+} TrwLabel;
+
+static void trw_label_free ( TrwLabel *label )
+{
+  g_object_unref ( label->layout );
+  g_free ( label );
+}
+
+/**
+ * trw_layer_get_label:
+ * @labels:   The cache of labels for this style of label
+ * @key:      Identifies the label within the cache
+ * @layout:   The layout with the font of this style of label
+ * @markup:   When not already cached, make the markup for the label from the text
+ * @text:     The plain text in case the markup is invalid
+ *
+ * Laying out label text with Pango is slow, so each distinct label is laid out once and then kept,
+ *  until the cache is cleared when the style of label changes (or it gets too big).
+ *
+ * Returns: The label (owned by the cache)
+ */
+static TrwLabel *trw_layer_get_label ( GHashTable *labels, const gchar *key, PangoLayout *layout, gchar *(*markup)(struct DrawingParams*, const gchar*), struct DrawingParams *dp, const gchar *text )
+{
+  TrwLabel *label = g_hash_table_lookup ( labels, key );
+  if ( label )
+    return label;
+
+  if ( g_hash_table_size(labels) >= TRW_LABELS_MAX )
+    g_hash_table_remove_all ( labels );
+
+  label = g_new ( TrwLabel, 1 );
+  label->layout = pango_layout_copy ( layout );
+  gchar *label_markup = markup ( dp, text );
+  if ( pango_parse_markup ( label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
+    pango_layout_set_markup ( label->layout, label_markup, -1 );
+  else
+    // Fallback if parse failure
+    pango_layout_set_text ( label->layout, text, -1 );
   g_free ( label_markup );
 
-  gint label_x, label_y;
-  gint width, height;
-  pango_layout_get_pixel_size ( dp->vtl->tracklabellayout, &width, &height );
+  pango_layout_get_pixel_size ( label->layout, &label->width, &label->height );
+  g_hash_table_insert ( labels, g_strdup(key), label );
+  return label;
+}
 
+static gchar *trw_layer_wp_label_markup ( struct DrawingParams *dp, const gchar *name )
+{
+  // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
+  return g_strdup_printf ( "<span size=\"%s\">%s</span>", dp->vtl->wp_fsize_str, name );
+}
+
+static gchar *trw_layer_track_label_markup ( struct DrawingParams *dp, const gchar *key )
+{
+  // The key is already the markup
+  return g_strdup ( key );
+}
+
+static void trw_layer_draw_track_label ( gchar *name, gchar *fgcolour, gchar *bgcolour, struct DrawingParams *dp, VikCoord *coord )
+{
+  if ( trw_layer_label_grid_full ( dp ) )
+    return;
+
+  // Track labels are relatively few, so whilst the markup makes a convenient key it's not worth avoiding making it
+  gchar *label_markup = g_strdup_printf ( "<span foreground=\"%s\" background=\"%s\" size=\"%s\">%s</span>", fgcolour, bgcolour, dp->vtl->track_fsize_str, name );
+  TrwLabel *label = trw_layer_get_label ( dp->vtl->track_labels, label_markup, dp->vtl->tracklabellayout, trw_layer_track_label_markup, dp, label_markup );
+  g_free ( label_markup );
+
+  gint label_x, label_y;
   vik_viewport_coord_to_screen ( dp->vp, coord, &label_x, &label_y );
-  vik_viewport_draw_layout ( dp->vp, dp->vtl->track_bg_gc, label_x-width/2, label_y-height/2, dp->vtl->tracklabellayout, &dp->vtl->track_bg_color );
+  label_x -= label->width/2;
+  label_y -= label->height/2;
+  if ( trw_layer_label_place ( dp, label_x, label_y, label->width, label->height, FALSE ) )
+    vik_viewport_draw_layout ( dp->vp, dp->vtl->track_bg_gc, label_x, label_y, label->layout, &dp->vtl->track_bg_color );
 }
 
 /**
@@ -2452,13 +3135,348 @@ static void trw_layer_draw_point_names ( struct DrawingParams *dp, VikTrack *trk
   g_free ( bgcolour );
 }
 
+/**
+ * Labels drawn after the trackpoints, so the labels are on top
+ */
+static void trw_layer_draw_track_labels ( struct DrawingParams *dp, VikTrack *track, gboolean drawing_highlight )
+{
+  if ( dp->vtl->track_draw_labels ) {
+    if ( track->max_number_dist_labels > 0 ) {
+      trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
+    }
+    trw_layer_draw_point_names (dp, track, drawing_highlight );
+
+    if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
+      trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
+    }
+  }
+}
+
+/**
+ * Consecutive lines in the same style, to be drawn with one stroke
+ */
+typedef struct {
+  GdkGC *gc;
+  GdkColor color;
+  guint thickness;
+  gint npoints;
+  GdkPoint points[VIK_TRACK_CHUNK_SIZE];
+} TrackPolyline;
+
+static void track_polyline_flush ( VikViewport *vvp, TrackPolyline *pl )
+{
+  if ( pl->npoints > 1 )
+    vik_viewport_draw_lines ( vvp, pl->gc, pl->points, pl->npoints, &pl->color, pl->thickness );
+  pl->npoints = 0;
+}
+
+/**
+ * Add a line as vik_viewport_draw_line() would draw it,
+ *  it's actually drawn when the style changes, the line doesn't follow on from the previous one,
+ *  or track_polyline_flush() at the end
+ */
+static void track_polyline_add ( VikViewport *vvp, TrackPolyline *pl, GdkGC *gc, GdkColor *color, guint thickness, gint x1, gint y1, gint x2, gint y2 )
+{
+  gint width = vik_viewport_get_width ( vvp );
+  gint height = vik_viewport_get_height ( vvp );
+  // Entirely to one side of the view
+  if ( ( x1 < 0 && x2 < 0 ) || ( y1 < 0 && y2 < 0 ) ||
+       ( x1 > width && x2 > width ) || ( y1 > height && y2 > height ) )
+    return;
+
+  if ( pl->npoints ) {
+    GdkPoint *last = &pl->points[pl->npoints-1];
+    if ( pl->gc != gc || pl->thickness != thickness || !gdk_color_equal ( &pl->color, color ) ||
+         last->x != x1 || last->y != y1 )
+      track_polyline_flush ( vvp, pl );
+    else if ( pl->npoints == G_N_ELEMENTS(pl->points) ) {
+      // Carry on in another stroke
+      track_polyline_flush ( vvp, pl );
+      pl->points[0].x = x1;
+      pl->points[0].y = y1;
+      pl->npoints = 1;
+    }
+  }
+  if ( !pl->npoints ) {
+    pl->gc = gc;
+    pl->color = *color;
+    pl->thickness = thickness;
+    pl->points[0].x = x1;
+    pl->points[0].y = y1;
+    pl->npoints = 1;
+  }
+  pl->points[pl->npoints].x = x2;
+  pl->points[pl->npoints].y = y2;
+  pl->npoints++;
+}
+
+// Fwd declaration
+static gboolean trw_layer_track_simplified_add ( struct DrawingParams *dp, VikTrack *track, TrackPolyline *polyline, GdkGC *gc, GdkColor *gcolor, guint lt );
+
+/**
+ * When only the line of the track is shown, draw just the points that make a visible difference
+ *  at this zoom level - e.g. when zoomed out to see many tracks.
+ *
+ * Returns: FALSE if not possible, so the track should be drawn in full
+ */
+static gboolean trw_layer_draw_track_simplified ( struct DrawingParams *dp, VikTrack *track, GdkGC *gc, GdkColor *gcolor, guint lt, gboolean draw_track_outline )
+{
+  // Point based features need every point and UTM zone changes are handled by the full drawing
+  if ( !dp->lat_lon || !dp->vtl->drawlines || dp->vtl->drawelevation || dp->vtl->drawdirections ||
+       (dp->vtl->drawpoints && !draw_track_outline) || (dp->vtl->drawmode == DRAWMODE_BY_SPEED && !dp->highlight) ||
+       track == dp->vtl->current_track )
+    return FALSE;
+
+  if ( draw_track_outline ) {
+    gc = dp->vtl->track_bg_gc;
+    gcolor = &dp->vtl->track_bg_color;
+    lt = dp->vtl->line_thickness + dp->vtl->bg_line_thickness;
+  }
+
+  TrackPolyline polyline;
+  polyline.npoints = 0;
+  if ( !trw_layer_track_simplified_add ( dp, track, &polyline, gc, gcolor, lt ) )
+    return FALSE;
+  track_polyline_flush ( dp->vp, &polyline );
+  return TRUE;
+}
+
+/**
+ * Add the lines of the track's simplified geometry to the polyline being built,
+ *  so lines of several tracks in the same style can be drawn together.
+ * Only for lat/lon mode.
+ *
+ * Returns: FALSE if there is no simplified geometry, and so nothing was added
+ */
+static gboolean trw_layer_track_simplified_add ( struct DrawingParams *dp, VikTrack *track, TrackPolyline *polyline, GdkGC *gc, GdkColor *gcolor, guint lt )
+{
+  const GPtrArray *tps = vik_track_get_simplified ( track, dp->simplify_tolerance );
+  if ( !tps )
+    return FALSE;
+
+  // Screen positions are worked out a block at a time
+  const VikCoord *coords[VIK_TRACK_CHUNK_SIZE];
+  gint xs[VIK_TRACK_CHUNK_SIZE], ys[VIK_TRACK_CHUNK_SIZE];
+
+  gint x, y, oldx = 0, oldy = 0;
+  gboolean oldin = FALSE;
+  VikTrackpoint *tp2 = NULL;
+  for ( guint ii = 0; ii < tps->len; ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT_AT(tps, ii);
+    guint jj = ii % VIK_TRACK_CHUNK_SIZE;
+    if ( jj == 0 ) {
+      guint nn = MIN ( VIK_TRACK_CHUNK_SIZE, tps->len - ii );
+      for ( guint kk = 0; kk < nn; kk++ )
+        coords[kk] = &(VIK_TRACKPOINT_AT(tps, ii+kk)->coord);
+      vik_viewport_projection_coords_to_screen ( dp->proj, coords, nn, xs, ys );
+    }
+    gboolean in = tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&
+                  tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2;
+    // Lines are drawn when either end is in view, same as the full drawing
+    gboolean draw = tp2 && !tp->newsegment && (in || oldin);
+    // Don't draw massively long lines across the 180 degrees East-West longitude boundary
+    if ( draw &&
+         (( tp2->coord.east_west < -90.0 && tp->coord.east_west > 90.0 ) ||
+          ( tp2->coord.east_west > 90.0 && tp->coord.east_west < -90.0 )) )
+      draw = FALSE;
+    x = xs[jj];
+    y = ys[jj];
+    if ( draw && (x != oldx || y != oldy) )
+      track_polyline_add ( dp->vp, polyline, gc, gcolor, lt, oldx, oldy, x, y );
+    oldx = x;
+    oldy = y;
+    oldin = in;
+    tp2 = tp;
+  }
+  return TRUE;
+}
+
+
+static void trw_layer_current_tp_drawn ( VikTrwLayer *vtl, VikTrackpoint *tp )
+{
+  vtl->current_tp_drawn = TRUE;
+  vtl->current_tp_drawn_coord = tp->coord;
+}
+
+/**
+ * The screen area the current trackpoint drawing can cover at the specified position
+ *  (the biggest being a 'stop' circle)
+ */
+static void trw_layer_current_tp_area ( VikTrwLayer *vtl, VikViewport *vvp, const VikCoord *coord, GdkRectangle *area )
+{
+  gint x, y;
+  vik_viewport_coord_to_screen ( vvp, coord, &x, &y );
+  gint radius = 3*(vtl->drawpoints_size*2) + vtl->line_thickness + vtl->bg_line_thickness + 2;
+  area->x = x - radius;
+  area->y = y - radius;
+  area->width = 2*radius + 1;
+  area->height = 2*radius + 1;
+}
+
+/**
+ * Add the lines of the track at full detail, for when nothing is drawn at the points.
+ * Only for lat/lon mode, or UTM mode with a single zone in view.
+ * The drawing choices are constant arguments, so the compiler can make a separate loop
+ *  for each combination used by trw_layer_draw_track_lines() without branching on them per point.
+ */
+static inline void trw_layer_track_lines_add ( struct DrawingParams *dp, VikTrack *track, TrackPolyline *polyline,
+                                               GdkGC *gc, GdkColor *gcolor, guint lt,
+                                               const gboolean utm, const gboolean by_speed,
+                                               gdouble average_speed, gdouble low_speed, gdouble high_speed )
+{
+  GList *list = track->trackpoints;
+  const GArray *chunks = vik_track_get_chunks ( track );
+  // Screen positions of the points in the current chunk (when in view)
+  const VikCoord *chunk_coords[VIK_TRACK_CHUNK_SIZE];
+  gint chunk_x[VIK_TRACK_CHUNK_SIZE], chunk_y[VIK_TRACK_CHUNK_SIZE];
+  gboolean chunk_projected = FALSE;
+  const gint zone = dp->center->utm_zone;
+  GdkGC *main_gc = gc;
+  GdkColor main_gcolor = *gcolor;
+
+  VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
+  if ( list == dp->vtl->current_tpl )
+    trw_layer_current_tp_drawn ( dp->vtl, tp );
+  gint x, y, oldx, oldy;
+  vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &oldx, &oldy );
+  gboolean useoldvals = TRUE;
+  guint index = 0;
+
+  while ( (list = g_list_next(list)) ) {
+    index++;
+    // As trw_layer_draw_track()
+    if ( chunks && index % VIK_TRACK_CHUNK_SIZE == 1 ) {
+      const VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, index / VIK_TRACK_CHUNK_SIZE );
+      if ( chunk->first != chunk->last && !BBOX_INTERSECT ( chunk->bbox, dp->lenient_bbox ) ) {
+        list = chunk->last;
+        index += VIK_TRACK_CHUNK_SIZE - 2;
+        useoldvals = FALSE;
+        chunk_projected = FALSE;
+        continue;
+      }
+      guint nn = 0;
+      for ( GList *iter = chunk->first; iter != chunk->last->next; iter = iter->next )
+        chunk_coords[nn++] = &(VIK_TRACKPOINT(iter->data)->coord);
+      vik_viewport_projection_coords_to_screen ( dp->proj, chunk_coords, nn, chunk_x, chunk_y );
+      chunk_projected = TRUE;
+    }
+    else if ( index % VIK_TRACK_CHUNK_SIZE == 0 )
+      chunk_projected = FALSE;
+
+    tp = VIK_TRACKPOINT(list->data);
+    if ( list == dp->vtl->current_tpl )
+      trw_layer_current_tp_drawn ( dp->vtl, tp );
+    VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
+
+    // Don't draw massively long lines across the 180 degrees East-West longitude boundary
+    if ( !utm &&
+         (( tp2->coord.east_west < -90.0 && tp->coord.east_west > 90.0 ) ||
+          ( tp2->coord.east_west > 90.0 && tp->coord.east_west < -90.0 )) ) {
+      useoldvals = FALSE;
+      continue;
+    }
+
+    const gboolean same_zone = !utm || tp->coord.utm_zone == zone;
+    const gboolean in = same_zone &&
+      tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&
+      tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2;
+    // Lines are drawn when either end is in view
+    if ( !in && (!useoldvals || tp->newsegment) ) {
+      useoldvals = FALSE;
+      continue;
+    }
+    if ( !same_zone ) {
+      // Mark where the track goes off into another zone
+      vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &x, &y );
+      draw_utm_skip_insignia ( dp->vp, main_gc, x, y, &main_gcolor, lt );
+      useoldvals = FALSE;
+      continue;
+    }
+
+    if ( chunk_projected ) {
+      x = chunk_x[index % VIK_TRACK_CHUNK_SIZE];
+      y = chunk_y[index % VIK_TRACK_CHUNK_SIZE];
+    }
+    else
+      vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+
+    // If points are the same in display coordinates, don't draw
+    if ( useoldvals && x == oldx && y == oldy )
+      continue;
+
+    if ( by_speed ) {
+#if GTK_CHECK_VERSION (3,0,0)
+      main_gcolor = track_section_gdkcolour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed );
+#else
+      main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
+#endif
+    }
+
+    if ( !tp->newsegment ) {
+      if ( !useoldvals )
+        vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
+      if ( x != oldx || y != oldy )
+        track_polyline_add ( dp->vp, polyline, main_gc, &main_gcolor, lt, oldx, oldy, x, y );
+    }
+    oldx = x;
+    oldy = y;
+    useoldvals = in;
+  }
+}
+
+/**
+ * Draw just the lines of the track at full detail, when that is all that is wanted,
+ *  with the choice of loop made once for the track rather than for each point
+ *
+ * Returns: FALSE if the full drawing is needed
+ */
+static gboolean trw_layer_draw_track_lines ( struct DrawingParams *dp, VikTrack *track, GdkGC *gc, GdkColor *gcolor, guint lt, gboolean draw_track_outline )
+{
+  // Point based features need the full drawing, as does UTM with several zones in view
+  if ( dp->from || !(dp->lat_lon || dp->one_zone) ||
+       !dp->vtl->drawlines || dp->vtl->drawelevation || dp->vtl->drawdirections ||
+       (dp->vtl->drawpoints && !draw_track_outline) || track == dp->vtl->current_track )
+    return FALSE;
+
+  if ( draw_track_outline ) {
+    gc = dp->vtl->track_bg_gc;
+    gcolor = &dp->vtl->track_bg_color;
+    lt = dp->vtl->line_thickness + dp->vtl->bg_line_thickness;
+  }
+
+  const gboolean by_speed = !draw_track_outline && !dp->highlight && dp->vtl->drawmode == DRAWMODE_BY_SPEED;
+  gdouble average_speed = 0.0, low_speed = 0.0, high_speed = 0.0;
+  if ( by_speed ) {
+    average_speed = vik_track_get_average_speed_moving ( track, dp->vtl->stop_length );
+    low_speed = average_speed - (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
+    high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
+  }
+
+  TrackPolyline polyline;
+  polyline.npoints = 0;
+  if ( dp->lat_lon ) {
+    if ( by_speed )
+      trw_layer_track_lines_add ( dp, track, &polyline, gc, gcolor, lt, FALSE, TRUE, average_speed, low_speed, high_speed );
+    else
+      trw_layer_track_lines_add ( dp, track, &polyline, gc, gcolor, lt, FALSE, FALSE, 0.0, 0.0, 0.0 );
+  }
+  else {
+    if ( by_speed )
+      trw_layer_track_lines_add ( dp, track, &polyline, gc, gcolor, lt, TRUE, TRUE, average_speed, low_speed, high_speed );
+    else
+      trw_layer_track_lines_add ( dp, track, &polyline, gc, gcolor, lt, TRUE, FALSE, 0.0, 0.0, 0.0 );
+  }
+  track_polyline_flush ( dp->vp, &polyline );
+  return TRUE;
+}
+
 static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
 {
   if ( ! track->visible )
     return;
 
   /* TODO: this function is a mess, get rid of any redundancy */
-  GList *list = track->trackpoints;
+  GList *list = dp->from ? dp->from : track->trackpoints;
   gboolean useoldvals = TRUE;
 
   gboolean drawpoints;
@@ -2525,17 +3543,29 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     }
   }
 
+  if ( list && !dp->from && trw_layer_draw_track_simplified ( dp, track, main_gc, &main_gcolor, lt, draw_track_outline ) ) {
+    trw_layer_draw_track_labels ( dp, track, drawing_highlight );
+    return;
+  }
+
+  if ( list && trw_layer_draw_track_lines ( dp, track, main_gc, &main_gcolor, lt, draw_track_outline ) ) {
+    trw_layer_draw_track_labels ( dp, track, drawing_highlight );
+    return;
+  }
+
   if (list) {
     int x, y, oldx, oldy;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
 
     tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+    if ( list == dp->vtl->current_tpl )
+      trw_layer_current_tp_drawn ( dp->vtl, tp );
 
     vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
     // Draw the first point as something a bit different from the normal points
     // ATM it's slightly bigger and a triangle
-    if ( drawpoints ) {
+    if ( drawpoints && !dp->from ) {
       GdkPoint trian[3] = { { x, y-(3*tp_size) }, { x-(2*tp_size), y+(2*tp_size) }, {x+(2*tp_size), y+(2*tp_size)} };
       vik_viewport_draw_polygon ( dp->vp, main_gc, TRUE, trian, 3, &main_gcolor );
     }
@@ -2554,10 +3584,50 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
       high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
     }
 
+    // Parts of the track well out of view can be skipped
+    //  (UTM with multiple zones only by their zones and bounds, as what's left is all drawn)
+    //  (not when only drawing the end, as the chunks are counted from the start)
+    const GArray *chunks = NULL;
+    if ( !dp->from )
+      chunks = vik_track_get_chunks ( track );
+    guint index = 0;
+    // Screen positions of the points in the current chunk (when in view)
+    const VikCoord *chunk_coords[VIK_TRACK_CHUNK_SIZE];
+    gint chunk_x[VIK_TRACK_CHUNK_SIZE], chunk_y[VIK_TRACK_CHUNK_SIZE];
+    gboolean chunk_projected = FALSE;
+
+    // When nothing is drawn in between, the lines (e.g. colour by speed) are joined up into as few strokes as possible
+    gboolean join_lines = !drawpoints && !dp->vtl->drawelevation && !dp->vtl->drawdirections;
+    TrackPolyline polyline;
+    polyline.npoints = 0;
+
     while ((list = g_list_next(list)))
     {
+      index++;
+      // Still process the first point of each chunk, so lines into and out of view are drawn
+      if ( chunks && index % VIK_TRACK_CHUNK_SIZE == 1 ) {
+        const VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, index / VIK_TRACK_CHUNK_SIZE );
+        if ( chunk->first != chunk->last && trw_layer_chunk_out_of_view ( dp, chunk ) ) {
+          list = chunk->last;
+          index += VIK_TRACK_CHUNK_SIZE - 2;
+          useoldvals = FALSE;
+          chunk_projected = FALSE;
+          continue;
+        }
+        // Each point is converted just once, straight to its position relative to the zone of the view
+        guint nn = 0;
+        for ( GList *iter = chunk->first; iter != chunk->last->next; iter = iter->next )
+          chunk_coords[nn++] = &(VIK_TRACKPOINT(iter->data)->coord);
+        vik_viewport_projection_coords_to_screen ( dp->proj, chunk_coords, nn, chunk_x, chunk_y );
+        chunk_projected = TRUE;
+      }
+      else if ( index % VIK_TRACK_CHUNK_SIZE == 0 )
+        chunk_projected = FALSE;
+
       tp = VIK_TRACKPOINT(list->data);
       tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+      if ( list == dp->vtl->current_tpl )
+        trw_layer_current_tp_drawn ( dp->vtl, tp );
 
       VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
       // See if in a different lat/lon 'quadrant' so don't draw massively long lines (presumably wrong way around the Earth)
@@ -2575,7 +3645,12 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
              tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&  /* both UTM and lat lon */
              tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2 ) )
       {
-        vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+        if ( chunk_projected ) {
+          x = chunk_x[index % VIK_TRACK_CHUNK_SIZE];
+          y = chunk_y[index % VIK_TRACK_CHUNK_SIZE];
+        }
+        else
+          vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
 	/*
 	 * If points are the same in display coordinates, don't draw.
@@ -2604,7 +3679,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         if ( drawpoints && ! draw_track_outline )
         {
 
-          if ( list->next ) {
+          // The end of a track being extended moves on, so it is not marked differently
+          if ( list->next || track == dp->vtl->live_track ) {
 	    /*
 	     * The concept of drawing stops is that a trackpoint
 	     * that is if the next trackpoint has a timestamp far into
@@ -2613,7 +3689,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	     * This is drawn first so the trackpoint will be drawn on top
 	     */
             /* stops */
-            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length )
+            if ( drawstops && list->next && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length )
 	      /* Stop point.  Draw 6x circle. Always in redish colour */
               vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64, NULL );
 
@@ -2635,7 +3711,13 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           if (!useoldvals)
             vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
 
-          if ( draw_track_outline ) {
+          if ( join_lines ) {
+            if ( draw_track_outline )
+              track_polyline_add ( dp->vp, &polyline, dp->vtl->track_bg_gc, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness, oldx, oldy, x, y );
+            else
+              track_polyline_add ( dp->vp, &polyline, main_gc, &main_gcolor, lt, oldx, oldy, x, y );
+          }
+          else if ( draw_track_outline ) {
             vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness );
           }
           else {
@@ -2704,16 +3786,32 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         {
           if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
-            vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+            if ( chunk_projected ) {
+              x = chunk_x[index % VIK_TRACK_CHUNK_SIZE];
+              y = chunk_y[index % VIK_TRACK_CHUNK_SIZE];
+            }
+            else
+              vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
             if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
+#if GTK_CHECK_VERSION (3,0,0)
+              main_gcolor = track_section_gdkcolour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed );
+#else
               main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
+#endif
 	    }
 
 	    /*
 	     * If points are the same in display coordinates, don't draw.
 	     */
-	    if ( x != oldx || y != oldy )
+	    if ( join_lines && ( x != oldx || y != oldy ) )
+	      {
+		if ( draw_track_outline )
+		  track_polyline_add ( dp->vp, &polyline, dp->vtl->track_bg_gc, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness, oldx, oldy, x, y );
+		else
+		  track_polyline_add ( dp->vp, &polyline, main_gc, &main_gcolor, lt, oldx, oldy, x, y );
+	      }
+	    else if ( x != oldx || y != oldy )
 	      {
 		if ( draw_track_outline )
 		  vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness );
@@ -2736,18 +3834,10 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = FALSE;
       }
     }
+    track_polyline_flush ( dp->vp, &polyline );
 
-    // Labels drawn after the trackpoints, so the labels are on top
-    if ( dp->vtl->track_draw_labels ) {
-      if ( track->max_number_dist_labels > 0 ) {
-        trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
-      }
-      trw_layer_draw_point_names (dp, track, drawing_highlight );
-
-      if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
-        trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
-      }
-    }
+    if ( !dp->from )
+      trw_layer_draw_track_labels ( dp, track, drawing_highlight );
   }
 
 #if GTK_CHECK_VERSION (3,0,0)
@@ -2756,17 +3846,98 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 #endif
 }
 
+// Packed tracks are unpacked when drawn (or otherwise needed), and packed again once not drawn for this many draws
+#define TRW_COMPACT_IDLE_DRAWS 16
+
+static void trw_layer_track_unpack ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  if ( !trk->packed )
+    return;
+  vik_track_unpack ( trk );
+  vtl->packed_tracks--;
+  if ( vtl->compact_drawn )
+    g_hash_table_insert ( vtl->compact_drawn, trk, GUINT_TO_POINTER(vtl->compact_draws) );
+}
+
+static void trw_layer_track_unpack_cb ( const gpointer id, VikTrack *trk, VikTrwLayer *vtl )
+{
+  trw_layer_track_unpack ( vtl, trk );
+}
+
+/**
+ * Bring back all the trackpoints, as something else than drawing wants to use them
+ */
+static void trw_ensure_unpacked ( VikTrwLayer *vtl )
+{
+  if ( !vtl->packed_tracks )
+    return;
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_track_unpack_cb, vtl );
+  g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_track_unpack_cb, vtl );
+}
+
+/**
+ * Leave alone tracks being worked on, or held elsewhere (e.g. in the undo journal)
+ */
+static gboolean trw_layer_track_packable ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  return !( trk->packed || trk->ref_count > 1 || trk->property_dialog ||
+            trk == vtl->current_track || trk == vtl->current_tp_track ||
+            trk == vtl->live_track || trk == vtl->route_finder_added_track );
+}
+
+static void trw_layer_track_pack_cb ( const gpointer id, VikTrack *trk, VikTrwLayer *vtl )
+{
+  if ( !trw_layer_track_packable ( vtl, trk ) )
+    return;
+  gpointer drawn;
+  if ( g_hash_table_lookup_extended ( vtl->compact_drawn, trk, NULL, &drawn ) &&
+       vtl->compact_draws - GPOINTER_TO_UINT(drawn) < TRW_COMPACT_IDLE_DRAWS )
+    return;
+  if ( vik_track_pack ( trk ) ) {
+    vtl->packed_tracks++;
+    g_hash_table_remove ( vtl->compact_drawn, trk );
+  }
+}
+
+static gboolean trw_layer_compact_drawn_expired ( gpointer key, gpointer value, VikTrwLayer *vtl )
+{
+  return vtl->compact_draws - GPOINTER_TO_UINT(value) >= TRW_COMPACT_IDLE_DRAWS;
+}
+
+/**
+ * Pack the tracks that have not been drawn recently
+ */
+static void trw_layer_compact_tracks ( VikTrwLayer *vtl )
+{
+  // Only looked through now and then
+  if ( ++vtl->compact_draws % TRW_COMPACT_IDLE_DRAWS )
+    return;
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_track_pack_cb, vtl );
+  g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_track_pack_cb, vtl );
+  // Also forgets any tracks since deleted
+  g_hash_table_foreach_remove ( vtl->compact_drawn, (GHRFunc) trw_layer_compact_drawn_expired, vtl );
+}
+
 static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct DrawingParams *dp )
 {
-  if ( BBOX_INTERSECT ( track->bbox, dp->bbox ) ) {
+  if ( track->visible && BBOX_INTERSECT ( track->bbox, dp->bbox ) ) {
+    trw_layer_track_unpack ( dp->vtl, track );
+    // Across several UTM zones, tracks only in zones out of view are passed over
+    gchar zone_min, zone_max;
+    if ( !dp->one_zone && !dp->lat_lon && vik_track_get_utm_zones ( track, &zone_min, &zone_max ) &&
+         ( zone_max < dp->zone_min || zone_min > dp->zone_max ) )
+      return;
+    if ( dp->vtl->compact_drawn )
+      g_hash_table_insert ( dp->vtl->compact_drawn, track, GUINT_TO_POINTER(dp->vtl->compact_draws) );
     trw_layer_draw_track ( id, track, dp, FALSE );
   }
 }
 
-static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
+static void trw_layer_draw_waypoint_item ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( wp->visible )
-  if ( (!dp->one_zone && !dp->lat_lon) || ( ( dp->lat_lon || wp->coord.utm_zone == dp->center->utm_zone ) &&
+  if ( (!dp->one_zone && !dp->lat_lon && wp->coord.utm_zone >= dp->zone_min && wp->coord.utm_zone <= dp->zone_max) ||
+       ( ( dp->lat_lon || wp->coord.utm_zone == dp->center->utm_zone ) &&
              wp->coord.east_west < dp->ce2 && wp->coord.east_west > dp->ce1 &&
              wp->coord.north_south > dp->cn1 && wp->coord.north_south < dp->cn2 ) )
   {
@@ -2780,11 +3951,14 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
       if ( dp->vtl->image_alpha == 0)
         return;
 
-      GdkPixbuf *pixbuf = g_hash_table_lookup ( dp->vtl->image_cache, wp->image );
+      GdkPixbuf *pixbuf = a_thumbnails_cache_get ( wp->image, dp->vtl->image_size, dp->vtl->image_alpha );
       if ( !pixbuf )
       {
         gchar *image = wp->image;
-        GdkPixbuf *regularthumb = a_thumbnails_get ( wp->image );
+        GdkPixbuf *regularthumb = NULL;
+        // Generated in the background if necessary, which then redraws the layer
+        if ( a_thumbnails_request ( wp->image, VIK_LAYER(dp->vtl) ) )
+          regularthumb = a_thumbnails_get ( wp->image );
         if ( ! regularthumb )
         {
           regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
@@ -2804,17 +3978,8 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
           if ( dp->vtl->image_alpha != 255 )
             pixbuf = ui_pixbuf_set_alpha ( pixbuf, dp->vtl->image_alpha );
 
-          /* needed so 'click picture' tool knows how big the pic is; we don't
-           * store it in the cache because they may have been freed already. */
-          wp->image_width = gdk_pixbuf_get_width ( pixbuf );
-          wp->image_height = gdk_pixbuf_get_height ( pixbuf );
-
-          if ( g_hash_table_size(dp->vtl->image_cache) < dp->vtl->image_cache_size )
-            g_hash_table_insert ( dp->vtl->image_cache, image, pixbuf );
-        }
-        else
-        {
-          pixbuf = a_thumbnails_get_default (); /* thumbnail not yet loaded */
+          if ( pixbuf )
+            a_thumbnails_cache_add ( image, dp->vtl->image_size, dp->vtl->image_alpha, pixbuf );
         }
       }
       if ( pixbuf )
@@ -2823,6 +3988,11 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
         w = gdk_pixbuf_get_width ( pixbuf );
         h = gdk_pixbuf_get_height ( pixbuf );
 
+        /* needed so 'click picture' tool knows how big the pic is; we don't
+         * store it in the cache because they may have been freed already. */
+        wp->image_width = w;
+        wp->image_height = h;
+
         if ( x+(w/2) > 0 && y+(h/2) > 0 && x-(w/2) < dp->width && y-(h/2) < dp->height ) /* always draw within boundaries */
         {
           if ( dp->highlight ) {
@@ -2837,10 +4007,24 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
 
           vik_viewport_draw_pixbuf ( dp->vp, pixbuf, 0, 0, x - (w/2), y - (h/2), w, h );
         }
+        g_object_unref ( pixbuf );
         return; /* if failed to draw picture, default to drawing regular waypoint (below) */
       }
     }
 
+    // Leave out waypoints on top of others
+    if ( dp->label_grid && dp->vtl->wp_declutter == DECLUTTER_SYMBOLS ) {
+      gint hw, hh;
+      if ( dp->vtl->wp_draw_symbols && wp->symbol && wp->symbol_pixbuf ) {
+        hw = gdk_pixbuf_get_width ( wp->symbol_pixbuf ) / 2;
+        hh = gdk_pixbuf_get_height ( wp->symbol_pixbuf ) / 2;
+      }
+      else
+        hw = hh = ( wp == dp->vtl->current_wp ) ? dp->vtl->wp_size : dp->vtl->wp_size/2;
+      if ( !trw_layer_label_place ( dp, x - hw, y - hh, 2*hw + 1, 2*hh + 1, wp == dp->vtl->current_wp ) )
+        return;
+    }
+
     // Proximity drawing - only in LATLON mode ATM
     if ( dp->vtl->wp_draw_proximity && !isnan(wp->proximity) && dp->vtl->coord_mode == VIK_COORD_LATLON ) {
       struct LatLon ll, ll2;
@@ -2892,31 +4076,25 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
       }
     }
 
-    if ( dp->vtl->drawlabels && !wp->hide_name )
+    if ( dp->vtl->drawlabels && !wp->hide_name && wp->name &&
+         ( wp == dp->vtl->current_wp || !trw_layer_label_grid_full ( dp ) ) )
     {
       /* thanks to the GPSDrive people (Fritz Ganter et al.) for hints on this part ... yah, I'm too lazy to study documentation */
       gint label_x, label_y;
-      gint width, height;
-      // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
-
-      // Could this stored in the waypoint rather than recreating each pass?
-      gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", dp->vtl->wp_fsize_str, wp->name );
-
-      if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-        pango_layout_set_markup ( dp->vtl->wplabellayout, wp_label_markup, -1 );
-      else
-        // Fallback if parse failure
-        pango_layout_set_text ( dp->vtl->wplabellayout, wp->name, -1 );
-
-      g_free ( wp_label_markup );
-
-      pango_layout_get_pixel_size ( dp->vtl->wplabellayout, &width, &height );
+      // The label is only laid out when first drawn (or the name has changed)
+      TrwLabel *label = trw_layer_get_label ( dp->vtl->wp_labels, wp->name, dp->vtl->wplabellayout, trw_layer_wp_label_markup, dp, wp->name );
+      gint width = label->width;
+      gint height = label->height;
       label_x = x - width/2;
       if ( wp->symbol_pixbuf )
         label_y = y - height - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
       else
         label_y = y - dp->vtl->wp_size - height - 2;
 
+      // Including the background
+      if ( !trw_layer_label_place ( dp, label_x-1, label_y-1, width+2, height+2, wp == dp->vtl->current_wp ) )
+        return;
+
       // Cater for 'longer' waypoint names, to ensure background is always shown correctly
       //  as otherwise vik_viewport_draw_rectangle() will not draw it if too big -ve offset
       //  hence perform adjustment here, including reducing the width as necessary
@@ -2953,11 +4131,36 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
           vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, &dp->vtl->waypoint_bg_color );
         }
       }
-      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, dp->vtl->wplabellayout, &dp->vtl->waypoint_text_color );
+      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, label->layout, &dp->vtl->waypoint_text_color );
     }
   }
 }
 
+static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
+{
+  if ( wp != dp->vtl->current_wp ) {
+    trw_layer_draw_waypoint_item ( id, wp, dp );
+    return;
+  }
+
+  // Remember what the current waypoint covers, in case it gets moved
+  GdkRectangle area;
+  vik_viewport_extents_begin ( dp->vp );
+  trw_layer_draw_waypoint_item ( id, wp, dp );
+  if ( vik_viewport_extents_end ( dp->vp, &area ) ) {
+    gint x, y;
+    vik_viewport_coord_to_screen ( dp->vp, &(wp->coord), &x, &y );
+    // Accumulate drawings in the same place (e.g. the highlight drawn on top)
+    if ( dp->vtl->current_wp_drawn == wp && x == dp->vtl->current_wp_drawn_x && y == dp->vtl->current_wp_drawn_y )
+      gdk_rectangle_union ( &dp->vtl->current_wp_extents, &area, &dp->vtl->current_wp_extents );
+    else
+      dp->vtl->current_wp_extents = area;
+    dp->vtl->current_wp_drawn = wp;
+    dp->vtl->current_wp_drawn_x = x;
+    dp->vtl->current_wp_drawn_y = y;
+  }
+}
+
 static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( BBOX_INTERSECT ( dp->vtl->waypoints_bbox, dp->bbox ) ) {
@@ -2965,25 +4168,136 @@ static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct Dr
   }
 }
 
+static gchar *trw_layer_cluster_label_markup ( struct DrawingParams *dp, const gchar *count )
+{
+  return g_strdup_printf ( "<span size=\"%s\" weight=\"bold\">%s</span>", dp->vtl->wp_fsize_str, count );
+}
+
+/**
+ * Draw the number of waypoints in an area as a badge at their average position,
+ *  or the waypoint itself when it's the only one
+ */
+static void trw_layer_draw_waypoint_cluster ( const VikPointCluster *cluster, struct DrawingParams *dp )
+{
+  if ( cluster->count == 1 ) {
+    trw_layer_foreach_in_bbox ( dp->vtl, dp->vtl->waypoints, cluster->cell, (GHFunc) trw_layer_draw_waypoint_cb, dp );
+    return;
+  }
+
+  VikCoord coord;
+  gint x, y;
+  vik_coord_load_from_latlon ( &coord, dp->vtl->coord_mode, &cluster->centre );
+  vik_viewport_coord_to_screen ( dp->vp, &coord, &x, &y );
+
+  gchar count[16];
+  g_snprintf ( count, sizeof(count), "%u", cluster->count );
+  TrwLabel *label = trw_layer_get_label ( dp->vtl->cluster_labels, count, dp->vtl->wplabellayout, trw_layer_cluster_label_markup, dp, count );
+  gint rr = MAX ( dp->vtl->wp_size, MAX(label->width, label->height)/2 + 3 );
+  // Labels of waypoints drawn after (e.g. the selected one) keep clear of it
+  (void)trw_layer_label_place ( dp, x - rr, y - rr, 2*rr, 2*rr, TRUE );
+
+  GdkColor outline = dp->highlight ? vik_viewport_get_highlight_gdkcolor(dp->vp) : dp->vtl->waypoint_color;
+  vik_viewport_draw_arc ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, x - rr, y - rr, 2*rr, 2*rr, 0, 360*64, &dp->vtl->waypoint_bg_color );
+  vik_viewport_draw_arc ( dp->vp, dp->vtl->waypoint_gc, FALSE, x - rr, y - rr, 2*rr, 2*rr, 0, 360*64, &outline );
+  vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, x - label->width/2, y - label->height/2, label->layout, &dp->vtl->waypoint_text_color );
+}
+
+/**
+ * trw_layer_draw_waypoint_clusters:
+ *
+ * Returns: FALSE if zoomed in enough for the waypoints to be drawn individually
+ */
+static gboolean trw_layer_draw_waypoint_clusters ( VikTrwLayer *vtl, struct DrawingParams *dp )
+{
+  gdouble cell_size = (dp->bbox.east - dp->bbox.west) / MAX(1, dp->width) * TRW_CLUSTER_PIXELS;
+  VikPointClusters *pc = trw_layer_get_waypoint_clusters ( vtl );
+  gint level = vik_point_clusters_get_level ( pc, cell_size );
+  if ( level < 0 )
+    return FALSE;
+
+  vik_point_clusters_query ( pc, level, dp->bbox, (VikPointClusterFunc) trw_layer_draw_waypoint_cluster, dp );
+  // Always show the selected waypoint
+  if ( vtl->current_wp )
+    trw_layer_draw_waypoint_cb ( NULL, vtl->current_wp, dp );
+  return TRUE;
+}
+
+/**
+ * Show the lines and points that a simplification would keep, over the track itself
+ */
+static void trw_layer_draw_simplify_preview ( struct DrawingParams *dp )
+{
+  GPtrArray *tps = dp->vtl->simplify_preview;
+  GdkGC *gc = vik_viewport_get_gc_highlight ( dp->vp );
+  GdkColor color = vik_viewport_get_highlight_gdkcolor ( dp->vp );
+  gint size = MAX ( 2, dp->vtl->drawpoints_size );
+  gint ox = 0, oy = 0;
+  gboolean have_old = FALSE;
+  for ( guint ii = 0; ii < tps->len; ii++ ) {
+    VikTrackpoint *tp = g_ptr_array_index ( tps, ii );
+    gint x, y;
+    vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+    if ( x == VIK_VIEWPORT_UTM_WRONG_ZONE ) {
+      have_old = FALSE;
+      continue;
+    }
+    if ( have_old && !tp->newsegment )
+      vik_viewport_draw_line ( dp->vp, gc, ox, oy, x, y, &color, dp->vtl->line_thickness );
+    vik_viewport_draw_rectangle ( dp->vp, gc, TRUE, x-size, y-size, 2*size, 2*size, &color );
+    ox = x;
+    oy = y;
+    have_old = TRUE;
+  }
+}
+
 static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gboolean highlight )
 {
   static struct DrawingParams dp;
   g_assert ( l != NULL );
 
   init_drawing_params ( &dp, l, vvp, highlight );
-
-  if ( l->tracks_visible )
-    g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
+  if ( l->wp_declutter != DECLUTTER_OFF )
+    trw_layer_label_grid_new ( &dp );
+
+  if ( l->tracks_visible ) {
+    gdouble start, end;
+    if ( vik_viewport_get_time_filter ( vvp, &start, &end ) ) {
+      // Fewer tracks are in a period than in view, so look them up by time and let each check its bounds
+      GList *spans = trw_layer_time_spans ( l, start, end );
+      for ( GList *iter = spans; iter; iter = iter->next ) {
+        TrwTimeSpan *span = iter->data;
+        trw_layer_draw_track_cb ( span->id, span->trk, &dp );
+      }
+      g_list_free ( spans );
+    }
+    else
+      trw_layer_foreach_in_bbox ( l, l->tracks, dp.bbox, (GHFunc) trw_layer_draw_track_cb, &dp );
+  }
 
   if ( l->routes_visible )
-    g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
+    trw_layer_foreach_in_bbox ( l, l->routes, dp.bbox, (GHFunc) trw_layer_draw_track_cb, &dp );
+
+  if ( l->waypoints_visible && BBOX_INTERSECT ( l->waypoints_bbox, dp.bbox ) )
+    if ( !l->wp_cluster || !trw_layer_draw_waypoint_clusters ( l, &dp ) )
+      trw_layer_foreach_in_bbox ( l, l->waypoints, dp.lenient_bbox, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+
+  trw_layer_label_grid_free ( &dp );
+
+  if ( l->simplify_preview )
+    trw_layer_draw_simplify_preview ( &dp );
 
-  if (l->waypoints_visible)
-    g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  if ( l->track_compact )
+    trw_layer_compact_tracks ( l );
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
 {
+  // No need to read in the contents until some of it could be seen
+  if ( l->deferred ) {
+    LatLonBBox bbox = vik_viewport_get_bbox ( vvp );
+    if ( !BBOX_INTERSECT ( a_binfile_deferred_get_bounds(l->deferred)->bbox, bbox ) )
+      return;
+  }
   trw_ensure_layer_loaded ( l );
   // If this layer is to be highlighted - then don't draw now - as it will be drawn later on in the specific highlight draw stage
   // This may seem slightly inefficient to test each time for every layer
@@ -2991,7 +4305,23 @@ static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
   if ( vik_viewport_get_draw_highlight ( vvp ) &&
        vik_window_get_selected_trw_layer ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER((VikLayer*)l)) == l )
     return;
-  trw_layer_draw_with_highlight ( l, vvp, FALSE );
+
+  if ( !trw_layer_draw_cache_enabled() && !l->draw_cache_wanted ) {
+    trw_layer_draw_with_highlight ( l, vvp, FALSE );
+    return;
+  }
+
+  if ( !l->draw_cache )
+    l->draw_cache = vik_viewport_cache_new ();
+  // Any track may have been edited
+  gint bounds = vik_track_get_bounds_changes ();
+  if ( bounds != l->draw_cache_bounds ) {
+    trw_layer_draw_cache_invalidate ( l );
+    l->draw_cache_bounds = bounds;
+  }
+  if ( vik_viewport_cache_begin ( vvp, l->draw_cache ) )
+    trw_layer_draw_with_highlight ( l, vvp, FALSE );
+  vik_viewport_cache_end ( vvp, l->draw_cache );
 }
 
 void vik_trw_layer_draw_highlight ( VikTrwLayer *vtl, VikViewport *vvp )
@@ -3079,6 +4409,30 @@ static void trw_layer_configure ( VikTrwLayer *vtl, VikViewport *vvp )
   trw_layer_create_other_gcs ( vtl, vvp );
 }
 
+typedef struct {
+  struct DrawingParams *dp;
+  GdkColor color;
+  TrackPolyline polyline;
+} TrwHighlightBatch;
+
+/**
+ * Highlighting only needs the line of a track in the one colour,
+ *  so the lines of all the tracks go together in as few strokes as possible using the simplified geometry.
+ * Points, labels and so on were already drawn by the normal drawing.
+ */
+static void trw_layer_draw_highlight_track_cb ( const gpointer id, VikTrack *track, TrwHighlightBatch *hb )
+{
+  struct DrawingParams *dp = hb->dp;
+  if ( !track->visible || !BBOX_INTERSECT ( track->bbox, dp->bbox ) )
+    return;
+  trw_layer_track_unpack ( dp->vtl, track );
+  if ( dp->lat_lon && dp->vtl->drawlines && track != dp->vtl->current_track &&
+       trw_layer_track_simplified_add ( dp, track, &hb->polyline, vik_viewport_get_gc_highlight(dp->vp), &hb->color, dp->vtl->line_thickness ) )
+    return;
+  track_polyline_flush ( dp->vp, &hb->polyline );
+  trw_layer_draw_track ( id, track, dp, FALSE );
+}
+
 /**
  * vik_trw_layer_draw_highlight_items:
  *
@@ -3098,8 +4452,18 @@ void vik_trw_layer_draw_highlight_items ( VikTrwLayer *vtl, GHashTable *trks, GH
   if ( trks ) {
     gboolean is_routes = (trks == vtl->routes);
     gboolean draw = ( is_routes && vtl->routes_visible ) || ( !is_routes && vtl->tracks_visible );
-    if ( draw )
-      g_hash_table_foreach ( trks, (GHFunc) trw_layer_draw_track_cb, &dp );
+    if ( draw ) {
+      TrwHighlightBatch hb;
+      hb.dp = &dp;
+      hb.color = vik_viewport_get_highlight_gdkcolor ( vvp );
+      hb.polyline.npoints = 0;
+      // All of them is the usual case, when only those in view need looking at
+      if ( trks == vtl->tracks || trks == vtl->routes )
+        trw_layer_foreach_in_bbox ( vtl, trks, dp.bbox, (GHFunc) trw_layer_draw_highlight_track_cb, &hb );
+      else
+        g_hash_table_foreach ( trks, (GHFunc) trw_layer_draw_highlight_track_cb, &hb );
+      track_polyline_flush ( vvp, &hb.polyline );
+    }
   }
 
   if ( vtl->waypoints_visible && wpts )
@@ -3200,6 +4564,10 @@ static VikTrwLayer* trw_layer_create ( VikViewport *vp )
   rv->tracklabellayout = gtk_widget_create_pango_layout (GTK_WIDGET(vp), NULL);
   pango_layout_set_font_description (rv->tracklabellayout, gtk_widget_get_style(GTK_WIDGET(vp))->font_desc);
 
+  rv->wp_labels = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)trw_label_free );
+  rv->track_labels = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)trw_label_free );
+  rv->cluster_labels = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)trw_label_free );
+
   trw_layer_edit_track_gcs ( rv, vp );
   trw_layer_create_other_gcs ( rv, vp );
 
@@ -3223,7 +4591,7 @@ static VikTrwLayer* trw_layer_create ( VikViewport *vp )
 /*
  * Can accept a null symbol, and may return null value
  */
-GdkPixbuf* get_wp_sym_small ( gchar *symbol )
+GdkPixbuf* get_wp_sym_small ( const gchar *symbol )
 {
   GdkPixbuf* wp_icon = a_get_wp_sym (symbol);
   // ATM a_get_wp_sym returns a cached icon, with the size dependent on the preferences.
@@ -3233,50 +4601,55 @@ GdkPixbuf* get_wp_sym_small ( gchar *symbol )
   return wp_icon;
 }
 
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, menu_array_realize pass_along )
-{
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
-
-  GdkPixbuf *pixbuf = NULL;
-
-  if ( track->has_color )
-    pixbuf = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
-
-  gdouble timestamp = 0;
-  VikTrackpoint *tpt = vik_track_get_tp_first(track);
-  if ( tpt && !isnan(tpt->timestamp) )
-    timestamp = tpt->timestamp;
-
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], track->name, pass_along[2], id, GPOINTER_TO_INT (pass_along[4]), pixbuf, TRUE, timestamp, track->number );
-
-  if ( pixbuf )
-    g_object_unref (pixbuf);
-
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  if ( track->is_route )
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->routes_iters, id, new_iter );
-  else
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->tracks_iters, id, new_iter );
-
-  if ( ! track->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
-}
-
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, menu_array_realize pass_along )
+/**
+ * Add all the tracks, routes or waypoints to the treeview in one go
+ */
+static void trw_layer_realize_items ( VikTrwLayer *vtl, VikTreeview *vt, GHashTable *items, GtkTreeIter *parent_iter, GHashTable *iters, gint subtype, vik_layer_sort_order_t order )
 {
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+  guint count = g_hash_table_size ( items );
+  VikTreeviewSublayer *sublayers = g_new0 ( VikTreeviewSublayer, count );
 
-  gdouble timestamp = 0;
-  if ( !isnan(wp->timestamp) )
-    timestamp = wp->timestamp;
-
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], wp->name, pass_along[2], id, GPOINTER_TO_UINT (pass_along[4]), get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+  GHashTableIter hiter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &hiter, items );
+  while ( g_hash_table_iter_next ( &hiter, &key, &value ) ) {
+    VikTreeviewSublayer *sl = &sublayers[ii++];
+    sl->item = key;
+    if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
+      VikWaypoint *wp = VIK_WAYPOINT(value);
+      sl->name = wp->name;
+      sl->icon = get_wp_sym_small ( wp->symbol );
+      sl->visible = wp->visible;
+      if ( !isnan(wp->timestamp) )
+        sl->timestamp = wp->timestamp;
+    }
+    else {
+      VikTrack *track = VIK_TRACK(value);
+      sl->name = track->name;
+      if ( track->has_color )
+        sl->icon = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+      sl->visible = track->visible;
+      gdouble first, last;
+      if ( track->packed && vik_track_get_time_span ( track, &first, &last ) )
+        sl->timestamp = first;
+      VikTrackpoint *tpt = vik_track_get_tp_first(track);
+      if ( tpt && !isnan(tpt->timestamp) )
+        sl->timestamp = tpt->timestamp;
+      sl->number = track->number;
+    }
+  }
 
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->waypoints_iters, id, new_iter );
+  vik_treeview_add_sublayers ( vt, parent_iter, vtl, subtype, TRUE, sublayers, count, order );
 
-  if ( ! wp->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
+  for ( ii = 0; ii < count; ii++ ) {
+    GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+    *new_iter = sublayers[ii].iter;
+    g_hash_table_insert ( iters, sublayers[ii].item, new_iter );
+    if ( subtype != VIK_TRW_LAYER_SUBLAYER_WAYPOINT && sublayers[ii].icon )
+      g_object_unref ( sublayers[ii].icon );
+  }
+  g_free ( sublayers );
 }
 
 static void trw_layer_add_sublayer_tracks ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
@@ -3296,43 +4669,27 @@ static void trw_layer_add_sublayer_routes ( VikTrwLayer *vtl, VikTreeview *vt, G
 
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
 {
-  GtkTreeIter iter2;
-  menu_array_realize pass_along = { &(vtl->tracks_iter), &iter2, vtl, vt, GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_TRACK) };
-
+  // Items are added already sorted, so no need to sort afterwards
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     trw_layer_add_sublayer_tracks ( vtl, vt , layer_iter );
-
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_track, pass_along );
-
+    trw_layer_realize_items ( vtl, vt, vtl->tracks, &(vtl->tracks_iter), vtl->tracks_iters, VIK_TRW_LAYER_SUBLAYER_TRACK, vtl->track_sort_order );
     vik_treeview_item_set_visible ( vt, &(vtl->tracks_iter), vtl->tracks_visible );
   }
 
   if ( g_hash_table_size (vtl->routes) > 0 ) {
     trw_layer_add_sublayer_routes ( vtl, vt, layer_iter );
-
-    pass_along[0] = &(vtl->routes_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_ROUTE);
-
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_track, pass_along );
-
-    vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->routes_iter), vtl->routes_visible );
+    trw_layer_realize_items ( vtl, vt, vtl->routes, &(vtl->routes_iter), vtl->routes_iters, VIK_TRW_LAYER_SUBLAYER_ROUTE, vtl->track_sort_order );
+    vik_treeview_item_set_visible ( vt, &(vtl->routes_iter), vtl->routes_visible );
   }
 
   if ( g_hash_table_size (vtl->waypoints) > 0 ) {
     trw_layer_add_sublayer_waypoints ( vtl, vt, layer_iter );
-
-    pass_along[0] = &(vtl->waypoints_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_WAYPOINT);
-
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_waypoint, pass_along );
-
-    vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->waypoints_iter), vtl->waypoints_visible );
+    trw_layer_realize_items ( vtl, vt, vtl->waypoints, &(vtl->waypoints_iter), vtl->waypoints_iters, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, vtl->wp_sort_order );
+    vik_treeview_item_set_visible ( vt, &(vtl->waypoints_iter), vtl->waypoints_visible );
   }
 
   trw_layer_verify_thumbnails ( vtl );
 
-  trw_layer_sort_all ( vtl );
-
   trw_update_layer_icon ( vtl );
 }
 
@@ -3358,6 +4715,7 @@ static gboolean trw_layer_sublayer_toggle_visible ( VikTrwLayer *l, gint subtype
 {
   gboolean answer = TRUE;
   VikTrack *t = NULL;
+  trw_layer_draw_cache_invalidate ( l );
   switch ( subtype )
   {
     case VIK_TRW_LAYER_SUBLAYER_TRACKS: answer = (l->tracks_visible ^= 1); break;
@@ -3397,6 +4755,8 @@ static gboolean trw_layer_sublayer_toggle_visible ( VikTrwLayer *l, gint subtype
 
 static void trw_layer_layer_toggle_visible ( VikTrwLayer *vtl )
 {
+  // Changes made while hidden would not have been seen
+  trw_layer_draw_cache_invalidate ( vtl );
   // Is it no longer visible?
   if ( !VIK_LAYER(vtl)->visible )
     close_graphs_of_specific_track_or_type ( vtl, NULL, -1 );
@@ -3511,6 +4871,8 @@ static gchar* trw_layer_lap_string ( VikTrwLayer *vtl )
  */
 static const gchar* trw_layer_layer_tooltip ( VikTrwLayer *vtl )
 {
+  trw_ensure_deferred_loaded ( vtl );
+  trw_ensure_unpacked ( vtl );
   gchar tbuf1[64];
   gchar tbuf2[64];
   gchar tbuf3[64];
@@ -3703,6 +5065,7 @@ static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, g
         tr = g_hash_table_lookup ( l->routes, sublayer );
 
       if ( tr ) {
+        trw_layer_track_unpack ( l, tr );
 
         // When only 1 track - show (layer) lap information
         //  since it must apply to this track
@@ -3920,6 +5283,7 @@ static void maybe_show_graph ( VikWindow *vw, VikTrwLayer *vtl, gpointer gw )
 static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer sublayer, gint type, gpointer vlp )
 {
   trw_ensure_layer_loaded ( l );
+  trw_ensure_unpacked ( l );
 
   // Reset
   l->current_wp    = NULL;
@@ -4013,16 +5377,32 @@ static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer subl
 
 GHashTable *vik_trw_layer_get_tracks ( VikTrwLayer *l )
 {
+  trw_ensure_deferred_loaded ( l );
+  trw_ensure_unpacked ( l );
   return l->tracks;
 }
 
+/**
+ * vik_trw_layer_get_tracks_changes:
+ *
+ * Returns: A count that changes whenever a track is added to or removed from the layer,
+ *  so a copy of the tracks can be checked to still be valid without going through them
+ */
+guint vik_trw_layer_get_tracks_changes ( VikTrwLayer *vtl )
+{
+  return vtl->tracks_changes;
+}
+
 GHashTable *vik_trw_layer_get_routes ( VikTrwLayer *l )
 {
+  trw_ensure_deferred_loaded ( l );
+  trw_ensure_unpacked ( l );
   return l->routes;
 }
 
 GHashTable *vik_trw_layer_get_waypoints ( VikTrwLayer *l )
 {
+  trw_ensure_deferred_loaded ( l );
   return l->waypoints;
 }
 
@@ -4043,11 +5423,164 @@ GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl )
 
 gboolean vik_trw_layer_is_empty ( VikTrwLayer *vtl )
 {
+  if ( vtl->deferred ) {
+    const VikBinBounds *bounds = a_binfile_deferred_get_bounds ( vtl->deferred );
+    return ! ( bounds->tracks || bounds->routes || bounds->waypoints );
+  }
   return ! ( g_hash_table_size ( vtl->tracks ) ||
              g_hash_table_size ( vtl->routes ) ||
              g_hash_table_size ( vtl->waypoints ) );
 }
 
+#define VIK_SETTINGS_IMPORT_SKIP_DUPLICATES "import_skip_duplicate_tracks"
+// Most possible duplicates named in the report
+#define IMPORT_NEAR_NAMES_MAX 10
+
+static void trw_import_index_free ( TrwImportIndex *ti )
+{
+  if ( !ti )
+    return;
+  g_hash_table_destroy ( ti->existing );
+  g_hash_table_destroy ( ti->exact );
+  g_hash_table_destroy ( ti->near );
+  g_free ( ti );
+}
+
+static void trw_import_index_add ( TrwImportIndex *ti, VikTrack *trk, guint64 exact, guint64 near )
+{
+  // Keys are held in the tables themselves
+  gint64 *key = g_new ( gint64, 1 );
+  *key = (gint64)exact;
+  if ( !g_hash_table_contains ( ti->exact, key ) )
+    g_hash_table_insert ( ti->exact, key, trk );
+  else
+    g_free ( key );
+  key = g_new ( gint64, 1 );
+  *key = (gint64)near;
+  if ( !g_hash_table_contains ( ti->near, key ) )
+    g_hash_table_insert ( ti->near, key, trk );
+  else
+    g_free ( key );
+}
+
+static void trw_import_index_tracks ( TrwImportIndex *ti, GHashTable *tracks )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    guint64 exact, near;
+    g_hash_table_add ( ti->existing, trk );
+    if ( vik_track_get_fingerprint ( trk, &exact, &near ) )
+      trw_import_index_add ( ti, trk, exact, near );
+  }
+}
+
+/**
+ * vik_trw_layer_import_begin:
+ *
+ * About to import more tracks into the layer (e.g. from a device),
+ *  so index the fingerprints of those already in it (see vik_track_get_fingerprint()).
+ * Then vik_trw_layer_import_end() can find the repeated ones in constant time per track.
+ */
+void vik_trw_layer_import_begin ( VikTrwLayer *vtl )
+{
+  trw_ensure_deferred_loaded ( vtl );
+  trw_import_index_free ( vtl->import );
+  TrwImportIndex *ti = g_new0 ( TrwImportIndex, 1 );
+  ti->existing = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  ti->exact = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  ti->near = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  trw_import_index_tracks ( ti, vtl->tracks );
+  trw_import_index_tracks ( ti, vtl->routes );
+  vtl->import = ti;
+}
+
+static void trw_import_check_tracks ( VikTrwLayer *vtl, GHashTable *tracks, gboolean skip, guint *exact_count, GString *near_names, guint *near_count )
+{
+  TrwImportIndex *ti = vtl->import;
+  GList *repeated = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    guint64 exact, near;
+    if ( g_hash_table_contains ( ti->existing, trk ) || !vik_track_get_fingerprint ( trk, &exact, &near ) )
+      continue;
+    gint64 lookup = (gint64)exact;
+    if ( g_hash_table_contains ( ti->exact, &lookup ) ) {
+      (*exact_count)++;
+      if ( skip ) {
+        repeated = g_list_prepend ( repeated, trk );
+        continue;
+      }
+    }
+    else {
+      lookup = (gint64)near;
+      VikTrack *similar = g_hash_table_lookup ( ti->near, &lookup );
+      if ( similar ) {
+        if ( (*near_count)++ < IMPORT_NEAR_NAMES_MAX )
+          g_string_append_printf ( near_names, "\n%s ~ %s", trk->name, similar->name );
+      }
+    }
+    // Also catches repeats within the same import
+    trw_import_index_add ( ti, trk, exact, near );
+  }
+  // Removed afterwards, as the table can't be changed whilst being iterated
+  GList *it;
+  for ( it = repeated; it; it = it->next ) {
+    if ( VIK_TRACK(it->data)->is_route )
+      (void)vik_trw_layer_delete_route ( vtl, VIK_TRACK(it->data) );
+    else
+      (void)vik_trw_layer_delete_track ( vtl, VIK_TRACK(it->data) );
+  }
+  g_list_free ( repeated );
+}
+
+/**
+ * vik_trw_layer_import_end:
+ *
+ * Compare each track added since vik_trw_layer_import_begin() with the ones already in the layer (and each other).
+ * Exact repeats are removed (unless the import_skip_duplicate_tracks setting is false),
+ *  and possible repeats are named in the report.
+ *
+ * Returns: The report for the user (free after use), or NULL if nothing was found
+ */
+gchar *vik_trw_layer_import_end ( VikTrwLayer *vtl )
+{
+  if ( !vtl->import )
+    return NULL;
+
+  gboolean skip = TRUE;
+  (void)a_settings_get_boolean ( VIK_SETTINGS_IMPORT_SKIP_DUPLICATES, &skip );
+  guint exact_count = 0, near_count = 0;
+  GString *near_names = g_string_new ( NULL );
+  trw_import_check_tracks ( vtl, vtl->tracks, skip, &exact_count, near_names, &near_count );
+  trw_import_check_tracks ( vtl, vtl->routes, skip, &exact_count, near_names, &near_count );
+  trw_import_index_free ( vtl->import );
+  vtl->import = NULL;
+
+  gchar *report = NULL;
+  if ( exact_count || near_count ) {
+    GString *gs = g_string_new ( NULL );
+    if ( exact_count )
+      g_string_append_printf ( gs, skip ? _("%d tracks already in the layer were not added again.") : _("%d tracks are already in the layer."), exact_count );
+    if ( near_count ) {
+      if ( exact_count )
+        g_string_append_c ( gs, '\n' );
+      g_string_append_printf ( gs, _("%d tracks may already be in the layer:"), near_count );
+      g_string_append ( gs, near_names->str );
+      if ( near_count > IMPORT_NEAR_NAMES_MAX )
+        g_string_append ( gs, "\n..." );
+    }
+    report = g_string_free ( gs, FALSE );
+  }
+  g_string_free ( near_names, TRUE );
+  return report;
+}
+
 /**
  * Returns: a #VikTrack if there is only one track or only one route in the layer
  * (irrespective of the number of waypoints), otherwise returns NULL
@@ -4095,55 +5628,116 @@ gboolean vik_trw_layer_get_prefer_gps_speed ( VikTrwLayer *vtl )
   return vtl->prefer_gps_speed;
 }
 
-/*
- * ATM use a case sensitive find
- * Finds the first one
- */
-static gboolean trw_layer_waypoint_find ( const gpointer id, const VikWaypoint *wp, const gchar *name )
+static VikNameIndex **trw_layer_name_index_of ( VikTrwLayer *vtl, GHashTable *items )
 {
-  if ( wp && wp->name )
-    if ( ! strcmp ( wp->name, name ) )
-      return TRUE;
-  return FALSE;
+  if ( items == vtl->tracks )
+    return &vtl->tracks_names;
+  else if ( items == vtl->routes )
+    return &vtl->routes_names;
+  return &vtl->waypoints_names;
 }
 
-/*
- * Get waypoint by name - not guaranteed to be unique
- * Finds the first one
+static void trw_layer_name_index_waypoint ( gpointer id, VikWaypoint *wp, VikNameIndex *index )
+{
+  vik_name_index_add ( index, wp->name, wp );
+}
+
+static void trw_layer_name_index_track ( gpointer id, VikTrack *trk, VikNameIndex *index )
+{
+  vik_name_index_add ( index, trk->name, trk );
+}
+
+/**
+ * trw_layer_name_index:
+ * @items: One of the tracks, routes or waypoints of the layer
+ *
+ * The index of the names of the items is only built when first needed,
+ *  after that it is kept up to date as items are added, removed or renamed.
  */
-VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name )
+static VikNameIndex *trw_layer_name_index ( VikTrwLayer *vtl, GHashTable *items )
+{
+  trw_ensure_deferred_loaded ( vtl );
+  VikNameIndex **index = trw_layer_name_index_of ( vtl, items );
+  if ( !*index ) {
+    *index = vik_name_index_new ();
+    g_hash_table_foreach ( items, items == vtl->waypoints ? (GHFunc)trw_layer_name_index_waypoint : (GHFunc)trw_layer_name_index_track, *index );
+  }
+  return *index;
+}
+
+static void trw_layer_name_index_add ( VikTrwLayer *vtl, GHashTable *items, const gchar *name, gpointer item )
+{
+  VikNameIndex *index = *trw_layer_name_index_of ( vtl, items );
+  if ( index )
+    vik_name_index_add ( index, name, item );
+}
+
+static void trw_layer_name_index_remove ( VikTrwLayer *vtl, GHashTable *items, gpointer item )
+{
+  VikNameIndex *index = *trw_layer_name_index_of ( vtl, items );
+  if ( index )
+    vik_name_index_remove ( index, item );
+}
+
+static void trw_layer_name_index_rename ( VikTrwLayer *vtl, GHashTable *items, gpointer item, const gchar *name )
+{
+  VikNameIndex *index = *trw_layer_name_index_of ( vtl, items );
+  if ( index )
+    vik_name_index_rename ( index, item, name );
+}
+
+static void trw_layer_name_index_clear ( VikTrwLayer *vtl, GHashTable *items )
 {
-  return g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find, (gpointer) name );
+  VikNameIndex **index = trw_layer_name_index_of ( vtl, items );
+  vik_name_index_free ( *index );
+  *index = NULL;
 }
 
 /*
+ * Get waypoint by name - not guaranteed to be unique
  * ATM use a case sensitive find
- * Finds the first one
  */
-static gboolean trw_layer_track_find ( const gpointer id, const VikTrack *trk, const gchar *name )
+VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name )
 {
-  if ( trk && trk->name )
-    if ( ! strcmp ( trk->name, name ) )
-      return TRUE;
-  return FALSE;
+  return vik_name_index_lookup ( trw_layer_name_index(vtl, vtl->waypoints), name );
 }
 
 /*
  * Get track by name - not guaranteed to be unique
- * Finds the first one
+ * ATM use a case sensitive find
  */
 VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name )
 {
-  return g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_track_find, (gpointer) name );
+  return vik_name_index_lookup ( trw_layer_name_index(vtl, vtl->tracks), name );
 }
 
 /*
  * Get route by name - not guaranteed to be unique
- * Finds the first one
+ * ATM use a case sensitive find
  */
 VikTrack *vik_trw_layer_get_route ( VikTrwLayer *vtl, const gchar *name )
 {
-  return g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find, (gpointer) name );
+  return vik_name_index_lookup ( trw_layer_name_index(vtl, vtl->routes), name );
+}
+
+/**
+ * vik_trw_layer_find_by_name:
+ * @sublayer_type: Which of the waypoints, tracks or routes to search
+ * @text:          Ignoring case, the start of the names to find
+ * @substring:     Also find names with the text anywhere in them
+ * @max:           The most items to give, 0 for no limit
+ *
+ * Returns: A list of the #VikWaypoint or #VikTrack items found, names starting with the text first.
+ *  Free the list (but not the items) after use.
+ */
+GList *vik_trw_layer_find_by_name ( VikTrwLayer *vtl, gint sublayer_type, const gchar *text, gboolean substring, guint max )
+{
+  GHashTable *items = vtl->waypoints;
+  if ( sublayer_type == VIK_TRW_LAYER_SUBLAYER_TRACK || sublayer_type == VIK_TRW_LAYER_SUBLAYER_TRACKS )
+    items = vtl->tracks;
+  else if ( sublayer_type == VIK_TRW_LAYER_SUBLAYER_ROUTE || sublayer_type == VIK_TRW_LAYER_SUBLAYER_ROUTES )
+    items = vtl->routes;
+  return vik_name_index_find ( trw_layer_name_index(vtl, items), text, substring, max );
 }
 
 static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] )
@@ -4160,6 +5754,7 @@ static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *tr
 
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
 {
+  trw_ensure_deferred_loaded ( vtl );
   // Continually reuse maxmin to find the latest maximum and minimum values
   // First set to waypoints bounds
   maxmin[0].lat = vtl->waypoints_bbox.north;
@@ -4172,6 +5767,10 @@ static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
 
 LatLonBBox vik_trw_layer_get_bbox ( VikTrwLayer *vtl )
 {
+  // Known without reading everything in
+  if ( vtl->deferred )
+    return a_binfile_deferred_get_bounds(vtl->deferred)->bbox;
+
   struct LatLon maxmin[2] = { {0.0,0.0}, {0.0,0.0} };
   trw_layer_find_maxmin (vtl, maxmin);
   LatLonBBox bbox;
@@ -4182,6 +5781,123 @@ LatLonBBox vik_trw_layer_get_bbox ( VikTrwLayer *vtl )
   return bbox;
 }
 
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrwLayer *dest;
+  gboolean use_bbox;
+  LatLonBBox bbox;
+  gboolean use_time;
+  gdouble start;
+  gdouble end;
+} TrwExtract;
+
+static gboolean trw_extract_coord ( TrwExtract *te, const VikCoord *coord, gdouble timestamp )
+{
+  // NB a missing time is never within the period
+  if ( te->use_time && !(timestamp >= te->start && timestamp <= te->end) )
+    return FALSE;
+  if ( te->use_bbox ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( coord, &ll );
+    return ( ll.lat >= te->bbox.south && ll.lat <= te->bbox.north &&
+             ll.lon >= te->bbox.west && ll.lon <= te->bbox.east );
+  }
+  return TRUE;
+}
+
+/**
+ * Copy the segments of the track with any trackpoint within the limits
+ */
+static void trw_extract_track ( gpointer id, VikTrack *trk, TrwExtract *te )
+{
+  trw_layer_track_unpack ( te->vtl, trk );
+
+  GList *points = NULL;
+  GList *iter = trk->trackpoints;
+  while ( iter ) {
+    GList *seg_end = iter->next;
+    while ( seg_end && !VIK_TRACKPOINT(seg_end->data)->newsegment )
+      seg_end = seg_end->next;
+
+    gboolean wanted = FALSE;
+    for ( GList *it = iter; it != seg_end && !wanted; it = it->next )
+      wanted = trw_extract_coord ( te, &VIK_TRACKPOINT(it->data)->coord, VIK_TRACKPOINT(it->data)->timestamp );
+    if ( wanted )
+      for ( GList *it = iter; it != seg_end; it = it->next )
+        points = g_list_prepend ( points, vik_trackpoint_copy(VIK_TRACKPOINT(it->data)) );
+    iter = seg_end;
+  }
+  if ( !points )
+    return;
+
+  VikTrack *copy = vik_track_copy ( trk, FALSE );
+  copy->trackpoints = g_list_reverse ( points );
+  vik_track_calculate_bounds ( copy );
+  if ( copy->is_route )
+    vik_trw_layer_add_route ( te->dest, NULL, copy );
+  else
+    vik_trw_layer_add_track ( te->dest, NULL, copy );
+}
+
+static void trw_extract_waypoint ( gpointer id, VikWaypoint *wp, TrwExtract *te )
+{
+  if ( trw_extract_coord ( te, &wp->coord, wp->timestamp ) )
+    vik_trw_layer_add_waypoint ( te->dest, NULL, vik_waypoint_copy(wp) );
+}
+
+/**
+ * vik_trw_layer_extract:
+ * @bbox:  Only the items within this area, or NULL for anywhere
+ * @start: Only the items with times within @start to @end (seconds since the epoch),
+ *         or NAN for any time (then including items without times)
+ *
+ * A new (unrealized) layer with copies of just the waypoints and track segments within the limits,
+ *  e.g. to export what is in view.
+ * The items are found via the spatial and time indices,
+ *  so this takes time according to how much is copied rather than the size of the layer.
+ *
+ * Returns: The new layer, to be released with g_object_unref()
+ */
+VikTrwLayer *vik_trw_layer_extract ( VikTrwLayer *vtl, const LatLonBBox *bbox, gdouble start, gdouble end )
+{
+  trw_ensure_deferred_loaded ( vtl );
+
+  VikTrwLayer *dest = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  vik_layer_rename ( VIK_LAYER(dest), VIK_LAYER(vtl)->name );
+  dest->coord_mode = vtl->coord_mode;
+  dest->tracks_visible = vtl->tracks_visible;
+  dest->routes_visible = vtl->routes_visible;
+  dest->waypoints_visible = vtl->waypoints_visible;
+  dest->gpx_version = vtl->gpx_version;
+  vik_trw_layer_set_gpx_header ( dest, vtl->gpx_header );
+  vik_trw_layer_set_gpx_extensions ( dest, vtl->gpx_extensions );
+
+  TrwExtract te = { vtl, dest, bbox != NULL, { 0.0, 0.0, 0.0, 0.0 }, !isnan(start), start, end };
+  if ( bbox )
+    te.bbox = *bbox;
+
+  if ( te.use_bbox ) {
+    trw_layer_foreach_in_bbox ( vtl, vtl->tracks, te.bbox, (GHFunc)trw_extract_track, &te );
+    trw_layer_foreach_in_bbox ( vtl, vtl->routes, te.bbox, (GHFunc)trw_extract_track, &te );
+    trw_layer_foreach_in_bbox ( vtl, vtl->waypoints, te.bbox, (GHFunc)trw_extract_waypoint, &te );
+  }
+  else {
+    if ( te.use_time ) {
+      GList *spans = trw_layer_time_spans ( vtl, start, end );
+      for ( GList *iter = spans; iter; iter = iter->next )
+        trw_extract_track ( NULL, ((TrwTimeSpan*)iter->data)->trk, &te );
+      g_list_free ( spans );
+    }
+    else
+      g_hash_table_foreach ( vtl->tracks, (GHFunc)trw_extract_track, &te );
+    // Not in the time index
+    g_hash_table_foreach ( vtl->routes, (GHFunc)trw_extract_track, &te );
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc)trw_extract_waypoint, &te );
+  }
+
+  return dest;
+}
+
 gboolean vik_trw_layer_find_center ( VikTrwLayer *vtl, VikCoord *dest )
 {
   /* TODO: what if there's only one waypoint @ 0,0, it will think nothing found. like I don't have more important things to worry about... */
@@ -4236,11 +5952,69 @@ static void trw_layer_auto_view ( menu_array_layer values )
     a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("This layer has no waypoints or trackpoints.") );
 }
 
-static void trw_layer_export_gpspoint ( menu_array_layer values )
+/**
+ * Copy the tracks of one table into another layer,
+ *  sharing the trackpoints (packing them first) rather than copying every one
+ */
+static void trw_layer_duplicate_tracks ( VikTrwLayer *vtl, GHashTable *tracks, VikTrwLayer *vtl_dup )
 {
-  gchar *auto_save_name = append_file_ext ( vik_layer_get_name(VIK_LAYER(values[MA_VTL])), FILE_TYPE_GPSPOINT );
-
-  vik_trw_layer_export ( VIK_LAYER(values[MA_VTL]), _("Export Layer"), auto_save_name, NULL, FILE_TYPE_GPSPOINT );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    if ( trw_layer_track_packable ( vtl, trk ) && vik_track_pack ( trk ) ) {
+      vtl->packed_tracks++;
+      if ( vtl->compact_drawn )
+        g_hash_table_remove ( vtl->compact_drawn, trk );
+    }
+    VikTrack *trk_dup = vik_track_copy_shared ( trk );
+    if ( trk_dup->packed )
+      vtl_dup->packed_tracks++;
+    if ( trk_dup->is_route )
+      vik_trw_layer_add_route ( vtl_dup, NULL, trk_dup );
+    else
+      vik_trw_layer_add_track ( vtl_dup, NULL, trk_dup );
+  }
+}
+
+/**
+ * A new layer of the same items, without going through marshalling (as the clipboard does)
+ *  so the copies of tracks can share trackpoints with the originals until either is changed
+ */
+static void trw_layer_duplicate ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  VikLayersPanel *vlp = VIK_LAYERS_PANEL(values[MA_VLP]);
+  VikViewport *vvp = vik_layers_panel_get_viewport ( vlp );
+
+  VikTrwLayer *vtl_dup = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+  guint8 *params;
+  guint len;
+  vik_layer_marshall_params ( VIK_LAYER(vtl), &params, &len );
+  vik_layer_unmarshall_params ( VIK_LAYER(vtl_dup), params, len, vvp );
+  g_free ( params );
+  vik_layer_rename ( VIK_LAYER(vtl_dup), vik_layer_get_name(VIK_LAYER(vtl)) );
+  vik_trw_layer_set_gpx_header ( vtl_dup, vtl->gpx_header );
+  vik_trw_layer_set_gpx_extensions ( vtl_dup, vtl->gpx_extensions );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    vik_trw_layer_add_waypoint ( vtl_dup, NULL, vik_waypoint_copy ( VIK_WAYPOINT(value) ) );
+  trw_layer_duplicate_tracks ( vtl, vtl->tracks, vtl_dup );
+  trw_layer_duplicate_tracks ( vtl, vtl->routes, vtl_dup );
+
+  vik_layer_post_read ( VIK_LAYER(vtl_dup), vvp, FALSE );
+  vik_layers_panel_add_layer ( vlp, VIK_LAYER(vtl_dup) );
+}
+
+static void trw_layer_export_gpspoint ( menu_array_layer values )
+{
+  gchar *auto_save_name = append_file_ext ( vik_layer_get_name(VIK_LAYER(values[MA_VTL])), FILE_TYPE_GPSPOINT );
+
+  vik_trw_layer_export ( VIK_LAYER(values[MA_VTL]), _("Export Layer"), auto_save_name, NULL, FILE_TYPE_GPSPOINT );
 
   g_free ( auto_save_name );
 }
@@ -4349,6 +6123,34 @@ gboolean trw_layer_waypoint_find_uuid ( const gpointer id, const VikWaypoint *wp
   return FALSE;
 }
 
+// Enough to choose from without slowing typing down
+#define TRW_FIND_COMPLETIONS 50
+
+/**
+ * Offer the waypoints whose names match what has been typed so far
+ */
+static void trw_layer_goto_wp_changed ( GtkEntry *entry, VikTrwLayer *vtl )
+{
+  GtkEntryCompletion *completion = gtk_entry_get_completion ( entry );
+  GtkListStore *store = GTK_LIST_STORE ( gtk_entry_completion_get_model(completion) );
+  gtk_list_store_clear ( store );
+
+  const gchar *text = gtk_entry_get_text ( entry );
+  if ( !text[0] )
+    return;
+
+  GList *wps = vik_trw_layer_find_by_name ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, text, TRUE, TRW_FIND_COMPLETIONS );
+  for ( GList *iter = wps; iter; iter = iter->next )
+    gtk_list_store_insert_with_values ( store, NULL, -1, 0, ((VikWaypoint*)iter->data)->name, -1 );
+  g_list_free ( wps );
+}
+
+// The store only has matching names already
+static gboolean trw_layer_goto_wp_match ( GtkEntryCompletion *completion, const gchar *key, GtkTreeIter *iter, gpointer user_data )
+{
+  return TRUE;
+}
+
 static void trw_layer_goto_wp ( menu_array_layer values )
 {
   VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
@@ -4366,6 +6168,16 @@ static void trw_layer_goto_wp ( menu_array_layer values )
   label = gtk_label_new(_("Waypoint Name:"));
   entry = ui_entry_new ( NULL, GTK_ENTRY_ICON_SECONDARY );
 
+  GtkEntryCompletion *completion = gtk_entry_completion_new ();
+  GtkListStore *store = gtk_list_store_new ( 1, G_TYPE_STRING );
+  gtk_entry_completion_set_model ( completion, GTK_TREE_MODEL(store) );
+  g_object_unref ( store );
+  gtk_entry_completion_set_text_column ( completion, 0 );
+  gtk_entry_completion_set_match_func ( completion, trw_layer_goto_wp_match, NULL, NULL );
+  gtk_entry_set_completion ( GTK_ENTRY(entry), completion );
+  g_object_unref ( completion );
+  g_signal_connect ( entry, "changed", G_CALLBACK(trw_layer_goto_wp_changed), vtl );
+
   gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dia))), label, FALSE, FALSE, 0);
   gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dia))), entry, FALSE, FALSE, 0);
   gtk_widget_show_all ( dia );
@@ -4378,6 +6190,13 @@ static void trw_layer_goto_wp ( menu_array_layer values )
     gchar *name = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
     // Find *first* wp with the given name
     VikWaypoint *wp = vik_trw_layer_get_waypoint ( vtl, name );
+    if ( !wp && name[0] ) {
+      // Otherwise the best partial match
+      GList *wps = vik_trw_layer_find_by_name ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, name, TRUE, 1 );
+      if ( wps )
+        wp = wps->data;
+      g_list_free ( wps );
+    }
 
     if ( !wp )
       a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("Waypoint not found in this layer.") );
@@ -4520,6 +6339,17 @@ static void trw_layer_geotagging ( menu_array_layer values )
 }
 #endif
 
+static void trw_layer_follow_stream_cb ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  a_trackstream_dialog ( VIK_GTK_WINDOW_FROM_LAYER(vtl), vtl );
+}
+
+static void trw_layer_stop_stream_cb ( menu_array_layer values )
+{
+  a_trackstream_stop ( VIK_TRW_LAYER(values[MA_VTL]) );
+}
+
 // 'Acquires' - Same as in File Menu -> Acquire - applies into the selected TRW Layer //
 
 static void trw_layer_acquire ( menu_array_layer values, VikDataSourceInterface *datasource )
@@ -4958,6 +6788,7 @@ static void trw_layer_visibility_tree ( menu_array_layer values )
   vik_treeview_item_set_visible_tree ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
   gboolean ignore_toggle = FALSE;
   (void)a_settings_get_boolean ( VIK_SETTINGS_IGNORE_VIS_MOD, &ignore_toggle );
+  trw_layer_draw_cache_invalidate ( vtl );
   vik_layers_panel_emit_update ( vlp, !ignore_toggle );
 }
 
@@ -4989,6 +6820,8 @@ static GtkMenu* create_external_submenu ( GtkMenu *menu )
 
 static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer vlp )
 {
+  trw_ensure_deferred_loaded ( vtl );
+  trw_ensure_unpacked ( vtl );
   static menu_array_layer data;
   data[MA_VTL] = vtl;
   data[MA_VLP] = vlp;
@@ -5001,8 +6834,27 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
     (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
   }
 
+  if ( vtl->journal ) {
+    const gchar *undo = vik_journal_get_undo_label ( vtl->journal );
+    const gchar *redo = vik_journal_get_redo_label ( vtl->journal );
+    if ( undo ) {
+      gchar *label = g_strdup_printf ( _("_Undo %s"), undo );
+      (void)vu_menu_add_item ( menu, label, GTK_STOCK_UNDO, G_CALLBACK(trw_layer_undo_cb), data );
+      g_free ( label );
+    }
+    if ( redo ) {
+      gchar *label = g_strdup_printf ( _("_Redo %s"), redo );
+      (void)vu_menu_add_item ( menu, label, GTK_STOCK_REDO, G_CALLBACK(trw_layer_redo_cb), data );
+      g_free ( label );
+    }
+    if ( undo || redo )
+      (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
+  }
+
   /* Now with icons */
   (void)vu_menu_add_item ( menu, _("_View Layer"), GTK_STOCK_ZOOM_FIT, G_CALLBACK(trw_layer_auto_view), data );
+  (void)vu_menu_add_item ( menu, _("_Duplicate Layer"), GTK_STOCK_COPY, G_CALLBACK(trw_layer_duplicate), data );
+  (void)vu_menu_add_item ( menu, _("_Merge Layer..."), NULL, G_CALLBACK(trw_layer_merge_layer), data );
 
   GtkMenu *view_submenu = GTK_MENU(gtk_menu_new());
   GtkWidget *itemv = vu_menu_add_item ( menu, _("V_iew"), GTK_STOCK_FIND, NULL, NULL );
@@ -5047,8 +6899,7 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
   if ( a_babel_available () )
     (void)vu_menu_add_item ( export_submenu, _("Export as _KML..."), NULL, G_CALLBACK(trw_layer_export_kml), data );
 
-  if ( have_geojson_export )
-    (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
+  (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
 
   if ( a_babel_available () )
     (void)vu_menu_add_item ( export_submenu, _("Export via GPSbabel..."), NULL, G_CALLBACK(trw_layer_export_babel), data );
@@ -5082,6 +6933,11 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
   (void)vu_menu_add_item ( menu, _("Geotag _Images..."), VIK_ICON_GLOBE, G_CALLBACK(trw_layer_geotagging), data );
 #endif
 
+  if ( a_trackstream_is_following(vtl) )
+    (void)vu_menu_add_item ( menu, _("Stop Following _Stream"), GTK_STOCK_STOP, G_CALLBACK(trw_layer_stop_stream_cb), data );
+  else
+    (void)vu_menu_add_item ( menu, _("Follow _Stream..."), GTK_STOCK_CONNECT, G_CALLBACK(trw_layer_follow_stream_cb), data );
+
   GtkMenu *acquire_submenu = GTK_MENU(gtk_menu_new());
   GtkWidget *itema = vu_menu_add_item ( menu, _("_Acquire"), GTK_STOCK_GO_DOWN, NULL, data );
   gtk_menu_item_set_submenu ( GTK_MENU_ITEM(itema), GTK_WIDGET(acquire_submenu) );
@@ -5179,7 +7035,7 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
 }
 
 // Fake Waypoint UUIDs vi simple increasing integer
-static guint wp_uuid = 0;
+static gint wp_uuid = 0;
 
 /**
  * vik_trw_layer_add_waypoint:
@@ -5188,7 +7044,8 @@ static guint wp_uuid = 0;
  */
 void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp )
 {
-  wp_uuid++;
+  // Files may be read into layers in the background
+  guint uuid = (guint)g_atomic_int_add ( &wp_uuid, 1 ) + 1;
 
   if ( name )
     vik_waypoint_set_name (wp, name);
@@ -5207,27 +7064,33 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
       timestamp = wp->timestamp;
 
     // Visibility column always needed for waypoints
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(wp_uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
 
     // Actual setting of visibility dependent on the waypoint
-    vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, wp->visible );
+    if ( !wp->visible )
+      vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, FALSE );
 
-    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(wp_uuid), iter );
+    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(uuid), iter );
 
-    // Sort now as post_read is not called on a realized waypoint
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    // Sort soon as post_read is not called on a realized waypoint
+    trw_layer_sort_soon ( vtl );
   }
 
   highest_wp_number_add_wp(vtl, wp->name);
-  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(uuid), wp );
+  trw_layer_index_clear ( vtl, &vtl->waypoints_index );
+  if ( vtl->waypoint_clusters )
+    trw_layer_cluster_waypoint ( NULL, wp, vtl->waypoint_clusters );
+  trw_layer_name_index_add ( vtl, vtl->waypoints, wp->name, wp );
 }
 
 // Fake Track UUIDs vi simple increasing integer
-static guint tr_uuid = 0;
+static gint tr_uuid = 0;
 
 void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 {
-  tr_uuid++;
+  // Files may be read into layers in the background
+  guint uuid = (guint)g_atomic_int_add ( &tr_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -5247,28 +7110,34 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
       timestamp = tpt->timestamp;
 
     // Visibility column always needed for tracks
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(tr_uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, TRUE, timestamp, t->number );
+    GdkPixbuf *pixbuf = ui_pixbuf_new ( &t->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, pixbuf, TRUE, timestamp, t->number );
+    g_object_unref ( pixbuf );
 
     // Actual setting of visibility dependent on the track
-    vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
+    if ( !t->visible )
+      vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, FALSE );
 
-    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(tr_uuid), iter );
+    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(uuid), iter );
 
-    // Sort now as post_read is not called on a realized track
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    // Sort soon as post_read is not called on a realized track
+    trw_layer_sort_soon ( vtl );
   }
 
-  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
-
-  trw_layer_update_treeview ( vtl, t, FALSE );
+  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(uuid), t );
+  vtl->tracks_changes++;
+  trw_layer_index_clear ( vtl, &vtl->tracks_index );
+  trw_layer_name_index_add ( vtl, vtl->tracks, t->name, t );
+  trw_layer_time_index_clear ( vtl );
 }
 
 // Fake Route UUIDs vi simple increasing integer
-static guint rt_uuid = 0;
+static gint rt_uuid = 0;
 
 void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 {
-  rt_uuid++;
+  // Files may be read into layers in the background
+  guint uuid = (guint)g_atomic_int_add ( &rt_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -5282,19 +7151,22 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     GtkTreeIter *iter = g_malloc(sizeof(GtkTreeIter));
     // Visibility column always needed for routes
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(rt_uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, NULL, TRUE, 0, t->number ); // Routes don't have times
+    GdkPixbuf *pixbuf = ui_pixbuf_new ( &t->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, pixbuf, TRUE, 0, t->number ); // Routes don't have times
+    g_object_unref ( pixbuf );
     // Actual setting of visibility dependent on the route
-    vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
+    if ( !t->visible )
+      vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, FALSE );
 
-    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(rt_uuid), iter );
+    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(uuid), iter );
 
-    // Sort now as post_read is not called on a realized route
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+    // Sort soon as post_read is not called on a realized route
+    trw_layer_sort_soon ( vtl );
   }
 
-  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
-
-  trw_layer_update_treeview ( vtl, t, FALSE );
+  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(uuid), t );
+  trw_layer_index_clear ( vtl, &vtl->routes_index );
+  trw_layer_name_index_add ( vtl, vtl->routes, t->name, t );
 }
 
 /* to be called whenever a track has been deleted or may have been changed. */
@@ -5312,6 +7184,7 @@ void vik_trw_layer_reset_waypoints ( VikTrwLayer *vtl )
   GHashTableIter iter;
   gpointer key, value;
 
+  trw_layer_draw_cache_invalidate ( vtl );
   // Foreach waypoint
   g_hash_table_iter_init ( &iter, vtl->waypoints );
   while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
@@ -5414,20 +7287,18 @@ void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t
   }
 }
 
+// Fwd declaration
+static gulong trw_layer_clean_tracks ( VikTrwLayer *vtl, GHashTable *tracks, const VikTrackCleanParams *params, gboolean journal );
+
 /**
  * ATM Only for removing bad first points
  */
 void vik_trw_layer_tidy_tracks ( VikTrwLayer *vtl, guint speed, gboolean recalc_bounds )
 {
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init ( &iter, vtl->tracks );
-  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-    VikTrack *trk = VIK_TRACK(value);
-    if ( vik_track_remove_dodgy_first_point ( trk, speed, FALSE ) )
-      g_message ( "%s: Removed dodgy first point from track: %s", __FUNCTION__, trk->name );
-  }
+  VikTrackCleanParams params = { FALSE, FALSE, speed, 0, 0 };
+  gulong removed = trw_layer_clean_tracks ( vtl, vtl->tracks, &params, FALSE );
+  if ( removed )
+    g_message ( "%s: Removed %ld dodgy first points", __FUNCTION__, removed );
 }
 
 static void trw_layer_enum_item ( gpointer id, GList **tr, GList **l )
@@ -5452,10 +7323,13 @@ static void trw_layer_move_item ( VikTrwLayer *vtl_src, VikTrwLayer *vtl_dest, g
 
     gchar *newname = trw_layer_new_unique_sublayer_name ( vtl_dest, type, trk->name );
 
-    VikTrack *trk2 = vik_track_copy ( trk, TRUE );
-    vik_trw_layer_add_track ( vtl_dest, newname, trk2 );
-    g_free ( newname );
+    // Move the track itself rather than copying all its trackpoints:
+    //  keep a reference while it is removed from the source layer
+    vik_track_ref ( trk );
+    trw_layer_track_close_dialog ( trk );
     vik_trw_layer_delete_track ( vtl_src, trk );
+    vik_trw_layer_add_track ( vtl_dest, newname, trk );
+    g_free ( newname );
     // Reset layer timestamps in case they have now changed
     vik_treeview_item_set_timestamp ( vtl_dest->vl.vt, &vtl_dest->vl.iter, trw_layer_get_timestamp(vtl_dest) );
     vik_treeview_item_set_timestamp ( vtl_src->vl.vt, &vtl_src->vl.iter, trw_layer_get_timestamp(vtl_src) );
@@ -5466,10 +7340,11 @@ static void trw_layer_move_item ( VikTrwLayer *vtl_src, VikTrwLayer *vtl_dest, g
 
     gchar *newname = trw_layer_new_unique_sublayer_name ( vtl_dest, type, trk->name );
 
-    VikTrack *trk2 = vik_track_copy ( trk, TRUE );
-    vik_trw_layer_add_route ( vtl_dest, newname, trk2 );
-    g_free ( newname );
+    vik_track_ref ( trk );
+    trw_layer_track_close_dialog ( trk );
     vik_trw_layer_delete_route ( vtl_src, trk );
+    vik_trw_layer_add_route ( vtl_dest, newname, trk );
+    g_free ( newname );
   }
 
   if (type == VIK_TRW_LAYER_SUBLAYER_WAYPOINT) {
@@ -5555,6 +7430,9 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
     if ( trk == vtl->route_finder_added_track )
       vtl->route_finder_added_track = NULL;
 
+    if ( trk == vtl->live_track )
+      vtl->live_track = NULL;
+
     trku_udata udata;
     udata.trk  = trk;
     udata.uuid = NULL;
@@ -5571,7 +7449,11 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
+        trw_layer_name_index_remove ( vtl, vtl->tracks, trk );
         g_hash_table_remove ( vtl->tracks, udata.uuid );
+        vtl->tracks_changes++;
+        trw_layer_index_clear ( vtl, &vtl->tracks_index );
+        trw_layer_time_index_clear ( vtl );
 
 	// If last sublayer, then remove sublayer container
 	if ( g_hash_table_size (vtl->tracks) == 0 ) {
@@ -5618,7 +7500,9 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->routes_iters, udata.uuid );
+        trw_layer_name_index_remove ( vtl, vtl->routes, trk );
         g_hash_table_remove ( vtl->routes, udata.uuid );
+        trw_layer_index_clear ( vtl, &vtl->routes_index );
 
         // If last sublayer, then remove sublayer container
         if ( g_hash_table_size (vtl->routes) == 0 ) {
@@ -5643,7 +7527,11 @@ static void delete_waypoint_low_level ( VikTrwLayer *vtl, VikWaypoint *wp, gpoin
   g_hash_table_remove ( vtl->waypoints_iters, uuid );
 
   highest_wp_number_remove_wp ( vtl, wp->name );
+  trw_layer_name_index_remove ( vtl, vtl->waypoints, wp );
+  if ( vtl->waypoint_clusters )
+    vik_point_clusters_remove ( vtl->waypoint_clusters, wp );
   g_hash_table_remove ( vtl->waypoints, uuid ); // last because this frees the name
+  trw_layer_index_clear ( vtl, &vtl->waypoints_index );
 }
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
@@ -5788,6 +7676,8 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->routes) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
   g_hash_table_remove_all(vtl->routes);
+  trw_layer_index_clear ( vtl, &vtl->routes_index );
+  trw_layer_name_index_clear ( vtl, vtl->routes );
 
   close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_ROUTES );
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
@@ -5797,75 +7687,1067 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
 {
   vtl->current_track = NULL;
   vtl->route_finder_added_track = NULL;
+  vtl->live_track = NULL;
   if (vtl->current_tp_track)
     trw_layer_cancel_current_tp(vtl, FALSE);
 
   g_hash_table_foreach(vtl->tracks_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->tracks_iters);
 
-  if ( g_hash_table_size (vtl->tracks) > 0 )
-    vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
-  g_hash_table_remove_all(vtl->tracks);
+  if ( g_hash_table_size (vtl->tracks) > 0 )
+    vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
+  g_hash_table_remove_all(vtl->tracks);
+  vtl->tracks_changes++;
+  trw_layer_index_clear ( vtl, &vtl->tracks_index );
+  trw_layer_name_index_clear ( vtl, vtl->tracks );
+  trw_layer_time_index_clear ( vtl );
+
+  close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_TRACKS );
+  vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+}
+
+void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
+{
+  if ( vtl->wpwin ) {
+    vik_trw_layer_wpwin_destroy ( vtl->wpwin );
+    vtl->wpwin = NULL;
+  }
+  vtl->wpwin_wpt = NULL;
+
+  vtl->current_wp = NULL;
+  vtl->current_wp_id = NULL;
+  vtl->moving_wp = FALSE;
+
+  highest_wp_number_reset(vtl);
+
+  g_hash_table_foreach(vtl->waypoints_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
+  g_hash_table_remove_all(vtl->waypoints_iters);
+
+  if ( g_hash_table_size (vtl->waypoints) > 0 )
+    vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
+  g_hash_table_remove_all(vtl->waypoints);
+  trw_layer_index_clear ( vtl, &vtl->waypoints_index );
+  trw_layer_name_index_clear ( vtl, vtl->waypoints );
+  vik_point_clusters_free ( vtl->waypoint_clusters );
+  vtl->waypoint_clusters = NULL;
+
+  vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+}
+
+static void trw_layer_delete_all_tracks ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  // Get confirmation from the user
+  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
+			    _("Are you sure you want to delete all tracks in %s?"),
+			    vik_layer_get_name ( VIK_LAYER(vtl) ) ) ) {
+    vik_trw_layer_delete_all_tracks (vtl);
+    if ( values[MA_VLP] )
+      vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
+  }
+}
+
+static void trw_layer_delete_all_routes ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  // Get confirmation from the user
+  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                            _("Are you sure you want to delete all routes in %s?"),
+                            vik_layer_get_name ( VIK_LAYER(vtl) ) ) )
+    vik_trw_layer_delete_all_routes (vtl);
+}
+
+static void trw_layer_delete_all_waypoints ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  // Get confirmation from the user
+  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
+			    _("Are you sure you want to delete all waypoints in %s?"),
+			    vik_layer_get_name ( VIK_LAYER(vtl) ) ) )
+    vik_trw_layer_delete_all_waypoints (vtl);
+}
+
+/*** Journal of edits for undo and redo ***/
+
+// Limits for the journal of each layer
+#define TRW_JOURNAL_MAX_SIZE (64*1024*1024)
+#define TRW_JOURNAL_MAX_EDITS 100
+
+static gint trackpoint_compare ( gconstpointer a, gconstpointer b );
+
+/*
+ * Edits share the tracks and trackpoints they involve (holding a reference on the tracks)
+ *  rather than copying them, recording only what changed.
+ * This relies on the tracks not being changed other than by journalled edits in between,
+ *  which is checked by the track serial expected after the last journalled edit of each track.
+ */
+static void trw_layer_journal_track_done ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  if ( !vtl->journal_serials )
+    vtl->journal_serials = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  g_hash_table_insert ( vtl->journal_serials, trk, GUINT_TO_POINTER(vik_track_get_serial(trk)) );
+}
+
+static gboolean trw_layer_journal_track_unchanged ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  gpointer serial;
+  if ( !vtl->journal_serials || !g_hash_table_lookup_extended ( vtl->journal_serials, trk, NULL, &serial ) )
+    return FALSE;
+  return GPOINTER_TO_UINT(serial) == vik_track_get_serial ( trk );
+}
+
+static gboolean trw_layer_contains_track ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  trku_udata udata;
+  udata.trk  = trk;
+  udata.uuid = NULL;
+  return g_hash_table_find ( trk->is_route ? vtl->routes : vtl->tracks, (GHRFunc)trw_layer_track_find_uuid, &udata ) != NULL;
+}
+
+// Any properties dialog goes with the track, as the track lives on (e.g. in the journal) after leaving the layer
+static void trw_layer_track_close_dialog ( VikTrack *trk )
+{
+  if ( trk->property_dialog && GTK_IS_WIDGET(trk->property_dialog) ) {
+    GtkWidget *dialog = trk->property_dialog;
+    vik_track_clear_property_dialog ( trk );
+    gtk_widget_destroy ( dialog );
+  }
+}
+
+// Put a track held by the journal (back) into the layer
+static void trw_layer_journal_add_track ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  vik_track_ref ( trk );
+  if ( trk->is_route )
+    vik_trw_layer_add_route ( vtl, NULL, trk );
+  else
+    vik_trw_layer_add_track ( vtl, NULL, trk );
+}
+
+// Take a track held by the journal out of the layer
+static void trw_layer_journal_remove_track ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  trw_layer_track_close_dialog ( trk );
+  if ( trk->is_route )
+    (void)vik_trw_layer_delete_route ( vtl, trk );
+  else
+    (void)vik_trw_layer_delete_track ( vtl, trk );
+}
+
+static void trw_layer_journal_add ( VikTrwLayer *vtl, const gchar *label, const VikJournalEditFuncs *funcs, gpointer data, gsize size )
+{
+  if ( !vtl->journal )
+    vtl->journal = vik_journal_new ( TRW_JOURNAL_MAX_SIZE, TRW_JOURNAL_MAX_EDITS );
+  vik_journal_add ( vtl->journal, label, funcs, data, size );
+}
+
+/*
+ * Deleting a track or route: the track itself is kept
+ */
+typedef struct {
+  VikTrack *trk;
+} TrwJournalDeleteTrack;
+
+static gboolean trw_journal_delete_track_undo ( TrwJournalDeleteTrack *edit, VikTrwLayer *vtl )
+{
+  if ( trw_layer_contains_track ( vtl, edit->trk ) )
+    return FALSE;
+  trw_layer_journal_add_track ( vtl, edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  return TRUE;
+}
+
+static gboolean trw_journal_delete_track_redo ( TrwJournalDeleteTrack *edit, VikTrwLayer *vtl )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  trw_layer_journal_remove_track ( vtl, edit->trk );
+  return TRUE;
+}
+
+static void trw_journal_delete_track_free ( TrwJournalDeleteTrack *edit )
+{
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_delete_track_funcs = {
+  (VikJournalEditFunc) trw_journal_delete_track_undo,
+  (VikJournalEditFunc) trw_journal_delete_track_redo,
+  (VikJournalFreeFunc) trw_journal_delete_track_free,
+};
+
+/*
+ * Delete a track or route from the layer, keeping it in the journal so it can be undone
+ */
+static gboolean trw_layer_delete_track_journalled ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  TrwJournalDeleteTrack *edit = g_new ( TrwJournalDeleteTrack, 1 );
+  edit->trk = trk;
+  vik_track_ref ( trk );
+  gchar *label = g_strdup_printf ( trk->is_route ? _("Delete Route %s") : _("Delete Track %s"), trk->name );
+  // Memory for the trackpoints now only held by the journal
+  gsize size = sizeof(*edit) + sizeof(VikTrack) + vik_track_get_tp_count(trk) * (sizeof(VikTrackpoint) + sizeof(GList));
+
+  trw_layer_track_close_dialog ( trk );
+  gboolean was_visible = trk->is_route ? vik_trw_layer_delete_route ( vtl, trk ) : vik_trw_layer_delete_track ( vtl, trk );
+  trw_layer_journal_track_done ( vtl, trk );
+  trw_layer_journal_add ( vtl, label, &trw_journal_delete_track_funcs, edit, size );
+  g_free ( label );
+  return was_visible;
+}
+
+/*
+ * Deleting a waypoint: waypoints are small so a copy is kept
+ */
+typedef struct {
+  VikWaypoint *wp;       // The copy owned by the edit
+  VikWaypoint *in_layer; // When undone, the waypoint put back in the layer
+} TrwJournalDeleteWaypoint;
+
+static gboolean trw_journal_delete_waypoint_undo ( TrwJournalDeleteWaypoint *edit, VikTrwLayer *vtl )
+{
+  edit->in_layer = vik_waypoint_copy ( edit->wp );
+  vik_trw_layer_add_waypoint ( vtl, NULL, edit->in_layer );
+  trw_layer_calculate_bounds_waypoints ( vtl );
+  return TRUE;
+}
+
+static gboolean trw_journal_delete_waypoint_redo ( TrwJournalDeleteWaypoint *edit, VikTrwLayer *vtl )
+{
+  wpu_udata udata;
+  udata.wp   = edit->in_layer;
+  udata.uuid = NULL;
+  if ( !g_hash_table_find ( vtl->waypoints, (GHRFunc)trw_layer_waypoint_find_uuid, &udata ) )
+    return FALSE;
+  // Any changes since the undo are kept too
+  vik_waypoint_free ( edit->wp );
+  edit->wp = vik_waypoint_copy ( edit->in_layer );
+  (void)trw_layer_delete_waypoint ( vtl, edit->in_layer );
+  edit->in_layer = NULL;
+  trw_layer_calculate_bounds_waypoints ( vtl );
+  return TRUE;
+}
+
+static void trw_journal_delete_waypoint_free ( TrwJournalDeleteWaypoint *edit )
+{
+  vik_waypoint_free ( edit->wp );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_delete_waypoint_funcs = {
+  (VikJournalEditFunc) trw_journal_delete_waypoint_undo,
+  (VikJournalEditFunc) trw_journal_delete_waypoint_redo,
+  (VikJournalFreeFunc) trw_journal_delete_waypoint_free,
+};
+
+static gboolean trw_layer_delete_waypoint_journalled ( VikTrwLayer *vtl, VikWaypoint *wp )
+{
+  TrwJournalDeleteWaypoint *edit = g_new0 ( TrwJournalDeleteWaypoint, 1 );
+  edit->wp = vik_waypoint_copy ( wp );
+  gchar *label = g_strdup_printf ( _("Delete Waypoint %s"), wp->name );
+  gboolean was_visible = trw_layer_delete_waypoint ( vtl, wp );
+  trw_layer_journal_add ( vtl, label, &trw_journal_delete_waypoint_funcs, edit, sizeof(*edit) + sizeof(VikWaypoint) );
+  g_free ( label );
+  return was_visible;
+}
+
+/*
+ * Splitting a track: the trackpoints are moved into the new tracks (the pieces), not copied.
+ * Either the original track keeps the trackpoints up to the first piece,
+ *  or the first piece starts at the beginning of the track and the original track is removed.
+ */
+typedef struct {
+  VikTrack *trk;
+  VikTrackpoint *first; // Where the piece starts in the original track
+  VikTrackpoint *dup;   // When set, a copy of the trackpoint before first, which the piece starts with
+} TrwJournalPiece;
+
+typedef struct {
+  VikTrack *trk;
+  gboolean trk_kept;
+  gboolean undone;   // When undone the edit owns the dup trackpoints
+  gboolean named;    // The pieces have been given their own names
+  guint n_pieces;
+  TrwJournalPiece pieces[];
+} TrwJournalSplit;
+
+static gboolean trw_journal_split_undo ( TrwJournalSplit *edit, VikTrwLayer *vtl )
+{
+  if ( edit->trk_kept ) {
+    if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+      return FALSE;
+  }
+  else if ( trw_layer_contains_track ( vtl, edit->trk ) )
+    return FALSE;
+  for ( guint ii = 0; ii < edit->n_pieces; ii++ ) {
+    VikTrack *piece = edit->pieces[ii].trk;
+    if ( !trw_layer_contains_track ( vtl, piece ) || !trw_layer_journal_track_unchanged ( vtl, piece ) )
+      return FALSE;
+  }
+
+  // Join the pieces back up
+  GList *pieces = NULL;
+  for ( gint ii = edit->n_pieces-1; ii >= 0; ii-- ) {
+    VikTrack *piece = edit->pieces[ii].trk;
+    if ( edit->pieces[ii].dup && piece->trackpoints )
+      piece->trackpoints = g_list_delete_link ( piece->trackpoints, piece->trackpoints );
+    pieces = g_list_prepend ( pieces, piece );
+  }
+  vik_track_steal_and_append_tracks ( edit->trk, pieces );
+  g_list_free ( pieces );
+  for ( guint ii = 0; ii < edit->n_pieces; ii++ )
+    trw_layer_journal_remove_track ( vtl, edit->pieces[ii].trk );
+  if ( !edit->trk_kept )
+    trw_layer_journal_add_track ( vtl, edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  edit->undone = TRUE;
+  return TRUE;
+}
+
+static gboolean trw_journal_split_redo ( TrwJournalSplit *edit, VikTrwLayer *vtl )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  for ( guint ii = 0; ii < edit->n_pieces; ii++ )
+    if ( trw_layer_contains_track ( vtl, edit->pieces[ii].trk ) )
+      return FALSE;
+
+  // Check all the pieces can be found first
+  guint found = 0;
+  GList *start = NULL;
+  for ( GList *iter = edit->trk->trackpoints; iter && found < edit->n_pieces; iter = iter->next )
+    if ( iter->data == edit->pieces[found].first ) {
+      if ( !found )
+        start = iter;
+      found++;
+    }
+  if ( found < edit->n_pieces )
+    return FALSE;
+
+  // Cut off the trackpoints from the first piece onwards and then at the start of each other piece
+  GList *iter = vik_track_cut_trackpoints ( edit->trk, start );
+  found = 0;
+  while ( iter && found < edit->n_pieces ) {
+    if ( iter->data == edit->pieces[found].first ) {
+      if ( iter->prev )
+        iter->prev->next = NULL;
+      iter->prev = NULL;
+      edit->pieces[found].trk->trackpoints = iter;
+      found++;
+    }
+    iter = iter->next;
+  }
+
+  for ( guint ii = 0; ii < edit->n_pieces; ii++ ) {
+    VikTrack *piece = edit->pieces[ii].trk;
+    if ( edit->pieces[ii].dup )
+      piece->trackpoints = g_list_prepend ( piece->trackpoints, edit->pieces[ii].dup );
+    vik_track_calculate_bounds ( piece );
+    if ( !edit->named ) {
+      gchar *name = trw_layer_new_unique_sublayer_name ( vtl, piece->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK, edit->trk->name );
+      vik_track_set_name ( piece, name );
+      g_free ( name );
+    }
+    trw_layer_journal_add_track ( vtl, piece );
+    trw_layer_journal_track_done ( vtl, piece );
+  }
+  edit->named = TRUE;
+  edit->undone = FALSE;
+
+  if ( !edit->trk_kept )
+    trw_layer_journal_remove_track ( vtl, edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  return TRUE;
+}
+
+static void trw_journal_split_free ( TrwJournalSplit *edit )
+{
+  for ( guint ii = 0; ii < edit->n_pieces; ii++ ) {
+    if ( edit->undone && edit->pieces[ii].dup )
+      vik_trackpoint_free ( edit->pieces[ii].dup );
+    vik_track_free ( edit->pieces[ii].trk );
+  }
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_split_funcs = {
+  (VikJournalEditFunc) trw_journal_split_undo,
+  (VikJournalEditFunc) trw_journal_split_redo,
+  (VikJournalFreeFunc) trw_journal_split_free,
+};
+
+/*
+ * Split a track into pieces starting at each of the given trackpoint list positions (in track order).
+ * If the first is not the start of the track then the track keeps the trackpoints before it.
+ * When dup_first is set the (single) piece starts with a copy of the trackpoint before it.
+ *
+ * Returns: The first new track
+ */
+static VikTrack *trw_layer_split_track_at ( VikTrwLayer *vtl, VikTrack *trk, GPtrArray *starts, gboolean dup_first )
+{
+  TrwJournalSplit *edit = g_malloc0 ( sizeof(TrwJournalSplit) + starts->len * sizeof(TrwJournalPiece) );
+  edit->trk = trk;
+  vik_track_ref ( trk );
+  edit->trk_kept = ((GList*)g_ptr_array_index(starts, 0))->prev != NULL;
+  edit->undone = TRUE;
+  edit->n_pieces = starts->len;
+  for ( guint ii = 0; ii < starts->len; ii++ ) {
+    GList *start = g_ptr_array_index ( starts, ii );
+    edit->pieces[ii].trk = vik_track_copy ( trk, FALSE );
+    edit->pieces[ii].first = VIK_TRACKPOINT(start->data);
+    if ( dup_first && start->prev )
+      edit->pieces[ii].dup = vik_trackpoint_copy ( VIK_TRACKPOINT(start->prev->data) );
+  }
+  trw_layer_journal_track_done ( vtl, trk );
+  (void)trw_journal_split_redo ( edit, vtl );
+
+  VikTrack *first = edit->pieces[0].trk;
+  gchar *label = g_strdup_printf ( trk->is_route ? _("Split Route %s") : _("Split Track %s"), trk->name );
+  trw_layer_journal_add ( vtl, label, &trw_journal_split_funcs, edit, sizeof(*edit) + edit->n_pieces * (sizeof(TrwJournalPiece) + sizeof(VikTrack)) );
+  g_free ( label );
+  return first;
+}
+
+/*
+ * Merging tracks: the trackpoints of the other tracks are moved into the track, not copied.
+ * As trackpoints may be sorted by time afterwards, the original order is then recorded
+ */
+typedef struct {
+  VikTrack *trk;
+  GPtrArray *others;    // The tracks merged into trk (references held)
+  GArray *counts;       // Number of trackpoints of trk and then of each of the others
+  GPtrArray *order;     // When sorted, the trackpoints of trk and then each of the others in their original order
+  GPtrArray *segments;  // When the segments were merged afterwards, the trackpoints that started segments
+  gboolean undone;
+} TrwJournalMerge;
+
+static TrwJournalMerge *trw_journal_merge_new ( VikTrack *trk, gboolean sorted )
+{
+  TrwJournalMerge *edit = g_new0 ( TrwJournalMerge, 1 );
+  edit->trk = trk;
+  vik_track_ref ( trk );
+  edit->others = g_ptr_array_new ();
+  edit->counts = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  guint count = 0;
+  if ( sorted )
+    edit->order = g_ptr_array_new ();
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    if ( sorted )
+      g_ptr_array_add ( edit->order, iter->data );
+    count++;
+  }
+  g_array_append_val ( edit->counts, count );
+  return edit;
+}
+
+/*
+ * Record another track about to be merged into the track (and then removed from the layer)
+ */
+static void trw_journal_merge_other ( TrwJournalMerge *edit, VikTrack *other )
+{
+  g_ptr_array_add ( edit->others, other );
+  vik_track_ref ( other );
+  trw_layer_track_close_dialog ( other );
+  guint count = 0;
+  for ( GList *iter = other->trackpoints; iter; iter = iter->next ) {
+    if ( edit->order )
+      g_ptr_array_add ( edit->order, iter->data );
+    count++;
+  }
+  g_array_append_val ( edit->counts, count );
+}
+
+/*
+ * Record the segments of the track about to be merged
+ */
+static void trw_journal_merge_segments ( TrwJournalMerge *edit )
+{
+  if ( !edit->segments )
+    edit->segments = g_ptr_array_new ();
+  if ( edit->trk->trackpoints )
+    for ( GList *iter = edit->trk->trackpoints->next; iter; iter = iter->next )
+      if ( VIK_TRACKPOINT(iter->data)->newsegment )
+        g_ptr_array_add ( edit->segments, iter->data );
+}
+
+static gboolean trw_journal_merge_undo ( TrwJournalMerge *edit, VikTrwLayer *vtl )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  for ( guint ii = 0; ii < edit->others->len; ii++ )
+    if ( trw_layer_contains_track ( vtl, g_ptr_array_index(edit->others, ii) ) )
+      return FALSE;
+
+  if ( edit->segments )
+    for ( guint ii = 0; ii < edit->segments->len; ii++ )
+      VIK_TRACKPOINT(g_ptr_array_index(edit->segments, ii))->newsegment = TRUE;
+
+  if ( edit->order ) {
+    // Rebuild the lists in the original order
+    g_list_free ( edit->trk->trackpoints );
+    guint pos = edit->order->len;
+    for ( gint ii = edit->others->len; ii >= 0; ii-- ) {
+      VikTrack *trk = ii ? g_ptr_array_index(edit->others, ii-1) : edit->trk;
+      GList *tps = NULL;
+      for ( guint jj = 0; jj < g_array_index(edit->counts, guint, ii); jj++ )
+        tps = g_list_prepend ( tps, g_ptr_array_index(edit->order, --pos) );
+      trk->trackpoints = tps;
+    }
+  }
+  else {
+    // Cut the list back up
+    GList *start = edit->trk->trackpoints;
+    for ( guint jj = 0; jj < g_array_index(edit->counts, guint, 0) && start; jj++ )
+      start = start->next;
+    for ( guint ii = 0; ii < edit->others->len; ii++ ) {
+      VikTrack *other = g_ptr_array_index ( edit->others, ii );
+      guint count = g_array_index ( edit->counts, guint, ii+1 );
+      if ( !count || !start ) {
+        other->trackpoints = NULL;
+        continue;
+      }
+      if ( start->prev ) {
+        start->prev->next = NULL;
+        start->prev = NULL;
+      }
+      else
+        edit->trk->trackpoints = NULL;
+      other->trackpoints = start;
+      for ( guint jj = 0; jj < count && start; jj++ )
+        start = start->next;
+    }
+  }
+
+  for ( guint ii = 0; ii < edit->others->len; ii++ ) {
+    VikTrack *other = g_ptr_array_index ( edit->others, ii );
+    vik_track_calculate_bounds ( other );
+    trw_layer_journal_add_track ( vtl, other );
+    trw_layer_journal_track_done ( vtl, other );
+  }
+  vik_track_calculate_bounds ( edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  edit->undone = TRUE;
+  return TRUE;
+}
+
+static gboolean trw_journal_merge_redo ( TrwJournalMerge *edit, VikTrwLayer *vtl )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  for ( guint ii = 0; ii < edit->others->len; ii++ ) {
+    VikTrack *other = g_ptr_array_index ( edit->others, ii );
+    if ( !trw_layer_contains_track ( vtl, other ) || !trw_layer_journal_track_unchanged ( vtl, other ) )
+      return FALSE;
+  }
+
+  // Join on all the others
+  GList *others = NULL;
+  for ( gint ii = edit->others->len-1; ii >= 0; ii-- )
+    others = g_list_prepend ( others, g_ptr_array_index(edit->others, ii) );
+  vik_track_steal_and_append_tracks ( edit->trk, others );
+  g_list_free ( others );
+  for ( guint ii = 0; ii < edit->others->len; ii++ )
+    trw_layer_journal_remove_track ( vtl, g_ptr_array_index(edit->others, ii) );
+
+  // Neither reordering nor merging segments changes the bounds
+  if ( edit->order ) {
+    edit->trk->trackpoints = g_list_sort ( edit->trk->trackpoints, trackpoint_compare );
+    vik_track_changed ( edit->trk );
+  }
+  if ( edit->segments )
+    (void)vik_track_merge_segments ( edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  edit->undone = FALSE;
+  return TRUE;
+}
+
+static void trw_journal_merge_free ( TrwJournalMerge *edit )
+{
+  for ( guint ii = 0; ii < edit->others->len; ii++ )
+    vik_track_free ( g_ptr_array_index(edit->others, ii) );
+  g_ptr_array_free ( edit->others, TRUE );
+  g_array_free ( edit->counts, TRUE );
+  if ( edit->order )
+    g_ptr_array_free ( edit->order, TRUE );
+  if ( edit->segments )
+    g_ptr_array_free ( edit->segments, TRUE );
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_merge_funcs = {
+  (VikJournalEditFunc) trw_journal_merge_undo,
+  (VikJournalEditFunc) trw_journal_merge_redo,
+  (VikJournalFreeFunc) trw_journal_merge_free,
+};
+
+/*
+ * Put a merge in the journal, once the recorded other tracks have been merged into the track
+ */
+static void trw_layer_journal_add_merge ( VikTrwLayer *vtl, TrwJournalMerge *edit )
+{
+  if ( !edit->others->len ) {
+    trw_journal_merge_free ( edit );
+    return;
+  }
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  for ( guint ii = 0; ii < edit->others->len; ii++ )
+    trw_layer_journal_track_done ( vtl, g_ptr_array_index(edit->others, ii) );
+
+  gsize size = sizeof(*edit) + edit->others->len * (sizeof(VikTrack) + sizeof(gpointer) + sizeof(guint));
+  if ( edit->order )
+    size += edit->order->len * sizeof(gpointer);
+  if ( edit->segments )
+    size += edit->segments->len * sizeof(gpointer);
+  gchar *label = g_strdup_printf ( edit->trk->is_route ? _("Merge Route %s") : _("Merge Track %s"), edit->trk->name );
+  trw_layer_journal_add ( vtl, label, &trw_journal_merge_funcs, edit, size );
+  g_free ( label );
+}
+
+/*
+ * Moving a trackpoint
+ */
+typedef struct {
+  VikTrack *trk;
+  VikTrackpoint *tp;
+  VikCoord coord[2]; // Before and after
+} TrwJournalMove;
+
+static gboolean trw_journal_move_set ( TrwJournalMove *edit, VikTrwLayer *vtl, guint which )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  edit->tp->coord = edit->coord[which];
+  vik_track_calculate_bounds ( edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  return TRUE;
+}
+
+static gboolean trw_journal_move_undo ( TrwJournalMove *edit, VikTrwLayer *vtl )
+{
+  return trw_journal_move_set ( edit, vtl, 0 );
+}
+
+static gboolean trw_journal_move_redo ( TrwJournalMove *edit, VikTrwLayer *vtl )
+{
+  return trw_journal_move_set ( edit, vtl, 1 );
+}
+
+static void trw_journal_move_free ( TrwJournalMove *edit )
+{
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_move_funcs = {
+  (VikJournalEditFunc) trw_journal_move_undo,
+  (VikJournalEditFunc) trw_journal_move_redo,
+  (VikJournalFreeFunc) trw_journal_move_free,
+};
+
+static void trw_layer_move_trackpoint_journalled ( VikTrwLayer *vtl, VikTrack *trk, VikTrackpoint *tp, const VikCoord *coord )
+{
+  TrwJournalMove *edit = g_new ( TrwJournalMove, 1 );
+  edit->trk = trk;
+  vik_track_ref ( trk );
+  edit->tp = tp;
+  edit->coord[0] = tp->coord;
+  edit->coord[1] = *coord;
+  tp->coord = *coord;
+  vik_track_calculate_bounds ( trk );
+  trw_layer_journal_track_done ( vtl, trk );
+  trw_layer_journal_add ( vtl, _("Move Trackpoint"), &trw_journal_move_funcs, edit, sizeof(*edit) );
+}
+
+/*
+ * Applying DEM data: only the altitudes that changed are recorded
+ */
+typedef struct {
+  VikTrackpoint *tp;
+  gdouble altitude[2]; // Before and after
+} TrwJournalAltitude;
+
+typedef struct {
+  VikTrack *trk;
+  GArray *changes; // Of TrwJournalAltitude, in track order
+} TrwJournalDem;
+
+static gboolean trw_journal_dem_set ( TrwJournalDem *edit, VikTrwLayer *vtl, guint which )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  guint jj = 0;
+  for ( GList *iter = edit->trk->trackpoints; iter && jj < edit->changes->len; iter = iter->next ) {
+    TrwJournalAltitude *change = &g_array_index ( edit->changes, TrwJournalAltitude, jj );
+    if ( iter->data == change->tp ) {
+      change->tp->altitude = change->altitude[which];
+      jj++;
+    }
+  }
+  vik_track_changed ( edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  return TRUE;
+}
+
+static gboolean trw_journal_dem_undo ( TrwJournalDem *edit, VikTrwLayer *vtl )
+{
+  return trw_journal_dem_set ( edit, vtl, 0 );
+}
+
+static gboolean trw_journal_dem_redo ( TrwJournalDem *edit, VikTrwLayer *vtl )
+{
+  return trw_journal_dem_set ( edit, vtl, 1 );
+}
+
+static void trw_journal_dem_free ( TrwJournalDem *edit )
+{
+  g_array_free ( edit->changes, TRUE );
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static const VikJournalEditFuncs trw_journal_dem_funcs = {
+  (VikJournalEditFunc) trw_journal_dem_undo,
+  (VikJournalEditFunc) trw_journal_dem_redo,
+  (VikJournalFreeFunc) trw_journal_dem_free,
+};
+
+static GArray *trw_journal_dem_before ( VikTrack *trk )
+{
+  GArray *before = g_array_sized_new ( FALSE, FALSE, sizeof(gdouble), vik_track_get_tp_count(trk) );
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next )
+    g_array_append_val ( before, VIK_TRACKPOINT(iter->data)->altitude );
+  return before;
+}
+
+/**
+ * Record the altitudes of the track that differ from those @before
+ */
+static TrwJournalDem *trw_journal_dem_new ( VikTrwLayer *vtl, VikTrack *trk, GArray *before, gulong changed )
+{
+  TrwJournalDem *edit = g_new ( TrwJournalDem, 1 );
+  edit->trk = trk;
+  vik_track_ref ( trk );
+  edit->changes = g_array_sized_new ( FALSE, FALSE, sizeof(TrwJournalAltitude), changed );
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gdouble old_alt = g_array_index ( before, gdouble, ii );
+    if ( !(tp->altitude == old_alt || (isnan(tp->altitude) && isnan(old_alt))) ) {
+      TrwJournalAltitude change = { tp, { old_alt, tp->altitude } };
+      g_array_append_val ( edit->changes, change );
+    }
+  }
+  trw_layer_journal_track_done ( vtl, trk );
+  return edit;
+}
+
+static gulong trw_layer_apply_dem_data_journalled ( VikTrwLayer *vtl, VikTrack *trk, gboolean skip_existing_elevations )
+{
+  GArray *before = trw_journal_dem_before ( trk );
+
+  gulong changed = vik_track_apply_dem_data ( trk, skip_existing_elevations );
+
+  if ( changed ) {
+    TrwJournalDem *edit = trw_journal_dem_new ( vtl, trk, before, changed );
+    trw_layer_journal_add ( vtl, _("Apply DEM Data"), &trw_journal_dem_funcs, edit, sizeof(*edit) + edit->changes->len * sizeof(TrwJournalAltitude) );
+  }
+  g_array_free ( before, TRUE );
+  return changed;
+}
+
+/*
+ * Applying DEM data to many tracks at once: a single edit of all of them
+ */
+static gboolean trw_journal_dems_set ( GPtrArray *edits, VikTrwLayer *vtl, guint which )
+{
+  gboolean ans = FALSE;
+  for ( guint ii = 0; ii < edits->len; ii++ )
+    if ( trw_journal_dem_set ( g_ptr_array_index(edits, ii), vtl, which ) )
+      ans = TRUE;
+  return ans;
+}
+
+static gboolean trw_journal_dems_undo ( GPtrArray *edits, VikTrwLayer *vtl )
+{
+  return trw_journal_dems_set ( edits, vtl, 0 );
+}
+
+static gboolean trw_journal_dems_redo ( GPtrArray *edits, VikTrwLayer *vtl )
+{
+  return trw_journal_dems_set ( edits, vtl, 1 );
+}
+
+static void trw_journal_dems_free ( GPtrArray *edits )
+{
+  g_ptr_array_free ( edits, TRUE );
+}
+
+static const VikJournalEditFuncs trw_journal_dems_funcs = {
+  (VikJournalEditFunc) trw_journal_dems_undo,
+  (VikJournalEditFunc) trw_journal_dems_redo,
+  (VikJournalFreeFunc) trw_journal_dems_free,
+};
+
+/*
+ * Cleaning up tracks: the order of the trackpoints (and where segments start) before and after,
+ *  with the removed trackpoints kept by the edit
+ */
+typedef struct {
+  VikTrackpoint *tp;
+  gboolean newsegment;
+} TrwJournalPointState;
+
+typedef struct {
+  VikTrack *trk;
+  GArray *states[2];  // Of TrwJournalPointState, before and after
+  GPtrArray *removed;
+  gboolean undone;    // When undone the removed trackpoints are back in the track
+} TrwJournalClean;
+
+static GArray *trw_journal_clean_states ( VikTrack *trk )
+{
+  GArray *states = g_array_sized_new ( FALSE, FALSE, sizeof(TrwJournalPointState), vik_track_get_tp_count(trk) );
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    TrwJournalPointState state = { VIK_TRACKPOINT(iter->data), VIK_TRACKPOINT(iter->data)->newsegment };
+    g_array_append_val ( states, state );
+  }
+  return states;
+}
+
+static gboolean trw_journal_clean_set ( TrwJournalClean *edit, VikTrwLayer *vtl, guint which )
+{
+  if ( !trw_layer_contains_track ( vtl, edit->trk ) || !trw_layer_journal_track_unchanged ( vtl, edit->trk ) )
+    return FALSE;
+  trw_layer_cancel_tps_of_track ( vtl, edit->trk );
+  GArray *states = edit->states[which];
+  GList *tps = NULL;
+  for ( gint ii = states->len-1; ii >= 0; ii-- ) {
+    TrwJournalPointState *state = &g_array_index ( states, TrwJournalPointState, ii );
+    state->tp->newsegment = state->newsegment;
+    tps = g_list_prepend ( tps, state->tp );
+  }
+  g_list_free ( edit->trk->trackpoints );
+  edit->trk->trackpoints = tps;
+  edit->undone = (which == 0);
+  vik_track_calculate_bounds ( edit->trk );
+  vik_track_changed ( edit->trk );
+  trw_layer_journal_track_done ( vtl, edit->trk );
+  return TRUE;
+}
+
+static void trw_journal_clean_free ( TrwJournalClean *edit )
+{
+  if ( !edit->undone )
+    g_ptr_array_foreach ( edit->removed, (GFunc)vik_trackpoint_free, NULL );
+  g_ptr_array_free ( edit->removed, TRUE );
+  g_array_free ( edit->states[0], TRUE );
+  g_array_free ( edit->states[1], TRUE );
+  vik_track_free ( edit->trk );
+  g_free ( edit );
+}
+
+static gboolean trw_journal_cleans_set ( GPtrArray *edits, VikTrwLayer *vtl, guint which )
+{
+  gboolean ans = FALSE;
+  for ( guint ii = 0; ii < edits->len; ii++ )
+    if ( trw_journal_clean_set ( g_ptr_array_index(edits, ii), vtl, which ) )
+      ans = TRUE;
+  return ans;
+}
+
+static gboolean trw_journal_cleans_undo ( GPtrArray *edits, VikTrwLayer *vtl )
+{
+  return trw_journal_cleans_set ( edits, vtl, 0 );
+}
+
+static gboolean trw_journal_cleans_redo ( GPtrArray *edits, VikTrwLayer *vtl )
+{
+  return trw_journal_cleans_set ( edits, vtl, 1 );
+}
+
+static void trw_journal_cleans_free ( GPtrArray *edits )
+{
+  g_ptr_array_free ( edits, TRUE );
+}
+
+static const VikJournalEditFuncs trw_journal_cleans_funcs = {
+  (VikJournalEditFunc) trw_journal_cleans_undo,
+  (VikJournalEditFunc) trw_journal_cleans_redo,
+  (VikJournalFreeFunc) trw_journal_cleans_free,
+};
+
+static void track_add_to_array ( const gpointer id, VikTrack *tr, GPtrArray *array )
+{
+  g_ptr_array_add ( array, tr );
+}
+
+typedef struct {
+  GPtrArray *tracks;
+  const VikTrackCleanParams *params;
+  guint threads;
+  gboolean journal;
+  gulong *removed;          // Per track
+  TrwJournalClean **edits;  // Per track, when journalled
+} CleanBatch;
+
+/**
+ * Each item cleans every 'threads'th track
+ */
+static void track_clean_item ( guint index, CleanBatch *batch )
+{
+  for ( guint ii = index; ii < batch->tracks->len; ii += batch->threads ) {
+    VikTrack *trk = g_ptr_array_index ( batch->tracks, ii );
+    if ( !batch->journal ) {
+      batch->removed[ii] = vik_track_clean ( trk, batch->params, NULL );
+      continue;
+    }
+    GArray *before = trw_journal_clean_states ( trk );
+    GPtrArray *removed = g_ptr_array_new ();
+    batch->removed[ii] = vik_track_clean ( trk, batch->params, removed );
+    if ( batch->removed[ii] ) {
+      TrwJournalClean *edit = g_new0 ( TrwJournalClean, 1 );
+      edit->trk = trk;
+      edit->states[0] = before;
+      edit->states[1] = trw_journal_clean_states ( trk );
+      edit->removed = removed;
+      batch->edits[ii] = edit;
+    }
+    else {
+      g_array_free ( before, TRUE );
+      g_ptr_array_free ( removed, TRUE );
+    }
+  }
+}
+
+/**
+ * Clean up all the tracks, spread over several threads when there are enough of them
+ *  (the tracks are otherwise left alone whilst waiting for this)
+ * When journalled, it can be undone as a single edit
+ *
+ * Returns: The number of trackpoints removed
+ */
+static gulong trw_layer_clean_tracks ( VikTrwLayer *vtl, GHashTable *tracks, const VikTrackCleanParams *params, gboolean journal )
+{
+  CleanBatch batch;
+  batch.tracks = g_ptr_array_sized_new ( g_hash_table_size(tracks) );
+  g_hash_table_foreach ( tracks, (GHFunc) track_add_to_array, batch.tracks );
+  batch.params = params;
+  batch.threads = MAX ( 1, MIN ( a_background_get_cpu_workers () + 1, batch.tracks->len ) );
+  batch.journal = journal;
+  batch.removed = g_new0 ( gulong, MAX(1, batch.tracks->len) );
+  batch.edits = g_new0 ( TrwJournalClean*, MAX(1, batch.tracks->len) );
+
+  // Any selected trackpoint may be removed
+  for ( guint ii = 0; ii < batch.tracks->len; ii++ )
+    trw_layer_cancel_tps_of_track ( vtl, g_ptr_array_index(batch.tracks, ii) );
+
+  a_background_parallel ( (vik_thr_index_func)track_clean_item, &batch, batch.threads );
+
+  gulong removed = 0;
+  GPtrArray *edits = g_ptr_array_new_with_free_func ( (GDestroyNotify)trw_journal_clean_free );
+  gsize size = sizeof(GPtrArray);
+  for ( guint ii = 0; ii < batch.tracks->len; ii++ ) {
+    removed += batch.removed[ii];
+    TrwJournalClean *edit = batch.edits[ii];
+    if ( edit ) {
+      vik_track_ref ( edit->trk );
+      trw_layer_journal_track_done ( vtl, edit->trk );
+      g_ptr_array_add ( edits, edit );
+      size += sizeof(*edit) + (edit->states[0]->len + edit->states[1]->len) * sizeof(TrwJournalPointState) +
+        edit->removed->len * sizeof(VikTrackpoint);
+    }
+  }
+  if ( edits->len )
+    trw_layer_journal_add ( vtl, _("Clean Up Tracks"), &trw_journal_cleans_funcs, edits, size );
+  else
+    g_ptr_array_free ( edits, TRUE );
+
+  g_free ( batch.edits );
+  g_free ( batch.removed );
+  g_ptr_array_free ( batch.tracks, TRUE );
+  return removed;
+}
 
-  close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_TRACKS );
+static void trw_layer_journal_done ( VikTrwLayer *vtl, const gchar *msg )
+{
+  vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, msg );
+  // Whatever changed, update everything that may depend on it
+  trw_layer_calculate_bounds_waypoints ( vtl );
+  vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
 }
 
-void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
+/**
+ * vik_trw_layer_undo:
+ *
+ * Undo the most recent edit of the layer (that hasn't been undone already)
+ *
+ * Returns: TRUE if an edit was undone
+ */
+gboolean vik_trw_layer_undo ( VikTrwLayer *vtl )
 {
-  if ( vtl->wpwin ) {
-    vik_trw_layer_wpwin_destroy ( vtl->wpwin );
-    vtl->wpwin = NULL;
+  const gchar *label = vtl->journal ? vik_journal_get_undo_label ( vtl->journal ) : NULL;
+  if ( !label ) {
+    vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, _("Nothing to undo") );
+    return FALSE;
   }
-  vtl->wpwin_wpt = NULL;
-
-  vtl->current_wp = NULL;
-  vtl->current_wp_id = NULL;
-  vtl->moving_wp = FALSE;
-
-  highest_wp_number_reset(vtl);
-
-  g_hash_table_foreach(vtl->waypoints_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
-  g_hash_table_remove_all(vtl->waypoints_iters);
-
-  if ( g_hash_table_size (vtl->waypoints) > 0 )
-    vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
-  g_hash_table_remove_all(vtl->waypoints);
+  gchar *name = g_strdup ( label );
+  gchar *msg;
 
-  vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+  trw_layer_cancel_current_tp ( vtl, FALSE );
+  gboolean undone = vik_journal_undo ( vtl->journal, vtl );
+  if ( undone )
+    msg = g_strdup_printf ( _("Undone: %s"), name );
+  else {
+    msg = g_strdup_printf ( _("Can not undo %s as it has since been changed in another way"), name );
+    g_hash_table_remove_all ( vtl->journal_serials );
+  }
+  trw_layer_journal_done ( vtl, msg );
+  g_free ( msg );
+  g_free ( name );
+  return undone;
 }
 
-static void trw_layer_delete_all_tracks ( menu_array_layer values )
+/**
+ * vik_trw_layer_redo:
+ *
+ * Redo the most recent undone edit of the layer
+ *
+ * Returns: TRUE if an edit was redone
+ */
+gboolean vik_trw_layer_redo ( VikTrwLayer *vtl )
 {
-  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
-  // Get confirmation from the user
-  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
-			    _("Are you sure you want to delete all tracks in %s?"),
-			    vik_layer_get_name ( VIK_LAYER(vtl) ) ) ) {
-    vik_trw_layer_delete_all_tracks (vtl);
-    if ( values[MA_VLP] )
-      vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
+  const gchar *label = vtl->journal ? vik_journal_get_redo_label ( vtl->journal ) : NULL;
+  if ( !label ) {
+    vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, _("Nothing to redo") );
+    return FALSE;
   }
+  gchar *name = g_strdup ( label );
+  gchar *msg;
+
+  trw_layer_cancel_current_tp ( vtl, FALSE );
+  gboolean redone = vik_journal_redo ( vtl->journal, vtl );
+  if ( redone )
+    msg = g_strdup_printf ( _("Redone: %s"), name );
+  else
+    msg = g_strdup_printf ( _("Can not redo %s as it has since been changed in another way"), name );
+  trw_layer_journal_done ( vtl, msg );
+  g_free ( msg );
+  g_free ( name );
+  return redone;
 }
 
-static void trw_layer_delete_all_routes ( menu_array_layer values )
+static void trw_layer_undo_cb ( menu_array_layer values )
 {
-  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
-  // Get confirmation from the user
-  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
-                            _("Are you sure you want to delete all routes in %s?"),
-                            vik_layer_get_name ( VIK_LAYER(vtl) ) ) )
-    vik_trw_layer_delete_all_routes (vtl);
+  (void)vik_trw_layer_undo ( VIK_TRW_LAYER(values[MA_VTL]) );
 }
 
-static void trw_layer_delete_all_waypoints ( menu_array_layer values )
+static void trw_layer_redo_cb ( menu_array_layer values )
 {
-  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
-  // Get confirmation from the user
-  if ( a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
-			    _("Are you sure you want to delete all waypoints in %s?"),
-			    vik_layer_get_name ( VIK_LAYER(vtl) ) ) )
-    vik_trw_layer_delete_all_waypoints (vtl);
+  (void)vik_trw_layer_redo ( VIK_TRW_LAYER(values[MA_VTL]) );
 }
 
 static void trw_layer_delete_item ( menu_array_sublayer values )
@@ -5883,7 +8765,7 @@ static void trw_layer_delete_item ( menu_array_sublayer values )
             _("Are you sure you want to delete the waypoint \"%s\"?"),
             wp->name ) )
           return;
-      was_visible = trw_layer_delete_waypoint ( vtl, wp );
+      was_visible = trw_layer_delete_waypoint_journalled ( vtl, wp );
       trw_layer_calculate_bounds_waypoints ( vtl );
       // Reset layer timestamp in case it has now changed
       vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
@@ -5899,7 +8781,7 @@ static void trw_layer_delete_item ( menu_array_sublayer values )
 				  _("Are you sure you want to delete the track \"%s\"?"),
 				  trk->name ) )
           return;
-      was_visible = vik_trw_layer_delete_track ( vtl, trk );
+      was_visible = trw_layer_delete_track_journalled ( vtl, trk );
       // Reset layer timestamp in case it has now changed
       vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
       if ( values[MA_VLP] )
@@ -5916,7 +8798,7 @@ static void trw_layer_delete_item ( menu_array_sublayer values )
                                     _("Are you sure you want to delete the route \"%s\"?"),
                                     trk->name ) )
           return;
-      was_visible = vik_trw_layer_delete_route ( vtl, trk );
+      was_visible = trw_layer_delete_track_journalled ( vtl, trk );
     }
   }
   if ( was_visible )
@@ -5951,6 +8833,7 @@ void trw_layer_treeview_waypoint_align_time ( VikTrwLayer *vtl, VikWaypoint *wp
 void trw_layer_waypoint_rename ( VikTrwLayer *vtl, VikWaypoint *wp, const gchar *new_name )
 {
   vik_waypoint_set_name ( wp, new_name );
+  trw_layer_name_index_rename ( vtl, vtl->waypoints, wp, wp->name );
 
   // Now update the treeview as well
   wpu_udata udataU;
@@ -5972,6 +8855,9 @@ void trw_layer_waypoint_rename ( VikTrwLayer *vtl, VikWaypoint *wp, const gchar
 
 void trw_layer_waypoint_properties_changed ( VikTrwLayer *vtl, VikWaypoint *wp )
 {
+  // Name may have changed
+  trw_layer_name_index_rename ( vtl, vtl->waypoints, wp, wp->name );
+
   // Find in treeview
   wpu_udata udataU;
   udataU.wp   = wp;
@@ -6292,11 +9178,12 @@ static void trw_layer_convert_to_track ( menu_array_sublayer values )
       tp->altitude  = wpt->altitude;
       tp->speed     = wpt->speed;
       tp->course    = wpt->course;
-      tp->fix_mode  = wpt->fix_mode;
-      tp->nsats     = wpt->nsats;
-      tp->hdop      = wpt->hdop;
-      tp->vdop      = wpt->vdop;
-      tp->pdop      = wpt->pdop;
+      const VikWaypointExtra *extra = vik_waypoint_get_extra ( wpt );
+      tp->fix_mode  = extra->fix_mode;
+      tp->nsats     = extra->nsats;
+      tp->hdop      = extra->hdop;
+      tp->vdop      = extra->vdop;
+      tp->pdop      = extra->pdop;
       trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
       count++;
     }
@@ -6347,11 +9234,13 @@ static void trw_layer_convert_to_waypoints ( menu_array_sublayer values )
     wpt->altitude  = tp->altitude;
     wpt->speed     = tp->speed;
     wpt->course    = tp->course;
-    wpt->fix_mode  = tp->fix_mode;
-    wpt->nsats     = tp->nsats;
-    wpt->hdop      = tp->hdop;
-    wpt->vdop      = tp->vdop;
-    wpt->pdop      = tp->pdop;
+    VikWaypointExtra *extra = vik_waypoint_edit_extra ( wpt );
+    extra->fix_mode  = tp->fix_mode;
+    extra->nsats     = tp->nsats;
+    extra->hdop      = tp->hdop;
+    extra->vdop      = tp->vdop;
+    extra->pdop      = tp->pdop;
+    vik_waypoint_trim_extra ( wpt );
     gchar *name = g_strdup_printf ( "%s%05d", trk->name, count++ );
     vik_trw_layer_add_waypoint ( vtl, name, wpt );
     g_free ( name );
@@ -6538,11 +9427,231 @@ static void trw_layer_rotate ( menu_array_sublayer values )
     seg = g_list_first ( track->trackpoints );
     tp = VIK_TRACKPOINT(seg->data);
     tp->newsegment = TRUE;
+    vik_track_changed ( track );
 
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
 
+/*** Simplifying a track, with the result shown on the map as the tolerance is changed ***/
+
+typedef struct {
+  gint ref_count;
+  VikTrwLayer *vtl;         // Referenced
+  VikTrack *trk;            // Referenced
+  gint subtype;
+  guint serial;             // When the positions were taken, so only an unchanged track is used
+  guint len;
+  gdouble *lat, *lon;
+  gdouble *times;           // NULL when the track has no timestamps
+  gboolean *newsegment;
+  gdouble *significance[2]; // By shape; by shape and timing
+} TrwSimplify;
+
+typedef struct {
+  TrwSimplify *ts;
+  GtkWidget *method;
+  GtkWidget *tolerance;
+  GtkWidget *count;
+} TrwSimplifyDialog;
+
+static TrwSimplify *trw_simplify_ref ( TrwSimplify *ts )
+{
+  g_atomic_int_inc ( &ts->ref_count );
+  return ts;
+}
+
+static void trw_simplify_unref ( TrwSimplify *ts )
+{
+  if ( !g_atomic_int_dec_and_test ( &ts->ref_count ) )
+    return;
+  g_object_unref ( ts->vtl );
+  vik_track_free ( ts->trk );
+  g_free ( ts->lat );
+  g_free ( ts->lon );
+  g_free ( ts->times );
+  g_free ( ts->newsegment );
+  g_free ( ts->significance[0] );
+  g_free ( ts->significance[1] );
+  g_free ( ts );
+}
+
+static const gdouble *trw_simplify_dialog_significance ( TrwSimplifyDialog *tsd )
+{
+  gint method = tsd->method ? gtk_combo_box_get_active ( GTK_COMBO_BOX(tsd->method) ) : 0;
+  return tsd->ts->significance[method == 1 ? 1 : 0];
+}
+
+/**
+ * Show which points would be kept for the current settings
+ */
+static void trw_simplify_dialog_update ( GtkWidget *widget, TrwSimplifyDialog *tsd )
+{
+  TrwSimplify *ts = tsd->ts;
+  const gdouble *significance = trw_simplify_dialog_significance ( tsd );
+  gdouble tolerance = gtk_spin_button_get_value ( GTK_SPIN_BUTTON(tsd->tolerance) );
+
+  if ( ts->vtl->simplify_preview )
+    g_ptr_array_set_size ( ts->vtl->simplify_preview, 0 );
+  else
+    ts->vtl->simplify_preview = g_ptr_array_new ();
+  guint ii = 0;
+  for ( GList *iter = ts->trk->trackpoints; iter && ii < ts->len; iter = iter->next, ii++ )
+    if ( significance[ii] >= tolerance )
+      g_ptr_array_add ( ts->vtl->simplify_preview, iter->data );
+
+  gchar *msg = g_strdup_printf ( _("Points: %d of %d"), ts->vtl->simplify_preview->len, ts->len );
+  gtk_label_set_text ( GTK_LABEL(tsd->count), msg );
+  g_free ( msg );
+
+  trw_layer_draw_cache_invalidate ( ts->vtl );
+  vik_layer_emit_update ( VIK_LAYER(ts->vtl), FALSE );
+}
+
+/**
+ * In the main thread, once the simplifications are worked out, let the user choose how much
+ */
+static gboolean trw_simplify_dialog ( TrwSimplify *ts )
+{
+  VikTrwLayer *vtl = ts->vtl;
+  if ( vik_track_get_serial(ts->trk) != ts->serial || !trw_layer_contains_track(vtl, ts->trk) ) {
+    trw_simplify_unref ( ts );
+    return FALSE;
+  }
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Simplify"),
+                                                    VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT,
+                                                    GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gtk_dialog_set_default_response ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+  GtkBox *vbox = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  TrwSimplifyDialog tsd = { ts, NULL, NULL, NULL };
+
+  if ( ts->times ) {
+    GtkWidget *hbox = gtk_hbox_new ( FALSE, 5 );
+    tsd.method = vik_combo_box_text_new ();
+    vik_combo_box_text_append ( tsd.method, _("Shape") );
+    vik_combo_box_text_append ( tsd.method, _("Shape and timing") );
+    gtk_combo_box_set_active ( GTK_COMBO_BOX(tsd.method), 0 );
+    gtk_widget_set_tooltip_text ( tsd.method, _("Shape and timing also keeps the points needed for where the track was when, such as stops") );
+    gtk_box_pack_start ( GTK_BOX(hbox), gtk_label_new(_("Method:")), FALSE, FALSE, 5 );
+    gtk_box_pack_start ( GTK_BOX(hbox), tsd.method, TRUE, TRUE, 5 );
+    gtk_box_pack_start ( vbox, hbox, FALSE, FALSE, 5 );
+  }
+
+  GtkWidget *hbox = gtk_hbox_new ( FALSE, 5 );
+  tsd.tolerance = gtk_spin_button_new_with_range ( 0.1, 10000.0, 1.0 );
+  gtk_spin_button_set_digits ( GTK_SPIN_BUTTON(tsd.tolerance), 1 );
+  gtk_spin_button_set_value ( GTK_SPIN_BUTTON(tsd.tolerance), 10.0 );
+  gtk_widget_set_tooltip_text ( tsd.tolerance, _("How far the simplified track may be from any of the original points") );
+  gtk_box_pack_start ( GTK_BOX(hbox), gtk_label_new(_("Tolerance (m):")), FALSE, FALSE, 5 );
+  gtk_box_pack_start ( GTK_BOX(hbox), tsd.tolerance, TRUE, TRUE, 5 );
+  gtk_box_pack_start ( vbox, hbox, FALSE, FALSE, 5 );
+
+  tsd.count = gtk_label_new ( NULL );
+  gtk_box_pack_start ( vbox, tsd.count, FALSE, FALSE, 5 );
+
+  if ( tsd.method )
+    g_signal_connect ( G_OBJECT(tsd.method), "changed", G_CALLBACK(trw_simplify_dialog_update), &tsd );
+  g_signal_connect ( G_OBJECT(tsd.tolerance), "value-changed", G_CALLBACK(trw_simplify_dialog_update), &tsd );
+  trw_simplify_dialog_update ( NULL, &tsd );
+
+  gtk_widget_show_all ( dialog );
+  // The track may be changed elsewhere (e.g. by live tracking) while the dialog is open
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT &&
+       vik_track_get_serial(ts->trk) == ts->serial && trw_layer_contains_track(vtl, ts->trk) ) {
+    const gdouble *significance = trw_simplify_dialog_significance ( &tsd );
+    gdouble tolerance = gtk_spin_button_get_value ( GTK_SPIN_BUTTON(tsd.tolerance) );
+    VikTrack *trk = vik_track_copy_simplified ( ts->trk, significance, tolerance );
+    gchar *name = trw_layer_new_unique_sublayer_name ( vtl, ts->subtype, ts->trk->name );
+    if ( ts->subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+      vik_trw_layer_add_route ( vtl, name, trk );
+    else
+      vik_trw_layer_add_track ( vtl, name, trk );
+    g_free ( name );
+  }
+  gtk_widget_destroy ( dialog );
+
+  g_ptr_array_free ( vtl->simplify_preview, TRUE );
+  vtl->simplify_preview = NULL;
+  trw_layer_draw_cache_invalidate ( vtl );
+  vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+  trw_simplify_unref ( ts );
+  return FALSE;
+}
+
+static gint trw_simplify_thread ( TrwSimplify *ts, gpointer threaddata )
+{
+  ts->significance[0] = vik_track_simplify_significance ( ts->lat, ts->lon, NULL, ts->newsegment, ts->len );
+  if ( a_background_thread_progress ( threaddata, ts->times ? 0.5 : 1.0 ) != 0 )
+    return -1;
+  if ( ts->times ) {
+    ts->significance[1] = vik_track_simplify_significance ( ts->lat, ts->lon, ts->times, ts->newsegment, ts->len );
+    if ( a_background_thread_progress ( threaddata, 1.0 ) != 0 )
+      return -1;
+  }
+  gdk_threads_add_idle ( (GSourceFunc)trw_simplify_dialog, trw_simplify_ref(ts) );
+  return 0;
+}
+
+/**
+ * trw_layer_simplify:
+ *
+ * Create a new track with fewer points, that stays within a tolerance of the original.
+ * All tolerances are worked out at once in the background (as for drawing when zoomed out),
+ *  so then the result of any tolerance can be shown immediately
+ */
+static void trw_layer_simplify ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  gint subtype = GPOINTER_TO_INT (values[MA_SUBTYPE]);
+  VikTrack *track;
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  else
+    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+  if ( !track || !track->trackpoints )
+    return;
+
+  TrwSimplify *ts = g_malloc0 ( sizeof(TrwSimplify) );
+  ts->ref_count = 1;
+  ts->vtl = g_object_ref ( vtl );
+  vik_track_ref ( track );
+  ts->trk = track;
+  ts->subtype = subtype;
+  ts->serial = vik_track_get_serial ( track );
+  ts->len = vik_track_get_tp_count ( track );
+  ts->lat = g_new ( gdouble, ts->len );
+  ts->lon = g_new ( gdouble, ts->len );
+  ts->newsegment = g_new ( gboolean, ts->len );
+  if ( vik_track_get_tp_first(track) && !isnan(vik_track_get_tp_first(track)->timestamp) )
+    ts->times = g_new ( gdouble, ts->len );
+  guint ii = 0;
+  for ( GList *iter = track->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(tp->coord), &ll );
+    ts->lat[ii] = ll.lat;
+    ts->lon[ii] = ll.lon;
+    ts->newsegment[ii] = tp->newsegment;
+    if ( ts->times )
+      ts->times[ii] = tp->timestamp;
+  }
+
+  gchar *msg = g_strdup_printf ( _("Simplifying %s"), track->name );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                        msg,
+                        (vik_thr_func)trw_simplify_thread,
+                        ts,
+                        (vik_thr_free_func)trw_simplify_unref,
+                        NULL,
+                        1 );
+  g_free ( msg );
+}
+
 /**
  * trw_layer_track_rename:
  *
@@ -6715,50 +9824,376 @@ static gboolean trw_layer_dem_test ( VikTrwLayer *vtl, VikLayersPanel *vlp )
 }
 
 /**
- * apply_dem_data_common:
- *
- * A common function for applying the DEM values and reporting the results.
+ * apply_dem_data_common:
+ *
+ * A common function for applying the DEM values and reporting the results.
+ */
+static void apply_dem_data_common ( VikTrwLayer *vtl, VikLayersPanel *vlp, VikTrack *track, gboolean skip_existing_elevations )
+{
+  if ( !trw_layer_dem_test ( vtl, vlp ) )
+    return;
+
+  gulong changed = trw_layer_apply_dem_data_journalled ( vtl, track, skip_existing_elevations );
+  // Inform user how much was changed
+  gchar str[64];
+  const gchar *tmp_str = ngettext("%ld point adjusted", "%ld points adjusted", changed);
+  g_snprintf(str, 64, tmp_str, changed);
+  a_dialog_info_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), str);
+
+  if ( changed )
+    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+}
+
+static void trw_layer_apply_dem_data_all ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  VikTrack *track;
+  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  else
+    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+
+  if ( track )
+    apply_dem_data_common ( vtl, values[MA_VLP], track, FALSE );
+}
+
+static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  VikTrack *track;
+  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  else
+    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+
+  if ( track )
+    apply_dem_data_common ( vtl, values[MA_VLP], track, TRUE );
+}
+
+/*** Applying DEM data to all the tracks or waypoints of layers in the background ***/
+
+// Positions looked up by each part of the work, between checks for cancellation
+#define DEM_BATCH_CHUNK 4096
+
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrack *trk;   // Referenced
+  guint serial;    // When the positions were taken, so only an unchanged track gets the values
+  guint first;     // Index of the value for its first trackpoint
+} DemBatchTrack;
+
+typedef struct {
+  VikTrwLayer *vtl;
+  gpointer key;    // Waypoints aren't referenced, so found again by their key in the layer
+  VikWaypoint *wp;
+  VikCoord coord;  // When the position was taken, so only an unmoved waypoint gets the value
+  guint slot;      // Index of its value
+} DemBatchWaypoint;
+
+typedef struct {
+  gint ref_count;
+  GSList *layers;     // Referenced
+  GArray *tracks;     // Of DemBatchTrack
+  GArray *wpts;       // Of DemBatchWaypoint
+  GArray *coords;     // Positions of the trackpoints wanting a value
+  GArray *slots;      // The index of the value of each position
+  gint16 *elevs;      // Values for all the trackpoints of the tracks
+  guint *order;       // Of the positions, grouped by DEM tile
+  guint chunks;
+  gint done;          // Chunks finished
+  gpointer threaddata;
+} DemBatch;
+
+static DemBatch *dem_batch_ref ( DemBatch *db )
+{
+  g_atomic_int_inc ( &db->ref_count );
+  return db;
+}
+
+static void dem_batch_unref ( DemBatch *db )
+{
+  if ( !g_atomic_int_dec_and_test ( &db->ref_count ) )
+    return;
+  for ( guint ii = 0; ii < db->tracks->len; ii++ )
+    vik_track_free ( g_array_index(db->tracks, DemBatchTrack, ii).trk );
+  g_array_free ( db->tracks, TRUE );
+  g_array_free ( db->wpts, TRUE );
+  g_array_free ( db->coords, TRUE );
+  g_array_free ( db->slots, TRUE );
+  g_free ( db->elevs );
+  g_free ( db->order );
+  g_slist_free_full ( db->layers, g_object_unref );
+  g_free ( db );
+}
+
+static void dem_batch_add_track ( const gpointer id, VikTrack *trk, gpointer data[3] )
+{
+  DemBatch *db = data[0];
+  gboolean skip_existing = GPOINTER_TO_INT(data[2]);
+  DemBatchTrack dbt = { data[1], trk, vik_track_get_serial(trk), 0 };
+  guint slot = 0;
+  if ( db->tracks->len ) {
+    DemBatchTrack *last = &g_array_index ( db->tracks, DemBatchTrack, db->tracks->len-1 );
+    slot = last->first + vik_track_get_tp_count ( last->trk );
+  }
+  dbt.first = slot;
+  vik_track_ref ( trk );
+  g_array_append_val ( db->tracks, dbt );
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, slot++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    // Don't apply if the point already has a value and the overwrite is off
+    if ( !(skip_existing && !isnan(tp->altitude)) ) {
+      g_array_append_val ( db->coords, tp->coord );
+      g_array_append_val ( db->slots, slot );
+    }
+  }
+}
+
+static gint dem_batch_tile_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  const guint *tiles = user_data;
+  guint ta = tiles[*(const guint*)a];
+  guint tb = tiles[*(const guint*)b];
+  if ( ta != tb )
+    return ta < tb ? -1 : 1;
+  // Otherwise keep the track order, as consecutive points are the closest
+  return *(const guint*)a < *(const guint*)b ? -1 : (*(const guint*)a > *(const guint*)b);
+}
+
+/**
+ * Look up one chunk of the positions, in any thread
+ */
+static void dem_batch_item ( guint index, DemBatch *db )
+{
+  if ( a_background_cancelled(db->threaddata) )
+    return;
+  guint start = index * DEM_BATCH_CHUNK;
+  guint num = MIN ( DEM_BATCH_CHUNK, db->coords->len - start );
+  VikCoord *coords = g_new ( VikCoord, num );
+  gint16 *elevs = g_new ( gint16, num );
+  for ( guint ii = 0; ii < num; ii++ )
+    coords[ii] = g_array_index ( db->coords, VikCoord, db->order[start+ii] );
+  a_dems_get_elev_batch ( coords, num, VIK_DEM_INTERPOL_BEST, elevs );
+  for ( guint ii = 0; ii < num; ii++ )
+    db->elevs[g_array_index(db->slots, guint, db->order[start+ii])] = elevs[ii];
+  g_free ( elevs );
+  g_free ( coords );
+  (void)a_background_set_progress ( db->threaddata, (gdouble)(g_atomic_int_add(&db->done, 1) + 1) / db->chunks );
+}
+
+/**
+ * In the main thread, give the values to the tracks (unless changed meanwhile)
+ *  as one edit for each layer
+ */
+static gboolean dem_batch_apply ( DemBatch *db )
+{
+  gulong changed = 0;
+  GPtrArray *edits = NULL;
+  gsize size = 0;
+  VikTrwLayer *vtl = NULL;
+  for ( guint ii = 0; ii <= db->tracks->len; ii++ ) {
+    DemBatchTrack *dbt = ii < db->tracks->len ? &g_array_index ( db->tracks, DemBatchTrack, ii ) : NULL;
+    if ( vtl && (!dbt || dbt->vtl != vtl) ) {
+      if ( edits->len ) {
+        trw_layer_journal_add ( vtl, _("Apply DEM Data"), &trw_journal_dems_funcs, edits, size );
+        vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+      }
+      else
+        g_ptr_array_free ( edits, TRUE );
+      edits = NULL;
+    }
+    if ( !dbt )
+      break;
+    vtl = dbt->vtl;
+    if ( !edits ) {
+      edits = g_ptr_array_new_with_free_func ( (GDestroyNotify)trw_journal_dem_free );
+      size = sizeof(GPtrArray);
+    }
+
+    VikTrack *trk = dbt->trk;
+    if ( vik_track_get_serial(trk) != dbt->serial || !trw_layer_contains_track(vtl, trk) )
+      continue;
+    GArray *before = trw_journal_dem_before ( trk );
+    gulong num = 0;
+    guint slot = dbt->first;
+    for ( GList *iter = trk->trackpoints; iter; iter = iter->next, slot++ ) {
+      if ( db->elevs[slot] != VIK_DEM_INVALID_ELEVATION ) {
+        VIK_TRACKPOINT(iter->data)->altitude = db->elevs[slot];
+        num++;
+      }
+    }
+    if ( num ) {
+      vik_track_changed ( trk );
+      TrwJournalDem *edit = trw_journal_dem_new ( vtl, trk, before, num );
+      g_ptr_array_add ( edits, edit );
+      size += sizeof(*edit) + edit->changes->len * sizeof(TrwJournalAltitude);
+      changed += num;
+    }
+    g_array_free ( before, TRUE );
+  }
+
+  // Waypoints are grouped by layer too
+  gulong wpts_changed = 0;
+  gboolean layer_changed = FALSE;
+  for ( guint ii = 0; ii <= db->wpts->len; ii++ ) {
+    DemBatchWaypoint *dbw = ii < db->wpts->len ? &g_array_index ( db->wpts, DemBatchWaypoint, ii ) : NULL;
+    if ( layer_changed && (!dbw || dbw->vtl != vtl) ) {
+      vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+      layer_changed = FALSE;
+    }
+    if ( !dbw )
+      break;
+    vtl = dbw->vtl;
+    if ( db->elevs[dbw->slot] == VIK_DEM_INVALID_ELEVATION )
+      continue;
+    if ( g_hash_table_lookup(vtl->waypoints, dbw->key) != dbw->wp || !vik_coord_equals(&dbw->wp->coord, &dbw->coord) )
+      continue;
+    dbw->wp->altitude = (gdouble)db->elevs[dbw->slot];
+    wpts_changed++;
+    layer_changed = TRUE;
+  }
+
+  if ( vtl ) {
+    gchar str[64];
+    if ( db->wpts->len )
+      g_snprintf ( str, 64, ngettext("%ld waypoint changed", "%ld waypoints changed", wpts_changed), wpts_changed );
+    else
+      g_snprintf ( str, 64, ngettext("%ld point adjusted", "%ld points adjusted", changed), changed );
+    vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, str );
+  }
+  dem_batch_unref ( db );
+  return FALSE;
+}
+
+static gint dem_batch_thread ( DemBatch *db, gpointer threaddata )
+{
+  db->threaddata = threaddata;
+
+  // Group the positions by the whole degree tile they are in,
+  //  so each chunk mostly reads from a single DEM
+  guint num = db->coords->len;
+  guint *tiles = g_new ( guint, num );
+  db->order = g_new ( guint, num );
+  for ( guint ii = 0; ii < num; ii++ ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &g_array_index(db->coords, VikCoord, ii), &ll );
+    gint lat = CLAMP ( (gint)floor(ll.lat), -90, 89 );
+    gint lon = CLAMP ( (gint)floor(ll.lon), -180, 179 );
+    tiles[ii] = (lat + 90) * 360 + (lon + 180);
+    db->order[ii] = ii;
+  }
+  g_qsort_with_data ( db->order, num, sizeof(guint), dem_batch_tile_compare, tiles );
+  g_free ( tiles );
+
+  db->chunks = (num + DEM_BATCH_CHUNK - 1) / DEM_BATCH_CHUNK;
+  a_background_parallel ( (vik_thr_index_func)dem_batch_item, db, db->chunks );
+
+  if ( a_background_thread_progress ( threaddata, 1.0 ) != 0 )
+    return -1;
+  gdk_threads_add_idle ( (GSourceFunc)dem_batch_apply, dem_batch_ref(db) );
+  return 0;
+}
+
+/**
+ * Apply DEM data to the tracks, routes and/or waypoints of the layers in the background
  */
-static void apply_dem_data_common ( VikTrwLayer *vtl, VikLayersPanel *vlp, VikTrack *track, gboolean skip_existing_elevations )
+static void trw_layer_apply_dem_data_batch ( GList *vtls, gboolean tracks, gboolean routes, gboolean waypoints, gboolean skip_existing )
 {
-  if ( !trw_layer_dem_test ( vtl, vlp ) )
+  if ( !vtls )
     return;
+  DemBatch *db = g_malloc0 ( sizeof(DemBatch) );
+  db->ref_count = 1;
+  db->tracks = g_array_new ( FALSE, FALSE, sizeof(DemBatchTrack) );
+  db->wpts = g_array_new ( FALSE, FALSE, sizeof(DemBatchWaypoint) );
+  db->coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+  db->slots = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  for ( GList *iter = vtls; iter; iter = iter->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+    db->layers = g_slist_prepend ( db->layers, g_object_ref(vtl) );
+    gpointer data[3] = { db, vtl, GINT_TO_POINTER(skip_existing) };
+    if ( tracks )
+      g_hash_table_foreach ( vtl->tracks, (GHFunc)dem_batch_add_track, data );
+    if ( routes )
+      g_hash_table_foreach ( vtl->routes, (GHFunc)dem_batch_add_track, data );
+  }
+  guint total = 0;
+  if ( db->tracks->len ) {
+    DemBatchTrack *last = &g_array_index ( db->tracks, DemBatchTrack, db->tracks->len-1 );
+    total = last->first + vik_track_get_tp_count ( last->trk );
+  }
+  // The values for waypoints come after those of all the trackpoints
+  if ( waypoints ) {
+    for ( GList *iter = vtls; iter; iter = iter->next ) {
+      VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+      GHashTableIter hiter;
+      gpointer key, value;
+      g_hash_table_iter_init ( &hiter, vtl->waypoints );
+      while ( g_hash_table_iter_next (&hiter, &key, &value) ) {
+        VikWaypoint *wp = VIK_WAYPOINT(value);
+        // Don't apply if the waypoint already has a value and the overwrite is off
+        if ( skip_existing && !isnan(wp->altitude) )
+          continue;
+        DemBatchWaypoint dbw = { vtl, key, wp, wp->coord, total };
+        g_array_append_val ( db->wpts, dbw );
+        g_array_append_val ( db->coords, wp->coord );
+        g_array_append_val ( db->slots, total );
+        total++;
+      }
+    }
+  }
+  db->elevs = g_new ( gint16, MAX(1, total) );
+  for ( guint ii = 0; ii < total; ii++ )
+    db->elevs[ii] = VIK_DEM_INVALID_ELEVATION;
 
-  gulong changed = vik_track_apply_dem_data ( track, skip_existing_elevations );
-  // Inform user how much was changed
-  gchar str[64];
-  const gchar *tmp_str = ngettext("%ld point adjusted", "%ld points adjusted", changed);
-  g_snprintf(str, 64, tmp_str, changed);
-  a_dialog_info_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), str);
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vtls->data);
+  gchar *msg;
+  if ( waypoints && !tracks && !routes )
+    msg = g_strdup_printf ( ngettext("Applying DEM data to %d waypoint", "Applying DEM data to %d waypoints", db->wpts->len), db->wpts->len );
+  else
+    msg = g_strdup_printf ( ngettext("Applying DEM data to %d track", "Applying DEM data to %d tracks", db->tracks->len), db->tracks->len );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                        msg,
+                        (vik_thr_func)dem_batch_thread,
+                        db,
+                        (vik_thr_free_func)dem_batch_unref,
+                        NULL,
+                        1 );
+  g_free ( msg );
+}
 
-  if ( changed )
-    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+/**
+ * vik_trw_layer_apply_dem_data_all:
+ * @vtls:          The #VikTrwLayer s
+ * @skip_existing: When TRUE, don't change the elevation if a trackpoint already has a value
+ *
+ * Apply DEM data to every track and route of the layers, as a background job
+ *  that can be undone as a single edit of each layer
+ */
+void vik_trw_layer_apply_dem_data_all ( GList *vtls, gboolean skip_existing )
+{
+  trw_layer_apply_dem_data_batch ( vtls, TRUE, TRUE, FALSE, skip_existing );
 }
 
-static void trw_layer_apply_dem_data_all ( menu_array_sublayer values )
+static void trw_layer_apply_dem_data_tracks ( menu_array_sublayer values, gboolean skip_existing )
 {
   VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
-  VikTrack *track;
-  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
-    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
-  else
-    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
-
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, FALSE );
+  if ( !trw_layer_dem_test ( vtl, values[MA_VLP] ) )
+    return;
+  gboolean routes = GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTES;
+  GList *vtls = g_list_append ( NULL, vtl );
+  trw_layer_apply_dem_data_batch ( vtls, !routes, routes, FALSE, skip_existing );
+  g_list_free ( vtls );
 }
 
-static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
+static void trw_layer_apply_dem_data_tracks_all ( menu_array_sublayer values )
 {
-  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
-  VikTrack *track;
-  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
-    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
-  else
-    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+  trw_layer_apply_dem_data_tracks ( values, FALSE );
+}
 
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, TRUE );
+static void trw_layer_apply_dem_data_tracks_only_missing ( menu_array_sublayer values )
+{
+  trw_layer_apply_dem_data_tracks ( values, TRUE );
 }
 
 /**
@@ -6820,7 +10255,10 @@ static void wp_changed_message ( VikTrwLayer *vtl, guint changed )
   a_dialog_info_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), str);
 }
 
-static void trw_layer_apply_dem_data_wpt_all ( menu_array_sublayer values )
+/**
+ * A single waypoint is done straight away, whereas all of them are done in the background
+ */
+static void trw_layer_apply_dem_data_wpt ( menu_array_sublayer values, gboolean skip_existing )
 {
   VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
   VikLayersPanel *vlp = (VikLayersPanel *)values[MA_VLP];
@@ -6828,54 +10266,30 @@ static void trw_layer_apply_dem_data_wpt_all ( menu_array_sublayer values )
   if ( !trw_layer_dem_test ( vtl, vlp ) )
     return;
 
-  guint changed = 0;
   if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
     // Single Waypoint
+    guint changed = 0;
     VikWaypoint *wp = (VikWaypoint *) g_hash_table_lookup ( vtl->waypoints, values[MA_SUBLAYER_ID] );
     if ( wp )
-      changed = (guint)vik_waypoint_apply_dem_data ( wp, FALSE );
+      changed = (guint)vik_waypoint_apply_dem_data ( wp, skip_existing );
+    wp_changed_message ( vtl, changed );
   }
   else {
     // All waypoints
-    GHashTableIter iter;
-    gpointer key, value;
-
-    g_hash_table_iter_init ( &iter, vtl->waypoints );
-    while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-      VikWaypoint *wp = VIK_WAYPOINT(value);
-      changed = changed + (gint)vik_waypoint_apply_dem_data ( wp, FALSE );
-    }
+    GList *vtls = g_list_append ( NULL, vtl );
+    trw_layer_apply_dem_data_batch ( vtls, FALSE, FALSE, TRUE, skip_existing );
+    g_list_free ( vtls );
   }
-  wp_changed_message ( vtl, changed );
 }
 
-static void trw_layer_apply_dem_data_wpt_only_missing ( menu_array_sublayer values )
+static void trw_layer_apply_dem_data_wpt_all ( menu_array_sublayer values )
 {
-  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
-  VikLayersPanel *vlp = (VikLayersPanel *)values[MA_VLP];
-
-  if ( !trw_layer_dem_test ( vtl, vlp ) )
-    return;
-
-  guint changed = 0;
-  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
-    // Single Waypoint
-    VikWaypoint *wp = (VikWaypoint *) g_hash_table_lookup ( vtl->waypoints, values[MA_SUBLAYER_ID] );
-    if ( wp )
-      changed = (guint)vik_waypoint_apply_dem_data ( wp, TRUE );
-  }
-  else {
-    // All waypoints
-    GHashTableIter iter;
-    gpointer key, value;
+  trw_layer_apply_dem_data_wpt ( values, FALSE );
+}
 
-    g_hash_table_iter_init ( &iter, vtl->waypoints );
-    while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-      VikWaypoint *wp = VIK_WAYPOINT(value);
-      changed = changed + (guint)vik_waypoint_apply_dem_data ( wp, TRUE );
-    }
-  }
-  wp_changed_message ( vtl, changed );
+static void trw_layer_apply_dem_data_wpt_only_missing ( menu_array_sublayer values )
+{
+  trw_layer_apply_dem_data_wpt ( values, TRUE );
 }
 
 static void trw_layer_goto_track_endpoint ( menu_array_sublayer values )
@@ -7346,6 +10760,8 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
 
   if (merge_list)
   {
+    TrwJournalMerge *edit = trw_journal_merge_new ( track, TRUE );
+    GList *merge_tracks = NULL;
     GList *l;
     for (l = merge_list; l != NULL; l = g_list_next(l)) {
       VikTrack *merge_track;
@@ -7354,23 +10770,221 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
       else
         merge_track = vik_trw_layer_get_track ( vtl, l->data );
 
-      if (merge_track) {
-        vik_track_steal_and_append_trackpoints ( track, merge_track );
-        if ( track->is_route )
-          vik_trw_layer_delete_route (vtl, merge_track);
-        else
-          vik_trw_layer_delete_track (vtl, merge_track);
-        track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+      // Same named tracks may be listed more than once
+      if ( merge_track && !g_list_find ( merge_tracks, merge_track ) ) {
+        trw_journal_merge_other ( edit, merge_track );
+        merge_tracks = g_list_prepend ( merge_tracks, merge_track );
       }
     }
     for (l = merge_list; l != NULL; l = g_list_next(l))
       g_free(l->data);
     g_list_free(merge_list);
 
+    // Join all the tracks on and then sort just the once
+    merge_tracks = g_list_reverse ( merge_tracks );
+    vik_track_steal_and_append_tracks ( track, merge_tracks );
+    for (l = merge_tracks; l != NULL; l = g_list_next(l)) {
+      if ( track->is_route )
+        vik_trw_layer_delete_route (vtl, VIK_TRACK(l->data));
+      else
+        vik_trw_layer_delete_track (vtl, VIK_TRACK(l->data));
+    }
+    g_list_free ( merge_tracks );
+    track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+    vik_track_changed ( track );
+    trw_layer_journal_add_merge ( vtl, edit );
+
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
 
+/*
+ * Merging another layer into this one.
+ * Items are compared by their content hash, so whole layers are compared in linear time:
+ *  an item with the same content as one here is identical (and so left out),
+ *  otherwise one with the same name as an item here is a modified version of it,
+ *  otherwise it is new.
+ */
+typedef struct {
+  guint identical;
+  GPtrArray *modified; // Pairs of this layer's item then the other layer's version of it
+  GPtrArray *added;    // The other layer's new items
+} TrwMergePlan;
+
+static guint64 trw_merge_item_hash ( gpointer item, gboolean waypoints )
+{
+  return waypoints ? vik_waypoint_get_content_hash ( VIK_WAYPOINT(item) ) : vik_track_get_content_hash ( VIK_TRACK(item) );
+}
+
+static const gchar *trw_merge_item_name ( gpointer item, gboolean waypoints )
+{
+  return waypoints ? VIK_WAYPOINT(item)->name : VIK_TRACK(item)->name;
+}
+
+static void trw_merge_plan_items ( TrwMergePlan *plan, GHashTable *items, GHashTable *others, gboolean waypoints )
+{
+  guint64 *hashes = g_new ( guint64, MAX(1, g_hash_table_size(items)) );
+  GHashTable *by_hash = g_hash_table_new ( g_int64_hash, g_int64_equal );
+  // First of each name not yet matched with a modified version
+  GHashTable *by_name = g_hash_table_new ( g_str_hash, g_str_equal );
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+
+  g_hash_table_iter_init ( &iter, items );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    hashes[ii] = trw_merge_item_hash ( value, waypoints );
+    g_hash_table_add ( by_hash, &hashes[ii++] );
+    const gchar *name = trw_merge_item_name ( value, waypoints );
+    if ( name && !g_hash_table_contains ( by_name, name ) )
+      g_hash_table_insert ( by_name, (gpointer)name, value );
+  }
+
+  g_hash_table_iter_init ( &iter, others );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    guint64 hash = trw_merge_item_hash ( value, waypoints );
+    if ( g_hash_table_contains ( by_hash, &hash ) ) {
+      plan->identical++;
+      continue;
+    }
+    const gchar *name = trw_merge_item_name ( value, waypoints );
+    gpointer mine = name ? g_hash_table_lookup ( by_name, name ) : NULL;
+    if ( mine ) {
+      g_ptr_array_add ( plan->modified, mine );
+      g_ptr_array_add ( plan->modified, value );
+      g_hash_table_remove ( by_name, name );
+    }
+    else
+      g_ptr_array_add ( plan->added, value );
+  }
+
+  g_hash_table_destroy ( by_name );
+  g_hash_table_destroy ( by_hash );
+  g_free ( hashes );
+}
+
+static void trw_merge_add_track ( VikTrwLayer *vtl, VikTrwLayer *vtl_other, VikTrack *trk )
+{
+  VikTrack *copy;
+  // Packed trackpoints can be shared, but not converted
+  if ( vtl->coord_mode == vtl_other->coord_mode ) {
+    copy = vik_track_copy_shared ( trk );
+    if ( copy->packed )
+      vtl->packed_tracks++;
+  }
+  else {
+    copy = vik_track_copy ( trk, TRUE );
+    vik_track_convert ( copy, vtl->coord_mode );
+  }
+  if ( copy->is_route )
+    vik_trw_layer_add_route ( vtl, NULL, copy );
+  else
+    vik_trw_layer_add_track ( vtl, NULL, copy );
+}
+
+static void trw_merge_add_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
+{
+  VikWaypoint *copy = vik_waypoint_copy ( wp );
+  vik_trw_layer_add_waypoint ( vtl, NULL, copy );
+  waypoint_convert ( NULL, copy, &vtl->coord_mode );
+}
+
+/**
+ * Merge the items of another TrackWaypoint layer into this one,
+ *  without duplicating the ones already here
+ */
+static void trw_layer_merge_layer ( menu_array_layer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  VikLayersPanel *vlp = VIK_LAYERS_PANEL(values[MA_VLP]);
+
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vlp), NULL, VIK_LAYER_TRW, TRUE );
+  layers = g_list_remove ( layers, vtl );
+  if ( !layers ) {
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("There are no other TrackWaypoint layers to merge.") );
+    return;
+  }
+  GList *names = NULL;
+  GList *iter;
+  for ( iter = layers; iter; iter = iter->next )
+    names = g_list_append ( names, (gpointer)vik_layer_get_name(VIK_LAYER(iter->data)) );
+  GList *selected = a_dialog_select_from_list ( VIK_GTK_WINDOW_FROM_LAYER(vtl), names, FALSE,
+                                                _("Merge Layer"), _("Select the layer to merge into this one") );
+  g_list_free ( names );
+  // Same named layers may be listed more than once, the first is used
+  VikTrwLayer *vtl_other = NULL;
+  if ( selected ) {
+    for ( iter = layers; iter && !vtl_other; iter = iter->next )
+      if ( g_strcmp0 ( vik_layer_get_name(VIK_LAYER(iter->data)), selected->data ) == 0 )
+        vtl_other = VIK_TRW_LAYER(iter->data);
+    g_list_free_full ( selected, g_free );
+  }
+  g_list_free ( layers );
+  if ( !vtl_other )
+    return;
+
+  trw_ensure_deferred_loaded ( vtl_other );
+
+  TrwMergePlan plans[3];
+  GHashTable *mine[3] = { vtl->waypoints, vtl->tracks, vtl->routes };
+  GHashTable *theirs[3] = { vtl_other->waypoints, vtl_other->tracks, vtl_other->routes };
+  guint identical = 0, modified = 0, added = 0;
+  guint ii;
+  for ( ii = 0; ii < G_N_ELEMENTS(plans); ii++ ) {
+    plans[ii].identical = 0;
+    plans[ii].modified = g_ptr_array_new ();
+    plans[ii].added = g_ptr_array_new ();
+    trw_merge_plan_items ( &plans[ii], mine[ii], theirs[ii], ii == 0 );
+    identical += plans[ii].identical;
+    modified += plans[ii].modified->len / 2;
+    added += plans[ii].added->len;
+  }
+
+  gboolean replace = FALSE;
+  gchar *summary = g_strdup_printf ( _("Identical: %d\nModified: %d\nNew: %d"), identical, modified, added );
+  if ( modified ) {
+    gchar *question = g_strdup_printf ( _("Replace the %d modified items in this layer with those from %s?"), modified, vik_layer_get_name(VIK_LAYER(vtl_other)) );
+    replace = a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl), question, summary );
+    g_free ( question );
+  }
+  else
+    a_dialog_info_msg_extra ( VIK_GTK_WINDOW_FROM_LAYER(vtl), "%s", summary );
+  g_free ( summary );
+
+  for ( ii = 0; ii < G_N_ELEMENTS(plans); ii++ ) {
+    guint jj;
+    // Without replacing, modified versions are added alongside the originals
+    for ( jj = 0; jj < plans[ii].modified->len; jj += 2 ) {
+      gpointer item = g_ptr_array_index ( plans[ii].modified, jj );
+      gpointer other = g_ptr_array_index ( plans[ii].modified, jj+1 );
+      if ( ii == 0 ) {
+        if ( replace )
+          (void)trw_layer_delete_waypoint_journalled ( vtl, VIK_WAYPOINT(item) );
+        trw_merge_add_waypoint ( vtl, VIK_WAYPOINT(other) );
+      }
+      else {
+        if ( replace )
+          (void)trw_layer_delete_track_journalled ( vtl, VIK_TRACK(item) );
+        trw_merge_add_track ( vtl, vtl_other, VIK_TRACK(other) );
+      }
+    }
+    for ( jj = 0; jj < plans[ii].added->len; jj++ ) {
+      if ( ii == 0 )
+        trw_merge_add_waypoint ( vtl, VIK_WAYPOINT(g_ptr_array_index(plans[ii].added, jj)) );
+      else
+        trw_merge_add_track ( vtl, vtl_other, VIK_TRACK(g_ptr_array_index(plans[ii].added, jj)) );
+    }
+    g_ptr_array_free ( plans[ii].modified, TRUE );
+    g_ptr_array_free ( plans[ii].added, TRUE );
+  }
+
+  if ( modified || added ) {
+    trw_layer_calculate_bounds_waypoints ( vtl );
+    trw_layer_calculate_bounds_tracks ( vtl );
+    vik_layer_emit_update ( VIK_LAYER(vtl), TRUE );
+  }
+}
+
 // c.f. trw_layer_sorted_track_id_by_name_list
 //  but don't add the specified track to the list (normally current track)
 static void trw_layer_sorted_track_id_by_name_list_exclude_self (const gpointer id, const VikTrack *trk, gpointer udata)
@@ -7433,6 +11047,7 @@ static void trw_layer_append_track ( menu_array_sublayer values )
 
   // It's a list, but shouldn't contain more than one other track!
   if ( append_list ) {
+    TrwJournalMerge *edit = trw_journal_merge_new ( trk, FALSE );
     GList *l;
     for (l = append_list; l != NULL; l = g_list_next(l)) {
       // TODO: at present this uses the first track found by name,
@@ -7444,6 +11059,7 @@ static void trw_layer_append_track ( menu_array_sublayer values )
         append_track = vik_trw_layer_get_track ( vtl, l->data );
 
       if ( append_track ) {
+        trw_journal_merge_other ( edit, append_track );
         vik_track_steal_and_append_trackpoints ( trk, append_track );
         if ( trk->is_route )
           vik_trw_layer_delete_route (vtl, append_track);
@@ -7457,8 +11073,10 @@ static void trw_layer_append_track ( menu_array_sublayer values )
 
     // Routes can only have one segment
     if ( trk->is_route ) {
+      trw_journal_merge_segments ( edit );
       (void)vik_track_merge_segments ( trk );
     }
+    trw_layer_journal_add_merge ( vtl, edit );
 
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
@@ -7620,6 +11238,7 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
   GList *nearby_tracks = NULL;
   GList *trps;
   static gpointer params[3];
+  TrwJournalMerge *edit = trw_journal_merge_new ( orig_trk, TRUE );
 
   while ( attempt_merge ) {
 
@@ -7628,7 +11247,7 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
 
     trps = orig_trk->trackpoints;
     if ( !trps )
-      return;
+      break;
 
     if (nearby_tracks) {
       g_list_free(nearby_tracks);
@@ -7640,25 +11259,34 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     params[2] = GUINT_TO_POINTER (threshold_in_minutes*60); // In seconds
 
     /* get a list of adjacent-in-time tracks */
-    g_hash_table_foreach(vtl->tracks, find_nearby_tracks_by_time, params);
+    // Only tracks with times near to the original track can be merged
+    gdouble t1 = vik_track_get_tp_first(orig_trk)->timestamp;
+    gdouble t2 = vik_track_get_tp_last(orig_trk)->timestamp;
+    if ( isnan(t1) || isnan(t2) )
+      break;
+    gdouble threshold = threshold_in_minutes*60;
+    GList *candidates = vik_trw_layer_get_tracks_by_time ( vtl, MIN(t1,t2) - threshold, MAX(t1,t2) + threshold );
+    for ( GList *iter = candidates; iter; iter = iter->next )
+      find_nearby_tracks_by_time ( NULL, iter->data, params );
+    g_list_free ( candidates );
 
     /* merge them */
-    GList *l = nearby_tracks;
-    while ( l ) {
-      /* remove trackpoints from merged track, delete track */
-      vik_track_steal_and_append_trackpoints ( orig_trk, VIK_TRACK(l->data) );
+    for ( GList *l = nearby_tracks; l; l = g_list_next(l) )
+      trw_journal_merge_other ( edit, VIK_TRACK(l->data) );
+    /* remove trackpoints from merged tracks, delete tracks */
+    vik_track_steal_and_append_tracks ( orig_trk, nearby_tracks );
+    for ( GList *l = nearby_tracks; l; l = g_list_next(l) ) {
       vik_trw_layer_delete_track (vtl, VIK_TRACK(l->data));
-
       // Tracks have changed, therefore retry again against all the remaining tracks
       attempt_merge = TRUE;
-
-      l = g_list_next(l);
     }
 
     orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    vik_track_changed ( orig_trk );
   }
 
   g_list_free(nearby_tracks);
+  trw_layer_journal_add_merge ( vtl, edit );
 
   if ( values[MA_VLP] )
     vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
@@ -7690,35 +11318,16 @@ static void trw_layer_split_at_selected_trackpoint ( VikTrwLayer *vtl, gint subt
     return;
 
   if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
-    gchar *name = trw_layer_new_unique_sublayer_name(vtl, subtype, vtl->current_tp_track->name);
-    if ( name ) {
-      VikTrack *tr = vik_track_copy ( vtl->current_tp_track, FALSE );
-      GList *newglist = g_list_alloc ();
-      newglist->prev = NULL;
-      newglist->next = vtl->current_tpl->next;
-      newglist->data = vik_trackpoint_copy(VIK_TRACKPOINT(vtl->current_tpl->data));
-      tr->trackpoints = newglist;
-
-      vtl->current_tpl->next->prev = newglist; /* end old track here */
-      vtl->current_tpl->next = NULL;
-
-      // Bounds of the selected track changed due to the split
-      vik_track_calculate_bounds ( vtl->current_tp_track );
+    // The new track starts with a copy of the selected trackpoint
+    GPtrArray *starts = g_ptr_array_new ();
+    g_ptr_array_add ( starts, vtl->current_tpl->next );
+    VikTrack *tr = trw_layer_split_track_at ( vtl, vtl->current_tp_track, starts, TRUE );
+    g_ptr_array_free ( starts, TRUE );
 
-      vtl->current_tpl = newglist; /* change tp to first of new track. */
-      vtl->current_tp_track = tr;
+    vtl->current_tpl = tr->trackpoints; /* change tp to first of new track. */
+    vtl->current_tp_track = tr;
 
-      if ( tr->is_route )
-        vik_trw_layer_add_route ( vtl, name, tr );
-      else
-        vik_trw_layer_add_track ( vtl, name, tr );
-
-      // Bounds of the new track created by the split
-      vik_track_calculate_bounds ( tr );
-
-      vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
-    }
-    g_free ( name );
+    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
 
@@ -7729,8 +11338,7 @@ static void trw_layer_split_by_timestamp ( menu_array_sublayer values )
   VikTrack *track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
   GList *trps = track->trackpoints;
   GList *iter;
-  GList *newlists = NULL;
-  GList *newtps = NULL;
+  GPtrArray *starts;
   static guint thr = 1;
 
   gdouble ts, prev_ts;
@@ -7745,9 +11353,11 @@ static void trw_layer_split_by_timestamp ( menu_array_sublayer values )
     return;
   }
 
-  /* iterate through trackpoints, and copy them into new lists without touching original list */
+  /* iterate through trackpoints, finding where each new track would start without touching original list */
   prev_ts = VIK_TRACKPOINT(trps->data)->timestamp;
   iter = trps;
+  starts = g_ptr_array_new ();
+  g_ptr_array_add ( starts, trps );
 
   while (iter) {
     ts = VIK_TRACKPOINT(iter->data)->timestamp;
@@ -7762,49 +11372,27 @@ static void trw_layer_split_by_timestamp ( menu_array_sublayer values )
                                 tmp_str ) ) {
         goto_coord ( values[MA_VLP], vtl, values[MA_VVP], &(VIK_TRACKPOINT(iter->data)->coord) );
       }
+      g_ptr_array_free ( starts, TRUE );
       return;
     }
 
-    if (ts - prev_ts > thr*60) {
-      /* flush accumulated trackpoints into new list */
-      newlists = g_list_append(newlists, g_list_reverse(newtps));
-      newtps = NULL;
-    }
+    if (ts - prev_ts > thr*60)
+      g_ptr_array_add ( starts, iter );
 
-    /* accumulate trackpoint copies in newtps, in reverse order */
-    newtps = g_list_prepend(newtps, vik_trackpoint_copy(VIK_TRACKPOINT(iter->data)));
     prev_ts = ts;
     iter = g_list_next(iter);
   }
-  if (newtps) {
-      newlists = g_list_append(newlists, g_list_reverse(newtps));
-  }
 
-  /* put lists of trackpoints into tracks */
-  iter = newlists;
   // Only bother updating if the split results in new tracks
-  if (g_list_length (newlists) > 1) {
-    while (iter) {
-      gchar *new_tr_name;
-      VikTrack *tr;
-
-      tr = vik_track_copy ( track, FALSE );
-      tr->trackpoints = (GList *)(iter->data);
-
-      new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, track->name);
-      vik_trw_layer_add_track(vtl, new_tr_name, tr);
-      g_free ( new_tr_name );
-      vik_track_calculate_bounds ( tr );
-      iter = g_list_next(iter);
-    }
-    // Remove original track and then update the display
-    vik_trw_layer_delete_track (vtl, track);
+  if ( starts->len > 1 ) {
+    // The trackpoints are moved into the new tracks and the original track removed
+    (void)trw_layer_split_track_at ( vtl, track, starts, FALSE );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
 
     if ( values[MA_VLP] )
       vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
   }
-  g_list_free(newlists);
+  g_ptr_array_free ( starts, TRUE );
 }
 
 /**
@@ -7839,63 +11427,24 @@ static void trw_layer_split_by_n_points ( menu_array_sublayer values )
     return;
 
   // Now split...
-  GList *iter;
-  GList *newlists = NULL;
-  GList *newtps = NULL;
+  GPtrArray *starts = g_ptr_array_new ();
+  g_ptr_array_add ( starts, trps );
   guint count = 0;
-  iter = trps;
-
-  while (iter) {
-    /* accumulate trackpoint copies in newtps, in reverse order */
-    newtps = g_list_prepend(newtps, vik_trackpoint_copy(VIK_TRACKPOINT(iter->data)));
-    count++;
-    if (count >= points) {
-      /* flush accumulated trackpoints into new list */
-      newlists = g_list_append(newlists, g_list_reverse(newtps));
-      newtps = NULL;
+  for ( GList *iter = trps; iter; iter = iter->next ) {
+    if ( count == points ) {
+      g_ptr_array_add ( starts, iter );
       count = 0;
     }
-    iter = g_list_next(iter);
-  }
-
-  // If there is a remaining chunk put that into the new split list
-  // This may well be the whole track if no split points were encountered
-  if (newtps) {
-      newlists = g_list_append(newlists, g_list_reverse(newtps));
+    count++;
   }
 
-  /* put lists of trackpoints into tracks */
-  iter = newlists;
   // Only bother updating if the split results in new tracks
-  if (g_list_length (newlists) > 1) {
-    while (iter) {
-      gchar *new_tr_name;
-      VikTrack *tr;
-
-      tr = vik_track_copy ( track, FALSE );
-      tr->trackpoints = (GList *)(iter->data);
-
-      if ( track->is_route ) {
-        new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_ROUTE, track->name);
-        vik_trw_layer_add_route(vtl, new_tr_name, tr);
-      }
-      else {
-        new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, track->name);
-        vik_trw_layer_add_track(vtl, new_tr_name, tr);
-      }
-      g_free ( new_tr_name );
-      vik_track_calculate_bounds ( tr );
-
-      iter = g_list_next(iter);
-    }
-    // Remove original track and then update the display
-    if ( track->is_route )
-      vik_trw_layer_delete_route (vtl, track);
-    else
-      vik_trw_layer_delete_track (vtl, track);
+  if ( starts->len > 1 ) {
+    // The trackpoints are moved into the new tracks and the original track removed
+    (void)trw_layer_split_track_at ( vtl, track, starts, FALSE );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
-  g_list_free(newlists);
+  g_ptr_array_free ( starts, TRUE );
 }
 
 /**
@@ -7917,25 +11466,18 @@ static void trw_layer_split_segments ( menu_array_sublayer values )
   VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
   VikTrack *trk = g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
 
-  if ( !trk )
+  if ( !trk || !trk->trackpoints )
     return;
 
-  guint ntracks;
+  GPtrArray *starts = g_ptr_array_new ();
+  g_ptr_array_add ( starts, trk->trackpoints );
+  for ( GList *iter = trk->trackpoints->next; iter; iter = iter->next )
+    if ( VIK_TRACKPOINT(iter->data)->newsegment )
+      g_ptr_array_add ( starts, iter );
 
-  VikTrack **tracks = vik_track_split_into_segments (trk, &ntracks);
-  gchar *new_tr_name;
-  guint i;
-  for ( i = 0; i < ntracks; i++ ) {
-    if ( tracks[i] ) {
-      new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, trk->name);
-      vik_trw_layer_add_track ( vtl, new_tr_name, tracks[i] );
-      g_free ( new_tr_name );
-    }
-  }
-  if ( tracks ) {
-    g_free ( tracks );
-    // Remove original track
-    vik_trw_layer_delete_track ( vtl, trk );
+  if ( starts->len > 1 ) {
+    // The trackpoints are moved into the new tracks and the original track removed
+    (void)trw_layer_split_track_at ( vtl, trk, starts, FALSE );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
     if ( values[MA_VLP] )
       vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
@@ -7943,6 +11485,7 @@ static void trw_layer_split_segments ( menu_array_sublayer values )
   else {
     a_dialog_error_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), _("Can not split track as it has no segments"));
   }
+  g_ptr_array_free ( starts, TRUE );
 }
 /* end of split/merge routines */
 
@@ -7970,6 +11513,7 @@ static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *t
     // Delete current trackpoint
     vik_trackpoint_free ( vtl->current_tpl->data );
     trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    vik_track_changed ( trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -8092,6 +11636,62 @@ static void trw_layer_delete_points_same_time ( menu_array_sublayer values )
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
 }
 
+static VikLayerParamScale clean_speed_scale[] = { {0.0, 1000.0, 1.0, 1} };
+static VikLayerParamScale clean_accel_scale[] = { {0.0, 100.0, 0.5, 1} };
+
+static VikLayerParam clean_params[] = {
+  { VIK_LAYER_TRW, "duplicates", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Same Position:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Remove points at the same position as the previous point"), NULL, NULL, NULL },
+  { VIK_LAYER_TRW, "sametime", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Same Time:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Remove points with the same time as the previous point"), NULL, NULL, NULL },
+  { VIK_LAYER_TRW, "firstspeed", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("First Point Speed (m/s):"), VIK_LAYER_WIDGET_SPINBUTTON, clean_speed_scale, NULL,
+    N_("Remove the first point when getting to the next point needs a higher speed than this. 0 to not check"), NULL, NULL, NULL },
+  { VIK_LAYER_TRW, "maxspeed", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Maximum Speed (m/s):"), VIK_LAYER_WIDGET_SPINBUTTON, clean_speed_scale, NULL,
+    N_("Remove points reached from the previous point at a higher speed than this. 0 to not check"), NULL, NULL, NULL },
+  { VIK_LAYER_TRW, "maxaccel", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Maximum Acceleration (m/s²):"), VIK_LAYER_WIDGET_SPINBUTTON, clean_accel_scale, NULL,
+    N_("Remove points needing a bigger change of speed than this. 0 to not check"), NULL, NULL, NULL },
+};
+
+// Remembered as the defaults for next time
+static VikLayerParamData clean_params_defaults[] = {
+  { .b = TRUE },
+  { .b = TRUE },
+  { .d = 0.0 },
+  { .d = 0.0 },
+  { .d = 0.0 },
+};
+
+/**
+ * Remove duplicate and anomalous points from all the tracks (or routes) in one go
+ */
+static void trw_layer_clean_up_tracks ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  gboolean routes = GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTES;
+
+  VikLayerParamData *paramdatas = a_uibuilder_run_dialog ( routes ? _("Clean Up Routes") : _("Clean Up Tracks"),
+                                                           VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                                                           clean_params, G_N_ELEMENTS(clean_params), NULL, 0,
+                                                           clean_params_defaults );
+  if ( !paramdatas )
+    return;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(clean_params); ii++ )
+    clean_params_defaults[ii] = paramdatas[ii];
+  VikTrackCleanParams params = { paramdatas[0].b, paramdatas[1].b, paramdatas[2].d, paramdatas[3].d, paramdatas[4].d };
+  a_uibuilder_free_paramdatas ( paramdatas, clean_params, G_N_ELEMENTS(clean_params) );
+
+  gulong removed = trw_layer_clean_tracks ( vtl, routes ? vtl->routes : vtl->tracks, &params, TRUE );
+
+  // Inform user how much was deleted as it's not obvious from the normal view
+  gchar str[64];
+  const gchar *tmp_str = ngettext("Deleted %ld point", "Deleted %ld points", removed);
+  g_snprintf(str, 64, tmp_str, removed);
+  a_dialog_info_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), str);
+
+  if ( removed )
+    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+}
+
 /**
  * Insert a point
  */
@@ -8452,6 +12052,7 @@ static void vik_trw_layer_uniquify_tracks ( VikTrwLayer *vtl, VikLayersPanel *vl
     // Rename it
     gchar *newname = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, udata.same_track_name );
     vik_track_set_name ( trk, newname );
+    trw_layer_name_index_rename ( vtl, track_table, trk, trk->name );
 
     trku_udata udataU;
     udataU.trk  = trk;
@@ -8491,6 +12092,7 @@ static void vik_trw_layer_uniquify_tracks ( VikTrwLayer *vtl, VikLayersPanel *vl
 
   // Update
   // TODO smarter check if anything has really changed
+  trw_layer_draw_cache_invalidate ( vtl );
   vik_layers_panel_emit_update ( vlp, trw_layer_modified(vtl) );
 }
 
@@ -8771,6 +12373,7 @@ static void vik_trw_layer_uniquify_waypoints ( VikTrwLayer *vtl, VikLayersPanel
 
   // Update
   // TODO smarter check if anything has really changed
+  trw_layer_draw_cache_invalidate ( vtl );
   vik_layers_panel_emit_update ( vlp, trw_layer_modified(vtl) );
 }
 
@@ -9316,10 +12919,12 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
 
     // Update WP name and refresh the treeview
     vik_waypoint_set_name (wp, newname);
+    trw_layer_name_index_rename ( l, l->waypoints, wp, wp->name );
 
     vik_treeview_item_set_name ( VIK_LAYER(l)->vt, iter, newname );
     vik_treeview_sort_children ( VIK_LAYER(l)->vt, &(l->waypoints_iter), l->wp_sort_order );
 
+    trw_layer_draw_cache_invalidate ( l );
     vik_layers_panel_emit_update ( VIK_LAYERS_PANEL(vlp), trw_layer_modified(l) );
 
     return newname;
@@ -9345,6 +12950,7 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
     }
     // Update track name and refresh GUI parts
     vik_track_set_name (trk, newname);
+    trw_layer_name_index_rename ( l, subtype == VIK_TRW_LAYER_SUBLAYER_TRACK ? l->tracks : l->routes, trk, trk->name );
 
     // Update any subwindows that could be displaying this track which has changed name
     // Only one Track Edit Window
@@ -9357,6 +12963,7 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
     vik_treeview_item_set_name ( VIK_LAYER(l)->vt, iter, newname );
     vik_treeview_sort_children ( VIK_LAYER(l)->vt, &(l->tracks_iter), l->track_sort_order );
 
+    trw_layer_draw_cache_invalidate ( l );
     vik_layers_panel_emit_update ( VIK_LAYERS_PANEL(vlp), trw_layer_modified(l) );
 
     return newname;
@@ -9382,6 +12989,7 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
     }
     // Update track name and refresh GUI parts
     vik_track_set_name (trk, newname);
+    trw_layer_name_index_rename ( l, subtype == VIK_TRW_LAYER_SUBLAYER_TRACK ? l->tracks : l->routes, trk, trk->name );
 
     // Update any subwindows that could be displaying this track which has changed name
     // Only one Track Edit Window
@@ -9394,6 +13002,7 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
     vik_treeview_item_set_name ( VIK_LAYER(l)->vt, iter, newname );
     vik_treeview_sort_children ( VIK_LAYER(l)->vt, &(l->routes_iter), l->track_sort_order );
 
+    trw_layer_draw_cache_invalidate ( l );
     vik_layers_panel_emit_update ( VIK_LAYERS_PANEL(vlp), trw_layer_modified(l) );
 
     return newname;
@@ -9439,6 +13048,7 @@ static void trw_layer_google_route_webpage ( menu_array_sublayer values )
 /* viewpoint is now available instead */
 static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *menu, gpointer vlp, gint subtype, gpointer sublayer, GtkTreeIter *iter, VikViewport *vvp )
 {
+  trw_ensure_unpacked ( l );
   static menu_array_sublayer data;
   GtkWidget *item;
   gboolean rv = FALSE;
@@ -9586,6 +13196,20 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     (void)vu_menu_add_item ( menu, _("_Statistics"), GTK_STOCK_INFO, G_CALLBACK(trw_layer_tracks_stats), data );
   }
 
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACKS || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTES ) {
+    (void)vu_menu_add_item ( menu, _("Clean _Up..."), GTK_STOCK_CLEAR, G_CALLBACK(trw_layer_clean_up_tracks), data );
+
+    GtkMenu *dem_submenu = GTK_MENU(gtk_menu_new());
+    GtkWidget *itemdem = vu_menu_add_item ( menu, _("_Apply DEM Data"), "vik-icon-DEM Download", NULL, NULL );
+    gtk_menu_item_set_submenu ( GTK_MENU_ITEM(itemdem), GTK_WIDGET(dem_submenu) );
+
+    GtkWidget *itemow = vu_menu_add_item ( dem_submenu, _("_Overwrite"), NULL, G_CALLBACK(trw_layer_apply_dem_data_tracks_all), data );
+    gtk_widget_set_tooltip_text ( itemow, _("Overwrite any existing elevation values with DEM values") );
+
+    GtkWidget *itemke = vu_menu_add_item ( dem_submenu, _("_Keep Existing"), NULL, G_CALLBACK(trw_layer_apply_dem_data_tracks_only_missing), data );
+    gtk_widget_set_tooltip_text ( itemke, _("Keep existing elevation values, only attempt for missing values") );
+  }
+
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTES ) {
     rv = TRUE;
 
@@ -9775,6 +13399,9 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     GtkWidget *itemro = vu_menu_add_item ( transform_submenu, _("_Rotate..."), NULL, G_CALLBACK(trw_layer_rotate), data );
     gtk_widget_set_tooltip_text ( itemro, _("Shift trackpoints to move the first points to the end") );
 
+    GtkWidget *itemsi = vu_menu_add_item ( transform_submenu, _("_Simplify..."), NULL, G_CALLBACK(trw_layer_simplify), data );
+    gtk_widget_set_tooltip_text ( itemsi, _("Create a copy with just the points needed to stay within a distance of the original") );
+
     (void)vu_menu_add_item ( transform_submenu, (subtype == VIK_TRW_LAYER_SUBLAYER_TRACK) ? _("_Reverse Track") : _("_Reverse Route"),
                              GTK_STOCK_GO_BACK, G_CALLBACK(trw_layer_reverse), data );
 
@@ -9968,13 +13595,11 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
     if ( !trk )
       return;
 
-    gint index =  g_list_index ( trk->trackpoints, tp_current );
-    if ( index > -1 ) {
-      if ( !before )
-        index = index + 1;
-      // NB no recalculation of bounds since it is inserted between points
-      trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
-    }
+    // Insert by the selected link rather than searching for its position
+    // NB no recalculation of bounds since it is inserted between points
+    // (and there is always a point after when inserting after)
+    trk->trackpoints = g_list_insert_before ( trk->trackpoints, before ? vtl->current_tpl : vtl->current_tpl->next, tp_new );
+    vik_track_changed ( trk );
   }
 
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
@@ -10075,6 +13700,8 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     }
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    if ( vtl->current_tp_track )
+      vik_track_changed ( vtl->current_tp_track );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
@@ -10280,50 +13907,152 @@ static void waypoint_search_closest_tp ( gpointer id, VikWaypoint *wp, WPSearchP
 
 static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
 {
-  GList *tpl = t->trackpoints;
   VikTrackpoint *tp;
 
-  if ( !t->visible )
-    return;
+  if ( !t->visible )
+    return;
+
+  if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
+    return;
+
+  // Only the parts of the track near the search
+  const GArray *chunks = vik_track_get_chunks ( t );
+  for ( guint ii = 0; ii < chunks->len; ii++ ) {
+    const VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    if ( ! BBOX_INTERSECT ( chunk->bbox, params->bbox ) )
+      continue;
+
+    for ( GList *tpl = chunk->first; tpl != chunk->last->next; tpl = tpl->next )
+    {
+      gint x, y;
+      tp = VIK_TRACKPOINT(tpl->data);
+
+      vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
+
+      if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
+          ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
+            abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
+      {
+        params->closest_track_id = id;
+        params->closest_tp = tp;
+        params->closest_tpl = tpl;
+        params->closest_x = x;
+        params->closest_y = y;
+      }
+    }
+  }
+}
+
+/**
+ * The area within which something drawn at the screen position could be picked
+ */
+static LatLonBBox trw_layer_pick_bbox ( VikViewport *vvp, gint x, gint y, guint size )
+{
+  VikCoord c1, c2;
+  struct LatLon ll1, ll2;
+  LatLonBBox bbox;
+  // Slightly larger, so points on the edges are not missed
+  size++;
+  vik_viewport_screen_to_coord ( vvp, x-size, y-size, &c1 );
+  vik_viewport_screen_to_coord ( vvp, x+size, y+size, &c2 );
+  vik_coord_to_latlon ( &c1, &ll1 );
+  vik_coord_to_latlon ( &c2, &ll2 );
+  bbox.north = MAX ( ll1.lat, ll2.lat );
+  bbox.south = MIN ( ll1.lat, ll2.lat );
+  bbox.east = MAX ( ll1.lon, ll2.lon );
+  bbox.west = MIN ( ll1.lon, ll2.lon );
+  return bbox;
+}
+
+// Pixels - the pointer usually moves within one for a while
+#define TRW_HOVER_CELL_SIZE 16
+
+typedef struct {
+  gint x, y; // Screen position
+  VikTrackpoint *tp;
+} TrwHoverTp;
+
+typedef struct {
+  VikViewport *vvp;
+  GArray *tps;
+  gint x1, y1, x2, y2; // Screen area
+  LatLonBBox bbox;
+} TrwHoverFill;
 
-  if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
+static void track_collect_hover_tps ( gpointer id, VikTrack *t, TrwHoverFill *fill )
+{
+  if ( !t->visible || !BBOX_INTERSECT ( t->bbox, fill->bbox ) )
     return;
 
-  while (tpl)
-  {
-    gint x, y;
-    tp = VIK_TRACKPOINT(tpl->data);
-
-    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
-
-    if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
-        ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
-          abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
-    {
-      params->closest_track_id = id;
-      params->closest_tp = tp;
-      params->closest_tpl = tpl;
-      params->closest_x = x;
-      params->closest_y = y;
+  const GArray *chunks = vik_track_get_chunks ( t );
+  for ( guint ii = 0; ii < chunks->len; ii++ ) {
+    const VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    if ( !BBOX_INTERSECT ( chunk->bbox, fill->bbox ) )
+      continue;
+    for ( GList *tpl = chunk->first; tpl != chunk->last->next; tpl = tpl->next ) {
+      TrwHoverTp htp;
+      htp.tp = VIK_TRACKPOINT(tpl->data);
+      vik_viewport_coord_to_screen ( fill->vvp, &(htp.tp->coord), &htp.x, &htp.y );
+      if ( htp.x >= fill->x1 && htp.x <= fill->x2 && htp.y >= fill->y1 && htp.y <= fill->y2 )
+        g_array_append_val ( fill->tps, htp );
     }
-    tpl = tpl->next;
   }
 }
 
+/**
+ * Find the trackpoints that could be picked from anywhere within the cell of the screen,
+ *  so while the pointer stays in it the tracks don't need searching again
+ */
+static void trw_layer_hover_fill ( VikTrwLayer *vtl, VikViewport *vvp, gint cx, gint cy, guint size )
+{
+  if ( vtl->hover_tps )
+    g_array_set_size ( vtl->hover_tps, 0 );
+  else
+    vtl->hover_tps = g_array_new ( FALSE, FALSE, sizeof(TrwHoverTp) );
+
+  TrwHoverFill fill;
+  fill.vvp = vvp;
+  fill.tps = vtl->hover_tps;
+  fill.x1 = cx * TRW_HOVER_CELL_SIZE - size;
+  fill.y1 = cy * TRW_HOVER_CELL_SIZE - size;
+  fill.x2 = (cx+1) * TRW_HOVER_CELL_SIZE - 1 + size;
+  fill.y2 = (cy+1) * TRW_HOVER_CELL_SIZE - 1 + size;
+  fill.bbox = trw_layer_pick_bbox ( vvp, (fill.x1 + fill.x2) / 2, (fill.y1 + fill.y2) / 2, (fill.x2 - fill.x1) / 2 + 1 );
+  trw_layer_foreach_in_bbox ( vtl, vtl->tracks, fill.bbox, (GHFunc) track_collect_hover_tps, &fill );
+
+  vtl->hover_valid = TRUE;
+  vtl->hover_cx = cx;
+  vtl->hover_cy = cy;
+  vtl->hover_size = size;
+  vtl->hover_serial = vik_viewport_get_projection(vvp)->serial;
+  vtl->hover_bounds = vik_track_get_bounds_changes ();
+  vtl->hover_times = vik_track_get_time_changes ();
+}
+
 // ATM: Leave this as 'Track' only.
 //  Not overly bothered about having a snap to route trackpoint capability
 static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y )
 {
-  TPSearchParams params;
-  params.x = x;
-  params.y = y;
-  params.size = MAX(5, vtl->drawpoints_size*2);
-  params.vvp = vvp;
-  params.closest_track_id = NULL;
-  params.closest_tp = NULL;
-  params.bbox = vik_viewport_get_bbox ( params.vvp );
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
-  return params.closest_tp;
+  guint size = MAX(5, vtl->drawpoints_size*2);
+  // Rounding down, including for negative positions
+  gint cx = x >= 0 ? x / TRW_HOVER_CELL_SIZE : -((-x - 1) / TRW_HOVER_CELL_SIZE) - 1;
+  gint cy = y >= 0 ? y / TRW_HOVER_CELL_SIZE : -((-y - 1) / TRW_HOVER_CELL_SIZE) - 1;
+  // Any track may have been edited, or the view changed
+  if ( !vtl->hover_valid || vtl->hover_cx != cx || vtl->hover_cy != cy || vtl->hover_size != size ||
+       vtl->hover_serial != vik_viewport_get_projection(vvp)->serial ||
+       vtl->hover_bounds != vik_track_get_bounds_changes () ||
+       vtl->hover_times != vik_track_get_time_changes () )
+    trw_layer_hover_fill ( vtl, vvp, cx, cy, size );
+
+  TrwHoverTp *closest = NULL;
+  for ( guint ii = 0; ii < vtl->hover_tps->len; ii++ ) {
+    TrwHoverTp *htp = &g_array_index ( vtl->hover_tps, TrwHoverTp, ii );
+    if ( abs (htp->x - x) <= size && abs (htp->y - y) <= size &&
+         ((!closest) ||        /* was the old trackpoint we already found closer than this one? */
+          abs(htp->x - x)+abs(htp->y - y) < abs(closest->x - x)+abs(closest->y - y)) )
+      closest = htp;
+  }
+  return closest ? closest->tp : NULL;
 }
 
 static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y )
@@ -10337,7 +14066,11 @@ static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp,
   params.draw_symbols = vtl->wp_draw_symbols;
   params.closest_wp = NULL;
   params.closest_wp_id = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  // Images and symbols can be any size, otherwise only those near need looking at
+  if ( params.draw_images || params.draw_symbols )
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  else
+    trw_layer_foreach_in_bbox ( vtl, vtl->waypoints, trw_layer_pick_bbox ( vvp, x, y, params.size ), (GHFunc) waypoint_search_closest_tp, &params );
   return params.closest_wp;
 }
 
@@ -10534,10 +14267,10 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
   tp_params.closest_track_id = NULL;
   tp_params.closest_tp = NULL;
   tp_params.closest_tpl = NULL;
-  tp_params.bbox = bbox;
+  tp_params.bbox = trw_layer_pick_bbox ( vvp, event->x, event->y, tp_params.size );
 
   if (vtl->tracks_visible) {
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_foreach_in_bbox ( vtl, vtl->tracks, tp_params.bbox, (GHFunc) track_search_closest_tp, &tp_params);
 
     if ( tp_params.closest_tp )  {
 
@@ -10580,7 +14313,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
 
   // Try again for routes
   if (vtl->routes_visible) {
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_foreach_in_bbox ( vtl, vtl->routes, tp_params.bbox, (GHFunc) track_search_closest_tp, &tp_params);
 
     if ( tp_params.closest_tp )  {
 
@@ -10943,10 +14676,27 @@ static VikLayerToolFuncStatus tool_edit_waypoint_release ( VikTrwLayer *vtl, Gdk
 
     marker_end_move ( t );
 
+    // Only where it was and where it now is needs redrawing,
+    //  presuming it was drawn in the current view
+    gboolean have_area = FALSE;
+    GdkRectangle area;
+    if ( vtl->current_wp_drawn == vtl->current_wp ) {
+      gint old_x, old_y, new_x, new_y;
+      vik_viewport_coord_to_screen ( vvp, &(vtl->current_wp->coord), &old_x, &old_y );
+      if ( old_x == vtl->current_wp_drawn_x && old_y == vtl->current_wp_drawn_y ) {
+        vik_viewport_coord_to_screen ( vvp, &new_coord, &new_x, &new_y );
+        GdkRectangle moved = vtl->current_wp_extents;
+        moved.x += new_x - old_x;
+        moved.y += new_y - old_y;
+        gdk_rectangle_union ( &vtl->current_wp_extents, &moved, &area );
+        have_area = TRUE;
+      }
+    }
+
     vtl->current_wp->coord = new_coord;
 
     trw_layer_calculate_bounds_waypoints ( vtl );
-    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+    vik_layer_emit_update_area ( VIK_LAYER(vtl), trw_layer_modified(vtl), have_area ? &area : NULL );
     return VIK_LAYER_TOOL_ACK;
   }
   /* PUT IN RIGHT PLACE!!! */
@@ -11006,9 +14756,25 @@ void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrac
   if ( !trk || !tpt ) {
     vik_viewport_surface_tool_destroy ( vvp );
 
-    if ( a_vik_get_auto_trackpoint_select() )
-      // Full update as selected trackpoint has probably changed
-      vik_layer_emit_update ( VIK_LAYER(vtl), FALSE );
+    if ( a_vik_get_auto_trackpoint_select() ) {
+      // Selected trackpoint has probably changed,
+      //  so redraw where it was shown and where it now is
+      gboolean have_area = FALSE;
+      GdkRectangle area, area2;
+      if ( vtl->current_tp_drawn ) {
+        trw_layer_current_tp_area ( vtl, vvp, &vtl->current_tp_drawn_coord, &area );
+        have_area = TRUE;
+      }
+      if ( vtl->current_tpl ) {
+        trw_layer_current_tp_area ( vtl, vvp, &(VIK_TRACKPOINT(vtl->current_tpl->data)->coord), &area2 );
+        if ( have_area )
+          gdk_rectangle_union ( &area, &area2, &area );
+        else
+          area = area2;
+        have_area = TRUE;
+      }
+      vik_layer_emit_update_area ( VIK_LAYER(vtl), FALSE, have_area ? &area : NULL );
+    }
     else
       // Basic refresh to clear any previous 'highlighted' trackpoint drawing
       vik_layer_redraw ( VIK_LAYER(vtl) );
@@ -11204,7 +14970,7 @@ static void update_statusbar ( VikTrwLayer *vtl )
 static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gboolean search_tracks, gboolean search_routes )
 {
   if ( vtl->tracks_visible && search_tracks )
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, params);
+    trw_layer_foreach_in_bbox ( vtl, vtl->tracks, params->bbox, (GHFunc) track_search_closest_tp, params);
 
   if ( params->closest_tp )
   {
@@ -11219,7 +14985,7 @@ static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gbool
   }
 
   if ( vtl->routes_visible && search_routes )
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, params);
+    trw_layer_foreach_in_bbox ( vtl, vtl->routes, params->bbox, (GHFunc) track_search_closest_tp, params);
 
   if ( params->closest_tp )
   {
@@ -11768,7 +15534,7 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_click_dispatch ( VikTrwLa
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = trw_layer_pick_bbox ( vvp, event->x, event->y, params.size );
 
   // if we're not already editing a track/route
   // (is_track == is_route means we want a track, but have a route, or vice versa)
@@ -11900,7 +15666,7 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_click ( VikTrwLayer *vtl, Gdk
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = trw_layer_pick_bbox ( vvp, event->x, event->y, params.size );
 
   if ( event->button != 1 )
     return VIK_LAYER_TOOL_IGNORED;
@@ -11995,9 +15761,10 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_release ( VikTrwLayer *vtl, G
         new_coord = tp->coord;
     }
 
-    VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
     if ( vtl->current_tp_track )
-      vik_track_calculate_bounds ( vtl->current_tp_track );
+      trw_layer_move_trackpoint_journalled ( vtl, vtl->current_tp_track, VIK_TRACKPOINT(vtl->current_tpl->data), &new_coord );
+    else
+      VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
 
     marker_end_move ( t );
 
@@ -12019,6 +15786,14 @@ static void tool_extended_route_finder_undo ( VikTrwLayer *vtl )
 {
   clear_tool_draw ( vtl, vik_window_get_active_tool_data(VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))) );
 
+  // A request still waiting to be made is what gets undone
+  if ( vtl->route_finder_timer_id ) {
+    g_source_remove ( vtl->route_finder_timer_id );
+    vtl->route_finder_timer_id = 0;
+    vtl->route_finder_end = FALSE;
+    return;
+  }
+
   VikCoord *new_end;
   new_end = vik_track_cut_back_to_double_point ( vtl->current_track );
   if ( new_end ) {
@@ -12064,7 +15839,7 @@ static VikLayerToolFuncStatus tool_extended_route_finder_click ( VikTrwLayer *vt
       params.closest_track_id = NULL;
       params.closest_tp = NULL;
       params.closest_tpl = NULL;
-      params.bbox = vik_viewport_get_bbox ( vvp );
+      params.bbox = trw_layer_pick_bbox ( vvp, event->x, event->y, params.size );
 
       (void)tool_edit_track_or_route_join ( vtl, &params, TRUE );
     }
@@ -12210,72 +15985,20 @@ static VikLayerToolFuncStatus tool_show_picture_click ( VikTrwLayer *vtl, GdkEve
  ***************************************************************************/
 
 
-static void image_wp_make_list ( const gpointer id, VikWaypoint *wp, GSList **pics )
-{
-  if ( wp->image && ( ! a_thumbnails_exists ( wp->image ) ) )
-    *pics = g_slist_append ( *pics, (gpointer) g_strdup ( wp->image ) );
-}
-
-/* Structure for thumbnail creating data used in the background thread */
-typedef struct {
-  VikTrwLayer *vtl; // Layer needed for redrawing
-  GSList *pics;     // Image list
-} thumbnail_create_thread_data;
-
-static int create_thumbnails_thread ( thumbnail_create_thread_data *tctd, gpointer threaddata )
-{
-  guint total = g_slist_length(tctd->pics), done = 0;
-  while ( tctd->pics )
-  {
-    a_thumbnails_create ( (gchar *) tctd->pics->data );
-    int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
-    if ( result != 0 )
-      return -1; /* Abort thread */
-
-    tctd->pics = tctd->pics->next;
-  }
-
-  // Redraw to show the thumbnails as they are now created
-  if ( IS_VIK_LAYER(tctd->vtl) )
-    vik_layer_emit_update ( VIK_LAYER(tctd->vtl), FALSE ); // NB update from background thread
-
-  return 0;
-}
-
-static void thumbnail_create_thread_free ( thumbnail_create_thread_data *tctd )
+static void image_wp_request_thumbnail ( const gpointer id, VikWaypoint *wp, VikTrwLayer *vtl )
 {
-  while ( tctd->pics )
-  {
-    g_free ( tctd->pics->data );
-    tctd->pics = g_slist_delete_link ( tctd->pics, tctd->pics );
-  }
-  g_free ( tctd );
+  if ( wp->image )
+    (void)a_thumbnails_request ( wp->image, VIK_LAYER(vtl) );
 }
 
+/**
+ * Ensure thumbnails exist for all the images, generated in the background
+ *  (the same image is only ever generated once even if requested by several layers)
+ */
 void trw_layer_verify_thumbnails ( VikTrwLayer *vtl )
 {
   if ( ! vtl->has_verified_thumbnails )
-  {
-    GSList *pics = NULL;
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) image_wp_make_list, &pics );
-    if ( pics )
-    {
-      gint len = g_slist_length ( pics );
-      gchar *tmp = g_strdup_printf ( _("Creating %d Image Thumbnails..."), len );
-      thumbnail_create_thread_data *tctd = g_malloc ( sizeof(thumbnail_create_thread_data) );
-      tctd->vtl = vtl;
-      tctd->pics = pics;
-      a_background_thread ( BACKGROUND_POOL_LOCAL,
-                            VIK_GTK_WINDOW_FROM_LAYER(vtl),
-			    tmp,
-			    (vik_thr_func) create_thumbnails_thread,
-			    tctd,
-			    (vik_thr_free_func) thumbnail_create_thread_free,
-			    NULL,
-			    len );
-      g_free ( tmp );
-    }
-  }
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc) image_wp_request_thumbnail, vtl );
 }
 
 static const gchar* my_track_colors ( gint ii )
@@ -12382,6 +16105,12 @@ void trw_layer_calculate_bounds_waypoints ( VikTrwLayer *vtl )
   vtl->waypoints_bbox.east = bottomright.lon;
   vtl->waypoints_bbox.south = bottomright.lat;
   vtl->waypoints_bbox.west = topleft.lon;
+
+  // Waypoints may have moved
+  trw_layer_index_clear ( vtl, &vtl->waypoints_index );
+  // Only those that have are moved between clusters
+  if ( vtl->waypoint_clusters )
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc)trw_layer_cluster_waypoint, vtl->waypoint_clusters );
 }
 
 static void trw_layer_calculate_bounds_track ( gpointer id, VikTrack *trk )
@@ -12389,6 +16118,11 @@ static void trw_layer_calculate_bounds_track ( gpointer id, VikTrack *trk )
   vik_track_calculate_bounds ( trk );
 }
 
+static void trw_layer_calculate_bounds_track_unless_summarised ( gpointer id, VikTrack *trk )
+{
+  vik_track_calculate_bounds_unless_summarised ( trk );
+}
+
 void trw_layer_calculate_bounds_tracks ( VikTrwLayer *vtl )
 {
   g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_calculate_bounds_track, NULL );
@@ -12411,6 +16145,22 @@ static void trw_layer_sort_all ( VikTrwLayer *vtl )
     vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
 }
 
+static gboolean trw_layer_sort_idle ( VikTrwLayer *vtl )
+{
+  vtl->sort_idle_id = 0;
+  trw_layer_sort_all ( vtl );
+  return FALSE;
+}
+
+/**
+ * Sort once after the items currently being added, rather than after each one
+ */
+static void trw_layer_sort_soon ( VikTrwLayer *vtl )
+{
+  if ( !vtl->sort_idle_id )
+    vtl->sort_idle_id = g_idle_add ( (GSourceFunc)trw_layer_sort_idle, vtl );
+}
+
 /**
  * Get the earliest timestamp available from all tracks
  */
@@ -12462,6 +16212,8 @@ static gdouble trw_layer_get_timestamp_waypoints ( VikTrwLayer *vtl )
  */
 static gdouble trw_layer_get_timestamp ( VikTrwLayer *vtl )
 {
+  trw_ensure_deferred_loaded ( vtl );
+  trw_ensure_unpacked ( vtl );
   gdouble timestamp_tracks = trw_layer_get_timestamp_tracks ( vtl );
   gdouble timestamp_waypoints = trw_layer_get_timestamp_waypoints ( vtl );
   // NB routes don't have timestamps - hence they are not considered
@@ -12482,6 +16234,10 @@ static gdouble trw_layer_get_timestamp ( VikTrwLayer *vtl )
 
 static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean from_file )
 {
+  // Performed once the contents are read in
+  if ( vtl->deferred )
+    return;
+
   if ( VIK_LAYER(vtl)->realized )
     trw_layer_verify_thumbnails ( vtl );
   trw_layer_track_alloc_colors ( vtl );
@@ -12508,7 +16264,9 @@ static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean f
   }
 
   trw_layer_calculate_bounds_waypoints ( vtl );
-  trw_layer_calculate_bounds_tracks ( vtl );
+  // Tracks read in with their summary already know their bounds
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_calculate_bounds_track_unless_summarised, NULL );
+  g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_calculate_bounds_track_unless_summarised, NULL );
 
   // Apply treeview sort after loading all the tracks for this layer
   //  (rather than sorted insert on each individual track additional)
@@ -12547,6 +16305,106 @@ VikCoordMode vik_trw_layer_get_coord_mode ( VikTrwLayer *vtl )
   return vtl->coord_mode;
 }
 
+/**
+ * vik_trw_layer_track_draws_locally:
+ *
+ * Returns: TRUE if adding a trackpoint to the end of the track only changes
+ *  how the track is drawn around that end (i.e. nothing depends on the whole track)
+ */
+gboolean vik_trw_layer_track_draws_locally ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  // Colouring by speed and the elevation drawing are relative to the whole track
+  if ( vtl->drawmode == DRAWMODE_BY_SPEED || vtl->drawelevation )
+    return FALSE;
+  // Labels are spread along the track
+  if ( trk->draw_name_mode != TRACK_DRAWNAME_NO || trk->max_number_dist_labels > 0 )
+    return FALSE;
+  // The simplified drawing can change anywhere (c.f. trw_layer_draw_track_simplified())
+  if ( vtl->drawlines && !vtl->drawpoints && !vtl->drawdirections )
+    return FALSE;
+  return TRUE;
+}
+
+/**
+ * vik_trw_layer_set_draw_cache:
+ *
+ * Keep what the layer draws for reuse, as the VIK_SETTINGS_DRAW_CACHE setting does for all layers.
+ * Needed for vik_trw_layer_track_extend() to be able to draw just the additions,
+ *  so turn off again once a track is no longer being extended.
+ */
+void vik_trw_layer_set_draw_cache ( VikTrwLayer *vtl, gboolean cache )
+{
+  vtl->draw_cache_wanted = cache;
+  // When finished with, nothing is being extended any more
+  if ( !cache )
+    vtl->live_track = NULL;
+  trw_layer_draw_cache_invalidate ( vtl );
+}
+
+/**
+ * Whether adding a trackpoint to the end of the track can be drawn just from around the end
+ *  (c.f. vik_trw_layer_track_draws_locally() for which the whole track is still drawn).
+ * NB A simplified drawing is extended with the actual points,
+ *  which is near enough until the next full redraw.
+ */
+static gboolean trw_layer_track_extends_locally ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  // Colouring by speed and the elevation drawing are relative to the whole track
+  if ( vtl->drawmode == DRAWMODE_BY_SPEED || vtl->drawelevation )
+    return FALSE;
+  // Labels are spread along the track
+  if ( trk->draw_name_mode != TRACK_DRAWNAME_NO || trk->max_number_dist_labels > 0 )
+    return FALSE;
+  return TRUE;
+}
+
+/**
+ * vik_trw_layer_track_extend:
+ * @trk:  A track of the layer
+ * @tp:   The trackpoint to add to the end of the track
+ * @last: The last link of the track's trackpoints from the previous call (or NULL),
+ *        updated to the new last link
+ * @vvp:  The viewport the layer is shown in
+ * @area: Set to what has changed on the viewport, when the function returns TRUE
+ *
+ * Add a trackpoint to the end of a track that is being recorded, in constant time,
+ *  drawing the new part directly onto the layer's cached drawing when possible.
+ *
+ * Returns: TRUE if only @area of the layer has changed, otherwise the layer needs drawing again
+ */
+gboolean vik_trw_layer_track_extend ( VikTrwLayer *vtl, VikTrack *trk, VikTrackpoint *tp, GList **last, VikViewport *vvp, GdkRectangle *area )
+{
+  // Whether the cached drawing is of everything up until now
+  gboolean cache_current = vtl->draw_cache && vtl->draw_cache_bounds == vik_track_get_bounds_changes ();
+  *last = vik_track_append_trackpoint ( trk, tp, *last );
+
+  // The end of the track must have already been drawn as it is while being extended
+  gboolean was_live = ( vtl->live_track == trk );
+  vtl->live_track = trk;
+
+  if ( !was_live || !cache_current || !(*last)->prev || !trk->visible ||
+       !trw_layer_track_extends_locally ( vtl, trk ) ||
+       !vik_viewport_cache_extend_begin ( vvp, vtl->draw_cache ) ) {
+    trw_layer_draw_cache_invalidate ( vtl );
+    return FALSE;
+  }
+
+  struct DrawingParams dp;
+  init_drawing_params ( &dp, vtl, vvp, FALSE );
+  // From far enough back for the previous end to be redrawn with what now follows it (e.g. a stop)
+  dp.from = (*last)->prev->prev ? (*last)->prev->prev : (*last)->prev;
+
+  vik_viewport_extents_begin ( vvp );
+  trw_layer_draw_track ( NULL, trk, &dp, FALSE );
+  if ( !vik_viewport_extents_end ( vvp, area ) )
+    area->width = area->height = 0;
+  vik_viewport_cache_extend_end ( vvp, vtl->draw_cache );
+
+  // Now up to date again
+  vtl->draw_cache_bounds = vik_track_get_bounds_changes ();
+  return TRUE;
+}
+
 /**
  * Uniquify the whole layer
  * Also requires the layers panel as the names shown there need updating too
@@ -12573,14 +16431,50 @@ static void track_convert ( const gpointer id, VikTrack *tr, VikCoordMode *dest_
   vik_track_convert ( tr, *dest_mode );
 }
 
+typedef struct {
+  GPtrArray *tracks;
+  VikCoordMode dest_mode;
+  guint threads;
+} ConvertBatch;
+
+/**
+ * Each item converts every 'threads'th track
+ */
+static void track_convert_item ( guint index, ConvertBatch *batch )
+{
+  for ( guint ii = index; ii < batch->tracks->len; ii += batch->threads )
+    vik_track_convert ( g_ptr_array_index(batch->tracks, ii), batch->dest_mode );
+}
+
+/**
+ * Convert all the tracks and routes, spread over several threads when there are enough of them
+ */
+static void trw_layer_convert_tracks ( VikTrwLayer *vtl, VikCoordMode dest_mode )
+{
+  guint num = g_hash_table_size ( vtl->tracks ) + g_hash_table_size ( vtl->routes );
+  guint threads = MIN ( a_background_get_cpu_workers () + 1, num );
+  if ( threads < 2 ) {
+    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_convert, &dest_mode );
+    g_hash_table_foreach ( vtl->routes, (GHFunc) track_convert, &dest_mode );
+    return;
+  }
+
+  ConvertBatch batch = { g_ptr_array_sized_new ( num ), dest_mode, threads };
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) track_add_to_array, batch.tracks );
+  g_hash_table_foreach ( vtl->routes, (GHFunc) track_add_to_array, batch.tracks );
+
+  a_background_parallel ( (vik_thr_index_func)track_convert_item, &batch, threads );
+  g_ptr_array_free ( batch.tracks, TRUE );
+}
+
 static void trw_layer_change_coord_mode ( VikTrwLayer *vtl, VikCoordMode dest_mode )
 {
   if ( vtl->coord_mode != dest_mode )
   {
+    trw_ensure_unpacked ( vtl );
     vtl->coord_mode = dest_mode;
     g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_convert, &dest_mode );
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_convert, &dest_mode );
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_convert, &dest_mode );
+    trw_layer_convert_tracks ( vtl, dest_mode );
   }
 }
 
@@ -12596,155 +16490,10 @@ static guint16 trw_layer_get_menu_selection ( VikTrwLayer *vtl )
 
 /* ----------- Downloading maps along tracks --------------- */
 
-static int get_download_area_width(VikViewport *vvp, gdouble zoom_level, struct LatLon *wh)
-{
-  /* TODO: calculating based on current size of viewport */
-  const gdouble w_at_zoom_0_125 = 0.0013;
-  const gdouble h_at_zoom_0_125 = 0.0011;
-  gdouble zoom_factor = zoom_level/0.125;
-
-  wh->lat = h_at_zoom_0_125 * zoom_factor;
-  wh->lon = w_at_zoom_0_125 * zoom_factor;
-
-  return 0;   /* all OK */
-}
-
-static VikCoord *get_next_coord(VikCoord *from, VikCoord *to, struct LatLon *dist, gdouble gradient)
-{
-  if ((dist->lon >= ABS(to->east_west - from->east_west)) &&
-      (dist->lat >= ABS(to->north_south - from->north_south)))
-    return NULL;
-
-  VikCoord *coord = g_malloc(sizeof(VikCoord));
-  coord->mode = VIK_COORD_LATLON;
-
-  if (ABS(gradient) < 1) {
-    if (from->east_west > to->east_west)
-      coord->east_west = from->east_west - dist->lon;
-    else
-      coord->east_west = from->east_west + dist->lon;
-    coord->north_south = gradient * (coord->east_west - from->east_west) + from->north_south;
-  } else {
-    if (from->north_south > to->north_south)
-      coord->north_south = from->north_south - dist->lat;
-    else
-      coord->north_south = from->north_south + dist->lat;
-    coord->east_west = (1/gradient) * (coord->north_south - from->north_south) + from->north_south;
-  }
-
-  return coord;
-}
-
-static GList *add_fillins(GList *list, VikCoord *from, VikCoord *to, struct LatLon *dist)
-{
-  /* TODO: handle virtical track (to->east_west - from->east_west == 0) */
-  gdouble gradient = (to->north_south - from->north_south)/(to->east_west - from->east_west);
-
-  VikCoord *next = from;
-  while (TRUE) {
-    if ((next = get_next_coord(next, to, dist, gradient)) == NULL)
-        break;
-    list = g_list_prepend(list, next);
-  }
-
-  return list;
-}
-
-void vik_track_download_map(VikTrack *tr, VikMapsLayer *vml, VikViewport *vvp, gdouble zoom_level)
-{
-  typedef struct _Rect {
-    VikCoord tl;
-    VikCoord br;
-    VikCoord center;
-  } Rect;
-#define GLRECT(iter) ((Rect *)((iter)->data))
-
-  struct LatLon wh;
-  GList *rects_to_download = NULL;
-  GList *rect_iter;
-
-  if (get_download_area_width(vvp, zoom_level, &wh))
-    return;
-
-  GList *iter = tr->trackpoints;
-  if (!iter)
-    return;
-
-  gboolean new_map = TRUE;
-  VikCoord *cur_coord, tl, br;
-  Rect *rect;
-  while (iter) {
-    cur_coord = &(VIK_TRACKPOINT(iter->data))->coord;
-    if (new_map) {
-      vik_coord_set_area(cur_coord, &wh, &tl, &br);
-      rect = g_malloc(sizeof(Rect));
-      rect->tl = tl;
-      rect->br = br;
-      rect->center = *cur_coord;
-      rects_to_download = g_list_prepend(rects_to_download, rect);
-      new_map = FALSE;
-      iter = iter->next;
-      continue;
-    }
-    gboolean found = FALSE;
-    for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next) {
-      if (vik_coord_inside(cur_coord, &GLRECT(rect_iter)->tl, &GLRECT(rect_iter)->br)) {
-        found = TRUE;
-        break;
-      }
-    }
-    if (found)
-        iter = iter->next;
-    else
-      new_map = TRUE;
-  }
-
-  GList *fillins = NULL;
-  /* 'fillin' doesn't work in UTM mode - potentially ending up in massive loop continually allocating memory - hence don't do it */
-  /* seems that ATM the function get_next_coord works only for LATLON */
-  if ( cur_coord->mode == VIK_COORD_LATLON ) {
-    /* fill-ins for far apart points */
-    GList *cur_rect, *next_rect;
-    for (cur_rect = rects_to_download;
-	 (next_rect = cur_rect->next) != NULL;
-	 cur_rect = cur_rect->next) {
-      if ((wh.lon < ABS(GLRECT(cur_rect)->center.east_west - GLRECT(next_rect)->center.east_west)) ||
-	  (wh.lat < ABS(GLRECT(cur_rect)->center.north_south - GLRECT(next_rect)->center.north_south))) {
-	fillins = add_fillins(fillins, &GLRECT(cur_rect)->center, &GLRECT(next_rect)->center, &wh);
-      }
-    }
-  } else
-    g_message("%s: this feature works only in Mercator mode", __FUNCTION__);
-
-  if (fillins) {
-    GList *fiter = fillins;
-    while (fiter) {
-      cur_coord = (VikCoord *)(fiter->data);
-      vik_coord_set_area(cur_coord, &wh, &tl, &br);
-      rect = g_malloc(sizeof(Rect));
-      rect->tl = tl;
-      rect->br = br;
-      rect->center = *cur_coord;
-      rects_to_download = g_list_prepend(rects_to_download, rect);
-      fiter = fiter->next;
-    }
-  }
-
-  for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next) {
-    vik_maps_layer_download_section (vml, vvp, &(((Rect *)(rect_iter->data))->tl), &(((Rect *)(rect_iter->data))->br), zoom_level);
-  }
-
-  if (fillins) {
-    for (iter = fillins; iter; iter = iter->next)
-      g_free(iter->data);
-    g_list_free(fillins);
-  }
-  if (rects_to_download) {
-    for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next)
-      g_free(rect_iter->data);
-    g_list_free(rects_to_download);
-  }
-}
+// Remembered for the next time
+static gint corridor_zoom1 = -1;
+static gint corridor_zoom2 = -1;
+static gdouble corridor_distance = 1.0; // km
 
 static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values )
 {
@@ -12752,7 +16501,7 @@ static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values )
   gint selected_map;
   gchar *zoomlist[] = {"0.125", "0.25", "0.5", "1", "2", "4", "8", "16", "32", "64", "128", "256", "512", "1024", NULL };
   gdouble zoom_vals[] = {0.125, 0.25, 0.5, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
-  gint selected_zoom, default_zoom;
+  gint selected_zoom1, selected_zoom2;
 
   VikTrwLayer *vtl = values[MA_VTL];
   VikLayersPanel *vlp = values[MA_VLP];
@@ -12791,17 +16540,32 @@ static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values )
   *lp = NULL;
   *np = NULL;
 
-  gdouble cur_zoom = vik_viewport_get_zoom(vvp);
-  for (default_zoom = 0; default_zoom < G_N_ELEMENTS(zoom_vals); default_zoom++) {
-    if (cur_zoom == zoom_vals[default_zoom])
-      break;
+  // Default to the usual detail for offline use - from 2 to 128 metres per pixel (i.e. OSM zoom levels 16 to 10)
+  if ( corridor_zoom1 < 0 ) {
+    corridor_zoom1 = 4;
+    corridor_zoom2 = 10;
   }
-  default_zoom = (default_zoom == G_N_ELEMENTS(zoom_vals)) ? G_N_ELEMENTS(zoom_vals) - 1 : default_zoom;
 
-  if (!a_dialog_map_n_zoom(VIK_GTK_WINDOW_FROM_LAYER(vtl), map_names, 0, zoomlist, default_zoom, &selected_map, &selected_zoom))
+  if (!a_dialog_map_corridor(VIK_GTK_WINDOW_FROM_LAYER(vtl), map_names, 0, zoomlist, corridor_zoom1, corridor_zoom2, corridor_distance,
+                             &selected_map, &selected_zoom1, &selected_zoom2, &corridor_distance))
     goto done;
+  corridor_zoom1 = MIN(selected_zoom1, selected_zoom2);
+  corridor_zoom2 = MAX(selected_zoom1, selected_zoom2);
+
+  // Least detailed first, as with downloading zoom levels of an area
+  gdouble zooms[G_N_ELEMENTS(zoom_vals)];
+  guint n_zooms = 0;
+  for ( i = corridor_zoom2; i >= corridor_zoom1; i-- )
+    zooms[n_zooms++] = zoom_vals[i];
+
+  GList *coords = NULL;
+  GList *tp_iter;
+  for ( tp_iter = trk->trackpoints; tp_iter; tp_iter = tp_iter->next )
+    coords = g_list_prepend ( coords, &(VIK_TRACKPOINT(tp_iter->data)->coord) );
+  coords = g_list_reverse ( coords );
 
-  vik_track_download_map(trk, map_layers[selected_map], vvp, zoom_vals[selected_zoom]);
+  vik_maps_layer_download_corridor ( map_layers[selected_map], vvp, coords, corridor_distance * 1000.0, zooms, n_zooms );
+  g_list_free ( coords );
 
 done:
   for (i = 0; i < num_maps; i++)
@@ -12916,6 +16680,8 @@ static void trw_layer_waypoint_list_dialog ( menu_array_layer values )
 
 static void trw_write_file ( VikTrwLayer *trw, FILE *f, const gchar *dirpath )
 {
+  trw_ensure_deferred_loaded ( trw );
+  trw_ensure_unpacked ( trw );
   if ( trw->external_layer == VIK_TRW_LAYER_EXTERNAL ) {
     trw_write_file_external ( trw, f, dirpath );
   } else if ( trw->external_layer != VIK_TRW_LAYER_EXTERNAL_NO_WRITE ) {
@@ -12955,15 +16721,20 @@ static void trw_write_file_external ( VikTrwLayer *trw, FILE *f, const gchar *di
   }
 }
 
-static gboolean trw_read_file_external ( VikTrwLayer *trw, FILE *f, const gchar *dirpath )
+static void trw_set_external_dirpath ( VikTrwLayer *trw, const gchar *dirpath )
 {
-  g_assert ( trw != NULL && trw->external_file != NULL && f != NULL );
-
   g_free ( trw->external_dirpath );
   trw->external_dirpath = g_strdup ( dirpath );
 
   // leave loading to trw_layer_draw function
   trw->external_loaded = FALSE;
+}
+
+static gboolean trw_read_file_external ( VikTrwLayer *trw, FILE *f, const gchar *dirpath )
+{
+  g_assert ( trw != NULL && trw->external_file != NULL && f != NULL );
+
+  trw_set_external_dirpath ( trw, dirpath );
 
   // read ~EndLayerData
   static char line_buffer[15];
@@ -12973,6 +16744,97 @@ static gboolean trw_read_file_external ( VikTrwLayer *trw, FILE *f, const gchar
   return success;
 }
 
+/**
+ * vik_trw_layer_write_file_binary:
+ *
+ * As trw_write_file() for the binary file format
+ */
+void vik_trw_layer_write_file_binary ( VikTrwLayer *trw, GByteArray *ba, const gchar *dirpath )
+{
+  trw_ensure_deferred_loaded ( trw );
+  trw_ensure_unpacked ( trw );
+  if ( trw->external_layer == VIK_TRW_LAYER_EXTERNAL ) {
+    trw_write_file_external ( trw, NULL, dirpath );
+  } else if ( trw->external_layer != VIK_TRW_LAYER_EXTERNAL_NO_WRITE ) {
+    a_binfile_write_trw ( trw, ba, dirpath );
+  }
+}
+
+/**
+ * vik_trw_layer_read_file_binary:
+ *
+ * As trw_read_file() for the binary file format
+ */
+gboolean vik_trw_layer_read_file_binary ( VikTrwLayer *trw, const guint8 *data, gsize len, const gchar *dirpath )
+{
+  if ( trw->external_layer != VIK_TRW_LAYER_INTERNAL ) {
+    trw_set_external_dirpath ( trw, dirpath );
+    return TRUE;
+  } else {
+    return a_binfile_read_trw ( trw, data, len, dirpath );
+  }
+}
+
+/**
+ * vik_trw_layer_set_deferred:
+ * @bd: The held back contents, which the layer takes ownership of
+ *
+ * Returns FALSE if the layer can't defer reading its contents,
+ *  in which case they should be read in now
+ */
+gboolean vik_trw_layer_set_deferred ( VikTrwLayer *trw, VikBinDeferred *bd )
+{
+  if ( trw->external_layer != VIK_TRW_LAYER_INTERNAL || trw->deferred )
+    return FALSE;
+  trw->deferred = bd;
+  return TRUE;
+}
+
+/**
+ * vik_trw_layer_may_have_time:
+ *
+ * Whether any track in the layer might be within the time range,
+ *  without necessarily reading in the layer's contents
+ */
+gboolean vik_trw_layer_may_have_time ( VikTrwLayer *trw, gdouble start, gdouble end )
+{
+  if ( !trw->deferred )
+    return TRUE;
+  const VikBinBounds *bounds = a_binfile_deferred_get_bounds ( trw->deferred );
+  if ( isnan(bounds->tracks_first) || isnan(bounds->tracks_last) )
+    return FALSE;
+  return bounds->tracks_first < end && bounds->tracks_last > start;
+}
+
+static void trw_ensure_deferred_loaded ( VikTrwLayer *trw )
+{
+  if ( !trw->deferred )
+    return;
+
+  // Detach first, as adding the items may trigger redraws (and so further loading)
+  VikBinDeferred *bd = trw->deferred;
+  trw->deferred = NULL;
+
+  gboolean realized = VIK_LAYER(trw)->realized;
+  VikWindow *vw = realized ? VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(trw)) : NULL;
+  if ( vw )
+    vik_window_set_busy_cursor ( vw );
+
+  // Add the items as if not realized, so the treeview is filled in one go
+  VIK_LAYER(trw)->realized = FALSE;
+  if ( !a_binfile_deferred_load ( bd, trw ) )
+    g_warning ( "%s: issues encountered reading layer %s", __FUNCTION__, VIK_LAYER(trw)->name );
+  VIK_LAYER(trw)->realized = realized;
+  a_binfile_deferred_free ( bd );
+
+  if ( realized )
+    trw_layer_realize ( trw, VIK_LAYER(trw)->vt, &(VIK_LAYER(trw)->iter) );
+  trw_layer_post_read ( trw, NULL, TRUE );
+
+  if ( vw )
+    vik_window_clear_busy_cursor ( vw );
+}
+
 static gboolean trw_load_external_layer ( VikTrwLayer *trw )
 {
   g_assert ( trw != NULL && trw->external_file != NULL );
@@ -13029,6 +16891,7 @@ static gboolean trw_load_external_layer ( VikTrwLayer *trw )
 
 void trw_ensure_layer_loaded ( VikTrwLayer *trw )
 {
+  trw_ensure_deferred_loaded ( trw );
   if ( trw->external_layer != VIK_TRW_LAYER_INTERNAL && ! trw->external_loaded ) {
     // set to true for now else the load will trigger redraws that will
     // trigger reloads...
@@ -13084,7 +16947,7 @@ static VikLayerToolFuncStatus tool_splitter_click ( VikTrwLayer *vtl, GdkEventBu
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = trw_layer_pick_bbox ( vvp, event->x, event->y, params.size );
 
   if ( tool_select_tp ( vtl, &params, TRUE, TRUE ) )
   {
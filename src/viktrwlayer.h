@@ -64,6 +64,9 @@ GType vik_trw_layer_get_type ();
 
 typedef struct _VikTrwLayer VikTrwLayer;
 
+// Layer contents held back from a binary file until needed, see binfile.c
+typedef struct _VikBinDeferred VikBinDeferred;
+
 typedef struct {
   gchar *description;
   gchar *author;
@@ -93,12 +96,24 @@ void vik_trwlayer_uninit ();
 
 gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikCoord *position, VikViewport *vvp, gboolean do_tracks, gboolean select );
 
+GList *vik_trw_layer_get_tracks_by_time ( VikTrwLayer *vtl, gdouble start, gdouble end );
+gboolean vik_trw_layer_get_time_range ( VikTrwLayer *vtl, gdouble *first, gdouble *last );
+VikTrack *vik_trw_layer_get_position_at_time ( VikTrwLayer *vtl, gdouble timestamp, gboolean across_segments, VikTrackPosition *pos );
+void vik_trw_layer_update_time_index ( VikTrwLayer *vtl );
+
 /* These are meant for use in file loaders (gpspoint.c, gpx.c, etc).
  * These copy the name, so you should free it if necessary. */
 void vik_trw_layer_filein_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp );
 void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *tr );
 
+// Layer data in the binary file format (binfile.c)
+void vik_trw_layer_write_file_binary ( VikTrwLayer *trw, GByteArray *ba, const gchar *dirpath );
+gboolean vik_trw_layer_read_file_binary ( VikTrwLayer *trw, const guint8 *data, gsize len, const gchar *dirpath );
+gboolean vik_trw_layer_set_deferred ( VikTrwLayer *trw, VikBinDeferred *bd );
+gboolean vik_trw_layer_may_have_time ( VikTrwLayer *trw, gdouble start, gdouble end );
+
 void vik_trw_layer_tidy_tracks ( VikTrwLayer *vtl, guint speed, gboolean recalc_bounds );
+void vik_trw_layer_apply_dem_data_all ( GList *vtls, gboolean skip_existing );
 
 gint vik_trw_layer_get_property_tracks_line_thickness ( VikTrwLayer *vtl );
 
@@ -111,6 +126,8 @@ VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name );
 
 // Track returned is the first one
 VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name );
+// Names starting with, or optionally containing, the text ignoring case
+GList *vik_trw_layer_find_by_name ( VikTrwLayer *vtl, gint sublayer_type, const gchar *text, gboolean substring, guint max );
 gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk );
 gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk );
 
@@ -118,15 +135,22 @@ void vik_trw_layer_center_view_track ( VikTrwLayer *vtl, VikTrack *trk, VikViewp
 gboolean vik_trw_layer_auto_set_view ( VikTrwLayer *vtl, VikViewport *vvp );
 gboolean vik_trw_layer_find_center ( VikTrwLayer *vtl, VikCoord *dest );
 GHashTable *vik_trw_layer_get_tracks ( VikTrwLayer *l );
+guint vik_trw_layer_get_tracks_changes ( VikTrwLayer *vtl );
 GHashTable *vik_trw_layer_get_routes ( VikTrwLayer *l );
 GHashTable *vik_trw_layer_get_waypoints ( VikTrwLayer *l );
 gboolean vik_trw_layer_is_empty ( VikTrwLayer *vtl );
+void vik_trw_layer_import_begin ( VikTrwLayer *vtl );
+gchar *vik_trw_layer_import_end ( VikTrwLayer *vtl );
 VikTrack *vik_trw_layer_get_only_track ( VikTrwLayer *vtl );
 LatLonBBox vik_trw_layer_get_bbox ( VikTrwLayer *vtl );
+VikTrwLayer *vik_trw_layer_extract ( VikTrwLayer *vtl, const LatLonBBox *bbox, gdouble start, gdouble end );
 
 gboolean vik_trw_layer_new_waypoint ( VikTrwLayer *vtl, GtkWindow *w, const VikCoord *def_coord );
 
 VikCoordMode vik_trw_layer_get_coord_mode ( VikTrwLayer *vtl );
+gboolean vik_trw_layer_track_draws_locally ( VikTrwLayer *vtl, VikTrack *trk );
+void vik_trw_layer_set_draw_cache ( VikTrwLayer *vtl, gboolean cache );
+gboolean vik_trw_layer_track_extend ( VikTrwLayer *vtl, VikTrack *trk, VikTrackpoint *tp, GList **last, VikViewport *vvp, GdkRectangle *area );
 
 gboolean vik_trw_layer_uniquify ( VikTrwLayer *vtl, VikLayersPanel *vlp );
 
@@ -169,7 +193,7 @@ typedef struct {
 typedef GList* (*VikTrwlayerGetWaypointsAndLayersFunc) (VikLayer*, gpointer);
 GList *vik_trw_layer_build_waypoint_list_t ( VikTrwLayer *vtl, GList *waypoints );
 
-GdkPixbuf* get_wp_sym_small ( gchar *symbol );
+GdkPixbuf* get_wp_sym_small ( const gchar *symbol );
 
 /* Exposed Layer Interface function definitions */
 // Intended only for use by other trw_layer subwindows
@@ -219,6 +243,9 @@ GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl );
 
 void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, VikTrackpoint *tpt );
 
+gboolean vik_trw_layer_undo ( VikTrwLayer *vtl );
+gboolean vik_trw_layer_redo ( VikTrwLayer *vtl );
+
 #define VIK_SETTINGS_LIST_DATE_FORMAT "list_date_format"
 
 typedef enum _VikTRWDataType
@@ -24,6 +24,7 @@
 #include "viking.h"
 #include "viktrwlayer_analysis.h"
 #include "viktrwlayer_tracklist.h"
+#include "background.h"
 
 // Units of each item are in SI Units
 // (as returned by the appropriate internal viking track functions)
@@ -45,19 +46,17 @@ typedef struct {
 	// https://en.wikipedia.org/wiki/Arthur_Eddington#Eddington_number_for_cycling
 } track_stats;
 
-// Early incarnations of the code had facilities to print output for multiple files
-//  but has been rescoped to work on a single list of tracks for the GUI
-typedef enum {
-	//TS_TRACK,
-	TS_TRACKS,
-	//TS_FILES,
-} track_stat_block;
-static track_stats tracks_stats[1];
-
 #define YEARS_HELD 100
-static track_stats tracks_years[YEARS_HELD];
-static guint current_year = 2020;
-static track_stats tracks_months[12];
+
+// All the results of analysing a list of tracks
+// Each analysis has its own, so several can be made at once (e.g. on different threads)
+//  and then merged together
+typedef struct {
+	guint current_year;
+	track_stats totals;
+	track_stats years[YEARS_HELD];      // Index 0 is the current year, 1 the previous year, etc...
+	track_stats months[YEARS_HELD][12]; // The months of each of the years
+} track_analysis_t;
 
 // cf with vik_track_get_minmax_alt internals
 #define VIK_VAL_MIN_ALT 25000.0
@@ -85,42 +84,98 @@ static void reset_me ( track_stats *stats )
 }
 
 /**
- * Reset the specified block
- * Call this when starting to processing multiple items
+ * Combine the stats of @src into @dest
+ * The Eddington values of @src are moved into @dest
  */
-static void val_reset ( track_stat_block block )
+static void merge_me ( track_stats *dest, track_stats *src )
 {
-	reset_me ( &tracks_stats[block] );
+	if ( src->min_alt < dest->min_alt )
+		dest->min_alt = src->min_alt;
+	if ( src->max_alt > dest->max_alt )
+		dest->max_alt = src->max_alt;
+	dest->elev_gain += src->elev_gain;
+	dest->elev_loss += src->elev_loss;
+	dest->length    += src->length;
+	if ( src->max_speed > dest->max_speed )
+		dest->max_speed = src->max_speed;
+	dest->duration  += src->duration;
+	if ( !isnan(src->start_time) )
+		if ( isnan(dest->start_time) || src->start_time < dest->start_time )
+			dest->start_time = src->start_time;
+	if ( !isnan(src->end_time) )
+		if ( isnan(dest->end_time) || src->end_time > dest->end_time )
+			dest->end_time = src->end_time;
+	dest->count     += src->count;
+	dest->e_list    = g_list_concat ( src->e_list, dest->e_list );
+	src->e_list     = NULL;
 }
 
 /**
- * Reset the years info
+ * Returns: A new empty analysis, with the years counted back from @current_year
  */
-static void val_reset_years ( void )
+static track_analysis_t *analysis_new ( guint current_year )
 {
-	for ( guint yi = 0; yi < YEARS_HELD; yi++ )
-		reset_me ( &tracks_years[yi] );
+	track_analysis_t *ta = g_malloc ( sizeof(track_analysis_t) );
+	ta->current_year = current_year;
+	reset_me ( &ta->totals );
+	for ( guint yi = 0; yi < YEARS_HELD; yi++ ) {
+		reset_me ( &ta->years[yi] );
+		for ( guint mi = 0; mi < 12; mi++ )
+			reset_me ( &ta->months[yi][mi] );
+	}
+	return ta;
+}
+
+static void analysis_free ( track_analysis_t *ta )
+{
+	if ( ta ) {
+		// Only the totals have Eddington values
+		g_list_free_full ( ta->totals.e_list, g_free );
+		g_free ( ta );
+	}
+}
+
+static gpointer copy_double ( gconstpointer src, gpointer data )
+{
+	return g_memdup ( src, sizeof(gdouble) );
+}
+
+static track_analysis_t *analysis_copy ( const track_analysis_t *ta )
+{
+	track_analysis_t *copy = g_memdup ( ta, sizeof(track_analysis_t) );
+	copy->totals.e_list = g_list_copy_deep ( ta->totals.e_list, copy_double, NULL );
+	return copy;
 }
 
 /**
- * Reset the months info
+ * Combine the results of @src into @dest
+ *  (which must be for the same current year)
  */
-static void val_reset_months ( void )
+static void analysis_merge ( track_analysis_t *dest, track_analysis_t *src )
 {
-	for ( guint ii = 0; ii < 12; ii++ )
-		reset_me ( &tracks_months[ii] );
+	merge_me ( &dest->totals, &src->totals );
+	for ( guint yi = 0; yi < YEARS_HELD; yi++ ) {
+		merge_me ( &dest->years[yi], &src->years[yi] );
+		for ( guint mi = 0; mi < 12; mi++ )
+			merge_me ( &dest->months[yi][mi], &src->months[yi][mi] );
+	}
 }
 
 /**
  * @val_analyse_track:
+ * @ta:  The analysis to add the track to
  * @trk: The track to be analyse
  *
  * Function to collect statistics, using the internal track functions
+ * This only reads the track, so can be used for different tracks at once
  */
-static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean include_no_times )
+static void val_analyse_track ( track_analysis_t *ta, VikTrack *trk, VikTrwLayer *vtl, gboolean include_no_times )
 {
-	//val_reset ( TS_TRACK );
-	gdouble min_alt, max_alt, up, down;
+	track_stats *ts = &ta->totals;
+	gdouble min_alt = VIK_VAL_MIN_ALT;
+	gdouble max_alt = VIK_VAL_MAX_ALT;
+	gdouble up = 0.0;
+	gdouble down = 0.0;
 
 	//gdouble  length_gaps = vik_track_get_length_including_gaps (trk);
 	gdouble  length      = 0.0;
@@ -136,28 +191,26 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 		gdouble t2 = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
 
 		// Initialize to the first or smallest/largest value
-		for (guint ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			if ( !isnan(t1) ) {
-				if ( !isnan(tracks_stats[ii].start_time) ) {
-					if ( t1 < tracks_stats[ii].start_time )
-						tracks_stats[ii].start_time = t1;
-				}
-				else
-					tracks_stats[ii].start_time = t1;
+		if ( !isnan(t1) ) {
+			if ( !isnan(ts->start_time) ) {
+				if ( t1 < ts->start_time )
+					ts->start_time = t1;
 			}
+			else
+				ts->start_time = t1;
+		}
 
-			if ( !isnan(t2) ) {
-				if ( !isnan(tracks_stats[ii].end_time) ) {
-					if ( t2 > tracks_stats[ii].end_time )
-						tracks_stats[ii].end_time = t2;
-				}
-				else
-					tracks_stats[ii].end_time = t2;
+		if ( !isnan(t2) ) {
+			if ( !isnan(ts->end_time) ) {
+				if ( t2 > ts->end_time )
+					ts->end_time = t2;
 			}
+			else
+				ts->end_time = t2;
+		}
 
-			if ( !isnan(t1) && !isnan(t2) ) {
-				tracks_stats[ii].duration = tracks_stats[ii].duration + (int)(t2-t1);
-			}
+		if ( !isnan(t1) && !isnan(t2) ) {
+			ts->duration = ts->duration + (int)(t2-t1);
 		}
 	}
 
@@ -165,7 +218,7 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 	//  i.e. generally a track recorded on a GPS device rather than manual/computer generated track
 	if ( !isnan(t1) || include_no_times ) {
 
-		tracks_stats[TS_TRACKS].count++;
+		ts->count++;
 
 		length    = vik_track_get_length (trk);
 		max_speed = vu_track_get_max_speed ( trk, vik_trw_layer_get_prefer_gps_speed(vtl) );
@@ -182,35 +235,28 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 			}
 			gdouble *gd = g_malloc ( sizeof(gdouble) );
 			*gd = e_len;
-			tracks_stats[TS_TRACKS].e_list = g_list_prepend ( tracks_stats[TS_TRACKS].e_list, gd );
+			ts->e_list = g_list_prepend ( ts->e_list, gd );
 		}
 
-		int ii;
-		for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			//tracks_stats[ii].trackpoints += trackpoints;
-			//tracks_stats[ii].segments    += segments;
-			tracks_stats[ii].length      += length;
-			//tracks_stats[ii].length_gaps += length_gaps;
-			if ( !isnan(max_speed) )
-				if ( max_speed > tracks_stats[ii].max_speed )
-					tracks_stats[ii].max_speed = max_speed;
-		}
+		//ts->trackpoints += trackpoints;
+		//ts->segments    += segments;
+		ts->length      += length;
+		//ts->length_gaps += length_gaps;
+		if ( !isnan(max_speed) )
+			if ( max_speed > ts->max_speed )
+				ts->max_speed = max_speed;
 
 		if ( vik_track_get_minmax_alt (trk, &min_alt, &max_alt) ) {
-			for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-				if ( min_alt < tracks_stats[ii].min_alt )
-					tracks_stats[ii].min_alt = min_alt;
-				if ( max_alt > tracks_stats[ii].max_alt )
-					tracks_stats[ii].max_alt = max_alt;
-			}
+			if ( min_alt < ts->min_alt )
+				ts->min_alt = min_alt;
+			if ( max_alt > ts->max_alt )
+				ts->max_alt = max_alt;
 		}
 
 		vik_track_get_total_elevation_gain (trk, &up, &down );
 
-		for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			tracks_stats[ii].elev_gain += up;
-			tracks_stats[ii].elev_loss += down;
-		}
+		ts->elev_gain += up;
+		ts->elev_loss += down;
 	}
 
 	// Insert into Years data - the track must have a time
@@ -219,18 +265,27 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 		GDate* gdate = g_date_new ();
 		g_date_set_time_t ( gdate, (time_t)t1 );
 		guint trk_year = g_date_get_year ( gdate );
+		GDateMonth mon = g_date_get_month ( gdate );
 
 		// Store track info
-		guint yi = current_year - trk_year;
+		guint yi = ta->current_year - trk_year;
 		if ( yi < YEARS_HELD ) {
-			tracks_years[yi].count++;
-			tracks_years[yi].length += length;
-			tracks_years[yi].elev_gain += up;
-			if ( max_alt > tracks_years[yi].max_alt )
-				tracks_years[yi].max_alt = max_alt;
+			ta->years[yi].count++;
+			ta->years[yi].length += length;
+			ta->years[yi].elev_gain += up;
+			if ( max_alt > ta->years[yi].max_alt )
+				ta->years[yi].max_alt = max_alt;
 			if ( !isnan(max_speed) )
-				 if ( max_speed > tracks_years[yi].max_speed )
-					 tracks_years[yi].max_speed = max_speed;
+				 if ( max_speed > ta->years[yi].max_speed )
+					 ta->years[yi].max_speed = max_speed;
+
+			// ...and the month within that year
+			if ( mon != G_DATE_BAD_MONTH ) {
+				ta->months[yi][mon-1].count++;
+				ta->months[yi][mon-1].length += vik_track_get_length (trk);
+			}
+			else
+				g_warning ("%s: Bad month %s", __FUNCTION__, trk->name );
 		}
 		g_date_free ( gdate );
 	}
@@ -238,33 +293,6 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 		g_debug ( "%s: %s has no time", __FUNCTION__, trk->name );
 }
 
-/**
- * @val_analyse_track_by_months:
- * @trk: The track to be analysed
- *
- * Function to collect statistics, using the internal track functions
- * All tracks passed to this function should be from the same year.
- */
-static void val_analyse_track_by_months ( VikTrack *trk )
-{
-	// NB Subsecond resolution not needed, as just using the timestamp to get dates
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
-		GDateMonth mon = g_date_get_month ( gdate );
-		g_date_free ( gdate );
-
-		if ( mon != G_DATE_BAD_MONTH ) {
-			tracks_months[mon-1].count++;
-			tracks_months[mon-1].length += vik_track_get_length (trk);
-		}
-		else
-			g_warning ("%s: Bad month %s", __FUNCTION__, trk->name );
-	}
-}
-
 // Could use GtkGrids but that is Gtk3+
 static GtkWidget *create_table (int cnt, char *labels[], GtkWidget *contents[], gboolean extended)
 {
@@ -395,15 +423,16 @@ static void table_output ( track_stats ts, GtkWidget *content[], gboolean extend
 		// Note that this currently is a simplified approach to calculate the Eddington number.
 		// In that a per track value is used, rather than trying to work out a length per day.
 		//  (i.e. doesn't combine multiple tracks for a single day or split very long tracks into days)
-		tracks_stats[TS_TRACKS].e_list = g_list_sort ( tracks_stats[TS_TRACKS].e_list, rsort_by_distance );
+		GList *e_list = g_list_sort ( g_list_copy(ts.e_list), rsort_by_distance );
 		guint Eddington = 0;
 		guint position = 0;
-		for (GList *iter = g_list_first (tracks_stats[TS_TRACKS].e_list); iter != NULL; iter = g_list_next (iter)) {
+		for (GList *iter = g_list_first (e_list); iter != NULL; iter = g_list_next (iter)) {
 			position++;
 			gdouble *num = (gdouble*)iter->data;
 			if ( *num > position )
 				Eddington = position;
 		}
+		g_list_free ( e_list );
 		g_snprintf ( tmp_buf, sizeof(tmp_buf), ("%d"), Eddington );
 		gtk_label_set_text ( GTK_LABEL(content[cnt++]), tmp_buf );
 	} else
@@ -481,150 +510,37 @@ static void table_output ( track_stats ts, GtkWidget *content[], gboolean extend
 typedef struct {
 	gboolean include_invisible;
 	gboolean include_no_times;
-	guint year; // Only applicable for month analysis
 } track_options_t;
 
 /**
  * val_analyse_item_maybe:
  * @vtlist: A track and the associated layer to consider for analysis
- * @data:   Whether to include invisible items
+ * @tot:    Whether to include invisible items
  *
- * Analyse this particular track
- *  considering whether it should be included depending on it's visibility
+ * Returns: Whether this particular track should be analysed
+ *  depending on it's visibility
  */
-static void val_analyse_item_maybe ( vik_trw_and_track_t *vtlist, const gpointer data )
+static gboolean val_analyse_item_maybe ( vik_trw_and_track_t *vtlist, track_options_t *tot )
 {
-	track_options_t *tot = (track_options_t*)data;
 	VikTrack *trk = vtlist->trk;
 	VikTrwLayer *vtl = vtlist->vtl;
 
 	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
+	if ( !IS_VIK_TRW_LAYER(vtl) ) return FALSE;
+	if ( !trk ) return FALSE;
 
 	if ( !tot->include_invisible ) {
 		// Skip invisible layers or sublayers
 		if ( !VIK_LAYER(vtl)->visible ||
 			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
 			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
+			return FALSE;
 
 		// Skip invisible tracks
 		if ( !trk->visible )
-			return;
-	}
-
-	val_analyse_track ( trk, vtl, tot->include_no_times );
-}
-
-/**
- * val_analyse_item_by_months:
- * @vtlist: A track and the associated layer to consider for analysis
- * @data:   Whether to include invisible items for the specified year
- *
- * Analyse this particular track
- *  considering whether it should be included depending on it's visibility & date
- */
-static void val_analyse_item_by_months ( vik_trw_and_track_t *vtlist, const gpointer data )
-{
-	track_options_t *tot = (track_options_t*)data;
-	VikTrack *trk = vtlist->trk;
-	VikTrwLayer *vtl = vtlist->vtl;
-
-	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
-
-	if ( !tot->include_invisible ) {
-		// Skip invisible layers or sublayers
-		if ( !VIK_LAYER(vtl)->visible ||
-			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
-			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
-
-		// Skip invisible tracks
-		if ( !trk->visible )
-			return;
-	}
-
-	// Is the track of this year?
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
-		guint trk_year = g_date_get_year ( gdate );
-		g_date_free ( gdate );
-
-		if ( trk_year == tot->year )
-			val_analyse_track_by_months ( trk );
-	}
-}
-
-/**
- * val_analyse:
- * @widgets:           The widget layout
- * @tracks_and_layers: A list of #vik_trw_and_track_t
- * @include_invisible: Whether to include invisible layers and tracks
- * @include_no_times: Whether tracks with no times should be included
- * @extended: Whether this is an extended table output
- *
- * Analyse each item in the @tracks_and_layers list
- *
- */
-static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboolean include_invisible, gboolean include_no_times, gboolean extended )
-{
-	val_reset ( TS_TRACKS );
-	val_reset_years ( );
-	time_t now = time ( NULL );
-	if ( now != (time_t)-1 ) {
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, now );
-		current_year = g_date_get_year ( gdate );
-		g_date_free ( gdate );
-	}
-
-	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
-	tot->include_invisible = include_invisible;
-	tot->include_no_times  = include_no_times;
-	GList *gl = g_list_first ( tracks_and_layers );
-	if ( gl ) {
-		g_list_foreach ( gl, (GFunc)val_analyse_item_maybe, tot );
-	}
-	g_free ( tot );
-
-	table_output ( tracks_stats[TS_TRACKS], widgets, extended );
-
-	g_list_free_full ( tracks_stats[TS_TRACKS].e_list, g_free );
-
-	// Years info...
-	if ( vik_debug ) {
-		for ( guint yi = 0; yi < YEARS_HELD; yi++ ) {
-			if ( tracks_years[yi].count > 0 )
-				g_printf ( "%s: %d: %d %d %5.2f %5.1f %d\n", __FUNCTION__, current_year-yi, tracks_years[yi].count, (gint)tracks_years[yi].max_alt, tracks_years[yi].max_speed, tracks_years[yi].length/1000, (gint)tracks_years[yi].elev_gain );
-		}
-	}
-}
-
-// Analyse the specified year
-static void val_analyse_months ( GList *tracks_and_layers, guint year, gboolean include_invisible )
-{
-	val_reset_months ( );
-
-	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
-	tot->include_invisible = include_invisible;
-	tot->year = year;
-	GList *gl = g_list_first ( tracks_and_layers );
-	if ( gl )
-		g_list_foreach ( gl, (GFunc)val_analyse_item_by_months, tot );
-	g_free ( tot );
-
-	// Months info...
-	if ( vik_debug ) {
-		for ( guint mi = 0; mi < 12; mi++ ) {
-			if ( tracks_months[mi].count > 0 )
-				g_printf ( "%s: %d: %d %d %5.2f %5.1f %d\n", __FUNCTION__, year, tracks_months[mi].count, (gint)tracks_months[mi].max_alt, tracks_months[mi].max_speed, tracks_months[mi].length/1000, (gint)tracks_months[mi].elev_gain );
-		}
+			return FALSE;
 	}
+	return TRUE;
 }
 
 typedef struct {
@@ -647,8 +563,27 @@ typedef struct {
 	GtkTreeStore *store_months;
 	guint year;
 	guint month; // 0 = Jan, etc...
+	gboolean year_chosen; // Otherwise the latest year with data is shown
+	GtkWidget *content;
+	track_analysis_t *analysis; // Results so far
+	struct _analyse_job_t *job; // The analysis in progress
 } analyse_cb_t;
 
+static void analyse_start ( analyse_cb_t *acb );
+
+/**
+ * Returns: The stats of the months of the year (or NULL if the year isn't held)
+ */
+static track_stats *analyse_months ( analyse_cb_t *acb, guint year )
+{
+	if ( !acb->analysis )
+		return NULL;
+	guint yi = acb->analysis->current_year - year;
+	if ( yi < YEARS_HELD )
+		return acb->analysis->months[yi];
+	return NULL;
+}
+
 #define YEARS_COLS 4
 
 static void years_copy_all ( GtkWidget *tree_view )
@@ -697,11 +632,16 @@ static gboolean years_menu_popup ( GtkWidget *tree_view,
 	return TRUE;
 }
 
-static void months_update_store ( GtkTreeStore *store )
+static void months_update_store ( analyse_cb_t *acb )
 {
+	GtkTreeStore *store = acb->store_months;
 	// Reset store
 	gtk_tree_store_clear ( store );
 
+	track_stats *tracks_months = analyse_months ( acb, acb->year );
+	if ( !tracks_months )
+		return;
+
 	vik_units_distance_t dist_units = a_vik_get_units_distance ();
 	GtkTreeIter t_iter;
 	for ( guint mi = 0; mi < 12; mi++ ) {
@@ -752,15 +692,13 @@ static gboolean years_button_released ( GtkWidget *tree_view,
 		return FALSE;
 
 	gtk_tree_model_get ( model, &iter, 0, &acb->year, -1 );
+	acb->year_chosen = TRUE;
 	gchar *label = g_strdup_printf ( "%d", acb->year );
 	gtk_notebook_set_tab_label_text ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, label );
 	g_free ( label );
 
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse_months ( acb->tracks_and_layers, acb->year, acb->include_invisible );
-	vik_window_clear_busy_cursor ( acb->vw );
-
-	months_update_store ( acb->store_months );
+	// The months of every year are already known
+	months_update_store ( acb );
 
 	return FALSE;
 }
@@ -775,11 +713,15 @@ static gboolean years_button_pressed ( GtkWidget *tree_view,
 	return FALSE;
 }
 
-static void years_update_store ( GtkTreeStore *store )
+static void years_update_store ( analyse_cb_t *acb )
 {
+	GtkTreeStore *store = acb->store;
 	// Reset store
 	gtk_tree_store_clear ( store );
 
+	track_stats *tracks_years = acb->analysis->years;
+	guint current_year = acb->analysis->current_year;
+
 	vik_units_distance_t dist_units = a_vik_get_units_distance ();
 	GtkTreeIter t_iter;
 	// NB Default ordering in store is in the order they are added
@@ -855,11 +797,7 @@ static void include_no_times_toggled_cb ( GtkToggleButton *togglebutton, analyse
 	// NB no change to the track list
 	// NB2 This option has no effect on the per Year output
 
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, acb->include_invisible, acb->include_no_times, acb->extended );
-	vik_window_clear_busy_cursor ( acb->vw );
-
-	gtk_widget_show_all ( acb->layout );
+	analyse_start ( acb );
 }
 
 static void include_invisible_toggled_cb ( GtkToggleButton *togglebutton, analyse_cb_t *acb )
@@ -877,18 +815,7 @@ static void include_invisible_toggled_cb ( GtkToggleButton *togglebutton, analys
 
 	acb->include_invisible = value;
 
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, acb->include_invisible, acb->include_no_times, acb->extended );
-	if ( acb->store_months )
-		val_analyse_months ( acb->tracks_and_layers, acb->year, acb->include_invisible );
-	vik_window_clear_busy_cursor ( acb->vw );
-
-	if ( acb->store )
-		years_update_store ( acb->store );
-	if ( acb->store_months )
-		months_update_store ( acb->store_months );
-
-	gtk_widget_show_all ( acb->layout );
+	analyse_start ( acb );
 }
 
 #define MONTHS_COLS 5
@@ -1074,6 +1001,305 @@ static void months_display_build ( analyse_cb_t *acb, GtkWidget* scrolledwindow
 	gtk_container_add ( GTK_CONTAINER(scrolledwindow), view );
 }
 
+/**
+ * Put the years and months into tabs, once there are enough to be worth showing
+ */
+static void analyse_tabs_update ( analyse_cb_t *acb, guint num_yrs, guint num_months )
+{
+	if ( num_yrs <= 1 && num_months <= 1 )
+		return;
+
+	if ( !acb->tabs ) {
+		acb->tabs = gtk_notebook_new();
+		g_object_ref ( acb->layout );
+		gtk_container_remove ( GTK_CONTAINER(acb->content), acb->layout );
+		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->layout, gtk_label_new(_("Totals")) );
+		g_object_unref ( acb->layout );
+		gtk_box_pack_start ( GTK_BOX(acb->content), acb->tabs, TRUE, TRUE, 0 );
+		// Keep in place under the name
+		gtk_box_reorder_child ( GTK_BOX(acb->content), acb->tabs, 1 );
+	}
+
+	if ( num_yrs > 1 && !acb->store ) {
+		// Multiple Years so show per year info as well
+		GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
+		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+		gtk_notebook_insert_page ( GTK_NOTEBOOK(acb->tabs), scrolledwindow, gtk_label_new(_("Years")), 1 );
+		years_display_build ( acb, scrolledwindow );
+	}
+
+	if ( !acb->sw_months ) {
+		acb->sw_months = gtk_scrolled_window_new ( NULL, NULL );
+		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(acb->sw_months), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, gtk_label_new(NULL) );
+		months_display_build ( acb, acb->sw_months );
+	}
+	gchar *label = g_strdup_printf ( "%d", acb->year );
+	gtk_notebook_set_tab_label_text ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, label );
+	g_free ( label );
+}
+
+/**
+ * Show the results so far (this takes ownership of @ta)
+ */
+static void analyse_show ( analyse_cb_t *acb, track_analysis_t *ta, gboolean complete )
+{
+	analysis_free ( acb->analysis );
+	acb->analysis = ta;
+
+	table_output ( ta->totals, acb->widgets, acb->extended );
+
+	guint num_yrs = 0;
+	for ( guint yi = 0; yi < YEARS_HELD; yi++ )
+		if ( ta->years[yi].count > 0 )
+			num_yrs++;
+
+	if ( !acb->year_chosen ) {
+		// Get latest year with data
+		acb->year = ta->current_year;
+		for ( guint yi = 0; yi < YEARS_HELD; yi++ )
+			if ( ta->years[yi].count > 0 ) {
+				acb->year = ta->current_year-yi;
+				break;
+			}
+	}
+
+	guint num_months = 0;
+	track_stats *tracks_months = analyse_months ( acb, acb->year );
+	if ( tracks_months )
+		for ( guint mi = 0; mi < 12; mi++ )
+			if ( tracks_months[mi].count > 0 )
+				num_months++;
+
+	analyse_tabs_update ( acb, num_yrs, num_months );
+
+	if ( acb->store )
+		years_update_store ( acb );
+	if ( acb->store_months )
+		months_update_store ( acb );
+
+	gtk_widget_show_all ( acb->tabs ? acb->tabs : acb->layout );
+
+	// Years info...
+	if ( complete && vik_debug ) {
+		for ( guint yi = 0; yi < YEARS_HELD; yi++ ) {
+			if ( ta->years[yi].count > 0 )
+				g_printf ( "%s: %d: %d %d %5.2f %5.1f %d\n", __FUNCTION__, ta->current_year-yi, ta->years[yi].count, (gint)ta->years[yi].max_alt, ta->years[yi].max_speed, ta->years[yi].length/1000, (gint)ta->years[yi].elev_gain );
+		}
+	}
+}
+
+// Tracks analysed at a time by a thread before merging into the overall results
+#define ANALYSE_CHUNK 64
+// Minimum time between showing the results so far
+#define ANALYSE_UPDATE_INTERVAL (G_USEC_PER_SEC/4)
+
+/**
+ * An analysis run in the background, shared with the dialog
+ *  so the results can be shown as they come in
+ */
+typedef struct _analyse_job_t {
+	gint ref_count;
+	GMutex *mutex;
+	analyse_cb_t *acb;         // Only used in the main thread; NULL once no longer wanted
+	GArray *items;             // Of #vik_trw_and_track_t to be analysed
+	gboolean include_no_times;
+	guint current_year;
+	gint next;                 // Index of the next item to be analysed
+	gint cancelled;
+	GAsyncQueue *finished;     // Signalled as each chunk is done
+	// Protected by the mutex
+	track_analysis_t *results; // Merged so far
+	gboolean complete;
+	gboolean update_pending;
+	gint64 updated;
+} analyse_job_t;
+
+static analyse_job_t *analyse_job_ref ( analyse_job_t *job )
+{
+	g_atomic_int_inc ( &job->ref_count );
+	return job;
+}
+
+static void analyse_job_unref ( analyse_job_t *job )
+{
+	if ( g_atomic_int_dec_and_test ( &job->ref_count ) ) {
+		analysis_free ( job->results );
+		g_async_queue_unref ( job->finished );
+		g_array_free ( job->items, TRUE );
+		vik_mutex_free ( job->mutex );
+		g_free ( job );
+	}
+}
+
+// In main thread
+static gboolean analyse_update_idle ( analyse_job_t *job )
+{
+	g_mutex_lock ( job->mutex );
+	job->update_pending = FALSE;
+	job->updated = g_get_monotonic_time ();
+	track_analysis_t *ta = analysis_copy ( job->results );
+	gboolean complete = job->complete;
+	g_mutex_unlock ( job->mutex );
+
+	if ( job->acb ) {
+		analyse_show ( job->acb, ta, complete );
+		if ( complete ) {
+			// Finished with by the dialog
+			job->acb->job = NULL;
+			job->acb = NULL;
+			analyse_job_unref ( job );
+		}
+	}
+	else
+		analysis_free ( ta );
+
+	analyse_job_unref ( job );
+	return FALSE;
+}
+
+/**
+ * Ask for the results so far to be shown
+ *  (not too often, apart from when all done)
+ */
+static void analyse_job_update ( analyse_job_t *job, gboolean complete )
+{
+	g_mutex_lock ( job->mutex );
+	if ( complete )
+		job->complete = TRUE;
+	if ( !job->update_pending &&
+	     (complete || (g_get_monotonic_time() - job->updated) > ANALYSE_UPDATE_INTERVAL) ) {
+		job->update_pending = TRUE;
+		(void)gdk_threads_add_idle ( (GSourceFunc)analyse_update_idle, analyse_job_ref(job) );
+	}
+	g_mutex_unlock ( job->mutex );
+}
+
+/**
+ * Analyse chunks of the items until none are left,
+ *  merging each chunk into the overall results
+ */
+static void analyse_worker ( gpointer data, analyse_job_t *job )
+{
+	while ( !g_atomic_int_get(&job->cancelled) ) {
+		guint start = (guint)g_atomic_int_add ( &job->next, ANALYSE_CHUNK );
+		if ( start >= job->items->len )
+			break;
+		guint end = MIN ( start + ANALYSE_CHUNK, job->items->len );
+
+		track_analysis_t *ta = analysis_new ( job->current_year );
+		for ( guint ii = start; ii < end; ii++ ) {
+			vik_trw_and_track_t *vtt = &g_array_index ( job->items, vik_trw_and_track_t, ii );
+			val_analyse_track ( ta, vtt->trk, vtt->vtl, job->include_no_times );
+		}
+		g_mutex_lock ( job->mutex );
+		analysis_merge ( job->results, ta );
+		g_mutex_unlock ( job->mutex );
+		analysis_free ( ta );
+
+		analyse_job_update ( job, FALSE );
+		g_async_queue_push ( job->finished, GUINT_TO_POINTER(1) );
+	}
+}
+
+/**
+ * Spread the analysis over several threads
+ */
+static gint analyse_thread ( analyse_job_t *job, gpointer threaddata )
+{
+	guint chunks = (job->items->len + ANALYSE_CHUNK - 1) / ANALYSE_CHUNK;
+	guint threads = MAX ( 1, MIN(util_get_number_of_cpus(), chunks) );
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)analyse_worker, job, threads, FALSE, NULL );
+	for ( guint nn = 0; nn < threads; nn++ )
+		g_thread_pool_push ( pool, GUINT_TO_POINTER(nn+1), NULL );
+
+	gint result = 0;
+	guint done = 0;
+	while ( done < chunks ) {
+		// Wake up periodically to notice if the dialog no longer wants the results
+		if ( g_async_queue_timeout_pop ( job->finished, G_USEC_PER_SEC/10 ) )
+			done++;
+		if ( a_background_thread_progress(threaddata, (gdouble)done/(gdouble)chunks) != 0 ||
+		     g_atomic_int_get(&job->cancelled) ) {
+			g_atomic_int_set ( &job->cancelled, 1 );
+			result = -1;
+			break;
+		}
+	}
+	// Wait for the threads to finish (or notice the cancellation)
+	g_thread_pool_free ( pool, FALSE, TRUE );
+
+	if ( result == 0 )
+		analyse_job_update ( job, TRUE );
+	return result;
+}
+
+/**
+ * Stop any analysis in progress from updating the dialog
+ */
+static void analyse_stop ( analyse_cb_t *acb )
+{
+	if ( acb->job ) {
+		acb->job->acb = NULL;
+		g_atomic_int_set ( &acb->job->cancelled, 1 );
+		analyse_job_unref ( acb->job );
+		acb->job = NULL;
+	}
+}
+
+/**
+ * Analyse each item in the list of tracks in the background
+ *  (replacing any analysis already in progress)
+ * The dialog is updated as the results come in
+ */
+static void analyse_start ( analyse_cb_t *acb )
+{
+	analyse_stop ( acb );
+
+	guint current_year = 2020;
+	time_t now = time ( NULL );
+	if ( now != (time_t)-1 ) {
+		GDate* gdate = g_date_new ();
+		g_date_set_time_t ( gdate, now );
+		current_year = g_date_get_year ( gdate );
+		g_date_free ( gdate );
+	}
+
+	analyse_job_t *job = g_malloc0 ( sizeof(analyse_job_t) );
+	job->ref_count = 1;
+	job->mutex = vik_mutex_new ();
+	job->acb = acb;
+	job->include_no_times = acb->include_no_times;
+	job->current_year = current_year;
+	job->results = analysis_new ( current_year );
+	job->finished = g_async_queue_new ();
+	job->updated = g_get_monotonic_time ();
+
+	// Visibility is decided here, so the threads only need to read the tracks
+	track_options_t tot = { acb->include_invisible, acb->include_no_times };
+	job->items = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+	for ( GList *gl = g_list_first(acb->tracks_and_layers); gl != NULL; gl = g_list_next(gl) )
+		if ( val_analyse_item_maybe ( (vik_trw_and_track_t*)gl->data, &tot ) )
+			g_array_append_val ( job->items, *(vik_trw_and_track_t*)gl->data );
+
+	if ( job->items->len == 0 ) {
+		// Nothing to wait for
+		analyse_show ( acb, analysis_copy(job->results), TRUE );
+		analyse_job_unref ( job );
+		return;
+	}
+
+	acb->job = analyse_job_ref ( job );
+	a_background_thread ( BACKGROUND_POOL_LOCAL,
+	                      GTK_WINDOW(acb->vw),
+	                      _("Track Analysis"),
+	                      (vik_thr_func)analyse_thread,
+	                      job,
+	                      (vik_thr_free_func)analyse_job_unref,
+	                      NULL,
+	                      job->items->len / ANALYSE_CHUNK + 1 );
+}
+
 #define VIK_SETTINGS_ANALYSIS_DO_INVISIBLE "track_analysis_do_invisible"
 #define VIK_SETTINGS_ANALYSIS_DO_NO_TIMES "track_analysis_do_no_times"
 
@@ -1092,6 +1318,9 @@ static void analyse_close ( GtkWidget *dialog, gint resp, analyse_cb_t *data )
 	gboolean do_no_times = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(data->check_button_times) );
 	a_settings_set_boolean ( VIK_SETTINGS_ANALYSIS_DO_NO_TIMES, do_no_times );
 
+	analyse_stop ( data );
+	analysis_free ( data->analysis );
+
 	//g_free ( data->layout );
 	g_free ( data->widgets );
 	g_list_free_full ( data->tracks_and_layers, g_free );
@@ -1160,64 +1389,14 @@ GtkWidget* vik_trw_layer_analyse_this ( GtkWindow *window,
 	acb->layout = create_layout ( acb->widgets, acb->extended );
 	acb->include_invisible = include_invisible;
 	acb->include_no_times = include_no_times;
+	acb->content = content;
 
-	// Analysis seems reasonably quick
-	//  unless you have really large numbers of tracks (i.e. many many thousands or a really slow computer)
-	// One day might store stats in the track itself....
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, include_invisible, include_no_times, acb->extended );
-
-	guint num_yrs = 0;
-	for ( guint yi = 0; yi < YEARS_HELD; yi++ )
-		if ( tracks_years[yi].count > 0 )
-			num_yrs++;
-
-	guint num_months = 0;
-	for ( guint mi = 0; mi < 12; mi++ )
-		if ( tracks_months[mi].count > 0 )
-			num_months++;
-
-	acb->year = current_year;
-	if ( num_yrs > 0 ) {
-		// Get latest year with data
-		for ( guint yi = 0; yi < YEARS_HELD; yi++ )
-			if ( tracks_years[yi].count > 0 ) {
-				acb->year = current_year-yi;
-				break;
-			}
-	}
-	val_analyse_months ( acb->tracks_and_layers, acb->year, include_invisible );
-
-	// Years or months to be shown, so put infomation into tabs
-	if ( num_yrs > 1 || num_months > 1 ) {
-		acb->tabs = gtk_notebook_new();
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->layout, gtk_label_new(_("Totals")) );
-		gtk_box_pack_start ( GTK_BOX(content), acb->tabs, TRUE, TRUE, 0 );
-	} else
-		gtk_box_pack_start ( GTK_BOX(content), acb->layout, TRUE, TRUE, 0 );
-
-	if ( num_yrs > 1 ) {
-		// Multiple Years so show per year info as well
-		GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
-		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), scrolledwindow, gtk_label_new(_("Years")) );
-
-		years_display_build ( acb, scrolledwindow );
-		years_update_store ( acb->store );
-	}
-
-	if ( num_yrs > 1 || num_months > 1 ) {
-		acb->sw_months = gtk_scrolled_window_new ( NULL, NULL );
-		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(acb->sw_months), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
-		gchar *label = g_strdup_printf ( "%d", acb->year );
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, gtk_label_new(label) );
-		g_free ( label );
-
-		months_display_build ( acb, acb->sw_months );
-		months_update_store ( acb->store_months );
-	}
+	// Years or months get put into tabs if the results have them
+	gtk_box_pack_start ( GTK_BOX(content), acb->layout, TRUE, TRUE, 0 );
 
-	vik_window_clear_busy_cursor ( acb->vw );
+	// Analysing really large numbers of tracks (i.e. many many thousands) can take a while,
+	//  so it is done in the background with the results shown as they come in
+	analyse_start ( acb );
 
 	GtkWidget *cb = gtk_check_button_new_with_label ( _("Include Invisible Items") );
 	gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(cb), include_invisible );
@@ -133,21 +133,38 @@ typedef struct {
 
 typedef struct {
 	VikTrwLayer *vtl;
-	gchar *image;
 	VikWaypoint *wpt;    // Use specified waypoint or otherwise the track(s) if NULL
 	VikTrack *track;     // Use specified track or all tracks if NULL
 	// User options...
 	option_values_t ov;
 	GList *files;
+	// Only used when none of the tracks match
+	VikTrack *waypoints_track;
+	// If anything has changed
+	gboolean redraw;
+} geotag_options_t;
+
+// Each image can be processed on a different thread,
+//  with the results then applied to the layer in the original order
+typedef struct {
+	gchar *image;
+	gboolean done;
+	gboolean positioned; // From the tracks, rather than the image's existing GPS information
+	VikWaypoint *wp;     // Waypoint to add (or update an existing one from)
+	gchar *name;
 	time_t PhotoTime;
-	// Store answer from interpolation for an image
-	gboolean found_match;
+	// Store answer from interpolation for the image
 	VikCoord coord;
 	gdouble altitude;
 	gdouble image_direction;
-	// If anything has changed
-	gboolean redraw;
-} geotag_options_t;
+} geotag_image_t;
+
+typedef struct {
+	geotag_options_t *options;
+	geotag_image_t *images;
+	GAsyncQueue *finished; // Of each image as it's completed
+	gint cancelled;
+} geotag_batch_t;
 
 #define VIK_SETTINGS_GEOTAG_CREATE_WAYPOINT      "geotag_create_waypoints"
 #define VIK_SETTINGS_GEOTAG_OVERWRITE_WAYPOINTS  "geotag_overwrite_waypoints"
@@ -160,8 +177,9 @@ typedef struct {
 #define VIK_SETTINGS_GEOTAG_TIME_OFFSET_HOURS    "geotag_time_offset_hours"
 #define VIK_SETTINGS_GEOTAG_TIME_OFFSET_MINS     "geotag_time_offset_mins"
 #define VIK_SETTINGS_GEOTAG_TIME_IS_LOCAL        "geotag_time_is_local"
-// Read only option
+// Read only options
 #define VIK_SETTINGS_GEOTAG_PHOTO_DIR            "geotag_photo_dir"
+#define VIK_SETTINGS_GEOTAG_THREADS              "geotag_threads"
 
 static void save_default_values ( option_values_t default_values )
 {
@@ -225,109 +243,36 @@ static gdouble get_heading_from_trackpoint ( GList *mytrkpt )
 }
 
 /**
- * Correlate the image against the specified track
+ * Use where the track was at the time of the image
  */
-static void trw_layer_geotag_track ( const gpointer id, VikTrack *track, geotag_options_t *options )
+static void geotag_apply_position ( geotag_options_t *options, geotag_image_t *img, const VikTrackPosition *pos )
 {
-	// If already found match then don't need to check this track
-	if ( options->found_match )
-		return;
-
-	VikTrackpoint *trkpt;
-	VikTrackpoint *trkpt_next;
-
-	GList *mytrkpt;
-	for ( mytrkpt = track->trackpoints; mytrkpt; mytrkpt = mytrkpt->next ) {
-
-		// Do something for this trackpoint...
-
-		trkpt = VIK_TRACKPOINT(mytrkpt->data);
-
-		if ( isnan(trkpt->timestamp) ) {
-			continue;
-		}
-
-		// is it exactly this point?
-		if ( options->PhotoTime == trkpt->timestamp ) {
-			options->coord = trkpt->coord;
-			options->altitude = trkpt->altitude;
-			options->found_match = TRUE;
-			if ( options->ov.auto_image_direction )
-				options->image_direction = get_heading_from_trackpoint ( mytrkpt );
-			break;
-		}
-
-		// Now need two trackpoints, hence check next is available
-		if ( !mytrkpt->next ) break;
-		trkpt_next = VIK_TRACKPOINT(mytrkpt->next->data);
-
-		if ( isnan(trkpt_next->timestamp) ) continue;
-		if ( trkpt->timestamp == trkpt_next->timestamp ) continue;
-		if ( trkpt->timestamp > trkpt_next->timestamp ) continue;
-
-		// When interpolating between segments, no need for any special segment handling
-		if ( !options->ov.interpolate_segments )
-			// Don't check between segments
-			if ( trkpt_next->newsegment )
-				// Simply move on to consider next point
-				continue;
-
-		// Too far
-		if ( trkpt->timestamp > options->PhotoTime ) break;
-
-		// Is is between this and the next point?
-		if ( (options->PhotoTime > trkpt->timestamp) && (options->PhotoTime < trkpt_next->timestamp) ) {
-			options->found_match = TRUE;
-			// Interpolate
-			/* Calculate the "scale": a decimal giving the relative distance
-			 * in time between the two points. Ie, a number between 0 and 1 -
-			 * 0 is the first point, 1 is the next point, and 0.5 would be
-			 * half way. */
-			gdouble tdiff = (gdouble)trkpt_next->timestamp - (gdouble)trkpt->timestamp;
-			gdouble scale = ((gdouble)options->PhotoTime - (gdouble)trkpt->timestamp) / tdiff;
-
-			options->PhotoTime = options->PhotoTime + (time_t)(tdiff * scale);
-
-			struct LatLon ll_result, ll1, ll2;
-
-			vik_coord_to_latlon ( &(trkpt->coord), &ll1 );
-			vik_coord_to_latlon ( &(trkpt_next->coord), &ll2 );
-
-			ll_result.lat = ll1.lat + ((ll2.lat - ll1.lat) * scale);
-
-			// NB This won't cope with going over the 180 degrees longitude boundary
-			ll_result.lon = ll1.lon + ((ll2.lon - ll1.lon) * scale);
-
-			// set coord
-			vik_coord_load_from_latlon ( &(options->coord), VIK_COORD_LATLON, &ll_result );
-
-			// Interpolate elevation
-			options->altitude = trkpt->altitude + ((trkpt_next->altitude - trkpt->altitude) * scale);
-
-			if ( options->ov.auto_image_direction )
-				options->image_direction = vik_coord_angle ( &trkpt->coord, &trkpt_next->coord );
-
-			break;
-		}
+	img->coord = pos->coord;
+	img->altitude = pos->altitude;
+	if ( options->ov.auto_image_direction ) {
+		if ( pos->exact )
+			img->image_direction = get_heading_from_trackpoint ( pos->link );
+		else
+			img->image_direction = vik_coord_angle ( &VIK_TRACKPOINT(pos->link->data)->coord, &VIK_TRACKPOINT(pos->link->next->data)->coord );
 	}
 }
 
 /**
  * Simply align the images the waypoint position
  */
-static void trw_layer_geotag_waypoint ( geotag_options_t *options )
+static void trw_layer_geotag_waypoint ( geotag_options_t *options, const gchar *image )
 {
 	// Write EXIF if specified - although a fairly useless process if you've turned it off!
 	if ( options->ov.write_exif ) {
 		gboolean has_gps_exif = FALSE;
-		gchar* datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
+		gchar* datetime = a_geotag_get_exif_date_from_file ( image, &has_gps_exif );
 		// If image already has gps info - don't attempt to change it unless forced
 		if ( options->ov.overwrite_gps_exif || !has_gps_exif ) {
-			gint ans = a_geotag_write_exif_gps ( options->image, options->wpt->coord, options->wpt->altitude,
+			gint ans = a_geotag_write_exif_gps ( image, options->wpt->coord, options->wpt->altitude,
 			                                     options->wpt->image_direction, options->wpt->image_direction_ref,
 			                                     options->ov.no_change_mtime );
 			if ( ans != 0 ) {
-				gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), options->image );
+				gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), image );
 				vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(options->vtl)), message, VIK_STATUSBAR_INFO );
 				g_free ( message );
 			}
@@ -340,13 +285,13 @@ static void trw_layer_geotag_waypoint ( geotag_options_t *options )
  * Backup method for the unusual case of having no timestamps on tracks, but have timestamps on (many?) waypoints
  * Possibly from KML files that have been generated by GPSBabel defaults which doesn't write tracks with timestamps
  */
-static void trw_layer_geotag_waypoints ( geotag_options_t *options )
+static VikTrack *geotag_track_from_waypoints ( VikTrwLayer *vtl )
 {
 	// Create a temporary track from the waypoints to perform the lookup
 	// c.f. trw_layer_convert_to_track()
 	VikTrack *trk = vik_track_new();
 	// Ensure sort by time
-	GList* gl = vu_sorted_list_from_hash_table ( vik_trw_layer_get_waypoints(options->vtl), VL_SO_DATE_ASCENDING, VIKING_WAYPOINT );
+	GList* gl = vu_sorted_list_from_hash_table ( vik_trw_layer_get_waypoints(vtl), VL_SO_DATE_ASCENDING, VIKING_WAYPOINT );
 
 	// Only need to copy the waypoint information relevant for geotagging
 	guint count = 1;
@@ -368,152 +313,145 @@ static void trw_layer_geotag_waypoints ( geotag_options_t *options )
 
 	g_list_free_full ( gl, g_free );
 	trk->trackpoints = g_list_reverse ( trk->trackpoints );
-
-	trw_layer_geotag_track ( NULL, trk, options );
-
-	vik_track_free ( trk );
+	return trk;
 }
 
 /**
- * Correlate the image to any track, waypoints or waypoint within the TrackWaypoint layer
+ * Prepare the time ordered trackpoints once, rather than searching every track for each image
+ *
+ * After this the lookups only read the tracks, so can be made from several threads
  */
-static void trw_layer_geotag_process ( geotag_options_t *options )
+static void trw_layer_geotag_index ( geotag_options_t *options )
 {
-	if ( !options->vtl || !IS_VIK_LAYER(options->vtl) )
+	if ( options->track ) {
+		// Single specified track
+		(void)vik_track_get_times ( options->track );
 		return;
+	}
 
-	if ( !options->image )
-		return;
+	// Try all tracks
+	vik_trw_layer_update_time_index ( options->vtl );
+
+	// Then waypoints
+	options->waypoints_track = geotag_track_from_waypoints ( options->vtl );
+	(void)vik_track_get_times ( options->waypoints_track );
+}
 
+/**
+ * Correlate the image to any track, waypoints or waypoint within the TrackWaypoint layer
+ *
+ * Only reads the layer, so can be run for several images at once;
+ *  any waypoint is then added by trw_layer_geotag_apply()
+ */
+static void trw_layer_geotag_process ( geotag_options_t *options, geotag_image_t *img )
+{
 	if ( options->wpt ) {
-		trw_layer_geotag_waypoint ( options );
+		trw_layer_geotag_waypoint ( options, img->image );
 		return;
 	}
 
 	gboolean has_gps_exif = FALSE;
-	gchar* datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
-
-	if ( datetime ) {
-
-		// If image already has gps info - don't attempt to change it.
-		if ( !options->ov.overwrite_gps_exif && has_gps_exif ) {
-			if ( options->ov.create_waypoints ) {
-				// Create waypoint with file information
-				gchar *name = NULL;
-				VikWaypoint *wp = a_geotag_create_waypoint_from_file ( options->image, vik_trw_layer_get_coord_mode (options->vtl), &name );
-				if ( !wp ) {
-					// Couldn't create Waypoint
-					g_free ( datetime );
-					return;
-				}
-				if ( !name )
-					name = g_strdup ( a_file_basename ( options->image ) );
-
-				gboolean updated_waypoint = FALSE;
-
-				if ( options->ov.overwrite_waypoints ) {
-					VikWaypoint *current_wp = vik_trw_layer_get_waypoint ( options->vtl, name );
-					if ( current_wp ) {
-						// Existing wp found, so set new position, comment and image
-						(void)a_geotag_waypoint_positioned ( options->image, wp->coord, wp->altitude, &name, current_wp );
-						updated_waypoint = TRUE;
-					}
-				}
-
-				if ( !updated_waypoint ) {
-					vik_trw_layer_filein_add_waypoint ( options->vtl, name, wp );
-				}
+	gchar* datetime = a_geotag_get_exif_date_from_file ( img->image, &has_gps_exif );
 
-				g_free ( name );
+	if ( !datetime )
+		return;
 
-				// Mark for redraw
-				options->redraw = TRUE;
-			}
-			g_free ( datetime );
-			return;
+	// If image already has gps info - don't attempt to change it.
+	if ( !options->ov.overwrite_gps_exif && has_gps_exif ) {
+		if ( options->ov.create_waypoints ) {
+			// Create waypoint with file information
+			img->wp = a_geotag_create_waypoint_from_file ( img->image, vik_trw_layer_get_coord_mode (options->vtl), &img->name );
+			if ( img->wp && !img->name )
+				img->name = g_strdup ( a_file_basename ( img->image ) );
 		}
-
-		options->PhotoTime = ConvertToUnixTime ( datetime, EXIF_DATE_FORMAT, options->ov.TimeZoneHours, options->ov.TimeZoneMins, options->ov.time_is_local );
 		g_free ( datetime );
+		return;
+	}
 
-		// Apply any offset
-		options->PhotoTime = options->PhotoTime + options->ov.time_offset;
+	img->PhotoTime = ConvertToUnixTime ( datetime, EXIF_DATE_FORMAT, options->ov.TimeZoneHours, options->ov.TimeZoneMins, options->ov.time_is_local );
+	g_free ( datetime );
 
-		options->found_match = FALSE;
-		options->image_direction = NAN;
+	// Apply any offset
+	img->PhotoTime = img->PhotoTime + options->ov.time_offset;
 
-		if ( options->track ) {
-			// Single specified track
-			// NB Doesn't care about track id
-			trw_layer_geotag_track ( NULL, options->track, options );
-		}
-		else {
-			// Try all tracks
-			GHashTable *tracks = vik_trw_layer_get_tracks ( options->vtl );
-			if ( g_hash_table_size (tracks) > 0 ) {
-				g_hash_table_foreach ( tracks, (GHFunc) trw_layer_geotag_track, options );
-			}
-			if ( !options->found_match ) {
-				// Try waypoints
-				trw_layer_geotag_waypoints ( options );
-			}
-		}
+	img->image_direction = NAN;
 
-		// Match found ?
-		if ( options->found_match ) {
+	VikTrackPosition pos;
+	gboolean found_match = FALSE;
+	if ( options->track )
+		found_match = vik_track_get_position_at_time ( options->track, img->PhotoTime, options->ov.interpolate_segments, &pos );
+	else {
+		found_match = vik_trw_layer_get_position_at_time ( options->vtl, img->PhotoTime, options->ov.interpolate_segments, &pos ) != NULL;
+		if ( !found_match && options->waypoints_track )
+			found_match = vik_track_get_position_at_time ( options->waypoints_track, img->PhotoTime, options->ov.interpolate_segments, &pos );
+	}
 
-			if ( options->ov.create_waypoints ) {
+	// Match found ?
+	if ( !found_match )
+		return;
 
-				gboolean updated_waypoint = FALSE;
+	geotag_apply_position ( options, img, &pos );
 
-				if ( options->ov.overwrite_waypoints ) {
+	if ( options->ov.create_waypoints ) {
+		// Waypoint with found position (NB this reads the image's comment)
+		img->wp = a_geotag_waypoint_positioned ( img->image, img->coord, img->altitude, &img->name, NULL );
+		img->positioned = TRUE;
+	}
 
-					// Update existing WP
-					// Find a WP with current name
-					gchar *name = NULL;
-					name = g_strdup ( a_file_basename ( options->image ) );
-					VikWaypoint *wp = vik_trw_layer_get_waypoint ( options->vtl, name );
-					if ( wp ) {
-						// Found, so set new position, comment and image
-						(void)a_geotag_waypoint_positioned ( options->image, options->coord, options->altitude, &name, wp );
-						wp->image_direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
-						wp->image_direction = options->image_direction;
-						wp->timestamp = options->PhotoTime;
-						updated_waypoint = TRUE;
-					}
-					g_free ( name );
-				}
+	// Write EXIF if specified
+	if ( options->ov.write_exif ) {
+		gint ans = a_geotag_write_exif_gps ( img->image, img->coord, img->altitude,
+		                                     img->image_direction, WP_IMAGE_DIRECTION_REF_TRUE,
+		                                     options->ov.no_change_mtime );
+		if ( ans != 0 ) {
+			gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), img->image );
+			vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(options->vtl)), message, VIK_STATUSBAR_INFO );
+			g_free ( message );
+		}
+	}
+}
 
-				if ( !updated_waypoint ) {
-					// Create waypoint with found position
-					gchar *name = NULL;
-					VikWaypoint *wp = a_geotag_waypoint_positioned ( options->image, options->coord, options->altitude, &name, NULL );
-					if ( !name )
-						name = g_strdup ( a_file_basename ( options->image ) );
-					wp->image_direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
-					wp->image_direction = options->image_direction;
-					wp->timestamp = options->PhotoTime;
-					vik_trw_layer_filein_add_waypoint ( options->vtl, name, wp );
-					g_free ( name );
-				}
+/**
+ * Add the waypoint for the image to the layer, or update the existing one
+ */
+static void trw_layer_geotag_apply ( geotag_options_t *options, geotag_image_t *img )
+{
+	if ( !img->wp )
+		return;
 
-				// Mark for redraw
-				options->redraw = TRUE;
-			}
+	if ( img->positioned ) {
+		img->wp->image_direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
+		img->wp->image_direction = img->image_direction;
+		img->wp->timestamp = img->PhotoTime;
+	}
 
-			// Write EXIF if specified
-			if ( options->ov.write_exif ) {
-				gint ans = a_geotag_write_exif_gps ( options->image, options->coord, options->altitude,
-				                                     options->image_direction, WP_IMAGE_DIRECTION_REF_TRUE,
-				                                     options->ov.no_change_mtime );
-				if ( ans != 0 ) {
-					gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), options->image );
-					vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(options->vtl)), message, VIK_STATUSBAR_INFO );
-					g_free ( message );
-				}
+	// Mark for redraw
+	options->redraw = TRUE;
+
+	if ( options->ov.overwrite_waypoints ) {
+		// Find a WP with current name
+		const gchar *name = img->positioned ? a_file_basename ( img->image ) : img->name;
+		VikWaypoint *current_wp = vik_trw_layer_get_waypoint ( options->vtl, name );
+		if ( current_wp ) {
+			// Existing wp found, so set new position, comment and image
+			current_wp->coord = img->wp->coord;
+			current_wp->altitude = img->wp->altitude;
+			vik_waypoint_set_comment ( current_wp, img->wp->comment );
+			vik_waypoint_set_image ( current_wp, img->image );
+			if ( img->positioned ) {
+				current_wp->image_direction_ref = img->wp->image_direction_ref;
+				current_wp->image_direction = img->wp->image_direction;
+				current_wp->timestamp = img->wp->timestamp;
 			}
+			return;
 		}
 	}
+
+	if ( !img->name )
+		img->name = g_strdup ( a_file_basename ( img->image ) );
+	vik_trw_layer_filein_add_waypoint ( options->vtl, img->name, img->wp );
+	// Now owned by the layer
+	img->wp = NULL;
 }
 
 /*
@@ -523,29 +461,82 @@ static void trw_layer_geotag_thread_free ( geotag_options_t *gtd )
 {
 	if ( gtd->files )
 		g_list_free ( gtd->files );
+	if ( gtd->waypoints_track )
+		vik_track_free ( gtd->waypoints_track );
 	g_free ( gtd );
 }
 
+static void trw_layer_geotag_image_thread ( gpointer data, geotag_batch_t *batch )
+{
+	geotag_image_t *img = &batch->images[GPOINTER_TO_UINT(data) - 1];
+	if ( !g_atomic_int_get ( &batch->cancelled ) ) {
+		trw_layer_geotag_process ( batch->options, img );
+		img->done = TRUE;
+	}
+	g_async_queue_push ( batch->finished, data );
+}
+
 /**
  * Run geotagging process in a separate thread
+ *
+ * The images are read and written on several threads at once,
+ *  as that's where nearly all of the time goes
  */
 static int trw_layer_geotag_thread ( geotag_options_t *options, gpointer threaddata )
 {
-	guint total = g_list_length(options->files), done = 0;
+	guint total = g_list_length(options->files);
+
+	if ( !total || !options->vtl || !IS_VIK_LAYER(options->vtl) )
+		return 0;
 
 	// TODO decide how to report any issues to the user ...
 
+	if ( !options->wpt )
+		trw_layer_geotag_index ( options );
+
+	geotag_batch_t batch = { options, g_new0 ( geotag_image_t, total ), g_async_queue_new (), 0 };
+	guint ii = 0;
+	for ( GList *it = options->files; it; it = it->next )
+		batch.images[ii++].image = (gchar *) ( it->data );
+
+	guint threads = util_get_number_of_cpus ();
+	gint gitmp = 0;
+	if ( a_settings_get_integer ( VIK_SETTINGS_GEOTAG_THREADS, &gitmp ) && gitmp > 0 )
+		threads = gitmp;
+
 	// Foreach file attempt to geotag it
-	while ( options->files ) {
-		options->image = (gchar *) ( options->files->data );
-		trw_layer_geotag_process ( options );
-		options->files = options->files->next;
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)trw_layer_geotag_image_thread, &batch, MIN(threads, total), FALSE, NULL );
+	for ( ii = 0; ii < total; ii++ )
+		g_thread_pool_push ( pool, GUINT_TO_POINTER(ii+1), NULL );
 
+	int result = 0;
+	for ( ii = 0; ii < total; ii++ ) {
+		(void)g_async_queue_pop ( batch.finished );
 		// Update thread progress and detect stop requests
-		int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
-		if ( result != 0 )
-			return -1; /* Abort thread */
+		result = a_background_thread_progress ( threaddata, ((gdouble) (ii+1)) / total );
+		if ( result != 0 ) {
+			g_atomic_int_set ( &batch.cancelled, 1 );
+			break;
+		}
+	}
+	// Don't start any more, but wait for those already being processed
+	g_thread_pool_free ( pool, TRUE, TRUE );
+	g_async_queue_unref ( batch.finished );
+
+	// Add waypoints in the order of the files, unless aborted
+	gboolean apply = result == 0 && IS_VIK_LAYER(options->vtl);
+	for ( ii = 0; ii < total; ii++ ) {
+		geotag_image_t *img = &batch.images[ii];
+		if ( apply && img->done )
+			trw_layer_geotag_apply ( options, img );
+		if ( img->wp )
+			vik_waypoint_free ( img->wp );
+		g_free ( img->name );
 	}
+	g_free ( batch.images );
+
+	if ( result != 0 )
+		return -1; /* Abort thread */
 
 	if ( options->redraw ) {
 		if ( IS_VIK_LAYER(options->vtl) ) {
@@ -572,7 +563,7 @@ static void trw_layer_geotag_response_cb ( GtkDialog *dialog, gint resp, GeoTagW
 	default: {
 		//GTK_RESPONSE_ACCEPT:
 		// Get options
-		geotag_options_t *options = g_malloc ( sizeof(geotag_options_t) );
+		geotag_options_t *options = g_malloc0 ( sizeof(geotag_options_t) );
 		options->vtl = widgets->vtl;
 		options->wpt = widgets->wpt;
 		options->track = widgets->track;
@@ -26,6 +26,7 @@
 #include "dems.h"
 #include "degrees_converters.h"
 #include "astronomy.h"
+#include "background.h"
 
 #ifdef HAVE_LIBNOVA_LIBNOVA_H
 #include <libnova/libnova.h>
@@ -168,6 +169,10 @@ typedef struct _propwidgets {
   cairo_t         *cr_2nd[PGT_END];       // Only used in GTK3 version
   cairo_surface_t *surface_main[PGT_END]; //       "       "
   cairo_surface_t *surface_2nd[PGT_END];  //       "       "
+  struct _propwin_job_t *job;      // Working out the statistics and graphs in the background when in the dialog
+  GtkWidget *stats_page;           //  with the statistics shown here once done
+  gdouble   *early_values[PGT_END]; // Made by the job (early_width wide) for use until it is complete
+  gint      early_width;
 } PropWidgets;
 
 static const double GRAPH_OVERLAY_LINE_WIDTH = 2.0;
@@ -176,6 +181,7 @@ static const double GRAPH_OVERLAY_LINE_WIDTH = 2.0;
 static gboolean split_at_marker ( PropWidgets *widgets );
 static void draw_all_graphs ( GtkWidget *widget, PropWidgets *widgets, gboolean resized );
 static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr );
+static void propwin_job_stop ( PropWidgets *widgets );
 
 static PropWidgets *prop_widgets_new()
 {
@@ -203,6 +209,7 @@ static void prop_widgets_free(PropWidgets *widgets)
 #endif
     if ( widgets->values[pwgt] )
      g_free ( widgets->values[pwgt] );
+    g_free ( widgets->early_values[pwgt] );
   }
   g_free ( widgets->values );
   g_free(widgets);
@@ -1282,10 +1289,11 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
                                       gboolean do_dem,
                                       gboolean do_speed )
 {
-  GList *iter;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
+  const VikTrackColumns *cols = vik_track_get_columns ( tr );
+  if ( !cols->len || cols->distance[cols->len-1] <= 0.0 )
+    return;
+  gdouble total_length = cols->distance[cols->len-1];
 
-  gdouble dist = 0;
   gint h2 = height + MARGIN_Y; // Adjust height for x axis labelling offset
   gdouble achunk = chunks[cia]*LINES;
   gdouble schunk = chunks[cis]*LINES;
@@ -1300,17 +1308,17 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
   cairo_set_line_width ( cr, GRAPH_OVERLAY_LINE_WIDTH * vik_viewport_get_scale(vvp) );
 #endif
 
-  for (iter = tr->trackpoints; iter; iter = iter->next) {
-    if (iter->prev) {
-      dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-    }
+  // The elevations of all the points are looked up once and kept with the track,
+  //  so redrawing (e.g. on resizing) doesn't go back to the DEMs
+  const gint16 *elevs = do_dem ? vik_track_get_dem_elevations ( tr ) : NULL;
 
-    int x = (width * dist)/total_length + margin;
+  for ( guint ii = 0; ii < cols->len; ii++ ) {
+    int x = (width * cols->distance[ii])/total_length + margin;
 
     int y_alt, y_speed;
 
     if (do_dem) {
-      gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
+      gint16 elev = elevs[ii];
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
 	// Convert into height units
 	if (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET)
@@ -1327,7 +1335,7 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
           ui_cr_set_color ( cr, "green" );
           if ( first_point_alt ) {
             first_point_alt = FALSE;
-          } else if ( ! VIK_TRACKPOINT(iter->data)->newsegment ) {
+          } else if ( !cols->newsegment[ii] ) {
             ui_cr_draw_line( cr, last_x_alt, last_y_alt, x, y_alt );
             cairo_stroke ( cr );
           }
@@ -1348,8 +1356,8 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
 
     if (do_speed) {
       // This is just a speed indicator - no actual values can be inferred by user
-      if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
-	gdouble spd = vu_speed_convert ( speed_units, VIK_TRACKPOINT(iter->data)->speed ) ;
+      if (!isnan(cols->speed[ii])) {
+	gdouble spd = vu_speed_convert ( speed_units, cols->speed[ii] ) ;
         y_speed = h2 - (height * (spd-draw_min_speed))/schunk;
 #if GTK_CHECK_VERSION (3,0,0)
         if ( y_speed > 0 ) {
@@ -1381,19 +1389,17 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
 }
 
 #ifdef HAVE_LIBNOVA_LIBNOVA_H
-typedef struct _risesets {
-  struct ln_rst_time rstATw; // Astronomical Twilight
-  int resA;
-  struct ln_rst_time rstNTw; // Nautical Twilight
-  int resN;
-  struct ln_rst_time rstCTw; // Civil Twilight
-  int resC;
-  struct ln_rst_time rstS; // 'Standard' rise/set hours
-  int resS;
-} RiseSetsT;
-
 #if GTK_CHECK_VERSION (3,0,0)
 #define DAYLIGHT_COLOR "#B1DAE7"
+// Colours of each VikSunlight level
+static const gchar *sunlight_colors[] = {
+  "black",        // Proper night
+  "#18404E",      // Astronomical twilight
+  "#316577",      // Nautical twilight
+  "#63B4CF",      // Civil (normal twilight)
+  DAYLIGHT_COLOR,
+};
+
 /**
  * draw_sunlight_times:
  *
@@ -1403,6 +1409,10 @@ typedef struct _risesets {
  * So ATM this must be performed before the grid layout and the main graph are drawn.
  * ATM this for only GTK3+
  *  i.e not bothering with a GTK2 version
+ *
+ * How light it was, as seen from where the track was at each time, is worked out once
+ *  (normally by the dialog's background job) and then kept with the track.
+ * Thus drawing only looks up the level for each pixel column.
  */
 static void draw_sunlight_times ( GtkWidget *window, PangoLayout *pl, PropWidgets *widgets, cairo_t *cr, VikTrack *trk )
 {
@@ -1414,135 +1424,33 @@ static void draw_sunlight_times ( GtkWidget *window, PangoLayout *pl, PropWidget
   if ( widgets->duration > chunkst[G_N_ELEMENTS(chunkst)-1] )
     return;
 
-  time_t jts = tp->timestamp; // no need to round
-
-  const double JD_trk = ln_get_julian_from_timet ( &jts );
-  const double JD_daystart = astro_get_daystart ( JD_trk, &tp->coord );
-  const double JD_dayend = JD_daystart + 1;
-
-  time_t jte;
-  ln_get_timet_from_julian ( JD_dayend, &jte );
-
-  const time_t tt_diff = jte - jts;
-
-  // Multi day track processing
-  // Track can be up to N 'days' in length but may span across N+1 actual days
-  const guint days = (guint)ceil ( widgets->duration/(24.0 * 60.0 * 60.0) ) + 1;
-
-  // For very long tracks, reset the position used each day this can be effect
-  //  the times much more than the change of Earth position around the Sun.
-  // Indeed even on single day tracks the change in position will effect the apparent sunrise/set
-  //  consider in particular 'Chase the Sun' cycle events which maximise this effect.
-  // Since it is computationally intensive to (re)calculate timings for all positions,
-  //  for simplicity get new timings for each day at the new starting position of that day.
-  // Obviously not many people create tracks of such length in both time and space.
-  struct LatLon ll;
-  gboolean multi_days_span = FALSE;
-  if ( days > 2 ) {
-    // Multi days - so for 1st day use start of the track
-    multi_days_span = TRUE;
-    vik_coord_to_latlon ( &tp->coord, &ll );
-  }
-  else {
-    // Single day - just use center
-    widgets->vc = vik_track_get_center ( trk, vik_trw_layer_get_coord_mode(widgets->vtl) );
-    vik_coord_to_latlon ( &widgets->vc, &ll ); // Center of track
-  }
-
-  RiseSetsT rss[days];
-
-  // NB libnova uses the mathematical long,lat ordering
-  struct ln_lnlat_posn observer = { ll.lon, ll.lat };
-
-  for ( guint dd = 0; dd < days; dd++ ) {
-
-    // Get times for each (starting) day in the track
-    if ( multi_days_span ) {
-      gdouble seconds_from_start = NAN;
-      VikTrackpoint *tpt = vik_track_get_closest_tp_by_percentage_time ( trk, (gdouble)dd/(gdouble)days, &seconds_from_start );
-      if ( tpt && !isnan(seconds_from_start) ) {
-        // Next valid position
-        vik_coord_to_latlon ( &tpt->coord, &ll );
-        observer.lng = ll.lon;
-        observer.lat = ll.lat;
-      }
-    }
-    rss[dd].resA = ln_get_solar_rst_horizon ( JD_daystart+dd, &observer, LN_SOLAR_ASTRONOMICAL_HORIZON, &rss[dd].rstATw );
-    rss[dd].resN = ln_get_solar_rst_horizon ( JD_daystart+dd, &observer, LN_SOLAR_NAUTIC_HORIZON, &rss[dd].rstNTw );
-    rss[dd].resC = ln_get_solar_rst_horizon ( JD_daystart+dd, &observer, LN_SOLAR_CIVIL_HORIZON, &rss[dd].rstCTw );
-    rss[dd].resS = ln_get_solar_rst ( JD_daystart+dd, &observer, &rss[dd].rstS );
-  }
-
-  GdkRGBA rgba;
-
-  // Colouring somewhat more complicated for multiple days...
-  gboolean one_color = TRUE;
-  // Check all resS for either permanent nighttime or daylight
-  for ( guint dd = 0; dd < days; dd++ ) {
-    if ( rss[dd].resS == -1 )
-      one_color = one_color && TRUE;
-    else
-      one_color = FALSE;
-  }
-  if ( one_color ) {
-    // Permanent night (resC, resA and resA should axiomatically be -1 as well)
-    (void)gdk_rgba_parse ( &rgba, "black" ); // Night time
-    gdk_cairo_set_source_rgba ( cr, &rgba );
-  }
-  else {
-    one_color = TRUE;
-    for ( guint dd = 0; dd < days; dd++ ) {
-      if ( rss[dd].resS == 1 )
-        one_color = one_color && TRUE;
-      else
-        one_color = FALSE;
-    }
-    if ( one_color ) {
-      // Permanent daylight (resC, resA and resA should axiomatically be 1 as well)
-      (void)gdk_rgba_parse ( &rgba, DAYLIGHT_COLOR );
-      gdk_cairo_set_source_rgba ( cr, &rgba );
-    }
+  const VikTrackSunlight *sun = vik_track_get_sunlight ( trk );
+  if ( !sun ) {
+    // The background job will provide it
+    if ( widgets->job )
+      return;
+    // Otherwise the track has changed since, so work it out again now
+    vik_track_set_sunlight ( trk, astro_track_sunlight(trk) );
+    sun = vik_track_get_sunlight ( trk );
+    if ( !sun )
+      return;
   }
 
   const guint height = MARGIN_Y + widgets->profile_height - 1;
-  const gdouble secs_per_day = 24.0 * 60.0 * 60.0;
   const gdouble time_per_pixel_secs = (gdouble)(widgets->duration) / widgets->profile_width;
-  const gdouble time_per_pixel_days = time_per_pixel_secs / secs_per_day;
 
-  if ( one_color ) {
-    for (int ii = 0; ii < widgets->profile_width; ii++ )
-      ui_cr_draw_line ( cr, MARGIN_X+ii, MARGIN_Y, MARGIN_X+ii, height );
-    cairo_stroke ( cr );
-  } else {
-    double JD_px;
-    guint dd = 0;
-    for (int ii = 0; ii < widgets->profile_width; ii++ ) {
-
-      // Convert time to colour:
-      JD_px = JD_trk + ( ii * time_per_pixel_days );
-
-      // Convert to the day
-      // Check to see if the current point in time is on the subsequent day
-      dd = (guint)floor ( ii * time_per_pixel_days );
-      if ( (ii * time_per_pixel_secs) - (dd * secs_per_day) > tt_diff )
-        dd += 1;
-
-      if ( (JD_px > rss[dd].rstS.rise) && (JD_px < rss[dd].rstS.set) )
-        ui_cr_set_color ( cr, DAYLIGHT_COLOR );
-      else if ( (JD_px > rss[dd].rstCTw.rise) && (JD_px < rss[dd].rstCTw.set) )
-        ui_cr_set_color ( cr, "#63B4CF" ); // Civil (normal twilight)
-      else if ( (JD_px > rss[dd].rstNTw.rise) && (JD_px < rss[dd].rstNTw.set) )
-        ui_cr_set_color ( cr, "#316577" ); // Nautical twilight
-      else if ( (JD_px > rss[dd].rstATw.rise) && (JD_px < rss[dd].rstATw.set) )
-        ui_cr_set_color ( cr, "#18404E" );  // Astronomical twilight
-      else
-        ui_cr_set_color ( cr, "black" ); // Proper night
-      ui_cr_draw_line ( cr, MARGIN_X+ii, MARGIN_Y, MARGIN_X+ii, height );
-      // Possibly could only perform when colour has actually changed
-      //  but doesn't seem too slow, so ATM not worth checking.
+  gint last_level = -1;
+  for ( int ii = 0; ii < widgets->profile_width; ii++ ) {
+    gdouble pos = round ( (tp->timestamp + ii * time_per_pixel_secs - sun->start) / sun->step );
+    guint8 level = sun->levels[(guint)CLAMP(pos, 0, sun->len-1)];
+    if ( level != last_level ) {
       cairo_stroke ( cr );
+      ui_cr_set_color ( cr, sunlight_colors[level] );
+      last_level = level;
     }
+    ui_cr_draw_line ( cr, MARGIN_X+ii, MARGIN_Y, MARGIN_X+ii, height );
   }
+  cairo_stroke ( cr );
 }
 #endif // GTK3
 
@@ -1907,6 +1815,41 @@ static void draw_dem_gps_speed ( PropWidgets *widgets, GtkWidget *window, GdkPix
 }
 #endif
 
+/**
+ * Resample values to a different width (e.g. the graph has been resized),
+ *  simply by taking the nearest value
+ */
+static gdouble *values_stretch ( const gdouble *src, gint src_width, gint width )
+{
+  if ( !src || src_width <= 0 || width <= 0 )
+    return NULL;
+  gdouble *values = g_malloc ( sizeof(gdouble) * width );
+  for ( gint xx = 0; xx < width; xx++ )
+    values[xx] = src[MIN(src_width-1, (gint)((gint64)xx * src_width / width))];
+  return values;
+}
+
+/**
+ * Make the values of a graph
+ * Only reads the track, so this can be used on a copy of the track in another thread
+ */
+static gdouble *graph_make_map ( const VikTrack *trk, guint16 width, VikPropWinGraphType_t pwgt )
+{
+  switch ( pwgt ) {
+  case PGT_ELEVATION_DISTANCE: return vik_track_make_elevation_map ( trk, width );
+  case PGT_GRADIENT_DISTANCE:  return vik_track_make_gradient_map ( trk, width );
+  case PGT_SPEED_TIME:         return vik_track_make_speed_map ( trk, width );
+  case PGT_DISTANCE_TIME:      return vik_track_make_distance_map ( trk, width );
+  case PGT_SPEED_DISTANCE:     return vik_track_make_speed_dist_map ( trk, width );
+  case PGT_ELEVATION_TIME:     return vik_track_make_time_map_for ( trk, width, TRACK_VALUE_ELEVATION );
+  case PGT_HEART_RATE:         return vik_track_make_time_map_for ( trk, width, TRACK_VALUE_HEART_RATE );
+  case PGT_CADENCE:            return vik_track_make_time_map_for ( trk, width, TRACK_VALUE_CADENCE );
+  case PGT_TEMP:               return vik_track_make_time_map_for ( trk, width, TRACK_VALUE_TEMP );
+  case PGT_POWER:              return vik_track_make_time_map_for ( trk, width, TRACK_VALUE_POWER );
+  default: return NULL;
+  }
+}
+
 /**
  * Need to evaluate speeds (as they have not been yet been done)
  *  typically if the speed-time graph has been deselected from showing
@@ -1916,7 +1859,10 @@ static void evaluate_speeds ( PropWidgets *widgets )
   const VikPropWinGraphType_t pwgt = PGT_SPEED_TIME;
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
-  widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
+  if ( widgets->job )
+    widgets->values[pwgt] = values_stretch ( widgets->early_values[pwgt], widgets->early_width, widgets->profile_width );
+  else
+    widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return;
   speed_convert ( widgets->values[pwgt], widgets->profile_width );
@@ -2152,26 +2098,21 @@ static void draw_it ( cairo_t *cr, GtkWidget *image, VikTrack *trk, PropWidgets
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
 
-  if ( widgets->make_map[pwgt] )
+  if ( widgets->job )
+    // Still being worked out in the background, so make do with what has been made so far
+    widgets->values[pwgt] = values_stretch ( widgets->early_values[pwgt], widgets->early_width, widgets->profile_width );
+  else if ( widgets->make_map[pwgt] )
     widgets->values[pwgt] = widgets->make_map[pwgt] ( trk, widgets->profile_width );
-  else {
-    VikTrackValueType vtvt;
-    switch ( pwgt ) {
-    case PGT_ELEVATION_TIME: vtvt = TRACK_VALUE_ELEVATION; break;
-    case PGT_HEART_RATE:     vtvt = TRACK_VALUE_HEART_RATE; break;
-    case PGT_CADENCE:        vtvt = TRACK_VALUE_CADENCE; break;
-    case PGT_TEMP:           vtvt = TRACK_VALUE_TEMP; break;
-    case PGT_POWER:          vtvt = TRACK_VALUE_POWER; break;
-    default: return; break;
-    }
-    widgets->values[pwgt] = vik_track_make_time_map_for ( trk, widgets->profile_width, vtvt );
-  }
+  else
+    widgets->values[pwgt] = graph_make_map ( trk, widgets->profile_width, pwgt );
 
   if ( widgets->values[pwgt] == NULL )
     return;
 
   if ( is_time_graph(pwgt) ) {
-    widgets->duration = vik_track_get_duration ( trk, TRUE );
+    // Otherwise given by the job's statistics
+    if ( !widgets->job )
+      widgets->duration = vik_track_get_duration ( trk, TRUE );
     // Negative time or other problem
     if ( widgets->duration <= 0 )
       return;
@@ -2682,16 +2623,20 @@ GtkWidget *create_event_box ( GtkWidget *window, PropWidgets *widgets, VikPropWi
 
 /**
  * Create height profile widgets including the image and callbacks
+ * NB For this and the other graphs, the values are only made if not already available
+ *  (i.e. when in the dialog they are made in the background - see propwin_job_idle())
  */
 GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, PropWidgets *widgets )
 {
   // First allocation & monitor how quick (or not it is)
   const VikPropWinGraphType_t pwgt = PGT_ELEVATION_DISTANCE;
-  clock_t begin = clock();
-  widgets->values[pwgt] = vik_track_make_elevation_map ( widgets->tr, widgets->profile_width );
-  clock_t end = clock();
-  widgets->alt_create_time = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, widgets->alt_create_time );
+  if ( !widgets->values[pwgt] ) {
+    clock_t begin = clock();
+    widgets->values[pwgt] = vik_track_make_elevation_map ( widgets->tr, widgets->profile_width );
+    clock_t end = clock();
+    widgets->alt_create_time = (double)(end - begin) / CLOCKS_PER_SEC;
+    g_debug ( "%s: %f", __FUNCTION__, widgets->alt_create_time );
+  }
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->make_map[pwgt] = vik_track_make_elevation_map;
@@ -2708,7 +2653,8 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, PropWidgets *widget
 GtkWidget *vik_trw_layer_create_gradient ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_GRADIENT_DISTANCE;
-  widgets->values[pwgt] = vik_track_make_gradient_map ( widgets->tr, widgets->profile_width );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_gradient_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->make_map[pwgt] = vik_track_make_gradient_map;
@@ -2725,7 +2671,8 @@ GtkWidget *vik_trw_layer_create_gradient ( GtkWidget *window, PropWidgets *widge
 GtkWidget *vik_trw_layer_create_vtdiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_SPEED_TIME;
-  widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->make_map[pwgt] = vik_track_make_speed_map;
@@ -2743,7 +2690,8 @@ GtkWidget *vik_trw_layer_create_dtdiag ( GtkWidget *window, PropWidgets *widgets
 {
   // First allocation
   const VikPropWinGraphType_t pwgt = PGT_DISTANCE_TIME;
-  widgets->values[pwgt] = vik_track_make_distance_map ( widgets->tr, widgets->profile_width );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_distance_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->make_map[pwgt] = vik_track_make_distance_map;
@@ -2760,7 +2708,8 @@ GtkWidget *vik_trw_layer_create_dtdiag ( GtkWidget *window, PropWidgets *widgets
 GtkWidget *vik_trw_layer_create_etdiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_ELEVATION_TIME;
-  widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_ELEVATION );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_ELEVATION );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->convert_values[pwgt] = elev_convert;
@@ -2776,7 +2725,8 @@ GtkWidget *vik_trw_layer_create_etdiag ( GtkWidget *window, PropWidgets *widgets
 GtkWidget *vik_trw_layer_create_sddiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_SPEED_DISTANCE;
-  widgets->values[pwgt] = vik_track_make_speed_dist_map ( widgets->tr, widgets->profile_width );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_speed_dist_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->make_map[pwgt] = vik_track_make_speed_dist_map;
@@ -2793,7 +2743,8 @@ GtkWidget *vik_trw_layer_create_sddiag ( GtkWidget *window, PropWidgets *widgets
 GtkWidget *vik_trw_layer_create_hrdiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_HEART_RATE;
-  widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_HEART_RATE );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_HEART_RATE );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->convert_values[pwgt] = NULL;
@@ -2809,7 +2760,8 @@ GtkWidget *vik_trw_layer_create_hrdiag ( GtkWidget *window, PropWidgets *widgets
 GtkWidget *vik_trw_layer_create_caddiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_CADENCE;
-  widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_CADENCE );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_CADENCE );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->convert_values[pwgt] = NULL;
@@ -2825,7 +2777,8 @@ GtkWidget *vik_trw_layer_create_caddiag ( GtkWidget *window, PropWidgets *widget
 GtkWidget *vik_trw_layer_create_tempdiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_TEMP;
-  widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_TEMP );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_TEMP );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->convert_values[pwgt] = temp_convert;
@@ -2841,7 +2794,8 @@ GtkWidget *vik_trw_layer_create_tempdiag ( GtkWidget *window, PropWidgets *widge
 GtkWidget *vik_trw_layer_create_powdiag ( GtkWidget *window, PropWidgets *widgets)
 {
   const VikPropWinGraphType_t pwgt = PGT_POWER;
-  widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_POWER );
+  if ( !widgets->values[pwgt] )
+    widgets->values[pwgt] = vik_track_make_time_map_for ( widgets->tr, widgets->profile_width, TRACK_VALUE_POWER );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
   widgets->convert_values[pwgt] = NULL;
@@ -2907,6 +2861,7 @@ static void save_values ( PropWidgets *widgets )
 
 static void destroy_cb ( GtkDialog *dialog, PropWidgets *widgets )
 {
+  propwin_job_stop ( widgets );
   save_values(widgets);
   prop_widgets_free(widgets);
 }
@@ -3074,7 +3029,6 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
               vik_trw_layer_add_route ( vtl, new_tr_name, tracks[i] );
             else
               vik_trw_layer_add_track ( vtl, new_tr_name, tracks[i] );
-            vik_track_calculate_bounds ( tracks[i] );
 
             g_free ( new_tr_name );
 	  }
@@ -3290,8 +3244,9 @@ static void format_time_cell_data_func ( GtkTreeViewColumn *col,
  *
  * Create a table of the split values in a scrollable treeview,
  *  which then allows sorting by each of the columns and a way to copy all the data
+ * The splits are then freed
  */
-static GtkWidget *create_a_split_table ( VikTrack *trk, guint split_factor )
+static GtkWidget *create_a_split_table ( GArray *ga )
 {
   GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
   gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
@@ -3304,8 +3259,6 @@ static GtkWidget *create_a_split_table ( VikTrack *trk, guint split_factor )
                                              G_TYPE_INT ) ;  // 4: Loss
 
   vik_units_distance_t dist_units = a_vik_get_units_distance ();
-  gdouble split_length = vu_distance_deconvert ( dist_units, split_factor );
-
   vik_units_height_t height_units = a_vik_get_units_height ();
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
 
@@ -3360,8 +3313,6 @@ static GtkWidget *create_a_split_table ( VikTrack *trk, guint split_factor )
   gtk_container_add ( GTK_CONTAINER(scrolledwindow), view );
 
   // Update the datastore
-
-  GArray *ga = vik_track_speed_splits ( trk, split_length );
   GtkTreeIter t_iter;
 
   for ( guint gg = 0; gg < ga->len; gg++ ) {
@@ -3398,13 +3349,18 @@ static GtkWidget *create_a_split_table ( VikTrack *trk, guint split_factor )
   return scrolledwindow;
 }
 
+#define SPLITS_TABS 3
+
 /**
- * Create a GtkNotebook containing a few tabs of speed split information
+ * Work out the speed splits for each of a few tabs
+ * Only reads the track, so this can be used on a copy of the track in another thread
  */
-GtkWidget *vik_trw_propwin_create_splits_tabs ( VikTrack *trk )
+static void splits_make ( VikTrack *trk, vik_units_distance_t dist_units, guint index[SPLITS_TABS], GArray *splits[SPLITS_TABS] )
 {
   // Standard distance splits (in whatever the preferred distance units are)
-  int index[3] = {1, 5, 10};
+  index[0] = 1;
+  index[1] = 5;
+  index[2] = 10;
   // When very long tracks use bigger split distances
   gdouble len = vik_track_get_length(trk);
   // > 1000 KM ?
@@ -3419,11 +3375,20 @@ GtkWidget *vik_trw_propwin_create_splits_tabs ( VikTrack *trk )
     index[2] = 25;
   }
 
+  for ( guint ii = 0; ii < SPLITS_TABS; ii++ )
+    splits[ii] = vik_track_speed_splits ( trk, vu_distance_deconvert(dist_units, index[ii]) );
+}
+
+/**
+ * Create a GtkNotebook of the speed splits, which are then freed
+ */
+static GtkWidget *splits_tabs_new ( guint index[SPLITS_TABS], GArray *splits[SPLITS_TABS] )
+{
   // Create the tables and stick in tabs
   GtkWidget *tabs = gtk_notebook_new();
-  for ( int i = 0; i < G_N_ELEMENTS(index); i++ ) {
-    GtkWidget *table = create_a_split_table ( trk, index[i] );
-    gchar *str = g_strdup_printf (_("Split %d"), index[i]);
+  for ( guint ii = 0; ii < SPLITS_TABS; ii++ ) {
+    GtkWidget *table = create_a_split_table ( splits[ii] );
+    gchar *str = g_strdup_printf (_("Split %d"), index[ii]);
     gtk_notebook_append_page ( GTK_NOTEBOOK(tabs), GTK_WIDGET(table), gtk_label_new(str) );
     g_free ( str );
   }
@@ -3432,22 +3397,106 @@ GtkWidget *vik_trw_propwin_create_splits_tabs ( VikTrack *trk )
 }
 
 /**
- * Create a table of statistics for this track which is put into the supplied scrolled window
- * ATM the widgets are generated in a local array hence the widget attachment is performed in this function
- *
- * @compact: if TRUE then a compact statistic table is created - intended for side panel usage
- *
- * As a bonus of track processing the TimeZone of the track is calculated and so exposed for reuse.
- *
- * Returns: TimeZone; which may be NULL
+ * Create a GtkNotebook containing a few tabs of speed split information
  */
-gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, VikTrwLayer *vtl, gboolean compact )
+GtkWidget *vik_trw_propwin_create_splits_tabs ( VikTrack *trk )
+{
+  guint index[SPLITS_TABS];
+  GArray *splits[SPLITS_TABS];
+  splits_make ( trk, a_vik_get_units_distance(), index, splits );
+  return splits_tabs_new ( index, splits );
+}
+
+/**
+ * The values shown in a statistics table,
+ *  worked out apart from the widgets so that it can be done in a background thread
+ */
+typedef struct {
+  gdouble length;
+  gdouble length_including_gaps;
+  gulong tp_count;
+  guint seg_count;
+  gulong dup_count;
+  gdouble max_speed;
+  gdouble avg_speed;
+  gdouble avg_speed_moving;
+  gdouble min_alt;
+  gdouble max_alt;
+  gdouble elev_gain;
+  gdouble elev_loss;
+  gdouble t1;                // First and last times
+  gdouble t2;
+  VikCoord center;           // In LatLon - only if there are any trackpoints
+  gdouble duration;          // Including gaps between segments
+  gdouble segments_duration;
+  guint max_cad;
+  gdouble avg_cad;
+  guint max_hr;
+  gdouble avg_hr;
+  gboolean has_temp;
+  gdouble min_temp;
+  gdouble max_temp;
+  gdouble avg_temp;
+  guint max_pow;
+  gdouble avg_pow;
+} PropStatistics;
+
+/**
+ * Work out the statistics of the track
+ * Only reads the track, so this can be used on a copy of the track in another thread
+ */
+static void statistics_gather ( PropStatistics *ps, VikTrack *tr, gboolean prefer_gps_speed )
+{
+  ps->seg_count = vik_track_get_segment_count ( tr );
+
+  // Don't use minmax_array(widgets->values[PGT_ELEVATION_DISTANCE]), as that is a simplified representative of the points
+  //  thus can miss the highest & lowest values by a few metres
+  if ( !vik_track_get_minmax_alt (tr, &ps->min_alt, &ps->max_alt) )
+    ps->min_alt = ps->max_alt = NAN;
+
+  ps->length = vik_track_get_length(tr);
+  ps->length_including_gaps = vik_track_get_length_including_gaps ( tr );
+  ps->tp_count = vik_track_get_tp_count(tr);
+  ps->dup_count = vik_track_get_dup_point_count(tr);
+  ps->max_speed = vu_track_get_max_speed ( tr, prefer_gps_speed );
+  ps->avg_speed = vik_track_get_average_speed(tr);
+  // Use 60sec as the default period to be considered stopped
+  //  this is the TrackWaypoint draw stops default value 'vtl->stop_length'
+  //  however this variable is not directly accessible - and I don't expect it's often changed from the default
+  //  so ATM just put in the number
+  ps->avg_speed_moving = vik_track_get_average_speed_moving(tr, 60);
+  vik_track_get_total_elevation_gain(tr, &ps->elev_gain, &ps->elev_loss );
+
+  ps->t1 = NAN;
+  ps->t2 = NAN;
+  if ( tr->trackpoints ) {
+    ps->t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
+    ps->t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+    ps->center = vik_track_get_center ( tr, VIK_COORD_LATLON );
+  }
+  ps->duration = vik_track_get_duration ( tr, TRUE );
+  ps->segments_duration = vik_track_get_duration ( tr, FALSE );
+
+  ps->max_cad = vik_track_get_max_cadence ( tr );
+  ps->avg_cad = vik_track_get_avg_cadence ( tr );
+  ps->max_hr = vik_track_get_max_heart_rate ( tr );
+  ps->avg_hr = vik_track_get_avg_heart_rate ( tr );
+  ps->has_temp = vik_track_get_minmax_temp ( tr, &ps->min_temp, &ps->max_temp );
+  ps->avg_temp = vik_track_get_avg_temp ( tr );
+  ps->max_pow = vik_track_get_max_power ( tr );
+  ps->avg_pow = vik_track_get_avg_power ( tr );
+}
+
+/**
+ * Create a table of the statistics which is put into the supplied scrolled window
+ * See vik_trw_propwin_attach_statistics_table()
+ */
+static gchar* statistics_attach ( GtkWidget *sw, const PropStatistics *ps, gboolean compact )
 {
   GPtrArray *paw = g_ptr_array_new();
   GtkWidget *table;
-  gdouble tr_len;
-  gulong tp_count;
   gdouble tmp_speed;
+  gdouble min_alt, max_alt;
 
   static gchar tmp_buf[50];
 
@@ -3491,22 +3540,16 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
     for ( guint nn = 0; nn < G_N_ELEMENTS(stats_texts); nn++ )
       g_ptr_array_add ( pat, stats_texts[nn] );
 
-  guint seg_count = vik_track_get_segment_count ( tr );
-
-  // Don't use minmax_array(widgets->values[PGT_ELEVATION_DISTANCE]), as that is a simplified representative of the points
-  //  thus can miss the highest & lowest values by a few metres
-  gdouble min_alt, max_alt;
-  if ( !vik_track_get_minmax_alt (tr, &min_alt, &max_alt) )
-    min_alt = max_alt = NAN;
+  const guint seg_count = ps->seg_count;
+  const gdouble tr_len = ps->length;
+  const gulong tp_count = ps->tp_count;
 
   vik_units_distance_t dist_units = a_vik_get_units_distance ();
 
-  tr_len = vik_track_get_length(tr);
   vu_distance_text ( tmp_buf, sizeof(tmp_buf), dist_units, tr_len, TRUE, "%.2f", FALSE );
   GtkWidget *wtl = ui_label_new_selectable ( tmp_buf );
   g_ptr_array_add ( paw, wtl );
 
-  tp_count = vik_track_get_tp_count(tr);
   if ( !compact ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", tp_count );
     g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
@@ -3514,7 +3557,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
     g_snprintf(tmp_buf, sizeof(tmp_buf), "%u", seg_count );
     g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
 
-    g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", vik_track_get_dup_point_count(tr) );
+    g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", ps->dup_count );
     g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
   } else {
     g_snprintf(tmp_buf, sizeof(tmp_buf), "%s %lu\n%s %u", stats_texts[1], tp_count, stats_texts[2], seg_count );
@@ -3522,7 +3565,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   }
 
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
-  tmp_speed = vu_track_get_max_speed ( tr, vik_trw_layer_get_prefer_gps_speed(vtl) );
+  tmp_speed = ps->max_speed;
   if ( isnan(tmp_speed) )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -3530,7 +3573,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   }
   g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
 
-  tmp_speed = vik_track_get_average_speed(tr);
+  tmp_speed = ps->avg_speed;
   if ( tmp_speed == 0 )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -3538,11 +3581,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   }
   g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
 
-  // Use 60sec as the default period to be considered stopped
-  //  this is the TrackWaypoint draw stops default value 'vtl->stop_length'
-  //  however this variable is not directly accessible - and I don't expect it's often changed from the default
-  //  so ATM just put in the number
-  tmp_speed = vik_track_get_average_speed_moving(tr, 60);
+  tmp_speed = ps->avg_speed_moving;
   if ( tmp_speed == 0 )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -3558,6 +3597,8 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   }
 
   vik_units_height_t height_units = a_vik_get_units_height ();
+  min_alt = ps->min_alt;
+  max_alt = ps->max_alt;
   if ( isnan(min_alt) && isnan(max_alt) )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -3575,7 +3616,8 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   }
   g_ptr_array_add ( paw, ui_label_new_selectable(tmp_buf) );
 
-  vik_track_get_total_elevation_gain(tr, &max_alt, &min_alt );
+  max_alt = ps->elev_gain;
+  min_alt = ps->elev_loss;
   if ( isnan(min_alt) && isnan(max_alt) )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -3617,15 +3659,11 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   g_ptr_array_add ( paw, wegl );
 
   gchar *tz = NULL;
-  gdouble t1 = NAN;
-  gdouble t2 = NAN;
+  const gdouble t1 = ps->t1;
+  const gdouble t2 = ps->t2;
 
-  if ( tr->trackpoints ) {
-    t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-    t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  }
   if ( !isnan(t1) && !isnan(t2) ) {
-    VikCoord vc = vik_track_get_center ( tr, VIK_COORD_LATLON );
+    VikCoord vc = ps->center;
     tz = vu_get_tz_at_location ( &vc );
 
     time_t ts1 = round ( t1 );
@@ -3640,7 +3678,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
     g_free ( msg );
 
     gint total_duration_s = (gint)(t2-t1);
-    gint segments_duration_s = (gint)vik_track_get_duration(tr,FALSE);
+    gint segments_duration_s = (gint)ps->segments_duration;
     gint total_duration_m = total_duration_s/60;
     gint segments_duration_m = segments_duration_s/60;
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d minutes - %d minutes moving"), total_duration_m, segments_duration_m);
@@ -3674,32 +3712,33 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   table = create_table_from_arrays ( paw, pat );
   int cnt = paw->len-1;
 
-  guint max_cad = vik_track_get_max_cadence ( tr );
+  guint max_cad = ps->max_cad;
   if ( max_cad != VIK_TRKPT_CADENCE_NONE ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d RPM"), max_cad);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Cadence:</b>") );
   }
 
-  gdouble avg_cad = vik_track_get_avg_cadence ( tr );
+  gdouble avg_cad = ps->avg_cad;
   if ( !isnan(avg_cad) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f RPM"), avg_cad);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Cadence:</b>") );
   }
 
-  guint max_hr = vik_track_get_max_heart_rate ( tr );
+  guint max_hr = ps->max_hr;
   if ( max_hr ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d bpm"), max_hr);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Heart Rate:</b>") );
   }
 
-  gdouble avg_hr = vik_track_get_avg_heart_rate ( tr );
+  gdouble avg_hr = ps->avg_hr;
   if ( !isnan(avg_hr) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f bpm"), avg_hr);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Heart Rate:</b>") );
   }
 
-  gdouble min_temp, max_temp;
-  if ( vik_track_get_minmax_temp(tr, &min_temp, &max_temp) ) {
+  const gdouble min_temp = ps->min_temp;
+  const gdouble max_temp = ps->max_temp;
+  if ( ps->has_temp ) {
     if ( a_vik_get_units_temp() == VIK_UNITS_TEMP_CELSIUS )
       g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f%sC / %.1f%sC"), min_temp, DEGREE_SYMBOL, max_temp, DEGREE_SYMBOL);
     else
@@ -3710,7 +3749,7 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
       attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Min/Max Temperature:</b>") );
   }
 
-  gdouble avg_temp = vik_track_get_avg_temp ( tr );
+  gdouble avg_temp = ps->avg_temp;
   if ( !isnan(avg_temp) ) {
     if ( a_vik_get_units_temp() == VIK_UNITS_TEMP_CELSIUS )
       g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f%sC"), avg_temp, DEGREE_SYMBOL);
@@ -3722,13 +3761,13 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
       attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Temperature:</b>") );
   }
 
-  guint max_pow = vik_track_get_max_power ( tr );
+  guint max_pow = ps->max_pow;
   if ( max_pow != VIK_TRKPT_POWER_NONE ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d Watts"), max_pow);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Power:</b>") );
   }
 
-  gdouble avg_pow = vik_track_get_avg_power ( tr );
+  gdouble avg_pow = ps->avg_pow;
   if ( !isnan(avg_pow) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f Watts"), avg_pow);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Power:</b>") );
@@ -3742,6 +3781,23 @@ gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, Vi
   return tz;
 }
 
+/**
+ * Create a table of statistics for this track which is put into the supplied scrolled window
+ * ATM the widgets are generated in a local array hence the widget attachment is performed in this function
+ *
+ * @compact: if TRUE then a compact statistic table is created - intended for side panel usage
+ *
+ * As a bonus of track processing the TimeZone of the track is calculated and so exposed for reuse.
+ *
+ * Returns: TimeZone; which may be NULL
+ */
+gchar* vik_trw_propwin_attach_statistics_table ( GtkWidget *sw, VikTrack *tr, VikTrwLayer *vtl, gboolean compact )
+{
+  PropStatistics ps;
+  statistics_gather ( &ps, tr, vik_trw_layer_get_prefer_gps_speed(vtl) );
+  return statistics_attach ( sw, &ps, compact );
+}
+
 static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
 {
   // NB This value not shown yet - but is used by internal calculations
@@ -3765,6 +3821,434 @@ static void add_reorderable_page ( GtkNotebook *notebook, GtkWidget *page, GtkWi
 static gboolean redraw_signal_event ( GtkWidget *widget, cairo_t *cr, PropWidgets *widgets );
 #endif
 
+/**
+ * Show these graphs in the dialog, according to the preferences
+ */
+static const gchar *graph_prefs[PGT_END] = {
+  TPW_PREFS_NS"show_elev_dist",
+  TPW_PREFS_NS"show_grad_dist",
+  TPW_PREFS_NS"show_speed_time",
+  TPW_PREFS_NS"show_dist_time",
+  TPW_PREFS_NS"show_elev_time",
+  TPW_PREFS_NS"show_speed_dist",
+  TPW_PREFS_NS"show_heart_rate",
+  TPW_PREFS_NS"show_cadence",
+  TPW_PREFS_NS"show_temp",
+  TPW_PREFS_NS"show_power",
+};
+
+typedef GtkWidget* (*create_graph_func) (GtkWidget *window, PropWidgets *widgets);
+
+static const create_graph_func create_graph[PGT_END] = {
+  vik_trw_layer_create_profile,
+  vik_trw_layer_create_gradient,
+  vik_trw_layer_create_vtdiag,
+  vik_trw_layer_create_dtdiag,
+  vik_trw_layer_create_etdiag,
+  vik_trw_layer_create_sddiag,
+  vik_trw_layer_create_hrdiag,
+  vik_trw_layer_create_caddiag,
+  vik_trw_layer_create_tempdiag,
+  vik_trw_layer_create_powdiag,
+};
+
+typedef struct {
+  const gchar *label;
+  const gchar *markup;
+  const gchar *markup2;
+  const gchar *markup3;
+  gboolean dem;
+  const gchar *show_speed_mnemonic;
+} graph_page_t;
+
+static const graph_page_t graph_pages[PGT_END] = {
+  { N_("Elevation-distance"), N_("<b>Track Distance:</b>"), N_("<b>Track Height:</b>"), NULL, TRUE, N_("Show _GPS Speed") },
+  { N_("Gradient-distance"), N_("<b>Track Distance:</b>"), N_("<b>Track Gradient:</b>"), NULL, FALSE, N_("Show _GPS Speed") },
+  { N_("Speed-time"), N_("<b>Track Time:</b>"), N_("<b>Track Speed:</b>"), N_("<b>Time/Date:</b>"), FALSE, N_("Show _GPS Speed") },
+  { N_("Distance-time"), N_("<b>Track Distance:</b>"), N_("<b>Track Time:</b>"), N_("<b>Time/Date:</b>"), FALSE, N_("Show S_peed") },
+  { N_("Elevation-time"), N_("<b>Track Time:</b>"), N_("<b>Track Height:</b>"), N_("<b>Time/Date:</b>"), TRUE, N_("Show S_peed") },
+  { N_("Speed-distance"), N_("<b>Track Distance:</b>"), N_("<b>Track Speed:</b>"), NULL, FALSE, N_("Show _GPS Speed") },
+  { N_("Heart Rate"), N_("<b>Heart Rate:</b>"), N_("<b>Track Time:</b>"), NULL, TRUE, N_("Show _GPS Speed") },
+  { N_("Cadence"), N_("<b>Cadence:</b>"), N_("<b>Track Time:</b>"), NULL, TRUE, N_("Show _GPS Speed") },
+  { N_("Temperature"), N_("<b>Temperature:</b>"), N_("<b>Track Time:</b>"), NULL, TRUE, N_("Show _GPS Speed") },
+  { N_("Power"), N_("<b>Power:</b>"), N_("<b>Track Time:</b>"), NULL, TRUE, N_("Show _GPS Speed") },
+};
+
+/**
+ * Graphs added after the dialog has been shown are sized here,
+ *  since the dialog itself may not get another configure event
+ */
+static void graph_size_allocate_cb ( GtkWidget *widget, GtkAllocation *allocation, PropWidgets *widgets )
+{
+  if ( !widgets->configure_dialog )
+    (void)configure_event ( widgets->dialog, NULL, widgets );
+}
+
+/**
+ * Add the tab for a graph, if there is anything to show
+ */
+static void graph_page_add ( PropWidgets *widgets, VikPropWinGraphType_t pwgt, gboolean DEM_available )
+{
+  widgets->event_box[pwgt] = create_graph[pwgt] ( widgets->dialog, widgets );
+  if ( !widgets->event_box[pwgt] )
+    return;
+
+  const graph_page_t *gp = &graph_pages[pwgt];
+  widgets->page[pwgt] = create_graph_page ( widgets, pwgt,
+                                            _(gp->markup),
+                                            _(gp->markup2),
+                                            gp->markup3 ? _(gp->markup3) : NULL,
+                                            gp->dem, DEM_available,
+                                            _(gp->show_speed_mnemonic) );
+  add_reorderable_page ( GTK_NOTEBOOK(widgets->tabs), widgets->page[pwgt], gtk_label_new(_(gp->label)) );
+
+  // All checkboxes goto the same callback
+  if ( widgets->w_show_dem[pwgt] ) {
+    widgets->show_dem[pwgt] = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_dem[pwgt]) );
+    g_signal_connect ( widgets->w_show_dem[pwgt], "toggled", G_CALLBACK (checkbutton_toggle_cb), widgets );
+  }
+  if ( widgets->w_show_speed[pwgt] ) {
+    widgets->show_speed[pwgt] = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_speed[pwgt]) );
+    g_signal_connect ( widgets->w_show_speed[pwgt], "toggled", G_CALLBACK(checkbutton_toggle_cb), widgets );
+  }
+
+  g_signal_connect ( G_OBJECT(widgets->event_box[pwgt]), "size-allocate", G_CALLBACK(graph_size_allocate_cb), widgets );
+#if GTK_CHECK_VERSION (3,0,0)
+  g_signal_connect ( G_OBJECT(widgets->event_box[pwgt]), "draw", G_CALLBACK(redraw_signal_event), widgets );
+  recreate_surfaces ( pwgt, widgets, widgets->profile_width+MARGIN_X, widgets->profile_height+MARGIN_Y );
+#endif
+  gtk_widget_show_all ( widgets->page[pwgt] );
+}
+
+/**
+ * Put the graph tabs back in the order they were last arranged
+ */
+static void restore_tabs_order ( PropWidgets *widgets )
+{
+  gint *vals;
+  gsize length;
+  if ( a_settings_get_integer_list(VIK_PROPWIN_TABS_ORDER, &vals, &length) ) {
+    for ( guint nn = 0; nn < length; nn++ ) {
+      if ( nn < PGT_END )
+        if ( widgets->page[nn] )
+          gtk_notebook_reorder_child ( GTK_NOTEBOOK(widgets->tabs), widgets->page[nn], vals[nn] );
+    }
+    g_free ( vals );
+  }
+}
+
+/**
+ * Replace the placeholder on the statistics tab with the actual statistics
+ */
+static void statistics_show ( PropWidgets *widgets, const PropStatistics *ps )
+{
+  GtkWidget *child = gtk_bin_get_child ( GTK_BIN(widgets->stats_page) );
+  if ( child )
+    gtk_widget_destroy ( child );
+
+  // NB This value not shown yet - but is used by internal calculations
+  widgets->track_length_inc_gaps = ps->length_including_gaps;
+  widgets->duration = ps->duration;
+  widgets->tz = statistics_attach ( widgets->stats_page, ps, FALSE );
+  gtk_widget_show_all ( widgets->stats_page );
+}
+
+/**
+ * The statistics and graphs of a track being worked out in the background,
+ *  shared with the dialog so that each part can be shown as soon as it is done.
+ * To be safe from any changes to the track meanwhile, the job uses its own copy of the track.
+ */
+typedef struct _propwin_job_t {
+  gint ref_count;
+  GMutex *mutex;
+  PropWidgets *widgets;        // Only used in the main thread; NULL once no longer wanted
+  VikTrack *trk;               // The copy
+  guint serial;                // Of the track when copied
+  gint width;                  // Of the graphs
+  gboolean wanted[PGT_END];    // Graphs to be shown
+  gboolean prefer_gps_speed;
+  gboolean do_splits;
+  gboolean do_sunlight;
+  vik_units_distance_t dist_units;
+  gint cancelled;
+  // Protected by the mutex
+  PropStatistics *stats;
+  guint split_index[SPLITS_TABS];
+  GArray *splits[SPLITS_TABS];
+  gdouble *values[PGT_END];
+  gboolean made[PGT_END];
+  gboolean taken[PGT_END];     // By the dialog
+  gboolean complete;
+  gboolean update_pending;
+} propwin_job_t;
+
+static propwin_job_t *propwin_job_ref ( propwin_job_t *job )
+{
+  g_atomic_int_inc ( &job->ref_count );
+  return job;
+}
+
+static void propwin_job_unref ( propwin_job_t *job )
+{
+  if ( g_atomic_int_dec_and_test ( &job->ref_count ) ) {
+    g_free ( job->stats );
+    for ( guint ii = 0; ii < SPLITS_TABS; ii++ )
+      if ( job->splits[ii] )
+        g_array_free ( job->splits[ii], TRUE );
+    for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+      g_free ( job->values[pwgt] );
+    vik_track_free ( job->trk );
+    vik_mutex_free ( job->mutex );
+    g_free ( job );
+  }
+}
+
+/**
+ * The job is done, so use the track's own values from now on
+ */
+static void propwin_job_complete ( PropWidgets *widgets, propwin_job_t *job )
+{
+  // Anything made on the copy need not be made again (if the track is unchanged),
+  //  thus redrawing the graphs at any size is quick
+  if ( !vik_track_adopt_caches ( widgets->tr, job->serial, job->trk ) )
+    g_debug ( "%s: track changed meanwhile", __FUNCTION__ );
+
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+    g_free ( widgets->early_values[pwgt] );
+    widgets->early_values[pwgt] = NULL;
+  }
+
+  restore_tabs_order ( widgets );
+  // Note despite potential reordering above, the notebook keeps showing the current page
+
+  widgets->job = NULL;
+  job->widgets = NULL;
+  propwin_job_unref ( job );
+}
+
+// In main thread
+static gboolean propwin_job_idle ( propwin_job_t *job )
+{
+  guint index[SPLITS_TABS];
+  GArray *splits[SPLITS_TABS] = { NULL };
+  gdouble *values[PGT_END] = { NULL };
+  gboolean fresh[PGT_END] = { FALSE };
+
+  g_mutex_lock ( job->mutex );
+  job->update_pending = FALSE;
+  PropStatistics *ps = job->stats;
+  job->stats = NULL;
+  for ( guint ii = 0; ii < SPLITS_TABS; ii++ ) {
+    index[ii] = job->split_index[ii];
+    splits[ii] = job->splits[ii];
+    job->splits[ii] = NULL;
+  }
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+    if ( job->made[pwgt] && !job->taken[pwgt] ) {
+      fresh[pwgt] = TRUE;
+      values[pwgt] = job->values[pwgt];
+      job->values[pwgt] = NULL;
+      job->taken[pwgt] = TRUE;
+    }
+  }
+  gboolean complete = job->complete;
+  g_mutex_unlock ( job->mutex );
+
+  PropWidgets *widgets = job->widgets;
+  if ( widgets ) {
+    gboolean redraw = FALSE;
+    if ( ps )
+      statistics_show ( widgets, ps );
+
+    if ( splits[0] ) {
+      GtkWidget *page = splits_tabs_new ( index, splits );
+      gint pos = gtk_notebook_page_num ( GTK_NOTEBOOK(widgets->tabs), widgets->stats_page );
+      gtk_notebook_insert_page ( GTK_NOTEBOOK(widgets->tabs), page, gtk_label_new(_("Splits")), pos+1 );
+      gtk_widget_show_all ( page );
+      for ( guint ii = 0; ii < SPLITS_TABS; ii++ )
+        splits[ii] = NULL;
+    }
+
+    gboolean DEM_available = a_dems_overlaps_bbox ( widgets->tr->bbox );
+    for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+      if ( !fresh[pwgt] )
+        continue;
+      widgets->early_values[pwgt] = values[pwgt];
+      if ( values[pwgt] && job->wanted[pwgt] ) {
+        widgets->values[pwgt] = values_stretch ( values[pwgt], widgets->early_width, widgets->profile_width );
+        graph_page_add ( widgets, pwgt, DEM_available );
+        redraw = TRUE;
+      }
+      values[pwgt] = NULL;
+    }
+
+    if ( complete ) {
+      propwin_job_complete ( widgets, job );
+      redraw = TRUE;
+    }
+    if ( redraw )
+      draw_all_graphs ( widgets->dialog, widgets, TRUE );
+  }
+
+  g_free ( ps );
+  for ( guint ii = 0; ii < SPLITS_TABS; ii++ )
+    if ( splits[ii] )
+      g_array_free ( splits[ii], TRUE );
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    g_free ( values[pwgt] );
+
+  propwin_job_unref ( job );
+  return FALSE;
+}
+
+/**
+ * Ask for whatever has been done so far to be shown
+ */
+static void propwin_job_update ( propwin_job_t *job, gboolean complete )
+{
+  g_mutex_lock ( job->mutex );
+  if ( complete )
+    job->complete = TRUE;
+  if ( !job->update_pending ) {
+    job->update_pending = TRUE;
+    (void)gdk_threads_add_idle ( (GSourceFunc)propwin_job_idle, propwin_job_ref(job) );
+  }
+  g_mutex_unlock ( job->mutex );
+}
+
+/**
+ * The order the graphs are made in
+ * The speeds are first, as they're also used for the scale of any speeds drawn on the other graphs
+ */
+static void graphs_order ( VikPropWinGraphType_t order[PGT_END] )
+{
+  guint nn = 0;
+  order[nn++] = PGT_SPEED_TIME;
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    if ( pwgt != PGT_SPEED_TIME )
+      order[nn++] = pwgt;
+}
+
+static guint propwin_job_graphs_count ( propwin_job_t *job )
+{
+  guint count = 0;
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    if ( job->wanted[pwgt] || pwgt == PGT_SPEED_TIME )
+      count++;
+  return count;
+}
+
+/**
+ * Work out the statistics, then the splits and then each graph in turn
+ */
+static gint propwin_job_thread ( propwin_job_t *job, gpointer threaddata )
+{
+  PropStatistics *ps = g_malloc ( sizeof(PropStatistics) );
+  statistics_gather ( ps, job->trk, job->prefer_gps_speed );
+  // Only bother showing timing splits if track has some kind of timespan
+  gboolean do_splits = job->do_splits && ps->segments_duration > 1;
+  g_mutex_lock ( job->mutex );
+  job->stats = ps;
+  g_mutex_unlock ( job->mutex );
+  propwin_job_update ( job, FALSE );
+
+  if ( do_splits && !g_atomic_int_get(&job->cancelled) ) {
+    guint index[SPLITS_TABS];
+    GArray *splits[SPLITS_TABS];
+    splits_make ( job->trk, job->dist_units, index, splits );
+    g_mutex_lock ( job->mutex );
+    for ( guint ii = 0; ii < SPLITS_TABS; ii++ ) {
+      job->split_index[ii] = index[ii];
+      job->splits[ii] = splits[ii];
+    }
+    g_mutex_unlock ( job->mutex );
+    propwin_job_update ( job, FALSE );
+  }
+
+  gint result = 0;
+  guint count = propwin_job_graphs_count ( job );
+  guint done = 0;
+  VikPropWinGraphType_t order[PGT_END];
+  graphs_order ( order );
+  for ( guint nn = 0; nn < PGT_END; nn++ ) {
+    VikPropWinGraphType_t pwgt = order[nn];
+    if ( !job->wanted[pwgt] && pwgt != PGT_SPEED_TIME )
+      continue;
+    if ( a_background_thread_progress(threaddata, (gdouble)done/(gdouble)count) != 0 ||
+         g_atomic_int_get(&job->cancelled) ) {
+      result = -1;
+      break;
+    }
+    gdouble *values = graph_make_map ( job->trk, job->width, pwgt );
+    g_mutex_lock ( job->mutex );
+    job->values[pwgt] = values;
+    job->made[pwgt] = TRUE;
+    g_mutex_unlock ( job->mutex );
+    propwin_job_update ( job, FALSE );
+    done++;
+  }
+
+#ifdef HAVE_LIBNOVA_LIBNOVA_H
+  // Kept with the copy and so with the track once complete
+  if ( job->do_sunlight && !g_atomic_int_get(&job->cancelled) )
+    vik_track_set_sunlight ( job->trk, astro_track_sunlight(job->trk) );
+#endif
+
+  // Even if cancelled, so the dialog carries on with whatever is available
+  propwin_job_update ( job, TRUE );
+  return result;
+}
+
+/**
+ * Stop the job from updating the dialog
+ */
+static void propwin_job_stop ( PropWidgets *widgets )
+{
+  if ( widgets->job ) {
+    widgets->job->widgets = NULL;
+    g_atomic_int_set ( &widgets->job->cancelled, 1 );
+    propwin_job_unref ( widgets->job );
+    widgets->job = NULL;
+  }
+}
+
+/**
+ * Work out the statistics and graphs for the dialog in the background,
+ *  so the dialog can be shown straight away
+ */
+static void propwin_job_start ( PropWidgets *widgets, GtkWindow *parent )
+{
+  propwin_job_t *job = g_malloc0 ( sizeof(propwin_job_t) );
+  job->ref_count = 1;
+  job->mutex = vik_mutex_new ();
+  job->widgets = widgets;
+  job->trk = vik_track_copy ( widgets->tr, TRUE );
+  job->serial = vik_track_get_serial ( widgets->tr );
+  job->width = widgets->profile_width;
+  job->prefer_gps_speed = vik_trw_layer_get_prefer_gps_speed ( widgets->vtl );
+  job->do_splits = bool_pref_get ( TPW_PREFS_NS"show_splits" );
+#if GTK_CHECK_VERSION (3,0,0)
+  job->do_sunlight = bool_pref_get ( VIKING_PREFERENCES_ADVANCED_NAMESPACE"graphs_draw_sunlight" );
+#endif
+  job->dist_units = a_vik_get_units_distance ();
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    job->wanted[pwgt] = bool_pref_get ( graph_prefs[pwgt] );
+
+  widgets->early_width = job->width;
+  widgets->job = propwin_job_ref ( job );
+
+  gchar *msg = g_strdup_printf ( _("%s - Track Properties"), widgets->tr->name );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        parent,
+                        msg,
+                        (vik_thr_func)propwin_job_thread,
+                        job,
+                        (vik_thr_free_func)propwin_job_unref,
+                        NULL,
+                        propwin_job_graphs_count(job) );
+  g_free ( msg );
+}
+
 /**
  *
  */
@@ -3813,28 +4297,6 @@ void vik_trw_layer_propwin_run ( GtkWindow *parent,
 
   g_free(title);
 
-  gboolean DEM_available = a_dems_overlaps_bbox (tr->bbox);
-
-  if ( bool_pref_get(TPW_PREFS_NS"show_elev_dist") )
-    widgets->event_box[PGT_ELEVATION_DISTANCE] = vik_trw_layer_create_profile(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_grad_dist") )
-    widgets->event_box[PGT_GRADIENT_DISTANCE] = vik_trw_layer_create_gradient(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_speed_time") )
-    widgets->event_box[PGT_SPEED_TIME] = vik_trw_layer_create_vtdiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_dist_time") )
-    widgets->event_box[PGT_DISTANCE_TIME] = vik_trw_layer_create_dtdiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_elev_time") )
-    widgets->event_box[PGT_ELEVATION_TIME] = vik_trw_layer_create_etdiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_speed_dist") )
-    widgets->event_box[PGT_SPEED_DISTANCE] = vik_trw_layer_create_sddiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_heart_rate") )
-    widgets->event_box[PGT_HEART_RATE] = vik_trw_layer_create_hrdiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_cadence") )
-    widgets->event_box[PGT_CADENCE] = vik_trw_layer_create_caddiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_temp") )
-    widgets->event_box[PGT_TEMP] = vik_trw_layer_create_tempdiag(GTK_WIDGET(parent), widgets);
-  if ( bool_pref_get(TPW_PREFS_NS"show_power") )
-    widgets->event_box[PGT_POWER] = vik_trw_layer_create_powdiag(GTK_WIDGET(parent), widgets);
   GtkWidget *graphs = gtk_notebook_new();
 
   if ( bool_pref_get(TPW_PREFS_NS"tabs_on_side") )
@@ -3948,122 +4410,16 @@ void vik_trw_layer_propwin_run ( GtkWindow *parent,
   }
 
   gtk_notebook_append_page ( GTK_NOTEBOOK(graphs), GTK_WIDGET(props), gtk_label_new(_("Properties")) );
-  GtkWidget *stats_page = create_statistics_page ( widgets, widgets->tr );
+  // Filled in once worked out in the background - see statistics_show()
+  GtkWidget *stats_page = gtk_scrolled_window_new ( NULL, NULL );
+  gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(stats_page), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC );
+  gtk_scrolled_window_add_with_viewport ( GTK_SCROLLED_WINDOW(stats_page), gtk_label_new(_("Calculating...")) );
+  widgets->stats_page = stats_page;
+  if ( tr->trackpoints )
+    widgets->vc = vik_track_get_center ( tr, vik_trw_layer_get_coord_mode(widgets->vtl) );
   gtk_notebook_append_page ( GTK_NOTEBOOK(graphs), stats_page, gtk_label_new(_("Statistics")) );
 
-  // TODO: One day might be nice to have bar chart equivalent of the simple table values.
-  // Only bother showing timing splits if track has some kind of timespan
-  if ( bool_pref_get(TPW_PREFS_NS"show_splits") )
-    if ( vik_track_get_duration(tr,FALSE) > 1 )
-      gtk_notebook_append_page(GTK_NOTEBOOK(graphs), vik_trw_propwin_create_splits_tabs(tr), gtk_label_new(_("Splits")));
-
-  if ( widgets->event_box[PGT_ELEVATION_DISTANCE] ) {
-    widgets->page[PGT_ELEVATION_DISTANCE] = create_graph_page ( widgets, PGT_ELEVATION_DISTANCE,
-                                          _("<b>Track Distance:</b>"),
-                                          _("<b>Track Height:</b>"),
-                                          NULL,
-                                          TRUE, DEM_available,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_ELEVATION_DISTANCE], gtk_label_new(_("Elevation-distance")) );
-  }
-
-  if ( widgets->event_box[PGT_GRADIENT_DISTANCE] ) {
-    widgets->page[PGT_GRADIENT_DISTANCE] = create_graph_page ( widgets, PGT_GRADIENT_DISTANCE,
-                                          _("<b>Track Distance:</b>"),
-                                          _("<b>Track Gradient:</b>"),
-                                          NULL,
-                                          FALSE, FALSE,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_GRADIENT_DISTANCE], gtk_label_new(_("Gradient-distance")) );
-  }
-
-  if ( widgets->event_box[PGT_SPEED_TIME] ) {
-    widgets->page[PGT_SPEED_TIME] = create_graph_page ( widgets, PGT_SPEED_TIME,
-                                          _("<b>Track Time:</b>"),
-                                          _("<b>Track Speed:</b>"),
-                                          _("<b>Time/Date:</b>"),
-                                          FALSE, FALSE,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_SPEED_TIME], gtk_label_new(_("Speed-time")) );
-  }
-
-  if ( widgets->event_box[PGT_DISTANCE_TIME] ) {
-    widgets->page[PGT_DISTANCE_TIME] = create_graph_page ( widgets, PGT_DISTANCE_TIME,
-                                          _("<b>Track Distance:</b>"),
-                                          _("<b>Track Time:</b>"),
-                                          _("<b>Time/Date:</b>"),
-                                         FALSE, FALSE,
-                                         _("Show S_peed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_DISTANCE_TIME], gtk_label_new(_("Distance-time")) );
-  }
-
-  if ( widgets->event_box[PGT_ELEVATION_TIME] ) {
-    widgets->page[PGT_ELEVATION_TIME] = create_graph_page ( widgets, PGT_ELEVATION_TIME,
-                                          _("<b>Track Time:</b>"),
-                                          _("<b>Track Height:</b>"),
-                                          _("<b>Time/Date:</b>"),
-                                          TRUE, DEM_available,
-                                          _("Show S_peed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_ELEVATION_TIME], gtk_label_new(_("Elevation-time")) );
-  }
-
-  if ( widgets->event_box[PGT_SPEED_DISTANCE] ) {
-    widgets->page[PGT_SPEED_DISTANCE] = create_graph_page ( widgets, PGT_SPEED_DISTANCE,
-                                          _("<b>Track Distance:</b>"),
-                                          _("<b>Track Speed:</b>"),
-                                          NULL,
-                                          FALSE, FALSE,
-                                         _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_SPEED_DISTANCE], gtk_label_new(_("Speed-distance")) );
-  }
-
-  if ( widgets->event_box[PGT_HEART_RATE] ) {
-    widgets->page[PGT_HEART_RATE] = create_graph_page ( widgets, PGT_HEART_RATE,
-                                          _("<b>Heart Rate:</b>"),
-                                          _("<b>Track Time:</b>"),
-                                          NULL,
-                                          TRUE, DEM_available,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_HEART_RATE], gtk_label_new(_("Heart Rate")) );
-  }
-
-  if ( widgets->event_box[PGT_CADENCE] ) {
-    widgets->page[PGT_CADENCE] = create_graph_page ( widgets, PGT_CADENCE,
-                                          _("<b>Cadence:</b>"),
-                                          _("<b>Track Time:</b>"),
-                                          NULL,
-                                          TRUE, DEM_available,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_CADENCE], gtk_label_new(_("Cadence")) );
-  }
-
-  if ( widgets->event_box[PGT_TEMP] ) {
-    widgets->page[PGT_TEMP] = create_graph_page ( widgets, PGT_TEMP,
-                                          _("<b>Temperature:</b>"),
-                                          _("<b>Track Time:</b>"),
-                                          NULL,
-                                          TRUE, DEM_available,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_TEMP], gtk_label_new(_("Temperature")) );
-  }
-
-  if ( widgets->event_box[PGT_POWER] ) {
-    widgets->page[PGT_POWER] = create_graph_page ( widgets, PGT_POWER,
-                                          _("<b>Power:</b>"),
-                                          _("<b>Track Time:</b>"),
-                                          NULL,
-                                          TRUE, DEM_available,
-                                          _("Show _GPS Speed") );
-    add_reorderable_page ( GTK_NOTEBOOK(graphs), widgets->page[PGT_POWER], gtk_label_new(_("Power")) );
-  }
-
-  // All checkboxes goto the same callback
-  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
-    if ( widgets->w_show_dem[pwgt] )
-      g_signal_connect ( widgets->w_show_dem[pwgt], "toggled", G_CALLBACK (checkbutton_toggle_cb), widgets );
-    if ( widgets->w_show_speed[pwgt] )
-      g_signal_connect ( widgets->w_show_speed[pwgt], "toggled", G_CALLBACK(checkbutton_toggle_cb), widgets );
-  }
+  // The splits and graph tabs are added as they are made - see propwin_job_idle()
 
   gtk_box_pack_start (GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), graphs, TRUE, TRUE, 5);
 
@@ -4078,12 +4434,6 @@ void vik_trw_layer_propwin_run ( GtkWindow *parent,
   g_signal_connect ( G_OBJECT(dialog), "configure-event", G_CALLBACK (configure_event), widgets );
   g_signal_connect ( G_OBJECT(dialog), "destroy", G_CALLBACK (destroy_cb), widgets );
 #if GTK_CHECK_VERSION (3,0,0)
-  // Better to connect each individual graph
-  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
-    if ( widgets->event_box[pwgt] )
-      g_signal_connect ( G_OBJECT(widgets->event_box[pwgt]), "draw", G_CALLBACK(redraw_signal_event), widgets );
-  }
-
   gint ww;
   gint hh;
   // Restore size values - if too small the GTK will ignore them anyway
@@ -4103,18 +4453,7 @@ void vik_trw_layer_propwin_run ( GtkWindow *parent,
 
   widgets->tabs = graphs;
 
-  gint *vals;
-  gsize length;
-  if ( a_settings_get_integer_list(VIK_PROPWIN_TABS_ORDER, &vals, &length) ) {
-    for ( guint nn = 0; nn < length; nn++ ) {
-      if ( nn < PGT_END )
-        if ( widgets->page[nn] )
-          gtk_notebook_reorder_child ( GTK_NOTEBOOK(graphs), widgets->page[nn], vals[nn] );
-    }
-    g_free ( vals );
-  }
-  // Note despite potential reordering above, the notebook seems to default to showing the first added page
-  //  i.e. thus it maintains showing the Property tab by default
+  propwin_job_start ( widgets, parent );
 
   // Gtk note: due to historical reasons, this must be done after widgets are shown
   if ( start_on_stats )
@@ -22,6 +22,7 @@
 #include "viking.h"
 #include "viktrwlayer_tracklist.h"
 #include "viktrwlayer_propwin.h"
+#include "viktracklistmodel.h"
 
 // Long formatted date+basic time - listing this way ensures the string comparison sort works - so no local type format %x or %c here!
 #define TRACK_LIST_DATE_FORMAT "%Y-%m-%d %H:%M"
@@ -62,9 +63,8 @@ static gboolean configure_event ( GtkWidget *widget, GdkEventConfigure *event, g
   return FALSE;
 }
 
-#define TRK_LIST_COLS 12
-#define TRK_COL_NUM TRK_LIST_COLS-1
-#define TRW_COL_NUM TRK_COL_NUM-1
+#define TRK_COL_NUM VIK_TRACK_LIST_COL_TRACK
+#define TRW_COL_NUM VIK_TRACK_LIST_COL_LAYER
 
 /*
  * trw_layer_track_tooltip_cb:
@@ -398,161 +398,12 @@ static gboolean trw_layer_track_button_pressed ( GtkWidget *tree_view,
 	return trw_layer_track_menu_popup ( tree_view, event, data );
 }
 
-/*
- * Foreach entry we copy the various individual track properties into the tree store
- *  formatting & converting the internal values into something for display
- */
-static void trw_layer_track_list_add ( vik_trw_and_track_t *vtt,
-                                       GtkTreeStore *store,
-                                       vik_units_distance_t dist_units,
-                                       vik_units_speed_t speed_units,
-                                       vik_units_height_t height_units,
-                                       const gchar* date_format )
-{
-	GtkTreeIter t_iter;
-	VikTrack *trk = vtt->trk;
-	VikTrwLayer *vtl = vtt->vtl;
-
-	// Store unit converted value
-	gdouble trk_dist = vu_distance_convert ( dist_units, vik_track_get_length(trk) );
-
-	// Get start date
-	gchar time_buf[32];
-	time_buf[0] = '\0';
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		VikTrackpoint *tp = VIK_TRACKPOINT(trk->trackpoints->data);
-		time_t tt = tp->timestamp;
-		gchar *time = vu_get_time_string ( &tt, date_format, &tp->coord, NULL );
-		g_strlcpy ( time_buf, time, sizeof(time_buf) );
-		g_free ( time );
-	}
-
-	gboolean visible = trk->visible && (trk->is_route ? vik_trw_layer_get_routes_visibility(vtl) : vik_trw_layer_get_tracks_visibility(vtl));
-	visible = visible && vik_treeview_item_get_visible_tree ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
-
-	guint trk_len_time = 0; // In minutes
-	if ( trk->trackpoints ) {
-		gdouble t1, t2;
-		t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		t2 = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
-		if ( !isnan(t1) && !isnan(t2) )
-			trk_len_time = (int)round(fabs(t2-t1)/60.0);
-	}
-
-	gdouble av_speed = 0.0;
-	gdouble max_speed = 0.0;
-	gdouble max_alt = 0.0;
-
-	// Routes clearly don't have speeds
-	if ( !trk->is_route ) {
-		av_speed = vik_track_get_average_speed ( trk );
-		av_speed = vu_speed_convert ( speed_units, av_speed );
-
-		max_speed = vu_track_get_max_speed ( trk, vik_trw_layer_get_prefer_gps_speed(vtl) );
-		if ( isnan(max_speed) )
-			max_speed = 0.0;
-		else
-			max_speed = vu_speed_convert ( speed_units, max_speed );
-	}
-
-	// TODO - make this a function to get min / max values?
-	gdouble *altitudes = NULL;
-	altitudes = vik_track_make_elevation_map ( trk, 500 );
-	if ( altitudes ) {
-		max_alt = -1000;
-		guint i;
-		for ( i=0; i < 500; i++ ) {
-			if ( !isnan(altitudes[i]) ) {
-				if ( altitudes[i] > max_alt )
-					max_alt = altitudes[i];
-			}
-		}
-	}
-	g_free ( altitudes );
-
-	switch (height_units) {
-	case VIK_UNITS_HEIGHT_FEET: max_alt = VIK_METERS_TO_FEET(max_alt); break;
-	default:
-		// VIK_UNITS_HEIGHT_METRES: no need to convert
-		break;
-	}
-
-	gtk_tree_store_append ( store, &t_iter, NULL );
-	gtk_tree_store_set ( store, &t_iter,
-	                     0, VIK_LAYER(vtl)->name,
-	                     1, trk->name,
-	                     2, time_buf,
-	                     3, visible,
-	                     4, trk_dist,
-	                     5, trk_len_time,
-	                     6, av_speed,
-	                     7, max_speed,
-	                     8, (gint)round(max_alt),
-	                     9, trk->is_route,
-	                     TRW_COL_NUM, vtl,
-	                     TRK_COL_NUM, trk,
-	                     -1 );
-}
-
-static gboolean
-filter_tracks_cb (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
-{
-	const gchar *filter = gtk_entry_get_text ( GTK_ENTRY(data) );
-
-	if ( filter == NULL || strlen ( filter ) == 0 )
-		return TRUE;
-
-	gchar *filter_case = g_utf8_casefold ( filter, -1 );
-
-	VikTrack *trk;
-	gtk_tree_model_get ( model, iter, TRK_COL_NUM, &trk, -1 );
-
-	if ( trk == NULL )
-		return FALSE;
-
-	gboolean visible = FALSE;
-
-	gchar *layer_name;
-	gtk_tree_model_get ( model, iter, 0, &layer_name, -1 );
-	if ( layer_name != NULL ) {
-		gchar *layer_name_case = g_utf8_casefold ( layer_name, -1 );
-		visible |= ( strstr ( layer_name_case, filter_case ) != NULL );
-		g_free ( layer_name_case );
-	}
-	g_free ( layer_name );
-
-	gchar *trk_name_case = g_utf8_casefold ( trk->name, -1 );
-	visible |= ( strstr ( trk_name_case, filter_case ) != NULL );
-	g_free ( trk_name_case );
-
-	gchar *time_buf;
-	gtk_tree_model_get ( model, iter, 2, &time_buf, -1 );
-	visible |= (time_buf != NULL && strstr ( time_buf, filter_case )  != NULL);
-	g_free ( time_buf );
-
-	if ( trk->comment != NULL ) {
-		gchar *trk_comment_case = g_utf8_casefold ( trk->comment, -1 );
-		visible |= ( strstr ( trk_comment_case, filter_case ) != NULL );
-		g_free ( trk_comment_case );
-	}
-
-	if ( trk->description != NULL ) {
-		gchar *trk_description_case = g_utf8_casefold ( trk->description, -1 );
-		visible |= ( strstr ( trk_description_case, filter_case ) != NULL );
-		g_free ( trk_description_case );
-	}
-
-	g_free ( filter_case );
-
-	return visible;
-}
-
 static void
 filter_changed_cb (GtkEntry   *entry,
                    GParamSpec *pspec,
                    gpointer   data)
 {
-    gtk_tree_model_filter_refilter( GTK_TREE_MODEL_FILTER(data) );
+	vik_track_list_model_set_filter ( VIK_TRACK_LIST_MODEL(data), gtk_entry_get_text(entry) );
 }
 
 /**
@@ -563,6 +414,9 @@ filter_changed_cb (GtkEntry   *entry,
  *
  * Create a table of tracks with corresponding track information
  * This table does not support being actively updated
+ *
+ * The rows of the model are only filled in as they are shown,
+ *  so even lists of very many tracks open quickly
  */
 static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
                                                 GList *tracks_and_layers,
@@ -571,42 +425,21 @@ static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
 	if ( !tracks_and_layers )
 		return;
 
-	// It's simple storing the gdouble values in the tree store as the sort works automatically
+	// The model keeps the gdouble values so the sort works numerically
 	// Then apply specific cell data formatting (rather default double is to 6 decimal places!)
-	GtkTreeStore *store = gtk_tree_store_new ( TRK_LIST_COLS,
-	                                           G_TYPE_STRING,    // 0: Layer Name
-	                                           G_TYPE_STRING,    // 1: Track Name
-	                                           G_TYPE_STRING,    // 2: Date
-	                                           G_TYPE_BOOLEAN,   // 3: Visible
-	                                           G_TYPE_DOUBLE,    // 4: Distance
-	                                           G_TYPE_UINT,      // 5: Length in time
-	                                           G_TYPE_DOUBLE,    // 6: Av. Speed
-	                                           G_TYPE_DOUBLE,    // 7: Max Speed
-	                                           G_TYPE_INT,       // 8: Max Height
-	                                           G_TYPE_BOOLEAN,   // 9: Is Route
-	                                           G_TYPE_POINTER,   // 10: TrackWaypoint Layer pointer
-	                                           G_TYPE_POINTER ); // 11: Track pointer
-
-	//gtk_tree_selection_set_select_function ( gtk_tree_view_get_selection (GTK_TREE_VIEW(vt)), vik_treeview_selection_filter, vt, NULL );
-
 	vik_units_distance_t dist_units = a_vik_get_units_distance ();
 	vik_units_speed_t speed_units = a_vik_get_units_speed ();
 	vik_units_height_t height_units = a_vik_get_units_height ();
 
-	//GList *gl = get_tracks_and_layers_cb ( vl, user_data );
-	//g_list_foreach ( tracks_and_layers, (GFunc) trw_layer_track_list_add, store );
 	gchar *date_format = NULL;
 	if ( !a_settings_get_string ( VIK_SETTINGS_LIST_DATE_FORMAT, &date_format ) )
 		date_format = g_strdup ( TRACK_LIST_DATE_FORMAT );
+	VikTrackListModel *model = vik_track_list_model_new ( tracks_and_layers, date_format );
+	g_free ( date_format );
 
 	gboolean is_only_routes = TRUE;
-	GList *gl = tracks_and_layers;
-	while ( gl ) {
-		trw_layer_track_list_add ( (vik_trw_and_track_t*)gl->data, store, dist_units, speed_units, height_units, date_format );
-		is_only_routes = is_only_routes & ((vik_trw_and_track_t*)gl->data)->trk->is_route;
-		gl = g_list_next ( gl );
-	}
-	g_free ( date_format );
+	for ( GList *gl = tracks_and_layers; gl && is_only_routes; gl = g_list_next(gl) )
+		is_only_routes = ((vik_trw_and_track_t*)gl->data)->trk->is_route;
 
 	GtkWidget *view = gtk_tree_view_new();
 	GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
@@ -693,14 +526,22 @@ static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
 	gtk_tree_view_append_column ( GTK_TREE_VIEW(view), column );
 	column_runner++;
 
-	GtkTreeModelFilter *model = GTK_TREE_MODEL_FILTER(gtk_tree_model_filter_new ( GTK_TREE_MODEL(store), NULL));
-	GtkTreeModelSort *sorted = GTK_TREE_MODEL_SORT(gtk_tree_model_sort_new_with_model ( GTK_TREE_MODEL(model) ));
+	// Fixed sizes so only the rows shown are asked for their values
+	GList *columns = gtk_tree_view_get_columns ( GTK_TREE_VIEW(view) );
+	for ( GList *gl = columns; gl; gl = g_list_next(gl) ) {
+		GtkTreeViewColumn *col = GTK_TREE_VIEW_COLUMN(gl->data);
+		gtk_tree_view_column_set_sizing ( col, GTK_TREE_VIEW_COLUMN_FIXED );
+		gtk_tree_view_column_set_fixed_width ( col, gtk_tree_view_column_get_expand(col) ? 150 : 80 );
+	}
+	g_list_free ( columns );
+	gtk_tree_view_set_fixed_height_mode ( GTK_TREE_VIEW(view), TRUE );
 
-	gtk_tree_view_set_model ( GTK_TREE_VIEW(view), GTK_TREE_MODEL(sorted) );
+	gtk_tree_view_set_model ( GTK_TREE_VIEW(view), GTK_TREE_MODEL(model) );
+	vik_track_list_model_set_view ( model, GTK_TREE_VIEW(view) );
 	gtk_tree_selection_set_mode ( gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), GTK_SELECTION_MULTIPLE );
 	gtk_tree_view_set_rules_hint ( GTK_TREE_VIEW(view), TRUE );
 
-	g_object_unref(store);
+	g_object_unref ( model );
 
 	GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
 	gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
@@ -716,7 +557,6 @@ static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
 
 	GtkWidget *filter_entry = ui_entry_new( NULL, GTK_ENTRY_ICON_SECONDARY );
 	g_signal_connect ( filter_entry, "notify::text", G_CALLBACK(filter_changed_cb), model );
-	gtk_tree_model_filter_set_visible_func ( model, filter_tracks_cb, filter_entry, NULL );
 
 	GtkWidget *filter_label = gtk_label_new ( _("Filter") );
 	g_object_set ( filter_label, "has-tooltip", TRUE, NULL );
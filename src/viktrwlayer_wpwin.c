@@ -210,7 +210,7 @@ static void VikTrwLayerWpwin_free ( VikTrwLayerWpwin *widgets )
 
 static void trw_layer_wpwin_response ( VikTrwLayerWpwin *ww, gint response );
 
-static void set_button_url ( GtkWidget *widget, gchar *str )
+static void set_button_url ( GtkWidget *widget, const gchar *str )
 {
   // GTK too stupid and shows a blank tooltip when ""
   //  and also shows a tooltip even when insensitized, so turn it off
@@ -425,7 +425,7 @@ VikTrwLayerWpwin *vik_trw_layer_wpwin_show ( GtkWindow *parent, VikTrwLayerWpwin
       switch (ii) {
       case 6:  ww->commentlabel = ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], wp->comment, TRUE, 1, TRUE ); break;
       case 7:  ww->descriptionlabel = ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], wp->description, TRUE, 1, TRUE ); break;
-      case 8:  ww->sourcelabel = ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], wp->source, TRUE, 1, TRUE ); break;
+      case 8:  ww->sourcelabel = ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], (gchar*)wp->source, TRUE, 1, TRUE ); break;
       case 10: ww->imagelabel = ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], wp->image, TRUE, 1, TRUE ); break;
       default:
         (void)ui_attach_to_table ( btab, ii, bas_labels_str[ii], bas_content_prop[ii], NULL, TRUE, 1, FALSE ); break;
@@ -687,17 +687,18 @@ VikTrwLayerWpwin *vik_trw_layer_wpwin_show ( GtkWindow *parent, VikTrwLayerWpwin
   set_button_url ( ww->urlbutton, wp->url );
   ui_entry_set_text ( ww->urlnameentry, wp->url_name );
 
-  set_widget_double ( ww->geoidhgtentry, wp->geoidheight, "%2f", height_units );
-  set_widget_double ( ww->hdopvalue, wp->hdop, "%0.3f", height_units );
-  set_widget_double ( ww->vdopvalue, wp->vdop, "%0.3f", height_units );
-  set_widget_double ( ww->pdopvalue, wp->pdop, "%0.3f", height_units );
+  const VikWaypointExtra *extra = vik_waypoint_get_extra ( wp );
+  set_widget_double ( ww->geoidhgtentry, extra->geoidheight, "%2f", height_units );
+  set_widget_double ( ww->hdopvalue, extra->hdop, "%0.3f", height_units );
+  set_widget_double ( ww->vdopvalue, extra->vdop, "%0.3f", height_units );
+  set_widget_double ( ww->pdopvalue, extra->pdop, "%0.3f", height_units );
   // Fake the units to ensure values not converted
-  set_widget_double ( ww->magvarvalue, wp->magvar, "%05.2f", VIK_UNITS_HEIGHT_METRES );
-  set_widget_double ( ww->agedvalue, wp->ageofdgpsdata, "%0.3f", VIK_UNITS_HEIGHT_METRES );
+  set_widget_double ( ww->magvarvalue, extra->magvar, "%05.2f", VIK_UNITS_HEIGHT_METRES );
+  set_widget_double ( ww->agedvalue, extra->ageofdgpsdata, "%0.3f", VIK_UNITS_HEIGHT_METRES );
 
-  set_text_uint ( ww->fixvalue, wp->fix_mode );
-  set_text_uint ( ww->satvalue, wp->nsats );
-  set_text_uint ( ww->dgpsidvalue, wp->dgpsid );
+  set_text_uint ( ww->fixvalue, extra->fix_mode );
+  set_text_uint ( ww->satvalue, extra->nsats );
+  set_text_uint ( ww->dgpsidvalue, extra->dgpsid );
 
   // Although proximity is a distance - we'll treat it more akin to metres/feet like the height preference
   set_widget_double ( ww->prxentry, wp->proximity, "%0.1f", height_units );
@@ -896,24 +897,24 @@ static void trw_layer_wpwin_response ( VikTrwLayerWpwin *ww, gint response )
       if ( util_gdouble_different(old, wp->speed) )
         changed = TRUE;
 
-      old = wp->geoidheight;
+      gdouble geoidheight = NAN;
       gchar const *ghtext = gtk_entry_get_text ( GTK_ENTRY(ww->geoidhgtentry) );
       if ( ghtext && strlen(ghtext) ) {
         // Always store in metres
         switch (height_units) {
         case VIK_UNITS_HEIGHT_FEET:
-          wp->geoidheight = VIK_FEET_TO_METERS(atof(ghtext));
+          geoidheight = VIK_FEET_TO_METERS(atof(ghtext));
           break;
         default:
           // VIK_UNITS_HEIGHT_METRES:
-          wp->geoidheight = atof ( ghtext );
+          geoidheight = atof ( ghtext );
         }
       }
-      else {
-        wp->geoidheight = NAN;
-      }
-      if ( util_gdouble_different(old, wp->geoidheight) )
+      if ( util_gdouble_different(vik_waypoint_get_extra(wp)->geoidheight, geoidheight) ) {
+        vik_waypoint_edit_extra(wp)->geoidheight = geoidheight;
+        vik_waypoint_trim_extra ( wp );
         changed = TRUE;
+      }
 
       str = gtk_entry_get_text ( GTK_ENTRY(ww->urlentry) );
       if ( g_strcmp0(wp->url, str) ) {
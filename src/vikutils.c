@@ -25,12 +25,13 @@
  */
 #include "viking.h"
 #include "compression.h"
+#include "binfile.h"
 #include "download.h"
 #include "vikmapslayer.h"
 #include "settings.h"
 #include "dir.h"
 #include "degrees_converters.h"
-#include "misc/kdtree.h"
+#include "latlontz.h"
 #include "misc/gtkhtml-private.h"
 
 #define FMT_MAX_NUMBER_CODES 9
@@ -528,76 +529,43 @@ gchar *vu_get_canonical_filename ( VikLayer *vl, const gchar *filename )
   return canonical;
 }
 
-static struct kdtree *kd = NULL;
-
-/**
- * load_ll_tz_dir
- * @dir: The directory from which to load the latlontz.txt file
- *
- * Returns: The number of elements within the latlontz.txt loaded
- */
-static gint load_ll_tz_dir ( const gchar *dir )
-{
-	gint inserted = 0;
-	gchar *lltz = g_build_filename ( dir, "latlontz.txt", NULL );
-	if ( g_access(lltz, R_OK) == 0 ) {
-		gchar buffer[4096];
-		long line_num = 0;
-		FILE *ff = g_fopen ( lltz, "r" );
-		if ( ff ) {
-			while ( fgets ( buffer, 4096, ff ) ) {
-				line_num++;
-				gchar **components = g_strsplit (buffer, " ", 3);
-				guint nn = g_strv_length ( components );
-				if ( nn == 3 ) {
-					double pt[2] = { g_ascii_strtod (components[0], NULL), g_ascii_strtod (components[1], NULL) };
-					gchar *timezone = g_strchomp ( components[2] );
-					if ( kd_insert ( kd, pt, timezone ) )
-						g_critical ( "Insertion problem of %s for line %ld of latlontz.txt", timezone, line_num );
-					else
-						inserted++;
-					// NB Don't free timezone as it's part of the kdtree data now
-					g_free ( components[0] );
-					g_free ( components[1] );
-				} else {
-					g_warning ( "Line %ld of latlontz.txt does not have 3 parts", line_num );
-				}
-				g_free ( components );
-			}
-			fclose ( ff );
-		}
-		else {
-			g_warning ( "%s: Could not open %s", __FUNCTION__, lltz);
-		}
-	}
-	g_free ( lltz );
-
-	return inserted;
-}
+static VikLatLonTz *lltz = NULL;
 
 /**
  * vu_setup_lat_lon_tz_lookup:
  *
  * Can be called multiple times but only initializes the lookup once
+ *
+ * The lookup made from the latlontz.txt files is kept in the viking directory,
+ *  so normally this only needs to map that file.
  */
 void vu_setup_lat_lon_tz_lookup ()
 {
 	// Only setup once
-	if ( kd )
+	if ( lltz )
 		return;
 
-	kd = kd_create(2);
-
 	// Look in the directories of data path
 	gchar **data_dirs = a_get_viking_data_path();
-	guint loaded = 0;
+	GPtrArray *files = g_ptr_array_new_with_free_func ( g_free );
 	// Process directories in reverse order for priority
 	guint n_data_dirs = g_strv_length ( data_dirs );
 	for (; n_data_dirs > 0; n_data_dirs--) {
-		loaded += load_ll_tz_dir(data_dirs[n_data_dirs-1]);
+		gchar *file = g_build_filename ( data_dirs[n_data_dirs-1], "latlontz.txt", NULL );
+		if ( g_access(file, R_OK) == 0 )
+			g_ptr_array_add ( files, file );
+		else
+			g_free ( file );
 	}
+	g_ptr_array_add ( files, NULL );
 	g_strfreev ( data_dirs );
 
+	gchar *cache_file = g_build_filename ( a_get_viking_dir(), "latlontz.bin", NULL );
+	lltz = vik_latlontz_new ( (gchar**)files->pdata, cache_file );
+	g_free ( cache_file );
+	g_ptr_array_free ( files, TRUE );
+
+	guint loaded = vik_latlontz_size ( lltz );
 	g_debug ( "%s: Loaded %d elements", __FUNCTION__, loaded );
 	if ( loaded == 0 )
 		g_critical ( "%s: No lat/lon/timezones loaded", __FUNCTION__ );
@@ -611,19 +579,8 @@ void vu_setup_lat_lon_tz_lookup ()
  */
 void vu_finalize_lat_lon_tz_lookup ()
 {
-	if ( kd ) {
-		kd_data_destructor ( kd, g_free );
-		kd_free ( kd );
-	}
-}
-
-static double dist_sq( double *a1, double *a2, int dims ) {
-  double dist_sq = 0, diff;
-  while( --dims >= 0 ) {
-    diff = (a1[dims] - a2[dims]);
-    dist_sq += diff*diff;
-  }
-  return dist_sq;
+	vik_latlontz_free ( lltz );
+	lltz = NULL;
 }
 
 static gchar* time_string_adjusted ( time_t *time, const gchar *format, gint offset_s )
@@ -671,34 +628,20 @@ static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz
  */
 gchar* vu_get_tz_at_location ( const VikCoord* vc )
 {
-	gchar *tz = NULL;
-	if ( !vc || !kd )
-		return tz;
+	if ( !vc || !lltz )
+		return NULL;
 
 	struct LatLon ll;
 	vik_coord_to_latlon ( vc, &ll );
-	double pt[2] = { ll.lat, ll.lon };
 
 	gdouble nearest;
 	if ( !a_settings_get_double(VIK_SETTINGS_NEAREST_TZ_FACTOR, &nearest) )
 		nearest = 1.0;
 
-	struct kdres *presults = kd_nearest_range ( kd, pt, nearest );
-	while( !kd_res_end( presults ) ) {
-		double pos[2];
-		gchar *ans = (gchar*)kd_res_item ( presults, pos );
-		// compute the distance of the current result from the pt
-		double dist = sqrt( dist_sq( pt, pos, 2 ) );
-		if ( dist < nearest ) {
-			//printf( "NEARER node at (%.3f, %.3f, %.3f) is %.3f away is %s\n", pos[0], pos[1], pos[2], dist, ans );
-			nearest = dist;
-			tz = ans;
-		}
-		kd_res_next ( presults );
-	}
+	// NB The string is owned by the lookup
+	gchar *tz = (gchar*)vik_latlontz_nearest ( lltz, ll.lat, ll.lon, nearest );
 	if ( vik_verbose )
-		g_debug ( "TZ lookup found %d results - picked %s", kd_res_size(presults), tz );
-	kd_res_free ( presults );
+		g_debug ( "TZ lookup picked %s", tz );
 
 	return tz;
 }
@@ -1309,6 +1252,7 @@ GSList* vu_get_ui_selected_gps_files ( VikWindow *vw, gboolean external )
 		gtk_file_filter_add_mime_type ( filter, "application/zip");
 		gtk_file_filter_add_pattern ( filter, "*.vik" );
 		gtk_file_filter_add_pattern ( filter, "*.viking" );
+		gtk_file_filter_add_pattern ( filter, "*"VIK_BINARY_FILE_EXT );
 		gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
 
 		filter = gtk_file_filter_new ();
@@ -1371,6 +1315,7 @@ GSList* vu_get_ui_selected_gps_files ( VikWindow *vw, gboolean external )
 		gtk_file_filter_set_name( filter, _("Viking") );
 		gtk_file_filter_add_pattern ( filter, "*.vik" );
 		gtk_file_filter_add_pattern ( filter, "*.viking" );
+		gtk_file_filter_add_pattern ( filter, "*"VIK_BINARY_FILE_EXT );
 		gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
 	}
 
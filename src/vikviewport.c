@@ -117,6 +117,11 @@ struct _VikViewport {
   gboolean draw_centermark;
   gboolean draw_highlight;
 
+  /* Only show tracks recorded within this period (seconds since the epoch) */
+  gboolean time_filter;
+  gdouble time_filter_start, time_filter_end;
+  guint time_filter_serial; // Changes whenever the filter does, so drawings of the old one are not reused
+
   /* subset of coord types. lat lon can be plotted in 2 ways, google or exp. */
   VikViewportDrawMode drawmode;
 
@@ -127,14 +132,79 @@ struct _VikViewport {
 #endif
   gboolean half_drawn;
 
+  // A copy of the drawing for overlays that change on their own (e.g. replay) - see vik_viewport_backdrop_save()
+#if !GTK_CHECK_VERSION (3,0,0)
+  GdkPixmap *backdrop_buffer;
+#else
+  cairo_surface_t *backdrop_surface;
+#endif
+  gint backdrop_width, backdrop_height;
+  guint backdrop_serial;
+  gboolean backdrop_valid;
+
+  guint pixbufs_drawn; // Count for benchmarking
+
   cairo_t *popup_crt;
   cairo_surface_t *popup_surf;
   gchar *popup_msg;
   gint popup_x;
   gint popup_y;
   gint popup_delay;
+
+  VikViewportProjection proj;  // Rebuilt by vik_viewport_get_projection() when the view has changed
+  gboolean proj_valid;
+
+  gboolean extents_recording;  // Between vik_viewport_extents_begin() and vik_viewport_extents_end()
+  gboolean extents_any;
+  GdkRectangle extents;
+
+  gboolean damage_clipped;     // Between vik_viewport_damage_clip_begin() and vik_viewport_damage_clip_end()
+  GdkRectangle damage_clip;
 };
 
+/**
+ * Include the area in the extents being recorded (if any)
+ * @pad: Extra pixels all around, e.g. for line thickness
+ */
+static inline void viewport_extents_add ( VikViewport *vvp, gint x, gint y, gint w, gint h, gint pad )
+{
+  if ( !vvp->extents_recording )
+    return;
+  GdkRectangle rect = { x - pad, y - pad, w + 2*pad, h + 2*pad };
+  if ( vvp->extents_any )
+    gdk_rectangle_union ( &vvp->extents, &rect, &vvp->extents );
+  else
+    vvp->extents = rect;
+  vvp->extents_any = TRUE;
+}
+
+/**
+ * Pixels drawn beyond the outline of a shape by a stroke with the gc
+ */
+static gint viewport_gc_pad ( GdkGC *gc )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  return gc ? (gint)ceil ( cairo_get_line_width(gc) ) + 1 : 1;
+#else
+  // GCs here are made with at most a few pixels line width
+  return 4;
+#endif
+}
+
+static void viewport_extents_add_points ( VikViewport *vvp, GdkPoint *points, gint npoints, gint pad )
+{
+  if ( !vvp->extents_recording || npoints < 1 )
+    return;
+  gint x1 = points[0].x, x2 = points[0].x, y1 = points[0].y, y2 = points[0].y;
+  for ( gint nn = 1; nn < npoints; nn++ ) {
+    x1 = MIN ( x1, points[nn].x );
+    x2 = MAX ( x2, points[nn].x );
+    y1 = MIN ( y1, points[nn].y );
+    y2 = MAX ( y2, points[nn].y );
+  }
+  viewport_extents_add ( vvp, x1, y1, x2-x1+1, y2-y1+1, pad );
+}
+
 static gdouble
 viewport_utm_zone_width ( VikViewport *vvp )
 {
@@ -671,6 +741,9 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->centers )
     g_list_free_full ( vvp->centers, g_free );
 
+  g_free ( vvp->proj.merclat );
+
+  vik_viewport_backdrop_clear ( vvp );
 #if !GTK_CHECK_VERSION (3,0,0)
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
@@ -733,6 +806,122 @@ void vik_viewport_clear ( VikViewport *vvp )
   vik_viewport_reset_logos ( vvp );
 }
 
+/**
+ * vik_viewport_shift:
+ * @dx: Pixels to move right
+ * @dy: Pixels to move down
+ *
+ * Move the current drawing across the viewport, leaving the uncovered area empty.
+ * Whilst panning this shows the view straight away, as a single copy,
+ *  until the layers are drawn again for the new position.
+ */
+void vik_viewport_shift ( VikViewport *vvp, gint dx, gint dy )
+{
+  g_return_if_fail ( vvp != NULL );
+  if ( dx == 0 && dy == 0 )
+    return;
+  if ( ABS(dx) >= vvp->width || ABS(dy) >= vvp->height ) {
+    vik_viewport_clear ( vvp );
+    return;
+  }
+  // The uncovered strips
+  GdkRectangle strips[2] = {
+    { dx > 0 ? 0 : vvp->width + dx, 0, ABS(dx), vvp->height },
+    { 0, dy > 0 ? 0 : vvp->height + dy, vvp->width, ABS(dy) },
+  };
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->surface_main )
+    return;
+  cairo_surface_flush ( vvp->surface_main );
+  guchar *data = cairo_image_surface_get_data ( vvp->surface_main );
+  gint stride = cairo_image_surface_get_stride ( vvp->surface_main );
+  // ARGB32 is 4 bytes per pixel; go in the order that doesn't overwrite rows yet to be moved
+  gsize row_len = ( vvp->width - ABS(dx) ) * 4;
+  gint src_x = dx > 0 ? 0 : -dx;
+  gint dest_x = dx > 0 ? dx : 0;
+  gint rows = vvp->height - ABS(dy);
+  for ( gint ii = 0; ii < rows; ii++ ) {
+    gint row = dy > 0 ? rows - 1 - ii : ii;
+    gint src_y = dy > 0 ? row : row - dy;
+    memmove ( data + (src_y + dy) * stride + dest_x * 4, data + src_y * stride + src_x * 4, row_len );
+  }
+  cairo_surface_mark_dirty ( vvp->surface_main );
+  cairo_save ( vvp->crt );
+  cairo_set_operator ( vvp->crt, CAIRO_OPERATOR_CLEAR );
+  for ( guint nn = 0; nn < G_N_ELEMENTS(strips); nn++ )
+    cairo_rectangle ( vvp->crt, strips[nn].x, strips[nn].y, strips[nn].width, strips[nn].height );
+  cairo_fill ( vvp->crt );
+  cairo_restore ( vvp->crt );
+#else
+  if ( !vvp->scr_buffer )
+    return;
+  // NB copying within the same drawable handles the overlap
+  gdk_draw_drawable ( vvp->scr_buffer, vvp->background_gc, vvp->scr_buffer, 0, 0, dx, dy, vvp->width, vvp->height );
+  for ( guint nn = 0; nn < G_N_ELEMENTS(strips); nn++ )
+    gdk_draw_rectangle ( vvp->scr_buffer, vvp->background_gc, TRUE, strips[nn].x, strips[nn].y, strips[nn].width, strips[nn].height );
+#endif
+}
+
+/**
+ * vik_viewport_zoom_shown:
+ * @factor: How much bigger to make the drawing (less than 1 to shrink it)
+ * @x:      Screen position that stays in place
+ * @y:      Screen position that stays in place
+ *
+ * Scale the current drawing, leaving any uncovered area empty.
+ * Whilst zooming this shows roughly the new view straight away,
+ *  until the layers are drawn again at the new zoom level.
+ */
+void vik_viewport_zoom_shown ( VikViewport *vvp, gdouble factor, gint x, gint y )
+{
+  g_return_if_fail ( vvp != NULL );
+  if ( factor <= 0.0 || factor == 1.0 )
+    return;
+  // Where the top left of the drawing ends up
+  const gdouble ox = x * (1.0 - factor);
+  const gdouble oy = y * (1.0 - factor);
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->surface_main )
+    return;
+  cairo_surface_t *copy = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, vvp->width, vvp->height );
+  cairo_t *cr = cairo_create ( copy );
+  cairo_set_source_surface ( cr, vvp->surface_main, 0, 0 );
+  cairo_set_operator ( cr, CAIRO_OPERATOR_SOURCE );
+  cairo_paint ( cr );
+  cairo_destroy ( cr );
+
+  ui_cr_clear ( vvp->crt );
+  cairo_save ( vvp->crt );
+  cairo_translate ( vvp->crt, ox, oy );
+  cairo_scale ( vvp->crt, factor, factor );
+  cairo_set_source_surface ( vvp->crt, copy, 0, 0 );
+  cairo_paint ( vvp->crt );
+  cairo_restore ( vvp->crt );
+  cairo_surface_destroy ( copy );
+#else
+  if ( !vvp->scr_buffer )
+    return;
+  GdkPixbuf *src = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vvp->scr_buffer), NULL, 0, 0, 0, 0, vvp->width, vvp->height );
+  gdk_draw_rectangle ( GDK_DRAWABLE(vvp->scr_buffer), vvp->background_gc, TRUE, 0, 0, vvp->width, vvp->height );
+  if ( !src )
+    return;
+  // Only the part of the scaled drawing that is on the screen
+  gint rx = MAX ( 0, (gint)floor(ox) );
+  gint ry = MAX ( 0, (gint)floor(oy) );
+  gint rw = MIN ( vvp->width, (gint)ceil(ox + vvp->width * factor) ) - rx;
+  gint rh = MIN ( vvp->height, (gint)ceil(oy + vvp->height * factor) ) - ry;
+  if ( rw > 0 && rh > 0 ) {
+    GdkPixbuf *dest = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(src), 8, rw, rh );
+    if ( dest ) {
+      gdk_pixbuf_scale ( src, dest, 0, 0, rw, rh, ox - rx, oy - ry, factor, factor, GDK_INTERP_BILINEAR );
+      gdk_draw_pixbuf ( vvp->scr_buffer, NULL, dest, 0, 0, rx, ry, rw, rh, GDK_RGB_DITHER_NONE, 0, 0 );
+      g_object_unref ( dest );
+    }
+  }
+  g_object_unref ( src );
+#endif
+}
+
 /**
  * vik_viewport_set_draw_scale:
  * @vvp: self
@@ -997,6 +1186,42 @@ gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp )
   return vvp->draw_highlight;
 }
 
+/**
+ * vik_viewport_set_time_filter:
+ * @active: Whether to filter at all
+ * @start:  Beginning of the period, in seconds since the epoch
+ * @end:    End of the period
+ *
+ * Layers with timestamped items (i.e. tracks) only draw those within the period.
+ * It is up to the caller to redraw afterwards.
+ */
+void vik_viewport_set_time_filter ( VikViewport *vvp, gboolean active, gdouble start, gdouble end )
+{
+  if ( vvp->time_filter == active &&
+       ( !active || ( vvp->time_filter_start == start && vvp->time_filter_end == end ) ) )
+    return;
+  vvp->time_filter = active;
+  vvp->time_filter_start = start;
+  vvp->time_filter_end = end;
+  vvp->time_filter_serial++;
+}
+
+/**
+ * vik_viewport_get_time_filter:
+ * @start: Set to the beginning of the period, when filtering (can be NULL)
+ * @end:   Set to the end of the period, when filtering (can be NULL)
+ *
+ * Returns: Whether only items within a period should be drawn
+ */
+gboolean vik_viewport_get_time_filter ( VikViewport *vvp, gdouble *start, gdouble *end )
+{
+  if ( vvp->time_filter ) {
+    if ( start ) *start = vvp->time_filter_start;
+    if ( end ) *end = vvp->time_filter_end;
+  }
+  return vvp->time_filter;
+}
+
 static gboolean remove_popup_cb ( VikViewport *vvp )
 {
   // Strangely using ui_cr_clear () is worse than destroying/recreating
@@ -1113,6 +1338,21 @@ void vik_viewport_sync ( VikViewport *vvp, GdkGC *cr )
 #endif
 }
 
+/**
+ * vik_viewport_sync_area:
+ *
+ * As vik_viewport_sync() (without a cairo context) but only for the given area
+ */
+void vik_viewport_sync_area ( VikViewport *vvp, const GdkRectangle *area )
+{
+  g_return_if_fail ( vvp != NULL );
+#if !GTK_CHECK_VERSION (3,0,0)
+  gdk_draw_drawable(gtk_widget_get_window(GTK_WIDGET(vvp)), gtk_widget_get_style(GTK_WIDGET(vvp))->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer), area->x, area->y, area->x, area->y, area->width, area->height);
+#else
+  gtk_widget_queue_draw_area ( GTK_WIDGET(vvp), area->x, area->y, area->width, area->height );
+#endif
+}
+
 void vik_viewport_set_zoom ( VikViewport *vvp, gdouble xympp )
 {
   g_return_if_fail ( vvp != NULL );
@@ -1540,6 +1780,15 @@ gint vik_viewport_get_height( VikViewport *vvp )
   return vvp->height;
 }
 
+/**
+ * Total number of images drawn on the viewport, e.g. for counting map tiles drawn by a layer
+ */
+guint vik_viewport_get_pixbufs_drawn ( VikViewport *vvp )
+{
+  g_return_val_if_fail ( vvp != NULL, 0 );
+  return vvp->pixbufs_drawn;
+}
+
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord )
 {
   g_return_if_fail ( vvp != NULL );
@@ -1613,9 +1862,210 @@ void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int
       *x = xx; *y = yy;
     } else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
       *x = vvp->width_2 + ( vvp->xmfactor * (ll->lon - center->lon) );
-      *y = vvp->height_2 + ( vvp->ymfactor * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) );
+      *y = vvp->height_2 + ( vvp->ymfactor * ( vik_viewport_get_projection(vvp)->center_merclat - MERCLAT(ll->lat) ) );
+    }
+  }
+}
+
+// Largest error allowed from interpolating the Mercator Y lookup, in pixels
+#define MERCLAT_LOOKUP_ERROR 0.001
+#define MERCLAT_LOOKUP_MAX 65536
+// Mercator is undefined at the poles - this is the usual limit for square tiles
+#define MERCLAT_LOOKUP_LAT_LIMIT 85.0511
+
+/**
+ * Make the Mercator Y lookup covering the view plus a screen height either side
+ *  (so anything drawn reaching off screen is covered too)
+ * The step is chosen from the curvature of the Mercator function at the most poleward end:
+ *  linear interpolation over a step h is out by at most h²/8 of the second derivative.
+ */
+static void projection_merclat_lookup ( VikViewportProjection *proj )
+{
+  g_free ( proj->merclat );
+  proj->merclat = NULL;
+
+  const gdouble margin = 3.0 * proj->height_2 / proj->ymfactor;
+  gdouble lat_lo = MAX ( DEMERCLAT(proj->center_merclat - margin), -MERCLAT_LOOKUP_LAT_LIMIT );
+  gdouble lat_hi = MIN ( DEMERCLAT(proj->center_merclat + margin), MERCLAT_LOOKUP_LAT_LIMIT );
+  if ( !(lat_hi > lat_lo) )
+    return;
+
+  // Second derivative (per degree) of MERCLAT is sec*tan*PI/180
+  gdouble phi = DEG2RAD ( MAX ( fabs(lat_lo), fabs(lat_hi) ) );
+  gdouble curvature = DEG2RAD ( tan(phi) / cos(phi) );
+  gdouble step = lat_hi - lat_lo;
+  if ( curvature > 0 )
+    step = MIN ( step, sqrt ( 8 * MERCLAT_LOOKUP_ERROR / ( proj->ymfactor * curvature ) ) );
+  gdouble len = ceil ( (lat_hi - lat_lo) / step ) + 1;
+  if ( len > MERCLAT_LOOKUP_MAX )
+    return;
+
+  proj->merclat_len = MAX ( 2, (guint)len );
+  proj->merclat_lat0 = lat_lo;
+  step = (lat_hi - lat_lo) / (proj->merclat_len - 1);
+  proj->merclat_inv_step = 1.0 / step;
+  proj->merclat = g_new ( gdouble, proj->merclat_len );
+  for ( guint ii = 0; ii < proj->merclat_len; ii++ )
+    proj->merclat[ii] = MERCLAT ( lat_lo + ii * step );
+}
+
+/**
+ * vik_viewport_get_projection:
+ *
+ * The projection is only worked out again when any of the viewport values it depends on have changed,
+ *  so it is cheap to call at the start of each drawing pass.
+ *
+ * Returns: The projection for the current view (owned by the viewport - don't free)
+ */
+const VikViewportProjection *vik_viewport_get_projection ( VikViewport *vvp )
+{
+  g_return_val_if_fail ( vvp != NULL, NULL );
+
+  VikViewportProjection *proj = &vvp->proj;
+  if ( vvp->proj_valid &&
+       proj->coord_mode == vvp->coord_mode &&
+       proj->drawmode == vvp->drawmode &&
+       proj->center.north_south == vvp->center.north_south &&
+       proj->center.east_west == vvp->center.east_west &&
+       proj->center.utm_zone == vvp->center.utm_zone &&
+       proj->width == vvp->width && proj->height == vvp->height &&
+       proj->width_2 == vvp->width_2 && proj->height_2 == vvp->height_2 &&
+       proj->xmpp == vvp->xmpp && proj->ympp == vvp->ympp &&
+       proj->xmfactor == vvp->xmfactor && proj->ymfactor == vvp->ymfactor &&
+       proj->utm_zone_width == vvp->utm_zone_width &&
+       proj->one_utm_zone == vvp->one_utm_zone )
+    return proj;
+
+  proj->vvp = vvp;
+  proj->coord_mode = vvp->coord_mode;
+  proj->drawmode = vvp->drawmode;
+  proj->center = vvp->center;
+  proj->width = vvp->width;
+  proj->height = vvp->height;
+  proj->width_2 = vvp->width_2;
+  proj->height_2 = vvp->height_2;
+  proj->xmpp = vvp->xmpp;
+  proj->ympp = vvp->ympp;
+  proj->xmfactor = vvp->xmfactor;
+  proj->ymfactor = vvp->ymfactor;
+  proj->utm_zone_width = vvp->utm_zone_width;
+  proj->one_utm_zone = vvp->one_utm_zone;
+  proj->center_merclat = 0.0;
+  if ( proj->coord_mode == VIK_COORD_LATLON && proj->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    proj->center_merclat = MERCLAT ( proj->center.north_south );
+    projection_merclat_lookup ( proj );
+  }
+  else {
+    g_free ( proj->merclat );
+    proj->merclat = NULL;
+  }
+  proj->serial++;
+  vvp->proj_valid = TRUE;
+  return proj;
+}
+
+/**
+ * Mercator Y of the latitude, interpolated from the lookup when it's covered
+ */
+static inline gdouble projection_merclat ( const VikViewportProjection *proj, gdouble lat )
+{
+  if ( proj->merclat ) {
+    gdouble pos = ( lat - proj->merclat_lat0 ) * proj->merclat_inv_step;
+    if ( pos >= 0.0 && pos < proj->merclat_len - 1 ) {
+      guint ii = (guint)pos;
+      gdouble frac = pos - ii;
+      return proj->merclat[ii] + frac * ( proj->merclat[ii+1] - proj->merclat[ii] );
+    }
+  }
+  return MERCLAT ( lat );
+}
+
+/**
+ * vik_viewport_projection_coords_to_screen:
+ * @proj:   From vik_viewport_get_projection()
+ * @coords: The coordinates to convert
+ * @n:      The number of coordinates
+ * @x:      Array of n screen x positions to fill in
+ * @y:      Array of n screen y positions to fill in
+ *
+ * As vik_viewport_coord_to_screen() for many coordinates at once,
+ *  e.g. all the trackpoints of a track.
+ * The projection is only decided once, leaving simple loops over the coordinates.
+ * In Mercator mode, latitudes within the view are projected via the lookup,
+ *  which is within a thousandth of a pixel of the exact value.
+ */
+void vik_viewport_projection_coords_to_screen ( const VikViewportProjection *proj, const VikCoord * const *coords, guint n, gint *x, gint *y )
+{
+  g_return_if_fail ( proj != NULL );
+
+  if ( proj->coord_mode == VIK_COORD_LATLON &&
+       ( proj->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR || proj->drawmode == VIK_VIEWPORT_DRAWMODE_LATLON ) ) {
+    const gdouble xmf = proj->xmfactor;
+    const gdouble ymf = proj->ymfactor;
+    const gdouble clon = proj->center.east_west;
+    if ( proj->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+      const gdouble cmlat = proj->center_merclat;
+      for ( guint ii = 0; ii < n; ii++ ) {
+        const struct LatLon *ll = (const struct LatLon *) coords[ii];
+        if ( G_UNLIKELY(coords[ii]->mode != VIK_COORD_LATLON) ) {
+          vik_viewport_coord_to_screen ( proj->vvp, coords[ii], &x[ii], &y[ii] );
+          continue;
+        }
+        x[ii] = proj->width_2 + ( xmf * (ll->lon - clon) );
+        y[ii] = proj->height_2 + ( ymf * ( cmlat - projection_merclat(proj, ll->lat) ) );
+      }
+    }
+    else {
+      const gdouble clat = proj->center.north_south;
+      for ( guint ii = 0; ii < n; ii++ ) {
+        const struct LatLon *ll = (const struct LatLon *) coords[ii];
+        if ( G_UNLIKELY(coords[ii]->mode != VIK_COORD_LATLON) ) {
+          vik_viewport_coord_to_screen ( proj->vvp, coords[ii], &x[ii], &y[ii] );
+          continue;
+        }
+        x[ii] = proj->width_2 + ( xmf * (ll->lon - clon) );
+        y[ii] = proj->height_2 + ( ymf * (clat - ll->lat) );
+      }
+    }
+  }
+  else if ( proj->coord_mode == VIK_COORD_UTM ) {
+    const struct UTM *center = (struct UTM *) &(proj->center);
+    for ( guint ii = 0; ii < n; ii++ ) {
+      const struct UTM *utm = (const struct UTM *) coords[ii];
+      if ( G_UNLIKELY(coords[ii]->mode != VIK_COORD_UTM) ) {
+        vik_viewport_coord_to_screen ( proj->vvp, coords[ii], &x[ii], &y[ii] );
+        continue;
+      }
+      if ( center->zone != utm->zone && proj->one_utm_zone ) {
+        x[ii] = y[ii] = VIK_VIEWPORT_UTM_WRONG_ZONE;
+        continue;
+      }
+      x[ii] = ( (utm->easting - center->easting) / proj->xmpp ) + (proj->width_2) -
+        (center->zone - utm->zone ) * proj->utm_zone_width / proj->xmpp;
+      y[ii] = (proj->height_2) - ( (utm->northing - center->northing) / proj->ympp );
     }
   }
+  else {
+    for ( guint ii = 0; ii < n; ii++ )
+      vik_viewport_coord_to_screen ( proj->vvp, coords[ii], &x[ii], &y[ii] );
+  }
+}
+
+/**
+ * vik_viewport_coords_to_screen:
+ * @coords: The coordinates to convert
+ * @n:      The number of coordinates
+ * @x:      Array of n screen x positions to fill in
+ * @y:      Array of n screen y positions to fill in
+ *
+ * The same as vik_viewport_coord_to_screen() for many coordinates at once.
+ * When doing this repeatedly for the same view, get the projection once instead
+ *  and use vik_viewport_projection_coords_to_screen().
+ */
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord * const *coords, guint n, gint *x, gint *y )
+{
+  g_return_if_fail ( vvp != NULL );
+  vik_viewport_projection_coords_to_screen ( vik_viewport_get_projection(vvp), coords, n, x, y );
 }
 
 /**
@@ -1703,6 +2153,7 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
   //g_print ( "%s: \n", __FUNCTION__ );
   if ( ! ( ( x1 < 0 && x2 < 0 ) || ( y1 < 0 && y2 < 0 ) ||
        ( x1 > vvp->width && x2 > vvp->width ) || ( y1 > vvp->height && y2 > vvp->height ) ) ) {
+    viewport_extents_add ( vvp, MIN(x1,x2), MIN(y1,y2), ABS(x2-x1)+1, ABS(y2-y1)+1, thickness );
 #if GTK_CHECK_VERSION (3,0,0)
     g_return_if_fail ( gc != NULL );
     cairo_set_line_width ( gc, thickness );
@@ -1718,6 +2169,33 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
   }
 }
 
+/**
+ * vik_viewport_draw_lines:
+ *
+ * Draw connected lines through the series of points,
+ *  the same as vik_viewport_draw_line() between each pair but with one stroke for all of them
+ */
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness )
+{
+  if ( npoints < 2 )
+    return;
+  viewport_extents_add_points ( vvp, points, npoints, thickness );
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( gc != NULL );
+  cairo_set_line_width ( gc, thickness );
+  if ( gcolor )
+    gdk_cairo_set_source_color ( gc, gcolor );
+  cairo_move_to ( gc, points[0].x-0.5, points[0].y-0.5 );
+  for ( gint nn = 1; nn < npoints; nn++ )
+    cairo_line_to ( gc, points[nn].x-0.5, points[nn].y-0.5 );
+  cairo_stroke ( gc );
+#else
+  // Each line still needs clipping
+  for ( gint nn = 1; nn < npoints; nn++ )
+    vik_viewport_draw_line ( vvp, gc, points[nn-1].x, points[nn-1].y, points[nn].x, points[nn].y, gcolor, thickness );
+#endif
+}
+
 /**
  * For GTK3 Need to pass in the color each time
  */
@@ -1725,6 +2203,7 @@ void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled,
 {
   // Using 32 as half the default waypoint image size, so this draws ensures the highlight gets done
   if ( x1 > -32 && x1 < vvp->width + 32 && y1 > -32 && y1 < vvp->height + 32 ) {
+    viewport_extents_add ( vvp, x1, y1, x2, y2, viewport_gc_pad(gc) );
 #if GTK_CHECK_VERSION (3,0,0)
     g_return_if_fail ( gc != NULL );
     if ( gcolor )
@@ -1747,18 +2226,412 @@ void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled,
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h )
 {
+  vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, 255, src_x, src_y, dest_x, dest_y, w, h );
+}
+
+/**
+ * vik_viewport_draw_pixbuf_with_alpha:
+ * @alpha: Transparency to draw with, multiplying that of the pixbuf itself
+ *
+ * As vik_viewport_draw_pixbuf(), but blended in with the given transparency,
+ *  so the pixbuf need not be altered for each transparency it is shown with.
+ * NB For GTK2 this makes a temporary copy of the pixbuf when @alpha is less than 255.
+ */
+void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha, gint src_x, gint src_y,
+                                           gint dest_x, gint dest_y, gint w, gint h )
+{
+  vvp->pixbufs_drawn++;
+  viewport_extents_add ( vvp, dest_x, dest_y,
+                         w < 0 ? gdk_pixbuf_get_width(pixbuf) : w,
+                         h < 0 ? gdk_pixbuf_get_height(pixbuf) : h, 0 );
 #if GTK_CHECK_VERSION (3,0,0)
   // TODO confirm this draws with negative dest_x & dest_y values...
   gdk_cairo_set_source_pixbuf ( vvp->crt, pixbuf, dest_x, dest_y );
   // This is needed after each pixbuf is applied
   //  (i.e. can't group together a series of pixbuf requests and paint once only at the end)
-  cairo_paint ( vvp->crt );
+  if ( alpha < 255 )
+    cairo_paint_with_alpha ( vvp->crt, alpha / 255.0 );
+  else
+    cairo_paint ( vvp->crt );
 #else
+  GdkPixbuf *faded = NULL;
+  if ( alpha < 255 ) {
+    faded = ui_pixbuf_scale_alpha ( gdk_pixbuf_copy(pixbuf), alpha );
+    if ( faded )
+      pixbuf = faded;
+  }
   gdk_draw_pixbuf ( vvp->scr_buffer,
                     NULL,
                     pixbuf,
                     src_x, src_y, dest_x, dest_y, w, h,
                     GDK_RGB_DITHER_NONE, 0, 0 );
+  if ( faded )
+    g_object_unref ( faded );
+#endif
+}
+
+/**
+ * vik_viewport_extents_begin:
+ *
+ * Start recording the screen area covered by the drawing functions,
+ *  e.g. so a layer knows what to redraw when an item it drew changes.
+ */
+void vik_viewport_extents_begin ( VikViewport *vvp )
+{
+  vvp->extents_recording = TRUE;
+  vvp->extents_any = FALSE;
+}
+
+/**
+ * vik_viewport_extents_end:
+ * @area: Set to the area covered since vik_viewport_extents_begin()
+ *
+ * Returns: FALSE if nothing was drawn
+ */
+gboolean vik_viewport_extents_end ( VikViewport *vvp, GdkRectangle *area )
+{
+  vvp->extents_recording = FALSE;
+  if ( vvp->extents_any )
+    *area = vvp->extents;
+  return vvp->extents_any;
+}
+
+/**
+ * vik_viewport_damage_clip_begin:
+ * @area: The only part of the viewport to change
+ *
+ * Until vik_viewport_damage_clip_end() all drawing (including vik_viewport_clear())
+ *  only changes the given area, the rest keeps what was drawn before.
+ * Layers still draw as normal; their drawing outside the area is simply clipped away.
+ *
+ * Returns: FALSE if clipped drawing is not possible (GTK2), so everything should be drawn
+ */
+gboolean vik_viewport_damage_clip_begin ( VikViewport *vvp, const GdkRectangle *area )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->crt )
+    return FALSE;
+  vvp->damage_clip = *area;
+  vvp->damage_clipped = TRUE;
+  cairo_rectangle ( vvp->crt, area->x, area->y, area->width, area->height );
+  cairo_clip ( vvp->crt );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+void vik_viewport_damage_clip_end ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( vvp->damage_clipped && vvp->crt )
+    cairo_reset_clip ( vvp->crt );
+#endif
+  vvp->damage_clipped = FALSE;
+}
+
+/**
+ * vik_viewport_get_damage_clip:
+ * @area: Set to the area being redrawn
+ *
+ * Layers can use this to skip drawing that would be clipped away anyway.
+ *
+ * Returns: TRUE if only part of the viewport is being drawn
+ */
+gboolean vik_viewport_get_damage_clip ( VikViewport *vvp, GdkRectangle *area )
+{
+  if ( vvp->damage_clipped )
+    *area = vvp->damage_clip;
+  return vvp->damage_clipped;
+}
+
+struct _VikViewportCache {
+  VikViewport *vvp;           // The viewport the surface was drawn for
+  cairo_surface_t *surface;   // NULL when invalid
+  gint width, height;
+  gdouble xmpp, ympp;
+  guint scale;
+  VikViewportDrawMode drawmode;
+  VikCoordMode coord_mode;
+  VikCoord ref;               // A fixed position to measure pans by
+  gint ref_x, ref_y;          // Where that position was on the surface
+  gboolean grouped;           // Drawing is redirected (between begin and end)
+  guint time_filter_serial;
+};
+
+VikViewportCache *vik_viewport_cache_new ()
+{
+  return g_malloc0 ( sizeof(VikViewportCache) );
+}
+
+void vik_viewport_cache_invalidate ( VikViewportCache *cache )
+{
+  if ( cache->surface ) {
+    cairo_surface_destroy ( cache->surface );
+    cache->surface = NULL;
+  }
+}
+
+void vik_viewport_cache_free ( VikViewportCache *cache )
+{
+  if ( !cache )
+    return;
+  vik_viewport_cache_invalidate ( cache );
+  g_free ( cache );
+}
+
+#if GTK_CHECK_VERSION (3,0,0)
+/**
+ * Whether the cache was drawn for the same view, except maybe for a pan
+ */
+static gboolean viewport_cache_matches ( VikViewport *vvp, VikViewportCache *cache )
+{
+  return ( cache->vvp == vvp &&
+           cache->width == vvp->width && cache->height == vvp->height &&
+           cache->xmpp == vvp->xmpp && cache->ympp == vvp->ympp &&
+           cache->scale == vvp->scale &&
+           cache->drawmode == vvp->drawmode &&
+           cache->coord_mode == vvp->coord_mode &&
+           cache->time_filter_serial == vvp->time_filter_serial &&
+           ( vvp->coord_mode != VIK_COORD_UTM || cache->ref.utm_zone == vvp->center.utm_zone ) );
+}
+
+static void viewport_cache_paint ( VikViewport *vvp, cairo_surface_t *surface, gint x, gint y )
+{
+  // Leave the source as it was, as drawing may rely on it
+  cairo_pattern_t *source = cairo_pattern_reference ( cairo_get_source(vvp->crt) );
+  cairo_set_source_surface ( vvp->crt, surface, x, y );
+  cairo_paint ( vvp->crt );
+  cairo_set_source ( vvp->crt, source );
+  cairo_pattern_destroy ( source );
+}
+#endif
+
+/**
+ * vik_viewport_cache_begin:
+ *
+ * Start drawing something that can be kept in the cache.
+ * Unless this returns FALSE, drawing then happens as normal, but is captured in the cache.
+ * vik_viewport_cache_end() must always be called afterwards to put the result on the viewport.
+ *
+ * When the viewport has only been panned since the last time,
+ *  what was drawn before is shifted across and only the newly exposed edges are drawn again
+ *  (drawing elsewhere is clipped away, so the sooner the caller skips it the better).
+ * Any other change of the view (zoom, size, projection) means everything is drawn again.
+ * Changes to what is drawn are up to the caller, via vik_viewport_cache_invalidate().
+ *
+ * Returns: FALSE if the cache can be used as it is and so no drawing is needed
+ */
+gboolean vik_viewport_cache_begin ( VikViewport *vvp, VikViewportCache *cache )
+{
+  cache->grouped = FALSE;
+#if GTK_CHECK_VERSION (3,0,0)
+  // Only a linear projection gives the same picture shifted across
+  if ( !vvp->crt || vvp->drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ) {
+    vik_viewport_cache_invalidate ( cache );
+    return TRUE;
+  }
+
+  gint dx = 0, dy = 0;
+  if ( cache->surface ) {
+    if ( !viewport_cache_matches ( vvp, cache ) )
+      vik_viewport_cache_invalidate ( cache );
+    else {
+      gint xx, yy;
+      vik_viewport_coord_to_screen ( vvp, &cache->ref, &xx, &yy );
+      dx = xx - cache->ref_x;
+      dy = yy - cache->ref_y;
+      if ( dx == 0 && dy == 0 )
+        return FALSE;
+      if ( ABS(dx) >= vvp->width || ABS(dy) >= vvp->height )
+        vik_viewport_cache_invalidate ( cache );
+      else {
+        cache->ref_x = xx;
+        cache->ref_y = yy;
+      }
+    }
+  }
+
+  if ( !cache->surface ) {
+    cache->vvp = vvp;
+    cache->width = vvp->width;
+    cache->height = vvp->height;
+    cache->xmpp = vvp->xmpp;
+    cache->ympp = vvp->ympp;
+    cache->scale = vvp->scale;
+    cache->drawmode = vvp->drawmode;
+    cache->coord_mode = vvp->coord_mode;
+    cache->time_filter_serial = vvp->time_filter_serial;
+    cache->ref = vvp->center;
+    cache->ref_x = vvp->width_2;
+    cache->ref_y = vvp->height_2;
+  }
+
+  // The cached picture must be complete, so any damage clip only applies once it is put on the viewport
+  if ( vvp->damage_clipped )
+    cairo_reset_clip ( vvp->crt );
+
+  // Layers draw with GCs that refer back to the crt, so a group catches everything
+  cairo_push_group ( vvp->crt );
+  cache->grouped = TRUE;
+
+  if ( cache->surface ) {
+    viewport_cache_paint ( vvp, cache->surface, dx, dy );
+    if ( dx > 0 )
+      cairo_rectangle ( vvp->crt, 0, 0, dx, vvp->height );
+    else if ( dx < 0 )
+      cairo_rectangle ( vvp->crt, vvp->width+dx, 0, -dx, vvp->height );
+    if ( dy > 0 )
+      cairo_rectangle ( vvp->crt, 0, 0, vvp->width, dy );
+    else if ( dy < 0 )
+      cairo_rectangle ( vvp->crt, 0, vvp->height+dy, vvp->width, -dy );
+    cairo_clip ( vvp->crt );
+  }
+#endif
+  return TRUE;
+}
+
+/**
+ * vik_viewport_cache_end:
+ *
+ * Finish drawing started with vik_viewport_cache_begin(), keeping the result and putting it on the viewport
+ */
+void vik_viewport_cache_end ( VikViewport *vvp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( cache->grouped ) {
+    // Also drops the clip
+    cairo_pattern_t *pattern = cairo_pop_group ( vvp->crt );
+    if ( vvp->damage_clipped ) {
+      cairo_rectangle ( vvp->crt, vvp->damage_clip.x, vvp->damage_clip.y, vvp->damage_clip.width, vvp->damage_clip.height );
+      cairo_clip ( vvp->crt );
+    }
+    cairo_surface_t *surface = NULL;
+    vik_viewport_cache_invalidate ( cache );
+    if ( cairo_pattern_get_surface ( pattern, &surface ) == CAIRO_STATUS_SUCCESS )
+      cache->surface = cairo_surface_reference ( surface );
+    else {
+      // Not to be kept, but still needs to be shown
+      cairo_pattern_t *source = cairo_pattern_reference ( cairo_get_source(vvp->crt) );
+      cairo_set_source ( vvp->crt, pattern );
+      cairo_paint ( vvp->crt );
+      cairo_set_source ( vvp->crt, source );
+      cairo_pattern_destroy ( source );
+    }
+    cairo_pattern_destroy ( pattern );
+    cache->grouped = FALSE;
+  }
+  if ( cache->surface )
+    viewport_cache_paint ( vvp, cache->surface, 0, 0 );
+#endif
+}
+
+/**
+ * vik_viewport_cache_extend_begin:
+ *
+ * Start drawing additions straight onto what is cached,
+ *  for when something has only been added to (e.g. a track being recorded) and the view is the same.
+ * Nothing is put on the viewport - that happens when the cache is next used.
+ * When this returns TRUE, vik_viewport_cache_extend_end() must be called afterwards.
+ *
+ * Returns: FALSE if the cache is not of the current view (so the addition can't be drawn onto it)
+ */
+gboolean vik_viewport_cache_extend_begin ( VikViewport *vvp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->crt || !cache->surface || cache->grouped || !viewport_cache_matches ( vvp, cache ) )
+    return FALSE;
+  gint xx, yy;
+  vik_viewport_coord_to_screen ( vvp, &cache->ref, &xx, &yy );
+  if ( xx != cache->ref_x || yy != cache->ref_y )
+    return FALSE;
+
+  if ( vvp->damage_clipped )
+    cairo_reset_clip ( vvp->crt );
+  cairo_push_group ( vvp->crt );
+  cache->grouped = TRUE;
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_cache_extend_end:
+ *
+ * Finish drawing started with vik_viewport_cache_extend_begin(), adding it to the cache
+ */
+void vik_viewport_cache_extend_end ( VikViewport *vvp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !cache->grouped )
+    return;
+  cairo_pattern_t *pattern = cairo_pop_group ( vvp->crt );
+  if ( vvp->damage_clipped ) {
+    cairo_rectangle ( vvp->crt, vvp->damage_clip.x, vvp->damage_clip.y, vvp->damage_clip.width, vvp->damage_clip.height );
+    cairo_clip ( vvp->crt );
+  }
+  cairo_t *cr = cairo_create ( cache->surface );
+  cairo_set_source ( cr, pattern );
+  cairo_paint ( cr );
+  cairo_destroy ( cr );
+  cairo_pattern_destroy ( pattern );
+  cache->grouped = FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_group_begin:
+ *
+ * Capture all the following drawing, rather than putting it on the viewport,
+ *  until vik_viewport_group_end().
+ * The drawing can then be painted later with vik_viewport_draw_pattern(),
+ *  e.g. to put separately drawn layers back together in the correct order.
+ *
+ * Returns: FALSE if drawing can not be captured (GTK2), so drawing goes straight onto the viewport
+ */
+gboolean vik_viewport_group_begin ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( vvp->crt ) {
+    cairo_push_group ( vvp->crt );
+    return TRUE;
+  }
+#endif
+  return FALSE;
+}
+
+/**
+ * vik_viewport_group_end:
+ *
+ * Returns: The captured drawing; free with cairo_pattern_destroy()
+ */
+cairo_pattern_t *vik_viewport_group_end ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( vvp->crt )
+    return cairo_pop_group ( vvp->crt );
+#endif
+  return NULL;
+}
+
+/**
+ * vik_viewport_draw_pattern:
+ *
+ * Paint a drawing the size of the viewport onto it,
+ *  e.g. from vik_viewport_group_end() or made from an image surface
+ */
+void vik_viewport_draw_pattern ( VikViewport *vvp, cairo_pattern_t *pattern )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->crt || !pattern )
+    return;
+  // Leave the source as it was, as drawing may rely on it
+  cairo_pattern_t *source = cairo_pattern_reference ( cairo_get_source(vvp->crt) );
+  cairo_set_source ( vvp->crt, pattern );
+  cairo_paint ( vvp->crt );
+  cairo_set_source ( vvp->crt, source );
+  cairo_pattern_destroy ( source );
 #endif
 }
 
@@ -1770,6 +2643,7 @@ void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x,
  */
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2, GdkColor *gcolor )
 {
+  viewport_extents_add ( vvp, x, y, width, height, viewport_gc_pad(gc) );
 #if GTK_CHECK_VERSION (3,0,0)
   g_return_if_fail ( gc != NULL );
   // ATM Only used for drawing circles - so height is ignored
@@ -1795,6 +2669,7 @@ void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint
  */
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints, GdkColor *gcolor )
 {
+  viewport_extents_add_points ( vvp, points, npoints, viewport_gc_pad(gc) );
 #if GTK_CHECK_VERSION (3,0,0)
   g_return_if_fail ( gc != NULL );
   if ( gcolor )
@@ -1930,6 +2805,11 @@ gboolean vik_viewport_is_one_zone ( VikViewport *vvp )
 void vik_viewport_draw_layout ( VikViewport *vvp, GdkGC *gc, gint x, gint y, PangoLayout *layout, GdkColor *gcolor )
 {
   if ( x > -VIK_VIEWPORT_LAYOUT_MAX && x < vvp->width + VIK_VIEWPORT_LAYOUT_MAX && y > -VIK_VIEWPORT_LAYOUT_MAX && y < vvp->height + VIK_VIEWPORT_LAYOUT_MAX ) {
+    if ( vvp->extents_recording ) {
+      gint wd, hd;
+      pango_layout_get_pixel_size ( layout, &wd, &hd );
+      viewport_extents_add ( vvp, x, y, wd, hd, 1 );
+    }
 #if GTK_CHECK_VERSION (3,0,0)
     if ( gcolor )
       gdk_cairo_set_source_color ( gc, gcolor );
@@ -1980,6 +2860,89 @@ void vik_viewport_snapshot_load ( VikViewport *vp )
 #endif
 }
 
+/**
+ * vik_viewport_backdrop_save:
+ *
+ * Keep a copy of what has been drawn so far,
+ *  so an overlay drawn on top can be replaced without drawing the layers again.
+ * Separate from the snapshot used by layer triggers.
+ */
+void vik_viewport_backdrop_save ( VikViewport *vvp )
+{
+  if ( vvp->backdrop_width != vvp->width || vvp->backdrop_height != vvp->height )
+    vik_viewport_backdrop_clear ( vvp );
+#if !GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->scr_buffer )
+    return;
+  if ( !vvp->backdrop_buffer )
+    vvp->backdrop_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  gdk_draw_drawable ( vvp->backdrop_buffer, vvp->background_gc, vvp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+#else
+  if ( !vvp->surface_main )
+    return;
+  if ( !vvp->backdrop_surface )
+    vvp->backdrop_surface = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, vvp->width, vvp->height );
+  cairo_surface_flush ( vvp->surface_main );
+  cairo_t *cr = cairo_create ( vvp->backdrop_surface );
+  cairo_set_operator ( cr, CAIRO_OPERATOR_SOURCE );
+  cairo_set_source_surface ( cr, vvp->surface_main, 0, 0 );
+  cairo_paint ( cr );
+  cairo_destroy ( cr );
+#endif
+  vvp->backdrop_width = vvp->width;
+  vvp->backdrop_height = vvp->height;
+  vvp->backdrop_serial = vik_viewport_get_projection(vvp)->serial;
+  vvp->backdrop_valid = TRUE;
+}
+
+/**
+ * vik_viewport_backdrop_restore:
+ *
+ * Put back the drawing kept by vik_viewport_backdrop_save()
+ *
+ * Returns: FALSE if there is none for the view as it is now,
+ *  in which case everything needs drawing again
+ */
+gboolean vik_viewport_backdrop_restore ( VikViewport *vvp )
+{
+  if ( !vvp->backdrop_valid ||
+       vvp->backdrop_width != vvp->width || vvp->backdrop_height != vvp->height ||
+       vvp->backdrop_serial != vik_viewport_get_projection(vvp)->serial )
+    return FALSE;
+#if !GTK_CHECK_VERSION (3,0,0)
+  gdk_draw_drawable ( vvp->scr_buffer, vvp->background_gc, vvp->backdrop_buffer, 0, 0, 0, 0, -1, -1 );
+#else
+  cairo_pattern_t *source = cairo_pattern_reference ( cairo_get_source(vvp->crt) );
+  cairo_save ( vvp->crt );
+  cairo_set_operator ( vvp->crt, CAIRO_OPERATOR_SOURCE );
+  cairo_set_source_surface ( vvp->crt, vvp->backdrop_surface, 0, 0 );
+  cairo_paint ( vvp->crt );
+  cairo_restore ( vvp->crt );
+  cairo_set_source ( vvp->crt, source );
+  cairo_pattern_destroy ( source );
+#endif
+  return TRUE;
+}
+
+/**
+ * vik_viewport_backdrop_clear:
+ *
+ * Free the drawing kept by vik_viewport_backdrop_save() once it is no longer needed
+ */
+void vik_viewport_backdrop_clear ( VikViewport *vvp )
+{
+#if !GTK_CHECK_VERSION (3,0,0)
+  if ( vvp->backdrop_buffer )
+    g_object_unref ( G_OBJECT ( vvp->backdrop_buffer ) );
+  vvp->backdrop_buffer = NULL;
+#else
+  if ( vvp->backdrop_surface )
+    cairo_surface_destroy ( vvp->backdrop_surface );
+  vvp->backdrop_surface = NULL;
+#endif
+  vvp->backdrop_valid = FALSE;
+}
+
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
 {
   vp->half_drawn = half_drawn;
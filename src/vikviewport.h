@@ -68,6 +68,7 @@ gboolean vik_viewport_configure ( VikViewport *vp );
 /* coordinate transformations */
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord );
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y );
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord * const *coords, guint n, gint *x, gint *y );
 
 
 /* viewport scale */
@@ -117,12 +118,47 @@ void vik_viewport_set_drawmode ( VikViewport *vvp, VikViewportDrawMode drawmode
 VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp );
    /* Do not forget to update vik_viewport_get_drawmode_name() if you modify VikViewportDrawMode */
 
+/**
+ * VikViewportProjection:
+ *
+ * How coordinates map onto the screen for the viewport as it currently is,
+ *  with everything that only depends on the viewport worked out once.
+ * Get it once per drawing pass via vik_viewport_get_projection();
+ *  it is owned by the viewport and only valid until the viewport next changes.
+ */
+typedef struct {
+  VikViewport *vvp;
+  VikCoordMode coord_mode;
+  VikViewportDrawMode drawmode;
+  VikCoord center;
+  gint width, height;
+  gint width_2, height_2;
+  gdouble xmpp, ympp;
+  gdouble xmfactor, ymfactor;
+  gdouble utm_zone_width;
+  gboolean one_utm_zone;
+  gdouble center_merclat;    // Mercator mode only
+  // Mercator Y of latitudes over the view (with a margin) at even steps, for linear interpolation
+  // Only used where the interpolation is well within a pixel, otherwise NULL
+  gdouble *merclat;
+  guint merclat_len;
+  gdouble merclat_lat0;
+  gdouble merclat_inv_step;
+  guint serial;              // Changes whenever the view changes
+} VikViewportProjection;
+
+const VikViewportProjection *vik_viewport_get_projection ( VikViewport *vvp );
+void vik_viewport_projection_coords_to_screen ( const VikViewportProjection *proj, const VikCoord * const *coords, guint n, gint *x, gint *y );
+
 
 /* Triggers */
 void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger );
 gpointer vik_viewport_get_trigger ( VikViewport *vp );
 void vik_viewport_snapshot_save ( VikViewport *vp );
 void vik_viewport_snapshot_load ( VikViewport *vp );
+void vik_viewport_backdrop_save ( VikViewport *vvp );
+gboolean vik_viewport_backdrop_restore ( VikViewport *vvp );
+void vik_viewport_backdrop_clear ( VikViewport *vvp );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 
@@ -141,11 +177,40 @@ void vik_viewport_surface_tool_destroy ( VikViewport *vvp );
 GdkPixmap *vik_viewport_get_pixmap ( VikViewport *vvp ); /* get pointer to drawing buffer */
 #endif
 void vik_viewport_sync ( VikViewport *vvp, GdkGC *cr );
+void vik_viewport_sync_area ( VikViewport *vvp, const GdkRectangle *area );
 void vik_viewport_clear ( VikViewport *vvp );
+void vik_viewport_shift ( VikViewport *vvp, gint dx, gint dy );
+void vik_viewport_zoom_shown ( VikViewport *vvp, gdouble factor, gint x, gint y );
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h );
+void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha, gint src_x, gint src_y,
+                                           gint dest_x, gint dest_y, gint w, gint h );
+
+/* Redrawing only part of the viewport */
+void vik_viewport_extents_begin ( VikViewport *vvp );
+gboolean vik_viewport_extents_end ( VikViewport *vvp, GdkRectangle *area );
+gboolean vik_viewport_damage_clip_begin ( VikViewport *vvp, const GdkRectangle *area );
+void vik_viewport_damage_clip_end ( VikViewport *vvp );
+gboolean vik_viewport_get_damage_clip ( VikViewport *vvp, GdkRectangle *area );
+
+/* Cached drawing, e.g. of a layer, so that it can be reused when panning */
+typedef struct _VikViewportCache VikViewportCache;
+VikViewportCache *vik_viewport_cache_new ();
+void vik_viewport_cache_free ( VikViewportCache *cache );
+void vik_viewport_cache_invalidate ( VikViewportCache *cache );
+gboolean vik_viewport_cache_begin ( VikViewport *vvp, VikViewportCache *cache );
+void vik_viewport_cache_end ( VikViewport *vvp, VikViewportCache *cache );
+gboolean vik_viewport_cache_extend_begin ( VikViewport *vvp, VikViewportCache *cache );
+void vik_viewport_cache_extend_end ( VikViewport *vvp, VikViewportCache *cache );
+
+/* Separately drawn parts, to be put onto the viewport later */
+gboolean vik_viewport_group_begin ( VikViewport *vvp );
+cairo_pattern_t *vik_viewport_group_end ( VikViewport *vvp );
+void vik_viewport_draw_pattern ( VikViewport *vvp, cairo_pattern_t *pattern );
+
 gint vik_viewport_get_width ( VikViewport *vvp );
 gint vik_viewport_get_height ( VikViewport *vvp );
+guint vik_viewport_get_pixbufs_drawn ( VikViewport *vvp );
 
 void vik_viewport_reset_copyrights ( VikViewport *vp );
 void vik_viewport_add_copyright ( VikViewport *vp, const gchar *copyright );
@@ -164,6 +229,8 @@ gboolean vik_viewport_get_draw_centermark ( VikViewport *vvp );
 void vik_viewport_draw_logo ( VikViewport *vvp );
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight );
 gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp );
+void vik_viewport_set_time_filter ( VikViewport *vvp, gboolean active, gdouble start, gdouble end );
+gboolean vik_viewport_get_time_filter ( VikViewport *vvp, gdouble *start, gdouble *end );
 
 /* Color/graphics context management */
 void vik_viewport_set_background_color ( VikViewport *vvp, const gchar *color );
@@ -187,6 +254,7 @@ void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run thi
 #define VIK_VIEWPORT_LAYOUT_MAX 100
 
 void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2, GdkColor *gcolor, guint thickness );
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness );
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2, GdkColor *gcolor );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2, GdkColor *gcolor );
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints, GdkColor *gcolor );
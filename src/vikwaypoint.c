@@ -29,6 +29,7 @@
 #include "garminsymbols.h"
 #include "dems.h"
 #include "gpx.h"
+#include "util.h"
 #include <glib/gi18n.h>
 
 VikWaypoint *vik_waypoint_new()
@@ -41,16 +42,64 @@ VikWaypoint *vik_waypoint_new()
   wp->timestamp = NAN;
   wp->course = NAN;
   wp->speed = NAN;
-  wp->magvar = NAN;
-  wp->geoidheight = NAN;
-  wp->hdop = NAN;
-  wp->vdop = NAN;
-  wp->pdop = NAN;
-  wp->ageofdgpsdata = NAN;
   wp->proximity = NAN;
   return wp;
 }
 
+// What a waypoint without any GPS fix details has
+static const VikWaypointExtra extra_unset = { NAN, NAN, NAN, NAN, NAN, NAN, VIK_GPS_MODE_NOT_SEEN, 0, 0 };
+
+/**
+ * vik_waypoint_get_extra:
+ *
+ * Returns: The GPS fix details, which are all unavailable values if none have been set
+ */
+const VikWaypointExtra *vik_waypoint_get_extra ( const VikWaypoint *wp )
+{
+  return wp->extra ? wp->extra : &extra_unset;
+}
+
+/**
+ * vik_waypoint_edit_extra:
+ *
+ * Returns: The GPS fix details to be set, allocating them if necessary
+ */
+VikWaypointExtra *vik_waypoint_edit_extra ( VikWaypoint *wp )
+{
+  if ( !wp->extra )
+    wp->extra = g_memdup ( &extra_unset, sizeof(VikWaypointExtra) );
+  return wp->extra;
+}
+
+static gboolean extra_is_unset ( const VikWaypointExtra *extra )
+{
+  return isnan(extra->magvar) && isnan(extra->geoidheight) &&
+    isnan(extra->hdop) && isnan(extra->vdop) && isnan(extra->pdop) && isnan(extra->ageofdgpsdata) &&
+    extra->fix_mode == VIK_GPS_MODE_NOT_SEEN && extra->nsats == 0 && extra->dgpsid == 0;
+}
+
+/**
+ * vik_waypoint_trim_extra:
+ *
+ * Free the GPS fix details if none of them are actually known,
+ *  e.g. after reading a waypoint that sets them all whether available or not
+ */
+void vik_waypoint_trim_extra ( VikWaypoint *wp )
+{
+  if ( wp->extra && extra_is_unset(wp->extra) ) {
+    g_free ( wp->extra );
+    wp->extra = NULL;
+  }
+}
+
+/**
+ * Returns: The shared copy of the string, or NULL for an empty one
+ */
+static const gchar *wp_intern ( const gchar *str )
+{
+  return ( str && str[0] != '\0' ) ? g_intern_string ( str ) : NULL;
+}
+
 // Hmmm tempted to put in new constructor
 void vik_waypoint_set_name(VikWaypoint *wp, const gchar *name)
 {
@@ -91,24 +140,12 @@ void vik_waypoint_set_description(VikWaypoint *wp, const gchar *description)
 
 void vik_waypoint_set_source(VikWaypoint *wp, const gchar *source)
 {
-  if ( wp->source )
-    g_free ( wp->source );
-
-  if ( source && source[0] != '\0' )
-    wp->source = g_strdup(source);
-  else
-    wp->source = NULL;
+  wp->source = wp_intern ( source );
 }
 
 void vik_waypoint_set_type(VikWaypoint *wp, const gchar *type)
 {
-  if ( wp->type )
-    g_free ( wp->type );
-
-  if ( type && type[0] != '\0' )
-    wp->type = g_strdup(type);
-  else
-    wp->type = NULL;
+  wp->type = wp_intern ( type );
 }
 
 void vik_waypoint_set_url(VikWaypoint *wp, const gchar *url)
@@ -158,16 +195,13 @@ void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname)
 {
   const gchar *hashed_symname;
 
-  if ( wp->symbol )
-    g_free ( wp->symbol );
-
   // NB symbol_pixbuf is just a reference, so no need to free it
 
   if ( symname && symname[0] != '\0' ) {
     hashed_symname = a_get_hashed_sym ( symname );
     if ( hashed_symname )
       symname = hashed_symname;
-    wp->symbol = g_strdup ( symname );
+    wp->symbol = wp_intern ( symname );
     wp->symbol_pixbuf = a_get_wp_sym ( wp->symbol );
   }
   else {
@@ -299,10 +333,8 @@ static void xt_text ( GMarkupParseContext *context,
     // Store any other tag contents
     gchar *txt = g_memdup ( text, text_len+1 );
     txt[text_len] = '\0';
-    gchar *tmp = a_gpx_entitize ( txt );
-    g_string_append ( gs_ext, tmp );
+    a_gpx_entitize_append ( gs_ext, txt );
     g_free ( txt );
-    g_free ( tmp );
   }
 }
 
@@ -365,9 +397,9 @@ static void wpt_ext_output ( VikWaypoint *wp, GString *gs, GHashTable *ght, gcha
       gpointer key, value;
       g_hash_table_iter_init ( &iter, ght );
       while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-        gchar *tmp = a_gpx_entitize ( value );
-        g_string_append_printf ( gs, "      <%s>%s</%s>\n", (gchar*)key, tmp, (gchar*)key );
-        g_free ( tmp );
+        g_string_append_printf ( gs, "      <%s>", (gchar*)key );
+        a_gpx_entitize_append ( gs, value );
+        g_string_append_printf ( gs, "</%s>\n", (gchar*)key );
       }
       g_string_append_printf ( gs, "    %s\n", ext_end );
     }
@@ -469,18 +501,13 @@ void vik_waypoint_free(VikWaypoint *wp)
     g_free ( wp->comment );
   if ( wp->description )
     g_free ( wp->description );
-  if ( wp->source )
-    g_free ( wp->source );
   if ( wp->url )
     g_free ( wp->url );
   if ( wp->url_name )
     g_free ( wp->url_name );
-  if ( wp->type )
-    g_free ( wp->type );
   if ( wp->image )
     g_free ( wp->image );
-  if ( wp->symbol )
-    g_free ( wp->symbol );
+  g_free ( wp->extra );
   if ( wp->extensions )
     g_free ( wp->extensions );
   if ( wp->gpxx )
@@ -499,23 +526,16 @@ VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp)
   new_wp->timestamp = wp->timestamp;
   new_wp->course = wp->course;
   new_wp->speed = wp->speed;
-  new_wp->magvar = wp->magvar;
-  new_wp->geoidheight = wp->geoidheight;
-  new_wp->fix_mode = wp->fix_mode;
-  new_wp->nsats = wp->nsats;
-  new_wp->hdop = wp->hdop;
-  new_wp->vdop = wp->vdop;
-  new_wp->pdop = wp->pdop;
-  new_wp->ageofdgpsdata = wp->ageofdgpsdata;
-  new_wp->dgpsid = wp->dgpsid;
+  if ( wp->extra )
+    new_wp->extra = g_memdup ( wp->extra, sizeof(VikWaypointExtra) );
   new_wp->proximity = wp->proximity;
   vik_waypoint_set_name(new_wp,wp->name);
   vik_waypoint_set_comment(new_wp,wp->comment);
   vik_waypoint_set_description(new_wp,wp->description);
-  vik_waypoint_set_source(new_wp,wp->source);
+  new_wp->source = wp->source;
   vik_waypoint_set_url(new_wp,wp->url);
   vik_waypoint_set_url_name(new_wp,wp->url_name);
-  vik_waypoint_set_type(new_wp,wp->type);
+  new_wp->type = wp->type;
   vik_waypoint_set_image(new_wp,wp->image);
   vik_waypoint_set_symbol(new_wp,wp->symbol);
   GString *gs = vik_waypoint_get_extensions((VikWaypoint*)wp);
@@ -526,6 +546,64 @@ VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp)
   return new_wp;
 }
 
+#define WP_STRING_SIZE(s) ((s) ? strlen(s) + 1 : 0)
+
+/**
+ * vik_waypoint_get_memory_usage:
+ *
+ * Returns: Bytes held for the waypoint and its strings
+ *  (symbol images and the interned strings are shared between waypoints and so not counted)
+ */
+gsize vik_waypoint_get_memory_usage ( const VikWaypoint *wp )
+{
+  return sizeof(VikWaypoint) + (wp->extra ? sizeof(VikWaypointExtra) : 0)
+    + WP_STRING_SIZE(wp->name) + WP_STRING_SIZE(wp->comment) + WP_STRING_SIZE(wp->description)
+    + WP_STRING_SIZE(wp->url) + WP_STRING_SIZE(wp->url_name)
+    + WP_STRING_SIZE(wp->image) + WP_STRING_SIZE(wp->extensions);
+}
+
+/**
+ * vik_waypoint_get_content_hash:
+ *
+ * Returns: A hash of everything read from or written to a file about the waypoint,
+ *  apart from how it is shown (visibility and so on).
+ *  So waypoints with the same hash can be taken to be the same waypoint (e.g. when merging layers).
+ */
+guint64 vik_waypoint_get_content_hash ( const VikWaypoint *wp )
+{
+  const VikWaypointExtra *extra = vik_waypoint_get_extra ( wp );
+  guint64 hash = UTIL_HASH_INIT;
+  hash = util_hash_bytes ( hash, &wp->coord.mode, sizeof(wp->coord.mode) );
+  hash = util_hash_double ( hash, wp->coord.north_south );
+  hash = util_hash_double ( hash, wp->coord.east_west );
+  hash = util_hash_double ( hash, wp->timestamp );
+  hash = util_hash_double ( hash, wp->altitude );
+  hash = util_hash_double ( hash, wp->course );
+  hash = util_hash_double ( hash, wp->speed );
+  hash = util_hash_double ( hash, extra->magvar );
+  hash = util_hash_double ( hash, extra->geoidheight );
+  hash = util_hash_string ( hash, wp->name );
+  hash = util_hash_string ( hash, wp->comment );
+  hash = util_hash_string ( hash, wp->description );
+  hash = util_hash_string ( hash, wp->source );
+  hash = util_hash_string ( hash, wp->url );
+  hash = util_hash_string ( hash, wp->url_name );
+  hash = util_hash_string ( hash, wp->type );
+  hash = util_hash_bytes ( hash, &extra->fix_mode, sizeof(extra->fix_mode) );
+  hash = util_hash_bytes ( hash, &extra->nsats, sizeof(extra->nsats) );
+  hash = util_hash_double ( hash, extra->hdop );
+  hash = util_hash_double ( hash, extra->vdop );
+  hash = util_hash_double ( hash, extra->pdop );
+  hash = util_hash_double ( hash, extra->ageofdgpsdata );
+  hash = util_hash_bytes ( hash, &extra->dgpsid, sizeof(extra->dgpsid) );
+  hash = util_hash_double ( hash, wp->proximity );
+  hash = util_hash_string ( hash, wp->image );
+  hash = util_hash_double ( hash, wp->image_direction );
+  hash = util_hash_string ( hash, wp->symbol );
+  hash = util_hash_string ( hash, wp->extensions );
+  return hash;
+}
+
 /**
  * vik_waypoint_apply_dem_data:
  * @wp:            The Waypoint to operate on
@@ -548,59 +626,119 @@ gboolean vik_waypoint_apply_dem_data ( VikWaypoint *wp, gboolean skip_existing )
   return updated;
 }
 
-/*
- * Take a Waypoint and convert it into a byte array
+// Each string is stored as its length (including the terminator, or 0 for NULL) then its content
+#define vwm_string_size(s) (sizeof(guint) + ((s) ? strlen(s)+1 : 0))
+
+static guint8 *vwm_append_string ( guint8 *data, const gchar *str )
+{
+  guint len = str ? strlen(str)+1 : 0;
+  memcpy ( data, &len, sizeof(len) );
+  data += sizeof(len);
+  if ( len ) {
+    memcpy ( data, str, len );
+    data += len;
+  }
+  return data;
+}
+
+// Hash table deep copy - size and then pairs of key,value
+static guint vwm_hash_size ( GHashTable *ght )
+{
+  guint size = sizeof(guint);
+  if ( ght ) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, ght );
+    while ( g_hash_table_iter_next (&iter, &key, &value) )
+      size += vwm_string_size((gchar*)key) + vwm_string_size((gchar*)value);
+  }
+  return size;
+}
+
+static guint8 *vwm_append_hash ( guint8 *data, GHashTable *ght )
+{
+  guint sz = ght ? g_hash_table_size(ght) : 0;
+  memcpy ( data, &sz, sizeof(sz) );
+  data += sizeof(sz);
+  if ( ght ) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, ght );
+    while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+      data = vwm_append_string ( data, key );
+      data = vwm_append_string ( data, value );
+    }
+  }
+  return data;
+}
+
+/**
+ * vik_waypoint_marshall_size:
+ *
+ * Returns: The number of bytes vik_waypoint_marshall_to() will write for this waypoint
  */
-void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *datalen)
+guint vik_waypoint_marshall_size ( const VikWaypoint *wp )
 {
-  GByteArray *b = g_byte_array_new();
-  guint len;
+  return sizeof(*wp) +
+    (wp->extra ? sizeof(VikWaypointExtra) : 0) +
+    vwm_string_size(wp->name) +
+    vwm_string_size(wp->comment) +
+    vwm_string_size(wp->description) +
+    vwm_string_size(wp->source) +
+    vwm_string_size(wp->url) +
+    vwm_string_size(wp->url_name) +
+    vwm_string_size(wp->type) +
+    vwm_string_size(wp->image) +
+    vwm_string_size(wp->symbol) +
+    vwm_string_size(wp->extensions) +
+    vwm_hash_size(wp->gpxx) +
+    vwm_hash_size(wp->wptx1);
+}
 
-  // This creates space for fixed sized members like gints and whatnot
-  //  and copies that amount of data from the waypoint to byte array
-  g_byte_array_append(b, (guint8 *)wp, sizeof(*wp));
-
-  // This allocates space for variant sized strings
-  //  and copies that amount of data from the waypoint to byte array
-#define vwm_append(s) \
-  len = (s) ? strlen(s)+1 : 0; \
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len)); \
-  if (s) g_byte_array_append(b, (guint8 *)s, len);
-
-  vwm_append(wp->name);
-  vwm_append(wp->comment);
-  vwm_append(wp->description);
-  vwm_append(wp->source);
-  vwm_append(wp->url);
-  vwm_append(wp->url_name);
-  vwm_append(wp->type);
-  vwm_append(wp->image);
-  vwm_append(wp->symbol);
-  vwm_append(wp->extensions);
-
-  // Hash table deep copy - size and then pairs of key,value
-  guint sz;
-  GHashTableIter iter;
-  gpointer key, value;
-#define vwm_append_hash(ght)                                    \
-  sz = (ght) ? g_hash_table_size((ght)): 0;                     \
-  g_byte_array_append ( b, (guint8*)&sz, sizeof(guint) );       \
-  if ( (ght) ) {                                                \
-    g_hash_table_iter_init ( &iter, (ght) );                    \
-    while ( g_hash_table_iter_next (&iter, &key, &value) ) {    \
-      vwm_append(key);                                          \
-      vwm_append(value);                                        \
-    }                                                           \
+/**
+ * vik_waypoint_marshall_to:
+ * @data: Where to write, with room for vik_waypoint_marshall_size() bytes
+ *
+ * Returns: The position just after the written waypoint
+ */
+guint8 *vik_waypoint_marshall_to ( const VikWaypoint *wp, guint8 *data )
+{
+  // This copies the fixed sized members like gints and whatnot
+  memcpy ( data, wp, sizeof(*wp) );
+  data += sizeof(*wp);
+  // The extra pointer copied above just says whether they follow
+  if ( wp->extra ) {
+    memcpy ( data, wp->extra, sizeof(VikWaypointExtra) );
+    data += sizeof(VikWaypointExtra);
   }
 
-  vwm_append_hash(wp->gpxx);
-  vwm_append_hash(wp->wptx1);
+  // Then the variant sized strings
+  data = vwm_append_string ( data, wp->name );
+  data = vwm_append_string ( data, wp->comment );
+  data = vwm_append_string ( data, wp->description );
+  data = vwm_append_string ( data, wp->source );
+  data = vwm_append_string ( data, wp->url );
+  data = vwm_append_string ( data, wp->url_name );
+  data = vwm_append_string ( data, wp->type );
+  data = vwm_append_string ( data, wp->image );
+  data = vwm_append_string ( data, wp->symbol );
+  data = vwm_append_string ( data, wp->extensions );
+
+  data = vwm_append_hash ( data, wp->gpxx );
+  data = vwm_append_hash ( data, wp->wptx1 );
+  return data;
+}
 
-  *data = b->data;
-  *datalen = b->len;
-  g_byte_array_free(b, FALSE);
-#undef vwm_append
-#undef vwm_append_hash
+/*
+ * Take a Waypoint and convert it into a byte array
+ *  sized up front so it is made in a single allocation
+ */
+void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *datalen)
+{
+  *datalen = vik_waypoint_marshall_size ( wp );
+  *data = g_malloc ( *datalen );
+  guint8 *end = vik_waypoint_marshall_to ( wp, *data );
+  g_assert ( end == *data + *datalen );
 }
 
 /*
@@ -614,6 +752,10 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
   // This copies the fixed sized elements (i.e. visibility, altitude, image_width, etc...)
   memcpy(new_wp, data, sizeof(*new_wp));
   data += sizeof(*new_wp);
+  if ( new_wp->extra ) {
+    new_wp->extra = g_memdup ( data, sizeof(VikWaypointExtra) );
+    data += sizeof(VikWaypointExtra);
+  }
 
   // Now the variant sized strings...
 #define vwu_get(s) \
@@ -626,15 +768,22 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
   } \
   data += len;
 
+// Interned strings are just looked up again
+#define vwu_get_interned(s) \
+  len = *(guint *)data; \
+  data += sizeof(len); \
+  (s) = len ? g_intern_string((gchar *)data) : NULL; \
+  data += len;
+
   vwu_get(new_wp->name);
   vwu_get(new_wp->comment);
   vwu_get(new_wp->description);
-  vwu_get(new_wp->source);
+  vwu_get_interned(new_wp->source);
   vwu_get(new_wp->url);
   vwu_get(new_wp->url_name);
-  vwu_get(new_wp->type);
+  vwu_get_interned(new_wp->type);
   vwu_get(new_wp->image);
-  vwu_get(new_wp->symbol);
+  vwu_get_interned(new_wp->symbol);
   vwu_get(new_wp->extensions);
 
   guint mylen;
@@ -667,5 +816,6 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
 
   return new_wp;
 #undef vwu_get
+#undef vwu_get_interned
 #undef vwu_get_hash
 }
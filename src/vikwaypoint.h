@@ -38,32 +38,31 @@ typedef enum {
 
 typedef struct _VikWaypoint VikWaypoint;
 
-struct _VikWaypoint {
-  VikCoord coord;
-  gboolean visible;
-  gdouble timestamp;         /* NAN if data unavailable */
-  gdouble altitude;
-  gdouble course;            /* NAN if data unavailable */
-  gdouble speed;             /* NAN if data unavailable */
+/**
+ * The GPS fix details, which most waypoints (e.g. points of interest) do not have,
+ *  so are only allocated when any are set - see vik_waypoint_edit_extra()
+ */
+typedef struct {
   gdouble magvar;            /* NAN if data unavailable */
   gdouble geoidheight;       /* NAN if data unavailable */
-  gboolean hide_name;
-  gchar *name;
-  gchar *comment;
-  gchar *description;
-  gchar *source;
-  gchar *url;
-  gchar *url_name;
-  gchar *type;
-  guint fix_mode;            /* VIK_GPS_MODE_NOT_SEEN if data unavailable */
-  guint nsats;               /* number of satellites used. 0 if data unavailable */
   gdouble hdop;              /* NAN if data unavailable */
   gdouble vdop;              /* NAN if data unavailable */
   gdouble pdop;              /* NAN if data unavailable */
   gdouble ageofdgpsdata;     /* NAN if data unavailable */
+  guint fix_mode;            /* VIK_GPS_MODE_NOT_SEEN if data unavailable */
+  guint nsats;               /* number of satellites used. 0 if data unavailable */
   guint dgpsid;              /* 0 .. 1023 */
+} VikWaypointExtra;
+
+struct _VikWaypoint {
+  VikCoord coord;
+  gboolean visible;
+  gboolean hide_name;
+  gdouble timestamp;         /* NAN if data unavailable */
+  gdouble altitude;
+  gdouble course;            /* NAN if data unavailable */
+  gdouble speed;             /* NAN if data unavailable */
   gdouble proximity;         /* NAN if data unavailable */
-  gchar *image;
   // NB Only really applicable if geotagging(exif info) is being used
   gdouble image_direction;   /* NAN if data unavailable */
   VikWaypointImageDirectionRef image_direction_ref;
@@ -72,7 +71,18 @@ struct _VikWaypoint {
    * dimensions of the original image. */
   guint8 image_width;
   guint8 image_height;
-  gchar *symbol;
+  gchar *name;
+  gchar *comment;
+  gchar *description;
+  // Usually the same few values across many waypoints,
+  //  so these are interned (shared and never freed) - only set them via the functions below
+  const gchar *source;
+  const gchar *type;
+  const gchar *symbol;
+  gchar *url;
+  gchar *url_name;
+  gchar *image;
+  VikWaypointExtra *extra;   // NULL when none of it is known
   gchar *extensions;         // GPX 1.1 (unsupported schema parts in here)
   GHashTable *gpxx;          // GPX 1.1 Garmin Schema: GPX Extensions v3 - 'gpxx:'
   GHashTable *wptx1;         // GPX 1.1 Garmin Schema: Waypoint Extension v1 'wptx1:'
@@ -93,13 +103,20 @@ void vik_waypoint_set_image_direction_info(VikWaypoint *wp, gdouble direction, V
 void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname);
 void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value);
 void vik_waypoint_set_proximity(VikWaypoint *wp, gdouble value);
+const VikWaypointExtra *vik_waypoint_get_extra ( const VikWaypoint *wp );
+VikWaypointExtra *vik_waypoint_edit_extra ( VikWaypoint *wp );
+void vik_waypoint_trim_extra ( VikWaypoint *wp );
 gboolean vik_waypoint_have_extensions(VikWaypoint *wp);
 GString *vik_waypoint_get_extensions(VikWaypoint *wp);
 
 void vik_waypoint_free(VikWaypoint * wp);
 VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp);
+gsize vik_waypoint_get_memory_usage ( const VikWaypoint *wp );
+guint64 vik_waypoint_get_content_hash ( const VikWaypoint *wp );
 void vik_waypoint_set_comment_no_copy(VikWaypoint *wp, gchar *comment);
 gboolean vik_waypoint_apply_dem_data ( VikWaypoint *wp, gboolean skip_existing );
+guint vik_waypoint_marshall_size ( const VikWaypoint *wp );
+guint8 *vik_waypoint_marshall_to ( const VikWaypoint *wp, guint8 *data );
 void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *len);
 VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen);
 
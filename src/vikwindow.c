@@ -23,12 +23,16 @@
 #include "viking.h"
 #include "background.h"
 #include "logging.h"
+#include "perfstats.h"
+#include "vikreplay.h"
 #include "acquire.h"
 #include "datasources.h"
 #include "geojson.h"
 #include "vikgoto.h"
 #include "dems.h"
 #include "mapcache.h"
+#include "thumbnails.h"
+#include "metatile.h"
 #include "print.h"
 #include "toolbar.h"
 #include "viklayer_defaults.h"
@@ -41,6 +45,10 @@
 #include "geonamessearch.h"
 #include "dir.h"
 #include "kmz.h"
+#include "pngstream.h"
+#include "binfile.h"
+#include "autosave.h"
+#include "devicesync.h"
 #ifdef HAVE_LIBGEOCLUE_2
 #include "libgeoclue.h"
 #endif
@@ -99,10 +107,13 @@ static void center_changed_cb ( VikWindow *vw );
 static gboolean window_configure_event ( VikWindow *vw, GdkEventConfigure *event, gpointer user_data );
 static gboolean draw_sync ( VikWindow *vw );
 static void draw_redraw ( VikWindow *vw );
+static gboolean draw_redraw_area ( VikWindow *vw, const GdkRectangle *area );
+static void draw_update_layers ( VikWindow *vw );
 static gboolean draw_scroll  ( VikWindow *vw, GdkEventScroll *event );
 static gboolean draw_click  ( VikWindow *vw, GdkEventButton *event );
 static gboolean draw_release ( VikWindow *vw, GdkEventButton *event );
 static gboolean draw_mouse_motion ( VikWindow *vw, GdkEventMotion *event );
+static void draw_mouse_motion_flush ( VikWindow *vw );
 static void draw_zoom_cb ( GtkAction *a, VikWindow *vw );
 static void draw_goto_cb ( GtkAction *a, VikWindow *vw );
 static void draw_refresh_cb ( GtkAction *a, VikWindow *vw );
@@ -177,10 +188,12 @@ static void register_vik_icons (GtkIconFactory *icon_factory);
 
 /* i/o */
 static void load_file ( GtkAction *a, VikWindow *vw );
+static gboolean open_files_import ( VikWindow *vw, GSList *files, gboolean new_layer, gboolean external );
 static gboolean save_file_as ( GtkAction *a, VikWindow *vw );
 static gboolean save_file ( GtkAction *a, VikWindow *vw );
 static gboolean save_file_and_exit ( GtkAction *a, VikWindow *vw );
 static gboolean window_save ( VikWindow *vw, VikAggregateLayer *agg, gchar *filename );
+static gboolean autosave_timeout ( VikWindow *vw );
 
 struct _VikWindow {
   GtkWindow gtkwindow;
@@ -243,6 +256,14 @@ struct _VikWindow {
   guint move_scroll_timeout;
   guint zoom_scroll_timeout;
   gdouble pinch_gesture_factor;
+  gboolean kinetic_pan;
+  gdouble pan_velocity_x, pan_velocity_y; // Pixels per millisecond
+  guint32 pan_time;
+  guint kinetic_id;
+
+  gchar *autosave_journal;
+  gboolean autosave_untitled; // Whether the journal is for an untitled workspace
+  guint autosave_id;
 
   guint draw_image_width, draw_image_height;
   gboolean draw_image_save_as_png;
@@ -255,8 +276,21 @@ struct _VikWindow {
 
   gboolean only_updating_coord_mode_ui; /* hack for a bug in GTK */
   GtkUIManager *uim;
+  gboolean babel_ui_added;
 
   GThread  *thread;
+  /* Screen area that layers have asked to redraw since the last draw - see vik_window_add_damage() */
+  GdkRectangle damage;
+  gboolean damage_any;
+  gint damage_full; // Atomic, as can be set from any thread
+  guint drawn_serial; // Viewport projection serial of the last draw
+  /* Redraw scheduling - see draw_update_layers() */
+  guint redraw_id;
+  guint redraw_requests; // Layer updates since the last draw
+  gint64 redraw_last;    // Start of the last draw (monotonic time)
+  guint redraw_count;
+  guint redraw_merged;   // Number of updates that didn't need a draw of their own
+  gdouble redraw_ms;     // How long the last draw took
   /* half-drawn update */
   VikLayer *trigger;
   VikCoord trigger_center;
@@ -276,6 +310,16 @@ struct _VikWindow {
   gdouble pinch_zoom_last;
 
   guint number_loaded; // Very simple tracker
+
+  guint time_filter_id;     // Pending update of the aggregate layers for the time filter
+  guint time_filter_period; // Index into time_filter_periods[]
+
+  VikReplay *replay;        // Only while replaying tracks
+
+  /* Pointer movement is handled at most once a frame - see draw_mouse_motion() */
+  GdkEvent *motion_pending;
+  guint motion_id;
+  gint64 motion_last;       // When movement was last handled (monotonic time)
 };
 
 enum {
@@ -692,6 +736,10 @@ static void open_window ( VikWindow *vw, GSList *files, gboolean external )
 {
   if ( !vw  )
     return;
+  if ( open_files_import ( vw, files, TRUE, external ) ) {
+    g_slist_free_full ( files, g_free );
+    return;
+  }
   guint file_num = 0;
   guint num_files = g_slist_length(files);
   gboolean change_fn = (num_files == 1); // only change fn if one file
@@ -749,6 +797,23 @@ static void window_finalize ( GObject *gob )
 
   if ( vw->sbiu_id )
     (void)g_source_remove ( vw->sbiu_id );
+  if ( vw->redraw_id )
+    (void)g_source_remove ( vw->redraw_id );
+  if ( vw->time_filter_id )
+    (void)g_source_remove ( vw->time_filter_id );
+  if ( vw->motion_id )
+    (void)g_source_remove ( vw->motion_id );
+  if ( vw->motion_pending )
+    gdk_event_free ( vw->motion_pending );
+  if ( vw->kinetic_id )
+    (void)g_source_remove ( vw->kinetic_id );
+  if ( vw->pending_draw_id )
+    (void)g_source_remove ( vw->pending_draw_id );
+  if ( vw->autosave_id )
+    (void)g_source_remove ( vw->autosave_id );
+  // Closing the window is either after saving or choosing not to
+  a_autosave_discard ( vw->autosave_journal );
+  g_free ( vw->autosave_journal );
 
   a_background_remove_window ( vw );
   a_logging_remove_window ( vw );
@@ -995,6 +1060,9 @@ static void zoom_gesture_scale_changed_cb ( GtkGesture *gesture,
     vik_viewport_coord_to_screen ( vw->viking_vvp, &coord, &x, &y );
     vik_viewport_set_center_screen ( vw->viking_vvp, center_x + (x - point_x), center_y + (y - point_y) );
 
+    // Show the scaled drawing whilst the layers are drawn again
+    vik_viewport_zoom_shown ( vw->viking_vvp, vw->pinch_zoom_last / new_zoom, (gint)point_x, (gint)point_y );
+    vik_viewport_sync ( vw->viking_vvp, NULL );
     draw_update ( vw );
     vw->pinch_zoom_last = new_zoom;
   }
@@ -1058,6 +1126,8 @@ static void default_tool_enable ( VikWindow *vw )
 #define VIK_SETTINGS_WIN_ZOOM_SCROLL_TIMEOUT "window_zoom_scroll_timeout"
 #define VIK_SETTINGS_WIN_MOVE_SCROLL_TIMEOUT "window_move_scroll_timeout"
 #define VIK_SETTINGS_WIN_PINCH_GESTURE_FACTOR "window_pinch_gesture_factor"
+#define VIK_SETTINGS_WIN_KINETIC_PAN "window_kinetic_pan"
+#define VIK_SETTINGS_WIN_AUTOSAVE_INTERVAL "window_autosave_interval"
 #define VIK_SETTINGS_WIN_FILE_MOUNT "window_mount_device_id"
 
 #define VIKING_ACCELERATOR_KEY_FILE "keys.rc"
@@ -1256,6 +1326,94 @@ static void try_mount_info_cb ( GtkAction *a, VikWindow *vw )
   g_free ( str );
 }
 
+#define VIK_SETTINGS_MEMORY_BUDGET "memory_budget_mb"
+// All the layers are looked through, so only every so often
+#define MEMORY_BUDGET_CHECK_SECONDS 10
+
+static guint64 memory_budget = 0;
+static gboolean memory_budget_warned = FALSE;
+
+static gsize memory_budget_layers_usage ( VikWindow *vw, VikLayerTypeEnum type )
+{
+  gsize size = 0;
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vw->viking_vlp), NULL, type, TRUE );
+  GList *iter;
+  for ( iter = layers; iter; iter = iter->next )
+    size += vik_layer_get_memory_usage ( VIK_LAYER(iter->data) );
+  g_list_free ( layers );
+  return size;
+}
+
+/**
+ * Keep to the soft memory budget by trimming the caches,
+ *  least costly to refill first: thumbnails, then map tiles, then DEMs.
+ * Layer data itself is never thrown away, so if that alone is over the budget only a warning is given.
+ */
+static gboolean memory_budget_check ( gpointer data )
+{
+  guint64 used = 0;
+  GSList *item;
+  for ( item = window_list; item; item = item->next ) {
+    // The caches are counted as a whole below, so only the layers holding their own data here
+    used += memory_budget_layers_usage ( VIK_WINDOW(item->data), VIK_LAYER_TRW );
+    used += memory_budget_layers_usage ( VIK_WINDOW(item->data), VIK_LAYER_GEOREF );
+  }
+  guint dem_count, dem_resident;
+  guint64 dem_bytes;
+  a_dems_get_usage ( &dem_count, &dem_resident, &dem_bytes );
+  gsize img_size;
+  guint img_count, img_hits, img_misses;
+  a_thumbnails_cache_get_stats ( &img_size, &img_count, &img_hits, &img_misses );
+  used += a_mapcache_get_size() + a_mapcache_encoded_get_size() + dem_bytes + img_size;
+
+  if ( used > memory_budget ) {
+    guint64 over = used - memory_budget;
+    guint64 freed = a_thumbnails_cache_trim ( over );
+    if ( freed < over )
+      freed += a_mapcache_trim ( over - freed );
+    if ( freed < over )
+      freed += a_dems_trim ( over - freed );
+    g_debug ( "%s: %" G_GUINT64_FORMAT " bytes over, trimmed %" G_GUINT64_FORMAT, __FUNCTION__, over, freed );
+    a_perfstats_count ( "memory", "budget trims", 1 );
+    used -= MIN(freed, used);
+  }
+
+  if ( used > memory_budget ) {
+    if ( !memory_budget_warned ) {
+      gchar *used_str = g_format_size ( used );
+      gchar *budget_str = g_format_size ( memory_budget );
+      gchar *msg = g_strdup_printf ( _("Memory in use %s is over the budget of %s"), used_str, budget_str );
+      for ( item = window_list; item; item = item->next )
+        vik_statusbar_set_message ( VIK_WINDOW(item->data)->viking_vs, VIK_STATUSBAR_INFO, msg );
+      g_warning ( "%s", msg );
+      g_free ( msg );
+      g_free ( budget_str );
+      g_free ( used_str );
+      memory_budget_warned = TRUE;
+    }
+  }
+  else
+    memory_budget_warned = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Start checking the memory budget when one is set (only once for all windows)
+ */
+static void memory_budget_init ( void )
+{
+  static gboolean done = FALSE;
+  if ( done )
+    return;
+  done = TRUE;
+  gint budget = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MEMORY_BUDGET, &budget ) && budget > 0 ) {
+    memory_budget = (guint64)budget * 1024 * 1024;
+    (void)g_timeout_add_seconds ( MEMORY_BUDGET_CHECK_SECONDS, memory_budget_check, NULL );
+  }
+}
+
 /**
  *
  */
@@ -1315,6 +1473,18 @@ static void vik_window_init ( VikWindow *vw )
   else
     vw->move_scroll_timeout = 5;
 
+  gboolean kinetic_pan;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_WIN_KINETIC_PAN, &kinetic_pan ) )
+    vw->kinetic_pan = kinetic_pan;
+  else
+    vw->kinetic_pan = TRUE;
+
+  gint autosave_interval;
+  if ( !a_settings_get_integer ( VIK_SETTINGS_WIN_AUTOSAVE_INTERVAL, &autosave_interval ) )
+    autosave_interval = 5;
+  if ( autosave_interval > 0 )
+    vw->autosave_id = g_timeout_add_seconds ( autosave_interval * 60, (GSourceFunc)autosave_timeout, vw );
+
   gdouble pinch_gesture_factor;
   if ( a_settings_get_double ( VIK_SETTINGS_WIN_PINCH_GESTURE_FACTOR, &pinch_gesture_factor ) )
     vw->pinch_gesture_factor = fabs(pinch_gesture_factor);
@@ -1355,7 +1525,7 @@ static void vik_window_init ( VikWindow *vw )
 
   // Own signals
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "updated_center", G_CALLBACK(center_changed_cb), vw);
-  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update), vw);
+  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update_layers), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "delete_layer", G_CALLBACK(vik_window_clear_selected), vw);
 
   // Signals from GTK
@@ -1417,6 +1587,7 @@ static void vik_window_init ( VikWindow *vw )
   a_logging_add_window ( vw );
 
   window_list = g_slist_prepend ( window_list, vw);
+  memory_budget_init ();
 
   gint height = VIKING_WINDOW_HEIGHT;
   gint width = VIKING_WINDOW_WIDTH;
@@ -1794,6 +1965,92 @@ void vik_window_draw_update ( VikWindow *vw )
   draw_update(vw);
 }
 
+/**
+ * vik_window_add_damage:
+ * @area: The screen area that needs redrawing, or NULL for everything
+ *
+ * Record what a forthcoming layer update needs to redraw,
+ *  so that small changes (e.g. moving a single waypoint) don't have to redraw the whole map.
+ * Any update without a specific area redraws everything as before.
+ */
+void vik_window_add_damage ( VikWindow *vw, const GdkRectangle *area )
+{
+  if ( !vw )
+    return;
+  if ( !area || g_thread_self() != vw->thread ) {
+    g_atomic_int_set ( &vw->damage_full, TRUE );
+    return;
+  }
+  if ( vw->damage_any )
+    gdk_rectangle_union ( &vw->damage, area, &vw->damage );
+  else
+    vw->damage = *area;
+  vw->damage_any = TRUE;
+}
+
+/**
+ * Redraw for the layer updates since the last draw,
+ *  only the damaged area when possible, otherwise everything
+ */
+static gboolean draw_update_layers_frame ( VikWindow *vw )
+{
+  vw->redraw_id = 0;
+
+  // Another draw has since happened, which covered all of the updates
+  if ( !vw->redraw_requests )
+    return FALSE;
+  vw->redraw_merged += vw->redraw_requests - 1;
+
+  GdkRectangle area = vw->damage;
+  gboolean partial = vw->damage_any && !g_atomic_int_get ( &vw->damage_full );
+
+  // Any change of view since the last draw means everything moved
+  if ( partial )
+    partial = ( vik_viewport_get_projection(vw->viking_vvp)->serial == vw->drawn_serial );
+
+  if ( partial ) {
+    GdkRectangle screen = { 0, 0, vik_viewport_get_width(vw->viking_vvp), vik_viewport_get_height(vw->viking_vvp) };
+    if ( !gdk_rectangle_intersect ( &area, &screen, &area ) ) {
+      // Damage entirely off screen so nothing visible changed
+      vw->damage_any = FALSE;
+      vw->redraw_requests = 0;
+      return FALSE;
+    }
+  }
+
+  if ( partial && draw_redraw_area ( vw, &area ) ) {
+    vik_viewport_sync_area ( vw->viking_vvp, &area );
+    draw_status ( vw );
+  }
+  else
+    draw_update ( vw );
+  return FALSE;
+}
+
+/**
+ * The layers have been updated
+ * Rather than drawing for every update, the next frame is scheduled
+ *  (no sooner than the maximum redraw rate allows) to cover all updates until then.
+ * Thus e.g. storms of updates from downloads or realtime GPS only get drawn as often as is useful.
+ */
+static void draw_update_layers ( VikWindow *vw )
+{
+  vw->redraw_requests++;
+  if ( vw->redraw_id )
+    return;
+
+  guint rate = a_vik_get_max_redraw_rate();
+  gint64 wait = 0;
+  if ( rate )
+    wait = vw->redraw_last + G_USEC_PER_SEC / rate - g_get_monotonic_time();
+
+  if ( wait > 0 )
+    vw->redraw_id = g_timeout_add ( (guint)((wait + 999) / 1000), (GSourceFunc)draw_update_layers_frame, vw );
+  else
+    // Still give any other updates already on their way the chance to be included
+    vw->redraw_id = g_idle_add ( (GSourceFunc)draw_update_layers_frame, vw );
+}
+
 /*
  * Split the status update, as sometimes only need to update the tool part
  *  also on initialization the zoom related stuff is not ready to be used
@@ -1828,6 +2085,12 @@ static void draw_status ( VikWindow *vw )
   vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_ZOOM, zoom_level );
 
   draw_status_tool ( vw );
+
+  if ( vik_debug ) {
+    gchar *msg = g_strdup_printf ( "Redraw %.1fms (#%u, %u merged)", vw->redraw_ms, vw->redraw_count, vw->redraw_merged );
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+    g_free ( msg );
+  }
 }
 
 void vik_window_set_redraw_trigger(VikLayer *vl)
@@ -1892,6 +2155,27 @@ static gboolean window_configure_event ( VikWindow *vw, GdkEventConfigure *event
 
 static void draw_redraw ( VikWindow *vw )
 {
+  (void)draw_redraw_area ( vw, NULL );
+}
+
+/**
+ * Draw everything, but when an area is given only that part of the viewport changes
+ *
+ * Returns: Whether drawing was limited to the area
+ */
+static gboolean draw_redraw_area ( VikWindow *vw, const GdkRectangle *area )
+{
+  // Whatever was damaged is now going to be drawn
+  vw->damage_any = FALSE;
+  g_atomic_int_set ( &vw->damage_full, FALSE );
+  vw->redraw_requests = 0;
+  vw->redraw_last = g_get_monotonic_time();
+
+  // The replay keeps a copy of the whole drawing
+  if ( vw->replay )
+    area = NULL;
+  gboolean clipped = area && vik_viewport_damage_clip_begin ( vw->viking_vvp, area );
+
   VikCoord old_center = vw->trigger_center;
   vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
   VikLayer *new_trigger = vw->trigger;
@@ -1931,8 +2215,18 @@ static void draw_redraw ( VikWindow *vw )
   vik_viewport_draw_copyright ( vw->viking_vvp );
   vik_viewport_draw_centermark ( vw->viking_vvp );
   vik_viewport_draw_logo ( vw->viking_vvp );
+  if ( vw->replay )
+    vik_replay_draw ( vw->replay );
 
   vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE ); /* just in case. */
+
+  if ( clipped )
+    vik_viewport_damage_clip_end ( vw->viking_vvp );
+  vw->drawn_serial = vik_viewport_get_projection(vw->viking_vvp)->serial;
+
+  vw->redraw_count++;
+  vw->redraw_ms = ( g_get_monotonic_time() - vw->redraw_last ) / 1000.0;
+  return clipped;
 }
 
 gboolean draw_buf_done = TRUE;
@@ -1950,16 +2244,30 @@ static gboolean draw_buf(gpointer data)
 
 /* Mouse event handlers ************************************************************************/
 
+static void kinetic_pan_stop ( VikWindow *vw )
+{
+  if ( vw->kinetic_id ) {
+    (void)g_source_remove ( vw->kinetic_id );
+    vw->kinetic_id = 0;
+  }
+}
+
 static void vik_window_pan_click (VikWindow *vw, GdkEventButton *event)
 {
+  // Catching the map whilst it is still moving
+  kinetic_pan_stop ( vw );
   /* set panning origin */
   vw->pan_move = FALSE;
   vw->pan_x = (gint) event->x;
   vw->pan_y = (gint) event->y;
+  vw->pan_velocity_x = vw->pan_velocity_y = 0.0;
+  vw->pan_time = event->time;
 }
 
 static gboolean draw_click (VikWindow *vw, GdkEventButton *event)
 {
+  // Tools see where the pointer got to first
+  draw_mouse_motion_flush ( vw );
   gtk_widget_grab_focus ( GTK_WIDGET(vw->viking_vvp) );
 
   /* middle button pressed.  we reserve all middle button and scroll events
@@ -1997,6 +2305,16 @@ static void vik_window_pan_move (VikWindow *vw, GdkEventMotion *event)
     vik_viewport_set_center_screen ( vw->viking_vvp,
                                      vik_viewport_get_width(vw->viking_vvp)/2 - new_pan_x + vw->pan_x,
                                      vik_viewport_get_height(vw->viking_vvp)/2 - new_pan_y + vw->pan_y );
+    // Move what's already drawn, until the layers are drawn in their new place
+    vik_viewport_shift ( vw->viking_vvp, new_pan_x - vw->pan_x, new_pan_y - vw->pan_y );
+    vik_viewport_sync ( vw->viking_vvp, NULL );
+    // Smoothed so that one jerky motion event doesn't decide how the map carries on moving
+    guint32 dt = event->time - vw->pan_time;
+    if ( dt > 0 ) {
+      vw->pan_velocity_x = ( vw->pan_velocity_x + (gdouble)(new_pan_x - vw->pan_x) / dt ) / 2;
+      vw->pan_velocity_y = ( vw->pan_velocity_y + (gdouble)(new_pan_y - vw->pan_y) / dt ) / 2;
+      vw->pan_time = event->time;
+    }
     vw->pan_move = TRUE;
     vw->pan_x = new_pan_x;
     vw->pan_y = new_pan_y;
@@ -2029,7 +2347,11 @@ static void get_location_strings ( VikWindow *vw, struct UTM utm, gchar **lat, g
   }
 }
 
-static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+/**
+ * Handle the pointer movement: the tool (e.g. looking for what is under the pointer),
+ *  the position in the statusbar and panning
+ */
+static void draw_mouse_motion_process ( VikWindow *vw, GdkEventMotion *event )
 {
   static VikCoord coord;
   static struct UTM utm;
@@ -2090,7 +2412,54 @@ static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
    * http://bugzilla.gnome.org/show_bug.cgi?id=587714
   */
   /* gdk_event_request_motions ( event ); */
+}
+
+static gboolean draw_mouse_motion_timeout ( VikWindow *vw )
+{
+  vw->motion_id = 0;
+  draw_mouse_motion_flush ( vw );
+  return FALSE;
+}
+
+/**
+ * Handle any pointer movement not yet handled
+ */
+static void draw_mouse_motion_flush ( VikWindow *vw )
+{
+  if ( vw->motion_id ) {
+    (void)g_source_remove ( vw->motion_id );
+    vw->motion_id = 0;
+  }
+  GdkEvent *event = vw->motion_pending;
+  if ( !event )
+    return;
+  vw->motion_pending = NULL;
+  vw->motion_last = g_get_monotonic_time ();
+  draw_mouse_motion_process ( vw, &event->motion );
+  gdk_event_free ( event );
+}
+
+// Pointers can report movement much more often than the screen changes
+#define MOTION_FRAME_US (G_USEC_PER_SEC / 60)
+
+/**
+ * Only the latest of the pointer movements within a frame is handled,
+ *  so high rate mice don't swamp the main loop with tool and statusbar updates.
+ * Anything pending is handled before button presses and releases.
+ */
+static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+{
+  if ( vw->motion_pending )
+    gdk_event_free ( vw->motion_pending );
+  vw->motion_pending = gdk_event_copy ( (GdkEvent*)event );
 
+  if ( !vw->motion_id ) {
+    gint64 wait = vw->motion_last + MOTION_FRAME_US - g_get_monotonic_time ();
+    if ( wait > 0 )
+      vw->motion_id = g_timeout_add ( (guint)((wait + 999) / 1000), (GSourceFunc)draw_mouse_motion_timeout, vw );
+    else
+      draw_mouse_motion_flush ( vw );
+  }
   return FALSE;
 }
 
@@ -2116,6 +2485,41 @@ static gboolean vik_window_pan_timeout (VikWindow *vw)
   return FALSE;
 }
 
+// Milliseconds between each step of a kinetic pan
+#define KINETIC_PAN_INTERVAL 16
+// Slowest release to carry on moving, in pixels per millisecond
+#define KINETIC_PAN_MIN_VELOCITY 0.3
+// Slowest movement before stopping
+#define KINETIC_PAN_STOP_VELOCITY 0.02
+
+/**
+ * Carry on moving the map after a fast pan, slowing down each time
+ */
+static gboolean kinetic_pan_timeout ( VikWindow *vw )
+{
+  gint dx = (gint)round ( vw->pan_velocity_x * KINETIC_PAN_INTERVAL );
+  gint dy = (gint)round ( vw->pan_velocity_y * KINETIC_PAN_INTERVAL );
+  vw->pan_velocity_x *= 0.9;
+  vw->pan_velocity_y *= 0.9;
+
+  if ( dx != 0 || dy != 0 ) {
+    vik_viewport_set_center_screen ( vw->viking_vvp,
+                                     vik_viewport_get_width(vw->viking_vvp)/2 - dx,
+                                     vik_viewport_get_height(vw->viking_vvp)/2 - dy );
+    vik_viewport_shift ( vw->viking_vvp, dx, dy );
+    vik_viewport_sync ( vw->viking_vvp, NULL );
+    if ( ! vw->pending_draw_id )
+      vw->pending_draw_id = g_timeout_add ( vw->move_scroll_timeout, (GSourceFunc)pending_draw_timeout, vw );
+  }
+
+  if ( hypot ( vw->pan_velocity_x, vw->pan_velocity_y ) < KINETIC_PAN_STOP_VELOCITY ) {
+    vw->kinetic_id = 0;
+    draw_update ( vw );
+    return FALSE;
+  }
+  return TRUE;
+}
+
 static void vik_window_pan_release ( VikWindow *vw, GdkEventButton *event )
 {
   gboolean do_draw = TRUE;
@@ -2142,6 +2546,13 @@ static void vik_window_pan_release ( VikWindow *vw, GdkEventButton *event )
   else {
     vik_viewport_set_center_screen ( vw->viking_vvp, vik_viewport_get_width(vw->viking_vvp)/2 - event->x + vw->pan_x,
                                      vik_viewport_get_height(vw->viking_vvp)/2 - event->y + vw->pan_y );
+    // Only when still moving at the time of the release - not after having paused
+    if ( vw->kinetic_pan &&
+         event->time - vw->pan_time < 50 &&
+         hypot ( vw->pan_velocity_x, vw->pan_velocity_y ) > KINETIC_PAN_MIN_VELOCITY ) {
+      kinetic_pan_stop ( vw );
+      vw->kinetic_id = g_timeout_add ( KINETIC_PAN_INTERVAL, (GSourceFunc)kinetic_pan_timeout, vw );
+    }
   }
 
   vw->pan_move = FALSE;
@@ -2152,6 +2563,7 @@ static void vik_window_pan_release ( VikWindow *vw, GdkEventButton *event )
 
 static gboolean draw_release ( VikWindow *vw, GdkEventButton *event )
 {
+  draw_mouse_motion_flush ( vw );
   gtk_widget_grab_focus ( GTK_WIDGET(vw->viking_vvp) );
 
   if ( event->button == 2 ) {  /* move / pan */
@@ -2252,8 +2664,27 @@ static void zoom_at_xy ( VikWindow *vw, guint point_x, guint point_y, gboolean s
   vik_viewport_set_center_screen ( vw->viking_vvp, center_x + (x - point_x), center_y + (y - point_y) );
 }
 
+/**
+ * Move and scale what's already drawn to match the view now,
+ *  given the centre and zoom level it was drawn at,
+ *  until the layers are drawn again
+ */
+static void draw_shown_moved ( VikWindow *vw, const VikCoord *old_center, gdouble old_xmpp )
+{
+  gint cx = vik_viewport_get_width ( vw->viking_vvp ) / 2;
+  gint cy = vik_viewport_get_height ( vw->viking_vvp ) / 2;
+  gint x, y;
+  vik_viewport_coord_to_screen ( vw->viking_vvp, old_center, &x, &y );
+  vik_viewport_zoom_shown ( vw->viking_vvp, old_xmpp / vik_viewport_get_xmpp(vw->viking_vvp), cx, cy );
+  vik_viewport_shift ( vw->viking_vvp, x - cx, y - cy );
+}
+
 static gboolean draw_scroll (VikWindow *vw, GdkEventScroll *event)
 {
+  kinetic_pan_stop ( vw );
+  VikCoord old_center = *vik_viewport_get_center ( vw->viking_vvp );
+  gdouble old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
+
   // Typically wheel mouse scrolls should zoom;
   //  but one could use a mouse with dual scroll wheels.
   // Whereas in GTK3 we can detect touch device scrolls and so it will then always move the viewport
@@ -2268,6 +2699,7 @@ static gboolean draw_scroll (VikWindow *vw, GdkEventScroll *event)
     scroll_move_viewport ( vw, event );
 
     // Paint the screen image
+    draw_shown_moved ( vw, &old_center, old_xmpp );
     draw_sync ( vw );
 
     // Note using a shorter timeout compared to the other instance at the end of this function
@@ -2311,11 +2743,16 @@ static gboolean draw_scroll (VikWindow *vw, GdkEventScroll *event)
     zoom_at_xy ( vw, event->x, event->y, TRUE, direction, 0 );
   }
 
+  // Straight away show roughly how it will look
+  draw_shown_moved ( vw, &old_center, old_xmpp );
+  draw_sync ( vw );
+
   // If a pending draw, remove it and create a new one
   //  thus avoiding intermediary screen redraws when transiting through several
   //  zoom levels in quick succession, as typical when scroll zooming.
-  if ( ! vw->pending_draw_id )
-    vw->pending_draw_id = g_timeout_add ( vw->zoom_scroll_timeout, (GSourceFunc)pending_draw_timeout, vw );
+  if ( vw->pending_draw_id )
+    (void)g_source_remove ( vw->pending_draw_id );
+  vw->pending_draw_id = g_timeout_add ( vw->zoom_scroll_timeout, (GSourceFunc)pending_draw_timeout, vw );
 
   return TRUE;
 }
@@ -3841,6 +4278,27 @@ static void menu_addlayer_cb ( GtkAction *a, VikWindow *vw )
   }
 }
 
+static void menu_undo_redo ( VikWindow *vw, gboolean redo )
+{
+  VikLayer *vl = vik_layers_panel_get_selected ( vw->viking_vlp );
+  if ( !vl || vl->type != VIK_LAYER_TRW ) {
+    vik_window_statusbar_update ( vw, _("Select a TrackWaypoint layer to undo or redo its edits"), VIK_STATUSBAR_INFO );
+    return;
+  }
+  if ( redo ? vik_trw_layer_redo ( VIK_TRW_LAYER(vl) ) : vik_trw_layer_undo ( VIK_TRW_LAYER(vl) ) )
+    vw->modified++;
+}
+
+static void menu_undo_cb ( GtkAction *a, VikWindow *vw )
+{
+  menu_undo_redo ( vw, FALSE );
+}
+
+static void menu_redo_cb ( GtkAction *a, VikWindow *vw )
+{
+  menu_undo_redo ( vw, TRUE );
+}
+
 static void menu_copy_layer_cb ( GtkAction *a, VikWindow *vw )
 {
   a_clipboard_copy_selected ( vw->viking_vlp );
@@ -4200,8 +4658,19 @@ static void help_cache_info_cb ( GtkAction *a, VikWindow *vw )
   // NB: No i18n as this is just for debug
   guint byte_size = a_mapcache_get_size();
   gchar *msg_sz = g_format_size_full ( byte_size, G_FORMAT_SIZE_LONG_FORMAT );
-  gchar *msg = g_strdup_printf ( "Map Cache size is %s with %d items", msg_sz, a_mapcache_get_count());
+  guint hits, misses;
+  a_mapcache_get_hit_stats ( &hits, &misses );
+  gchar *msg_enc_sz = g_format_size_full ( a_mapcache_encoded_get_size(), G_FORMAT_SIZE_LONG_FORMAT );
+  gsize img_size;
+  guint img_count, img_hits, img_misses;
+  a_thumbnails_cache_get_stats ( &img_size, &img_count, &img_hits, &img_misses );
+  gchar *msg_img_sz = g_format_size_full ( img_size, G_FORMAT_SIZE_LONG_FORMAT );
+  gchar *msg = g_strdup_printf ( "Map Cache size is %s with %d items\nCompressed tiles size is %s\nLookups: %u hits, %u misses\nLock contention count: %u\n\nImage Cache size is %s with %u items\nLookups: %u hits, %u misses",
+                                 msg_sz, a_mapcache_get_count(), msg_enc_sz, hits, misses, a_mapcache_get_contended(),
+                                 msg_img_sz, img_count, img_hits, img_misses );
   a_dialog_info_msg_extra ( GTK_WINDOW(vw), "%s", msg );
+  g_free ( msg_img_sz );
+  g_free ( msg_enc_sz );
   g_free ( msg_sz );
   g_free ( msg );
 }
@@ -4592,8 +5061,82 @@ static void window_refresh_title ( VikWindow *vw )
   g_free ( title );
 }
 
+/**
+ * Periodically put the layers changed since the last save into the journal
+ */
+static gboolean autosave_timeout ( VikWindow *vw )
+{
+  if ( vw->modified ) {
+    guint num = a_autosave_snapshot ( vw->autosave_journal, vik_layers_panel_get_top_layer(vw->viking_vlp) );
+    if ( num ) {
+      gchar *msg = g_strdup_printf ( ngettext("Autosaved %d layer", "Autosaved %d layers", num), num );
+      vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+      g_free ( msg );
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Offer to put the layers from the journal into a new aggregate layer
+ *  after which the journal is finished with
+ *  (any recovered layers being autosaved again as new layers)
+ */
+static void window_autosave_recover ( VikWindow *vw, const gchar *journal, const gchar *name )
+{
+  if ( a_dialog_yes_or_no ( GTK_WINDOW(vw), _("There are autosaved changes to \"%s\" that were never saved.\n\nDo you want to recover them?"), name ) ) {
+    VikAggregateLayer *agg = VIK_AGGREGATE_LAYER ( vik_layer_create(VIK_LAYER_AGGREGATE, vw->viking_vvp, FALSE) );
+    vik_layer_rename ( VIK_LAYER(agg), _("Recovered") );
+    if ( a_autosave_recover ( journal, agg, vw->viking_vvp ) ) {
+      vik_aggregate_layer_add_layer ( vik_layers_panel_get_top_layer(vw->viking_vlp), VIK_LAYER(agg), FALSE );
+      vik_window_set_modified ( vw );
+      draw_update ( vw );
+    }
+    else
+      g_object_unref ( agg );
+  }
+  a_autosave_discard ( journal );
+}
+
+/**
+ * vik_window_autosave_recover_untitled:
+ *
+ * Offer to recover autosaved layers from untitled workspaces of an earlier run
+ *  (so only when no other instance is running)
+ */
+void vik_window_autosave_recover_untitled ( VikWindow *vw )
+{
+  GList *journals = a_autosave_get_untitled_journals ();
+  for ( GList *iter = journals; iter; iter = iter->next )
+    window_autosave_recover ( vw, iter->data, _("Untitled") );
+  g_list_free_full ( journals, g_free );
+}
+
+/**
+ * The journal goes by the filename, so when that changes start a new one with everything in it
+ */
+static void window_autosave_follow ( VikWindow *vw, const gchar *filename )
+{
+  if ( !filename && vw->autosave_untitled )
+    return;
+  gchar *journal = a_autosave_journal_name ( filename );
+  if ( g_strcmp0 ( journal, vw->autosave_journal ) == 0 ) {
+    g_free ( journal );
+    return;
+  }
+  // NB None yet when the window is being created
+  if ( vw->autosave_journal )
+    a_autosave_discard ( vw->autosave_journal );
+  g_free ( vw->autosave_journal );
+  vw->autosave_journal = journal;
+  vw->autosave_untitled = !filename;
+  a_autosave_set_changed ( vik_layers_panel_get_top_layer(vw->viking_vlp), TRUE );
+}
+
 static void window_set_filename ( VikWindow *vw, const gchar *filename )
 {
+  window_autosave_follow ( vw, filename );
+
   if ( vw->filename )
     g_free ( vw->filename );
   if ( filename == NULL )
@@ -4859,6 +5402,33 @@ void calendar_update ( VikWindow *vw )
 }
 #endif
 
+/**
+ * Update the display and title once the last of a list of files has been loaded
+ */
+static void open_files_complete ( VikWindow *vw, VikAggregateLayer *agg, const gchar *filename )
+{
+  vik_aggregate_layer_file_load_complete ( agg );
+  // Draw even if the last load unsuccessful, as may have successful loads in a list of files
+  draw_update ( vw );
+  vik_layers_panel_calendar_update ( vw->viking_vlp );
+
+  // For other file types and only for the very first loaded file (e.g. the common/simple use case),
+  //  put in the filename in the title but inside '[]' to distinguish between project files
+  // Thus for example, useful when running multiple Viking instances to tell them apart
+  if ( !vw->filename ) {
+    if ( vw->number_loaded == 1 ) {
+      gchar *title = g_strdup_printf ( "[%s] - Viking", a_file_basename(filename) );
+      gtk_window_set_title ( GTK_WINDOW(vw), title );
+      g_free ( title );
+    } else {
+      if ( vw->modified )
+        set_modified_title ( vw );
+      else
+        window_set_filename ( vw, NULL );
+    }
+  }
+}
+
 /**
  * @first: Indicates the first file in a possible list of files to be loaded
  * @last:  Indicates the last file in a possible list of files to be loaded
@@ -4946,8 +5516,12 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
       restore_original_filename = TRUE; // NB Will actually get inverted by the 'success' component below
       GtkWidget *mode_button;
       /* Update UI */
-      if ( change_filename )
+      if ( change_filename ) {
         window_set_filename ( vw, filename );
+        a_autosave_set_changed ( vik_layers_panel_get_top_layer(vw->viking_vlp), FALSE );
+        if ( a_autosave_journal_exists ( vw->autosave_journal ) )
+          window_autosave_recover ( vw, vw->autosave_journal, a_file_basename(filename) );
+      }
       mode_button = vik_window_get_drawmode_button ( vw, vik_viewport_get_drawmode ( vw->viking_vvp ) );
       vw->only_updating_coord_mode_ui = TRUE; /* if we don't set this, it will change the coord to UTM if we click Lat/Lon. I don't know why. */
       gtk_check_menu_item_set_active ( GTK_CHECK_MENU_ITEM(mode_button), TRUE );
@@ -4995,32 +5569,260 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
     window_set_filename ( vw, original_filename );
   g_free ( original_filename );
 
-  if ( last ) {
-    vik_aggregate_layer_file_load_complete ( agg );
-    // Draw even if the last load unsuccessful, as may have successful loads in a list of files
-    draw_update ( vw );
-    vik_layers_panel_calendar_update ( vw->viking_vlp );
-
-    // For other file types and only for the very first loaded file (e.g. the common/simple use case),
-    //  put in the filename in the title but inside '[]' to distinguish between project files
-    // Thus for example, useful when running multiple Viking instances to tell them apart
-    if ( !vw->filename ) {
-      if ( vw->number_loaded == 1 ) {
-        gchar *title = g_strdup_printf ( "[%s] - Viking", a_file_basename(filename) );
-        gtk_window_set_title ( GTK_WINDOW(vw), title );
-        g_free ( title );
-      } else {
-        if ( vw->modified )
-          set_modified_title ( vw );
-        else
-          window_set_filename ( vw, NULL );
-      }
-    }
-  }
+  if ( last )
+    open_files_complete ( vw, agg, filename );
   // Always clear cursor (e.g. incase first & last loads are on different VikWindows)
   vik_window_clear_busy_cursor ( vw );
 }
 
+/*
+ * Opening several GPX or FIT files at once
+ *
+ * The files are read concurrently in background threads into new (not yet attached) layers,
+ *  which are then added to the layers panel from the main thread in the order given
+ */
+typedef struct {
+  VikWindow *vw;           // NULL if the window has been closed meanwhile
+  gulong destroy_handler;
+  VikAggregateLayer *agg;
+  guint num;
+  gchar **files;
+  gboolean *fit;           // Otherwise GPX
+  VikTrwLayer **layers;
+  VikLoadType_t *results;
+  gboolean *done;
+  guint next;              // The next file to be attached
+  guint failures;
+  guint first_failure;
+  gboolean device_sync;    // Remember the files loaded, see a_device_sync_remember()
+  GSList *loaded;
+} WindowImport;
+
+typedef struct {
+  WindowImport *wi;
+  guint index;
+} WindowImportJob;
+
+static void window_import_destroyed ( VikWindow *vw, WindowImport *wi )
+{
+  wi->vw = NULL;
+}
+
+static void window_import_free ( WindowImport *wi )
+{
+  if ( wi->vw )
+    g_signal_handler_disconnect ( wi->vw, wi->destroy_handler );
+  for ( guint ii = 0; ii < wi->num; ii++ )
+    if ( wi->layers[ii] )
+      g_object_unref ( wi->layers[ii] );
+  g_object_unref ( wi->agg );
+  g_strfreev ( wi->files );
+  g_free ( wi->fit );
+  g_free ( wi->layers );
+  g_free ( wi->results );
+  g_free ( wi->done );
+  g_slist_free ( wi->loaded );
+  g_free ( wi );
+}
+
+/**
+ * Same handling of the layer as a_file_load() does for a GPX or FIT file,
+ *  and of the result as vik_window_open_file() does
+ */
+static void window_import_attach ( WindowImport *wi, guint ii )
+{
+  VikWindow *vw = wi->vw;
+  VikTrwLayer *vtl = wi->layers[ii];
+  wi->layers[ii] = NULL;
+  VikLoadType_t result = wi->results[ii];
+
+  // Unlike GPX, nothing is kept from a FIT file that could not be fully read
+  if ( !vw || result == LOAD_TYPE_READ_FAILURE || result == LOAD_TYPE_FIT_FAILURE ) {
+    g_object_unref ( vtl );
+    if ( vw ) {
+      g_warning ( "%s: could not open %s", __FUNCTION__, wi->files[ii] );
+      if ( !wi->failures++ )
+        wi->first_failure = ii;
+    }
+    return;
+  }
+
+  // Icons are not available to the background threads
+  vik_trw_layer_reset_waypoints ( vtl );
+  vik_layer_post_read ( VIK_LAYER(vtl), vw->viking_vvp, TRUE );
+  vik_aggregate_layer_add_layer ( wi->agg, VIK_LAYER(vtl), FALSE );
+  vik_trw_layer_auto_set_view ( vtl, vw->viking_vvp );
+
+  if ( result == LOAD_TYPE_GPX_FAILURE || result == LOAD_TYPE_GPX_WARNING ) {
+    if ( !wi->failures++ )
+      wi->first_failure = ii;
+  }
+  if ( result != LOAD_TYPE_GPX_FAILURE ) {
+    vw->number_loaded++;
+    if ( wi->device_sync )
+      wi->loaded = g_slist_prepend ( wi->loaded, wi->files[ii] );
+    else
+      update_recently_used_document ( vw, wi->files[ii] );
+  }
+}
+
+static gboolean window_import_job_done ( WindowImportJob *job )
+{
+  WindowImport *wi = job->wi;
+  wi->done[job->index] = TRUE;
+  g_free ( job );
+
+  // Keep the original order, so wait for any earlier files
+  while ( wi->next < wi->num && wi->done[wi->next] )
+    window_import_attach ( wi, wi->next++ );
+
+  if ( wi->next < wi->num ) {
+    if ( wi->vw ) {
+      gchar *msg = g_strdup_printf ( _("Loaded %d of %d files"), wi->next, wi->num );
+      vik_statusbar_set_message ( wi->vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+      g_free ( msg );
+    }
+    return FALSE;
+  }
+
+  VikWindow *vw = wi->vw;
+  if ( vw ) {
+    vw->loaded_type = wi->results[wi->num-1];
+    open_files_complete ( vw, wi->agg, wi->files[wi->num-1] );
+    a_device_sync_remember ( wi->loaded );
+    vik_window_clear_busy_cursor ( vw );
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, "" );
+    // Report problems once rather than a dialog per file
+    if ( wi->failures == 1 ) {
+      if ( wi->fit[wi->first_failure] )
+        a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load FIT file %s"), wi->files[wi->first_failure] );
+      else
+        a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load or malformed GPX file %s"), wi->files[wi->first_failure] );
+    }
+    else if ( wi->failures > 1 ) {
+      gchar *msg = g_strdup_printf ( _("%d files could not be loaded or were malformed, the first being %s"),
+                                     wi->failures, wi->files[wi->first_failure] );
+      a_dialog_error_msg ( GTK_WINDOW(vw), msg );
+      g_free ( msg );
+    }
+  }
+  window_import_free ( wi );
+  return FALSE;
+}
+
+static void window_import_thread ( WindowImportJob *job, gpointer threaddata )
+{
+  WindowImport *wi = job->wi;
+  if ( wi->fit[job->index] )
+    wi->results[job->index] = a_file_load_fit ( wi->layers[job->index], wi->files[job->index] );
+  else
+    wi->results[job->index] = a_file_load_gpx ( wi->layers[job->index], wi->files[job->index] );
+}
+
+/**
+ * NB Called from the worker thread (even if the job was cancelled)
+ */
+static void window_import_job_free ( WindowImportJob *job )
+{
+  gdk_threads_add_idle ( (GSourceFunc)window_import_job_done, job );
+}
+
+/**
+ * open_files_import:
+ *
+ * Returns TRUE if the files are being loaded concurrently
+ *  otherwise FALSE, and they should be opened one by one
+ *
+ * The list of files is not modified
+ */
+static void window_import_start ( VikWindow *vw, GSList *files, gboolean *fit, gboolean device_sync );
+
+static gboolean open_files_import ( VikWindow *vw, GSList *files, gboolean new_layer, gboolean external )
+{
+  guint num = g_slist_length ( files );
+  if ( num < 2 || !new_layer || external || a_vik_get_open_files_in_selected_layer() )
+    return FALSE;
+  gboolean *fit = g_new0 ( gboolean, num );
+  guint ii = 0;
+  for ( GSList *cur = files; cur; cur = cur->next, ii++ ) {
+    if ( a_file_load_can_read_gpx_only ( cur->data ) )
+      continue;
+    if ( !(fit[ii] = a_file_load_can_read_fit_only ( cur->data )) ) {
+      g_free ( fit );
+      return FALSE;
+    }
+  }
+
+  window_import_start ( vw, files, fit, FALSE );
+  return TRUE;
+}
+
+/**
+ * Load the files concurrently into new layers
+ * Takes ownership of @fit, which says which of the files are FIT (otherwise GPX)
+ */
+static void window_import_start ( VikWindow *vw, GSList *files, gboolean *fit, gboolean device_sync )
+{
+  guint num = g_slist_length ( files );
+  vik_window_set_busy_cursor ( vw );
+
+  WindowImport *wi = g_malloc0 ( sizeof(WindowImport) );
+  wi->vw = vw;
+  wi->device_sync = device_sync;
+  wi->destroy_handler = g_signal_connect ( G_OBJECT(vw), "destroy", G_CALLBACK(window_import_destroyed), wi );
+  wi->agg = g_object_ref ( vik_layers_panel_get_top_layer(vw->viking_vlp) );
+  wi->num = num;
+  wi->files = g_new0 ( gchar*, num+1 );
+  wi->fit = fit;
+  wi->layers = g_new0 ( VikTrwLayer*, num );
+  wi->results = g_new ( VikLoadType_t, num );
+  wi->done = g_new0 ( gboolean, num );
+
+  guint ii = 0;
+  for ( GSList *cur = files; cur; cur = cur->next, ii++ ) {
+    wi->files[ii] = g_strdup ( cur->data );
+    // Layer creation involves GTK, so is done here
+    wi->layers[ii] = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vw->viking_vvp, FALSE ));
+    vik_layer_rename ( VIK_LAYER(wi->layers[ii]), a_file_basename ( wi->files[ii] ) );
+    // Until read
+    wi->results[ii] = LOAD_TYPE_READ_FAILURE;
+  }
+
+  for ( ii = 0; ii < num; ii++ ) {
+    WindowImportJob *job = g_malloc ( sizeof(WindowImportJob) );
+    job->wi = wi;
+    job->index = ii;
+    gchar *msg = g_strdup_printf ( _("Loading %s"), a_file_basename ( wi->files[ii] ) );
+    a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_NORMAL,
+                                        GTK_WINDOW(vw), msg,
+                                        (vik_thr_func) window_import_thread,
+                                        job,
+                                        (vik_thr_free_func) window_import_job_free,
+                                        NULL,
+                                        1 );
+    g_free ( msg );
+  }
+}
+
+/**
+ * vik_window_open_files:
+ * @files: List of filenames, which is not modified
+ *
+ * Open the files as new layers in this window,
+ *  reading them concurrently when they are all GPX or FIT files
+ */
+void vik_window_open_files ( VikWindow *vw, GSList *files, gboolean external )
+{
+  if ( open_files_import ( vw, files, TRUE, external ) )
+    return;
+  guint file_num = 0;
+  guint num_files = g_slist_length ( files );
+  for ( GSList *cur_file = files; cur_file; cur_file = cur_file->next ) {
+    file_num++;
+    vik_window_open_file ( vw, cur_file->data, FALSE, (file_num==1), (file_num==num_files), TRUE, external );
+  }
+}
+
 static void load_file ( GtkAction *a, VikWindow *vw )
 {
   GSList *files = NULL;
@@ -5050,6 +5852,9 @@ static void load_file ( GtkAction *a, VikWindow *vw )
       open_window ( vw, files, external );
       // NB: GSList & contents of 'files' are freed by open_window()
     }
+    else if ( open_files_import ( vw, files, !append, external ) ) {
+      g_slist_free_full ( files, g_free );
+    }
     else {
       guint file_num = 0;
       guint num_files = g_slist_length(files);
@@ -5109,6 +5914,7 @@ static gboolean window_save_file_as ( VikWindow *vw, VikAggregateLayer *agg, gbo
   gtk_file_filter_set_name( filter, _("Viking") );
   gtk_file_filter_add_pattern ( filter, "*.vik" );
   gtk_file_filter_add_pattern ( filter, "*.viking" );
+  gtk_file_filter_add_pattern ( filter, "*"VIK_BINARY_FILE_EXT );
   gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
   // Default to a Viking file
   gtk_file_chooser_set_filter (GTK_FILE_CHOOSER(dialog), filter);
@@ -5123,7 +5929,7 @@ static gboolean window_save_file_as ( VikWindow *vw, VikAggregateLayer *agg, gbo
   else
     auto_save_name = VIK_LAYER(agg)->name;
 
-  if ( ! a_file_check_ext ( auto_save_name, ".vik" ) )
+  if ( ! a_file_check_ext ( auto_save_name, ".vik" ) && ! a_file_check_ext ( auto_save_name, VIK_BINARY_FILE_EXT ) )
     auto_save_name = g_strconcat ( auto_save_name, ".vik", NULL );
 
   gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER(dialog), auto_save_name);
@@ -5168,6 +5974,11 @@ static gboolean save_file_as ( GtkAction *a, VikWindow *vw )
   if ( a_file_save(agg, vw->viking_vvp, filename) )
   {
     update_recently_used_document ( vw, filename );
+    // Everything is in the file now, so the journal is no longer needed
+    if ( agg == vik_layers_panel_get_top_layer(vw->viking_vlp) && g_strcmp0 ( filename, vw->filename ) == 0 ) {
+      a_autosave_set_changed ( agg, FALSE );
+      a_autosave_discard ( vw->autosave_journal );
+    }
   }
   else
   {
@@ -5198,14 +6009,21 @@ static gboolean save_file ( GtkAction *a, VikWindow *vw )
  *
  * Export all TRW Layers in the list to individual files in the specified directory
  *
+ * @visible_area: Only export what is in view - within the viewport and any time filter
+ *
  * Returns: %TRUE on success
  */
-static gboolean export_to ( VikWindow *vw, GList *gl, VikFileType_t vft, const gchar *dir, const gchar *extension )
+static gboolean export_to ( VikWindow *vw, GList *gl, VikFileType_t vft, const gchar *dir, const gchar *extension, gboolean visible_area )
 {
   gboolean success = TRUE;
 
   gint export_count = 0;
 
+  LatLonBBox bbox = vik_viewport_get_bbox ( vw->viking_vvp );
+  gdouble start = NAN, end = NAN;
+  if ( visible_area && !vik_viewport_get_time_filter ( vw->viking_vvp, &start, &end ) )
+    start = NAN;
+
   vik_window_set_busy_cursor ( vw );
 
   while ( gl ) {
@@ -5233,7 +6051,11 @@ static gboolean export_to ( VikWindow *vw, GList *gl, VikFileType_t vft, const g
 
     // NB: We allow exporting empty layers
     if ( safe ) {
-      gboolean this_success = a_file_export ( VIK_TRW_LAYER(gl->data), fn, vft, NULL, TRUE );
+      gboolean this_success;
+      if ( visible_area )
+        this_success = a_file_export_area ( VIK_TRW_LAYER(gl->data), fn, vft, &bbox, start, end, TRUE );
+      else
+        this_success = a_file_export ( VIK_TRW_LAYER(gl->data), fn, vft, NULL, TRUE );
 
       // Show some progress
       if ( this_success ) {
@@ -5262,7 +6084,7 @@ static gboolean export_to ( VikWindow *vw, GList *gl, VikFileType_t vft, const g
   return success;
 }
 
-static void export_to_common ( VikWindow *vw, VikFileType_t vft, const gchar *extension )
+static void export_to_common ( VikWindow *vw, VikFileType_t vft, const gchar *extension, gboolean visible_area )
 {
   GList *gl = vik_layers_panel_get_all_layers_of_type ( vw->viking_vlp, VIK_LAYER_TRW, TRUE );
 
@@ -5289,7 +6111,7 @@ static void export_to_common ( VikWindow *vw, VikFileType_t vft, const gchar *ex
     gchar *dir = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
     gtk_widget_destroy ( dialog );
     if ( dir ) {
-      if ( !export_to ( vw, gl, vft, dir, extension ) )
+      if ( !export_to ( vw, gl, vft, dir, extension, visible_area ) )
         a_dialog_error_msg ( GTK_WINDOW(vw),_("Could not convert all files") );
       g_free ( dir );
     }
@@ -5302,7 +6124,12 @@ static void export_to_common ( VikWindow *vw, VikFileType_t vft, const gchar *ex
 
 static void export_to_gpx ( GtkAction *a, VikWindow *vw )
 {
-  export_to_common ( vw, FILE_TYPE_GPX, ".gpx" );
+  export_to_common ( vw, FILE_TYPE_GPX, ".gpx", FALSE );
+}
+
+static void export_visible_to_gpx ( GtkAction *a, VikWindow *vw )
+{
+  export_to_common ( vw, FILE_TYPE_GPX, ".gpx", TRUE );
 }
 
 static void export_to_single_gpx ( GtkAction *a, VikWindow *vw )
@@ -5313,7 +6140,12 @@ static void export_to_single_gpx ( GtkAction *a, VikWindow *vw )
 
 static void export_to_kml ( GtkAction *a, VikWindow *vw )
 {
-  export_to_common ( vw, FILE_TYPE_KML, ".kml" );
+  export_to_common ( vw, FILE_TYPE_KML, ".kml", FALSE );
+}
+
+static void export_visible_to_kml ( GtkAction *a, VikWindow *vw )
+{
+  export_to_common ( vw, FILE_TYPE_KML, ".kml", TRUE );
 }
 
 static void file_properties_cb ( GtkAction *a, VikWindow *vw )
@@ -5409,6 +6241,67 @@ static void acquire_from_url ( GtkAction *a, VikWindow *vw )
   my_acquire ( vw, &vik_datasource_url_interface );
 }
 
+#define VIK_SETTINGS_DEVICE_SYNC_FOLDER "device_sync_folder"
+
+/**
+ * Import the FIT files of a USB mass storage device not imported before,
+ *  each into a new layer read concurrently with the native FIT decoder
+ */
+static void acquire_from_device ( GtkAction *a, VikWindow *vw )
+{
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Select the Activity Folder of the Device"),
+                                                    GTK_WINDOW(vw),
+                                                    GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+                                                    GTK_STOCK_CANCEL,
+                                                    GTK_RESPONSE_REJECT,
+                                                    GTK_STOCK_OK,
+                                                    GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gtk_window_set_transient_for ( GTK_WINDOW(dialog), GTK_WINDOW(vw) );
+  gtk_window_set_destroy_with_parent ( GTK_WINDOW(dialog), TRUE );
+  gtk_window_set_modal ( GTK_WINDOW(dialog), TRUE );
+
+  gchar *folder = NULL;
+  if ( a_settings_get_string ( VIK_SETTINGS_DEVICE_SYNC_FOLDER, &folder ) ) {
+    gtk_file_chooser_set_filename ( GTK_FILE_CHOOSER(dialog), folder );
+    g_free ( folder );
+    folder = NULL;
+  }
+
+  gtk_widget_show_all ( dialog );
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+    folder = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+  gtk_widget_destroy ( dialog );
+  if ( !folder )
+    return;
+  a_settings_set_string ( VIK_SETTINGS_DEVICE_SYNC_FOLDER, folder );
+
+  // Only what the native decoder can read
+  GSList *files = NULL;
+  GSList *scanned = a_device_sync_scan ( folder );
+  for ( GSList *iter = scanned; iter; iter = iter->next ) {
+    if ( a_file_load_can_read_fit_only ( iter->data ) )
+      files = g_slist_prepend ( files, iter->data );
+    else
+      g_free ( iter->data );
+  }
+  g_slist_free ( scanned );
+  files = g_slist_reverse ( files );
+
+  guint num = g_slist_length ( files );
+  if ( num ) {
+    gboolean *fit = g_new ( gboolean, num );
+    for ( guint ii = 0; ii < num; ii++ )
+      fit[ii] = TRUE;
+    window_import_start ( vw, files, fit, TRUE );
+  }
+  else
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, _("No new files on the device") );
+
+  g_slist_free_full ( files, g_free );
+  g_free ( folder );
+}
+
 #define GPSBABEL_URL "https://www.gpsbabel.org"
 static void goto_gpsbabel_website ( GtkAction *a, VikWindow *vw )
 {
@@ -5438,6 +6331,7 @@ static void goto_address( GtkAction *a, VikWindow *vw)
 static void mapcache_flush_cb ( GtkAction *a, VikWindow *vw )
 {
   a_mapcache_flush();
+  metatile_cache_flush();
 }
 
 static void menu_copy_centre_cb ( GtkAction *a, VikWindow *vw )
@@ -5638,6 +6532,315 @@ static gboolean save_file_and_exit ( GtkAction *a, VikWindow *vw )
     return(FALSE);
 }
 
+static void performance_cb ( GtkAction *a, VikWindow *vw )
+{
+  a_perfstats_show_window ( GTK_WINDOW(vw) );
+}
+
+// Once the time filter slider has stopped moving for this long, the aggregate layers recalculate
+#define TIME_FILTER_AGGREGATE_DELAY_MS 500
+
+static const gdouble time_filter_periods[] = { 86400.0, 7*86400.0, 30*86400.0, 365.25*86400.0 };
+static const gchar *time_filter_period_names[] = { N_("Day"), N_("Week"), N_("30 Days"), N_("Year") };
+
+typedef struct {
+  VikWindow *vw;
+  GtkWidget *check;
+  GtkWidget *combo;
+  GtkWidget *scale;
+  GtkWidget *label;
+} TimeFilterWidgets;
+
+static gboolean time_filter_aggregate_timeout ( VikWindow *vw )
+{
+  VikAggregateLayer *top = vik_layers_panel_get_top_layer ( vw->viking_vlp );
+  if ( !vik_aggregate_layer_time_filter_changed ( top ) )
+    // Try again once the current calculations have finished
+    return TRUE;
+  vw->time_filter_id = 0;
+  return FALSE;
+}
+
+static gchar *time_filter_format_value ( GtkScale *scale, gdouble value, gpointer user_data )
+{
+  time_t tt = (time_t)value;
+  return vu_get_time_string ( &tt, "%x", NULL, NULL );
+}
+
+/**
+ * Apply the dialog settings to the viewport
+ *  drawing straight away, but leaving the (slower) aggregate layer calculations until the settings stop changing
+ */
+static void time_filter_changed ( TimeFilterWidgets *tfw )
+{
+  VikWindow *vw = tfw->vw;
+  gboolean active = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(tfw->check) );
+  gint period = gtk_combo_box_get_active ( GTK_COMBO_BOX(tfw->combo) );
+  if ( period >= 0 && period < G_N_ELEMENTS(time_filter_periods) )
+    vw->time_filter_period = period;
+  gdouble end = gtk_range_get_value ( GTK_RANGE(tfw->scale) );
+  gdouble start = end - time_filter_periods[vw->time_filter_period];
+
+  gtk_widget_set_sensitive ( tfw->combo, active );
+  gtk_widget_set_sensitive ( tfw->scale, active );
+  if ( active ) {
+    time_t ts = (time_t)start, te = (time_t)end;
+    gchar *str_start = vu_get_time_string ( &ts, "%x %X", NULL, NULL );
+    gchar *str_end = vu_get_time_string ( &te, "%x %X", NULL, NULL );
+    gchar *msg = g_strdup_printf ( _("Showing tracks from %s to %s"), str_start, str_end );
+    gtk_label_set_text ( GTK_LABEL(tfw->label), msg );
+    g_free ( msg );
+    g_free ( str_start );
+    g_free ( str_end );
+  }
+  else
+    gtk_label_set_text ( GTK_LABEL(tfw->label), _("Showing all tracks") );
+
+  gdouble old_start, old_end;
+  gboolean was_active = vik_viewport_get_time_filter ( vw->viking_vvp, &old_start, &old_end );
+  if ( was_active == active && ( !active || ( old_start == start && old_end == end ) ) )
+    return;
+
+  vik_viewport_set_time_filter ( vw->viking_vvp, active, start, end );
+  draw_update ( vw );
+
+  if ( vw->time_filter_id )
+    (void)g_source_remove ( vw->time_filter_id );
+  vw->time_filter_id = g_timeout_add ( TIME_FILTER_AGGREGATE_DELAY_MS, (GSourceFunc)time_filter_aggregate_timeout, vw );
+}
+
+// Aiming for a smooth 60 frames per second
+#define REPLAY_FRAME_MS 16
+
+static const gdouble replay_speeds[] = { 10.0, 60.0, 600.0, 3600.0, 86400.0 };
+static const gchar *replay_speed_names[] = { N_("10 x"), N_("1 minute per second"), N_("10 minutes per second"),
+                                             N_("1 hour per second"), N_("1 day per second") };
+#define REPLAY_DEFAULT_SPEED 1
+
+typedef struct {
+  VikWindow *vw;
+  GtkWidget *play;
+  GtkWidget *speed;
+  GtkWidget *scale;
+  GtkWidget *label;
+  guint tick_id;
+  gint64 tick_last;      // Monotonic time of the last step
+  gboolean moving_scale; // Setting the slider from playing rather than it being moved
+} ReplayWidgets;
+
+static void replay_show_time ( ReplayWidgets *rw )
+{
+  time_t tt = (time_t)vik_replay_get_time ( rw->vw->replay );
+  gchar *str = vu_get_time_string ( &tt, "%c", NULL, NULL );
+  gtk_label_set_text ( GTK_LABEL(rw->label), str );
+  g_free ( str );
+}
+
+/**
+ * Show the replay at the time, drawing everything again only when needed
+ */
+static void replay_move ( ReplayWidgets *rw, gdouble time )
+{
+  VikWindow *vw = rw->vw;
+  if ( vik_replay_set_time ( vw->replay, time ) )
+    vik_viewport_sync ( vw->viking_vvp, NULL );
+  else
+    draw_update ( vw );
+  replay_show_time ( rw );
+}
+
+static gboolean replay_tick ( ReplayWidgets *rw )
+{
+  VikReplay *rp = rw->vw->replay;
+  gint64 now = g_get_monotonic_time ();
+  gint speed = gtk_combo_box_get_active ( GTK_COMBO_BOX(rw->speed) );
+  gdouble factor = replay_speeds[( speed >= 0 && speed < G_N_ELEMENTS(replay_speeds) ) ? speed : REPLAY_DEFAULT_SPEED];
+  gdouble time = vik_replay_get_time ( rp ) + factor * ( now - rw->tick_last ) / G_USEC_PER_SEC;
+  rw->tick_last = now;
+
+  gdouble first, last;
+  vik_replay_get_range ( rp, &first, &last );
+  replay_move ( rw, time );
+  rw->moving_scale = TRUE;
+  gtk_range_set_value ( GTK_RANGE(rw->scale), vik_replay_get_time(rp) );
+  rw->moving_scale = FALSE;
+
+  if ( time >= last ) {
+    // Reached the end
+    rw->tick_id = 0;
+    gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(rw->play), FALSE );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void replay_play_toggled ( ReplayWidgets *rw )
+{
+  gboolean play = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(rw->play) );
+  gtk_button_set_label ( GTK_BUTTON(rw->play), play ? GTK_STOCK_MEDIA_PAUSE : GTK_STOCK_MEDIA_PLAY );
+  if ( play && !rw->tick_id ) {
+    gdouble first, last;
+    vik_replay_get_range ( rw->vw->replay, &first, &last );
+    // Start again when at the end
+    if ( vik_replay_get_time(rw->vw->replay) >= last )
+      replay_move ( rw, first );
+    rw->tick_last = g_get_monotonic_time ();
+    rw->tick_id = g_timeout_add ( REPLAY_FRAME_MS, (GSourceFunc)replay_tick, rw );
+  }
+  else if ( !play && rw->tick_id ) {
+    (void)g_source_remove ( rw->tick_id );
+    rw->tick_id = 0;
+  }
+}
+
+static void replay_scale_changed ( ReplayWidgets *rw )
+{
+  if ( !rw->moving_scale )
+    replay_move ( rw, gtk_range_get_value(GTK_RANGE(rw->scale)) );
+}
+
+/**
+ * Play back the visible tracks over time
+ */
+static void replay_cb ( GtkAction *a, VikWindow *vw )
+{
+  if ( vw->replay )
+    return;
+
+  GList *tracks = NULL;
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vw->viking_vlp), NULL, VIK_LAYER_TRW, FALSE );
+  for ( GList *iter = layers; iter; iter = iter->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+    if ( vik_trw_layer_get_tracks_visibility ( vtl ) )
+      // NB Getting the tracks also ensures they are loaded and unpacked
+      tracks = g_list_concat ( tracks, g_hash_table_get_values ( vik_trw_layer_get_tracks(vtl) ) );
+  }
+  g_list_free ( layers );
+  vw->replay = vik_replay_new ( vw->viking_vvp, tracks );
+  g_list_free ( tracks );
+  if ( !vw->replay ) {
+    a_dialog_info_msg ( GTK_WINDOW(vw), _("No visible tracks with timestamps.") );
+    return;
+  }
+
+  // The replay draws the tracks as it goes, so hide them otherwise
+  gdouble filter_start = NAN, filter_end = NAN;
+  gboolean filter = vik_viewport_get_time_filter ( vw->viking_vvp, &filter_start, &filter_end );
+  gdouble first, last;
+  vik_replay_get_range ( vw->replay, &first, &last );
+  vik_viewport_set_time_filter ( vw->viking_vvp, TRUE, first - 1.0, first - 1.0 );
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Replay"), GTK_WINDOW(vw), 0,
+                                                    GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                                    NULL );
+  ReplayWidgets rw = { 0 };
+  rw.vw = vw;
+  rw.play = gtk_toggle_button_new_with_label ( GTK_STOCK_MEDIA_PLAY );
+  gtk_button_set_use_stock ( GTK_BUTTON(rw.play), TRUE );
+  rw.speed = vik_combo_box_text_new ();
+  for ( guint ii = 0; ii < G_N_ELEMENTS(replay_speed_names); ii++ )
+    vik_combo_box_text_append ( rw.speed, _(replay_speed_names[ii]) );
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(rw.speed), REPLAY_DEFAULT_SPEED );
+  rw.scale = gtk_hscale_new_with_range ( first, MAX(last, first + 1.0), 1.0 );
+  gtk_scale_set_draw_value ( GTK_SCALE(rw.scale), FALSE );
+  rw.label = gtk_label_new ( NULL );
+
+  GtkWidget *hbox = gtk_hbox_new ( FALSE, 5 );
+  gtk_box_pack_start ( GTK_BOX(hbox), rw.play, FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(hbox), gtk_label_new(_("Speed:")), FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(hbox), rw.speed, FALSE, FALSE, 0 );
+
+  GtkBox *vbox = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  gtk_box_pack_start ( vbox, hbox, FALSE, FALSE, 5 );
+  gtk_box_pack_start ( vbox, rw.scale, FALSE, FALSE, 5 );
+  gtk_box_pack_start ( vbox, rw.label, FALSE, FALSE, 5 );
+
+  g_signal_connect_swapped ( rw.play, "toggled", G_CALLBACK(replay_play_toggled), &rw );
+  g_signal_connect_swapped ( rw.scale, "value-changed", G_CALLBACK(replay_scale_changed), &rw );
+
+  replay_show_time ( &rw );
+  draw_update ( vw );
+
+  gtk_window_set_default_size ( GTK_WINDOW(dialog), 500, -1 );
+  gtk_widget_show_all ( dialog );
+  (void)gtk_dialog_run ( GTK_DIALOG(dialog) );
+  if ( rw.tick_id )
+    (void)g_source_remove ( rw.tick_id );
+  gtk_widget_destroy ( dialog );
+
+  vik_replay_free ( vw->replay );
+  vw->replay = NULL;
+  vik_viewport_set_time_filter ( vw->viking_vvp, filter, filter_start, filter_end );
+  draw_update ( vw );
+}
+
+/**
+ * Limit the tracks shown to those within a period, which can be slid along the times of all the tracks
+ */
+static void time_filter_cb ( GtkAction *a, VikWindow *vw )
+{
+  // The times of all the tracks
+  gdouble first = NAN, last = NAN;
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vw->viking_vlp), NULL, VIK_LAYER_TRW, TRUE );
+  for ( GList *iter = layers; iter; iter = iter->next ) {
+    gdouble lfirst, llast;
+    if ( vik_trw_layer_get_time_range ( VIK_TRW_LAYER(iter->data), &lfirst, &llast ) ) {
+      first = isnan(first) ? lfirst : MIN ( first, lfirst );
+      last = isnan(last) ? llast : MAX ( last, llast );
+    }
+  }
+  g_list_free ( layers );
+
+  if ( isnan(first) ) {
+    a_dialog_info_msg ( GTK_WINDOW(vw), _("No tracks with timestamps.") );
+    return;
+  }
+  // Allow a range to slide (which gtk_range_set_value() needs)
+  if ( last - first < 1.0 )
+    last = first + 1.0;
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Time Filter"), GTK_WINDOW(vw), 0,
+                                                    GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                                    NULL );
+  TimeFilterWidgets tfw;
+  tfw.vw = vw;
+  tfw.check = gtk_check_button_new_with_mnemonic ( _("_Only show tracks within the period") );
+  tfw.combo = vik_combo_box_text_new ();
+  for ( guint ii = 0; ii < G_N_ELEMENTS(time_filter_period_names); ii++ )
+    vik_combo_box_text_append ( tfw.combo, _(time_filter_period_names[ii]) );
+  tfw.scale = gtk_hscale_new_with_range ( first, last, 3600.0 );
+  tfw.label = gtk_label_new ( NULL );
+
+  gdouble start, end = last;
+  gboolean active = vik_viewport_get_time_filter ( vw->viking_vvp, &start, &end );
+  gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(tfw.check), active );
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(tfw.combo), vw->time_filter_period );
+  gtk_range_set_value ( GTK_RANGE(tfw.scale), CLAMP(end, first, last) );
+  // The period ends at the slider position
+  gtk_scale_set_value_pos ( GTK_SCALE(tfw.scale), GTK_POS_TOP );
+
+  GtkWidget *hbox = gtk_hbox_new ( FALSE, 5 );
+  gtk_box_pack_start ( GTK_BOX(hbox), gtk_label_new(_("Period:")), FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(hbox), tfw.combo, FALSE, FALSE, 0 );
+
+  GtkBox *vbox = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  gtk_box_pack_start ( vbox, tfw.check, FALSE, FALSE, 5 );
+  gtk_box_pack_start ( vbox, hbox, FALSE, FALSE, 5 );
+  gtk_box_pack_start ( vbox, tfw.scale, FALSE, FALSE, 5 );
+  gtk_box_pack_start ( vbox, tfw.label, FALSE, FALSE, 5 );
+
+  time_filter_changed ( &tfw );
+  g_signal_connect ( tfw.scale, "format-value", G_CALLBACK(time_filter_format_value), NULL );
+  g_signal_connect_swapped ( tfw.check, "toggled", G_CALLBACK(time_filter_changed), &tfw );
+  g_signal_connect_swapped ( tfw.combo, "changed", G_CALLBACK(time_filter_changed), &tfw );
+  g_signal_connect_swapped ( tfw.scale, "value-changed", G_CALLBACK(time_filter_changed), &tfw );
+
+  gtk_window_set_default_size ( GTK_WINDOW(dialog), 500, -1 );
+  gtk_widget_show_all ( dialog );
+  (void)gtk_dialog_run ( GTK_DIALOG(dialog) );
+  gtk_widget_destroy ( dialog );
+}
+
 static void zoom_to_cb ( GtkAction *a, VikWindow *vw )
 {
   gdouble xmpp = vik_viewport_get_xmpp ( vw->viking_vvp ), ympp = vik_viewport_get_ympp ( vw->viking_vvp );
@@ -5649,6 +6852,79 @@ static void zoom_to_cb ( GtkAction *a, VikWindow *vw )
   }
 }
 
+#define SAVE_IMAGE_TILE_SIZE 2048
+#define SAVE_IMAGE_BAND_BYTES (64*1024*1024)
+
+/**
+ * Draw the image a tile at a time, assembling the tiles into bands of rows
+ *  that are streamed out to the PNG file (being compressed in the background),
+ *  so the image size is not limited by memory or the maximum pixmap size.
+ * As for save_image_dir() items across the tile boundaries may draw slightly differently
+ */
+static gboolean save_image_file_png_stream ( VikWindow *vw, const gchar *fn, guint w, guint h )
+{
+  VikCoord centre = *vik_viewport_get_center ( vw->viking_vvp );
+  guint tile_w = MIN ( w, SAVE_IMAGE_TILE_SIZE );
+  guint band_h = MIN ( h, CLAMP ( SAVE_IMAGE_BAND_BYTES / (4*w), 16, SAVE_IMAGE_TILE_SIZE ) );
+  PngStream *ps = NULL;
+  gboolean ok = TRUE;
+
+  for ( guint yy = 0; ok && yy < h; yy += band_h ) {
+    guint bh = MIN ( band_h, h - yy );
+    GdkPixbuf *band = NULL;
+    for ( guint xx = 0; ok && xx < w; xx += tile_w ) {
+      guint tw = MIN ( tile_w, w - xx );
+      vik_viewport_set_center_coord ( vw->viking_vvp, &centre, FALSE );
+      if ( vik_viewport_get_width ( vw->viking_vvp ) != tw || vik_viewport_get_height ( vw->viking_vvp ) != bh )
+        vik_viewport_configure_manually ( vw->viking_vvp, tw, bh );
+
+      // Move from the centre of the whole image to the centre of this tile
+      VikCoord coord;
+      vik_viewport_screen_to_coord ( vw->viking_vvp,
+                                     (gint)(xx + tw/2 + tw/2) - (gint)(w/2),
+                                     (gint)(yy + bh/2 + bh/2) - (gint)(h/2),
+                                     &coord );
+      vik_viewport_set_center_coord ( vw->viking_vvp, &coord, FALSE );
+      draw_redraw ( vw );
+
+      GdkPixbuf *tile = vik_viewport_get_pixbuf ( vw->viking_vvp, tw, bh );
+      if ( !tile ) {
+        g_warning ( "%s: Failed to generate internal pixmap size: %d x %d", __FUNCTION__, tw, bh );
+        ok = FALSE;
+        break;
+      }
+      if ( !band )
+        band = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(tile), 8, w, bh );
+      if ( band )
+        gdk_pixbuf_copy_area ( tile, 0, 0, tw, bh, band, xx, 0 );
+      else
+        ok = FALSE;
+      g_object_unref ( G_OBJECT(tile) );
+    }
+
+    if ( ok && !ps ) {
+      ps = png_stream_new ( fn, w, h, gdk_pixbuf_get_has_alpha(band) );
+      ok = ( ps != NULL );
+    }
+    if ( ok )
+      ok = png_stream_write ( ps, band );
+    if ( band )
+      g_object_unref ( G_OBJECT(band) );
+
+    gchar *msg = g_strdup_printf ( _("Generating image file... %d%%"), (gint)(100.0 * (yy+bh) / h) );
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+    g_free ( msg );
+    while ( gtk_events_pending() )
+      gtk_main_iteration ();
+  }
+
+  if ( ps )
+    ok = png_stream_close ( ps ) && ok;
+
+  vik_viewport_set_center_coord ( vw->viking_vvp, &centre, FALSE );
+  return ok;
+}
+
 static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, gboolean save_kmz )
 {
   /* more efficient way: stuff draws directly to pixbuf (fork viewport) */
@@ -5677,6 +6953,14 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
   vik_viewport_set_zoom ( vw->viking_vvp, zoom );
 
+  if ( save_as_png && !save_kmz && png_stream_available() ) {
+    if ( save_image_file_png_stream ( vw, fn, w, h ) )
+      gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Image file generated.") );
+    else
+      gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate image file.") );
+    goto cleanup;
+  }
+
   /* reset width and height: */
   vik_viewport_configure_manually ( vw->viking_vvp, w, h );
 
@@ -6011,11 +7295,13 @@ static void draw_to_image_file ( VikWindow *vw, img_generation_t img_gen )
 
   // only used for VW_GEN_DIRECTORY_OF_IMAGES
   GtkWidget *tiles_width_spin = NULL, *tiles_height_spin = NULL;
+  // Much bigger images can be streamed out
+  gdouble max_size = ( img_gen == VW_GEN_SINGLE_IMAGE && png_stream_available() ) ? 200000 : 50000;
 
   width_label = gtk_label_new ( _("Width (pixels):") );
-  width_spin = gtk_spin_button_new ( GTK_ADJUSTMENT(gtk_adjustment_new ( vw->draw_image_width, 10, 50000, 10, 100, 0 )), 10, 0 );
+  width_spin = gtk_spin_button_new ( GTK_ADJUSTMENT(gtk_adjustment_new ( vw->draw_image_width, 10, max_size, 10, 100, 0 )), 10, 0 );
   height_label = gtk_label_new ( _("Height (pixels):") );
-  height_spin = gtk_spin_button_new ( GTK_ADJUSTMENT(gtk_adjustment_new ( vw->draw_image_height, 10, 50000, 10, 100, 0 )), 10, 0 );
+  height_spin = gtk_spin_button_new ( GTK_ADJUSTMENT(gtk_adjustment_new ( vw->draw_image_height, 10, max_size, 10, 100, 0 )), 10, 0 );
 #ifdef WINDOWS
   GtkWidget *win_warning_label = gtk_label_new ( _("WARNING: USING LARGE IMAGES OVER 10000x10000\nMAY CRASH THE PROGRAM!") );
 #endif
@@ -6391,6 +7677,8 @@ static GtkActionEntry entries[] = {
   { "Export",    GTK_STOCK_CONVERT,      N_("_Export All"),               NULL,         N_("Export All TrackWaypoint Layers"),              (GCallback)NULL                  },
   { "ExportGPX", NULL,                   N_("_GPX..."),           	      NULL,         N_("Export as GPX"),                                (GCallback)export_to_gpx         },
   { "ExportSingleGPX", NULL,             N_("_Single GPX File..."),       NULL,         N_("Export to Single GPX File"),                    (GCallback)export_to_single_gpx  },
+  { "ExportVisible", GTK_STOCK_CONVERT,  N_("Export _Visible Area"),      NULL,         N_("Export what is in view from all TrackWaypoint Layers"), (GCallback)NULL        },
+  { "ExportVisibleGPX", NULL,            N_("_GPX..."),                   NULL,         N_("Export what is in view as GPX"),                (GCallback)export_visible_to_gpx },
   { "Acquire",   GTK_STOCK_GO_DOWN,      N_("A_cquire"),                  NULL,         NULL,                                               (GCallback)NULL },
   { "AcquireRouting",   NULL,             N_("_Directions..."),     NULL,         N_("Get driving directions"),           (GCallback)acquire_from_routing   },
 #ifdef VIK_CONFIG_OPENSTREETMAP
@@ -6404,6 +7692,7 @@ static GtkActionEntry entries[] = {
   { "AcquireGeotag", NULL,               N_("From Geotagged _Images..."), NULL,         N_("Create waypoints from geotagged images"),       (GCallback)acquire_from_geotag   },
 #endif
   { "AcquireURL", NULL,                  N_("From _URL..."),              NULL,         N_("Get a file from a URL"),                        (GCallback)acquire_from_url },
+  { "AcquireDevice", NULL,               N_("From _Device Folder..."),    NULL,         N_("Import new FIT files from a GPS device connected as USB storage"), (GCallback)acquire_from_device },
 #ifdef VIK_CONFIG_GEONAMES
   { "AcquireWikipedia", NULL,            N_("From _Wikipedia Waypoints"), NULL,         N_("Create waypoints from Wikipedia items in the current view"), (GCallback)acquire_from_wikipedia },
 #endif
@@ -6440,7 +7729,12 @@ static GtkActionEntry entries[] = {
   { "PanWest",   GTK_STOCK_GO_BACK,      N_("Pan _West"),                 "<control>Left",  N_("Pan West"),                                 (GCallback)draw_pan_cb },
   { "BGJobs",    GTK_STOCK_EXECUTE,      N_("Background _Jobs"),              NULL,         N_("Background Jobs"),                          (GCallback)a_background_show_window },
   { "Log",       GTK_STOCK_INFO,         N_("Log"),                           NULL,         N_("Logged messages"),                          (GCallback)a_logging_show_window },
+  { "Performance", NULL,                 N_("_Performance"),                  NULL,         N_("Performance counters and timings"),         (GCallback)performance_cb },
+  { "TimeFilter", NULL,                  N_("_Time Filter..."),               NULL,         N_("Only show the tracks recorded within a period"), (GCallback)time_filter_cb },
+  { "Replay",   NULL,                    N_("_Replay..."),                    NULL,         N_("Play back the visible tracks over time"),   (GCallback)replay_cb },
 
+  { "Undo",      GTK_STOCK_UNDO,         N_("_Undo"),                         NULL,         N_("Undo the last edit of the selected layer"), (GCallback)menu_undo_cb          },
+  { "Redo",      GTK_STOCK_REDO,         N_("_Redo"),                         NULL,         N_("Redo the last undone edit of the selected layer"), (GCallback)menu_redo_cb   },
   { "Cut",       GTK_STOCK_CUT,          N_("Cu_t"),                          NULL,         N_("Cut selected layer"),                       (GCallback)menu_cut_layer_cb     },
   { "Copy",      GTK_STOCK_COPY,         N_("_Copy"),                         NULL,         N_("Copy selected layer"),                      (GCallback)menu_copy_layer_cb    },
   { "Paste",     GTK_STOCK_PASTE,        N_("_Paste"),                        NULL,         N_("Paste layer into selected container layer or otherwise above selected layer"), (GCallback)menu_paste_layer_cb },
@@ -6475,6 +7769,7 @@ static GtkActionEntry debug_entries[] = {
 
 static GtkActionEntry entries_gpsbabel[] = {
   { "ExportKML", NULL,                   N_("_KML..."),           	      NULL,         N_("Export as KML"),                                (GCallback)export_to_kml },
+  { "ExportVisibleKML", NULL,            N_("_KML..."),                   NULL,         N_("Export what is in view as KML"),                (GCallback)export_visible_to_kml },
   { "AcquireGPS",   NULL,                N_("From _GPS..."),           	  NULL,         N_("Transfer data from a GPS device"),              (GCallback)acquire_from_gps      },
   { "AcquireGPSBabel", NULL,             N_("Import File With GPS_Babel..."), NULL,     N_("Import file via GPSBabel converter"),           (GCallback)acquire_from_file },
 };
@@ -6539,6 +7834,54 @@ static gpointer toggle_entries_toolbar_cb[] = {
 };
 
 #include "menu.xml.h"
+/**
+ * The menu entries depending on whether GPSBabel is available
+ */
+static void window_add_babel_ui ( VikWindow *window, GtkUIManager *uim, GtkActionGroup *action_group )
+{
+  if ( window->babel_ui_added )
+    return;
+  window->babel_ui_added = TRUE;
+
+  // Use this to see if GPSBabel is available:
+  if ( a_babel_available () ) {
+    // If going to add more entries then might be worth creating a menu_gpsbabel.xml.h file
+    if ( gtk_ui_manager_add_ui_from_string ( uim,
+         "<ui>" \
+         "<menubar name='MainMenu'>" \
+         "<menu action='File'><menu action='Export'><menuitem action='ExportKML'/></menu></menu>" \
+         "<menu action='File'><menu action='ExportVisible'><menuitem action='ExportVisibleKML'/></menu></menu>" \
+         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPS'/></menu></menu>" \
+         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPSBabel'/></menu></menu>" \
+         "</menubar>" \
+         "</ui>",
+         -1, NULL ) )
+      gtk_action_group_add_actions ( action_group, entries_gpsbabel, G_N_ELEMENTS (entries_gpsbabel), window );
+  } else {
+    // Stick in a link to GPSBabel website
+    if ( gtk_ui_manager_add_ui_from_string ( uim,
+         "<ui><menubar name='MainMenu'><menu action='Help'><separator/><menuitem action='GPSBabelURL'/></menu></menubar></ui>",
+         -1, NULL ) )
+      gtk_action_group_add_actions ( action_group, entries_nogpsbabel, G_N_ELEMENTS (entries_nogpsbabel), window );
+  }
+}
+
+static void window_babel_features_probed ( VikWindow *vw )
+{
+  if ( vw->action_group )
+    window_add_babel_ui ( vw, vw->uim, vw->action_group );
+}
+
+/**
+ * vik_window_babel_features_probed:
+ *
+ * Add the GPSBabel dependent menu entries to the windows created before its features were known
+ */
+void vik_window_babel_features_probed ()
+{
+  g_slist_foreach ( window_list, (GFunc)window_babel_features_probed, NULL );
+}
+
 static void window_create_ui( VikWindow *window )
 {
   GtkUIManager *uim;
@@ -6617,36 +7960,15 @@ static void window_create_ui( VikWindow *window )
     toolbar_action_mode_entry_register ( window->viking_vtb, &mode_entries[i] );
   }
 
-  // Use this to see if GPSBabel is available:
-  if ( a_babel_available () ) {
-    // If going to add more entries then might be worth creating a menu_gpsbabel.xml.h file
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui>" \
-         "<menubar name='MainMenu'>" \
-         "<menu action='File'><menu action='Export'><menuitem action='ExportKML'/></menu></menu>" \
-         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPS'/></menu></menu>" \
-         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPSBabel'/></menu></menu>" \
-         "</menubar>" \
-         "</ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_gpsbabel, G_N_ELEMENTS (entries_gpsbabel), window );
-  } else {
-    // Stick in a link to GPSBabel website
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui><menubar name='MainMenu'><menu action='Help'><separator/><menuitem action='GPSBabelURL'/></menu></menubar></ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_nogpsbabel, G_N_ELEMENTS (entries_nogpsbabel), window );
-  }
+  // Otherwise added once known, see vik_window_babel_features_probed()
+  if ( a_babel_features_probed () )
+    window_add_babel_ui ( window, uim, action_group );
 
   // GeoJSON import capability
-  gchar *gjp = g_find_program_in_path ( a_geojson_program_import() );
-  if ( gjp ) {
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
-    g_free ( gjp );
-  }
+  if ( gtk_ui_manager_add_ui_from_string ( uim,
+       "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
+       -1, &error ) )
+    gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
 
   icon_factory = gtk_icon_factory_new ();
   gtk_icon_factory_add_default (icon_factory);
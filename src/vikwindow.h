@@ -55,6 +55,7 @@ GType vik_window_get_type ();
 VikWindow *vik_window_new_window ();
 
 void vik_window_new_window_finish ( VikWindow *vw, gboolean maybe_add_map, gboolean maybe_add_location );
+void vik_window_babel_features_probed ();
 
 void vik_window_draw_update ( VikWindow *vw );
 
@@ -67,6 +68,8 @@ void vik_window_close_graphs ( VikWindow *vw );
 GtkWidget *vik_window_get_drawmode_button ( VikWindow *vw, VikViewportDrawMode mode );
 gboolean vik_window_get_pan_move ( VikWindow *vw );
 void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean change_filename, gboolean first, gboolean last, gboolean new_layer, gboolean external );
+void vik_window_open_files ( VikWindow *vw, GSList *files, gboolean external );
+void vik_window_autosave_recover_untitled ( VikWindow *vw );
 struct _VikLayer;
 void vik_window_selected_layer(VikWindow *vw, struct _VikLayer *vl);
 struct _VikViewport * vik_window_viewport(VikWindow *vw);
@@ -79,6 +82,7 @@ gboolean vik_window_save_file_as ( VikWindow *vw, gpointer val ); // gpointer is
 void vik_window_statusbar_update (VikWindow *vw, const gchar* message, vik_statusbar_type_t vs_type);
 
 void vik_window_set_redraw_trigger(struct _VikLayer *vl);
+void vik_window_add_damage ( VikWindow *vw, const GdkRectangle *area );
 
 void vik_window_enable_layer_tool ( VikWindow *vw, gint layer_id, gint tool_id );
 
@@ -0,0 +1,182 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/**
+ * The known element paths of an XML format in a tree,
+ *  so a reader can follow where it is as a stack of node numbers
+ *  and find the tag of each element with a look at just its siblings,
+ *  rather than building and comparing the whole path string every time.
+ *
+ * Paths are in the '/gpx/trk/name' form.
+ * A path ending in '/' gives its tag to anything at all inside that element,
+ *  apart from the paths that are themselves known.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "xmltagtree.h"
+
+#define NODE_NONE G_MAXUINT
+
+typedef struct {
+  gchar *name;
+  gint tag;
+  guint first_child;
+  guint next_sibling;
+  guint any; // Node for anything not known inside this one
+} XmlTagNode;
+
+struct _VikXmlTagTree {
+  GArray *nodes; // The first is the document itself
+};
+
+#define NODE(tree,nn) (&g_array_index((tree)->nodes, XmlTagNode, (nn)))
+
+static guint node_new ( VikXmlTagTree *tree, const gchar *name, guint any )
+{
+  XmlTagNode node = { g_strdup(name), 0, NODE_NONE, NODE_NONE, any };
+  g_array_append_val ( tree->nodes, node );
+  return tree->nodes->len - 1;
+}
+
+VikXmlTagTree *vik_xml_tag_tree_new ( void )
+{
+  VikXmlTagTree *tree = g_malloc0 ( sizeof(VikXmlTagTree) );
+  tree->nodes = g_array_new ( FALSE, FALSE, sizeof(XmlTagNode) );
+  (void)node_new ( tree, "", NODE_NONE );
+  return tree;
+}
+
+void vik_xml_tag_tree_free ( VikXmlTagTree *tree )
+{
+  guint nn;
+  for ( nn = 0; nn < tree->nodes->len; nn++ )
+    g_free ( NODE(tree,nn)->name );
+  g_array_free ( tree->nodes, TRUE );
+  g_free ( tree );
+}
+
+static guint find_child ( const VikXmlTagTree *tree, guint parent, const gchar *name )
+{
+  guint child;
+  for ( child = NODE(tree,parent)->first_child; child != NODE_NONE; child = NODE(tree,child)->next_sibling )
+    if ( !strcmp ( NODE(tree,child)->name, name ) )
+      return child;
+  return NODE_NONE;
+}
+
+/**
+ * Make everything inside this node not otherwise known go to the node 'any'
+ */
+static void set_any ( VikXmlTagTree *tree, guint nn, guint any )
+{
+  guint child;
+  if ( NODE(tree,nn)->any != NODE_NONE )
+    return;
+  NODE(tree,nn)->any = any;
+  for ( child = NODE(tree,nn)->first_child; child != NODE_NONE; child = NODE(tree,child)->next_sibling )
+    set_any ( tree, child, any );
+}
+
+/**
+ * vik_xml_tag_tree_add:
+ * @path: The full path of the element, or of its parent followed by '/' for anything within it
+ * @tag:  Non zero value to be given for the element
+ *
+ * When a path is added more than once, the first tag is kept.
+ */
+void vik_xml_tag_tree_add ( VikXmlTagTree *tree, const gchar *path, gint tag )
+{
+  gchar **parts = g_strsplit ( path, "/", -1 );
+  guint nn = 0;
+  guint ii;
+  // First part is before the leading '/'
+  for ( ii = 1; parts[ii]; ii++ ) {
+    if ( parts[ii][0] == '\0' && !parts[ii+1] ) {
+      // Ends with '/'
+      if ( NODE(tree,nn)->any == NODE_NONE ) {
+        guint any = node_new ( tree, "", NODE_NONE );
+        NODE(tree,any)->tag = tag;
+        NODE(tree,any)->any = any;
+        set_any ( tree, nn, any );
+      }
+      g_strfreev ( parts );
+      return;
+    }
+    guint child = find_child ( tree, nn, parts[ii] );
+    if ( child == NODE_NONE ) {
+      // NB nodes may move when the array grows
+      child = node_new ( tree, parts[ii], NODE(tree,nn)->any );
+      NODE(tree,child)->next_sibling = NODE(tree,nn)->first_child;
+      NODE(tree,nn)->first_child = child;
+    }
+    nn = child;
+  }
+  if ( NODE(tree,nn)->tag == 0 )
+    NODE(tree,nn)->tag = tag;
+  g_strfreev ( parts );
+}
+
+/**
+ * A new stack for following where a reader is in a document
+ */
+GArray *vik_xml_tag_tree_stack_new ( void )
+{
+  return g_array_sized_new ( FALSE, FALSE, sizeof(guint), 16 );
+}
+
+static gint stack_tag ( const VikXmlTagTree *tree, GArray *stack )
+{
+  if ( stack->len == 0 )
+    return 0;
+  guint nn = g_array_index ( stack, guint, stack->len - 1 );
+  return nn == NODE_NONE ? 0 : NODE(tree,nn)->tag;
+}
+
+/**
+ * vik_xml_tag_tree_push:
+ * @el: The name of the element being started
+ *
+ * Returns: The tag of the element, or 0 when it is not known
+ */
+gint vik_xml_tag_tree_push ( const VikXmlTagTree *tree, GArray *stack, const gchar *el )
+{
+  guint parent = stack->len ? g_array_index ( stack, guint, stack->len - 1 ) : 0;
+  guint nn = NODE_NONE;
+  if ( parent != NODE_NONE ) {
+    nn = find_child ( tree, parent, el );
+    if ( nn == NODE_NONE )
+      nn = NODE(tree,parent)->any;
+  }
+  g_array_append_val ( stack, nn );
+  return stack_tag ( tree, stack );
+}
+
+/**
+ * vik_xml_tag_tree_pop:
+ *
+ * Returns: The tag of the element now being read after the current one has ended
+ */
+gint vik_xml_tag_tree_pop ( const VikXmlTagTree *tree, GArray *stack )
+{
+  if ( stack->len )
+    g_array_set_size ( stack, stack->len - 1 );
+  return stack_tag ( tree, stack );
+}
@@ -0,0 +1,40 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_XMLTAGTREE_H
+#define __VIKING_XMLTAGTREE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikXmlTagTree VikXmlTagTree;
+
+VikXmlTagTree *vik_xml_tag_tree_new ( void );
+void vik_xml_tag_tree_free ( VikXmlTagTree *tree );
+
+void vik_xml_tag_tree_add ( VikXmlTagTree *tree, const gchar *path, gint tag );
+
+GArray *vik_xml_tag_tree_stack_new ( void );
+gint vik_xml_tag_tree_push ( const VikXmlTagTree *tree, GArray *stack, const gchar *el );
+gint vik_xml_tag_tree_pop ( const VikXmlTagTree *tree, GArray *stack );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,1292 @@
+// Copyright: CC0
+//
+// Headless benchmarks of the core data paths, on synthetic data of a configurable size
+//
+//run like:
+// ./bench --points=20000 --tracks=10 --repeats=5 [--only=gpx,tac]
+//
+// Output is one line per benchmark (tab separated), after a header line started with '#':
+//  name  items  repeats  min_s  median_s  mean_s  items_per_s  MB_per_s  ns_per_item
+// The throughputs are from the median time, with MB_per_s only for the file formats (the size of the file read or written)
+// The coords_* microbenchmarks are per function call, with the _batch ones for the same work via the array versions
+// Benchmarks that can not be run are reported with repeats of 0 (e.g. .vik files need a display)
+//
+// As a regression check the output of a previous run can be given as the baseline, e.g.:
+// ./bench --large --only=gpx,kml,fit,vik > baseline.tsv
+// ./bench --large --only=gpx,kml,fit,vik --baseline=baseline.tsv [--threshold=20]
+// then the exit status is a failure if any items_per_s is lower than the baseline by more than the threshold %
+//
+// The download_* benchmarks fetch a fixed area of map tiles from a local HTTP server (so no network is needed),
+//  where each tile response can be delayed by --latency and limited to --bandwidth.
+// These also output comment lines of the requests per connection and the CPU time per tile.
+//
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <glib/gstdio.h>
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "vikaggregatelayer.h"
+#include "viktrwlayer.h"
+#include "settings.h"
+#include "preferences.h"
+#include "download.h"
+#include "globals.h"
+#include "gpx.h"
+#include "kml.h"
+#include "fit.h"
+#include "file.h"
+#include "dems.h"
+#include "mapcache.h"
+#include "modules.h"
+#include "background.h"
+#include "coords.h"
+#include "degrees_converters.h"
+#include "misc/fpconv.h"
+#include "vikslippymapsource.h"
+
+static gint points = 10000;
+static gint tracks = 20;
+static gint waypoints = 1000;
+static gint tiles = 5000;
+static gint repeats = 5;
+static gchar *only = NULL;
+static gchar *baseline = NULL;
+static gdouble threshold = 20.0;
+static gint latency = 10;
+static gint bandwidth = 0;
+static gint batch = 8;
+
+/**
+ * Sizes for the file format round trips - 1M trackpoints and 100k waypoints.
+ * Set when the option is parsed, so any sizes given after it still apply
+ */
+static gboolean set_large ( const gchar *option_name, const gchar *value, gpointer data, GError **error )
+{
+  points = 100000;
+  tracks = 10;
+  waypoints = 100000;
+  return TRUE;
+}
+
+static GOptionEntry entries[] =
+{
+  { "points", 'p', 0, G_OPTION_ARG_INT, &points, "Trackpoints per track", "N" },
+  { "tracks", 't', 0, G_OPTION_ARG_INT, &tracks, "Number of tracks", "N" },
+  { "waypoints", 'w', 0, G_OPTION_ARG_INT, &waypoints, "Number of waypoints", "N" },
+  { "tiles", 'm', 0, G_OPTION_ARG_INT, &tiles, "Number of map cache tiles", "N" },
+  { "repeats", 'r', 0, G_OPTION_ARG_INT, &repeats, "Times to run each benchmark", "N" },
+  { "only", 'o', 0, G_OPTION_ARG_STRING, &only, "Comma separated prefixes of the benchmarks to run", "NAMES" },
+  { "large", 'l', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, set_large, "1M trackpoints (in 10 tracks) and 100k waypoints", NULL },
+  { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline, "Output of a previous run to compare the throughput against", "FILE" },
+  { "threshold", 'x', 0, G_OPTION_ARG_DOUBLE, &threshold, "Percentage below the baseline throughput that fails (default 20)", "PCT" },
+  { "latency", 0, 0, G_OPTION_ARG_INT, &latency, "Delay before each tile server response (default 10)", "MS" },
+  { "bandwidth", 0, 0, G_OPTION_ARG_INT, &bandwidth, "Tile server bandwidth per connection, 0 for unlimited (default)", "KB/S" },
+  { "batch", 0, 0, G_OPTION_ARG_INT, &batch, "Tiles downloaded together, as the maps_download_batch setting (default 8)", "N" },
+  { NULL }
+};
+
+// The synthetic data is within this SRTM tile
+#define DEM_NAME "N51W002.hgt"
+#define DEM_SIZE 1201
+#define BASE_LAT 51.0
+#define BASE_LON -2.0
+
+typedef gdouble (*BenchFunc) ( gpointer data );
+
+static gchar *tmp_dir = NULL;
+
+// Benchmark name -> items_per_s from the baseline file
+static GHashTable *baseline_rates = NULL;
+static guint regressions = 0;
+
+static gboolean wanted ( const gchar *name )
+{
+  if ( !only )
+    return TRUE;
+  gboolean ans = FALSE;
+  gchar **prefixes = g_strsplit ( only, ",", -1 );
+  for ( guint ii = 0; prefixes[ii] && !ans; ii++ )
+    ans = g_str_has_prefix ( name, prefixes[ii] );
+  g_strfreev ( prefixes );
+  return ans;
+}
+
+static gint compare_doubles ( gconstpointer a, gconstpointer b )
+{
+  gdouble aa = *(const gdouble*)a, bb = *(const gdouble*)b;
+  return (aa > bb) - (aa < bb);
+}
+
+/**
+ * Read the items_per_s of each benchmark from the output of a previous run
+ */
+static gboolean load_baseline ( const gchar *fn )
+{
+  gchar *contents = NULL;
+  GError *error = NULL;
+  if ( !g_file_get_contents ( fn, &contents, NULL, &error ) ) {
+    fprintf ( stderr, "Reading the baseline failed: %s\n", error->message );
+    g_error_free ( error );
+    return FALSE;
+  }
+  baseline_rates = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+  gchar **lines = g_strsplit ( contents, "\n", -1 );
+  for ( guint ii = 0; lines[ii]; ii++ ) {
+    if ( lines[ii][0] == '\0' || lines[ii][0] == '#' )
+      continue;
+    gchar **fields = g_strsplit ( lines[ii], "\t", -1 );
+    if ( g_strv_length ( fields ) > 6 ) {
+      gdouble rate = g_ascii_strtod ( fields[6], NULL );
+      if ( rate > 0.0 )
+        g_hash_table_replace ( baseline_rates, g_strdup ( fields[0] ), g_memdup ( &rate, sizeof(rate) ) );
+    }
+    g_strfreev ( fields );
+  }
+  g_strfreev ( lines );
+  g_free ( contents );
+  return TRUE;
+}
+
+/**
+ * Against the baseline (if any), where a rate of 0 means it could not be run
+ */
+static void check_baseline ( const gchar *name, gdouble rate )
+{
+  if ( !baseline_rates )
+    return;
+  gdouble *base = g_hash_table_lookup ( baseline_rates, name );
+  if ( !base )
+    return;
+  if ( rate <= 0.0 ) {
+    fprintf ( stderr, "REGRESSION %s: could not be run\n", name );
+    regressions++;
+  }
+  else if ( rate < *base * (1.0 - threshold / 100.0) ) {
+    fprintf ( stderr, "REGRESSION %s: %.0f items/s is %.1f%% below the baseline of %.0f\n",
+              name, rate, 100.0 * (1.0 - rate / *base), *base );
+    regressions++;
+  }
+}
+
+/**
+ * The bytes are of the file read or written, or 0 when there is no file
+ */
+static void report ( const gchar *name, gulong items, goffset bytes, GArray *times )
+{
+  if ( !times || !times->len ) {
+    printf ( "%s\t%lu\t0\t\t\t\t\t\t\n", name, items );
+    check_baseline ( name, 0.0 );
+    return;
+  }
+  g_array_sort ( times, compare_doubles );
+  gdouble sum = 0.0;
+  for ( guint ii = 0; ii < times->len; ii++ )
+    sum += g_array_index ( times, gdouble, ii );
+  gdouble median = g_array_index ( times, gdouble, times->len/2 );
+  // Avoid dividing by zero for anything faster than the clock resolution
+  gdouble secs = MAX ( median, 1e-6 );
+  gdouble rate = items / secs;
+  printf ( "%s\t%lu\t%u\t%.6f\t%.6f\t%.6f\t%.1f\t", name, items, times->len,
+           g_array_index(times, gdouble, 0), median, sum / times->len, rate );
+  if ( bytes > 0 )
+    printf ( "%.2f", bytes / secs / 1e6 );
+  printf ( "\t%.2f\n", items ? 1e9 * secs / items : 0.0 );
+  fflush ( stdout );
+  check_baseline ( name, rate );
+}
+
+static gchar *tmp_file ( const gchar *name )
+{
+  return g_build_filename ( tmp_dir, name, NULL );
+}
+
+static void remove_tree ( const gchar *path )
+{
+  GDir *dir = g_dir_open ( path, 0, NULL );
+  if ( dir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name ( dir )) ) {
+      gchar *fn = g_build_filename ( path, name, NULL );
+      if ( g_file_test ( fn, G_FILE_TEST_IS_DIR ) )
+        remove_tree ( fn );
+      else
+        (void)g_remove ( fn );
+      g_free ( fn );
+    }
+    g_dir_close ( dir );
+  }
+  (void)g_rmdir ( path );
+}
+
+/**
+ * The function returns the seconds taken by the part being measured,
+ *  or a negative value if it could not be run.
+ * Any file is the name (within the temporary directory) of the one read or written, for the throughput in MB/s
+ */
+static void run_file ( const gchar *name, gulong items, const gchar *file, BenchFunc func, gpointer data )
+{
+  if ( !wanted ( name ) )
+    return;
+  GArray *times = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+  for ( gint ii = 0; ii < repeats; ii++ ) {
+    gdouble secs = func ( data );
+    if ( secs < 0.0 )
+      break;
+    g_array_append_val ( times, secs );
+  }
+  goffset bytes = 0;
+  if ( file ) {
+    gchar *fn = tmp_file ( file );
+    GStatBuf stat_buf;
+    if ( g_stat ( fn, &stat_buf ) == 0 )
+      bytes = stat_buf.st_size;
+    g_free ( fn );
+  }
+  report ( name, items, bytes, times );
+  g_array_free ( times, TRUE );
+}
+
+static void run ( const gchar *name, gulong items, BenchFunc func, gpointer data )
+{
+  run_file ( name, items, NULL, func, data );
+}
+
+static gdouble elapsed ( gint64 start )
+{
+  return (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+}
+
+/**
+ * Random walks around the middle of the DEM tile, at 1 second intervals
+ */
+static VikTrwLayer *make_layer ( void )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ) );
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  gdouble ts = 1500000000.0;
+  for ( gint tt = 0; tt < tracks; tt++ ) {
+    VikTrack *trk = vik_track_new ();
+    struct LatLon ll = { BASE_LAT + g_rand_double_range(rand, 0.3, 0.7), BASE_LON + g_rand_double_range(rand, 0.3, 0.7) };
+    gdouble alt = g_rand_double_range ( rand, 50, 300 );
+    GList *tps = NULL;
+    for ( gint pp = 0; pp < points; pp++ ) {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      ll.lat = CLAMP ( ll.lat + g_rand_double_range(rand, -0.0001, 0.0001), BASE_LAT + 0.01, BASE_LAT + 0.99 );
+      ll.lon = CLAMP ( ll.lon + g_rand_double_range(rand, -0.0001, 0.0001), BASE_LON + 0.01, BASE_LON + 0.99 );
+      alt += g_rand_double_range ( rand, -1.0, 1.0 );
+      vik_coord_load_from_latlon ( &tp->coord, vik_trw_layer_get_coord_mode(vtl), &ll );
+      tp->altitude = alt;
+      tp->timestamp = ts;
+      tp->speed = g_rand_double_range ( rand, 0.0, 10.0 );
+      ts += 1.0;
+      tps = g_list_prepend ( tps, tp );
+    }
+    trk->trackpoints = g_list_reverse ( tps );
+    vik_track_calculate_bounds ( trk );
+    gchar *name = g_strdup_printf ( "Track%04d", tt );
+    vik_trw_layer_add_track ( vtl, name, trk );
+    g_free ( name );
+  }
+  for ( gint ww = 0; ww < waypoints; ww++ ) {
+    VikWaypoint *wp = vik_waypoint_new ();
+    struct LatLon ll = { BASE_LAT + g_rand_double_range(rand, 0.01, 0.99), BASE_LON + g_rand_double_range(rand, 0.01, 0.99) };
+    vik_coord_load_from_latlon ( &wp->coord, vik_trw_layer_get_coord_mode(vtl), &ll );
+    wp->altitude = g_rand_double_range ( rand, 50, 300 );
+    gchar *name = g_strdup_printf ( "Waypoint%05d", ww );
+    vik_trw_layer_add_waypoint ( vtl, name, wp );
+    g_free ( name );
+  }
+  g_rand_free ( rand );
+  return vtl;
+}
+
+static GList *layer_tracks ( VikTrwLayer *vtl )
+{
+  return g_hash_table_get_values ( vik_trw_layer_get_tracks ( vtl ) );
+}
+
+/*** File formats ***/
+
+static gdouble bench_gpx_write ( VikTrwLayer *vtl )
+{
+  gchar *fn = tmp_file ( "bench.gpx" );
+  FILE *ff = g_fopen ( fn, "w" );
+  g_free ( fn );
+  if ( !ff )
+    return -1.0;
+  gint64 start = g_get_monotonic_time ();
+  a_gpx_write_file ( vtl, ff, NULL, NULL );
+  fclose ( ff );
+  return elapsed ( start );
+}
+
+static gdouble read_file ( const gchar *name, gboolean (*read_func)(VikTrwLayer*, FILE*, const gchar*) )
+{
+  gchar *fn = tmp_file ( name );
+  FILE *ff = g_fopen ( fn, "r" );
+  if ( !ff ) {
+    g_free ( fn );
+    return -1.0;
+  }
+  VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ) );
+  gint64 start = g_get_monotonic_time ();
+  gboolean ok = read_func ( vtl, ff, fn );
+  gdouble secs = elapsed ( start );
+  fclose ( ff );
+  g_object_unref ( vtl );
+  g_free ( fn );
+  return ok ? secs : -1.0;
+}
+
+static gboolean gpx_read ( VikTrwLayer *vtl, FILE *ff, const gchar *fn )
+{
+  return a_gpx_read_file ( vtl, ff, NULL, FALSE ) == GPX_READ_SUCCESS;
+}
+
+static gdouble bench_gpx_read ( gpointer data )
+{
+  return read_file ( "bench.gpx", gpx_read );
+}
+
+static gboolean kml_read ( VikTrwLayer *vtl, FILE *ff, const gchar *fn )
+{
+  return a_kml_read_file ( vtl, ff, FALSE );
+}
+
+static gdouble bench_kml_read ( gpointer data )
+{
+  return read_file ( "bench.kml", kml_read );
+}
+
+static gboolean fit_read ( VikTrwLayer *vtl, FILE *ff, const gchar *fn )
+{
+  return a_fit_read_file_into_layer ( vtl, ff, fn );
+}
+
+static gdouble bench_fit_read ( gpointer data )
+{
+  return read_file ( "bench.fit", fit_read );
+}
+
+static void write_kml ( VikTrwLayer *vtl )
+{
+  gchar *fn = tmp_file ( "bench.kml" );
+  FILE *ff = g_fopen ( fn, "w" );
+  g_free ( fn );
+  if ( !ff )
+    return;
+  fprintf ( ff, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n<Document>\n" );
+  GList *trks = layer_tracks ( vtl );
+  char lat[G_ASCII_DTOSTR_BUF_SIZE], lon[G_ASCII_DTOSTR_BUF_SIZE], alt[G_ASCII_DTOSTR_BUF_SIZE];
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    fprintf ( ff, "<Placemark><name>%s</name><LineString><coordinates>\n", trk->name );
+    for ( GList *tpl = trk->trackpoints; tpl; tpl = tpl->next ) {
+      VikTrackpoint *tp = VIK_TRACKPOINT(tpl->data);
+      struct LatLon ll;
+      vik_coord_to_latlon ( &tp->coord, &ll );
+      fprintf ( ff, "%s,%s,%s\n", g_ascii_dtostr(lon, sizeof(lon), ll.lon), g_ascii_dtostr(lat, sizeof(lat), ll.lat),
+                g_ascii_dtostr(alt, sizeof(alt), tp->altitude) );
+    }
+    fprintf ( ff, "</coordinates></LineString></Placemark>\n" );
+  }
+  g_list_free ( trks );
+  fprintf ( ff, "</Document>\n</kml>\n" );
+  fclose ( ff );
+}
+
+static void fit_put ( GByteArray *ba, guint32 value, guint size )
+{
+  for ( guint ii = 0; ii < size; ii++ ) {
+    guint8 byte = (value >> (8 * ii)) & 0xff;
+    g_byte_array_append ( ba, &byte, 1 );
+  }
+}
+
+/**
+ * A minimal activity: a file_id message then a record message per trackpoint
+ */
+static void write_fit ( VikTrwLayer *vtl )
+{
+  GByteArray *ba = g_byte_array_new ();
+  // Header - with the data size filled in at the end
+  fit_put ( ba, 12, 1 );
+  fit_put ( ba, 0x10, 1 );
+  fit_put ( ba, 2093, 2 );
+  fit_put ( ba, 0, 4 );
+  g_byte_array_append ( ba, (const guint8*)".FIT", 4 );
+
+  // file_id definition (local 0) and data: type=activity
+  const guint8 file_id[] = { 0x40, 0, 0, 0, 0, 1, 0, 1, 0x00, 0x00, 4 };
+  g_byte_array_append ( ba, file_id, sizeof(file_id) );
+  // record definition (local 1): timestamp, position_lat, position_long, altitude
+  const guint8 record[] = { 0x41, 0, 0, 20, 0, 4, 253, 4, 0x86, 0, 4, 0x85, 1, 4, 0x85, 2, 2, 0x84 };
+  g_byte_array_append ( ba, record, sizeof(record) );
+
+  GList *trks = layer_tracks ( vtl );
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    for ( GList *tpl = VIK_TRACK(iter->data)->trackpoints; tpl; tpl = tpl->next ) {
+      VikTrackpoint *tp = VIK_TRACKPOINT(tpl->data);
+      struct LatLon ll;
+      vik_coord_to_latlon ( &tp->coord, &ll );
+      fit_put ( ba, 0x01, 1 );
+      fit_put ( ba, (guint32)(tp->timestamp - 631065600), 4 ); // FIT epoch of 1989-12-31
+      fit_put ( ba, (guint32)(gint32)(ll.lat * (2147483648.0 / 180.0)), 4 );
+      fit_put ( ba, (guint32)(gint32)(ll.lon * (2147483648.0 / 180.0)), 4 );
+      fit_put ( ba, (guint32)((tp->altitude + 500) * 5), 2 );
+    }
+  }
+  g_list_free ( trks );
+
+  guint32 data_size = ba->len - 12;
+  for ( guint ii = 0; ii < 4; ii++ )
+    ba->data[4+ii] = (data_size >> (8 * ii)) & 0xff;
+  // 'No' CRC
+  fit_put ( ba, 0, 2 );
+
+  gchar *fn = tmp_file ( "bench.fit" );
+  (void)g_file_set_contents ( fn, (const gchar*)ba->data, ba->len, NULL );
+  g_free ( fn );
+  g_byte_array_free ( ba, TRUE );
+}
+
+typedef struct {
+  VikAggregateLayer *agg;
+  VikViewport *vp;
+} VikFileData;
+
+static gdouble bench_vik_save ( VikFileData *vfd )
+{
+  if ( !vfd->vp )
+    return -1.0;
+  gchar *fn = tmp_file ( "bench.vik" );
+  gint64 start = g_get_monotonic_time ();
+  gboolean ok = a_file_save ( vfd->agg, vfd->vp, fn );
+  gdouble secs = elapsed ( start );
+  g_free ( fn );
+  return ok ? secs : -1.0;
+}
+
+static gdouble bench_vik_load ( VikFileData *vfd )
+{
+  if ( !vfd->vp )
+    return -1.0;
+  gchar *fn = tmp_file ( "bench.vik" );
+  VikAggregateLayer *agg = vik_aggregate_layer_new ( vfd->vp );
+  gint64 start = g_get_monotonic_time ();
+  VikLoadType_t lt = a_file_load ( agg, vfd->vp, NULL, fn, TRUE, FALSE, NULL );
+  gdouble secs = elapsed ( start );
+  g_object_unref ( agg );
+  g_free ( fn );
+  return lt == LOAD_TYPE_VIK_SUCCESS ? secs : -1.0;
+}
+
+/*** Tracks ***/
+
+static gdouble bench_track_length ( VikTrwLayer *vtl )
+{
+  GList *trks = layer_tracks ( vtl );
+  // Measure the calculation, rather than any cached values
+  for ( GList *iter = trks; iter; iter = iter->next )
+    vik_track_changed ( VIK_TRACK(iter->data) );
+  gdouble length = 0.0;
+  gint64 start = g_get_monotonic_time ();
+  for ( GList *iter = trks; iter; iter = iter->next )
+    length += vik_track_get_length ( VIK_TRACK(iter->data) );
+  gdouble secs = elapsed ( start );
+  g_list_free ( trks );
+  return length > 0.0 ? secs : -1.0;
+}
+
+static gdouble bench_track_statistics ( VikTrwLayer *vtl )
+{
+  GList *trks = layer_tracks ( vtl );
+  for ( GList *iter = trks; iter; iter = iter->next )
+    vik_track_changed ( VIK_TRACK(iter->data) );
+  gint64 start = g_get_monotonic_time ();
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    gdouble up, down, min_alt, max_alt;
+    (void)vik_track_get_length_including_gaps ( trk );
+    (void)vik_track_get_max_speed ( trk );
+    (void)vik_track_get_average_speed ( trk );
+    (void)vik_track_get_average_speed_moving ( trk, 60 );
+    (void)vik_track_get_duration ( trk, TRUE );
+    vik_track_get_total_elevation_gain ( trk, &up, &down );
+    (void)vik_track_get_minmax_alt ( trk, &min_alt, &max_alt );
+  }
+  gdouble secs = elapsed ( start );
+  g_list_free ( trks );
+  return secs;
+}
+
+#define MAP_CHUNKS 500
+
+static gdouble *track_make_elevation_time_map ( const VikTrack *trk, guint16 num_chunks )
+{
+  return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_ELEVATION );
+}
+
+static gdouble bench_track_maps ( VikTrwLayer *vtl )
+{
+  gdouble *(*makers[])(const VikTrack*, guint16) = {
+    vik_track_make_elevation_map,
+    vik_track_make_gradient_map,
+    vik_track_make_speed_map,
+    vik_track_make_distance_map,
+    track_make_elevation_time_map,
+    vik_track_make_speed_dist_map,
+  };
+  GList *trks = layer_tracks ( vtl );
+  gint64 start = g_get_monotonic_time ();
+  for ( GList *iter = trks; iter; iter = iter->next )
+    for ( guint mm = 0; mm < G_N_ELEMENTS(makers); mm++ )
+      g_free ( makers[mm] ( VIK_TRACK(iter->data), MAP_CHUNKS ) );
+  gdouble secs = elapsed ( start );
+  g_list_free ( trks );
+  return secs;
+}
+
+// Positions looked up along each track, as when moving over a graph
+#define LOOKUPS 1000
+
+static gdouble bench_track_lookup ( VikTrwLayer *vtl )
+{
+  GList *trks = layer_tracks ( vtl );
+  gint64 start = g_get_monotonic_time ();
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    for ( guint ll = 0; ll < LOOKUPS; ll++ ) {
+      (void)vik_track_get_closest_tp_by_percentage_dist ( trk, (gdouble)ll / LOOKUPS, NULL );
+      (void)vik_track_get_closest_tp_by_percentage_time ( trk, (gdouble)ll / LOOKUPS, NULL );
+    }
+  }
+  gdouble secs = elapsed ( start );
+  g_list_free ( trks );
+  return secs;
+}
+
+static gdouble bench_track_ranges ( VikTrwLayer *vtl )
+{
+  GList *trks = layer_tracks ( vtl );
+  gint64 start = g_get_monotonic_time ();
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    guint len = vik_track_get_tp_count ( trk );
+    // Ranges growing from the middle, as when dragging out a selection on a graph
+    for ( guint ll = 0; ll < LOOKUPS; ll++ ) {
+      VikTrackRangeStats stats;
+      guint half = (guint)((gdouble)ll / LOOKUPS * len / 2);
+      (void)vik_track_get_range_stats ( trk, TRACK_VALUE_ELEVATION, len/2 - half, len/2 + half, &stats );
+    }
+  }
+  gdouble secs = elapsed ( start );
+  g_list_free ( trks );
+  return secs;
+}
+
+/*** Coordinates ***/
+
+typedef struct {
+  guint n;
+  struct LatLon *lls;
+  struct UTM *utms;
+  VikCoord *coords;
+  const VikCoord **coord_ptrs;
+  // Outputs - kept so the work is not optimised away
+  struct LatLon *lls_out;
+  struct UTM *utms_out;
+  gdouble *diffs;
+  gint *x;
+  gint *y;
+  VikViewport *vp;
+} CoordsData;
+
+static volatile gdouble coords_sink;
+
+static CoordsData *coords_data_new ( VikTrwLayer *vtl, gulong total_points, VikViewport *vp )
+{
+  CoordsData *cd = g_new0 ( CoordsData, 1 );
+  cd->lls = g_new ( struct LatLon, total_points );
+  cd->utms = g_new ( struct UTM, total_points );
+  cd->coords = g_new ( VikCoord, total_points );
+  cd->coord_ptrs = g_new ( const VikCoord*, total_points );
+  cd->lls_out = g_new ( struct LatLon, total_points );
+  cd->utms_out = g_new ( struct UTM, total_points );
+  cd->diffs = g_new ( gdouble, total_points );
+  cd->x = g_new ( gint, total_points );
+  cd->y = g_new ( gint, total_points );
+  GList *trks = layer_tracks ( vtl );
+  for ( GList *iter = trks; iter; iter = iter->next )
+    for ( GList *tpl = VIK_TRACK(iter->data)->trackpoints; tpl; tpl = tpl->next ) {
+      cd->coords[cd->n] = VIK_TRACKPOINT(tpl->data)->coord;
+      vik_coord_to_latlon ( &cd->coords[cd->n], &cd->lls[cd->n] );
+      a_coords_latlon_to_utm ( &cd->lls[cd->n], &cd->utms[cd->n] );
+      cd->n++;
+    }
+  g_list_free ( trks );
+  for ( guint ii = 0; ii < cd->n; ii++ )
+    cd->coord_ptrs[ii] = &cd->coords[ii];
+
+  // With all the points on the screen
+  if ( vp ) {
+    struct LatLon ll = { BASE_LAT + 0.5, BASE_LON + 0.5 };
+    vik_viewport_set_center_latlon ( vp, &ll, FALSE );
+    vik_viewport_set_zoom ( vp, 64.0 );
+    cd->vp = vp;
+  }
+  return cd;
+}
+
+static void coords_data_free ( CoordsData *cd )
+{
+  g_free ( cd->lls );
+  g_free ( cd->utms );
+  g_free ( cd->coords );
+  g_free ( cd->coord_ptrs );
+  g_free ( cd->lls_out );
+  g_free ( cd->utms_out );
+  g_free ( cd->diffs );
+  g_free ( cd->x );
+  g_free ( cd->y );
+  g_free ( cd );
+}
+
+static gdouble bench_coords_utm ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < cd->n; ii++ )
+    a_coords_latlon_to_utm ( &cd->lls[ii], &cd->utms_out[ii] );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_utm_batch ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  a_coords_latlons_to_utms ( cd->lls, cd->utms_out, cd->n );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_latlon ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < cd->n; ii++ )
+    a_coords_utm_to_latlon ( &cd->utms[ii], &cd->lls_out[ii] );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_latlon_batch ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  a_coords_utms_to_latlons ( cd->utms, cd->lls_out, cd->n );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_diff_latlon ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii + 1 < cd->n; ii++ )
+    cd->diffs[ii] = a_coords_latlon_diff ( &cd->lls[ii], &cd->lls[ii+1] );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_diff_latlon_batch ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  a_coords_latlon_diffs ( cd->lls, cd->n, cd->diffs );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_diff_vik ( CoordsData *cd )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii + 1 < cd->n; ii++ )
+    cd->diffs[ii] = vik_coord_diff ( &cd->coords[ii], &cd->coords[ii+1] );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_degrees ( CoordsData *cd, gchar *(*convert)(gdouble) )
+{
+  gsize len = 0;
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < cd->n; ii++ ) {
+    gchar *str = convert ( cd->lls[ii].lat );
+    len += strlen ( str );
+    g_free ( str );
+  }
+  gdouble secs = elapsed ( start );
+  coords_sink = len;
+  return secs;
+}
+
+static gdouble bench_coords_degrees_ddd ( CoordsData *cd )
+{
+  return bench_coords_degrees ( cd, convert_lat_dec_to_ddd );
+}
+
+static gdouble bench_coords_degrees_dmm ( CoordsData *cd )
+{
+  return bench_coords_degrees ( cd, convert_lat_dec_to_dmm );
+}
+
+static gdouble bench_coords_degrees_dms ( CoordsData *cd )
+{
+  return bench_coords_degrees ( cd, convert_lat_dec_to_dms );
+}
+
+static gdouble bench_coords_fpconv ( CoordsData *cd )
+{
+  char buf[24];
+  gint len = 0;
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < cd->n; ii++ )
+    len += fpconv_dtoa ( cd->lls[ii].lat, buf, 0 );
+  gdouble secs = elapsed ( start );
+  coords_sink = len;
+  return secs;
+}
+
+static gdouble bench_coords_screen ( CoordsData *cd )
+{
+  if ( !cd->vp )
+    return -1.0;
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < cd->n; ii++ )
+    vik_viewport_coord_to_screen ( cd->vp, &cd->coords[ii], &cd->x[ii], &cd->y[ii] );
+  return elapsed ( start );
+}
+
+static gdouble bench_coords_screen_batch ( CoordsData *cd )
+{
+  if ( !cd->vp )
+    return -1.0;
+  gint64 start = g_get_monotonic_time ();
+  vik_viewport_coords_to_screen ( cd->vp, cd->coord_ptrs, cd->n, cd->x, cd->y );
+  return elapsed ( start );
+}
+
+/*** DEM ***/
+
+static gchar *write_dem ( void )
+{
+  gsize size = DEM_SIZE * DEM_SIZE * sizeof(gint16);
+  guint8 *grid = g_malloc ( size );
+  for ( guint yy = 0; yy < DEM_SIZE; yy++ )
+    for ( guint xx = 0; xx < DEM_SIZE; xx++ ) {
+      // Big endian samples
+      gint16 elev = 100 + (gint16)(50 * sin(xx / 50.0) + 50 * cos(yy / 70.0));
+      grid[2 * (yy * DEM_SIZE + xx)] = (elev >> 8) & 0xff;
+      grid[2 * (yy * DEM_SIZE + xx) + 1] = elev & 0xff;
+    }
+  gchar *fn = tmp_file ( DEM_NAME );
+  gboolean ok = g_file_set_contents ( fn, (const gchar*)grid, size, NULL );
+  g_free ( grid );
+  if ( !ok ) {
+    g_free ( fn );
+    return NULL;
+  }
+  return fn;
+}
+
+typedef struct {
+  VikCoord *coords;
+  guint n;
+  VikDemInterpol method;
+} DemData;
+
+static gdouble bench_dem_lookup ( DemData *dd )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < dd->n; ii++ )
+    (void)a_dems_get_elev_by_coord ( &dd->coords[ii], dd->method );
+  return elapsed ( start );
+}
+
+static gdouble bench_dem_batch ( DemData *dd )
+{
+  gint16 *out = g_new ( gint16, dd->n );
+  gint64 start = g_get_monotonic_time ();
+  a_dems_get_elev_batch ( dd->coords, dd->n, dd->method, out );
+  gdouble secs = elapsed ( start );
+  g_free ( out );
+  return secs;
+}
+
+/*** Map cache ***/
+
+#define BENCH_MAP_TYPE 1000
+#define BENCH_MAP_ZOOM 13
+
+static gdouble bench_mapcache_add ( GdkPixbuf *pixbuf )
+{
+  a_mapcache_flush_type ( BENCH_MAP_TYPE );
+  gint64 start = g_get_monotonic_time ();
+  for ( gint ii = 0; ii < tiles; ii++ )
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){ -1.0, 0 }, ii % 100, ii / 100, BENCH_MAP_ZOOM, BENCH_MAP_TYPE, BENCH_MAP_ZOOM, 255, 1.0, 1.0, "bench" );
+  return elapsed ( start );
+}
+
+static gdouble bench_mapcache_get ( gpointer data )
+{
+  guint hits = 0;
+  gint64 start = g_get_monotonic_time ();
+  // Half hits (if they all fit in the cache), half misses
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    gint y = ii / 100 + ( (ii % 2) ? 1000000 : 0 );
+    GdkPixbuf *pixbuf = a_mapcache_get ( ii % 100, y, BENCH_MAP_ZOOM, BENCH_MAP_TYPE, BENCH_MAP_ZOOM, 255, 1.0, 1.0, "bench" );
+    if ( pixbuf ) {
+      hits++;
+      g_object_unref ( pixbuf );
+    }
+  }
+  gdouble secs = elapsed ( start );
+  return hits ? secs : -1.0;
+}
+
+/*** Map downloads ***/
+
+// Minimal HTTP/1.1 server of the same tile for any request, with keep-alive
+typedef struct {
+  GSocket *listener;
+  GCancellable *cancel;
+  GThread *thread;
+  guint16 port;
+  GBytes *tile;
+  gint active;
+  gint connections;
+  gint requests;
+} TileServer;
+
+typedef struct {
+  TileServer *ts;
+  GSocket *socket;
+} TileConnection;
+
+static gboolean tile_server_send ( TileServer *ts, GSocket *socket, const gchar *buf, gsize len )
+{
+  // Chunks of 10ms at the bandwidth
+  gsize chunk = bandwidth > 0 ? MAX ( 1, bandwidth * 1024 / 100 ) : len;
+  while ( len ) {
+    gssize sent = g_socket_send ( socket, buf, MIN ( chunk, len ), ts->cancel, NULL );
+    if ( sent <= 0 )
+      return FALSE;
+    buf += sent;
+    len -= sent;
+    if ( bandwidth > 0 )
+      g_usleep ( sent * G_USEC_PER_SEC / (bandwidth * 1024) );
+  }
+  return TRUE;
+}
+
+static gpointer tile_server_connection ( TileConnection *tc )
+{
+  TileServer *ts = tc->ts;
+  GString *in = g_string_new ( NULL );
+  gchar buf[4096];
+  gsize tile_len;
+  const gchar *tile = g_bytes_get_data ( ts->tile, &tile_len );
+  gchar *header = g_strdup_printf ( "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %" G_GSIZE_FORMAT "\r\n\r\n", tile_len );
+  gboolean ok = TRUE;
+  while ( ok ) {
+    gssize got = g_socket_receive ( tc->socket, buf, sizeof(buf), ts->cancel, NULL );
+    if ( got <= 0 )
+      break;
+    g_string_append_len ( in, buf, got );
+    // Answer each complete request, in order
+    gchar *end;
+    while ( ok && (end = strstr ( in->str, "\r\n\r\n" )) ) {
+      g_atomic_int_inc ( &ts->requests );
+      if ( latency > 0 )
+        g_usleep ( latency * 1000 );
+      ok = tile_server_send ( ts, tc->socket, header, strlen(header) ) && tile_server_send ( ts, tc->socket, tile, tile_len );
+      g_string_erase ( in, 0, end + 4 - in->str );
+    }
+  }
+  g_free ( header );
+  g_string_free ( in, TRUE );
+  g_socket_close ( tc->socket, NULL );
+  g_object_unref ( tc->socket );
+  g_free ( tc );
+  g_atomic_int_add ( &ts->active, -1 );
+  return NULL;
+}
+
+static gpointer tile_server_accept ( TileServer *ts )
+{
+  GSocket *socket;
+  while ( (socket = g_socket_accept ( ts->listener, ts->cancel, NULL )) ) {
+    g_atomic_int_inc ( &ts->connections );
+    g_atomic_int_inc ( &ts->active );
+    TileConnection *tc = g_new ( TileConnection, 1 );
+    tc->ts = ts;
+    tc->socket = socket;
+    g_thread_unref ( g_thread_new ( "bench-tile-connection", (GThreadFunc)tile_server_connection, tc ) );
+  }
+  return NULL;
+}
+
+/**
+ * Listening on any free port of the loopback interface
+ */
+static TileServer *tile_server_start ( GBytes *tile )
+{
+  GSocket *listener = g_socket_new ( G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL );
+  if ( !listener )
+    return NULL;
+  GInetAddress *loopback = g_inet_address_new_loopback ( G_SOCKET_FAMILY_IPV4 );
+  GSocketAddress *address = g_inet_socket_address_new ( loopback, 0 );
+  g_object_unref ( loopback );
+  gboolean ok = g_socket_bind ( listener, address, TRUE, NULL ) && g_socket_listen ( listener, NULL );
+  g_object_unref ( address );
+  GSocketAddress *local = ok ? g_socket_get_local_address ( listener, NULL ) : NULL;
+  if ( !local ) {
+    g_object_unref ( listener );
+    return NULL;
+  }
+  TileServer *ts = g_new0 ( TileServer, 1 );
+  ts->listener = listener;
+  ts->port = g_inet_socket_address_get_port ( G_INET_SOCKET_ADDRESS(local) );
+  g_object_unref ( local );
+  ts->cancel = g_cancellable_new ();
+  ts->tile = g_bytes_ref ( tile );
+  ts->thread = g_thread_new ( "bench-tile-server", (GThreadFunc)tile_server_accept, ts );
+  return ts;
+}
+
+static void tile_server_stop ( TileServer *ts )
+{
+  g_cancellable_cancel ( ts->cancel );
+  g_thread_join ( ts->thread );
+  // The connection threads stop once their next socket operation sees the cancel
+  while ( g_atomic_int_get ( &ts->active ) )
+    g_usleep ( 1000 );
+  g_socket_close ( ts->listener, NULL );
+  g_object_unref ( ts->listener );
+  g_object_unref ( ts->cancel );
+  g_bytes_unref ( ts->tile );
+  g_free ( ts );
+}
+
+// The area covered at each zoom level - OSM zoom 10 to 15 around the synthetic tracks
+#define DOWNLOAD_ZOOM_MIN 10
+#define DOWNLOAD_ZOOM_MAX 15
+#define DOWNLOAD_SIZE 0.1
+
+typedef struct {
+  VikMapSource *map;
+  TileServer *ts;
+  guint batch;
+  MapCoord *mcs;
+  guint n;
+  guint downloads;
+  gdouble cpu;
+} DownloadData;
+
+static void download_data_init ( DownloadData *dd, TileServer *ts )
+{
+  gchar *hostname = g_strdup_printf ( "127.0.0.1:%d", ts->port );
+  dd->map = VIK_MAP_SOURCE ( vik_slippy_map_source_new_with_id ( BENCH_MAP_TYPE, "bench", hostname, "/%d/%d/%d.png" ) );
+  g_free ( hostname );
+  dd->ts = ts;
+  GArray *mcs = g_array_new ( FALSE, FALSE, sizeof(MapCoord) );
+  for ( gint zz = DOWNLOAD_ZOOM_MIN; zz <= DOWNLOAD_ZOOM_MAX; zz++ ) {
+    // Viking zoom (metres per pixel) for this OSM zoom
+    gdouble zoom = (gdouble)(1 << (17 - zz));
+    struct LatLon ul = { BASE_LAT + 0.5 + DOWNLOAD_SIZE/2, BASE_LON + 0.5 - DOWNLOAD_SIZE/2 };
+    struct LatLon br = { BASE_LAT + 0.5 - DOWNLOAD_SIZE/2, BASE_LON + 0.5 + DOWNLOAD_SIZE/2 };
+    VikCoord c1, c2;
+    vik_coord_load_from_latlon ( &c1, VIK_COORD_LATLON, &ul );
+    vik_coord_load_from_latlon ( &c2, VIK_COORD_LATLON, &br );
+    MapCoord m1, m2;
+    if ( !vik_map_source_coord_to_mapcoord ( dd->map, &c1, zoom, zoom, &m1 ) ||
+         !vik_map_source_coord_to_mapcoord ( dd->map, &c2, zoom, zoom, &m2 ) )
+      continue;
+    for ( gint x = MIN(m1.x, m2.x); x <= MAX(m1.x, m2.x); x++ )
+      for ( gint y = MIN(m1.y, m2.y); y <= MAX(m1.y, m2.y); y++ ) {
+        MapCoord mc = m1;
+        mc.x = x;
+        mc.y = y;
+        g_array_append_val ( mcs, mc );
+      }
+  }
+  dd->n = mcs->len;
+  dd->mcs = (MapCoord*)g_array_free ( mcs, FALSE );
+}
+
+/**
+ * All the tiles into a new cache directory each time, in batches as the maps layer download thread does
+ */
+static gdouble bench_download ( DownloadData *dd )
+{
+  gchar **fns = g_new0 ( gchar*, dd->n + 1 );
+  for ( guint ii = 0; ii < dd->n; ii++ )
+    fns[ii] = g_strdup_printf ( "%s%cdownload%u%c%d%c%d%c%d.png", tmp_dir, G_DIR_SEPARATOR, dd->downloads, G_DIR_SEPARATOR,
+                                17 - dd->mcs[ii].scale, G_DIR_SEPARATOR, dd->mcs[ii].x, G_DIR_SEPARATOR, dd->mcs[ii].y );
+  DownloadResult_t *results = g_new0 ( DownloadResult_t, dd->n );
+  dd->downloads++;
+
+  clock_t cpu = clock ();
+  gint64 start = g_get_monotonic_time ();
+  void *handle = vik_map_source_download_handle_init ( dd->map );
+  for ( guint ii = 0; ii < dd->n; ii += dd->batch ) {
+    guint count = MIN ( dd->batch, dd->n - ii );
+    if ( count == 1 )
+      results[ii] = vik_map_source_download ( dd->map, &dd->mcs[ii], fns[ii], handle );
+    else
+      vik_map_source_download_multi ( dd->map, &dd->mcs[ii], (const gchar**)&fns[ii], &results[ii], count, handle );
+  }
+  vik_map_source_download_handle_cleanup ( dd->map, handle );
+  gdouble secs = elapsed ( start );
+  dd->cpu += (clock() - cpu) / (gdouble)CLOCKS_PER_SEC;
+
+  for ( guint ii = 0; ii < dd->n; ii++ )
+    if ( results[ii] != DOWNLOAD_SUCCESS )
+      secs = -1.0;
+  g_free ( results );
+  g_strfreev ( fns );
+  return secs;
+}
+
+static void run_download ( const gchar *name, DownloadData *dd, guint batch_size )
+{
+  if ( !wanted ( name ) )
+    return;
+  dd->batch = batch_size;
+  dd->downloads = 0;
+  dd->cpu = 0.0;
+  g_atomic_int_set ( &dd->ts->connections, 0 );
+  g_atomic_int_set ( &dd->ts->requests, 0 );
+  run ( name, dd->n, (BenchFunc)bench_download, dd );
+  gint connections = g_atomic_int_get ( &dd->ts->connections );
+  gint requests = g_atomic_int_get ( &dd->ts->requests );
+  printf ( "#%s: %d requests on %d connections (%.1f per connection), %.3f ms CPU per tile\n", name, requests, connections,
+           connections ? (gdouble)requests / connections : 0.0, dd->downloads ? 1000.0 * dd->cpu / (dd->downloads * dd->n) : 0.0 );
+  fflush ( stdout );
+}
+
+/*** Tracks Area Coverage & Heatmap ***/
+
+static gdouble bench_tac ( VikAggregateLayer *agg )
+{
+  gint64 start = g_get_monotonic_time ();
+  // All of it each time, rather than just any changes since before
+  gint ans = vik_aggregate_layer_tac_calculate_now ( agg, TRUE );
+  gdouble secs = elapsed ( start );
+  return ans == 0 ? secs : -1.0;
+}
+
+static gdouble bench_heatmap ( VikAggregateLayer *agg )
+{
+  gint64 start = g_get_monotonic_time ();
+  gint ans = vik_aggregate_layer_hm_calculate_now ( agg, 10 );
+  gdouble secs = elapsed ( start );
+  return ans == 0 ? secs : -1.0;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( "- benchmark core data paths" );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+    fprintf ( stderr, "Parsing command line options failed: %s\n", error->message );
+    g_error_free ( error );
+    return EXIT_FAILURE;
+  }
+  g_option_context_free ( context );
+  points = MAX ( 2, points );
+  tracks = MAX ( 1, tracks );
+  waypoints = MAX ( 0, waypoints );
+  tiles = MAX ( 1, tiles );
+  repeats = MAX ( 1, repeats );
+  latency = MAX ( 0, latency );
+  bandwidth = MAX ( 0, bandwidth );
+  batch = MAX ( 1, batch );
+  if ( baseline && !load_baseline ( baseline ) )
+    return EXIT_FAILURE;
+
+  // Only the .vik benchmarks need a display
+  gboolean have_display = gtk_init_check ( &argc, &argv );
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init ();
+  a_mapcache_init ();
+  a_dems_init ();
+  a_background_init ();
+  // For the CPU workers used by parallel GPX writing
+  a_background_post_init ();
+  if ( have_display ) {
+    modules_init ();
+    modules_post_init ();
+  }
+
+  tmp_dir = g_dir_make_tmp ( "vikbench-XXXXXX", NULL );
+  if ( !tmp_dir ) {
+    fprintf ( stderr, "Failed to create a temporary directory\n" );
+    return EXIT_FAILURE;
+  }
+
+  const gulong total_points = (gulong)points * tracks;
+  printf ( "#name\titems\trepeats\tmin_s\tmedian_s\tmean_s\titems_per_s\tMB_per_s\tns_per_item\n" );
+
+  // The synthetic data is only made once
+  gint64 start = g_get_monotonic_time ();
+  VikTrwLayer *vtl = make_layer ();
+  gdouble secs = elapsed ( start );
+  if ( wanted ( "create_layer" ) ) {
+    GArray *times = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+    g_array_append_val ( times, secs );
+    report ( "create_layer", total_points, 0, times );
+    g_array_free ( times, TRUE );
+  }
+
+  // Files
+  //  those to be read are written first (if that fails the read is reported as not run)
+  run_file ( "gpx_write", total_points, "bench.gpx", (BenchFunc)bench_gpx_write, vtl );
+  if ( wanted ( "gpx_read" ) ) {
+    (void)bench_gpx_write ( vtl );
+    run_file ( "gpx_read", total_points, "bench.gpx", bench_gpx_read, NULL );
+  }
+  if ( wanted ( "kml" ) ) {
+    write_kml ( vtl );
+    run_file ( "kml_read", total_points, "bench.kml", bench_kml_read, NULL );
+  }
+  if ( wanted ( "fit" ) ) {
+    write_fit ( vtl );
+    run_file ( "fit_read", total_points, "bench.fit", bench_fit_read, NULL );
+  }
+
+  VikAggregateLayer *agg = vik_aggregate_layer_new ( NULL );
+  vik_aggregate_layer_add_layer ( agg, VIK_LAYER(vtl), FALSE );
+
+  VikFileData vfd = { agg, have_display ? vik_viewport_new () : NULL };
+  run_file ( "vik_save", total_points, "bench.vik", (BenchFunc)bench_vik_save, &vfd );
+  if ( wanted ( "vik_load" ) ) {
+    (void)bench_vik_save ( &vfd );
+    run_file ( "vik_load", total_points, "bench.vik", (BenchFunc)bench_vik_load, &vfd );
+  }
+
+  // Tracks
+  run ( "track_length", total_points, (BenchFunc)bench_track_length, vtl );
+  run ( "track_statistics", total_points, (BenchFunc)bench_track_statistics, vtl );
+  run ( "track_make_maps", total_points, (BenchFunc)bench_track_maps, vtl );
+  run ( "track_lookup", tracks * LOOKUPS * 2, (BenchFunc)bench_track_lookup, vtl );
+  run ( "track_ranges", tracks * LOOKUPS, (BenchFunc)bench_track_ranges, vtl );
+
+  // Coordinates
+  if ( wanted ( "coords" ) ) {
+    CoordsData *cd = coords_data_new ( vtl, total_points, vfd.vp );
+    run ( "coords_utm", cd->n, (BenchFunc)bench_coords_utm, cd );
+    run ( "coords_utm_batch", cd->n, (BenchFunc)bench_coords_utm_batch, cd );
+    run ( "coords_latlon", cd->n, (BenchFunc)bench_coords_latlon, cd );
+    run ( "coords_latlon_batch", cd->n, (BenchFunc)bench_coords_latlon_batch, cd );
+    run ( "coords_diff_latlon", cd->n - 1, (BenchFunc)bench_coords_diff_latlon, cd );
+    run ( "coords_diff_latlon_batch", cd->n - 1, (BenchFunc)bench_coords_diff_latlon_batch, cd );
+    run ( "coords_diff_vik", cd->n - 1, (BenchFunc)bench_coords_diff_vik, cd );
+    run ( "coords_degrees_ddd", cd->n, (BenchFunc)bench_coords_degrees_ddd, cd );
+    run ( "coords_degrees_dmm", cd->n, (BenchFunc)bench_coords_degrees_dmm, cd );
+    run ( "coords_degrees_dms", cd->n, (BenchFunc)bench_coords_degrees_dms, cd );
+    run ( "coords_fpconv", cd->n, (BenchFunc)bench_coords_fpconv, cd );
+    run ( "coords_screen", cd->n, (BenchFunc)bench_coords_screen, cd );
+    run ( "coords_screen_batch", cd->n, (BenchFunc)bench_coords_screen_batch, cd );
+    coords_data_free ( cd );
+  }
+
+  // DEM
+  if ( wanted ( "dem" ) ) {
+    gchar *dem_file = write_dem ();
+    if ( dem_file && a_dems_load ( dem_file ) ) {
+      DemData dd = { g_new ( VikCoord, total_points ), 0, VIK_DEM_INTERPOL_NONE };
+      GList *trks = layer_tracks ( vtl );
+      for ( GList *iter = trks; iter; iter = iter->next )
+        for ( GList *tpl = VIK_TRACK(iter->data)->trackpoints; tpl; tpl = tpl->next )
+          dd.coords[dd.n++] = VIK_TRACKPOINT(tpl->data)->coord;
+      g_list_free ( trks );
+      run ( "dem_lookup", dd.n, (BenchFunc)bench_dem_lookup, &dd );
+      dd.method = VIK_DEM_INTERPOL_BEST;
+      run ( "dem_lookup_best", dd.n, (BenchFunc)bench_dem_lookup, &dd );
+      dd.method = VIK_DEM_INTERPOL_NONE;
+      run ( "dem_batch", dd.n, (BenchFunc)bench_dem_batch, &dd );
+      g_free ( dd.coords );
+      a_dems_unref ( dem_file );
+    }
+    else
+      report ( "dem_lookup", total_points, 0, NULL );
+    g_free ( dem_file );
+  }
+
+  // Map cache
+  if ( wanted ( "mapcache" ) ) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 256, 256 );
+    gdk_pixbuf_fill ( pixbuf, 0x808080ff );
+    run ( "mapcache_add", tiles, (BenchFunc)bench_mapcache_add, pixbuf );
+    run ( "mapcache_get", tiles, bench_mapcache_get, NULL );
+    a_mapcache_flush_type ( BENCH_MAP_TYPE );
+    g_object_unref ( pixbuf );
+  }
+
+  // Map downloads
+  if ( wanted ( "download" ) ) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 256, 256 );
+    gdk_pixbuf_fill ( pixbuf, 0x808080ff );
+    gchar *png = NULL;
+    gsize png_len = 0;
+    TileServer *ts = NULL;
+    if ( gdk_pixbuf_save_to_buffer ( pixbuf, &png, &png_len, "png", NULL, NULL ) ) {
+      GBytes *tile = g_bytes_new_take ( png, png_len );
+      ts = tile_server_start ( tile );
+      g_bytes_unref ( tile );
+    }
+    g_object_unref ( pixbuf );
+    if ( ts ) {
+      DownloadData dd = { NULL };
+      download_data_init ( &dd, ts );
+      run_download ( "download_single", &dd, 1 );
+      run_download ( "download_batch", &dd, batch );
+      g_object_unref ( dd.map );
+      g_free ( dd.mcs );
+      tile_server_stop ( ts );
+    }
+    else
+      report ( "download_single", 0, 0, NULL );
+  }
+
+  // Aggregate calculations over all the tracks
+  run ( "tac", total_points, (BenchFunc)bench_tac, agg );
+  run ( "heatmap", total_points, (BenchFunc)bench_heatmap, agg );
+
+  g_object_unref ( agg );
+  if ( vfd.vp )
+    g_object_unref ( g_object_ref_sink ( vfd.vp ) );
+
+  if ( have_display )
+    modules_uninit ();
+  a_background_uninit ();
+  a_dems_uninit ();
+  a_mapcache_uninit ();
+  a_download_uninit ();
+  a_layer_defaults_uninit ();
+  a_vik_preferences_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  // Tidy up - after any downloaded tiles have been written
+  remove_tree ( tmp_dir );
+  g_free ( tmp_dir );
+
+  if ( baseline_rates ) {
+    if ( regressions )
+      fprintf ( stderr, "%u benchmark(s) slower than the baseline by more than %.0f%%\n", regressions, threshold );
+    g_hash_table_destroy ( baseline_rates );
+  }
+
+  return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+#
+# viking-routegraph.py - make a road graph for Viking's offline routing engine
+#                        (VikRoutingGraphEngine) from an OpenStreetMap XML extract
+#
+# Usage: viking-routegraph.py [--highways=motorway,trunk,...] extract.osm graph.bin
+#
+# Every way with a highway tag is used (unless limited with --highways),
+#  with each pair of its consecutive nodes connected in both directions
+#  unless the way is oneway.
+# The graph file layout is described in src/vikroutinggraphengine.c
+#
+# License: CC0
+
+import math
+import struct
+import sys
+import xml.etree.ElementTree as ET
+
+NOT_ROUTABLE = set(['proposed', 'construction', 'abandoned', 'platform', 'elevator', 'raceway'])
+
+def diff_dm(ll1, ll2):
+  # Haversine on the same sphere as a_coords_latlon_diff() (which is not so accurate for short distances)
+  lat1, lon1 = map(math.radians, ll1)
+  lat2, lon2 = map(math.radians, ll2)
+  a = math.sin((lat2-lat1)/2)**2 + math.cos(lat1)*math.cos(lat2)*math.sin((lon2-lon1)/2)**2
+  metres = 2 * 6378137 * math.asin(min(1.0, math.sqrt(a)))
+  # Round up so an edge is never shorter than the straight line
+  return int(math.ceil(metres * 10))
+
+def main(argv):
+  highways = None
+  args = []
+  for arg in argv[1:]:
+    if arg.startswith('--highways='):
+      highways = set(arg[len('--highways='):].split(','))
+    else:
+      args.append(arg)
+  if len(args) != 2:
+    sys.stderr.write('Usage: %s [--highways=motorway,trunk,...] extract.osm graph.bin\n' % argv[0])
+    return 1
+
+  positions = {}
+  ways = []
+  for event, elem in ET.iterparse(args[0], events=('end',)):
+    if elem.tag == 'node':
+      positions[elem.get('id')] = (float(elem.get('lat')), float(elem.get('lon')))
+      elem.clear()
+    elif elem.tag == 'way':
+      tags = dict((tag.get('k'), tag.get('v')) for tag in elem.findall('tag'))
+      highway = tags.get('highway')
+      if highway and highway not in NOT_ROUTABLE and (highways is None or highway in highways):
+        refs = [nd.get('ref') for nd in elem.findall('nd')]
+        oneway = tags.get('oneway', 'no')
+        if tags.get('junction') == 'roundabout' and oneway == 'no':
+          oneway = 'yes'
+        ways.append((refs, oneway))
+      elem.clear()
+
+  # Only the nodes on the ways go in the graph
+  index = {}
+  coords = []
+  adjacency = []
+  def node_index(ref):
+    if ref not in index:
+      index[ref] = len(coords)
+      coords.append(positions[ref])
+      adjacency.append([])
+    return index[ref]
+
+  for refs, oneway in ways:
+    refs = [ref for ref in refs if ref in positions]
+    for a, b in zip(refs, refs[1:]):
+      ia, ib = node_index(a), node_index(b)
+      length = diff_dm(coords[ia], coords[ib])
+      if oneway != '-1':
+        adjacency[ia].append((ib, length))
+      if oneway in ('no', 'false', '0', '-1'):
+        adjacency[ib].append((ia, length))
+
+  edges = sum(len(adj) for adj in adjacency)
+  with open(args[1], 'wb') as out:
+    out.write(b'VIKGRAPH')
+    out.write(struct.pack('<IIII', 1, len(coords), edges, 0))
+    for lat, lon in coords:
+      out.write(struct.pack('<ii', int(round(lat * 1e7)), int(round(lon * 1e7))))
+    offset = 0
+    for adj in adjacency:
+      out.write(struct.pack('<I', offset))
+      offset += len(adj)
+    out.write(struct.pack('<I', offset))
+    for adj in adjacency:
+      for target, length in adj:
+        out.write(struct.pack('<II', target, length))
+
+  sys.stderr.write('%d nodes, %d edges\n' % (len(coords), edges))
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))